@@ -4,6 +4,8 @@
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
 #include "extension/callback/callback.h"
+#include "extension/callback/once_closure.h"
+#include "base/bind.h"
 #include <functional>
 
 EXTENSION_BEGIN_DECLS
@@ -14,6 +16,17 @@ auto InvokeCallback(const std::function<R(Args...)>& f,Args && ... args)->R
 	return f(std::forward<Args>(args)...);
 }
 
+inline void RunOnceClosure(OnceClosure task)
+{
+	task();
+}
+
+// 把 OnceClosure 移进 base::Closure，捕获不拷贝；得到的 base::Closure 只能执行一次
+inline base::Closure ToBaseClosure(OnceClosure task)
+{
+	return base::Bind(&RunOnceClosure, base::Passed(std::move(task)));
+}
+
 EXTENSION_END_DECLS
 
 #endif //__BASE_EXTENSION_BIND_EXTENSION_H__
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "extension/callback/callback.h"
+#include <mutex>
+
+EXTENSION_BEGIN_DECLS
+
+namespace {
+// 每次向系统申请的槽数
+const size_t kWEAK_SLOT_CHUNK = 256;
+
+struct WeakSlotFreeList
+{
+	std::mutex lock_;
+	WeakSlot* head_ = nullptr;
+};
+
+// 槽和链表都不释放：句柄可能比对象甚至比全局对象的析构活得更久，读到的槽内存必须一直有效
+WeakSlotFreeList& GetFreeList()
+{
+	static WeakSlotFreeList* free_list = new WeakSlotFreeList;
+	return *free_list;
+}
+}
+
+WeakSlot* WeakSlotPool::Acquire()
+{
+	WeakSlotFreeList& free_list = GetFreeList();
+	std::lock_guard<std::mutex> auto_lock(free_list.lock_);
+	if (free_list.head_ == nullptr)
+	{
+		WeakSlot* chunk = new WeakSlot[kWEAK_SLOT_CHUNK];
+		for (size_t i = 0; i < kWEAK_SLOT_CHUNK; i++)
+		{
+			chunk[i].generation_.store(0, std::memory_order_relaxed);
+			chunk[i].next_free_ = i + 1 < kWEAK_SLOT_CHUNK ? &chunk[i + 1] : nullptr;
+		}
+		free_list.head_ = chunk;
+	}
+	WeakSlot* slot = free_list.head_;
+	free_list.head_ = slot->next_free_;
+	slot->next_free_ = nullptr;
+	return slot;
+}
+
+void WeakSlotPool::Release(WeakSlot* slot)
+{
+	//release与WeakHandle::expired()的acquire配对
+	slot->generation_.fetch_add(1, std::memory_order_release);
+	WeakSlotFreeList& free_list = GetFreeList();
+	std::lock_guard<std::mutex> auto_lock(free_list.lock_);
+	slot->next_free_ = free_list.head_;
+	free_list.head_ = slot;
+}
+
+EXTENSION_END_DECLS
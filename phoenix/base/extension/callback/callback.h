@@ -2,6 +2,8 @@
 #define BASE_EXTENSION_CALLBACK_H_
 #include "extension/config/build_config.h"
 #include "extension/extension_export.h"
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <functional>
 
@@ -9,23 +11,57 @@ typedef std::function<void(void)> StdClosure;
 
 EXTENSION_BEGIN_DECLS
 
-class EXTENSION_EXPORT WeakFlag
+// 弱引用句柄指向的槽，分配后永不释放，归还后可以被别的对象复用
+// 代数只由持有它的对象递增，对象析构或取消时加一，之前发出的句柄随即失效
+struct WeakSlot
 {
+	std::atomic<uint64_t> generation_;
+	WeakSlot* next_free_;
+};
+
+class EXTENSION_EXPORT WeakSlotPool
+{
+public:
+	static WeakSlot* Acquire();
+	// 递增代数后放回空闲链表
+	static void Release(WeakSlot* slot);
+};
+
+// 槽和代数组成的弱引用句柄，代替std::weak_ptr<WeakFlag>
+// 复制只是两个字的拷贝，检查是一次原子读，不修改任何引用计数；64位的代数不会回绕，槽被复用也不会误判
+// 和weak_ptr::expired()一样，只保证检查时对象未析构，对象需要在执行回调的线程上销毁
+class WeakHandle
+{
+public:
+	WeakHandle() : slot_(nullptr), generation_(0) {}
+	WeakHandle(WeakSlot* slot, uint64_t generation) : slot_(slot), generation_(generation) {}
+
+	bool expired() const
+	{
+		return slot_ == nullptr || slot_->generation_.load(std::memory_order_acquire) != generation_;
+	}
+	void reset()
+	{
+		slot_ = nullptr;
+	}
 
+private:
+	WeakSlot* slot_;
+	uint64_t generation_;
 };
 
 template<typename T>
 class EXTENSION_EXPORT WeakCallback
 {
 public:
-	WeakCallback(const std::weak_ptr<WeakFlag>& weak_flag, const T& t) :
+	WeakCallback(const WeakHandle& weak_flag, const T& t) :
 		weak_flag_(weak_flag),
 		t_(t)
 	{
 
 	}
 
-	WeakCallback(const std::weak_ptr<WeakFlag>& weak_flag, T&& t) :
+	WeakCallback(const WeakHandle& weak_flag, T&& t) :
 		weak_flag_(weak_flag),
 		t_(std::move(t))
 	{
@@ -51,36 +87,50 @@ public:
 	{
 		return weak_flag_.expired();
 	}
-	std::weak_ptr<WeakFlag> weak_flag_;
+	WeakHandle weak_flag_;
 	mutable T t_;
 };
 
 class EXTENSION_EXPORT SupportWeakCallback
 {
 public:
-	typedef std::weak_ptr<WeakFlag> _TyWeakFlag;
+	typedef WeakHandle _TyWeakFlag;
 public:
-	virtual ~SupportWeakCallback(){};
+	SupportWeakCallback() : m_weakSlot(nullptr) {}
+	// 槽属于对象本身，复制出的对象使用自己的槽，不继承原对象发出的句柄
+	SupportWeakCallback(const SupportWeakCallback&) : m_weakSlot(nullptr) {}
+	SupportWeakCallback& operator=(const SupportWeakCallback&) { return *this; }
+	virtual ~SupportWeakCallback()
+	{
+		ReleaseWeakSlot();
+	}
 
+	// 右值会移动进 WeakCallback，只能移动的 lambda 也可以包装，再交给 OnceClosure 投递
 	template<typename CallbackType>
-	auto ToWeakCallback(const CallbackType& closure) const
-		->WeakCallback<CallbackType>
+	auto ToWeakCallback(CallbackType&& closure) const
+		->WeakCallback<typename std::decay<CallbackType>::type>
 	{
-		return WeakCallback<CallbackType>(GetWeakFlag(), closure);
+		return WeakCallback<typename std::decay<CallbackType>::type>(GetWeakFlag(), std::forward<CallbackType>(closure));
 	}
 
-	std::weak_ptr<WeakFlag> GetWeakFlag()const
+	// 第一次调用时分配槽，多个线程同时第一次调用时只有一个槽会被保留
+	WeakHandle GetWeakFlag()const
 	{
-		if (m_weakFlag.use_count() == 0) {
-			m_weakFlag.reset((WeakFlag*)NULL);
+		WeakSlot* slot = m_weakSlot.load(std::memory_order_acquire);
+		if (slot == nullptr) {
+			WeakSlot* acquired = WeakSlotPool::Acquire();
+			if (m_weakSlot.compare_exchange_strong(slot, acquired, std::memory_order_acq_rel))
+				slot = acquired;
+			else
+				WeakSlotPool::Release(acquired);
 		}
-		return m_weakFlag;
+		return WeakHandle(slot, slot->generation_.load(std::memory_order_relaxed));
 	}
 
 private:
-	template<typename ReturnValue, typename... Param, typename WeakFlag>
+	template<typename ReturnValue, typename... Param>
 	static std::function<ReturnValue(Param...)> ConvertToWeakCallback(
-		const std::function<ReturnValue(Param...)>& callback, std::weak_ptr<WeakFlag> expiredFlag)
+		const std::function<ReturnValue(Param...)>& callback, const WeakHandle& expiredFlag)
 	{
 		auto weakCallback = [expiredFlag, callback](Param... p) {
 			if (!expiredFlag.expired()) {
@@ -93,7 +143,16 @@ private:
 	}
 
 protected:
-	mutable std::shared_ptr<WeakFlag> m_weakFlag;
+	// 使已发出的句柄全部失效并归还槽
+	void ReleaseWeakSlot()
+	{
+		WeakSlot* slot = m_weakSlot.exchange(nullptr, std::memory_order_acq_rel);
+		if (slot != nullptr)
+			WeakSlotPool::Release(slot);
+	}
+
+protected:
+	mutable std::atomic<WeakSlot*> m_weakSlot;
 };
 
 //WeakCallbackFlag一般作为类成员变量使用，要继承，可使用不带Cancel()函数的SupportWeakCallback
@@ -105,12 +164,12 @@ class EXTENSION_EXPORT WeakCallbackFlag final : public SupportWeakCallback
 public:
 	void Cancel()
 	{
-		m_weakFlag.reset();
+		ReleaseWeakSlot();
 	}
 
 	bool HasUsed()
 	{
-		return m_weakFlag.use_count() != 0;
+		return m_weakSlot.load(std::memory_order_relaxed) != nullptr;
 	}
 };
 
@@ -118,18 +177,18 @@ public:
 // global function 
 template<class F, class... Args, class = typename std::enable_if<!std::is_member_function_pointer<F>::value>::type>
 auto Bind(F && f, Args && ... args)
-	->decltype(std::bind(f, args...))
+	->decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...))
 {
-	return std::bind(f, args...);
+	return std::bind(std::forward<F>(f), std::forward<Args>(args)...);
 }
 
 // const class member function 
 template<class R, class C, class... DArgs, class P, class... Args>
 auto Bind(R(C::*f)(DArgs...) const, P && p, Args && ... args)
-	->WeakCallback<decltype(std::bind(f, p, args...))>
+	->WeakCallback<decltype(std::bind(f, p, std::forward<Args>(args)...))>
 {
-	std::weak_ptr<WeakFlag> weak_flag = ((SupportWeakCallback*)p)->GetWeakFlag();
-	auto bind_obj = std::bind(f, p, args...);
+	WeakHandle weak_flag = ((SupportWeakCallback*)p)->GetWeakFlag();
+	auto bind_obj = std::bind(f, p, std::forward<Args>(args)...);
 	static_assert(std::is_base_of<NS_EXTENSION::SupportWeakCallback, C>::value, "NS_EXTENSION::SupportWeakCallback should be base of C");
 	WeakCallback<decltype(bind_obj)> weak_callback(weak_flag, std::move(bind_obj));
 	return weak_callback;
@@ -138,10 +197,10 @@ auto Bind(R(C::*f)(DArgs...) const, P && p, Args && ... args)
 // non-const class member function 
 template<class R, class C, class... DArgs, class P, class... Args>
 auto Bind(R(C::*f)(DArgs...), P && p, Args && ... args) 
-	->WeakCallback<decltype(std::bind(f, p, args...))>
+	->WeakCallback<decltype(std::bind(f, p, std::forward<Args>(args)...))>
 {
-	std::weak_ptr<WeakFlag> weak_flag = ((SupportWeakCallback*)p)->GetWeakFlag();
-	auto bind_obj = std::bind(f, p, args...);
+	WeakHandle weak_flag = ((SupportWeakCallback*)p)->GetWeakFlag();
+	auto bind_obj = std::bind(f, p, std::forward<Args>(args)...);
 	static_assert(std::is_base_of<NS_EXTENSION::SupportWeakCallback, C>::value, "NS_EXTENSION::SupportWeakCallback should be base of C");
 	WeakCallback<decltype(bind_obj)> weak_callback(weak_flag, std::move(bind_obj));
 	return weak_callback;
@@ -0,0 +1,200 @@
+#include "extension/callback/cancellation_token.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include "base/lazy_instance.h"
+#include "base/threading/thread_local.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 当前线程上 CancellationScope 设置的令牌
+base::LazyInstance<base::ThreadLocalPointer<const CancellationToken>>::Leaky lazy_current_token = LAZY_INSTANCE_INITIALIZER;
+}
+
+class CancellationState
+{
+public:
+	explicit CancellationState(TimeTicks deadline)
+		: cancelled_(false)
+		, deadline_(deadline)
+		, next_id_(1)
+		, parent_callback_id_(0) {}
+
+	~CancellationState()
+	{
+		std::shared_ptr<CancellationState> parent = parent_.lock();
+		if (parent)
+			parent->RemoveCallback(parent_callback_id_);
+	}
+
+	bool IsCancelled() const
+	{
+		if (cancelled_.load(std::memory_order_acquire))
+			return true;
+		return !deadline_.is_null() && TimeTicks::Now() >= deadline_;
+	}
+
+	void Cancel()
+	{
+		if (cancelled_.exchange(true, std::memory_order_acq_rel))
+			return;
+		std::map<CancellationToken::CallbackID, StdClosure> callbacks;
+		{
+			std::lock_guard<std::mutex> auto_lock(lock_);
+			callbacks.swap(callbacks_);
+		}
+		// 回调在锁外执行，其中可以创建、取消别的令牌
+		for (auto &callback : callbacks)
+			callback.second();
+	}
+
+	CancellationToken::CallbackID AddCallback(const StdClosure &callback)
+	{
+		{
+			std::lock_guard<std::mutex> auto_lock(lock_);
+			//Cancel 先置标记再取走回调，标记已置位时回调可能已被取走，直接执行
+			if (!cancelled_.load(std::memory_order_acquire))
+			{
+				CancellationToken::CallbackID id = next_id_++;
+				callbacks_[id] = callback;
+				return id;
+			}
+		}
+		callback();
+		return 0;
+	}
+
+	void RemoveCallback(CancellationToken::CallbackID id)
+	{
+		// 回调捕获的对象可能持有本令牌的子令牌，在锁外析构，以免子令牌析构时重入锁
+		StdClosure callback;
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		auto it = callbacks_.find(id);
+		if (it == callbacks_.end())
+			return;
+		callback.swap(it->second);
+		callbacks_.erase(it);
+	}
+
+	// 子令牌挂在父令牌的取消回调上，子令牌先销毁时从父令牌中摘除
+	void AttachTo(const std::shared_ptr<CancellationState> &parent, const std::weak_ptr<CancellationState> &self)
+	{
+		parent_ = parent;
+		parent_callback_id_ = parent->AddCallback([self]() {
+			std::shared_ptr<CancellationState> child = self.lock();
+			if (child)
+				child->Cancel();
+		});
+	}
+
+	TimeTicks deadline() const { return deadline_; }
+
+private:
+	std::atomic<bool> cancelled_;
+	const TimeTicks deadline_;
+	std::mutex lock_;
+	std::map<CancellationToken::CallbackID, StdClosure> callbacks_;
+	CancellationToken::CallbackID next_id_;
+	std::weak_ptr<CancellationState> parent_;
+	CancellationToken::CallbackID parent_callback_id_;
+};
+
+CancellationToken CancellationToken::Create()
+{
+	return CancellationToken(std::make_shared<CancellationState>(TimeTicks()));
+}
+
+CancellationToken CancellationToken::WithTimeout(TimeDelta timeout)
+{
+	return WithDeadline(TimeTicks::Now() + timeout);
+}
+
+CancellationToken CancellationToken::WithDeadline(TimeTicks deadline)
+{
+	return CancellationToken(std::make_shared<CancellationState>(deadline));
+}
+
+CancellationToken CancellationToken::Current()
+{
+	const CancellationToken *current = lazy_current_token.Pointer()->Get();
+	return current != nullptr ? *current : CancellationToken();
+}
+
+CancellationToken CancellationToken::CreateChild() const
+{
+	if (!state_)
+		return Create();
+	auto state = std::make_shared<CancellationState>(state_->deadline());
+	state->AttachTo(state_, state);
+	return CancellationToken(state);
+}
+
+CancellationToken CancellationToken::CreateChild(TimeDelta timeout) const
+{
+	TimeTicks deadline = TimeTicks::Now() + timeout;
+	if (!state_)
+		return WithDeadline(deadline);
+	if (!state_->deadline().is_null() && state_->deadline() < deadline)
+		deadline = state_->deadline();
+	auto state = std::make_shared<CancellationState>(deadline);
+	state->AttachTo(state_, state);
+	return CancellationToken(state);
+}
+
+void CancellationToken::Cancel() const
+{
+	if (state_)
+		state_->Cancel();
+}
+
+bool CancellationToken::IsCancelled() const
+{
+	return state_ && state_->IsCancelled();
+}
+
+bool CancellationToken::HasDeadline() const
+{
+	return state_ && !state_->deadline().is_null();
+}
+
+TimeTicks CancellationToken::GetDeadline() const
+{
+	return state_ ? state_->deadline() : TimeTicks();
+}
+
+TimeDelta CancellationToken::GetRemainingTime() const
+{
+	if (!HasDeadline())
+		return TimeDelta::Max();
+	TimeDelta remaining = state_->deadline() - TimeTicks::Now();
+	return remaining > TimeDelta() ? remaining : TimeDelta();
+}
+
+CancellationToken::CallbackID CancellationToken::AddCancelCallback(const StdClosure &callback) const
+{
+	if (!state_)
+		return 0;
+	return state_->AddCallback(callback);
+}
+
+void CancellationToken::RemoveCancelCallback(CallbackID id) const
+{
+	if (state_ && id != 0)
+		state_->RemoveCallback(id);
+}
+
+CancellationScope::CancellationScope(const CancellationToken &token)
+	: token_(token)
+	, previous_(lazy_current_token.Pointer()->Get())
+{
+	lazy_current_token.Pointer()->Set(&token_);
+}
+
+CancellationScope::~CancellationScope()
+{
+	lazy_current_token.Pointer()->Set(previous_);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,130 @@
+// cancellation tokens with deadlines shared by tasks, HTTP requests and database queries
+
+#ifndef __BASE_EXTENSION_CANCELLATION_TOKEN_H__
+#define __BASE_EXTENSION_CANCELLATION_TOKEN_H__
+
+#include "extension/config/build_config.h"
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "extension/callback/callback.h"
+#include "extension/time/time.h"
+
+#include "extension/extension_export.h"
+
+EXTENSION_BEGIN_DECLS
+
+class CancellationState;
+template<typename T>
+class CancellableCallback;
+
+// 取消令牌：一次用户操作（如打开一个页面）派生出的任务、HTTP 请求和数据库查询共用一个令牌，
+// 操作放弃时调用 Cancel()，还没执行的任务被跳过，进行中的请求被移除，正在执行的查询被中断。
+// 令牌可以带截止时间，到期后 IsCancelled() 返回 true；截止时间是被动检查的，到期不会触发取消回调，
+// HTTP 请求把剩余时间换算为 CURLOPT_TIMEOUT_MS，数据库查询在进度回调中检查。
+// 子令牌随父令牌一起取消，截止时间不晚于父令牌；取消子令牌不影响父令牌。
+// 复制只增加引用计数，所有副本共享同一状态；默认构造的空令牌永远不会取消。线程安全
+class EXTENSION_EXPORT CancellationToken
+{
+public:
+	using CallbackID = uint64_t;
+
+	CancellationToken() {}
+
+	static CancellationToken Create();
+	static CancellationToken WithTimeout(TimeDelta timeout);
+	static CancellationToken WithDeadline(TimeTicks deadline);
+	// 当前线程正在执行的 Wrap 包装的任务所带的令牌，没有时为空令牌，用于把令牌传递给任务中发起的后续工作
+	static CancellationToken Current();
+
+	// 空令牌的子令牌是一个独立的新令牌
+	CancellationToken CreateChild() const;
+	CancellationToken CreateChild(TimeDelta timeout) const;
+
+	bool IsValid() const { return !!state_; }
+	// 标记为已取消，在当前线程上依次执行取消回调，再取消子令牌；重复调用什么也不做
+	void Cancel() const;
+	// 已取消或已过截止时间
+	bool IsCancelled() const;
+	bool HasDeadline() const;
+	// 没有截止时间时为 TimeTicks()
+	TimeTicks GetDeadline() const;
+	// 到截止时间的剩余时间，已过期时为 0，没有截止时间时为 TimeDelta::Max()
+	TimeDelta GetRemainingTime() const;
+
+	// 令牌已取消时立即在当前线程执行 callback 并返回 0；回调中不要再调用同一令牌的 Add/RemoveCancelCallback
+	CallbackID AddCancelCallback(const StdClosure &callback) const;
+	// 返回后回调不会再开始执行，但可能正在另一个线程上执行
+	void RemoveCancelCallback(CallbackID id) const;
+
+	// 执行前检查令牌，已取消则跳过；执行期间令牌设为 Current()
+	template<typename CallbackType>
+	auto Wrap(CallbackType &&closure) const
+		->CancellableCallback<typename std::decay<CallbackType>::type>
+	{
+		return CancellableCallback<typename std::decay<CallbackType>::type>(*this, std::forward<CallbackType>(closure));
+	}
+
+private:
+	explicit CancellationToken(const std::shared_ptr<CancellationState> &state) : state_(state) {}
+
+	std::shared_ptr<CancellationState> state_;
+};
+
+// 在作用域内把 token 设为当前线程的 CancellationToken::Current()，退出时恢复原来的令牌
+class EXTENSION_EXPORT CancellationScope
+{
+public:
+	explicit CancellationScope(const CancellationToken &token);
+	~CancellationScope();
+
+	CancellationScope(const CancellationScope &) = delete;
+	CancellationScope& operator=(const CancellationScope &) = delete;
+
+private:
+	CancellationToken token_;
+	const CancellationToken *previous_;
+};
+
+template<typename T>
+class CancellableCallback
+{
+public:
+	CancellableCallback(const CancellationToken &token, const T &t) :
+		token_(token),
+		t_(t)
+	{
+
+	}
+
+	CancellableCallback(const CancellationToken &token, T &&t) :
+		token_(token),
+		t_(std::move(t))
+	{
+
+	}
+
+	template<class... Args>
+	auto operator ()(Args && ... args) const
+	{
+		if (!token_.IsCancelled()) {
+			CancellationScope scope(token_);
+			return t_(std::forward<Args>(args)...);
+		}
+		return decltype(t_(std::forward<Args>(args)...))();
+	}
+	bool Cancelled() const
+	{
+		return token_.IsCancelled();
+	}
+
+private:
+	CancellationToken token_;
+	mutable T t_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_CANCELLATION_TOKEN_H__
@@ -1,76 +1,136 @@
 #include "extension/callback/post_task.h"
+#include "extension/callback/bind_extension.h"
 #include "extension/thread/thread_manager.h"
 #include "base/bind.h"
 
 EXTENSION_BEGIN_DECLS
 
-bool PostTask(const StdClosure &task)
+bool PostTask(OnceClosure task)
 {
-	return NS_EXTENSION::ThreadManager::PostTask(task);
+	return NS_EXTENSION::ThreadManager::PostTask(std::move(task));
 }
-bool PostTask(int64_t identifier, const StdClosure &task)
+bool PostTask(int64_t identifier, OnceClosure task)
 {
-	return NS_EXTENSION::ThreadManager::PostTask(identifier,task);
+	return NS_EXTENSION::ThreadManager::PostTask(identifier,std::move(task));
 }
-bool PostTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task)
+bool PostTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task)
 {
 	DCHECK(!!task_runner);
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToBaseClosure(std::move(task));
 	task_runner->PostTask(from_here, closure);
 	return true;
 }
 
-bool PostDelayedTask(const StdClosure &task, TimeDelta delay)
+bool PostTask(OnceClosure task, TaskPriority priority)
 {
-	return NS_EXTENSION::ThreadManager::PostDelayedTask(task,delay);
+	return NS_EXTENSION::ThreadManager::PostTask(std::move(task), priority);
 }
-bool PostDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay)
+bool PostTask(int64_t identifier, OnceClosure task, TaskPriority priority)
 {
-	return NS_EXTENSION::ThreadManager::PostDelayedTask(identifier,task,delay);
+	return NS_EXTENSION::ThreadManager::PostTask(identifier, std::move(task), priority);
 }
 
-bool PostDelayedTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task, TimeDelta delay)
+bool PostTask(OnceClosure task, const CancellationToken& token)
+{
+	return NS_EXTENSION::ThreadManager::PostTask(token.Wrap(std::move(task)));
+}
+bool PostTask(int64_t identifier, OnceClosure task, const CancellationToken& token)
+{
+	return NS_EXTENSION::ThreadManager::PostTask(identifier, token.Wrap(std::move(task)));
+}
+
+bool PostIdleTask(IdleTask task, TimeDelta timeout)
+{
+	return NS_EXTENSION::ThreadManager::PostIdleTask(std::move(task), timeout);
+}
+bool PostIdleTask(int64_t identifier, IdleTask task, TimeDelta timeout)
+{
+	return NS_EXTENSION::ThreadManager::PostIdleTask(identifier, std::move(task), timeout);
+}
+
+bool PostDelayedTask(OnceClosure task, TimeDelta delay)
+{
+	return NS_EXTENSION::ThreadManager::PostDelayedTask(std::move(task),delay);
+}
+bool PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay)
+{
+	return NS_EXTENSION::ThreadManager::PostDelayedTask(identifier,std::move(task),delay);
+}
+
+bool PostDelayedTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task, TimeDelta delay)
 {
 	DCHECK(!!task_runner);
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToBaseClosure(std::move(task));
 	task_runner->PostDelayedTask(from_here, closure,delay);
 	return true;
 }
-bool PostNonNestableTask(const StdClosure &task)
+bool PostDelayedTask(OnceClosure task, TimeDelta delay, const CancellationToken& token)
 {
-	return NS_EXTENSION::ThreadManager::PostNonNestableTask(task);
+	return NS_EXTENSION::ThreadManager::PostDelayedTask(token.Wrap(std::move(task)), delay);
 }
-bool PostNonNestableTask(int64_t identifier, const StdClosure &task)
+bool PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay, const CancellationToken& token)
 {
-	return NS_EXTENSION::ThreadManager::PostNonNestableTask(identifier,task);
+	return NS_EXTENSION::ThreadManager::PostDelayedTask(identifier, token.Wrap(std::move(task)), delay);
+}
+bool PostNonNestableTask(OnceClosure task)
+{
+	return NS_EXTENSION::ThreadManager::PostNonNestableTask(std::move(task));
+}
+bool PostNonNestableTask(int64_t identifier, OnceClosure task)
+{
+	return NS_EXTENSION::ThreadManager::PostNonNestableTask(identifier,std::move(task));
 }
 
-bool PostNonNestableTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task)
+bool PostNonNestableTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task)
 {
 	DCHECK(!!task_runner);
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToBaseClosure(std::move(task));
 	task_runner->PostNonNestableTask(from_here, closure);
 	return true;
 }
-bool PostNonNestableDelayedTask(const StdClosure &task, TimeDelta delay)
+bool PostNonNestableDelayedTask(OnceClosure task, TimeDelta delay)
 {
-	return NS_EXTENSION::ThreadManager::PostNonNestableDelayedTask(task,delay);
+	return NS_EXTENSION::ThreadManager::PostNonNestableDelayedTask(std::move(task),delay);
 }
-bool PostNonNestableDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay)
+bool PostNonNestableDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay)
 {
-	return NS_EXTENSION::ThreadManager::PostNonNestableDelayedTask(identifier,task,delay);
+	return NS_EXTENSION::ThreadManager::PostNonNestableDelayedTask(identifier,std::move(task),delay);
 }
-bool PostNonNestableDelayedTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task, TimeDelta delay)
+bool PostNonNestableDelayedTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task, TimeDelta delay)
 {
 	DCHECK(!!task_runner);
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToBaseClosure(std::move(task));
 	task_runner->PostNonNestableDelayedTask(from_here, closure,delay);
 	return true;
 }
 
-bool PostTaskAndReply(int64_t identifier, const StdClosure &task, const StdClosure &reply)
+bool PostTaskAndReply(int64_t identifier, OnceClosure task, OnceClosure reply)
+{
+	return NS_EXTENSION::ThreadManager::PostTaskAndReply(identifier,std::move(task),std::move(reply));
+}
+bool PostTasks(std::vector<OnceClosure> tasks)
+{
+	return NS_EXTENSION::ThreadManager::PostTasks(std::move(tasks));
+}
+bool PostTasks(int64_t identifier, std::vector<OnceClosure> tasks)
+{
+	return NS_EXTENSION::ThreadManager::PostTasks(identifier,std::move(tasks));
+}
+bool PostCoalescedTask(const std::string &key, OnceClosure task)
+{
+	return NS_EXTENSION::ThreadManager::PostCoalescedTask(key,std::move(task));
+}
+bool PostCoalescedTask(int64_t identifier, const std::string &key, OnceClosure task)
+{
+	return NS_EXTENSION::ThreadManager::PostCoalescedTask(identifier,key,std::move(task));
+}
+bool PostParallelTask(OnceClosure task)
+{
+	return NS_EXTENSION::ThreadManager::PostParallelTask(std::move(task));
+}
+bool PostParallelTaskAndReply(OnceClosure task, OnceClosure reply)
 {
-	return NS_EXTENSION::ThreadManager::PostTaskAndReply(identifier,task,reply);
+	return NS_EXTENSION::ThreadManager::PostParallelTaskAndReply(std::move(task),std::move(reply));
 }
 
 
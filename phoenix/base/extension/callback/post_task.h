@@ -4,27 +4,52 @@
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
 #include "extension/callback/callback.h"
+#include "extension/callback/cancellation_token.h"
+#include "extension/callback/once_closure.h"
+#include "extension/thread/thread_options.h"
 #include "google_base/base/single_thread_task_runner.h"
+#include <string>
+#include <vector>
 
 EXTENSION_BEGIN_DECLS
 
-EXTENSION_EXPORT bool PostTask(const StdClosure &task);
-EXTENSION_EXPORT bool PostTask(int64_t identifier, const StdClosure &task);
-EXTENSION_EXPORT bool PostTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task);
+EXTENSION_EXPORT bool PostTask(OnceClosure task);
+EXTENSION_EXPORT bool PostTask(int64_t identifier, OnceClosure task);
+EXTENSION_EXPORT bool PostTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task);
+EXTENSION_EXPORT bool PostTask(OnceClosure task, TaskPriority priority);
+EXTENSION_EXPORT bool PostTask(int64_t identifier, OnceClosure task, TaskPriority priority);
 
-EXTENSION_EXPORT bool PostDelayedTask(const StdClosure &task, TimeDelta delay);
-EXTENSION_EXPORT bool PostDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay);
-EXTENSION_EXPORT bool PostDelayedTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task, TimeDelta delay);
+// token 已取消或已过截止时间时跳过任务，执行期间 token 为 CancellationToken::Current()
+EXTENSION_EXPORT bool PostTask(OnceClosure task, const CancellationToken& token);
+EXTENSION_EXPORT bool PostTask(int64_t identifier, OnceClosure task, const CancellationToken& token);
 
-EXTENSION_EXPORT bool PostNonNestableTask(const StdClosure &task);
-EXTENSION_EXPORT bool PostNonNestableTask(int64_t identifier, const StdClosure &task);
-EXTENSION_EXPORT bool PostNonNestableTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task);
+EXTENSION_EXPORT bool PostIdleTask(IdleTask task, TimeDelta timeout = TimeDelta());
+EXTENSION_EXPORT bool PostIdleTask(int64_t identifier, IdleTask task, TimeDelta timeout = TimeDelta());
 
-EXTENSION_EXPORT bool PostNonNestableDelayedTask(const StdClosure &task, TimeDelta delay);
-EXTENSION_EXPORT bool PostNonNestableDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay);
-EXTENSION_EXPORT bool PostNonNestableDelayedTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, const StdClosure &task, TimeDelta delay);
+EXTENSION_EXPORT bool PostDelayedTask(OnceClosure task, TimeDelta delay);
+EXTENSION_EXPORT bool PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay);
+EXTENSION_EXPORT bool PostDelayedTask(TaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task, TimeDelta delay);
+EXTENSION_EXPORT bool PostDelayedTask(OnceClosure task, TimeDelta delay, const CancellationToken& token);
+EXTENSION_EXPORT bool PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay, const CancellationToken& token);
 
-EXTENSION_EXPORT bool PostTaskAndReply(int64_t identifier, const StdClosure &task, const StdClosure &reply);
+EXTENSION_EXPORT bool PostNonNestableTask(OnceClosure task);
+EXTENSION_EXPORT bool PostNonNestableTask(int64_t identifier, OnceClosure task);
+EXTENSION_EXPORT bool PostNonNestableTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task);
+
+EXTENSION_EXPORT bool PostNonNestableDelayedTask(OnceClosure task, TimeDelta delay);
+EXTENSION_EXPORT bool PostNonNestableDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay);
+EXTENSION_EXPORT bool PostNonNestableDelayedTask(SingleThreadTaskRunner* task_runner, const tracked_objects::Location& from_here, OnceClosure task, TimeDelta delay);
+
+EXTENSION_EXPORT bool PostTaskAndReply(int64_t identifier, OnceClosure task, OnceClosure reply);
+
+EXTENSION_EXPORT bool PostTasks(std::vector<OnceClosure> tasks);
+EXTENSION_EXPORT bool PostTasks(int64_t identifier, std::vector<OnceClosure> tasks);
+
+EXTENSION_EXPORT bool PostCoalescedTask(const std::string &key, OnceClosure task);
+EXTENSION_EXPORT bool PostCoalescedTask(int64_t identifier, const std::string &key, OnceClosure task);
+
+EXTENSION_EXPORT bool PostParallelTask(OnceClosure task);
+EXTENSION_EXPORT bool PostParallelTaskAndReply(OnceClosure task, OnceClosure reply);
 
 
 EXTENSION_END_DECLS
@@ -0,0 +1,451 @@
+// open-addressing hash map and set stored in one flat array
+
+#ifndef __BASE_EXTENSION_FLAT_HASH_MAP_H__
+#define __BASE_EXTENSION_FLAT_HASH_MAP_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <utility>
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal {
+
+// 整数的 std::hash 是恒等映射，直接取低位时步长为 2 的幂的 id 会落进同一串槽，先乘黄金分割常数打散
+inline size_t MixFlatHash(size_t hash)
+{
+	uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+	return (size_t)(mixed ^ (mixed >> 32));
+}
+
+// FlatHashMap / FlatHashSet 共用的线性探测表。
+// 元素直接存放在一块连续数组中，另有一个每槽 1 字节的状态数组；删除只把状态标成 kDeleted，
+// 不移动其他元素，遍历时删除当前元素是安全的；墓碑在扩容或重建时清除。
+template<typename Value, typename Key, typename KeyOf, typename Hash, typename KeyEqual>
+class FlatHashTable
+{
+public:
+	typedef Value value_type;
+	typedef Key key_type;
+	typedef size_t size_type;
+
+	enum : uint8_t { kEmpty = 0, kFull = 1, kDeleted = 2 };
+
+	template<bool Const>
+	class Iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef typename FlatHashTable::value_type value_type;
+		typedef ptrdiff_t difference_type;
+		typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+		typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+
+		Iterator() : state_(nullptr), slot_(nullptr) {}
+		// 非 const 迭代器可以转换为 const 迭代器
+		template<bool OtherConst, class = typename std::enable_if<Const && !OtherConst>::type>
+		Iterator(const Iterator<OtherConst>& other) : state_(other.state_), slot_(other.slot_) {}
+
+		reference operator*() const { return *slot_; }
+		pointer operator->() const { return slot_; }
+		Iterator& operator++()
+		{
+			// 状态数组末尾有一个 kFull 的哨兵，不需要比较边界
+			do {
+				++state_;
+				++slot_;
+			} while (*state_ != kFull);
+			return *this;
+		}
+		Iterator operator++(int)
+		{
+			Iterator it = *this;
+			++*this;
+			return it;
+		}
+		template<bool OtherConst>
+		bool operator==(const Iterator<OtherConst>& other) const { return state_ == other.state_; }
+		template<bool OtherConst>
+		bool operator!=(const Iterator<OtherConst>& other) const { return state_ != other.state_; }
+
+	private:
+		friend class FlatHashTable;
+		template<bool> friend class Iterator;
+		Iterator(const uint8_t* state, value_type* slot) : state_(state), slot_(slot) {}
+
+		const uint8_t* state_;
+		value_type* slot_;
+	};
+	typedef Iterator<false> iterator;
+	typedef Iterator<true> const_iterator;
+
+	FlatHashTable() : slots_(nullptr), states_(nullptr), capacity_(0), size_(0), used_(0) {}
+	FlatHashTable(const FlatHashTable& other) : FlatHashTable()
+	{
+		Reserve(other.size_);
+		for (const_iterator it = other.begin(); it != other.end(); ++it)
+			InsertUnique(*it);
+	}
+	FlatHashTable(FlatHashTable&& other) noexcept : FlatHashTable()
+	{
+		Swap(other);
+	}
+	FlatHashTable& operator=(const FlatHashTable& other)
+	{
+		if (this != &other)
+		{
+			FlatHashTable copy(other);
+			Swap(copy);
+		}
+		return *this;
+	}
+	FlatHashTable& operator=(FlatHashTable&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			Swap(other);
+		}
+		return *this;
+	}
+	~FlatHashTable() { Release(); }
+
+	iterator begin() { return iterator(FirstFull(), slots_ + (FirstFull() - states_)); }
+	iterator end() { return iterator(states_ + capacity_, slots_ + capacity_); }
+	const_iterator begin() const { return const_cast<FlatHashTable*>(this)->begin(); }
+	const_iterator end() const { return const_cast<FlatHashTable*>(this)->end(); }
+
+	size_type size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	size_type capacity() const { return capacity_; }
+
+	// 保留容量，之后插入 count 个元素不会重建
+	void Reserve(size_type count)
+	{
+		size_type capacity = CapacityFor(count);
+		if (capacity > capacity_)
+			Rehash(capacity);
+	}
+
+	void Clear()
+	{
+		for (size_type i = 0; i < capacity_; i++)
+		{
+			if (states_[i] == kFull)
+				slots_[i].~value_type();
+			states_[i] = kEmpty;
+		}
+		size_ = 0;
+		used_ = 0;
+	}
+
+	iterator Find(const key_type& key)
+	{
+		if (size_ == 0)
+			return end();
+		size_type mask = capacity_ - 1;
+		for (size_type i = MixFlatHash(hash_(key)) & mask;; i = (i + 1) & mask)
+		{
+			if (states_[i] == kEmpty)
+				return end();
+			if (states_[i] == kFull && equal_(KeyOf()(slots_[i]), key))
+				return iterator(states_ + i, slots_ + i);
+		}
+	}
+	const_iterator Find(const key_type& key) const { return const_cast<FlatHashTable*>(this)->Find(key); }
+
+	// key 不存在时用 args 在空槽上构造元素，存在时什么也不做
+	template<typename... Args>
+	std::pair<iterator, bool> EmplaceKey(const key_type& key, Args&&... args)
+	{
+		iterator it = Find(key);
+		if (it != end())
+			return std::make_pair(it, false);
+		ReserveOneMore();
+		size_type index = FreeSlotFor(key);
+		new (slots_ + index) value_type(std::forward<Args>(args)...);
+		MarkFull(index);
+		return std::make_pair(iterator(states_ + index, slots_ + index), true);
+	}
+
+	size_type Erase(const key_type& key)
+	{
+		iterator it = Find(key);
+		if (it == end())
+			return 0;
+		Erase(it);
+		return 1;
+	}
+	// 返回下一个元素
+	iterator Erase(const_iterator pos)
+	{
+		size_type index = pos.state_ - states_;
+		slots_[index].~value_type();
+		size_--;
+		// 后一个槽为空时探测链在这里就断开了，不需要墓碑
+		if (states_[(index + 1) & (capacity_ - 1)] == kEmpty)
+		{
+			states_[index] = kEmpty;
+			used_--;
+		}
+		else
+		{
+			states_[index] = kDeleted;
+		}
+		iterator next(states_ + index, slots_ + index);
+		++next;
+		return next;
+	}
+
+	void Swap(FlatHashTable& other) noexcept
+	{
+		std::swap(slots_, other.slots_);
+		std::swap(states_, other.states_);
+		std::swap(capacity_, other.capacity_);
+		std::swap(size_, other.size_);
+		std::swap(used_, other.used_);
+	}
+
+private:
+	// 最大装载率 7/8，墓碑也计入
+	static bool OverLoaded(size_type used, size_type capacity) { return used * 8 > capacity * 7; }
+	static size_type CapacityFor(size_type count)
+	{
+		size_type capacity = 8;
+		while (OverLoaded(count, capacity))
+			capacity *= 2;
+		return capacity;
+	}
+
+	const uint8_t* FirstFull() const
+	{
+		if (states_ == nullptr)
+			return nullptr;
+		const uint8_t* state = states_;
+		while (*state != kFull)
+			++state;
+		return state;
+	}
+
+	void ReserveOneMore()
+	{
+		if (capacity_ != 0 && !OverLoaded(used_ + 1, capacity_))
+			return;
+		// 满载主要是墓碑造成的（元素不到一半）时按原容量重建，清掉墓碑即可
+		size_type capacity = capacity_ == 0 ? CapacityFor(1) : capacity_;
+		if (OverLoaded((size_ + 1) * 2, capacity))
+			capacity *= 2;
+		Rehash(capacity);
+	}
+
+	// 调用前 key 已确认不存在，且至少有一个空槽
+	size_type FreeSlotFor(const key_type& key) const
+	{
+		size_type mask = capacity_ - 1;
+		size_type i = MixFlatHash(hash_(key)) & mask;
+		while (states_[i] == kFull)
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	void MarkFull(size_type index)
+	{
+		if (states_[index] == kEmpty)
+			used_++;
+		states_[index] = kFull;
+		size_++;
+	}
+
+	void InsertUnique(const value_type& value)
+	{
+		ReserveOneMore();
+		size_type index = FreeSlotFor(KeyOf()(value));
+		new (slots_ + index) value_type(value);
+		MarkFull(index);
+	}
+
+	void Rehash(size_type capacity)
+	{
+		value_type* old_slots = slots_;
+		uint8_t* old_states = states_;
+		size_type old_capacity = capacity_;
+
+		slots_ = static_cast<value_type*>(::operator new(sizeof(value_type) * capacity));
+		states_ = new uint8_t[capacity + 1]();
+		states_[capacity] = kFull;
+		capacity_ = capacity;
+		size_ = 0;
+		used_ = 0;
+		for (size_type i = 0; i < old_capacity; i++)
+		{
+			if (old_states[i] != kFull)
+				continue;
+			size_type index = FreeSlotFor(KeyOf()(old_slots[i]));
+			new (slots_ + index) value_type(std::move(old_slots[i]));
+			MarkFull(index);
+			old_slots[i].~value_type();
+		}
+		::operator delete(old_slots);
+		delete[] old_states;
+	}
+
+	void Release()
+	{
+		if (states_ == nullptr)
+			return;
+		Clear();
+		::operator delete(slots_);
+		delete[] states_;
+		slots_ = nullptr;
+		states_ = nullptr;
+		capacity_ = 0;
+	}
+
+	value_type* slots_;
+	uint8_t* states_;		// capacity_ + 1 个，最后一个是哨兵
+	size_type capacity_;	// 0 或 2 的幂
+	size_type size_;
+	size_type used_;		// 元素和墓碑的个数
+	Hash hash_;
+	KeyEqual equal_;
+};
+
+template<typename Pair>
+struct FlatPairKey
+{
+	const typename Pair::first_type& operator()(const Pair& value) const { return value.first; }
+};
+
+template<typename Key>
+struct FlatIdentityKey
+{
+	const Key& operator()(const Key& value) const { return value; }
+};
+
+} // namespace internal
+
+// 开放寻址（线性探测）的哈希表，接口是 std::unordered_map 的常用子集。
+// 元素存放在一块连续数组中，插入不为每个元素分配节点，查找只访问相邻的几个槽；
+// 适合 id 到请求、线程这类频繁增删查的小对象映射。
+// 与 std::unordered_map 的区别：
+// 1. 插入可能重建整张表，所有迭代器、指针、引用随之失效；删除只使被删的元素失效；
+// 2. 元素在重建时被移动（key 被复制），key 和 value 都应当可以廉价地复制/移动且不抛异常；
+// 3. 遍历顺序与插入顺序无关，重建后也会变化。
+// 不是线程安全的
+template<typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap
+{
+	typedef std::pair<const Key, T> Pair;
+	typedef internal::FlatHashTable<Pair, Key, internal::FlatPairKey<Pair>, Hash, KeyEqual> Table;
+
+public:
+	typedef Key key_type;
+	typedef T mapped_type;
+	typedef Pair value_type;
+	typedef size_t size_type;
+	typedef typename Table::iterator iterator;
+	typedef typename Table::const_iterator const_iterator;
+
+	FlatHashMap() {}
+
+	iterator begin() { return table_.begin(); }
+	iterator end() { return table_.end(); }
+	const_iterator begin() const { return table_.begin(); }
+	const_iterator end() const { return table_.end(); }
+
+	size_type size() const { return table_.size(); }
+	bool empty() const { return table_.empty(); }
+	void reserve(size_type count) { table_.Reserve(count); }
+	void clear() { table_.Clear(); }
+	void swap(FlatHashMap& other) noexcept { table_.Swap(other.table_); }
+
+	iterator find(const key_type& key) { return table_.Find(key); }
+	const_iterator find(const key_type& key) const { return table_.Find(key); }
+	size_type count(const key_type& key) const { return table_.Find(key) != table_.end() ? 1 : 0; }
+
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+	{
+		return table_.EmplaceKey(key, std::piecewise_construct, std::forward_as_tuple(key),
+			std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+	std::pair<iterator, bool> insert(const value_type& value)
+	{
+		return table_.EmplaceKey(value.first, value);
+	}
+	std::pair<iterator, bool> insert(value_type&& value)
+	{
+		const key_type key = value.first;
+		return table_.EmplaceKey(key, std::move(value));
+	}
+	template<typename K, typename V>
+	std::pair<iterator, bool> emplace(K&& key, V&& value)
+	{
+		return try_emplace(key_type(std::forward<K>(key)), std::forward<V>(value));
+	}
+	mapped_type& operator[](const key_type& key)
+	{
+		return try_emplace(key).first->second;
+	}
+
+	size_type erase(const key_type& key) { return table_.Erase(key); }
+	iterator erase(const_iterator pos) { return table_.Erase(pos); }
+	iterator erase(iterator pos) { return table_.Erase(pos); }
+
+private:
+	Table table_;
+};
+
+// 开放寻址的哈希集合，特性同 FlatHashMap；元素只能通过 const 引用访问
+template<typename Key, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashSet
+{
+	typedef internal::FlatHashTable<Key, Key, internal::FlatIdentityKey<Key>, Hash, KeyEqual> Table;
+
+public:
+	typedef Key key_type;
+	typedef Key value_type;
+	typedef size_t size_type;
+	typedef typename Table::const_iterator iterator;
+	typedef typename Table::const_iterator const_iterator;
+
+	FlatHashSet() {}
+
+	const_iterator begin() const { return table_.begin(); }
+	const_iterator end() const { return table_.end(); }
+
+	size_type size() const { return table_.size(); }
+	bool empty() const { return table_.empty(); }
+	void reserve(size_type count) { table_.Reserve(count); }
+	void clear() { table_.Clear(); }
+	void swap(FlatHashSet& other) noexcept { table_.Swap(other.table_); }
+
+	const_iterator find(const key_type& key) const { return table_.Find(key); }
+	size_type count(const key_type& key) const { return table_.Find(key) != table_.end() ? 1 : 0; }
+
+	std::pair<const_iterator, bool> insert(const value_type& value)
+	{
+		return table_.EmplaceKey(value, value);
+	}
+	std::pair<const_iterator, bool> insert(value_type&& value)
+	{
+		const key_type& key = value;
+		return table_.EmplaceKey(key, std::move(value));
+	}
+
+	size_type erase(const key_type& key) { return table_.Erase(key); }
+	const_iterator erase(const_iterator pos) { return table_.Erase(pos); }
+
+private:
+	Table table_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_FLAT_HASH_MAP_H__
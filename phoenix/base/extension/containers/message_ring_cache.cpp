@@ -0,0 +1,279 @@
+#include "extension/containers/message_ring_cache.h"
+#include <string.h>
+#include <algorithm>
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 槽号存为 uint32_t
+const size_t kMaxCapacity = (size_t)1 << 31;
+
+size_t RoundUpToPowerOfTwo(size_t value)
+{
+	size_t result = 1;
+	while (result < value && result < kMaxCapacity)
+		result <<= 1;
+	return result;
+}
+}
+
+MessageRingCache::MessageRingCache(size_t capacity, size_t arena_size)
+	: mask_(RoundUpToPowerOfTwo(capacity) - 1)
+	, head_(0)
+	, count_(0)
+	, out_of_order_count_(0)
+	, arena_size_(std::max<size_t>(arena_size, 1))
+	, arena_head_(0)
+	, arena_tail_(0)
+{
+	ids_.reset(new uint64_t[mask_ + 1]);
+	timestamps_.reset(new int64_t[mask_ + 1]);
+	flags_.reset(new uint32_t[mask_ + 1]);
+	offsets_.reset(new uint64_t[mask_ + 1]);
+	sizes_.reset(new uint32_t[mask_ + 1]);
+	arena_.reset(new char[arena_size_]);
+	slots_.reserve(mask_ + 1);
+}
+
+MessageRingCache::~MessageRingCache()
+{
+}
+
+bool MessageRingCache::Insert(uint64_t id, int64_t timestamp, uint32_t flags, const void *payload, size_t size)
+{
+	if (size > arena_size_ || size >= kOutOfOrderBit || slots_.count(id) != 0)
+		return false;
+	// 早于所有缓存的消息时，为它淘汰的只能是比它晚的
+	bool oldest = count_ > 0 && UpperBound(timestamp, id) == 0;
+	if (count_ == capacity())
+	{
+		if (oldest)
+			return false;
+		EvictOldest();
+	}
+
+	// 消息体不跨越环形内存的末尾，放不下末尾剩余的部分时从头开始
+	uint64_t position = arena_tail_;
+	while (true)
+	{
+		if (position % arena_size_ + size > arena_size_)
+			position += arena_size_ - position % arena_size_;
+		if (position + size - arena_head_ <= arena_size_)
+			break;
+		if (count_ == 0)
+		{
+			arena_head_ = arena_tail_ = position;
+			continue;
+		}
+		if (UpperBound(timestamp, id) == 0)
+			return false;
+		EvictOldest();
+	}
+	if (size > 0)
+		memcpy(arena_.get() + position % arena_size_, payload, size);
+	arena_tail_ = position + size;
+
+	// 多数消息按时间到达，追加到末尾；否则挪动其后各条
+	size_t index = count_;
+	if (count_ > 0)
+	{
+		size_t last = Slot(count_ - 1);
+		if (timestamp < timestamps_[last] || (timestamp == timestamps_[last] && id < ids_[last]))
+			index = UpperBound(timestamp, id);
+	}
+	for (size_t i = count_; i > index; i--)
+		MoveSlot(Slot(i - 1), Slot(i));
+
+	size_t slot = Slot(index);
+	ids_[slot] = id;
+	timestamps_[slot] = timestamp;
+	flags_[slot] = flags;
+	offsets_[slot] = position;
+	sizes_[slot] = (uint32_t)size;
+	if (index != count_)
+	{
+		sizes_[slot] |= kOutOfOrderBit;
+		out_of_order_count_++;
+	}
+	slots_[id] = (uint32_t)slot;
+	count_++;
+	return true;
+}
+
+bool MessageRingCache::Erase(uint64_t id)
+{
+	auto iter = slots_.find(id);
+	if (iter == slots_.end())
+		return false;
+	size_t slot = iter->second;
+	size_t index = (slot - head_) & mask_;
+	slots_.erase(iter);
+	if (sizes_[slot] & kOutOfOrderBit)
+		out_of_order_count_--;
+
+	// 挪动较短的一侧
+	if (index < count_ / 2)
+	{
+		for (size_t i = index; i > 0; i--)
+			MoveSlot(Slot(i - 1), Slot(i));
+		head_ = (head_ + 1) & mask_;
+	}
+	else
+	{
+		for (size_t i = index + 1; i < count_; i++)
+			MoveSlot(Slot(i), Slot(i - 1));
+	}
+	count_--;
+	ReclaimArena();
+	return true;
+}
+
+void MessageRingCache::Clear()
+{
+	slots_.clear();
+	head_ = 0;
+	count_ = 0;
+	out_of_order_count_ = 0;
+	arena_head_ = arena_tail_;
+}
+
+bool MessageRingCache::Find(uint64_t id, size_t *index) const
+{
+	auto iter = slots_.find(id);
+	if (iter == slots_.end())
+		return false;
+	if (index != nullptr)
+		*index = (iter->second - head_) & mask_;
+	return true;
+}
+
+size_t MessageRingCache::LowerBound(int64_t timestamp) const
+{
+	size_t low = 0, high = count_;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (timestamps_[Slot(middle)] < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t MessageRingCache::UpperBound(int64_t timestamp) const
+{
+	size_t low = 0, high = count_;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (timestamps_[Slot(middle)] <= timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t MessageRingCache::UpperBound(int64_t timestamp, uint64_t id) const
+{
+	size_t low = 0, high = count_;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		size_t slot = Slot(middle);
+		if (timestamps_[slot] < timestamp || (timestamps_[slot] == timestamp && ids_[slot] <= id))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t MessageRingCache::CountFlags(size_t begin, size_t end, uint32_t mask, uint32_t value) const
+{
+	end = std::min(end, count_);
+	size_t count = 0;
+	// 环绕时分成两段连续的数组，各自是可以向量化的简单循环
+	while (begin < end)
+	{
+		size_t slot = Slot(begin);
+		size_t length = std::min(end - begin, mask_ + 1 - slot);
+		const uint32_t *flags = flags_.get() + slot;
+		for (size_t i = 0; i < length; i++)
+			count += (flags[i] & mask) == value ? 1 : 0;
+		begin += length;
+	}
+	return count;
+}
+
+size_t MessageRingCache::UpdateFlags(size_t begin, size_t end, uint32_t clear_bits, uint32_t set_bits)
+{
+	end = std::min(end, count_);
+	size_t changed = 0;
+	while (begin < end)
+	{
+		size_t slot = Slot(begin);
+		size_t length = std::min(end - begin, mask_ + 1 - slot);
+		uint32_t *flags = flags_.get() + slot;
+		for (size_t i = 0; i < length; i++)
+		{
+			uint32_t updated = (flags[i] & ~clear_bits) | set_bits;
+			changed += updated != flags[i] ? 1 : 0;
+			flags[i] = updated;
+		}
+		begin += length;
+	}
+	return changed;
+}
+
+bool MessageRingCache::SetFlags(uint64_t id, uint32_t flags)
+{
+	auto iter = slots_.find(id);
+	if (iter == slots_.end())
+		return false;
+	flags_[iter->second] = flags;
+	return true;
+}
+
+void MessageRingCache::EvictOldest()
+{
+	slots_.erase(ids_[head_]);
+	if (sizes_[head_] & kOutOfOrderBit)
+		out_of_order_count_--;
+	head_ = (head_ + 1) & mask_;
+	count_--;
+	ReclaimArena();
+}
+
+void MessageRingCache::MoveSlot(size_t from, size_t to)
+{
+	ids_[to] = ids_[from];
+	timestamps_[to] = timestamps_[from];
+	flags_[to] = flags_[from];
+	offsets_[to] = offsets_[from];
+	sizes_[to] = sizes_[from];
+	slots_[ids_[to]] = (uint32_t)to;
+}
+
+void MessageRingCache::ReclaimArena()
+{
+	if (count_ == 0)
+	{
+		arena_head_ = arena_tail_;
+		return;
+	}
+	// 消息体都是按时间顺序写入的，最早一条的就在最前面；有插到中间的消息时才需要扫一遍
+	if (out_of_order_count_ == 0)
+	{
+		arena_head_ = offsets_[head_];
+		return;
+	}
+	uint64_t head = arena_tail_;
+	for (size_t i = 0; i < count_; i++)
+		head = std::min(head, offsets_[Slot(i)]);
+	arena_head_ = head;
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,109 @@
+// fixed-capacity ring cache of recent messages with columnar metadata
+
+#ifndef __BASE_EXTENSION_MESSAGE_RING_CACHE_H__
+#define __BASE_EXTENSION_MESSAGE_RING_CACHE_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+#include "extension/containers/flat_hash_map.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 一个会话最近的消息，取代每条消息一个堆上结构体的 std::map：
+// id、时间、标志位各存一个连续数组（按列存放），数一段消息里的未读数、找同步游标时只扫需要的那一列；
+// 消息体依次拷进一块固定大小的环形内存，不为每条消息单独分配。
+// 消息按 (timestamp, id) 升序排列，下标 0 是最早的一条；新消息不早于最新一条时追加到末尾，
+// 否则插到中间，挪动其后各条的元数据（不挪消息体）。条数达到 capacity 或消息体放不下时淘汰最早的消息。
+// 按时间的范围查找是二分，按 id 查找走 FlatHashMap。
+// 下标在 Insert / Erase 后失效，payload_data 返回的指针在下一次 Insert 前有效。
+// 不是线程安全的，由会话所在的线程使用
+class EXTENSION_EXPORT MessageRingCache
+{
+public:
+	// capacity 向上取整到 2 的幂，arena_size 是存放消息体的字节数
+	MessageRingCache(size_t capacity, size_t arena_size);
+	~MessageRingCache();
+
+	size_t size() const { return count_; }
+	bool empty() const { return count_ == 0; }
+	size_t capacity() const { return mask_ + 1; }
+	size_t arena_size() const { return arena_size_; }
+	// 环形内存中尚未回收的字节数，含按时间插到中间的消息之前、已淘汰消息占用的部分
+	size_t arena_used() const { return (size_t)(arena_tail_ - arena_head_); }
+
+	// id 已存在、消息体超过 arena_size，或已满而它早于缓存中所有的消息时返回 false。
+	// 放不下时先淘汰最早的消息，淘汰到比它晚的消息为止仍放不下也返回 false
+	bool Insert(uint64_t id, int64_t timestamp, uint32_t flags, const void *payload, size_t size);
+	bool Insert(uint64_t id, int64_t timestamp, uint32_t flags, const std::string &payload)
+	{
+		return Insert(id, timestamp, flags, payload.data(), payload.size());
+	}
+	// 如撤回的消息
+	bool Erase(uint64_t id);
+	void Clear();
+
+	// 找到时 index 为它的下标
+	bool Find(uint64_t id, size_t *index) const;
+	// 第一条 timestamp 不早于 / 晚于给定时间的下标，没有时为 size()
+	size_t LowerBound(int64_t timestamp) const;
+	size_t UpperBound(int64_t timestamp) const;
+
+	uint64_t id(size_t index) const { return ids_[Slot(index)]; }
+	int64_t timestamp(size_t index) const { return timestamps_[Slot(index)]; }
+	uint32_t flags(size_t index) const { return flags_[Slot(index)]; }
+	const char *payload_data(size_t index) const { return arena_.get() + offsets_[Slot(index)] % arena_size_; }
+	size_t payload_size(size_t index) const { return sizes_[Slot(index)] & ~kOutOfOrderBit; }
+	std::string payload(size_t index) const { return std::string(payload_data(index), payload_size(index)); }
+
+	// [begin, end) 中 (flags & mask) == value 的条数，如未读数 CountFlags(UpperBound(read_time), size(), kUnread, kUnread)
+	size_t CountFlags(size_t begin, size_t end, uint32_t mask, uint32_t value) const;
+	// [begin, end) 每条的标志位先清除 clear_bits 再置上 set_bits，返回标志位有变化的条数
+	size_t UpdateFlags(size_t begin, size_t end, uint32_t clear_bits, uint32_t set_bits);
+	bool SetFlags(uint64_t id, uint32_t flags);
+
+private:
+	// sizes_ 的最高位标记按时间插到中间的消息，它的消息体在环形内存中的位置与时间顺序不一致
+	static const uint32_t kOutOfOrderBit = 0x80000000u;
+
+	size_t Slot(size_t index) const { return (head_ + index) & mask_; }
+	// (timestamp, id) 之后第一条的下标
+	size_t UpperBound(int64_t timestamp, uint64_t id) const;
+	void EvictOldest();
+	// 把 from 槽的一条移到 to 槽
+	void MoveSlot(size_t from, size_t to);
+	// 回收已删除消息的消息体占用的环形内存
+	void ReclaimArena();
+
+	size_t mask_;
+	size_t head_;
+	size_t count_;
+	std::unique_ptr<uint64_t[]> ids_;
+	std::unique_ptr<int64_t[]> timestamps_;
+	std::unique_ptr<uint32_t[]> flags_;
+	// 消息体在环形内存中的位置，只增不减，取模 arena_size_ 得到偏移
+	std::unique_ptr<uint64_t[]> offsets_;
+	std::unique_ptr<uint32_t[]> sizes_;
+	size_t out_of_order_count_;
+
+	std::unique_ptr<char[]> arena_;
+	size_t arena_size_;
+	// 未回收的消息体位于 [arena_head_, arena_tail_)
+	uint64_t arena_head_;
+	uint64_t arena_tail_;
+
+	// id -> 槽
+	FlatHashMap<uint64_t, uint32_t> slots_;
+
+	DISALLOW_COPY_AND_ASSIGN(MessageRingCache);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_MESSAGE_RING_CACHE_H__
@@ -0,0 +1,237 @@
+#include "extension/device/device_info_cache.h"
+#include <thread>
+#include "base/hash.h"
+#include "base/pickle.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/platform_thread.h"
+
+#include "extension/device/platform_device.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/tools/tool.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 字段有增减时加一，旧文件直接丢弃
+const uint32_t kFormatVersion = 1;
+const size_t kChecksumSize = sizeof(uint32_t);
+
+bool SameInfo(const DeviceInfo &a, const DeviceInfo &b)
+{
+	return a.device_uuid == b.device_uuid
+		&& a.mac_address == b.mac_address
+		&& a.mac_address_valid == b.mac_address_valid
+		&& a.bios_serial_num == b.bios_serial_num
+		&& a.hard_disk_serial_num == b.hard_disk_serial_num
+		&& a.is_virtual_pc == b.is_virtual_pc
+		&& a.hardware_info.manufacturer == b.hardware_info.manufacturer
+		&& a.hardware_info.model == b.hardware_info.model
+		&& a.hardware_info.serial_number == b.hardware_info.serial_number;
+}
+}
+
+DeviceInfoCache* DeviceInfoCache::GetInstance()
+{
+	static DeviceInfoCache *cache = new DeviceInfoCache;
+	return cache;
+}
+
+DeviceInfoCache::DeviceInfoCache()
+	: started_(false)
+	, ready_(false)
+	, refreshed_(false)
+{
+
+}
+
+void DeviceInfoCache::Start(const UTF8String &cache_file)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (started_)
+			return;
+		started_ = true;
+		cache_file_ = cache_file;
+	}
+	DeviceInfo cached;
+	if (!cache_file.empty() && Load(cache_file, cached))
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			info_ = cached;
+			ready_ = true;
+		}
+		ready_cv_.notify_all();
+	}
+	//采集会阻塞在 WMI / IO 上，不占用 WorkStealingPool 的工作线程
+	std::thread([this]() { Refresh(); }).detach();
+}
+
+bool DeviceInfoCache::IsReady()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return ready_;
+}
+
+bool DeviceInfoCache::IsRefreshed()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return refreshed_;
+}
+
+DeviceInfo DeviceInfoCache::Get()
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	if (!started_)
+	{
+		//没有启动后台采集，在调用线程上采集，同时到来的查询等待这一次的结果
+		started_ = true;
+		guard.unlock();
+		DeviceInfo info = Collect();
+		guard.lock();
+		info_ = info;
+		ready_ = true;
+		refreshed_ = true;
+		ready_cv_.notify_all();
+		return info_;
+	}
+	ready_cv_.wait(guard, [this]() { return ready_; });
+	return info_;
+}
+
+std::string DeviceInfoCache::GetDeviceUUID()
+{
+	return Get().device_uuid;
+}
+
+bool DeviceInfoCache::GetMacAddress(std::string &mac_address)
+{
+	DeviceInfo info = Get();
+	mac_address = info.mac_address;
+	return info.mac_address_valid;
+}
+
+std::string DeviceInfoCache::GetBIOSSerialNum()
+{
+	return Get().bios_serial_num;
+}
+
+std::string DeviceInfoCache::GetHardDiskSerialNum()
+{
+	return Get().hard_disk_serial_num;
+}
+
+bool DeviceInfoCache::IsVirtualPC()
+{
+	return Get().is_virtual_pc;
+}
+
+base::SysInfo::HardwareInfo DeviceInfoCache::GetHardwareInfo()
+{
+	return Get().hardware_info;
+}
+
+void DeviceInfoCache::Refresh()
+{
+	base::PlatformThread::SetName("DeviceInfo");
+	DeviceInfo info = Collect();
+	bool changed = false;
+	UTF8String cache_file;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		changed = !ready_ || !SameInfo(info_, info);
+		info_ = info;
+		ready_ = true;
+		refreshed_ = true;
+		cache_file = cache_file_;
+	}
+	ready_cv_.notify_all();
+	if (changed && !cache_file.empty())
+		Save(cache_file, info);
+}
+
+DeviceInfo DeviceInfoCache::Collect()
+{
+	DeviceInfo info;
+	info.device_uuid = NS_EXTENSION::GetDeviceUUID();
+	info.mac_address_valid = NS_EXTENSION::GetMacAddress(info.mac_address);
+#if defined(OS_WIN)
+	info.bios_serial_num = NS_EXTENSION::GetBIOSSerialNum();
+	info.hard_disk_serial_num = NS_EXTENSION::GetHardDiskSerialNum();
+	info.is_virtual_pc = NS_EXTENSION::IsVirtualPC();
+#endif
+	info.hardware_info = NS_EXTENSION::GetHardwareInfo();
+#if defined(OS_WIN)
+	info.hardware_info.serial_number = info.bios_serial_num;
+#endif
+	return info;
+}
+
+std::string DeviceInfoCache::Fingerprint()
+{
+	//只取几项不需要 WMI 的值，换了机器或者升级了系统时让保存的结果失效
+	return base::StringPrintf("%s|%s|%d|%d",
+		base::SysInfo::OperatingSystemVersion().c_str(),
+		base::SysInfo::OperatingSystemArchitecture().c_str(),
+		base::SysInfo::NumberOfProcessors(),
+		base::SysInfo::AmountOfPhysicalMemoryMB());
+}
+
+bool DeviceInfoCache::Load(const UTF8String &cache_file, DeviceInfo &info)
+{
+	std::string content;
+	if (!NS_EXTENSION::ReadFileToString(cache_file, content) || content.size() <= kChecksumSize)
+		return false;
+	size_t payload_size = content.size() - kChecksumSize;
+	const uint8_t *p = (const uint8_t *)content.data() + payload_size;
+	uint32_t checksum = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	if (checksum != base::Hash(content.data(), payload_size))
+		return false;
+
+	base::Pickle pickle(content.data(), (int)payload_size);
+	base::PickleIterator iter(pickle);
+	uint32_t version = 0;
+	std::string fingerprint;
+	if (!iter.ReadUInt32(&version) || version != kFormatVersion
+		|| !iter.ReadString(&fingerprint) || fingerprint != Fingerprint())
+		return false;
+	return iter.ReadString(&info.device_uuid)
+		&& iter.ReadString(&info.mac_address)
+		&& iter.ReadBool(&info.mac_address_valid)
+		&& iter.ReadString(&info.bios_serial_num)
+		&& iter.ReadString(&info.hard_disk_serial_num)
+		&& iter.ReadBool(&info.is_virtual_pc)
+		&& iter.ReadString(&info.hardware_info.manufacturer)
+		&& iter.ReadString(&info.hardware_info.model)
+		&& iter.ReadString(&info.hardware_info.serial_number);
+}
+
+void DeviceInfoCache::Save(const UTF8String &cache_file, const DeviceInfo &info)
+{
+	base::Pickle pickle;
+	pickle.WriteUInt32(kFormatVersion);
+	pickle.WriteString(Fingerprint());
+	pickle.WriteString(info.device_uuid);
+	pickle.WriteString(info.mac_address);
+	pickle.WriteBool(info.mac_address_valid);
+	pickle.WriteString(info.bios_serial_num);
+	pickle.WriteString(info.hard_disk_serial_num);
+	pickle.WriteBool(info.is_virtual_pc);
+	pickle.WriteString(info.hardware_info.manufacturer);
+	pickle.WriteString(info.hardware_info.model);
+	pickle.WriteString(info.hardware_info.serial_number);
+
+	std::string content((const char *)pickle.data(), pickle.size());
+	uint32_t checksum = base::Hash(content);
+	char tail[kChecksumSize] = { (char)checksum, (char)(checksum >> 8), (char)(checksum >> 16), (char)(checksum >> 24) };
+	content.append(tail, sizeof(tail));
+
+	//先写临时文件再改名，进程中途退出也不会留下半个文件
+	UTF8String temp_file = cache_file + ".tmp";
+	if (NS_EXTENSION::WriteFile(temp_file, content) != (int)content.size()
+		|| !NS_EXTENSION::MoveFile(temp_file, cache_file))
+		NS_EXTENSION::DeleteFile(temp_file);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,87 @@
+// device and hardware identifiers collected once in the background and persisted across runs
+
+#ifndef __BASE_EXTENSION_DEVICE_INFO_CACHE_H__
+#define __BASE_EXTENSION_DEVICE_INFO_CACHE_H__
+
+#include "extension/config/build_config.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include "base/macros.h"
+#include "base/sys_info.h"
+
+#include "extension/extension_export.h"
+#include "extension/strings/unicode.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 各项含义同 platform_device.h 和 tools/tool.h 中的同名函数，不支持的平台为空
+struct EXTENSION_EXPORT DeviceInfo
+{
+	DeviceInfo() : mac_address_valid(false), is_virtual_pc(false) {}
+
+	std::string device_uuid;
+	std::string mac_address;
+	bool		mac_address_valid;		// GetMacAddress 的返回值，失败时 mac_address 为默认值
+	std::string bios_serial_num;
+	std::string hard_disk_serial_num;
+	bool		is_virtual_pc;
+	base::SysInfo::HardwareInfo hardware_info;	// Windows 上 serial_number 为 BIOS 序列号
+};
+
+// GetDeviceUUID、GetBIOSSerialNum 等每次都要查询系统，Windows 上部分走 WMI / DeviceIoControl，
+// 一次几十到几百毫秒。启动时调用 Start：先读上次保存的结果，校验通过就立即可用；
+// 同时在后台线程重新采集一次，结果有变化时更新内存并写回文件。之后的查询只是一次加锁拷贝。
+//   DeviceInfoCache::GetInstance()->Start(user_data_dir + "device_info.dat");
+//   ...
+//   std::string uuid = DeviceInfoCache::GetInstance()->GetDeviceUUID();
+// 保存的文件带格式版本、校验和以及本机指纹（系统版本、CPU 核数、内存大小），
+// 文件损坏或被拷到其他机器上时丢弃，查询等待后台采集完成。
+// 没有调用 Start 时，第一次查询在调用线程上同步采集（不写文件）。
+// 该单例刻意不析构，可以在任意线程调用
+class EXTENSION_EXPORT DeviceInfoCache
+{
+public:
+	static DeviceInfoCache* GetInstance();
+
+	// 只有第一次调用有效；cache_file 为空时不持久化，只在后台采集
+	void Start(const UTF8String &cache_file);
+	// 是否已有可用的结果（读取到有效的缓存文件或者采集完成），为 true 时查询不会阻塞
+	bool IsReady();
+	// 后台采集是否已完成，之后的结果是本次运行采集到的
+	bool IsRefreshed();
+
+	DeviceInfo Get();
+	std::string GetDeviceUUID();
+	bool GetMacAddress(std::string &mac_address);
+	std::string GetBIOSSerialNum();
+	std::string GetHardDiskSerialNum();
+	bool IsVirtualPC();
+	base::SysInfo::HardwareInfo GetHardwareInfo();
+
+private:
+	DeviceInfoCache();
+
+	// 在后台线程上执行
+	void Refresh();
+	static DeviceInfo Collect();
+	static std::string Fingerprint();
+	bool Load(const UTF8String &cache_file, DeviceInfo &info);
+	void Save(const UTF8String &cache_file, const DeviceInfo &info);
+
+private:
+	std::mutex					lock_;
+	std::condition_variable		ready_cv_;
+	bool						started_;
+	bool						ready_;
+	bool						refreshed_;
+	UTF8String					cache_file_;
+	DeviceInfo					info_;
+
+	DISALLOW_COPY_AND_ASSIGN(DeviceInfoCache);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_DEVICE_INFO_CACHE_H__
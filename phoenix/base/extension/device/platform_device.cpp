@@ -2,6 +2,9 @@
 #include "extension/device/platform_device_internal.h"
 #include "extension/file_util/path_util.h"
 #include "extension/file_util/utf8_file_util.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
 
 #if defined(OS_WIN)
 #include <SensAPI.h>
@@ -12,30 +15,107 @@
 
 EXTENSION_BEGIN_DECLS
 
-namespace internal
+namespace
 {
+	// 没有收到过网络变化通知时的最长缓存时间
+	const int kNetworkStateMaxAgeMs = 5000;
 
-	bool GetMacAddress(std::string &mac_address)
+	template <typename T>
+	struct CachedValue
+	{
+		CachedValue() : valid(false), generation(0) {}
+
+		bool valid;
+		uint64_t generation;
+		std::chrono::steady_clock::time_point time;
+		T value;
+	};
+
+	struct NetworkStateCache
+	{
+		NetworkStateCache() : change_driven(false), generation(0) {}
+
+		std::mutex lock;
+		bool change_driven;
+		uint64_t generation;	// 每次 NotifyNetworkChanged 加一，查询期间发生变化时不写回缓存
+		CachedValue<bool> alive;
+		CachedValue<std::pair<bool, std::string>> mac_address;
+	};
+
+	//刻意不析构，退出时其他线程可能还在查询
+	NetworkStateCache* GetNetworkStateCache()
 	{
-		return internal::GetMacAddress(mac_address);
+		static NetworkStateCache* cache = new NetworkStateCache;
+		return cache;
 	}
 
-	bool IsNetworkAlive()
+	//查询不持锁，多个线程同时未命中时各自查询一次
+	template <typename T>
+	T GetCached(CachedValue<T> NetworkStateCache::*member, const std::function<T()>& query)
+	{
+		NetworkStateCache* cache = GetNetworkStateCache();
+		uint64_t generation = 0;
+		{
+			std::lock_guard<std::mutex> guard(cache->lock);
+			CachedValue<T>& cached = cache->*member;
+			auto now = std::chrono::steady_clock::now();
+			if (cached.valid && cached.generation == cache->generation
+				&& (cache->change_driven || now - cached.time < std::chrono::milliseconds(kNetworkStateMaxAgeMs)))
+				return cached.value;
+			generation = cache->generation;
+		}
+		T value = query();
+		std::lock_guard<std::mutex> guard(cache->lock);
+		if (generation == cache->generation)
+		{
+			CachedValue<T>& cached = cache->*member;
+			cached.valid = true;
+			cached.generation = generation;
+			cached.time = std::chrono::steady_clock::now();
+			cached.value = value;
+		}
+		return value;
+	}
+
+	bool QueryNetworkAlive()
 	{
 #if defined(OS_WIN)
+		DWORD dwStates;
+		bool connected = false;
+		if (::IsNetworkAlive(&dwStates) && ::GetLastError() == 0)
 		{
-			DWORD dwStates;
-			bool connected = false;
-			if (::IsNetworkAlive(&dwStates) && ::GetLastError() == 0)
-			{
-				connected = ::InternetGetConnectedState(&dwStates, 0);
-			}
-			return connected;
+			connected = ::InternetGetConnectedState(&dwStates, 0);
 		}
+		return connected;
 #else
 		return false;
 #endif
 	}
+}
+
+	bool GetMacAddress(std::string &mac_address)
+	{
+		auto result = GetCached<std::pair<bool, std::string>>(&NetworkStateCache::mac_address, []() {
+			std::pair<bool, std::string> result;
+			result.first = internal::GetMacAddress(result.second);
+			return result;
+		});
+		mac_address = result.second;
+		return result.first;
+	}
+
+	bool IsNetworkAlive()
+	{
+		return GetCached<bool>(&NetworkStateCache::alive, &QueryNetworkAlive);
+	}
+
+	void NotifyNetworkChanged()
+	{
+		NetworkStateCache* cache = GetNetworkStateCache();
+		std::lock_guard<std::mutex> guard(cache->lock);
+		cache->change_driven = true;
+		cache->generation++;
+	}
 
 	std::string GetDeviceUUID()
 	{
@@ -45,5 +125,4 @@ namespace internal
 #endif
 		return dev_uuid;
 	}
-}
 EXTENSION_END_DECLS
\ No newline at end of file
@@ -8,8 +8,13 @@
 
 EXTENSION_BEGIN_DECLS
 
+// GetMacAddress 和 IsNetworkAlive 要枚举网卡（Windows 上为 GetAdaptersAddresses 等，虚拟网卡多时很慢），
+// 结果会缓存：调用过 NotifyNetworkChanged 之后缓存一直有效到下一次 NotifyNetworkChanged，
+// 否则最多缓存 5 秒，可以放心在定时器里轮询
 EXTENSION_EXPORT bool GetMacAddress(std::string &mac_address);
 EXTENSION_EXPORT bool IsNetworkAlive();
+// 网络变化时调用（google_net 的 NimNetworkTransition 会调用），清掉上面两个函数的缓存
+EXTENSION_EXPORT void NotifyNetworkChanged();
 EXTENSION_EXPORT std::string GetDeviceUUID();
 
 #if defined(OS_WIN)
@@ -1,72 +1,193 @@
 #include "extension/encrypt/url_encode.h"
-#include <assert.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define URL_ENCODE_USE_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define URL_ENCODE_USE_NEON
+#include <arm_neon.h>
+#endif
 
 EXTENSION_BEGIN_DECLS
 
-unsigned char ToHex(unsigned char x)
+namespace
+{
+const size_t kChunkSize = 16;
+const char kHexChars[] = "0123456789ABCDEF";
+
+// Same set as isalnum() in the "C" locale plus "-_.~", without the locale lookup
+inline bool IsUnreserved(unsigned char c)
 {
-	return  x > 9 ? x + 55 : x + 48;
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+		c == '-' || c == '_' || c == '.' || c == '~';
 }
 
-unsigned char FromHex(unsigned char x)
+inline int FromHex(unsigned char c)
 {
-	unsigned char y;
-	if (x >= 'A' && x <= 'Z') 
-		y = x - 'A' + 10;
-	else if (x >= 'a' && x <= 'z') 
-		y = x - 'a' + 10;
-	else if (x >= '0' && x <= '9') 
-		y = x - '0';
-	else 
-		assert(0);
-	return y;
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
 }
 
-std::string URLEncode(const std::string& input)
+#if defined(URL_ENCODE_USE_SSE2)
+inline size_t CountTrailingZeros(uint32_t mask)
 {
-	std::string output;
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Signed compares: bytes >= 0x80 are negative and fall outside every range
+inline __m128i InRange(__m128i chunk, char low, char high)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1)));
+}
+#endif
+
+// Length of the leading run in |data| that URLEncode copies unchanged
+size_t UnreservedPrefix(const char* data, size_t length)
+{
+	size_t i = 0;
+#if defined(URL_ENCODE_USE_SSE2)
+	for (; i + kChunkSize <= length; i += kChunkSize)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i safe = _mm_or_si128(_mm_or_si128(InRange(chunk, 'a', 'z'), InRange(chunk, 'A', 'Z')), InRange(chunk, '0', '9'));
+		safe = _mm_or_si128(safe, _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('-')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'))));
+		safe = _mm_or_si128(safe, _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('.')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('~'))));
+		uint32_t unsafe = ~(uint32_t)_mm_movemask_epi8(safe) & 0xFFFF;
+		if (unsafe != 0)
+			return i + CountTrailingZeros(unsafe);
+	}
+#elif defined(URL_ENCODE_USE_NEON)
+	for (; i + kChunkSize <= length; i += kChunkSize)
+	{
+		uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+		uint8x16_t lower = vsubq_u8(vorrq_u8(chunk, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+		uint8x16_t safe = vcltq_u8(lower, vdupq_n_u8(26));
+		safe = vorrq_u8(safe, vcltq_u8(vsubq_u8(chunk, vdupq_n_u8('0')), vdupq_n_u8(10)));
+		safe = vorrq_u8(safe, vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('-')), vceqq_u8(chunk, vdupq_n_u8('_'))));
+		safe = vorrq_u8(safe, vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('.')), vceqq_u8(chunk, vdupq_n_u8('~'))));
+		if (vminvq_u8(safe) != 0xFF)
+			break;
+	}
+#endif
+	while (i < length && IsUnreserved((unsigned char)data[i]))
+		i++;
+	return i;
+}
+
+// Length of the leading run in |data| that URLDecode copies unchanged
+size_t PlainPrefix(const char* data, size_t length)
+{
+	size_t i = 0;
+#if defined(URL_ENCODE_USE_SSE2)
+	for (; i + kChunkSize <= length; i += kChunkSize)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('%')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('+')));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+		if (mask != 0)
+			return i + CountTrailingZeros(mask);
+	}
+#elif defined(URL_ENCODE_USE_NEON)
+	for (; i + kChunkSize <= length; i += kChunkSize)
+	{
+		uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+		uint8x16_t special = vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('%')), vceqq_u8(chunk, vdupq_n_u8('+')));
+		if (vmaxvq_u8(special) != 0)
+			break;
+	}
+#endif
+	while (i < length && data[i] != '%' && data[i] != '+')
+		i++;
+	return i;
+}
+}
+
+void URLEncodeAppend(std::string_view input, std::string& output)
+{
+	const char* data = input.data();
 	size_t length = input.length();
-	for (size_t i = 0; i < length; i++)
+	output.reserve(output.size() + length + length / 2);
+	size_t i = 0;
+	while (i < length)
 	{
-		if (isalnum((unsigned char)input[i]) ||
-			(input[i] == '-') ||
-			(input[i] == '_') ||
-			(input[i] == '.') ||
-			(input[i] == '~')) {
-			output += input[i];
-		}
-		else if (input[i] == ' '){
-			output += "+";
-		}
-		else
+		size_t run = UnreservedPrefix(data + i, length - i);
+		output.append(data + i, run);
+		i += run;
+		for (; i < length && !IsUnreserved((unsigned char)data[i]); i++)
 		{
-			output += '%';
-			output += ToHex((unsigned char)input[i] >> 4);
-			output += ToHex((unsigned char)input[i] % 16);
+			unsigned char c = (unsigned char)data[i];
+			if (c == ' ')
+			{
+				output += '+';
+			}
+			else
+			{
+				char escaped[3] = { '%', kHexChars[c >> 4], kHexChars[c & 0x0F] };
+				output.append(escaped, sizeof(escaped));
+			}
 		}
 	}
-	return output;
 }
-std::string URLDecode(const std::string& input)
+
+void URLDecodeAppend(std::string_view input, std::string& output)
 {
-	std::string output;
+	const char* data = input.data();
 	size_t length = input.length();
-	for (size_t i = 0; i < length; i++)
+	output.reserve(output.size() + length);
+	size_t i = 0;
+	while (i < length)
 	{
-		if (input[i] == '+') {
+		size_t run = PlainPrefix(data + i, length - i);
+		output.append(data + i, run);
+		i += run;
+		if (i >= length)
+			break;
+		if (data[i] == '+')
+		{
 			output += ' ';
+			i++;
+			continue;
 		}
-		else if (input[i] == '%'){
-			assert(i + 2 < length);
-			unsigned char high = FromHex((unsigned char)input[++i]);
-			unsigned char low = FromHex((unsigned char)input[++i]);
-			output += high * 16 + low;
-		}
-		else{ 
-			output += input[i];
+		int high = i + 2 < length ? FromHex((unsigned char)data[i + 1]) : -1;
+		int low = high >= 0 ? FromHex((unsigned char)data[i + 2]) : -1;
+		if (low < 0)
+		{
+			output += '%';
+			i++;
+			continue;
 		}
+		output += (char)(high * 16 + low);
+		i += 3;
 	}
+}
+
+std::string URLEncode(const std::string& input)
+{
+	std::string output;
+	URLEncodeAppend(input, output);
+	return output;
+}
+
+std::string URLDecode(const std::string& input)
+{
+	std::string output;
+	URLDecodeAppend(input, output);
 	return output;
 }
 
-EXTENSION_END_DECLS
\ No newline at end of file
+EXTENSION_END_DECLS
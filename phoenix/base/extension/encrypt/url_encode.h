@@ -4,12 +4,21 @@
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
 #include <string>
+#include <string_view>
 
 EXTENSION_BEGIN_DECLS
 
 EXTENSION_EXPORT std::string URLEncode(const std::string& input);
 EXTENSION_EXPORT std::string URLDecode(const std::string& input);
 
+// Append the result to |output| instead of returning a new string, so that a
+// caller building many URLs can reuse one buffer.
+// Runs of characters that need no escaping are found 16 bytes at a time with
+// SSE2/NEON where available and copied in one go.
+// A '%' not followed by two hex digits is kept as is by URLDecodeAppend.
+EXTENSION_EXPORT void URLEncodeAppend(std::string_view input, std::string& output);
+EXTENSION_EXPORT void URLDecodeAppend(std::string_view input, std::string& output);
+
 EXTENSION_END_DECLS
 
 #endif // __BASE_EXTENSION_URL_ENCODE_H__
@@ -0,0 +1,727 @@
+#include "extension/file_util/async_file.h"
+
+#include <string.h>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/thread_task_runner_handle.h"
+#include "base/threading/platform_thread.h"
+
+#include "extension/callback/post_task.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include "extension/strings/string_util.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#endif
+
+// io_uring needs Linux 5.1; Android forbids it to the applications by seccomp
+#if defined(OS_LINUX) && !defined(OS_ANDROID)
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define EXTENSION_ASYNC_FILE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+#endif
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const int kWorkerCount = 4;
+
+enum class FileOperationType
+{
+	kRead,
+	kWrite,
+	kFlush,
+};
+
+struct FileOperation;
+
+#if defined(OS_WIN)
+// The completion packet points to |overlapped|
+struct IocpOverlapped
+{
+	OVERLAPPED overlapped;
+	FileOperation *operation;
+};
+#endif
+
+struct FileOperation
+{
+	FileOperation() : type(FileOperationType::kFlush), offset(0), done(0) {}
+
+	FileOperationType type;
+	scoped_refptr<AsyncFile> file;
+	int64_t offset;
+	// The data to write, or the buffer read into
+	std::string buffer;
+	// Transferred by the previous submissions of a short read or write
+	size_t done;
+	AsyncFileCallback callback;
+	AsyncFileReadCallback read_callback;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner;
+#if defined(OS_WIN)
+	IocpOverlapped iocp;
+#elif defined(EXTENSION_ASYNC_FILE_IO_URING)
+	struct iovec iov;
+#endif
+};
+
+scoped_refptr<base::SingleThreadTaskRunner> CurrentTaskRunner()
+{
+	if (!base::ThreadTaskRunnerHandle::IsSet())
+		return nullptr;
+	return base::ThreadTaskRunnerHandle::Get();
+}
+
+void PostReply(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner, OnceClosure reply)
+{
+	if (task_runner != nullptr)
+		NS_EXTENSION::PostTask(task_runner.get(), FROM_HERE, std::move(reply));
+	else
+		reply();
+}
+
+void CompleteOperation(FileOperation *operation, int64_t result)
+{
+	std::unique_ptr<FileOperation> owner(operation);
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = std::move(operation->reply_task_runner);
+	operation->file = nullptr;
+	if (operation->type == FileOperationType::kRead)
+	{
+		operation->buffer.resize(result >= 0 ? operation->done : 0);
+		AsyncFileReadCallback callback = std::move(operation->read_callback);
+		std::string data = std::move(operation->buffer);
+		if (callback)
+			PostReply(task_runner, [callback, result, data]() mutable { callback(result, std::move(data)); });
+	}
+	else
+	{
+		AsyncFileCallback callback = std::move(operation->callback);
+		if (callback)
+			PostReply(task_runner, [callback, result]() { callback(result); });
+	}
+}
+
+// Runs |operation| synchronously, on a worker thread
+int64_t RunOperation(FileOperation *operation)
+{
+	base::PlatformFile file = operation->file->platform_file();
+	std::string &buffer = operation->buffer;
+	if (operation->type == FileOperationType::kFlush)
+	{
+#if defined(OS_WIN)
+		return ::FlushFileBuffers(file) ? 0 : -(int64_t)::GetLastError();
+#else
+		return HANDLE_EINTR(fsync(file)) == 0 ? 0 : -(int64_t)errno;
+#endif
+	}
+	while (operation->done < buffer.size())
+	{
+		int64_t offset = operation->offset + (int64_t)operation->done;
+		size_t length = buffer.size() - operation->done;
+#if defined(OS_WIN)
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+		DWORD transferred = 0;
+		BOOL ok = operation->type == FileOperationType::kRead
+			? ::ReadFile(file, &buffer[operation->done], chunk, &transferred, &overlapped)
+			: ::WriteFile(file, buffer.data() + operation->done, chunk, &transferred, &overlapped);
+		if (!ok)
+		{
+			DWORD error = ::GetLastError();
+			if (error == ERROR_HANDLE_EOF)
+				break;
+			return -(int64_t)error;
+		}
+		int64_t ret = transferred;
+#else
+		ssize_t ret = operation->type == FileOperationType::kRead
+			? HANDLE_EINTR(pread(file, &buffer[operation->done], length, (off_t)offset))
+			: HANDLE_EINTR(pwrite(file, buffer.data() + operation->done, length, (off_t)offset));
+		if (ret < 0)
+			return -(int64_t)errno;
+#endif
+		if (ret == 0)
+			break;
+		operation->done += (size_t)ret;
+	}
+	return (int64_t)operation->done;
+}
+
+// The threads which run the blocking calls: flushes, opening and copying the
+// files, and all the operations without io_uring or IOCP.
+// Never destructed, the threads are not joined, as WorkStealingPool
+class FileWorkers : public base::PlatformThread::Delegate
+{
+public:
+	explicit FileWorkers(int count) : wakeup_(&lock_)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			base::PlatformThreadHandle handle;
+			bool success = base::PlatformThread::Create(0, this, &handle);
+			DCHECK(success);
+		}
+	}
+
+	void PostTask(OnceClosure task)
+	{
+		base::AutoLock lock(lock_);
+		tasks_.push_back(std::move(task));
+		wakeup_.Signal();
+	}
+
+	virtual void ThreadMain() override
+	{
+		base::PlatformThread::SetName("async_file_worker");
+		for (;;)
+		{
+			OnceClosure task;
+			{
+				base::AutoLock lock(lock_);
+				while (tasks_.empty())
+					wakeup_.Wait();
+				task = std::move(tasks_.front());
+				tasks_.pop_front();
+			}
+			task();
+		}
+	}
+
+private:
+	base::Lock lock_;
+	base::ConditionVariable wakeup_;
+	std::deque<OnceClosure> tasks_;
+};
+
+class FileIOBackend
+{
+public:
+	virtual ~FileIOBackend() {}
+	virtual const char* name() const = 0;
+	// Takes |operation| and completes it with CompleteOperation
+	virtual void Submit(FileOperation *operation) = 0;
+#if defined(OS_WIN)
+	// The flags and the association of the files opened by AsyncFile::Open
+	virtual DWORD open_flags() const { return 0; }
+	virtual bool Attach(HANDLE file) { return true; }
+#endif
+};
+
+class ThreadFileIOBackend : public FileIOBackend
+{
+public:
+	explicit ThreadFileIOBackend(FileWorkers *workers) : workers_(workers) {}
+
+	virtual const char* name() const override { return "threads"; }
+	virtual void Submit(FileOperation *operation) override
+	{
+		workers_->PostTask([operation]() { CompleteOperation(operation, RunOperation(operation)); });
+	}
+
+private:
+	FileWorkers *workers_;
+};
+
+// Handles the result of one submission: the rest of a short read or write is
+// submitted again, EOF completes a read
+void OnTransferred(FileIOBackend *backend, FileOperation *operation, int64_t result)
+{
+	if (result < 0)
+	{
+		CompleteOperation(operation, result);
+		return;
+	}
+	if (operation->type == FileOperationType::kFlush)
+	{
+		CompleteOperation(operation, 0);
+		return;
+	}
+	operation->done += (size_t)result;
+	if (result > 0 && operation->done < operation->buffer.size())
+	{
+		backend->Submit(operation);
+		return;
+	}
+	CompleteOperation(operation, (int64_t)operation->done);
+}
+
+#if defined(EXTENSION_ASYNC_FILE_IO_URING)
+// Submissions from any thread under |lock_|, one thread waits for the completions
+class IoUringFileIOBackend : public FileIOBackend, public base::PlatformThread::Delegate
+{
+public:
+	static IoUringFileIOBackend* Create(FileWorkers *workers)
+	{
+		const unsigned kEntries = 256;
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		int ring_fd = (int)syscall(__NR_io_uring_setup, kEntries, &params);
+		if (ring_fd < 0)
+			return nullptr;
+
+		std::unique_ptr<IoUringFileIOBackend> backend(new IoUringFileIOBackend(ring_fd, workers));
+		if (!backend->MapRings(params))
+			return nullptr;
+		base::PlatformThreadHandle handle;
+		if (!base::PlatformThread::Create(0, backend.get(), &handle))
+			return nullptr;
+		return backend.release();
+	}
+
+	virtual ~IoUringFileIOBackend()
+	{
+		if (sqes_ != MAP_FAILED)
+			munmap(sqes_, sqes_size_);
+		if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+			munmap(cq_ring_, cq_ring_size_);
+		if (sq_ring_ != MAP_FAILED)
+			munmap(sq_ring_, sq_ring_size_);
+		close(ring_fd_);
+	}
+
+	virtual const char* name() const override { return "io_uring"; }
+
+	virtual void Submit(FileOperation *operation) override
+	{
+		{
+			base::AutoLock lock(lock_);
+			// The completion queue must not overflow, and a slot is not reused
+			// before its request is completed
+			if (in_flight_ < sq_entries_ && Enqueue(operation))
+			{
+				in_flight_++;
+				return;
+			}
+		}
+		workers_->PostTask([operation]() { CompleteOperation(operation, RunOperation(operation)); });
+	}
+
+	virtual void ThreadMain() override
+	{
+		base::PlatformThread::SetName("async_file_io_uring");
+		std::vector<std::pair<FileOperation *, int64_t>> completed;
+		for (;;)
+		{
+			int ret = (int)syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				PLOG(ERROR) << "io_uring_enter";
+				base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(10));
+			}
+
+			unsigned head = *cq_head_;
+			unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+				completed.emplace_back(reinterpret_cast<FileOperation *>((uintptr_t)cqe.user_data), (int64_t)cqe.res);
+			}
+			__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+			if (completed.empty())
+				continue;
+			{
+				base::AutoLock lock(lock_);
+				in_flight_ -= (unsigned)completed.size();
+			}
+			for (const auto &it : completed)
+				OnTransferred(this, it.first, it.second);
+			completed.clear();
+		}
+	}
+
+private:
+	IoUringFileIOBackend(int ring_fd, FileWorkers *workers)
+		: ring_fd_(ring_fd), workers_(workers), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_(MAP_FAILED)
+		, sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0), sq_entries_(0), in_flight_(0)
+	{
+	}
+
+	bool MapRings(const io_uring_params &params)
+	{
+		sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap)
+			sq_ring_size_ = cq_ring_size_ = sq_ring_size_ > cq_ring_size_ ? sq_ring_size_ : cq_ring_size_;
+		sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+		if (sq_ring_ == MAP_FAILED)
+			return false;
+		cq_ring_ = single_mmap ? sq_ring_
+			: mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+		if (cq_ring_ == MAP_FAILED)
+			return false;
+		sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+		sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+		if (sqes_ == MAP_FAILED)
+			return false;
+
+		char *sq = static_cast<char *>(sq_ring_);
+		sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+		sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+		sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+		sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+		char *cq = static_cast<char *>(cq_ring_);
+		cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+		cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+		cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+		cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+		sq_entries_ = params.sq_entries;
+		return true;
+	}
+
+	// Under |lock_|, false if the kernel did not take the request
+	bool Enqueue(FileOperation *operation)
+	{
+		unsigned tail = *sq_tail_;
+		unsigned index = tail & *sq_mask_;
+		io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->fd = operation->file->platform_file();
+		sqe->user_data = (uint64_t)(uintptr_t)operation;
+		if (operation->type == FileOperationType::kFlush)
+		{
+			sqe->opcode = IORING_OP_FSYNC;
+		}
+		else
+		{
+			// READV/WRITEV instead of READ/WRITE, which need Linux 5.6
+			operation->iov.iov_base = &operation->buffer[operation->done];
+			operation->iov.iov_len = operation->buffer.size() - operation->done;
+			sqe->opcode = operation->type == FileOperationType::kRead ? IORING_OP_READV : IORING_OP_WRITEV;
+			sqe->addr = (uint64_t)(uintptr_t)&operation->iov;
+			sqe->len = 1;
+			sqe->off = (uint64_t)(operation->offset + (int64_t)operation->done);
+		}
+		sq_array_[index] = index;
+		__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+		int ret;
+		do
+		{
+			ret = (int)syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0);
+		} while (ret < 0 && errno == EINTR);
+		if (ret > 0 || __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) != tail)
+			return true;
+		// Not consumed by the kernel, nobody else submits while |lock_| is held
+		__atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+		return false;
+	}
+
+private:
+	int ring_fd_;
+	FileWorkers *workers_;
+	void *sq_ring_;
+	void *cq_ring_;
+	void *sqes_;
+	size_t sq_ring_size_;
+	size_t cq_ring_size_;
+	size_t sqes_size_;
+	unsigned *sq_head_;
+	unsigned *sq_tail_;
+	unsigned *sq_mask_;
+	unsigned *sq_array_;
+	unsigned *cq_head_;
+	unsigned *cq_tail_;
+	unsigned *cq_mask_;
+	io_uring_cqe *cqes_;
+	unsigned sq_entries_;
+	base::Lock lock_;
+	unsigned in_flight_;
+};
+#endif
+
+#if defined(OS_WIN)
+// Reads and writes are overlapped and complete on the port, flushes run on
+// the workers
+class IocpFileIOBackend : public FileIOBackend, public base::PlatformThread::Delegate
+{
+public:
+	static IocpFileIOBackend* Create(FileWorkers *workers)
+	{
+		HANDLE port = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+		if (port == NULL)
+			return nullptr;
+		std::unique_ptr<IocpFileIOBackend> backend(new IocpFileIOBackend(port, workers));
+		base::PlatformThreadHandle handle;
+		if (!base::PlatformThread::Create(0, backend.get(), &handle))
+			return nullptr;
+		return backend.release();
+	}
+
+	virtual ~IocpFileIOBackend()
+	{
+		::CloseHandle(port_);
+	}
+
+	virtual const char* name() const override { return "iocp"; }
+	virtual DWORD open_flags() const override { return FILE_FLAG_OVERLAPPED; }
+	virtual bool Attach(HANDLE file) override
+	{
+		return ::CreateIoCompletionPort(file, port_, 0, 0) == port_;
+	}
+
+	virtual void Submit(FileOperation *operation) override
+	{
+		if (operation->type == FileOperationType::kFlush)
+		{
+			workers_->PostTask([operation]() { CompleteOperation(operation, RunOperation(operation)); });
+			return;
+		}
+
+		int64_t offset = operation->offset + (int64_t)operation->done;
+		size_t length = operation->buffer.size() - operation->done;
+		DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+		memset(&operation->iocp.overlapped, 0, sizeof(operation->iocp.overlapped));
+		operation->iocp.overlapped.Offset = (DWORD)offset;
+		operation->iocp.overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		operation->iocp.operation = operation;
+		HANDLE file = operation->file->platform_file();
+		// A request completed at once still queues its packet to the port
+		BOOL ok = operation->type == FileOperationType::kRead
+			? ::ReadFile(file, &operation->buffer[operation->done], chunk, NULL, &operation->iocp.overlapped)
+			: ::WriteFile(file, operation->buffer.data() + operation->done, chunk, NULL, &operation->iocp.overlapped);
+		if (ok)
+			return;
+		DWORD error = ::GetLastError();
+		if (error == ERROR_IO_PENDING)
+			return;
+		OnTransferred(this, operation, error == ERROR_HANDLE_EOF ? 0 : -(int64_t)error);
+	}
+
+	virtual void ThreadMain() override
+	{
+		base::PlatformThread::SetName("async_file_iocp");
+		for (;;)
+		{
+			DWORD transferred = 0;
+			ULONG_PTR key = 0;
+			OVERLAPPED *overlapped = nullptr;
+			BOOL ok = ::GetQueuedCompletionStatus(port_, &transferred, &key, &overlapped, INFINITE);
+			if (overlapped == nullptr)
+				continue;
+			FileOperation *operation = reinterpret_cast<IocpOverlapped *>(overlapped)->operation;
+			int64_t result = transferred;
+			if (!ok)
+			{
+				DWORD error = ::GetLastError();
+				result = error == ERROR_HANDLE_EOF ? 0 : -(int64_t)error;
+			}
+			OnTransferred(this, operation, result);
+		}
+	}
+
+private:
+	IocpFileIOBackend(HANDLE port, FileWorkers *workers) : port_(port), workers_(workers) {}
+
+	HANDLE port_;
+	FileWorkers *workers_;
+};
+#endif
+
+struct AsyncFileService
+{
+	AsyncFileService() : workers(kWorkerCount), backend(nullptr)
+	{
+#if defined(EXTENSION_ASYNC_FILE_IO_URING)
+		backend = IoUringFileIOBackend::Create(&workers);
+#elif defined(OS_WIN)
+		backend = IocpFileIOBackend::Create(&workers);
+#endif
+		if (backend == nullptr)
+			backend = new ThreadFileIOBackend(&workers);
+	}
+
+	FileWorkers workers;
+	FileIOBackend *backend;
+};
+
+AsyncFileService* GetAsyncFileService()
+{
+	static AsyncFileService *service = new AsyncFileService;
+	return service;
+}
+
+void SubmitOperation(FileOperation *operation)
+{
+	GetAsyncFileService()->backend->Submit(operation);
+}
+}
+
+scoped_refptr<AsyncFile> AsyncFile::Open(const UTF8String &filepath, Mode mode)
+{
+	FileIOBackend *backend = GetAsyncFileService()->backend;
+#if defined(OS_WIN)
+	DWORD access = GENERIC_READ;
+	DWORD disposition = OPEN_EXISTING;
+	if (mode == kWrite)
+	{
+		access = GENERIC_WRITE;
+		disposition = CREATE_ALWAYS;
+	}
+	else if (mode == kReadWrite)
+	{
+		access = GENERIC_READ | GENERIC_WRITE;
+		disposition = OPEN_ALWAYS;
+	}
+	HANDLE file = ::CreateFileW(UTF8ToUTF16(filepath).c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, disposition, FILE_ATTRIBUTE_NORMAL | backend->open_flags(), NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	if (!backend->Attach(file))
+	{
+		::CloseHandle(file);
+		return nullptr;
+	}
+#else
+	int flags = O_RDONLY;
+	if (mode == kWrite)
+		flags = O_WRONLY | O_CREAT | O_TRUNC;
+	else if (mode == kReadWrite)
+		flags = O_RDWR | O_CREAT;
+	int file = HANDLE_EINTR(open(filepath.c_str(), flags | O_CLOEXEC, 0666));
+	if (file < 0)
+		return nullptr;
+#endif
+	scoped_refptr<AsyncFile> async_file(new AsyncFile(file));
+	async_file->set_reply_task_runner(CurrentTaskRunner());
+	return async_file;
+}
+
+AsyncFile::AsyncFile(base::PlatformFile file) : file_(file)
+{
+}
+
+AsyncFile::~AsyncFile()
+{
+#if defined(OS_WIN)
+	::CloseHandle(file_);
+#else
+	IGNORE_EINTR(close(file_));
+#endif
+}
+
+void AsyncFile::Read(int64_t offset, size_t length, AsyncFileReadCallback callback)
+{
+	FileOperation *operation = new FileOperation;
+	operation->type = FileOperationType::kRead;
+	operation->file = this;
+	operation->offset = offset;
+	operation->buffer.resize(length);
+	operation->read_callback = std::move(callback);
+	operation->reply_task_runner = reply_task_runner();
+	if (length == 0)
+		CompleteOperation(operation, 0);
+	else
+		SubmitOperation(operation);
+}
+
+void AsyncFile::Write(int64_t offset, std::string data, AsyncFileCallback callback)
+{
+	FileOperation *operation = new FileOperation;
+	operation->type = FileOperationType::kWrite;
+	operation->file = this;
+	operation->offset = offset;
+	operation->buffer = std::move(data);
+	operation->callback = std::move(callback);
+	operation->reply_task_runner = reply_task_runner();
+	if (operation->buffer.empty())
+		CompleteOperation(operation, 0);
+	else
+		SubmitOperation(operation);
+}
+
+void AsyncFile::Flush(AsyncFileCallback callback)
+{
+	FileOperation *operation = new FileOperation;
+	operation->type = FileOperationType::kFlush;
+	operation->file = this;
+	operation->callback = std::move(callback);
+	operation->reply_task_runner = reply_task_runner();
+	SubmitOperation(operation);
+}
+
+void AsyncFile::set_reply_task_runner(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner)
+{
+	base::AutoLock lock(lock_);
+	reply_task_runner_ = task_runner;
+}
+
+scoped_refptr<base::SingleThreadTaskRunner> AsyncFile::reply_task_runner() const
+{
+	base::AutoLock lock(lock_);
+	return reply_task_runner_;
+}
+
+void AsyncOpenFile(const UTF8String &filepath, AsyncFile::Mode mode,
+	const std::function<void(scoped_refptr<AsyncFile> file)> &callback)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = CurrentTaskRunner();
+	GetAsyncFileService()->workers.PostTask([filepath, mode, callback, task_runner]() {
+		scoped_refptr<AsyncFile> file = AsyncFile::Open(filepath, mode);
+		if (file != nullptr)
+			file->set_reply_task_runner(task_runner);
+		if (callback)
+			PostReply(task_runner, [callback, file]() { callback(file); });
+	});
+}
+
+void AsyncWriteFile(const UTF8String &filepath, std::string data,
+	const std::function<void(int result)> &callback)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = CurrentTaskRunner();
+	auto shared_data = std::make_shared<std::string>(std::move(data));
+	GetAsyncFileService()->workers.PostTask([filepath, shared_data, callback, task_runner]() {
+		int result = NS_EXTENSION::WriteFile(filepath, *shared_data);
+		if (callback)
+			PostReply(task_runner, [callback, result]() { callback(result); });
+	});
+}
+
+void AsyncCopyFile(const UTF8String &from_path, const UTF8String &to_path,
+	const std::function<void(bool result)> &callback)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = CurrentTaskRunner();
+	GetAsyncFileService()->workers.PostTask([from_path, to_path, callback, task_runner]() {
+		bool result = NS_EXTENSION::CopyFile(from_path, to_path);
+		if (callback)
+			PostReply(task_runner, [callback, result]() { callback(result); });
+	});
+}
+
+void AsyncMoveFile(const UTF8String &from_path, const UTF8String &to_path,
+	const std::function<void(bool result)> &callback)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = CurrentTaskRunner();
+	GetAsyncFileService()->workers.PostTask([from_path, to_path, callback, task_runner]() {
+		bool result = NS_EXTENSION::MoveFile(from_path, to_path);
+		if (callback)
+			PostReply(task_runner, [callback, result]() { callback(result); });
+	});
+}
+
+const char* AsyncFileBackendName()
+{
+	return GetAsyncFileService()->backend->name();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,91 @@
+// asynchronous file reads and writes, completed by io_uring, IOCP or worker threads
+
+#ifndef __BASE_EXTENSION_ASYNC_FILE_H__
+#define __BASE_EXTENSION_ASYNC_FILE_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include "base/files/file.h"
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/file_util/utf8_file_util.h"
+
+EXTENSION_BEGIN_DECLS
+
+// |result| is the number of bytes transferred, or negative on failure:
+// -errno on POSIX and -GetLastError() on Windows
+typedef std::function<void(int64_t result)> AsyncFileCallback;
+typedef std::function<void(int64_t result, std::string data)> AsyncFileReadCallback;
+
+// A file whose reads, writes and flushes are queued and never block the
+// calling thread. Linux submits them to io_uring, Windows to an I/O completion
+// port, the other systems (and kernels without io_uring) run them on a few
+// worker threads.
+// Operations may complete in any order, the caller orders the writes which
+// overlap or depend on each other. The file is closed once the last reference
+// is dropped, pending operations hold one.
+class EXTENSION_EXPORT AsyncFile : public base::RefCountedThreadSafe<AsyncFile>
+{
+public:
+	enum Mode
+	{
+		kRead,			// an existing file
+		kWrite,			// created, or truncated if it exists
+		kReadWrite,		// created if it does not exist, not truncated
+	};
+
+	// Opens the file synchronously, nullptr on failure; see AsyncOpenFile.
+	// The callbacks are posted to the task runner of the calling thread.
+	static scoped_refptr<AsyncFile> Open(const UTF8String &filepath, Mode mode);
+
+	// Reads up to |length| bytes at |offset|, less only at the end of the file
+	void Read(int64_t offset, size_t length, AsyncFileReadCallback callback);
+	// Writes the whole |data| at |offset|, the buffer is kept until then
+	void Write(int64_t offset, std::string data, AsyncFileCallback callback);
+	// Flushes the written data to the disk, |result| is 0 on success
+	void Flush(AsyncFileCallback callback);
+
+	// A null task runner runs the callbacks on the completion thread, they
+	// must be short and must not block then
+	void set_reply_task_runner(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner);
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner() const;
+	base::PlatformFile platform_file() const { return file_; }
+
+private:
+	friend class base::RefCountedThreadSafe<AsyncFile>;
+
+	explicit AsyncFile(base::PlatformFile file);
+	~AsyncFile();
+
+	base::PlatformFile file_;
+	mutable base::Lock lock_;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner_;
+
+	DISALLOW_COPY_AND_ASSIGN(AsyncFile);
+};
+
+// The following run the synchronous functions of utf8_file_util on the worker
+// threads, |callback| is posted to the task runner of the calling thread or
+// run on the worker thread if it has none
+EXTENSION_EXPORT void AsyncOpenFile(const UTF8String &filepath, AsyncFile::Mode mode,
+	const std::function<void(scoped_refptr<AsyncFile> file)> &callback);
+// |result| is the one of WriteFile
+EXTENSION_EXPORT void AsyncWriteFile(const UTF8String &filepath, std::string data,
+	const std::function<void(int result)> &callback);
+EXTENSION_EXPORT void AsyncCopyFile(const UTF8String &from_path, const UTF8String &to_path,
+	const std::function<void(bool result)> &callback);
+EXTENSION_EXPORT void AsyncMoveFile(const UTF8String &from_path, const UTF8String &to_path,
+	const std::function<void(bool result)> &callback);
+
+// "io_uring", "iocp" or "threads"
+EXTENSION_EXPORT const char* AsyncFileBackendName();
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_ASYNC_FILE_H__
@@ -0,0 +1,742 @@
+// a durable FIFO queue of records in memory-mapped segment files
+
+#include "extension/file_util/persistent_queue.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "base/files/file_enumerator.h"
+#include "zlib/include/zlib.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include "extension/strings/string_util.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+
+const uint32_t kSegmentMagic	= 0x5153494E;	// "NISQ"
+const uint32_t kHeadMagic		= 0x4853494E;	// "NISH"
+const uint32_t kQueueVersion	= 1;
+// Written where a record does not fit, the reader goes on at the next segment
+const uint32_t kWrapMarker		= 0xFFFFFFFF;
+const size_t kSegmentHeaderSize	= 64;
+const size_t kRecordHeaderSize	= 16;
+const size_t kMinSegmentSize	= 64 * 1024;
+const size_t kMaxSegmentSize	= 1024 * 1024 * 1024;
+const char kSegmentExtension[]	= ".seg";
+const char kHeadFileName[]		= "head";
+
+struct SegmentHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t index;
+	uint64_t first_sequence;
+	uint64_t size;
+	// Of the fields above
+	uint32_t crc;
+	uint32_t reserved;
+};
+static_assert(sizeof(SegmentHeader) <= kSegmentHeaderSize, "segment header too large");
+
+// Records are 8 byte aligned, the payload follows
+struct RecordHeader
+{
+	uint32_t size;
+	// Of |size|, |sequence| and the payload
+	uint32_t crc;
+	uint64_t sequence;
+};
+static_assert(sizeof(RecordHeader) == kRecordHeaderSize, "record header size");
+
+// The head file has two of them, written in turn, the valid one of the
+// larger generation is the head
+struct HeadSlot
+{
+	uint32_t magic;
+	// Of the fields after it
+	uint32_t crc;
+	uint64_t generation;
+	uint64_t segment;
+	uint64_t offset;
+	uint64_t sequence;
+	uint64_t reserved[3];
+};
+static_assert(sizeof(HeadSlot) == 64, "head slot size");
+
+size_t RecordSize(size_t payload_size)
+{
+	return kRecordHeaderSize + ((payload_size + 7) & ~(size_t)7);
+}
+
+uint32_t Crc32(uint32_t crc, const void *data, size_t size)
+{
+	return (uint32_t)::crc32(crc, (const Bytef *)data, (uInt)size);
+}
+
+uint32_t RecordCrc(uint32_t size, uint64_t sequence, const void *data)
+{
+	uint32_t crc = Crc32(0, &size, sizeof(size));
+	crc = Crc32(crc, &sequence, sizeof(sequence));
+	return Crc32(crc, data, size);
+}
+
+uint32_t SegmentHeaderCrc(const SegmentHeader &header)
+{
+	return Crc32(0, &header, offsetof(SegmentHeader, crc));
+}
+
+uint32_t HeadSlotCrc(const HeadSlot &slot)
+{
+	return Crc32(0, &slot.generation, sizeof(HeadSlot) - offsetof(HeadSlot, generation));
+}
+
+// Clears the non-zero words of [offset, end), reading the zero pages of a
+// sparse file does not make them dirty
+void ZeroRange(char *data, size_t offset, size_t end)
+{
+	for (; offset < end && (offset & 7) != 0; offset++)
+		data[offset] = 0;
+	for (; offset + 8 <= end; offset += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + offset, sizeof(word));
+		if (word != 0)
+			memset(data + offset, 0, sizeof(word));
+	}
+	for (; offset < end; offset++)
+		data[offset] = 0;
+}
+
+}
+
+// A file mapped for reading and writing
+class PersistentQueue::MappedRegion
+{
+public:
+	MappedRegion() : data_(nullptr), size_(0)
+#if defined(OS_WIN)
+		, file_(INVALID_HANDLE_VALUE), mapping_(nullptr)
+#else
+		, fd_(-1)
+#endif
+	{
+	}
+	~MappedRegion() { Close(); }
+
+	// |size| 0 maps the existing file as it is, otherwise the file is created
+	// or truncated to |size| zero bytes
+	bool Open(const UTF8String &path, size_t size);
+	void Close();
+	// Writes the dirty pages of [offset, offset + length) to the disk
+	bool Flush(size_t offset, size_t length);
+
+	char* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	char *data_;
+	size_t size_;
+#if defined(OS_WIN)
+	HANDLE file_;
+	HANDLE mapping_;
+#else
+	int fd_;
+#endif
+};
+
+#if defined(OS_WIN)
+bool PersistentQueue::MappedRegion::Open(const UTF8String &path, size_t size)
+{
+	file_ = ::CreateFileW(UTF8ToUTF16(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+		nullptr, size == 0 ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (size != 0)
+	{
+		file_size.QuadPart = (LONGLONG)size;
+		if (!::SetFilePointerEx(file_, file_size, nullptr, FILE_BEGIN) || !::SetEndOfFile(file_))
+		{
+			Close();
+			return false;
+		}
+	}
+	else if (!::GetFileSizeEx(file_, &file_size) || file_size.QuadPart <= 0 || file_size.QuadPart > (LONGLONG)kMaxSegmentSize)
+	{
+		Close();
+		return false;
+	}
+	mapping_ = ::CreateFileMappingW(file_, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+	void *view = mapping_ != nullptr ? ::MapViewOfFile(mapping_, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+	if (view == nullptr)
+	{
+		Close();
+		return false;
+	}
+	data_ = (char *)view;
+	size_ = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void PersistentQueue::MappedRegion::Close()
+{
+	if (data_ != nullptr)
+		::UnmapViewOfFile(data_);
+	data_ = nullptr;
+	size_ = 0;
+	if (mapping_ != nullptr)
+		::CloseHandle(mapping_);
+	mapping_ = nullptr;
+	if (file_ != INVALID_HANDLE_VALUE)
+		::CloseHandle(file_);
+	file_ = INVALID_HANDLE_VALUE;
+}
+
+bool PersistentQueue::MappedRegion::Flush(size_t offset, size_t length)
+{
+	if (data_ == nullptr)
+		return false;
+	length = std::min(length, size_ - std::min(offset, size_));
+	// FlushViewOfFile only starts the writes, FlushFileBuffers waits for them
+	return (length == 0 || ::FlushViewOfFile(data_ + offset, length)) && ::FlushFileBuffers(file_);
+}
+#else
+bool PersistentQueue::MappedRegion::Open(const UTF8String &path, size_t size)
+{
+	fd_ = HANDLE_EINTR(open(path.c_str(), size == 0 ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR));
+	if (fd_ < 0)
+		return false;
+	if (size != 0)
+	{
+		// A sparse file, the pages are allocated as the records are written
+		if (HANDLE_EINTR(ftruncate(fd_, (off_t)size)) != 0)
+		{
+			Close();
+			return false;
+		}
+	}
+	else
+	{
+		struct stat st;
+		if (fstat(fd_, &st) != 0 || st.st_size <= 0 || st.st_size > (off_t)kMaxSegmentSize)
+		{
+			Close();
+			return false;
+		}
+		size = (size_t)st.st_size;
+	}
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (memory == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data_ = (char *)memory;
+	size_ = size;
+	return true;
+}
+
+void PersistentQueue::MappedRegion::Close()
+{
+	if (data_ != nullptr)
+		munmap(data_, size_);
+	data_ = nullptr;
+	size_ = 0;
+	if (fd_ >= 0)
+		close(fd_);
+	fd_ = -1;
+}
+
+bool PersistentQueue::MappedRegion::Flush(size_t offset, size_t length)
+{
+	if (data_ == nullptr)
+		return false;
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t begin = page_size > 0 ? offset - offset % (size_t)page_size : 0;
+	size_t end = std::min(offset + length, size_);
+	if (end <= begin)
+		return true;
+	return msync(data_ + begin, end - begin, MS_SYNC) == 0;
+}
+#endif
+
+struct PersistentQueue::Segment
+{
+	uint64_t index;
+	uint64_t first_sequence;
+	MappedRegion region;
+};
+
+PersistentQueue::PersistentQueue() : head_generation_(0)
+{
+}
+
+PersistentQueue::~PersistentQueue()
+{
+	Close();
+}
+
+bool PersistentQueue::Open(const UTF8String &directory, const PersistentQueueOptions &options)
+{
+	base::AutoLock auto_lock(lock_);
+	if (head_file_ != nullptr || directory.empty())
+		return false;
+	if (!FilePathIsExist(directory, true) && !NS_EXTENSION::CreateDirectory(directory))
+		return false;
+	directory_ = FilePathAsEndWithSeparator(directory);
+	options_ = options;
+	options_.segment_size = std::min(std::max(options_.segment_size, kMinSegmentSize), kMaxSegmentSize) & ~(size_t)7;
+
+	std::vector<uint64_t> indexes;
+	FileEnumerator enumerator(directory_, false, base::FileEnumerator::FILES, UTF8String("*") + kSegmentExtension);
+	for (base::FilePath path = enumerator.Next(); !path.empty(); path = enumerator.Next())
+	{
+		uint64_t index = 0;
+		char extension[8] = { 0 };
+		if (sscanf(path.BaseName().AsUTF8Unsafe().c_str(), "%16" SCNx64 "%7s", &index, extension) == 2 &&
+			index != 0 && strcmp(extension, kSegmentExtension) == 0)
+			indexes.push_back(index);
+	}
+	std::sort(indexes.begin(), indexes.end());
+	for (uint64_t index : indexes)
+	{
+		std::unique_ptr<Segment> segment = OpenSegment(index, 0, false);
+		if (segment == nullptr)
+		{
+			// Torn by a crash while being created, or corrupted
+			NS_EXTENSION::DeleteFile(SegmentPath(index));
+			continue;
+		}
+		if (!segments_.empty() && segments_.back()->index + 1 != index)
+		{
+			// The segments before a gap can not be reached
+			for (auto &dropped : segments_)
+				NS_EXTENSION::DeleteFile(SegmentPath(dropped->index));
+			segments_.clear();
+		}
+		segments_.push_back(std::move(segment));
+	}
+
+	head_file_.reset(new MappedRegion);
+	UTF8String head_path = directory_ + kHeadFileName;
+	bool head_loaded = FilePathIsExist(head_path, false) && head_file_->Open(head_path, 0) &&
+		head_file_->size() >= 2 * sizeof(HeadSlot) && LoadHead();
+	if (!head_loaded)
+	{
+		head_file_->Close();
+		if (!head_file_->Open(head_path, 2 * sizeof(HeadSlot)))
+		{
+			head_file_.reset();
+			segments_.clear();
+			return false;
+		}
+		head_generation_ = 0;
+	}
+
+	if (segments_.empty())
+	{
+		uint64_t index = head_loaded ? std::max<uint64_t>(head_.segment, 1) : 1;
+		uint64_t sequence = head_loaded ? std::max<uint64_t>(head_.sequence, 1) : 1;
+		std::unique_ptr<Segment> segment = OpenSegment(index, sequence, true);
+		if (segment == nullptr)
+		{
+			head_file_.reset();
+			return false;
+		}
+		segments_.push_back(std::move(segment));
+		head_loaded = false;
+	}
+	if (!head_loaded || head_.segment < segments_.front()->index || head_.segment > segments_.back()->index)
+	{
+		// A new queue, or the segment of the head is gone: from the oldest record
+		head_.segment = segments_.front()->index;
+		head_.offset = kSegmentHeaderSize;
+		head_.sequence = segments_.front()->first_sequence;
+	}
+	DropConsumedSegments();
+	RecoverTail();
+	if (head_.segment == tail_.segment && head_.offset >= tail_.offset)
+		head_ = tail_;
+	read_end_ = head_;
+	StoreHead();
+	return true;
+}
+
+void PersistentQueue::Close()
+{
+	base::AutoLock auto_lock(lock_);
+	segments_.clear();
+	head_file_.reset();
+	head_generation_ = 0;
+	head_ = tail_ = read_end_ = Position();
+}
+
+bool PersistentQueue::IsOpen() const
+{
+	base::AutoLock auto_lock(lock_);
+	return head_file_ != nullptr;
+}
+
+UTF8String PersistentQueue::SegmentPath(uint64_t index) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 "%s", index, kSegmentExtension);
+	return directory_ + name;
+}
+
+std::unique_ptr<PersistentQueue::Segment> PersistentQueue::OpenSegment(uint64_t index, uint64_t first_sequence, bool create)
+{
+	std::unique_ptr<Segment> segment(new Segment);
+	segment->index = index;
+	if (!segment->region.Open(SegmentPath(index), create ? options_.segment_size : 0) ||
+		segment->region.size() < kSegmentHeaderSize + kRecordHeaderSize)
+		return nullptr;
+
+	SegmentHeader *header = (SegmentHeader *)segment->region.data();
+	if (create)
+	{
+		SegmentHeader value;
+		memset(&value, 0, sizeof(value));
+		value.magic = kSegmentMagic;
+		value.version = kQueueVersion;
+		value.index = index;
+		value.first_sequence = first_sequence;
+		value.size = segment->region.size();
+		value.crc = SegmentHeaderCrc(value);
+		// The magic last, a segment without it is torn
+		memcpy((char *)header + sizeof(value.magic), (const char *)&value + sizeof(value.magic), sizeof(value) - sizeof(value.magic));
+		header->magic = kSegmentMagic;
+	}
+	else if (header->magic != kSegmentMagic || header->version != kQueueVersion || header->index != index ||
+		header->size != segment->region.size() || header->first_sequence == 0 || header->crc != SegmentHeaderCrc(*header))
+	{
+		return nullptr;
+	}
+	segment->first_sequence = header->first_sequence;
+	return segment;
+}
+
+bool PersistentQueue::LoadHead()
+{
+	const HeadSlot *slots = (const HeadSlot *)head_file_->data();
+	const HeadSlot *head = nullptr;
+	for (int i = 0; i < 2; i++)
+	{
+		if (slots[i].magic == kHeadMagic && slots[i].crc == HeadSlotCrc(slots[i]) &&
+			(head == nullptr || slots[i].generation > head->generation))
+			head = &slots[i];
+	}
+	if (head == nullptr)
+		return false;
+	head_generation_ = head->generation;
+	head_.segment = head->segment;
+	head_.offset = (size_t)head->offset;
+	head_.sequence = head->sequence;
+	return true;
+}
+
+void PersistentQueue::StoreHead()
+{
+	// The other slot keeps the last head if this write is torn
+	head_generation_++;
+	HeadSlot *slot = (HeadSlot *)head_file_->data() + (head_generation_ & 1);
+	HeadSlot value;
+	memset(&value, 0, sizeof(value));
+	value.magic = kHeadMagic;
+	value.generation = head_generation_;
+	value.segment = head_.segment;
+	value.offset = head_.offset;
+	value.sequence = head_.sequence;
+	value.crc = HeadSlotCrc(value);
+	memcpy(slot, &value, sizeof(value));
+}
+
+void PersistentQueue::RecoverTail()
+{
+	Segment *segment = segments_.back().get();
+	char *data = segment->region.data();
+	size_t size = segment->region.size();
+	tail_.segment = segment->index;
+	tail_.offset = kSegmentHeaderSize;
+	tail_.sequence = segment->first_sequence;
+	while (tail_.offset + kRecordHeaderSize <= size)
+	{
+		RecordHeader header;
+		memcpy(&header, data + tail_.offset, sizeof(header));
+		if (header.size == kWrapMarker && header.sequence == tail_.sequence)
+		{
+			// Full, the next segment was not created yet
+			tail_.offset = size;
+			return;
+		}
+		if (header.size == 0 || header.size > size - tail_.offset - kRecordHeaderSize ||
+			header.sequence != tail_.sequence ||
+			header.crc != RecordCrc(header.size, header.sequence, data + tail_.offset + kRecordHeaderSize))
+			break;
+		tail_.offset += RecordSize(header.size);
+		tail_.sequence++;
+	}
+	// A torn record, or what a power loss left behind it, must not show up
+	// again once the records written over it line up with it
+	if (tail_.offset < size)
+		ZeroRange(data, tail_.offset, size);
+}
+
+bool PersistentQueue::Normalize(Position &position, uint32_t &size) const
+{
+	while (!(position.segment == tail_.segment && position.offset >= tail_.offset))
+	{
+		const Segment *segment = segments_[(size_t)(position.segment - segments_.front()->index)].get();
+		const char *data = segment->region.data();
+		size_t segment_size = segment->region.size();
+		if (position.offset + kRecordHeaderSize <= segment_size)
+		{
+			RecordHeader header;
+			memcpy(&header, data + position.offset, sizeof(header));
+			if (header.size != kWrapMarker && header.size != 0 &&
+				header.size <= segment_size - position.offset - kRecordHeaderSize &&
+				header.sequence == position.sequence &&
+				header.crc == RecordCrc(header.size, header.sequence, data + position.offset + kRecordHeaderSize))
+			{
+				size = header.size;
+				return true;
+			}
+		}
+		// The end of the segment, or a corrupted record which skips the rest of it
+		if (position.segment == tail_.segment)
+			break;
+		const Segment *next = segments_[(size_t)(position.segment + 1 - segments_.front()->index)].get();
+		position.segment = next->index;
+		position.offset = kSegmentHeaderSize;
+		position.sequence = std::max(position.sequence, next->first_sequence);
+	}
+	position = tail_;
+	return false;
+}
+
+PersistentQueue::Position PersistentQueue::Seek(uint64_t sequence) const
+{
+	Position position = head_;
+	if (read_end_.sequence >= head_.sequence && read_end_.sequence <= sequence)
+		position = read_end_;
+	// Jumps to the segment of |sequence| instead of walking its records
+	for (auto iter = segments_.rbegin(); iter != segments_.rend() && (*iter)->index > position.segment; ++iter)
+	{
+		if ((*iter)->first_sequence <= sequence)
+		{
+			position.segment = (*iter)->index;
+			position.offset = kSegmentHeaderSize;
+			position.sequence = (*iter)->first_sequence;
+			break;
+		}
+	}
+	uint32_t size = 0;
+	while (position.sequence < sequence && Normalize(position, size))
+	{
+		position.offset += RecordSize(size);
+		position.sequence++;
+	}
+	return position;
+}
+
+bool PersistentQueue::Push(const void *data, size_t size, uint64_t *sequence)
+{
+	base::AutoLock auto_lock(lock_);
+	if (head_file_ == nullptr || size == 0 || size > max_record_size())
+		return false;
+	Position start = tail_;
+	if (sequence != nullptr)
+		*sequence = tail_.sequence;
+	if (!AppendLocked(data, size))
+		return false;
+	if (options_.sync_on_write)
+	{
+		if (start.segment != tail_.segment)
+			SyncLocked();
+		else
+			segments_.back()->region.Flush(start.offset, tail_.offset - start.offset);
+	}
+	return true;
+}
+
+bool PersistentQueue::PushBatch(const std::vector<std::string> &records)
+{
+	base::AutoLock auto_lock(lock_);
+	if (head_file_ == nullptr)
+		return false;
+	for (const std::string &record : records)
+	{
+		if (record.empty() || record.size() > max_record_size())
+			return false;
+	}
+	Position start = tail_;
+	for (const std::string &record : records)
+	{
+		if (AppendLocked(record.data(), record.size()))
+			continue;
+		// None of them: the segments created for the batch are deleted, and
+		// the records written to the first one are cleared
+		while (segments_.back()->index > start.segment)
+		{
+			uint64_t index = segments_.back()->index;
+			segments_.pop_back();
+			NS_EXTENSION::DeleteFile(SegmentPath(index));
+		}
+		Segment *segment = segments_.back().get();
+		ZeroRange(segment->region.data(), start.offset,
+			tail_.segment == start.segment ? tail_.offset : segment->region.size());
+		tail_ = start;
+		return false;
+	}
+	if (options_.sync_on_write)
+		SyncLocked();
+	return true;
+}
+
+bool PersistentQueue::AppendLocked(const void *data, size_t size)
+{
+	size_t record_size = RecordSize(size);
+	Segment *segment = segments_.back().get();
+	if (tail_.offset + record_size > segment->region.size())
+	{
+		std::unique_ptr<Segment> next = OpenSegment(segment->index + 1, tail_.sequence, true);
+		if (next == nullptr)
+			return false;
+		if (tail_.offset + kRecordHeaderSize <= segment->region.size())
+		{
+			RecordHeader marker = { kWrapMarker, 0, tail_.sequence };
+			memcpy(segment->region.data() + tail_.offset, &marker, sizeof(marker));
+		}
+		segment = next.get();
+		segments_.push_back(std::move(next));
+		tail_.segment = segment->index;
+		tail_.offset = kSegmentHeaderSize;
+	}
+
+	// The payload first, the size last: a record torn by a crash is not valid
+	char *record = segment->region.data() + tail_.offset;
+	memcpy(record + kRecordHeaderSize, data, size);
+	RecordHeader header = { (uint32_t)size, RecordCrc((uint32_t)size, tail_.sequence, data), tail_.sequence };
+	memcpy(record + offsetof(RecordHeader, crc), &header.crc, sizeof(header.crc) + sizeof(header.sequence));
+	memcpy(record, &header.size, sizeof(header.size));
+	tail_.offset += record_size;
+	tail_.sequence++;
+	return true;
+}
+
+size_t PersistentQueue::Read(uint64_t from_sequence, size_t max_records, size_t max_bytes, const RecordHandler &handler)
+{
+	base::AutoLock auto_lock(lock_);
+	if (head_file_ == nullptr)
+		return 0;
+	Position position = Seek(std::max(from_sequence, head_.sequence));
+	size_t count = 0;
+	size_t bytes = 0;
+	uint32_t size = 0;
+	while (count < max_records && Normalize(position, size))
+	{
+		if (count > 0 && bytes + size > max_bytes)
+			break;
+		const char *data = segments_[(size_t)(position.segment - segments_.front()->index)]->region.data();
+		handler(position.sequence, data + position.offset + kRecordHeaderSize, size);
+		bytes += size;
+		count++;
+		position.offset += RecordSize(size);
+		position.sequence++;
+	}
+	read_end_ = position;
+	return count;
+}
+
+bool PersistentQueue::Commit(uint64_t sequence)
+{
+	base::AutoLock auto_lock(lock_);
+	if (head_file_ == nullptr)
+		return false;
+	if (sequence < head_.sequence)
+		return true;
+	head_ = Seek(sequence + 1);
+	StoreHead();
+	if (options_.sync_on_write)
+		head_file_->Flush(0, head_file_->size());
+	DropConsumedSegments();
+	return true;
+}
+
+size_t PersistentQueue::Consume(size_t max_records, const RecordHandler &handler)
+{
+	uint64_t last = 0;
+	size_t count = Read(0, max_records, SIZE_MAX, [&handler, &last](uint64_t sequence, const char *data, size_t size) {
+		handler(sequence, data, size);
+		last = sequence;
+	});
+	if (count > 0)
+		Commit(last);
+	return count;
+}
+
+void PersistentQueue::DropConsumedSegments()
+{
+	while (segments_.size() > 1 && segments_.front()->index < head_.segment)
+	{
+		uint64_t index = segments_.front()->index;
+		segments_.pop_front();
+		NS_EXTENSION::DeleteFile(SegmentPath(index));
+	}
+}
+
+uint64_t PersistentQueue::head_sequence() const
+{
+	base::AutoLock auto_lock(lock_);
+	return head_.sequence;
+}
+
+uint64_t PersistentQueue::tail_sequence() const
+{
+	base::AutoLock auto_lock(lock_);
+	return tail_.sequence;
+}
+
+uint64_t PersistentQueue::size() const
+{
+	base::AutoLock auto_lock(lock_);
+	return tail_.sequence - head_.sequence;
+}
+
+size_t PersistentQueue::max_record_size() const
+{
+	return options_.segment_size - kSegmentHeaderSize - kRecordHeaderSize;
+}
+
+bool PersistentQueue::Sync()
+{
+	base::AutoLock auto_lock(lock_);
+	return head_file_ != nullptr && SyncLocked();
+}
+
+bool PersistentQueue::SyncLocked()
+{
+	// The consumed part of the head segment is not written again
+	bool ret = true;
+	for (auto &segment : segments_)
+	{
+		size_t offset = segment->index == head_.segment ? head_.offset : 0;
+		ret = segment->region.Flush(offset, segment->region.size() - std::min(offset, segment->region.size())) && ret;
+	}
+	return head_file_->Flush(0, head_file_->size()) && ret;
+}
+
+EXTENSION_END_DECLS
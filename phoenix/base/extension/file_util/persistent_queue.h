@@ -0,0 +1,144 @@
+// a durable FIFO queue of records in memory-mapped segment files
+
+#ifndef __BASE_EXTENSION_PERSISTENT_QUEUE_H__
+#define __BASE_EXTENSION_PERSISTENT_QUEUE_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/file_util/utf8_file_util.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct PersistentQueueOptions
+{
+	PersistentQueueOptions() : segment_size(8 * 1024 * 1024), sync_on_write(false) {}
+
+	// Size of a segment file, a record is at most this less 80 bytes.
+	// The segments written before keep their own size.
+	size_t segment_size;
+	// Flushes every Push() and Commit() to the disk. Without it the records
+	// survive a crash of the process, the system writes them back later, and
+	// Sync() makes them survive a power loss.
+	bool sync_on_write;
+};
+
+// A queue of the messages and events waiting to be delivered, kept in the
+// files of |directory| instead of a database table:
+//   0000000000000001.seg ...	segments of the records, appended in order
+//   head					the consumed position, two alternating slots
+// A push appends the record to the mapped tail segment, a commit moves the
+// head; neither updates an index nor syncs the file unless asked, and a
+// segment file is deleted once it is consumed.
+// Every record carries its sequence and a CRC-32. Opening scans the last
+// segment for the tail, so a record torn by a crash is dropped with the ones
+// after it, and a corrupted record in an older segment skips the rest of that
+// segment. A torn head slot falls back to the other one, which may deliver
+// the last batch again: the consumer should be idempotent by the sequence.
+// Records are read in place from the mapping, so |data| of RecordHandler is
+// valid only during the call. Thread safe; the handlers run under the lock
+// of the queue and must not call it back. One process opens a directory at
+// a time.
+class EXTENSION_EXPORT PersistentQueue
+{
+public:
+	// |sequence| starts at 1 and increases by 1 for each record pushed
+	typedef std::function<void(uint64_t sequence, const char *data, size_t size)> RecordHandler;
+
+	PersistentQueue();
+	~PersistentQueue();
+
+	// Opens the queue in |directory|, created if it does not exist
+	bool Open(const UTF8String &directory, const PersistentQueueOptions &options = PersistentQueueOptions());
+	void Close();
+	bool IsOpen() const;
+
+	// Appends a record, |sequence| is set to its sequence
+	bool Push(const void *data, size_t size, uint64_t *sequence = nullptr);
+	bool Push(const std::string &data, uint64_t *sequence = nullptr) { return Push(data.data(), data.size(), sequence); }
+	// Appends all the |records| or none of them, with a single sync
+	bool PushBatch(const std::vector<std::string> &records);
+
+	// Calls |handler| for up to |max_records| records from |from_sequence|,
+	// stopping before the one exceeding |max_bytes| in total, at least one is
+	// read. 0 or a consumed sequence reads from the head. The records stay in
+	// the queue, e.g. to send a batch and Commit() once it is acknowledged,
+	// or to send the next batch before that. Returns the records read.
+	size_t Read(uint64_t from_sequence, size_t max_records, size_t max_bytes, const RecordHandler &handler);
+	// Consumes the records up to and including |sequence|
+	bool Commit(uint64_t sequence);
+	// Reads up to |max_records| from the head and consumes them
+	size_t Consume(size_t max_records, const RecordHandler &handler);
+
+	// The sequence of the first record not consumed, equal to
+	// tail_sequence() if the queue is empty
+	uint64_t head_sequence() const;
+	// The sequence the next pushed record gets
+	uint64_t tail_sequence() const;
+	// Records not consumed, including the ones lost to corruption
+	uint64_t size() const;
+	bool empty() const { return size() == 0; }
+	size_t max_record_size() const;
+
+	// Flushes the segments and the head to the disk
+	bool Sync();
+
+private:
+	class MappedRegion;
+	struct Segment;
+	// A record in a segment, |segment| indexes |segments_|
+	struct Position
+	{
+		Position() : segment(0), offset(0), sequence(0) {}
+
+		size_t segment;
+		size_t offset;
+		uint64_t sequence;
+	};
+
+	// Maps segment |index| of |directory_|, creating it if |create|
+	std::unique_ptr<Segment> OpenSegment(uint64_t index, uint64_t first_sequence, bool create);
+	UTF8String SegmentPath(uint64_t index) const;
+	// Finds the end of the valid records of the last segment
+	void RecoverTail();
+	bool LoadHead();
+	void StoreHead();
+	// Advances to the next record if the one at |position| is not valid,
+	// false at the tail; |size| is of the payload at |position| then
+	bool Normalize(Position &position, uint32_t &size) const;
+	// Position of |sequence|, which is between the head and the tail
+	Position Seek(uint64_t sequence) const;
+	bool AppendLocked(const void *data, size_t size);
+	// Deletes the segments before the one of the head
+	void DropConsumedSegments();
+	bool SyncLocked();
+
+	mutable base::Lock lock_;
+	UTF8String directory_;
+	PersistentQueueOptions options_;
+	std::deque<std::unique_ptr<Segment>> segments_;
+	std::unique_ptr<MappedRegion> head_file_;
+	uint64_t head_generation_;
+	Position head_;
+	// The offset in the last segment and the sequence to append at
+	Position tail_;
+	// Where the last Read() stopped, so that a batch following it or the
+	// commit of it does not scan from the head
+	Position read_end_;
+
+	DISALLOW_COPY_AND_ASSIGN(PersistentQueue);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_PERSISTENT_QUEUE_H__
@@ -4,7 +4,30 @@
 #include "extension/file_util/utf8_file_util.h"
 #include "extension/strings/string_util.h"
 #include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/md5.h"
+#include <memory>
+#if defined(OS_WIN)
+#include <windows.h>
+#include <winioctl.h>
+#include "base/win/scoped_handle.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#endif
+#if defined(OS_MACOSX) || defined(OS_IOS)
+#include <sys/clonefile.h>
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 EXTENSION_BEGIN_DECLS
 
@@ -222,26 +245,44 @@ bool ParsePathComponents(const UTF16CharType *PathChar,std::list<UTF16String> &c
 		components);
 }
 #endif
-void CalculateFileMd5(const UTF8String &file_path, UTF8String &md5_value)
+static void CalculateFileMd5Buffered(const UTF8String &file_path, UTF8String &md5_value)
 {
-	char buffer[1024];
+	// Large reads, the length is passed as the data may contain '\0'
+	const size_t kBufferSize = 1024 * 1024;
 	FILE* fp = NS_EXTENSION::OpenFile(file_path, "rb");
 	if (fp == NULL)
 		return;
+	std::unique_ptr<char[]> buffer(new char[kBufferSize]);
 	base::MD5Context mm;
 	base::MD5Init(&mm);
-	int len = 0;
-	while (!feof(fp))
+	size_t len = 0;
+	while ((len = fread(buffer.get(), sizeof(char), kBufferSize, fp)) > 0)
+		base::MD5Update(&mm, base::StringPiece(buffer.get(), len));
+	NS_EXTENSION::CloseFile(fp);
+	base::MD5Digest md5;
+	base::MD5Final(&md5, &mm);
+	constexpr int md5_length = 16;
+	BinaryToHexString(md5.a, md5_length, md5_value);
+}
+void CalculateFileMd5(const UTF8String &file_path, UTF8String &md5_value)
+{
+	// Hashed straight from the mapped file, the pages hashed are released as it goes
+	// so a large file does not stay in the working set
+	const size_t kChunkSize = 4 * 1024 * 1024;
+	MappedFile file;
+	if (!file.Open(file_path, MappedFile::kSequential, false))
 	{
-		memset(buffer, 0, 1024 * sizeof(char));
-		if ((int)fread(buffer, sizeof(char), 1024, fp) > 0)
-		{
-			base::MD5Update(&mm, buffer);			
-			continue;
-		}
-		break;
+		CalculateFileMd5Buffered(file_path, md5_value);
+		return;
+	}
+	base::MD5Context mm;
+	base::MD5Init(&mm);
+	for (size_t offset = 0; offset < file.length(); offset += kChunkSize)
+	{
+		size_t len = file.length() - offset < kChunkSize ? file.length() - offset : kChunkSize;
+		base::MD5Update(&mm, base::StringPiece(reinterpret_cast<const char *>(file.data()) + offset, len));
+		file.Release(offset, len);
 	}
-	NS_EXTENSION::CloseFile(fp);
 	base::MD5Digest md5;
 	base::MD5Final(&md5, &mm);
 	constexpr int md5_length = 16;
@@ -357,8 +398,183 @@ bool CloseFile(FILE* file)
 	return base::CloseFile(file);
 }
     
+#if defined(OS_WIN) && defined(FSCTL_DUPLICATE_EXTENTS_TO_FILE)
+// Block cloning of ReFS: the copy shares the clusters of the source until
+// either of them is written. False if the volume does not support it.
+static bool CloneFileBlocks(const UTF16String &from_path, const UTF16String &to_path)
+{
+	base::win::ScopedHandle source(::CreateFileW((const wchar_t *)from_path.c_str(), GENERIC_READ,
+		FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!source.IsValid())
+		return false;
+	DWORD fs_flags = 0;
+	if (!::GetVolumeInformationByHandleW(source.Get(), NULL, 0, NULL, NULL, &fs_flags, NULL, 0) ||
+		(fs_flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) == 0)
+		return false;
+	BY_HANDLE_FILE_INFORMATION info;
+	LARGE_INTEGER size;
+	wchar_t volume[MAX_PATH];
+	DWORD sectors_per_cluster = 0, bytes_per_sector = 0, free_clusters = 0, total_clusters = 0;
+	if (!::GetFileInformationByHandle(source.Get(), &info) || !::GetFileSizeEx(source.Get(), &size) ||
+		!::GetVolumePathNameW((const wchar_t *)from_path.c_str(), volume, MAX_PATH) ||
+		!::GetDiskFreeSpaceW(volume, &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters))
+		return false;
+
+	base::win::ScopedHandle target(::CreateFileW((const wchar_t *)to_path.c_str(), GENERIC_READ | GENERIC_WRITE | DELETE,
+		0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!target.IsValid())
+		return false;
+	DWORD bytes = 0;
+	bool cloned = true;
+	if ((info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0)
+		cloned = !!::DeviceIoControl(target.Get(), FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytes, NULL);
+	FILE_END_OF_FILE_INFO end_of_file;
+	end_of_file.EndOfFile = size;
+	cloned = cloned && ::SetFileInformationByHandle(target.Get(), FileEndOfFileInfo, &end_of_file, sizeof(end_of_file));
+	// The ranges are whole clusters, at most 4 GB each
+	const int64_t cluster = (int64_t)sectors_per_cluster * bytes_per_sector;
+	const int64_t kMaxCloneLength = 1LL << 30;
+	int64_t aligned_size = (size.QuadPart + cluster - 1) / cluster * cluster;
+	for (int64_t offset = 0; cloned && offset < aligned_size; offset += kMaxCloneLength)
+	{
+		DUPLICATE_EXTENTS_DATA extents;
+		extents.FileHandle = source.Get();
+		extents.SourceFileOffset.QuadPart = offset;
+		extents.TargetFileOffset.QuadPart = offset;
+		extents.ByteCount.QuadPart = aligned_size - offset < kMaxCloneLength ? aligned_size - offset : kMaxCloneLength;
+		cloned = !!::DeviceIoControl(target.Get(), FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents),
+			NULL, 0, &bytes, NULL);
+	}
+	if (!cloned)
+	{
+		// Removed when closed, the caller copies it the usual way
+		FILE_DISPOSITION_INFO disposition;
+		disposition.DeleteFile = TRUE;
+		::SetFileInformationByHandle(target.Get(), FileDispositionInfo, &disposition, sizeof(disposition));
+	}
+	return cloned;
+}
+#elif defined(OS_POSIX) && !defined(OS_MACOSX) && !defined(OS_IOS)
+// Errors of the system copies meaning "not supported here", the next way is
+// tried from the current offsets
+static bool IsCopyUnsupported(int error)
+{
+	return error == ENOSYS || error == EINVAL || error == EXDEV || error == EOPNOTSUPP ||
+		error == ENOTSUP || error == EPERM || error == ETXTBSY;
+}
+
+// Copies |in| of |size| bytes to |out|: a reflink, then copy_file_range and
+// sendfile, which copy in the kernel, then a large buffer loop.
+// Android only takes sendfile, seccomp kills the applications calling the
+// newer syscalls on some versions.
+// The kernel copies stop at |size|, some kernels return 0 at once for the
+// pseudo files (size 0 too), the buffer loop reads them to their end.
+static bool CopyFileContents(int in, int out, int64_t size)
+{
+	int64_t total = 0;
+#if defined(OS_LINUX) && !defined(OS_ANDROID)
+#if defined(FICLONE)
+	// Btrfs, XFS and others share the extents of the source
+	if (size > 0 && ioctl(out, FICLONE, in) == 0)
+		return true;
+#endif
+#if defined(__NR_copy_file_range)
+	while (total < size)
+	{
+		ssize_t copied = syscall(__NR_copy_file_range, in, NULL, out, NULL, (size_t)1 << 30, 0);
+		if (copied == 0)
+			break;
+		if (copied > 0)
+		{
+			total += copied;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (!IsCopyUnsupported(errno))
+			return false;
+		break;
+	}
+#endif
+#endif
+	while (total < size)
+	{
+		ssize_t copied = sendfile(out, in, NULL, (size_t)1 << 30);
+		if (copied == 0)
+			break;
+		if (copied > 0)
+		{
+			total += copied;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (!IsCopyUnsupported(errno))
+			return false;
+		break;
+	}
+
+	const size_t kBufferSize = 1024 * 1024;
+	std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+	for (;;)
+	{
+		ssize_t bytes_read = HANDLE_EINTR(read(in, buffer.get(), kBufferSize));
+		if (bytes_read < 0)
+			return false;
+		if (bytes_read == 0)
+			return true;
+		for (ssize_t written = 0; written < bytes_read;)
+		{
+			ssize_t ret = HANDLE_EINTR(write(out, buffer.get() + written, bytes_read - written));
+			if (ret < 0)
+				return false;
+			written += ret;
+		}
+	}
+}
+#endif
+
 bool CopyFile(const UTF8String &from_path, const UTF8String &to_path)
 {
+	// The fast ways are taken for a regular file, base::CopyFile does the rest
+#if defined(OS_WIN) && defined(FSCTL_DUPLICATE_EXTENTS_TO_FILE)
+	if (CloneFileBlocks(NS_EXTENSION::UTF8ToUTF16(from_path), NS_EXTENSION::UTF8ToUTF16(to_path)))
+		return true;
+#elif defined(OS_MACOSX) || defined(OS_IOS)
+	// APFS clones the file at once; the target must not exist then
+	if (__builtin_available(macOS 10.12, iOS 10.0, *))
+	{
+		struct stat from_info;
+		if (stat(from_path.c_str(), &from_info) == 0 && S_ISREG(from_info.st_mode))
+		{
+			if (unlink(to_path.c_str()) != 0 && errno != ENOENT)
+				return false;
+			if (clonefile(from_path.c_str(), to_path.c_str(), CLONE_NOFOLLOW) == 0)
+				return true;
+		}
+	}
+#elif defined(OS_POSIX)
+	int in = HANDLE_EINTR(open(from_path.c_str(), O_RDONLY | O_CLOEXEC));
+	if (in >= 0)
+	{
+		struct stat from_info;
+		if (fstat(in, &from_info) == 0 && S_ISREG(from_info.st_mode))
+		{
+			// The mode of base::File, which base::CopyFile creates the target with
+			int out = HANDLE_EINTR(open(to_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+			if (out < 0)
+			{
+				IGNORE_EINTR(close(in));
+				return false;
+			}
+			bool copied = CopyFileContents(in, out, (int64_t)from_info.st_size);
+			copied = IGNORE_EINTR(close(out)) == 0 && copied;
+			IGNORE_EINTR(close(in));
+			return copied;
+		}
+		IGNORE_EINTR(close(in));
+	}
+#endif
 	return base::CopyFile(base::FilePath::FromUTF8Unsafe(from_path), base::FilePath::FromUTF8Unsafe(to_path));
 }
 #if defined(OS_WIN)
@@ -370,7 +586,17 @@ bool CopyFile(const UTF16String &from_path, const UTF16String &to_path)
 // Moves a single file.
 bool MoveFile(const UTF8String &from_path, const UTF8String &to_path)
 {
-	return base::Move(base::FilePath::FromUTF8Unsafe(from_path), base::FilePath::FromUTF8Unsafe(to_path));
+	base::FilePath from = base::FilePath::FromUTF8Unsafe(from_path);
+	base::FilePath to = base::FilePath::FromUTF8Unsafe(to_path);
+#if defined(OS_POSIX)
+	// Across the file systems base::Move copies with a small buffer loop,
+	// a single file takes CopyFile above instead
+	if (rename(from_path.c_str(), to_path.c_str()) == 0)
+		return true;
+	if (errno == EXDEV && !base::DirectoryExists(from))
+		return CopyFile(from_path, to_path) && base::DeleteFile(from, false);
+#endif
+	return base::Move(from, to);
 }
 #if defined(OS_WIN)
 bool MoveFile(const UTF16String &from_path, const UTF16String &to_path)
@@ -401,6 +627,111 @@ int64_t GetFileSize(const UTF16String &filepath)
 	return GetFileSize(NS_EXTENSION::UTF16ToUTF8(filepath));
 }
 #endif
+MappedFile::MappedFile() : data_(nullptr), length_(0), valid_(false)
+{
+}
+MappedFile::~MappedFile()
+{
+	Close();
+}
+bool MappedFile::Open(const UTF8String &filepath, AccessHint hint, bool read_on_failure)
+{
+	Close();
+	base::FilePath path = base::FilePath::FromUTF8Unsafe(filepath);
+	int64_t size = NS_EXTENSION::GetFileSize(filepath);
+	if (size < 0)
+		return false;
+	// An empty file cannot be mapped
+	if (size == 0)
+	{
+		valid_ = base::PathExists(path);
+		data_ = reinterpret_cast<const uint8_t *>(buffer_.data());
+		return valid_;
+	}
+	std::unique_ptr<base::MemoryMappedFile> mapped(new base::MemoryMappedFile);
+	if (mapped->Initialize(path))
+	{
+		mapped_ = std::move(mapped);
+		data_ = mapped_->data();
+		length_ = mapped_->length();
+		valid_ = true;
+#if defined(OS_POSIX)
+		if (hint != kNormal)
+			madvise(const_cast<uint8_t *>(data_), length_, hint == kSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+		return true;
+	}
+	if (!read_on_failure || !base::ReadFileToString(path, &buffer_))
+		return false;
+	data_ = reinterpret_cast<const uint8_t *>(buffer_.data());
+	length_ = buffer_.size();
+	valid_ = true;
+	return true;
+}
+#if defined(OS_WIN)
+bool MappedFile::Open(const UTF16String &filepath, AccessHint hint, bool read_on_failure)
+{
+	return Open(NS_EXTENSION::UTF16ToUTF8(filepath), hint, read_on_failure);
+}
+#endif
+void MappedFile::Close()
+{
+	mapped_.reset();
+	std::string().swap(buffer_);
+	data_ = nullptr;
+	length_ = 0;
+	valid_ = false;
+}
+bool MappedFile::IsMapped() const
+{
+	return mapped_ != nullptr;
+}
+void MappedFile::Prefetch(size_t offset, size_t length) const
+{
+	if (!IsMapped() || offset >= length_)
+		return;
+	if (length > length_ - offset)
+		length = length_ - offset;
+#if defined(OS_WIN)
+	// PrefetchVirtualMemory is only available since Windows 8
+	typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+	static PrefetchVirtualMemoryFunc prefetch = reinterpret_cast<PrefetchVirtualMemoryFunc>(
+		::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+	if (prefetch == nullptr)
+		return;
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t *>(data_ + offset);
+	range.NumberOfBytes = length;
+	prefetch(::GetCurrentProcess(), 1, &range, 0);
+#else
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = reinterpret_cast<uintptr_t>(data_ + offset) & ~(uintptr_t)(page_size - 1);
+	uintptr_t end = reinterpret_cast<uintptr_t>(data_ + offset + length);
+	madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
+void MappedFile::Release(size_t offset, size_t length) const
+{
+	if (!IsMapped() || offset >= length_)
+		return;
+	if (length > length_ - offset)
+		length = length_ - offset;
+#if defined(OS_WIN)
+	// Unlocking pages that are not locked fails but removes them from the working set
+	::VirtualUnlock(const_cast<uint8_t *>(data_ + offset), length);
+#else
+	// Only whole pages inside the range, the neighbours may still be in use
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (reinterpret_cast<uintptr_t>(data_ + offset) + page_size - 1) & ~(uintptr_t)(page_size - 1);
+	uintptr_t end = reinterpret_cast<uintptr_t>(data_ + offset + length);
+	if (offset + length == length_)
+		end = (end + page_size - 1) & ~(uintptr_t)(page_size - 1);
+	else
+		end &= ~(uintptr_t)(page_size - 1);
+	if (end > begin)
+		madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
 ExtensionFile ScopedFileTraits::InvalidValue() 
 { 
 	return nullptr; 
@@ -10,6 +10,13 @@
 #include "google_base/base/scoped_generic.h"
 #include "google_base/base/files/file_enumerator.h"
 #include <list>
+#include <memory>
+#include <string_view>
+
+namespace base
+{
+class MemoryMappedFile;
+}
 
 EXTENSION_BEGIN_DECLS
 
@@ -110,6 +117,56 @@ EXTENSION_EXPORT bool ReadFileToString(const UTF8String &filepath, std::string &
 EXTENSION_EXPORT bool ReadFileToString(const UTF16String &filepath, std::string &contents_out);
 #endif
 
+// A read-only view of a whole file, mapped into memory (mmap / CreateFileMapping)
+// instead of being copied, so hashing or uploading a large file does not need
+// a second copy of it. Files that cannot be mapped (e.g. on some network file
+// systems) are read into memory when |read_on_failure| is true.
+// Changes to the file while it is mapped are visible through the view, and
+// truncating it may crash the reader on POSIX; only map files the process owns.
+class EXTENSION_EXPORT MappedFile
+{
+public:
+	enum AccessHint
+	{
+		kNormal,
+		kSequential,	// read from the beginning to the end, e.g. hashing and uploading
+		kRandom,
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const UTF8String &filepath, AccessHint hint = kSequential, bool read_on_failure = true);
+#if defined(OS_WIN)
+	bool Open(const UTF16String &filepath, AccessHint hint = kSequential, bool read_on_failure = true);
+#endif
+	void Close();
+
+	bool IsValid() const { return valid_; }
+	// False if the file was read into memory
+	bool IsMapped() const;
+	const uint8_t* data() const { return data_; }
+	size_t length() const { return length_; }
+	std::string_view view() const { return std::string_view(reinterpret_cast<const char *>(data_), length_); }
+
+	// The following are only hints to the system and do nothing for the files read into memory.
+	// Starts reading [offset, offset + length) in ahead.
+	void Prefetch(size_t offset, size_t length) const;
+	// The range has been consumed and its pages can leave the working set, reading
+	// it again faults them back in from the page cache or the file.
+	void Release(size_t offset, size_t length) const;
+
+private:
+	// Declared ahead, only the implementation needs base/files/memory_mapped_file.h
+	std::unique_ptr<base::MemoryMappedFile> mapped_;
+	std::string buffer_;
+	const uint8_t *data_;
+	size_t length_;
+	bool valid_;
+
+	DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
 // Writes the content of given buffer into the file
 EXTENSION_EXPORT int WriteFile(const UTF8String &filepath, const std::string &data);
 #if defined(OS_WIN)
@@ -0,0 +1,671 @@
+// a shared memory message channel between two processes
+
+#include "extension/ipc/shared_memory_channel.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include "base/strings/utf_string_conversions.h"
+#elif defined(OS_MACOSX)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#if !defined(OS_MACOSX)
+#include "base/memory/shared_memory.h"
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+
+const uint32_t kChannelMagic	= 0x4E494D43;	// "NIMC"
+const uint32_t kChannelVersion	= 1;
+// 缓冲区末尾放不下一条消息时写入这个长度，读端跳到缓冲区开头
+const uint32_t kWrapMarker		= 0xFFFFFFFF;
+// 记录为 8 字节的头（消息长度和保留字段）加按 8 字节对齐的消息
+const size_t kRecordHeaderSize	= 8;
+const size_t kHeaderSize		= 4096;
+const size_t kMaxRingSize		= 1024 * 1024 * 1024;
+
+size_t RecordSize(size_t message_size)
+{
+	return kRecordHeaderSize + ((message_size + 7) & ~(size_t)7);
+}
+
+int64_t NowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// deadline_ms 为 -1 时一直等，返回 -1；已过期时返回 0
+int RemainingMs(int64_t deadline_ms)
+{
+	if (deadline_ms < 0)
+		return -1;
+	int64_t remaining = deadline_ms - NowMs();
+	return remaining <= 0 ? 0 : (int)std::min<int64_t>(remaining, std::numeric_limits<int>::max());
+}
+
+bool IsValidName(const std::string &name)
+{
+	if (name.empty())
+		return false;
+	for (char c : name)
+	{
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-'))
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
+// 两个进程中的 std::atomic 要求是无锁的，同一块内存映射到不同地址时才能互相看到
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+	"SharedMemoryChannel needs lock-free atomics");
+
+// 读写位置是只增不减的字节数，分在不同的缓存行，避免两端互相让对方的缓存行失效
+struct SharedMemoryChannel::RingHeader
+{
+	std::atomic<uint64_t> write_pos;
+	char pad0[56];
+	std::atomic<uint64_t> read_pos;
+	char pad1[56];
+	// 门铃的序号，Linux 上就是 futex
+	std::atomic<uint32_t> data_seq;
+	std::atomic<uint32_t> space_seq;
+	// 读端等数据、写端等空间时置 1，对端只在置 1 时才敲门铃
+	std::atomic<uint32_t> reader_waiting;
+	std::atomic<uint32_t> writer_waiting;
+	char pad2[48];
+};
+
+struct SharedMemoryChannel::ChannelHeader
+{
+	// 服务端初始化完成后才写入，客户端看到它才开始使用
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint64_t ring_size;
+	// 服务端、客户端是否已关闭
+	std::atomic<uint32_t> closed[2];
+	char pad[40];
+	RingHeader rings[2];
+};
+
+// 有名字的共享内存
+class SharedMemoryChannel::Region
+{
+public:
+	Region() : owner_(false)
+#if defined(OS_MACOSX)
+		, fd_(-1), memory_(nullptr), size_(0)
+#endif
+	{
+	}
+	~Region() { Close(); }
+
+	bool Create(const std::string &name, size_t size);
+	// 映射整个共享内存，大小由服务端写在头部
+	bool Open(const std::string &name);
+	void Close();
+	char* memory() const;
+
+private:
+	std::string name_;
+	bool owner_;
+#if defined(OS_MACOSX)
+	// base::SharedMemory 在 macOS 上没有有名字的共享内存
+	bool Map(size_t size);
+	int fd_;
+	void *memory_;
+	size_t size_;
+#else
+	base::SharedMemory shm_;
+#endif
+};
+
+#if defined(OS_MACOSX)
+bool SharedMemoryChannel::Region::Create(const std::string &name, size_t size)
+{
+	std::string path = "/" + name;
+	// 清除上次崩溃残留的
+	shm_unlink(path.c_str());
+	fd_ = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd_ < 0)
+		return false;
+	name_ = name;
+	owner_ = true;
+	if (ftruncate(fd_, (off_t)size) != 0 || !Map(size))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedMemoryChannel::Region::Open(const std::string &name)
+{
+	std::string path = "/" + name;
+	fd_ = shm_open(path.c_str(), O_RDWR, 0);
+	if (fd_ < 0)
+		return false;
+	name_ = name;
+	struct stat st;
+	if (fstat(fd_, &st) != 0 || (size_t)st.st_size < kHeaderSize || !Map((size_t)st.st_size))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedMemoryChannel::Region::Map(size_t size)
+{
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (memory == MAP_FAILED)
+		return false;
+	memory_ = memory;
+	size_ = size;
+	return true;
+}
+
+void SharedMemoryChannel::Region::Close()
+{
+	if (memory_ != nullptr)
+		munmap(memory_, size_);
+	memory_ = nullptr;
+	size_ = 0;
+	if (fd_ >= 0)
+		close(fd_);
+	fd_ = -1;
+	if (owner_)
+		shm_unlink(("/" + name_).c_str());
+	owner_ = false;
+}
+
+char* SharedMemoryChannel::Region::memory() const
+{
+	return (char *)memory_;
+}
+#else
+bool SharedMemoryChannel::Region::Create(const std::string &name, size_t size)
+{
+	// POSIX 上是 /dev/shm 中的文件，清除上次崩溃残留的；Windows 上没有残留，同名的通道还在时创建失败
+	shm_.Delete(name);
+	if (!shm_.CreateNamedDeprecated(name, false, size))
+		return false;
+	name_ = name;
+	owner_ = true;
+	if (!shm_.Map(size))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedMemoryChannel::Region::Open(const std::string &name)
+{
+	if (!shm_.Open(name, false))
+		return false;
+	name_ = name;
+	// 先映射头部得到大小，再映射整个通道
+	if (!shm_.Map(kHeaderSize))
+	{
+		Close();
+		return false;
+	}
+	const ChannelHeader *header = (const ChannelHeader *)shm_.memory();
+	uint64_t ring_size = header->ring_size;
+	bool ready = header->magic.load(std::memory_order_acquire) == kChannelMagic &&
+		header->version == kChannelVersion && ring_size > 0 && ring_size <= kMaxRingSize;
+	shm_.Unmap();
+	if (!ready || !shm_.Map(kHeaderSize + 2 * (size_t)ring_size))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SharedMemoryChannel::Region::Close()
+{
+	shm_.Unmap();
+	shm_.Close();
+	if (owner_)
+		shm_.Delete(name_);
+	owner_ = false;
+}
+
+char* SharedMemoryChannel::Region::memory() const
+{
+	return (char *)shm_.memory();
+}
+#endif
+
+// 唤醒等待的对端
+class SharedMemoryChannel::Doorbell
+{
+public:
+	Doorbell() : word_(nullptr)
+#if defined(OS_WIN)
+		, event_(NULL)
+#elif defined(OS_MACOSX)
+		, fd_(-1), owner_(false)
+#endif
+	{
+	}
+	~Doorbell() { Close(); }
+
+	// word 是共享内存中门铃的序号
+	bool Init(const std::string &name, bool create, std::atomic<uint32_t> *word);
+	void Close();
+	// 检查等待条件之前取序号，之后的 Ring 都会让 Wait 立即返回
+	uint32_t Prepare() const { return word_->load(std::memory_order_acquire); }
+	void Wait(uint32_t seq, int timeout_ms);
+	void Ring();
+
+private:
+	std::atomic<uint32_t> *word_;
+#if defined(OS_WIN)
+	HANDLE event_;
+#elif defined(OS_MACOSX)
+	std::string path_;
+	int fd_;
+	bool owner_;
+#endif
+};
+
+#if defined(OS_WIN)
+bool SharedMemoryChannel::Doorbell::Init(const std::string &name, bool create, std::atomic<uint32_t> *word)
+{
+	word_ = word;
+	std::wstring event_name = base::UTF8ToWide(name);
+	if (create)
+		event_ = CreateEventW(NULL, FALSE, FALSE, event_name.c_str());
+	else
+		event_ = OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, event_name.c_str());
+	return event_ != NULL;
+}
+
+void SharedMemoryChannel::Doorbell::Close()
+{
+	if (event_ != NULL)
+		CloseHandle(event_);
+	event_ = NULL;
+}
+
+void SharedMemoryChannel::Doorbell::Wait(uint32_t seq, int timeout_ms)
+{
+	// 自动重置事件记住了等待之前的 Ring，不会丢失唤醒
+	WaitForSingleObject(event_, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+}
+
+void SharedMemoryChannel::Doorbell::Ring()
+{
+	word_->fetch_add(1, std::memory_order_release);
+	SetEvent(event_);
+}
+#elif defined(OS_MACOSX)
+bool SharedMemoryChannel::Doorbell::Init(const std::string &name, bool create, std::atomic<uint32_t> *word)
+{
+	word_ = word;
+	path_ = "/tmp/" + name;
+	if (create)
+	{
+		unlink(path_.c_str());
+		if (mkfifo(path_.c_str(), S_IRUSR | S_IWUSR) != 0)
+			return false;
+		owner_ = true;
+	}
+	// 两端都以读写方式打开，打开时不等对端，写端也不会因为没有读者而出错
+	fd_ = open(path_.c_str(), O_RDWR | O_NONBLOCK);
+	return fd_ >= 0;
+}
+
+void SharedMemoryChannel::Doorbell::Close()
+{
+	if (fd_ >= 0)
+		close(fd_);
+	fd_ = -1;
+	if (owner_)
+		unlink(path_.c_str());
+	owner_ = false;
+}
+
+void SharedMemoryChannel::Doorbell::Wait(uint32_t seq, int timeout_ms)
+{
+	if (word_->load(std::memory_order_acquire) != seq)
+		return;
+	struct pollfd pfd;
+	pfd.fd = fd_;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, timeout_ms) <= 0)
+		return;
+	// 一次取走积累的全部唤醒
+	char buffer[64];
+	while (read(fd_, buffer, sizeof(buffer)) > 0)
+		;
+}
+
+void SharedMemoryChannel::Doorbell::Ring()
+{
+	word_->fetch_add(1, std::memory_order_release);
+	// FIFO 满了说明已经有足够的唤醒没被取走
+	char c = 0;
+	ssize_t r = write(fd_, &c, 1);
+	(void)r;
+}
+#else
+bool SharedMemoryChannel::Doorbell::Init(const std::string &name, bool create, std::atomic<uint32_t> *word)
+{
+	word_ = word;
+	return true;
+}
+
+void SharedMemoryChannel::Doorbell::Close()
+{
+}
+
+void SharedMemoryChannel::Doorbell::Wait(uint32_t seq, int timeout_ms)
+{
+	// 序号已经变化时 FUTEX_WAIT 立即返回，跨进程的 futex 不能用 FUTEX_PRIVATE_FLAG
+	struct timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+	syscall(SYS_futex, (uint32_t *)word_, FUTEX_WAIT, seq, timeout_ms < 0 ? nullptr : &ts, nullptr, 0);
+}
+
+void SharedMemoryChannel::Doorbell::Ring()
+{
+	word_->fetch_add(1, std::memory_order_release);
+	syscall(SYS_futex, (uint32_t *)word_, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+
+void SharedMemoryChannel::RingIfWaiting(std::atomic<uint32_t> &waiting, SharedMemoryChannel::Doorbell *bell)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiting.load(std::memory_order_relaxed) != 0)
+		bell->Ring();
+}
+
+SharedMemoryChannel::SharedMemoryChannel()
+	: role_(0), ring_size_(0), header_(nullptr), write_ring_(nullptr), read_ring_(nullptr),
+	  write_data_(nullptr), read_data_(nullptr), pending_record_(0), wakeup_(false)
+{
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+	Close();
+}
+
+bool SharedMemoryChannel::Create(const std::string &name, size_t ring_size/* = kDefaultRingSize*/)
+{
+	Close();
+	if (!IsValidName(name) || ring_size == 0 || ring_size > kMaxRingSize)
+		return false;
+	// 按页对齐，两个缓冲区的起点也就都是页对齐的
+	ring_size = (ring_size + kHeaderSize - 1) & ~(kHeaderSize - 1);
+	return Attach(name, true, ring_size);
+}
+
+bool SharedMemoryChannel::Open(const std::string &name)
+{
+	Close();
+	if (!IsValidName(name))
+		return false;
+	return Attach(name, false, 0);
+}
+
+bool SharedMemoryChannel::Attach(const std::string &name, bool create, size_t ring_size)
+{
+#if defined(OS_ANDROID) || defined(OS_IOS)
+	// 移动端 SDK 与界面在同一个进程，base::SharedMemory 在这些平台上也没有有名字的共享内存
+	return false;
+#else
+	static_assert(sizeof(ChannelHeader) <= kHeaderSize, "ChannelHeader is too large");
+	region_.reset(new Region);
+	if (create ? !region_->Create(name, kHeaderSize + 2 * ring_size) : !region_->Open(name))
+	{
+		region_.reset();
+		return false;
+	}
+	header_ = (ChannelHeader *)region_->memory();
+	if (create)
+	{
+		// 新建的共享内存全是 0，原子变量的初始值就是 0
+		header_->version = kChannelVersion;
+		header_->ring_size = ring_size;
+	}
+	else
+	{
+		if (header_->magic.load(std::memory_order_acquire) != kChannelMagic || header_->version != kChannelVersion)
+		{
+			Detach();
+			return false;
+		}
+		ring_size = (size_t)header_->ring_size;
+	}
+
+	role_ = create ? 0 : 1;
+	write_ring_ = &header_->rings[role_];
+	read_ring_ = &header_->rings[1 - role_];
+	char *data = region_->memory() + kHeaderSize;
+	write_data_ = data + role_ * ring_size;
+	read_data_ = data + (1 - role_) * ring_size;
+
+	std::string write_prefix = name + (role_ == 0 ? ".0" : ".1");
+	std::string read_prefix = name + (role_ == 0 ? ".1" : ".0");
+	write_data_bell_.reset(new Doorbell);
+	write_space_bell_.reset(new Doorbell);
+	read_data_bell_.reset(new Doorbell);
+	read_space_bell_.reset(new Doorbell);
+	if (!write_data_bell_->Init(write_prefix + "d", create, &write_ring_->data_seq) ||
+		!write_space_bell_->Init(write_prefix + "s", create, &write_ring_->space_seq) ||
+		!read_data_bell_->Init(read_prefix + "d", create, &read_ring_->data_seq) ||
+		!read_space_bell_->Init(read_prefix + "s", create, &read_ring_->space_seq))
+	{
+		Detach();
+		return false;
+	}
+
+	ring_size_ = ring_size;
+	if (create)
+		header_->magic.store(kChannelMagic, std::memory_order_release);
+	return true;
+#endif
+}
+
+void SharedMemoryChannel::Detach()
+{
+	write_data_bell_.reset();
+	write_space_bell_.reset();
+	read_data_bell_.reset();
+	read_space_bell_.reset();
+	region_.reset();
+	header_ = nullptr;
+	write_ring_ = nullptr;
+	read_ring_ = nullptr;
+	write_data_ = nullptr;
+	read_data_ = nullptr;
+	ring_size_ = 0;
+	pending_record_ = 0;
+	wakeup_ = false;
+}
+
+void SharedMemoryChannel::Close()
+{
+	if (!IsValid())
+		return;
+	header_->closed[role_].store(1, std::memory_order_release);
+	// 对端可能在等数据，也可能在等空间
+	write_data_bell_->Ring();
+	read_space_bell_->Ring();
+	Detach();
+}
+
+bool SharedMemoryChannel::IsPeerClosed() const
+{
+	return !IsValid() || header_->closed[1 - role_].load(std::memory_order_acquire) != 0;
+}
+
+size_t SharedMemoryChannel::GetMaxMessageSize() const
+{
+	return IsValid() ? ring_size_ - kRecordHeaderSize : 0;
+}
+
+bool SharedMemoryChannel::Send(const void *data, size_t size, int timeout_ms/* = -1*/)
+{
+	char *buffer = BeginSend(size, timeout_ms);
+	if (buffer == nullptr)
+		return false;
+	if (size > 0)
+		memcpy(buffer, data, size);
+	EndSend();
+	return true;
+}
+
+char* SharedMemoryChannel::BeginSend(size_t size, int timeout_ms/* = -1*/)
+{
+	if (!IsValid() || pending_record_ != 0 || size > GetMaxMessageSize() || IsPeerClosed())
+		return nullptr;
+
+	int64_t deadline_ms = timeout_ms < 0 ? -1 : NowMs() + timeout_ms;
+	size_t record = RecordSize(size);
+	uint64_t pos = write_ring_->write_pos.load(std::memory_order_relaxed);
+	size_t offset = (size_t)(pos % ring_size_);
+	size_t tail = ring_size_ - offset;
+	if (record > tail)
+	{
+		// 末尾放不下，标记后从头开始；标记先发布，之后等空间超时也不影响对端
+		if (!WaitForSpace(tail, deadline_ms))
+			return nullptr;
+		memcpy(write_data_ + offset, &kWrapMarker, sizeof(kWrapMarker));
+		pos += tail;
+		offset = 0;
+		write_ring_->write_pos.store(pos, std::memory_order_release);
+	}
+	if (!WaitForSpace(record, deadline_ms))
+		return nullptr;
+
+	uint32_t length = (uint32_t)size;
+	memcpy(write_data_ + offset, &length, sizeof(length));
+	pending_record_ = record;
+	return write_data_ + offset + kRecordHeaderSize;
+}
+
+void SharedMemoryChannel::EndSend()
+{
+	if (!IsValid() || pending_record_ == 0)
+		return;
+	uint64_t pos = write_ring_->write_pos.load(std::memory_order_relaxed) + pending_record_;
+	pending_record_ = 0;
+	write_ring_->write_pos.store(pos, std::memory_order_release);
+	RingIfWaiting(write_ring_->reader_waiting, write_data_bell_.get());
+}
+
+bool SharedMemoryChannel::WaitForSpace(size_t bytes, int64_t deadline_ms)
+{
+	uint64_t write_pos = write_ring_->write_pos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		if (ring_size_ - (size_t)(write_pos - write_ring_->read_pos.load(std::memory_order_acquire)) >= bytes)
+			return true;
+		if (IsPeerClosed())
+			return false;
+		int remaining = RemainingMs(deadline_ms);
+		if (remaining == 0)
+			return false;
+
+		uint32_t seq = write_space_bell_->Prepare();
+		write_ring_->writer_waiting.store(1, std::memory_order_seq_cst);
+		if (ring_size_ - (size_t)(write_pos - write_ring_->read_pos.load(std::memory_order_seq_cst)) < bytes &&
+			!IsPeerClosed())
+			write_space_bell_->Wait(seq, remaining);
+		write_ring_->writer_waiting.store(0, std::memory_order_relaxed);
+	}
+}
+
+int SharedMemoryChannel::Receive(const MessageHandler &handler, int timeout_ms/* = -1*/,
+								 size_t max_messages/* = SIZE_MAX*/)
+{
+	if (!IsValid())
+		return -1;
+
+	int64_t deadline_ms = timeout_ms < 0 ? -1 : NowMs() + timeout_ms;
+	for (;;)
+	{
+		int count = 0;
+		uint64_t pos = read_ring_->read_pos.load(std::memory_order_relaxed);
+		uint64_t end = read_ring_->write_pos.load(std::memory_order_acquire);
+		while (pos != end && (size_t)count < max_messages)
+		{
+			size_t offset = (size_t)(pos % ring_size_);
+			uint32_t length = 0;
+			memcpy(&length, read_data_ + offset, sizeof(length));
+			if (length == kWrapMarker)
+			{
+				pos += ring_size_ - offset;
+				read_ring_->read_pos.store(pos, std::memory_order_release);
+				RingIfWaiting(read_ring_->writer_waiting, read_space_bell_.get());
+				continue;
+			}
+			// 长度来自对端，越界说明共享内存已损坏
+			size_t record = RecordSize(length);
+			if (record > ring_size_ - offset || record > end - pos)
+				return -1;
+			handler(read_data_ + offset + kRecordHeaderSize, length);
+			// 处理完才释放空间，handler 读的是共享内存本身
+			pos += record;
+			read_ring_->read_pos.store(pos, std::memory_order_release);
+			RingIfWaiting(read_ring_->writer_waiting, read_space_bell_.get());
+			count++;
+			if (pos == end)
+				end = read_ring_->write_pos.load(std::memory_order_acquire);
+		}
+		if (count > 0 || max_messages == 0)
+			return count;
+		if (wakeup_.exchange(false))
+			return 0;
+		if (IsPeerClosed() && read_ring_->write_pos.load(std::memory_order_acquire) == pos)
+			return -1;
+		int remaining = RemainingMs(deadline_ms);
+		if (remaining == 0)
+			return 0;
+
+		uint32_t seq = read_data_bell_->Prepare();
+		read_ring_->reader_waiting.store(1, std::memory_order_seq_cst);
+		if (read_ring_->write_pos.load(std::memory_order_seq_cst) == pos && !IsPeerClosed() && !wakeup_.load())
+			read_data_bell_->Wait(seq, remaining);
+		read_ring_->reader_waiting.store(0, std::memory_order_relaxed);
+	}
+}
+
+void SharedMemoryChannel::WakeUp()
+{
+	if (!IsValid())
+		return;
+	wakeup_ = true;
+	read_data_bell_->Ring();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,109 @@
+// a shared memory message channel between two processes
+
+#ifndef __BASE_EXTENSION_SHARED_MEMORY_CHANNEL_H__
+#define __BASE_EXTENSION_SHARED_MEMORY_CHANNEL_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+#include "extension/memory/packet.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 同一台机器上两个进程之间的双向消息通道，取代本地 TCP：
+// SDK 服务进程用 Create 创建有名字的共享内存，UI 进程用同一个名字 Open，
+// 每个方向一个单生产者单消费者的环形缓冲区，消息写入后对端直接在共享内存中读取，
+// 不经过内核的 socket 缓冲区，也不在接收端拼包。
+// 消息在缓冲区中是连续的，放不下时从头开始，所以 Receive 交给 handler 的数据可以直接用
+// UnpackReader 解析；BeginSend/EndSend 可以直接在共享内存中构造消息。
+// 对端只在等待时才需要唤醒：Linux 上用共享内存中的 futex（与 eventfd 同样是一次系统调用，
+// 但不需要在两个无亲缘关系的进程间传递描述符），Windows 上用有名字的自动重置事件，
+// macOS 上用有名字的 FIFO。对端正在处理时收发都不进入内核。
+// 每一端的 Send/BeginSend 只能在一个线程调用，Receive 也只能在一个线程调用，两者可以是不同的线程。
+// 对端崩溃时不会收到通知，收发的等待都可以带超时；Create 会清除上次崩溃残留的同名通道
+class EXTENSION_EXPORT SharedMemoryChannel
+{
+public:
+	// data 指向共享内存，只在回调期间有效
+	typedef std::function<void(const char *data, size_t size)> MessageHandler;
+
+	static const size_t kDefaultRingSize = 4 * 1024 * 1024;
+
+	SharedMemoryChannel();
+	~SharedMemoryChannel();
+
+	// 服务端：创建名为 name 的通道，ring_size 为每个方向的缓冲区字节数，最多 1GB。
+	// name 只能包含字母、数字、'.'、'_' 和 '-'，macOS 上不超过 30 个字符（shm_open 的限制）
+	bool Create(const std::string &name, size_t ring_size = kDefaultRingSize);
+	// 客户端：打开服务端已创建的通道，还没有创建时返回 false，调用方稍后重试
+	bool Open(const std::string &name);
+	// 通知对端本端已关闭并唤醒它的等待，服务端关闭后名字被释放。
+	// 本端的收发线程要先停下来（用 WakeUp 让 Receive 返回）
+	void Close();
+
+	bool IsValid() const { return ring_size_ != 0; }
+	bool IsPeerClosed() const;
+	// 一条消息最多的字节数
+	size_t GetMaxMessageSize() const;
+
+	// 发送一条消息，缓冲区空间不够时等待对端读取，最多 timeout_ms，-1 一直等。
+	// 超时、对端已关闭或消息超过 GetMaxMessageSize 时返回 false
+	bool Send(const void *data, size_t size, int timeout_ms = -1);
+	bool Send(Pack &pack, int timeout_ms = -1) { return Send(pack.data(), pack.size(), timeout_ms); }
+
+	// 在缓冲区中预留 size 字节的消息直接写入，EndSend 之后对端才能看到；失败时返回 nullptr。
+	// 两次调用之间不能再发送别的消息
+	char* BeginSend(size_t size, int timeout_ms = -1);
+	void EndSend();
+
+	// 依次处理已到达的消息，最多 max_messages 条；没有消息时最多等待 timeout_ms，0 不等待。
+	// 返回处理的消息数，对端已关闭且没有消息时返回 -1
+	int Receive(const MessageHandler &handler, int timeout_ms = -1, size_t max_messages = SIZE_MAX);
+	// 唤醒本端等待在 Receive 中的线程，例如退出时
+	void WakeUp();
+
+private:
+	struct ChannelHeader;
+	struct RingHeader;
+	class Region;
+	class Doorbell;
+
+	bool Attach(const std::string &name, bool create, size_t ring_size);
+	void Detach();
+	// 等待写缓冲区有 bytes 字节的空闲，返回 false 表示超时或对端已关闭
+	bool WaitForSpace(size_t bytes, int64_t deadline_ms);
+	// 发布位置之后对端在不在等待，与等待方先置标志再检查位置配对，不会丢失唤醒
+	static void RingIfWaiting(std::atomic<uint32_t> &waiting, Doorbell *bell);
+
+	std::unique_ptr<Region> region_;
+	// 本端为服务端时 0 号缓冲区是写缓冲区，客户端相反
+	int role_;
+	size_t ring_size_;
+	ChannelHeader *header_;
+	RingHeader *write_ring_;
+	RingHeader *read_ring_;
+	char *write_data_;
+	char *read_data_;
+	// 写缓冲区的数据就绪、空间可用，读缓冲区的数据就绪、空间可用
+	std::unique_ptr<Doorbell> write_data_bell_;
+	std::unique_ptr<Doorbell> write_space_bell_;
+	std::unique_ptr<Doorbell> read_data_bell_;
+	std::unique_ptr<Doorbell> read_space_bell_;
+	// BeginSend 预留的记录长度，0 表示没有
+	size_t pending_record_;
+	std::atomic<bool> wakeup_;
+
+	DISALLOW_COPY_AND_ASSIGN(SharedMemoryChannel);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_SHARED_MEMORY_CHANNEL_H__
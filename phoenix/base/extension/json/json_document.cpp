@@ -0,0 +1,402 @@
+#include "extension/json/json_document.h"
+#include <string.h>
+#include <limits>
+#include <new>
+#include <vector>
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const JsonValue kNullValue;
+
+// arena 的第一块和最大的块，块按两倍增长，减少小文档的浪费和大文档的块数
+const size_t kMinBlockSize = 4 * 1024;
+const size_t kMaxBlockSize = 1024 * 1024;
+
+// 只分配不释放的内存池，整块随 document 释放或在 Clear 时复用
+class Arena
+{
+public:
+	Arena() : current_(nullptr), left_(0), next_block_size_(kMinBlockSize) {}
+
+	void* Allocate(size_t size)
+	{
+		// 节点和字符串都按 8 字节对齐
+		size = (size + 7) & ~(size_t)7;
+		if (size > left_)
+			NewBlock(size);
+		char *result = current_;
+		current_ += size;
+		left_ -= size;
+		return result;
+	}
+
+	// 只保留最大的一块
+	void Reset()
+	{
+		if (blocks_.empty())
+			return;
+		size_t largest = 0;
+		for (size_t i = 1; i < blocks_.size(); i++)
+			if (blocks_[i].size > blocks_[largest].size)
+				largest = i;
+		Block block = std::move(blocks_[largest]);
+		blocks_.clear();
+		current_ = block.data.get();
+		left_ = block.size;
+		blocks_.push_back(std::move(block));
+	}
+
+private:
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	void NewBlock(size_t min_size)
+	{
+		size_t size = next_block_size_;
+		if (size < min_size)
+			size = min_size;
+		else if (next_block_size_ < kMaxBlockSize)
+			next_block_size_ *= 2;
+		Block block;
+		block.data.reset(new char[size]);
+		block.size = size;
+		current_ = block.data.get();
+		left_ = size;
+		blocks_.push_back(std::move(block));
+	}
+
+	std::vector<Block> blocks_;
+	char *current_;
+	size_t left_;
+	size_t next_block_size_;
+};
+}
+
+// 把解析事件构造成 arena 中的节点。未完成的容器的子节点先放在 stack_ 上，
+// 容器结束时个数已知，一次拷进 arena 中连续的一段；对象的键作为字符串值和成员的值交替入栈
+class JsonDocumentBuilder : public JsonHandler
+{
+public:
+	JsonDocumentBuilder() : borrow_input_(false) {}
+
+	// borrow_input 为 true 时 stable 的字符串直接引用输入
+	void Start(bool borrow_input)
+	{
+		borrow_input_ = borrow_input;
+		stack_.clear();
+		arena_.Reset();
+	}
+
+	// 解析成功后栈上只剩顶层的值
+	JsonValue TakeRoot()
+	{
+		JsonValue root = stack_.size() == 1 ? stack_[0] : JsonValue();
+		stack_.clear();
+		return root;
+	}
+
+	void Clear()
+	{
+		std::vector<JsonValue>().swap(stack_);
+		arena_.Reset();
+	}
+
+	bool OnNull() override
+	{
+		stack_.push_back(JsonValue());
+		return true;
+	}
+
+	bool OnBool(bool value) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kBool;
+		node.u_.bool_value = value;
+		stack_.push_back(node);
+		return true;
+	}
+
+	bool OnInt(int64_t value) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kInt;
+		node.u_.int_value = value;
+		stack_.push_back(node);
+		return true;
+	}
+
+	bool OnUint(uint64_t value) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kUint;
+		node.u_.uint_value = value;
+		stack_.push_back(node);
+		return true;
+	}
+
+	bool OnDouble(double value) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kDouble;
+		node.u_.double_value = value;
+		stack_.push_back(node);
+		return true;
+	}
+
+	bool OnString(std::string_view value, bool stable) override
+	{
+		return PushString(value, stable);
+	}
+
+	bool OnKey(std::string_view key, bool stable) override
+	{
+		return PushString(key, stable);
+	}
+
+	bool OnStartObject() override
+	{
+		return true;
+	}
+
+	bool OnEndObject(size_t member_count) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kObject;
+		node.size_ = (uint32_t)member_count;
+		JsonMember *members = nullptr;
+		if (member_count > 0)
+		{
+			members = static_cast<JsonMember *>(arena_.Allocate(sizeof(JsonMember) * member_count));
+			const JsonValue *pairs = &stack_[stack_.size() - member_count * 2];
+			for (size_t i = 0; i < member_count; i++)
+			{
+				const JsonValue &key = pairs[i * 2];
+				new (&members[i]) JsonMember();
+				members[i].name = std::string_view(key.u_.string_value, key.size_);
+				members[i].value = pairs[i * 2 + 1];
+			}
+			stack_.resize(stack_.size() - member_count * 2);
+		}
+		node.u_.members = members;
+		stack_.push_back(node);
+		return true;
+	}
+
+	bool OnStartArray() override
+	{
+		return true;
+	}
+
+	bool OnEndArray(size_t element_count) override
+	{
+		JsonValue node;
+		node.type_ = JsonValue::kArray;
+		node.size_ = (uint32_t)element_count;
+		JsonValue *items = nullptr;
+		if (element_count > 0)
+		{
+			items = static_cast<JsonValue *>(arena_.Allocate(sizeof(JsonValue) * element_count));
+			memcpy(items, &stack_[stack_.size() - element_count], sizeof(JsonValue) * element_count);
+			stack_.resize(stack_.size() - element_count);
+		}
+		node.u_.items = items;
+		stack_.push_back(node);
+		return true;
+	}
+
+private:
+	bool PushString(std::string_view value, bool stable)
+	{
+		// 长度只有 32 位，元素个数也一样，但 4GB 的容器在栈上就已经放不下了
+		if (value.size() > std::numeric_limits<uint32_t>::max())
+			return false;
+		JsonValue node;
+		node.type_ = JsonValue::kString;
+		node.size_ = (uint32_t)value.size();
+		if (stable && borrow_input_)
+		{
+			node.u_.string_value = value.data();
+		}
+		else
+		{
+			char *copy = static_cast<char *>(arena_.Allocate(value.size() + 1));
+			memcpy(copy, value.data(), value.size());
+			copy[value.size()] = '\0';
+			node.u_.string_value = copy;
+		}
+		stack_.push_back(node);
+		return true;
+	}
+
+	Arena arena_;
+	std::vector<JsonValue> stack_;
+	bool borrow_input_;
+};
+
+bool JsonValue::AsBool(bool default_value) const
+{
+	return type_ == kBool ? u_.bool_value : default_value;
+}
+
+int64_t JsonValue::AsInt64(int64_t default_value) const
+{
+	switch (type_)
+	{
+	case kInt:
+		return u_.int_value;
+	case kUint:
+		return default_value;
+	case kDouble:
+		// 2^63 本身已超出 int64
+		if (u_.double_value >= -9223372036854775808.0 && u_.double_value < 9223372036854775808.0)
+			return (int64_t)u_.double_value;
+		return default_value;
+	default:
+		return default_value;
+	}
+}
+
+int JsonValue::AsInt(int default_value) const
+{
+	int64_t value = AsInt64(default_value);
+	if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max())
+		return default_value;
+	return (int)value;
+}
+
+double JsonValue::AsDouble(double default_value) const
+{
+	switch (type_)
+	{
+	case kInt:
+		return (double)u_.int_value;
+	case kUint:
+		return (double)u_.uint_value;
+	case kDouble:
+		return u_.double_value;
+	default:
+		return default_value;
+	}
+}
+
+std::string_view JsonValue::AsString(std::string_view default_value) const
+{
+	return type_ == kString ? std::string_view(u_.string_value, size_) : default_value;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	return (type_ == kArray && index < size_) ? u_.items[index] : kNullValue;
+}
+
+const JsonValue* JsonValue::Find(std::string_view key) const
+{
+	if (type_ != kObject)
+		return nullptr;
+	for (uint32_t i = 0; i < size_; i++)
+	{
+		if (u_.members[i].name == key)
+			return &u_.members[i].value;
+	}
+	return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const
+{
+	const JsonValue *value = Find(key);
+	return value != nullptr ? *value : kNullValue;
+}
+
+const JsonValue* JsonValue::begin() const
+{
+	return type_ == kArray ? u_.items : nullptr;
+}
+
+const JsonValue* JsonValue::end() const
+{
+	return type_ == kArray ? u_.items + size_ : nullptr;
+}
+
+const JsonMember* JsonValue::members_begin() const
+{
+	return type_ == kObject ? u_.members : nullptr;
+}
+
+const JsonMember* JsonValue::members_end() const
+{
+	return type_ == kObject ? u_.members + size_ : nullptr;
+}
+
+JsonDocument::JsonDocument()
+	: builder_(new JsonDocumentBuilder)
+	, error_(kJsonOk)
+	, error_offset_(0)
+{
+}
+
+JsonDocument::~JsonDocument()
+{
+}
+
+bool JsonDocument::Parse(std::string_view json)
+{
+	stream_parser_.reset();
+	root_ = JsonValue();
+	builder_->Start(true);
+	JsonSaxParser parser(builder_.get());
+	if (parser.Feed(json.data(), json.size()))
+		parser.Finish();
+	return Complete(parser);
+}
+
+bool JsonDocument::Feed(const char *data, size_t size)
+{
+	if (stream_parser_ == nullptr)
+	{
+		root_ = JsonValue();
+		error_ = kJsonOk;
+		error_offset_ = 0;
+		builder_->Start(false);
+		stream_parser_.reset(new JsonSaxParser(builder_.get()));
+	}
+	if (stream_parser_->Feed(data, size))
+		return true;
+	error_ = stream_parser_->error();
+	error_offset_ = stream_parser_->error_offset();
+	return false;
+}
+
+bool JsonDocument::Finish()
+{
+	if (stream_parser_ == nullptr)
+		return false;
+	stream_parser_->Finish();
+	std::unique_ptr<JsonSaxParser> parser(std::move(stream_parser_));
+	return Complete(*parser);
+}
+
+void JsonDocument::Clear()
+{
+	stream_parser_.reset();
+	root_ = JsonValue();
+	error_ = kJsonOk;
+	error_offset_ = 0;
+	builder_->Clear();
+}
+
+bool JsonDocument::Complete(const JsonSaxParser &parser)
+{
+	error_ = parser.error();
+	error_offset_ = parser.error_offset();
+	root_ = error_ == kJsonOk ? builder_->TakeRoot() : JsonValue();
+	if (error_ != kJsonOk)
+		builder_->Start(false);
+	return error_ == kJsonOk;
+}
+
+EXTENSION_END_DECLS
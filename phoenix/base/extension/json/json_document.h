@@ -0,0 +1,144 @@
+// a read-only JSON DOM whose nodes live in one arena and whose strings point into the source
+
+#ifndef __BASE_EXTENSION_JSON_DOCUMENT_H__
+#define __BASE_EXTENSION_JSON_DOCUMENT_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string_view>
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+#include "extension/json/json_sax_parser.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct JsonMember;
+// 在 arena 中构造 JsonValue，只在实现中定义
+class JsonDocumentBuilder;
+
+// JsonDocument 中的一个值，只能由 JsonDocument 创建，随 document 一起释放。
+// 16 字节，数组的元素和对象的成员在 arena 中连续存放；
+// 类型不符或下标、键不存在时访问函数返回默认值或 null 值，可以直接链式访问
+class EXTENSION_EXPORT JsonValue
+{
+public:
+	enum Type : uint8_t
+	{
+		kNull,
+		kBool,
+		kInt,		// int64 范围内的整数
+		kUint,		// 超出 int64 的正整数
+		kDouble,
+		kString,
+		kArray,
+		kObject,
+	};
+
+	JsonValue() : type_(kNull), size_(0) { u_.int_value = 0; }
+
+	Type type() const { return type_; }
+	bool is_null() const { return type_ == kNull; }
+	bool is_bool() const { return type_ == kBool; }
+	bool is_int() const { return type_ == kInt; }
+	bool is_number() const { return type_ == kInt || type_ == kUint || type_ == kDouble; }
+	bool is_string() const { return type_ == kString; }
+	bool is_array() const { return type_ == kArray; }
+	bool is_object() const { return type_ == kObject; }
+
+	bool AsBool(bool default_value = false) const;
+	// 数字都可以读成整数，小数截断，超出 int64 范围的返回 default_value
+	int64_t AsInt64(int64_t default_value = 0) const;
+	int AsInt(int default_value = 0) const;
+	double AsDouble(double default_value = 0) const;
+	// 指向 document 的源数据或 arena，与 document 的生命周期相同
+	std::string_view AsString(std::string_view default_value = std::string_view()) const;
+
+	// 数组的元素个数或对象的成员个数，其余类型为 0
+	size_t size() const { return (type_ == kArray || type_ == kObject) ? size_ : 0; }
+	bool empty() const { return size() == 0; }
+
+	// 数组的元素，越界或不是数组时返回 null 值
+	const JsonValue& operator[](size_t index) const;
+	// 对象的成员，按顺序查找，同名的取第一个；不存在或不是对象时返回 nullptr
+	const JsonValue* Find(std::string_view key) const;
+	// 同 Find，不存在时返回 null 值
+	const JsonValue& operator[](std::string_view key) const;
+	const JsonValue& operator[](const char *key) const { return (*this)[std::string_view(key)]; }
+
+	// 遍历数组：for (const JsonValue &item : value)，不是数组时为空
+	const JsonValue* begin() const;
+	const JsonValue* end() const;
+	// 遍历对象的成员，不是对象时为空
+	const JsonMember* members_begin() const;
+	const JsonMember* members_end() const;
+
+private:
+	friend class JsonDocumentBuilder;
+
+	Type type_;
+	uint32_t size_;		// 字符串的字节数，数组和对象的元素个数
+	union
+	{
+		bool bool_value;
+		int64_t int_value;
+		uint64_t uint_value;
+		double double_value;
+		const char *string_value;
+		const JsonValue *items;
+		const JsonMember *members;
+	} u_;
+};
+
+struct JsonMember
+{
+	std::string_view name;
+	JsonValue value;
+};
+
+// 一次解析 JSON 得到的只读 DOM，所有节点和需要拷贝的字符串都分配在 document 自己的 arena 中，
+// 析构时整块释放，不像 base::Value / Json::Value 那样每个节点单独分配。
+// Parse 时不含转义的字符串直接指向输入，不拷贝；
+// Feed 用于边下载边解析，字符串都拷贝进 arena，不需要保留输入。
+// 不是线程安全的，解析完成后可以在多个线程中同时读
+class EXTENSION_EXPORT JsonDocument
+{
+public:
+	JsonDocument();
+	~JsonDocument();
+
+	// 解析完整的 json，json 在 document 使用期间必须有效且不被修改。
+	// 成功后 root 为顶层的值，失败时 root 为 null 值
+	bool Parse(std::string_view json);
+
+	// 流式解析，可以直接作为 nim_http 的 DataCallback 或 Decompressor 的 sink：
+	//   request->SetDataCallback([document](const char *data, size_t size) { return document->Feed(data, size); });
+	// 第一次 Feed 前的内容被清空，所有数据都输入之后调用 Finish
+	bool Feed(const char *data, size_t size);
+	bool Finish();
+
+	const JsonValue& root() const { return root_; }
+	JsonError error() const { return error_; }
+	uint64_t error_offset() const { return error_offset_; }
+
+	// 释放所有节点，保留 arena 中最大的一块内存给下一次解析
+	void Clear();
+
+private:
+	// 解析结束后从 builder 取出结果
+	bool Complete(const JsonSaxParser &parser);
+
+	std::unique_ptr<JsonDocumentBuilder> builder_;	// 同时持有 arena
+	std::unique_ptr<JsonSaxParser> stream_parser_;	// Feed 期间的解析器
+	JsonValue root_;
+	JsonError error_;
+	uint64_t error_offset_;
+
+	DISALLOW_COPY_AND_ASSIGN(JsonDocument);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_JSON_DOCUMENT_H__
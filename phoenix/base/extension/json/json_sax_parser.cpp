@@ -0,0 +1,678 @@
+#include "extension/json/json_sax_parser.h"
+#include <string.h>
+#include <cmath>
+#include <limits>
+#include "base/strings/string_number_conversions.h"
+
+#include "extension/strings/string_util.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const uint64_t kOnes = 0x0101010101010101ULL;
+const uint64_t kHighBits = 0x8080808080808080ULL;
+
+inline bool IsWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline bool IsNumberCharacter(char c)
+{
+	return IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+inline bool IsLiteralCharacter(char c)
+{
+	return c >= 'a' && c <= 'z';
+}
+
+// 字符串中需要逐字节处理的字符：引号、反斜杠和控制字符
+inline bool IsStringSpecial(unsigned char c)
+{
+	return c == '"' || c == '\\' || c < 0x20;
+}
+
+// 8 个字节中是否有 IsStringSpecial 的字节，没有时整体跳过
+inline bool HasStringSpecial(uint64_t v)
+{
+	uint64_t quote = v ^ (kOnes * '"');
+	uint64_t backslash = v ^ (kOnes * '\\');
+	uint64_t found = ((quote - kOnes) & ~quote) | ((backslash - kOnes) & ~backslash) | ((v - kOnes * 0x20) & ~v);
+	return (found & kHighBits) != 0;
+}
+
+// 跳过不需要特殊处理的字节，non_ascii 记录其中是否有非 ASCII 字节
+inline const char* SkipPlainCharacters(const char *p, const char *end, bool &non_ascii)
+{
+	uint64_t high = 0;
+	while (end - p >= 8)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		if (HasStringSpecial(v))
+			break;
+		high |= v;
+		p += 8;
+	}
+	while (p < end && !IsStringSpecial((unsigned char)*p))
+		high |= (unsigned char)*p++;
+	non_ascii = non_ascii || (high & kHighBits) != 0;
+	return p;
+}
+
+int HexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// 读取 \u 之后的 4 个十六进制数字
+bool ReadHex4(const char *p, const char *end, uint32_t &value)
+{
+	if (end - p < 4)
+		return false;
+	value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int digit = HexValue(p[i]);
+		if (digit < 0)
+			return false;
+		value = (value << 4) | (uint32_t)digit;
+	}
+	return true;
+}
+
+void AppendUTF8(uint32_t code_point, std::string &out)
+{
+	if (code_point < 0x80)
+	{
+		out.push_back((char)code_point);
+	}
+	else if (code_point < 0x800)
+	{
+		out.push_back((char)(0xC0 | (code_point >> 6)));
+		out.push_back((char)(0x80 | (code_point & 0x3F)));
+	}
+	else if (code_point < 0x10000)
+	{
+		out.push_back((char)(0xE0 | (code_point >> 12)));
+		out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+		out.push_back((char)(0x80 | (code_point & 0x3F)));
+	}
+	else
+	{
+		out.push_back((char)(0xF0 | (code_point >> 18)));
+		out.push_back((char)(0x80 | ((code_point >> 12) & 0x3F)));
+		out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+		out.push_back((char)(0x80 | (code_point & 0x3F)));
+	}
+}
+
+// 解码 [p, end) 中的转义，end 为结束引号的位置；失败时返回出错的位置
+const char* Unescape(const char *p, const char *end, std::string &out)
+{
+	out.clear();
+	out.reserve(end - p);
+	while (p < end)
+	{
+		const char *backslash = (const char *)memchr(p, '\\', end - p);
+		if (backslash == nullptr)
+		{
+			out.append(p, end - p);
+			return nullptr;
+		}
+		out.append(p, backslash - p);
+		p = backslash + 1;
+		if (p == end)
+			return backslash;
+		switch (*p++)
+		{
+		case '"': out.push_back('"'); break;
+		case '\\': out.push_back('\\'); break;
+		case '/': out.push_back('/'); break;
+		case 'b': out.push_back('\b'); break;
+		case 'f': out.push_back('\f'); break;
+		case 'n': out.push_back('\n'); break;
+		case 'r': out.push_back('\r'); break;
+		case 't': out.push_back('\t'); break;
+		case 'u':
+		{
+			uint32_t code_point = 0;
+			if (!ReadHex4(p, end, code_point))
+				return backslash;
+			p += 4;
+			if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+				return backslash;
+			// 高代理项后必须紧跟低代理项
+			if (code_point >= 0xD800 && code_point <= 0xDBFF)
+			{
+				uint32_t low = 0;
+				if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ReadHex4(p + 2, end, low) ||
+					low < 0xDC00 || low > 0xDFFF)
+					return backslash;
+				p += 6;
+				code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+			}
+			AppendUTF8(code_point, out);
+			break;
+		}
+		default:
+			return backslash;
+		}
+	}
+	return nullptr;
+}
+
+// pending 的字符串末尾是否是一个还没有配对的反斜杠，首字节为开头的引号
+bool EndsWithEscape(const std::string &token)
+{
+	size_t count = 0;
+	for (size_t i = token.size(); i > 1 && token[i - 1] == '\\'; i--)
+		count++;
+	return (count & 1) != 0;
+}
+}
+
+const char* JsonErrorToString(JsonError error)
+{
+	switch (error)
+	{
+	case kJsonOk: return "ok";
+	case kJsonUnexpectedEnd: return "unexpected end of input";
+	case kJsonUnexpectedCharacter: return "unexpected character";
+	case kJsonInvalidNumber: return "invalid number";
+	case kJsonInvalidEscape: return "invalid escape sequence";
+	case kJsonInvalidUTF8: return "invalid UTF-8";
+	case kJsonControlCharacter: return "unescaped control character in string";
+	case kJsonTooDeep: return "nesting too deep";
+	case kJsonTrailingData: return "trailing data after the value";
+	case kJsonAborted: return "aborted by the handler";
+	default: return "unknown error";
+	}
+}
+
+JsonSaxParser::JsonSaxParser(JsonHandler *handler, size_t max_depth)
+	: handler_(handler)
+	, max_depth_(max_depth)
+	, validate_utf8_(true)
+	, state_(kValue)
+	, pending_(kPendingNone)
+	, pending_is_key_(false)
+	, error_(kJsonOk)
+	, error_offset_(0)
+	, consumed_(0)
+	, chunk_(nullptr)
+	, chunk_size_(0)
+{
+}
+
+JsonSaxParser::~JsonSaxParser()
+{
+}
+
+bool JsonSaxParser::Feed(const char *data, size_t size)
+{
+	if (error_ != kJsonOk)
+		return false;
+	chunk_ = data;
+	chunk_size_ = size;
+	const char *p = data;
+	const char *end = data + size;
+	if (pending_ != kPendingNone)
+		p = ResumePending(p, end);
+	if (p != nullptr)
+		p = ParseTokens(p, end);
+	consumed_ += size;
+	chunk_ = nullptr;
+	chunk_size_ = 0;
+	return p != nullptr;
+}
+
+bool JsonSaxParser::Finish()
+{
+	if (error_ != kJsonOk)
+		return false;
+	// 数字和字面量只有遇到之后的字符才知道结束了，输入的结尾也是它们的结束
+	if (pending_ == kPendingNumber || pending_ == kPendingLiteral)
+	{
+		std::string token;
+		token.swap(pending_token_);
+		Pending pending = pending_;
+		pending_ = kPendingNone;
+		bool ret = pending == kPendingNumber ? EmitNumber(token.data(), token.data() + token.size())
+			: EmitLiteral(token.data(), token.data() + token.size());
+		if (!ret)
+			return false;
+	}
+	if (state_ != kDone)
+		return Fail(kJsonUnexpectedEnd, nullptr);
+	return true;
+}
+
+JsonError JsonSaxParser::Parse(std::string_view json, JsonHandler *handler, size_t max_depth)
+{
+	JsonSaxParser parser(handler, max_depth);
+	if (parser.Feed(json.data(), json.size()))
+		parser.Finish();
+	return parser.error();
+}
+
+const char* JsonSaxParser::ParseTokens(const char *p, const char *end)
+{
+	for (;;)
+	{
+		while (p < end && IsWhitespace(*p))
+			p++;
+		if (p == end)
+			return p;
+
+		char c = *p;
+		switch (state_)
+		{
+		case kDone:
+			Fail(kJsonTrailingData, p);
+			return nullptr;
+		case kColon:
+			if (c != ':')
+			{
+				Fail(kJsonUnexpectedCharacter, p);
+				return nullptr;
+			}
+			state_ = kValue;
+			p++;
+			continue;
+		case kCommaOrEnd:
+			if (c == ',')
+			{
+				state_ = stack_.back().is_object ? kKey : kValue;
+				p++;
+				continue;
+			}
+			if (c != (stack_.back().is_object ? '}' : ']'))
+			{
+				Fail(kJsonUnexpectedCharacter, p);
+				return nullptr;
+			}
+			if (!EndContainer(stack_.back().is_object))
+				return nullptr;
+			p++;
+			continue;
+		case kFirstKeyOrEnd:
+			if (c == '}')
+			{
+				if (!EndContainer(true))
+					return nullptr;
+				p++;
+				continue;
+			}
+			// fall through
+		case kKey:
+			if (c != '"')
+			{
+				Fail(kJsonUnexpectedCharacter, p);
+				return nullptr;
+			}
+			p = ParseString(p, end, true, true);
+			break;
+		case kFirstValueOrEnd:
+			if (c == ']')
+			{
+				if (!EndContainer(false))
+					return nullptr;
+				p++;
+				continue;
+			}
+			// fall through
+		case kValue:
+			if (c == '"')
+			{
+				p = ParseString(p, end, false, true);
+			}
+			else if (c == '{' || c == '[')
+			{
+				if (!StartContainer(c == '{'))
+					return nullptr;
+				p++;
+			}
+			else if (c == '-' || IsDigit(c))
+			{
+				p = ParseNumber(p, end);
+			}
+			else if (IsLiteralCharacter(c))
+			{
+				p = ParseLiteral(p, end);
+			}
+			else
+			{
+				Fail(kJsonUnexpectedCharacter, p);
+				return nullptr;
+			}
+			break;
+		}
+		if (p == nullptr)
+			return nullptr;
+	}
+}
+
+const char* JsonSaxParser::ParseString(const char *p, const char *end, bool is_key, bool stable)
+{
+	const char *begin = p + 1;
+	bool escaped = false;
+	bool non_ascii = false;
+	const char *q = begin;
+	for (;;)
+	{
+		q = SkipPlainCharacters(q, end, non_ascii);
+		if (q == end)
+			break;
+		unsigned char c = (unsigned char)*q;
+		if (c == '"')
+		{
+			if (!EmitString(begin, q, escaped, non_ascii, is_key, stable))
+				return nullptr;
+			return q + 1;
+		}
+		if (c == '\\')
+		{
+			escaped = true;
+			// 转义的字符由 Unescape 校验，这里只需跳过它，使 \" 不被当作结尾
+			q += 2;
+			if (q > end)
+				break;
+			continue;
+		}
+		Fail(kJsonControlCharacter, q);
+		return nullptr;
+	}
+	pending_ = kPendingString;
+	pending_is_key_ = is_key;
+	pending_token_.assign(p, end);
+	return end;
+}
+
+const char* JsonSaxParser::ParseNumber(const char *p, const char *end)
+{
+	const char *q = p;
+	while (q < end && IsNumberCharacter(*q))
+		q++;
+	if (q == end)
+	{
+		pending_ = kPendingNumber;
+		pending_token_.assign(p, end);
+		return end;
+	}
+	return EmitNumber(p, q) ? q : nullptr;
+}
+
+const char* JsonSaxParser::ParseLiteral(const char *p, const char *end)
+{
+	const char *q = p;
+	while (q < end && IsLiteralCharacter(*q))
+		q++;
+	if (q == end)
+	{
+		pending_ = kPendingLiteral;
+		pending_token_.assign(p, end);
+		return end;
+	}
+	return EmitLiteral(p, q) ? q : nullptr;
+}
+
+const char* JsonSaxParser::ResumePending(const char *p, const char *end)
+{
+	const char *q = p;
+	if (pending_ == kPendingString)
+	{
+		// 找到没有被转义的结束引号
+		if (EndsWithEscape(pending_token_))
+			q++;
+		while (q < end && *q != '"')
+			q += (*q == '\\') ? 2 : 1;
+		if (q >= end)
+		{
+			pending_token_.append(p, end);
+			return end;
+		}
+		pending_token_.append(p, q + 1);
+		pending_ = kPendingNone;
+		const char *token = pending_token_.data();
+		const char *token_end = token + pending_token_.size();
+		// token 已完整，不会再次进入 pending
+		if (ParseString(token, token_end, pending_is_key_, false) == nullptr)
+			return nullptr;
+		pending_token_.clear();
+		return q + 1;
+	}
+
+	bool is_number = pending_ == kPendingNumber;
+	while (q < end && (is_number ? IsNumberCharacter(*q) : IsLiteralCharacter(*q)))
+		q++;
+	pending_token_.append(p, q);
+	if (q == end)
+	{
+		// 字面量最长是 false
+		if (!is_number && pending_token_.size() > 5)
+		{
+			Fail(kJsonUnexpectedCharacter, p);
+			return nullptr;
+		}
+		return end;
+	}
+	pending_ = kPendingNone;
+	const char *token = pending_token_.data();
+	const char *token_end = token + pending_token_.size();
+	bool ret = is_number ? EmitNumber(token, token_end) : EmitLiteral(token, token_end);
+	pending_token_.clear();
+	return ret ? q : nullptr;
+}
+
+bool JsonSaxParser::EmitString(const char *begin, const char *end, bool escaped, bool non_ascii, bool is_key, bool stable)
+{
+	std::string_view value(begin, end - begin);
+	if (escaped)
+	{
+		const char *invalid = Unescape(begin, end, unescaped_);
+		if (invalid != nullptr)
+			return Fail(kJsonInvalidEscape, invalid);
+		value = unescaped_;
+		stable = false;
+	}
+	// 转义只会产生合法的 UTF-8，只需校验原样出现的非 ASCII 字节
+	if (non_ascii && validate_utf8_ && !ValidateUTF8Stream(value.data(), (unsigned)value.size()))
+		return Fail(kJsonInvalidUTF8, begin);
+
+	if (is_key)
+	{
+		if (!handler_->OnKey(value, stable))
+			return Fail(kJsonAborted, end);
+		state_ = kColon;
+		return true;
+	}
+	if (!handler_->OnString(value, stable))
+		return Fail(kJsonAborted, end);
+	EndValue();
+	return true;
+}
+
+bool JsonSaxParser::EmitNumber(const char *begin, const char *end)
+{
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	const char *p = begin;
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	const char *digits = p;
+	if (p < end && *p == '0')
+		p++;
+	else if (p < end && IsDigit(*p))
+		while (p < end && IsDigit(*p))
+			p++;
+	else
+		return Fail(kJsonInvalidNumber, begin);
+	const char *digits_end = p;
+	const char *fraction = p;
+	const char *fraction_end = p;
+	bool integer = true;
+	if (p < end && *p == '.')
+	{
+		integer = false;
+		if (++p == end || !IsDigit(*p))
+			return Fail(kJsonInvalidNumber, begin);
+		fraction = p;
+		while (p < end && IsDigit(*p))
+			p++;
+		fraction_end = p;
+	}
+	int exponent = 0;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		integer = false;
+		bool negative_exponent = false;
+		if (++p < end && (*p == '+' || *p == '-'))
+			negative_exponent = *p++ == '-';
+		if (p == end || !IsDigit(*p))
+			return Fail(kJsonInvalidNumber, begin);
+		for (; p < end && IsDigit(*p); p++)
+		{
+			if (exponent < 100000)
+				exponent = exponent * 10 + (*p - '0');
+		}
+		if (negative_exponent)
+			exponent = -exponent;
+	}
+	if (p != end)
+		return Fail(kJsonInvalidNumber, begin);
+
+	bool ret = true;
+	if (integer && digits_end - digits <= 20)
+	{
+		uint64_t value = 0;
+		bool overflow = false;
+		for (const char *d = digits; d < digits_end && !overflow; d++)
+		{
+			uint64_t digit = (uint64_t)(*d - '0');
+			overflow = value > (std::numeric_limits<uint64_t>::max() - digit) / 10;
+			value = value * 10 + digit;
+		}
+		const uint64_t kInt64Max = (uint64_t)std::numeric_limits<int64_t>::max();
+		if (!overflow && (!negative || value <= kInt64Max + 1))
+		{
+			if (negative)
+				ret = handler_->OnInt((int64_t)(0 - value));
+			else
+				ret = value <= kInt64Max ? handler_->OnInt((int64_t)value) : handler_->OnUint(value);
+			if (!ret)
+				return Fail(kJsonAborted, end);
+			EndValue();
+			return true;
+		}
+	}
+	else if (!integer && (digits_end - digits) + (fraction_end - fraction) <= 15)
+	{
+		// 有效数字不超过 15 位时尾数精确地落在 double 中，10 的 22 次幂以内也是精确的，
+		// 一次乘除即得到正确舍入的结果（Clinger 快速路径），不必走 strtod
+		static const double kPowersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		uint64_t mantissa = 0;
+		for (const char *d = digits; d < digits_end; d++)
+			mantissa = mantissa * 10 + (uint64_t)(*d - '0');
+		for (const char *d = fraction; d < fraction_end; d++)
+			mantissa = mantissa * 10 + (uint64_t)(*d - '0');
+		int scale = exponent - (int)(fraction_end - fraction);
+		if (scale >= -22 && scale <= 22)
+		{
+			double value = (double)mantissa;
+			value = scale < 0 ? value / kPowersOf10[-scale] : value * kPowersOf10[scale];
+			if (!handler_->OnDouble(negative ? -value : value))
+				return Fail(kJsonAborted, end);
+			EndValue();
+			return true;
+		}
+	}
+	// dmg_fp 的 strtod，与区域设置无关
+	double value = 0;
+	if (!base::StringToDouble(std::string(begin, end), &value) || !std::isfinite(value))
+		return Fail(kJsonInvalidNumber, begin);
+	if (!handler_->OnDouble(value))
+		return Fail(kJsonAborted, end);
+	EndValue();
+	return true;
+}
+
+bool JsonSaxParser::EmitLiteral(const char *begin, const char *end)
+{
+	std::string_view literal(begin, end - begin);
+	bool ret = false;
+	if (literal == "true")
+		ret = handler_->OnBool(true);
+	else if (literal == "false")
+		ret = handler_->OnBool(false);
+	else if (literal == "null")
+		ret = handler_->OnNull();
+	else
+		return Fail(kJsonUnexpectedCharacter, begin);
+	if (!ret)
+		return Fail(kJsonAborted, end);
+	EndValue();
+	return true;
+}
+
+void JsonSaxParser::EndValue()
+{
+	if (stack_.empty())
+	{
+		state_ = kDone;
+		return;
+	}
+	stack_.back().count++;
+	state_ = kCommaOrEnd;
+}
+
+bool JsonSaxParser::StartContainer(bool is_object)
+{
+	if (stack_.size() >= max_depth_)
+		return Fail(kJsonTooDeep, nullptr);
+	if (!(is_object ? handler_->OnStartObject() : handler_->OnStartArray()))
+		return Fail(kJsonAborted, nullptr);
+	Container container = { is_object, 0 };
+	stack_.push_back(container);
+	state_ = is_object ? kFirstKeyOrEnd : kFirstValueOrEnd;
+	return true;
+}
+
+bool JsonSaxParser::EndContainer(bool is_object)
+{
+	size_t count = stack_.back().count;
+	stack_.pop_back();
+	if (!(is_object ? handler_->OnEndObject(count) : handler_->OnEndArray(count)))
+		return Fail(kJsonAborted, nullptr);
+	EndValue();
+	return true;
+}
+
+bool JsonSaxParser::Fail(JsonError error, const char *at)
+{
+	error_ = error;
+	// 不在当前输入中的位置（如 pending_token_ 里的）按本次 Feed 的开头算
+	error_offset_ = consumed_;
+	if (at != nullptr && chunk_ != nullptr && at >= chunk_ && at <= chunk_ + chunk_size_)
+		error_offset_ += at - chunk_;
+	return false;
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,153 @@
+// an incremental SAX-style JSON parser which can be fed chunk by chunk
+
+#ifndef __BASE_EXTENSION_JSON_SAX_PARSER_H__
+#define __BASE_EXTENSION_JSON_SAX_PARSER_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 解析事件的处理者，每个回调返回 false 时解析中止（错误为 kJsonAborted）。
+// 默认实现忽略事件，只需要重写关心的部分。
+// 字符串只在回调期间有效；stable 为 true 表示 value 直接指向调用方传入的数据
+// （没有转义且没有跨越两次 Feed），调用方保证输入有效期间可以保存这个 view 而不拷贝
+class EXTENSION_EXPORT JsonHandler
+{
+public:
+	virtual ~JsonHandler() {}
+
+	virtual bool OnNull() { return true; }
+	virtual bool OnBool(bool value) { return true; }
+	// 没有小数和指数、在 int64 范围内的整数
+	virtual bool OnInt(int64_t value) { return true; }
+	// 超出 int64 但在 uint64 范围内的正整数
+	virtual bool OnUint(uint64_t value) { return true; }
+	// 其余的数字
+	virtual bool OnDouble(double value) { return true; }
+	virtual bool OnString(std::string_view value, bool stable) { return true; }
+	virtual bool OnStartObject() { return true; }
+	virtual bool OnKey(std::string_view key, bool stable) { return true; }
+	// member_count 为该对象的成员数
+	virtual bool OnEndObject(size_t member_count) { return true; }
+	virtual bool OnStartArray() { return true; }
+	virtual bool OnEndArray(size_t element_count) { return true; }
+};
+
+enum JsonError
+{
+	kJsonOk = 0,
+	kJsonUnexpectedEnd,			// 输入在一个值完整之前结束
+	kJsonUnexpectedCharacter,
+	kJsonInvalidNumber,
+	kJsonInvalidEscape,
+	kJsonInvalidUTF8,
+	kJsonControlCharacter,		// 字符串中未转义的控制字符
+	kJsonTooDeep,
+	kJsonTrailingData,			// 顶层的值之后还有非空白字符
+	kJsonAborted,				// 处理者返回了 false
+};
+
+EXTENSION_EXPORT const char* JsonErrorToString(JsonError error);
+
+// RFC 8259 的 JSON 解析器，不构造任何中间对象，通过 JsonHandler 报告解析到的值。
+// 输入可以在任意字节处切分后分多次 Feed，例如直接作为 nim_http 的 DataCallback
+// 或 Decompressor 的 sink，解析与下载同步进行，不需要先拼出完整的响应体。
+// 只在 token 跨越两次 Feed 或字符串含转义时拷贝，其余情况字符串都直接指向输入。
+// 嵌套用显式的栈而不是递归，深度受 max_depth 限制
+class EXTENSION_EXPORT JsonSaxParser
+{
+public:
+	enum { kDefaultMaxDepth = 512 };
+
+	explicit JsonSaxParser(JsonHandler *handler, size_t max_depth = kDefaultMaxDepth);
+	~JsonSaxParser();
+
+	// 出错后返回 false，之后的 Feed 都被忽略
+	bool Feed(const char *data, size_t size);
+	bool Feed(std::string_view data) { return Feed(data.data(), data.size()); }
+	// 输入结束，顶层的值不完整时返回 false
+	bool Finish();
+	// 一次性解析完整的输入
+	static JsonError Parse(std::string_view json, JsonHandler *handler, size_t max_depth = kDefaultMaxDepth);
+
+	// 默认校验字符串是合法的 UTF-8，已知输入可信时可以关闭
+	void set_validate_utf8(bool validate) { validate_utf8_ = validate; }
+
+	JsonError error() const { return error_; }
+	// 出错位置相对于第一次 Feed 的字节偏移
+	uint64_t error_offset() const { return error_offset_; }
+	bool finished() const { return state_ == kDone; }
+
+private:
+	enum State
+	{
+		kValue,				// 期待一个值
+		kFirstValueOrEnd,	// '[' 之后
+		kKey,				// 对象中 ',' 之后
+		kFirstKeyOrEnd,		// '{' 之后
+		kColon,
+		kCommaOrEnd,		// 容器中一个值之后
+		kDone,				// 顶层的值已完整
+	};
+	// 跨越两次 Feed 的 token
+	enum Pending
+	{
+		kPendingNone,
+		kPendingString,
+		kPendingNumber,
+		kPendingLiteral,
+	};
+	struct Container
+	{
+		bool is_object;
+		size_t count;
+	};
+
+	// 从 p 开始解析，返回处理到的位置，出错时返回 nullptr
+	const char* ParseTokens(const char *p, const char *end);
+	// 在 p 处解析一个完整的 token，token 在 end 之前不完整时把剩余部分存入 pending_token_ 并返回 end
+	const char* ParseString(const char *p, const char *end, bool is_key, bool stable);
+	const char* ParseNumber(const char *p, const char *end);
+	const char* ParseLiteral(const char *p, const char *end);
+	// 继续解析 pending_ 中的 token，返回本次输入中 token 之后的位置
+	const char* ResumePending(const char *p, const char *end);
+
+	// token 解析完成后的事件和状态转移
+	bool EmitString(const char *begin, const char *end, bool escaped, bool non_ascii, bool is_key, bool stable);
+	bool EmitNumber(const char *begin, const char *end);
+	bool EmitLiteral(const char *begin, const char *end);
+	void EndValue();
+	bool StartContainer(bool is_object);
+	bool EndContainer(bool is_object);
+
+	bool Fail(JsonError error, const char *at);
+
+	JsonHandler *handler_;
+	size_t max_depth_;
+	bool validate_utf8_;
+	State state_;
+	std::vector<Container> stack_;
+	Pending pending_;
+	std::string pending_token_;	// 跨越 Feed 的 token 已收到的部分
+	bool pending_is_key_;
+	std::string unescaped_;		// 含转义的字符串解码后的内容，复用以免每次分配
+	JsonError error_;
+	uint64_t error_offset_;
+	uint64_t consumed_;			// 之前的 Feed 共输入的字节数
+	const char *chunk_;			// 当前 Feed 的数据，用于计算出错偏移
+	size_t chunk_size_;
+
+	DISALLOW_COPY_AND_ASSIGN(JsonSaxParser);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_JSON_SAX_PARSER_H__
@@ -0,0 +1,213 @@
+// This file defines a pooled block allocator for BlockBuffer
+
+#ifndef BASE_MEMORY_BLOCK_POOL_ALLOCATOR_H_
+#define BASE_MEMORY_BLOCK_POOL_ALLOCATOR_H_
+#include "extension/config/build_config.h"
+#include "base/threading/thread_local_storage.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+
+EXTENSION_BEGIN_DECLS
+
+// 带线程缓存的块池，可作为 BlockBuffer 的 BlockAllocator，如 BlockBuffer<pool_block_alloc_4k, 16>
+// ordered_malloc(n) 按块数 n 分档，n 不超过 MaxPooledBlocks 的依次从本线程缓存、全局池里取，都没有才 malloc；
+// ordered_free 先放回本线程缓存，缓存超过 ThreadCacheBlocks 个块时把该档的一半挪回全局池，
+// 全局池超过 GlobalPoolBlocks 个块时才 free。线程退出时缓存的块归还全局池。
+// 线程缓存与全局池之间成批搬运，多数分配和释放不加锁。
+// 超过 MaxPooledBlocks 的请求直接 malloc/free，不占用池。
+template <unsigned BlockSize, unsigned MaxPooledBlocks = 4, unsigned ThreadCacheBlocks = 32, unsigned GlobalPoolBlocks = 512>
+struct pooled_block_allocator
+{
+	enum { requested_size = BlockSize };
+	enum { max_pooled_blocks = MaxPooledBlocks };
+
+	static char * ordered_malloc(size_t n)
+	{
+		if (n == 0 || n > max_pooled_blocks)
+		{
+			s_misses++;
+			return (char *)malloc(requested_size * n);
+		}
+		thread_cache *cache = get_thread_cache();
+		if (cache != 0)
+		{
+			free_list &list = cache->lists[n - 1];
+			if (list.head == 0)
+				refill(*cache, list, n);
+			if (list.head != 0)
+			{
+				s_hits++;
+				return pop(list, n, cache->blocks);
+			}
+		}
+		s_misses++;
+		return (char *)malloc(requested_size * n);
+	}
+
+	static void ordered_free(char * const block, size_t n)
+	{
+		if (block == 0)
+			return;
+		thread_cache *cache = (n == 0 || n > max_pooled_blocks) ? 0 : get_thread_cache();
+		if (cache == 0)
+		{
+			free(block);
+			return;
+		}
+		free_list &list = cache->lists[n - 1];
+		push(list, block, n, cache->blocks);
+		if (cache->blocks > ThreadCacheBlocks)
+			flush(list, n, cache->blocks, list.count - list.count / 2);
+	}
+
+	// 从池里取到的次数、需要 malloc 的次数
+	static size_t pool_hits()   { return s_hits; }
+	static size_t pool_misses() { return s_misses; }
+	// 全局池中空闲的块数，不含线程缓存
+	static size_t pooled_blocks() { return s_pooled_blocks; }
+
+	// 释放全局池中的块，线程缓存不受影响
+	static void purge()
+	{
+		global_pool &pool = get_global_pool();
+		std::lock_guard<std::mutex> guard(pool.lock);
+		for (size_t i = 0; i < max_pooled_blocks; i++)
+		{
+			while (pool.lists[i].head != 0)
+			{
+				size_t blocks = 0;
+				free(pop(pool.lists[i], i + 1, blocks));
+			}
+		}
+		s_pooled_blocks = 0;
+	}
+
+private:
+	// 空闲的块串成单链表，链接指针放在块的开头
+	struct chunk { chunk *next; };
+	struct free_list
+	{
+		free_list() : head(0), count(0) {}
+		chunk *head;
+		size_t count;
+	};
+	struct thread_cache
+	{
+		thread_cache() : blocks(0) {}
+		free_list lists[MaxPooledBlocks];
+		size_t blocks;
+	};
+	struct global_pool
+	{
+		std::mutex lock;
+		free_list lists[MaxPooledBlocks];
+	};
+
+	static char * pop(free_list &list, size_t n, size_t &blocks)
+	{
+		chunk *c = list.head;
+		list.head = c->next;
+		list.count--;
+		blocks -= n;
+		return (char *)c;
+	}
+	static void push(free_list &list, char *block, size_t n, size_t &blocks)
+	{
+		chunk *c = (chunk *)block;
+		c->next = list.head;
+		list.head = c;
+		list.count++;
+		blocks += n;
+	}
+
+	// 从全局池批量取，最多取半个线程缓存
+	static void refill(thread_cache &cache, free_list &list, size_t n)
+	{
+		global_pool &pool = get_global_pool();
+		size_t batch = ThreadCacheBlocks / 2 / n;
+		if (batch == 0)
+			batch = 1;
+		std::lock_guard<std::mutex> guard(pool.lock);
+		free_list &global = pool.lists[n - 1];
+		size_t global_blocks = 0;
+		for (size_t i = 0; i < batch && global.head != 0; i++)
+		{
+			push(list, pop(global, n, global_blocks), n, cache.blocks);
+			s_pooled_blocks -= n;
+		}
+	}
+
+	// 挪 count 个到全局池，全局池满了就 free
+	static void flush(free_list &list, size_t n, size_t &blocks, size_t count)
+	{
+		global_pool &pool = get_global_pool();
+		std::lock_guard<std::mutex> guard(pool.lock);
+		free_list &global = pool.lists[n - 1];
+		size_t global_blocks = 0;
+		for (size_t i = 0; i < count && list.head != 0; i++)
+		{
+			char *block = pop(list, n, blocks);
+			if (s_pooled_blocks + n > GlobalPoolBlocks)
+			{
+				free(block);
+				continue;
+			}
+			push(global, block, n, global_blocks);
+			s_pooled_blocks += n;
+		}
+	}
+
+	static void destroy_thread_cache(void *value)
+	{
+		thread_cache *cache = (thread_cache *)value;
+		for (size_t i = 0; i < max_pooled_blocks; i++)
+			flush(cache->lists[i], i + 1, cache->blocks, cache->lists[i].count);
+		delete cache;
+	}
+
+	// 分配不到线程缓存时返回 0，调用方退回 malloc/free
+	static thread_cache * get_thread_cache()
+	{
+		static base::ThreadLocalStorage::Slot *slot = new base::ThreadLocalStorage::Slot(&destroy_thread_cache);
+		thread_cache *cache = (thread_cache *)slot->Get();
+		if (cache == 0)
+		{
+			cache = new (std::nothrow) thread_cache;
+			slot->Set(cache);
+		}
+		return cache;
+	}
+
+	// 刻意不析构，线程退出时还要归还缓存
+	static global_pool & get_global_pool()
+	{
+		static global_pool *pool = new global_pool;
+		return *pool;
+	}
+
+	static std::atomic<size_t> s_hits;
+	static std::atomic<size_t> s_misses;
+	static std::atomic<size_t> s_pooled_blocks;
+};
+
+template <unsigned BlockSize, unsigned MaxPooledBlocks, unsigned ThreadCacheBlocks, unsigned GlobalPoolBlocks>
+std::atomic<size_t> pooled_block_allocator<BlockSize, MaxPooledBlocks, ThreadCacheBlocks, GlobalPoolBlocks>::s_hits(0);
+
+template <unsigned BlockSize, unsigned MaxPooledBlocks, unsigned ThreadCacheBlocks, unsigned GlobalPoolBlocks>
+std::atomic<size_t> pooled_block_allocator<BlockSize, MaxPooledBlocks, ThreadCacheBlocks, GlobalPoolBlocks>::s_misses(0);
+
+template <unsigned BlockSize, unsigned MaxPooledBlocks, unsigned ThreadCacheBlocks, unsigned GlobalPoolBlocks>
+std::atomic<size_t> pooled_block_allocator<BlockSize, MaxPooledBlocks, ThreadCacheBlocks, GlobalPoolBlocks>::s_pooled_blocks(0);
+
+typedef pooled_block_allocator<1*1024> pool_block_alloc_1k;
+typedef pooled_block_allocator<2*1024> pool_block_alloc_2k;
+typedef pooled_block_allocator<4*1024> pool_block_alloc_4k;
+typedef pooled_block_allocator<8*1024> pool_block_alloc_8k;
+typedef pooled_block_allocator<16*1024> pool_block_alloc_16k;
+typedef pooled_block_allocator<32*1024> pool_block_alloc_32k;
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_BLOCK_POOL_ALLOCATOR_H_
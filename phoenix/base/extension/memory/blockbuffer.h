@@ -3,6 +3,7 @@
 #ifndef BASE_MEMORY_BLOCKBUFFER_H_
 #define BASE_MEMORY_BLOCKBUFFER_H_
 #include "extension/config/build_config.h"
+#include <atomic>
 #include <new>
 #include <assert.h>
 #include <stdlib.h>
@@ -89,6 +90,7 @@ public:
 	bool replace(size_t pos, const char *rep, size_t n);
 	void erase(size_t pos = 0, size_t n = npos, bool hold = false);
 
+	// 同一种 BlockBuffer 在所有线程上的块数
 	static size_t current_total_blocks() { return s_current_total_blocks; }
 	static size_t peak_total_blocks()    { return s_peak_total_blocks; }
 
@@ -99,8 +101,8 @@ protected:
 
 private:
 	void free();
-	static size_t s_current_total_blocks;
-	static size_t s_peak_total_blocks;
+	static std::atomic<size_t> s_current_total_blocks;
+	static std::atomic<size_t> s_peak_total_blocks;
 
 	char  *data_;
 	size_t size_;
@@ -111,10 +113,10 @@ private:
 };
 
 template <typename BlockAllocator, unsigned MaxBlocks>
-size_t BlockBuffer<BlockAllocator, MaxBlocks >::s_current_total_blocks = 0;
+std::atomic<size_t> BlockBuffer<BlockAllocator, MaxBlocks >::s_current_total_blocks(0);
 
 template <typename BlockAllocator, unsigned MaxBlocks>
-size_t BlockBuffer<BlockAllocator, MaxBlocks >::s_peak_total_blocks = 0;
+std::atomic<size_t> BlockBuffer<BlockAllocator, MaxBlocks >::s_peak_total_blocks(0);
 
 template <typename BlockAllocator, unsigned MaxBlocks>
 inline void BlockBuffer<BlockAllocator, MaxBlocks >::free()
@@ -229,9 +231,10 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::increase_capacity(size_t in
         allocator::ordered_free(data_, block_);
     }
 
-    s_current_total_blocks += newblock - block_;
-    if (s_current_total_blocks > s_peak_total_blocks)
-        s_peak_total_blocks = s_current_total_blocks;
+    size_t current = s_current_total_blocks += newblock - block_;
+    size_t peak = s_peak_total_blocks;
+    while (current > peak && !s_peak_total_blocks.compare_exchange_weak(peak, current))
+        ;
 
     data_ = newdata;
     block_ = newblock;
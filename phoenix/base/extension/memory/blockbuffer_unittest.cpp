@@ -7,10 +7,14 @@
 
 #if defined(WITH_UNITTEST)
 
-#include "base/memory/blockbuffer.h"
+#include "extension/memory/blockbuffer.h"
+#include "extension/memory/block_pool_allocator.h"
 #include "gtest/gtest.h"
+#include <vector>
 
-typedef nbase::BlockBuffer<nbase::def_block_alloc_4k, 64> Def4BB;
+USING_NS_EXTENSION
+
+typedef BlockBuffer<def_block_alloc_4k, 64> Def4BB;
 
 TEST(BlockBuffer, Basic)
 {
@@ -60,4 +64,126 @@ TEST(BlockBuffer, Basic)
 	EXPECT_EQ(5000, bbuffer.size());
 }
 
-#endif  // WITH_UNITTEST
\ No newline at end of file
+// 计数是每个实例化各自的静态变量，所以每个用例用不同的模板参数
+
+TEST(BlockPoolAllocator, Reuse)
+{
+	typedef pooled_block_allocator<64, 2, 4, 8> Alloc;
+	char *block = Alloc::ordered_malloc(1);
+	ASSERT_TRUE(block != 0);
+	EXPECT_EQ(0u, Alloc::pool_hits());
+	EXPECT_EQ(1u, Alloc::pool_misses());
+
+	Alloc::ordered_free(block, 1);
+	EXPECT_EQ(block, Alloc::ordered_malloc(1));
+	EXPECT_EQ(1u, Alloc::pool_hits());
+
+	// 不同块数分档缓存，互不复用
+	char *pair = Alloc::ordered_malloc(2);
+	EXPECT_EQ(2u, Alloc::pool_misses());
+	Alloc::ordered_free(pair, 2);
+	Alloc::ordered_free(block, 1);
+	EXPECT_EQ(pair, Alloc::ordered_malloc(2));
+	EXPECT_EQ(block, Alloc::ordered_malloc(1));
+	EXPECT_EQ(3u, Alloc::pool_hits());
+	EXPECT_EQ(2u, Alloc::pool_misses());
+	Alloc::ordered_free(pair, 2);
+	Alloc::ordered_free(block, 1);
+}
+
+TEST(BlockPoolAllocator, ThreadCacheOverflow)
+{
+	typedef pooled_block_allocator<64, 1, 4, 8> Alloc;
+	std::vector<char *> blocks;
+	for (int i = 0; i < 6; i++)
+		blocks.push_back(Alloc::ordered_malloc(1));
+	EXPECT_EQ(6u, Alloc::pool_misses());
+
+	// 线程缓存超过 4 块时一半挪回全局池
+	for (size_t i = 0; i < blocks.size(); i++)
+		Alloc::ordered_free(blocks[i], 1);
+	EXPECT_GT(Alloc::pooled_blocks(), 0u);
+	EXPECT_LE(Alloc::pooled_blocks(), 4u);
+
+	// 线程缓存和全局池里的块都能取回来
+	for (size_t i = 0; i < blocks.size(); i++)
+		blocks[i] = Alloc::ordered_malloc(1);
+	EXPECT_EQ(6u, Alloc::pool_hits());
+	EXPECT_EQ(6u, Alloc::pool_misses());
+	EXPECT_EQ(0u, Alloc::pooled_blocks());
+	for (size_t i = 0; i < blocks.size(); i++)
+		Alloc::ordered_free(blocks[i], 1);
+}
+
+TEST(BlockPoolAllocator, Exhaustion)
+{
+	typedef pooled_block_allocator<128, 1, 4, 8> Alloc;
+	std::vector<char *> blocks;
+	for (int i = 0; i < 40; i++)
+		blocks.push_back(Alloc::ordered_malloc(1));
+	for (size_t i = 0; i < blocks.size(); i++)
+		Alloc::ordered_free(blocks[i], 1);
+	// 全局池最多留 8 块，线程缓存最多 4 块，其余的直接释放
+	EXPECT_EQ(8u, Alloc::pooled_blocks());
+
+	for (size_t i = 0; i < blocks.size(); i++)
+		blocks[i] = Alloc::ordered_malloc(1);
+	EXPECT_LE(Alloc::pool_hits(), 12u);
+	EXPECT_EQ(80u, Alloc::pool_hits() + Alloc::pool_misses());
+	EXPECT_EQ(0u, Alloc::pooled_blocks());
+	for (size_t i = 0; i < blocks.size(); i++)
+		Alloc::ordered_free(blocks[i], 1);
+
+	Alloc::purge();
+	EXPECT_EQ(0u, Alloc::pooled_blocks());
+}
+
+TEST(BlockPoolAllocator, OversizeFallback)
+{
+	typedef pooled_block_allocator<256, 2, 4, 8> Alloc;
+	// 超过 MaxPooledBlocks 的请求直接 malloc/free，不进池
+	char *block = Alloc::ordered_malloc(3);
+	ASSERT_TRUE(block != 0);
+	memset(block, 0, 3 * 256);
+	EXPECT_EQ(1u, Alloc::pool_misses());
+	Alloc::ordered_free(block, 3);
+	EXPECT_EQ(0u, Alloc::pooled_blocks());
+
+	block = Alloc::ordered_malloc(3);
+	EXPECT_EQ(0u, Alloc::pool_hits());
+	EXPECT_EQ(2u, Alloc::pool_misses());
+	Alloc::ordered_free(block, 3);
+}
+
+TEST(BlockPoolAllocator, BlockBuffer)
+{
+	typedef pooled_block_allocator<512, 2, 4, 8> Alloc;
+	typedef BlockBuffer<Alloc, 4> PoolBB;
+	std::string data(700, 'x');
+	{
+		PoolBB bbuffer;
+		EXPECT_TRUE(bbuffer.append(data.data(), data.size()));
+		EXPECT_EQ(2u, bbuffer.block());
+		EXPECT_EQ(1u, Alloc::pool_misses());
+
+		// 超过 maxsize 的追加失败，已有数据不变
+		EXPECT_FALSE(bbuffer.append(data.data(), 4 * 512 - 699));
+		EXPECT_EQ(700u, bbuffer.size());
+		EXPECT_EQ(2u, bbuffer.block());
+
+		// 涨到 3 块超出池的分档，走 malloc
+		EXPECT_TRUE(bbuffer.append(data.data(), 400));
+		EXPECT_EQ(3u, bbuffer.block());
+		EXPECT_EQ(2u, Alloc::pool_misses());
+		EXPECT_EQ(0u, Alloc::pool_hits());
+	}
+	{
+		// 第一个 buffer 扩容时放回的 2 块被复用
+		PoolBB bbuffer;
+		EXPECT_TRUE(bbuffer.append(data.data(), data.size()));
+		EXPECT_EQ(1u, Alloc::pool_hits());
+		EXPECT_EQ(std::string(bbuffer.data(), bbuffer.size()), data);
+	}
+}
+
+#endif  // WITH_UNITTEST
@@ -0,0 +1,82 @@
+#include "extension/memory/byte_swap.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BYTE_SWAP_USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define BYTE_SWAP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const size_t kChunkSize = 16;
+
+#if defined(BYTE_SWAP_USE_SSE2)
+// SSE2 没有 pshufb：先交换 16 位内的两个字节，再按宽度重排 16 位字
+inline __m128i SwapChunk(__m128i v, size_t width)
+{
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	if (width == 4)
+	{
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	else if (width == 8)
+	{
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	}
+	return v;
+}
+#elif defined(BYTE_SWAP_USE_NEON)
+inline uint8x16_t SwapChunk(uint8x16_t v, size_t width)
+{
+	if (width == 2)
+		return vrev16q_u8(v);
+	if (width == 4)
+		return vrev32q_u8(v);
+	return vrev64q_u8(v);
+}
+#endif
+
+inline void SwapOne(char *dest, const char *src, size_t width)
+{
+	char tmp[8];
+	for (size_t i = 0; i < width; i++)
+		tmp[i] = src[width - 1 - i];
+	memcpy(dest, tmp, width);
+}
+}
+
+void byte_swap_copy(void *dest, const void *src, size_t count, size_t width)
+{
+	if (width != 2 && width != 4 && width != 8)
+	{
+		if (dest != src)
+			memmove(dest, src, count * width);
+		return;
+	}
+	char *out = (char *)dest;
+	const char *in = (const char *)src;
+	size_t bytes = count * width;
+	size_t i = 0;
+#if defined(BYTE_SWAP_USE_SSE2)
+	for (; i + kChunkSize <= bytes; i += kChunkSize)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), SwapChunk(v, width));
+	}
+#elif defined(BYTE_SWAP_USE_NEON)
+	for (; i + kChunkSize <= bytes; i += kChunkSize)
+		vst1q_u8((uint8_t *)(out + i), SwapChunk(vld1q_u8((const uint8_t *)(in + i)), width));
+#endif
+	for (; i < bytes; i += width)
+		SwapOne(out + i, in + i, width);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,18 @@
+// This file defines bulk byte order conversion
+
+#ifndef BASE_MEMORY_BYTE_SWAP_H_
+#define BASE_MEMORY_BYTE_SWAP_H_
+
+#include "extension/extension_export.h"
+#include "extension/config/build_config.h"
+#include <stddef.h>
+
+EXTENSION_BEGIN_DECLS
+
+// 把 count 个宽度为 width（2、4、8）字节的整数从 src 拷到 dest 并逐个反转字节序，
+// 支持 SSE2/NEON 时每次处理 16 字节，dest 与 src 可以相同但不能部分重叠，都不要求对齐
+EXTENSION_EXPORT void byte_swap_copy(void *dest, const void *src, size_t count, size_t width);
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_BYTE_SWAP_H_
@@ -0,0 +1,263 @@
+#include "extension/memory/chained_buffer.h"
+#include "extension/nexeption/error.h"
+#include <algorithm>
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 不超过该大小的字符串拷贝进段里，更大的直接接管
+const size_t kAdoptStringSize = ChainedBuffer::kSegmentSize / 2;
+// append(const ChainedBuffer &) 时不超过该大小的片段拷贝而不共享
+const size_t kCopyViewSize = 512;
+}
+
+struct ChainedBuffer::Segment
+{
+	Segment() : block(0), base(0), capacity(0) {}
+	~Segment()
+	{
+		if (block != 0)
+			pool_block_alloc_4k::ordered_free(block, 1);
+	}
+
+	char				*block;		// 自有的段，引用外部内存时为 0
+	const char			*base;
+	size_t				capacity;
+	std::shared_ptr<const void>	owner;	// 外部内存的所有者
+
+private:
+	Segment(const Segment &);
+	Segment & operator = (const Segment &);
+};
+
+void ChainedBuffer::append(const char *data, size_t size)
+{
+	while (size > 0)
+	{
+		size_t room = views_.empty() ? 0 : tail_room(views_.back());
+		if (room == 0)
+		{
+			views_.push_back(new_view(views_.empty() ? kHeadroom : 0));
+			continue;
+		}
+		View &tail = views_.back();
+		size_t n = std::min(room, size);
+		memcpy(writable_data(tail) + tail.size, data, n);
+		tail.size += n;
+		size_ += n;
+		data += n;
+		size -= n;
+	}
+}
+
+void ChainedBuffer::append(std::string &&data)
+{
+	if (data.size() <= kAdoptStringSize)
+	{
+		append(data.data(), data.size());
+		return;
+	}
+	std::shared_ptr<const std::string> owner = std::make_shared<std::string>(std::move(data));
+	append_owned(owner);
+}
+
+void ChainedBuffer::append(const ChainedBuffer &other)
+{
+	if (&other == this)
+	{
+		ChainedBuffer copy(other);
+		append(copy);
+		return;
+	}
+	for (auto &view : other.views_)
+	{
+		if (view.size <= kCopyViewSize && !views_.empty() && view.size <= tail_room(views_.back()))
+		{
+			append(view_data(view), view.size);
+			continue;
+		}
+		views_.push_back(view);
+		size_ += view.size;
+	}
+}
+
+void ChainedBuffer::append_external(const std::shared_ptr<const void> &owner, const char *data, size_t size)
+{
+	if (size == 0)
+		return;
+	std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+	segment->base = data;
+	segment->capacity = size;
+	segment->owner = owner;
+	View view;
+	view.segment = std::move(segment);
+	view.offset = 0;
+	view.size = size;
+	views_.push_back(std::move(view));
+	size_ += size;
+}
+
+void ChainedBuffer::prepend(const char *data, size_t size)
+{
+	if (views_.empty())
+	{
+		append(data, size);
+		return;
+	}
+	//从后往前填，新段的数据靠段尾放，紧挨着原来的首段
+	while (size > 0)
+	{
+		size_t room = head_room(views_.front());
+		if (room == 0)
+		{
+			views_.push_front(new_view(kSegmentSize));
+			continue;
+		}
+		View &head = views_.front();
+		size_t n = std::min(room, size);
+		head.offset -= n;
+		head.size += n;
+		memcpy(writable_data(head), data + size - n, n);
+		size_ += n;
+		size -= n;
+	}
+}
+
+ChainedBuffer ChainedBuffer::split(size_t n)
+{
+	ChainedBuffer front;
+	while (n > 0 && !views_.empty())
+	{
+		View &head = views_.front();
+		if (head.size <= n)
+		{
+			n -= head.size;
+			size_ -= head.size;
+			front.size_ += head.size;
+			front.views_.push_back(std::move(head));
+			views_.pop_front();
+			continue;
+		}
+		//段被两边共享，之后两边都不会再往里写
+		View part = head;
+		part.size = n;
+		front.views_.push_back(std::move(part));
+		front.size_ += n;
+		head.offset += n;
+		head.size -= n;
+		size_ -= n;
+		n = 0;
+	}
+	return front;
+}
+
+void ChainedBuffer::consume(size_t n)
+{
+	while (n > 0 && !views_.empty())
+	{
+		View &head = views_.front();
+		if (head.size <= n)
+		{
+			n -= head.size;
+			size_ -= head.size;
+			views_.pop_front();
+			continue;
+		}
+		head.offset += n;
+		head.size -= n;
+		size_ -= n;
+		n = 0;
+	}
+}
+
+void ChainedBuffer::clear()
+{
+	views_.clear();
+	size_ = 0;
+}
+
+size_t ChainedBuffer::slices(Slice *out, size_t max) const
+{
+	size_t count = 0;
+	for (auto it = views_.begin(); it != views_.end() && count < max; ++it, ++count)
+	{
+		out[count].data = view_data(*it);
+		out[count].size = it->size;
+	}
+	return count;
+}
+
+void ChainedBuffer::visit(const SegmentVisitor &visitor) const
+{
+	for (auto &view : views_)
+		visitor(view.segment, view_data(view), view.size);
+}
+
+size_t ChainedBuffer::copy_to(size_t offset, char *dest, size_t size) const
+{
+	size_t copied = 0;
+	for (auto it = views_.begin(); it != views_.end() && copied < size; ++it)
+	{
+		if (offset >= it->size)
+		{
+			offset -= it->size;
+			continue;
+		}
+		size_t n = std::min(it->size - offset, size - copied);
+		memcpy(dest + copied, view_data(*it) + offset, n);
+		copied += n;
+		offset = 0;
+	}
+	return copied;
+}
+
+std::string ChainedBuffer::to_string() const
+{
+	std::string result;
+	result.reserve(size_);
+	for (auto &view : views_)
+		result.append(view_data(view), view.size);
+	return result;
+}
+
+size_t ChainedBuffer::head_room(const View &view)
+{
+	if (view.segment->block == 0 || view.segment.use_count() != 1)
+		return 0;
+	return view.offset;
+}
+
+size_t ChainedBuffer::tail_room(const View &view)
+{
+	if (view.segment->block == 0 || view.segment.use_count() != 1)
+		return 0;
+	return view.segment->capacity - view.offset - view.size;
+}
+
+ChainedBuffer::View ChainedBuffer::new_view(size_t offset)
+{
+	std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+	segment->block = pool_block_alloc_4k::ordered_malloc(1);
+	if (segment->block == 0)
+		throw NException("chained buffer segment allocation failed", kResultMemoryError);
+	segment->base = segment->block;
+	segment->capacity = kSegmentSize;
+	View view;
+	view.segment = std::move(segment);
+	view.offset = offset;
+	view.size = 0;
+	return view;
+}
+
+char * ChainedBuffer::writable_data(const View &view)
+{
+	return view.segment->block + view.offset;
+}
+
+const char * ChainedBuffer::view_data(const View &view)
+{
+	return view.segment->base + view.offset;
+}
+
+EXTENSION_END_DECLS
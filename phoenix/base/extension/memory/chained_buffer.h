@@ -0,0 +1,104 @@
+// This file defines a chained buffer of refcounted segments
+
+#ifndef BASE_MEMORY_CHAINED_BUFFER_H_
+#define BASE_MEMORY_CHAINED_BUFFER_H_
+
+#include "extension/extension_export.h"
+#include "extension/config/build_config.h"
+#include "extension/memory/block_pool_allocator.h"
+#include <string.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+EXTENSION_BEGIN_DECLS
+
+// 由引用计数的固定大小段串成的缓冲区，用于组包和发送时免拷贝：
+// append 写满一段再从 pool_block_alloc_4k 取新段，不会像 BlockBuffer 那样扩容时整体搬移；
+// prepend 优先写进首段前部预留的空间，装包头不需要挪动包体；
+// split、append(const ChainedBuffer &) 和拷贝构造只增加段的引用计数，不拷贝数据；
+// append_owned 直接引用 PackBuffer、std::string 等外部缓冲区。
+// 只有被唯一引用的段才会继续写入，共享出去的段（如已交给 SendQueue 的）只读。
+// 与 std::string 一样不是线程安全的，不同线程各自持有的拷贝可以并发使用。
+class EXTENSION_EXPORT ChainedBuffer
+{
+public:
+	enum { kSegmentSize = pool_block_alloc_4k::requested_size };
+	// 空缓冲区第一次写入时在段首预留的字节数，留给之后 prepend 的包头
+	enum { kHeadroom = 64 };
+
+	// 内存布局与 SendQueue::Slice 一致，可直接用于 writev/WSASend
+	struct Slice
+	{
+		const char	*data;
+		size_t		size;
+	};
+	// owner 持有 data 所在的段，回调方保留它即可在缓冲区释放后继续使用数据
+	typedef std::function<void(const std::shared_ptr<const void> &owner, const char *data, size_t size)> SegmentVisitor;
+
+	ChainedBuffer() : size_(0) {}
+
+	size_t size() const         { return size_; }
+	bool empty() const          { return size_ == 0; }
+	size_t slice_count() const  { return views_.size(); }
+
+	// 段内存分配失败时抛 NException(kResultMemoryError)，与 PackBuffer 一致
+	void append(const char *data, size_t size);
+	void append(const char *data) { append(data, ::strlen(data)); }
+	void append(const std::string &data) { append(data.data(), data.size()); }
+	// 较大的字符串直接接管，不拷贝
+	void append(std::string &&data);
+	// 共享 other 的段；很短的片段直接拷进尾段，避免碎片让 iovec 变多
+	void append(const ChainedBuffer &other);
+	// 引用外部内存，owner 在缓冲区不再使用这段数据前保持其有效，期间数据不能被修改
+	void append_external(const std::shared_ptr<const void> &owner, const char *data, size_t size);
+	// T 需提供 data() 和 size()，如 PackBuffer、std::string
+	template <class T>
+	void append_owned(const std::shared_ptr<T> &owner, size_t offset = 0)
+	{
+		if (owner && offset < owner->size())
+			append_external(owner, owner->data() + offset, owner->size() - offset);
+	}
+	// 插到最前面，用于包体写完后再补包头
+	void prepend(const char *data, size_t size);
+
+	// 从缓冲区取走前 n 个字节并返回，n 超过 size() 时取走全部
+	ChainedBuffer split(size_t n);
+	// 丢弃前 n 个字节
+	void consume(size_t n);
+	void clear();
+
+	// 导出分片，返回填充的个数；分片数超过 max 时只导出最前面的 max 个
+	size_t slices(Slice *out, size_t max) const;
+	// 依次访问每个分片
+	void visit(const SegmentVisitor &visitor) const;
+	// 从 offset 开始拷出最多 size 个字节，返回实际拷贝的字节数
+	size_t copy_to(size_t offset, char *dest, size_t size) const;
+	std::string to_string() const;
+
+private:
+	struct Segment;
+	struct View
+	{
+		std::shared_ptr<Segment>	segment;
+		size_t						offset;
+		size_t						size;
+	};
+
+	// 段未共享时，段内 view 前后的空闲字节数，否则为 0
+	static size_t head_room(const View &view);
+	static size_t tail_room(const View &view);
+	// 新段的数据从 offset 处开始
+	static View new_view(size_t offset);
+	static char * writable_data(const View &view);
+	static const char * view_data(const View &view);
+
+private:
+	std::deque<View>	views_;
+	size_t				size_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_CHAINED_BUFFER_H_
@@ -0,0 +1,217 @@
+// ChainedBuffer Unittest
+// 覆盖跨段追加、跨段消费、切分、prepend 使用预留空间以及合并短片段
+
+#if defined(WITH_UNITTEST)
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "extension/memory/chained_buffer.h"
+#include "gtest/gtest.h"
+
+USING_NS_EXTENSION
+
+namespace
+{
+// 每个字节不同，错位能被比较出来
+std::string Pattern(size_t size, size_t seed = 0)
+{
+	std::string data(size, 0);
+	for (size_t i = 0; i < size; i++)
+		data[i] = (char)((i + seed) * 131 % 251);
+	return data;
+}
+
+std::string SliceString(const ChainedBuffer &buffer)
+{
+	std::vector<ChainedBuffer::Slice> slices(buffer.slice_count());
+	size_t count = buffer.slices(slices.data(), slices.size());
+	std::string result;
+	for (size_t i = 0; i < count; i++)
+		result.append(slices[i].data, slices[i].size);
+	return result;
+}
+}
+
+TEST(ChainedBuffer, AppendAcrossSegments)
+{
+	ChainedBuffer buffer;
+	EXPECT_TRUE(buffer.empty());
+	EXPECT_EQ(0u, buffer.slice_count());
+
+	// 首段预留 kHeadroom，能装下 kSegmentSize - kHeadroom 个字节
+	std::string data = Pattern(ChainedBuffer::kSegmentSize * 2);
+	buffer.append(data.data(), ChainedBuffer::kSegmentSize - ChainedBuffer::kHeadroom);
+	EXPECT_EQ(1u, buffer.slice_count());
+	buffer.append(data.data() + buffer.size(), data.size() - buffer.size());
+	EXPECT_EQ(3u, buffer.slice_count());
+	EXPECT_EQ(data.size(), buffer.size());
+	EXPECT_EQ(data, buffer.to_string());
+	EXPECT_EQ(data, SliceString(buffer));
+
+	// 导出的分片数受 max 限制
+	ChainedBuffer::Slice slice;
+	EXPECT_EQ(1u, buffer.slices(&slice, 1));
+	EXPECT_EQ(ChainedBuffer::kSegmentSize - ChainedBuffer::kHeadroom, slice.size);
+}
+
+TEST(ChainedBuffer, AppendString)
+{
+	ChainedBuffer buffer;
+	buffer.append("head");
+	// 长字符串接管而不拷贝，自成一个分片
+	std::string large = Pattern(ChainedBuffer::kSegmentSize);
+	const char *large_data = large.data();
+	buffer.append(std::move(large));
+	EXPECT_EQ(2u, buffer.slice_count());
+	ChainedBuffer::Slice slices[2];
+	buffer.slices(slices, 2);
+	EXPECT_EQ(large_data, slices[1].data);
+
+	// 短字符串拷贝，外部引用的分片之后另起一段
+	buffer.append(std::string("tail"));
+	EXPECT_EQ(3u, buffer.slice_count());
+	EXPECT_EQ("head" + Pattern(ChainedBuffer::kSegmentSize) + "tail", buffer.to_string());
+}
+
+TEST(ChainedBuffer, ConsumeAcrossLinks)
+{
+	std::string data = Pattern(ChainedBuffer::kSegmentSize * 3);
+	ChainedBuffer buffer;
+	buffer.append(data);
+	size_t slices = buffer.slice_count();
+
+	// 在首段中间、恰好首段末尾、跨过一段
+	size_t first = ChainedBuffer::kSegmentSize - ChainedBuffer::kHeadroom;
+	buffer.consume(100);
+	EXPECT_EQ(data.substr(100), buffer.to_string());
+	EXPECT_EQ(slices, buffer.slice_count());
+	buffer.consume(first - 100);
+	EXPECT_EQ(slices - 1, buffer.slice_count());
+	EXPECT_EQ(data.substr(first), buffer.to_string());
+	buffer.consume(ChainedBuffer::kSegmentSize + 10);
+	EXPECT_EQ(data.substr(first + ChainedBuffer::kSegmentSize + 10), buffer.to_string());
+	EXPECT_EQ(data.size() - first - ChainedBuffer::kSegmentSize - 10, buffer.size());
+
+	// 超过剩余长度时全部丢弃
+	buffer.consume(data.size());
+	EXPECT_TRUE(buffer.empty());
+	EXPECT_EQ(0u, buffer.slice_count());
+}
+
+TEST(ChainedBuffer, Split)
+{
+	std::string data = Pattern(ChainedBuffer::kSegmentSize * 2);
+	ChainedBuffer buffer;
+	buffer.append(data);
+
+	ChainedBuffer front = buffer.split(5000);
+	EXPECT_EQ(5000u, front.size());
+	EXPECT_EQ(data.substr(0, 5000), front.to_string());
+	EXPECT_EQ(data.substr(5000), buffer.to_string());
+
+	// 被切开的段两边共享，追加不会写进共享段
+	front.append("x");
+	buffer.append("y");
+	EXPECT_EQ(data.substr(0, 5000) + "x", front.to_string());
+	EXPECT_EQ(data.substr(5000) + "y", buffer.to_string());
+
+	ChainedBuffer rest = buffer.split(buffer.size() + 1);
+	EXPECT_TRUE(buffer.empty());
+	EXPECT_EQ(data.substr(5000) + "y", rest.to_string());
+}
+
+TEST(ChainedBuffer, Prepend)
+{
+	ChainedBuffer buffer;
+	buffer.append("body");
+	// 包头写进首段的预留空间，不增加分片
+	std::string header = Pattern(ChainedBuffer::kHeadroom);
+	buffer.prepend(header.data(), header.size());
+	EXPECT_EQ(1u, buffer.slice_count());
+	EXPECT_EQ(header + "body", buffer.to_string());
+
+	// 预留空间用完后另起一段，数据仍然连续
+	buffer.prepend("ab", 2);
+	EXPECT_EQ(2u, buffer.slice_count());
+	EXPECT_EQ("ab" + header + "body", buffer.to_string());
+
+	// 共享的首段不再往前写
+	ChainedBuffer shared;
+	shared.append("body");
+	ChainedBuffer copy(shared);
+	shared.prepend("h", 1);
+	EXPECT_EQ(2u, shared.slice_count());
+	EXPECT_EQ("hbody", shared.to_string());
+	EXPECT_EQ("body", copy.to_string());
+}
+
+TEST(ChainedBuffer, Coalesce)
+{
+	ChainedBuffer buffer;
+	buffer.append("header");
+
+	// 短片段拷进尾段，不增加分片
+	ChainedBuffer small;
+	small.append("small");
+	buffer.append(small);
+	buffer.append(small);
+	EXPECT_EQ(1u, buffer.slice_count());
+	EXPECT_EQ("headersmallsmall", buffer.to_string());
+	EXPECT_EQ("small", small.to_string());
+
+	// 长片段共享段，不拷贝
+	ChainedBuffer large;
+	large.append(Pattern(1000));
+	buffer.append(large);
+	EXPECT_EQ(2u, buffer.slice_count());
+	ChainedBuffer::Slice slices[2], large_slice;
+	buffer.slices(slices, 2);
+	large.slices(&large_slice, 1);
+	EXPECT_EQ(large_slice.data, slices[1].data);
+
+	// 尾段已共享，之后的短片段只能另起分片
+	buffer.append(small);
+	EXPECT_EQ(3u, buffer.slice_count());
+	EXPECT_EQ("headersmallsmall" + Pattern(1000) + "small", buffer.to_string());
+
+	// 追加自身
+	ChainedBuffer self;
+	self.append("abc");
+	self.append(self);
+	EXPECT_EQ("abcabc", self.to_string());
+}
+
+TEST(ChainedBuffer, ExternalAndCopyTo)
+{
+	std::shared_ptr<std::string> owner = std::make_shared<std::string>(Pattern(300));
+	ChainedBuffer buffer;
+	buffer.append("0123456789");
+	buffer.append_owned(owner, 100);
+	buffer.append("end");
+	EXPECT_EQ(3u, buffer.slice_count());
+	EXPECT_EQ(10 + 200 + 3, buffer.size());
+
+	std::string expected = "0123456789" + owner->substr(100) + "end";
+	std::vector<char> dest(buffer.size() + 8, 0);
+	EXPECT_EQ(buffer.size(), buffer.copy_to(0, dest.data(), dest.size()));
+	EXPECT_EQ(expected, std::string(dest.data(), buffer.size()));
+
+	// 跨分片的中间一段，以及越过末尾的 offset
+	EXPECT_EQ(20u, buffer.copy_to(5, dest.data(), 20));
+	EXPECT_EQ(expected.substr(5, 20), std::string(dest.data(), 20));
+	EXPECT_EQ(3u, buffer.copy_to(buffer.size() - 3, dest.data(), 20));
+	EXPECT_EQ(0u, buffer.copy_to(buffer.size(), dest.data(), 20));
+
+	// visit 给出的 owner 可以让数据比缓冲区活得久
+	std::vector<std::shared_ptr<const void> > owners;
+	buffer.visit([&](const std::shared_ptr<const void> &segment, const char *, size_t) { owners.push_back(segment); });
+	EXPECT_EQ(3u, owners.size());
+	buffer.clear();
+	EXPECT_TRUE(buffer.empty());
+	EXPECT_EQ(2, owner.use_count());
+	owners.clear();
+	EXPECT_EQ(1, owner.use_count());
+}
+
+#endif  // WITH_UNITTEST
@@ -0,0 +1,505 @@
+// This file defines PHOENIX_MARSHAL, marshalling generated from a field list
+
+#ifndef BASE_MEMORY_MARSHAL_FIELDS_H_
+#define BASE_MEMORY_MARSHAL_FIELDS_H_
+
+#include "extension/memory/packet.h"
+#include "extension/memory/unpack_reader.h"
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 在结构体内列出要打包的字段，生成非虚的、可内联的打包解包代码，不需要再继承 Marshallable：
+//   struct UserInfo
+//   {
+//       uint64_t uid;
+//       std::string name;
+//       std::vector<uint32_t> tags;
+//       PHOENIX_MARSHAL(UserInfo, uid, name, tags)
+//   };
+//   pack << info;  unpack >> info;
+// 字段按列出的顺序依次打包，格式与手写的 << 链相同：整数按 Pack 的字节序定长，
+// std::string 为 varstr，无符号整数的 std::vector 走 push_array，其他 std::vector 同 marshal_container，
+// 嵌套的 PHOENIX_MARSHAL 结构体展开打包，其余类型（如 Marshallable）交给已有的 <</>>。
+// pack << info 会先按 marshal_size 一次性 reserve，之后不再扩容。
+//
+// 需要向前向后兼容的结构体用 PHOENIX_MARSHAL_VERSIONED 带上版本号，新增字段用 PHOENIX_SINCE 标注起始版本：
+//   PHOENIX_MARSHAL_VERSIONED(UserInfo, 2, uid, name, PHOENIX_SINCE(2, tags))
+// 打包时先写 varint 版本号和 uint32 包体长度；解包时只读对方版本里有的字段，其余保持原值，
+// 对方版本更新时多出来的字段按包体长度跳过。
+#define PHOENIX_MARSHAL_VERSIONED(Struct, Version, ...) \
+	typedef Struct phoenix_marshal_type; \
+	static constexpr uint32_t phoenix_marshal_version = Version; \
+	template <class Visitor> void phoenix_visit_fields(Visitor &visitor) { visitor(__VA_ARGS__); } \
+	template <class Visitor> void phoenix_visit_fields(Visitor &visitor) const { visitor(__VA_ARGS__); }
+
+#define PHOENIX_MARSHAL(Struct, ...) PHOENIX_MARSHAL_VERSIONED(Struct, 0, __VA_ARGS__)
+
+#define PHOENIX_SINCE(Version, field) NS_EXTENSION::marshal_since<Version>(field)
+
+EXTENSION_BEGIN_DECLS
+
+// 从 Version 版本开始才有的字段，由 PHOENIX_SINCE 生成
+template <uint32_t Version, class T>
+struct marshal_since_field
+{
+	T &field;
+};
+
+template <uint32_t Version, class T>
+inline marshal_since_field<Version, T> marshal_since(T &field)
+{
+	return marshal_since_field<Version, T>{ field };
+}
+
+namespace internal
+{
+// 要求 phoenix_marshal_type 就是 T 本身，避免派生类沿用基类的字段表而漏掉自己的字段
+template <class T, class = void>
+struct is_marshal_fields : std::false_type {};
+template <class T>
+struct is_marshal_fields<T, typename std::enable_if<std::is_same<typename T::phoenix_marshal_type, T>::value>::type> : std::true_type {};
+
+template <class T>
+struct is_vector : std::false_type {};
+template <class T, class A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+template <class T>
+struct is_unsigned_vector : std::false_type {};
+template <class T, class A>
+struct is_unsigned_vector<std::vector<T, A>>
+	: std::integral_constant<bool, std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value> {};
+
+inline size_t varint_size(uint64_t value)
+{
+	size_t n = 1;
+	for (; value >= 0x80; value >>= 7)
+		n++;
+	return n;
+}
+
+// 不带版本号的结构体没有版本之分，PHOENIX_SINCE 的字段总是读取
+const uint32_t kAllVersions = 0xFFFFFFFF;
+
+template <class T>
+struct is_fixed_size : std::integral_constant<bool, std::is_integral<T>::value || std::is_enum<T>::value> {};
+
+template <class T> void pack_field(Pack &p, const T &value);
+template <class T> void unpack_field(const Unpack &up, T &value);
+template <class T> size_t field_size(const T &value);
+template <class T> void read_field(UnpackReader &reader, T &value);
+template <class T> size_t field_min_size(const T &value);
+
+struct pack_visitor
+{
+	template <class... Fields>
+	void operator()(const Fields &... fields) { (pack(fields), ...); }
+
+	template <class T>
+	void pack(const T &field) { pack_field(p, field); }
+	template <uint32_t Version, class T>
+	void pack(const marshal_since_field<Version, T> &since) { pack_field(p, since.field); }
+
+	Pack &p;
+};
+
+struct unpack_visitor
+{
+	template <class... Fields>
+	void operator()(Fields &&... fields) { (unpack(fields), ...); }
+
+	template <class T>
+	void unpack(T &field) { unpack_field(up, field); }
+	template <uint32_t Version, class T>
+	void unpack(marshal_since_field<Version, T> &since)
+	{
+		if (Version <= version)
+			unpack_field(up, since.field);
+	}
+
+	const Unpack &up;
+	uint32_t version;
+};
+
+struct size_visitor
+{
+	template <class... Fields>
+	void operator()(const Fields &... fields) { (add(fields), ...); }
+
+	template <class T>
+	void add(const T &field) { size += field_size(field); }
+	template <uint32_t Version, class T>
+	void add(const marshal_since_field<Version, T> &since) { size += field_size(since.field); }
+
+	size_t size;
+};
+
+// 版本号和包体长度的位置，见 PHOENIX_MARSHAL_VERSIONED
+template <class T>
+void pack_struct(Pack &p, const T &value)
+{
+	pack_visitor visitor = { p };
+	if constexpr (T::phoenix_marshal_version == 0)
+	{
+		value.phoenix_visit_fields(visitor);
+	}
+	else
+	{
+		p.push_varint(T::phoenix_marshal_version);
+		size_t pos = p.size();
+		p.push_uint32(0);
+		value.phoenix_visit_fields(visitor);
+		uint32_t length = p.xhtonl(uint32_t(p.size() - pos - 4));
+		memcpy(p.data() + pos, &length, 4);
+	}
+}
+
+template <class T>
+void unpack_struct(const Unpack &up, T &value)
+{
+	if constexpr (T::phoenix_marshal_version == 0)
+	{
+		unpack_visitor visitor = { up, kAllVersions };
+		value.phoenix_visit_fields(visitor);
+	}
+	else
+	{
+		uint32_t version = up.pop_varint();
+		uint32_t length = up.pop_uint32();
+		Unpack body(up.pop_fetch_ptr(length), length, up.byte_order());
+		unpack_visitor visitor = { body, version };
+		value.phoenix_visit_fields(visitor);
+	}
+}
+
+template <class T>
+size_t struct_size(const T &value)
+{
+	size_visitor visitor = { 0 };
+	value.phoenix_visit_fields(visitor);
+	if constexpr (T::phoenix_marshal_version == 0)
+		return visitor.size;
+	else
+		return varint_size(T::phoenix_marshal_version) + 4 + visitor.size;
+}
+
+template <class T>
+void pack_field(Pack &p, const T &value)
+{
+	if constexpr (std::is_same<T, bool>::value)
+		p.push_bool(value);
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 1)
+		p.push_uint8(uint8_t(value));
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 2)
+		p.push_uint16(uint16_t(value));
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 4)
+		p.push_uint32(uint32_t(value));
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 8)
+		p.push_uint64(uint64_t(value));
+	else if constexpr (std::is_same<T, std::string>::value)
+		p.push_varstr(value);
+	else if constexpr (is_marshal_fields<T>::value)
+		pack_struct(p, value);
+	else if constexpr (is_unsigned_vector<T>::value)
+		p.push_array(value);
+	else if constexpr (is_vector<T>::value)
+	{
+		p.push_varint(uint32_t(value.size()));
+		for (auto &item : value)
+			pack_field(p, item);
+	}
+	else
+		p << value;
+}
+
+template <class T>
+void unpack_field(const Unpack &up, T &value)
+{
+	if constexpr (std::is_same<T, bool>::value)
+		value = up.pop_bool();
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 1)
+		value = T(up.pop_uint8());
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 2)
+		value = T(up.pop_uint16());
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 4)
+		value = T(up.pop_uint32());
+	else if constexpr ((std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) == 8)
+		value = T(up.pop_uint64());
+	else if constexpr (std::is_same<T, std::string>::value)
+		value = up.pop_varstr();
+	else if constexpr (is_marshal_fields<T>::value)
+		unpack_struct(up, value);
+	else if constexpr (is_unsigned_vector<T>::value)
+		up.pop_array(value);
+	else if constexpr (is_vector<T>::value)
+	{
+		uint32_t count = up.pop_varint();
+		value.clear();
+		//个数来自对端，不按它预分配
+		for (; count > 0; --count)
+		{
+			typename T::value_type item;
+			unpack_field(up, item);
+			value.push_back(std::move(item));
+		}
+	}
+	else
+		up >> value;
+}
+
+// 交给 <</>> 的类型大小未知，按 0 计，只是少预留一些
+template <class T>
+size_t field_size(const T &value)
+{
+	if constexpr (std::is_integral<T>::value || std::is_enum<T>::value)
+		return sizeof(T);
+	else if constexpr (std::is_same<T, std::string>::value)
+		return varint_size(value.size()) + value.size();
+	else if constexpr (is_marshal_fields<T>::value)
+		return struct_size(value);
+	else if constexpr (is_unsigned_vector<T>::value)
+		return varint_size(value.size()) + value.size() * sizeof(typename T::value_type);
+	else if constexpr (is_vector<T>::value)
+	{
+		size_t size = varint_size(value.size());
+		for (auto &item : value)
+			size += field_size(item);
+		return size;
+	}
+	else
+		return 0;
+}
+
+struct min_size_visitor
+{
+	template <class... Fields>
+	void operator()(const Fields &... fields) { (add(fields), ...); }
+
+	template <class T>
+	void add(const T &field) { size += field_min_size(field); }
+	// 旧版本的对端可能没有这些字段
+	template <uint32_t Version, class T>
+	void add(const marshal_since_field<Version, T> &) {}
+
+	size_t size;
+};
+
+// 解包每个字段至少需要的字节数：定长字段为其大小，变长字段为 1（varint 长度），交给 >> 的字段为 0
+template <class T>
+size_t field_min_size(const T &value)
+{
+	if constexpr (is_fixed_size<T>::value)
+		return sizeof(T);
+	else if constexpr (std::is_same<T, std::string>::value || is_vector<T>::value)
+		return 1;
+	else if constexpr (is_marshal_fields<T>::value)
+	{
+		if constexpr (T::phoenix_marshal_version != 0)
+			return 1 + 4;
+		else
+		{
+			min_size_visitor visitor = { 0 };
+			value.phoenix_visit_fields(visitor);
+			return visitor.size;
+		}
+	}
+	else
+		return 0;
+}
+
+// 与字段的值无关，每个类型只算一次
+template <class T>
+size_t schema_min_size(const T &value)
+{
+	static const size_t size = field_min_size(value);
+	return size;
+}
+
+// unchecked 为 true 时调用方已保证剩余数据不少于 rest：定长字段不再逐个检查，
+// 每读完一个变长字段后再按 rest 检查一次
+struct reader_visitor
+{
+	template <class... Fields>
+	void operator()(Fields &&... fields) { (read(fields), ...); }
+
+	template <class T>
+	void read(T &field)
+	{
+		if (!reader.ok())
+			return;
+		if constexpr (is_fixed_size<T>::value)
+		{
+			if (unchecked)
+			{
+				read_fixed_unchecked(field);
+				rest -= sizeof(T);
+				return;
+			}
+			read_field(reader, field);
+		}
+		else
+		{
+			size_t min_size = field_min_size(field);
+			read_field(reader, field);
+			if (unchecked)
+			{
+				rest -= min_size;
+				reader.require(rest);
+			}
+		}
+	}
+	template <uint32_t Version, class T>
+	void read(marshal_since_field<Version, T> &since)
+	{
+		if (Version > version || !reader.ok())
+			return;
+		read_field(reader, since.field);
+		//不计入 rest，读完同样要重新检查
+		if (unchecked)
+			reader.require(rest);
+	}
+
+	template <class T>
+	void read_fixed_unchecked(T &field)
+	{
+		if constexpr (std::is_same<T, bool>::value)
+			field = reader.read_bool_unchecked();
+		else if constexpr (sizeof(T) == 1)
+			field = T(reader.read_uint8_unchecked());
+		else if constexpr (sizeof(T) == 2)
+			field = T(reader.read_uint16_unchecked());
+		else if constexpr (sizeof(T) == 4)
+			field = T(reader.read_uint32_unchecked());
+		else
+			field = T(reader.read_uint64_unchecked());
+	}
+
+	UnpackReader &reader;
+	uint32_t version;
+	size_t rest;
+	bool unchecked;
+};
+
+template <class T>
+void read_struct(UnpackReader &reader, T &value)
+{
+	if constexpr (T::phoenix_marshal_version == 0)
+	{
+		size_t min_size = schema_min_size(value);
+		if (!reader.require(min_size))
+			return;
+		reader_visitor visitor = { reader, kAllVersions, min_size, true };
+		value.phoenix_visit_fields(visitor);
+	}
+	else
+	{
+		uint32_t version = reader.read_varint();
+		uint32_t length = reader.read_uint32();
+		const char *body = reader.read_fetch_ptr(length);
+		if (!reader.ok())
+			return;
+		UnpackReader body_reader(body, length, reader.byte_order());
+		reader_visitor visitor = { body_reader, version, 0, false };
+		value.phoenix_visit_fields(visitor);
+		if (!body_reader.ok())
+			reader.fail();
+	}
+}
+
+template <class T>
+void read_field(UnpackReader &reader, T &value)
+{
+	if constexpr (std::is_same<T, bool>::value)
+		value = reader.read_bool();
+	else if constexpr (is_fixed_size<T>::value && sizeof(T) == 1)
+		value = T(reader.read_uint8());
+	else if constexpr (is_fixed_size<T>::value && sizeof(T) == 2)
+		value = T(reader.read_uint16());
+	else if constexpr (is_fixed_size<T>::value && sizeof(T) == 4)
+		value = T(reader.read_uint32());
+	else if constexpr (is_fixed_size<T>::value && sizeof(T) == 8)
+		value = T(reader.read_uint64());
+	else if constexpr (std::is_same<T, std::string>::value)
+		value = reader.read_varstr();
+	else if constexpr (is_marshal_fields<T>::value)
+		read_struct(reader, value);
+	else if constexpr (is_unsigned_vector<T>::value)
+		reader.read_array(value);
+	else if constexpr (is_vector<T>::value)
+	{
+		uint32_t count = reader.read_varint();
+		value.clear();
+		//每个元素至少一个字节，先挡住伪造的超大个数
+		if (count > reader.size())
+		{
+			reader.fail();
+			return;
+		}
+		for (; count > 0 && reader.ok(); --count)
+		{
+			typename T::value_type item;
+			read_field(reader, item);
+			value.push_back(std::move(item));
+		}
+	}
+	else
+	{
+		//只有 >> 可用的类型退回会抛异常的 Unpack
+		Unpack up(reader.data(), reader.size(), reader.byte_order());
+		try
+		{
+			up >> value;
+		}
+		catch (const NException &)
+		{
+			reader.fail();
+			return;
+		}
+		reader.read_fetch_ptr(reader.size() - up.size());
+	}
+}
+}
+
+// 打包后的字节数，含交给 <</>> 的字段时为下限
+template <class T>
+inline typename std::enable_if<internal::is_marshal_fields<T>::value, size_t>::type marshal_size(const T &value)
+{
+	return internal::struct_size(value);
+}
+
+template <class T>
+inline typename std::enable_if<internal::is_marshal_fields<T>::value, Pack &>::type operator << (Pack &p, const T &value)
+{
+	p.reserve(internal::struct_size(value));
+	internal::pack_struct(p, value);
+	return p;
+}
+
+template <class T>
+inline typename std::enable_if<internal::is_marshal_fields<T>::value, const Unpack &>::type operator >> (const Unpack &up, T &value)
+{
+	internal::unpack_struct(up, value);
+	return up;
+}
+
+// 不抛异常的解包：先按字段表算出的最小长度检查一次，连续的定长字段不再逐个检查；
+// 失败时返回 kResultMemoryError，value 中可能已有部分字段被改写
+template <class T>
+inline typename std::enable_if<internal::is_marshal_fields<T>::value, RESULT>::type try_unpack(UnpackReader &reader, T &value)
+{
+	internal::read_struct(reader, value);
+	return reader.error();
+}
+
+template <class T>
+inline typename std::enable_if<internal::is_marshal_fields<T>::value, RESULT>::type try_unpack(const void *data, size_t size, T &value, int bo = 0)
+{
+	UnpackReader reader(data, size, bo);
+	return try_unpack(reader, value);
+}
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_MARSHAL_FIELDS_H_
@@ -0,0 +1,207 @@
+// PHOENIX_MARSHAL Unittest
+// 生成的打包格式与手写的 push 链一致，>> 与 try_unpack 都能原样解回，带版本号的结构体新旧版本互通
+
+#if defined(WITH_UNITTEST)
+
+#include <string>
+#include <vector>
+#include "extension/memory/marshal_fields.h"
+#include "gtest/gtest.h"
+
+USING_NS_EXTENSION
+
+namespace
+{
+struct Point
+{
+	int32_t x;
+	uint16_t y;
+	PHOENIX_MARSHAL(Point, x, y)
+
+	bool operator == (const Point &other) const { return x == other.x && y == other.y; }
+};
+
+struct UserInfo
+{
+	uint64_t uid;
+	std::string name;
+	std::vector<uint32_t> tags;
+	Point pos;
+	std::vector<Point> path;
+	std::vector<std::string> aliases;
+	bool vip;
+	PHOENIX_MARSHAL(UserInfo, uid, name, tags, pos, path, aliases, vip)
+};
+
+struct ProfileV1
+{
+	uint64_t uid;
+	std::string name;
+	PHOENIX_MARSHAL_VERSIONED(ProfileV1, 1, uid, name)
+};
+
+struct ProfileV2
+{
+	uint64_t uid;
+	std::string name;
+	std::vector<uint32_t> tags;
+	PHOENIX_MARSHAL_VERSIONED(ProfileV2, 2, uid, name, PHOENIX_SINCE(2, tags))
+};
+
+UserInfo SampleUser()
+{
+	UserInfo info;
+	info.uid = 0x0102030405060708ull;
+	info.name = "phoenix";
+	info.tags = { 1, 0x7F, 0x12345678 };
+	info.pos.x = -3;
+	info.pos.y = 0xABCD;
+	info.path = { { 1, 2 }, { -1, 0xFFFF } };
+	info.aliases = { "a", "", "alias" };
+	info.vip = true;
+	return info;
+}
+
+void ExpectSameUser(const UserInfo &expected, const UserInfo &actual)
+{
+	EXPECT_EQ(expected.uid, actual.uid);
+	EXPECT_EQ(expected.name, actual.name);
+	EXPECT_EQ(expected.tags, actual.tags);
+	EXPECT_TRUE(expected.pos == actual.pos);
+	EXPECT_TRUE(expected.path == actual.path);
+	EXPECT_EQ(expected.aliases, actual.aliases);
+	EXPECT_EQ(expected.vip, actual.vip);
+}
+
+template <class T>
+std::string PackToString(const T &value, int bo = 0)
+{
+	PackBuffer pbuffer;
+	Pack pack(pbuffer, 0, bo);
+	pack << value;
+	return std::string(pbuffer.data(), pbuffer.size());
+}
+}
+
+TEST(MarshalFields, RoundTrip)
+{
+	UserInfo info = SampleUser();
+	for (int bo = 0; bo <= 1; bo++)
+	{
+		std::string packed = PackToString(info, bo);
+		EXPECT_EQ(marshal_size(info), packed.size());
+
+		UserInfo out;
+		Unpack unpack(packed.data(), packed.size(), bo);
+		unpack >> out;
+		EXPECT_TRUE(unpack.empty());
+		ExpectSameUser(info, out);
+	}
+}
+
+TEST(MarshalFields, WireFormat)
+{
+	UserInfo info = SampleUser();
+	PackBuffer pbuffer;
+	Pack pack(pbuffer);
+	pack.push_uint64(info.uid).push_varstr(info.name).push_array(info.tags);
+	pack.push_uint32(uint32_t(info.pos.x)).push_uint16(info.pos.y);
+	pack.push_varint(uint32_t(info.path.size()));
+	for (auto &point : info.path)
+		pack.push_uint32(uint32_t(point.x)).push_uint16(point.y);
+	pack.push_varint(uint32_t(info.aliases.size()));
+	for (auto &alias : info.aliases)
+		pack.push_varstr(alias);
+	pack.push_bool(info.vip);
+	EXPECT_EQ(std::string(pbuffer.data(), pbuffer.size()), PackToString(info));
+}
+
+TEST(MarshalFields, TryUnpack)
+{
+	UserInfo info = SampleUser();
+	for (int bo = 0; bo <= 1; bo++)
+	{
+		std::string packed = PackToString(info, bo);
+		UserInfo out;
+		EXPECT_EQ(kResultSuccess, try_unpack(packed.data(), packed.size(), out, bo));
+		ExpectSameUser(info, out);
+
+		UnpackReader reader(packed.data(), packed.size(), bo);
+		UserInfo out2;
+		EXPECT_EQ(kResultSuccess, try_unpack(reader, out2));
+		EXPECT_EQ(kResultSuccess, reader.finish());
+		ExpectSameUser(info, out2);
+	}
+}
+
+TEST(MarshalFields, TryUnpackTruncated)
+{
+	std::string packed = PackToString(SampleUser());
+	// 每个长度都放进恰好等长的堆内存，越界读取会被 ASan 发现
+	for (size_t size = 0; size < packed.size(); size++)
+	{
+		std::vector<char> input(packed.begin(), packed.begin() + size);
+		UserInfo out;
+		EXPECT_EQ(kResultMemoryError, try_unpack(input.data(), input.size(), out)) << size;
+	}
+
+	// 伪造的超大个数
+	UserInfo info = SampleUser();
+	info.aliases.clear();
+	std::string bad = PackToString(info);
+	size_t count_pos = bad.size() - 2;
+	bad[count_pos] = '\x7F';
+	UserInfo out;
+	EXPECT_EQ(kResultMemoryError, try_unpack(bad.data(), bad.size(), out));
+}
+
+TEST(MarshalFields, Versioned)
+{
+	ProfileV2 v2;
+	v2.uid = 42;
+	v2.name = "new";
+	v2.tags = { 7, 8, 9 };
+	std::string packed_v2 = PackToString(v2);
+	EXPECT_EQ(marshal_size(v2), packed_v2.size());
+
+	// 旧版本按包体长度跳过不认识的字段
+	PackBuffer pbuffer;
+	Pack pack(pbuffer);
+	pack << v2;
+	pack.push_uint32(0xDEADBEEF);
+	ProfileV1 v1;
+	Unpack unpack(pbuffer.data(), pbuffer.size());
+	unpack >> v1;
+	EXPECT_EQ(42u, v1.uid);
+	EXPECT_EQ("new", v1.name);
+	EXPECT_EQ(0xDEADBEEF, unpack.pop_uint32());
+
+	ProfileV1 try_v1;
+	EXPECT_EQ(kResultSuccess, try_unpack(packed_v2.data(), packed_v2.size(), try_v1));
+	EXPECT_EQ("new", try_v1.name);
+
+	// 新版本读旧数据时 PHOENIX_SINCE 的字段保持原值
+	v1.uid = 1;
+	v1.name = "old";
+	std::string packed_v1 = PackToString(v1);
+	ProfileV2 out;
+	out.tags = { 5 };
+	Unpack old_unpack(packed_v1.data(), packed_v1.size());
+	old_unpack >> out;
+	EXPECT_TRUE(old_unpack.empty());
+	EXPECT_EQ(1u, out.uid);
+	EXPECT_EQ("old", out.name);
+	EXPECT_EQ(std::vector<uint32_t>(1, 5), out.tags);
+
+	ProfileV2 try_out;
+	try_out.tags = { 6 };
+	EXPECT_EQ(kResultSuccess, try_unpack(packed_v1.data(), packed_v1.size(), try_out));
+	EXPECT_EQ("old", try_out.name);
+	EXPECT_EQ(std::vector<uint32_t>(1, 6), try_out.tags);
+
+	// 包体长度超出数据
+	std::vector<char> truncated(packed_v2.begin(), packed_v2.end() - 1);
+	EXPECT_EQ(kResultMemoryError, try_unpack(truncated.data(), truncated.size(), try_out));
+}
+
+#endif  // WITH_UNITTEST
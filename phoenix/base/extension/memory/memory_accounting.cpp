@@ -0,0 +1,222 @@
+#include "extension/memory/memory_accounting.h"
+#include <algorithm>
+#include <map>
+#include "base/bind.h"
+#include "base/json/string_escape.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/memory/block_pool_allocator.h"
+#include "extension/memory/packet.h"
+#include "extension/thread/thread_manager.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+class AccountingRegistry
+{
+public:
+	struct Account
+	{
+		std::string name;
+		MemoryUsageFunc usage;
+		int running;	// 正在执行的 Snapshot 数
+	};
+
+	static AccountingRegistry* GetInstance()
+	{
+		// 刻意不析构，退出前注销的模块仍要访问它
+		static AccountingRegistry *instance = new AccountingRegistry;
+		return instance;
+	}
+
+	AccountingRegistry() : changed(&lock), next_id(1), report_generation(0) {}
+
+	base::Lock lock;
+	base::ConditionVariable changed;	// 统计函数返回时广播
+	std::map<int, Account> accounts;
+	int next_id;
+	// 定时报告，每次 Start/Stop 递增 report_generation，之前投递的定时任务据此作废
+	int report_generation;
+	TimeDelta report_interval;
+	MemoryReportCallback report_callback;
+};
+
+int64_t BlockPoolBytes()
+{
+	return (int64_t)(pool_block_alloc_1k::pooled_blocks() * pool_block_alloc_1k::requested_size
+		+ pool_block_alloc_2k::pooled_blocks() * pool_block_alloc_2k::requested_size
+		+ pool_block_alloc_4k::pooled_blocks() * pool_block_alloc_4k::requested_size
+		+ pool_block_alloc_8k::pooled_blocks() * pool_block_alloc_8k::requested_size
+		+ pool_block_alloc_16k::pooled_blocks() * pool_block_alloc_16k::requested_size
+		+ pool_block_alloc_32k::pooled_blocks() * pool_block_alloc_32k::requested_size);
+}
+
+void AppendUsage(const std::string &name, int64_t bytes, MemoryUsageSnapshot *snapshot)
+{
+	snapshot->total_bytes += bytes;
+	if (!snapshot->subsystems.empty() && snapshot->subsystems.back().first == name)
+		snapshot->subsystems.back().second += bytes;
+	else
+		snapshot->subsystems.push_back(std::make_pair(name, bytes));
+}
+
+void PostReportTask(int generation, TimeDelta interval);
+
+void OnReportTimer(int generation)
+{
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	MemoryReportCallback callback;
+	{
+		base::AutoLock lock(registry->lock);
+		if (generation != registry->report_generation)
+			return;
+		callback = registry->report_callback;
+	}
+	if (callback)
+		callback(MemoryAccounting::Snapshot());
+
+	TimeDelta interval;
+	{
+		base::AutoLock lock(registry->lock);
+		if (generation != registry->report_generation)
+			return;
+		interval = registry->report_interval;
+	}
+	PostReportTask(generation, interval);
+}
+
+void PostReportTask(int generation, TimeDelta interval)
+{
+	auto task_runner = ThreadManager::GlobalTimerTaskRunner();
+	if (task_runner)
+		task_runner->PostDelayedTask(FROM_HERE, base::Bind(&OnReportTimer, generation), interval);
+}
+}
+
+std::string MemoryUsageSnapshot::ToJson() const
+{
+	std::string output = base::StringPrintf("{\"time\":%lld,\"total\":%lld,\"subsystems\":{",
+		(long long)time.ToJavaTime(), (long long)total_bytes);
+	for (size_t i = 0; i < subsystems.size(); ++i)
+	{
+		if (i != 0)
+			output.push_back(',');
+		base::EscapeJSONString(subsystems[i].first, true, &output);
+		output.push_back(':');
+		output += std::to_string(subsystems[i].second);
+	}
+	output += "}}";
+	return output;
+}
+
+std::string MemoryUsageSnapshot::ToLogLine() const
+{
+	std::string output = base::StringPrintf("total=%lld", (long long)total_bytes);
+	for (const auto &subsystem : subsystems)
+	{
+		if (subsystem.second != 0)
+			base::StringAppendF(&output, " %s=%lld", subsystem.first.c_str(), (long long)subsystem.second);
+	}
+	return output;
+}
+
+int MemoryAccounting::Register(const std::string &name, MemoryUsageFunc usage)
+{
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	int id = registry->next_id++;
+	AccountingRegistry::Account &entry = registry->accounts[id];
+	entry.name = name;
+	entry.usage = std::move(usage);
+	entry.running = 0;
+	return id;
+}
+
+void MemoryAccounting::Unregister(int id)
+{
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	MemoryUsageFunc usage;	// 捕获在锁外析构
+	base::AutoLock lock(registry->lock);
+	auto it = registry->accounts.find(id);
+	while (it != registry->accounts.end() && it->second.running > 0)
+	{
+		registry->changed.Wait();
+		it = registry->accounts.find(id);
+	}
+	if (it == registry->accounts.end())
+		return;
+	usage = std::move(it->second.usage);
+	registry->accounts.erase(it);
+}
+
+MemoryUsageSnapshot MemoryAccounting::Snapshot()
+{
+	TRACE_EVENT0("nim.memory", "MemoryAccounting::Snapshot");
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	std::vector<std::pair<int, AccountingRegistry::Account>> accounts;
+	{
+		base::AutoLock lock(registry->lock);
+		for (auto &item : registry->accounts)
+		{
+			if (!item.second.usage)
+				continue;
+			item.second.running++;
+			accounts.push_back(item);
+		}
+	}
+
+	std::vector<std::pair<std::string, int64_t>> usages;
+	usages.push_back(std::make_pair(std::string("extension.block_pool"), BlockPoolBytes()));
+	usages.push_back(std::make_pair(std::string("extension.pack_buffer"), (int64_t)PackBuffer::live_bytes()));
+	for (auto &item : accounts)
+	{
+		usages.push_back(std::make_pair(item.second.name, item.second.usage()));
+		base::AutoLock lock(registry->lock);
+		auto it = registry->accounts.find(item.first);
+		if (it != registry->accounts.end())
+			it->second.running--;
+		registry->changed.Broadcast();
+	}
+	std::stable_sort(usages.begin(), usages.end(),
+		[](const std::pair<std::string, int64_t> &left, const std::pair<std::string, int64_t> &right) {
+			return left.first < right.first;
+		});
+
+	MemoryUsageSnapshot snapshot;
+	snapshot.time = Time::Now();
+	for (const auto &usage : usages)
+		AppendUsage(usage.first, usage.second, &snapshot);
+	return snapshot;
+}
+
+bool MemoryAccounting::StartPeriodicReport(TimeDelta interval, MemoryReportCallback callback)
+{
+	if (!ThreadManager::GlobalTimerTaskRunner())
+		return false;
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	int generation = 0;
+	MemoryReportCallback previous;	// 在锁外析构
+	{
+		base::AutoLock lock(registry->lock);
+		generation = ++registry->report_generation;
+		registry->report_interval = interval;
+		previous = std::move(registry->report_callback);
+		registry->report_callback = std::move(callback);
+	}
+	PostReportTask(generation, interval);
+	return true;
+}
+
+void MemoryAccounting::StopPeriodicReport()
+{
+	AccountingRegistry *registry = AccountingRegistry::GetInstance();
+	MemoryReportCallback previous;
+	base::AutoLock lock(registry->lock);
+	registry->report_generation++;
+	previous = std::move(registry->report_callback);
+}
+
+EXTENSION_END_DECLS
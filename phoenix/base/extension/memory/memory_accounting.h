@@ -0,0 +1,63 @@
+// This file defines the registry attributing the live bytes to the subsystems
+
+#ifndef BASE_MEMORY_MEMORY_ACCOUNTING_H_
+#define BASE_MEMORY_MEMORY_ACCOUNTING_H_
+#include "extension/config/build_config.h"
+#include "extension/extension_export.h"
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 返回当前占用的字节数，在调用 Snapshot 的线程上调用，要自己保证线程安全，应只读计数而不遍历大的容器
+typedef std::function<int64_t()> MemoryUsageFunc;
+
+// 某一时刻各模块占用的内存，按名称排序，同名的多个统计函数合并为一项
+struct EXTENSION_EXPORT MemoryUsageSnapshot
+{
+	MemoryUsageSnapshot() : total_bytes(0) {}
+
+	Time time;
+	int64_t total_bytes;
+	std::vector<std::pair<std::string, int64_t>> subsystems;
+
+	// {"time":毫秒时间戳,"total":..,"subsystems":{"name":..,..}}
+	std::string ToJson() const;
+	// 写日志用的一行：total=.. name=.. ...，单位为字节，为 0 的项省略
+	std::string ToLogLine() const;
+};
+typedef std::function<void(const MemoryUsageSnapshot &)> MemoryReportCallback;
+
+// 按模块统计 SDK 持有的内存，用于定位用户机器上的内存暴涨、OOM 是哪部分造成的：
+//   int id = MemoryAccounting::Register("nim_http.cache", [this]() { return (int64_t)memory_size_; });
+// 只统计各模块自己记账的缓冲、队列和缓存，不是堆的全部，与进程的内存占用之差是未记账的部分。
+// 内置的统计项：
+//   extension.block_pool   BlockBuffer 块池（pool_block_alloc_*）全局池中空闲的块，不含线程缓存
+//   extension.pack_buffer  所有 PackBuffer 占用的块
+// 名称约定与 MetricsRegistry 相同，为 模块.对象
+class EXTENSION_EXPORT MemoryAccounting
+{
+public:
+	// 返回注销用的 id
+	static int Register(const std::string &name, MemoryUsageFunc usage);
+	// 统计函数正在执行时等待其返回，不要在统计函数中注销
+	static void Unregister(int id);
+	// 在调用线程上调用所有统计函数
+	static MemoryUsageSnapshot Snapshot();
+
+	// 每隔 interval 在全局定时器线程上取一次 Snapshot 交给 callback，再次调用时替换之前的设置。
+	// 需已通过 ThreadManager::GlobalTimerThreadRef 启动全局定时器线程，否则返回 false
+	static bool StartPeriodicReport(TimeDelta interval, MemoryReportCallback callback);
+	static void StopPeriodicReport();
+
+private:
+	MemoryAccounting() = delete;
+};
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_MEMORY_ACCOUNTING_H_
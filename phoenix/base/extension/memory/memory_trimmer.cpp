@@ -0,0 +1,168 @@
+#include "extension/memory/memory_trimmer.h"
+#include <map>
+#include <memory>
+#include <vector>
+#include "base/bind.h"
+#include "base/memory/memory_pressure_listener.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/memory/block_pool_allocator.h"
+#include "extension/notification_center/notification_center.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+class TrimRegistry : public NotificaionObserver
+{
+public:
+	struct Trimmer
+	{
+		std::string name;
+		MemoryTrimFunc trim;
+		bool running;
+	};
+
+	static TrimRegistry* GetInstance()
+	{
+		// 刻意不析构，退出前注销的模块仍要访问它
+		static TrimRegistry *instance = new TrimRegistry;
+		return instance;
+	}
+
+	TrimRegistry() : changed(&lock), next_id(1), notification_attached(false) {}
+
+	virtual void enterBackground() override { MemoryTrimmer::Trim(kMemoryTrimBackground); }
+
+	base::Lock lock;
+	base::ConditionVariable changed;	// 释放函数返回时广播
+	std::map<int, Trimmer> trimmers;
+	int next_id;
+	bool notification_attached;
+	std::unique_ptr<base::MemoryPressureListener> listener;
+};
+
+void OnMemoryPressure(base::MemoryPressureListener::MemoryPressureLevel level)
+{
+	if (level == base::MemoryPressureListener::MEMORY_PRESSURE_LEVEL_CRITICAL)
+		MemoryTrimmer::Trim(kMemoryTrimCritical);
+	else if (level == base::MemoryPressureListener::MEMORY_PRESSURE_LEVEL_MODERATE)
+		MemoryTrimmer::Trim(kMemoryTrimModerate);
+}
+
+// 全局池中的块随时可以重新 malloc，每一级都清空；线程缓存只能由各自的线程访问，不在这里释放
+void PurgeBlockPools()
+{
+	pool_block_alloc_1k::purge();
+	pool_block_alloc_2k::purge();
+	pool_block_alloc_4k::purge();
+	pool_block_alloc_8k::purge();
+	pool_block_alloc_16k::purge();
+	pool_block_alloc_32k::purge();
+}
+}
+
+int MemoryTrimmer::Register(const std::string &name, MemoryTrimFunc trim)
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	int id = registry->next_id++;
+	TrimRegistry::Trimmer &entry = registry->trimmers[id];
+	entry.name = name;
+	entry.trim = std::move(trim);
+	entry.running = false;
+	return id;
+}
+
+void MemoryTrimmer::Unregister(int id)
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	MemoryTrimFunc trim;	// 捕获在锁外析构
+	base::AutoLock lock(registry->lock);
+	auto it = registry->trimmers.find(id);
+	while (it != registry->trimmers.end() && it->second.running)
+	{
+		registry->changed.Wait();
+		it = registry->trimmers.find(id);
+	}
+	if (it == registry->trimmers.end())
+		return;
+	trim = std::move(it->second.trim);
+	registry->trimmers.erase(it);
+}
+
+void MemoryTrimmer::Trim(MemoryTrimLevel level)
+{
+	TRACE_EVENT1("nim.memory", "MemoryTrimmer::Trim", "level", (int)level);
+	PurgeBlockPools();
+
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	std::vector<std::pair<int, TrimRegistry::Trimmer>> trims;
+	{
+		base::AutoLock lock(registry->lock);
+		for (auto &item : registry->trimmers)
+		{
+			if (item.second.running || !item.second.trim)
+				continue;
+			item.second.running = true;
+			trims.push_back(item);
+		}
+	}
+	for (auto &item : trims)
+	{
+		{
+			TRACE_EVENT1("nim.memory", "MemoryTrimmer::TrimOne", "name", TRACE_STR_COPY(item.second.name.c_str()));
+			item.second.trim(level);
+		}
+		base::AutoLock lock(registry->lock);
+		auto it = registry->trimmers.find(item.first);
+		if (it != registry->trimmers.end())
+			it->second.running = false;
+		registry->changed.Broadcast();
+	}
+}
+
+void MemoryTrimmer::AttachMemoryPressureListener()
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	if (registry->listener == nullptr)
+		registry->listener.reset(new base::MemoryPressureListener(base::Bind(&OnMemoryPressure)));
+}
+
+void MemoryTrimmer::DetachMemoryPressureListener()
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	std::unique_ptr<base::MemoryPressureListener> listener;
+	{
+		base::AutoLock lock(registry->lock);
+		listener = std::move(registry->listener);
+	}
+}
+
+void MemoryTrimmer::AttachNotificationCenter()
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	{
+		base::AutoLock lock(registry->lock);
+		if (registry->notification_attached)
+			return;
+		registry->notification_attached = true;
+	}
+	NotificaionCenter::GetInstance()->AddObserver(registry);
+}
+
+void MemoryTrimmer::DetachNotificationCenter()
+{
+	TrimRegistry *registry = TrimRegistry::GetInstance();
+	{
+		base::AutoLock lock(registry->lock);
+		if (!registry->notification_attached)
+			return;
+		registry->notification_attached = false;
+	}
+	NotificaionCenter::GetInstance()->RemoveObserver(registry);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,54 @@
+// This file defines the registry of the caches released under memory pressure
+
+#ifndef BASE_MEMORY_MEMORY_TRIMMER_H_
+#define BASE_MEMORY_MEMORY_TRIMMER_H_
+#include "extension/config/build_config.h"
+#include "extension/extension_export.h"
+#include <functional>
+#include <string>
+
+EXTENSION_BEGIN_DECLS
+
+// 释放缓存的级别，级别越高释放得越多
+enum MemoryTrimLevel
+{
+	kMemoryTrimBackground = 0,	// 进入后台：空闲的句柄全部释放，内存缓存只保留最近用的一部分
+	kMemoryTrimModerate,		// 系统内存偏紧：内存缓存全部释放
+	kMemoryTrimCritical,		// 即将被系统杀掉：重建代价较大的也释放，如预编译语句、共享的 DNS 缓存
+};
+
+typedef std::function<void(MemoryTrimLevel level)> MemoryTrimFunc;
+
+// 各模块在这里注册释放缓存的函数，内存紧张或进入后台时统一调用。
+// 信号来源：
+// 1. base::MemoryPressureListener，平台的内存警告（Android onTrimMemory、iOS didReceiveMemoryWarning、
+//    base::win::MemoryPressureMonitor）经 MemoryPressureListener::NotifyMemoryPressure 转发过来，
+//    MODERATE/CRITICAL 分别对应 kMemoryTrimModerate/kMemoryTrimCritical；
+// 2. NotificaionCenter 的 enterBackground，对应 kMemoryTrimBackground；
+// 3. 直接调用 Trim。
+// 释放函数在发出信号的线程上依次调用，要自己保证线程安全，需要在特定线程上释放的应投递过去。
+// BlockBuffer 的块池（pool_block_alloc_*）在每一级都会清空全局池。
+class EXTENSION_EXPORT MemoryTrimmer
+{
+public:
+	// 返回注销用的 id，name 用于 trace
+	static int Register(const std::string &name, MemoryTrimFunc trim);
+	// 释放函数正在执行时等待其返回，不要在释放函数中注销
+	static void Unregister(int id);
+	// 在调用线程上调用所有释放函数，另一个线程正在执行的释放函数这次跳过
+	static void Trim(MemoryTrimLevel level);
+
+	// 在当前线程上创建 MemoryPressureListener，当前线程须有消息循环，通知在这个线程上处理
+	static void AttachMemoryPressureListener();
+	static void DetachMemoryPressureListener();
+	// 进入后台时 Trim(kMemoryTrimBackground)
+	static void AttachNotificationCenter();
+	static void DetachNotificationCenter();
+
+private:
+	MemoryTrimmer() = delete;
+};
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_MEMORY_TRIMMER_H_
@@ -18,9 +18,12 @@
 #include <iostream>
 #include <stdexcept>
 #include <map>
+#include <type_traits>
+#include <vector>
 
 #include "extension/nexeption/error.h"
 #include "extension//memory/blockbuffer.h"
+#include "extension/memory/byte_swap.h"
 #include "extension/macros.h"
 #include "extension/strings/string_util.h"
 #include "base/strings/string_number_conversions.h"
@@ -89,6 +92,9 @@ public:
 		  throw NException("reserve buffer overflow", kResultMemoryError);
       }
 
+      // 所有线程上的 PackBuffer 占用的字节数，见 MemoryAccounting
+      static size_t live_bytes() { return BB::current_total_blocks() * BB::allocator::requested_size; }
+
 private:
       // use big-block. more BIG? MAX 64K*16k = 1G
       typedef BlockBuffer<def_block_alloc_32k, 65536> BB;
@@ -183,6 +189,9 @@ public:
       // access this packet.
       char * data()       { return buffer_.data() + offset_; }
       size_t size() const { return buffer_.size() - offset_; }
+      int byte_order() const { return byte_order_; }
+      // 预留 n 个字节，之后的 push 不再扩容
+      void reserve(size_t n) { buffer_.reserve(buffer_.size() + n); }
 
       Pack & push(const void *s, size_t n) { buffer_.append((const char *)s, n); return *this; }
       Pack & push(const void *s)           { buffer_.append((const char *)s); return *this; }
@@ -225,7 +234,54 @@ public:
 			  value >>= 7;
 		  }
 		  return push_uint8((uint8_t) (value & 0x7F));
-	  }	  
+	  }
+	  //64 位的变长编码，每 7 位一个字节，最多 10 个字节；ID 等通常远小于上限的值只占 1~5 个字节
+	  Pack & push_varint64(uint64_t value)
+	  {
+		  char buf[10];
+		  return push(buf, encode_varint64(buf, value));
+	  }
+
+	  //varint 个数加逐个元素，与 marshal_container 写 std::vector<uint32_t> 等的格式相同，
+	  //但只扩容一次、一遍转换字节序（SSE2/NEON）；T 为 uint8_t/uint16_t/uint32_t/uint64_t
+	  template <class T>
+	  Pack & push_array(const T *values, size_t count)
+	  {
+		  static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "push_array: T must be an unsigned integer");
+		  if (count > 0x7FFFFFFF)
+			  throw NException("push_array: array too big", kResultMemoryError);
+		  push_varint(uint32_t(count));
+		  if (count == 0)
+			  return *this;
+		  size_t pos = buffer_.size();
+		  buffer_.resize(pos + count * sizeof(T));
+		  if (sizeof(T) > 1 && swap_bytes())
+			  byte_swap_copy(buffer_.data() + pos, values, count, sizeof(T));
+		  else
+			  memcpy(buffer_.data() + pos, values, count * sizeof(T));
+		  return *this;
+	  }
+	  template <class T>
+	  Pack & push_array(const std::vector<T> &values) { return push_array(values.data(), values.size()); }
+
+	  //varint 个数加逐个 push_varint64 编码的元素，按最坏情况一次扩容
+	  template <class T>
+	  Pack & push_varint_array(const T *values, size_t count)
+	  {
+		  static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "push_varint_array: T must be an unsigned integer");
+		  if (count > 0x7FFFFFFF)
+			  throw NException("push_varint_array: array too big", kResultMemoryError);
+		  push_varint(uint32_t(count));
+		  size_t pos = buffer_.size();
+		  buffer_.resize(pos + count * 10);
+		  char *p = buffer_.data() + pos;
+		  for (size_t i = 0; i < count; i++)
+			  p += encode_varint64(p, values[i]);
+		  buffer_.resize(p - buffer_.data());
+		  return *this;
+	  }
+	  template <class T>
+	  Pack & push_varint_array(const std::vector<T> &values) { return push_varint_array(values.data(), values.size()); }
 
       virtual ~Pack() {}
 
@@ -252,6 +308,20 @@ protected:
       size_t      offset_;
 
 private:
+	  //按网络字节序写时需要反转字节序
+	  bool swap_bytes() { return xhtons(1) != 1; }
+	  static size_t encode_varint64(char *p, uint64_t value)
+	  {
+		  size_t n = 0;
+		  while (value >= 0x80)
+		  {
+			  p[n++] = (char)((value & 0x7F) | 0x80);
+			  value >>= 7;
+		  }
+		  p[n++] = (char)value;
+		  return n;
+	  }
+
 	Pack (const Pack &o);
 	Pack & operator = (const Pack &o);
 
@@ -383,6 +453,61 @@ public:
 		  return value | (b << i);
 	  }
 	  
+	  //与 Pack::push_varint64 对应
+	  uint64_t pop_varint64() const
+	  {
+		  uint64_t value = 0;
+		  const char *p = data_;
+		  const char *end = data_ + size_;
+		  if (!decode_varint64(p, end, value))
+			  throw NException("pop_varint64: bad varint", kResultMemoryError);
+		  size_ -= p - data_;
+		  data_ = p;
+		  return value;
+	  }
+
+	  //与 Pack::push_array 对应，数据长度只检查一次
+	  template <class T>
+	  void pop_array(std::vector<T> &values) const
+	  {
+		  static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "pop_array: T must be an unsigned integer");
+		  size_t count = pop_varint();
+		  if (count > size_ / sizeof(T))
+			  throw NException("pop_array: not enough data", kResultMemoryError);
+		  values.resize(count);
+		  if (count == 0)
+			  return;
+		  if (sizeof(T) > 1 && swap_bytes())
+			  byte_swap_copy(&values[0], data_, count, sizeof(T));
+		  else
+			  memcpy(&values[0], data_, count * sizeof(T));
+		  data_ += count * sizeof(T);
+		  size_ -= count * sizeof(T);
+	  }
+
+	  //与 Pack::push_varint_array 对应，元素超出 T 的范围时抛异常
+	  template <class T>
+	  void pop_varint_array(std::vector<T> &values) const
+	  {
+		  static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "pop_varint_array: T must be an unsigned integer");
+		  size_t count = pop_varint();
+		  //每个元素至少一个字节，先挡住伪造的超大个数
+		  if (count > size_)
+			  throw NException("pop_varint_array: not enough data", kResultMemoryError);
+		  values.resize(count);
+		  const char *p = data_;
+		  const char *end = data_ + size_;
+		  for (size_t i = 0; i < count; i++)
+		  {
+			  uint64_t value = 0;
+			  if (!decode_varint64(p, end, value) || value > (uint64_t)(T)-1)
+				  throw NException("pop_varint_array: bad varint", kResultMemoryError);
+			  values[i] = (T)value;
+		  }
+		  size_ -= p - data_;
+		  data_ = p;
+	  }
+
       Varstr pop_varstr_ptr() const
       {
 		  // Varstr { uint16_t size; const char * data; }
@@ -409,8 +534,24 @@ public:
       bool empty() const        { return size_ == 0; }
       const char * data() const { return data_; }
       size_t size() const       { return size_; }
+      int byte_order() const    { return byte_order_; }
 
 private:
+	  bool swap_bytes() const { return xntohs(1) != 1; }
+	  //成功时 p 移到 varint 之后
+	  static bool decode_varint64(const char *&p, const char *end, uint64_t &value)
+	  {
+		  value = 0;
+		  for (uint32_t shift = 0; p < end && shift < 64; shift += 7)
+		  {
+			  uint8_t b = (uint8_t)*p++;
+			  value |= (uint64_t)(b & 0x7F) << shift;
+			  if ((b & 0x80) == 0)
+				  return true;
+		  }
+		  return false;
+	  }
+
       mutable const char  *data_;
       mutable size_t       size_;
 
@@ -584,7 +725,7 @@ inline const Unpack & operator >> (const Unpack &up, const uint32_t &i32)
 
 inline const Unpack & operator >> (const Unpack &up, const uint64_t &i64)
 {
-	const_cast<uint64_t &>(i64) = up.pop_uint32();
+	const_cast<uint64_t &>(i64) = up.pop_uint64();
 	return up;
 }
 
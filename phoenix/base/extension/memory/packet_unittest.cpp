@@ -7,12 +7,15 @@
 
 #if defined(WITH_UNITTEST)
 
-#include "base/memory/packet.h"
+#include "extension/memory/packet.h"
+#include "extension/memory/unpack_reader.h"
 #include "gtest/gtest.h"
 
+USING_NS_EXTENSION
+
 TEST(PackBuffer, Basic)
 {
-	nbase::PackBuffer pbuffer;
+	PackBuffer pbuffer;
 
 	EXPECT_EQ(0, pbuffer.size());
 
@@ -35,8 +38,8 @@ TEST(PackBuffer, Basic)
 
 TEST(PackUnpack, Basic)
 {
-	nbase::PackBuffer pbuffer;
-	nbase::Pack test_pack(pbuffer);
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
 
 	EXPECT_EQ(0, test_pack.size());
 
@@ -50,45 +53,45 @@ TEST(PackUnpack, Basic)
 	std::string input3 = "test input string 3";
 	std::string input4 = "test input string 4";
 	std::string input5 = "test input string 5";
-	nbase::Varstr var_str(input1.data(), input1.size());
+	Varstr var_str(input1.data(), input1.size());
 	test_pack.push_varstr(var_str);
 	test_pack.push_varstr(input2.c_str());
 	test_pack.push_varstr(input3);
 	test_pack.push_varstr(input4.data(), input4.size());
-	test_pack.push_varstr32(input5.data(), input5.size());
+	test_pack.push_varstr(input5.data(), input5.size());
 
-	nbase::Unpack test_unpack(pbuffer.data(), pbuffer.size());
+	Unpack test_unpack(pbuffer.data(), pbuffer.size());
 	EXPECT_EQ(8, test_unpack.pop_uint8());
 	EXPECT_EQ(16, test_unpack.pop_uint16());
 	EXPECT_EQ(32, test_unpack.pop_uint32());
 	EXPECT_EQ(64, test_unpack.pop_uint64());
-	nbase::Varstr var_output1 = test_unpack.pop_varstr_ptr();
+	Varstr var_output1 = test_unpack.pop_varstr_ptr();
 	std::string output1(var_output1.data(), var_output1.size()); 
 	EXPECT_EQ(input1, output1);
-	nbase::Varstr var_output2 = test_unpack.pop_varstr_ptr();
+	Varstr var_output2 = test_unpack.pop_varstr_ptr();
 	std::string output2(var_output2.data(), var_output2.size()); 
 	EXPECT_EQ(input2, output2);
-	nbase::Varstr var_output3 = test_unpack.pop_varstr_ptr();
+	Varstr var_output3 = test_unpack.pop_varstr_ptr();
 	std::string output3(var_output3.data(), var_output3.size()); 
 	EXPECT_EQ(input3, output3);
-	nbase::Varstr var_output4 = test_unpack.pop_varstr_ptr();
+	Varstr var_output4 = test_unpack.pop_varstr_ptr();
 	std::string output4(var_output4.data(), var_output4.size()); 
 	EXPECT_EQ(input4, output4);
-	nbase::Varstr var_output5 = test_unpack.pop_varstr32_ptr();
+	Varstr var_output5 = test_unpack.pop_varstr_ptr();
 	std::string output5(var_output5.data(), var_output5.size()); 
 	EXPECT_EQ(input5, output5);	
 }
 
-class MarshallableTest : public nbase::Marshallable
+class MarshallableTest : public Marshallable
 {
 public:
-	virtual void marshal(nbase::Pack &p) const
+	virtual void marshal(Pack &p) const
 	{
 		p << value_u_;
 		p << value_s_;
 	}
 
-	virtual void unmarshal(const nbase::Unpack &up)
+	virtual void unmarshal(const Unpack &up)
 	{
 		up >> value_u_ >> value_s_; 
 	}
@@ -104,16 +107,294 @@ TEST(Marshallable, Basic)
 	m_test1.value_u_ = 128;
 	m_test1.value_s_ = "Hello world";
 
-	nbase::PackBuffer pbuffer;
-	nbase::Pack test_pack(pbuffer);
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
 	m_test1.marshal(test_pack);
 
-	nbase::Unpack test_unpack(pbuffer.data(), pbuffer.size());
+	Unpack test_unpack(pbuffer.data(), pbuffer.size());
 	m_test2.unmarshal(test_unpack);
 
 	EXPECT_EQ(m_test1.value_u_, m_test2.value_u_);	
 	EXPECT_EQ(m_test1.value_s_, m_test2.value_s_);	
 }
 
+namespace
+{
+std::string PackedBytes(PackBuffer &pbuffer)
+{
+	return std::string(pbuffer.data(), pbuffer.size());
+}
+}
+
+TEST(PackVarint64, RoundTrip)
+{
+	const uint64_t values[] = { 0, 1, 127, 128, 16383, 16384, 0xFFFFFFFFull, 0x100000000ull, 0x7FFFFFFFFFFFFFFFull, 0xFFFFFFFFFFFFFFFFull };
+	const size_t sizes[] = { 1, 1, 1, 2, 2, 3, 5, 5, 9, 10 };
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+	{
+		PackBuffer pbuffer;
+		Pack test_pack(pbuffer);
+		test_pack.push_varint64(values[i]);
+		EXPECT_EQ(sizes[i], test_pack.size());
+
+		Unpack test_unpack(pbuffer.data(), pbuffer.size());
+		EXPECT_EQ(values[i], test_unpack.pop_varint64());
+		EXPECT_TRUE(test_unpack.empty());
+	}
+}
+
+TEST(PackVarint64, MaxLength)
+{
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack.push_varint64(0xFFFFFFFFFFFFFFFFull);
+	EXPECT_EQ(std::string(9, '\xFF') + '\x01', PackedBytes(pbuffer));
+
+	// 第 11 个字节仍带续位的 varint 超出 64 位
+	std::string too_long(10, '\x80');
+	too_long += '\x01';
+	Unpack test_unpack(too_long.data(), too_long.size());
+	EXPECT_THROW(test_unpack.pop_varint64(), NException);
+}
+
+TEST(PackVarint64, Truncated)
+{
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack.push_varint64(0x100000000ull);
+	for (size_t size = 0; size < pbuffer.size(); size++)
+	{
+		Unpack test_unpack(pbuffer.data(), size);
+		EXPECT_THROW(test_unpack.pop_varint64(), NException);
+		EXPECT_EQ(size, test_unpack.size());
+	}
+}
+
+TEST(PackArray, RoundTrip)
+{
+	std::vector<uint16_t> u16 = { 0, 1, 0x1234, 0xFFFF };
+	std::vector<uint32_t> u32 = { 0, 1, 0x12345678, 0xFFFFFFFF, 7, 8, 9 };
+	std::vector<uint64_t> u64 = { 0, 0x0102030405060708ull, 0xFFFFFFFFFFFFFFFFull };
+	std::vector<uint8_t> u8 = { 1, 2, 3 };
+	for (int bo = 0; bo <= 1; bo++)
+	{
+		PackBuffer pbuffer;
+		Pack test_pack(pbuffer, 0, bo);
+		test_pack.push_array(u16).push_array(u32).push_array(u64).push_array(u8).push_array(std::vector<uint32_t>());
+
+		std::vector<uint16_t> out16;
+		std::vector<uint32_t> out32, empty(3, 1);
+		std::vector<uint64_t> out64;
+		std::vector<uint8_t> out8;
+		Unpack test_unpack(pbuffer.data(), pbuffer.size(), bo);
+		test_unpack.pop_array(out16);
+		test_unpack.pop_array(out32);
+		test_unpack.pop_array(out64);
+		test_unpack.pop_array(out8);
+		test_unpack.pop_array(empty);
+		EXPECT_EQ(u16, out16);
+		EXPECT_EQ(u32, out32);
+		EXPECT_EQ(u64, out64);
+		EXPECT_EQ(u8, out8);
+		EXPECT_TRUE(empty.empty());
+		EXPECT_TRUE(test_unpack.empty());
+	}
+}
+
+// 与逐个 push_uint32 的 marshal_container 格式相同，字节序由 Pack 决定
+TEST(PackArray, ByteOrder)
+{
+	std::vector<uint32_t> values = { 0x01020304, 0xA0B0C0D0 };
+	for (int bo = 0; bo <= 1; bo++)
+	{
+		PackBuffer array_buffer, container_buffer;
+		Pack array_pack(array_buffer, 0, bo);
+		Pack container_pack(container_buffer, 0, bo);
+		array_pack.push_array(values);
+		marshal_container(container_pack, values);
+		EXPECT_EQ(PackedBytes(container_buffer), PackedBytes(array_buffer));
+	}
+
+	PackBuffer le_buffer, be_buffer;
+	Pack le_pack(le_buffer, 0, 0);
+	Pack be_pack(be_buffer, 0, 1);
+	le_pack.push_array(values);
+	be_pack.push_array(values);
+	EXPECT_EQ(std::string("\x02\x04\x03\x02\x01\xD0\xC0\xB0\xA0", 9), PackedBytes(le_buffer));
+	EXPECT_EQ(std::string("\x02\x01\x02\x03\x04\xA0\xB0\xC0\xD0", 9), PackedBytes(be_buffer));
+}
+
+TEST(PackArray, Truncated)
+{
+	std::vector<uint32_t> values = { 1, 2, 3, 4 };
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack.push_array(values);
+
+	std::vector<uint32_t> out;
+	Unpack test_unpack(pbuffer.data(), pbuffer.size() - 1);
+	EXPECT_THROW(test_unpack.pop_array(out), NException);
+	EXPECT_TRUE(out.empty());
+
+	// 个数远超剩余数据时不按它分配
+	const char huge_count[] = { '\xFF', '\xFF', '\xFF', '\x7F', 1, 2, 3, 4 };
+	Unpack huge_unpack(huge_count, sizeof(huge_count));
+	EXPECT_THROW(huge_unpack.pop_array(out), NException);
+	EXPECT_TRUE(out.empty());
+}
+
+TEST(PackVarintArray, RoundTrip)
+{
+	std::vector<uint64_t> values = { 0, 127, 128, 0xFFFFFFFFull, 0xFFFFFFFFFFFFFFFFull };
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack.push_varint_array(values);
+	EXPECT_EQ(1 + 1 + 1 + 2 + 5 + 10, test_pack.size());
+
+	std::vector<uint64_t> out;
+	Unpack test_unpack(pbuffer.data(), pbuffer.size());
+	test_unpack.pop_varint_array(out);
+	EXPECT_EQ(values, out);
+	EXPECT_TRUE(test_unpack.empty());
+}
+
+TEST(PackVarintArray, BadInput)
+{
+	// 元素超出目标类型的范围
+	std::vector<uint32_t> values = { 1, 70000 };
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack.push_varint_array(values);
+	std::vector<uint16_t> narrow;
+	Unpack narrow_unpack(pbuffer.data(), pbuffer.size());
+	EXPECT_THROW(narrow_unpack.pop_varint_array(narrow), NException);
+
+	// 最后一个元素被截断
+	std::vector<uint32_t> out;
+	Unpack truncated_unpack(pbuffer.data(), pbuffer.size() - 1);
+	EXPECT_THROW(truncated_unpack.pop_varint_array(out), NException);
+
+	// 个数多于剩余的字节数
+	const char huge_count[] = { '\x10', 1, 2, 3 };
+	Unpack huge_unpack(huge_count, sizeof(huge_count));
+	EXPECT_THROW(huge_unpack.pop_varint_array(out), NException);
+}
+
+// 输入都放在恰好等长的堆内存里，越界读取会被 ASan 发现
+namespace
+{
+std::vector<char> ExactBytes(const char *data, size_t size)
+{
+	return std::vector<char>(data, data + size);
+}
+}
+
+TEST(UnpackReader, TruncatedFixed)
+{
+	std::vector<char> input = ExactBytes("\x01\x02\x03", 3);
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_EQ(0u, reader.read_uint32());
+	EXPECT_FALSE(reader.ok());
+	EXPECT_EQ(kResultMemoryError, reader.error());
+	// 失败时不消耗数据，之后的读取也都失败
+	EXPECT_EQ(3u, reader.size());
+	EXPECT_EQ(0u, reader.read_uint8());
+	EXPECT_EQ(0u, reader.read_uint16());
+	EXPECT_EQ(3u, reader.size());
+	EXPECT_EQ(kResultMemoryError, reader.finish());
+}
+
+TEST(UnpackReader, Require)
+{
+	std::vector<char> input = ExactBytes("\x01\x02\x03\x04", 4);
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_TRUE(reader.require(4));
+	EXPECT_EQ(0x0201u, reader.read_uint16());
+	EXPECT_FALSE(reader.require(3));
+	EXPECT_FALSE(reader.require(0));
+	EXPECT_EQ(nullptr, reader.read_fetch_ptr(0));
+}
+
+TEST(UnpackReader, OverlongVarint)
+{
+	// read_varint 最多 4 个字节
+	std::vector<char> input = ExactBytes("\x80\x80\x80\x80\x01", 5);
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_EQ(0u, reader.read_varint());
+	EXPECT_FALSE(reader.ok());
+
+	std::vector<char> input64(10, '\x80');
+	input64.push_back('\x01');
+	UnpackReader reader64(input64.data(), input64.size());
+	EXPECT_EQ(0u, reader64.read_varint64());
+	EXPECT_FALSE(reader64.ok());
+}
+
+TEST(UnpackReader, TruncatedVarint)
+{
+	std::vector<char> input = ExactBytes("\xFF\xFF", 2);
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_EQ(0u, reader.read_varint());
+	EXPECT_FALSE(reader.ok());
+
+	std::vector<char> input64(9, '\xFF');
+	UnpackReader reader64(input64.data(), input64.size());
+	EXPECT_EQ(0u, reader64.read_varint64());
+	EXPECT_FALSE(reader64.ok());
+}
+
+TEST(UnpackReader, OversizedVarstr)
+{
+	// 声明 5 字节，实际只有 4 字节
+	std::vector<char> input = ExactBytes("\x05" "abcd", 5);
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_TRUE(reader.read_varstr().empty());
+	EXPECT_FALSE(reader.ok());
+
+	std::vector<char> huge = ExactBytes("\xFF\xFF\xFF\x7F" "abcd", 8);
+	UnpackReader huge_reader(huge.data(), huge.size());
+	Varstr vs = huge_reader.read_varstr_ptr();
+	EXPECT_EQ(0u, vs.size());
+	EXPECT_FALSE(huge_reader.ok());
+}
+
+TEST(UnpackReader, OversizedArray)
+{
+	// 个数超出剩余数据时不按它分配，values 保持不变
+	std::vector<char> input = ExactBytes("\xFF\xFF\xFF\x7F\x01\x02\x03\x04", 8);
+	UnpackReader reader(input.data(), input.size());
+	std::vector<uint32_t> values;
+	EXPECT_FALSE(reader.read_array(values));
+	EXPECT_TRUE(values.empty());
+	EXPECT_FALSE(reader.ok());
+
+	// 差一个字节
+	std::vector<char> short_input = ExactBytes("\x02\x01\x00\x00\x00\x02\x00\x00", 8);
+	UnpackReader short_reader(short_input.data(), short_input.size());
+	EXPECT_FALSE(short_reader.read_array(values));
+	EXPECT_TRUE(values.empty());
+	EXPECT_FALSE(short_reader.ok());
+}
+
+TEST(UnpackReader, Finish)
+{
+	PackBuffer pbuffer;
+	Pack test_pack(pbuffer);
+	test_pack << (uint32_t)7 << std::string("abc");
+	test_pack.push_varint64(1ull << 40);
+	std::vector<char> input = ExactBytes(pbuffer.data(), pbuffer.size());
+
+	UnpackReader reader(input.data(), input.size());
+	EXPECT_EQ(7u, reader.read_uint32());
+	EXPECT_EQ("abc", reader.read_varstr());
+	EXPECT_EQ(kResultMemoryError, reader.finish());
+	EXPECT_FALSE(reader.empty());
+
+	UnpackReader full_reader(input.data(), input.size());
+	full_reader.read_uint32();
+	full_reader.read_varstr();
+	EXPECT_EQ(1ull << 40, full_reader.read_varint64());
+	EXPECT_EQ(kResultSuccess, full_reader.finish());
+}
 
-#endif  // WITH_UNITTEST
\ No newline at end of file
+#endif  // WITH_UNITTEST
@@ -1,6 +1,7 @@
 #ifndef __EXTENSION_MEMORY_SINGLETON_H__
 #define __EXTENSION_MEMORY_SINGLETON_H__
 #include "extension/config/build_config.h"
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include "extension/at_exit_manager.h"
@@ -61,9 +62,13 @@ TypeName& operator=(const TypeName&) = delete
 
 		static TSingletonPtr instance;
 		static std::unique_ptr<std::once_flag> oc;
+		// call_once 完成后置位，之后的访问只有一次 acquire 读取；AtExitManager 释放实例时复位
+		static std::atomic<bool> initialized;
 	public:
 		static const TSingletonPtr& GetInstance()
 		{
+			if (initialized.load(std::memory_order_acquire))
+				return instance;
 			assert(!std::is_array<TSingleton>::value);
 			std::call_once(*oc, [&] (){				
 				if (release_atexitmanager)
@@ -73,6 +78,7 @@ TypeName& operator=(const TypeName&) = delete
 					{
 						instance = std::make_unique<TSingleton>();
 						at_exit->RegisterCallback([](void* ptr) {
+							initialized.store(false, std::memory_order_relaxed);
 							instance.reset();
 							oc.reset(new std::once_flag);
 						}, nullptr);
@@ -86,6 +92,7 @@ TypeName& operator=(const TypeName&) = delete
 				{
 					instance = std::make_unique<TSingleton>();
 				}
+				initialized.store(true, std::memory_order_release);
 			});
 			return instance;
 		}
@@ -94,6 +101,8 @@ TypeName& operator=(const TypeName&) = delete
 	std::unique_ptr<TSingleton> Singleton< TSingleton, release_atexitmanager>::instance = nullptr;
 	template <typename TSingleton, bool release_atexitmanager>
 	std::unique_ptr<std::once_flag> Singleton< TSingleton, release_atexitmanager>::oc = std::make_unique<std::once_flag>();
+	template <typename TSingleton, bool release_atexitmanager>
+	std::atomic<bool> Singleton< TSingleton, release_atexitmanager>::initialized(false);
 
 	EXTENSION_END_DECLS
 
@@ -0,0 +1,152 @@
+// This file defines UnpackReader, a non-throwing Unpack
+
+#ifndef BASE_MEMORY_UNPACK_READER_H_
+#define BASE_MEMORY_UNPACK_READER_H_
+
+#include "extension/memory/packet.h"
+#include <assert.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+EXTENSION_BEGIN_DECLS
+
+// 不抛异常的 Unpack，格式与 Unpack 完全相同，用于接收线程上解包对端发来的数据：
+// 数据不足或格式错误时记下 kResultMemoryError，之后的读取都直接失败并返回 0 或空值，
+// 读完一组字段后检查一次 ok() 即可，畸形包不会走异常展开。
+// 定长字段可以先用 require 一次性检查总长度，再用 *_unchecked 逐个读取，不再逐个检查。
+class EXTENSION_EXPORT UnpackReader
+{
+public:
+	UnpackReader(const void *data, size_t size, int bo = 0)
+		: data_((const char *)data), size_(size), byte_order_(bo), error_(kResultSuccess)
+	{
+	}
+
+	bool ok() const           { return error_ == kResultSuccess; }
+	RESULT error() const      { return error_; }
+	bool empty() const        { return size_ == 0; }
+	const char * data() const { return data_; }
+	size_t size() const       { return size_; }
+	int byte_order() const    { return byte_order_; }
+
+	// 剩余数据不足 n 字节时置错误
+	bool require(size_t n)
+	{
+		if (ok() && size_ < n)
+			fail();
+		return ok();
+	}
+	// 数据有剩余时置错误，返回最终的错误码
+	RESULT finish()
+	{
+		if (ok() && !empty())
+			fail();
+		return error_;
+	}
+	void fail() { error_ = kResultMemoryError; }
+
+	bool read_bool()       { return read_uint8() != 0; }
+	uint8_t read_uint8()   { return require(1) ? read_uint8_unchecked() : 0; }
+	uint16_t read_uint16() { return require(2) ? read_uint16_unchecked() : 0; }
+	uint32_t read_uint32() { return require(4) ? read_uint32_unchecked() : 0; }
+	uint64_t read_uint64() { return require(8) ? read_uint64_unchecked() : 0; }
+
+	// 调用方需已用 require 保证长度
+	bool read_bool_unchecked()         { return read_uint8_unchecked() != 0; }
+	uint8_t read_uint8_unchecked()     { return (uint8_t)*advance(1); }
+	uint16_t read_uint16_unchecked()   { uint16_t v; memcpy(&v, advance(2), 2); return byte_order_ ? BETOHS(v) : LETOHS(v); }
+	uint32_t read_uint32_unchecked()   { uint32_t v; memcpy(&v, advance(4), 4); return byte_order_ ? BETOHL(v) : LETOHL(v); }
+	uint64_t read_uint64_unchecked()   { uint64_t v; memcpy(&v, advance(8), 8); return byte_order_ ? BETOHLL(v) : LETOHLL(v); }
+
+	// 与 Unpack::pop_varint 一样最多 4 个字节
+	uint32_t read_varint()
+	{
+		uint32_t value = 0;
+		for (uint32_t shift = 0; ok(); shift += 7)
+		{
+			if (shift > 21 || !require(1))
+			{
+				fail();
+				return 0;
+			}
+			uint8_t b = read_uint8_unchecked();
+			value |= (uint32_t)(b & 0x7F) << shift;
+			if ((b & 0x80) == 0)
+				return value;
+		}
+		return 0;
+	}
+	uint64_t read_varint64()
+	{
+		uint64_t value = 0;
+		for (uint32_t shift = 0; ok(); shift += 7)
+		{
+			if (shift >= 64 || !require(1))
+			{
+				fail();
+				return 0;
+			}
+			uint8_t b = read_uint8_unchecked();
+			value |= (uint64_t)(b & 0x7F) << shift;
+			if ((b & 0x80) == 0)
+				return value;
+		}
+		return 0;
+	}
+
+	const char * read_fetch_ptr(size_t k) { return require(k) ? advance(k) : nullptr; }
+	Varstr read_varstr_ptr()
+	{
+		size_t size = read_varint();
+		const char *data = read_fetch_ptr(size);
+		return data != nullptr ? Varstr(data, size) : Varstr();
+	}
+	std::string read_varstr()
+	{
+		Varstr vs = read_varstr_ptr();
+		return std::string(vs.data(), vs.size());
+	}
+
+	// 与 Unpack::pop_array 对应
+	template <class T>
+	bool read_array(std::vector<T> &values)
+	{
+		static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "read_array: T must be an unsigned integer");
+		size_t count = read_varint();
+		if (!ok() || count > size_ / sizeof(T))
+		{
+			fail();
+			return false;
+		}
+		values.resize(count);
+		if (count == 0)
+			return true;
+		if (sizeof(T) > 1 && (byte_order_ ? BETOHS(1) : LETOHS(1)) != 1)
+			byte_swap_copy(&values[0], advance(count * sizeof(T)), count, sizeof(T));
+		else
+			memcpy(&values[0], advance(count * sizeof(T)), count * sizeof(T));
+		return true;
+	}
+
+private:
+	const char * advance(size_t k)
+	{
+		assert(size_ >= k);
+		const char *p = data_;
+		data_ += k;
+		size_ -= k;
+		return p;
+	}
+
+private:
+	const char	*data_;
+	size_t		size_;
+	int			byte_order_;	//0 : le; 1 : be;
+	RESULT		error_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // BASE_MEMORY_UNPACK_READER_H_
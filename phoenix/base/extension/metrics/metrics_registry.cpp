@@ -0,0 +1,334 @@
+#include "extension/metrics/metrics_registry.h"
+#include <limits>
+#include "base/bits.h"
+#include "base/json/string_escape.h"
+#include "base/strings/stringprintf.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const int64_t kSubBuckets = 1 << MetricHistogram::kSubBucketBits;
+const int64_t kMaxValue = (int64_t(1) << MetricHistogram::kMaxValueBits) - 1;
+
+std::atomic<size_t> g_next_metric_shard(0);
+
+int Log2Floor64(uint64_t value)
+{
+	uint32_t high = static_cast<uint32_t>(value >> 32);
+	if (high != 0)
+		return 32 + base::bits::Log2Floor(high);
+	return base::bits::Log2Floor(static_cast<uint32_t>(value));
+}
+
+void UpdateMin(std::atomic<int64_t> &min_value, int64_t value)
+{
+	int64_t current = min_value.load(std::memory_order_relaxed);
+	while (value < current && !min_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+
+void UpdateMax(std::atomic<int64_t> &max_value, int64_t value)
+{
+	int64_t current = max_value.load(std::memory_order_relaxed);
+	while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+
+void AppendJsonName(const std::string &name, std::string *output)
+{
+	base::EscapeJSONString(name, true, output);
+	output->push_back(':');
+}
+}
+
+namespace internal
+{
+size_t CurrentMetricShard()
+{
+	static thread_local size_t shard = g_next_metric_shard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+	return shard;
+}
+}
+
+int64_t MetricCounter::Value() const
+{
+	int64_t value = 0;
+	for (const internal::MetricCell &cell : cells_)
+		value += cell.value.load(std::memory_order_relaxed);
+	return value;
+}
+
+void MetricCounter::Reset()
+{
+	for (internal::MetricCell &cell : cells_)
+		cell.value.store(0, std::memory_order_relaxed);
+}
+
+int64_t HistogramSnapshot::Percentile(double percentile) const
+{
+	if (count == 0)
+		return 0;
+	if (percentile <= 0)
+		return min;
+	if (percentile >= 100)
+		return max;
+	uint64_t rank = static_cast<uint64_t>(count * percentile / 100);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < buckets.size(); ++i)
+	{
+		seen += buckets[i].second;
+		if (seen <= rank)
+			continue;
+		//取桶的上界，再限制在实际的最小、最大值之间
+		int64_t upper = MetricHistogram::BucketLowerBound(MetricHistogram::BucketIndex(buckets[i].first) + 1) - 1;
+		if (upper > max)
+			upper = max;
+		return upper < min ? min : upper;
+	}
+	return max;
+}
+
+MetricHistogram::Shard::Shard()
+	: count(0)
+	, sum(0)
+{
+	for (std::atomic<uint64_t> &bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+MetricHistogram::MetricHistogram(const std::string &name)
+	: name_(name)
+	, min_(std::numeric_limits<int64_t>::max())
+	, max_(std::numeric_limits<int64_t>::min())
+{
+
+}
+
+size_t MetricHistogram::BucketIndex(int64_t value)
+{
+	if (value < kSubBuckets)
+		return value < 0 ? 0 : static_cast<size_t>(value);
+	if (value > kMaxValue)
+		return kBucketCount - 1;
+	int exponent = Log2Floor64(static_cast<uint64_t>(value));
+	size_t group = exponent - kSubBucketBits + 1;
+	size_t sub_bucket = static_cast<size_t>(value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+	return (group << kSubBucketBits) | sub_bucket;
+}
+
+int64_t MetricHistogram::BucketLowerBound(size_t index)
+{
+	if (index < static_cast<size_t>(kSubBuckets))
+		return static_cast<int64_t>(index);
+	if (index >= kBucketCount)
+		return kMaxValue + 1;
+	size_t group = index >> kSubBucketBits;
+	int64_t sub_bucket = static_cast<int64_t>(index & (kSubBuckets - 1));
+	return (kSubBuckets + sub_bucket) << (group - 1);
+}
+
+void MetricHistogram::Add(int64_t value)
+{
+	if (value < 0)
+		value = 0;
+	Shard &shard = shards_[internal::CurrentMetricShard()];
+	shard.buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	shard.sum.fetch_add(value, std::memory_order_relaxed);
+	shard.count.fetch_add(1, std::memory_order_relaxed);
+	UpdateMin(min_, value);
+	UpdateMax(max_, value);
+}
+
+HistogramSnapshot MetricHistogram::Snapshot() const
+{
+	HistogramSnapshot snapshot;
+	snapshot.name = name_;
+	uint64_t counts[kBucketCount] = { 0 };
+	for (const Shard &shard : shards_)
+	{
+		snapshot.count += shard.count.load(std::memory_order_relaxed);
+		snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < kBucketCount; ++i)
+			counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < kBucketCount; ++i)
+	{
+		if (counts[i] != 0)
+			snapshot.buckets.push_back(std::make_pair(BucketLowerBound(i), counts[i]));
+	}
+	if (snapshot.count != 0)
+	{
+		snapshot.min = min_.load(std::memory_order_relaxed);
+		snapshot.max = max_.load(std::memory_order_relaxed);
+	}
+	return snapshot;
+}
+
+void MetricHistogram::Reset()
+{
+	for (Shard &shard : shards_)
+	{
+		shard.count.store(0, std::memory_order_relaxed);
+		shard.sum.store(0, std::memory_order_relaxed);
+		for (std::atomic<uint64_t> &bucket : shard.buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+	min_.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+	max_.store(std::numeric_limits<int64_t>::min(), std::memory_order_relaxed);
+}
+
+std::string MetricsSnapshot::ToJson() const
+{
+	std::string output("{\"counters\":{");
+	for (size_t i = 0; i < counters.size(); ++i)
+	{
+		if (i != 0)
+			output.push_back(',');
+		AppendJsonName(counters[i].first, &output);
+		output += std::to_string(counters[i].second);
+	}
+	output += "},\"gauges\":{";
+	for (size_t i = 0; i < gauges.size(); ++i)
+	{
+		if (i != 0)
+			output.push_back(',');
+		AppendJsonName(gauges[i].first, &output);
+		output += std::to_string(gauges[i].second);
+	}
+	output += "},\"histograms\":{";
+	for (size_t i = 0; i < histograms.size(); ++i)
+	{
+		const HistogramSnapshot &histogram = histograms[i];
+		if (i != 0)
+			output.push_back(',');
+		AppendJsonName(histogram.name, &output);
+		base::StringAppendF(&output,
+			"{\"count\":%llu,\"sum\":%lld,\"min\":%lld,\"max\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"buckets\":[",
+			(unsigned long long)histogram.count, (long long)histogram.sum,
+			(long long)histogram.min, (long long)histogram.max,
+			(long long)histogram.Percentile(50), (long long)histogram.Percentile(90),
+			(long long)histogram.Percentile(99));
+		for (size_t j = 0; j < histogram.buckets.size(); ++j)
+		{
+			base::StringAppendF(&output, "%s[%lld,%llu]", j == 0 ? "" : ",",
+				(long long)histogram.buckets[j].first, (unsigned long long)histogram.buckets[j].second);
+		}
+		output += "]}";
+	}
+	output += "}}";
+	return output;
+}
+
+std::string MetricsSnapshot::ToLogLine() const
+{
+	std::string output;
+	for (const auto &counter : counters)
+	{
+		if (counter.second != 0)
+			base::StringAppendF(&output, "%s=%lld ", counter.first.c_str(), (long long)counter.second);
+	}
+	for (const auto &gauge : gauges)
+		base::StringAppendF(&output, "%s=%lld ", gauge.first.c_str(), (long long)gauge.second);
+	for (const HistogramSnapshot &histogram : histograms)
+	{
+		if (histogram.count == 0)
+			continue;
+		base::StringAppendF(&output, "%s{n=%llu p50=%lld p99=%lld max=%lld} ", histogram.name.c_str(),
+			(unsigned long long)histogram.count, (long long)histogram.Percentile(50),
+			(long long)histogram.Percentile(99), (long long)histogram.max);
+	}
+	if (!output.empty())
+		output.pop_back();
+	return output;
+}
+
+MetricsRegistry* MetricsRegistry::GetInstance()
+{
+	//指标的指针被各模块的静态变量持有，不随进程退出释放
+	static MetricsRegistry *registry = new MetricsRegistry;
+	return registry;
+}
+
+MetricCounter* MetricsRegistry::GetCounter(const std::string &name)
+{
+	base::AutoLock lock(lock_);
+	std::unique_ptr<MetricCounter> &counter = counters_[name];
+	if (!counter)
+		counter.reset(new MetricCounter(name));
+	return counter.get();
+}
+
+MetricGauge* MetricsRegistry::GetGauge(const std::string &name)
+{
+	base::AutoLock lock(lock_);
+	std::unique_ptr<MetricGauge> &gauge = gauges_[name];
+	if (!gauge)
+		gauge.reset(new MetricGauge(name));
+	return gauge.get();
+}
+
+MetricHistogram* MetricsRegistry::GetHistogram(const std::string &name)
+{
+	base::AutoLock lock(lock_);
+	std::unique_ptr<MetricHistogram> &histogram = histograms_[name];
+	if (!histogram)
+		histogram.reset(new MetricHistogram(name));
+	return histogram.get();
+}
+
+void MetricsRegistry::RegisterGaugeCallback(const std::string &name, const GaugeCallback &callback)
+{
+	base::AutoLock lock(lock_);
+	gauge_callbacks_[name] = callback;
+}
+
+void MetricsRegistry::UnregisterGaugeCallback(const std::string &name)
+{
+	base::AutoLock lock(lock_);
+	gauge_callbacks_.erase(name);
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() const
+{
+	MetricsSnapshot snapshot;
+	std::vector<MetricCounter *> counters;
+	std::vector<MetricGauge *> gauges;
+	std::vector<MetricHistogram *> histograms;
+	std::map<std::string, GaugeCallback> callbacks;
+	{
+		base::AutoLock lock(lock_);
+		for (const auto &it : counters_)
+			counters.push_back(it.second.get());
+		for (const auto &it : gauges_)
+			gauges.push_back(it.second.get());
+		for (const auto &it : histograms_)
+			histograms.push_back(it.second.get());
+		callbacks = gauge_callbacks_;
+	}
+	//合并分片和执行回调都在锁外，不阻塞其他线程注册指标
+	snapshot.counters.reserve(counters.size());
+	for (MetricCounter *counter : counters)
+		snapshot.counters.push_back(std::make_pair(counter->name(), counter->Value()));
+	std::map<std::string, int64_t> gauge_values;
+	for (MetricGauge *gauge : gauges)
+		gauge_values[gauge->name()] = gauge->Value();
+	for (const auto &it : callbacks)
+		gauge_values[it.first] = it.second ? it.second() : 0;
+	snapshot.gauges.assign(gauge_values.begin(), gauge_values.end());
+	snapshot.histograms.reserve(histograms.size());
+	for (MetricHistogram *histogram : histograms)
+		snapshot.histograms.push_back(histogram->Snapshot());
+	return snapshot;
+}
+
+void MetricsRegistry::Reset()
+{
+	base::AutoLock lock(lock_);
+	for (auto &it : counters_)
+		it.second->Reset();
+	for (auto &it : histograms_)
+		it.second->Reset();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,203 @@
+// process-wide counters, gauges and log-linear histograms sharded across threads and merged on read
+
+#ifndef __BASE_EXTENSION_METRICS_REGISTRY_H__
+#define __BASE_EXTENSION_METRICS_REGISTRY_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+class MetricsRegistry;
+
+namespace internal
+{
+// 每个指标的分片数，线程按第一次记录的先后轮流分到各个分片，
+// 同一分片上只有少数几个线程，彼此之间不会争抢同一条 cache line
+const size_t kMetricShards = 8;
+// 当前线程使用的分片
+EXTENSION_EXPORT size_t CurrentMetricShard();
+
+struct alignas(64) MetricCell
+{
+	MetricCell() : value(0) {}
+	std::atomic<int64_t> value;
+};
+}
+
+// 单调累加的计数，Increment 只是当前线程所在分片上的一次 relaxed fetch_add，读取时把各分片相加
+class EXTENSION_EXPORT MetricCounter
+{
+public:
+	const std::string& name() const { return name_; }
+
+	void Increment(int64_t delta = 1)
+	{
+		cells_[internal::CurrentMetricShard()].value.fetch_add(delta, std::memory_order_relaxed);
+	}
+	int64_t Value() const;
+	// 与 Increment 同时进行时可能丢失少量计数
+	void Reset();
+
+private:
+	friend class MetricsRegistry;
+	explicit MetricCounter(const std::string &name) : name_(name) {}
+
+	std::string name_;
+	internal::MetricCell cells_[internal::kMetricShards];
+
+	DISALLOW_COPY_AND_ASSIGN(MetricCounter);
+};
+
+// 当前值，例如队列长度、连接数。Set 的结果无法按分片合并，所以只有一个原子量；
+// 写得很频繁又只需要增减的值用两个 MetricCounter 相减
+class EXTENSION_EXPORT MetricGauge
+{
+public:
+	const std::string& name() const { return name_; }
+
+	void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+	void Add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+	int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+	friend class MetricsRegistry;
+	explicit MetricGauge(const std::string &name) : name_(name), value_(0) {}
+
+	std::string name_;
+	std::atomic<int64_t> value_;
+
+	DISALLOW_COPY_AND_ASSIGN(MetricGauge);
+};
+
+// 一个直方图在某一时刻的合并结果
+struct EXTENSION_EXPORT HistogramSnapshot
+{
+	HistogramSnapshot() : count(0), sum(0), min(0), max(0) {}
+
+	// 按百分位 percentile（0~100）估计的值，误差不超过所在桶的宽度（约 25%），没有样本时为 0
+	int64_t Percentile(double percentile) const;
+
+	std::string name;
+	uint64_t count;
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+	// 非空的桶：(桶的下界, 样本数)，按下界升序
+	std::vector<std::pair<int64_t, uint64_t>> buckets;
+};
+
+// 对数-线性分桶的直方图：每个 2 的幂区间再等分为 4 个桶，
+// 0~3 各占一个桶，最大到 2^40（微秒约 12 天），更大的值记入最后一个桶，负数记为 0。
+// 桶边界固定，不需要像 base::Histogram 那样事先给出范围和桶数；
+// Add 只写当前线程所在分片的计数，min/max 只在刷新时做一次 CAS
+class EXTENSION_EXPORT MetricHistogram
+{
+public:
+	static const int kSubBucketBits = 2;
+	static const int kMaxValueBits = 40;
+	static const size_t kBucketCount = (kMaxValueBits - kSubBucketBits + 1) << kSubBucketBits;
+
+	const std::string& name() const { return name_; }
+
+	void Add(int64_t value);
+	// 按微秒记录，时间类的直方图名称约定以 .us 结尾
+	void AddTime(TimeDelta time) { Add(time.InMicroseconds()); }
+	HistogramSnapshot Snapshot() const;
+	void Reset();
+
+	// value 所在的桶和桶的下界，导出和测试时用
+	static size_t BucketIndex(int64_t value);
+	static int64_t BucketLowerBound(size_t index);
+
+private:
+	friend class MetricsRegistry;
+	explicit MetricHistogram(const std::string &name);
+
+	struct alignas(64) Shard
+	{
+		Shard();
+		std::atomic<uint64_t> count;
+		std::atomic<int64_t> sum;
+		std::atomic<uint64_t> buckets[kBucketCount];
+	};
+
+	std::string name_;
+	// 没有样本时 min_ 为 INT64_MAX，max_ 为 INT64_MIN
+	std::atomic<int64_t> min_;
+	std::atomic<int64_t> max_;
+	Shard shards_[internal::kMetricShards];
+
+	DISALLOW_COPY_AND_ASSIGN(MetricHistogram);
+};
+
+// 所有指标在某一时刻的值，各部分按名称排序
+struct EXTENSION_EXPORT MetricsSnapshot
+{
+	std::vector<std::pair<std::string, int64_t>> counters;
+	std::vector<std::pair<std::string, int64_t>> gauges;
+	std::vector<HistogramSnapshot> histograms;
+
+	// {"counters":{..},"gauges":{..},"histograms":{"name":{"count":..,"sum":..,"min":..,"max":..,
+	//  "p50":..,"p90":..,"p99":..,"buckets":[[下界,样本数],..]},..}}
+	std::string ToJson() const;
+	// 写日志用的一行：name=value ... name{n=.. p50=.. p99=.. max=..} ...，没有样本的直方图和为 0 的计数省略
+	std::string ToLogLine() const;
+};
+
+// 全进程共用的指标表，各模块不再各自维护统计变量：
+//   static MetricCounter *bytes_sent = MetricsRegistry::GetInstance()->GetCounter("net.tcp.bytes_sent");
+//   bytes_sent->Increment(size);
+// Get* 按名称查找（加锁），热路径上应像上面这样只取一次，之后直接使用返回的指针；
+// 指标创建后不释放，指针在进程内一直有效。名称约定为 模块.对象.指标，不同类型的指标可以同名但不建议。
+// 与 base/metrics 不同，记录时不经过任何全局锁；读取（Snapshot）时才合并各分片，开销与指标数成正比
+class EXTENSION_EXPORT MetricsRegistry
+{
+public:
+	typedef std::function<int64_t()> GaugeCallback;
+
+	static MetricsRegistry* GetInstance();
+
+	// 不存在时创建，任意线程可调用
+	MetricCounter* GetCounter(const std::string &name);
+	MetricGauge* GetGauge(const std::string &name);
+	MetricHistogram* GetHistogram(const std::string &name);
+
+	// 只在 Snapshot 时取值的 gauge，用于已经由别的模块维护的值（如 BlockBuffer 的块数），记录时没有任何开销；
+	// 同名的替换原来的回调。回调在调用 Snapshot 的线程上执行，不能再调用 MetricsRegistry
+	void RegisterGaugeCallback(const std::string &name, const GaugeCallback &callback);
+	void UnregisterGaugeCallback(const std::string &name);
+
+	MetricsSnapshot Snapshot() const;
+	// 清零所有计数和直方图，gauge 保持当前值
+	void Reset();
+
+private:
+	MetricsRegistry() = default;
+	~MetricsRegistry() = default;
+
+	mutable base::Lock lock_;
+	std::map<std::string, std::unique_ptr<MetricCounter>> counters_;
+	std::map<std::string, std::unique_ptr<MetricGauge>> gauges_;
+	std::map<std::string, std::unique_ptr<MetricHistogram>> histograms_;
+	std::map<std::string, GaugeCallback> gauge_callbacks_;
+
+	DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_METRICS_REGISTRY_H__
@@ -0,0 +1,529 @@
+#include "extension/network/address_selector.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "base/hash.h"
+#include "base/pickle.h"
+#include "base/time/time.h"
+
+#include "extension/file_util/async_file.h"
+#include "extension/file_util/utf8_file_util.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 字段有增减时加一，旧文件直接丢弃
+const uint32_t kFormatVersion = 1;
+const size_t kChecksumSize = sizeof(uint32_t);
+// 新样本的权重，同 NetworkQualityEstimator
+const double kRttWeight = 0.25;
+// 连续失败的退避时长 kBackoffSeconds << (failures - 1)，不超过 kMaxBackoffSeconds
+const int64_t kBackoffSeconds = 30;
+const int64_t kMaxBackoffSeconds = 30 * 60;
+// 读入时丢弃这么久没有用过的地址
+const int64_t kMaxAgeSeconds = 7 * 24 * 3600;
+
+// RFC 6724 的范围
+const int kScopeLinkLocal = 2;
+const int kScopeSiteLocal = 5;
+const int kScopeGlobal = 14;
+
+// RFC 6724 第 2.1 节的默认策略表，按前缀从长到短排列，取第一个匹配的
+struct PolicyEntry
+{
+	uint8_t prefix[16];
+	size_t prefix_bits;
+	int precedence;
+};
+const PolicyEntry kPolicyTable[] = {
+	{ { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 }, 128, 50 },			// ::1/128
+	{ { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff }, 96, 35 },				// ::ffff:0:0/96，IPv4
+	{ { 0 }, 96, 1 },														// ::/96，IPv4 兼容地址
+	{ { 0x20, 0x01, 0, 0 }, 32, 5 },										// 2001::/32，Teredo
+	{ { 0x20, 0x02 }, 16, 30 },												// 2002::/16，6to4
+	{ { 0x3f, 0xfe }, 16, 1 },												// 3ffe::/16，6bone
+	{ { 0xfe, 0xc0 }, 10, 1 },												// fec0::/10，站点本地
+	{ { 0xfc }, 7, 3 },														// fc00::/7，ULA
+	{ { 0 }, 0, 40 },														// ::/0
+};
+
+bool ParseIPv4(const char* begin, const char* end, uint8_t* bytes)
+{
+	int component = 0;
+	int value = -1;
+	for (const char* p = begin; ; p++)
+	{
+		if (p == end || *p == '.')
+		{
+			if (value < 0 || component == 4)
+				return false;
+			bytes[component++] = (uint8_t)value;
+			value = -1;
+			if (p == end)
+				break;
+		}
+		else if (*p >= '0' && *p <= '9')
+		{
+			value = (value < 0 ? 0 : value * 10) + (*p - '0');
+			if (value > 255)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return component == 4;
+}
+
+// 解析为 16 字节，IPv4 按 IPv4 映射的 IPv6 地址存放，策略表就是这样匹配 IPv4 的
+bool ParseAddress(const std::string& ip, uint8_t* bytes)
+{
+	memset(bytes, 0, 16);
+	const char* begin = ip.c_str();
+	const char* end = begin + ip.size();
+	if (begin != end && *begin == '[' && end[-1] == ']')
+	{
+		begin++;
+		end--;
+	}
+	const char* zone = std::find(begin, end, '%');
+	end = zone;
+	if (std::find(begin, end, ':') == end)
+	{
+		bytes[10] = bytes[11] = 0xff;
+		return ParseIPv4(begin, end, bytes + 12);
+	}
+
+	uint16_t groups[8] = { 0 };
+	int count = 0;
+	int compress = -1;
+	const char* p = begin;
+	if (end - p >= 2 && p[0] == ':' && p[1] == ':')
+	{
+		compress = 0;
+		p += 2;
+	}
+	while (p != end)
+	{
+		const char* group_end = p;
+		while (group_end != end && *group_end != ':')
+			group_end++;
+		if (std::find(p, group_end, '.') != group_end)
+		{
+			//最后两组可以写成点分的 IPv4
+			uint8_t ipv4[4];
+			if (group_end != end || count > 6 || !ParseIPv4(p, group_end, ipv4))
+				return false;
+			groups[count++] = (uint16_t)((ipv4[0] << 8) | ipv4[1]);
+			groups[count++] = (uint16_t)((ipv4[2] << 8) | ipv4[3]);
+			p = end;
+			break;
+		}
+		if (group_end == p || group_end - p > 4 || count == 8)
+			return false;
+		uint16_t value = 0;
+		for (const char* q = p; q != group_end; q++)
+		{
+			char c = *q;
+			int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+				(c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+			if (digit < 0)
+				return false;
+			value = (uint16_t)((value << 4) | digit);
+		}
+		groups[count++] = value;
+		p = group_end;
+		if (p == end)
+			break;
+		p++;
+		if (p != end && *p == ':')
+		{
+			if (compress >= 0)
+				return false;
+			compress = count;
+			p++;
+		}
+		else if (p == end)
+		{
+			return false;//末尾单个冒号
+		}
+	}
+	if (compress < 0 ? count != 8 : count > 7)
+		return false;
+
+	int zeros = 8 - count;
+	for (int i = 0, out = 0; i < count; i++, out++)
+	{
+		if (i == compress)
+			out += zeros;
+		bytes[out * 2] = (uint8_t)(groups[i] >> 8);
+		bytes[out * 2 + 1] = (uint8_t)groups[i];
+	}
+	return true;
+}
+
+bool MatchPrefix(const uint8_t* bytes, const uint8_t* prefix, size_t prefix_bits)
+{
+	size_t whole = prefix_bits / 8;
+	if (memcmp(bytes, prefix, whole) != 0)
+		return false;
+	size_t remaining = prefix_bits % 8;
+	if (remaining == 0)
+		return true;
+	uint8_t mask = (uint8_t)(0xff << (8 - remaining));
+	return (bytes[whole] & mask) == (prefix[whole] & mask);
+}
+
+int Precedence(const uint8_t* bytes)
+{
+	for (const PolicyEntry& entry : kPolicyTable)
+	{
+		if (MatchPrefix(bytes, entry.prefix, entry.prefix_bits))
+			return entry.precedence;
+	}
+	return 0;
+}
+
+int Scope(const uint8_t* bytes)
+{
+	static const uint8_t kIPv4MappedPrefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	if (memcmp(bytes, kIPv4MappedPrefix, sizeof(kIPv4MappedPrefix)) == 0)
+	{
+		//RFC 6724 第 3.2 节：回环和 169.254/16 为链路本地，其余为全局
+		if (bytes[12] == 127 || (bytes[12] == 169 && bytes[13] == 254))
+			return kScopeLinkLocal;
+		return kScopeGlobal;
+	}
+	if (bytes[0] == 0xff)
+		return bytes[1] & 0x0f;//组播地址自带范围
+	if (bytes[0] == 0xfe && (bytes[1] & 0xc0) == 0x80)
+		return kScopeLinkLocal;
+	if (bytes[0] == 0xfe && (bytes[1] & 0xc0) == 0xc0)
+		return kScopeSiteLocal;
+	static const uint8_t kLoopback[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+	if (memcmp(bytes, kLoopback, sizeof(kLoopback)) == 0)
+		return kScopeLinkLocal;
+	return kScopeGlobal;
+}
+
+int64_t Now()
+{
+	return base::Time::Now().ToTimeT();
+}
+
+struct SortKey
+{
+	// 0 为成功连接过，1 为没有历史，2 为在退避期内
+	int group;
+	// group 0 为 RTT，group 2 为退避结束的时间
+	int64_t value;
+	int precedence;
+	int scope;
+	const std::string* ip;
+};
+
+bool LessSortKey(const SortKey& a, const SortKey& b)
+{
+	if (a.group != b.group)
+		return a.group < b.group;
+	if (a.value != b.value)
+		return a.value < b.value;
+	//规则 6：优先级高的在前
+	if (a.precedence != b.precedence)
+		return a.precedence > b.precedence;
+	//规则 8：范围小的在前
+	return a.scope < b.scope;
+}
+}
+
+AddressSelector* AddressSelector::GetInstance()
+{
+	static AddressSelector *instance = new AddressSelector;
+	return instance;
+}
+
+AddressSelector::AddressSelector() :
+	started_(false),
+	dirty_(false),
+	last_save_time_(0)
+{
+}
+
+void AddressSelector::Start(const UTF8String &cache_file)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	if (started_)
+		return;
+	started_ = true;
+	cache_file_ = cache_file;
+	last_save_time_ = Now();
+	LoadLocked();
+}
+
+void AddressSelector::ReportSuccess(const std::string& ip, int rtt_ms)
+{
+	uint8_t bytes[16];
+	if (rtt_ms < 0 || !ParseAddress(ip, bytes))
+		return;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		int64_t now = Now();
+		AddressStats& stats = GetEntryLocked(ip, now);
+		stats.rtt_ms = stats.samples == 0 ? rtt_ms : (int)(stats.rtt_ms + (rtt_ms - stats.rtt_ms) * kRttWeight);
+		stats.samples++;
+		stats.failures = 0;
+		stats.last_failure_time = 0;
+		dirty_ = true;
+		TrimLocked();
+	}
+	MaybeSave(false);
+}
+
+void AddressSelector::ReportFailure(const std::string& ip)
+{
+	uint8_t bytes[16];
+	if (!ParseAddress(ip, bytes))
+		return;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		int64_t now = Now();
+		AddressStats& stats = GetEntryLocked(ip, now);
+		stats.failures++;
+		stats.last_failure_time = now;
+		dirty_ = true;
+		TrimLocked();
+	}
+	MaybeSave(false);
+}
+
+void AddressSelector::Sort(std::list<std::string>& ip_list)
+{
+	if (ip_list.size() < 2)
+		return;
+
+	std::vector<SortKey> keys;
+	keys.reserve(ip_list.size());
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		int64_t now = Now();
+		for (const std::string& ip : ip_list)
+		{
+			SortKey key;
+			key.group = 1;
+			key.value = 0;
+			key.ip = &ip;
+			uint8_t bytes[16];
+			if (ParseAddress(ip, bytes))
+			{
+				key.precedence = Precedence(bytes);
+				key.scope = Scope(bytes);
+			}
+			else
+			{
+				//不是 IP 的放在没有历史的地址最后
+				key.precedence = -1;
+				key.scope = kScopeGlobal + 1;
+			}
+			auto iter = entries_.find(ip);
+			if (iter != entries_.end())
+			{
+				int64_t backoff_end = BackoffEndLocked(iter->second);
+				if (now < backoff_end)
+				{
+					key.group = 2;
+					key.value = backoff_end;
+				}
+				else if (iter->second.rtt_ms >= 0)
+				{
+					key.group = 0;
+					key.value = iter->second.rtt_ms;
+				}
+			}
+			keys.push_back(key);
+		}
+	}
+	std::stable_sort(keys.begin(), keys.end(), LessSortKey);
+
+	std::list<std::string> sorted;
+	for (const SortKey& key : keys)
+		sorted.push_back(*key.ip);
+	ip_list.swap(sorted);
+}
+
+bool AddressSelector::IsBackedOff(const std::string& ip)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto iter = entries_.find(ip);
+	return iter != entries_.end() && Now() < BackoffEndLocked(iter->second);
+}
+
+bool AddressSelector::GetStats(const std::string& ip, AddressStats* stats)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto iter = entries_.find(ip);
+	if (iter == entries_.end())
+		return false;
+	if (stats != nullptr)
+		*stats = iter->second;
+	return true;
+}
+
+void AddressSelector::OnNetworkChanged()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	for (auto& item : entries_)
+	{
+		if (item.second.failures == 0)
+			continue;
+		item.second.failures = 0;
+		item.second.last_failure_time = 0;
+		dirty_ = true;
+	}
+}
+
+void AddressSelector::Flush()
+{
+	MaybeSave(true);
+}
+
+void AddressSelector::Clear()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		entries_.clear();
+		dirty_ = true;
+	}
+	MaybeSave(true);
+}
+
+AddressStats& AddressSelector::GetEntryLocked(const std::string& ip, int64_t now)
+{
+	AddressStats& stats = entries_[ip];
+	stats.last_used_time = now;
+	return stats;
+}
+
+int64_t AddressSelector::BackoffEndLocked(const AddressStats& stats) const
+{
+	if (stats.failures <= 0)
+		return 0;
+	int shift = std::min(stats.failures - 1, 8);
+	return stats.last_failure_time + std::min(kBackoffSeconds << shift, kMaxBackoffSeconds);
+}
+
+void AddressSelector::TrimLocked()
+{
+	while (entries_.size() > kMaxEntries)
+	{
+		auto oldest = entries_.begin();
+		for (auto iter = entries_.begin(); iter != entries_.end(); ++iter)
+		{
+			if (iter->second.last_used_time < oldest->second.last_used_time)
+				oldest = iter;
+		}
+		entries_.erase(oldest);
+	}
+}
+
+bool AddressSelector::LoadLocked()
+{
+	std::string content;
+	if (cache_file_.empty() || !NS_EXTENSION::ReadFileToString(cache_file_, content) || content.size() <= kChecksumSize)
+		return false;
+	size_t payload_size = content.size() - kChecksumSize;
+	const uint8_t *p = (const uint8_t *)content.data() + payload_size;
+	uint32_t checksum = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	if (checksum != base::Hash(content.data(), payload_size))
+		return false;
+
+	base::Pickle pickle(content.data(), (int)payload_size);
+	base::PickleIterator iter(pickle);
+	uint32_t version = 0;
+	uint32_t count = 0;
+	if (!iter.ReadUInt32(&version) || version != kFormatVersion || !iter.ReadUInt32(&count))
+		return false;
+	int64_t oldest = Now() - kMaxAgeSeconds;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		std::string ip;
+		AddressStats stats;
+		if (!iter.ReadString(&ip)
+			|| !iter.ReadInt(&stats.rtt_ms)
+			|| !iter.ReadInt(&stats.samples)
+			|| !iter.ReadInt(&stats.failures)
+			|| !iter.ReadInt64(&stats.last_failure_time)
+			|| !iter.ReadInt64(&stats.last_used_time))
+			return false;
+		if (stats.last_used_time >= oldest)
+			entries_[ip] = stats;
+	}
+	TrimLocked();
+	return true;
+}
+
+std::string AddressSelector::SerializeLocked() const
+{
+	base::Pickle pickle;
+	pickle.WriteUInt32(kFormatVersion);
+	pickle.WriteUInt32((uint32_t)entries_.size());
+	for (const auto& item : entries_)
+	{
+		pickle.WriteString(item.first);
+		pickle.WriteInt(item.second.rtt_ms);
+		pickle.WriteInt(item.second.samples);
+		pickle.WriteInt(item.second.failures);
+		pickle.WriteInt64(item.second.last_failure_time);
+		pickle.WriteInt64(item.second.last_used_time);
+	}
+
+	std::string content((const char *)pickle.data(), pickle.size());
+	uint32_t checksum = base::Hash(content);
+	char tail[kChecksumSize] = { (char)checksum, (char)(checksum >> 8), (char)(checksum >> 16), (char)(checksum >> 24) };
+	content.append(tail, sizeof(tail));
+	return content;
+}
+
+void AddressSelector::MaybeSave(bool force)
+{
+	UTF8String cache_file;
+	std::string content;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (cache_file_.empty() || !dirty_)
+			return;
+		int64_t now = Now();
+		if (!force && now - last_save_time_ < kSaveIntervalSeconds)
+			return;
+		cache_file = cache_file_;
+		content = SerializeLocked();
+		dirty_ = false;
+		last_save_time_ = now;
+	}
+
+	//先写临时文件再改名，进程中途退出也不会留下半个文件
+	UTF8String temp_file = cache_file + ".tmp";
+	if (force)
+	{
+		if (NS_EXTENSION::WriteFile(temp_file, content) != (int)content.size()
+			|| !NS_EXTENSION::MoveFile(temp_file, cache_file))
+			NS_EXTENSION::DeleteFile(temp_file);
+		return;
+	}
+	//上报发生在传输线程上，不在这里等磁盘
+	int size = (int)content.size();
+	NS_EXTENSION::AsyncWriteFile(temp_file, content, [temp_file, cache_file, size](int result) {
+		if (result != size)
+		{
+			NS_EXTENSION::DeleteFile(temp_file);
+			return;
+		}
+		NS_EXTENSION::AsyncMoveFile(temp_file, cache_file, [temp_file](bool moved) {
+			if (!moved)
+				NS_EXTENSION::DeleteFile(temp_file);
+		});
+	});
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,85 @@
+#ifndef __BASE_EXTENSION_NETWORK_ADDRESS_SELECTOR_H__
+#define __BASE_EXTENSION_NETWORK_ADDRESS_SELECTOR_H__
+
+#include "extension/extension_export.h"
+#include "extension/config/build_config.h"
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include "extension/strings/unicode.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct AddressStats
+{
+	AddressStats() : rtt_ms(-1), samples(0), failures(0), last_failure_time(0), last_used_time(0) {}
+
+	int rtt_ms;					// 握手耗时的指数加权平均，-1 为没有成功过
+	int samples;
+	int failures;				// 连续失败次数，成功一次清零
+	int64_t last_failure_time;	// time_t，秒
+	int64_t last_used_time;
+};
+
+// 目的地址选择
+// 解析出的地址原样使用的是 getaddrinfo 的顺序，多个任播、分区域的地址时经常先连到慢的那个。
+// 这里按 RFC 6724 的目的地址规则排序，再结合每个地址的连接历史：
+//   1. 最近连接失败的地址排到最后，按连续失败次数退避（30 秒起翻倍，最多 30 分钟），退避结束前先试其他地址
+//   2. 成功连接过的地址按平滑后的握手耗时从快到慢
+//   3. 没有历史的地址按 RFC 6724 的规则 6（策略表优先级）和规则 8（范围小的优先），其余保持原顺序
+// 规则 1~5、7 需要知道源地址，这里不做，交给 Happy Eyeballs 竞速兜底。
+// google_net 的 TcpClientImpl 和 nim_http 在连接完成时上报结果；网络切换时由 NimNetworkTransition
+// 调用 OnNetworkChanged，旧网络上的失败不再作数，RTT 保留作为参考，由新样本逐渐覆盖。
+// 调用 Start 后历史保存在文件中，下次启动时读回，有变化时至多每 kSaveIntervalSeconds 异步写一次。
+// 线程安全；该单例刻意不析构，传输线程退出前仍可能上报。
+class EXTENSION_EXPORT AddressSelector
+{
+public:
+	static AddressSelector* GetInstance();
+
+	// 只有第一次调用有效；读入 cache_file 中保存的历史，cache_file 为空时不持久化
+	void Start(const UTF8String &cache_file);
+	// ip 为 IP 字面量，不是 IP 的忽略
+	void ReportSuccess(const std::string& ip, int rtt_ms);
+	void ReportFailure(const std::string& ip);
+
+	// 按上面的规则排序，排序是稳定的
+	void Sort(std::list<std::string>& ip_list);
+	// 是否处在失败后的退避期内
+	bool IsBackedOff(const std::string& ip);
+	bool GetStats(const std::string& ip, AddressStats* stats);
+
+	void OnNetworkChanged();
+	// 有变化时同步写回文件，用于退出前
+	void Flush();
+	void Clear();
+
+private:
+	static const size_t kMaxEntries = 256;
+	static const int kSaveIntervalSeconds = 60;
+
+	AddressSelector();
+
+	AddressStats& GetEntryLocked(const std::string& ip, int64_t now);
+	int64_t BackoffEndLocked(const AddressStats& stats) const;
+	// 超过 kMaxEntries 时淘汰最久没用的
+	void TrimLocked();
+	bool LoadLocked();
+	std::string SerializeLocked() const;
+	// 有变化且距上次写入超过 kSaveIntervalSeconds 时异步写文件，调用前不能持锁
+	void MaybeSave(bool force);
+
+private:
+	std::mutex lock_;
+	std::map<std::string, AddressStats> entries_;
+	bool started_;
+	UTF8String cache_file_;
+	bool dirty_;
+	int64_t last_save_time_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_NETWORK_ADDRESS_SELECTOR_H__
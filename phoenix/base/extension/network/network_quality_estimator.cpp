@@ -0,0 +1,264 @@
+#include "extension/network/network_quality_estimator.h"
+#include <algorithm>
+#include <vector>
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 新样本的权重，约 8 个样本后旧值的影响降到 10% 以下
+const double kAverageWeight = 0.25;
+// 建连超时不低于此值，给 SYN 丢包后 1 秒的重传留出余地
+const long kMinConnectTimeoutMs = 3000;
+// 建连超时取握手耗时 P95 的倍数
+const int kConnectTimeoutRTTs = 4;
+
+// Chromium NQE 的默认阈值，RTT 不低于或吞吐不高于阈值即为该类型，从慢到快依次判断
+struct TypeThreshold
+{
+	EffectiveConnectionType type;
+	int http_rtt_ms;
+	int transport_rtt_ms;
+	int downstream_kbps;
+};
+const TypeThreshold kTypeThresholds[] = {
+	{ kEffectiveConnectionTypeSlow2G, 2010, 1870, 40 },
+	{ kEffectiveConnectionType2G, 1420, 1280, 75 },
+	{ kEffectiveConnectionType3G, 272, 204, 400 },
+};
+
+void AddHostSample(std::deque<int>& samples, int sample, size_t max_samples)
+{
+	samples.push_back(sample);
+	if (samples.size() > max_samples)
+		samples.pop_front();
+}
+}
+
+void NetworkQualityEstimator::Average::Add(double sample)
+{
+	value = count == 0 ? sample : value + (sample - value) * kAverageWeight;
+	count++;
+}
+
+NetworkQualityEstimator* NetworkQualityEstimator::GetInstance()
+{
+	static NetworkQualityEstimator *instance = new NetworkQualityEstimator;
+	return instance;
+}
+
+NetworkQualityEstimator::NetworkQualityEstimator() :
+	offline_(false),
+	type_(kEffectiveConnectionTypeUnknown),
+	next_index_(0)
+{
+}
+
+void NetworkQualityEstimator::AddHttpSample(const std::string& host, int http_rtt_ms, int64_t bytes, int transfer_ms)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		offline_ = false;
+		if (http_rtt_ms >= 0)
+		{
+			http_rtt_.Add(http_rtt_ms);
+			if (!host.empty())
+				AddHostSample(GetHostLocked(host).http_rtt, http_rtt_ms, kMaxHostSamples);
+		}
+		if (bytes >= kMinThroughputBytes && transfer_ms > 0)
+			downstream_kbps_.Add(bytes * 8.0 / transfer_ms);
+	}
+	UpdateType();
+}
+
+void NetworkQualityEstimator::AddTransportRTT(const std::string& host, int rtt_ms)
+{
+	if (rtt_ms < 0)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		offline_ = false;
+		transport_rtt_.Add(rtt_ms);
+		if (!host.empty())
+			AddHostSample(GetHostLocked(host).transport_rtt, rtt_ms, kMaxHostSamples);
+	}
+	UpdateType();
+}
+
+void NetworkQualityEstimator::Reset(bool offline/* = false*/)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		http_rtt_ = Average();
+		transport_rtt_ = Average();
+		downstream_kbps_ = Average();
+		hosts_.clear();
+		offline_ = offline;
+	}
+	UpdateType();
+}
+
+NetworkQualityEstimate NetworkQualityEstimator::GetEstimate()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	NetworkQualityEstimate estimate;
+	estimate.type = type_;
+	estimate.http_rtt_ms = http_rtt_.Get();
+	estimate.transport_rtt_ms = transport_rtt_.Get();
+	estimate.downstream_kbps = downstream_kbps_.Get();
+	return estimate;
+}
+
+EffectiveConnectionType NetworkQualityEstimator::GetEffectiveConnectionType()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return type_;
+}
+
+bool NetworkQualityEstimator::GetHostRTT(const std::string& host, int percentile, bool http, int* rtt_ms)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = hosts_.find(host);
+	if (it == hosts_.end())
+		return false;
+	const std::deque<int>& samples = http ? it->second.http_rtt : it->second.transport_rtt;
+	if (samples.empty())
+		return false;
+	std::vector<int> sorted(samples.begin(), samples.end());
+	size_t index = (sorted.size() - 1) * (size_t)std::min(std::max(percentile, 0), 100) / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	*rtt_ms = sorted[index];
+	return true;
+}
+
+long NetworkQualityEstimator::TuneTimeout(long timeout_ms)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return (long)(timeout_ms * FactorLocked(4, 3, 1.5, 1));
+}
+
+long NetworkQualityEstimator::TuneLowSpeedTime(long low_speed_time)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return std::max(1L, (long)(low_speed_time * FactorLocked(3, 2, 1, 0.5)));
+}
+
+long NetworkQualityEstimator::TuneConnectTimeout(const std::string& host, long timeout_ms)
+{
+	long tuned = 0;
+	bool known = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		tuned = (long)(timeout_ms * FactorLocked(3, 2, 1.5, 1));
+		known = type_ != kEffectiveConnectionTypeUnknown && type_ != kEffectiveConnectionTypeOffline;
+	}
+	int rtt_ms = 0;
+	if (known && GetHostRTT(host, 95, false, &rtt_ms))
+		tuned = std::min(tuned, std::max(kMinConnectTimeoutMs, (long)rtt_ms * kConnectTimeoutRTTs));
+	return tuned;
+}
+
+int NetworkQualityEstimator::TuneMaxHostConnections(int max_host_connections)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	int limit = 0;
+	if (type_ == kEffectiveConnectionTypeSlow2G || type_ == kEffectiveConnectionType2G)
+		limit = 2;
+	else if (type_ == kEffectiveConnectionType3G)
+		limit = 4;
+	//0 为不限制
+	if (limit == 0 || (max_host_connections > 0 && max_host_connections < limit))
+		return max_host_connections;
+	return limit;
+}
+
+int NetworkQualityEstimator::TuneHeartbeatInterval(int interval)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return (int)(interval * FactorLocked(2, 1.5, 1, 1));
+}
+
+int NetworkQualityEstimator::AttachTypeChanged(const TypeChangedCallback& callback)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	callbacks_[++next_index_] = callback;
+	return next_index_;
+}
+
+void NetworkQualityEstimator::DetachTypeChanged(int index)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	callbacks_.erase(index);
+}
+
+NetworkQualityEstimator::HostSamples& NetworkQualityEstimator::GetHostLocked(const std::string& host)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto it = hosts_.find(host);
+	if (it == hosts_.end() && hosts_.size() >= kMaxHosts)
+	{
+		//淘汰最久没有样本的 host
+		auto oldest = std::min_element(hosts_.begin(), hosts_.end(), [](const std::pair<const std::string, HostSamples>& left, const std::pair<const std::string, HostSamples>& right) {
+			return left.second.last_used < right.second.last_used;
+		});
+		hosts_.erase(oldest);
+	}
+	HostSamples& samples = hosts_[host];
+	samples.last_used = now;
+	return samples;
+}
+
+EffectiveConnectionType NetworkQualityEstimator::ComputeTypeLocked() const
+{
+	if (offline_)
+		return kEffectiveConnectionTypeOffline;
+	bool http_rtt = http_rtt_.count >= kMinSamples;
+	bool transport_rtt = transport_rtt_.count >= kMinSamples;
+	bool downstream = downstream_kbps_.count >= kMinSamples;
+	if (!http_rtt && !transport_rtt)
+		return kEffectiveConnectionTypeUnknown;
+	for (auto& threshold : kTypeThresholds)
+	{
+		if ((http_rtt && http_rtt_.value >= threshold.http_rtt_ms) ||
+			(transport_rtt && transport_rtt_.value >= threshold.transport_rtt_ms) ||
+			(downstream && downstream_kbps_.value <= threshold.downstream_kbps))
+			return threshold.type;
+	}
+	return kEffectiveConnectionType4G;
+}
+
+void NetworkQualityEstimator::UpdateType()
+{
+	std::vector<TypeChangedCallback> callbacks;
+	EffectiveConnectionType type = kEffectiveConnectionTypeUnknown;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		type = ComputeTypeLocked();
+		if (type == type_)
+			return;
+		type_ = type;
+		for (auto& it : callbacks_)
+			callbacks.push_back(it.second);
+	}
+	for (auto& callback : callbacks)
+		callback(type);
+}
+
+double NetworkQualityEstimator::FactorLocked(double slow2g, double g2, double g3, double g4) const
+{
+	switch (type_)
+	{
+	case kEffectiveConnectionTypeSlow2G:
+		return slow2g;
+	case kEffectiveConnectionType2G:
+		return g2;
+	case kEffectiveConnectionType3G:
+		return g3;
+	case kEffectiveConnectionType4G:
+		return g4;
+	default:
+		return 1;
+	}
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,130 @@
+#ifndef __BASE_EXTENSION_NETWORK_QUALITY_ESTIMATOR_H__
+#define __BASE_EXTENSION_NETWORK_QUALITY_ESTIMATOR_H__
+
+#include "extension/extension_export.h"
+#include "extension/config/build_config.h"
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+EXTENSION_BEGIN_DECLS
+
+// 有效连接类型，取值与 Chromium NQE 的 EffectiveConnectionType 一致：
+// 按 RTT 和下行吞吐折算成“相当于哪种网络”，Wi-Fi 信号差时也可能是 kEffectiveConnectionType2G
+enum EffectiveConnectionType
+{
+	kEffectiveConnectionTypeUnknown = 0,	// 样本不足
+	kEffectiveConnectionTypeOffline,
+	kEffectiveConnectionTypeSlow2G,
+	kEffectiveConnectionType2G,
+	kEffectiveConnectionType3G,
+	kEffectiveConnectionType4G,
+};
+
+struct NetworkQualityEstimate
+{
+	NetworkQualityEstimate() :
+		type(kEffectiveConnectionTypeUnknown),
+		http_rtt_ms(-1),
+		transport_rtt_ms(-1),
+		downstream_kbps(-1)
+	{
+	}
+
+	EffectiveConnectionType type;
+	int http_rtt_ms;			// 请求发出到收到首字节，含服务端处理时间，-1 为未知
+	int transport_rtt_ms;		// TCP 握手耗时，-1 为未知
+	int downstream_kbps;		// 下行吞吐，-1 为未知
+};
+
+// 网络质量估计
+// nim_http 每个请求完成时上报 HTTP RTT 和吞吐，google_net 的 TcpClientImpl 上报 TCP 握手耗时；
+// 全局的 RTT、吞吐按指数加权平均，每个 host 另外保留最近 kMaxHostSamples 个 RTT 用于求分位数。
+// Tune* 根据有效连接类型调整调用方配置的超时、并发和心跳间隔，慢网放宽、快网收紧，
+// 样本不足（kEffectiveConnectionTypeUnknown）时原样返回。
+// 网络切换后旧的样本不再有参考价值，由 google_net 的 NimNetworkTransition 调用 Reset。
+// 线程安全；该单例刻意不析构，传输线程退出前仍可能上报。
+class EXTENSION_EXPORT NetworkQualityEstimator
+{
+public:
+	typedef std::function<void(EffectiveConnectionType type)> TypeChangedCallback;
+
+	static NetworkQualityEstimator* GetInstance();
+
+	// http_rtt_ms 小于 0 时只记吞吐；bytes 不足 kMinThroughputBytes 的响应不计吞吐，慢启动阶段测不准
+	void AddHttpSample(const std::string& host, int http_rtt_ms, int64_t bytes, int transfer_ms);
+	void AddTransportRTT(const std::string& host, int rtt_ms);
+	// 清空样本，offline 为 true 时有效连接类型为 kEffectiveConnectionTypeOffline，直到收到新样本
+	void Reset(bool offline = false);
+
+	NetworkQualityEstimate GetEstimate();
+	EffectiveConnectionType GetEffectiveConnectionType();
+	// percentile 取 0~100，http 为 false 时取 TCP 握手耗时；该 host 没有样本时返回 false
+	bool GetHostRTT(const std::string& host, int percentile, bool http, int* rtt_ms);
+
+	// 请求总超时，让慢网上的请求有足够的时间，只放宽不收紧（大文件下载的耗时与网络质量无关）
+	long TuneTimeout(long timeout_ms);
+	// 低速判定时间（CURLOPT_LOW_SPEED_TIME），单位秒
+	long TuneLowSpeedTime(long low_speed_time);
+	// 建连超时，取该 host 握手耗时的 P95 的若干倍，没有样本时按有效连接类型缩放 timeout_ms
+	long TuneConnectTimeout(const std::string& host, long timeout_ms);
+	// 单 host 并发连接数，慢网上并发只会互相抢带宽
+	int TuneMaxHostConnections(int max_host_connections);
+	// 长连接心跳间隔，慢网上拉长以减少唤醒射频的次数，单位由调用方决定
+	int TuneHeartbeatInterval(int interval);
+
+	// 有效连接类型变化时在上报样本的线程上回调，返回值用于 DetachTypeChanged
+	int AttachTypeChanged(const TypeChangedCallback& callback);
+	void DetachTypeChanged(int index);
+
+private:
+	// 有效连接类型判定前至少需要的样本数
+	static const int kMinSamples = 3;
+	static const size_t kMaxHostSamples = 32;
+	static const size_t kMaxHosts = 64;
+	static const int64_t kMinThroughputBytes = 32 * 1024;
+
+	struct Average
+	{
+		Average() : value(0), count(0) {}
+		void Add(double sample);
+		int Get() const { return count > 0 ? (int)value : -1; }
+
+		double value;
+		int count;
+	};
+	struct HostSamples
+	{
+		std::deque<int> http_rtt;
+		std::deque<int> transport_rtt;
+		std::chrono::steady_clock::time_point last_used;
+	};
+
+	NetworkQualityEstimator();
+
+	HostSamples& GetHostLocked(const std::string& host);
+	EffectiveConnectionType ComputeTypeLocked() const;
+	// 重新计算有效连接类型，有变化时回调，调用前不能持锁
+	void UpdateType();
+	// 各有效连接类型对应的放宽倍数，快网小于 1
+	double FactorLocked(double slow2g, double g2, double g3, double g4) const;
+
+private:
+	std::mutex lock_;
+	Average http_rtt_;
+	Average transport_rtt_;
+	Average downstream_kbps_;
+	std::map<std::string, HostSamples> hosts_;
+	bool offline_;
+	EffectiveConnectionType type_;
+	std::map<int, TypeChangedCallback> callbacks_;
+	int next_index_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_NETWORK_QUALITY_ESTIMATOR_H__
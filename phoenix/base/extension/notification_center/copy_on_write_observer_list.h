@@ -0,0 +1,160 @@
+// an observer list whose notifications iterate an immutable snapshot and never wait for registration
+
+#ifndef __BASE_EXTENSION_COPY_ON_WRITE_OBSERVER_LIST_H__
+#define __BASE_EXTENSION_COPY_ON_WRITE_OBSERVER_LIST_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "base/macros.h"
+
+#include "extension/callback/post_task.h"
+#include "extension/synchronization/adaptive_lock.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 写时复制的观察者列表：Add/Remove 在锁内复制一份新列表后原子地替换指针，
+// Notify 只原子地取一次当前列表的 shared_ptr 再遍历，不加锁，也不会被同时进行的注册、注销阻塞；
+// 回调中注册或注销观察者（包括注销自己）都是安全的，只影响之后的通知。
+// 添加时可以指定 ThreadManager 的线程 identifier，通知时投递到该线程执行，
+// 处理慢的观察者不会拖慢其他观察者；不指定时在 Notify 的线程上依次同步调用。
+//   list_.AddObserver(this, kThreadUI);
+//   list_.Notify(&Observer::OnSomething, value);	// 参数按值保存，投递的参数在执行时仍然有效
+// 注销后已投递但还没执行的通知不再调用；指定了线程的观察者应在该线程上注销，之后即可安全析构。
+// 同步调用的观察者注销时，其他线程上正在进行的 Notify 可能仍在调用它，需要调用方自己保证这种情况下的生命周期
+template <typename ObserverType>
+class CopyOnWriteObserverList
+{
+public:
+	// 在 Notify 的线程上同步调用
+	static const int64_t kDeliverInline = -1;
+
+	CopyOnWriteObserverList() {}
+
+	// 已经添加过时返回 false，不改变原来的投递线程
+	bool AddObserver(ObserverType *observer, int64_t thread_identifier = kDeliverInline)
+	{
+		if (observer == nullptr)
+			return false;
+		AdaptiveAutoLock guard(&write_lock_);
+		std::shared_ptr<const Entries> current = std::atomic_load(&entries_);
+		std::shared_ptr<Entries> entries = current ? std::make_shared<Entries>(*current) : std::make_shared<Entries>();
+		for (const Entry &entry : *entries)
+		{
+			if (entry.observer == observer)
+				return false;
+		}
+		Entry entry;
+		entry.observer = observer;
+		entry.thread_identifier = thread_identifier;
+		entry.alive = std::make_shared<std::atomic<bool>>(true);
+		entries->push_back(std::move(entry));
+		std::atomic_store(&entries_, std::shared_ptr<const Entries>(std::move(entries)));
+		return true;
+	}
+
+	bool RemoveObserver(ObserverType *observer)
+	{
+		AdaptiveAutoLock guard(&write_lock_);
+		std::shared_ptr<const Entries> current = std::atomic_load(&entries_);
+		if (!current)
+			return false;
+		std::shared_ptr<Entries> entries = std::make_shared<Entries>();
+		entries->reserve(current->size());
+		bool found = false;
+		for (const Entry &entry : *current)
+		{
+			if (entry.observer == observer)
+			{
+				entry.alive->store(false, std::memory_order_release);
+				found = true;
+				continue;
+			}
+			entries->push_back(entry);
+		}
+		if (found)
+			std::atomic_store(&entries_, std::shared_ptr<const Entries>(std::move(entries)));
+		return found;
+	}
+
+	bool HasObserver(ObserverType *observer) const
+	{
+		std::shared_ptr<const Entries> entries = std::atomic_load(&entries_);
+		if (!entries)
+			return false;
+		for (const Entry &entry : *entries)
+		{
+			if (entry.observer == observer)
+				return true;
+		}
+		return false;
+	}
+
+	size_t size() const
+	{
+		std::shared_ptr<const Entries> entries = std::atomic_load(&entries_);
+		return entries ? entries->size() : 0;
+	}
+
+	void Clear()
+	{
+		AdaptiveAutoLock guard(&write_lock_);
+		std::shared_ptr<const Entries> current = std::atomic_load(&entries_);
+		if (!current)
+			return;
+		for (const Entry &entry : *current)
+			entry.alive->store(false, std::memory_order_release);
+		std::atomic_store(&entries_, std::shared_ptr<const Entries>());
+	}
+
+	// 对每个观察者调用 (observer->*method)(args...)
+	template <typename Method, typename... Args>
+	void Notify(Method method, const Args&... args) const
+	{
+		std::shared_ptr<const Entries> entries = std::atomic_load(&entries_);
+		if (!entries)
+			return;
+		for (const Entry &entry : *entries)
+		{
+			if (entry.thread_identifier == kDeliverInline)
+			{
+				if (entry.alive->load(std::memory_order_acquire))
+					(entry.observer->*method)(args...);
+				continue;
+			}
+			ObserverType *observer = entry.observer;
+			std::shared_ptr<std::atomic<bool>> alive = entry.alive;
+			//目标线程已经退出时投递失败，直接丢弃这次通知
+			PostTask(entry.thread_identifier, [observer, alive, method, args...]() {
+				if (alive->load(std::memory_order_acquire))
+					(observer->*method)(args...);
+			});
+		}
+	}
+
+private:
+	struct Entry
+	{
+		ObserverType *observer;
+		int64_t thread_identifier;
+		// 注销时置为 false，已经取到旧列表的 Notify 和已经投递的通知据此跳过
+		std::shared_ptr<std::atomic<bool>> alive;
+	};
+	typedef std::vector<Entry> Entries;
+
+	AdaptiveLock write_lock_;	// 只在 Add/Remove/Clear 之间互斥
+	// 只通过 std::atomic_load / std::atomic_store 访问
+	std::shared_ptr<const Entries> entries_;
+
+	DISALLOW_COPY_AND_ASSIGN(CopyOnWriteObserverList);
+};
+
+template <typename ObserverType>
+const int64_t CopyOnWriteObserverList<ObserverType>::kDeliverInline;
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_COPY_ON_WRITE_OBSERVER_LIST_H__
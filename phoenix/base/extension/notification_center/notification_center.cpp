@@ -20,14 +20,12 @@ NotificaionCenter::~NotificaionCenter()
         source_->Shutdown();
     }
 }
-void NotificaionCenter::AddObserver(NotificaionObserver* observer)
+void NotificaionCenter::AddObserver(NotificaionObserver* observer, int64_t thread_identifier)
 {
-    NS_EXTENSION::NAutoLock lock(&lock_);
-    observers_.AddObserver(observer);
+    observers_.AddObserver(observer, thread_identifier);
 }
 void NotificaionCenter::RemoveObserver(NotificaionObserver* observer)
 {
-    NS_EXTENSION::NAutoLock lock(&lock_);
     observers_.RemoveObserver(observer);
 }
 std::shared_ptr<NotificationSource> NotificaionCenter::Source()
@@ -36,19 +34,11 @@ std::shared_ptr<NotificationSource> NotificaionCenter::Source()
 }
 void NotificaionCenter::notifyEnterBackground()
 {
-//    for (const auto& obs : observers_) {
-//        obs.enterBackground();
-//    }
-    
-    FOR_EACH_OBSERVER(NotificaionObserver, observers_, enterBackground());
+    observers_.Notify(&NotificaionObserver::enterBackground);
 }
 void NotificaionCenter::notifyEnterForeground()
 {
-//    for (auto& obs : observers_) {
-//        obs.enterForeground();
-//    }
-//    observers_->Notify(FROM_HERE, &NotificaionObserver::enterForeground);
-    FOR_EACH_OBSERVER(NotificaionObserver, observers_, enterForeground());
+    observers_.Notify(&NotificaionObserver::enterForeground);
 }
 
 EXTENSION_END_DECLS
@@ -10,10 +10,9 @@
 
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
-#include "extension/synchronization/lock.h"
+#include "extension/notification_center/copy_on_write_observer_list.h"
 #include "extension/memory/singleton.h"
 #include "base/memory/ref_counted.h"
-#include "base/observer_list_threadsafe.h"
 
 EXTENSION_BEGIN_DECLS
 
@@ -34,7 +33,10 @@ class EXTENSION_EXPORT NotificaionCenter : public NS_EXTENSION::Singleton<Notifi
 public:
     NotificaionCenter();
     ~NotificaionCenter();
-    void AddObserver(NotificaionObserver* observer);
+    // thread_identifier 为 ThreadManager 的线程 identifier 时通知投递到该线程执行，并应在该线程上 RemoveObserver；
+    // 默认在 NotificationSource 发出通知的线程上同步调用
+    void AddObserver(NotificaionObserver* observer,
+                     int64_t thread_identifier = CopyOnWriteObserverList<NotificaionObserver>::kDeliverInline);
     void RemoveObserver(NotificaionObserver* observer);
     
     
@@ -45,8 +47,7 @@ protected:
     void notifyEnterForeground();
     
 private:
-    NS_EXTENSION::NLock lock_;
-    base::ObserverList<NotificaionObserver> observers_;
+    CopyOnWriteObserverList<NotificaionObserver> observers_;
     std::shared_ptr<NotificationSource> source_;
 };
 
@@ -27,7 +27,7 @@ void NotificationSource::PlatformInit()
 }
 void NotificationSource::Shutdown()
 {
-    NS_EXTENSION::NAutoLock lock(&lock_);
+    NS_EXTENSION::AdaptiveAutoLock lock(&lock_);
     if (is_shutdown_) {
         return;
     }
@@ -10,7 +10,7 @@
 
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
-#include "extension/synchronization/lock.h"
+#include "extension/synchronization/adaptive_lock.h"
 
 #include <vector>
 
@@ -36,7 +36,7 @@ protected:
     void PlatfomDestroyForMac();
 #endif
 private:
-    NS_EXTENSION::NLock lock_;
+    NS_EXTENSION::AdaptiveLock lock_;
     bool is_shutdown_;
 #if defined(OS_MACOSX)
     std::vector<id> notification_observers_;
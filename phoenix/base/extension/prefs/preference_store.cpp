@@ -0,0 +1,340 @@
+#include "extension/prefs/preference_store.h"
+#include <algorithm>
+#include "base/hash.h"
+#include "base/pickle.h"
+#include "base/strings/string_number_conversions.h"
+
+#include "extension/file_util/utf8_file_util.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 格式有变化时加一，旧文件直接丢弃
+const uint32_t kFormatVersion = 1;
+const size_t kChecksumSize = sizeof(uint32_t);
+const char kFileExtension[] = ".prefs";
+}
+
+PreferenceStore::PreferenceStore(const UTF8String &directory, const PreferenceStoreOptions &options)
+	: directory_(NS_EXTENSION::FilePathAsEndWithSeparator(directory))
+	, options_(options)
+	, stopping_(false)
+	, write_count_(0)
+	, write_failure_count_(0)
+{
+	if (options_.max_delay_ms < options_.debounce_ms)
+		options_.max_delay_ms = options_.debounce_ms;
+	writer_ = std::thread([this]() { WriterThread(); });
+}
+
+PreferenceStore::~PreferenceStore()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		stopping_ = true;
+	}
+	wakeup_cv_.notify_all();
+	writer_.join();
+	WriteDue(true);
+}
+
+bool PreferenceStore::GetString(const std::string &file, const std::string &key, std::string *value)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	PrefFile &pref_file = GetFileLocked(file);
+	auto it = pref_file.values.find(key);
+	if (it == pref_file.values.end())
+		return false;
+	if (value != nullptr)
+		*value = it->second;
+	return true;
+}
+
+std::string PreferenceStore::GetString(const std::string &file, const std::string &key, const std::string &default_value)
+{
+	std::string value;
+	return GetString(file, key, &value) ? value : default_value;
+}
+
+int64_t PreferenceStore::GetInt64(const std::string &file, const std::string &key, int64_t default_value)
+{
+	std::string value;
+	int64_t result = 0;
+	if (!GetString(file, key, &value) || !base::StringToInt64(value, &result))
+		return default_value;
+	return result;
+}
+
+bool PreferenceStore::GetBool(const std::string &file, const std::string &key, bool default_value)
+{
+	std::string value;
+	if (!GetString(file, key, &value))
+		return default_value;
+	if (value == "1")
+		return true;
+	if (value == "0")
+		return false;
+	return default_value;
+}
+
+bool PreferenceStore::HasKey(const std::string &file, const std::string &key)
+{
+	return GetString(file, key, nullptr);
+}
+
+std::vector<std::string> PreferenceStore::GetKeys(const std::string &file)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	PrefFile &pref_file = GetFileLocked(file);
+	std::vector<std::string> keys;
+	keys.reserve(pref_file.values.size());
+	for (auto &item : pref_file.values)
+		keys.push_back(item.first);
+	return keys;
+}
+
+void PreferenceStore::SetString(const std::string &file, const std::string &key, const std::string &value)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	PrefFile &pref_file = GetFileLocked(file);
+	auto it = pref_file.values.find(key);
+	if (it != pref_file.values.end())
+	{
+		if (it->second == value)
+			return;
+		it->second = value;
+	}
+	else
+	{
+		pref_file.values.emplace(key, value);
+	}
+	MarkDirtyLocked(pref_file);
+}
+
+void PreferenceStore::SetInt64(const std::string &file, const std::string &key, int64_t value)
+{
+	SetString(file, key, base::Int64ToString(value));
+}
+
+void PreferenceStore::SetBool(const std::string &file, const std::string &key, bool value)
+{
+	SetString(file, key, value ? "1" : "0");
+}
+
+void PreferenceStore::Remove(const std::string &file, const std::string &key)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	PrefFile &pref_file = GetFileLocked(file);
+	if (pref_file.values.erase(key) > 0)
+		MarkDirtyLocked(pref_file);
+}
+
+void PreferenceStore::Clear(const std::string &file)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	PrefFile &pref_file = GetFileLocked(file);
+	if (pref_file.values.empty())
+		return;
+	pref_file.values.clear();
+	MarkDirtyLocked(pref_file);
+}
+
+void PreferenceStore::Flush()
+{
+	WriteDue(true);
+}
+
+bool PreferenceStore::HasPendingWrites()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	for (auto &item : files_)
+	{
+		if (item.second->dirty)
+			return true;
+	}
+	return false;
+}
+
+uint64_t PreferenceStore::write_count()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return write_count_;
+}
+
+uint64_t PreferenceStore::write_failure_count()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return write_failure_count_;
+}
+
+PreferenceStore::PrefFile& PreferenceStore::GetFileLocked(const std::string &file)
+{
+	auto it = files_.find(file);
+	if (it != files_.end())
+		return *it->second;
+	std::unique_ptr<PrefFile> pref_file(new PrefFile);
+	//设置文件都很小，持锁同步读入，避免同一个文件被读两次
+	if (!Load(file, pref_file->values))
+		pref_file->values.clear();
+	return *files_.emplace(file, std::move(pref_file)).first->second;
+}
+
+void PreferenceStore::MarkDirtyLocked(PrefFile &pref_file)
+{
+	auto now = Clock::now();
+	pref_file.last_change = now;
+	if (pref_file.dirty)
+		return;
+	//继续修改只会推迟写入时间，只有变脏时需要唤醒后台线程重新计算
+	pref_file.dirty = true;
+	pref_file.first_change = now;
+	wakeup_cv_.notify_one();
+}
+
+PreferenceStore::Clock::time_point PreferenceStore::DeadlineLocked(const PrefFile &pref_file) const
+{
+	return std::min(pref_file.last_change + std::chrono::milliseconds(options_.debounce_ms),
+		pref_file.first_change + std::chrono::milliseconds(options_.max_delay_ms));
+}
+
+UTF8String PreferenceStore::FilePath(const std::string &file) const
+{
+	return directory_ + file + kFileExtension;
+}
+
+bool PreferenceStore::Load(const std::string &file, std::map<std::string, std::string> &values)
+{
+	std::string content;
+	if (!NS_EXTENSION::ReadFileToString(FilePath(file), content) || content.size() <= kChecksumSize)
+		return false;
+	size_t payload_size = content.size() - kChecksumSize;
+	const uint8_t *p = (const uint8_t *)content.data() + payload_size;
+	uint32_t checksum = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	if (checksum != base::Hash(content.data(), payload_size))
+		return false;
+
+	base::Pickle pickle(content.data(), (int)payload_size);
+	base::PickleIterator iter(pickle);
+	uint32_t version = 0;
+	uint32_t count = 0;
+	if (!iter.ReadUInt32(&version) || version != kFormatVersion || !iter.ReadUInt32(&count))
+		return false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		std::string key, value;
+		if (!iter.ReadString(&key) || !iter.ReadString(&value))
+			return false;
+		values[key] = value;
+	}
+	return true;
+}
+
+void PreferenceStore::WriteDue(bool force)
+{
+	//持 write_lock_ 取快照和写入，Flush 与后台线程同时写同一个文件时不会让旧的快照覆盖新的
+	std::lock_guard<std::mutex> write_guard(write_lock_);
+	std::vector<std::pair<std::string, std::map<std::string, std::string>>> snapshots;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto now = Clock::now();
+		for (auto &item : files_)
+		{
+			PrefFile &pref_file = *item.second;
+			if (!pref_file.dirty || (!force && DeadlineLocked(pref_file) > now))
+				continue;
+			pref_file.dirty = false;
+			snapshots.emplace_back(item.first, pref_file.values);
+		}
+	}
+	for (auto &snapshot : snapshots)
+	{
+		bool result = Write(snapshot.first, snapshot.second);
+		std::lock_guard<std::mutex> guard(lock_);
+		if (result)
+		{
+			write_count_++;
+			continue;
+		}
+		write_failure_count_++;
+		//写失败（磁盘满、目录被删）时间隔 max_delay_ms 重试，期间的修改一起写
+		PrefFile &pref_file = *files_[snapshot.first];
+		if (!pref_file.dirty)
+		{
+			auto now = Clock::now();
+			pref_file.dirty = true;
+			pref_file.first_change = now;
+			pref_file.last_change = now + std::chrono::milliseconds(options_.max_delay_ms - options_.debounce_ms);
+		}
+	}
+}
+
+bool PreferenceStore::Write(const std::string &file, const std::map<std::string, std::string> &values)
+{
+	UTF8String file_path = FilePath(file);
+	if (values.empty())
+	{
+		//清空的文件直接删掉，不用留一个空文件
+		NS_EXTENSION::DeleteFile(file_path);
+		return !NS_EXTENSION::FilePathIsExist(file_path, false);
+	}
+
+	base::Pickle pickle;
+	pickle.WriteUInt32(kFormatVersion);
+	pickle.WriteUInt32((uint32_t)values.size());
+	for (auto &item : values)
+	{
+		pickle.WriteString(item.first);
+		pickle.WriteString(item.second);
+	}
+	std::string content((const char *)pickle.data(), pickle.size());
+	uint32_t checksum = base::Hash(content);
+	char tail[kChecksumSize] = { (char)checksum, (char)(checksum >> 8), (char)(checksum >> 16), (char)(checksum >> 24) };
+	content.append(tail, sizeof(tail));
+
+	if (!NS_EXTENSION::FilePathIsExist(directory_, true))
+		NS_EXTENSION::CreateDirectory(directory_);
+	//先写临时文件再改名，进程中途退出也不会留下半个文件
+	UTF8String temp_file = file_path + ".tmp";
+	if (NS_EXTENSION::WriteFile(temp_file, content) != (int)content.size()
+		|| !NS_EXTENSION::MoveFile(temp_file, file_path))
+	{
+		NS_EXTENSION::DeleteFile(temp_file);
+		return false;
+	}
+	return true;
+}
+
+void PreferenceStore::WriterThread()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (!stopping_)
+	{
+		bool has_dirty = false;
+		Clock::time_point deadline;
+		for (auto &item : files_)
+		{
+			if (!item.second->dirty)
+				continue;
+			Clock::time_point file_deadline = DeadlineLocked(*item.second);
+			if (!has_dirty || file_deadline < deadline)
+				deadline = file_deadline;
+			has_dirty = true;
+		}
+		if (!has_dirty)
+		{
+			wakeup_cv_.wait(lock);
+			continue;
+		}
+		if (deadline > Clock::now())
+		{
+			wakeup_cv_.wait_until(lock, deadline);
+			continue;
+		}
+		lock.unlock();
+		WriteDue(false);
+		lock.lock();
+	}
+}
+
+EXTENSION_END_DECLS
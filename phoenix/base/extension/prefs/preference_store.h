@@ -0,0 +1,118 @@
+// key-value preferences split into small files, changes coalesced in memory and written in the background
+
+#ifndef __BASE_EXTENSION_PREFERENCE_STORE_H__
+#define __BASE_EXTENSION_PREFERENCE_STORE_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+#include "extension/strings/unicode.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct PreferenceStoreOptions
+{
+	PreferenceStoreOptions() : debounce_ms(1000), max_delay_ms(10000) {}
+
+	int debounce_ms;	// 最后一次修改后这么久没有新的修改才写文件
+	int max_delay_ms;	// 持续修改时，距第一次未保存的修改最多这么久也要写一次
+};
+
+// 偏好设置存储。base/prefs 的 JsonPrefStore 把所有设置放在一个 JSON 里，任何一项变化都要整个序列化、重写整个文件，
+// 已读回执、会话的已读位置这类频繁变化的设置会让文件不停地被重写。这里：
+//   1. 设置按调用方指定的文件名分成多个小文件，一个文件的变化只重写这个文件
+//   2. 修改只改内存，同一个文件在 debounce_ms 内的多次修改合并成一次写入，持续修改时最晚 max_delay_ms 写一次
+//   3. 在存储自己的后台线程上写临时文件后改名替换，中途退出不会留下半个文件；文件带校验和，损坏时按空文件处理
+//   PreferenceStore store(user_data_dir + "prefs/");
+//   store.SetInt64("receipts", session_id, msg_time);
+//   int64_t last = store.GetInt64("receipts", session_id, 0);
+// 值统一以字符串保存，GetInt64 等按需转换。文件在第一次访问时同步读入。
+// 析构时同步写出所有未保存的修改；线程安全
+class EXTENSION_EXPORT PreferenceStore
+{
+public:
+	// directory 不存在时在第一次写文件时创建
+	explicit PreferenceStore(const UTF8String &directory, const PreferenceStoreOptions &options = PreferenceStoreOptions());
+	~PreferenceStore();
+
+	// file 为文件名，不含路径和扩展名，保存在 directory/file.prefs
+	bool GetString(const std::string &file, const std::string &key, std::string *value);
+	std::string GetString(const std::string &file, const std::string &key, const std::string &default_value);
+	int64_t GetInt64(const std::string &file, const std::string &key, int64_t default_value);
+	bool GetBool(const std::string &file, const std::string &key, bool default_value);
+	bool HasKey(const std::string &file, const std::string &key);
+	std::vector<std::string> GetKeys(const std::string &file);
+
+	// 值没有变化时不会触发写入
+	void SetString(const std::string &file, const std::string &key, const std::string &value);
+	void SetInt64(const std::string &file, const std::string &key, int64_t value);
+	void SetBool(const std::string &file, const std::string &key, bool value);
+	void Remove(const std::string &file, const std::string &key);
+	// 清空一个文件中的所有设置
+	void Clear(const std::string &file);
+
+	// 在调用线程上同步写出所有未保存的修改，用于退出或切换账号前
+	void Flush();
+	// 是否有未保存的修改
+	bool HasPendingWrites();
+	// 写文件成功、失败的次数，用于测试与统计
+	uint64_t write_count();
+	uint64_t write_failure_count();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct PrefFile
+	{
+		PrefFile() : dirty(false) {}
+
+		std::map<std::string, std::string> values;
+		bool dirty;
+		Clock::time_point first_change;
+		Clock::time_point last_change;
+	};
+
+	// 调用前需持有 lock_；文件第一次访问时读入
+	PrefFile& GetFileLocked(const std::string &file);
+	void MarkDirtyLocked(PrefFile &pref_file);
+	// 该文件应当写入的时间
+	Clock::time_point DeadlineLocked(const PrefFile &pref_file) const;
+	UTF8String FilePath(const std::string &file) const;
+	bool Load(const std::string &file, std::map<std::string, std::string> &values);
+	// 写出已经到期（force 为 true 时为所有）的脏文件，调用前不能持有 lock_
+	void WriteDue(bool force);
+	bool Write(const std::string &file, const std::map<std::string, std::string> &values);
+	void WriterThread();
+
+private:
+	const UTF8String directory_;
+	PreferenceStoreOptions options_;
+
+	std::mutex lock_;
+	std::condition_variable wakeup_cv_;
+	std::map<std::string, std::unique_ptr<PrefFile>> files_;
+	bool stopping_;
+	uint64_t write_count_;
+	uint64_t write_failure_count_;
+
+	// 写文件的过程串行化，保证同一个文件后取的快照后写
+	std::mutex write_lock_;
+	std::thread writer_;
+
+	DISALLOW_COPY_AND_ASSIGN(PreferenceStore);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_PREFERENCE_STORE_H__
@@ -0,0 +1,118 @@
+#include "extension/simd/cpu_features.h"
+#include "base/cpu.h"
+
+#if defined(ARCH_CPU_ARM_FAMILY) && (defined(OS_ANDROID) || defined(OS_LINUX))
+#include <sys/auxv.h>
+#endif
+#if defined(ARCH_CPU_ARM_FAMILY) && defined(OS_WIN)
+#include <windows.h>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+#if defined(ARCH_CPU_ARM_FAMILY) && (defined(OS_ANDROID) || defined(OS_LINUX))
+// 取自 <asm/hwcap.h>，旧的 NDK 头文件里没有这些定义
+#if defined(ARCH_CPU_ARM64)
+const unsigned long kHwcapAsimd = 1 << 1;
+const unsigned long kHwcapAes = 1 << 3;
+const unsigned long kHwcapPmull = 1 << 4;
+const unsigned long kHwcapSha1 = 1 << 5;
+const unsigned long kHwcapSha2 = 1 << 6;
+#else
+const unsigned long kHwcapNeon = 1 << 12;
+const unsigned long kHwcap2Aes = 1 << 0;
+const unsigned long kHwcap2Pmull = 1 << 1;
+const unsigned long kHwcap2Sha1 = 1 << 2;
+const unsigned long kHwcap2Sha2 = 1 << 3;
+const unsigned long kAtHwcap2 = 26;
+#endif
+#endif
+
+uint32_t DetectArmFeatures()
+{
+	uint32_t features = 0;
+#if defined(ARCH_CPU_ARM_FAMILY)
+#if defined(OS_ANDROID) || defined(OS_LINUX)
+#if defined(ARCH_CPU_ARM64)
+	unsigned long hwcap = getauxval(AT_HWCAP);
+	if (hwcap & kHwcapAsimd)
+		features |= kCpuFeatureNEON;
+	const unsigned long crypto = kHwcapAes | kHwcapPmull | kHwcapSha1 | kHwcapSha2;
+	if ((hwcap & crypto) == crypto)
+		features |= kCpuFeatureARMCrypto;
+#else
+	if (getauxval(AT_HWCAP) & kHwcapNeon)
+		features |= kCpuFeatureNEON;
+	// 32 位的进程跑在 ARMv8 上也可以用加密扩展
+	unsigned long hwcap2 = getauxval(kAtHwcap2);
+	const unsigned long crypto = kHwcap2Aes | kHwcap2Pmull | kHwcap2Sha1 | kHwcap2Sha2;
+	if ((hwcap2 & crypto) == crypto)
+		features |= kCpuFeatureARMCrypto;
+#endif
+#elif defined(OS_WIN)
+	// Windows on ARM 要求 NEON
+	features |= kCpuFeatureNEON;
+	if (IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE))
+		features |= kCpuFeatureARMCrypto;
+#elif defined(OS_IOS) || defined(OS_MACOSX)
+	// 支持的 armv7 设备都带 NEON，所有的 arm64 设备都带加密扩展
+	features |= kCpuFeatureNEON;
+#if defined(ARCH_CPU_ARM64)
+	features |= kCpuFeatureARMCrypto;
+#endif
+#endif
+	base::CPU cpu;
+	if (cpu.has_broken_neon())
+		features &= ~kCpuFeatureNEON;
+#endif
+	return features;
+}
+
+uint32_t DetectFeatures()
+{
+	uint32_t features = 0;
+#if defined(ARCH_CPU_X86_FAMILY)
+	base::CPU cpu;
+	if (cpu.has_ssse3() && cpu.has_sse42())
+		features |= kCpuFeatureSSE42;
+	if (cpu.has_avx2())
+		features |= kCpuFeatureAVX2;
+#endif
+	features |= DetectArmFeatures();
+	return features;
+}
+}
+
+uint32_t CpuFeatures::Detected()
+{
+	static const uint32_t features = DetectFeatures();
+	return features;
+}
+
+std::string CpuFeatures::ToString(uint32_t features)
+{
+	static const struct
+	{
+		CpuFeature feature;
+		const char *name;
+	} kNames[] = {
+		{ kCpuFeatureSSE42, "sse4.2" },
+		{ kCpuFeatureAVX2, "avx2" },
+		{ kCpuFeatureNEON, "neon" },
+		{ kCpuFeatureARMCrypto, "armv8-crypto" },
+	};
+	std::string output;
+	for (const auto &item : kNames)
+	{
+		if ((features & item.feature) == 0)
+			continue;
+		if (!output.empty())
+			output.push_back(',');
+		output += item.name;
+	}
+	return output.empty() ? std::string("none") : output;
+}
+
+EXTENSION_END_DECLS
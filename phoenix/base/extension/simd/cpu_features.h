@@ -0,0 +1,42 @@
+// runtime detection of the SIMD instruction sets the kernels are dispatched on
+
+#ifndef __BASE_EXTENSION_CPU_FEATURES_H__
+#define __BASE_EXTENSION_CPU_FEATURES_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <string>
+
+#include "extension/extension_export.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 向量化实现依赖的指令集，可按位组合
+enum CpuFeature
+{
+	kCpuFeatureSSE42 = 1 << 0,		// x86：SSE4.2（含 SSSE3）
+	kCpuFeatureAVX2 = 1 << 1,		// x86：AVX2，且系统保存了 YMM 寄存器
+	kCpuFeatureNEON = 1 << 2,		// ARM：NEON（ARM64 上即 ASIMD）
+	kCpuFeatureARMCrypto = 1 << 3,	// ARM：ARMv8 的 AES/PMULL/SHA1/SHA2 指令
+};
+
+// 检测当前 CPU 支持的指令集，首次调用时检测一次，之后只返回缓存的结果，任意线程可调用。
+// x86 基于 base::CPU（已确认系统支持 AVX 的寄存器状态）；ARM 上 Linux/Android 读取 getauxval，
+// Windows 用 IsProcessorFeaturePresent，iOS/macOS 按架构确定；base::CPU 报告 NEON 有缺陷的芯片不算支持 NEON。
+// 检测到的指令集还要编译器能生成对应代码才会被 GetSimdKernels 选用
+class EXTENSION_EXPORT CpuFeatures
+{
+public:
+	static uint32_t Detected();
+	static bool Has(CpuFeature feature) { return (Detected() & feature) != 0; }
+	// 以逗号分隔的名称，如 "sse4.2,avx2"，没有时为 "none"，用于日志和崩溃信息
+	static std::string ToString(uint32_t features);
+
+private:
+	CpuFeatures() = delete;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_CPU_FEATURES_H__
@@ -0,0 +1,106 @@
+#include "extension/simd/simd_kernels.h"
+#include <string.h>
+#include <atomic>
+#include "extension/simd/cpu_features.h"
+#include "extension/simd/simd_kernels_internal.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+size_t AsciiPrefixLengthScalar(const char *data, size_t length)
+{
+	const uint64_t kHighBits = 0x8080808080808080ULL;
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		if (word & kHighBits)
+			break;
+	}
+	while (i < length && (unsigned char)data[i] < 0x80)
+		i++;
+	return i;
+}
+
+void HexEncodeScalar(const uint8_t *data, size_t length, char *output)
+{
+	static const char kHexChars[] = "0123456789abcdef";
+	for (size_t i = 0; i < length; i++)
+	{
+		output[i * 2] = kHexChars[data[i] >> 4];
+		output[i * 2 + 1] = kHexChars[data[i] & 0x0f];
+	}
+}
+
+void ByteSwap32Scalar(const uint32_t *input, size_t count, uint32_t *output)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t value = input[i];
+		output[i] = (value >> 24) | ((value >> 8) & 0x0000ff00) | ((value << 8) & 0x00ff0000) | (value << 24);
+	}
+}
+
+const SimdKernels kScalarSimdKernels = {
+	kSimdScalar,
+	"scalar",
+	&AsciiPrefixLengthScalar,
+	&HexEncodeScalar,
+	&ByteSwap32Scalar,
+};
+}
+
+namespace
+{
+// 按从快到慢的顺序排列
+std::vector<const SimdKernels*> SupportedKernels()
+{
+	std::vector<const SimdKernels*> kernels;
+	uint32_t features = CpuFeatures::Detected();
+	(void)features;
+#if defined(EXTENSION_SIMD_X86)
+	if (features & kCpuFeatureAVX2)
+		kernels.push_back(&internal::kAVX2SimdKernels);
+	if (features & kCpuFeatureSSE42)
+		kernels.push_back(&internal::kSSE42SimdKernels);
+#endif
+#if defined(EXTENSION_SIMD_NEON)
+	if (features & kCpuFeatureNEON)
+		kernels.push_back(&internal::kNEONSimdKernels);
+#endif
+	kernels.push_back(&internal::kScalarSimdKernels);
+	return kernels;
+}
+
+const SimdKernels* BestKernels()
+{
+	static const SimdKernels *best = SupportedKernels().front();
+	return best;
+}
+
+std::atomic<const SimdKernels*> g_override_kernels(nullptr);
+}
+
+const SimdKernels& GetSimdKernels()
+{
+	const SimdKernels *kernels = g_override_kernels.load(std::memory_order_acquire);
+	return kernels != nullptr ? *kernels : *BestKernels();
+}
+
+std::vector<const SimdKernels*> GetSupportedSimdKernels()
+{
+	std::vector<const SimdKernels*> kernels = SupportedKernels();
+	// 标量放在最前面，作为对比的基准
+	kernels.insert(kernels.begin(), kernels.back());
+	kernels.pop_back();
+	return kernels;
+}
+
+void SetSimdKernelsForTesting(const SimdKernels *kernels)
+{
+	g_override_kernels.store(kernels, std::memory_order_release);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,54 @@
+// function-pointer tables routing the hot byte loops to the best SIMD kernels of the CPU
+
+#ifndef __BASE_EXTENSION_SIMD_KERNELS_H__
+#define __BASE_EXTENSION_SIMD_KERNELS_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "extension/extension_export.h"
+
+EXTENSION_BEGIN_DECLS
+
+enum SimdLevel
+{
+	kSimdScalar = 0,	// 标量参考实现，所有平台都有
+	kSimdSSE42,			// x86 的 SSE4.2/SSSE3，128 位
+	kSimdAVX2,			// x86 的 AVX2，256 位
+	kSimdNEON,			// ARM 的 NEON，128 位
+};
+
+// 一组实现相同语义的内核，各字段的结果必须与标量实现逐字节一致。
+// 要向量化新的热点循环时在这里加一个字段，并在 simd_kernels.cpp 里给出标量实现，
+// 各指令集的表（simd_kernels_x86.cpp、simd_kernels_neon.cpp）可以先填标量的函数，再逐个替换；
+// 输入输出都不要求对齐，长度可以为 0
+struct SimdKernels
+{
+	SimdLevel level;
+	const char *name;
+
+	// data 开头连续的 ASCII（小于 0x80）字节数，用于 UTF-8 转码和转义前的快速跳过
+	size_t (*ascii_prefix_length)(const char *data, size_t length);
+	// 把 length 个字节编码为 2 * length 个小写十六进制字符，output 不加结尾的 '\0'
+	void (*hex_encode)(const uint8_t *data, size_t length, char *output);
+	// 逐个翻转 32 位整数的字节序，input 和 output 可以是同一块内存
+	void (*byte_swap_32)(const uint32_t *input, size_t count, uint32_t *output);
+};
+
+// 当前 CPU 上最快的一组内核，首次调用时按 CpuFeatures 选定，之后只是读一个指针：
+//   const SimdKernels &simd = GetSimdKernels();
+//   simd.hex_encode(digest, 20, output);
+// 热路径上可以像上面这样取一次后使用，任意线程可调用
+EXTENSION_EXPORT const SimdKernels& GetSimdKernels();
+// 当前 CPU 能运行的所有内核，第一个是标量参考实现，用于测试各实现的一致性和基准对比
+EXTENSION_EXPORT std::vector<const SimdKernels*> GetSupportedSimdKernels();
+// 强制使用 kernels（须来自 GetSupportedSimdKernels），nullptr 恢复自动选择；
+// 用于测试和排查，替换前取得的引用仍指向原来的那组
+EXTENSION_EXPORT void SetSimdKernelsForTesting(const SimdKernels *kernels);
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_SIMD_KERNELS_H__
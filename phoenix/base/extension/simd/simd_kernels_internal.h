@@ -0,0 +1,62 @@
+// the per instruction set kernel tables, shared by the dispatcher and the kernel files
+
+#ifndef __BASE_EXTENSION_SIMD_KERNELS_INTERNAL_H__
+#define __BASE_EXTENSION_SIMD_KERNELS_INTERNAL_H__
+
+#include "extension/simd/simd_kernels.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 编译器能否生成对应指令集的代码。x86 上 MSVC 不需要编译选项，GCC/Clang 用 target 属性逐个函数开启，
+// 整个工程仍按基础指令集编译；ARMv7 只有打开 -mfpu=neon 编译时才有 NEON 内核
+#if defined(ARCH_CPU_X86_FAMILY)
+#define EXTENSION_SIMD_X86 1
+#if defined(_MSC_VER)
+#define EXTENSION_TARGET_SSE42
+#define EXTENSION_TARGET_AVX2
+#else
+#define EXTENSION_TARGET_SSE42 __attribute__((target("ssse3,sse4.2")))
+#define EXTENSION_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64) || defined(_M_ARM)
+#define EXTENSION_SIMD_NEON 1
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+extern const SimdKernels kScalarSimdKernels;
+#if defined(EXTENSION_SIMD_X86)
+extern const SimdKernels kSSE42SimdKernels;
+extern const SimdKernels kAVX2SimdKernels;
+#endif
+#if defined(EXTENSION_SIMD_NEON)
+extern const SimdKernels kNEONSimdKernels;
+#endif
+
+// 标量实现，也用于向量实现处理不足一个寄存器的尾部
+size_t AsciiPrefixLengthScalar(const char *data, size_t length);
+void HexEncodeScalar(const uint8_t *data, size_t length, char *output);
+void ByteSwap32Scalar(const uint32_t *input, size_t count, uint32_t *output);
+
+// mask 不为 0
+inline int CountTrailingZeros32(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+}
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_SIMD_KERNELS_INTERNAL_H__
@@ -0,0 +1,83 @@
+#include "extension/simd/simd_kernels_internal.h"
+
+#if defined(EXTENSION_SIMD_NEON)
+#if defined(_MSC_VER) && defined(_M_ARM64)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+namespace
+{
+// 16 个半字节查表，ARMv7 没有 vqtbl1q_u8，拆成两次 8 字节的 vtbl2_u8
+inline uint8x16_t LookupNibbles(uint8x16_t table, uint8x16_t nibbles)
+{
+#if defined(ARCH_CPU_ARM64)
+	return vqtbl1q_u8(table, nibbles);
+#else
+	uint8x8x2_t table_pair = { { vget_low_u8(table), vget_high_u8(table) } };
+	return vcombine_u8(vtbl2_u8(table_pair, vget_low_u8(nibbles)), vtbl2_u8(table_pair, vget_high_u8(nibbles)));
+#endif
+}
+
+size_t AsciiPrefixLengthNEON(const char *data, size_t length)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(data + i));
+		uint64x2_t words = vreinterpretq_u64_u8(chunk);
+		uint64_t high_bits = (vgetq_lane_u64(words, 0) | vgetq_lane_u64(words, 1)) & 0x8080808080808080ULL;
+		if (high_bits != 0)
+			break;
+	}
+	return i + AsciiPrefixLengthScalar(data + i, length - i);
+}
+
+void HexEncodeNEON(const uint8_t *data, size_t length, char *output)
+{
+	static const uint8_t kHexChars[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+	const uint8x16_t hex_chars = vld1q_u8(kHexChars);
+	const uint8x16_t low_mask = vdupq_n_u8(0x0f);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		uint8x16_t bytes = vld1q_u8(data + i);
+		uint8x16x2_t chars;
+		chars.val[0] = LookupNibbles(hex_chars, vshrq_n_u8(bytes, 4));
+		chars.val[1] = LookupNibbles(hex_chars, vandq_u8(bytes, low_mask));
+		// vst2q 交错写入高低半字节的字符
+		vst2q_u8(reinterpret_cast<uint8_t *>(output + i * 2), chars);
+	}
+	HexEncodeScalar(data + i, length - i, output + i * 2);
+}
+
+void ByteSwap32NEON(const uint32_t *input, size_t count, uint32_t *output)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint8x16_t words = vld1q_u8(reinterpret_cast<const uint8_t *>(input + i));
+		vst1q_u8(reinterpret_cast<uint8_t *>(output + i), vrev32q_u8(words));
+	}
+	ByteSwap32Scalar(input + i, count - i, output + i);
+}
+}
+
+const SimdKernels kNEONSimdKernels = {
+	kSimdNEON,
+	"neon",
+	&AsciiPrefixLengthNEON,
+	&HexEncodeNEON,
+	&ByteSwap32NEON,
+};
+}
+
+EXTENSION_END_DECLS
+
+#endif // EXTENSION_SIMD_NEON
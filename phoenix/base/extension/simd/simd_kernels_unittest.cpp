@@ -0,0 +1,128 @@
+// SIMD kernels Unittest
+// 每个当前 CPU 支持的实现都与标量参考实现对比，长度覆盖寄存器宽度前后的边界，起始地址覆盖各种不对齐
+
+#if defined(WITH_UNITTEST)
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "extension/simd/cpu_features.h"
+#include "extension/simd/simd_kernels.h"
+#include "gtest/gtest.h"
+
+USING_NS_EXTENSION
+
+namespace
+{
+const size_t kMaxLength = 130;
+const size_t kMaxOffset = 32;
+
+std::vector<uint8_t> MakeBytes(size_t length, uint32_t seed)
+{
+	std::vector<uint8_t> bytes(length);
+	for (size_t i = 0; i < length; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		bytes[i] = (uint8_t)(seed >> 16);
+	}
+	return bytes;
+}
+}
+
+TEST(SimdKernels, ScalarFirst)
+{
+	std::vector<const SimdKernels*> kernels = GetSupportedSimdKernels();
+	ASSERT_FALSE(kernels.empty());
+	EXPECT_EQ(kSimdScalar, kernels.front()->level);
+	EXPECT_FALSE(CpuFeatures::ToString(CpuFeatures::Detected()).empty());
+}
+
+TEST(SimdKernels, AsciiPrefixLength)
+{
+	const SimdKernels *scalar = GetSupportedSimdKernels().front();
+	for (const SimdKernels *kernels : GetSupportedSimdKernels())
+	{
+		for (size_t length = 0; length <= kMaxLength; length++)
+		{
+			// 非 ASCII 字节出现在每一个位置，以及没有出现
+			for (size_t position = 0; position <= length; position++)
+			{
+				std::string text(kMaxOffset + length, 'a');
+				if (position < length)
+					text[kMaxOffset + position] = (char)(0x80 | (position & 0x7f));
+				for (size_t offset = 0; offset < kMaxOffset; offset += 7)
+				{
+					const char *data = text.data() + kMaxOffset - offset;
+					size_t expected = scalar->ascii_prefix_length(data + offset, length);
+					EXPECT_EQ(position, expected);
+					EXPECT_EQ(expected, kernels->ascii_prefix_length(data + offset, length)) << kernels->name;
+				}
+			}
+		}
+	}
+}
+
+TEST(SimdKernels, HexEncode)
+{
+	const SimdKernels *scalar = GetSupportedSimdKernels().front();
+	uint8_t digest[] = { 0x00, 0x7f, 0x80, 0xff, 0x12, 0xab };
+	char hex[sizeof(digest) * 2];
+	scalar->hex_encode(digest, sizeof(digest), hex);
+	EXPECT_EQ("007f80ff12ab", std::string(hex, sizeof(hex)));
+
+	for (const SimdKernels *kernels : GetSupportedSimdKernels())
+	{
+		for (size_t length = 0; length <= kMaxLength; length++)
+		{
+			std::vector<uint8_t> bytes = MakeBytes(length + kMaxOffset, (uint32_t)length);
+			for (size_t offset = 0; offset < kMaxOffset; offset += 5)
+			{
+				// 输出的前后各留一段，检查没有越界写
+				std::string expected(length * 2 + 2, '#');
+				std::string actual(length * 2 + 2, '#');
+				scalar->hex_encode(bytes.data() + offset, length, &expected[1]);
+				kernels->hex_encode(bytes.data() + offset, length, &actual[1]);
+				EXPECT_EQ(expected, actual) << kernels->name << " length " << length;
+			}
+		}
+	}
+}
+
+TEST(SimdKernels, ByteSwap32)
+{
+	const SimdKernels *scalar = GetSupportedSimdKernels().front();
+	uint32_t value = 0x12345678;
+	scalar->byte_swap_32(&value, 1, &value);
+	EXPECT_EQ(0x78563412u, value);
+
+	for (const SimdKernels *kernels : GetSupportedSimdKernels())
+	{
+		for (size_t count = 0; count <= kMaxLength / 4; count++)
+		{
+			std::vector<uint8_t> bytes = MakeBytes((count + 1) * 4, (uint32_t)count);
+			std::vector<uint32_t> input(count + 1);
+			memcpy(input.data(), bytes.data(), bytes.size());
+			std::vector<uint32_t> expected(count + 1, 0xdeadbeef);
+			std::vector<uint32_t> actual(count + 1, 0xdeadbeef);
+			scalar->byte_swap_32(input.data(), count, expected.data());
+			kernels->byte_swap_32(input.data(), count, actual.data());
+			EXPECT_EQ(expected, actual) << kernels->name << " count " << count;
+			// 原地翻转
+			std::vector<uint32_t> in_place = input;
+			kernels->byte_swap_32(in_place.data(), count, in_place.data());
+			in_place[count] = 0xdeadbeef;
+			EXPECT_EQ(expected, in_place) << kernels->name << " in place, count " << count;
+		}
+	}
+}
+
+TEST(SimdKernels, Override)
+{
+	const SimdKernels *scalar = GetSupportedSimdKernels().front();
+	SetSimdKernelsForTesting(scalar);
+	EXPECT_EQ(scalar, &GetSimdKernels());
+	SetSimdKernelsForTesting(nullptr);
+	EXPECT_EQ(GetSupportedSimdKernels().size() > 1 ? GetSupportedSimdKernels()[1] : scalar, &GetSimdKernels());
+}
+
+#endif  // WITH_UNITTEST
@@ -0,0 +1,135 @@
+#include "extension/simd/simd_kernels_internal.h"
+
+#if defined(EXTENSION_SIMD_X86)
+#include <immintrin.h>
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+namespace
+{
+//////////////////////////////////////////////////////////////////////////////
+// SSE4.2，实际用到的是 SSE2 和 SSSE3 的 pshufb
+
+EXTENSION_TARGET_SSE42
+size_t AsciiPrefixLengthSSE42(const char *data, size_t length)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(chunk);
+		if (mask != 0)
+			return i + CountTrailingZeros32(mask);
+	}
+	return i + AsciiPrefixLengthScalar(data + i, length - i);
+}
+
+EXTENSION_TARGET_SSE42
+void HexEncodeSSE42(const uint8_t *data, size_t length, char *output)
+{
+	const __m128i hex_chars = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m128i low_mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i high = _mm_shuffle_epi8(hex_chars, _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask));
+		__m128i low = _mm_shuffle_epi8(hex_chars, _mm_and_si128(bytes, low_mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + i * 2), _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + i * 2 + 16), _mm_unpackhi_epi8(high, low));
+	}
+	HexEncodeScalar(data + i, length - i, output + i * 2);
+}
+
+EXTENSION_TARGET_SSE42
+void ByteSwap32SSE42(const uint32_t *input, size_t count, uint32_t *output)
+{
+	const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_shuffle_epi8(words, reverse));
+	}
+	ByteSwap32Scalar(input + i, count - i, output + i);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// AVX2，不足 32 字节的部分交给 SSE4.2 的实现（有 AVX2 的 CPU 都有 SSE4.2）
+
+EXTENSION_TARGET_AVX2
+size_t AsciiPrefixLengthAVX2(const char *data, size_t length)
+{
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32)
+	{
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(chunk);
+		if (mask != 0)
+			return i + CountTrailingZeros32(mask);
+	}
+	return i + AsciiPrefixLengthSSE42(data + i, length - i);
+}
+
+EXTENSION_TARGET_AVX2
+void HexEncodeAVX2(const uint8_t *data, size_t length, char *output)
+{
+	// vpshufb 和 unpack 都是在两个 128 位的半边内各自进行的，最后按半边重新拼接
+	const __m256i hex_chars = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+		__m256i high = _mm256_shuffle_epi8(hex_chars, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_mask));
+		__m256i low = _mm256_shuffle_epi8(hex_chars, _mm256_and_si256(bytes, low_mask));
+		// first：字节 0-7 与 16-23，second：字节 8-15 与 24-31
+		__m256i first = _mm256_unpacklo_epi8(high, low);
+		__m256i second = _mm256_unpackhi_epi8(high, low);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i * 2), _mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i * 2 + 32), _mm256_permute2x128_si256(first, second, 0x31));
+	}
+	HexEncodeSSE42(data + i, length - i, output + i * 2);
+}
+
+EXTENSION_TARGET_AVX2
+void ByteSwap32AVX2(const uint32_t *input, size_t count, uint32_t *output)
+{
+	const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_shuffle_epi8(words, reverse));
+	}
+	ByteSwap32SSE42(input + i, count - i, output + i);
+}
+}
+
+const SimdKernels kSSE42SimdKernels = {
+	kSimdSSE42,
+	"sse4.2",
+	&AsciiPrefixLengthSSE42,
+	&HexEncodeSSE42,
+	&ByteSwap32SSE42,
+};
+
+const SimdKernels kAVX2SimdKernels = {
+	kSimdAVX2,
+	"avx2",
+	&AsciiPrefixLengthAVX2,
+	&HexEncodeAVX2,
+	&ByteSwap32AVX2,
+};
+}
+
+EXTENSION_END_DECLS
+
+#endif // EXTENSION_SIMD_X86
@@ -0,0 +1,366 @@
+#include "extension/strings/string_format.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+namespace
+{
+const char kDigitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+const uint64_t kPowersOf10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+// Writes the decimal digits of 'value' backwards before 'end' two at a time and returns the first digit
+char* FormatDecimal(char *end, uint64_t value)
+{
+	while (value >= 100)
+	{
+		unsigned pair = (unsigned)(value % 100) * 2;
+		value /= 100;
+		*--end = kDigitPairs[pair + 1];
+		*--end = kDigitPairs[pair];
+	}
+	if (value >= 10)
+	{
+		unsigned pair = (unsigned)value * 2;
+		*--end = kDigitPairs[pair + 1];
+		*--end = kDigitPairs[pair];
+	}
+	else
+	{
+		*--end = (char)('0' + value);
+	}
+	return end;
+}
+
+// The hexadecimal, octal or binary digits, 'bits' is the bits of a digit
+char* FormatPowerOf2(char *end, uint64_t value, int bits, bool upper)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	uint64_t mask = (1u << bits) - 1;
+	do
+	{
+		*--end = digits[value & mask];
+		value >>= bits;
+	} while (value != 0);
+	return end;
+}
+
+// Outputs 'prefix' (the sign and the base prefix) and 'body' with the width, fill and alignment of 'spec',
+// the zeros padding a number go after its prefix
+void WriteField(FormatOutput &output, const FormatSpec &spec, std::string_view prefix, std::string_view body, bool numeric)
+{
+	size_t length = prefix.size() + body.size();
+	size_t padding = (size_t)spec.width > length ? spec.width - length : 0;
+	if (padding == 0)
+	{
+		output.Append(prefix.data(), prefix.size());
+		output.Append(body.data(), body.size());
+		return;
+	}
+	if (numeric && spec.zero_pad && spec.align == 0)
+	{
+		output.Append(prefix.data(), prefix.size());
+		output.Append(padding, '0');
+		output.Append(body.data(), body.size());
+		return;
+	}
+	char align = spec.align != 0 ? spec.align : (numeric ? '>' : '<');
+	size_t before = align == '>' ? padding : (align == '^' ? padding / 2 : 0);
+	output.Append(before, spec.fill);
+	output.Append(prefix.data(), prefix.size());
+	output.Append(body.data(), body.size());
+	output.Append(padding - before, spec.fill);
+}
+
+void FormatInteger(FormatOutput &output, const FormatSpec &spec, uint64_t magnitude, bool negative)
+{
+	if (spec.type == 'c')
+	{
+		char c = (char)(negative ? 0 - magnitude : magnitude);
+		WriteField(output, spec, std::string_view(), std::string_view(&c, 1), false);
+		return;
+	}
+	char buffer[72];
+	char *end = buffer + sizeof(buffer);
+	char *begin;
+	char prefix[3];
+	size_t prefix_size = 0;
+	if (negative)
+		prefix[prefix_size++] = '-';
+	else if (spec.sign != 0)
+		prefix[prefix_size++] = spec.sign;
+	switch (spec.type)
+	{
+	case 'x':
+	case 'X':
+		begin = FormatPowerOf2(end, magnitude, 4, spec.type == 'X');
+		if (spec.alternate)
+		{
+			prefix[prefix_size++] = '0';
+			prefix[prefix_size++] = spec.type;
+		}
+		break;
+	case 'b':
+	case 'B':
+		begin = FormatPowerOf2(end, magnitude, 1, false);
+		if (spec.alternate)
+		{
+			prefix[prefix_size++] = '0';
+			prefix[prefix_size++] = spec.type;
+		}
+		break;
+	case 'o':
+		begin = FormatPowerOf2(end, magnitude, 3, false);
+		if (spec.alternate && magnitude != 0)
+			prefix[prefix_size++] = '0';
+		break;
+	default:
+		begin = FormatDecimal(end, magnitude);
+		break;
+	}
+	WriteField(output, spec, std::string_view(prefix, prefix_size), std::string_view(begin, end - begin), true);
+}
+
+// Writes 'magnitude' with 'precision' decimals backwards before 'end'. Below 2^40 the scaled value is off by
+// 2^-13 at most, so the rounding is certain unless it is that close to a tie, then nullptr is returned
+// and printf rounds the exact binary value
+char* FormatFixedFast(char *end, double magnitude, int precision)
+{
+	if (precision > 9)
+		return nullptr;
+	double scaled = magnitude * (double)kPowersOf10[precision];
+	if (!(scaled < 1099511627776.0))
+		return nullptr;
+	double integral = floor(scaled);
+	double fraction = scaled - integral;
+	if (fraction > 0.499 && fraction < 0.501)
+		return nullptr;
+	uint64_t digits = (uint64_t)integral + (fraction > 0.5 ? 1 : 0);
+	if (precision > 0)
+	{
+		uint64_t decimals = digits % kPowersOf10[precision];
+		digits /= kPowersOf10[precision];
+		char *begin = FormatDecimal(end, decimals);
+		while (end - begin < precision)
+			*--begin = '0';
+		*--begin = '.';
+		end = begin;
+	}
+	return FormatDecimal(end, digits);
+}
+
+// 'printf_format' takes the precision by ".*"
+void PrintDouble(FormatOutput &output, const FormatSpec &spec, std::string_view prefix, const char *printf_format,
+	int precision, double magnitude)
+{
+	char buffer[128];
+	int length = snprintf(buffer, sizeof(buffer), printf_format, precision, magnitude);
+	if (length < 0)
+		return;
+	if ((size_t)length < sizeof(buffer))
+	{
+		WriteField(output, spec, prefix, std::string_view(buffer, length), true);
+		return;
+	}
+	std::string text(length + 1, '\0');
+	snprintf(&text[0], text.size(), printf_format, precision, magnitude);
+	text.resize(length);
+	WriteField(output, spec, prefix, text, true);
+}
+
+void FormatDouble(FormatOutput &output, const FormatSpec &spec, double value)
+{
+	char prefix[1];
+	size_t prefix_size = 0;
+	if (signbit(value) && !isnan(value))
+		prefix[prefix_size++] = '-';
+	else if (spec.sign != 0)
+		prefix[prefix_size++] = spec.sign;
+	std::string_view sign(prefix, prefix_size);
+	bool upper = spec.type == 'F' || spec.type == 'E' || spec.type == 'G';
+	double magnitude = fabs(value);
+	if (!isfinite(value))
+	{
+		// no zeros before inf and nan
+		FormatSpec padded = spec;
+		padded.zero_pad = false;
+		const char *text = isnan(value) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+		WriteField(output, padded, sign, text, true);
+		return;
+	}
+
+	char buffer[64];
+	char *end = buffer + sizeof(buffer);
+	if (spec.type == 'f' || spec.type == 'F' || (spec.type == 0 && spec.precision >= 0))
+	{
+		int precision = spec.precision >= 0 ? spec.precision : 6;
+		char *begin = FormatFixedFast(end, magnitude, precision);
+		if (begin != nullptr)
+			WriteField(output, spec, sign, std::string_view(begin, end - begin), true);
+		else
+			PrintDouble(output, spec, sign, "%.*f", precision, magnitude);
+		return;
+	}
+	if (spec.type != 0)
+	{
+		char printf_format[] = "%.*e";
+		printf_format[3] = spec.type;
+		PrintDouble(output, spec, sign, printf_format, spec.precision >= 0 ? spec.precision : 6, magnitude);
+		return;
+	}
+
+	// the shortest text which reads back as the same double, integers are converted directly
+	if (magnitude < 1e15 && magnitude == floor(magnitude))
+	{
+		char *begin = FormatDecimal(end, (uint64_t)magnitude);
+		WriteField(output, spec, sign, std::string_view(begin, end - begin), true);
+		return;
+	}
+	int length = 0;
+	for (int precision = 15; precision <= 17; precision++)
+	{
+		length = snprintf(buffer, sizeof(buffer), "%.*g", precision, magnitude);
+		if (precision == 17 || strtod(buffer, nullptr) == magnitude)
+			break;
+	}
+	if (length > 0 && (size_t)length < sizeof(buffer))
+		WriteField(output, spec, sign, std::string_view(buffer, length), true);
+}
+
+void FormatArgument(FormatOutput &output, const FormatSpec &spec, const FormatArg &arg)
+{
+	switch (arg.type)
+	{
+	case kFormatArgInt:
+		if (arg.int_value < 0)
+			FormatInteger(output, spec, 0 - (uint64_t)arg.int_value, true);
+		else
+			FormatInteger(output, spec, (uint64_t)arg.int_value, false);
+		break;
+	case kFormatArgUint:
+		FormatInteger(output, spec, arg.uint_value, false);
+		break;
+	case kFormatArgBool:
+		if (IsIntegerFormatType(spec.type))
+			FormatInteger(output, spec, arg.uint_value, false);
+		else
+			WriteField(output, spec, std::string_view(), arg.uint_value ? "true" : "false", false);
+		break;
+	case kFormatArgChar:
+		if (IsIntegerFormatType(spec.type))
+		{
+			FormatArg value;
+			value.type = kFormatArgInt;
+			value.int_value = arg.int_value;
+			FormatArgument(output, spec, value);
+		}
+		else
+		{
+			char c = (char)arg.int_value;
+			WriteField(output, spec, std::string_view(), std::string_view(&c, 1), false);
+		}
+		break;
+	case kFormatArgDouble:
+		FormatDouble(output, spec, arg.double_value);
+		break;
+	case kFormatArgString:
+	{
+		size_t size = arg.string_value.size;
+		if (spec.precision >= 0)
+			size = std::min(size, (size_t)spec.precision);
+		WriteField(output, spec, std::string_view(), std::string_view(arg.string_value.data, size), false);
+		break;
+	}
+	case kFormatArgPointer:
+	{
+		char buffer[24];
+		char *end = buffer + sizeof(buffer);
+		char *begin = FormatPowerOf2(end, (uint64_t)(uintptr_t)arg.pointer_value, 4, false);
+		WriteField(output, spec, "0x", std::string_view(begin, end - begin), true);
+		break;
+	}
+	default:
+		break;
+	}
+}
+}
+
+StringFormatOutput::StringFormatOutput(std::string &output, size_t size_hint)
+	: FormatOutput(nullptr, 0), output_(output), offset_(output.size())
+{
+	// use up the capacity the string already has
+	capacity_ = std::max(size_hint, output_.capacity() - offset_);
+	output_.resize(offset_ + capacity_);
+	data_ = &output_[offset_];
+}
+
+StringFormatOutput::~StringFormatOutput()
+{
+	output_.resize(offset_ + size_);
+}
+
+bool StringFormatOutput::Grow(size_t more)
+{
+	capacity_ = std::max(capacity_ * 2, size_ + more);
+	output_.resize(offset_ + capacity_);
+	data_ = &output_[offset_];
+	return true;
+}
+
+bool InlineFormatOutput::Grow(size_t more)
+{
+	capacity_ = std::max(capacity_ * 2, size_ + more);
+	if (data_ == inline_buffer_)
+	{
+		heap_buffer_.resize(capacity_);
+		memcpy(&heap_buffer_[0], inline_buffer_, size_);
+	}
+	else
+	{
+		heap_buffer_.resize(capacity_);
+	}
+	data_ = &heap_buffer_[0];
+	return true;
+}
+
+void FormatArgs(FormatOutput &output, std::string_view format, const FormatArg *args, size_t count)
+{
+	size_t index = 0;
+	for (FormatToken token = NextFormatToken(format, 0); token.kind != kFormatTokenEnd;
+		token = NextFormatToken(format, token.next))
+	{
+		output.Append(format.data() + token.text_begin, token.text_end - token.text_begin);
+		if (token.kind == kFormatTokenText)
+			continue;
+		// an unmatched brace, or a field without an argument or with an invalid spec is output as it is,
+		// the argument of an invalid field is skipped all the same
+		FormatSpec spec;
+		if (token.kind == kFormatTokenField && index < count && ParseFormatSpec(token.spec, spec)
+			&& IsFormatSpecValid(spec, args[index].type))
+		{
+			FormatArgument(output, spec, args[index++]);
+			continue;
+		}
+		if (token.kind == kFormatTokenField && index < count)
+			index++;
+		output.Append(format.data() + token.field_begin, token.next - token.field_begin);
+	}
+}
+}
+
+EXTENSION_END_DECLS
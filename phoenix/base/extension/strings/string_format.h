@@ -0,0 +1,543 @@
+// fmt-style string formatting checked at compile time
+
+#ifndef BASE_EXTENSION_STRINGS_STRING_FORMAT_H_
+#define BASE_EXTENSION_STRINGS_STRING_FORMAT_H_
+
+#include "extension/extension_export.h"
+#include "extension/config/build_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "extension/memory/blockbuffer.h"
+
+EXTENSION_BEGIN_DECLS
+
+// A type-safe alternative to StringPrintf for the hot paths: the fields of the format string are matched
+// against the argument types at compile time, integers and fixed-point floats are converted without the
+// C runtime, and the text is written to a std::string, a caller buffer or a BlockBuffer directly
+//
+//	StringFormatAppend(range, EXTENSION_FORMAT("{}-{}"), range_start, range_end);
+//	char prefix[32];
+//	StringFormatTo(prefix, sizeof(prefix), EXTENSION_FORMAT("{:02}:{:02}:{:02}.{:03} "), hour, minute, second, ms);
+//
+// A field is "{}" or "{:spec}", taking the arguments in order; spec is [[fill]align][sign][#][0][width][.precision][type]
+//	align		'<' left, '>' right, '^' center; numbers are right aligned by default, the others left aligned
+//	sign		'+' or ' ' before the non-negative numbers
+//	'#'			the "0x", "0b" or "0" prefix of 'x', 'b' and 'o'
+//	'0'			pads a number with zeros after its sign and prefix
+//	width		the minimum bytes of the field, the padding is 'fill', a space by default
+//	precision	the digits after the point of a float, the maximum bytes of a string
+//	type		integer: d x X o b c; float: f e g and the upper cases, "{}" is the shortest text read back
+//				as the same double; string: s; bool: s, or an integer type for 1/0; char: c, or an integer type;
+//				pointer: p
+// "{{" and "}}" are the braces themselves. The arguments can be the built-in numbers, bool, char, enums
+// (their underlying integers), C strings, std::string, std::string_view and pointers; other types do not compile.
+// A format string wrapped in EXTENSION_FORMAT does not compile if its fields do not match the arguments
+// in number or type. A plain format string is checked while formatting instead: a field without an argument
+// or with an invalid spec is output as it is, and the extra arguments are ignored.
+// The output must not be one of the arguments.
+#define EXTENSION_FORMAT(s) \
+	[] { \
+		struct ExtensionFormatString : NS_EXTENSION::internal::CompileTimeFormat \
+		{ \
+			static constexpr std::string_view Get() { return std::string_view(s, sizeof(s) - 1); } \
+		}; \
+		return ExtensionFormatString(); \
+	}()
+
+namespace internal
+{
+struct CompileTimeFormat {};
+
+enum FormatArgType
+{
+	kFormatArgNone = 0,
+	kFormatArgInt,
+	kFormatArgUint,
+	kFormatArgBool,
+	kFormatArgChar,
+	kFormatArgDouble,
+	kFormatArgString,
+	kFormatArgPointer,
+};
+
+struct FormatStringArg
+{
+	const char *data;
+	size_t size;
+};
+
+struct FormatArg
+{
+	FormatArg() : type(kFormatArgNone), uint_value(0) {}
+
+	FormatArgType type;
+	union
+	{
+		int64_t int_value;
+		uint64_t uint_value;
+		double double_value;
+		const void *pointer_value;
+		FormatStringArg string_value;
+	};
+};
+
+// not defined for the unsupported types
+template <typename T, typename Enable = void>
+struct FormatArgTraits;
+
+template <typename T>
+struct FormatArgTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value
+	&& !std::is_same<T, char>::value>::type>
+{
+	static constexpr FormatArgType kType = kFormatArgInt;
+	static FormatArg Make(T value) { FormatArg arg; arg.type = kType; arg.int_value = value; return arg; }
+};
+
+template <typename T>
+struct FormatArgTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value
+	&& !std::is_same<T, char>::value && !std::is_same<T, bool>::value>::type>
+{
+	static constexpr FormatArgType kType = kFormatArgUint;
+	static FormatArg Make(T value) { FormatArg arg; arg.type = kType; arg.uint_value = value; return arg; }
+};
+
+template <>
+struct FormatArgTraits<bool>
+{
+	static constexpr FormatArgType kType = kFormatArgBool;
+	static FormatArg Make(bool value) { FormatArg arg; arg.type = kType; arg.uint_value = value ? 1 : 0; return arg; }
+};
+
+template <>
+struct FormatArgTraits<char>
+{
+	static constexpr FormatArgType kType = kFormatArgChar;
+	static FormatArg Make(char value) { FormatArg arg; arg.type = kType; arg.int_value = value; return arg; }
+};
+
+template <typename T>
+struct FormatArgTraits<T, typename std::enable_if<std::is_enum<T>::value>::type>
+	: FormatArgTraits<typename std::underlying_type<T>::type>
+{
+	static FormatArg Make(T value)
+	{
+		return FormatArgTraits<typename std::underlying_type<T>::type>::Make(
+			static_cast<typename std::underlying_type<T>::type>(value));
+	}
+};
+
+template <typename T>
+struct FormatArgTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+	static constexpr FormatArgType kType = kFormatArgDouble;
+	static FormatArg Make(T value) { FormatArg arg; arg.type = kType; arg.double_value = (double)value; return arg; }
+};
+
+template <>
+struct FormatArgTraits<const char *>
+{
+	static constexpr FormatArgType kType = kFormatArgString;
+	static FormatArg Make(const char *value)
+	{
+		FormatArg arg;
+		arg.type = kType;
+		arg.string_value.data = value != nullptr ? value : "(null)";
+		arg.string_value.size = strlen(arg.string_value.data);
+		return arg;
+	}
+};
+
+template <>
+struct FormatArgTraits<char *> : FormatArgTraits<const char *> {};
+
+template <>
+struct FormatArgTraits<std::string_view>
+{
+	static constexpr FormatArgType kType = kFormatArgString;
+	static FormatArg Make(std::string_view value)
+	{
+		FormatArg arg;
+		arg.type = kType;
+		arg.string_value.data = value.data();
+		arg.string_value.size = value.size();
+		return arg;
+	}
+};
+
+template <>
+struct FormatArgTraits<std::string> : FormatArgTraits<std::string_view> {};
+
+template <typename T>
+struct FormatArgTraits<T, typename std::enable_if<(std::is_pointer<T>::value
+	&& !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value)
+	|| std::is_same<T, std::nullptr_t>::value>::type>
+{
+	static constexpr FormatArgType kType = kFormatArgPointer;
+	static FormatArg Make(T value) { FormatArg arg; arg.type = kType; arg.pointer_value = (const void *)value; return arg; }
+};
+
+template <typename T>
+inline FormatArg MakeFormatArg(const T &value)
+{
+	return FormatArgTraits<typename std::decay<T>::type>::Make(value);
+}
+
+struct FormatSpec
+{
+	char fill = ' ';
+	char align = 0;			// '<', '>', '^' or 0 for the default of the type
+	char sign = 0;			// '+', ' ' or 0
+	bool alternate = false;
+	bool zero_pad = false;
+	int width = 0;
+	int precision = -1;
+	char type = 0;
+};
+
+static const int kMaxFormatWidth = 4096;
+
+enum FormatTokenKind
+{
+	kFormatTokenEnd,
+	kFormatTokenText,		// text and then an escaped brace, or text up to the end
+	kFormatTokenField,		// text and then a field
+	kFormatTokenError,		// text and then an unmatched brace
+};
+
+struct FormatToken
+{
+	FormatTokenKind kind = kFormatTokenEnd;
+	size_t text_begin = 0;
+	size_t text_end = 0;
+	// the field or the unmatched brace follows the text, |next| is where the next token starts
+	size_t field_begin = 0;
+	size_t next = 0;
+	std::string_view spec;
+};
+
+// the token of |format| from |position|, the text of which has no braces except one escaped brace at the end
+constexpr FormatToken NextFormatToken(std::string_view format, size_t position)
+{
+	FormatToken token;
+	token.text_begin = position;
+	size_t i = position;
+	while (i < format.size() && format[i] != '{' && format[i] != '}')
+		i++;
+	token.text_end = i;
+	token.field_begin = i;
+	if (i == format.size())
+	{
+		token.kind = i == position ? kFormatTokenEnd : kFormatTokenText;
+		token.next = i;
+		return token;
+	}
+	if (i + 1 < format.size() && format[i + 1] == format[i])
+	{
+		token.kind = kFormatTokenText;
+		token.text_end = i + 1;
+		token.next = i + 2;
+		return token;
+	}
+	token.kind = kFormatTokenError;
+	token.next = i + 1;
+	if (format[i] == '}')
+		return token;
+	size_t close = i + 1;
+	while (close < format.size() && format[close] != '}' && format[close] != '{')
+		close++;
+	if (close == format.size() || format[close] == '{')
+		return token;
+	std::string_view content = format.substr(i + 1, close - i - 1);
+	// only the automatic argument order, no argument index
+	if (!content.empty() && content[0] != ':')
+		return token;
+	token.kind = kFormatTokenField;
+	token.spec = content.empty() ? content : content.substr(1);
+	token.next = close + 1;
+	return token;
+}
+
+constexpr bool IsFormatAlign(char c)
+{
+	return c == '<' || c == '>' || c == '^';
+}
+
+constexpr bool ParseFormatSpec(std::string_view text, FormatSpec &spec)
+{
+	size_t i = 0;
+	if (text.size() >= 2 && IsFormatAlign(text[1]) && text[0] != '{' && text[0] != '}')
+	{
+		spec.fill = text[0];
+		spec.align = text[1];
+		i = 2;
+	}
+	else if (!text.empty() && IsFormatAlign(text[0]))
+	{
+		spec.align = text[0];
+		i = 1;
+	}
+	if (i < text.size() && (text[i] == '+' || text[i] == ' '))
+		spec.sign = text[i++];
+	else if (i < text.size() && text[i] == '-')
+		i++;
+	if (i < text.size() && text[i] == '#')
+	{
+		spec.alternate = true;
+		i++;
+	}
+	if (i < text.size() && text[i] == '0')
+	{
+		spec.zero_pad = true;
+		i++;
+	}
+	while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+	{
+		spec.width = spec.width * 10 + (text[i++] - '0');
+		if (spec.width > kMaxFormatWidth)
+			return false;
+	}
+	if (i < text.size() && text[i] == '.')
+	{
+		i++;
+		if (i == text.size() || text[i] < '0' || text[i] > '9')
+			return false;
+		spec.precision = 0;
+		while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+		{
+			spec.precision = spec.precision * 10 + (text[i++] - '0');
+			if (spec.precision > kMaxFormatWidth)
+				return false;
+		}
+	}
+	if (i < text.size())
+		spec.type = text[i++];
+	return i == text.size();
+}
+
+constexpr bool IsIntegerFormatType(char type)
+{
+	return type == 'd' || type == 'x' || type == 'X' || type == 'o' || type == 'b' || type == 'B';
+}
+
+constexpr bool IsFormatSpecValid(const FormatSpec &spec, FormatArgType type)
+{
+	// the sign, '#' and '0' belong to numbers
+	bool numeric_flags = spec.sign != 0 || spec.alternate || spec.zero_pad;
+	switch (type)
+	{
+	case kFormatArgInt:
+	case kFormatArgUint:
+		if (spec.precision >= 0)
+			return false;
+		if (spec.type == 'c')
+			return !numeric_flags;
+		return spec.type == 0 || IsIntegerFormatType(spec.type);
+	case kFormatArgBool:
+	case kFormatArgChar:
+		if (spec.precision >= 0)
+			return false;
+		if (IsIntegerFormatType(spec.type))
+			return true;
+		return !numeric_flags && (spec.type == 0 || spec.type == (type == kFormatArgBool ? 's' : 'c'));
+	case kFormatArgDouble:
+		return !spec.alternate && (spec.type == 0 || spec.type == 'f' || spec.type == 'F' || spec.type == 'e'
+			|| spec.type == 'E' || spec.type == 'g' || spec.type == 'G');
+	case kFormatArgString:
+		return !numeric_flags && (spec.type == 0 || spec.type == 's');
+	case kFormatArgPointer:
+		return !numeric_flags && spec.precision < 0 && (spec.type == 0 || spec.type == 'p');
+	default:
+		return false;
+	}
+}
+
+// the number of fields in |format|, -1 if a brace is unmatched
+constexpr int CountFormatFields(std::string_view format)
+{
+	int count = 0;
+	for (FormatToken token = NextFormatToken(format, 0); token.kind != kFormatTokenEnd;
+		token = NextFormatToken(format, token.next))
+	{
+		if (token.kind == kFormatTokenError)
+			return -1;
+		if (token.kind == kFormatTokenField)
+			count++;
+	}
+	return count;
+}
+
+constexpr bool CheckFormatFields(std::string_view format, const FormatArgType *types, size_t count)
+{
+	size_t index = 0;
+	for (FormatToken token = NextFormatToken(format, 0); token.kind != kFormatTokenEnd;
+		token = NextFormatToken(format, token.next))
+	{
+		if (token.kind != kFormatTokenField)
+			continue;
+		FormatSpec spec;
+		if (index >= count || !ParseFormatSpec(token.spec, spec) || !IsFormatSpecValid(spec, types[index]))
+			return false;
+		index++;
+	}
+	return index == count;
+}
+
+template <typename Format, typename... Args>
+inline void CheckFormat()
+{
+	if constexpr (std::is_base_of<CompileTimeFormat, Format>::value)
+	{
+		constexpr FormatArgType types[] = { FormatArgTraits<typename std::decay<Args>::type>::kType..., kFormatArgNone };
+		static_assert(CountFormatFields(Format::Get()) >= 0, "unmatched '{' or '}' in the format string");
+		static_assert(CountFormatFields(Format::Get()) == (int)sizeof...(Args),
+			"the number of fields in the format string does not match the arguments");
+		static_assert(CheckFormatFields(Format::Get(), types, sizeof...(Args)),
+			"a field spec is invalid or does not fit the type of its argument");
+		(void)types;
+	}
+}
+
+template <typename Format>
+inline std::string_view GetFormatString(const Format &format)
+{
+	if constexpr (std::is_base_of<CompileTimeFormat, Format>::value)
+		return Format::Get();
+	else
+		return std::string_view(format);
+}
+
+// the destination of the formatted text: a fixed buffer which drops what does not fit,
+// or a buffer which the subclass grows
+class EXTENSION_EXPORT FormatOutput
+{
+public:
+	FormatOutput(char *data, size_t capacity) : data_(data), size_(0), capacity_(capacity), total_(0) {}
+	virtual ~FormatOutput() {}
+
+	void Append(const char *data, size_t size)
+	{
+		total_ += size;
+		if (size > capacity_ - size_ && !Grow(size))
+			size = capacity_ - size_;
+		if (size == 0)
+			return;
+		memcpy(data_ + size_, data, size);
+		size_ += size;
+	}
+	void Append(size_t count, char c)
+	{
+		total_ += count;
+		if (count > capacity_ - size_ && !Grow(count))
+			count = capacity_ - size_;
+		if (count == 0)
+			return;
+		memset(data_ + size_, c, count);
+		size_ += count;
+	}
+
+	char *data() const { return data_; }
+	// the bytes written
+	size_t size() const { return size_; }
+	// the bytes of the whole text, more than size() if it has been truncated
+	size_t total() const { return total_; }
+
+protected:
+	// makes room for |more| bytes after size() and updates data_ and capacity_, false to truncate
+	virtual bool Grow(size_t more) { return false; }
+
+	char *data_;
+	size_t size_;
+	size_t capacity_;
+
+private:
+	size_t total_;
+};
+
+// formats in place at the end of a std::string, which is cut to the text at last
+class EXTENSION_EXPORT StringFormatOutput : public FormatOutput
+{
+public:
+	StringFormatOutput(std::string &output, size_t size_hint);
+	virtual ~StringFormatOutput();
+
+protected:
+	virtual bool Grow(size_t more) override;
+
+private:
+	std::string &output_;
+	size_t offset_;
+};
+
+// formats on the stack and then on the heap if the text is longer
+class EXTENSION_EXPORT InlineFormatOutput : public FormatOutput
+{
+public:
+	InlineFormatOutput() : FormatOutput(inline_buffer_, sizeof(inline_buffer_)) {}
+
+protected:
+	virtual bool Grow(size_t more) override;
+
+private:
+	char inline_buffer_[512];
+	std::string heap_buffer_;
+};
+
+EXTENSION_EXPORT void FormatArgs(FormatOutput &output, std::string_view format, const FormatArg *args, size_t count);
+
+template <typename Format, typename... Args>
+inline void FormatTo(FormatOutput &output, const Format &format, const Args &... args)
+{
+	const FormatArg arg_list[] = { MakeFormatArg(args)..., FormatArg() };
+	FormatArgs(output, GetFormatString(format), arg_list, sizeof...(Args));
+}
+}
+
+// appends the text to |output|
+template <typename Format, typename... Args>
+inline void StringFormatAppend(std::string &output, const Format &format, const Args &... args)
+{
+	internal::CheckFormat<Format, Args...>();
+	std::string_view format_string = internal::GetFormatString(format);
+	internal::StringFormatOutput string_output(output, format_string.size() + 16 * sizeof...(Args));
+	internal::FormatTo(string_output, format_string, args...);
+}
+
+template <typename Format, typename... Args>
+inline std::string StringFormat(const Format &format, const Args &... args)
+{
+	internal::CheckFormat<Format, Args...>();
+	std::string output;
+	StringFormatAppend(output, internal::GetFormatString(format), args...);
+	return output;
+}
+
+// writes the text to the caller buffer of |size| bytes like snprintf: it is always ended by a '\0' and
+// the return is the length of the whole text without the '\0', which is not less than |size| if truncated
+template <typename Format, typename... Args>
+inline size_t StringFormatTo(char *buffer, size_t size, const Format &format, const Args &... args)
+{
+	internal::CheckFormat<Format, Args...>();
+	internal::FormatOutput output(buffer, size > 0 ? size - 1 : 0);
+	internal::FormatTo(output, internal::GetFormatString(format), args...);
+	if (size > 0)
+		buffer[output.size()] = '\0';
+	return output.total();
+}
+
+// appends the text to a BlockBuffer, nothing is appended and false is returned if it exceeds maxsize()
+template <typename BlockAllocator, unsigned MaxBlocks, typename Format, typename... Args>
+inline bool StringFormatAppend(BlockBuffer<BlockAllocator, MaxBlocks> &output, const Format &format, const Args &... args)
+{
+	internal::CheckFormat<Format, Args...>();
+	internal::InlineFormatOutput text;
+	internal::FormatTo(text, internal::GetFormatString(format), args...);
+	return output.append(text.data(), text.size());
+}
+
+EXTENSION_END_DECLS
+
+#endif  // BASE_EXTENSION_STRINGS_STRING_FORMAT_H_
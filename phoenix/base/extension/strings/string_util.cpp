@@ -20,10 +20,229 @@
 #include "google_base/base/strings/sys_string_conversions.h"
 #include "google_base/base/strings/string_split.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_UTIL_USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define STRING_UTIL_USE_NEON
+#include <arm_neon.h>
+#endif
+
 EXTENSION_BEGIN_DECLS
 
 namespace
 {
+const char kLowerHexChars[] = "0123456789abcdef";
+
+// Widens the leading ASCII run of 'src' into 'dst' 16 characters at a time and returns its length;
+// the run stops at the first chunk containing a non-ASCII byte, the caller continues with the scalar code
+size_t WidenASCIIRun(const char *src, size_t length, UTF16CharType *dst)
+{
+	size_t i = 0;
+#if defined(STRING_UTIL_USE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		if (_mm_movemask_epi8(chunk) != 0)
+			break;
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi8(chunk, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_unpackhi_epi8(chunk, zero));
+	}
+#elif defined(STRING_UTIL_USE_NEON)
+	for (; i + 16 <= length; i += 16)
+	{
+		uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+		if (vmaxvq_u8(chunk) >= 0x80)
+			break;
+		vst1q_u16(reinterpret_cast<uint16_t *>(dst + i), vmovl_u8(vget_low_u8(chunk)));
+		vst1q_u16(reinterpret_cast<uint16_t *>(dst + i + 8), vmovl_high_u8(chunk));
+	}
+#endif
+	for (; i < length && (unsigned char)src[i] < 0x80; i++)
+		dst[i] = (UTF16CharType)src[i];
+	return i;
+}
+
+// The UTF-16 counterpart of WidenASCIIRun, 8 code units at a time
+size_t NarrowASCIIRun(const UTF16CharType *src, size_t length, char *dst)
+{
+	size_t i = 0;
+#if defined(STRING_UTIL_USE_SSE2)
+	const __m128i non_ascii = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= length; i += 8)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, non_ascii), zero)) != 0xFFFF)
+			break;
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(chunk, chunk));
+	}
+#elif defined(STRING_UTIL_USE_NEON)
+	for (; i + 8 <= length; i += 8)
+	{
+		uint16x8_t chunk = vld1q_u16(reinterpret_cast<const uint16_t *>(src + i));
+		if (vmaxvq_u16(chunk) >= 0x80)
+			break;
+		vst1_u8(reinterpret_cast<uint8_t *>(dst + i), vmovn_u16(chunk));
+	}
+#endif
+	for (; i < length && (uint32_t)src[i] < 0x80; i++)
+		dst[i] = (char)src[i];
+	return i;
+}
+
+// Length of the leading ASCII run of 'data'
+size_t ASCIIPrefixLength(const unsigned char *data, size_t length)
+{
+	size_t i = 0;
+#if defined(STRING_UTIL_USE_SSE2)
+	for (; i + 16 <= length; i += 16)
+	{
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))) != 0)
+			break;
+	}
+#elif defined(STRING_UTIL_USE_NEON)
+	for (; i + 16 <= length && vmaxvq_u8(vld1q_u8(data + i)) < 0x80; i += 16)
+		;
+#endif
+	while (i < length && data[i] < 0x80)
+		i++;
+	return i;
+}
+
+// Encodes 16 bytes into 32 lower case hexadecimal characters
+#if defined(STRING_UTIL_USE_SSE2)
+inline __m128i NibblesToHex(__m128i nibbles)
+{
+	// '0' + n for 0-9, 'a' - 10 + n for 10-15
+	__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Signed compares: bytes >= 0x80 are negative and fall outside every range
+inline __m128i InRange(__m128i chunk, char low, char high)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1)));
+}
+
+// Decodes 16 hexadecimal characters into nibbles, 'valid' is all ones when every character is hexadecimal
+inline __m128i HexToNibbles(__m128i chunk, bool *valid)
+{
+	__m128i digit = InRange(chunk, '0', '9');
+	__m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+	__m128i letter = InRange(lower, 'a', 'f');
+	*valid = _mm_movemask_epi8(_mm_or_si128(digit, letter)) == 0xFFFF;
+	__m128i digit_value = _mm_and_si128(digit, _mm_sub_epi8(chunk, _mm_set1_epi8('0')));
+	__m128i letter_value = _mm_and_si128(letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+	return _mm_or_si128(digit_value, letter_value);
+}
+#endif
+
+size_t EncodeHexChunks(const unsigned char *src, size_t length, unsigned char *dst)
+{
+	size_t i = 0;
+#if defined(STRING_UTIL_USE_SSE2)
+	const __m128i low_mask = _mm_set1_epi8(0x0F);
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i high = NibblesToHex(_mm_and_si128(_mm_srli_epi16(chunk, 4), low_mask));
+		__m128i low = NibblesToHex(_mm_and_si128(chunk, low_mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i << 1)), _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i << 1) + 16), _mm_unpackhi_epi8(high, low));
+	}
+#elif defined(STRING_UTIL_USE_NEON)
+	const uint8x16_t table = vld1q_u8(reinterpret_cast<const uint8_t *>(kLowerHexChars));
+	for (; i + 16 <= length; i += 16)
+	{
+		uint8x16_t chunk = vld1q_u8(src + i);
+		uint8x16x2_t hex;
+		hex.val[0] = vqtbl1q_u8(table, vshrq_n_u8(chunk, 4));
+		hex.val[1] = vqtbl1q_u8(table, vandq_u8(chunk, vdupq_n_u8(0x0F)));
+		vst2q_u8(dst + (i << 1), hex);
+	}
+#endif
+	return i;
+}
+
+// Decodes 32 characters at a time into 'dst' and returns the number of bytes written;
+// stops before the first chunk containing a non-hexadecimal character
+size_t DecodeHexChunks(const char *src, size_t size, char *dst)
+{
+	size_t i = 0;
+#if defined(STRING_UTIL_USE_SSE2)
+	const __m128i low_byte = _mm_set1_epi16(0x00FF);
+	for (; i + 16 <= size; i += 16)
+	{
+		bool valid_first = false, valid_second = false;
+		__m128i first = HexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i << 1))), &valid_first);
+		__m128i second = HexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i << 1) + 16)), &valid_second);
+		if (!valid_first || !valid_second)
+			break;
+		// Each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte
+		first = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(first, low_byte), 4), _mm_srli_epi16(first, 8));
+		second = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(second, low_byte), 4), _mm_srli_epi16(second, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(first, second));
+	}
+#elif defined(STRING_UTIL_USE_NEON)
+	for (; i + 16 <= size; i += 16)
+	{
+		uint8x16x2_t chars = vld2q_u8(reinterpret_cast<const uint8_t *>(src + (i << 1)));
+		uint8x16_t nibbles[2];
+		bool valid = true;
+		for (int k = 0; k < 2; k++)
+		{
+			uint8x16_t digit = vsubq_u8(chars.val[k], vdupq_n_u8('0'));
+			uint8x16_t letter = vsubq_u8(vorrq_u8(chars.val[k], vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+			uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+			uint8x16_t is_letter = vcltq_u8(letter, vdupq_n_u8(6));
+			valid = valid && vminvq_u8(vorrq_u8(is_digit, is_letter)) == 0xFF;
+			nibbles[k] = vbslq_u8(is_digit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+		}
+		if (!valid)
+			break;
+		vst1q_u8(reinterpret_cast<uint8_t *>(dst + i), vorrq_u8(vshlq_n_u8(nibbles[0], 4), nibbles[1]));
+	}
+#endif
+	return i;
+}
+
+const uint64_t kEachByte = 0x0101010101010101ull;
+const uint64_t kHighBits = 0x8080808080808080ull;
+
+// the high bit of each byte of the result is set if the byte of 'word' is an ASCII letter in [first, last]
+inline uint64_t ASCIIRangeMask(uint64_t word, unsigned char first, unsigned char last)
+{
+	uint64_t low_bits = word & ~kHighBits;
+	uint64_t above_last = low_bits + kEachByte * (0x7F - last);
+	uint64_t from_first = low_bits + kEachByte * (0x80 - first);
+	return (from_first ^ above_last) & ~word & kHighBits;
+}
+
+// 0x20 is the difference between the upper and lower case letters and equals kHighBits >> 2
+template<bool kToLower>
+void ChangeASCIICase(char *data, size_t length)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		if (kToLower)
+			word |= ASCIIRangeMask(word, 'A', 'Z') >> 2;
+		else
+			word &= ~(ASCIIRangeMask(word, 'a', 'z') >> 2);
+		memcpy(data + i, &word, sizeof(word));
+	}
+	for (; i < length; i++)
+	{
+		if (kToLower && data[i] >= 'A' && data[i] <= 'Z')
+			data[i] += 'a' - 'A';
+		else if (!kToLower && data[i] >= 'a' && data[i] <= 'z')
+			data[i] -= 'a' - 'A';
+	}
+}
 
 template<typename CharType>
 int StringTokenizeT(const std::basic_string<CharType> &input,
@@ -362,17 +581,49 @@ size_t StringReplaceAll(const UTF16String& find, const UTF16String& replace, UTF
 	return StringReplaceAllT<UTF16CharType>(find, replace, output);
 }
 
+void LowerASCII(char *data, size_t length)
+{
+	ChangeASCIICase<true>(data, length);
+}
+
+void UpperASCII(char *data, size_t length)
+{
+	ChangeASCIICase<false>(data, length);
+}
+
+bool EqualsCaseInsensitiveASCII(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size())
+		return false;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= a.size(); i += sizeof(uint64_t))
+	{
+		uint64_t x, y;
+		memcpy(&x, a.data() + i, sizeof(x));
+		memcpy(&y, b.data() + i, sizeof(y));
+		x |= ASCIIRangeMask(x, 'A', 'Z') >> 2;
+		y |= ASCIIRangeMask(y, 'A', 'Z') >> 2;
+		if (x != y)
+			return false;
+	}
+	for (; i < a.size(); i++)
+	{
+		char x = a[i], y = b[i];
+		if (x >= 'A' && x <= 'Z')
+			x += 'a' - 'A';
+		if (y >= 'A' && y <= 'Z')
+			y += 'a' - 'A';
+		if (x != y)
+			return false;
+	}
+	return true;
+}
+
 void LowerString(UTF8String &str)
 {
 	if (str.empty())
 		return;
-	char *start = &str[0];
-	char *end = start + str.length();
-	for (; start < end; start++)
-	{
-		if (*start >= 'A' && *start <= 'Z')
-			*start += 'a' - 'A';
-	}
+	LowerASCII(&str[0], str.length());
 }
 
 void LowerString(UTF16String &str)
@@ -392,13 +643,7 @@ void UpperString(UTF8String &str)
 {
 	if (str.empty())
 		return;
-	char *start = &str[0];
-	char *end = start + str.length();
-	for (; start < end; start++)
-	{
-		if (*start >= 'a' && *start <= 'z')
-			*start -= 'a' - 'A';
-	}
+	UpperASCII(&str[0], str.length());
 }
 
 void UpperString(UTF16String &str)
@@ -453,7 +698,7 @@ void BinaryToHexString(const void *binary, size_t length, UTF8String &output)
 	unsigned char *dst = reinterpret_cast<unsigned char *>(&output[0]);
 	const unsigned char *src = reinterpret_cast<const unsigned char *>(binary);
 
-	for (size_t i = 0; i < length; i++)
+	for (size_t i = EncodeHexChunks(src, length, dst); i < length; i++)
 	{
 		dst[i<<1]   = kHexChars[src[i]>>4];
 		dst[(i<<1)+1] = kHexChars[src[i]&0xF];
@@ -484,7 +729,7 @@ int HexStringToBinary(const char *input, size_t length, UTF8String &output)
 	char *dst = &output[0];
 	size_t i, size = output.size();
 
-	for (i = 0; i < size; i++)
+	for (i = DecodeHexChunks(src, size, dst); i < size; i++)
 	{
 		char h = HexCharToInt8(src[i<<1]);
 		char l = HexCharToInt8(src[(i<<1)+1]);
@@ -518,17 +763,94 @@ char HexCharToInt8(char c)
 	return -1;
 }
 
+// ASCII runs are converted with SIMD, the other characters are decoded by base::ReadUnicodeCharacter
+// one at a time, invalid sequences become U+FFFD as with base::UTF8ToUTF16
 UTF16String UTF8ToUTF16(const UTF8CharType *utf8, size_t length)
 {
-	base::string16 utf16;
-	base::UTF8ToUTF16(utf8, length, &utf16);
-	return utf16.c_str();
+	UTF16String utf16;
+	if (length == 0)
+		return utf16;
+	// every byte yields at most one UTF-16 code unit
+	utf16.resize(length);
+	UTF16CharType *dst = &utf16[0];
+	size_t written = 0;
+	int32_t src_length = static_cast<int32_t>(length);
+	for (int32_t i = 0; i < src_length; i++)
+	{
+		size_t run = WidenASCIIRun(utf8 + i, length - i, dst + written);
+		written += run;
+		i += static_cast<int32_t>(run);
+		if (i >= src_length)
+			break;
+		uint32_t code_point;
+		if (!base::ReadUnicodeCharacter(utf8, src_length, &i, &code_point))
+			code_point = 0xFFFD;
+		if (code_point <= 0xFFFF)
+		{
+			dst[written++] = static_cast<UTF16CharType>(code_point);
+		}
+		else
+		{
+			dst[written++] = static_cast<UTF16CharType>(0xD7C0 + (code_point >> 10));
+			dst[written++] = static_cast<UTF16CharType>(0xDC00 | (code_point & 0x3FF));
+		}
+	}
+	utf16.resize(written);
+	return utf16;
 }
 
 UTF8String UTF16ToUTF8(const UTF16CharType *utf16, size_t length)
 {
 	UTF8String utf8;
-	base::UTF16ToUTF8(utf16, length, &utf8);
+	if (length == 0)
+		return utf8;
+	const base::char16 *src = reinterpret_cast<const base::char16 *>(utf16);
+	utf8.resize(length);
+	size_t written = 0;
+	int32_t src_length = static_cast<int32_t>(length);
+	for (int32_t i = 0; i < src_length; i++)
+	{
+		// the buffer always has room for the rest of the input as ASCII
+		size_t run = NarrowASCIIRun(utf16 + i, length - i, &utf8[written]);
+		written += run;
+		i += static_cast<int32_t>(run);
+		if (i >= src_length)
+			break;
+		// a character takes at most 4 bytes for the at least 1 code unit it consumes
+		if (written + 4 + (length - i) > utf8.size())
+			utf8.resize(utf8.size() * 2 + 4);
+		uint32_t code_point;
+		if (!base::ReadUnicodeCharacter(src, src_length, &i, &code_point))
+			code_point = 0xFFFD;
+		char *dst = &utf8[written];
+		if (code_point < 0x80)
+		{
+			dst[0] = static_cast<char>(code_point);
+			written += 1;
+		}
+		else if (code_point < 0x800)
+		{
+			dst[0] = static_cast<char>(0xC0 | (code_point >> 6));
+			dst[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+			written += 2;
+		}
+		else if (code_point < 0x10000)
+		{
+			dst[0] = static_cast<char>(0xE0 | (code_point >> 12));
+			dst[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+			dst[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+			written += 3;
+		}
+		else
+		{
+			dst[0] = static_cast<char>(0xF0 | (code_point >> 18));
+			dst[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+			dst[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+			dst[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+			written += 4;
+		}
+	}
+	utf8.resize(written);
 	return utf8;
 }
 
@@ -616,6 +938,13 @@ bool ValidateUTF8Stream(const void* stream, unsigned length)
 
 	for (i = 0; i < length;)
 	{
+		/* ASCII 字符一次检查 16 个 */
+		if (s[i] < 0x80)
+		{
+			i += (unsigned)ASCIIPrefixLength(s + i, length - i);
+			if (i == length)
+				break;
+		}
 		k = table[s[i]];
 		if (k == 0)
 			break;
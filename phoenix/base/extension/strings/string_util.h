@@ -3,7 +3,10 @@
 
 #include "extension/extension_export.h"
 #include "extension/config/build_config.h"
+#include <iterator>
 #include <list>
+#include <string_view>
+#include "base/containers/stack_container.h"
 #include "extension/strings/unicode.h"
 
 EXTENSION_BEGIN_DECLS
@@ -38,6 +41,88 @@ EXTENSION_EXPORT std::list<UTF16String> StringTokenize(const UTF16CharType *inpu
 EXTENSION_EXPORT int StringTokenize(const UTF8String& input, const UTF8String& delimitor, std::list<UTF8String>& output);
 EXTENSION_EXPORT int StringTokenize(const UTF16String& input, const UTF16String& delimitor, std::list<UTF16String>& output);
 
+// the non-allocating form of StringTokenize: a range whose iterator finds the tokens lazily,
+// each token is a view into 'input', which must outlive the views
+//
+//	for (std::string_view field : StringTokens(header_line, "; "))
+//		...
+template<typename CharType>
+class StringTokenRange
+{
+public:
+	typedef std::basic_string_view<CharType> StringView;
+
+	class iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef StringView value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const StringView* pointer;
+		typedef const StringView& reference;
+
+		iterator() : begin_(StringView::npos), end_(StringView::npos) {}
+		iterator(StringView input, StringView delimitor) : input_(input), delimitor_(delimitor) { Find(0); }
+
+		reference operator*() const { return token_; }
+		pointer operator->() const { return &token_; }
+		iterator& operator++() { Find(end_); return *this; }
+		iterator operator++(int) { iterator old(*this); Find(end_); return old; }
+		// only iterators of the same range can be compared
+		bool operator==(const iterator &other) const { return begin_ == other.begin_; }
+		bool operator!=(const iterator &other) const { return begin_ != other.begin_; }
+
+	private:
+		void Find(size_t from)
+		{
+			begin_ = from == StringView::npos ? StringView::npos : input_.find_first_not_of(delimitor_, from);
+			if (begin_ == StringView::npos)
+			{
+				end_ = StringView::npos;
+				token_ = StringView();
+				return;
+			}
+			end_ = input_.find_first_of(delimitor_, begin_ + 1);
+			token_ = input_.substr(begin_, end_ == StringView::npos ? StringView::npos : end_ - begin_);
+		}
+
+		StringView input_;
+		StringView delimitor_;
+		StringView token_;
+		size_t begin_;
+		size_t end_;
+	};
+
+	StringTokenRange(StringView input, StringView delimitor) : input_(input), delimitor_(delimitor) {}
+
+	iterator begin() const { return iterator(input_, delimitor_); }
+	iterator end() const { return iterator(); }
+
+private:
+	StringView input_;
+	StringView delimitor_;
+};
+
+inline StringTokenRange<char> StringTokens(std::string_view input, std::string_view delimitor)
+{
+	return StringTokenRange<char>(input, delimitor);
+}
+inline StringTokenRange<UTF16CharType> StringTokens(std::basic_string_view<UTF16CharType> input,
+													std::basic_string_view<UTF16CharType> delimitor)
+{
+	return StringTokenRange<UTF16CharType>(input, delimitor);
+}
+
+// split 'input' into views of its tokens, at most N of them are stored without allocating
+template<size_t N>
+size_t StringSplit(std::string_view input, std::string_view delimitor, base::StackVector<std::string_view, N> &output)
+{
+	output->clear();
+	for (std::string_view token : StringTokens(input, delimitor))
+		output->push_back(token);
+	return output->size();
+}
+
 // replace all 'find' with 'replace' in the string
 EXTENSION_EXPORT size_t StringReplaceAll(const UTF8String& find, const UTF8String& replace, UTF8String& output);
 EXTENSION_EXPORT size_t StringReplaceAll(const UTF16String& find, const UTF16String& replace, UTF16String& output);
@@ -47,6 +132,13 @@ EXTENSION_EXPORT void BinaryToHexString(const void *binary, size_t length, UTF8S
 EXTENSION_EXPORT UTF8String BinaryToHexString(const void *binary, size_t length);
 EXTENSION_EXPORT UTF8String BinaryToHexString(const UTF8String &binary);
 
+// in-place case folding of the ASCII letters, the other bytes (including utf-8 sequences) are kept,
+// 8 bytes are handled at a time
+EXTENSION_EXPORT void LowerASCII(char *data, size_t length);
+EXTENSION_EXPORT void UpperASCII(char *data, size_t length);
+// compare two strings ignoring the case of the ASCII letters, without making lower case copies
+EXTENSION_EXPORT bool EqualsCaseInsensitiveASCII(std::string_view a, std::string_view b);
+
 EXTENSION_EXPORT void LowerString(UTF8String &str);
 EXTENSION_EXPORT void LowerString(UTF16String &str);
 EXTENSION_EXPORT void UpperString(UTF8String &str);
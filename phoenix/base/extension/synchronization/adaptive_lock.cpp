@@ -0,0 +1,306 @@
+#include "extension/synchronization/adaptive_lock.h"
+#include <algorithm>
+#include <thread>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#endif
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const int kMaxSpins = 100;
+const int kMinSpins = 10;
+
+inline void CpuRelax()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+bool IsMultiProcessor()
+{
+	static const bool multi_processor = std::thread::hardware_concurrency() > 1;
+	return multi_processor;
+}
+
+// 与 glibc 的 PTHREAD_MUTEX_ADAPTIVE_NP 相同：最多自旋最近所需次数的两倍，结果按 1/8 平滑；
+// 单核上持锁的线程不可能在自旋期间释放锁，直接睡眠
+template <typename TryLock>
+bool SpinTry(std::atomic<int> &estimate, TryLock try_lock)
+{
+	if (!IsMultiProcessor())
+		return false;
+	int current = estimate.load(std::memory_order_relaxed);
+	int max_spins = std::min(kMaxSpins, current * 2 + kMinSpins);
+	for (int spins = 1; spins <= max_spins; ++spins)
+	{
+		CpuRelax();
+		if (try_lock())
+		{
+			estimate.store(current + (spins - current) / 8, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	estimate.store(current + (max_spins - current) / 8, std::memory_order_relaxed);
+	return false;
+}
+
+#if defined(OS_WIN)
+static_assert(sizeof(SRWLOCK) == sizeof(void *), "SRWLOCK must fit in a pointer");
+
+inline PSRWLOCK ToSRWLock(void **lock)
+{
+	return reinterpret_cast<PSRWLOCK>(lock);
+}
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+inline void FutexWait(std::atomic<int> *address, int value)
+{
+	syscall(SYS_futex, reinterpret_cast<int *>(address), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+inline void FutexWake(std::atomic<int> *address, int count)
+{
+	syscall(SYS_futex, reinterpret_cast<int *>(address), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+#endif
+}
+
+#if defined(OS_WIN)
+
+AdaptiveLock::AdaptiveLock()
+	: srw_lock_(nullptr)
+	, spin_estimate_(0)
+{
+	InitializeSRWLock(ToSRWLock(&srw_lock_));
+}
+
+AdaptiveLock::~AdaptiveLock()
+{
+
+}
+
+void AdaptiveLock::lock()
+{
+	if (TryAcquireSRWLockExclusive(ToSRWLock(&srw_lock_)))
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return TryAcquireSRWLockExclusive(ToSRWLock(&srw_lock_)) != 0; }))
+		return;
+	AcquireSRWLockExclusive(ToSRWLock(&srw_lock_));
+}
+
+bool AdaptiveLock::try_lock()
+{
+	return TryAcquireSRWLockExclusive(ToSRWLock(&srw_lock_)) != 0;
+}
+
+void AdaptiveLock::unlock()
+{
+	ReleaseSRWLockExclusive(ToSRWLock(&srw_lock_));
+}
+
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+
+AdaptiveLock::AdaptiveLock()
+	: state_(0)
+	, spin_estimate_(0)
+{
+
+}
+
+AdaptiveLock::~AdaptiveLock()
+{
+
+}
+
+void AdaptiveLock::lock()
+{
+	if (try_lock())
+		return;
+	if (SpinTry(spin_estimate_, [this]() {
+			int expected = 0;
+			return state_.load(std::memory_order_relaxed) == 0
+				&& state_.compare_exchange_weak(expected, 1, std::memory_order_acquire);
+		}))
+		return;
+	//标记为有等待者后睡眠，被唤醒的线程同样以 2 加锁，保证它解锁时会唤醒下一个
+	int state = state_.exchange(2, std::memory_order_acquire);
+	while (state != 0)
+	{
+		FutexWait(&state_, 2);
+		state = state_.exchange(2, std::memory_order_acquire);
+	}
+}
+
+bool AdaptiveLock::try_lock()
+{
+	int expected = 0;
+	return state_.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+}
+
+void AdaptiveLock::unlock()
+{
+	if (state_.exchange(0, std::memory_order_release) == 2)
+		FutexWake(&state_, 1);
+}
+
+#else
+
+AdaptiveLock::AdaptiveLock()
+	: spin_estimate_(0)
+{
+	pthread_mutex_init(&mutex_, nullptr);
+}
+
+AdaptiveLock::~AdaptiveLock()
+{
+	pthread_mutex_destroy(&mutex_);
+}
+
+void AdaptiveLock::lock()
+{
+	if (try_lock())
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return pthread_mutex_trylock(&mutex_) == 0; }))
+		return;
+	pthread_mutex_lock(&mutex_);
+}
+
+bool AdaptiveLock::try_lock()
+{
+	return pthread_mutex_trylock(&mutex_) == 0;
+}
+
+void AdaptiveLock::unlock()
+{
+	pthread_mutex_unlock(&mutex_);
+}
+
+#endif
+
+#if defined(OS_WIN)
+
+RWLock::RWLock()
+	: srw_lock_(nullptr)
+	, spin_estimate_(0)
+{
+	InitializeSRWLock(ToSRWLock(&srw_lock_));
+}
+
+RWLock::~RWLock()
+{
+
+}
+
+void RWLock::lock()
+{
+	if (try_lock())
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return try_lock(); }))
+		return;
+	AcquireSRWLockExclusive(ToSRWLock(&srw_lock_));
+}
+
+bool RWLock::try_lock()
+{
+	return TryAcquireSRWLockExclusive(ToSRWLock(&srw_lock_)) != 0;
+}
+
+void RWLock::unlock()
+{
+	ReleaseSRWLockExclusive(ToSRWLock(&srw_lock_));
+}
+
+void RWLock::lock_shared()
+{
+	if (try_lock_shared())
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return try_lock_shared(); }))
+		return;
+	AcquireSRWLockShared(ToSRWLock(&srw_lock_));
+}
+
+bool RWLock::try_lock_shared()
+{
+	return TryAcquireSRWLockShared(ToSRWLock(&srw_lock_)) != 0;
+}
+
+void RWLock::unlock_shared()
+{
+	ReleaseSRWLockShared(ToSRWLock(&srw_lock_));
+}
+
+#else
+
+RWLock::RWLock()
+	: spin_estimate_(0)
+{
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+#if defined(__GLIBC__)
+	//glibc 默认读优先，读很频繁时写会一直拿不到锁
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&rwlock_, &attr);
+	pthread_rwlockattr_destroy(&attr);
+}
+
+RWLock::~RWLock()
+{
+	pthread_rwlock_destroy(&rwlock_);
+}
+
+void RWLock::lock()
+{
+	if (try_lock())
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return try_lock(); }))
+		return;
+	pthread_rwlock_wrlock(&rwlock_);
+}
+
+bool RWLock::try_lock()
+{
+	return pthread_rwlock_trywrlock(&rwlock_) == 0;
+}
+
+void RWLock::unlock()
+{
+	pthread_rwlock_unlock(&rwlock_);
+}
+
+void RWLock::lock_shared()
+{
+	if (try_lock_shared())
+		return;
+	if (SpinTry(spin_estimate_, [this]() { return try_lock_shared(); }))
+		return;
+	pthread_rwlock_rdlock(&rwlock_);
+}
+
+bool RWLock::try_lock_shared()
+{
+	return pthread_rwlock_tryrdlock(&rwlock_) == 0;
+}
+
+void RWLock::unlock_shared()
+{
+	pthread_rwlock_unlock(&rwlock_);
+}
+
+#endif
+
+EXTENSION_END_DECLS
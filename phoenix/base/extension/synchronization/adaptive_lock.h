@@ -0,0 +1,135 @@
+// non-recursive spin-then-park mutex and reader-writer lock for short critical sections
+
+#ifndef __BASE_EXTENSION_ADAPTIVE_LOCK_H__
+#define __BASE_EXTENSION_ADAPTIVE_LOCK_H__
+
+#include "extension/config/build_config.h"
+
+#include <atomic>
+#include <assert.h>
+#if defined(OS_POSIX)
+#include <pthread.h>
+#endif
+#include "base/macros.h"
+
+#include "extension/extension_export.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 非递归的互斥锁，用于只保护几条语句的临界区。
+// 拿不到锁时先自旋一小段（多核上才自旋，次数按最近几次的实际情况自适应，最多约 100 次 pause），
+// 仍拿不到再睡眠等待：Linux / Android 上为 futex，Windows 上为 SRWLock，其他平台为 pthread_mutex。
+// 与 NLock（std::recursive_mutex）不同，同一线程重复加锁会死锁；
+// 接口与 std::mutex 相同，也可以用于 std::lock_guard / std::unique_lock / std::condition_variable_any
+class EXTENSION_EXPORT AdaptiveLock
+{
+public:
+	AdaptiveLock();
+	~AdaptiveLock();
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+private:
+#if defined(OS_WIN)
+	void				*srw_lock_;		// SRWLOCK，避免在头文件中包含 windows.h
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+	std::atomic<int>	state_;			// 0 未加锁，1 已加锁，2 已加锁且可能有线程在等待
+#else
+	pthread_mutex_t		mutex_;
+#endif
+	std::atomic<int>	spin_estimate_;
+
+	DISALLOW_COPY_AND_ASSIGN(AdaptiveLock);
+};
+
+// 读写锁，用于读多写少的表：读之间不互斥，写与读、写互斥。
+// Windows 上为 SRWLock，POSIX 上为 pthread_rwlock（glibc 上写优先，持续的读不会饿死写），
+// 拿不到锁时同样先短暂自旋。不可重入：持有读锁时再加写锁或读锁都可能死锁。
+// 接口与 std::shared_mutex 相同，也可以用于 std::shared_lock
+class EXTENSION_EXPORT RWLock
+{
+public:
+	RWLock();
+	~RWLock();
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	void lock_shared();
+	bool try_lock_shared();
+	void unlock_shared();
+
+private:
+#if defined(OS_WIN)
+	void				*srw_lock_;
+#else
+	pthread_rwlock_t	rwlock_;
+#endif
+	std::atomic<int>	spin_estimate_;
+
+	DISALLOW_COPY_AND_ASSIGN(RWLock);
+};
+
+class EXTENSION_EXPORT AdaptiveAutoLock
+{
+public:
+	explicit AdaptiveAutoLock(AdaptiveLock *lock) : lock_(lock)
+	{
+		assert(lock);
+		lock_->lock();
+	}
+
+	~AdaptiveAutoLock()
+	{
+		lock_->unlock();
+	}
+
+private:
+	AdaptiveLock *lock_;
+	DISALLOW_COPY_AND_ASSIGN(AdaptiveAutoLock);
+};
+
+class EXTENSION_EXPORT ReadAutoLock
+{
+public:
+	explicit ReadAutoLock(RWLock *lock) : lock_(lock)
+	{
+		assert(lock);
+		lock_->lock_shared();
+	}
+
+	~ReadAutoLock()
+	{
+		lock_->unlock_shared();
+	}
+
+private:
+	RWLock *lock_;
+	DISALLOW_COPY_AND_ASSIGN(ReadAutoLock);
+};
+
+class EXTENSION_EXPORT WriteAutoLock
+{
+public:
+	explicit WriteAutoLock(RWLock *lock) : lock_(lock)
+	{
+		assert(lock);
+		lock_->lock();
+	}
+
+	~WriteAutoLock()
+	{
+		lock_->unlock();
+	}
+
+private:
+	RWLock *lock_;
+	DISALLOW_COPY_AND_ASSIGN(WriteAutoLock);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_ADAPTIVE_LOCK_H__
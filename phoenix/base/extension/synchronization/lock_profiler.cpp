@@ -0,0 +1,182 @@
+#include "extension/synchronization/lock_profiler.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include "base/metrics/histogram.h"
+#include "base/metrics/statistics_recorder.h"
+#include "base/strings/stringprintf.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const char kHistogramPrefix[] = "Lock.";
+const int kHistogramMaxMicroseconds = 10 * 1000 * 1000;
+const size_t kHistogramBuckets = 50;
+
+std::atomic<bool> g_lock_profiler_enabled(false);
+
+struct SiteRegistry
+{
+	base::Lock lock;
+	std::map<std::string, std::unique_ptr<LockSite>> sites;
+};
+
+SiteRegistry* GetRegistry()
+{
+	static SiteRegistry *registry = new SiteRegistry;
+	return registry;
+}
+
+void UpdateMax(std::atomic<int64_t> &max_value, int64_t value)
+{
+	int64_t current = max_value.load(std::memory_order_relaxed);
+	while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+}
+
+LockSite::LockSite(const std::string &name)
+	: name_(name)
+	, acquisitions_(0)
+	, contended_(0)
+	, total_wait_(0)
+	, max_wait_(0)
+	, total_hold_(0)
+	, max_hold_(0)
+	, wait_histogram_(nullptr)
+	, hold_histogram_(nullptr)
+{
+
+}
+
+void LockSite::RecordAcquire(bool contended, TimeDelta wait)
+{
+	acquisitions_.fetch_add(1, std::memory_order_relaxed);
+	if (!contended)
+		return;
+	int64_t wait_us = wait.InMicroseconds();
+	contended_.fetch_add(1, std::memory_order_relaxed);
+	total_wait_.fetch_add(wait_us, std::memory_order_relaxed);
+	UpdateMax(max_wait_, wait_us);
+	EnsureHistograms();
+	if (wait_histogram_ != nullptr)
+		wait_histogram_->Add((int)std::min<int64_t>(wait_us, kHistogramMaxMicroseconds));
+}
+
+void LockSite::RecordHold(TimeDelta hold)
+{
+	int64_t hold_us = hold.InMicroseconds();
+	total_hold_.fetch_add(hold_us, std::memory_order_relaxed);
+	UpdateMax(max_hold_, hold_us);
+	EnsureHistograms();
+	if (hold_histogram_ != nullptr)
+		hold_histogram_->Add((int)std::min<int64_t>(hold_us, kHistogramMaxMicroseconds));
+}
+
+LockSiteStats LockSite::Snapshot() const
+{
+	LockSiteStats stats;
+	stats.name = name_;
+	stats.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+	stats.contended = contended_.load(std::memory_order_relaxed);
+	stats.total_wait = TimeDelta::FromMicroseconds(total_wait_.load(std::memory_order_relaxed));
+	stats.max_wait = TimeDelta::FromMicroseconds(max_wait_.load(std::memory_order_relaxed));
+	stats.total_hold = TimeDelta::FromMicroseconds(total_hold_.load(std::memory_order_relaxed));
+	stats.max_hold = TimeDelta::FromMicroseconds(max_hold_.load(std::memory_order_relaxed));
+	return stats;
+}
+
+void LockSite::Reset()
+{
+	acquisitions_.store(0, std::memory_order_relaxed);
+	contended_.store(0, std::memory_order_relaxed);
+	total_wait_.store(0, std::memory_order_relaxed);
+	max_wait_.store(0, std::memory_order_relaxed);
+	total_hold_.store(0, std::memory_order_relaxed);
+	max_hold_.store(0, std::memory_order_relaxed);
+}
+
+void LockSite::EnsureHistograms()
+{
+	//锁可能是静态对象，在 StatisticsRecorder 可用之前构造，直方图到第一次记录时再创建
+	std::call_once(histograms_once_, [this]() {
+		base::StatisticsRecorder::Initialize();
+		wait_histogram_ = base::Histogram::FactoryGet(kHistogramPrefix + name_ + ".WaitTime",
+			1, kHistogramMaxMicroseconds, kHistogramBuckets, base::HistogramBase::kNoFlags);
+		hold_histogram_ = base::Histogram::FactoryGet(kHistogramPrefix + name_ + ".HoldTime",
+			1, kHistogramMaxMicroseconds, kHistogramBuckets, base::HistogramBase::kNoFlags);
+	});
+}
+
+void LockProfiler::SetEnabled(bool enabled)
+{
+	g_lock_profiler_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool LockProfiler::IsEnabled()
+{
+	return g_lock_profiler_enabled.load(std::memory_order_relaxed);
+}
+
+LockSite* LockProfiler::GetSite(const std::string &name)
+{
+	SiteRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	std::unique_ptr<LockSite> &site = registry->sites[name];
+	if (!site)
+		site.reset(new LockSite(name));
+	return site.get();
+}
+
+std::vector<LockSiteStats> LockProfiler::Snapshot()
+{
+	std::vector<LockSiteStats> result;
+	{
+		SiteRegistry *registry = GetRegistry();
+		base::AutoLock lock(registry->lock);
+		result.reserve(registry->sites.size());
+		for (const auto &it : registry->sites)
+			result.push_back(it.second->Snapshot());
+	}
+	std::sort(result.begin(), result.end(), [](const LockSiteStats &a, const LockSiteStats &b) {
+		if (a.total_wait != b.total_wait)
+			return a.total_wait > b.total_wait;
+		return a.contended > b.contended;
+	});
+	return result;
+}
+
+std::string LockProfiler::Dump(size_t max_sites)
+{
+	std::vector<LockSiteStats> sites = Snapshot();
+	std::string output = base::StringPrintf("Lock sites (profiling %s), by total wait:\n", IsEnabled() ? "on" : "off");
+	for (size_t i = 0; i < sites.size() && i < max_sites; ++i)
+	{
+		const LockSiteStats &stats = sites[i];
+		if (stats.acquisitions == 0)
+			continue;
+		base::StringAppendF(&output,
+			"  %s: acquisitions=%llu contended=%llu (%.2f%%) wait total=%.3fms max=%lldus hold total=%.3fms max=%lldus\n",
+			stats.name.c_str(),
+			(unsigned long long)stats.acquisitions,
+			(unsigned long long)stats.contended,
+			stats.contended * 100.0 / stats.acquisitions,
+			stats.total_wait.InMicroseconds() / 1000.0,
+			(long long)stats.max_wait.InMicroseconds(),
+			stats.total_hold.InMicroseconds() / 1000.0,
+			(long long)stats.max_hold.InMicroseconds());
+	}
+	base::StatisticsRecorder::WriteGraph(kHistogramPrefix, &output);
+	return output;
+}
+
+void LockProfiler::Reset()
+{
+	SiteRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	for (auto &it : registry->sites)
+		it.second->Reset();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,227 @@
+// optional per-site lock contention statistics: wait time, hold time and contended acquisitions
+
+#ifndef __BASE_EXTENSION_LOCK_PROFILER_H__
+#define __BASE_EXTENSION_LOCK_PROFILER_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "base/location.h"
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+namespace base
+{
+class HistogramBase;
+}
+
+EXTENSION_BEGIN_DECLS
+
+struct LockSiteStats
+{
+	LockSiteStats() : acquisitions(0), contended(0) {}
+
+	std::string name;
+	uint64_t acquisitions;		// 独占和共享加锁的总次数
+	uint64_t contended;			// 没能立即拿到锁的次数
+	TimeDelta total_wait;		// 只统计没能立即拿到锁时的等待
+	TimeDelta max_wait;
+	TimeDelta total_hold;		// 只统计独占持有的时间，递归锁按最外层计
+	TimeDelta max_hold;
+};
+
+// 一个加锁位置的统计，同名的锁（如同一个类的多个实例）共用一个，由 LockProfiler 创建且不释放
+class EXTENSION_EXPORT LockSite
+{
+public:
+	explicit LockSite(const std::string &name);
+
+	const std::string& name() const { return name_; }
+	void RecordAcquire(bool contended, TimeDelta wait);
+	void RecordHold(TimeDelta hold);
+	LockSiteStats Snapshot() const;
+	void Reset();
+
+private:
+	void EnsureHistograms();
+
+	std::string name_;
+	std::atomic<uint64_t> acquisitions_;
+	std::atomic<uint64_t> contended_;
+	// 以下单位为微秒
+	std::atomic<int64_t> total_wait_;
+	std::atomic<int64_t> max_wait_;
+	std::atomic<int64_t> total_hold_;
+	std::atomic<int64_t> max_hold_;
+	std::once_flag histograms_once_;
+	base::HistogramBase *wait_histogram_;
+	base::HistogramBase *hold_histogram_;
+
+	DISALLOW_COPY_AND_ASSIGN(LockSite);
+};
+
+// 锁竞争统计的开关和汇总。默认关闭，关闭时 ProfiledLock 只多一次原子读；
+// 打开后每次加锁记录等待时间和持有时间，同时写入 base/metrics 直方图
+// Lock.<name>.WaitTime / HoldTime（单位微秒，等待只记录发生竞争的那些次），
+// Dump 按总等待时间由高到低列出各加锁位置，用来找出 SDK 各线程之间争抢最厉害的锁
+class EXTENSION_EXPORT LockProfiler
+{
+public:
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+
+	// 同名的返回同一个 LockSite，可以在任意线程调用
+	static LockSite* GetSite(const std::string &name);
+	// 按总等待时间由高到低
+	static std::vector<LockSiteStats> Snapshot();
+	// 最多 max_sites 个加锁位置的汇总，以及 Lock. 开头的直方图
+	static std::string Dump(size_t max_sites = 20);
+	// 清空汇总，直方图不受影响
+	static void Reset();
+};
+
+namespace internal
+{
+// ProfiledLock 通过它调用被包装的锁，base::Lock 的接口与 std 的不同
+template <typename T>
+struct LockTraits
+{
+	static void Lock(T &lock) { lock.lock(); }
+	static bool TryLock(T &lock) { return lock.try_lock(); }
+	static void Unlock(T &lock) { lock.unlock(); }
+};
+
+template <>
+struct LockTraits<base::Lock>
+{
+	static void Lock(base::Lock &lock) { lock.Acquire(); }
+	static bool TryLock(base::Lock &lock) { return lock.Try(); }
+	static void Unlock(base::Lock &lock) { lock.Release(); }
+};
+}
+
+// 给 base::Lock、NLock、AdaptiveLock、RWLock（以及 std::mutex 等）加上竞争统计：
+//   mutable ProfiledLock<base::Lock> lock_{ "extension.TimerWheel" };
+//   std::lock_guard<ProfiledLock<base::Lock>> guard(lock_);
+// 或者用构造它的位置命名：ProfiledLock<AdaptiveLock> lock_{ FROM_HERE };
+// 接口与 std::mutex / std::shared_mutex 相同（共享接口只在 T 支持时可用），另有 base::Lock 风格的 Acquire/Release/Try；
+// 不能用于 base::AutoLock 和 base::ConditionVariable，需要它们的地方继续使用 base::Lock
+template <typename T>
+class ProfiledLock
+{
+public:
+	explicit ProfiledLock(const char *name)
+		: site_(LockProfiler::GetSite(name)), depth_(0) {}
+	explicit ProfiledLock(const tracked_objects::Location &location)
+		: site_(LockProfiler::GetSite(location.ToString())), depth_(0) {}
+
+	void lock()
+	{
+		if (!LockProfiler::IsEnabled())
+		{
+			internal::LockTraits<T>::Lock(lock_);
+			OnLocked(false);
+			return;
+		}
+		bool contended = false;
+		TimeDelta wait;
+		if (!internal::LockTraits<T>::TryLock(lock_))
+		{
+			contended = true;
+			base::TimeTicks begin = base::TimeTicks::Now();
+			internal::LockTraits<T>::Lock(lock_);
+			wait = base::TimeTicks::Now() - begin;
+		}
+		site_->RecordAcquire(contended, wait);
+		OnLocked(true);
+	}
+
+	bool try_lock()
+	{
+		if (!internal::LockTraits<T>::TryLock(lock_))
+			return false;
+		bool enabled = LockProfiler::IsEnabled();
+		if (enabled)
+			site_->RecordAcquire(false, TimeDelta());
+		OnLocked(enabled);
+		return true;
+	}
+
+	void unlock()
+	{
+		TimeDelta hold;
+		bool record = false;
+		if (--depth_ == 0 && !hold_begin_.is_null())
+		{
+			hold = base::TimeTicks::Now() - hold_begin_;
+			hold_begin_ = base::TimeTicks();
+			record = true;
+		}
+		internal::LockTraits<T>::Unlock(lock_);
+		if (record)
+			site_->RecordHold(hold);
+	}
+
+	void lock_shared()
+	{
+		if (!LockProfiler::IsEnabled())
+		{
+			lock_.lock_shared();
+			return;
+		}
+		bool contended = false;
+		TimeDelta wait;
+		if (!lock_.try_lock_shared())
+		{
+			contended = true;
+			base::TimeTicks begin = base::TimeTicks::Now();
+			lock_.lock_shared();
+			wait = base::TimeTicks::Now() - begin;
+		}
+		site_->RecordAcquire(contended, wait);
+	}
+
+	bool try_lock_shared()
+	{
+		if (!lock_.try_lock_shared())
+			return false;
+		if (LockProfiler::IsEnabled())
+			site_->RecordAcquire(false, TimeDelta());
+		return true;
+	}
+
+	void unlock_shared() { lock_.unlock_shared(); }
+
+	void Acquire() { lock(); }
+	bool Try() { return try_lock(); }
+	void Release() { unlock(); }
+
+	LockSite* site() const { return site_; }
+
+private:
+	// 持有锁之后调用，depth_ 和 hold_begin_ 只由持有者访问
+	void OnLocked(bool enabled)
+	{
+		if (depth_++ == 0 && enabled)
+			hold_begin_ = base::TimeTicks::Now();
+	}
+
+	T lock_;
+	LockSite *site_;
+	int depth_;					// 递归锁的嵌套层数
+	base::TimeTicks hold_begin_;	// 最外层加锁的时间，统计关闭时为空
+
+	DISALLOW_COPY_AND_ASSIGN(ProfiledLock);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_LOCK_PROFILER_H__
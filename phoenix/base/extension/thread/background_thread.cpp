@@ -0,0 +1,97 @@
+#include "extension/thread/background_thread.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/platform_thread.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 线程结束时删除自己
+class BackgroundThreadDelegate : public base::PlatformThread::Delegate
+{
+public:
+	BackgroundThreadDelegate(const std::string &name, StdClosure run) : name_(name), run_(std::move(run)) {}
+
+	virtual void ThreadMain() override
+	{
+		base::PlatformThread::SetName(name_);
+		run_();
+		delete this;
+	}
+
+private:
+	std::string name_;
+	StdClosure run_;
+};
+}
+
+bool BackgroundThread::Start(const std::string &name, StdClosure run)
+{
+	//CreateNonJoinable 的线程上禁止访问 Singleton，所以按可 join 的线程创建，只是从不 join
+	BackgroundThreadDelegate *delegate = new BackgroundThreadDelegate(name, std::move(run));
+	base::PlatformThreadHandle handle;
+	if (!base::PlatformThread::Create(0, delegate, &handle))
+	{
+		delete delegate;
+		return false;
+	}
+	return true;
+}
+
+BackgroundWorkerPool::BackgroundWorkerPool(const std::string &name, size_t max_threads)
+	: cond_(&lock_)
+	, name_(name)
+	, max_threads_(max_threads > 0 ? max_threads : 1)
+	, thread_count_(0)
+	, idle_threads_(0)
+{
+}
+
+void BackgroundWorkerPool::SetMaxThreads(size_t max_threads)
+{
+	base::AutoLock lock(lock_);
+	max_threads_ = max_threads > 0 ? max_threads : 1;
+}
+
+void BackgroundWorkerPool::PostTask(StdClosure task)
+{
+	if (!task)
+		return;
+
+	base::AutoLock lock(lock_);
+	tasks_.push_back(std::move(task));
+	if (idle_threads_ > 0 || thread_count_ >= max_threads_)
+	{
+		cond_.Signal();
+		return;
+	}
+	std::string name = base::StringPrintf("%s_%d", name_.c_str(), (int)thread_count_);
+	bool success = BackgroundThread::Start(name, [this]() { Run(); });
+	DCHECK(success);
+	if (success)
+		thread_count_++;
+}
+
+void BackgroundWorkerPool::Run()
+{
+	base::AutoLock lock(lock_);
+	for (;;)
+	{
+		if (tasks_.empty())
+		{
+			idle_threads_++;
+			cond_.Wait();
+			idle_threads_--;
+			continue;
+		}
+		StdClosure task = std::move(tasks_.front());
+		tasks_.pop_front();
+		{
+			base::AutoUnlock unlock(lock_);
+			task();
+		}
+	}
+}
+
+EXTENSION_END_DECLS
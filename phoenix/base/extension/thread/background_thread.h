@@ -0,0 +1,58 @@
+// long-lived background threads owned by never-destroyed singletons
+
+#ifndef __BASE_EXTENSION_BACKGROUND_THREAD_H__
+#define __BASE_EXTENSION_BACKGROUND_THREAD_H__
+
+#include "extension/config/build_config.h"
+
+#include <deque>
+#include <string>
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/callback/callback.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 常驻后台线程，供域名解析、代理解析、发送合并定时器这类进程级单例使用。
+// 这些单例刻意不析构，线程从不 join：DLL 卸载或进程退出时线程可能还阻塞在系统调用里，join 会在加载器锁下死锁。
+// 也不交给 ThreadManager 托管：ThreadManager::Shutdown 会结束托管线程，而这些单例在 Shutdown 之后（如切换帐号）仍要工作。
+// 线程上可以访问 Singleton，可以长时间阻塞；启动线程的对象和 BackgroundWorkerPool 本身都不能析构。
+class EXTENSION_EXPORT BackgroundThread
+{
+public:
+	// 以 name 为线程名启动一个线程执行 run，run 返回后线程退出
+	static bool Start(const std::string &name, StdClosure run);
+};
+
+// 由 BackgroundThread 组成的任务池，线程按需创建、最多 max_threads 个，任务按投递顺序开始执行，
+// 用于 getaddrinfo、WPAD 这类会阻塞数秒的调用
+class EXTENSION_EXPORT BackgroundWorkerPool
+{
+public:
+	BackgroundWorkerPool(const std::string &name, size_t max_threads);
+
+	// 调小时已经启动的线程不退出
+	void SetMaxThreads(size_t max_threads);
+	void PostTask(StdClosure task);
+
+private:
+	void Run();
+
+private:
+	base::Lock lock_;
+	base::ConditionVariable cond_;
+	std::string name_;
+	std::deque<StdClosure> tasks_;
+	size_t max_threads_;
+	size_t thread_count_;
+	size_t idle_threads_;
+
+	DISALLOW_COPY_AND_ASSIGN(BackgroundWorkerPool);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_BACKGROUND_THREAD_H__
@@ -0,0 +1,172 @@
+// C++20 coroutine adapters for the task runners managed by ThreadManager
+
+#ifndef __BASE_EXTENSION_COROUTINE_H__
+#define __BASE_EXTENSION_COROUTINE_H__
+
+#include "extension/config/build_config.h"
+
+// 工程默认按 C++17 编译，只有编译器支持协程（/std:c++latest、-std=c++20）时才提供下面的接口
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define EXTENSION_HAS_COROUTINE 1
+#endif
+#endif
+
+#if defined(EXTENSION_HAS_COROUTINE)
+
+#include <coroutine>
+#include <exception>
+#include "base/single_thread_task_runner.h"
+#include "base/thread_task_runner_handle.h"
+
+#include "extension/callback/bind_extension.h"
+#include "extension/thread/framework_thread.h"
+#include "extension/thread/thread_manager.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 用协程把多次线程切换写成顺序代码，代替层层嵌套的 PostTaskAndReply：
+//
+//	Async SyncContacts()
+//	{
+//		co_await ResumeOn(kThreadDB);		// 之后的代码在 DB 线程上执行
+//		auto contacts = LoadContacts();
+//		co_await ResumeOn(kThreadUI);
+//		ShowContacts(contacts);
+//		co_await Delay(TimeDelta::FromSeconds(1));
+//	}
+//
+// 协程帧只在挂起时分配一次，每次切换只投递一个 OnceClosure，不再为每一跳包装 WeakCallback。
+// 协程恢复后不会检查调用方对象是否还活着，需要时在 co_await 之后自行检查 weak_ptr / WeakFlag。
+// 目标线程已退出或投递的任务被丢弃时，挂起的协程不会再恢复，协程帧也不会释放。
+
+// 只管启动不等结果的协程返回类型，协程体执行完后自行销毁；协程体不允许抛出异常
+class Async
+{
+public:
+	struct promise_type
+	{
+		Async get_return_object() { return Async(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+namespace internal
+{
+// 投递出去恢复协程的任务
+class ResumeTask
+{
+public:
+	explicit ResumeTask(std::coroutine_handle<> handle) : handle_(handle) {}
+	ResumeTask(ResumeTask &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+
+	void operator()()
+	{
+		std::coroutine_handle<> handle = handle_;
+		handle_ = nullptr;
+		if (handle)
+			handle.resume();
+	}
+
+private:
+	std::coroutine_handle<> handle_;
+};
+}
+
+// co_await ResumeOn(identifier)：切到 ThreadManager 托管的 identifier 线程上继续执行，
+// 已在该线程上时不切换。结果为 false 表示目标线程不存在，协程仍在原线程上继续
+class ResumeOnAwaiter
+{
+public:
+	explicit ResumeOnAwaiter(int64_t identifier) : identifier_(identifier), posted_(false) {}
+
+	bool await_ready() const
+	{
+		return FrameworkThread::CurrentManagedThreadId() == identifier_;
+	}
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		//投递成功后协程可能已在目标线程上恢复，不能再访问 this
+		posted_ = true;
+		if (!ThreadManager::PostTask(identifier_, internal::ResumeTask(handle)))
+		{
+			posted_ = false;
+			return false;
+		}
+		return true;
+	}
+	bool await_resume() const
+	{
+		return posted_ || FrameworkThread::CurrentManagedThreadId() == identifier_;
+	}
+
+private:
+	int64_t identifier_;
+	bool posted_;
+};
+
+inline ResumeOnAwaiter ResumeOn(int64_t identifier)
+{
+	return ResumeOnAwaiter(identifier);
+}
+
+// co_await ResumeOn(task_runner)：切到任意 SingleThreadTaskRunner 上继续执行，已在其上时不切换
+class ResumeOnRunnerAwaiter
+{
+public:
+	explicit ResumeOnRunnerAwaiter(scoped_refptr<base::SingleThreadTaskRunner> task_runner)
+		: task_runner_(std::move(task_runner)) {}
+
+	bool await_ready() const
+	{
+		return !task_runner_ || task_runner_->RunsTasksOnCurrentThread();
+	}
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		scoped_refptr<base::SingleThreadTaskRunner> task_runner = task_runner_;
+		task_runner->PostTask(FROM_HERE, ToBaseClosure(internal::ResumeTask(handle)));
+	}
+	void await_resume() const {}
+
+private:
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+};
+
+inline ResumeOnRunnerAwaiter ResumeOn(scoped_refptr<base::SingleThreadTaskRunner> task_runner)
+{
+	return ResumeOnRunnerAwaiter(std::move(task_runner));
+}
+
+// co_await Delay(delay)：在当前线程的消息循环上等待 delay 后继续执行
+class DelayAwaiter
+{
+public:
+	explicit DelayAwaiter(TimeDelta delay) : delay_(delay) {}
+
+	bool await_ready() const { return delay_ <= TimeDelta(); }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+		base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(FROM_HERE,
+			ToBaseClosure(internal::ResumeTask(handle)), delay_);
+	}
+	void await_resume() const {}
+
+private:
+	TimeDelta delay_;
+};
+
+inline DelayAwaiter Delay(TimeDelta delay)
+{
+	return DelayAwaiter(delay);
+}
+
+EXTENSION_END_DECLS
+
+#endif // EXTENSION_HAS_COROUTINE
+
+#endif // __BASE_EXTENSION_COROUTINE_H__
@@ -1,12 +1,19 @@
 #include "extension/thread/framework_thread.h"
-#include "base/lazy_instance.h"
-#include "base/threading/thread_local.h"
 #include "base/bind.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/thread/task_instrumentation.h"
+#include "extension/thread/thread_manager.h"
 
 EXTENSION_BEGIN_DECLS
 
-base::LazyInstance<base::ThreadLocalPointer<FrameworkThreadTlsData>>::Leaky
-	lazy_framework_thread_tls = LAZY_INSTANCE_INITIALIZER;
+namespace
+{
+// ThreadManager 和日志几乎每次调用都要取，thread_local 只是一次相对线程指针的读取
+thread_local FrameworkThreadTlsData *framework_thread_tls = nullptr;
+
+inline FrameworkThreadTlsData* GetFrameworkThreadTls() { return framework_thread_tls; }
+inline void SetFrameworkThreadTls(FrameworkThreadTlsData *tls) { framework_thread_tls = tls; }
+}
 
 
 int64_t FrameworkThread::CurrentManagedThreadId()
@@ -16,6 +23,25 @@ int64_t FrameworkThread::CurrentManagedThreadId()
 		return -1;
 	return tls->managed_thread_id;
 }
+bool FrameworkThread::StartWithOptions(const FrameworkThreadOptions& options)
+{
+	TRACE_EVENT1("nim.thread", "FrameworkThread::Start", "name", TRACE_STR_COPY(thread_name().c_str()));
+	SetThreadOptions(options);
+	return base::Thread::StartWithOptions(options);
+}
+void FrameworkThread::SetThreadOptions(const FrameworkThreadOptions& options)
+{
+	DCHECK(!IsRunning());
+	_thread_options = options;
+	_has_thread_options = true;
+}
+bool FrameworkThread::Start()
+{
+	TRACE_EVENT1("nim.thread", "FrameworkThread::Start", "name", TRACE_STR_COPY(thread_name().c_str()));
+	if (!_has_thread_options)
+		return base::Thread::Start();
+	return base::Thread::StartWithOptions(_thread_options);
+}
 void FrameworkThread::RegisterInitCallback(StdClosure closure)
 {
 	_init_callback = std::move(closure);
@@ -26,7 +52,13 @@ void FrameworkThread::RegisterCleanupCallback(StdClosure closure)
 }
 void FrameworkThread::Init()
 {
+	TRACE_EVENT1("nim.thread", "FrameworkThread::Init", "name", TRACE_STR_COPY(thread_name().c_str()));
+	ThreadManager::OnFrameworkThreadStarted(this);
+	if (_has_thread_options)
+		ApplyCurrentThreadOptions(_thread_options);
 	FrameworkThread::InitTlsData(this);
+	if (_has_thread_options && _thread_options.instrument_tasks)
+		TaskInstrumentation::AttachToCurrentThread(thread_name(), _thread_options.long_task_threshold);
 	if (_thread_register != nullptr)
 		_thread_register(true);
 	if (_init_callback)	{
@@ -35,11 +67,13 @@ void FrameworkThread::Init()
 }
 void FrameworkThread::CleanUp()
 {
+	TRACE_EVENT1("nim.thread", "FrameworkThread::CleanUp", "name", TRACE_STR_COPY(thread_name().c_str()));
 	if (_clean_callback) {
 		_clean_callback();
 	}
 	if (_thread_register != nullptr)
 		_thread_register(false);
+	ThreadManager::OnFrameworkThreadStopped(this);
 	FrameworkThread::FreeTlsData();
 }
 
@@ -53,7 +87,7 @@ void FrameworkThread::InitTlsData(FrameworkThread *self)
 	tls->managed = 0;
 	tls->managed_thread_id = -1;
 	tls->custom_data = nullptr;
-	lazy_framework_thread_tls.Pointer()->Set(tls);
+	SetFrameworkThreadTls(tls);
 }
 void FrameworkThread::FreeTlsData()
 {
@@ -61,17 +95,17 @@ void FrameworkThread::FreeTlsData()
 	FrameworkThreadTlsData *tls = FrameworkThread::GetTlsData();
 	if (!tls)
 		return;
-	lazy_framework_thread_tls.Pointer()->Set(nullptr);
+	SetFrameworkThreadTls(nullptr);
 	delete tls;
 }
 FrameworkThreadTlsData* FrameworkThread::GetTlsData()
 {
-	return lazy_framework_thread_tls.Pointer()->Get();
+	return GetFrameworkThreadTls();
 }
 
 bool FrameworkThread::IsTlsDataSet()
 {
-	return !!lazy_framework_thread_tls.Pointer()->Get();
+	return !!GetFrameworkThreadTls();
 }
 scoped_ptr<MessagePump> MessagePumpFactory(const MessageLoop::Type type)
 {
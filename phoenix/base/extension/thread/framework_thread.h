@@ -8,6 +8,7 @@
 #include "extension/callback/callback.h"
 #include "base/macros.h"
 #include "base/threading/thread.h"
+#include "extension/thread/thread_options.h"
 
 EXTENSION_BEGIN_DECLS
 
@@ -25,7 +26,14 @@ class EXTENSION_EXPORT FrameworkThread :public base::Thread
 	friend class ThreadMap;
 	friend class ThreadManager;
 public:
-	explicit FrameworkThread(const std::string& name):base::Thread(name), _attached_some_where(false){}
+	explicit FrameworkThread(const std::string& name):base::Thread(name), _has_thread_options(false), _attached_some_where(false){}
+
+	// 按 options 启动，调度等级和绑核在新线程上、Init 回调之前生效
+	bool StartWithOptions(const FrameworkThreadOptions& options);
+	using base::Thread::StartWithOptions;
+	// 保存 Start() 使用的选项，ThreadManager::CreateFrameworkThread 带 options 时调用
+	void SetThreadOptions(const FrameworkThreadOptions& options);
+	bool Start();
 
 	// Get the managed thread id of current thread
 	// return -1 means current thread is not managed by ThreadManager
@@ -54,6 +62,8 @@ private:
 		_thread_register = thread_register;
 	};
 private:
+	FrameworkThreadOptions _thread_options;
+	bool _has_thread_options;
 	StdClosure _init_callback;
 	StdClosure _clean_callback;
 	std::function<void(bool)> _thread_register;
@@ -0,0 +1,77 @@
+// a lock-free intrusive multi-producer single-consumer queue
+
+#ifndef __BASE_EXTENSION_MPSC_QUEUE_H__
+#define __BASE_EXTENSION_MPSC_QUEUE_H__
+
+#include "extension/config/build_config.h"
+
+#include <atomic>
+#include <type_traits>
+
+EXTENSION_BEGIN_DECLS
+
+// 放入 MpscQueue 的元素需从 MpscQueueNode 派生，队列不分配内存也不拥有元素
+struct MpscQueueNode
+{
+	MpscQueueNode() : mpsc_next(nullptr) {}
+	MpscQueueNode *mpsc_next;
+};
+
+// 任意线程 Push，唯一的消费线程用 PopAll 一次取走全部元素。
+// Push 返回队列此前是否为空，只有第一个放入元素的生产者需要唤醒消费线程，
+// 一批并发的 Push 只对应一次唤醒和一次 PopAll。
+// 生产者之间只有一个 CAS 循环；PopAll 整体摘下链表，不存在 ABA 问题
+template <typename T>
+class MpscQueue
+{
+public:
+	MpscQueue() : head_(nullptr) {}
+
+	// 可以在任意线程调用
+	bool Push(T *node)
+	{
+		// T 可以是在使用 MpscQueue<T> 的类中前置声明的类型，在这里才检查
+		static_assert(std::is_base_of<MpscQueueNode, T>::value, "T should derive from MpscQueueNode");
+		MpscQueueNode *head = head_.load(std::memory_order_relaxed);
+		do
+		{
+			node->mpsc_next = head;
+		} while (!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+		return head == nullptr;
+	}
+
+	// 只能在消费线程调用，按 Push 的顺序返回第一个元素，用 Next 遍历；队列为空时返回 nullptr
+	T* PopAll()
+	{
+		MpscQueueNode *node = head_.exchange(nullptr, std::memory_order_acquire);
+		MpscQueueNode *reversed = nullptr;
+		while (node != nullptr)
+		{
+			MpscQueueNode *next = node->mpsc_next;
+			node->mpsc_next = reversed;
+			reversed = node;
+			node = next;
+		}
+		return static_cast<T *>(reversed);
+	}
+
+	static T* Next(T *node)
+	{
+		return static_cast<T *>(node->mpsc_next);
+	}
+
+	bool empty() const
+	{
+		return head_.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	std::atomic<MpscQueueNode *> head_;
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue& operator=(const MpscQueue &) = delete;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_MPSC_QUEUE_H__
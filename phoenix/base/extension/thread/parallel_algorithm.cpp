@@ -0,0 +1,108 @@
+#include "extension/thread/parallel_algorithm.h"
+#include <algorithm>
+#include <atomic>
+#include "base/synchronization/condition_variable.h"
+#include "extension/thread/work_stealing_pool.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace internal
+{
+namespace
+{
+// 一次 RunParallel 的进度，由调用线程和投递出去的工作线程任务共享
+class ParallelState
+{
+public:
+	ParallelState(size_t begin, size_t end, size_t min_grain, size_t threads,
+		const std::function<void(size_t, size_t)> *body)
+		: next_(begin), end_(end), min_grain_(min_grain), threads_(threads), body_(body), active_(0), idle_(&lock_)
+	{
+	}
+
+	// 取块执行直到取完
+	void Work()
+	{
+		size_t chunk_begin, chunk_end;
+		while (Claim(chunk_begin, chunk_end))
+			(*body_)(chunk_begin, chunk_end);
+	}
+
+	// 工作线程上的入口。先登记再取块：调用线程看到 active_ 为 0 时块已取完，之后开始的任务取不到块，
+	// 不会再访问 body_，调用线程可以放心返回
+	void Help()
+	{
+		active_.fetch_add(1, std::memory_order_seq_cst);
+		Work();
+		if (active_.fetch_sub(1, std::memory_order_seq_cst) == 1)
+		{
+			base::AutoLock lock(lock_);
+			idle_.Broadcast();
+		}
+	}
+
+	// 等待已开始的工作线程任务做完手上的块，还在排队的不等
+	void WaitHelpers()
+	{
+		base::AutoLock lock(lock_);
+		while (active_.load(std::memory_order_seq_cst) > 0)
+			idle_.Wait();
+	}
+
+private:
+	bool Claim(size_t &chunk_begin, size_t &chunk_end)
+	{
+		size_t current = next_.load(std::memory_order_seq_cst);
+		size_t next;
+		do
+		{
+			if (current >= end_)
+				return false;
+			size_t remaining = end_ - current;
+			size_t grain = std::max(min_grain_, remaining / (threads_ * 2));
+			next = current + std::min(grain, remaining);
+		} while (!next_.compare_exchange_weak(current, next, std::memory_order_seq_cst));
+		chunk_begin = current;
+		chunk_end = next;
+		return true;
+	}
+
+	std::atomic<size_t> next_;
+	const size_t end_;
+	const size_t min_grain_;
+	const size_t threads_;
+	const std::function<void(size_t, size_t)> *body_;
+	std::atomic<size_t> active_;
+	base::Lock lock_;
+	base::ConditionVariable idle_;
+};
+}
+
+void RunParallel(size_t begin, size_t end, const ParallelOptions &options,
+	const std::function<void(size_t, size_t)> &body)
+{
+	if (begin >= end)
+		return;
+
+	size_t count = end - begin;
+	size_t min_grain = std::max<size_t>(options.min_grain, 1);
+	WorkStealingPool *pool = WorkStealingPool::GetInstance();
+	size_t threads = pool->worker_count() + (pool->RunsTasksOnCurrentThread() ? 0 : 1);
+	if (options.max_concurrency > 0)
+		threads = std::min(threads, options.max_concurrency);
+	threads = std::min(threads, (count + min_grain - 1) / min_grain);
+	if (threads <= 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelState>(begin, end, min_grain, threads, &body);
+	for (size_t i = 1; i < threads; i++)
+		pool->PostTask([state]() { state->Help(); });
+	state->Work();
+	state->WaitHelpers();
+}
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,138 @@
+// parallel for / transform / reduce on the work-stealing pool
+
+#ifndef __BASE_EXTENSION_PARALLEL_ALGORITHM_H__
+#define __BASE_EXTENSION_PARALLEL_ALGORITHM_H__
+
+#include "extension/config/build_config.h"
+
+#include <stddef.h>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/callback/once_closure.h"
+#include "extension/thread/thread_manager.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct ParallelOptions
+{
+	ParallelOptions() : min_grain(1), max_concurrency(0) {}
+
+	// 每次至少取这么多个元素，元素的处理很轻（几十纳秒）时调大，摊薄取元素的开销
+	size_t min_grain;
+	// 同时参与的线程数上限，0 表示工作线程数（调用线程不是工作线程时再加上它）
+	size_t max_concurrency;
+};
+
+namespace internal
+{
+// 把 [begin, end) 分块交给调用线程和 WorkStealingPool 的工作线程执行 body(chunk_begin, chunk_end)，返回时全部执行完。
+// 块的大小自适应：每次取剩余元素数除以参与线程数的两倍，不小于 min_grain，开始时块大、取的次数少，
+// 临近结束时块变小，先做完的线程能分走慢线程剩下的部分。
+// 调用线程自己也在取块，工作线程忙时由它做完全部，所以在工作线程上调用也不会死锁
+EXTENSION_EXPORT void RunParallel(size_t begin, size_t end, const ParallelOptions &options,
+	const std::function<void(size_t, size_t)> &body);
+}
+
+// 并行的 for，function(size_t index) 对每个下标调用一次，不保证顺序，返回时全部完成。
+// 调用线程也参与执行并阻塞到结束，界面线程等有消息循环的线程上请用 PostParallelFor。
+// 各次调用之间不应有共享的可写状态；元素很少或只有一个核时直接在调用线程上顺序执行
+template<typename Function>
+void ParallelFor(size_t begin, size_t end, Function &&function, const ParallelOptions &options = ParallelOptions())
+{
+	internal::RunParallel(begin, end, options, [&function](size_t chunk_begin, size_t chunk_end) {
+		for (size_t i = chunk_begin; i < chunk_end; i++)
+			function(i);
+	});
+}
+
+// *(out + i) = op(*(first + i))，迭代器须是随机访问的，out 须已有足够的元素（如 resize 过的 vector）。
+// 不要输出到 std::vector<bool>，它按位存放，不同下标的写入会互相覆盖
+template<typename InputIt, typename OutputIt, typename UnaryOperation>
+OutputIt ParallelTransform(InputIt first, InputIt last, OutputIt out, UnaryOperation &&op,
+	const ParallelOptions &options = ParallelOptions())
+{
+	size_t count = (size_t)std::distance(first, last);
+	internal::RunParallel(0, count, options, [first, out, &op](size_t chunk_begin, size_t chunk_end) {
+		InputIt input = first + chunk_begin;
+		OutputIt output = out + chunk_begin;
+		for (size_t i = chunk_begin; i < chunk_end; i++, ++input, ++output)
+			*output = op(*input);
+	});
+	return out + count;
+}
+
+// 返回 identity 与各 map(index) 用 reduce 合并的结果。
+// 每块先在本线程上合并，块的结果再按完成的顺序合并，所以 reduce 须满足结合律和交换律（求和、计数、取最大值等），
+// identity 须是 reduce 的单位元
+template<typename T, typename Map, typename Reduce>
+T ParallelReduce(size_t begin, size_t end, T identity, Map &&map, Reduce &&reduce,
+	const ParallelOptions &options = ParallelOptions())
+{
+	T result = identity;
+	base::Lock lock;
+	internal::RunParallel(begin, end, options, [&](size_t chunk_begin, size_t chunk_end) {
+		T partial = identity;
+		for (size_t i = chunk_begin; i < chunk_end; i++)
+			partial = reduce(std::move(partial), map(i));
+		base::AutoLock auto_lock(lock);
+		result = reduce(std::move(result), std::move(partial));
+	});
+	return result;
+}
+
+// 以下在 WorkStealingPool 上执行，完成后 reply 回到调用线程执行，调用线程须有消息循环（见 ThreadManager::PostParallelTaskAndReply）
+// function 被移动到工作线程上，执行期间它引用的数据须保持有效
+template<typename Function>
+bool PostParallelFor(size_t begin, size_t end, Function function, OnceClosure reply,
+	const ParallelOptions &options = ParallelOptions())
+{
+	return ThreadManager::PostParallelTaskAndReply([begin, end, function = std::move(function), options]() mutable {
+		ParallelFor(begin, end, function, options);
+	}, std::move(reply));
+}
+
+// input 被移动到工作线程上，reply(std::vector<op 的结果>&&) 在调用线程上执行，如批量计算文件的哈希：
+//   PostParallelTransform(std::move(paths), [](const std::string &path) { return HashFile(path); },
+//       [this](std::vector<std::string> &&hashes) { OnHashed(hashes); });
+template<typename Input, typename UnaryOperation, typename Reply>
+bool PostParallelTransform(std::vector<Input> input, UnaryOperation op, Reply reply,
+	const ParallelOptions &options = ParallelOptions())
+{
+	typedef typename std::decay<decltype(op(std::declval<const Input &>()))>::type Output;
+	static_assert(!std::is_same<Output, bool>::value, "std::vector<bool> can not be written in parallel");
+	auto output = std::make_shared<std::vector<Output>>();
+	return ThreadManager::PostParallelTaskAndReply(
+		[input = std::move(input), op = std::move(op), output, options]() mutable {
+			output->resize(input.size());
+			ParallelTransform(input.cbegin(), input.cend(), output->begin(), op, options);
+		},
+		[reply = std::move(reply), output]() mutable {
+			reply(std::move(*output));
+		});
+}
+
+// reply(T&&) 在调用线程上执行，要求同 ParallelReduce
+template<typename T, typename Map, typename Reduce, typename Reply>
+bool PostParallelReduce(size_t begin, size_t end, T identity, Map map, Reduce reduce, Reply reply,
+	const ParallelOptions &options = ParallelOptions())
+{
+	auto result = std::make_shared<T>(identity);
+	return ThreadManager::PostParallelTaskAndReply(
+		[begin, end, map = std::move(map), reduce = std::move(reduce), result, options]() mutable {
+			*result = ParallelReduce(begin, end, std::move(*result), map, reduce, options);
+		},
+		[reply = std::move(reply), result]() mutable {
+			reply(std::move(*result));
+		});
+}
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_PARALLEL_ALGORITHM_H__
@@ -0,0 +1,156 @@
+#include "extension/thread/power_scheduler.h"
+#include <algorithm>
+#include "base/bind.h"
+#include "base/trace_event/trace_event.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+void RunPowerModeCallback(const PowerModeCallback &callback, bool background)
+{
+	callback(background);
+}
+}
+
+std::atomic<bool> PowerScheduler::background_(false);
+
+PowerScheduler* PowerScheduler::GetInstance()
+{
+	// 刻意不析构，退出前注销的模块仍要访问它
+	static PowerScheduler *instance = new PowerScheduler;
+	return instance;
+}
+
+PowerScheduler::PowerScheduler() : next_observer_id_(1), notification_attached_(false)
+{
+}
+
+bool PowerScheduler::IsBackground()
+{
+	return background_.load(std::memory_order_relaxed);
+}
+
+void PowerScheduler::SetPolicy(const PowerPolicy &policy)
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	policy_ = policy;
+}
+
+PowerPolicy PowerScheduler::GetPolicy() const
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return policy_;
+}
+
+void PowerScheduler::AttachNotificationCenter()
+{
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		if (notification_attached_)
+			return;
+		notification_attached_ = true;
+	}
+	NotificaionCenter::GetInstance()->AddObserver(this);
+}
+
+void PowerScheduler::DetachNotificationCenter()
+{
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		if (!notification_attached_)
+			return;
+		notification_attached_ = false;
+	}
+	NotificaionCenter::GetInstance()->RemoveObserver(this);
+}
+
+void PowerScheduler::SetBackground(bool background)
+{
+	// 切换和通知整体串行，同一线程上的观察者按切换的顺序收到通知
+	std::lock_guard<std::mutex> notify_lock(notify_lock_);
+	std::vector<DeferredTask> deferred_tasks;
+	std::vector<Observer> observers;
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		if (background_.load(std::memory_order_relaxed) == background)
+			return;
+		background_.store(background, std::memory_order_relaxed);
+		// 在锁内取走，之后 DeferLowPriorityTask 看到的已是前台，不会有任务漏在队列里
+		if (!background)
+			deferred_tasks.swap(deferred_tasks_);
+		for (auto &observer : observers_)
+			observers.push_back(observer.second);
+	}
+	TRACE_EVENT2("nim.thread", "PowerScheduler::SetBackground", "background", background, "deferred_tasks", deferred_tasks.size());
+
+	for (auto &observer : observers)
+	{
+		if (observer.task_runner == nullptr)
+			observer.callback(background);
+		else
+			observer.task_runner->PostTask(FROM_HERE, base::Bind(&RunPowerModeCallback, observer.callback, background));
+	}
+	//目标线程已经退出时投递失败，直接丢弃
+	for (auto &deferred : deferred_tasks)
+		deferred.task_runner->PostPriorityTask(FROM_HERE, deferred.task, base::SingleThreadTaskRunner::PRIORITY_LOW);
+}
+
+int PowerScheduler::AddObserver(const PowerModeCallback &callback, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner)
+{
+	if (!callback)
+		return 0;
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	int id = next_observer_id_++;
+	Observer &observer = observers_[id];
+	observer.callback = callback;
+	observer.task_runner = task_runner;
+	return id;
+}
+
+void PowerScheduler::RemoveObserver(int id)
+{
+	if (id == 0)
+		return;
+	std::lock_guard<std::mutex> notify_lock(notify_lock_);
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	observers_.erase(id);
+}
+
+bool PowerScheduler::DeferLowPriorityTask(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner, const base::Closure &task)
+{
+	if (!IsBackground() || task_runner == nullptr)
+		return false;
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	if (!background_.load(std::memory_order_relaxed) || !policy_.defer_low_priority_tasks)
+		return false;
+	DeferredTask deferred;
+	deferred.task_runner = task_runner;
+	deferred.task = task;
+	deferred_tasks_.push_back(std::move(deferred));
+	return true;
+}
+
+size_t PowerScheduler::GetDeferredTaskCount() const
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return deferred_tasks_.size();
+}
+
+TimeDelta PowerScheduler::StretchTimerDelay(TimeDelta delay) const
+{
+	if (!IsBackground())
+		return delay;
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return policy_.timer_stretch_factor > 1 ? delay * policy_.timer_stretch_factor : delay;
+}
+
+TimeDelta PowerScheduler::GetTimerSlack(TimeDelta delay, TimeDelta slack) const
+{
+	if (!IsBackground())
+		return slack;
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return std::max(slack, std::min(delay, policy_.max_timer_slack));
+}
+
+EXTENSION_END_DECLS
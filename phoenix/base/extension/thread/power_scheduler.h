@@ -0,0 +1,107 @@
+// background-aware power policy for tasks, timers, HTTP transfers and database writes
+
+#ifndef __BASE_EXTENSION_POWER_SCHEDULER_H__
+#define __BASE_EXTENSION_POWER_SCHEDULER_H__
+
+#include "extension/config/build_config.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+
+#include "extension/extension_export.h"
+#include "extension/notification_center/notification_center.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 应用在后台时各模块的省电行为，回到前台后全部恢复
+struct EXTENSION_EXPORT PowerPolicy
+{
+	PowerPolicy()
+		: defer_low_priority_tasks(true)
+		, timer_stretch_factor(4)
+		, max_timer_slack(TimeDelta::FromSeconds(2))
+		, http_background_budget(1024 * 1024)
+		, db_batch_delay_factor(20) {}
+
+	bool defer_low_priority_tasks;		// TaskPriority::kLow 的任务保存起来，回到前台时再投递
+	int timer_stretch_factor;			// RepeatingTimer 的间隔乘以它，1 表示不拉长
+	TimeDelta max_timer_slack;			// TimerWheel 的定时器允许推迟 min(delay, max_timer_slack)，到期时间相近的合并唤醒
+	long long http_background_budget;	// 进入后台后 PRIORITY_BACKGROUND/PRIORITY_LOW 的 HTTP 传输还能收发的字节数，用完后暂停，负数表示不限
+	int db_batch_delay_factor;			// SQLiteBatchWriter 的 max_delay_ms 乘以它，攒更大的批次、更少地唤醒写线程
+};
+
+// 前后台切换时通知，参数为是否进入后台
+using PowerModeCallback = std::function<void(bool background)>;
+
+// 后台省电调度：跟随 NotificaionCenter 的 enterBackground/enterForeground（或宿主直接调用 SetBackground），
+// 按 PowerPolicy 推迟低优先级任务、拉长重复定时器、合并定时器唤醒、限制后台 HTTP 传输、放大数据库批量写入的间隔，
+// 减少后台的 CPU 唤醒，避免被 iOS/Android 判为耗电而限制。
+// 各模块通过 AddObserver 得知切换，或在需要时读取 IsBackground()；线程安全，刻意不析构
+class EXTENSION_EXPORT PowerScheduler : public NotificaionObserver
+{
+public:
+	static PowerScheduler* GetInstance();
+	// 只读一个原子变量，可以在热路径上调用
+	static bool IsBackground();
+
+	// 后台时修改的策略在下一次切换时生效
+	void SetPolicy(const PowerPolicy &policy);
+	PowerPolicy GetPolicy() const;
+
+	void AttachNotificationCenter();
+	void DetachNotificationCenter();
+	// 没有 NotificationSource 的平台由宿主在前后台切换时调用；状态不变时什么也不做
+	void SetBackground(bool background);
+
+	// task_runner 不为空时通知投递到该线程执行，否则在切换的线程上同步调用；返回注销用的 id。
+	// 同步调用的回调执行期间 RemoveObserver 会等待其返回，回调中不要注销观察者或切换前后台
+	int AddObserver(const PowerModeCallback &callback, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner = nullptr);
+	void RemoveObserver(int id);
+
+	// 后台且策略允许时保存任务并返回 true，回到前台时按保存的顺序以低优先级投递回 task_runner；
+	// 应用在后台被杀掉时保存的任务不会执行
+	bool DeferLowPriorityTask(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner, const base::Closure &task);
+	size_t GetDeferredTaskCount() const;
+	// 后台时按策略拉长重复定时器的间隔，前台时原样返回
+	TimeDelta StretchTimerDelay(TimeDelta delay) const;
+	// 后台时放宽一次性定时器允许的推迟时间，前台时原样返回
+	TimeDelta GetTimerSlack(TimeDelta delay, TimeDelta slack) const;
+
+protected:
+	virtual void enterBackground() override { SetBackground(true); }
+	virtual void enterForeground() override { SetBackground(false); }
+
+private:
+	struct Observer
+	{
+		PowerModeCallback callback;
+		scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+	};
+	struct DeferredTask
+	{
+		scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+		base::Closure task;
+	};
+
+	PowerScheduler();
+
+	static std::atomic<bool> background_;
+	mutable std::mutex lock_;				// 保护以下成员
+	std::mutex notify_lock_;				// 同步调用观察者期间持有，与 RemoveObserver 互斥
+	PowerPolicy policy_;
+	std::map<int, Observer> observers_;
+	int next_observer_id_;
+	std::vector<DeferredTask> deferred_tasks_;
+	bool notification_attached_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_POWER_SCHEDULER_H__
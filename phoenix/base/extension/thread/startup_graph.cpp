@@ -0,0 +1,414 @@
+#include "extension/thread/startup_graph.h"
+#include <algorithm>
+#include "base/logging.h"
+#include "base/metrics/histogram.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/platform_thread.h"
+
+#include "extension/thread/thread_manager.h"
+#include "extension/thread/work_stealing_pool.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const char kHistogramPrefix[] = "Startup.";
+
+// CollectLocked 中深度优先遍历的标记
+const int kVisiting = 1;
+const int kVisited = 2;
+
+void RecordHistogram(const StartupStepTiming &timing)
+{
+	base::HistogramBase *histogram = base::Histogram::FactoryTimeGet(kHistogramPrefix + timing.name,
+		TimeDelta::FromMilliseconds(1), TimeDelta::FromSeconds(60), 50, base::HistogramBase::kNoFlags);
+	if (histogram != nullptr)
+		histogram->AddTime(timing.duration);
+}
+}
+
+StartupGraph* StartupGraph::GetInstance()
+{
+	static StartupGraph *graph = new StartupGraph;
+	return graph;
+}
+
+StartupGraph::StartupGraph()
+	: finished_(&lock_)
+	, started_(false)
+	, outstanding_(0)
+	, all_succeeded_(true)
+	, created_time_(TimeTicks::Now())
+{
+}
+
+bool StartupGraph::Register(const std::string &name, const std::vector<std::string> &dependencies, Step step,
+	StartupPolicy policy)
+{
+	DCHECK(step);
+	base::AutoLock auto_lock(lock_);
+	if (nodes_.find(name) != nodes_.end())
+		return false;
+	if (started_ && policy == StartupPolicy::kParallel)
+		return false;
+	std::unique_ptr<Node> node(new Node);
+	node->name = name;
+	node->dependencies = dependencies;
+	node->step = std::move(step);
+	node->policy = policy;
+	node->state = kPending;
+	node->waiting_dependencies = 0;
+	node->in_start = false;
+	node->timing.name = name;
+	node->timing.parallel = false;
+	node->timing.succeeded = false;
+	order_.push_back(node.get());
+	nodes_[name] = std::move(node);
+	return true;
+}
+
+bool StartupGraph::Require(const std::string &name)
+{
+	base::AutoLock auto_lock(lock_);
+	Node *target = FindLocked(name);
+	if (target == nullptr)
+		return false;
+	if (target->state == kSucceeded || target->state == kFailed)
+		return target->state == kSucceeded;
+
+	std::vector<Node *> order;
+	std::map<Node *, int> marks;
+	if (!CollectLocked(target, &order, &marks))
+	{
+		LOG(ERROR) << "[startup] dependency cycle at " << name;
+		return false;
+	}
+	// order 中依赖总在前面，轮到一个步骤时它的依赖都已结束
+	for (Node *node : order)
+	{
+		while (node->state == kRunning)
+			finished_.Wait();
+		if (node->state != kPending)
+			continue;
+		bool dependencies_succeeded = true;
+		for (const std::string &dependency : node->dependencies)
+		{
+			Node *dependency_node = FindLocked(dependency);
+			if (dependency_node == nullptr || dependency_node->state != kSucceeded)
+			{
+				dependencies_succeeded = false;
+				break;
+			}
+		}
+		if (dependencies_succeeded)
+			RunLocked(node, false);
+		else
+			FailLocked(node);
+	}
+	return target->state == kSucceeded;
+}
+
+void StartupGraph::Start()
+{
+	base::AutoLock auto_lock(lock_);
+	if (started_)
+		return;
+	started_ = true;
+
+	// 参与的步骤：所有未结束的 kParallel 步骤以及它们未结束的依赖
+	std::vector<Node *> members;
+	std::map<Node *, int> marks;
+	for (Node *node : order_)
+	{
+		if (node->policy != StartupPolicy::kParallel || node->state == kSucceeded || node->state == kFailed)
+			continue;
+		// 成环的部分在下面的拓扑排序中找出，这里只是收集
+		CollectLocked(node, &members, &marks);
+	}
+
+	std::vector<Node *> failed;
+	for (Node *node : members)
+	{
+		node->in_start = true;
+		outstanding_++;
+		bool missing = false;
+		for (const std::string &dependency : node->dependencies)
+		{
+			Node *dependency_node = FindLocked(dependency);
+			if (dependency_node == nullptr || dependency_node->state == kFailed)
+			{
+				missing = true;
+			}
+			else if (dependency_node->state != kSucceeded)
+			{
+				dependency_node->dependents.push_back(node);
+				node->waiting_dependencies++;
+			}
+		}
+		if (missing)
+			failed.push_back(node);
+	}
+
+	// 模拟一次拓扑排序，排不出来的步骤在环上或依赖环上的步骤
+	std::map<Node *, size_t> waiting;
+	std::vector<Node *> ready;
+	for (Node *node : members)
+	{
+		waiting[node] = node->waiting_dependencies;
+		if (node->waiting_dependencies == 0)
+			ready.push_back(node);
+	}
+	size_t sorted = 0;
+	while (!ready.empty())
+	{
+		Node *node = ready.back();
+		ready.pop_back();
+		sorted++;
+		for (Node *dependent : node->dependents)
+		{
+			if (--waiting[dependent] == 0)
+				ready.push_back(dependent);
+		}
+	}
+	if (sorted != members.size())
+	{
+		for (Node *node : members)
+		{
+			if (waiting[node] == 0)
+				continue;
+			LOG(ERROR) << "[startup] dependency cycle at " << node->name;
+			// 环上的步骤互为 dependents，逐个失败时会沿着 dependents 传播
+			if (node->state == kPending)
+				FailLocked(node);
+		}
+	}
+
+	for (Node *node : failed)
+	{
+		if (node->state == kPending)
+			FailLocked(node);
+	}
+	TimeTicks now = TimeTicks::Now();
+	for (Node *node : members)
+	{
+		if (node->state == kPending && node->waiting_dependencies == 0)
+		{
+			node->ready_time = now;
+			ScheduleLocked(node);
+		}
+	}
+}
+
+bool StartupGraph::Wait()
+{
+	DCHECK(!WorkStealingPool::GetInstance()->RunsTasksOnCurrentThread());
+	base::AutoLock auto_lock(lock_);
+	while (outstanding_ > 0)
+		finished_.Wait();
+	return all_succeeded_;
+}
+
+bool StartupGraph::IsIdle()
+{
+	base::AutoLock auto_lock(lock_);
+	return outstanding_ == 0;
+}
+
+void StartupGraph::SetStepObserver(const StartupStepObserver &observer)
+{
+	base::AutoLock auto_lock(lock_);
+	observer_ = observer;
+}
+
+std::vector<StartupStepTiming> StartupGraph::Timings()
+{
+	std::vector<StartupStepTiming> timings;
+	{
+		base::AutoLock auto_lock(lock_);
+		for (Node *node : order_)
+		{
+			if (node->state == kSucceeded || node->state == kFailed)
+				timings.push_back(node->timing);
+		}
+	}
+	std::stable_sort(timings.begin(), timings.end(), [](const StartupStepTiming &a, const StartupStepTiming &b) {
+		return a.start_offset < b.start_offset;
+	});
+	return timings;
+}
+
+std::string StartupGraph::Dump()
+{
+	std::vector<StartupStepTiming> timings = Timings();
+	std::map<std::string, std::vector<std::string>> dependencies;
+	{
+		base::AutoLock auto_lock(lock_);
+		for (Node *node : order_)
+			dependencies[node->name] = node->dependencies;
+	}
+
+	std::string output;
+	TimeDelta total;
+	TimeDelta end;
+	for (const StartupStepTiming &timing : timings)
+	{
+		base::StringAppendF(&output, "%-32s %8.2fms +%8.2fms queue %6.2fms %s %s%s\n", timing.name.c_str(),
+			timing.duration.InMillisecondsF(), timing.start_offset.InMillisecondsF(),
+			timing.queue_delay.InMillisecondsF(),
+			timing.parallel ? "parallel" : (timing.thread_name.empty() ? "skipped " : "inline  "),
+			timing.thread_name.c_str(), timing.succeeded ? "" : " FAILED");
+		total += timing.duration;
+		end = std::max(end, timing.start_offset + timing.duration);
+	}
+
+	// 依赖按 Timings 的开始时间排在前面，按顺序计算到每一步为止最长的依赖链
+	std::map<std::string, std::pair<TimeDelta, std::string>> longest;	// 链的总耗时，链上的前一步
+	std::string critical;
+	for (const StartupStepTiming &timing : timings)
+	{
+		std::pair<TimeDelta, std::string> best;
+		for (const std::string &dependency : dependencies[timing.name])
+		{
+			auto it = longest.find(dependency);
+			if (it != longest.end() && it->second.first > best.first)
+				best = std::make_pair(it->second.first, dependency);
+		}
+		longest[timing.name] = std::make_pair(best.first + timing.duration, best.second);
+		if (critical.empty() || longest[timing.name].first > longest[critical].first)
+			critical = timing.name;
+	}
+	base::StringAppendF(&output, "steps %u, sum %.2fms, wall %.2fms", (unsigned)timings.size(),
+		total.InMillisecondsF(), end.InMillisecondsF());
+	if (!critical.empty())
+	{
+		std::string path;
+		for (std::string step = critical; !step.empty(); step = longest[step].second)
+			path = path.empty() ? step : step + " > " + path;
+		base::StringAppendF(&output, ", critical path %.2fms: %s", longest[critical].first.InMillisecondsF(),
+			path.c_str());
+	}
+	output += "\n";
+	return output;
+}
+
+StartupGraph::Node* StartupGraph::FindLocked(const std::string &name)
+{
+	auto it = nodes_.find(name);
+	return it != nodes_.end() ? it->second.get() : nullptr;
+}
+
+bool StartupGraph::CollectLocked(Node *node, std::vector<Node *> *order, std::map<Node *, int> *marks)
+{
+	int &mark = (*marks)[node];
+	if (mark == kVisited)
+		return true;
+	if (mark == kVisiting)
+		return false;
+	if (node->state == kSucceeded || node->state == kFailed)
+	{
+		mark = kVisited;
+		return true;
+	}
+	mark = kVisiting;
+	bool acyclic = true;
+	for (const std::string &dependency : node->dependencies)
+	{
+		Node *dependency_node = FindLocked(dependency);
+		// 缺失的依赖在执行时按失败处理
+		if (dependency_node != nullptr && !CollectLocked(dependency_node, order, marks))
+			acyclic = false;
+	}
+	(*marks)[node] = kVisited;
+	order->push_back(node);
+	return acyclic;
+}
+
+void StartupGraph::RunLocked(Node *node, bool parallel)
+{
+	DCHECK_EQ(node->state, kPending);
+	node->state = kRunning;
+	StartupStepTiming timing = node->timing;
+	timing.parallel = parallel;
+	timing.thread_name = base::PlatformThread::GetName() != nullptr ? base::PlatformThread::GetName() : "";
+	Step step = std::move(node->step);
+	StartupStepObserver observer = observer_;
+	TimeTicks ready_time = node->ready_time;
+
+	TimeTicks begin = TimeTicks::Now();
+	bool succeeded = false;
+	{
+		base::AutoUnlock auto_unlock(lock_);
+		succeeded = step();
+		// 步骤捕获的对象在锁外释放
+		step = Step();
+		timing.duration = TimeTicks::Now() - begin;
+		timing.start_offset = begin - created_time_;
+		// Require 执行的步骤没有经过排队
+		timing.queue_delay = (parallel && !ready_time.is_null()) ? begin - ready_time : TimeDelta();
+		timing.succeeded = succeeded;
+		RecordHistogram(timing);
+		if (!succeeded)
+			LOG(WARNING) << "[startup] " << timing.name << " failed";
+		if (observer)
+			observer(timing);
+	}
+
+	node->state = succeeded ? kSucceeded : kFailed;
+	node->timing = timing;
+	FinishLocked(node);
+}
+
+void StartupGraph::FailLocked(Node *node)
+{
+	DCHECK_EQ(node->state, kPending);
+	node->state = kFailed;
+	node->step = Step();
+	node->timing.succeeded = false;
+	node->timing.start_offset = TimeTicks::Now() - created_time_;
+	FinishLocked(node);
+}
+
+void StartupGraph::FinishLocked(Node *node)
+{
+	if (node->in_start)
+	{
+		node->in_start = false;
+		outstanding_--;
+		if (node->state != kSucceeded)
+			all_succeeded_ = false;
+	}
+	std::vector<Node *> dependents;
+	dependents.swap(node->dependents);
+	TimeTicks now = TimeTicks::Now();
+	for (Node *dependent : dependents)
+	{
+		if (dependent->state != kPending)
+			continue;
+		if (node->state != kSucceeded)
+		{
+			FailLocked(dependent);
+		}
+		else if (--dependent->waiting_dependencies == 0)
+		{
+			dependent->ready_time = now;
+			ScheduleLocked(dependent);
+		}
+	}
+	finished_.Broadcast();
+}
+
+void StartupGraph::ScheduleLocked(Node *node)
+{
+	ThreadManager::PostParallelTask([this, node]() { RunScheduled(node); });
+}
+
+void StartupGraph::RunScheduled(Node *node)
+{
+	base::AutoLock auto_lock(lock_);
+	// 投递之后可能已经被 Require 在其他线程上执行了
+	if (node->state != kPending)
+		return;
+	RunLocked(node, true);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,135 @@
+// a dependency graph of startup steps, run lazily on first use or in parallel on the worker pool
+
+#ifndef __BASE_EXTENSION_STARTUP_GRAPH_H__
+#define __BASE_EXTENSION_STARTUP_GRAPH_H__
+
+#include "extension/config/build_config.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "base/macros.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 启动步骤什么时候执行
+enum class StartupPolicy
+{
+	kOnDemand,	// 只在第一次 Require 时在调用线程上执行
+	kParallel,	// Start 之后依赖一满足就投递到 WorkStealingPool 执行，之前被 Require 的在调用线程上执行
+};
+
+// 一个启动步骤的执行记录
+struct StartupStepTiming
+{
+	std::string name;
+	std::string thread_name;	// 执行该步骤的线程
+	bool parallel;				// 由 Start 投递到工作线程执行，否则为 Require 时同步执行
+	bool succeeded;
+	TimeDelta start_offset;		// 相对于 StartupGraph 创建的时间
+	TimeDelta queue_delay;		// 依赖全部完成到开始执行的时间
+	TimeDelta duration;
+};
+typedef std::function<void(const StartupStepTiming &)> StartupStepObserver;
+
+// 启动编排：各模块把初始化注册成带依赖的步骤，不再在启动时逐个串行初始化。
+//   StartupGraph *graph = StartupGraph::GetInstance();
+//   graph->Register("net.observer", {}, [] { NimNetUtil::GetInstance()->StartNetWorkStateChangeObserver(); return true; });
+//   graph->Register("http.threads", { "net.observer" }, [manager] { manager->Prewarm(); return true; });
+//   graph->Start();						// 没有依赖关系的步骤在工作线程上同时执行
+//   ...
+//   graph->Require("http.threads");		// 第一次使用前调用，已完成时只是一次查表
+// 每个步骤最多执行一次，执行时它的依赖都已成功完成；依赖失败的步骤不执行，也算失败。
+// 每一步的耗时写入 base/metrics 直方图 Startup.<name>，并可以通过 Timings / Dump 查看。
+// 步骤在工作线程上执行，不要依赖线程局部状态，也不要长时间阻塞；
+// 步骤中只能 Require 自己声明过的依赖，否则可能和等待它的线程互相等待。
+// 该单例刻意不析构，可以在任意线程调用
+class EXTENSION_EXPORT StartupGraph
+{
+public:
+	typedef std::function<bool()> Step;
+
+	static StartupGraph* GetInstance();
+
+	// 注册一个步骤，step 返回 false 表示失败。同名的步骤已存在或者 Start 之后再注册 kParallel 的步骤时返回 false；
+	// 依赖可以在之后注册，执行时仍未注册的依赖视为失败
+	bool Register(const std::string &name, const std::vector<std::string> &dependencies, Step step,
+		StartupPolicy policy = StartupPolicy::kParallel);
+	// 确保 name 及其依赖已执行：未执行的在调用线程上按依赖顺序执行，正在其他线程上执行的等待其完成。
+	// 返回 name 是否成功，未注册或依赖成环时返回 false
+	bool Require(const std::string &name);
+	// 把 kParallel 的步骤按依赖关系投递到 WorkStealingPool，立即返回，只有第一次调用有效
+	void Start();
+	// 等待 Start 投递的步骤全部结束，返回是否都成功；不能在工作线程上调用
+	bool Wait();
+	// Start 投递的步骤是否都已结束
+	bool IsIdle();
+
+	// 每个步骤执行完后在执行它的线程上调用
+	void SetStepObserver(const StartupStepObserver &observer);
+	// 已执行的步骤，按开始时间排序
+	std::vector<StartupStepTiming> Timings();
+	// 每一步的耗时和总耗时，便于写日志；critical path 为耗时最长的一条依赖链
+	std::string Dump();
+
+private:
+	enum State
+	{
+		kPending,
+		kRunning,
+		kSucceeded,
+		kFailed,
+	};
+	struct Node
+	{
+		std::string name;
+		std::vector<std::string> dependencies;
+		std::vector<Node *> dependents;	// Start 时建立
+		Step step;
+		StartupPolicy policy;
+		State state;
+		size_t waiting_dependencies;	// Start 之后还没完成的依赖数
+		bool in_start;					// 由 Start 计入 outstanding_ 且还没结束
+		TimeTicks ready_time;			// 依赖全部完成的时间
+		StartupStepTiming timing;
+	};
+
+	StartupGraph();
+
+	// 以下带 Locked 的函数调用时持有 lock_
+	Node* FindLocked(const std::string &name);
+	// 按依赖顺序收集 node 所有未完成的步骤，成环时返回 false
+	bool CollectLocked(Node *node, std::vector<Node *> *order, std::map<Node *, int> *marks);
+	// 在调用线程上执行 node，node 必须处于 kPending 且依赖都已成功，执行期间释放锁
+	void RunLocked(Node *node, bool parallel);
+	// node 因依赖失败、缺失或成环而不执行
+	void FailLocked(Node *node);
+	// node 结束后通知 Start 建立的依赖关系，把依赖已满足的步骤投递出去
+	void FinishLocked(Node *node);
+	void ScheduleLocked(Node *node);
+	// 工作线程的入口
+	void RunScheduled(Node *node);
+
+	base::Lock lock_;
+	base::ConditionVariable finished_;	// 任一步骤结束时广播
+	std::map<std::string, std::unique_ptr<Node>> nodes_;
+	std::vector<Node *> order_;			// 注册顺序
+	bool started_;
+	size_t outstanding_;				// Start 投递而还没结束的步骤数
+	bool all_succeeded_;
+	TimeTicks created_time_;
+	StartupStepObserver observer_;
+
+	DISALLOW_COPY_AND_ASSIGN(StartupGraph);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_STARTUP_GRAPH_H__
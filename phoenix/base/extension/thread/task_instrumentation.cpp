@@ -0,0 +1,212 @@
+#include "extension/thread/task_instrumentation.h"
+#include <algorithm>
+#include <set>
+#include "base/lazy_instance.h"
+#include "base/logging.h"
+#include "base/metrics/histogram.h"
+#include "base/metrics/statistics_recorder.h"
+#include "base/pending_task.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread_local.h"
+#include "extension/thread/framework_thread.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const char kHistogramPrefix[] = "FrameworkThread.";
+
+base::LazyInstance<base::ThreadLocalPointer<TaskInstrumentation>>::Leaky
+	lazy_task_instrumentation_tls = LAZY_INSTANCE_INITIALIZER;
+
+// 所有正在统计的线程，以及长任务的处理函数
+struct InstrumentationRegistry
+{
+	base::Lock lock;
+	std::set<TaskInstrumentation *> instrumentations;
+	LongTaskHandler long_task_handler;
+	LongTaskHandler long_task_trigger;
+};
+
+InstrumentationRegistry* GetRegistry()
+{
+	static InstrumentationRegistry *registry = new InstrumentationRegistry;
+	return registry;
+}
+
+void LogLongTask(const LongTaskInfo &info)
+{
+	LOG(WARNING) << "Long task on thread " << info.thread_name
+				 << " posted from " << info.posted_from.ToString()
+				 << ": ran " << info.run_time.InMilliseconds() << "ms"
+				 << ", queued " << info.queue_delay.InMilliseconds() << "ms";
+}
+}
+
+void TaskInstrumentation::AttachToCurrentThread(const std::string &thread_name, TimeDelta long_task_threshold)
+{
+	base::MessageLoop *message_loop = base::MessageLoop::current();
+	if (message_loop == nullptr || lazy_task_instrumentation_tls.Pointer()->Get() != nullptr)
+		return;
+
+	base::StatisticsRecorder::Initialize();
+	TaskInstrumentation *instrumentation = new TaskInstrumentation(thread_name, long_task_threshold);
+	lazy_task_instrumentation_tls.Pointer()->Set(instrumentation);
+	message_loop->AddTaskObserver(instrumentation);
+	message_loop->AddDestructionObserver(instrumentation);
+
+	InstrumentationRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	registry->instrumentations.insert(instrumentation);
+}
+
+void TaskInstrumentation::SetLongTaskHandler(const LongTaskHandler &handler)
+{
+	InstrumentationRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	registry->long_task_handler = handler;
+}
+
+void TaskInstrumentation::SetLongTaskTrigger(const LongTaskHandler &trigger)
+{
+	InstrumentationRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	registry->long_task_trigger = trigger;
+}
+
+std::string TaskInstrumentation::Dump(size_t max_locations)
+{
+	std::string output;
+	base::StatisticsRecorder::WriteGraph(kHistogramPrefix, &output);
+
+	InstrumentationRegistry *registry = GetRegistry();
+	base::AutoLock lock(registry->lock);
+	for (const TaskInstrumentation *instrumentation : registry->instrumentations)
+		instrumentation->DumpLocations(max_locations, &output);
+	return output;
+}
+
+TaskInstrumentation::TaskInstrumentation(const std::string &thread_name, TimeDelta long_task_threshold)
+	: thread_name_(thread_name)
+	, long_task_threshold_(long_task_threshold)
+{
+	std::string prefix = kHistogramPrefix + thread_name + ".";
+	queue_depth_ = base::Histogram::FactoryGet(prefix + "QueueDepth", 1, 10000, 50,
+		base::HistogramBase::kNoFlags);
+	queue_delay_ = base::Histogram::FactoryTimeGet(prefix + "QueueDelay", TimeDelta::FromMilliseconds(1),
+		TimeDelta::FromSeconds(10), 50, base::HistogramBase::kNoFlags);
+	run_time_ = base::Histogram::FactoryTimeGet(prefix + "RunTime", TimeDelta::FromMilliseconds(1),
+		TimeDelta::FromSeconds(10), 50, base::HistogramBase::kNoFlags);
+}
+
+TaskInstrumentation::~TaskInstrumentation()
+{
+}
+
+void TaskInstrumentation::WillProcessTask(const base::PendingTask &pending_task)
+{
+	base::TimeTicks now = base::TimeTicks::Now();
+	TimeDelta queue_delay;
+	if (!pending_task.queue_time.is_null())
+	{
+		// 延时任务从到期开始算
+		base::TimeTicks ready_time = pending_task.queue_time;
+		if (pending_task.delayed_run_time > ready_time)
+			ready_time = pending_task.delayed_run_time;
+		if (now > ready_time)
+			queue_delay = now - ready_time;
+		queue_delay_->AddTime(queue_delay);
+	}
+	queue_depth_->Add((int)base::MessageLoop::current()->GetPendingTaskCount());
+	running_.push_back(std::make_pair(now, queue_delay));
+}
+
+void TaskInstrumentation::DidProcessTask(const base::PendingTask &pending_task)
+{
+	if (running_.empty())
+		return;
+	TimeDelta run_time = base::TimeTicks::Now() - running_.back().first;
+	TimeDelta queue_delay = running_.back().second;
+	running_.pop_back();
+	run_time_->AddTime(run_time);
+
+	{
+		base::AutoLock lock(lock_);
+		const tracked_objects::Location &location = pending_task.posted_from;
+		auto &entry = locations_[LocationKey(location.file_name(), location.line_number())];
+		entry.first = location;
+		LocationStats &stats = entry.second;
+		stats.count++;
+		stats.total_run_time += run_time;
+		stats.total_queue_delay += queue_delay;
+		if (run_time > stats.max_run_time)
+			stats.max_run_time = run_time;
+	}
+
+	if (long_task_threshold_ <= TimeDelta() || run_time < long_task_threshold_)
+		return;
+	LongTaskHandler handler;
+	LongTaskHandler trigger;
+	{
+		InstrumentationRegistry *registry = GetRegistry();
+		base::AutoLock lock(registry->lock);
+		handler = registry->long_task_handler;
+		trigger = registry->long_task_trigger;
+	}
+	LongTaskInfo info;
+	info.thread_name = thread_name_;
+	info.thread_identifier = FrameworkThread::CurrentManagedThreadId();
+	info.posted_from = pending_task.posted_from;
+	info.run_time = run_time;
+	info.queue_delay = queue_delay;
+	if (handler)
+		handler(info);
+	else
+		LogLongTask(info);
+	if (trigger)
+		trigger(info);
+}
+
+void TaskInstrumentation::WillDestroyCurrentMessageLoop()
+{
+	{
+		InstrumentationRegistry *registry = GetRegistry();
+		base::AutoLock lock(registry->lock);
+		registry->instrumentations.erase(this);
+	}
+	base::MessageLoop::current()->RemoveTaskObserver(this);
+	lazy_task_instrumentation_tls.Pointer()->Set(nullptr);
+	delete this;
+}
+
+void TaskInstrumentation::DumpLocations(size_t max_locations, std::string *output) const
+{
+	typedef std::pair<tracked_objects::Location, LocationStats> Item;
+	std::vector<Item> items;
+	{
+		base::AutoLock lock(lock_);
+		for (const auto &it : locations_)
+			items.push_back(it.second);
+	}
+	std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+		return a.second.total_run_time > b.second.total_run_time;
+	});
+	if (items.size() > max_locations)
+		items.resize(max_locations);
+
+	base::StringAppendF(output, "Tasks of thread %s by location (count, total/max run ms, average queue ms)\n",
+		thread_name_.c_str());
+	for (const Item &item : items)
+	{
+		const LocationStats &stats = item.second;
+		base::StringAppendF(output, "  %s: %llu, %lld/%lld, %lld\n",
+			item.first.ToString().c_str(),
+			(unsigned long long)stats.count,
+			(long long)stats.total_run_time.InMilliseconds(),
+			(long long)stats.max_run_time.InMilliseconds(),
+			(long long)(stats.total_queue_delay.InMilliseconds() / (int64_t)stats.count));
+	}
+	output->append("\n");
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,98 @@
+// per-thread statistics of the posted tasks: queue depth, time in queue and run time
+
+#ifndef __BASE_EXTENSION_TASK_INSTRUMENTATION_H__
+#define __BASE_EXTENSION_TASK_INSTRUMENTATION_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/location.h"
+#include "base/message_loop/message_loop.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+namespace base
+{
+class HistogramBase;
+}
+
+EXTENSION_BEGIN_DECLS
+
+// 一个耗时过长的任务
+struct LongTaskInfo
+{
+	LongTaskInfo() : thread_identifier(-1) {}
+
+	std::string thread_name;
+	int64_t thread_identifier;	// 线程在 ThreadManager 中的 identifier，没有托管时为 -1
+	tracked_objects::Location posted_from;
+	TimeDelta run_time;
+	TimeDelta queue_delay;	// 从投递（延时任务从到期）到开始执行的时间
+};
+typedef std::function<void(const LongTaskInfo &)> LongTaskHandler;
+
+// 挂在线程消息循环上的 TaskObserver，统计该线程执行的每一个任务：
+// 开始执行时队列中还在等待的任务数、在队列中等待的时间和执行时间写入 base/metrics 直方图
+// （FrameworkThread.<线程名>.QueueDepth / QueueDelay / RunTime），并按投递位置汇总；
+// 执行时间超过阈值的任务交给 LongTaskHandler。
+// 消息循环销毁时自动移除，统计结果保留在直方图中
+class EXTENSION_EXPORT TaskInstrumentation : public base::MessageLoop::TaskObserver,
+											 public base::MessageLoop::DestructionObserver
+{
+public:
+	// 在当前线程的消息循环上开始统计，long_task_threshold 为 0 时不报告长任务；
+	// 当前线程没有消息循环或已经在统计时什么也不做
+	static void AttachToCurrentThread(const std::string &thread_name, TimeDelta long_task_threshold);
+	// 替换长任务的处理函数，默认写 LOG(WARNING)；处理函数在执行任务的线程上调用
+	static void SetLongTaskHandler(const LongTaskHandler &handler);
+	// 在处理函数之后调用，用于长任务发生后自动收集诊断信息（如 SamplingProfiler），不影响日志上报；传空函数即移除
+	static void SetLongTaskTrigger(const LongTaskHandler &trigger);
+	// 所有线程的直方图和各投递位置的汇总，按总执行时间由高到低，每个线程最多 max_locations 项
+	static std::string Dump(size_t max_locations = 20);
+
+private:
+	struct LocationStats
+	{
+		LocationStats() : count(0) {}
+		uint64_t count;
+		TimeDelta total_run_time;
+		TimeDelta max_run_time;
+		TimeDelta total_queue_delay;
+	};
+	// 投递位置的文件名和函数名都是字符串常量，按指针和行号区分
+	typedef std::pair<const char *, int> LocationKey;
+
+	TaskInstrumentation(const std::string &thread_name, TimeDelta long_task_threshold);
+	~TaskInstrumentation();
+
+	void WillProcessTask(const base::PendingTask &pending_task) override;
+	void DidProcessTask(const base::PendingTask &pending_task) override;
+	void WillDestroyCurrentMessageLoop() override;
+
+	void DumpLocations(size_t max_locations, std::string *output) const;
+
+private:
+	std::string thread_name_;
+	TimeDelta long_task_threshold_;
+	base::HistogramBase *queue_depth_;
+	base::HistogramBase *queue_delay_;
+	base::HistogramBase *run_time_;
+	// 嵌套消息循环中的任务会在外层任务结束前开始
+	std::vector<std::pair<base::TimeTicks, TimeDelta>> running_;
+	mutable base::Lock lock_;
+	std::map<LocationKey, std::pair<tracked_objects::Location, LocationStats>> locations_;
+
+	DISALLOW_COPY_AND_ASSIGN(TaskInstrumentation);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_TASK_INSTRUMENTATION_H__
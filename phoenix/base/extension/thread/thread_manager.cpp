@@ -1,10 +1,197 @@
 #include "base/atomicops.h"
+#include <set>
+#include <thread>
+#include "base/logging.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/threading/platform_thread.h"
 #include "base/thread_task_runner_handle.h"
 #include "base/task_runner_util.h"
+#include "base/trace_event/trace_event.h"
 #include "extension/thread/thread_manager.h"
+#include "extension/thread/power_scheduler.h"
+#include "extension/thread/virtual_thread.h"
+#include "extension/thread/work_stealing_pool.h"
 
 EXTENSION_BEGIN_DECLS
 
+namespace
+{
+// Shutdown 期间为 true，之前投递、还没开始执行的任务不再执行
+std::atomic<bool> g_discard_pending_tasks(false);
+std::atomic<bool> g_shutting_down(false);
+
+void RunManagedTask(OnceClosure task)
+{
+	if (g_discard_pending_tasks.load(std::memory_order_relaxed))
+		return;
+	task();
+}
+
+// ThreadManager 投递的任务都经过这里，丢弃的任务随闭包一起析构
+base::Closure ToManagedClosure(OnceClosure task)
+{
+	return base::Bind(&RunManagedTask, base::Passed(std::move(task)));
+}
+
+void RunManagedIdleTask(const IdleTask &task, TimeTicks deadline)
+{
+	if (g_discard_pending_tasks.load(std::memory_order_relaxed))
+		return;
+	task(deadline);
+}
+
+base::SingleThreadTaskRunner::Priority ToRunnerPriority(TaskPriority priority)
+{
+	switch (priority)
+	{
+	case TaskPriority::kHigh:
+		return base::SingleThreadTaskRunner::PRIORITY_HIGH;
+	case TaskPriority::kLow:
+		return base::SingleThreadTaskRunner::PRIORITY_LOW;
+	default:
+		return base::SingleThreadTaskRunner::PRIORITY_NORMAL;
+	}
+}
+
+// 退出时的 flush 步骤和正在运行的 FrameworkThread
+class ShutdownRegistry
+{
+public:
+	struct Flush
+	{
+		std::string name;
+		TimeDelta budget;
+		StdClosure flush;
+		bool running;
+		TimeDelta elapsed;
+	};
+
+	static ShutdownRegistry* GetInstance()
+	{
+		static ShutdownRegistry *instance = new ShutdownRegistry;
+		return instance;
+	}
+
+	ShutdownRegistry() : changed(&lock), next_id(1) {}
+
+	base::Lock lock;
+	base::ConditionVariable changed;	// flush 返回或线程退出时广播
+	std::map<int, Flush> flushes;
+	int next_id;
+	std::set<FrameworkThread *> threads;
+};
+
+// 合并投递中还没开始执行的任务，按目标线程的 task runner 和 key 索引
+class CoalescedTaskTable
+{
+public:
+	static CoalescedTaskTable* GetInstance()
+	{
+		static CoalescedTaskTable *instance = new CoalescedTaskTable;
+		return instance;
+	}
+
+	bool Post(const scoped_refptr<base::SingleThreadTaskRunner> &task_runner, const std::string &key, OnceClosure task)
+	{
+		Key slot_key(task_runner.get(), key);
+		std::shared_ptr<Slot> slot;
+		OnceClosure replaced;	// 被顶替的任务在锁外析构，它的捕获析构时可能再次投递
+		{
+			base::AutoLock lock(lock_);
+			std::shared_ptr<Slot> &pending = slots_[slot_key];
+			if (pending)
+			{
+				replaced = std::move(pending->task);
+				pending->task = std::move(task);
+				return true;
+			}
+			pending = std::make_shared<Slot>();
+			pending->task = std::move(task);
+			slot = pending;
+		}
+		return task_runner->PostTask(FROM_HERE, ToManagedClosure(Drain(this, std::move(slot_key), std::move(slot))));
+	}
+
+private:
+	typedef std::pair<const void *, std::string> Key;
+
+	struct Slot
+	{
+		OnceClosure task;
+	};
+
+	// 投递到目标线程上的闭包；目标线程退出时没执行就被销毁，也要把表项删掉
+	class Drain
+	{
+	public:
+		Drain(CoalescedTaskTable *table, Key &&key, std::shared_ptr<Slot> &&slot)
+			: table_(table), key_(std::move(key)), slot_(std::move(slot)) {}
+		Drain(Drain &&other) noexcept
+			: table_(other.table_), key_(std::move(other.key_)), slot_(std::move(other.slot_)) {}
+		~Drain()
+		{
+			if (slot_)
+				table_->Take(key_, slot_);
+		}
+
+		void operator()()
+		{
+			OnceClosure task = table_->Take(key_, slot_);
+			slot_.reset();
+			task();
+		}
+
+	private:
+		CoalescedTaskTable *table_;
+		Key key_;
+		std::shared_ptr<Slot> slot_;
+	};
+
+	OnceClosure Take(const Key &key, const std::shared_ptr<Slot> &slot)
+	{
+		base::AutoLock lock(lock_);
+		auto it = slots_.find(key);
+		if (it != slots_.end() && it->second == slot)
+			slots_.erase(it);
+		return std::move(slot->task);
+	}
+
+	base::Lock lock_;
+	std::map<Key, std::shared_ptr<Slot>> slots_;
+};
+
+OnceClosure MakeBatchTask(std::vector<OnceClosure> tasks)
+{
+	return [tasks = std::move(tasks)]() mutable {
+		for (auto &task : tasks)
+			task();
+	};
+}
+}
+
+ThreadMap::ThreadMap()
+{
+	for (auto &page : pages_)
+		page.store(nullptr, std::memory_order_relaxed);
+}
+
+ThreadMap::~ThreadMap()
+{
+	for (auto &page : pages_)
+	{
+		Page *p = page.load(std::memory_order_relaxed);
+		if (!p)
+			continue;
+		for (auto &slot : p->slots)
+		{
+			base::SingleThreadTaskRunner *task_runner = slot.task_runner.load(std::memory_order_relaxed);
+			if (task_runner)
+				task_runner->Release();
+		}
+		delete p;
+	}
+}
+
 bool ThreadMap::AquireAccess()
 {
 	FrameworkThreadTlsData *tls = FrameworkThread::GetTlsData();
@@ -25,6 +212,11 @@ bool ThreadMap::RegisterThread(int64_t self_identifier)
 		return false;
 
 	base::AutoLock lock(lock_);
+	if (virtual_threads_.count(self_identifier) > 0)
+	{
+		DCHECK(false); // a virtual thread has registered with the same id
+		return false;
+	}
 	auto pr = threads_.insert(
 			std::make_pair(self_identifier, tls->self));
 	if (!pr.second)
@@ -38,6 +230,11 @@ bool ThreadMap::RegisterThread(int64_t self_identifier)
 		DCHECK(tls->managed > 0);
 		DCHECK(tls->managed_thread_id == self_identifier);
 	}
+	if (pr.second)
+	{
+		PublishTaskRunner(self_identifier, tls->self->task_runner());
+		platform_thread_ids_[self_identifier] = base::PlatformThread::CurrentId();
+	}
 	// 'self' is registered
 	tls->managed++;
 	tls->managed_thread_id = self_identifier;
@@ -61,6 +258,8 @@ bool ThreadMap::UnregisterThread()
 		auto iter = threads_.find(tls->managed_thread_id);
 		if (iter != threads_.end()){
 			threads_.erase(iter);
+			platform_thread_ids_.erase(tls->managed_thread_id);
+			RetractTaskRunner(tls->managed_thread_id);
 		}
 		else{
 			DCHECK(false);	// logic error, we should not come here
@@ -70,7 +269,29 @@ bool ThreadMap::UnregisterThread()
 	return true;
 }
 
-// no lock
+bool ThreadMap::RegisterTaskRunner(int64_t identifier, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner)
+{
+	if (identifier < 0 || !task_runner)
+		return false;
+	base::AutoLock lock(lock_);
+	if (threads_.count(identifier) > 0 || !virtual_threads_.insert(std::make_pair(identifier, task_runner)).second)
+		return false;
+	PublishTaskRunner(identifier, task_runner);
+	return true;
+}
+
+bool ThreadMap::UnregisterTaskRunner(int64_t identifier)
+{
+	base::AutoLock lock(lock_);
+	auto iter = virtual_threads_.find(identifier);
+	if (iter == virtual_threads_.end())
+		return false;
+	RetractTaskRunner(identifier);
+	virtual_threads_.erase(iter);
+	return true;
+}
+
+// lock_ must be held
 FrameworkThread* ThreadMap::InternalQueryThread(int64_t identifier) const
 {
 	auto iter = threads_.find(identifier);
@@ -92,15 +313,76 @@ int64_t ThreadMap::GetManagedThreadId(const FrameworkThread *thread)
 	}
 	return -1;
 }
+base::PlatformThreadId ThreadMap::GetPlatformThreadId(int64_t identifier) const
+{
+	base::AutoLock lock(lock_);
+	auto iter = platform_thread_ids_.find(identifier);
+	if (iter == platform_thread_ids_.end())
+		return base::kInvalidThreadId;
+	return iter->second;
+}
 scoped_refptr<base::SingleThreadTaskRunner> ThreadMap::task_runner(int64_t identifier) const
 {
-	FrameworkThread* thread = InternalQueryThread(identifier);
-	if (!thread)
+	if (identifier < 0)
+		return nullptr;
+	if (identifier >= kMaxIndexedIdentifier)
 	{
+		base::AutoLock lock(lock_);
+		FrameworkThread* thread = InternalQueryThread(identifier);
+		if (!thread)
+		{
+			auto iter = virtual_threads_.find(identifier);
+			return iter != virtual_threads_.end() ? iter->second : nullptr;
+		}
+		return thread->task_runner();
+	}
+
+	Page *page = pages_[identifier / kPageSize].load(std::memory_order_acquire);
+	if (!page)
 		return nullptr;
+	// 先登记读者再取指针，RetractTaskRunner 摘掉指针后会等到读者取完引用
+	Slot &slot = page->slots[identifier % kPageSize];
+	slot.readers.fetch_add(1, std::memory_order_seq_cst);
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner(slot.task_runner.load(std::memory_order_seq_cst));
+	slot.readers.fetch_sub(1, std::memory_order_release);
+	return task_runner;
+}
+
+void ThreadMap::PublishTaskRunner(int64_t identifier, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner)
+{
+	if (identifier >= kMaxIndexedIdentifier)
+		return;
+	if (!task_runner)
+		return;
+	std::atomic<Page*> &entry = pages_[identifier / kPageSize];
+	Page *page = entry.load(std::memory_order_relaxed);
+	if (!page)
+	{
+		page = new Page;
+		entry.store(page, std::memory_order_release);
 	}
+	task_runner->AddRef();
+	base::SingleThreadTaskRunner *old = page->slots[identifier % kPageSize].task_runner.exchange(task_runner.get(), std::memory_order_seq_cst);
+	DCHECK(!old);
+	if (old)
+		old->Release();
+}
 
-	return thread->task_runner();
+void ThreadMap::RetractTaskRunner(int64_t identifier)
+{
+	if (identifier >= kMaxIndexedIdentifier)
+		return;
+	Page *page = pages_[identifier / kPageSize].load(std::memory_order_relaxed);
+	if (!page)
+		return;
+	Slot &slot = page->slots[identifier % kPageSize];
+	base::SingleThreadTaskRunner *task_runner = slot.task_runner.exchange(nullptr, std::memory_order_seq_cst);
+	if (!task_runner)
+		return;
+	// 读者只在取指针和加引用之间停留，很快就会退出
+	while (slot.readers.load(std::memory_order_seq_cst) != 0)
+		base::PlatformThread::YieldCurrentThread();
+	task_runner->Release();
 }
 
 ThreadManager::ThreadManager()
@@ -130,6 +412,26 @@ bool ThreadManager::UnregisterThread()
 	}
 	return thread_map->UnregisterThread();
 }
+bool ThreadManager::RegisterVirtualThread(int64_t identifier, const std::string& name)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	if (!thread_map)
+	{
+		return false;
+	}
+	return thread_map->RegisterTaskRunner(identifier, VirtualThreadPool::GetInstance()->CreateTaskRunner(name));
+}
+
+bool ThreadManager::UnregisterVirtualThread(int64_t identifier)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	if (!thread_map)
+	{
+		return false;
+	}
+	return thread_map->UnregisterTaskRunner(identifier);
+}
+
 FrameworkThread* ThreadManager::CreateFrameworkThread(int64_t identifier, const std::string& name)
 {
 	auto thread = new FrameworkThread(name);
@@ -141,11 +443,19 @@ FrameworkThread* ThreadManager::CreateFrameworkThread(int64_t identifier, const
 		});
 	return thread;
 }
+FrameworkThread* ThreadManager::CreateFrameworkThread(int64_t identifier, const std::string& name, const FrameworkThreadOptions& options)
+{
+	auto thread = CreateFrameworkThread(identifier, name);
+	thread->SetThreadOptions(options);
+	return thread;
+}
 std::shared_ptr<FrameworkThread> ThreadManager::GlobalTimerThreadRef()
 {
 	auto weak_thread = ThreadManager::GetInstance()->_global_timer_thread;
 	auto shared_thread = weak_thread.lock();
-	if (!shared_thread) {
+	// Shutdown 之后旧线程已退出，重新创建（例如切换帐号后再次登录）
+	if (!shared_thread || !shared_thread->IsRunning()) {
+		TRACE_EVENT0("nim.thread", "ThreadManager::CreateGlobalTimerThread");
 		shared_thread = std::make_shared<FrameworkThread>("global_timer_thread");
 		ThreadManager::GetInstance()->SetGlobalTimerThread(shared_thread);
 		bool success = shared_thread->Start();
@@ -191,6 +501,16 @@ int64_t ThreadManager::QueryThreadId(const FrameworkThread *thread)
 	return thread_map->GetManagedThreadId(thread);
 }
 
+base::PlatformThreadId ThreadManager::QueryPlatformThreadId(int64_t identifier)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	if (!thread_map)
+	{
+		return base::kInvalidThreadId;
+	}
+	return thread_map->GetPlatformThreadId(identifier);
+}
+
 FrameworkThread* ThreadManager::CurrentThread()
 {
 	FrameworkThreadTlsData *tls = FrameworkThread::GetTlsData();
@@ -202,38 +522,82 @@ FrameworkThread* ThreadManager::CurrentThread()
 	return tls->self;
 }
 
-bool ThreadManager::PostTask(const StdClosure &task)
+bool ThreadManager::PostTask(OnceClosure task)
 {
 	//MessageLoop::current()->PostTask(task);
 	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	base::ThreadTaskRunnerHandle::Get()->PostTask(FROM_HERE,closure);
 	return true;
 }
 
-bool ThreadManager::PostTimerTask(const StdClosure &task, const StdClosure &cb, TimeDelta delay)
+bool ThreadManager::PostTask(OnceClosure task, TaskPriority priority)
+{
+	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+	auto closure = ToManagedClosure(std::move(task));
+	if (priority == TaskPriority::kLow && PowerScheduler::IsBackground() &&
+		PowerScheduler::GetInstance()->DeferLowPriorityTask(base::ThreadTaskRunnerHandle::Get(), closure))
+		return true;
+	return base::ThreadTaskRunnerHandle::Get()->PostPriorityTask(FROM_HERE, closure, ToRunnerPriority(priority));
+}
+
+bool ThreadManager::PostTask(int64_t identifier, OnceClosure task, TaskPriority priority)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	auto task_runner = thread_map ? thread_map->task_runner(identifier) : nullptr;
+	if (!task_runner)
+	{
+		return false;
+	}
+	auto closure = ToManagedClosure(std::move(task));
+	if (priority == TaskPriority::kLow && PowerScheduler::IsBackground() &&
+		PowerScheduler::GetInstance()->DeferLowPriorityTask(task_runner, closure))
+		return true;
+	return task_runner->PostPriorityTask(FROM_HERE, closure, ToRunnerPriority(priority));
+}
+
+bool ThreadManager::PostIdleTask(IdleTask task, TimeDelta timeout)
+{
+	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+	if (!task)
+		return false;
+	return base::ThreadTaskRunnerHandle::Get()->PostIdleTask(FROM_HERE, base::Bind(&RunManagedIdleTask, std::move(task)), timeout);
+}
+
+bool ThreadManager::PostIdleTask(int64_t identifier, IdleTask task, TimeDelta timeout)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	auto task_runner = thread_map ? thread_map->task_runner(identifier) : nullptr;
+	if (!task_runner || !task)
+	{
+		return false;
+	}
+	return task_runner->PostIdleTask(FROM_HERE, base::Bind(&RunManagedIdleTask, std::move(task)), timeout);
+}
+
+bool ThreadManager::PostTimerTask(OnceClosure task, OnceClosure cb, TimeDelta delay)
 {
 	auto task_runner = base::ThreadTaskRunnerHandle::Get();
 	task_runner = task_runner ? task_runner : GlobalTimerTaskRunner();
-	auto timer_task = [task, cb, task_runner, delay]() {
+	auto timer_task = [task = std::move(task), cb = std::move(cb), task_runner, delay]() mutable {
 
 		NS_EXTENSION::WeakCallbackFlag timer_;
-		StdClosure time_out_task = timer_.ToWeakCallback([cb]()
+		auto time_out_task = timer_.ToWeakCallback([cb = std::move(cb)]() mutable
 		{
 			cb();
 		});
-		auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, time_out_task);
+		auto closure = ToManagedClosure(std::move(time_out_task));
 		task_runner->PostDelayedTask(FROM_HERE,closure, delay);
 		task();
 		if (timer_.HasUsed())
 			timer_.Cancel();
 	};
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, timer_task);
+	auto closure = ToManagedClosure(std::move(timer_task));
 	task_runner->PostTask(FROM_HERE,closure);
 	return true;
 }
 
-bool ThreadManager::PostTaskAndReply(int64_t identifier, const StdClosure &task, const StdClosure &reply)
+bool ThreadManager::PostTaskAndReply(int64_t identifier, OnceClosure task, OnceClosure reply)
 {
 	auto thread_map = ThreadManager::GetInstance()->_threadMap;
 	auto task_runner = thread_map ? thread_map->task_runner(identifier) : nullptr;
@@ -241,13 +605,75 @@ bool ThreadManager::PostTaskAndReply(int64_t identifier, const StdClosure &task,
 	{
 		return false;
 	}
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
-	auto reply_closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, reply);
+	auto closure = ToManagedClosure(std::move(task));
+	auto reply_closure = ToManagedClosure(std::move(reply));
 	task_runner->PostTaskAndReply(FROM_HERE, closure,reply_closure);
 	return true;
 }
 
-bool ThreadManager::PostTask(int64_t identifier, const StdClosure &task)
+bool ThreadManager::PostTasks(std::vector<OnceClosure> tasks)
+{
+	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+	if (tasks.empty())
+		return true;
+	base::ThreadTaskRunnerHandle::Get()->PostTask(FROM_HERE, ToManagedClosure(MakeBatchTask(std::move(tasks))));
+	return true;
+}
+
+bool ThreadManager::PostTasks(int64_t identifier, std::vector<OnceClosure> tasks)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	auto task_runner = thread_map ? thread_map->task_runner(identifier) : nullptr;
+	if (!task_runner)
+	{
+		return false;
+	}
+	if (tasks.empty())
+		return true;
+	task_runner->PostTask(FROM_HERE, ToManagedClosure(MakeBatchTask(std::move(tasks))));
+	return true;
+}
+
+bool ThreadManager::PostCoalescedTask(const std::string &key, OnceClosure task)
+{
+	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+	return CoalescedTaskTable::GetInstance()->Post(base::ThreadTaskRunnerHandle::Get(), key, std::move(task));
+}
+
+bool ThreadManager::PostCoalescedTask(int64_t identifier, const std::string &key, OnceClosure task)
+{
+	auto thread_map = ThreadManager::GetInstance()->_threadMap;
+	auto task_runner = thread_map ? thread_map->task_runner(identifier) : nullptr;
+	if (!task_runner)
+	{
+		return false;
+	}
+	return CoalescedTaskTable::GetInstance()->Post(task_runner, key, std::move(task));
+}
+
+bool ThreadManager::PostParallelTask(OnceClosure task)
+{
+	WorkStealingPool::GetInstance()->PostTask(std::move(task));
+	return true;
+}
+
+bool ThreadManager::PostParallelTaskAndReply(OnceClosure task, OnceClosure reply)
+{
+	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
+	if (!base::ThreadTaskRunnerHandle::IsSet())
+	{
+		return false;
+	}
+	scoped_refptr<base::SingleThreadTaskRunner> reply_runner = base::ThreadTaskRunnerHandle::Get();
+	WorkStealingPool::GetInstance()->PostTask([task = std::move(task), reply = std::move(reply), reply_runner]() mutable {
+		task();
+		auto reply_closure = ToManagedClosure(std::move(reply));
+		reply_runner->PostTask(FROM_HERE, reply_closure);
+	});
+	return true;
+}
+
+bool ThreadManager::PostTask(int64_t identifier, OnceClosure task)
 {
 // 	std::shared_ptr<MessageLoopProxy> message_loop =
 // 		ThreadMap::GetInstance()->GetMessageLoop(identifier);
@@ -260,21 +686,21 @@ bool ThreadManager::PostTask(int64_t identifier, const StdClosure &task)
 	{
 		return false;
 	}
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	task_runner->PostTask(FROM_HERE, closure);
 	return true;
 }
 
-bool ThreadManager::PostDelayedTask(const StdClosure &task, TimeDelta delay)
+bool ThreadManager::PostDelayedTask(OnceClosure task, TimeDelta delay)
 {
 	//MessageLoop::current()->PostDelayedTask(task, delay);
 	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(FROM_HERE, closure,delay);
 	return true;
 }
 
-bool ThreadManager::PostDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay)
+bool ThreadManager::PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay)
 {
 // 	std::shared_ptr<MessageLoopProxy> message_loop =
 // 		ThreadMap::GetInstance()->GetMessageLoop(identifier);
@@ -287,22 +713,22 @@ bool ThreadManager::PostDelayedTask(int64_t identifier, const StdClosure &task,
 	{
 		return false;
 	}
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	task_runner->PostDelayedTask(FROM_HERE, closure,delay);
 	return true;
 }
 
-bool ThreadManager::PostNonNestableTask(const StdClosure &task)
+bool ThreadManager::PostNonNestableTask(OnceClosure task)
 {
 // 	MessageLoop::current()->PostNonNestableTask(task);
 
 	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	base::ThreadTaskRunnerHandle::Get()->PostNonNestableTask(FROM_HERE, closure);
 	return true;
 }
 
-bool ThreadManager::PostNonNestableTask(int64_t identifier, const StdClosure &task)
+bool ThreadManager::PostNonNestableTask(int64_t identifier, OnceClosure task)
 {
 // 	std::shared_ptr<MessageLoopProxy> message_loop =
 // 		ThreadMap::GetInstance()->GetMessageLoop(identifier);
@@ -315,21 +741,21 @@ bool ThreadManager::PostNonNestableTask(int64_t identifier, const StdClosure &ta
 	{
 		return false;
 	}
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	task_runner->PostNonNestableTask(FROM_HERE, closure);
  	return true;
 }
 
-bool ThreadManager::PostNonNestableDelayedTask(const StdClosure &task, TimeDelta delay)
+bool ThreadManager::PostNonNestableDelayedTask(OnceClosure task, TimeDelta delay)
 {
 	// 	MessageLoop::current()->PostNonNestableDelayedTask(task, delay);
 	DCHECK(base::ThreadTaskRunnerHandle::IsSet());
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	base::ThreadTaskRunnerHandle::Get()->PostNonNestableDelayedTask(FROM_HERE, closure,delay);
  	return true;
 }
 
-bool ThreadManager::PostNonNestableDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay)
+bool ThreadManager::PostNonNestableDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay)
 {
 // 	std::shared_ptr<MessageLoopProxy> message_loop =
 // 		ThreadMap::GetInstance()->GetMessageLoop(identifier);
@@ -342,15 +768,181 @@ bool ThreadManager::PostNonNestableDelayedTask(int64_t identifier, const StdClos
 	{
 		return false;
 	}
-	auto closure = base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, task);
+	auto closure = ToManagedClosure(std::move(task));
 	task_runner->PostNonNestableDelayedTask(FROM_HERE, closure,delay);
 	return true;
 }
 
 void ThreadManager::Cleanup()
 {
-// 	if (GlobalTimerThread::GetInstance()->IsRunning())
-// 		GlobalTimerThread::GetInstance()->Stop();
+	Shutdown(ShutdownOptions());
+}
+
+int ThreadManager::RegisterShutdownFlush(const std::string &name, TimeDelta budget, StdClosure flush)
+{
+	ShutdownRegistry *registry = ShutdownRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	int id = registry->next_id++;
+	ShutdownRegistry::Flush &entry = registry->flushes[id];
+	entry.name = name;
+	entry.budget = budget;
+	entry.flush = std::move(flush);
+	entry.running = false;
+	return id;
+}
+
+void ThreadManager::UnregisterShutdownFlush(int id)
+{
+	ShutdownRegistry *registry = ShutdownRegistry::GetInstance();
+	StdClosure flush;	// 捕获在锁外析构
+	base::AutoLock lock(registry->lock);
+	auto it = registry->flushes.find(id);
+	while (it != registry->flushes.end() && it->second.running)
+	{
+		registry->changed.Wait();
+		it = registry->flushes.find(id);
+	}
+	if (it == registry->flushes.end())
+		return;
+	flush = std::move(it->second.flush);
+	registry->flushes.erase(it);
+}
+
+ShutdownReport ThreadManager::Shutdown(const ShutdownOptions &options)
+{
+	TRACE_EVENT0("nim.thread", "ThreadManager::Shutdown");
+	ShutdownReport report;
+	bool expected = false;
+	if (!g_shutting_down.compare_exchange_strong(expected, true))
+		return report;
+	ShutdownRegistry *registry = ShutdownRegistry::GetInstance();
+
+	// 1. 同时执行所有 flush，超时的留在临时线程上继续执行，不再等待
+	TimeTicks flush_begin = TimeTicks::Now();
+	{
+		base::AutoLock lock(registry->lock);
+		for (auto &item : registry->flushes)
+		{
+			int id = item.first;
+			ShutdownRegistry::Flush &entry = item.second;
+			if (!entry.flush)
+				continue;
+			entry.running = true;
+			entry.elapsed = TimeDelta();
+			StdClosure flush = entry.flush;
+			std::thread([registry, id, flush, flush_begin]() {
+				flush();
+				base::AutoLock lock(registry->lock);
+				auto it = registry->flushes.find(id);
+				if (it != registry->flushes.end())
+				{
+					it->second.running = false;
+					it->second.elapsed = TimeTicks::Now() - flush_begin;
+				}
+				registry->changed.Broadcast();
+			}).detach();
+		}
+		for (;;)
+		{
+			// 等待还在执行且没有到期的 flush 中最早到期的一个
+			TimeTicks now = TimeTicks::Now();
+			TimeTicks wake_up;
+			for (auto &item : registry->flushes)
+			{
+				const ShutdownRegistry::Flush &entry = item.second;
+				TimeTicks deadline = flush_begin + std::min(entry.budget, options.flush_deadline);
+				if (entry.running && deadline > now && (wake_up.is_null() || deadline < wake_up))
+					wake_up = deadline;
+			}
+			if (wake_up.is_null())
+				break;
+			registry->changed.TimedWait(wake_up - now);
+		}
+		TimeTicks now = TimeTicks::Now();
+		for (auto &item : registry->flushes)
+		{
+			const ShutdownRegistry::Flush &entry = item.second;
+			if (!entry.flush)
+				continue;
+			ShutdownStepReport step;
+			step.name = entry.name;
+			step.budget = entry.budget;
+			step.finished = !entry.running;
+			step.elapsed = step.finished ? entry.elapsed : now - flush_begin;
+			step.over_budget = !step.finished || step.elapsed > step.budget;
+			if (step.over_budget)
+			{
+				report.within_budget = false;
+				LOG(WARNING) << "[shutdown] flush " << step.name << (step.finished ? " finished" : " unfinished")
+					<< " after " << step.elapsed.InMilliseconds() << "ms, budget " << step.budget.InMilliseconds() << "ms";
+			}
+			report.flushes.push_back(step);
+		}
+	}
+	report.flush_time = TimeTicks::Now() - flush_begin;
+
+	// 2. 队列中的任务不再执行
+	if (options.discard_pending_tasks)
+		g_discard_pending_tasks.store(true);
+
+	// 3. 同时通知所有线程退出，再一起等待。线程在 CleanUp 结束前要拿到锁才能注销，
+	// 持锁期间线程对象一定还在
+	TimeTicks join_begin = TimeTicks::Now();
+	{
+		base::AutoLock lock(registry->lock);
+		base::PlatformThreadId current_thread = base::PlatformThread::CurrentId();
+		FrameworkThread *current = nullptr;
+		for (FrameworkThread *thread : registry->threads)
+		{
+			if (thread->GetThreadId() == current_thread)
+				current = thread;
+			else
+				thread->StopSoon();
+		}
+		TimeTicks deadline = join_begin + options.join_deadline;
+		for (;;)
+		{
+			size_t running = registry->threads.size() - (current != nullptr ? 1 : 0);
+			TimeTicks now = TimeTicks::Now();
+			if (running == 0 || now >= deadline)
+				break;
+			registry->changed.TimedWait(deadline - now);
+		}
+		for (FrameworkThread *thread : registry->threads)
+		{
+			if (thread == current)
+				continue;
+			report.within_budget = false;
+			report.unfinished_threads.push_back(thread->thread_name());
+			LOG(WARNING) << "[shutdown] thread " << thread->thread_name() << " did not stop in "
+				<< options.join_deadline.InMilliseconds() << "ms";
+		}
+	}
+	report.join_time = TimeTicks::Now() - join_begin;
+
+	g_discard_pending_tasks.store(false);
+	g_shutting_down.store(false);
+	return report;
+}
+
+bool ThreadManager::IsShuttingDown()
+{
+	return g_shutting_down.load();
+}
+
+void ThreadManager::OnFrameworkThreadStarted(FrameworkThread *thread)
+{
+	ShutdownRegistry *registry = ShutdownRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	registry->threads.insert(thread);
+}
+
+void ThreadManager::OnFrameworkThreadStopped(FrameworkThread *thread)
+{
+	ShutdownRegistry *registry = ShutdownRegistry::GetInstance();
+	base::AutoLock lock(registry->lock);
+	registry->threads.erase(thread);
+	registry->changed.Broadcast();
 }
 void ThreadManager::SetGlobalTimerThread(std::weak_ptr<FrameworkThread> thread)
 {
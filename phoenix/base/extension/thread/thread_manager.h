@@ -5,8 +5,11 @@
 
 #include "extension/config/build_config.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 #include "base/synchronization/lock.h"
 #include "base/memory/ref_counted.h"
 #include "base/single_thread_task_runner.h"
@@ -14,29 +17,99 @@
 
 #include "extension/extension_export.h"
 #include "extension/callback/bind_extension.h"
+#include "extension/containers/flat_hash_map.h"
 #include "extension/thread/framework_thread.h"
 #include "extension/time/time.h"
 #include "extension/memory/singleton.h"
 
 EXTENSION_BEGIN_DECLS
 
+// 托管线程表
+// 注册、注销很少发生，Post 族却在每个线程上频繁调用，所以 task_runner 不加锁：
+// identifier 小于 kMaxIndexedIdentifier（覆盖 thread_id.h 中的全部区间）的线程的 task runner
+// 发布在按 identifier 索引的两级数组里，页在首次注册时分配且从不释放；
+// 每个槽位带读者计数，注销时先摘掉指针，等槽位上正在读的线程取到引用后再释放。
+// 更大的 identifier 退回到 threads_ 上加锁查找。
 class ThreadMap
 {
 	friend class ThreadManager;
 public:
-	ThreadMap() = default;
+	ThreadMap();
+	~ThreadMap();
 	bool AquireAccess();
 	bool RegisterThread(int64_t self_identifier);
 	bool UnregisterThread();
+	bool RegisterTaskRunner(int64_t identifier, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner);
+	bool UnregisterTaskRunner(int64_t identifier);
 	int64_t GetManagedThreadId(const FrameworkThread *thread);
+	base::PlatformThreadId GetPlatformThreadId(int64_t identifier) const;
 	scoped_refptr<base::SingleThreadTaskRunner> task_runner(int64_t identifier) const;
 
 private:
+	static const int64_t kPageSize = 256;
+	static const int64_t kPageCount = 256;
+	static const int64_t kMaxIndexedIdentifier = kPageSize * kPageCount;
+
+	struct Slot
+	{
+		Slot() : task_runner(nullptr), readers(0) {}
+		std::atomic<base::SingleThreadTaskRunner*> task_runner;	// 持有一个引用
+		std::atomic<int> readers;
+	};
+	struct Page
+	{
+		Slot slots[kPageSize];
+	};
+
 	FrameworkThread* InternalQueryThread(int64_t identifier) const;
-	base::Lock lock_;
-	std::map<int, FrameworkThread*> threads_;
+	// 需持有 lock_
+	void PublishTaskRunner(int64_t identifier, const scoped_refptr<base::SingleThreadTaskRunner> &task_runner);
+	void RetractTaskRunner(int64_t identifier);
+
+	mutable base::Lock lock_;
+	FlatHashMap<int64_t, FrameworkThread*> threads_;
+	// 注册时在线程自己身上取得，AttachCurrentThreadWithLoop 接管的线程没有 base::Thread 的 id
+	FlatHashMap<int64_t, base::PlatformThreadId> platform_thread_ids_;
+	// 虚拟线程没有 FrameworkThread，直接登记 task runner，和 threads_ 共用 identifier 空间
+	FlatHashMap<int64_t, scoped_refptr<base::SingleThreadTaskRunner>> virtual_threads_;
+	std::atomic<Page*> pages_[kPageCount];
+};
+
+
+// ThreadManager::Shutdown 的参数
+struct ShutdownOptions
+{
+	ShutdownOptions()
+		: flush_deadline(TimeDelta::FromSeconds(2))
+		, join_deadline(TimeDelta::FromSeconds(2))
+		, discard_pending_tasks(true) {}
+
+	TimeDelta flush_deadline;	// 所有 flush 步骤共用的上限，单个步骤还受自己的 budget 限制
+	TimeDelta join_deadline;	// 等待线程退出的上限
+	bool discard_pending_tasks;	// 丢弃经 ThreadManager 投递、还在队列中的任务
+};
+
+// 一个 flush 步骤的耗时
+struct ShutdownStepReport
+{
+	std::string name;
+	TimeDelta budget;
+	TimeDelta elapsed;		// 没有完成时为等待的时间
+	bool finished;
+	bool over_budget;
 };
 
+// ThreadManager::Shutdown 的结果
+struct ShutdownReport
+{
+	ShutdownReport() : within_budget(true) {}
+
+	std::vector<ShutdownStepReport> flushes;
+	std::vector<std::string> unfinished_threads;	// join_deadline 内没有退出的线程
+	TimeDelta flush_time;
+	TimeDelta join_time;
+	bool within_budget;
+};
 
 // 使用ThreadManager可以极大地方便线程间通信
 // 注意：只有受ThreadManager托管的线程（通过Register托管）才允许调用除Register和Post族外的成员函数
@@ -55,6 +128,8 @@ public:
 
 	ThreadManager();
 	static FrameworkThread* CreateFrameworkThread(int64_t identifier, const std::string& name);
+	// options 在 Start() 时生效，用于给网络 IO 线程提高调度等级、给数据库和日志等后台线程降级
+	static FrameworkThread* CreateFrameworkThread(int64_t identifier, const std::string& name, const FrameworkThreadOptions& options);
 	//全局初始化的时候 需要保存这个引用，并在cleanup的时候unref
 	static std::shared_ptr<FrameworkThread> GlobalTimerThreadRef();
 	static scoped_refptr<base::SingleThreadTaskRunner> GlobalTimerTaskRunner();
@@ -65,26 +140,52 @@ public:
 	// 取消当前线程托管
 	// 线程运行结束之前必须调用UnregisterThread取消托管
 	static bool UnregisterThread();
+	// 以 identifier 注册一个虚拟线程（见 virtual_thread.h），之后 Post 族按 identifier 投递的代码不用修改，
+	// 可在任意线程调用；identifier 已被线程或虚拟线程占用时返回 false。
+	// 虚拟线程不参与 Shutdown 的 join，注销后已投递的任务仍会执行
+	static bool RegisterVirtualThread(int64_t identifier, const std::string& name);
+	static bool UnregisterVirtualThread(int64_t identifier);
 
 
 	// 查找
 	static FrameworkThread* CurrentThread();
 	//template<typename T> static T* CurrentThreadT();
 	static int64_t QueryThreadId(const FrameworkThread *thread);
-
-	static bool PostTask(const StdClosure &task);
-	static bool PostTask(int64_t identifier, const StdClosure &task);
-
-	static bool PostDelayedTask(const StdClosure &task, TimeDelta delay);
-	static bool PostDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay);
-
-	static bool PostNonNestableTask(const StdClosure &task);
-	static bool PostNonNestableTask(int64_t identifier, const StdClosure &task);
-
-	static bool PostNonNestableDelayedTask(const StdClosure &task, TimeDelta delay);
-	static bool PostNonNestableDelayedTask(int64_t identifier, const StdClosure &task, TimeDelta delay);
-	static bool PostTimerTask(const StdClosure &task, const StdClosure &cb, TimeDelta delay);
-	static bool PostTaskAndReply(int64_t identifier, const StdClosure &task, const StdClosure &reply);
+	// 托管线程的系统线程 id，用于采样等需要系统 id 的场合；没有以 identifier 注册的线程时返回 base::kInvalidThreadId
+	static base::PlatformThreadId QueryPlatformThreadId(int64_t identifier);
+
+	// Post 族接受 OnceClosure：传 StdClosure 时拷贝一次，传 lambda 时直接移动，可以捕获只能移动的对象
+	static bool PostTask(OnceClosure task);
+	static bool PostTask(int64_t identifier, OnceClosure task);
+	// 投递到 priority 对应的通道，见 TaskPriority
+	static bool PostTask(OnceClosure task, TaskPriority priority);
+	static bool PostTask(int64_t identifier, OnceClosure task, TaskPriority priority);
+	// 目标线程没有待执行的任务时才执行 task；timeout 内一直不空闲时仍会执行，deadline 为执行时的当前时间，
+	// timeout 为 0 表示一直等到空闲。Shutdown 丢弃任务时空闲任务也一并丢弃
+	static bool PostIdleTask(IdleTask task, TimeDelta timeout = TimeDelta());
+	static bool PostIdleTask(int64_t identifier, IdleTask task, TimeDelta timeout = TimeDelta());
+
+	static bool PostDelayedTask(OnceClosure task, TimeDelta delay);
+	static bool PostDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay);
+
+	static bool PostNonNestableTask(OnceClosure task);
+	static bool PostNonNestableTask(int64_t identifier, OnceClosure task);
+
+	static bool PostNonNestableDelayedTask(OnceClosure task, TimeDelta delay);
+	static bool PostNonNestableDelayedTask(int64_t identifier, OnceClosure task, TimeDelta delay);
+	static bool PostTimerTask(OnceClosure task, OnceClosure cb, TimeDelta delay);
+	static bool PostTaskAndReply(int64_t identifier, OnceClosure task, OnceClosure reply);
+	// 一次投递一批任务：整批只入队一次、唤醒目标线程一次，在目标线程上按顺序连续执行
+	static bool PostTasks(std::vector<OnceClosure> tasks);
+	static bool PostTasks(int64_t identifier, std::vector<OnceClosure> tasks);
+	// 合并投递：同一线程上同一 key 的任务在开始执行前重复投递只会执行一次，执行的是最后一次投递的 task，
+	// 执行开始后再投递会重新排队。用于界面刷新、进度通知这类只关心最新状态、投递又很频繁的任务
+	static bool PostCoalescedTask(const std::string &key, OnceClosure task);
+	static bool PostCoalescedTask(int64_t identifier, const std::string &key, OnceClosure task);
+	// 投递到 WorkStealingPool，供耗 CPU 的任务使用，可在任意线程调用；批量处理一组数据见 parallel_algorithm.h 的 ParallelFor 等
+	static bool PostParallelTask(OnceClosure task);
+	// task 在 WorkStealingPool 上执行完后，reply 回到调用线程执行，调用线程须有消息循环
+	static bool PostParallelTaskAndReply(OnceClosure task, OnceClosure reply);
 // 	template<typename T1, typename T2>
 // 	static bool Await(int64_t identifier, const std::function<T1> &task, const std::function<T2> &reply)
 // 	{
@@ -95,8 +196,30 @@ public:
 // 		message_loop->PostTaskAndReply(task, reply);
 // 		return true;
 // 	}
+	// 以默认的 ShutdownOptions 调用 Shutdown
 	static void Cleanup();
+
+	// 注册退出时需要完成的 flush（数据库、日志这类不能丢的数据），返回注销用的 id。
+	// flush 在 Shutdown 中和其他 flush 一起在各自的临时线程上执行，超过 budget 只报告不等待
+	static int RegisterShutdownFlush(const std::string &name, TimeDelta budget, StdClosure flush);
+	// flush 正在执行时等待其返回，不要在 flush 中注销
+	static void UnregisterShutdownFlush(int id);
+	// 并行退出，用于应用退出和切换账号：
+	// 1. 同时执行所有注册的 flush，等到各自的 budget 或 flush_deadline 为止；
+	// 2. 丢弃经 ThreadManager 投递且还没开始执行的任务（discard_pending_tasks），
+	//    直接用 task runner 投递的任务不受影响；
+	// 3. 同时通知所有正在运行的 FrameworkThread 退出，等待它们的 CleanUp 执行完，最多 join_deadline。
+	// 超时的 flush 和线程写 LOG(WARNING) 并记在返回值中。线程对象仍由创建者持有，创建者之后的 Stop 立即返回。
+	// 不能在 FrameworkThread 的 CleanUp 回调中调用；调用线程本身不会被退出。
+	// 返回后丢弃任务的开关关闭，可以重新创建线程
+	static ShutdownReport Shutdown(const ShutdownOptions &options = ShutdownOptions());
+	// Shutdown 正在进行
+	static bool IsShuttingDown();
 private:
+	friend class FrameworkThread;
+	// FrameworkThread 在 Init 开始和 CleanUp 结束时调用，Shutdown 据此得知正在运行的线程
+	static void OnFrameworkThreadStarted(FrameworkThread *thread);
+	static void OnFrameworkThreadStopped(FrameworkThread *thread);
 // 	static void RunRepeatedly(const WeakCallback<StdClosure>& task, const TimeDelta& delay, int times);
 // 	static void RunRepeatedly2(int thread_id, const WeakCallback<StdClosure>& task, const TimeDelta& delay, int times);
 	void SetGlobalTimerThread(std::weak_ptr<FrameworkThread> thread);
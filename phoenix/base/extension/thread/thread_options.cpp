@@ -0,0 +1,206 @@
+#include "extension/thread/thread_options.h"
+#include "base/threading/platform_thread.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include <vector>
+#elif defined(OS_MACOSX) || defined(OS_IOS)
+#include <pthread.h>
+#include <pthread/qos.h>
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 大小核掩码，进程内只探测一次
+struct ClusterMasks
+{
+	uint64_t little;
+	uint64_t big;
+};
+
+#if defined(OS_WIN)
+ClusterMasks ProbeClusterMasks()
+{
+	ClusterMasks masks = { 0, 0 };
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || length == 0)
+		return masks;
+	std::vector<char> buffer(length);
+	auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&buffer[0]);
+	if (!GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+		return masks;
+
+	// EfficiencyClass 越大性能越高，混合架构以外都为 0
+	BYTE min_class = 0xFF, max_class = 0;
+	for (DWORD offset = 0; offset < length;)
+	{
+		auto core = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&buffer[offset]);
+		BYTE efficiency = core->Processor.EfficiencyClass;
+		min_class = efficiency < min_class ? efficiency : min_class;
+		max_class = efficiency > max_class ? efficiency : max_class;
+		offset += core->Size;
+	}
+	if (min_class == max_class)
+		return masks;
+	for (DWORD offset = 0; offset < length;)
+	{
+		auto core = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&buffer[offset]);
+		const GROUP_AFFINITY &group = core->Processor.GroupMask[0];
+		if (group.Group == 0)
+		{
+			if (core->Processor.EfficiencyClass == min_class)
+				masks.little |= group.Mask;
+			else if (core->Processor.EfficiencyClass == max_class)
+				masks.big |= group.Mask;
+		}
+		offset += core->Size;
+	}
+	return masks;
+}
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+ClusterMasks ProbeClusterMasks()
+{
+	ClusterMasks masks = { 0, 0 };
+	long count = sysconf(_SC_NPROCESSORS_CONF);
+	if (count <= 0)
+		return masks;
+	if (count > 64)
+		count = 64;
+
+	// 以各核的最高频率区分大小核
+	std::vector<long> max_freqs((size_t)count, 0);
+	long lowest = LONG_MAX, highest = 0;
+	for (long cpu = 0; cpu < count; cpu++)
+	{
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cpufreq/cpuinfo_max_freq", cpu);
+		FILE *file = fopen(path, "r");
+		if (file == nullptr)
+			continue;
+		long freq = 0;
+		if (fscanf(file, "%ld", &freq) == 1 && freq > 0)
+		{
+			max_freqs[cpu] = freq;
+			lowest = freq < lowest ? freq : lowest;
+			highest = freq > highest ? freq : highest;
+		}
+		fclose(file);
+	}
+	if (highest == 0 || lowest == highest)
+		return masks;
+	for (long cpu = 0; cpu < count; cpu++)
+	{
+		if (max_freqs[cpu] == lowest)
+			masks.little |= 1ull << cpu;
+		else if (max_freqs[cpu] == highest)
+			masks.big |= 1ull << cpu;
+	}
+	return masks;
+}
+#else
+ClusterMasks ProbeClusterMasks()
+{
+	ClusterMasks masks = { 0, 0 };
+	return masks;
+}
+#endif
+}
+
+bool SetCurrentThreadQoS(ThreadQoS qos)
+{
+#if defined(OS_MACOSX) || defined(OS_IOS)
+	qos_class_t qos_class = QOS_CLASS_DEFAULT;
+	switch (qos)
+	{
+	case ThreadQoS::kBackground:		qos_class = QOS_CLASS_BACKGROUND; break;
+	case ThreadQoS::kUtility:			qos_class = QOS_CLASS_UTILITY; break;
+	case ThreadQoS::kDefault:			qos_class = QOS_CLASS_DEFAULT; break;
+	case ThreadQoS::kUserInteractive:	qos_class = QOS_CLASS_USER_INTERACTIVE; break;
+	case ThreadQoS::kRealtime:
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::REALTIME_AUDIO);
+		return true;
+	}
+	return pthread_set_qos_class_self_np(qos_class, 0) == 0;
+#else
+	switch (qos)
+	{
+	case ThreadQoS::kBackground:
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::BACKGROUND);
+		return true;
+	case ThreadQoS::kUtility:
+		// base 没有介于 BACKGROUND 与 NORMAL 之间的等级
+#if defined(OS_WIN)
+		return !!::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+		return setpriority(PRIO_PROCESS, base::PlatformThread::CurrentId(), 5) == 0;
+#else
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::BACKGROUND);
+		return true;
+#endif
+	case ThreadQoS::kDefault:
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::NORMAL);
+		return true;
+	case ThreadQoS::kUserInteractive:
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::DISPLAY);
+		return true;
+	case ThreadQoS::kRealtime:
+		base::PlatformThread::SetCurrentThreadPriority(base::ThreadPriority::REALTIME_AUDIO);
+		return true;
+	}
+	return false;
+#endif
+}
+
+bool SetCurrentThreadAffinity(uint64_t mask)
+{
+	if (mask == 0)
+		return false;
+#if defined(OS_WIN)
+	return ::SetThreadAffinityMask(::GetCurrentThread(), (DWORD_PTR)mask) != 0;
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu = 0; cpu < 64; cpu++)
+	{
+		if (mask & (1ull << cpu))
+			CPU_SET(cpu, &set);
+	}
+	// pid 为 0 时作用于调用线程
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	// macOS/iOS 只有亲和性标签，没有真正的绑核
+	return false;
+#endif
+}
+
+uint64_t CoreClusterMask(CoreCluster cluster)
+{
+	static const ClusterMasks masks = ProbeClusterMasks();
+	switch (cluster)
+	{
+	case CoreCluster::kLittle:	return masks.little;
+	case CoreCluster::kBig:		return masks.big;
+	default:					return 0;
+	}
+}
+
+void ApplyCurrentThreadOptions(const FrameworkThreadOptions &options)
+{
+	if (options.qos != ThreadQoS::kDefault)
+		SetCurrentThreadQoS(options.qos);
+	uint64_t mask = options.affinity_mask != 0 ? options.affinity_mask : CoreClusterMask(options.cluster);
+	if (mask != 0)
+		SetCurrentThreadAffinity(mask);
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,75 @@
+// scheduling options of the framework threads: QoS class and core affinity
+
+#ifndef __BASE_EXTENSION_THREAD_OPTIONS_H__
+#define __BASE_EXTENSION_THREAD_OPTIONS_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <functional>
+#include "base/threading/thread.h"
+
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 线程的调度等级，由低到高
+// Windows 映射为线程优先级，Linux/Android 映射为 nice 值，macOS/iOS 映射为 QoS class；
+// 提高等级可能需要权限，失败时保持原等级
+enum class ThreadQoS
+{
+	kBackground,		// 日志、统计上报等用户感知不到的后台任务
+	kUtility,			// 数据库、同步等耗时但不紧急的任务
+	kDefault,
+	kUserInteractive,	// 网络 IO、界面相关等对延迟敏感的任务
+	kRealtime,			// 音视频等不能卡顿的任务，慎用
+};
+
+// 大小核（big.LITTLE / 性能核与能效核）的提示，只在 affinity_mask 为 0 时生效；
+// 设备上各核性能相同或无法识别时不做绑定
+enum class CoreCluster
+{
+	kAny,
+	kLittle,	// 能效核
+	kBig,		// 性能核
+};
+
+// ThreadManager::PostTask 的优先级通道，同一通道内按投递顺序执行
+// 有消息循环的 FrameworkThread 上生效，虚拟线程和其他 task runner 上都按 kNormal 执行
+enum class TaskPriority
+{
+	kHigh,		// 排在线程上已有的任务之前，用于界面等待的结果
+	kNormal,	// 与不带优先级的 PostTask 相同
+	kLow,		// 线程上没有其他任务时才执行，最多等待 1 秒，不会饿死；应用在后台时由 PowerScheduler 推迟到回到前台
+};
+
+// ThreadManager::PostIdleTask 的任务，deadline 为应当返回的时刻（最多 50ms，不超过下一个定时任务）；
+// 耗时的整理工作（缓存裁剪、数据库分步 vacuum）每次做一段，没做完就重新投递
+using IdleTask = std::function<void(TimeTicks deadline)>;
+
+// 在 base::Thread::Options（消息循环类型、message pump、栈大小）之上增加调度相关的选项，
+// 由 FrameworkThread::StartWithOptions 在线程启动后、消息循环运行前应用到新线程上
+struct EXTENSION_EXPORT FrameworkThreadOptions : public base::Thread::Options
+{
+	FrameworkThreadOptions() : qos(ThreadQoS::kDefault), affinity_mask(0), cluster(CoreCluster::kAny), instrument_tasks(false) {}
+
+	ThreadQoS qos;
+	uint64_t affinity_mask;	// 逻辑核的位掩码，0 表示不绑定；Windows 下只支持第一个处理器组，macOS/iOS 不支持绑定
+	CoreCluster cluster;
+	bool instrument_tasks;			// 用 TaskInstrumentation 统计该线程上的任务
+	TimeDelta long_task_threshold;	// 执行时间超过它的任务报告为长任务，0 表示不报告
+};
+
+// 设置当前线程的调度等级
+EXTENSION_EXPORT bool SetCurrentThreadQoS(ThreadQoS qos);
+// 把当前线程绑定到 mask 中的逻辑核上
+EXTENSION_EXPORT bool SetCurrentThreadAffinity(uint64_t mask);
+// 指定大小核对应的逻辑核掩码，无法区分大小核时返回 0
+EXTENSION_EXPORT uint64_t CoreClusterMask(CoreCluster cluster);
+// 在当前线程上应用 options 中的调度选项
+EXTENSION_EXPORT void ApplyCurrentThreadOptions(const FrameworkThreadOptions &options);
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_THREAD_OPTIONS_H__
@@ -0,0 +1,130 @@
+#include "extension/thread/virtual_thread.h"
+#include <algorithm>
+#include "base/bind.h"
+#include "base/lazy_instance.h"
+#include "base/sys_info.h"
+#include "base/thread_task_runner_handle.h"
+#include "base/threading/sequenced_worker_pool.h"
+#include "base/threading/thread_local.h"
+#include "base/trace_event/trace_event.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+const size_t kMinPoolThreads = 4;
+
+class VirtualTaskRunner;
+// 当前工作线程正在执行的虚拟线程
+base::LazyInstance<base::ThreadLocalPointer<VirtualTaskRunner>>::Leaky lazy_current_runner = LAZY_INSTANCE_INITIALIZER;
+
+class VirtualTaskRunner : public base::SingleThreadTaskRunner
+{
+public:
+	VirtualTaskRunner(const scoped_refptr<base::SequencedWorkerPool> &pool, const std::string &name)
+		: pool_(pool)
+		, token_(pool->GetSequenceToken())
+		, name_(name) {}
+
+	virtual bool PostDelayedTask(const tracked_objects::Location &from_here, const base::Closure &task, base::TimeDelta delay) override
+	{
+		base::Closure closure = base::Bind(&VirtualTaskRunner::RunTask, make_scoped_refptr(this), task);
+		// 池不 Shutdown，统一按 SKIP_ON_SHUTDOWN 投递，不会拖住进程退出
+		if (delay <= base::TimeDelta())
+			return pool_->PostSequencedWorkerTaskWithShutdownBehavior(token_, from_here, closure, base::SequencedWorkerPool::SKIP_ON_SHUTDOWN);
+		return pool_->PostDelayedSequencedWorkerTask(token_, from_here, closure, delay);
+	}
+
+	// 工作线程上不会嵌套执行任务
+	virtual bool PostNonNestableDelayedTask(const tracked_objects::Location &from_here, const base::Closure &task, base::TimeDelta delay) override
+	{
+		return PostDelayedTask(from_here, task, delay);
+	}
+
+	// 只读线程局部变量，不像 IsRunningSequenceOnCurrentThread 那样加池的锁
+	virtual bool RunsTasksOnCurrentThread() const override
+	{
+		return lazy_current_runner.Pointer()->Get() == this;
+	}
+
+private:
+	virtual ~VirtualTaskRunner() {}
+
+	void RunTask(const base::Closure &task)
+	{
+		TRACE_EVENT1("nim.thread", "VirtualThread::RunTask", "name", name_);
+		base::ThreadLocalPointer<VirtualTaskRunner> *current = lazy_current_runner.Pointer();
+		current->Set(this);
+		{
+			base::ThreadTaskRunnerHandle handle(this);
+			task.Run();
+		}
+		current->Set(nullptr);
+	}
+
+	scoped_refptr<base::SequencedWorkerPool> pool_;
+	base::SequencedWorkerPool::SequenceToken token_;
+	std::string name_;
+};
+
+// SequencedWorkerPool 构造时要取当前线程的 ThreadTaskRunnerHandle，只在 OnDestruct 里用来删除自己；
+// 池刻意泄漏用不到它，在没有消息循环的线程上构造时临时设置这个不接受任务的占位
+class PlaceholderTaskRunner : public base::SingleThreadTaskRunner
+{
+public:
+	virtual bool PostDelayedTask(const tracked_objects::Location &, const base::Closure &, base::TimeDelta) override
+	{
+		return false;
+	}
+	virtual bool PostNonNestableDelayedTask(const tracked_objects::Location &, const base::Closure &, base::TimeDelta) override
+	{
+		return false;
+	}
+	virtual bool RunsTasksOnCurrentThread() const override
+	{
+		return true;
+	}
+
+private:
+	virtual ~PlaceholderTaskRunner() {}
+};
+}
+
+std::atomic<size_t> VirtualThreadPool::max_threads_(0);
+
+VirtualThreadPool* VirtualThreadPool::GetInstance()
+{
+	static VirtualThreadPool *instance = new VirtualThreadPool;
+	return instance;
+}
+
+void VirtualThreadPool::SetMaxThreads(size_t max_threads)
+{
+	max_threads_.store(max_threads, std::memory_order_relaxed);
+}
+
+VirtualThreadPool::VirtualThreadPool()
+{
+	size_t max_threads = max_threads_.load(std::memory_order_relaxed);
+	if (max_threads == 0)
+		max_threads = std::max((size_t)base::SysInfo::NumberOfProcessors(), kMinPoolThreads);
+	if (base::ThreadTaskRunnerHandle::IsSet())
+	{
+		pool_ = new base::SequencedWorkerPool(max_threads, "virtual_thread");
+		return;
+	}
+	base::ThreadTaskRunnerHandle placeholder(new PlaceholderTaskRunner);
+	pool_ = new base::SequencedWorkerPool(max_threads, "virtual_thread");
+}
+
+scoped_refptr<base::SingleThreadTaskRunner> VirtualThreadPool::CreateTaskRunner(const std::string &name)
+{
+	return new VirtualTaskRunner(pool_, name);
+}
+
+bool VirtualThreadPool::RunsTasksOnCurrentThread()
+{
+	return lazy_current_runner.Pointer()->Get() != nullptr;
+}
+
+EXTENSION_END_DECLS
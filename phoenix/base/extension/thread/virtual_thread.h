@@ -0,0 +1,49 @@
+// sequenced virtual threads multiplexed over a shared worker pool
+
+#ifndef __BASE_EXTENSION_VIRTUAL_THREAD_H__
+#define __BASE_EXTENSION_VIRTUAL_THREAD_H__
+
+#include "extension/config/build_config.h"
+
+#include <atomic>
+#include <string>
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+
+#include "extension/extension_export.h"
+
+namespace base {
+class SequencedWorkerPool;
+}
+
+EXTENSION_BEGIN_DECLS
+
+// 虚拟线程：一个串行的任务队列，任务按投递顺序逐个执行、彼此不并发，但不独占系统线程，
+// 所有虚拟线程共用一个 SequencedWorkerPool，空闲时不占线程、栈和消息循环。
+// 任务执行期间设置了 ThreadTaskRunnerHandle，不带 identifier 的 Post 族、PostCoalescedTask 投递回本虚拟线程；
+// 相邻的两个任务可能在不同的工作线程上执行，不能依赖线程局部存储、MessageLoop::current() 或 libuv 这类绑定线程的设施，
+// 也不要长时间阻塞，会占住池中的一个工作线程。
+// 通过 ThreadManager::RegisterVirtualThread 使用；该单例刻意不析构，池不 Shutdown，Shutdown 后仍可重新注册。
+class EXTENSION_EXPORT VirtualThreadPool
+{
+public:
+	static VirtualThreadPool* GetInstance();
+	// 池中工作线程数的上限，线程按需创建；只在第一次 GetInstance 之前调用有效，默认为 max(CPU 核数, 4)
+	static void SetMaxThreads(size_t max_threads);
+
+	// 每次调用都返回一个新的虚拟线程
+	scoped_refptr<base::SingleThreadTaskRunner> CreateTaskRunner(const std::string &name);
+	// 当前线程是否正在执行某个虚拟线程的任务
+	static bool RunsTasksOnCurrentThread();
+
+private:
+	VirtualThreadPool();
+
+private:
+	static std::atomic<size_t> max_threads_;
+	scoped_refptr<base::SequencedWorkerPool> pool_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_VIRTUAL_THREAD_H__
@@ -0,0 +1,136 @@
+#include "extension/thread/work_stealing_pool.h"
+#include "base/lazy_instance.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/thread_local.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 当前线程在池中的序号加 1，不是工作线程时为 0
+base::LazyInstance<base::ThreadLocalPointer<void>>::Leaky lazy_worker_tls = LAZY_INSTANCE_INITIALIZER;
+}
+
+class WorkStealingPool::Worker : public base::PlatformThread::Delegate
+{
+public:
+	Worker(WorkStealingPool *pool, size_t index) : pool_(pool), index_(index) {}
+
+	virtual void ThreadMain() override
+	{
+		base::PlatformThread::SetName(base::StringPrintf("work_stealing_worker_%d", (int)index_));
+		lazy_worker_tls.Pointer()->Set(reinterpret_cast<void *>(index_ + 1));
+		pool_->Run(index_);
+	}
+
+	base::PlatformThreadHandle handle;
+	base::Lock lock;
+	std::deque<OnceClosure> tasks;
+
+private:
+	WorkStealingPool *pool_;
+	size_t index_;
+};
+
+WorkStealingPool* WorkStealingPool::GetInstance()
+{
+	static WorkStealingPool *instance = new WorkStealingPool;
+	return instance;
+}
+
+WorkStealingPool::WorkStealingPool()
+	: next_worker_(0)
+	, pending_(0)
+	, sleepers_(0)
+	, wakeup_(&sleep_lock_)
+{
+	int count = base::SysInfo::NumberOfProcessors();
+	if (count < 1)
+		count = 1;
+	for (int i = 0; i < count; i++)
+		workers_.emplace_back(new Worker(this, i));
+	//CreateNonJoinable 的线程上禁止访问 Singleton，任务里却常会用到，
+	//所以按可 join 的线程创建，只是从不 join
+	for (auto &worker : workers_)
+	{
+		bool success = base::PlatformThread::Create(0, worker.get(), &worker->handle);
+		DCHECK(success);
+	}
+}
+
+void WorkStealingPool::PostTask(OnceClosure task)
+{
+	if (!task)
+		return;
+
+	size_t self = (size_t)lazy_worker_tls.Pointer()->Get();
+	size_t index = self > 0 ? self - 1 : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+	//先计数再入队，取任务时的减一不会先于加一
+	pending_.fetch_add(1, std::memory_order_seq_cst);
+	{
+		Worker *worker = workers_[index].get();
+		base::AutoLock lock(worker->lock);
+		worker->tasks.push_back(std::move(task));
+	}
+	//空闲线程在 sleep_lock_ 下先登记 sleepers_ 再检查 pending_，这里加锁通知不会丢
+	if (sleepers_.load(std::memory_order_seq_cst) > 0)
+	{
+		base::AutoLock lock(sleep_lock_);
+		wakeup_.Signal();
+	}
+}
+
+bool WorkStealingPool::RunsTasksOnCurrentThread() const
+{
+	return lazy_worker_tls.Pointer()->Get() != nullptr;
+}
+
+void WorkStealingPool::Run(size_t index)
+{
+	for (;;)
+	{
+		OnceClosure task;
+		if (TakeTask(index, task))
+		{
+			task();
+			continue;
+		}
+		base::AutoLock lock(sleep_lock_);
+		sleepers_.fetch_add(1, std::memory_order_seq_cst);
+		while (pending_.load(std::memory_order_seq_cst) == 0)
+			wakeup_.Wait();
+		sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+	}
+}
+
+bool WorkStealingPool::TakeTask(size_t index, OnceClosure &task)
+{
+	{
+		Worker *self = workers_[index].get();
+		base::AutoLock lock(self->lock);
+		if (!self->tasks.empty())
+		{
+			task = std::move(self->tasks.back());
+			self->tasks.pop_back();
+			pending_.fetch_sub(1, std::memory_order_seq_cst);
+			return true;
+		}
+	}
+	for (size_t i = 1; i < workers_.size(); i++)
+	{
+		Worker *victim = workers_[(index + i) % workers_.size()].get();
+		base::AutoLock lock(victim->lock);
+		if (!victim->tasks.empty())
+		{
+			task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+			pending_.fetch_sub(1, std::memory_order_seq_cst);
+			return true;
+		}
+	}
+	return false;
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,55 @@
+// a work-stealing worker pool for CPU-bound tasks
+
+#ifndef __BASE_EXTENSION_WORK_STEALING_POOL_H__
+#define __BASE_EXTENSION_WORK_STEALING_POOL_H__
+
+#include "extension/config/build_config.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+
+#include "extension/extension_export.h"
+#include "extension/callback/once_closure.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 按 CPU 核数启动的工作线程池，用于 JSON 解析、图片哈希、加解密这类耗 CPU 的一次性任务，
+// 不要投递会阻塞在 IO 或锁上的任务，也不保证执行顺序。
+// 每个工作线程有自己的任务队列：工作线程上投递的任务放进自己队列的尾部并优先从尾部取（LIFO，缓存友好），
+// 其他线程投递的任务轮流分给各工作线程；自己的队列空了就从其他工作线程队列的头部偷取。
+// 通过 ThreadManager::PostParallelTask 使用；该单例刻意不析构，工作线程不 join，避免 DLL 卸载时死锁。
+class EXTENSION_EXPORT WorkStealingPool
+{
+public:
+	static WorkStealingPool* GetInstance();
+
+	void PostTask(OnceClosure task);
+	size_t worker_count() const { return workers_.size(); }
+	// 当前线程是否为池中的工作线程
+	bool RunsTasksOnCurrentThread() const;
+
+private:
+	class Worker;
+
+	WorkStealingPool();
+
+	void Run(size_t index);
+	// 先取自己队列的尾部，再从其他队列的头部偷
+	bool TakeTask(size_t index, OnceClosure &task);
+
+private:
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::atomic<size_t> next_worker_;
+	std::atomic<size_t> pending_;	// 所有队列中的任务数
+	std::atomic<size_t> sleepers_;
+	base::Lock sleep_lock_;
+	base::ConditionVariable wakeup_;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_WORK_STEALING_POOL_H__
@@ -0,0 +1,93 @@
+#include "extension/time/coarse_clock.h"
+#include <mutex>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+#if defined(OS_WIN)
+// FILETIME 的起点 1601-01-01 到 1970-01-01 的 100ns 数
+const int64_t kFileTimeToUnixEpoch = 116444736000000000LL;
+#else
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+const clockid_t kRealtimeClock = CLOCK_REALTIME_COARSE;
+const clockid_t kMonotonicClock = CLOCK_MONOTONIC_COARSE;
+#elif defined(OS_MACOSX) && defined(CLOCK_MONOTONIC_RAW_APPROX)
+const clockid_t kRealtimeClock = CLOCK_REALTIME;
+const clockid_t kMonotonicClock = CLOCK_MONOTONIC_RAW_APPROX;
+#else
+const clockid_t kRealtimeClock = CLOCK_REALTIME;
+const clockid_t kMonotonicClock = CLOCK_MONOTONIC;
+#endif
+
+int64_t ClockMs(clockid_t clock)
+{
+	struct timespec ts;
+	if (clock_gettime(clock, &ts) != 0)
+		return 0;
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif
+
+struct LocalTimeCache
+{
+	LocalTimeCache() : seconds(-1) {}
+
+	std::mutex lock;
+	int64_t seconds;
+	TimeStruct exploded;
+};
+
+LocalTimeCache& GetLocalTimeCache()
+{
+	//不析构，退出过程中写日志也能用
+	static LocalTimeCache *cache = new LocalTimeCache;
+	return *cache;
+}
+}
+
+int64_t CoarseClock::NowMs()
+{
+#if defined(OS_WIN)
+	FILETIME file_time;
+	::GetSystemTimeAsFileTime(&file_time);
+	int64_t value = ((int64_t)file_time.dwHighDateTime << 32) | file_time.dwLowDateTime;
+	return (value - kFileTimeToUnixEpoch) / 10000;
+#else
+	return ClockMs(kRealtimeClock);
+#endif
+}
+
+Time CoarseClock::Now()
+{
+	return Time::UnixEpoch() + TimeDelta::FromMilliseconds(NowMs());
+}
+
+int64_t CoarseClock::MonotonicMs()
+{
+#if defined(OS_WIN)
+	return (int64_t)::GetTickCount64();
+#else
+	return ClockMs(kMonotonicClock);
+#endif
+}
+
+void CoarseClock::LocalExplode(int64_t seconds, TimeStruct *exploded)
+{
+	LocalTimeCache &cache = GetLocalTimeCache();
+	std::lock_guard<std::mutex> guard(cache.lock);
+	if (seconds != cache.seconds)
+	{
+		Time::FromTimeT((time_t)seconds).LocalExplode(&cache.exploded);
+		cache.seconds = seconds;
+	}
+	*exploded = cache.exploded;
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,34 @@
+// coarse clocks for the timestamps of hot paths, e.g. log headers and transfer progress
+
+#ifndef __BASE_EXTENSION_COARSE_CLOCK_H__
+#define __BASE_EXTENSION_COARSE_CLOCK_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include "extension/extension_export.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 粗粒度时钟。Time::Now()/TimeTicks::Now() 要取精确时间，LocalExplode 每次都要做一次 localtime 转换，
+// 每条日志、每次进度回调都调用时在性能分析里很显眼。这里：
+//   1. 墙上时间与单调时间直接读系统维护的粗粒度时钟（Linux/Android 的 CLOCK_REALTIME_COARSE/CLOCK_MONOTONIC_COARSE，
+//      Windows 的 GetSystemTimeAsFileTime/GetTickCount64），不需要后台线程刷新，精度为一个时钟中断（1~16ms）
+//   2. 本地时间按秒缓存，进程内共用，同一秒只转换一次
+// 不要求毫秒以下精度的时间戳、超时与间隔判断使用；单调时间与 TimeTicks::Now() 的起点不同，不要混用。线程安全
+class EXTENSION_EXPORT CoarseClock
+{
+public:
+	// 墙上时间，自 1970 年起的毫秒数，同 Time::ToJavaTime()
+	static int64_t NowMs();
+	static Time Now();
+	// 单调时间的毫秒数，不受修改系统时间影响，只用于计算间隔
+	static int64_t MonotonicMs();
+	// |seconds| 为自 1970 年起的秒数，与上一次转换的是同一秒时直接返回缓存
+	static void LocalExplode(int64_t seconds, TimeStruct *exploded);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_COARSE_CLOCK_H__
@@ -1,5 +1,6 @@
 #include "extension/timer/timer.h"
 #include "extension/callback/bind_extension.h"
+#include "extension/thread/power_scheduler.h"
 
 EXTENSION_BEGIN_DECLS
 
@@ -18,6 +19,13 @@ void OneShotTimer::Start(TimeDelta delay, const StdClosure& callback)
 			base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, callback));
 	}	
 }
+RepeatingTimer::RepeatingTimer() : stretch_in_background_(true), power_observer_id_(0)
+{
+}
+RepeatingTimer::~RepeatingTimer()
+{
+	RemovePowerObserver();
+}
 void RepeatingTimer::Start(TimeDelta delay, const StdClosure& callback)
 {
 	scoped_refptr<SingleThreadTaskRunner> task_runner = task_runner_;
@@ -29,9 +37,47 @@ void RepeatingTimer::Start(TimeDelta delay, const StdClosure& callback)
 	{
 		if (task_runner != task_runner_)
 			SetTaskRunner(task_runner);		
-		base::RepeatingTimer::Start(FROM_HERE, delay, 
+		interval_ = delay;
+		// 切换通知投递到定时器的线程，每次 Start 重新注册，跟随可能变化的 task runner
+		RemovePowerObserver();
+		if (stretch_in_background_)
+			power_observer_id_ = PowerScheduler::GetInstance()->AddObserver(
+				ToWeakCallback([this](bool) { OnPowerModeChanged(); }), task_runner);
+		base::RepeatingTimer::Start(FROM_HERE, StretchedDelay(), 
 			base::Bind(base::extension::InvokeCallback<typename std::result_of<StdClosure()>::type>, callback));
 	}
 }
+void RepeatingTimer::SetStretchInBackground(bool stretch)
+{
+	if (stretch_in_background_ == stretch)
+		return;
+	stretch_in_background_ = stretch;
+	if (!stretch)
+	{
+		RemovePowerObserver();
+		OnPowerModeChanged();
+	}
+}
+void RepeatingTimer::OnPowerModeChanged()
+{
+	if (!IsRunning())
+		return;
+	TimeDelta delay = StretchedDelay();
+	if (delay == GetCurrentDelay())
+		return;
+	base::Closure task = user_task();
+	base::RepeatingTimer::Start(FROM_HERE, delay, task);
+}
+void RepeatingTimer::RemovePowerObserver()
+{
+	if (power_observer_id_ == 0)
+		return;
+	PowerScheduler::GetInstance()->RemoveObserver(power_observer_id_);
+	power_observer_id_ = 0;
+}
+TimeDelta RepeatingTimer::StretchedDelay() const
+{
+	return stretch_in_background_ ? PowerScheduler::GetInstance()->StretchTimerDelay(interval_) : interval_;
+}
 
 EXTENSION_END_DECLS
\ No newline at end of file
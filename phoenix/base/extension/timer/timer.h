@@ -24,10 +24,25 @@ public:
 
 //-----------------------------------------------------------------------------
 // A simple, repeating timer.  See usage notes at the top of the file.
-class EXTENSION_EXPORT RepeatingTimer : public base::RepeatingTimer
+// 应用在后台时间隔按 PowerPolicy::timer_stretch_factor 拉长，前后台切换时从切换的时刻重新计时；
+// 心跳这类不能推迟的定时器用 SetStretchInBackground(false) 关闭
+class EXTENSION_EXPORT RepeatingTimer : public base::RepeatingTimer, public SupportWeakCallback
 {
 public:
+	RepeatingTimer();
+	~RepeatingTimer();
 	void Start(TimeDelta delay, const StdClosure& callback);
+	void SetStretchInBackground(bool stretch);
+
+private:
+	// 在定时器的线程上执行
+	void OnPowerModeChanged();
+	void RemovePowerObserver();
+	TimeDelta StretchedDelay() const;
+
+	TimeDelta interval_;	// Start 传入的前台间隔
+	bool stretch_in_background_;
+	int power_observer_id_;
 };
 EXTENSION_END_DECLS
 #endif  // BASE_TIME_TIMER_H_
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "extension/timer/timer_wheel.h"
+#include <vector>
+#include "base/bind.h"
+#include "base/thread_task_runner_handle.h"
+#include "extension/callback/bind_extension.h"
+#include "extension/thread/power_scheduler.h"
+#include "extension/thread/thread_manager.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct TimerWheel::Entry
+{
+	Entry *prev;
+	Entry *next;
+	int slot;
+	uint64_t expires;	// 到期的 tick
+	TimerId id;
+	OnceClosure task;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_runner;
+};
+
+TimerWheel* TimerWheel::GetInstance()
+{
+	static TimerWheel *instance = new TimerWheel;
+	return instance;
+}
+
+TimerWheel::TimerWheel()
+	: lock_("extension.TimerWheel")
+	, origin_(base::TimeTicks::Now())
+	, current_tick_(0)
+	, wakeup_tick_(0)
+	, next_id_(0)
+{
+	for (auto &slot : slots_)
+		slot = nullptr;
+	for (auto &bits : occupied_)
+		bits = 0;
+}
+
+int TimerWheel::SlotBase(int level)
+{
+	return level == 0 ? 0 : (1 << kLevel0Bits) + (level - 1) * (1 << kLevelBits);
+}
+
+int TimerWheel::SlotShift(int level)
+{
+	return level == 0 ? 0 : kLevel0Bits + (level - 1) * kLevelBits;
+}
+
+int TimerWheel::SlotCountOf(int level)
+{
+	return level == 0 ? (1 << kLevel0Bits) : (1 << kLevelBits);
+}
+
+uint64_t TimerWheel::NowTick() const
+{
+	return (uint64_t)(base::TimeTicks::Now() - origin_).InMilliseconds();
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(TimeDelta delay, OnceClosure task, TimeDelta slack)
+{
+	if (!task || !ThreadManager::GlobalTimerTaskRunner())
+		return 0;
+
+	Entry *entry = new Entry;
+	entry->task = std::move(task);
+	if (base::ThreadTaskRunnerHandle::IsSet())
+		entry->reply_runner = base::ThreadTaskRunnerHandle::Get();
+
+	// 后台时放宽推迟时间，让更多的定时器落进同一格
+	slack = PowerScheduler::GetInstance()->GetTimerSlack(delay, slack);
+	int64_t delay_us = delay.InMicroseconds();
+	uint64_t ticks = delay_us > 0 ? (uint64_t)(delay_us + 999) / 1000 : 0;
+	uint64_t slack_ms = slack > TimeDelta() ? (uint64_t)slack.InMilliseconds() : 0;
+
+	std::lock_guard<ProfiledLock<base::Lock>> lock(lock_);
+	uint64_t expires = NowTick() + ticks;
+	if (slack_ms > 1)
+	{
+		uint64_t granularity = 1;
+		while (granularity * 2 <= slack_ms)
+			granularity *= 2;
+		expires = (expires + granularity - 1) & ~(granularity - 1);
+	}
+	if (expires <= current_tick_)
+		expires = current_tick_ + 1;
+	entry->expires = expires;
+	entry->id = ++next_id_;
+	entries_[entry->id] = entry;
+	Insert(entry);
+	ScheduleWakeupLocked();
+	return entry->id;
+}
+
+bool TimerWheel::Cancel(TimerId id)
+{
+	Entry *entry = nullptr;
+	{
+		std::lock_guard<ProfiledLock<base::Lock>> lock(lock_);
+		auto it = entries_.find(id);
+		if (it == entries_.end())
+			return false;
+		entry = it->second;
+		entries_.erase(it);
+		Unlink(entry);
+	}
+	//task 的捕获在锁外析构
+	delete entry;
+	return true;
+}
+
+size_t TimerWheel::size() const
+{
+	std::lock_guard<ProfiledLock<base::Lock>> lock(lock_);
+	return entries_.size();
+}
+
+void TimerWheel::Insert(Entry *entry)
+{
+	// 超出最高层范围的先放在最远处，到时再重新放入
+	uint64_t expires = entry->expires;
+	if (expires > current_tick_ + kMaxDelta)
+		expires = current_tick_ + kMaxDelta;
+	uint64_t delta = expires > current_tick_ ? expires - current_tick_ : 0;
+
+	int slot = 0;
+	if (delta < (1u << kLevel0Bits))
+	{
+		slot = (int)(expires & ((1u << kLevel0Bits) - 1));
+	}
+	else
+	{
+		int level = 1;
+		while (level < kLevels - 1 && delta >= (1ull << (SlotShift(level) + kLevelBits)))
+			level++;
+		slot = SlotBase(level) + (int)((expires >> SlotShift(level)) & ((1u << kLevelBits) - 1));
+	}
+
+	entry->slot = slot;
+	entry->prev = nullptr;
+	entry->next = slots_[slot];
+	if (entry->next != nullptr)
+		entry->next->prev = entry;
+	slots_[slot] = entry;
+	occupied_[slot / 64] |= 1ull << (slot % 64);
+}
+
+void TimerWheel::Unlink(Entry *entry)
+{
+	if (entry->prev != nullptr)
+		entry->prev->next = entry->next;
+	else
+		slots_[entry->slot] = entry->next;
+	if (entry->next != nullptr)
+		entry->next->prev = entry->prev;
+	if (slots_[entry->slot] == nullptr)
+		occupied_[entry->slot / 64] &= ~(1ull << (entry->slot % 64));
+}
+
+uint64_t TimerWheel::NextEventTick() const
+{
+	uint64_t next = 0;
+	for (int level = 0; level < kLevels; level++)
+	{
+		int base = SlotBase(level);
+		int count = SlotCountOf(level);
+		bool empty = true;
+		for (int i = base / 64; i < (base + count) / 64 && empty; i++)
+			empty = occupied_[i] == 0;
+		if (empty)
+			continue;
+
+		// 第 0 层从下一个 tick 开始找，高层从下一个整格边界开始找
+		int shift = SlotShift(level);
+		uint64_t first = level == 0 ? current_tick_ + 1 : (current_tick_ >> shift) + 1;
+		for (int d = 0; d < count; d++)
+		{
+			int slot = base + (int)((first + d) & (count - 1));
+			if (occupied_[slot / 64] & (1ull << (slot % 64)))
+			{
+				uint64_t tick = (first + d) << shift;
+				if (next == 0 || tick < next)
+					next = tick;
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+void TimerWheel::ScheduleWakeupLocked()
+{
+	uint64_t next = NextEventTick();
+	if (next == 0 || (wakeup_tick_ != 0 && wakeup_tick_ <= next))
+		return;
+	auto task_runner = ThreadManager::GlobalTimerTaskRunner();
+	if (!task_runner)
+		return;
+	uint64_t now = NowTick();
+	TimeDelta delay = next > now ? TimeDelta::FromMilliseconds((int64_t)(next - now)) : TimeDelta();
+	if (task_runner->PostDelayedTask(FROM_HERE, base::Bind(&TimerWheel::OnTick, base::Unretained(this)), delay))
+		wakeup_tick_ = next;
+}
+
+void TimerWheel::OnTick()
+{
+	std::vector<Entry *> fired;
+	{
+		std::lock_guard<ProfiledLock<base::Lock>> lock(lock_);
+		uint64_t now = NowTick();
+		for (;;)
+		{
+			uint64_t tick = NextEventTick();
+			if (tick == 0 || tick > now)
+				break;
+			current_tick_ = tick;
+			// 先把到达边界的高层格子下放，再触发第 0 层的格子
+			for (int level = 1; level < kLevels; level++)
+			{
+				int shift = SlotShift(level);
+				if ((tick & ((1ull << shift) - 1)) != 0)
+					break;
+				int slot = SlotBase(level) + (int)((tick >> shift) & ((1u << kLevelBits) - 1));
+				Entry *entry = slots_[slot];
+				slots_[slot] = nullptr;
+				occupied_[slot / 64] &= ~(1ull << (slot % 64));
+				while (entry != nullptr)
+				{
+					Entry *next = entry->next;
+					Insert(entry);
+					entry = next;
+				}
+			}
+			int slot = (int)(tick & ((1u << kLevel0Bits) - 1));
+			Entry *entry = slots_[slot];
+			slots_[slot] = nullptr;
+			occupied_[slot / 64] &= ~(1ull << (slot % 64));
+			while (entry != nullptr)
+			{
+				Entry *next = entry->next;
+				if (entry->expires > tick)
+				{
+					Insert(entry);
+				}
+				else
+				{
+					entries_.erase(entry->id);
+					fired.push_back(entry);
+				}
+				entry = next;
+			}
+		}
+		if (now > current_tick_)
+			current_tick_ = now;
+		wakeup_tick_ = 0;
+		ScheduleWakeupLocked();
+	}
+
+	for (Entry *entry : fired)
+	{
+		if (entry->reply_runner != nullptr && !entry->reply_runner->RunsTasksOnCurrentThread())
+			entry->reply_runner->PostTask(FROM_HERE, ToBaseClosure(std::move(entry->task)));
+		else
+			entry->task();
+		delete entry;
+	}
+}
+
+void WheelTimer::Start(TimeDelta delay, const StdClosure &callback, TimeDelta slack)
+{
+	Stop();
+	id_ = TimerWheel::GetInstance()->Schedule(delay, flag_.ToWeakCallback([this, callback]() {
+		id_ = 0;
+		callback();
+	}), slack);
+}
+
+void WheelTimer::Stop()
+{
+	if (id_ != 0)
+	{
+		TimerWheel::GetInstance()->Cancel(id_);
+		id_ = 0;
+	}
+	//已到期、正投递回本线程的回调也不再执行
+	flag_.Cancel();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,102 @@
+// a hashed hierarchical timer wheel driven by the global timer thread
+
+#ifndef __BASE_EXTENSION_TIMER_WHEEL_H__
+#define __BASE_EXTENSION_TIMER_WHEEL_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+#include "base/time/time.h"
+
+#include "extension/extension_export.h"
+#include "extension/callback/callback.h"
+#include "extension/callback/once_closure.h"
+#include "extension/synchronization/lock_profiler.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 分层时间轮：1ms 一格，4 层分别为 256/64/64/64 格，覆盖约 18.6 小时，更远的到期时间分段等待。
+// 添加、取消都是 O(1)，适合大量的请求超时、消息超时这类多半会被取消的定时器；
+// 需要严格按毫秒触发或需要重复触发的场景仍使用 OneShotTimer / RepeatingTimer。
+// 时间轮运行在 ThreadManager 的全局定时器线程上，使用前需已通过 GlobalTimerThreadRef 启动该线程。
+// 全局定时器线程只在下一个非空格子或需要下放的格子到期时醒来，没有定时器时不会空转。
+class EXTENSION_EXPORT TimerWheel
+{
+public:
+	typedef uint64_t TimerId;	// 0 表示无效
+
+	static TimerWheel* GetInstance();
+
+	// delay 后执行 task：调用线程有消息循环时投递回调用线程执行，否则在全局定时器线程上执行。
+	// slack 为允许推迟的时间，到期时间会向上取整到不超过 slack 的 2 的幂毫秒，
+	// 相近的定时器落进同一格一起触发，减少定时器线程的唤醒次数；应用在后台时按 PowerPolicy::max_timer_slack 放宽。
+	// 全局定时器线程不存在时返回 0
+	TimerId Schedule(TimeDelta delay, OnceClosure task, TimeDelta slack = TimeDelta());
+	// 尚未到期时取消并返回 true；已到期（task 可能正在投递或执行）时返回 false
+	bool Cancel(TimerId id);
+	size_t size() const;
+
+private:
+	struct Entry;
+
+	static const int kLevels = 4;
+	static const int kLevel0Bits = 8;
+	static const int kLevelBits = 6;
+	static const int kSlotCount = (1 << kLevel0Bits) + (kLevels - 1) * (1 << kLevelBits);
+	static const uint64_t kMaxDelta = (1ull << (kLevel0Bits + (kLevels - 1) * kLevelBits)) - 1;
+
+	TimerWheel();
+
+	uint64_t NowTick() const;
+	void Insert(Entry *entry);
+	void Unlink(Entry *entry);
+	// 下一个需要处理的 tick：最近的非空的第 0 层格子，或最近的需要下放的非空高层格子；没有定时器时返回 0
+	uint64_t NextEventTick() const;
+	// 在全局定时器线程上执行：处理到当前时间为止的所有格子
+	void OnTick();
+	// 调用时需持有 lock_
+	void ScheduleWakeupLocked();
+
+	static int SlotBase(int level);
+	static int SlotShift(int level);
+	static int SlotCountOf(int level);
+
+private:
+	mutable ProfiledLock<base::Lock> lock_;
+	base::TimeTicks origin_;
+	uint64_t current_tick_;	// 已处理到的 tick
+	uint64_t wakeup_tick_;	// 已投递的唤醒任务中最早的 tick，0 表示没有
+	TimerId next_id_;
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+	Entry *slots_[kSlotCount];
+	uint64_t occupied_[kSlotCount / 64];
+	std::unordered_map<TimerId, Entry *> entries_;
+};
+
+// 基于 TimerWheel 的一次性定时器，在有消息循环的线程上使用，回调在该线程上执行。
+// Stop 或析构之后回调不会再执行
+class EXTENSION_EXPORT WheelTimer
+{
+public:
+	WheelTimer() : id_(0) {}
+	~WheelTimer() { Stop(); }
+
+	void Start(TimeDelta delay, const StdClosure &callback, TimeDelta slack = TimeDelta());
+	void Stop();
+	bool IsRunning() const { return id_ != 0; }
+
+private:
+	TimerWheel::TimerId id_;
+	WeakCallbackFlag flag_;
+
+	WheelTimer(const WheelTimer &) = delete;
+	WheelTimer& operator=(const WheelTimer &) = delete;
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_TIMER_WHEEL_H__
@@ -0,0 +1,439 @@
+#include "extension/trace/sampling_profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "base/bind.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/thread/task_instrumentation.h"
+#include "extension/thread/thread_manager.h"
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 采样线程在采完最后一个样本后才交回结果，多等一会再放弃
+const int64_t kCompletionGraceSeconds = 5;
+
+typedef base::StackSamplingProfiler::CallStackProfile CallStackProfile;
+
+class SamplingSession
+{
+public:
+	SamplingSession(const SamplingOptions &options, const SamplingCallback &callback)
+		: options_(options), callback_(callback), completed_(0), stop_requested_(false) {}
+
+	// 在内部线程上执行全部采样并调用 callback
+	void Run(const std::vector<std::pair<int64_t, base::PlatformThreadId>> &threads);
+	void RequestStop();
+
+private:
+	// 在 StackSamplingProfiler 的采样线程上调用
+	void OnCompleted(size_t index, const base::StackSamplingProfiler::CallStackProfiles &profiles);
+
+	SamplingOptions options_;
+	SamplingCallback callback_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::vector<CallStackProfile> profiles_;
+	size_t completed_;
+	bool stop_requested_;
+};
+
+struct ProfilerState
+{
+	ProfilerState() : trigger_enabled(false) {}
+
+	base::Lock lock;
+	std::shared_ptr<SamplingSession> session;
+	bool trigger_enabled;
+	SamplingOptions trigger_options;
+	TimeDelta trigger_cooldown;
+	SamplingCallback trigger_callback;
+	TimeTicks last_trigger;
+};
+
+ProfilerState* GetState()
+{
+	static ProfilerState *state = new ProfilerState;
+	return state;
+}
+
+void ClearSession(const SamplingSession *session)
+{
+	ProfilerState *state = GetState();
+	base::AutoLock lock(state->lock);
+	if (state->session.get() == session)
+		state->session.reset();
+}
+
+void SamplingSession::Run(const std::vector<std::pair<int64_t, base::PlatformThreadId>> &threads)
+{
+	base::PlatformThread::SetName("SamplingProfiler");
+	base::StackSamplingProfiler::SamplingParams params;
+	params.bursts = 1;
+	params.burst_interval = options_.duration;
+	params.sampling_interval = options_.interval;
+	params.samples_per_burst = (int)std::max<int64_t>(1, options_.duration / options_.interval);
+
+	SamplingResult result;
+	result.start_time = Time::Now();
+	result.interval = options_.interval;
+	TimeTicks begin = TimeTicks::Now();
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		profiles_.resize(threads.size());
+	}
+	{
+		std::vector<std::unique_ptr<base::StackSamplingProfiler>> profilers;
+		for (size_t i = 0; i < threads.size(); ++i)
+		{
+			profilers.emplace_back(new base::StackSamplingProfiler(threads[i].second, params,
+				base::Bind(&SamplingSession::OnCompleted, base::Unretained(this), i)));
+			profilers.back()->Start();
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		condition_.wait_for(lock,
+			std::chrono::microseconds((options_.duration + TimeDelta::FromSeconds(kCompletionGraceSeconds)).InMicroseconds()),
+			[this, &threads]() { return stop_requested_ || completed_ == threads.size(); });
+		lock.unlock();
+		//析构时停止还在进行的采样并等待采样线程退出，采样线程退出前会把已采到的样本交给 OnCompleted
+	}
+	result.duration = TimeTicks::Now() - begin;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		for (size_t i = 0; i < threads.size(); ++i)
+		{
+			if (!profiles_[i].samples.empty())
+				result.threads.push_back(std::make_pair(threads[i].first, std::move(profiles_[i])));
+		}
+	}
+	//先结束本次采样，callback 中可以开始下一次
+	ClearSession(this);
+	if (callback_)
+		callback_(result);
+}
+
+void SamplingSession::RequestStop()
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	stop_requested_ = true;
+	condition_.notify_all();
+}
+
+void SamplingSession::OnCompleted(size_t index, const base::StackSamplingProfiler::CallStackProfiles &profiles)
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	//只有一个 burst
+	if (!profiles.empty() && index < profiles_.size())
+		profiles_[index] = profiles.front();
+	completed_++;
+	condition_.notify_all();
+}
+
+void OnLongTask(const LongTaskInfo &info)
+{
+	if (info.thread_identifier < 0)
+		return;
+	SamplingOptions options;
+	SamplingCallback callback;
+	{
+		ProfilerState *state = GetState();
+		base::AutoLock lock(state->lock);
+		TimeTicks now = TimeTicks::Now();
+		if (!state->trigger_enabled || state->session)
+			return;
+		if (!state->last_trigger.is_null() && now - state->last_trigger < state->trigger_cooldown)
+			return;
+		state->last_trigger = now;
+		options = state->trigger_options;
+		callback = state->trigger_callback;
+	}
+	SamplingProfiler::Start(std::vector<int64_t>(1, info.thread_identifier), options, callback);
+}
+
+// profile.proto 的最小编码，只用到 varint 和 length-delimited 两种类型
+class ProtoWriter
+{
+public:
+	void Varint(uint32_t field, uint64_t value)
+	{
+		PutVarint((uint64_t)field << 3);
+		PutVarint(value);
+	}
+
+	void Bytes(uint32_t field, const std::string &bytes)
+	{
+		PutVarint(((uint64_t)field << 3) | 2);
+		PutVarint(bytes.size());
+		data_.append(bytes);
+	}
+
+	void Packed(uint32_t field, const std::vector<uint64_t> &values)
+	{
+		ProtoWriter packed;
+		for (uint64_t value : values)
+			packed.PutVarint(value);
+		Bytes(field, packed.data());
+	}
+
+	const std::string& data() const { return data_; }
+
+private:
+	void PutVarint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			data_.push_back((char)((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		data_.push_back((char)value);
+	}
+
+	std::string data_;
+};
+
+class StringTable
+{
+public:
+	StringTable() { Intern(std::string()); }
+
+	uint64_t Intern(const std::string &value)
+	{
+		auto it = index_.find(value);
+		if (it != index_.end())
+			return it->second;
+		uint64_t index = strings_.size();
+		index_[value] = index;
+		strings_.push_back(value);
+		return index;
+	}
+
+	const std::vector<std::string>& strings() const { return strings_; }
+
+private:
+	std::map<std::string, uint64_t> index_;
+	std::vector<std::string> strings_;
+};
+
+std::string ValueType(StringTable *strings, const char *type, const char *unit)
+{
+	ProtoWriter writer;
+	writer.Varint(1, strings->Intern(type));
+	writer.Varint(2, strings->Intern(unit));
+	return writer.data();
+}
+}
+
+size_t SamplingResult::sample_count() const
+{
+	size_t count = 0;
+	for (const auto &thread : threads)
+		count += thread.second.samples.size();
+	return count;
+}
+
+std::string SamplingResult::ToPprof() const
+{
+	struct Mapping
+	{
+		uint64_t start;
+		uint64_t limit;
+		std::string filename;
+		std::string build_id;
+	};
+	StringTable strings;
+	ProtoWriter profile;
+	profile.Bytes(1, ValueType(&strings, "samples", "count"));
+	profile.Bytes(1, ValueType(&strings, "wall", "nanoseconds"));
+	uint64_t thread_label = strings.Intern("thread");
+	int64_t period = interval.InMicroseconds() * 1000;
+
+	// mapping 和 location 的 id 从 1 开始，0 表示没有
+	std::vector<Mapping> mappings;
+	std::map<std::pair<uintptr_t, std::string>, uint64_t> mapping_ids;
+	std::vector<std::pair<uint64_t, uint64_t>> locations;	// (address, mapping id)
+	std::map<uint64_t, uint64_t> location_ids;
+	std::map<std::pair<int64_t, std::vector<uint64_t>>, int64_t> stacks;
+	for (const auto &thread : threads)
+	{
+		const CallStackProfile &call_stacks = thread.second;
+		std::vector<uint64_t> module_mappings;
+		for (const base::StackSamplingProfiler::Module &module : call_stacks.modules)
+		{
+			std::string filename = module.filename.AsUTF8Unsafe();
+			uint64_t &id = mapping_ids[std::make_pair(module.base_address, filename)];
+			if (id == 0)
+			{
+				Mapping mapping;
+				mapping.start = module.base_address;
+				mapping.limit = module.base_address + 1;
+				mapping.filename = filename;
+				mapping.build_id = module.id;
+				mappings.push_back(mapping);
+				id = mappings.size();
+			}
+			module_mappings.push_back(id);
+		}
+		for (const base::StackSamplingProfiler::Sample &sample : call_stacks.samples)
+		{
+			std::vector<uint64_t> stack;
+			stack.reserve(sample.size());
+			for (size_t i = 0; i < sample.size(); ++i)
+			{
+				//除最内层外都是返回地址，减一落到调用指令上，符号化时行号才对
+				uint64_t address = sample[i].instruction_pointer;
+				if (i != 0 && address != 0)
+					address--;
+				uint64_t mapping_id = sample[i].module_index < module_mappings.size()
+					? module_mappings[sample[i].module_index] : 0;
+				if (mapping_id != 0)
+				{
+					Mapping &mapping = mappings[mapping_id - 1];
+					mapping.limit = std::max(mapping.limit, address + 1);
+				}
+				uint64_t &location_id = location_ids[address];
+				if (location_id == 0)
+				{
+					locations.push_back(std::make_pair(address, mapping_id));
+					location_id = locations.size();
+				}
+				stack.push_back(location_id);
+			}
+			if (!stack.empty())
+				stacks[std::make_pair(thread.first, std::move(stack))]++;
+		}
+	}
+
+	for (const auto &it : stacks)
+	{
+		ProtoWriter sample;
+		sample.Packed(1, it.first.second);
+		sample.Packed(2, std::vector<uint64_t>{ (uint64_t)it.second, (uint64_t)(it.second * period) });
+		ProtoWriter label;
+		label.Varint(1, thread_label);
+		label.Varint(3, (uint64_t)it.first.first);
+		sample.Bytes(3, label.data());
+		profile.Bytes(2, sample.data());
+	}
+	for (size_t i = 0; i < mappings.size(); ++i)
+	{
+		ProtoWriter mapping;
+		mapping.Varint(1, i + 1);
+		mapping.Varint(2, mappings[i].start);
+		mapping.Varint(3, mappings[i].limit);
+		mapping.Varint(5, strings.Intern(mappings[i].filename));
+		mapping.Varint(6, strings.Intern(mappings[i].build_id));
+		profile.Bytes(3, mapping.data());
+	}
+	for (size_t i = 0; i < locations.size(); ++i)
+	{
+		ProtoWriter location;
+		location.Varint(1, i + 1);
+		if (locations[i].second != 0)
+			location.Varint(2, locations[i].second);
+		location.Varint(3, locations[i].first);
+		profile.Bytes(4, location.data());
+	}
+	std::string period_type = ValueType(&strings, "wall", "nanoseconds");
+	for (const std::string &value : strings.strings())
+		profile.Bytes(6, value);
+	profile.Varint(9, (uint64_t)((start_time - Time::UnixEpoch()).InMicroseconds() * 1000));
+	profile.Varint(10, (uint64_t)(duration.InMicroseconds() * 1000));
+	profile.Bytes(11, period_type);
+	profile.Varint(12, (uint64_t)period);
+	return profile.data();
+}
+
+bool SamplingResult::WritePprof(const UTF8String &path) const
+{
+	std::string data = ToPprof();
+	return WriteFile(path, data) == (int)data.size();
+}
+
+bool SamplingProfiler::IsSupported()
+{
+	//NativeStackSampler 的 POSIX 实现是空的，Start 不会采到任何样本
+#if defined(OS_WIN)
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool SamplingProfiler::IsSampling()
+{
+	ProfilerState *state = GetState();
+	base::AutoLock lock(state->lock);
+	return state->session != nullptr;
+}
+
+bool SamplingProfiler::Start(const std::vector<int64_t> &identifiers, const SamplingOptions &options,
+	const SamplingCallback &callback)
+{
+	if (!IsSupported() || options.duration <= TimeDelta() || options.interval <= TimeDelta())
+		return false;
+	std::vector<std::pair<int64_t, base::PlatformThreadId>> threads;
+	for (int64_t identifier : identifiers)
+	{
+		base::PlatformThreadId thread_id = ThreadManager::QueryPlatformThreadId(identifier);
+		if (thread_id != base::kInvalidThreadId)
+			threads.push_back(std::make_pair(identifier, thread_id));
+	}
+	if (threads.empty())
+		return false;
+
+	std::shared_ptr<SamplingSession> session = std::make_shared<SamplingSession>(options, callback);
+	{
+		ProfilerState *state = GetState();
+		base::AutoLock lock(state->lock);
+		if (state->session)
+			return false;
+		state->session = session;
+	}
+	std::thread([session, threads]() { session->Run(threads); }).detach();
+	return true;
+}
+
+void SamplingProfiler::Stop()
+{
+	std::shared_ptr<SamplingSession> session;
+	{
+		ProfilerState *state = GetState();
+		base::AutoLock lock(state->lock);
+		session = state->session;
+	}
+	if (session)
+		session->RequestStop();
+}
+
+void SamplingProfiler::EnableLongTaskTrigger(const SamplingOptions &options, TimeDelta cooldown,
+	const SamplingCallback &callback)
+{
+	{
+		ProfilerState *state = GetState();
+		base::AutoLock lock(state->lock);
+		state->trigger_enabled = true;
+		state->trigger_options = options;
+		state->trigger_cooldown = cooldown;
+		state->trigger_callback = callback;
+	}
+	TaskInstrumentation::SetLongTaskTrigger(&OnLongTask);
+}
+
+void SamplingProfiler::DisableLongTaskTrigger()
+{
+	TaskInstrumentation::SetLongTaskTrigger(LongTaskHandler());
+	ProfilerState *state = GetState();
+	base::AutoLock lock(state->lock);
+	state->trigger_enabled = false;
+	state->trigger_callback = SamplingCallback();
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,78 @@
+// time-boxed stack sampling of FrameworkThreads with export to the pprof profile format
+
+#ifndef __BASE_EXTENSION_SAMPLING_PROFILER_H__
+#define __BASE_EXTENSION_SAMPLING_PROFILER_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/profiler/stack_sampling_profiler.h"
+
+#include "extension/extension_export.h"
+#include "extension/strings/unicode.h"
+#include "extension/time/time.h"
+
+EXTENSION_BEGIN_DECLS
+
+struct SamplingOptions
+{
+	SamplingOptions()
+		: duration(TimeDelta::FromSeconds(5))
+		, interval(TimeDelta::FromMilliseconds(10)) {}
+
+	TimeDelta duration;		// 采样的总时长
+	TimeDelta interval;		// 两次采样的间隔，每次采样要挂起目标线程几十微秒，不宜小于 1ms
+};
+
+// 一次采样的结果，地址未符号化，随 ToPprof 导出的模块信息在开发机上用对应版本的符号文件解析
+struct SamplingResult
+{
+	Time start_time;
+	TimeDelta duration;		// 实际的采样时长，提前停止时小于 SamplingOptions::duration
+	TimeDelta interval;
+	// (线程的 identifier, 该线程的样本)
+	std::vector<std::pair<int64_t, base::StackSamplingProfiler::CallStackProfile>> threads;
+
+	size_t sample_count() const;
+	// 序列化为 pprof 的 profile.proto（未压缩，go tool pprof / pprof 可以直接读取）：
+	// 每个样本的值为 samples/count 和 wall/nanoseconds，带 thread 标签（线程的 identifier），
+	// 相同线程上相同的调用栈合并为一个样本；每个模块对应一个 mapping，地址保持原始值，由 pprof 按模块符号化
+	std::string ToPprof() const;
+	bool WritePprof(const UTF8String &path) const;
+};
+typedef std::function<void(const SamplingResult &)> SamplingCallback;
+
+// 按需采样 FrameworkThread 的调用栈，用于只在用户机器上、特定负载下才出现的卡顿：
+//   SamplingProfiler::Start({ kThreadUI, kThreadDatabase }, SamplingOptions(),
+//       [](const SamplingResult &result) { result.WritePprof(path); });
+// 采样在专门的线程上进行（目标线程被短暂挂起后回溯栈），不需要目标线程配合；
+// 同一时间只有一次采样，callback 在采样结束后于内部线程上调用。
+// 基于 base::StackSamplingProfiler，目前只有 Windows 上有栈回溯实现，其他平台 IsSupported 返回 false
+class EXTENSION_EXPORT SamplingProfiler
+{
+public:
+	static bool IsSupported();
+	static bool IsSampling();
+
+	// 对以 identifiers 注册到 ThreadManager 的线程采样 options.duration。
+	// 不支持、已经在采样、或者没有一个 identifier 对应正在运行的线程时返回 false，callback 不会被调用
+	static bool Start(const std::vector<int64_t> &identifiers, const SamplingOptions &options,
+		const SamplingCallback &callback);
+	// 提前结束当前的采样，callback 仍会收到已经采到的样本
+	static void Stop();
+
+	// 出现长任务（见 TaskInstrumentation）时自动对该线程采样，两次触发至少间隔 cooldown。
+	// 长任务是在执行完后才报告的，采到的是其后 options.duration 内的调用栈，适合负载持续时的卡顿。
+	// 没有托管到 ThreadManager 的线程不会触发
+	static void EnableLongTaskTrigger(const SamplingOptions &options, TimeDelta cooldown,
+		const SamplingCallback &callback);
+	static void DisableLongTaskTrigger();
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_SAMPLING_PROFILER_H__
@@ -0,0 +1,118 @@
+#include "extension/trace/trace_recorder.h"
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/message_loop/message_loop.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/trace_event/trace_buffer.h"
+#include "base/trace_event/trace_config.h"
+#include "base/trace_event/trace_log.h"
+
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/thread/framework_thread.h"
+
+EXTENSION_BEGIN_DECLS
+
+const char kTraceCategoriesDefault[] = "nim.*";
+
+namespace
+{
+// TraceLog 分多次给出的事件片段拼成一个 JSON
+struct TraceCollector
+{
+	TraceCollector() : done(true, false)
+	{
+		buffer.SetOutputCallback(output.GetCallback());
+		buffer.Start();
+	}
+
+	base::trace_event::TraceResultBuffer::SimpleOutput output;
+	base::trace_event::TraceResultBuffer buffer;
+	base::WaitableEvent done;
+};
+
+void OnTraceFragment(TraceCollector *collector, const scoped_refptr<base::RefCountedString> &fragment,
+	bool has_more_events)
+{
+	if (!fragment->data().empty())
+		collector->buffer.AddFragment(fragment->data());
+	if (!has_more_events)
+	{
+		collector->buffer.Finish();
+		collector->done.Signal();
+	}
+}
+
+void RequestFlush(TraceCollector *collector)
+{
+	base::trace_event::TraceLog::GetInstance()->Flush(base::Bind(&OnTraceFragment, collector));
+}
+
+// 调用线程有消息循环时先交出它自己缓冲中的事件，否则 Flush 要等它的消息循环超时
+void FlushCurrentThreadBuffer()
+{
+	if (base::MessageLoop::current() != nullptr)
+		base::trace_event::TraceLog::GetInstance()->SetCurrentThreadBlocksMessageLoop();
+}
+
+bool WriteTrace(const UTF8String &path, const std::string &json)
+{
+	if (json.empty())
+		return false;
+	return WriteFile(path, json) == (int)json.size();
+}
+}
+
+void TraceRecorder::Start(const std::string &categories)
+{
+	base::trace_event::TraceConfig config(categories, "record-continuously");
+	base::trace_event::TraceLog::GetInstance()->SetEnabled(config, base::trace_event::TraceLog::RECORDING_MODE);
+}
+
+bool TraceRecorder::IsRecording()
+{
+	return base::trace_event::TraceLog::GetInstance()->IsEnabled();
+}
+
+std::string TraceRecorder::Snapshot()
+{
+	if (!IsRecording())
+		return std::string();
+	FlushCurrentThreadBuffer();
+	TraceCollector collector;
+	// 在调用线程上同步转换，回调返回前已全部给出
+	base::trace_event::TraceLog::GetInstance()->FlushButLeaveBufferIntact(base::Bind(&OnTraceFragment, &collector));
+	return collector.output.json_output;
+}
+
+bool TraceRecorder::WriteSnapshot(const UTF8String &path)
+{
+	return WriteTrace(path, Snapshot());
+}
+
+std::string TraceRecorder::Stop()
+{
+	base::trace_event::TraceLog *trace_log = base::trace_event::TraceLog::GetInstance();
+	if (!trace_log->IsEnabled())
+		return std::string();
+	FlushCurrentThreadBuffer();
+	trace_log->SetDisabled();
+
+	// Flush 要求在有消息循环的线程上调用，各线程交出事件后最后的片段也回到这个线程，
+	// 用一个临时线程完成，调用线程只需要等待
+	TraceCollector collector;
+	FrameworkThread flush_thread("trace_flush_thread");
+	if (!flush_thread.Start() || !flush_thread.WaitUntilThreadStarted())
+		return std::string();
+	flush_thread.task_runner()->PostTask(FROM_HERE, base::Bind(&RequestFlush, &collector));
+	collector.done.Wait();
+	flush_thread.Stop();
+	return collector.output.json_output;
+}
+
+bool TraceRecorder::StopAndWrite(const UTF8String &path)
+{
+	return WriteTrace(path, Stop());
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,53 @@
+// records base/trace_event events into a ring buffer and exports them as Chrome trace JSON
+
+#ifndef __BASE_EXTENSION_TRACE_RECORDER_H__
+#define __BASE_EXTENSION_TRACE_RECORDER_H__
+
+#include "extension/config/build_config.h"
+
+#include <string>
+
+#include "extension/extension_export.h"
+#include "extension/strings/unicode.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 各组件使用的 trace 类别，TRACE_EVENT 宏要求类别是字符串字面量，这里只用于文档和过滤串：
+//   nim.thread  FrameworkThread 的启动、初始化回调和退出，ThreadManager 的全局定时器线程
+//   nim.log     日志文件的打开、切分、异步写线程和 Flush
+//   nim.db      数据库的打开和预处理（建表、升级、备份）
+//   nim.http    nim_http 传输线程的创建和初始化
+//   nim.net     网络状态监听的启动和 TCP 连接（解析和连接两个阶段）
+EXTENSION_EXPORT extern const char kTraceCategoriesDefault[];
+
+// 把 base/trace_event 的事件记录在环形缓冲中（record-continuously，旧事件被覆盖，内存有上限），
+// 需要时导出为 Chrome trace JSON，用 chrome://tracing 或 ui.perfetto.dev 打开。
+// 用于查看启动和退出时各组件的耗时与并发情况：
+//   TraceRecorder::Start();						// 进程启动后尽早调用
+//   ...
+//   TraceRecorder::WriteSnapshot(path);			// 启动完成后或收到诊断指令时
+// 没有调用 Start 时 TRACE_EVENT 宏只是一次类别开关的读取。
+// 所有函数都可以在任意线程调用
+class EXTENSION_EXPORT TraceRecorder
+{
+public:
+	// 开始记录，categories 为 base::trace_event::TraceConfig 的类别过滤串，例如 "nim.*,toplevel"；
+	// 已经在记录时合并类别
+	static void Start(const std::string &categories = kTraceCategoriesDefault);
+	static bool IsRecording();
+
+	// 不停止记录，导出环形缓冲中当前的事件。
+	// 有消息循环的线程把事件先攒在线程自己的缓冲中，其中最近的一小段（每个线程最多一个 chunk）
+	// 要等攒满或调用 Stop 时才会出现在导出结果中
+	static std::string Snapshot();
+	static bool WriteSnapshot(const UTF8String &path);
+
+	// 停止记录并导出全部事件，会等待各消息循环线程交出自己缓冲中的事件，
+	// 消息循环被阻塞的线程最多等待 3 秒，该线程未交出的事件丢失。没有在记录时返回空串
+	static std::string Stop();
+	static bool StopAndWrite(const UTF8String &path);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_TRACE_RECORDER_H__
@@ -0,0 +1,620 @@
+#include "extension/zip/compression.h"
+#include <string.h>
+#include <limits>
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+
+#include "extension/file_util/utf8_file_util.h"
+
+#if defined(EXTENSION_USE_MINIZ)
+#include "extension/zip/miniz/miniz.h"
+// miniz 不支持预置字典
+#define deflateSetDictionary(stream, dictionary, size) Z_STREAM_ERROR
+#define inflateSetDictionary(stream, dictionary, size) Z_STREAM_ERROR
+#else
+#include "zlib/include/zlib.h"
+#endif
+
+EXTENSION_BEGIN_DECLS
+
+namespace
+{
+// 每次交给 sink 的最大字节数
+const size_t kChunkSize = 64 * 1024;
+// z_stream 的长度字段是 32 位的，更长的输入分段送入
+const size_t kMaxInputSize = std::numeric_limits<uInt>::max();
+
+int WindowBits(CompressionFormat format)
+{
+	switch (format)
+	{
+	case CompressionFormat::kRawDeflate:
+		return -MAX_WBITS;
+	case CompressionFormat::kGzip:
+		return MAX_WBITS + 16;
+	case CompressionFormat::kAuto:
+		// 只对 inflate 有效，自动识别 zlib 和 gzip 头
+		return MAX_WBITS + 32;
+	default:
+		return MAX_WBITS;
+	}
+}
+
+int ClampLevel(int level)
+{
+	if (level < 0)
+		return kCompressionDefault;
+	return level > kCompressionBest ? kCompressionBest : level;
+}
+
+// 依次把 ChainedBuffer 的每个分片交给 write，任何一个失败即停止
+template <typename Write>
+bool WriteSegments(const ChainedBuffer &data, const Write &write)
+{
+	bool result = true;
+	data.visit([&](const std::shared_ptr<const void> &, const char *segment, size_t size) {
+		if (result)
+			result = write(segment, size);
+	});
+	return result;
+}
+}
+
+struct Compressor::Stream
+{
+	Stream(CompressionFormat format, int level) : format(format), level(level), inited(false), failed(false),
+		crc(0), total_in(0), total_out(0), buffer(new char[kChunkSize])
+	{
+		memset(&stream, 0, sizeof(stream));
+	}
+
+	CompressionFormat format;
+	int level;
+	z_stream stream;
+	bool inited;
+	bool failed;
+	uint32_t crc;
+	uint64_t total_in;
+	uint64_t total_out;
+	std::unique_ptr<char[]> buffer;
+	std::string dictionary;
+};
+
+Compressor::Compressor(CompressionFormat format, int level) :
+	stream_(new Stream(format == CompressionFormat::kAuto ? CompressionFormat::kZlib : format, ClampLevel(level)))
+{
+	stream_->inited = deflateInit2(&stream_->stream, stream_->level, Z_DEFLATED,
+		WindowBits(stream_->format), 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Compressor::~Compressor()
+{
+	if (stream_->inited)
+		deflateEnd(&stream_->stream);
+}
+
+bool Compressor::IsValid() const
+{
+	return stream_->inited;
+}
+
+bool Compressor::SetDictionary(const std::string &dictionary)
+{
+	if (!stream_->inited || stream_->failed)
+		return false;
+	stream_->dictionary = dictionary;
+	if (dictionary.empty())
+		return true;
+	if (deflateSetDictionary(&stream_->stream, (const Bytef *)dictionary.data(), (uInt)dictionary.size()) != Z_OK)
+	{
+		stream_->failed = true;
+		return false;
+	}
+	return true;
+}
+
+bool Compressor::Write(const char *data, size_t size, const CompressionSink &sink)
+{
+	if (size == 0)
+		return stream_->inited && !stream_->failed;
+	for (size_t offset = 0; offset < size; offset += kMaxInputSize)
+	{
+		size_t length = size - offset < kMaxInputSize ? size - offset : kMaxInputSize;
+		stream_->crc = (uint32_t)::crc32(stream_->crc, (const Bytef *)data + offset, (uInt)length);
+		if (!Deflate(data + offset, length, Z_NO_FLUSH, sink))
+			return false;
+	}
+	return true;
+}
+
+bool Compressor::Write(const ChainedBuffer &data, const CompressionSink &sink)
+{
+	return WriteSegments(data, [this, &sink](const char *segment, size_t size) { return Write(segment, size, sink); });
+}
+
+bool Compressor::Flush(const CompressionSink &sink)
+{
+	return Deflate(nullptr, 0, Z_SYNC_FLUSH, sink);
+}
+
+bool Compressor::Finish(const CompressionSink &sink)
+{
+	return Deflate(nullptr, 0, Z_FINISH, sink);
+}
+
+void Compressor::Reset()
+{
+	if (!stream_->inited)
+		return;
+	stream_->failed = deflateReset(&stream_->stream) != Z_OK;
+	if (!stream_->failed && !stream_->dictionary.empty())
+		stream_->failed = deflateSetDictionary(&stream_->stream,
+			(const Bytef *)stream_->dictionary.data(), (uInt)stream_->dictionary.size()) != Z_OK;
+	stream_->crc = 0;
+	stream_->total_in = 0;
+	stream_->total_out = 0;
+}
+
+uint64_t Compressor::total_in() const
+{
+	return stream_->total_in;
+}
+
+uint64_t Compressor::total_out() const
+{
+	return stream_->total_out;
+}
+
+uint32_t Compressor::crc() const
+{
+	return stream_->crc;
+}
+
+bool Compressor::Compress(const char *data, size_t size, std::string *out, CompressionFormat format, int level)
+{
+	Compressor compressor(format, level);
+	size_t offset = out->size();
+	CompressionSink sink = AppendTo(out);
+	if (compressor.Write(data, size, sink) && compressor.Finish(sink))
+		return true;
+	out->resize(offset);
+	return false;
+}
+
+bool Compressor::Deflate(const char *data, size_t size, int flush, const CompressionSink &sink)
+{
+	if (!stream_->inited || stream_->failed)
+		return false;
+	z_stream &stream = stream_->stream;
+	stream.next_in = (Bytef *)data;
+	stream.avail_in = (uInt)size;
+	int ret = Z_OK;
+	// 输出缓冲区被写满说明还有输出，否则输入已全部消耗
+	do
+	{
+		stream.next_out = (Bytef *)stream_->buffer.get();
+		stream.avail_out = (uInt)kChunkSize;
+		ret = deflate(&stream, flush);
+		size_t have = kChunkSize - stream.avail_out;
+		if (ret == Z_STREAM_ERROR || (have > 0 && !sink(stream_->buffer.get(), have)))
+		{
+			stream_->failed = true;
+			return false;
+		}
+		stream_->total_out += have;
+	} while (stream.avail_out == 0);
+	stream_->total_in += size;
+	if (flush == Z_FINISH && ret != Z_STREAM_END)
+	{
+		stream_->failed = true;
+		return false;
+	}
+	return true;
+}
+
+struct Decompressor::Stream
+{
+	Stream(CompressionFormat format, uint64_t max_output) : format(format), max_output(max_output), inited(false), failed(false), finished(false),
+		total_in(0), total_out(0), buffer(new char[kChunkSize])
+	{
+		memset(&stream, 0, sizeof(stream));
+	}
+
+	CompressionFormat format;
+	uint64_t max_output;
+	z_stream stream;
+	bool inited;
+	bool failed;
+	bool finished;
+	uint64_t total_in;
+	uint64_t total_out;
+	std::unique_ptr<char[]> buffer;
+	std::string dictionary;
+};
+
+Decompressor::Decompressor(CompressionFormat format, uint64_t max_output) :
+	stream_(new Stream(format, max_output))
+{
+	stream_->inited = inflateInit2(&stream_->stream, WindowBits(format)) == Z_OK;
+}
+
+Decompressor::~Decompressor()
+{
+	if (stream_->inited)
+		inflateEnd(&stream_->stream);
+}
+
+bool Decompressor::IsValid() const
+{
+	return stream_->inited;
+}
+
+bool Decompressor::SetDictionary(const std::string &dictionary)
+{
+	if (!stream_->inited || stream_->failed)
+		return false;
+	stream_->dictionary = dictionary;
+	//原始 deflate 没有字典标识，只能预先设置；zlib 格式等 inflate 返回 Z_NEED_DICT 时再设置
+	if (stream_->format != CompressionFormat::kRawDeflate || dictionary.empty())
+		return true;
+	if (inflateSetDictionary(&stream_->stream, (const Bytef *)dictionary.data(), (uInt)dictionary.size()) != Z_OK)
+	{
+		stream_->failed = true;
+		return false;
+	}
+	return true;
+}
+
+bool Decompressor::Write(const char *data, size_t size, const CompressionSink &sink)
+{
+	if (!stream_->inited || stream_->failed)
+		return false;
+	z_stream &stream = stream_->stream;
+	for (size_t offset = 0; offset < size && !stream_->finished; offset += kMaxInputSize)
+	{
+		size_t length = size - offset < kMaxInputSize ? size - offset : kMaxInputSize;
+		stream.next_in = (Bytef *)data + offset;
+		stream.avail_in = (uInt)length;
+		bool need_dictionary = false;
+		do
+		{
+			stream.next_out = (Bytef *)stream_->buffer.get();
+			stream.avail_out = (uInt)kChunkSize;
+			int ret = inflate(&stream, Z_NO_FLUSH);
+			//设置字典后还要再 inflate 一次才有输出
+			need_dictionary = ret == Z_NEED_DICT && !stream_->dictionary.empty();
+			if (need_dictionary)
+				ret = inflateSetDictionary(&stream, (const Bytef *)stream_->dictionary.data(), (uInt)stream_->dictionary.size());
+			size_t have = kChunkSize - stream.avail_out;
+			stream_->total_out += have;
+			// Z_BUF_ERROR 只表示这次没有进展，需要更多输入
+			if ((ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) ||
+				(stream_->max_output != 0 && stream_->total_out > stream_->max_output) ||
+				(have > 0 && !sink(stream_->buffer.get(), have)))
+			{
+				stream_->failed = true;
+				return false;
+			}
+			if (ret == Z_STREAM_END)
+				stream_->finished = true;
+		} while ((stream.avail_out == 0 || need_dictionary) && !stream_->finished);
+		stream_->total_in += length - stream.avail_in;
+	}
+	return true;
+}
+
+bool Decompressor::Write(const ChainedBuffer &data, const CompressionSink &sink)
+{
+	return WriteSegments(data, [this, &sink](const char *segment, size_t size) { return Write(segment, size, sink); });
+}
+
+bool Decompressor::finished() const
+{
+	return stream_->finished;
+}
+
+void Decompressor::Reset()
+{
+	if (!stream_->inited)
+		return;
+	stream_->failed = inflateReset(&stream_->stream) != Z_OK;
+	if (!stream_->failed && stream_->format == CompressionFormat::kRawDeflate && !stream_->dictionary.empty())
+		stream_->failed = inflateSetDictionary(&stream_->stream,
+			(const Bytef *)stream_->dictionary.data(), (uInt)stream_->dictionary.size()) != Z_OK;
+	stream_->finished = false;
+	stream_->total_in = 0;
+	stream_->total_out = 0;
+}
+
+uint64_t Decompressor::total_in() const
+{
+	return stream_->total_in;
+}
+
+uint64_t Decompressor::total_out() const
+{
+	return stream_->total_out;
+}
+
+bool Decompressor::Decompress(const char *data, size_t size, std::string *out, CompressionFormat format, uint64_t max_output)
+{
+	Decompressor decompressor(format, max_output);
+	size_t offset = out->size();
+	if (decompressor.Write(data, size, AppendTo(out)) && decompressor.finished())
+		return true;
+	out->resize(offset);
+	return false;
+}
+
+namespace
+{
+const uint32_t kLocalFileHeaderSignature = 0x04034b50;
+const uint32_t kDataDescriptorSignature = 0x08074b50;
+const uint32_t kCentralDirectorySignature = 0x02014b50;
+const uint32_t kEndOfCentralDirectorySignature = 0x06054b50;
+// 2.0，支持 deflate 和 data descriptor 的版本
+const uint16_t kVersionNeeded = 20;
+// 高字节 3 表示 Unix，外部属性的高 16 位即 st_mode
+const uint16_t kVersionMadeBy = (3 << 8) | kVersionNeeded;
+// 位 3：CRC 和长度在数据之后的 data descriptor 中；位 11：文件名为 UTF-8
+const uint16_t kGeneralPurposeFlags = (1 << 3) | (1 << 11);
+const uint16_t kMethodDeflate = 8;
+// 普通文件，rw-r--r--
+const uint32_t kExternalAttributes = 0100644u << 16;
+// 条目读文件时每次压缩的字节数
+const size_t kFileChunkSize = 1024 * 1024;
+
+void PutUint16(std::string &out, uint16_t value)
+{
+	out.push_back((char)(value & 0xff));
+	out.push_back((char)(value >> 8));
+}
+
+void PutUint32(std::string &out, uint32_t value)
+{
+	PutUint16(out, (uint16_t)(value & 0xffff));
+	PutUint16(out, (uint16_t)(value >> 16));
+}
+
+// MS-DOS 的日期时间，精度 2 秒，只能表示 1980 年以后
+void ToDosTime(base::Time time, uint16_t *dos_time, uint16_t *dos_date)
+{
+	base::Time::Exploded exploded;
+	(time.is_null() ? base::Time::Now() : time).LocalExplode(&exploded);
+	if (exploded.year < 1980)
+	{
+		*dos_time = 0;
+		*dos_date = (1 << 5) | 1;
+		return;
+	}
+	*dos_time = (uint16_t)((exploded.hour << 11) | (exploded.minute << 5) | (exploded.second / 2));
+	*dos_date = (uint16_t)(((exploded.year - 1980) << 9) | (exploded.month << 5) | exploded.day_of_month);
+}
+}
+
+struct ZipWriter::File
+{
+	explicit File(const UTF8String &path) : file(path, "wb") {}
+	ScopedFile file;
+};
+
+ZipWriter::ZipWriter(const CompressionSink &sink) :
+	sink_(sink), level_(-1), in_entry_(false), failed_(false), finished_(false), offset_(0)
+{
+}
+
+ZipWriter::ZipWriter(const UTF8String &zip_path) :
+	file_(new File(zip_path)), level_(-1), in_entry_(false), failed_(false), finished_(false), offset_(0)
+{
+	failed_ = !file_->file.is_valid();
+	FILE *file = file_->file;
+	sink_ = [file](const char *data, size_t size) { return fwrite(data, 1, size, file) == size; };
+}
+
+ZipWriter::~ZipWriter()
+{
+}
+
+bool ZipWriter::IsValid() const
+{
+	return !failed_;
+}
+
+bool ZipWriter::BeginEntry(const std::string &name, int level, base::Time mtime)
+{
+	if (finished_ || (in_entry_ && !EndEntry()) || failed_)
+		return false;
+	if (entries_.size() >= 0xffff || name.size() > 0xffff || offset_ > 0xffffffffu)
+	{
+		Fail();
+		return false;
+	}
+	level = ClampLevel(level);
+	if (compressor_ == nullptr || level != level_)
+	{
+		compressor_.reset(new Compressor(CompressionFormat::kRawDeflate, level));
+		level_ = level;
+	}
+	else
+	{
+		compressor_->Reset();
+	}
+
+	Entry entry;
+	entry.name = name;
+	ToDosTime(mtime, &entry.dos_time, &entry.dos_date);
+	entry.crc = 0;
+	entry.compressed_size = 0;
+	entry.size = 0;
+	entry.offset = (uint32_t)offset_;
+
+	std::string header;
+	PutUint32(header, kLocalFileHeaderSignature);
+	PutUint16(header, kVersionNeeded);
+	PutUint16(header, kGeneralPurposeFlags);
+	PutUint16(header, kMethodDeflate);
+	PutUint16(header, entry.dos_time);
+	PutUint16(header, entry.dos_date);
+	// CRC 和长度写在 data descriptor 中
+	PutUint32(header, 0);
+	PutUint32(header, 0);
+	PutUint32(header, 0);
+	PutUint16(header, (uint16_t)name.size());
+	PutUint16(header, 0);
+	header.append(name);
+	entries_.push_back(entry);
+	in_entry_ = true;
+	return Output(header.data(), header.size());
+}
+
+bool ZipWriter::WriteEntry(const char *data, size_t size)
+{
+	if (!in_entry_ || failed_)
+		return false;
+	if (!compressor_->Write(data, size, [this](const char *out, size_t out_size) { return Output(out, out_size); }))
+	{
+		Fail();
+		return false;
+	}
+	return true;
+}
+
+bool ZipWriter::WriteEntry(const ChainedBuffer &data)
+{
+	return WriteSegments(data, [this](const char *segment, size_t size) { return WriteEntry(segment, size); });
+}
+
+bool ZipWriter::EndEntry()
+{
+	if (!in_entry_ || failed_)
+		return false;
+	in_entry_ = false;
+	if (!compressor_->Finish([this](const char *out, size_t out_size) { return Output(out, out_size); }) ||
+		compressor_->total_in() > 0xffffffffu || compressor_->total_out() > 0xffffffffu)
+	{
+		Fail();
+		return false;
+	}
+	Entry &entry = entries_.back();
+	entry.crc = compressor_->crc();
+	entry.compressed_size = (uint32_t)compressor_->total_out();
+	entry.size = (uint32_t)compressor_->total_in();
+
+	std::string descriptor;
+	PutUint32(descriptor, kDataDescriptorSignature);
+	PutUint32(descriptor, entry.crc);
+	PutUint32(descriptor, entry.compressed_size);
+	PutUint32(descriptor, entry.size);
+	return Output(descriptor.data(), descriptor.size());
+}
+
+bool ZipWriter::AddEntry(const std::string &name, const char *data, size_t size, int level)
+{
+	return BeginEntry(name, level) && WriteEntry(data, size) && EndEntry();
+}
+
+bool ZipWriter::AddFile(const std::string &name, const UTF8String &filepath, int level)
+{
+	MappedFile file;
+	if (failed_ || !file.Open(filepath, MappedFile::kSequential))
+		return false;
+	base::File::Info info;
+	base::Time mtime;
+	if (base::GetFileInfo(base::FilePath::FromUTF8Unsafe(filepath), &info))
+		mtime = info.last_modified;
+	if (!BeginEntry(name, level, mtime))
+		return false;
+	const char *data = reinterpret_cast<const char *>(file.data());
+	for (size_t offset = 0; offset < file.length(); offset += kFileChunkSize)
+	{
+		size_t length = file.length() - offset < kFileChunkSize ? file.length() - offset : kFileChunkSize;
+		if (!WriteEntry(data + offset, length))
+			return false;
+		// 每段只读一遍，压缩完就让它离开工作集
+		file.Release(offset, length);
+	}
+	return EndEntry();
+}
+
+bool ZipWriter::Finish(const std::string &comment)
+{
+	if (finished_ || (in_entry_ && !EndEntry()) || failed_)
+		return false;
+	finished_ = true;
+	if (offset_ > 0xffffffffu || comment.size() > 0xffff)
+	{
+		Fail();
+		return false;
+	}
+
+	uint32_t directory_offset = (uint32_t)offset_;
+	std::string directory;
+	for (const Entry &entry : entries_)
+	{
+		PutUint32(directory, kCentralDirectorySignature);
+		PutUint16(directory, kVersionMadeBy);
+		PutUint16(directory, kVersionNeeded);
+		PutUint16(directory, kGeneralPurposeFlags);
+		PutUint16(directory, kMethodDeflate);
+		PutUint16(directory, entry.dos_time);
+		PutUint16(directory, entry.dos_date);
+		PutUint32(directory, entry.crc);
+		PutUint32(directory, entry.compressed_size);
+		PutUint32(directory, entry.size);
+		PutUint16(directory, (uint16_t)entry.name.size());
+		PutUint16(directory, 0);	// extra field
+		PutUint16(directory, 0);	// comment
+		PutUint16(directory, 0);	// disk number
+		PutUint16(directory, 0);	// internal attributes
+		PutUint32(directory, kExternalAttributes);
+		PutUint32(directory, entry.offset);
+		directory.append(entry.name);
+	}
+	uint64_t directory_size = directory.size();
+	if (offset_ + directory_size > 0xffffffffu)
+	{
+		Fail();
+		return false;
+	}
+	PutUint32(directory, kEndOfCentralDirectorySignature);
+	PutUint16(directory, 0);
+	PutUint16(directory, 0);
+	PutUint16(directory, (uint16_t)entries_.size());
+	PutUint16(directory, (uint16_t)entries_.size());
+	PutUint32(directory, (uint32_t)directory_size);
+	PutUint32(directory, directory_offset);
+	PutUint16(directory, (uint16_t)comment.size());
+	directory.append(comment);
+	if (!Output(directory.data(), directory.size()))
+		return false;
+
+	if (file_ != nullptr)
+	{
+		FILE *file = file_->file.release();
+		if (fclose(file) != 0)
+		{
+			failed_ = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ZipWriter::Output(const char *data, size_t size)
+{
+	if (failed_ || !sink_(data, size))
+	{
+		Fail();
+		return false;
+	}
+	offset_ += size;
+	return true;
+}
+
+void ZipWriter::Fail()
+{
+	failed_ = true;
+	in_entry_ = false;
+}
+
+EXTENSION_END_DECLS
@@ -0,0 +1,202 @@
+// streaming deflate/zlib/gzip compression and zip archives over the bundled zlib (or miniz)
+
+#ifndef __BASE_EXTENSION_COMPRESSION_H__
+#define __BASE_EXTENSION_COMPRESSION_H__
+
+#include "extension/config/build_config.h"
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "base/macros.h"
+#include "base/time/time.h"
+
+#include "extension/extension_export.h"
+#include "extension/memory/blockbuffer.h"
+#include "extension/memory/chained_buffer.h"
+#include "extension/strings/unicode.h"
+
+EXTENSION_BEGIN_DECLS
+
+// 默认使用 third_party 中预编译的 zlib；定义 EXTENSION_USE_MINIZ 并把 miniz.h/miniz.c
+// 放进 extension/zip/miniz 后改用 miniz（与 zlib 接口兼容），用于不便链接 zlib 的平台
+enum class CompressionFormat
+{
+	kRawDeflate,	// 不带头尾的 deflate 数据，zip 条目使用
+	kZlib,			// RFC 1950，HTTP 的 deflate 编码
+	kGzip,			// RFC 1952，HTTP 的 gzip 编码
+	kAuto,			// 只用于解压，按头部识别 zlib 或 gzip
+};
+
+// 压缩等级的预设，也可以直接传 0~9
+enum CompressionLevel
+{
+	kCompressionStore = 0,		// 不压缩，只加上格式的头尾
+	kCompressionFastest = 1,	// 日志、实时上传等 CPU 优先的场景
+	kCompressionDefault = 6,
+	kCompressionBest = 9,		// 一次压缩多次下发的数据
+};
+
+// 接收压缩或解压输出的回调，返回 false 时中止，数据只在回调期间有效
+typedef std::function<bool(const char *data, size_t size)> CompressionSink;
+
+// 把输出追加到常用的缓冲区；BlockBuffer 写满时返回 false
+inline CompressionSink AppendTo(std::string *out)
+{
+	return [out](const char *data, size_t size) { out->append(data, size); return true; };
+}
+inline CompressionSink AppendTo(ChainedBuffer *out)
+{
+	return [out](const char *data, size_t size) { out->append(data, size); return true; };
+}
+template <typename BlockAllocator, unsigned MaxBlocks>
+CompressionSink AppendTo(BlockBuffer<BlockAllocator, MaxBlocks> *out)
+{
+	return [out](const char *data, size_t size) { return out->append(data, size); };
+}
+
+// 流式压缩：输入分多次 Write，输出按不超过 64KB 的块交给 sink，不需要在内存中保留
+// 完整的输入或输出。一个 Compressor 同时只压缩一个流，Finish 后可以 Reset 复用。
+// 任何一步失败后流即作废，之后的调用都返回 false，直到 Reset
+class EXTENSION_EXPORT Compressor
+{
+public:
+	explicit Compressor(CompressionFormat format = CompressionFormat::kGzip, int level = kCompressionDefault);
+	~Compressor();
+
+	// 压缩库初始化失败时为 false
+	bool IsValid() const;
+
+	// 预置字典，小而重复的数据（协议消息等）可以引用字典中的内容，压缩率明显提高。
+	// 需在流开始前（构造或 Reset 之后、第一次 Write 之前）调用，之后每次 Reset 自动重新设置；
+	// 解压方必须使用同样的字典。字典最多用到末尾 32KB，常用的内容放在后面
+	bool SetDictionary(const std::string &dictionary);
+
+	bool Write(const char *data, size_t size, const CompressionSink &sink);
+	bool Write(const std::string &data, const CompressionSink &sink) { return Write(data.data(), data.size(), sink); }
+	bool Write(const ChainedBuffer &data, const CompressionSink &sink);
+	// 输出目前为止的全部数据（Z_SYNC_FLUSH），接收方可以先解出这部分；会略微降低压缩率
+	bool Flush(const CompressionSink &sink);
+	// 结束流并输出尾部
+	bool Finish(const CompressionSink &sink);
+	// 开始一个新的流，格式和等级不变
+	void Reset();
+
+	uint64_t total_in() const;
+	uint64_t total_out() const;
+	// 已输入数据的 CRC-32
+	uint32_t crc() const;
+
+	// 一次性压缩，结果追加到 out
+	static bool Compress(const char *data, size_t size, std::string *out,
+		CompressionFormat format = CompressionFormat::kGzip, int level = kCompressionDefault);
+
+private:
+	bool Deflate(const char *data, size_t size, int flush, const CompressionSink &sink);
+
+	struct Stream;
+	std::unique_ptr<Stream> stream_;
+
+	DISALLOW_COPY_AND_ASSIGN(Compressor);
+};
+
+// 流式解压，压缩数据可以在任意位置切分后分多次 Write。
+// max_output 非 0 时解压结果超过它即失败，防止解压炸弹
+class EXTENSION_EXPORT Decompressor
+{
+public:
+	explicit Decompressor(CompressionFormat format = CompressionFormat::kAuto, uint64_t max_output = 0);
+	~Decompressor();
+
+	bool IsValid() const;
+
+	// 与压缩时相同的字典，Reset 后保留；kRawDeflate 需在第一次 Write 之前调用，
+	// zlib 格式在数据要求字典时使用
+	bool SetDictionary(const std::string &dictionary);
+
+	// 流结束后的输入被忽略
+	bool Write(const char *data, size_t size, const CompressionSink &sink);
+	bool Write(const std::string &data, const CompressionSink &sink) { return Write(data.data(), data.size(), sink); }
+	bool Write(const ChainedBuffer &data, const CompressionSink &sink);
+	// 已读到流的结尾（及 gzip/zlib 的校验），输入不完整时为 false
+	bool finished() const;
+	void Reset();
+
+	uint64_t total_in() const;
+	uint64_t total_out() const;
+
+	// 一次性解压，结果追加到 out；数据不完整时返回 false
+	static bool Decompress(const char *data, size_t size, std::string *out,
+		CompressionFormat format = CompressionFormat::kAuto, uint64_t max_output = 0);
+
+private:
+	struct Stream;
+	std::unique_ptr<Stream> stream_;
+
+	DISALLOW_COPY_AND_ASSIGN(Decompressor);
+};
+
+// 流式生成 zip 归档：条目边压缩边输出，不需要预先知道大小也不回头改写已输出的数据，
+// sink 可以直接是上传的请求体。条目使用 data descriptor（通用标记位 3）记录 CRC 和长度，
+// 中央目录在 Finish 时输出。不支持 zip64，单个条目和整个归档都不能超过 4GB，条目不超过 65535 个
+class EXTENSION_EXPORT ZipWriter
+{
+public:
+	explicit ZipWriter(const CompressionSink &sink);
+	// 写到文件，文件无法创建时 IsValid 为 false
+	explicit ZipWriter(const UTF8String &zip_path);
+	// 没有 Finish 的归档是不完整的
+	~ZipWriter();
+
+	bool IsValid() const;
+
+	// name 为归档内的 UTF-8 路径，以 / 分隔；mtime 为空时取当前时间
+	bool BeginEntry(const std::string &name, int level = kCompressionDefault, base::Time mtime = base::Time());
+	bool WriteEntry(const char *data, size_t size);
+	bool WriteEntry(const ChainedBuffer &data);
+	bool EndEntry();
+
+	bool AddEntry(const std::string &name, const char *data, size_t size, int level = kCompressionDefault);
+	// 按块读取 filepath 压缩进归档，修改时间取文件的；文件无法打开时返回 false，归档不受影响
+	bool AddFile(const std::string &name, const UTF8String &filepath, int level = kCompressionDefault);
+
+	// 结束正在写的条目，输出中央目录；文件输出时同时关闭文件
+	bool Finish(const std::string &comment = std::string());
+
+	// 已输出的字节数
+	uint64_t size() const { return offset_; }
+
+private:
+	struct Entry
+	{
+		std::string name;
+		uint16_t dos_time;
+		uint16_t dos_date;
+		uint32_t crc;
+		uint32_t compressed_size;
+		uint32_t size;
+		uint32_t offset;
+	};
+
+	bool Output(const char *data, size_t size);
+	void Fail();
+
+	CompressionSink sink_;
+	struct File;
+	std::unique_ptr<File> file_;
+	std::unique_ptr<Compressor> compressor_;	// 条目间复用，等级变化时重建
+	int level_;
+	std::vector<Entry> entries_;
+	bool in_entry_;
+	bool failed_;
+	bool finished_;
+	uint64_t offset_;
+
+	DISALLOW_COPY_AND_ASSIGN(ZipWriter);
+};
+
+EXTENSION_END_DECLS
+
+#endif // __BASE_EXTENSION_COMPRESSION_H__
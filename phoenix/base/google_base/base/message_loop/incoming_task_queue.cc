@@ -6,6 +6,7 @@
 
 #include <limits>
 
+#include "base/bind.h"
 #include "base/location.h"
 #include "base/message_loop/message_loop.h"
 #include "base/metrics/histogram.h"
@@ -46,7 +47,8 @@ IncomingTaskQueue::IncomingTaskQueue(MessageLoop* message_loop)
       next_sequence_num_(0),
       message_loop_scheduled_(false),
       always_schedule_work_(AlwaysNotifyPump(message_loop_->type())),
-      is_ready_for_scheduling_(false) {
+      is_ready_for_scheduling_(false),
+      urgent_candidate_count_(0) {
 }
 
 bool IncomingTaskQueue::AddToIncomingQueue(
@@ -62,6 +64,7 @@ bool IncomingTaskQueue::AddToIncomingQueue(
   AutoLock locked(incoming_queue_lock_);
   PendingTask pending_task(
       from_here, task, CalculateDelayedRuntime(delay), nestable);
+  pending_task.queue_time = TimeTicks::Now();
 #if defined(OS_WIN)
   // We consider the task needs a high resolution timer if the delay is
   // more than 0 and less than 32ms. This caps the relative error to
@@ -76,6 +79,97 @@ bool IncomingTaskQueue::AddToIncomingQueue(
   return PostPendingTask(&pending_task);
 }
 
+bool IncomingTaskQueue::AddToPriorityQueue(
+    const tracked_objects::Location& from_here,
+    const Closure& task,
+    SingleThreadTaskRunner::Priority priority) {
+  if (priority == SingleThreadTaskRunner::PRIORITY_NORMAL)
+    return AddToIncomingQueue(from_here, task, TimeDelta(), true);
+
+  AutoLock locked(incoming_queue_lock_);
+  PendingTask pending_task(from_here, task, TimeTicks(), true);
+  pending_task.queue_time = TimeTicks::Now();
+  return PostLaneTask(&pending_task,
+                      priority == SingleThreadTaskRunner::PRIORITY_HIGH
+                          ? &high_priority_queue_
+                          : &low_priority_queue_);
+}
+
+bool IncomingTaskQueue::AddToIdleQueue(
+    const tracked_objects::Location& from_here,
+    const SingleThreadTaskRunner::IdleTask& task,
+    TimeDelta timeout) {
+  AutoLock locked(incoming_queue_lock_);
+  if (!message_loop_)
+    return false;
+  IdleTaskEntry entry;
+  entry.posted_from = from_here;
+  entry.task = task;
+  entry.queue_time = TimeTicks::Now();
+  if (timeout > TimeDelta()) {
+    entry.timeout_time = entry.queue_time + timeout;
+    urgent_candidate_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+  idle_queue_.push_back(entry);
+  // The loop runs idle tasks before it sleeps, wake it only if it already
+  // sleeps.
+  if (is_ready_for_scheduling_ &&
+      (always_schedule_work_ || !message_loop_scheduled_)) {
+    ScheduleWork();
+  }
+  return true;
+}
+
+bool IncomingTaskQueue::TakeUrgentTask(PendingTask* pending_task) {
+  if (urgent_candidate_count_.load(std::memory_order_relaxed) == 0)
+    return false;
+
+  AutoLock lock(incoming_queue_lock_);
+  if (!high_priority_queue_.empty()) {
+    *pending_task = high_priority_queue_.front();
+    high_priority_queue_.pop();
+    urgent_candidate_count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  TimeTicks now = TimeTicks::Now();
+  if (!low_priority_queue_.empty() &&
+      now - low_priority_queue_.front().queue_time >=
+          TimeDelta::FromMilliseconds(
+              SingleThreadTaskRunner::kLowPriorityMaxDelayMs)) {
+    *pending_task = low_priority_queue_.front();
+    low_priority_queue_.pop();
+    urgent_candidate_count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  for (auto it = idle_queue_.begin(); it != idle_queue_.end(); ++it) {
+    if (it->timeout_time.is_null() || it->timeout_time > now)
+      continue;
+    // Timed out while the loop was busy, so there is no idle time to give.
+    PendingTask timed_out(it->posted_from, Bind(it->task, now));
+    timed_out.queue_time = it->queue_time;
+    *pending_task = timed_out;
+    idle_queue_.erase(it);
+    urgent_candidate_count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool IncomingTaskQueue::TakeIdleTask(TimeTicks deadline,
+                                     PendingTask* pending_task) {
+  AutoLock lock(incoming_queue_lock_);
+  if (idle_queue_.empty())
+    return false;
+  const IdleTaskEntry& entry = idle_queue_.front();
+  PendingTask idle_task(entry.posted_from, Bind(entry.task, deadline));
+  idle_task.queue_time = entry.queue_time;
+  *pending_task = idle_task;
+  if (!entry.timeout_time.is_null())
+    urgent_candidate_count_.fetch_sub(1, std::memory_order_relaxed);
+  idle_queue_.pop_front();
+  return true;
+}
+
 bool IncomingTaskQueue::HasHighResolutionTasks() {
   AutoLock lock(incoming_queue_lock_);
   return high_res_task_count_ > 0;
@@ -83,7 +177,14 @@ bool IncomingTaskQueue::HasHighResolutionTasks() {
 
 bool IncomingTaskQueue::IsIdleForTesting() {
   AutoLock lock(incoming_queue_lock_);
-  return incoming_queue_.empty();
+  return incoming_queue_.empty() && high_priority_queue_.empty() &&
+         low_priority_queue_.empty();
+}
+
+size_t IncomingTaskQueue::GetIncomingTaskCount() {
+  AutoLock lock(incoming_queue_lock_);
+  return incoming_queue_.size() + high_priority_queue_.size() +
+         low_priority_queue_.size();
 }
 
 int IncomingTaskQueue::ReloadWorkQueue(TaskQueue* work_queue) {
@@ -92,13 +193,21 @@ int IncomingTaskQueue::ReloadWorkQueue(TaskQueue* work_queue) {
 
   // Acquire all we can from the inter-thread queue with one lock acquisition.
   AutoLock lock(incoming_queue_lock_);
-  if (incoming_queue_.empty()) {
+  if (!incoming_queue_.empty()) {
+    incoming_queue_.Swap(work_queue);
+  } else if (!high_priority_queue_.empty() || !low_priority_queue_.empty()) {
+    // A lane task the loop did not take by TakeUrgentTask(), the low priority
+    // ones run here when nothing else is pending.
+    TaskQueue* lane = high_priority_queue_.empty() ? &low_priority_queue_
+                                                   : &high_priority_queue_;
+    work_queue->push(lane->front());
+    lane->pop();
+    urgent_candidate_count_.fetch_sub(1, std::memory_order_relaxed);
+  } else {
     // If the loop attempts to reload but there are no tasks in the incoming
     // queue, that means it will go to sleep waiting for more work. If the
     // incoming queue becomes nonempty we need to schedule it again.
     message_loop_scheduled_ = false;
-  } else {
-    incoming_queue_.Swap(work_queue);
   }
   // Reset the count of high resolution tasks since our queue is now empty.
   int high_res_tasks = high_res_task_count_;
@@ -107,8 +216,17 @@ int IncomingTaskQueue::ReloadWorkQueue(TaskQueue* work_queue) {
 }
 
 void IncomingTaskQueue::WillDestroyCurrentMessageLoop() {
+  // The tasks left in the lanes are deleted on the thread of the loop, out of
+  // the lock as their destructors may post tasks.
+  TaskQueue high_priority_queue;
+  TaskQueue low_priority_queue;
+  std::deque<IdleTaskEntry> idle_queue;
   AutoLock lock(incoming_queue_lock_);
   message_loop_ = NULL;
+  high_priority_queue_.Swap(&high_priority_queue);
+  low_priority_queue_.Swap(&low_priority_queue);
+  idle_queue_.swap(idle_queue);
+  urgent_candidate_count_.store(0, std::memory_order_relaxed);
 }
 
 void IncomingTaskQueue::StartScheduling() {
@@ -116,7 +234,8 @@ void IncomingTaskQueue::StartScheduling() {
   DCHECK(!is_ready_for_scheduling_);
   DCHECK(!message_loop_scheduled_);
   is_ready_for_scheduling_ = true;
-  if (!incoming_queue_.empty())
+  if (!incoming_queue_.empty() || !high_priority_queue_.empty() ||
+      !low_priority_queue_.empty() || !idle_queue_.empty())
     ScheduleWork();
 }
 
@@ -167,6 +286,31 @@ bool IncomingTaskQueue::PostPendingTask(PendingTask* pending_task) {
   return true;
 }
 
+bool IncomingTaskQueue::PostLaneTask(PendingTask* pending_task,
+                                     TaskQueue* lane) {
+  incoming_queue_lock_.AssertAcquired();
+
+  if (!message_loop_) {
+    pending_task->task.Reset();
+    return false;
+  }
+
+  pending_task->sequence_num = next_sequence_num_++;
+  message_loop_->task_annotator()->DidQueueTask("MessageLoop::PostTask",
+                                                *pending_task);
+  lane->push(*pending_task);
+  pending_task->task.Reset();
+  urgent_candidate_count_.fetch_add(1, std::memory_order_relaxed);
+
+  // ReloadWorkQueue() unschedules the loop only once the lanes are empty too,
+  // so it needs waking only if it is going to sleep.
+  if (is_ready_for_scheduling_ &&
+      (always_schedule_work_ || !message_loop_scheduled_)) {
+    ScheduleWork();
+  }
+  return true;
+}
+
 void IncomingTaskQueue::ScheduleWork() {
   DCHECK(is_ready_for_scheduling_);
   // Wake up the message loop.
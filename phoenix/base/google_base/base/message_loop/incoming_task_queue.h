@@ -5,10 +5,14 @@
 #ifndef BASE_MESSAGE_LOOP_INCOMING_TASK_QUEUE_H_
 #define BASE_MESSAGE_LOOP_INCOMING_TASK_QUEUE_H_
 
+#include <atomic>
+#include <deque>
+
 #include "base/base_export.h"
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
 #include "base/pending_task.h"
+#include "base/single_thread_task_runner.h"
 #include "base/synchronization/lock.h"
 #include "base/time/time.h"
 
@@ -39,6 +43,26 @@ class BASE_EXPORT IncomingTaskQueue
                           TimeDelta delay,
                           bool nestable);
 
+  // Appends a task to the lane of |priority|, PRIORITY_NORMAL is the same as
+  // AddToIncomingQueue() without delay.
+  bool AddToPriorityQueue(const tracked_objects::Location& from_here,
+                          const Closure& task,
+                          SingleThreadTaskRunner::Priority priority);
+
+  // Appends a task run by TakeIdleTask(), or by TakeUrgentTask() once
+  // |timeout| has passed if it is not zero.
+  bool AddToIdleQueue(const tracked_objects::Location& from_here,
+                      const SingleThreadTaskRunner::IdleTask& task,
+                      TimeDelta timeout);
+
+  // Takes the oldest high priority task, else a low priority task or an idle
+  // task that has waited too long. Called by the loop before each task from
+  // the work queue, it does not lock while the lanes are empty.
+  bool TakeUrgentTask(PendingTask* pending_task);
+
+  // Takes the oldest idle task bound to |deadline|.
+  bool TakeIdleTask(TimeTicks deadline, PendingTask* pending_task);
+
   // Returns true if the queue contains tasks that require higher than default
   // timer resolution. Currently only needed for Windows.
   bool HasHighResolutionTasks();
@@ -46,9 +70,13 @@ class BASE_EXPORT IncomingTaskQueue
   // Returns true if the message loop is "idle". Provided for testing.
   bool IsIdleForTesting();
 
-  // Loads tasks from the |incoming_queue_| into |*work_queue|. Must be called
-  // from the thread that is running the loop. Returns the number of tasks that
-  // require high resolution timers.
+  // Returns the number of tasks in |incoming_queue_|.
+  size_t GetIncomingTaskCount();
+
+  // Loads tasks from the |incoming_queue_| into |*work_queue|, or the next
+  // task of the lanes when it is empty. Must be called from the thread that is
+  // running the loop. Returns the number of tasks that require high
+  // resolution timers.
   int ReloadWorkQueue(TaskQueue* work_queue);
 
   // Disconnects |this| from the parent message loop.
@@ -71,9 +99,20 @@ class BASE_EXPORT IncomingTaskQueue
   // does not retain |pending_task->task| beyond this function call.
   bool PostPendingTask(PendingTask* pending_task);
 
+  // Adds a task to |lane| the same way as PostPendingTask().
+  bool PostLaneTask(PendingTask* pending_task, TaskQueue* lane);
+
   // Wakes up the message loop and schedules work.
   void ScheduleWork();
 
+  struct IdleTaskEntry {
+    tracked_objects::Location posted_from;
+    SingleThreadTaskRunner::IdleTask task;
+    TimeTicks queue_time;
+    // Null if the task waits for an idle period forever.
+    TimeTicks timeout_time;
+  };
+
   // Number of tasks that require high resolution timing. This value is kept
   // so that ReloadWorkQueue() completes in constant time.
   int high_res_task_count_;
@@ -86,6 +125,16 @@ class BASE_EXPORT IncomingTaskQueue
   // |message_loop_|.
   TaskQueue incoming_queue_;
 
+  // The lanes of SingleThreadTaskRunner::PostPriorityTask() and the idle
+  // tasks, also protected by |incoming_queue_lock_|.
+  TaskQueue high_priority_queue_;
+  TaskQueue low_priority_queue_;
+  std::deque<IdleTaskEntry> idle_queue_;
+
+  // The tasks TakeUrgentTask() may return: the lane tasks and the idle tasks
+  // with a timeout. Read without the lock as a hint.
+  std::atomic<int> urgent_candidate_count_;
+
   // Points to the message loop that owns |this|.
   MessageLoop* message_loop_;
 
@@ -372,6 +372,11 @@ bool MessageLoop::IsIdleForTesting() {
   return incoming_task_queue_->IsIdleForTesting();
 }
 
+size_t MessageLoop::GetPendingTaskCount() {
+  DCHECK_EQ(this, current());
+  return work_queue_.size() + incoming_task_queue_->GetIncomingTaskCount();
+}
+
 //------------------------------------------------------------------------------
 
 // static
@@ -591,24 +596,31 @@ bool MessageLoop::DoWork() {
   }
 
   for (;;) {
+    // High priority tasks, and the low priority or idle tasks that waited too
+    // long, go before the work queue.
+    PendingTask urgent_task(FROM_HERE, Closure());
+    if (incoming_task_queue_->TakeUrgentTask(&urgent_task)) {
+      if (DeferOrRunPendingTask(urgent_task))
+        return true;
+      continue;
+    }
+
     ReloadWorkQueue();
     if (work_queue_.empty())
       break;
 
     // Execute oldest task.
-    do {
-      PendingTask pending_task = work_queue_.front();
-      work_queue_.pop();
-      if (!pending_task.delayed_run_time.is_null()) {
-        AddToDelayedWorkQueue(pending_task);
-        // If we changed the topmost task, then it is time to reschedule.
-        if (delayed_work_queue_.top().task.Equals(pending_task.task))
-          pump_->ScheduleDelayedWork(pending_task.delayed_run_time);
-      } else {
-        if (DeferOrRunPendingTask(pending_task))
-          return true;
-      }
-    } while (!work_queue_.empty());
+    PendingTask pending_task = work_queue_.front();
+    work_queue_.pop();
+    if (!pending_task.delayed_run_time.is_null()) {
+      AddToDelayedWorkQueue(pending_task);
+      // If we changed the topmost task, then it is time to reschedule.
+      if (delayed_work_queue_.top().task.Equals(pending_task.task))
+        pump_->ScheduleDelayedWork(pending_task.delayed_run_time);
+    } else {
+      if (DeferOrRunPendingTask(pending_task))
+        return true;
+    }
   }
 
   // Nothing happened.
@@ -650,6 +662,20 @@ bool MessageLoop::DoIdleWork() {
   if (ProcessNextDelayedNonNestableTask())
     return true;
 
+  if (nestable_tasks_allowed_) {
+    // The idle period ends at the next delayed task.
+    TimeTicks deadline = TimeTicks::Now() + TimeDelta::FromMilliseconds(
+        SingleThreadTaskRunner::kMaxIdlePeriodMs);
+    if (!delayed_work_queue_.empty() &&
+        delayed_work_queue_.top().delayed_run_time < deadline)
+      deadline = delayed_work_queue_.top().delayed_run_time;
+    PendingTask idle_task(FROM_HERE, Closure());
+    if (incoming_task_queue_->TakeIdleTask(deadline, &idle_task)) {
+      RunTask(idle_task);
+      return true;
+    }
+  }
+
   if (run_loop_->quit_when_idle_received_)
     pump_->Quit();
 
@@ -387,6 +387,11 @@ class BASE_EXPORT MessageLoop : public MessagePump::Delegate {
   // Returns true if the message loop is "idle". Provided for testing.
   bool IsIdleForTesting();
 
+  // Returns the number of posted tasks that are ready to run but have not run
+  // yet, not counting delayed tasks still waiting for their run time. Can only
+  // be called from the thread that owns the MessageLoop.
+  size_t GetPendingTaskCount();
+
   // Returns the TaskAnnotator which is used to add debug information to posted
   // tasks.
   debug::TaskAnnotator* task_annotator() { return &task_annotator_; }
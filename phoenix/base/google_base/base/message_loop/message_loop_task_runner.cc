@@ -38,6 +38,22 @@ bool MessageLoopTaskRunner::PostNonNestableDelayedTask(
   return incoming_queue_->AddToIncomingQueue(from_here, task, delay, false);
 }
 
+bool MessageLoopTaskRunner::PostPriorityTask(
+    const tracked_objects::Location& from_here,
+    const base::Closure& task,
+    Priority priority) {
+  DCHECK(!task.is_null()) << from_here.ToString();
+  return incoming_queue_->AddToPriorityQueue(from_here, task, priority);
+}
+
+bool MessageLoopTaskRunner::PostIdleTask(
+    const tracked_objects::Location& from_here,
+    const IdleTask& task,
+    base::TimeDelta timeout) {
+  DCHECK(!task.is_null()) << from_here.ToString();
+  return incoming_queue_->AddToIdleQueue(from_here, task, timeout);
+}
+
 bool MessageLoopTaskRunner::RunsTasksOnCurrentThread() const {
   AutoLock lock(valid_thread_id_lock_);
   return valid_thread_id_ == PlatformThread::CurrentId();
@@ -37,6 +37,12 @@ class BASE_EXPORT MessageLoopTaskRunner : public SingleThreadTaskRunner {
                                   const base::Closure& task,
                                   base::TimeDelta delay) override;
   bool RunsTasksOnCurrentThread() const override;
+  bool PostPriorityTask(const tracked_objects::Location& from_here,
+                        const base::Closure& task,
+                        Priority priority) override;
+  bool PostIdleTask(const tracked_objects::Location& from_here,
+                    const IdleTask& task,
+                    base::TimeDelta timeout) override;
 
  private:
   friend class RefCountedThreadSafe<MessageLoopTaskRunner>;
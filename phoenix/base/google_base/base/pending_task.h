@@ -38,6 +38,10 @@ struct BASE_EXPORT PendingTask : public TrackingInfo {
   // Secondary sort key for run time.
   int sequence_num;
 
+  // Time this PendingTask was posted, used to measure how long it waited in
+  // the queue. Null for tasks that did not go through the incoming queue.
+  TimeTicks queue_time;
+
   // OK to dispatch from a nested loop.
   bool nestable;
 
@@ -0,0 +1,34 @@
+// Copyright (c) 2012 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/single_thread_task_runner.h"
+
+#include "base/bind.h"
+#include "base/location.h"
+
+namespace base {
+
+namespace {
+
+void RunIdleTaskWithoutIdlePeriod(const SingleThreadTaskRunner::IdleTask& task) {
+  task.Run(TimeTicks::Now());
+}
+
+}  // namespace
+
+bool SingleThreadTaskRunner::PostPriorityTask(
+    const tracked_objects::Location& from_here,
+    const Closure& task,
+    Priority priority) {
+  return PostTask(from_here, task);
+}
+
+bool SingleThreadTaskRunner::PostIdleTask(
+    const tracked_objects::Location& from_here,
+    const IdleTask& task,
+    TimeDelta timeout) {
+  return PostTask(from_here, Bind(&RunIdleTaskWithoutIdlePeriod, task));
+}
+
+}  // namespace base
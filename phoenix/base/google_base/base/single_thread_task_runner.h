@@ -6,7 +6,9 @@
 #define BASE_SINGLE_THREAD_TASK_RUNNER_H_
 
 #include "base/base_export.h"
+#include "base/callback_forward.h"
 #include "base/sequenced_task_runner.h"
+#include "base/time/time.h"
 
 namespace base {
 
@@ -24,11 +26,45 @@ namespace base {
 //     running other kinds of message loop, e.g. Jingle threads.
 class BASE_EXPORT SingleThreadTaskRunner : public SequencedTaskRunner {
  public:
+  // The lanes of PostPriorityTask(). Tasks of a lane run in posting order.
+  enum Priority {
+    // Runs before the tasks already queued on the thread.
+    PRIORITY_HIGH,
+    // The same as PostTask().
+    PRIORITY_NORMAL,
+    // Runs when no other task is pending, or after waiting
+    // kLowPriorityMaxDelayMs at the latest so it is never starved.
+    PRIORITY_LOW,
+  };
+  static const int kLowPriorityMaxDelayMs = 1000;
+  // The longest idle period given to an idle task.
+  static const int kMaxIdlePeriodMs = 50;
+
+  // Called with the time the idle task should return by. A long chore
+  // should do a slice of its work and post itself again.
+  typedef Callback<void(TimeTicks deadline)> IdleTask;
+
   // A more explicit alias to RunsTasksOnCurrentThread().
   bool BelongsToCurrentThread() const {
     return RunsTasksOnCurrentThread();
   }
 
+  // Posts |task| to the lane of |priority|. Runners without lanes, the
+  // default, post it as a regular task.
+  virtual bool PostPriorityTask(const tracked_objects::Location& from_here,
+                                const Closure& task,
+                                Priority priority);
+
+  // Posts |task| to run when the thread has no pending work, with at most
+  // kMaxIdlePeriodMs to its deadline and never past the next delayed task.
+  // If the thread is not idle within |timeout| it runs anyway with the
+  // deadline already reached; a zero |timeout| waits forever. Runners
+  // without an idle queue, the default, post it as a regular task with no
+  // idle time.
+  virtual bool PostIdleTask(const tracked_objects::Location& from_here,
+                            const IdleTask& task,
+                            TimeDelta timeout);
+
  protected:
   ~SingleThreadTaskRunner() override {}
 };
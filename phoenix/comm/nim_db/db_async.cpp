@@ -0,0 +1,163 @@
+// Async SQLite database on a dedicated thread
+
+#include "nim_db/db_async.h"
+#include <future>
+#include "base/thread_task_runner_handle.h"
+#include "extension/thread/framework_thread.h"
+#include "extension/thread/thread_manager.h"
+#include "extension/callback/post_task.h"
+#include "extension/memory/memory_trimmer.h"
+
+DB_BEGIN_DECLS
+
+AsyncSQLiteDB::AsyncSQLiteDB(int64_t thread_identifier, const std::string& thread_name)
+	: thread_identifier_(thread_identifier), thread_name_(thread_name), next_sequence_(0), memory_trim_id_(0)
+{
+}
+
+AsyncSQLiteDB::~AsyncSQLiteDB()
+{
+	Close();
+}
+
+bool AsyncSQLiteDB::Open(const char* filename,
+	const std::string &key,
+	int flags/* = SQLiteDB::modeReadWrite|SQLiteDB::modeCreate|SQLiteDB::modeMultiThread*/)
+{
+	Close();
+
+	if (filename == NULL)
+		return false;
+
+	// 数据库线程做的是不紧急的持久化，降级以免和网络、界面线程抢核
+	NS_EXTENSION::FrameworkThreadOptions options;
+	options.qos = NS_EXTENSION::ThreadQoS::kUtility;
+	thread_.reset(NS_EXTENSION::ThreadManager::CreateFrameworkThread(thread_identifier_, thread_name_, options));
+	if (!thread_->Start())
+	{
+		thread_.reset();
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		task_runner_ = thread_->task_runner();
+	}
+
+	std::string path(filename);
+	std::promise<bool> opened;
+	std::future<bool> result = opened.get_future();
+	PostTask(kPriorityHigh, [&](SQLiteDB* db) {
+		opened.set_value(db->Open(path.c_str(), key, flags));
+	});
+	if (!result.get())
+	{
+		Close();
+		return false;
+	}
+
+	// 连接只能在数据库线程上使用，释放内存也投递过去
+	memory_trim_id_ = NS_EXTENSION::MemoryTrimmer::Register("nim_db.async." + thread_name_,
+		[this](NS_EXTENSION::MemoryTrimLevel level) {
+			bool clear_statements = (level == NS_EXTENSION::kMemoryTrimCritical);
+			PostTask(kPriorityNormal, [clear_statements](SQLiteDB* db) {
+				db->ReleaseMemory(clear_statements);
+			});
+		});
+	return true;
+}
+
+void AsyncSQLiteDB::Close()
+{
+	if (!thread_)
+		return;
+
+	if (memory_trim_id_ != 0)
+	{
+		NS_EXTENSION::MemoryTrimmer::Unregister(memory_trim_id_);
+		memory_trim_id_ = 0;
+	}
+	// 取走task_runner_之后其他线程的PostTask都会失败，关闭任务优先级最低，排在所有已投递的任务之后
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		task_runner.swap(task_runner_);
+		PushTaskLocked(kPriorityLow, [](SQLiteDB* db) {
+			db->Close();
+		});
+	}
+	if (task_runner != nullptr)
+		PostRunNextTask(task_runner);
+	thread_->Stop();
+	thread_.reset();
+}
+
+bool AsyncSQLiteDB::IsRunning() const
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	return task_runner_ != nullptr;
+}
+
+bool AsyncSQLiteDB::PostTask(TaskPriority priority, const Task& task)
+{
+	if (!task)
+		return false;
+
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (task_runner_ == nullptr)
+			return false;
+		task_runner = task_runner_;
+		PushTaskLocked(priority, task);
+	}
+	return PostRunNextTask(task_runner);
+}
+
+void AsyncSQLiteDB::PushTaskLocked(TaskPriority priority, const Task& task)
+{
+	PendingTask pending;
+	pending.priority = priority;
+	pending.sequence = next_sequence_++;
+	pending.task     = task;
+	tasks_.push(pending);
+}
+
+bool AsyncSQLiteDB::PostRunNextTask(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner)
+{
+	// 每个任务投递一次RunNextTask，执行时再从队列中取优先级最高的任务
+	return NS_EXTENSION::PostTask(task_runner.get(), FROM_HERE, [this]() {
+		RunNextTask();
+	});
+}
+
+bool AsyncSQLiteDB::PostTaskAndReply(TaskPriority priority, const Task& task, const StdClosure& reply)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> reply_runner;
+	if (base::ThreadTaskRunnerHandle::IsSet())
+		reply_runner = base::ThreadTaskRunnerHandle::Get();
+
+	return PostTask(priority, [task, reply, reply_runner](SQLiteDB* db) {
+		task(db);
+		if (!reply)
+			return;
+		if (reply_runner != nullptr)
+			NS_EXTENSION::PostTask(reply_runner.get(), FROM_HERE, reply);
+		else
+			reply();
+	});
+}
+
+void AsyncSQLiteDB::RunNextTask()
+{
+	Task task;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (tasks_.empty())
+			return;
+		task = tasks_.top().task;
+		tasks_.pop();
+	}
+	task(&db_);
+}
+
+DB_END_DECLS
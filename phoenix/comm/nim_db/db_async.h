@@ -0,0 +1,123 @@
+#ifndef __BASE_DB_ASYNC_H__
+#define __BASE_DB_ASYNC_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include "base/single_thread_task_runner.h"
+#include "extension/config/build_config.h"
+#include "extension/callback/callback.h"
+
+EXTENSION_BEGIN_DECLS
+class FrameworkThread;
+EXTENSION_END_DECLS
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Run all the operations of one database on a dedicated thread
+    *  Remark      The thread is a FrameworkThread registered in ThreadManager with thread_identifier,
+    *              the SQLiteDB is opened, used and closed only on it, so no mutex is needed around it.
+    *              Queued tasks run by priority, a higher priority task (e.g. a UI query) posted later
+    *              runs before the lower priority ones (e.g. background writes) still waiting.
+    *              Tasks of the same priority run in posting order.
+    *              Under memory pressure (NS_EXTENSION::MemoryTrimmer) the page cache is released on the
+    *              database thread, the cached statements too at kMemoryTrimCritical.
+    */
+class DB_EXPORT AsyncSQLiteDB
+{
+public:
+
+    enum TaskPriority
+    {
+        kPriorityLow = 0,       // Background writes, cleanup
+        kPriorityNormal,
+        kPriorityHigh,          // Interactive queries
+    };
+
+    typedef std::function<void(SQLiteDB* db)> Task;
+
+    AsyncSQLiteDB(int64_t thread_identifier, const std::string& thread_name);
+    virtual ~AsyncSQLiteDB();
+
+    /*
+        *  Purpose     Start the thread and open the database on it, return after the database is opened
+        *  Remark      Parameters are the same as SQLiteDB::Open
+        */
+    bool Open(const char* filename,
+              const std::string &key,
+              int flags = SQLiteDB::modeReadWrite|SQLiteDB::modeCreate|SQLiteDB::modeMultiThread);
+
+    /*
+        *  Purpose     Run the queued tasks, close the database and stop the thread
+        *  Remark      PostTask from other threads fails once Close has begun
+        */
+    void Close();
+
+    bool IsRunning() const;
+
+    /*
+        *  Purpose     Run task on the database thread
+        */
+    bool PostTask(TaskPriority priority, const Task& task);
+
+    /*
+        *  Purpose     Run task on the database thread, then run reply on the calling thread
+        *  Remark      The calling thread must have a message loop, otherwise reply runs on the database thread
+        */
+    bool PostTaskAndReply(TaskPriority priority, const Task& task, const StdClosure& reply);
+
+    /*
+        *  Purpose     Run task on the database thread, then pass its result to reply on the calling thread
+        */
+    template<typename R>
+    bool PostTaskAndReplyWithResult(TaskPriority priority,
+                                    const std::function<R(SQLiteDB* db)>& task,
+                                    const std::function<void(const R& result)>& reply)
+    {
+        std::shared_ptr<R> result = std::make_shared<R>();
+        return PostTaskAndReply(priority,
+            [task, result](SQLiteDB* db) { *result = task(db); },
+            [reply, result]() { if (reply) reply(*result); });
+    }
+
+private:
+
+    struct PendingTask
+    {
+        TaskPriority    priority;
+        uint64_t        sequence;
+        Task            task;
+
+        bool operator<(const PendingTask& other) const
+        {
+            // priority_queue先取出最大的元素：优先级高的在前，同优先级的先投递的在前
+            if (priority != other.priority)
+                return priority < other.priority;
+            return sequence > other.sequence;
+        }
+    };
+
+    AsyncSQLiteDB(const AsyncSQLiteDB&);
+    AsyncSQLiteDB& operator=(const AsyncSQLiteDB&);
+
+    // 需持有mutex_
+    void PushTaskLocked(TaskPriority priority, const Task& task);
+    bool PostRunNextTask(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner);
+    void RunNextTask();
+
+    int64_t                                             thread_identifier_;
+    std::string                                         thread_name_;
+    std::unique_ptr<NS_EXTENSION::FrameworkThread>      thread_;
+    scoped_refptr<base::SingleThreadTaskRunner>         task_runner_;       // Close开始时置空，之后不再接受任务
+    SQLiteDB                                            db_;                // 只在数据库线程上访问
+    mutable std::mutex                                  mutex_;             // 保护task_runner_/tasks_/next_sequence_
+    std::priority_queue<PendingTask>                    tasks_;
+    uint64_t                                            next_sequence_;
+    int                                                 memory_trim_id_;    // NS_EXTENSION::MemoryTrimmer
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_ASYNC_H__
@@ -0,0 +1,93 @@
+// SQLite online backup
+
+#include "nim_db/db_backup.h"
+#include <thread>
+#include <chrono>
+
+DB_BEGIN_DECLS
+
+SQLiteBackup::SQLiteBackup()
+{
+	backup_ = NULL;
+}
+
+SQLiteBackup::~SQLiteBackup()
+{
+	Finish();
+}
+
+bool SQLiteBackup::Begin(SQLiteDB* source, const char* dest_path, const std::string& key)
+{
+	Finish();
+
+	if (source == NULL || !source->IsValid() || dest_path == NULL)
+		return false;
+
+	if (!dest_.Open(dest_path, key, SQLiteDB::modeReadWrite | SQLiteDB::modeCreate | SQLiteDB::modeMultiThread))
+		return false;
+
+	backup_ = sqlite3_backup_init(dest_.sqlite3_, "main", source->sqlite3_, "main");
+	if (backup_ == NULL)
+	{
+		dest_.Close();
+		return false;
+	}
+	return true;
+}
+
+int SQLiteBackup::Step(int pages)
+{
+	if (backup_ == NULL)
+		return SQLITE_MISUSE;
+	return sqlite3_backup_step(backup_, pages);
+}
+
+int SQLiteBackup::Run(int pages_per_step/* = 64*/, int step_interval_ms/* = 10*/, const std::atomic_bool* cancel/* = NULL*/)
+{
+	if (backup_ == NULL)
+		return SQLITE_MISUSE;
+
+	for (;;)
+	{
+		if (cancel != NULL && *cancel)
+			return SQLITE_INTERRUPT;
+
+		int r = Step(pages_per_step);
+		if (r == SQLITE_DONE)
+			return r;
+		if (r != SQLITE_OK && r != SQLITE_BUSY && r != SQLITE_LOCKED)
+			return r;
+
+		// 每步之间让出数据库，写操作不会被整个备份过程阻塞
+		if (step_interval_ms > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(step_interval_ms));
+	}
+}
+
+int SQLiteBackup::Finish()
+{
+	int r = SQLITE_OK;
+	if (backup_ != NULL)
+	{
+		r = sqlite3_backup_finish(backup_);
+		backup_ = NULL;
+	}
+	dest_.Close();
+	return r;
+}
+
+int SQLiteBackup::GetRemainingPages() const
+{
+	if (backup_ == NULL)
+		return 0;
+	return sqlite3_backup_remaining(backup_);
+}
+
+int SQLiteBackup::GetTotalPages() const
+{
+	if (backup_ == NULL)
+		return 0;
+	return sqlite3_backup_pagecount(backup_);
+}
+
+DB_END_DECLS
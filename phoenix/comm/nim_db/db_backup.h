@@ -0,0 +1,65 @@
+#ifndef __BASE_DB_BACKUP_H__
+#define __BASE_DB_BACKUP_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <atomic>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Online backup by sqlite3_backup API
+    *  Remark      The source database is locked only while a step is copying pages, so other
+    *              connections and threads can read and write between steps. If the source is
+    *              written by another connection during the backup, SQLite restarts the backup
+    *              automatically on the next step.
+    */
+class DB_EXPORT SQLiteBackup
+{
+public:
+
+    SQLiteBackup();
+    virtual ~SQLiteBackup();
+
+    /*
+        *  Purpose     Open/Create the destination file and prepare to copy the main database of source
+        *  source      Opened source database, it must be valid until the backup finished
+        *  dest_path   Destination file, its content is replaced
+        *  key         Encrypt key of the destination, see SQLiteDB::Open
+        */
+    bool Begin(SQLiteDB* source, const char* dest_path, const std::string& key);
+
+    /*
+        *  Purpose     Copy up to pages pages
+        *  Return      SQLITE_OK means there are more pages to copy
+        *              SQLITE_DONE means the backup is finished
+        *              SQLITE_BUSY/SQLITE_LOCKED means the step should be retried later
+        *              other value means the backup failed
+        */
+    int Step(int pages);
+
+    /*
+        *  Purpose     Run Step until finished, sleep step_interval_ms after every step
+        *  cancel      Stop the backup when it becomes true, can be NULL
+        *  Return      SQLITE_DONE if finished, SQLITE_INTERRUPT if canceled, otherwise the error code
+        */
+    int Run(int pages_per_step = 64, int step_interval_ms = 10, const std::atomic_bool* cancel = NULL);
+
+    /*
+        *  Purpose     Release the backup, the destination is closed
+        */
+    int Finish();
+
+    int GetRemainingPages() const;
+    int GetTotalPages() const;
+
+private:
+
+    SQLiteBackup(const SQLiteBackup&);
+    SQLiteBackup& operator=(const SQLiteBackup&);
+
+    SQLiteDB        dest_;
+    sqlite3_backup* backup_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_BACKUP_H__
@@ -0,0 +1,207 @@
+// Write-behind queue with group commit
+
+#include "nim_db/db_batch_writer.h"
+#include <algorithm>
+#include "extension/thread/power_scheduler.h"
+#include "extension/thread/thread_manager.h"
+
+DB_BEGIN_DECLS
+
+SQLiteBatchWriter::SQLiteBatchWriter(SQLiteDB* db)
+{
+	db_              = db;
+	max_batch_rows_  = 500;
+	max_delay_ms_    = 50;
+	posted_count_    = 0;
+	committed_count_ = 0;
+	flush_count_     = 0;
+	running_         = false;
+	stopping_        = false;
+	shutdown_flush_id_ = 0;
+	delay_factor_    = 1;
+	power_observer_id_ = 0;
+}
+
+SQLiteBatchWriter::~SQLiteBatchWriter()
+{
+	Stop();
+}
+
+bool SQLiteBatchWriter::Start(size_t max_batch_rows/* = 500*/, int max_delay_ms/* = 50*/)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (running_ || db_ == NULL || !db_->IsValid())
+		return false;
+
+	max_batch_rows_ = max_batch_rows == 0 ? 1 : max_batch_rows;
+	max_delay_ms_   = max_delay_ms < 0 ? 0 : max_delay_ms;
+	stopping_       = false;
+	running_        = true;
+	thread_         = std::thread(&SQLiteBatchWriter::Run, this);
+	// 退出时和其他组件同时提交队列中的修改
+	shutdown_flush_id_ = NS_EXTENSION::ThreadManager::RegisterShutdownFlush("nim_db.batch_writer",
+		NS_EXTENSION::TimeDelta::FromMilliseconds(1000), [this]() { Flush(); });
+	// 先注册再读取状态，其间的切换由通知在释放锁后覆盖
+	NS_EXTENSION::PowerScheduler* power_scheduler = NS_EXTENSION::PowerScheduler::GetInstance();
+	power_observer_id_ = power_scheduler->AddObserver([this](bool background) { OnPowerModeChanged(background); });
+	delay_factor_ = 1;
+	if (NS_EXTENSION::PowerScheduler::IsBackground())
+		delay_factor_ = std::max(power_scheduler->GetPolicy().db_batch_delay_factor, 1);
+	return true;
+}
+
+void SQLiteBatchWriter::Stop()
+{
+	// 等待正在执行的 flush 返回，之后不会再调用 Flush
+	if (shutdown_flush_id_ != 0)
+	{
+		NS_EXTENSION::ThreadManager::UnregisterShutdownFlush(shutdown_flush_id_);
+		shutdown_flush_id_ = 0;
+	}
+	// 等待正在执行的切换通知返回
+	if (power_observer_id_ != 0)
+	{
+		NS_EXTENSION::PowerScheduler::GetInstance()->RemoveObserver(power_observer_id_);
+		power_observer_id_ = 0;
+	}
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (!running_)
+			return;
+		stopping_ = true;
+	}
+	queue_cond_.notify_one();
+	thread_.join();
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	running_ = false;
+}
+
+bool SQLiteBatchWriter::Post(const Mutation& mutation, const CompletionCallback& callback)
+{
+	if (!mutation)
+		return false;
+
+	bool notify = false;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (!running_ || stopping_)
+			return false;
+
+		PendingMutation pending;
+		pending.mutation  = mutation;
+		pending.callback  = callback;
+		pending.post_time = std::chrono::steady_clock::now();
+		queue_.push_back(pending);
+		posted_count_++;
+		// 只在队列从空变为非空或攒够一批时唤醒写线程
+		notify = queue_.size() == 1 || queue_.size() >= max_batch_rows_;
+	}
+	if (notify)
+		queue_cond_.notify_one();
+	return true;
+}
+
+void SQLiteBatchWriter::Flush()
+{
+	std::unique_lock<std::mutex> auto_lock(mutex_);
+	if (!running_)
+		return;
+
+	uint64_t target = posted_count_;
+	flush_count_ = target;
+	queue_cond_.notify_one();
+	committed_cond_.wait(auto_lock, [this, target]() { return committed_count_ >= target || !running_; });
+}
+
+void SQLiteBatchWriter::Run()
+{
+	std::deque<PendingMutation> batch;
+	std::unique_lock<std::mutex> auto_lock(mutex_);
+	for (;;)
+	{
+		if (queue_.empty())
+		{
+			if (stopping_)
+				break;
+			queue_cond_.wait(auto_lock);
+			continue;
+		}
+
+		// 攒够一批、最早的任务等待超时、需要立即提交或正在停止时提交
+		std::chrono::steady_clock::time_point deadline =
+			queue_.front().post_time + std::chrono::milliseconds((int64_t)max_delay_ms_ * delay_factor_);
+		bool ready = queue_.size() >= max_batch_rows_ ||
+			flush_count_ > committed_count_ ||
+			stopping_ ||
+			std::chrono::steady_clock::now() >= deadline;
+		if (!ready)
+		{
+			queue_cond_.wait_until(auto_lock, deadline);
+			continue;
+		}
+
+		size_t count = queue_.size() < max_batch_rows_ ? queue_.size() : max_batch_rows_;
+		batch.assign(queue_.begin(), queue_.begin() + count);
+		queue_.erase(queue_.begin(), queue_.begin() + count);
+
+		auto_lock.unlock();
+		CommitBatch(batch);
+		batch.clear();
+		auto_lock.lock();
+
+		committed_count_ += count;
+		committed_cond_.notify_all();
+	}
+}
+
+void SQLiteBatchWriter::OnPowerModeChanged(bool background)
+{
+	int factor = background ? std::max(NS_EXTENSION::PowerScheduler::GetInstance()->GetPolicy().db_batch_delay_factor, 1) : 1;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		delay_factor_ = factor;
+	}
+	// 回到前台时已经等得足够久的批次立即提交
+	queue_cond_.notify_one();
+}
+
+void SQLiteBatchWriter::CommitBatch(std::deque<PendingMutation>& batch)
+{
+	std::vector<int> results(batch.size(), SQLITE_OK);
+	int commit_result = SQLITE_OK;
+	{
+		SQLiteAutoTransaction transaction(db_);
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			// 每个任务使用单独的保存点，失败时只回滚它自己
+			if (db_->Query("SAVEPOINT batch_mutation") != SQLITE_OK)
+			{
+				results[i] = db_->GetLastErrorCode();
+				continue;
+			}
+			results[i] = batch[i].mutation(db_);
+			if (results[i] != SQLITE_OK && results[i] != SQLITE_DONE && results[i] != SQLITE_ROW)
+				db_->Query("ROLLBACK TO batch_mutation");
+			else
+				results[i] = SQLITE_OK;
+			db_->Query("RELEASE batch_mutation");
+		}
+		if (!transaction.Commit())
+		{
+			commit_result = db_->GetLastErrorCode();
+			if (commit_result == SQLITE_OK)
+				commit_result = SQLITE_ERROR;
+			transaction.Rollback();
+		}
+	}
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (!batch[i].callback)
+			continue;
+		batch[i].callback(commit_result != SQLITE_OK ? commit_result : results[i]);
+	}
+}
+
+DB_END_DECLS
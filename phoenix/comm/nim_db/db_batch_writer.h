@@ -0,0 +1,105 @@
+#ifndef __BASE_DB_BATCH_WRITER_H__
+#define __BASE_DB_BATCH_WRITER_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Write-behind queue with group commit
+    *  Remark      Mutations posted from any thread are queued and executed on the writer thread,
+    *              and every max_batch_rows mutations or max_delay_ms milliseconds they are committed
+    *              in one transaction, so a batch costs one fsync instead of one per row.
+    *              Every mutation runs in its own savepoint, a failed mutation is rolled back alone
+    *              and does not affect the others in the batch.
+    *              The database must not be used by other threads while the writer is running.
+    *              While the app is in background (NS_EXTENSION::PowerScheduler) max_delay_ms is multiplied
+    *              by PowerPolicy::db_batch_delay_factor, so the writer wakes up less often.
+    */
+class DB_EXPORT SQLiteBatchWriter
+{
+public:
+
+    /*
+        *  Purpose     A row mutation executed on the writer thread, return a SQLite result code
+        */
+    typedef std::function<int(SQLiteDB* db)> Mutation;
+
+    /*
+        *  Purpose     Called on the writer thread after the batch is committed
+        *  result      SQLITE_OK if the mutation is committed, otherwise the error of the mutation or the commit
+        */
+    typedef std::function<void(int result)> CompletionCallback;
+
+    SQLiteBatchWriter(SQLiteDB* db);
+    virtual ~SQLiteBatchWriter();
+
+    /*
+        *  Purpose     Start the writer thread
+        *  max_batch_rows  Commit when so many mutations are queued
+        *  max_delay_ms    Commit when the oldest queued mutation has waited so long
+        */
+    bool Start(size_t max_batch_rows = 500, int max_delay_ms = 50);
+
+    /*
+        *  Purpose     Commit all the queued mutations and stop the writer thread
+        */
+    void Stop();
+
+    bool IsRunning() const { return running_; }
+
+    /*
+        *  Purpose     Queue a mutation, return false if the writer is not running
+        */
+    bool Post(const Mutation& mutation, const CompletionCallback& callback = CompletionCallback());
+
+    /*
+        *  Purpose     Commit the mutations queued before now without waiting for the batch limits,
+        *              and wait until they are committed
+        *  Remark      Do not call it in a CompletionCallback
+        */
+    void Flush();
+
+private:
+
+    struct PendingMutation
+    {
+        Mutation                            mutation;
+        CompletionCallback                  callback;
+        std::chrono::steady_clock::time_point post_time;
+    };
+
+    SQLiteBatchWriter(const SQLiteBatchWriter&);
+    SQLiteBatchWriter& operator=(const SQLiteBatchWriter&);
+
+    void Run();
+    void CommitBatch(std::deque<PendingMutation>& batch);
+    void OnPowerModeChanged(bool background);
+
+    SQLiteDB*                   db_;
+    size_t                      max_batch_rows_;
+    int                         max_delay_ms_;
+    std::thread                 thread_;
+    std::mutex                  mutex_;             // 保护以下成员
+    std::condition_variable     queue_cond_;        // 有新的任务或需要立即提交
+    std::condition_variable     committed_cond_;    // 一批提交完成
+    std::deque<PendingMutation> queue_;
+    uint64_t                    posted_count_;
+    uint64_t                    committed_count_;
+    uint64_t                    flush_count_;       // 序号不大于它的任务需要立即提交
+    bool                        running_;
+    bool                        stopping_;
+    int                         shutdown_flush_id_; // ThreadManager::RegisterShutdownFlush 返回的id
+    int                         delay_factor_;      // 后台时放大 max_delay_ms_ 的倍数，前台为1
+    int                         power_observer_id_; // PowerScheduler::AddObserver 返回的id
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_BATCH_WRITER_H__
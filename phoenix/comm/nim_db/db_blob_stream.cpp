@@ -0,0 +1,187 @@
+// SQLite incremental blob I/O
+
+#include "nim_db/db_blob_stream.h"
+#include <algorithm>
+#include <vector>
+
+DB_BEGIN_DECLS
+
+SQLiteBlobStream::SQLiteBlobStream()
+{
+	blob_ = NULL;
+	position_ = 0;
+}
+
+SQLiteBlobStream::~SQLiteBlobStream()
+{
+	Close();
+}
+
+int SQLiteBlobStream::Open(SQLiteDB* db, const char* table, const char* column, sqlite3_int64 rowid,
+						   bool writable, const char* db_name/* = "main"*/)
+{
+	Close();
+
+	if (db == NULL || !db->IsValid() || table == NULL || column == NULL)
+		return SQLITE_MISUSE;
+
+	int r = sqlite3_blob_open(db->sqlite3_, db_name != NULL ? db_name : "main", table, column,
+		rowid, writable ? 1 : 0, &blob_);
+	if (r != SQLITE_OK)
+	{
+		// 失败时 sqlite 也可能返回句柄，要释放
+		if (blob_ != NULL)
+			sqlite3_blob_close(blob_);
+		blob_ = NULL;
+	}
+	return r;
+}
+
+int SQLiteBlobStream::Reopen(sqlite3_int64 rowid)
+{
+	if (blob_ == NULL)
+		return SQLITE_MISUSE;
+
+	position_ = 0;
+	int r = sqlite3_blob_reopen(blob_, rowid);
+	// 失败后句柄不能再读写，只能关闭
+	if (r != SQLITE_OK)
+		Close();
+	return r;
+}
+
+int SQLiteBlobStream::Close()
+{
+	int r = SQLITE_OK;
+	if (blob_ != NULL)
+	{
+		r = sqlite3_blob_close(blob_);
+		blob_ = NULL;
+	}
+	position_ = 0;
+	return r;
+}
+
+int SQLiteBlobStream::GetSize() const
+{
+	if (blob_ == NULL)
+		return 0;
+	return sqlite3_blob_bytes(blob_);
+}
+
+int SQLiteBlobStream::Read(void* buffer, int size, int offset)
+{
+	if (blob_ == NULL || buffer == NULL || size < 0 || offset < 0)
+		return SQLITE_MISUSE;
+	if (size == 0)
+		return SQLITE_OK;
+	return sqlite3_blob_read(blob_, buffer, size, offset);
+}
+
+int SQLiteBlobStream::Write(const void* data, int size, int offset)
+{
+	if (blob_ == NULL || data == NULL || size < 0 || offset < 0)
+		return SQLITE_MISUSE;
+	if (size == 0)
+		return SQLITE_OK;
+	return sqlite3_blob_write(blob_, data, size, offset);
+}
+
+int SQLiteBlobStream::ReadNext(void* buffer, int size, int* bytes_read)
+{
+	if (bytes_read != NULL)
+		*bytes_read = 0;
+	if (blob_ == NULL || size < 0)
+		return SQLITE_MISUSE;
+
+	// 读到末尾时只读剩下的部分
+	int n = std::min(size, GetSize() - position_);
+	if (n <= 0)
+		return SQLITE_OK;
+	int r = Read(buffer, n, position_);
+	if (r != SQLITE_OK)
+		return r;
+	position_ += n;
+	if (bytes_read != NULL)
+		*bytes_read = n;
+	return SQLITE_OK;
+}
+
+int SQLiteBlobStream::WriteNext(const void* data, int size)
+{
+	int r = Write(data, size, position_);
+	if (r == SQLITE_OK)
+		position_ += size;
+	return r;
+}
+
+int SQLiteBlobStream::Seek(int position)
+{
+	if (blob_ == NULL || position < 0 || position > GetSize())
+		return SQLITE_MISUSE;
+	position_ = position;
+	return SQLITE_OK;
+}
+
+int SQLiteBlobStream::ReadChunks(const ChunkReader& reader, int offset/* = 0*/, int size/* = -1*/,
+								 int chunk_size/* = kDefaultChunkSize*/)
+{
+	if (blob_ == NULL || !reader || offset < 0 || chunk_size <= 0)
+		return SQLITE_MISUSE;
+
+	int blob_size = GetSize();
+	if (offset > blob_size)
+		return SQLITE_MISUSE;
+	int end = size < 0 ? blob_size : std::min(blob_size, offset + size);
+
+	// 缓冲区只按一块分配，大的 blob 也不会整个读进内存
+	std::vector<char> buffer(std::min(chunk_size, std::max(end - offset, 1)));
+	while (offset < end)
+	{
+		int n = std::min((int)buffer.size(), end - offset);
+		int r = Read(&buffer[0], n, offset);
+		if (r != SQLITE_OK)
+			return r;
+		if (!reader(&buffer[0], n))
+			return SQLITE_INTERRUPT;
+		offset += n;
+	}
+	return SQLITE_OK;
+}
+
+int SQLiteBlobStream::WriteChunks(const ChunkWriter& writer, int offset/* = 0*/, int* written/* = NULL*/,
+								  int chunk_size/* = kDefaultChunkSize*/)
+{
+	if (written != NULL)
+		*written = 0;
+	if (blob_ == NULL || !writer || offset < 0 || chunk_size <= 0)
+		return SQLITE_MISUSE;
+
+	int blob_size = GetSize();
+	if (offset > blob_size)
+		return SQLITE_MISUSE;
+
+	std::vector<char> buffer(chunk_size);
+	int total = 0;
+	for (;;)
+	{
+		int n = writer(&buffer[0], chunk_size);
+		if (n < 0)
+			return SQLITE_INTERRUPT;
+		if (n == 0)
+			return SQLITE_OK;
+		n = std::min(n, chunk_size);
+		// blob 的大小是固定的，超出的部分写不进去
+		if (n > blob_size - offset)
+			return SQLITE_FULL;
+		int r = Write(&buffer[0], n, offset);
+		if (r != SQLITE_OK)
+			return r;
+		offset += n;
+		total += n;
+		if (written != NULL)
+			*written = total;
+	}
+}
+
+DB_END_DECLS
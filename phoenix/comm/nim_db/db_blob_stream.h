@@ -0,0 +1,89 @@
+#ifndef __BASE_DB_BLOB_STREAM_H__
+#define __BASE_DB_BLOB_STREAM_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <functional>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Incremental I/O of a blob cell by sqlite3_blob API, so a large blob is read and written
+    *              in chunks instead of being loaded by SQLiteStatement::GetBlobField or bound whole
+    *  Remark      The size of a blob can not be changed by the stream. Preallocate it with
+    *              SQLiteStatement::BindZeroBlob or zeroblob(N) in SQL, then write it in chunks.
+    *              The stream is expired when its row is changed or deleted by a statement, Read and Write
+    *              then return SQLITE_ABORT and it has to be opened again.
+    *              The stream uses the connection of the database like a statement, it must be closed
+    *              before the database.
+    */
+class DB_EXPORT SQLiteBlobStream
+{
+public:
+
+    // Receives a chunk read, returns false to stop
+    using ChunkReader = std::function<bool(const void* data, int size)>;
+    // Fills up to size bytes, returns the bytes filled, 0 at the end or -1 to stop
+    using ChunkWriter = std::function<int(void* buffer, int size)>;
+
+    SQLiteBlobStream();
+    virtual ~SQLiteBlobStream();
+
+    /*
+        *  Purpose     Open the blob of column in the row rowid of table
+        *  db_name     "main", "temp" or the name of an attached database
+        */
+    int Open(SQLiteDB* db, const char* table, const char* column, sqlite3_int64 rowid,
+             bool writable, const char* db_name = "main");
+
+    /*
+        *  Purpose     Move to another row of the same column, faster than opening a new stream
+        *  Remark      The stream is closed if it fails, e.g. it is expired or the row does not exist
+        */
+    int Reopen(sqlite3_int64 rowid);
+    int Close();
+
+    bool IsValid() const { return blob_ != NULL; }
+    int GetSize() const;
+
+    /*
+        *  Purpose     Read/Write size bytes at offset, [offset, offset + size) must be in the blob
+        */
+    int Read(void* buffer, int size, int offset);
+    int Write(const void* data, int size, int offset);
+
+    /*
+        *  Purpose     Read/Write at the position, which is moved by the bytes read/written
+        *  bytes_read  The bytes read, less than size at the end of the blob
+        */
+    int ReadNext(void* buffer, int size, int* bytes_read);
+    int WriteNext(const void* data, int size);
+    int GetPosition() const { return position_; }
+    int Seek(int position);
+
+    /*
+        *  Purpose     Pass the blob from offset to reader chunk by chunk, size < 0 means to the end
+        *  Return      SQLITE_OK if all passed, SQLITE_INTERRUPT if the reader stopped
+        */
+    int ReadChunks(const ChunkReader& reader, int offset = 0, int size = -1, int chunk_size = kDefaultChunkSize);
+
+    /*
+        *  Purpose     Fill the blob from offset by writer chunk by chunk until it returns 0 or the blob is full
+        *  written     The bytes written, can be NULL
+        *  Return      SQLITE_OK if finished, SQLITE_INTERRUPT if the writer stopped, SQLITE_FULL if the writer
+        *              has more bytes than the blob holds
+        */
+    int WriteChunks(const ChunkWriter& writer, int offset = 0, int* written = NULL, int chunk_size = kDefaultChunkSize);
+
+    static const int kDefaultChunkSize = 64 * 1024;
+
+private:
+
+    SQLiteBlobStream(const SQLiteBlobStream&);
+    SQLiteBlobStream& operator=(const SQLiteBlobStream&);
+
+    sqlite3_blob*   blob_;
+    int             position_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_BLOB_STREAM_H__
@@ -0,0 +1,240 @@
+// SQLite connection pool in WAL mode
+
+#include "nim_db/db_connection_pool.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+DB_BEGIN_DECLS
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteConnection
+SQLiteConnection::SQLiteConnection()
+{
+	pool_ = NULL;
+	db_   = NULL;
+}
+
+SQLiteConnection::SQLiteConnection(SQLiteConnection& src)
+{
+	pool_     = src.pool_;
+	db_       = src.db_;
+	src.pool_ = NULL;
+	src.db_   = NULL;
+}
+
+SQLiteConnection::~SQLiteConnection()
+{
+	Release();
+}
+
+SQLiteConnection& SQLiteConnection::operator=(SQLiteConnection& src)
+{
+	Release();
+
+	pool_     = src.pool_;
+	db_       = src.db_;
+	src.pool_ = NULL;
+	src.db_   = NULL;
+	return *this;
+}
+
+void SQLiteConnection::Release()
+{
+	if (pool_ != NULL && db_ != NULL)
+		pool_->ReleaseConnection(db_);
+	pool_ = NULL;
+	db_   = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteConnectionPool
+SQLiteConnectionPool::SQLiteConnectionPool()
+{
+	writer_      = NULL;
+	writer_idle_ = false;
+}
+
+SQLiteConnectionPool::~SQLiteConnectionPool()
+{
+	Close();
+}
+
+bool SQLiteConnectionPool::Open(const char* filename,
+	const std::string &key,
+	size_t reader_count/* = 4*/,
+	int busy_timeout/* = 5000*/)
+{
+	if (!Close())
+		return false;
+
+	if (filename == NULL || strcmp(filename, ":memory:") == 0 || reader_count == 0)
+		return false;
+
+	SQLiteDB* writer = new SQLiteDB;
+	if (!writer->Open(filename, key, SQLiteDB::modeReadWrite | SQLiteDB::modeCreate | SQLiteDB::modeMultiThread))
+	{
+		delete writer;
+		return false;
+	}
+	writer->SetBusyTimeout(busy_timeout);
+
+	// journal_mode会返回切换后的模式，加密或只读等原因切换失败时不是wal
+	SQLiteResultTable table;
+	if (writer->Query("PRAGMA journal_mode=WAL", table) != SQLITE_OK ||
+		table.GetRowCount() < 1 || table.GetValue(0, 0) == NULL ||
+		strcmp(table.GetValue(0, 0), "wal") != 0)
+	{
+		delete writer;
+		return false;
+	}
+
+	std::vector<SQLiteDB*> readers;
+	for (size_t i = 0; i < reader_count; i++)
+	{
+		SQLiteDB* reader = new SQLiteDB;
+		if (!reader->Open(filename, key, SQLiteDB::modeReadOnly | SQLiteDB::modeMultiThread))
+		{
+			delete reader;
+			for (size_t j = 0; j < readers.size(); j++)
+				delete readers[j];
+			delete writer;
+			return false;
+		}
+		reader->SetBusyTimeout(busy_timeout);
+		readers.push_back(reader);
+	}
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	writer_       = writer;
+	writer_idle_  = true;
+	readers_      = readers;
+	idle_readers_ = readers;
+	return true;
+}
+
+bool SQLiteConnectionPool::Close()
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (writer_ == NULL)
+		return true;
+
+	// 还有连接被借出时不能关闭
+	if (!writer_idle_ || idle_readers_.size() != readers_.size())
+		return false;
+
+	for (size_t i = 0; i < readers_.size(); i++)
+		delete readers_[i];
+	readers_.clear();
+	idle_readers_.clear();
+
+	delete writer_;
+	writer_      = NULL;
+	writer_idle_ = false;
+	return true;
+}
+
+bool SQLiteConnectionPool::IsValid() const
+{
+	return writer_ != NULL;
+}
+
+bool SQLiteConnectionPool::AcquireWriter(SQLiteConnection& connection)
+{
+	connection.Release();
+
+	std::unique_lock<std::mutex> auto_lock(mutex_);
+	if (writer_ == NULL)
+		return false;
+	idle_cond_.wait(auto_lock, [this]() { return writer_idle_ || writer_ == NULL; });
+	if (writer_ == NULL)
+		return false;
+
+	writer_idle_     = false;
+	connection.pool_ = this;
+	connection.db_   = writer_;
+	return true;
+}
+
+bool SQLiteConnectionPool::AcquireReader(SQLiteConnection& connection)
+{
+	connection.Release();
+
+	std::unique_lock<std::mutex> auto_lock(mutex_);
+	if (writer_ == NULL)
+		return false;
+	idle_cond_.wait(auto_lock, [this]() { return !idle_readers_.empty() || writer_ == NULL; });
+	if (writer_ == NULL)
+		return false;
+
+	// 后进先出，最近用过的连接页缓存和语句缓存更热
+	connection.pool_ = this;
+	connection.db_   = idle_readers_.back();
+	idle_readers_.pop_back();
+	return true;
+}
+
+void SQLiteConnectionPool::ReleaseConnection(SQLiteDB* db)
+{
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (db == writer_)
+		{
+			writer_idle_ = true;
+		}
+		else
+		{
+			assert(std::find(readers_.begin(), readers_.end(), db) != readers_.end());
+			idle_readers_.push_back(db);
+		}
+	}
+	idle_cond_.notify_all();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteReadSnapshot
+SQLiteReadSnapshot::SQLiteReadSnapshot()
+{
+}
+
+SQLiteReadSnapshot::~SQLiteReadSnapshot()
+{
+	End();
+}
+
+bool SQLiteReadSnapshot::Begin(SQLiteConnectionPool* pool)
+{
+	End();
+	if (pool == NULL || !pool->AcquireReader(connection_))
+		return false;
+
+	// BEGIN DEFERRED 要到第一次读时才获取快照，在这里读一次，之后的查询都看到Begin时的数据
+	SQLiteStatement statement;
+	if (connection_->Query("BEGIN DEFERRED") != SQLITE_OK)
+	{
+		connection_.Release();
+		return false;
+	}
+	int result = connection_->Query(statement, "SELECT 1 FROM sqlite_master LIMIT 1");
+	if (result == SQLITE_OK)
+		result = statement.NextRow();
+	statement.Finalize();
+	if (result != SQLITE_ROW && result != SQLITE_DONE)
+	{
+		connection_->Query("ROLLBACK");
+		connection_.Release();
+		return false;
+	}
+	return true;
+}
+
+void SQLiteReadSnapshot::End()
+{
+	if (!connection_.IsValid())
+		return;
+	// 读事务没有要提交的数据，用 ROLLBACK 结束，还没读完的语句也会被终止
+	connection_->Query("ROLLBACK");
+	connection_.Release();
+}
+
+DB_END_DECLS
@@ -0,0 +1,150 @@
+#ifndef __BASE_DB_CONNECTION_POOL_H__
+#define __BASE_DB_CONNECTION_POOL_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+DB_BEGIN_DECLS
+
+class SQLiteConnectionPool;
+
+/*
+    *  Purpose     A connection leased from SQLiteConnectionPool
+    *  Remark      The connection is used by the current thread only and goes back to the pool
+    *              when the object destruct. Copying transfers the lease like SQLiteStatement.
+    */
+class DB_EXPORT SQLiteConnection
+{
+    friend class SQLiteConnectionPool;
+
+public:
+
+    SQLiteConnection();
+    SQLiteConnection(SQLiteConnection& src);
+    virtual ~SQLiteConnection();
+
+    SQLiteConnection& operator=(SQLiteConnection& src);
+
+    bool IsValid() const { return db_ != NULL; }
+    SQLiteDB* operator->() const { return db_; }
+    SQLiteDB& operator*() const { return *db_; }
+    SQLiteDB* Get() const { return db_; }
+
+    /*
+        *  Purpose     Return the connection to the pool before destruct
+        */
+    void Release();
+
+private:
+
+    SQLiteConnectionPool* pool_;
+    SQLiteDB*             db_;
+};
+
+/*
+    *  Purpose     Open one database with one writer connection and N read-only connections in WAL mode
+    *  Remark      In WAL mode readers do not block the writer and the writer does not block readers,
+    *              so queries on the UI thread no longer wait behind bulk inserts on a sync thread.
+    *              Every connection is opened with modeMultiThread (no mutex), a connection is
+    *              used by only one thread at a time through SQLiteConnection.
+    *              A thread should not lease a second reader while holding one, it may wait forever
+    *              when all the readers are leased by threads doing the same.
+    */
+class DB_EXPORT SQLiteConnectionPool
+{
+    friend class SQLiteConnection;
+
+public:
+
+    SQLiteConnectionPool();
+    virtual ~SQLiteConnectionPool();
+
+    /*
+        *  Purpose     Open/Create the database file and switch it to WAL mode
+        *  filename    Database file name, ":memory:" is not supported because it can not be shared
+        *  key         Encrypt key, see SQLiteDB::Open
+        *  reader_count  Count of read-only connections, at least 1
+        *  busy_timeout  Busy timeout (ms) of every connection, see SQLiteDB::SetBusyTimeout
+        */
+    bool Open(const char* filename,
+              const std::string &key,
+              size_t reader_count = 4,
+              int busy_timeout = 5000);
+
+    /*
+        *  Purpose     Close all the connections
+        *  Remark      It returns false if any connection is still leased
+        */
+    bool Close();
+
+    bool IsValid() const;
+
+    /*
+        *  Purpose     Lease the writer connection, wait until the writer is returned by other thread
+        *  connection  Return the leased connection, the connection leased before is released first
+        */
+    bool AcquireWriter(SQLiteConnection& connection);
+
+    /*
+        *  Purpose     Lease an idle read-only connection, wait until one is returned when all are leased
+        *  connection  Return the leased connection, the connection leased before is released first
+        */
+    bool AcquireReader(SQLiteConnection& connection);
+
+private:
+
+    SQLiteConnectionPool(const SQLiteConnectionPool&);
+    SQLiteConnectionPool& operator=(const SQLiteConnectionPool&);
+
+    void ReleaseConnection(SQLiteDB* db);
+
+    std::mutex                  mutex_;
+    std::condition_variable     idle_cond_;
+    SQLiteDB*                   writer_;
+    bool                        writer_idle_;
+    std::vector<SQLiteDB*>      readers_;
+    std::vector<SQLiteDB*>      idle_readers_;
+};
+
+/*
+    *  Purpose     A read transaction on a reader of SQLiteConnectionPool, every query run through it
+    *              sees the database as it was when Begin() returned
+    *  Remark      In WAL mode the snapshot does not block the writer, so a long list rendering or export
+    *              can read a consistent view while the writer commits. The WAL can not be checkpointed
+    *              past the snapshot, so it should not be held longer than the read needs.
+    *              The transaction is ended and the reader goes back to the pool when the object destruct.
+    */
+class DB_EXPORT SQLiteReadSnapshot
+{
+public:
+
+    SQLiteReadSnapshot();
+    virtual ~SQLiteReadSnapshot();
+
+    /*
+        *  Purpose     Lease a reader of pool and start the read transaction, the snapshot begun before is ended first
+        */
+    bool Begin(SQLiteConnectionPool* pool);
+
+    /*
+        *  Purpose     End the read transaction and return the reader before destruct
+        */
+    void End();
+
+    bool IsValid() const { return connection_.IsValid(); }
+    SQLiteDB* operator->() const { return connection_.Get(); }
+    SQLiteDB& operator*() const { return *connection_; }
+    SQLiteDB* Get() const { return connection_.Get(); }
+
+private:
+
+    SQLiteReadSnapshot(const SQLiteReadSnapshot&);
+    SQLiteReadSnapshot& operator=(const SQLiteReadSnapshot&);
+
+    SQLiteConnection connection_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_CONNECTION_POOL_H__
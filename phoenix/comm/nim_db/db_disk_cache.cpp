@@ -0,0 +1,554 @@
+// Size accounting and LRU eviction of a cache directory
+
+#include "nim_db/db_disk_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "base/files/file_path.h"
+#include "base/time/time.h"
+#include "extension/file_util/utf8_file_util.h"
+
+DB_BEGIN_DECLS
+
+namespace
+{
+
+// 每个淘汰任务最多处理的文件数，删文件是同步 IO，分批执行让同一数据库的查询能插进来
+const int kEvictBatchSize = 64;
+
+struct ScannedFile
+{
+	std::string     path;
+	int64_t         size;
+	int64_t         access_time;
+};
+
+int64_t NowSeconds()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 统一为相对 root 的、以 '/' 分隔的路径
+std::string NormalizePath(const std::string& path)
+{
+	std::string result = path;
+#if defined(OS_WIN)
+	std::replace(result.begin(), result.end(), '\\', '/');
+#endif
+	size_t begin = result.find_first_not_of('/');
+	return begin == std::string::npos ? std::string() : result.substr(begin);
+}
+
+void ScanDirectory(const std::string& root, const std::string& directory, bool recursive,
+	std::vector<ScannedFile>& files, std::vector<std::string>* subdirectories)
+{
+	int file_type = base::FileEnumerator::FILES;
+	if (subdirectories != NULL)
+		file_type |= base::FileEnumerator::DIRECTORIES;
+	NS_EXTENSION::FileEnumerator enumerator(directory, recursive, file_type, std::string());
+	for (base::FilePath path = enumerator.Next(); !path.empty(); path = enumerator.Next())
+	{
+		std::string full_path = path.AsUTF8Unsafe();
+		base::FileEnumerator::FileInfo info = enumerator.GetInfo();
+		if (info.IsDirectory())
+		{
+			if (subdirectories != NULL)
+				subdirectories->push_back(full_path);
+			continue;
+		}
+		if (full_path.size() <= root.size())
+			continue;
+		ScannedFile file;
+		file.path        = NormalizePath(full_path.substr(root.size()));
+		file.size        = info.GetSize();
+		file.access_time = info.GetLastModifiedTime().ToTimeT();
+		files.push_back(file);
+	}
+}
+
+}
+
+struct SQLiteDiskCache::State
+{
+	struct Change
+	{
+		enum Type
+		{
+			kAdd,
+			kAccess,
+			kRemove,
+		};
+
+		Type        type;
+		int64_t     size;
+		int64_t     time;
+	};
+
+	std::string                         root;           // 以分隔符结尾
+	std::string                         table;
+	std::string                         select_size_sql;
+	std::string                         replace_sql;
+	std::string                         touch_sql;
+	std::string                         delete_sql;
+	std::string                         lru_sql;
+	int                                 target_percent;
+	int64_t                             max_age_seconds;
+	int                                 scan_threads;
+
+	std::mutex                          lock;
+	std::map<std::string, Change>       pending;        // 同一个文件的多次修改合并为一个
+	bool                                apply_posted;
+
+	std::atomic<int64_t>                max_bytes;
+	std::atomic_bool                    ready;
+	std::atomic_bool                    failed;         // 建表失败，之后的修改都忽略
+	std::atomic_bool                    closed;
+	std::atomic_bool                    evicting;
+	std::atomic<int64_t>                total_bytes;
+	std::atomic<int64_t>                entry_count;
+	std::atomic<uint64_t>               evicted_files;
+	std::atomic<uint64_t>               evicted_bytes;
+	std::atomic<uint64_t>               rebuilds;
+
+	int64_t TargetBytes() const
+	{
+		return max_bytes / 100 * target_percent;
+	}
+};
+
+SQLiteDiskCache::SQLiteDiskCache(AsyncSQLiteDB* db, const std::string& root_dir, const std::string& table,
+	const SQLiteDiskCacheOptions& options/* = SQLiteDiskCacheOptions()*/)
+	: db_(db), state_(std::make_shared<State>())
+{
+	State& state = *state_;
+	state.root            = NS_EXTENSION::FilePathAsEndWithSeparator(root_dir);
+	state.table           = table;
+	state.select_size_sql = "SELECT size FROM " + table + " WHERE path=?";
+	state.replace_sql     = "INSERT OR REPLACE INTO " + table + "(path, size, access_time) VALUES(?, ?, ?)";
+	state.touch_sql       = "UPDATE " + table + " SET access_time=? WHERE path=?";
+	state.delete_sql      = "DELETE FROM " + table + " WHERE path=?";
+	state.lru_sql         = "SELECT path, size, access_time FROM " + table + " ORDER BY access_time LIMIT ?";
+	state.target_percent  = std::min(std::max(options.target_percent, 0), 100);
+	state.max_age_seconds = options.max_age_seconds;
+	state.scan_threads    = std::max(options.scan_threads, 1);
+	state.apply_posted    = false;
+	state.max_bytes       = options.max_bytes;
+	state.ready           = false;
+	state.failed          = false;
+	state.closed          = false;
+	state.evicting        = false;
+	state.total_bytes     = 0;
+	state.entry_count     = 0;
+	state.evicted_files   = 0;
+	state.evicted_bytes   = 0;
+	state.rebuilds        = 0;
+}
+
+SQLiteDiskCache::~SQLiteDiskCache()
+{
+	Close();
+}
+
+bool SQLiteDiskCache::Open()
+{
+	if (db_ == NULL)
+		return false;
+	AsyncSQLiteDB* db = db_;
+	std::shared_ptr<State> state = state_;
+	return db_->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state](SQLiteDB* sqlite) {
+		Init(db, state, sqlite, false);
+	});
+}
+
+void SQLiteDiskCache::Close()
+{
+	if (state_->closed.exchange(true))
+		return;
+	Flush();
+}
+
+void SQLiteDiskCache::OnFileAdded(const std::string& relative_path, int64_t size)
+{
+	if (state_->closed || state_->failed)
+		return;
+	{
+		std::lock_guard<std::mutex> auto_lock(state_->lock);
+		State::Change& change = state_->pending[NormalizePath(relative_path)];
+		change.type = State::Change::kAdd;
+		change.size = size;
+		change.time = NowSeconds();
+	}
+	PostApply(db_, state_);
+}
+
+void SQLiteDiskCache::OnFileAccessed(const std::string& relative_path)
+{
+	if (state_->closed || state_->failed)
+		return;
+	{
+		std::lock_guard<std::mutex> auto_lock(state_->lock);
+		std::string path = NormalizePath(relative_path);
+		auto it = state_->pending.find(path);
+		if (it == state_->pending.end())
+		{
+			State::Change& change = state_->pending[path];
+			change.type = State::Change::kAccess;
+			change.size = 0;
+			change.time = NowSeconds();
+		}
+		else if (it->second.type != State::Change::kRemove)
+		{
+			// 还没写入的新增只更新访问时间，已删除的不再复活
+			it->second.time = NowSeconds();
+		}
+	}
+	PostApply(db_, state_);
+}
+
+void SQLiteDiskCache::OnFileRemoved(const std::string& relative_path)
+{
+	if (state_->closed || state_->failed)
+		return;
+	{
+		std::lock_guard<std::mutex> auto_lock(state_->lock);
+		State::Change& change = state_->pending[NormalizePath(relative_path)];
+		change.type = State::Change::kRemove;
+		change.size = 0;
+		change.time = 0;
+	}
+	PostApply(db_, state_);
+}
+
+void SQLiteDiskCache::SetMaxBytes(int64_t max_bytes)
+{
+	state_->max_bytes = max_bytes;
+	Trim();
+}
+
+void SQLiteDiskCache::Trim()
+{
+	if (db_ == NULL || state_->closed || !state_->ready)
+		return;
+	PostEvictStep(db_, state_);
+}
+
+void SQLiteDiskCache::Rebuild()
+{
+	if (db_ == NULL || state_->closed)
+		return;
+	AsyncSQLiteDB* db = db_;
+	std::shared_ptr<State> state = state_;
+	db_->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state](SQLiteDB* sqlite) {
+		Init(db, state, sqlite, true);
+	});
+}
+
+void SQLiteDiskCache::Flush()
+{
+	if (db_ == NULL)
+		return;
+	std::shared_ptr<State> state = state_;
+	AsyncSQLiteDB* db = db_;
+	std::mutex mutex;
+	std::condition_variable done_cv;
+	bool done = false;
+	bool posted = db_->PostTask(AsyncSQLiteDB::kPriorityNormal, [db, state, &mutex, &done_cv, &done](SQLiteDB* sqlite) {
+		if (state->ready)
+			ApplyPending(db, state, sqlite);
+		std::lock_guard<std::mutex> auto_lock(mutex);
+		done = true;
+		done_cv.notify_one();
+	});
+	if (!posted)
+		return;
+	std::unique_lock<std::mutex> auto_lock(mutex);
+	done_cv.wait(auto_lock, [&done]() { return done; });
+}
+
+bool SQLiteDiskCache::IsReady() const
+{
+	return state_->ready;
+}
+
+int64_t SQLiteDiskCache::GetTotalBytes() const
+{
+	return state_->total_bytes;
+}
+
+SQLiteDiskCacheStats SQLiteDiskCache::GetStats() const
+{
+	SQLiteDiskCacheStats stats;
+	stats.total_bytes   = state_->total_bytes;
+	stats.entry_count   = state_->entry_count;
+	stats.evicted_files = state_->evicted_files;
+	stats.evicted_bytes = state_->evicted_bytes;
+	stats.rebuilds      = state_->rebuilds;
+	return stats;
+}
+
+void SQLiteDiskCache::PostApply(AsyncSQLiteDB* db, const std::shared_ptr<State>& state)
+{
+	if (db == NULL)
+		return;
+	{
+		std::lock_guard<std::mutex> auto_lock(state->lock);
+		// 索引就绪前的修改由 Init 在最后统一应用
+		if (state->apply_posted || !state->ready)
+			return;
+		state->apply_posted = true;
+	}
+	bool posted = db->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state](SQLiteDB* sqlite) {
+		ApplyPending(db, state, sqlite);
+	});
+	if (!posted)
+	{
+		std::lock_guard<std::mutex> auto_lock(state->lock);
+		state->apply_posted = false;
+	}
+}
+
+void SQLiteDiskCache::Init(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, SQLiteDB* sqlite, bool force_rebuild)
+{
+	if (force_rebuild || !sqlite->DoesTableExist(state->table.c_str()))
+	{
+		RebuildIndex(state, sqlite);
+	}
+	else
+	{
+		SQLiteStatement statement;
+		std::string sql = "SELECT COUNT(*), COALESCE(SUM(size), 0) FROM " + state->table;
+		if (sqlite->Query(statement, sql.c_str()) == SQLITE_OK && statement.NextRow() == SQLITE_ROW)
+		{
+			state->entry_count = statement.GetInt64Field(0);
+			state->total_bytes = statement.GetInt64Field(1);
+		}
+	}
+	if (!sqlite->DoesTableExist(state->table.c_str()))
+	{
+		state->failed = true;
+		std::lock_guard<std::mutex> auto_lock(state->lock);
+		state->pending.clear();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> auto_lock(state->lock);
+		state->ready = true;
+	}
+	ApplyPending(db, state, sqlite);
+}
+
+void SQLiteDiskCache::ApplyPending(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, SQLiteDB* sqlite)
+{
+	std::map<std::string, State::Change> changes;
+	{
+		std::lock_guard<std::mutex> auto_lock(state->lock);
+		changes.swap(state->pending);
+		state->apply_posted = false;
+	}
+
+	if (!changes.empty())
+	{
+		SQLiteAutoTransaction transaction(sqlite);
+		for (auto& item : changes)
+		{
+			const std::string& path = item.first;
+			const State::Change& change = item.second;
+			if (change.type == State::Change::kAccess)
+			{
+				SQLiteStatement statement;
+				if (sqlite->Query(statement, state->touch_sql.c_str()) != SQLITE_OK)
+					continue;
+				statement.BindInt64(1, change.time);
+				statement.BindText(2, path.data(), path.size());
+				statement.NextRow();
+				continue;
+			}
+
+			// 新增和删除都要先查出原来的大小，增量维护总大小
+			int64_t old_size = -1;
+			{
+				SQLiteStatement statement;
+				if (sqlite->Query(statement, state->select_size_sql.c_str()) != SQLITE_OK)
+					continue;
+				statement.BindText(1, path.data(), path.size());
+				if (statement.NextRow() == SQLITE_ROW)
+					old_size = statement.GetInt64Field(0);
+			}
+			SQLiteStatement statement;
+			if (change.type == State::Change::kAdd)
+			{
+				if (sqlite->Query(statement, state->replace_sql.c_str()) != SQLITE_OK)
+					continue;
+				statement.BindText(1, path.data(), path.size());
+				statement.BindInt64(2, change.size);
+				statement.BindInt64(3, change.time);
+				if (statement.NextRow() != SQLITE_DONE)
+					continue;
+				state->total_bytes += change.size - std::max<int64_t>(old_size, 0);
+				if (old_size < 0)
+					state->entry_count++;
+			}
+			else if (old_size >= 0)
+			{
+				if (sqlite->Query(statement, state->delete_sql.c_str()) != SQLITE_OK)
+					continue;
+				statement.BindText(1, path.data(), path.size());
+				if (statement.NextRow() != SQLITE_DONE)
+					continue;
+				state->total_bytes -= old_size;
+				state->entry_count--;
+			}
+		}
+	}
+
+	if (state->total_bytes > state->max_bytes || state->max_age_seconds > 0)
+		PostEvictStep(db, state);
+}
+
+void SQLiteDiskCache::RebuildIndex(const std::shared_ptr<State>& state, SQLiteDB* sqlite)
+{
+	state->rebuilds++;
+
+	// 第一层在当前线程上枚举，各个子目录分给多个线程并行递归枚举
+	std::vector<ScannedFile> files;
+	std::vector<std::string> subdirectories;
+	ScanDirectory(state->root, state->root, false, files, &subdirectories);
+	if (!subdirectories.empty())
+	{
+		std::mutex files_lock;
+		std::atomic<size_t> next_directory(0);
+		auto scan = [&]() {
+			std::vector<ScannedFile> local_files;
+			for (size_t i = next_directory++; i < subdirectories.size(); i = next_directory++)
+				ScanDirectory(state->root, subdirectories[i], true, local_files, NULL);
+			std::lock_guard<std::mutex> auto_lock(files_lock);
+			files.insert(files.end(), local_files.begin(), local_files.end());
+		};
+		size_t thread_count = std::min<size_t>(state->scan_threads, subdirectories.size());
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < thread_count; i++)
+			threads.emplace_back(scan);
+		scan();
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	// 删表、建表和写入在一个事务里，中途退出时下次启动仍会发现索引不存在而重建
+	SQLiteAutoTransaction transaction(sqlite);
+	std::string sql = "DROP TABLE IF EXISTS " + state->table;
+	sqlite->Query(sql.c_str());
+	sql = "CREATE TABLE " + state->table +
+		"(path TEXT PRIMARY KEY NOT NULL, size INTEGER NOT NULL, access_time INTEGER NOT NULL) WITHOUT ROWID";
+	if (sqlite->Query(sql.c_str()) != SQLITE_OK)
+	{
+		transaction.Rollback();
+		return;
+	}
+	sql = "CREATE INDEX " + state->table + "_access_time ON " + state->table + "(access_time)";
+	sqlite->Query(sql.c_str());
+
+	int64_t total_bytes = 0;
+	int64_t entry_count = 0;
+	for (auto& file : files)
+	{
+		SQLiteStatement statement;
+		if (sqlite->Query(statement, state->replace_sql.c_str()) != SQLITE_OK)
+			break;
+		statement.BindText(1, file.path.data(), file.path.size());
+		statement.BindInt64(2, file.size);
+		statement.BindInt64(3, file.access_time);
+		if (statement.NextRow() != SQLITE_DONE)
+			continue;
+		total_bytes += file.size;
+		entry_count++;
+	}
+	if (!transaction.Commit())
+	{
+		transaction.Rollback();
+		return;
+	}
+	state->total_bytes = total_bytes;
+	state->entry_count = entry_count;
+}
+
+void SQLiteDiskCache::PostEvictStep(AsyncSQLiteDB* db, const std::shared_ptr<State>& state)
+{
+	if (state->evicting.exchange(true))
+		return;
+	bool posted = db->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state](SQLiteDB* sqlite) {
+		bool more = EvictStep(state, sqlite);
+		state->evicting = false;
+		if (more)
+			PostEvictStep(db, state);
+	});
+	if (!posted)
+		state->evicting = false;
+}
+
+bool SQLiteDiskCache::EvictStep(const std::shared_ptr<State>& state, SQLiteDB* sqlite)
+{
+	int64_t now = NowSeconds();
+	int64_t expire_time = state->max_age_seconds > 0 ? now - state->max_age_seconds : std::numeric_limits<int64_t>::min();
+	bool over_budget = state->total_bytes > state->max_bytes;
+	int64_t target_bytes = state->TargetBytes();
+
+	std::vector<ScannedFile> candidates;
+	{
+		SQLiteStatement statement;
+		if (sqlite->Query(statement, state->lru_sql.c_str()) != SQLITE_OK)
+			return false;
+		statement.BindInt(1, kEvictBatchSize);
+		while (statement.NextRow() == SQLITE_ROW)
+		{
+			ScannedFile file;
+			file.path.assign(statement.GetTextField(0), statement.GetFieldBytes(0));
+			file.size        = statement.GetInt64Field(1);
+			file.access_time = statement.GetInt64Field(2);
+			candidates.push_back(file);
+		}
+	}
+
+	SQLiteAutoTransaction transaction(sqlite);
+	bool evicted = false;
+	for (auto& file : candidates)
+	{
+		// 按访问时间从旧到新，超出预算时淘汰到目标大小，此外只淘汰过期的
+		bool evict = (over_budget && state->total_bytes > target_bytes) || file.access_time < expire_time;
+		if (!evict)
+			break;
+		std::string full_path = state->root + file.path;
+		NS_EXTENSION::DeleteFile(full_path);
+		SQLiteStatement statement;
+		if (NS_EXTENSION::FilePathIsExist(full_path, false))
+		{
+			// 正在使用（Windows 上被打开）删不掉，当作刚访问过，不要每次都卡在它上面
+			if (sqlite->Query(statement, state->touch_sql.c_str()) == SQLITE_OK)
+			{
+				statement.BindInt64(1, now);
+				statement.BindText(2, file.path.data(), file.path.size());
+				statement.NextRow();
+			}
+			continue;
+		}
+		if (sqlite->Query(statement, state->delete_sql.c_str()) != SQLITE_OK)
+			continue;
+		statement.BindText(1, file.path.data(), file.path.size());
+		if (statement.NextRow() != SQLITE_DONE)
+			continue;
+		evicted = true;
+		state->total_bytes -= file.size;
+		state->entry_count--;
+		state->evicted_files++;
+		state->evicted_bytes += file.size;
+	}
+	// 一批里一个都没删掉（都在使用中）时停下，等下次修改或 Trim 再试，避免空转
+	return evicted && candidates.size() == (size_t)kEvictBatchSize;
+}
+
+DB_END_DECLS
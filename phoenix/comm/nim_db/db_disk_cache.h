@@ -0,0 +1,143 @@
+#ifndef __BASE_DB_DISK_CACHE_H__
+#define __BASE_DB_DISK_CACHE_H__
+
+#include "nim_db/db_async.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Limits of a SQLiteDiskCache
+    */
+struct SQLiteDiskCacheOptions
+{
+    SQLiteDiskCacheOptions() : max_bytes(512ll * 1024 * 1024), target_percent(90), max_age_seconds(0), scan_threads(4) {}
+
+    int64_t     max_bytes;          // Eviction starts when the cache grows beyond it
+    int         target_percent;     // Eviction stops at this percent of max_bytes
+    int64_t     max_age_seconds;    // Files not accessed for so long are evicted too, 0 means no age limit
+    int         scan_threads;       // Threads enumerating the directory when the index is rebuilt
+};
+
+/*
+    *  Purpose     Counters of a SQLiteDiskCache
+    */
+struct SQLiteDiskCacheStats
+{
+    int64_t     total_bytes;
+    int64_t     entry_count;
+    uint64_t    evicted_files;
+    uint64_t    evicted_bytes;
+    uint64_t    rebuilds;           // Full scans of the directory
+};
+
+/*
+    *  Purpose     Size accounting and LRU eviction of a cache directory (downloads, thumbnails, HTTP cache)
+    *  Remark      Every file of the directory has a row (relative path, size, access time) in a table of
+    *              the index database, and the total size is kept up to date incrementally, so cleaning
+    *              the cache does not walk a multi-GB directory on the calling thread.
+    *              OnFileAdded/OnFileAccessed/OnFileRemoved only update an in-memory queue, changes of the
+    *              same file are merged and applied in one transaction by a low priority task on the
+    *              database thread. When the total exceeds max_bytes, files are deleted in LRU order down to
+    *              target_percent, a batch per task so queries of the same database are not held up.
+    *              The directory is enumerated only when the table does not exist yet (first run, deleted
+    *              index) or Rebuild() is called, then the top-level subdirectories are enumerated in
+    *              parallel on scan_threads threads. Files written while the index missed the change (e.g.
+    *              a crash before the queue is applied) are picked up by the next Rebuild().
+    *              Paths are UTF-8, relative to root_dir, with '/' as the separator. Several caches can share
+    *              one AsyncSQLiteDB with different tables. The methods can be called on any thread except
+    *              where noted.
+    */
+class DB_EXPORT SQLiteDiskCache
+{
+public:
+
+    SQLiteDiskCache(AsyncSQLiteDB* db, const std::string& root_dir, const std::string& table,
+        const SQLiteDiskCacheOptions& options = SQLiteDiskCacheOptions());
+    virtual ~SQLiteDiskCache();
+
+    /*
+        *  Purpose     Create the table on the database thread, load the totals or rebuild the index
+        *  Remark      Returns false if the task can not be posted. Changes reported before the index is ready
+        *              are queued and applied after it.
+        */
+    bool Open();
+
+    /*
+        *  Purpose     Apply the queued changes and wait for them, later changes are ignored
+        *  Remark      Do not call it on the database thread, as Flush()
+        */
+    void Close();
+
+    /*
+        *  Purpose     Report a file written (or rewritten) under root_dir
+        */
+    void OnFileAdded(const std::string& relative_path, int64_t size);
+
+    /*
+        *  Purpose     Report a cache hit, the file becomes the most recently used
+        */
+    void OnFileAccessed(const std::string& relative_path);
+
+    /*
+        *  Purpose     Report a file deleted by the owner of the cache
+        */
+    void OnFileRemoved(const std::string& relative_path);
+
+    /*
+        *  Purpose     Change the size budget, eviction runs at once if the cache is over it
+        */
+    void SetMaxBytes(int64_t max_bytes);
+
+    /*
+        *  Purpose     Evict now, e.g. under low disk space, down to target_percent of max_bytes
+        */
+    void Trim();
+
+    /*
+        *  Purpose     Forget the index and enumerate the directory again
+        */
+    void Rebuild();
+
+    /*
+        *  Purpose     Apply the queued changes and wait until they are written
+        *  Remark      Do not call it on the database thread, it would wait for itself
+        */
+    void Flush();
+
+    /*
+        *  Purpose     True after the index is loaded or rebuilt
+        */
+    bool IsReady() const;
+
+    /*
+        *  Purpose     Cheap, does not query the database. The totals include the changes applied so far.
+        */
+    int64_t GetTotalBytes() const;
+    SQLiteDiskCacheStats GetStats() const;
+
+private:
+
+    struct State;
+
+    SQLiteDiskCache(const SQLiteDiskCache&);
+    SQLiteDiskCache& operator=(const SQLiteDiskCache&);
+
+    // 投递一次应用队列中修改的任务，已经投递过且还没执行时不重复投递
+    static void PostApply(AsyncSQLiteDB* db, const std::shared_ptr<State>& state);
+    // 以下在数据库线程上执行
+    static void Init(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, SQLiteDB* sqlite, bool force_rebuild);
+    static void ApplyPending(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, SQLiteDB* sqlite);
+    static void RebuildIndex(const std::shared_ptr<State>& state, SQLiteDB* sqlite);
+    static void PostEvictStep(AsyncSQLiteDB* db, const std::shared_ptr<State>& state);
+    // 淘汰一批，还需继续时返回 true
+    static bool EvictStep(const std::shared_ptr<State>& state, SQLiteDB* sqlite);
+
+    AsyncSQLiteDB*          db_;
+    std::shared_ptr<State>  state_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_DISK_CACHE_H__
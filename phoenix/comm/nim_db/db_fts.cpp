@@ -0,0 +1,827 @@
+// Full-text index with a CJK bigram tokenizer
+
+#include "nim_db/db_fts.h"
+#include "nim_db/db_async.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+// fts3_tokenizer.h不在sqlite3.h中，以下结构与它一致
+struct sqlite3_tokenizer_module;
+struct sqlite3_tokenizer
+{
+	const sqlite3_tokenizer_module* pModule;
+};
+struct sqlite3_tokenizer_cursor
+{
+	sqlite3_tokenizer* pTokenizer;
+};
+struct sqlite3_tokenizer_module
+{
+	int iVersion;
+	int (*xCreate)(int argc, const char* const* argv, sqlite3_tokenizer** ppTokenizer);
+	int (*xDestroy)(sqlite3_tokenizer* pTokenizer);
+	int (*xOpen)(sqlite3_tokenizer* pTokenizer, const char* pInput, int nBytes, sqlite3_tokenizer_cursor** ppCursor);
+	int (*xClose)(sqlite3_tokenizer_cursor* pCursor);
+	int (*xNext)(sqlite3_tokenizer_cursor* pCursor, const char** ppToken, int* pnBytes,
+		int* piStartOffset, int* piEndOffset, int* piPosition);
+};
+
+// 3.12起两个参数的fts3_tokenizer()默认被禁用，要按连接打开
+#ifndef SQLITE_DBCONFIG_ENABLE_FTS3_TOKENIZER
+#define SQLITE_DBCONFIG_ENABLE_FTS3_TOKENIZER 1004
+#endif
+
+DB_BEGIN_DECLS
+
+namespace
+{
+
+const char kTokenizerName[] = "nim_cjk";
+const char kStateTable[]    = "nim_fts_state";
+
+enum CharClass
+{
+	kCharSeparator,
+	kCharWord,
+	kCharCjk,
+};
+
+// 解码一个UTF-8字符，非法的字节当作一个单字节的分隔符
+int DecodeUTF8(const unsigned char* p, int bytes, uint32_t* c)
+{
+	if (p[0] < 0x80)
+	{
+		*c = p[0];
+		return 1;
+	}
+	int length = 0;
+	if ((p[0] & 0xE0) == 0xC0)
+	{
+		*c = p[0] & 0x1F;
+		length = 2;
+	}
+	else if ((p[0] & 0xF0) == 0xE0)
+	{
+		*c = p[0] & 0x0F;
+		length = 3;
+	}
+	else if ((p[0] & 0xF8) == 0xF0)
+	{
+		*c = p[0] & 0x07;
+		length = 4;
+	}
+	if (length == 0 || length > bytes)
+	{
+		*c = 0;
+		return 1;
+	}
+	for (int i = 1; i < length; i++)
+	{
+		if ((p[i] & 0xC0) != 0x80)
+		{
+			*c = 0;
+			return 1;
+		}
+		*c = (*c << 6) | (p[i] & 0x3F);
+	}
+	return length;
+}
+
+CharClass ClassifyChar(uint32_t c)
+{
+	if (c < 0x80)
+		return (isalnum((int)c) != 0) ? kCharWord : kCharSeparator;
+	if ((c >= 0x3040 && c <= 0x30FF) ||		// 平假名、片假名
+		(c >= 0x3400 && c <= 0x4DBF) ||		// CJK扩展A
+		(c >= 0x4E00 && c <= 0x9FFF) ||		// CJK基本区
+		(c >= 0xAC00 && c <= 0xD7AF) ||		// 韩文音节
+		(c >= 0xF900 && c <= 0xFAFF) ||		// CJK兼容汉字
+		(c >= 0x20000 && c <= 0x2FA1F))		// CJK扩展B及以后
+		return kCharCjk;
+	if ((c >= 0xFF10 && c <= 0xFF19) || (c >= 0xFF21 && c <= 0xFF3A) || (c >= 0xFF41 && c <= 0xFF5A))
+		return kCharWord;					// 全角字母和数字
+	if (c < 0xC0 ||							// Latin-1的标点和符号
+		(c >= 0x2000 && c <= 0x2BFF) ||		// 通用标点、各种符号
+		(c >= 0x3000 && c <= 0x303F) ||		// CJK标点
+		(c >= 0xFE30 && c <= 0xFE4F) ||		// CJK兼容形式
+		(c >= 0xFF00 && c <= 0xFFEF) ||		// 全角标点
+		(c >= 0x1F000 && c <= 0x1FAFF))		// emoji
+		return kCharSeparator;
+	return kCharWord;
+}
+
+// 单词中的字符：ASCII转小写，全角字母数字转为ASCII，其他字符原样保留
+void AppendWordChar(std::string& token, const char* p, int length, uint32_t c)
+{
+	if (c >= 0xFF01 && c <= 0xFF5E)
+		c -= 0xFEE0;
+	if (c < 0x80)
+		token.push_back((char)tolower((int)c));
+	else
+		token.append(p, length);
+}
+
+// 切词的状态，tokenizer和BuildMatchQuery共用
+struct Tokenizer
+{
+	Tokenizer(const char* text, int bytes)
+		: input(text), input_bytes(bytes), offset(0), position(-1), after_bigram(false)
+	{
+	}
+
+	// 返回false表示结束；single_cjk表示一个不与其他CJK字符相连的单字
+	bool Next(int* start, int* end, bool* single_cjk)
+	{
+		const unsigned char* p = (const unsigned char*)input;
+		while (offset < input_bytes)
+		{
+			uint32_t c = 0;
+			int length = DecodeUTF8(p + offset, input_bytes - offset, &c);
+			CharClass char_class = (c == 0) ? kCharSeparator : ClassifyChar(c);
+			if (char_class == kCharSeparator)
+			{
+				offset += length;
+				after_bigram = false;
+				continue;
+			}
+
+			*single_cjk = false;
+			token.clear();
+			*start = offset;
+			if (char_class == kCharWord)
+			{
+				after_bigram = false;
+				while (char_class == kCharWord)
+				{
+					AppendWordChar(token, input + offset, length, c);
+					offset += length;
+					if (offset >= input_bytes)
+						break;
+					length = DecodeUTF8(p + offset, input_bytes - offset, &c);
+					char_class = (c == 0) ? kCharSeparator : ClassifyChar(c);
+				}
+				*end = offset;
+				position++;
+				return true;
+			}
+
+			// 连续的CJK字符两两重叠成词：ABC -> AB BC，只有一个字时单独成词
+			int next = offset + length;
+			uint32_t next_c = 0;
+			int next_length = next < input_bytes ? DecodeUTF8(p + next, input_bytes - next, &next_c) : 0;
+			if (next_c != 0 && ClassifyChar(next_c) == kCharCjk)
+			{
+				*end = next + next_length;
+				after_bigram = true;
+			}
+			else if (after_bigram)
+			{
+				// 已经在上一个二元词中
+				offset = next;
+				after_bigram = false;
+				continue;
+			}
+			else
+			{
+				*end = next;
+				*single_cjk = true;
+			}
+			token.assign(input + *start, *end - *start);
+			offset = next;
+			position++;
+			return true;
+		}
+		return false;
+	}
+
+	const char* input;
+	int         input_bytes;
+	int         offset;
+	int         position;
+	bool        after_bigram;
+	std::string token;
+};
+
+struct TokenizerCursor : public sqlite3_tokenizer_cursor
+{
+	TokenizerCursor(sqlite3_tokenizer* owner, const char* input, int bytes) : tokenizer(input, bytes)
+	{
+		pTokenizer = owner;
+	}
+
+	Tokenizer tokenizer;
+};
+
+sqlite3_tokenizer g_tokenizer = { NULL };
+
+int TokenizerCreate(int argc, const char* const* argv, sqlite3_tokenizer** tokenizer)
+{
+	// 没有参数和状态，所有的表共用一个
+	*tokenizer = &g_tokenizer;
+	return SQLITE_OK;
+}
+
+int TokenizerDestroy(sqlite3_tokenizer* tokenizer)
+{
+	return SQLITE_OK;
+}
+
+int TokenizerOpen(sqlite3_tokenizer* tokenizer, const char* input, int bytes, sqlite3_tokenizer_cursor** cursor)
+{
+	if (input == NULL)
+		bytes = 0;
+	else if (bytes < 0)
+		bytes = (int)strlen(input);
+	TokenizerCursor* result = new (std::nothrow) TokenizerCursor(tokenizer, input, bytes);
+	if (result == NULL)
+		return SQLITE_NOMEM;
+	*cursor = result;
+	return SQLITE_OK;
+}
+
+int TokenizerClose(sqlite3_tokenizer_cursor* cursor)
+{
+	delete static_cast<TokenizerCursor*>(cursor);
+	return SQLITE_OK;
+}
+
+int TokenizerNext(sqlite3_tokenizer_cursor* cursor, const char** token, int* token_bytes,
+	int* start, int* end, int* position)
+{
+	Tokenizer& tokenizer = static_cast<TokenizerCursor*>(cursor)->tokenizer;
+	bool single_cjk = false;
+	if (!tokenizer.Next(start, end, &single_cjk))
+		return SQLITE_DONE;
+	*token       = tokenizer.token.data();
+	*token_bytes = (int)tokenizer.token.size();
+	*position    = tokenizer.position;
+	return SQLITE_OK;
+}
+
+const sqlite3_tokenizer_module g_tokenizer_module = {
+	0,
+	TokenizerCreate,
+	TokenizerDestroy,
+	TokenizerOpen,
+	TokenizerClose,
+	TokenizerNext,
+};
+
+// nim_fts_bm25(matchinfo(fts, 'pcnalx') [, column weights...])
+void RankBM25(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+	const double k1 = 1.2;
+	const double b  = 0.75;
+
+	if (argc < 1 || sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+	{
+		sqlite3_result_error(context, "nim_fts_bm25 needs matchinfo(fts, 'pcnalx')", -1);
+		return;
+	}
+	const unsigned int* info = (const unsigned int*)sqlite3_value_blob(argv[0]);
+	int info_count = sqlite3_value_bytes(argv[0]) / (int)sizeof(unsigned int);
+	if (info_count < 3)
+	{
+		sqlite3_result_double(context, 0);
+		return;
+	}
+	unsigned int phrases = info[0];
+	unsigned int columns = info[1];
+	double rows = info[2];
+	if (info_count < (int)(3 + 2 * columns + 3 * phrases * columns))
+	{
+		sqlite3_result_error(context, "nim_fts_bm25 needs matchinfo(fts, 'pcnalx')", -1);
+		return;
+	}
+	const unsigned int* average_tokens = info + 3;
+	const unsigned int* row_tokens     = average_tokens + columns;
+	const unsigned int* hits           = row_tokens + columns;
+
+	double score = 0;
+	for (unsigned int phrase = 0; phrase < phrases; phrase++)
+	{
+		for (unsigned int column = 0; column < columns; column++)
+		{
+			const unsigned int* hit = hits + 3 * (phrase * columns + column);
+			double frequency = hit[0];
+			double documents = hit[2];
+			if (frequency == 0)
+				continue;
+			double weight = ((int)column + 1 < argc) ? sqlite3_value_double(argv[column + 1]) : 1.0;
+			// 出现在超过一半的行中时idf为负，取一个很小的正数，不让常见词降低得分
+			double idf = log((rows - documents + 0.5) / (documents + 0.5));
+			if (idf <= 0)
+				idf = 1e-6;
+			double length_ratio = average_tokens[column] > 0 ? (double)row_tokens[column] / average_tokens[column] : 1.0;
+			score += weight * idf * (frequency * (k1 + 1)) / (frequency + k1 * (1 - b + b * length_ratio));
+		}
+	}
+	sqlite3_result_double(context, score);
+}
+
+std::string QuoteIdentifier(const std::string& name)
+{
+	std::string result("\"");
+	for (char c : name)
+	{
+		if (c == '"')
+			result.push_back('"');
+		result.push_back(c);
+	}
+	result.push_back('"');
+	return result;
+}
+
+std::string QuoteString(const std::string& text)
+{
+	std::string result("'");
+	for (char c : text)
+	{
+		if (c == '\'')
+			result.push_back('\'');
+		result.push_back(c);
+	}
+	result.push_back('\'');
+	return result;
+}
+
+// 依次执行多条没有结果的语句
+int Execute(SQLiteDB* db, const std::vector<std::string>& sqls)
+{
+	for (const std::string& sql : sqls)
+	{
+		int r = db->Query(sql.c_str());
+		if (r != SQLITE_OK)
+			return r;
+	}
+	return SQLITE_OK;
+}
+
+int StepToDone(SQLiteStatement& statement)
+{
+	int r = statement.NextRow();
+	return r == SQLITE_DONE ? SQLITE_OK : r;
+}
+
+}
+
+SQLiteFtsIndex::SQLiteFtsIndex(const std::string& name, const std::string& source_table, const std::vector<std::string>& columns)
+	: name_(name), source_table_(source_table), columns_(columns)
+{
+}
+
+SQLiteFtsIndex::~SQLiteFtsIndex()
+{
+	if (rebuild_state_ != nullptr)
+	{
+		rebuild_state_->running = false;
+		rebuild_state_->alive   = false;
+	}
+}
+
+int SQLiteFtsIndex::RegisterTokenizer(SQLiteDB* db)
+{
+	if (db == NULL || !db->IsValid())
+		return SQLITE_MISUSE;
+
+	sqlite3_db_config(db->sqlite3_, SQLITE_DBCONFIG_ENABLE_FTS3_TOKENIZER, 1, (int*)NULL);
+	SQLiteStatement statement;
+	int r = db->Query(statement, "SELECT fts3_tokenizer(?, ?)");
+	if (r != SQLITE_OK)
+		return r;
+	const sqlite3_tokenizer_module* module = &g_tokenizer_module;
+	statement.BindText(1, kTokenizerName);
+	statement.BindBlob(2, &module, (int)sizeof(module));
+	r = statement.NextRow();
+	if (r != SQLITE_ROW && r != SQLITE_DONE)
+		return r;
+	statement.Finalize();
+
+	return sqlite3_create_function(db->sqlite3_, "nim_fts_bm25", -1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+		NULL, &RankBM25, NULL, NULL);
+}
+
+bool SQLiteFtsIndex::Exists(SQLiteDB* db) const
+{
+	return db != NULL && db->DoesTableExist(name_.c_str());
+}
+
+std::string SQLiteFtsIndex::GetTriggerName(const char* suffix) const
+{
+	return QuoteIdentifier(name_ + suffix);
+}
+
+std::string SQLiteFtsIndex::GetPendingCondition(const char* row) const
+{
+	// 创建索引时已有而还没有补建索引的行由RebuildStep处理，触发器跳过它们
+	std::string condition("NOT EXISTS(SELECT 1 FROM ");
+	condition.append(kStateTable);
+	condition.append(" WHERE name=");
+	condition.append(QuoteString(name_));
+	condition.append(" AND ");
+	condition.append(row);
+	condition.append(">rebuild_from AND ");
+	condition.append(row);
+	condition.append("<=rebuild_to)");
+	return condition;
+}
+
+int SQLiteFtsIndex::Create(SQLiteDB* db)
+{
+	if (db == NULL || !db->IsValid() || columns_.empty())
+		return SQLITE_MISUSE;
+
+	std::string fts = QuoteIdentifier(name_);
+	std::string source = QuoteIdentifier(source_table_);
+	std::string column_list, old_values, new_values;
+	for (const std::string& column : columns_)
+	{
+		std::string quoted = QuoteIdentifier(column);
+		column_list.append(",").append(quoted);
+		old_values.append(",old.").append(quoted);
+		new_values.append(",new.").append(quoted);
+	}
+	std::string update_of = column_list.substr(1);
+
+	std::vector<std::string> sqls;
+	sqls.push_back(std::string("CREATE TABLE IF NOT EXISTS ") + kStateTable +
+		"(name TEXT PRIMARY KEY, rebuild_from INTEGER NOT NULL, rebuild_to INTEGER NOT NULL)");
+	if (!Exists(db))
+	{
+		sqls.push_back("CREATE VIRTUAL TABLE " + fts + " USING fts4(content=" + source + column_list +
+			", tokenize=" + kTokenizerName + ")");
+		// 已有的行留给RebuildStep，不在创建时一次建完
+		sqls.push_back(std::string("INSERT OR REPLACE INTO ") + kStateTable + " SELECT " + QuoteString(name_) +
+			", IFNULL(MIN(rowid), 1) - 1, IFNULL(MAX(rowid), 0) FROM " + source);
+		// 写入时逐步合并小段，查询不用遍历大量的段
+		sqls.push_back("INSERT INTO " + fts + "(" + fts + ") VALUES('automerge=8')");
+	}
+	std::string insert = "INSERT INTO " + fts + "(docid" + column_list + ") VALUES(new.rowid" + new_values + ");";
+	std::string remove = "DELETE FROM " + fts + " WHERE docid=old.rowid;";
+	sqls.push_back("CREATE TRIGGER IF NOT EXISTS " + GetTriggerName("_bu") + " BEFORE UPDATE OF " + update_of +
+		" ON " + source + " WHEN " + GetPendingCondition("old.rowid") + " BEGIN " + remove + " END");
+	sqls.push_back("CREATE TRIGGER IF NOT EXISTS " + GetTriggerName("_bd") + " BEFORE DELETE ON " + source +
+		" WHEN " + GetPendingCondition("old.rowid") + " BEGIN " + remove + " END");
+	sqls.push_back("CREATE TRIGGER IF NOT EXISTS " + GetTriggerName("_au") + " AFTER UPDATE OF " + update_of +
+		" ON " + source + " WHEN " + GetPendingCondition("new.rowid") + " BEGIN " + insert + " END");
+	sqls.push_back("CREATE TRIGGER IF NOT EXISTS " + GetTriggerName("_ai") + " AFTER INSERT ON " + source +
+		" WHEN " + GetPendingCondition("new.rowid") + " BEGIN " + insert + " END");
+
+	SQLiteAutoTransaction transaction(db);
+	int r = Execute(db, sqls);
+	if (r != SQLITE_OK)
+	{
+		transaction.Rollback();
+		return r;
+	}
+	return transaction.Commit() ? SQLITE_OK : db->GetLastErrorCode();
+}
+
+int SQLiteFtsIndex::Drop(SQLiteDB* db)
+{
+	if (db == NULL || !db->IsValid())
+		return SQLITE_MISUSE;
+
+	std::vector<std::string> sqls;
+	sqls.push_back("DROP TRIGGER IF EXISTS " + GetTriggerName("_bu"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + GetTriggerName("_bd"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + GetTriggerName("_au"));
+	sqls.push_back("DROP TRIGGER IF EXISTS " + GetTriggerName("_ai"));
+	sqls.push_back("DROP TABLE IF EXISTS " + QuoteIdentifier(name_));
+	if (db->DoesTableExist(kStateTable))
+		sqls.push_back(std::string("DELETE FROM ") + kStateTable + " WHERE name=" + QuoteString(name_));
+
+	SQLiteAutoTransaction transaction(db);
+	int r = Execute(db, sqls);
+	if (r != SQLITE_OK)
+	{
+		transaction.Rollback();
+		return r;
+	}
+	return transaction.Commit() ? SQLITE_OK : db->GetLastErrorCode();
+}
+
+int SQLiteFtsIndex::RebuildStep(SQLiteDB* db, int batch_rows, bool* finished)
+{
+	*finished = false;
+	if (db == NULL || !db->IsValid())
+		return SQLITE_MISUSE;
+
+	SQLiteAutoTransaction transaction(db);
+	SQLiteStatement statement;
+	int r = db->Query(statement, (std::string("SELECT rebuild_from, rebuild_to FROM ") + kStateTable + " WHERE name=?").c_str());
+	if (r != SQLITE_OK)
+	{
+		transaction.Rollback();
+		return r;
+	}
+	statement.BindText(1, name_.c_str());
+	r = statement.NextRow();
+	if (r != SQLITE_ROW)
+	{
+		transaction.Rollback();
+		*finished = (r == SQLITE_DONE);
+		return r == SQLITE_DONE ? SQLITE_OK : r;
+	}
+	sqlite3_int64 from = statement.GetInt64Field(0);
+	sqlite3_int64 to   = statement.GetInt64Field(1);
+	statement.Finalize();
+	if (from >= to)
+	{
+		transaction.Rollback();
+		*finished = true;
+		return SQLITE_OK;
+	}
+
+	std::string source = QuoteIdentifier(source_table_);
+	std::string column_list;
+	for (const std::string& column : columns_)
+		column_list.append(",").append(QuoteIdentifier(column));
+
+	// 这一批的最后一行
+	r = db->Query(statement, ("SELECT MAX(rowid) FROM (SELECT rowid FROM " + source +
+		" WHERE rowid>? AND rowid<=? ORDER BY rowid LIMIT ?)").c_str());
+	if (r == SQLITE_OK)
+	{
+		statement.BindInt64(1, from);
+		statement.BindInt64(2, to);
+		statement.BindInt(3, batch_rows > 0 ? batch_rows : 1);
+		r = statement.NextRow();
+	}
+	if (r != SQLITE_ROW)
+	{
+		transaction.Rollback();
+		return r;
+	}
+	sqlite3_int64 last = statement.IsNullField(0) ? to : statement.GetInt64Field(0);
+	statement.Finalize();
+
+	r = db->Query(statement, ("INSERT INTO " + QuoteIdentifier(name_) + "(docid" + column_list + ") SELECT rowid" +
+		column_list + " FROM " + source + " WHERE rowid>? AND rowid<=?").c_str());
+	if (r == SQLITE_OK)
+	{
+		statement.BindInt64(1, from);
+		statement.BindInt64(2, last);
+		r = StepToDone(statement);
+	}
+	statement.Finalize();
+	if (r == SQLITE_OK)
+	{
+		r = db->Query(statement, (std::string("UPDATE ") + kStateTable + " SET rebuild_from=? WHERE name=?").c_str());
+		if (r == SQLITE_OK)
+		{
+			statement.BindInt64(1, last);
+			statement.BindText(2, name_.c_str());
+			r = StepToDone(statement);
+		}
+		statement.Finalize();
+	}
+	if (r != SQLITE_OK)
+	{
+		transaction.Rollback();
+		return r;
+	}
+	if (!transaction.Commit())
+		return db->GetLastErrorCode();
+	*finished = (last >= to);
+	return SQLITE_OK;
+}
+
+sqlite3_int64 SQLiteFtsIndex::GetPendingRows(SQLiteDB* db) const
+{
+	if (db == NULL || !db->DoesTableExist(kStateTable))
+		return 0;
+
+	SQLiteStatement statement;
+	if (db->Query(statement, ("SELECT COUNT(*) FROM " + QuoteIdentifier(source_table_) + " AS s, " + kStateTable +
+		" AS st WHERE st.name=? AND s.rowid>st.rebuild_from AND s.rowid<=st.rebuild_to").c_str()) != SQLITE_OK)
+		return 0;
+	statement.BindText(1, name_.c_str());
+	if (statement.NextRow() != SQLITE_ROW)
+		return 0;
+	return statement.GetInt64Field(0);
+}
+
+void SQLiteFtsIndex::StartRebuild(AsyncSQLiteDB* db, int batch_rows/* = 500*/,
+	const std::function<void(int result)>& callback/* = nullptr*/)
+{
+	if (db == NULL || IsRebuilding())
+		return;
+
+	if (rebuild_state_ != nullptr)
+		rebuild_state_->alive = false;
+	rebuild_state_ = std::make_shared<RebuildState>();
+	rebuild_state_->running    = true;
+	rebuild_state_->alive      = true;
+	rebuild_state_->batch_rows = batch_rows > 0 ? batch_rows : 1;
+	rebuild_state_->callback   = callback;
+	rebuild_state_->index      = std::make_shared<SQLiteFtsIndex>(name_, source_table_, columns_);
+	PostRebuildStep(db, rebuild_state_);
+}
+
+void SQLiteFtsIndex::StopRebuild()
+{
+	// 已投递的步骤执行时发现已停止就不再继续，没有完成的部分下次继续
+	if (rebuild_state_ != nullptr)
+		rebuild_state_->running = false;
+}
+
+bool SQLiteFtsIndex::IsRebuilding() const
+{
+	return rebuild_state_ != nullptr && rebuild_state_->running;
+}
+
+void SQLiteFtsIndex::PostRebuildStep(AsyncSQLiteDB* db, const std::shared_ptr<RebuildState>& state)
+{
+	bool posted = db->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state](SQLiteDB* sqlite) {
+		if (!state->alive || !state->running)
+			return;
+
+		bool finished = false;
+		int r = state->index->RebuildStep(sqlite, state->batch_rows, &finished);
+		if (r == SQLITE_OK && !finished)
+		{
+			PostRebuildStep(db, state);
+			return;
+		}
+		state->running = false;
+		if (state->callback)
+			state->callback(r);
+	});
+	if (!posted)
+		state->running = false;
+}
+
+std::string SQLiteFtsIndex::BuildMatchQuery(const std::string& text)
+{
+	// 每个词中的各段组成一个短语，短语之间是AND；分隔符（包括引号、*和-）不会出现在短语中
+	std::string query;
+	std::string phrase;
+	Tokenizer tokenizer(text.data(), (int)text.size());
+	int last_end = -1;
+	int start = 0, end = 0;
+	bool single_cjk = false;
+	for (;;)
+	{
+		bool has_token = tokenizer.Next(&start, &end, &single_cjk);
+		// 与上一段相连（二元词互相重叠）的属于同一个词
+		if ((!has_token || start > last_end) && !phrase.empty())
+		{
+			if (!query.empty())
+				query.push_back(' ');
+			query.append("\"").append(phrase).append("\"");
+			phrase.clear();
+		}
+		if (!has_token)
+			break;
+		if (!phrase.empty())
+			phrase.push_back(' ');
+		phrase.append(tokenizer.token);
+		if (single_cjk)
+			phrase.push_back('*');
+		last_end = end;
+	}
+	return query;
+}
+
+int SQLiteFtsIndex::PrepareSearch(SQLiteDB* db, SQLiteStatement& statement,
+	const SQLiteFtsSearchOptions& options/* = SQLiteFtsSearchOptions()*/) const
+{
+	if (db == NULL || !db->IsValid())
+		return SQLITE_MISUSE;
+
+	std::string fts = QuoteIdentifier(name_);
+	std::string sql = "SELECT " + fts + ".docid, nim_fts_bm25(matchinfo(" + fts + ", 'pcnalx')) AS rank, offsets(" +
+		fts + ")";
+	for (const std::string& column : columns_)
+		sql += ", " + fts + "." + QuoteIdentifier(column);
+	sql += " FROM " + fts;
+	if (!options.filter.empty())
+		sql += " JOIN " + QuoteIdentifier(source_table_) + " AS s ON s.rowid=" + fts + ".docid";
+	sql += " WHERE " + fts + " MATCH ?1";
+	if (!options.filter.empty())
+		sql += " AND (" + options.filter + ")";
+	sql += " ORDER BY rank DESC LIMIT " + std::to_string(options.limit > 0 ? options.limit : -1) +
+		" OFFSET " + std::to_string(options.offset > 0 ? options.offset : 0);
+
+	return db->Query(statement, sql.c_str(), (int)sql.size());
+}
+
+std::string SQLiteFtsIndex::BuildSnippet(const SQLiteRow& row, const SQLiteFtsSearchOptions& options/* = SQLiteFtsSearchOptions()*/) const
+{
+	// offsets()每个匹配是四个整数：列、短语、字节偏移、字节数，二元词的范围互相重叠，合并后再高亮
+	std::vector<int> values;
+	std::string_view offsets = row.GetText(2);
+	for (size_t i = 0; i < offsets.size(); )
+	{
+		if (offsets[i] < '0' || offsets[i] > '9')
+		{
+			i++;
+			continue;
+		}
+		int value = 0;
+		for (; i < offsets.size() && offsets[i] >= '0' && offsets[i] <= '9'; i++)
+			value = value * 10 + (offsets[i] - '0');
+		values.push_back(value);
+	}
+
+	int column = options.snippet_column;
+	if (column < 0 || column >= (int)columns_.size())
+	{
+		std::vector<int> hits(columns_.size(), 0);
+		for (size_t i = 0; i + 3 < values.size(); i += 4)
+		{
+			if (values[i] >= 0 && values[i] < (int)hits.size())
+				hits[values[i]]++;
+		}
+		column = 0;
+		for (size_t i = 1; i < hits.size(); i++)
+		{
+			if (hits[i] > hits[column])
+				column = (int)i;
+		}
+	}
+	std::string_view text = row.GetText(3 + column);
+
+	std::vector<std::pair<size_t, size_t>> ranges;
+	for (size_t i = 0; i + 3 < values.size(); i += 4)
+	{
+		if (values[i] == column && (size_t)values[i + 2] + values[i + 3] <= text.size())
+			ranges.push_back(std::make_pair((size_t)values[i + 2], (size_t)values[i + 2] + values[i + 3]));
+	}
+	std::sort(ranges.begin(), ranges.end());
+	std::vector<std::pair<size_t, size_t>> merged;
+	for (const auto& range : ranges)
+	{
+		if (!merged.empty() && range.first <= merged.back().second)
+			merged.back().second = std::max(merged.back().second, range.second);
+		else
+			merged.push_back(range);
+	}
+
+	// 在第一个匹配之前留四分之一的字符，按字符而不是字节截取
+	int chars = options.snippet_chars > 0 ? options.snippet_chars : 1;
+	auto is_char_begin = [&text](size_t i) { return i >= text.size() || (text[i] & 0xC0) != 0x80; };
+	size_t begin = merged.empty() ? 0 : merged.front().first;
+	for (int before = chars / 4; begin > 0 && before > 0; before--)
+	{
+		do { begin--; } while (begin > 0 && !is_char_begin(begin));
+	}
+	size_t end = begin;
+	for (int count = 0; end < text.size() && count < chars; count++)
+	{
+		do { end++; } while (!is_char_begin(end));
+	}
+
+	std::string snippet;
+	if (begin > 0)
+		snippet.append(options.ellipsis);
+	size_t copied = begin;
+	for (const auto& range : merged)
+	{
+		size_t hit_begin = std::max(range.first, begin);
+		size_t hit_end = std::min(range.second, end);
+		if (hit_begin >= hit_end)
+			continue;
+		snippet.append(text.data() + copied, hit_begin - copied);
+		snippet.append(options.highlight_begin);
+		snippet.append(text.data() + hit_begin, hit_end - hit_begin);
+		snippet.append(options.highlight_end);
+		copied = hit_end;
+	}
+	snippet.append(text.data() + copied, end - copied);
+	if (end < text.size())
+		snippet.append(options.ellipsis);
+	return snippet;
+}
+
+int SQLiteFtsIndex::Search(SQLiteDB* db, const std::string& text, std::vector<SQLiteFtsHit>& hits,
+	const SQLiteFtsSearchOptions& options/* = SQLiteFtsSearchOptions()*/) const
+{
+	std::string match = BuildMatchQuery(text);
+	if (match.empty())
+		return SQLITE_OK;
+
+	SQLiteStatement statement;
+	int r = PrepareSearch(db, statement, options);
+	if (r == SQLITE_OK)
+		r = statement.BindText(1, match.data(), match.size());
+	if (r != SQLITE_OK)
+		return r;
+
+	SQLiteRowRange rows = db->Rows(statement);
+	for (SQLiteRow row : rows)
+	{
+		SQLiteFtsHit hit;
+		hit.rowid   = row.GetInt64(0);
+		hit.rank    = row.GetDouble(1);
+		hit.snippet = BuildSnippet(row, options);
+		hits.push_back(std::move(hit));
+	}
+	return rows.GetResult() == SQLITE_DONE ? SQLITE_OK : rows.GetResult();
+}
+
+DB_END_DECLS
@@ -0,0 +1,166 @@
+#ifndef __BASE_DB_FTS_H__
+#define __BASE_DB_FTS_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+DB_BEGIN_DECLS
+
+class AsyncSQLiteDB;
+
+/*
+    *  Purpose     A search result of SQLiteFtsIndex
+    */
+struct SQLiteFtsHit
+{
+    sqlite3_int64   rowid;      // rowid of the source table
+    double          rank;       // BM25 score, larger is better
+    std::string     snippet;    // matched text with the terms highlighted
+};
+
+/*
+    *  Purpose     Options of SQLiteFtsIndex::Search
+    *  Remark      filter is an SQL condition on the source table aliased "s", e.g. "s.session_id=?",
+    *              its parameters are bound from index 2 by PrepareSearch callers.
+    */
+struct SQLiteFtsSearchOptions
+{
+    SQLiteFtsSearchOptions()
+        : limit(50), offset(0), snippet_column(-1), snippet_chars(40),
+          highlight_begin("<b>"), highlight_end("</b>"), ellipsis("...")
+    {
+    }
+
+    int             limit;
+    int             offset;
+    int             snippet_column;     // -1 means the column which matches best
+    int             snippet_chars;      // Characters of a snippet, about a quarter of them are before the first match
+    std::string     highlight_begin;
+    std::string     highlight_end;
+    std::string     ellipsis;
+    std::string     filter;
+};
+
+/*
+    *  Purpose     Full-text index of some text columns of a table, replacing LIKE '%term%' full scans
+    *  Remark      The index is an FTS4 external-content table (content=<source table>), so the text is
+    *              not stored twice, and it is kept in sync with the source table by triggers.
+    *              FTS5 and the trigram tokenizer are not available in the bundled SQLite, the index uses
+    *              the "nim_cjk" tokenizer instead: Latin words and digits are tokens (ASCII is case folded),
+    *              and Chinese/Japanese/Korean text is split into overlapping bigrams, so a search of any
+    *              CJK substring of two or more characters matches, and one character is a prefix query.
+    *              The tokenizer and the rank function are registered per connection, RegisterTokenizer()
+    *              must be called on every connection which writes the source table or searches the index,
+    *              before the first statement touching them.
+    *              Rows existing when the index is created are indexed later by RebuildStep() in small
+    *              transactions (StartRebuild() runs the steps on an AsyncSQLiteDB thread), rows inserted
+    *              after that are indexed by the triggers at once.
+    *              The source table must be a rowid table whose rowids are not changed by UPDATE.
+    */
+class DB_EXPORT SQLiteFtsIndex
+{
+public:
+
+    /*
+        *  name            Name of the FTS table
+        *  source_table    The table to index
+        *  columns         Indexed TEXT columns of the source table
+        */
+    SQLiteFtsIndex(const std::string& name, const std::string& source_table, const std::vector<std::string>& columns);
+    virtual ~SQLiteFtsIndex();
+
+    /*
+        *  Purpose     Register the "nim_cjk" tokenizer and the nim_fts_bm25() rank function on db
+        */
+    static int RegisterTokenizer(SQLiteDB* db);
+
+    /*
+        *  Purpose     Create the FTS table and the triggers if they do not exist
+        *  Remark      Existing rows of the source table are not searchable until the rebuild finishes
+        */
+    int Create(SQLiteDB* db);
+
+    /*
+        *  Purpose     Drop the FTS table and the triggers
+        */
+    int Drop(SQLiteDB* db);
+
+    bool Exists(SQLiteDB* db) const;
+
+    /*
+        *  Purpose     Index at most batch_rows existing rows in one transaction
+        *  finished    Set to true when all the existing rows are indexed
+        */
+    int RebuildStep(SQLiteDB* db, int batch_rows, bool* finished);
+
+    /*
+        *  Purpose     Count of existing rows which are not indexed yet, 0 after the rebuild finishes
+        */
+    sqlite3_int64 GetPendingRows(SQLiteDB* db) const;
+
+    /*
+        *  Purpose     Run RebuildStep() as low priority tasks on the database thread until it finishes,
+        *              so queries posted between steps run first
+        *  callback    Called on the database thread with SQLITE_OK or the error which stopped the rebuild
+        */
+    void StartRebuild(AsyncSQLiteDB* db, int batch_rows = 500, const std::function<void(int result)>& callback = nullptr);
+    void StopRebuild();
+    bool IsRebuilding() const;
+
+    /*
+        *  Purpose     Convert user input to an FTS query: every word separated by spaces must match as a phrase,
+        *              a single CJK character is a prefix query. Returns empty if nothing can be searched.
+        */
+    static std::string BuildMatchQuery(const std::string& text);
+
+    /*
+        *  Purpose     Prepare a search sorted by rank
+        *  Remark      Columns of the result: 0 rowid, 1 rank, 2 offsets() of the matches, then the indexed columns.
+        *              Parameter 1 is the query of BuildMatchQuery(), it is bound without copying and must be valid
+        *              until the statement is stepped. The parameters of options.filter start from 2.
+        */
+    int PrepareSearch(SQLiteDB* db, SQLiteStatement& statement,
+        const SQLiteFtsSearchOptions& options = SQLiteFtsSearchOptions()) const;
+
+    /*
+        *  Purpose     Snippet of a row of PrepareSearch, the matched text is highlighted
+        *  Remark      The snippet() of FTS4 does not support the overlapping bigrams of the tokenizer
+        */
+    std::string BuildSnippet(const SQLiteRow& row, const SQLiteFtsSearchOptions& options = SQLiteFtsSearchOptions()) const;
+
+    /*
+        *  Purpose     Search text, options.filter must not have parameters
+        */
+    int Search(SQLiteDB* db, const std::string& text, std::vector<SQLiteFtsHit>& hits,
+        const SQLiteFtsSearchOptions& options = SQLiteFtsSearchOptions()) const;
+
+    const std::string& GetName() const { return name_; }
+
+private:
+
+    // 与调度器的任务共享，任务可能在对象析构之后才执行
+    struct RebuildState
+    {
+        std::atomic_bool    running;
+        std::atomic_bool    alive;
+        int                 batch_rows;
+        std::function<void(int result)> callback;
+        std::shared_ptr<SQLiteFtsIndex> index;  // 只复制表名和列名
+    };
+
+    std::string GetTriggerName(const char* suffix) const;
+    std::string GetPendingCondition(const char* row) const;
+    static void PostRebuildStep(AsyncSQLiteDB* db, const std::shared_ptr<RebuildState>& state);
+
+    std::string                     name_;
+    std::string                     source_table_;
+    std::vector<std::string>        columns_;
+    std::shared_ptr<RebuildState>   rebuild_state_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_FTS_H__
@@ -0,0 +1,566 @@
+// Collations and functions of nim_db
+
+#include "nim_db/db_functions.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <vector>
+#include "extension/json/json_sax_parser.h"
+#include "nim_db/db_pinyin_table.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include "base/strings/utf_string_conversions.h"
+#endif
+
+DB_BEGIN_DECLS
+
+namespace
+{
+
+// 一级汉字都在 CJK 基本区的这个范围内
+const uint32_t kPinyinTableBegin	= 0x4E00;
+const uint32_t kPinyinTableEnd		= 0x9FA6;
+// 排序权重：ASCII 非字母在最前，之后每个字母一段，段内先是字母本身再是这个声母的汉字，
+// 其他字符在所有字母之后按码位排列
+const uint32_t kLetterWeightBase	= 0x100;
+const uint32_t kLetterWeightRange	= 0x1000;
+const uint32_t kOtherWeightBase		= kLetterWeightBase + 26 * kLetterWeightRange;
+
+// 解码一个UTF-8字符，非法的字节当作一个单字节字符，码位为0
+int DecodeUTF8(const unsigned char* p, size_t bytes, uint32_t* c)
+{
+	if (p[0] < 0x80)
+	{
+		*c = p[0];
+		return 1;
+	}
+	int length = 0;
+	if ((p[0] & 0xE0) == 0xC0)
+	{
+		*c = p[0] & 0x1F;
+		length = 2;
+	}
+	else if ((p[0] & 0xF0) == 0xE0)
+	{
+		*c = p[0] & 0x0F;
+		length = 3;
+	}
+	else if ((p[0] & 0xF8) == 0xF0)
+	{
+		*c = p[0] & 0x07;
+		length = 4;
+	}
+	if (length == 0 || (size_t)length > bytes)
+	{
+		*c = 0;
+		return 1;
+	}
+	for (int i = 1; i < length; i++)
+	{
+		if ((p[i] & 0xC0) != 0x80)
+		{
+			*c = 0;
+			return 1;
+		}
+		*c = (*c << 6) | (p[i] & 0x3F);
+	}
+	return length;
+}
+
+// 码位到拼音序的表，值为拼音序加 1，0 表示不是一级汉字，第一次用到时生成
+const std::vector<uint16_t>& GetPinyinRankTable()
+{
+	static const std::vector<uint16_t> table = []() {
+		std::vector<uint16_t> ranks(kPinyinTableEnd - kPinyinTableBegin, 0);
+		for (size_t i = 0; i < sizeof(kPinyinOrderedChars) / sizeof(kPinyinOrderedChars[0]); i++)
+			ranks[kPinyinOrderedChars[i] - kPinyinTableBegin] = (uint16_t)(i + 1);
+		return ranks;
+	}();
+	return table;
+}
+
+// 一级汉字的拼音序，其他字符返回 -1
+int GetPinyinRank(uint32_t c)
+{
+	if (c < kPinyinTableBegin || c >= kPinyinTableEnd)
+		return -1;
+	return (int)GetPinyinRankTable()[c - kPinyinTableBegin] - 1;
+}
+
+char GetRankInitial(int rank)
+{
+	size_t i = sizeof(kPinyinInitials) / sizeof(kPinyinInitials[0]) - 1;
+	while (i > 0 && kPinyinInitials[i].first > rank)
+		i--;
+	return kPinyinInitials[i].initial;
+}
+
+// 全角字母和数字转为 ASCII
+uint32_t NormalizeChar(uint32_t c)
+{
+	if ((c >= 0xFF10 && c <= 0xFF19) || (c >= 0xFF21 && c <= 0xFF3A) || (c >= 0xFF41 && c <= 0xFF5A))
+		return c - 0xFEE0;
+	return c;
+}
+
+uint32_t GetPinyinWeight(uint32_t c)
+{
+	c = NormalizeChar(c);
+	if (c < 0x80)
+	{
+		if (isalpha((int)c) == 0)
+			return c;
+		return kLetterWeightBase + (tolower((int)c) - 'a') * kLetterWeightRange;
+	}
+	int rank = GetPinyinRank(c);
+	if (rank < 0)
+		return kOtherWeightBase + c;
+	return kLetterWeightBase + (GetRankInitial(rank) - 'a') * kLetterWeightRange + 1 + rank;
+}
+
+int CompareBytes(std::string_view a, std::string_view b)
+{
+	int r = a.compare(b);
+	return r < 0 ? -1 : (r > 0 ? 1 : 0);
+}
+
+struct JsonPathStep
+{
+	bool		is_index;
+	int64_t		index;
+	std::string	key;
+};
+
+typedef std::vector<JsonPathStep> JsonPath;
+
+bool ParseJsonPath(std::string_view path, JsonPath& steps)
+{
+	steps.clear();
+	size_t i = 0;
+	// 省略了 "$." 的路径以键开始
+	std::string implicit;
+	if (!path.empty() && path[0] == '$')
+	{
+		i++;
+	}
+	else if (!path.empty() && path[0] != '.' && path[0] != '[')
+	{
+		implicit.assign(".").append(path.data(), path.size());
+		path = implicit;
+	}
+	while (i < path.size())
+	{
+		JsonPathStep step;
+		step.is_index = false;
+		step.index = 0;
+		if (path[i] == '[')
+		{
+			size_t end = path.find(']', i);
+			if (end == std::string_view::npos || end == i + 1)
+				return false;
+			for (size_t j = i + 1; j < end; j++)
+			{
+				if (path[j] < '0' || path[j] > '9')
+					return false;
+				step.index = step.index * 10 + (path[j] - '0');
+			}
+			step.is_index = true;
+			i = end + 1;
+		}
+		else if (path[i] == '.')
+		{
+			i++;
+			if (i < path.size() && path[i] == '"')
+			{
+				size_t end = path.find('"', i + 1);
+				if (end == std::string_view::npos)
+					return false;
+				step.key.assign(path.data() + i + 1, end - i - 1);
+				i = end + 1;
+			}
+			else
+			{
+				size_t end = path.find_first_of(".[", i);
+				if (end == std::string_view::npos)
+					end = path.size();
+				if (end == i)
+					return false;
+				step.key.assign(path.data() + i, end - i);
+				i = end;
+			}
+		}
+		else
+		{
+			return false;
+		}
+		steps.push_back(step);
+	}
+	return true;
+}
+
+void AppendJsonString(std::string& out, std::string_view value)
+{
+	out.push_back('"');
+	for (char c : value)
+	{
+		switch (c)
+		{
+		case '"':	out.append("\\\""); break;
+		case '\\':	out.append("\\\\"); break;
+		case '\b':	out.append("\\b"); break;
+		case '\f':	out.append("\\f"); break;
+		case '\n':	out.append("\\n"); break;
+		case '\r':	out.append("\\r"); break;
+		case '\t':	out.append("\\t"); break;
+		default:
+			if ((unsigned char)c < 0x20)
+			{
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int)(unsigned char)c);
+				out.append(buffer);
+			}
+			else
+			{
+				out.push_back(c);
+			}
+			break;
+		}
+	}
+	out.push_back('"');
+}
+
+// 边解析边沿路径匹配，找到值后设置结果并中止解析，不再解析后面的部分
+class JsonFieldExtractor : public NS_EXTENSION::JsonHandler
+{
+public:
+	JsonFieldExtractor(SQLiteFunctionCall& call, const JsonPath& path)
+		: call_(call), path_(path), found_(false), capture_level_(0), need_comma_(false) {}
+
+	bool found() const { return found_; }
+
+	virtual bool OnNull() override
+	{
+		if (capture_level_ > 0)
+			return Write("null");
+		if (BeginValue() != kTarget)
+			return true;
+		call_.SetNull();
+		return Found();
+	}
+	virtual bool OnBool(bool value) override
+	{
+		if (capture_level_ > 0)
+			return Write(value ? "true" : "false");
+		if (BeginValue() != kTarget)
+			return true;
+		call_.SetInt64(value ? 1 : 0);
+		return Found();
+	}
+	virtual bool OnInt(int64_t value) override
+	{
+		if (capture_level_ > 0)
+			return Write(std::to_string(value));
+		if (BeginValue() != kTarget)
+			return true;
+		call_.SetInt64(value);
+		return Found();
+	}
+	virtual bool OnUint(uint64_t value) override
+	{
+		if (capture_level_ > 0)
+			return Write(std::to_string(value));
+		if (BeginValue() != kTarget)
+			return true;
+		// 超出 INTEGER 的范围，与 json_extract 一样作为 REAL
+		call_.SetDouble((double)value);
+		return Found();
+	}
+	virtual bool OnDouble(double value) override
+	{
+		if (capture_level_ > 0)
+		{
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.17g", value);
+			return Write(buffer);
+		}
+		if (BeginValue() != kTarget)
+			return true;
+		call_.SetDouble(value);
+		return Found();
+	}
+	virtual bool OnString(std::string_view value, bool stable) override
+	{
+		if (capture_level_ > 0)
+		{
+			WriteSeparator();
+			AppendJsonString(captured_, value);
+			need_comma_ = true;
+			return true;
+		}
+		if (BeginValue() != kTarget)
+			return true;
+		call_.SetText(value);
+		return Found();
+	}
+	virtual bool OnStartObject() override { return StartContainer(true); }
+	virtual bool OnKey(std::string_view key, bool stable) override
+	{
+		if (capture_level_ > 0)
+		{
+			WriteSeparator();
+			AppendJsonString(captured_, key);
+			captured_.push_back(':');
+			need_comma_ = false;
+			return true;
+		}
+		Frame& frame = frames_.back();
+		if (frame.on_path)
+		{
+			const JsonPathStep& step = path_[frames_.size() - 1];
+			frame.key_matched = !step.is_index && key == step.key;
+		}
+		return true;
+	}
+	virtual bool OnEndObject(size_t member_count) override { return EndContainer('}'); }
+	virtual bool OnStartArray() override { return StartContainer(false); }
+	virtual bool OnEndArray(size_t element_count) override { return EndContainer(']'); }
+
+private:
+	enum ValueKind
+	{
+		kOffPath,
+		kOnPath,	// 路径经过的容器
+		kTarget,
+	};
+	struct Frame
+	{
+		Frame(bool object, bool path) : is_object(object), on_path(path), key_matched(false), count(0) {}
+		bool	is_object;
+		bool	on_path;
+		bool	key_matched;
+		int64_t	count;
+	};
+
+	// 一个值开始时判断它在不在路径上
+	ValueKind BeginValue()
+	{
+		if (frames_.empty())
+			return path_.empty() ? kTarget : kOnPath;
+		Frame& frame = frames_.back();
+		int64_t index = frame.count++;
+		if (!frame.on_path)
+			return kOffPath;
+		const JsonPathStep& step = path_[frames_.size() - 1];
+		bool match = frame.is_object ? frame.key_matched : (step.is_index && step.index == index);
+		if (!match)
+			return kOffPath;
+		return frames_.size() == path_.size() ? kTarget : kOnPath;
+	}
+
+	bool StartContainer(bool is_object)
+	{
+		if (capture_level_ > 0)
+		{
+			WriteSeparator();
+			captured_.push_back(is_object ? '{' : '[');
+			need_comma_ = false;
+			capture_level_++;
+			return true;
+		}
+		ValueKind kind = BeginValue();
+		if (kind == kTarget)
+		{
+			// 对象和数组的结果是它的 JSON 文本
+			captured_.assign(1, is_object ? '{' : '[');
+			need_comma_ = false;
+			capture_level_ = 1;
+			return true;
+		}
+		frames_.push_back(Frame(is_object, kind == kOnPath));
+		return true;
+	}
+
+	bool EndContainer(char end)
+	{
+		if (capture_level_ > 0)
+		{
+			captured_.push_back(end);
+			need_comma_ = true;
+			if (--capture_level_ > 0)
+				return true;
+			call_.SetText(captured_);
+			return Found();
+		}
+		// 路径经过的容器结束了还没找到，后面不会再有
+		bool on_path = frames_.back().on_path;
+		frames_.pop_back();
+		return !on_path;
+	}
+
+	void WriteSeparator()
+	{
+		if (need_comma_)
+			captured_.push_back(',');
+	}
+
+	bool Write(const std::string& value)
+	{
+		WriteSeparator();
+		captured_.append(value);
+		need_comma_ = true;
+		return true;
+	}
+
+	bool Found()
+	{
+		found_ = true;
+		return false;
+	}
+
+	SQLiteFunctionCall& call_;
+	const JsonPath& path_;
+	bool found_;
+	std::vector<Frame> frames_;
+	int capture_level_;
+	std::string captured_;
+	bool need_comma_;
+};
+
+void ExtractJsonByPath(SQLiteFunctionCall& call, std::string_view json, const JsonPath& path)
+{
+	JsonFieldExtractor extractor(call, path);
+	NS_EXTENSION::JsonSaxParser parser(&extractor);
+	// SQLite 的 TEXT 已经是 UTF-8
+	parser.set_validate_utf8(false);
+	parser.Feed(json);
+	if (!extractor.found())
+		call.SetNull();
+}
+
+void DeleteJsonPath(void* path)
+{
+	delete (JsonPath*)path;
+}
+
+void OnJsonExtract(SQLiteFunctionCall& call)
+{
+	if (call.IsNull(0) || call.IsNull(1))
+	{
+		call.SetNull();
+		return;
+	}
+	// 路径一般是常量，解析的结果缓存到语句的下一行
+	JsonPath* cached = (JsonPath*)call.GetAuxData(1);
+	if (cached != NULL)
+	{
+		ExtractJsonByPath(call, call.GetText(0), *cached);
+		return;
+	}
+	std::unique_ptr<JsonPath> path(new JsonPath);
+	if (!ParseJsonPath(call.GetText(1), *path))
+	{
+		call.SetError("nim_json_extract: bad path");
+		return;
+	}
+	ExtractJsonByPath(call, call.GetText(0), *path);
+	// 失败时 SQLite 会立即释放它，所以放在最后
+	call.SetAuxData(1, path.release(), &DeleteJsonPath);
+}
+
+} // namespace
+
+int SQLiteBuiltinFunctions::Register(SQLiteDB* db)
+{
+	if (db == NULL || !db->IsValid())
+		return SQLITE_MISUSE;
+
+	int r = db->CreateCollation("NIM_PINYIN", &SQLiteBuiltinFunctions::ComparePinyin);
+	if (r != SQLITE_OK)
+		return r;
+	r = db->CreateCollation("NIM_LOCALE", &SQLiteBuiltinFunctions::CompareLocale);
+	if (r != SQLITE_OK)
+		return r;
+	r = db->CreateScalarFunction("nim_pinyin_initial", [](std::string_view text) {
+		return std::string(1, GetPinyinInitial(text));
+	});
+	if (r != SQLITE_OK)
+		return r;
+	return db->CreateFunction("nim_json_extract", 2, &OnJsonExtract);
+}
+
+int SQLiteBuiltinFunctions::ComparePinyin(std::string_view a, std::string_view b)
+{
+	const unsigned char* p1 = (const unsigned char*)a.data();
+	const unsigned char* p2 = (const unsigned char*)b.data();
+	size_t i1 = 0;
+	size_t i2 = 0;
+	while (i1 < a.size() && i2 < b.size())
+	{
+		uint32_t c1 = 0;
+		uint32_t c2 = 0;
+		i1 += DecodeUTF8(p1 + i1, a.size() - i1, &c1);
+		i2 += DecodeUTF8(p2 + i2, b.size() - i2, &c2);
+		uint32_t w1 = GetPinyinWeight(c1);
+		uint32_t w2 = GetPinyinWeight(c2);
+		if (w1 != w2)
+			return w1 < w2 ? -1 : 1;
+	}
+	if (i1 < a.size())
+		return 1;
+	if (i2 < b.size())
+		return -1;
+	// 大小写或全角半角不同的按字节区分，保证不相同的字符串不相等
+	return CompareBytes(a, b);
+}
+
+int SQLiteBuiltinFunctions::CompareLocale(std::string_view a, std::string_view b)
+{
+	int r = 0;
+#if defined(OS_WIN)
+	std::wstring wide_a = base::UTF8ToWide(base::StringPiece(a.data(), a.size()));
+	std::wstring wide_b = base::UTF8ToWide(base::StringPiece(b.data(), b.size()));
+	r = CompareStringEx(LOCALE_NAME_USER_DEFAULT, 0, wide_a.data(), (int)wide_a.size(),
+		wide_b.data(), (int)wide_b.size(), NULL, NULL, 0);
+	// 失败时返回 0，按字节比较
+	r = r == 0 ? 0 : r - CSTR_EQUAL;
+#else
+	// strcoll 要以 0 结尾的字符串
+	std::string string_a(a);
+	std::string string_b(b);
+	r = strcoll(string_a.c_str(), string_b.c_str());
+#endif
+	if (r != 0)
+		return r < 0 ? -1 : 1;
+	return CompareBytes(a, b);
+}
+
+char SQLiteBuiltinFunctions::GetPinyinInitial(std::string_view text)
+{
+	if (text.empty())
+		return '#';
+	uint32_t c = 0;
+	DecodeUTF8((const unsigned char*)text.data(), text.size(), &c);
+	c = NormalizeChar(c);
+	if (c < 0x80)
+		return isalpha((int)c) != 0 ? (char)toupper((int)c) : '#';
+	int rank = GetPinyinRank(c);
+	if (rank < 0)
+		return '#';
+	return (char)toupper(GetRankInitial(rank));
+}
+
+void SQLiteBuiltinFunctions::ExtractJson(SQLiteFunctionCall& call, std::string_view json, std::string_view path)
+{
+	JsonPath steps;
+	if (!ParseJsonPath(path, steps))
+	{
+		call.SetNull();
+		return;
+	}
+	ExtractJsonByPath(call, json, steps);
+}
+
+DB_END_DECLS
@@ -0,0 +1,64 @@
+#ifndef __BASE_DB_FUNCTIONS_H__
+#define __BASE_DB_FUNCTIONS_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <string>
+#include <string_view>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Collations and functions of nim_db, so rows are sorted and filtered inside SQLite
+    *              instead of being read out and sorted or parsed in C++
+    *              COLLATE NIM_PINYIN              Chinese by pinyin, mixed with Latin letters by the initial,
+    *                                              e.g. "Alice" < "安娜" < "Bob" < "白雪" < "陈"
+    *              COLLATE NIM_LOCALE              The order of the user locale of the system
+    *              nim_pinyin_initial(text)        Upper case pinyin initial or letter of the first
+    *                                              character, '#' for the others, for an A-Z index bar
+    *              nim_json_extract(json, path)    The value at path of a JSON text, see ExtractJson
+    *  Remark      Registered per connection like SQLiteFtsIndex::RegisterTokenizer. An index using
+    *              NIM_LOCALE has to be rebuilt (REINDEX) when the user locale changes.
+    */
+class DB_EXPORT SQLiteBuiltinFunctions
+{
+public:
+
+    static int Register(SQLiteDB* db);
+
+    /*
+        *  Purpose     The order of NIM_PINYIN
+        *  Remark      The 3755 level 1 characters of GB2312, which are the common ones, are ordered by
+        *              pinyin, the other Chinese characters follow all the letters by code point. ASCII
+        *              letters are compared case-insensitively and come before the Chinese characters of
+        *              the same initial. Strings equal in that order are compared by bytes at last.
+        */
+    static int ComparePinyin(std::string_view a, std::string_view b);
+
+    /*
+        *  Purpose     The order of NIM_LOCALE
+        *  Remark      CompareStringEx with the user default locale on Windows, strcoll of the LC_COLLATE
+        *              set by setlocale() elsewhere, which is byte order for the default "C" locale.
+        */
+    static int CompareLocale(std::string_view a, std::string_view b);
+
+    /*
+        *  Purpose     'A' - 'Z' by the first character of text, '#' if it is not a letter or a level 1
+        *              character of GB2312
+        */
+    static char GetPinyinInitial(std::string_view text);
+
+    /*
+        *  Purpose     Set the result of call to the value at path of json, like json_extract of SQLite
+        *  path        "$" and then ".key" or "[index]" steps, e.g. "$.user.tags[0]", the leading "$" can
+        *              be omitted, a key with '.' or '[' is quoted: $."a.b"
+        *  Remark      The text is parsed by a streaming parser up to the value only, without building
+        *              a document. A string, number, true/false (1/0) or null is returned as its SQL value,
+        *              an object or array as its compact JSON text. NULL is returned if the path is not
+        *              found or the JSON is malformed before the value, the rest of the text is not checked.
+        *              With the same key repeated in an object the first one is used.
+        */
+    static void ExtractJson(SQLiteFunctionCall& call, std::string_view json, std::string_view path);
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_FUNCTIONS_H__
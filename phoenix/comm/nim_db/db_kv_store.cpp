@@ -0,0 +1,374 @@
+// Key-value store with a write-through cache
+
+#include "nim_db/db_kv_store.h"
+#include "nim_db/db_batch_writer.h"
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "base/containers/mru_cache.h"
+
+DB_BEGIN_DECLS
+
+struct SQLiteKVStore::Shard
+{
+	struct Entry
+	{
+		bool            exists;     // false表示已知不存在
+		SQLiteKVValue   value;
+	};
+
+	// 已写入缓存而还没有提交的写，提交前缓存项被淘汰时仍以它为准
+	struct PendingWrite
+	{
+		uint64_t        sequence;
+		bool            exists;
+		SQLiteKVValue   value;
+	};
+
+	explicit Shard(size_t max_entries) : cache(max_entries), epoch(0), next_sequence(0) {}
+
+	std::mutex                                          lock;
+	base::HashingMRUCache<std::string, Entry>           cache;
+	std::unordered_map<std::string, PendingWrite>       pending;
+	uint64_t                                            epoch;          // 每次写或失效时加一，读数据库期间有变化时不缓存读到的值
+	uint64_t                                            next_sequence;
+};
+
+namespace
+{
+
+int BindValue(SQLiteStatement& statement, int index, const SQLiteKVValue& value)
+{
+	switch (value.type)
+	{
+	case SQLiteKVValue::kTypeInt64:
+		return statement.BindInt64(index, value.int_value);
+	case SQLiteKVValue::kTypeDouble:
+		return statement.BindDouble(index, value.double_value);
+	case SQLiteKVValue::kTypeString:
+		return statement.BindText(index, value.string_value.data(), value.string_value.size());
+	case SQLiteKVValue::kTypeBlob:
+		return statement.BindBlob(index, value.string_value.data(), (int)value.string_value.size());
+	}
+	return SQLITE_MISUSE;
+}
+
+}
+
+SQLiteKVStore::SQLiteKVStore(SQLiteDB* db, SQLiteBatchWriter* writer, const std::string& table/* = "nim_kv"*/,
+	size_t cache_entries/* = 1024*/, size_t shards/* = 8*/)
+	: db_(db), writer_(writer), table_(table),
+	  hits_(0), negative_hits_(0), misses_(0), writes_(0), write_errors_(0)
+{
+	select_sql_  = "SELECT value FROM " + table_ + " WHERE key=?";
+	replace_sql_ = "INSERT OR REPLACE INTO " + table_ + "(key, value) VALUES(?, ?)";
+	delete_sql_  = "DELETE FROM " + table_ + " WHERE key=?";
+
+	if (shards == 0)
+		shards = 1;
+	size_t entries_per_shard = (cache_entries + shards - 1) / shards;
+	if (entries_per_shard == 0)
+		entries_per_shard = 1;
+	for (size_t i = 0; i < shards; i++)
+		shards_.push_back(std::unique_ptr<Shard>(new Shard(entries_per_shard)));
+}
+
+SQLiteKVStore::~SQLiteKVStore()
+{
+	// 写完成的回调要访问分片
+	Flush();
+}
+
+int SQLiteKVStore::Init()
+{
+	if (db_ == NULL || !db_->IsValid())
+		return SQLITE_MISUSE;
+	std::string sql = "CREATE TABLE IF NOT EXISTS " + table_ + "(key TEXT PRIMARY KEY NOT NULL, value) WITHOUT ROWID";
+	return db_->Query(sql.c_str());
+}
+
+SQLiteKVStore::Shard& SQLiteKVStore::GetShard(const std::string& key)
+{
+	return *shards_[std::hash<std::string>()(key) % shards_.size()];
+}
+
+bool SQLiteKVStore::Get(const std::string& key, SQLiteKVValue* value)
+{
+	Shard& shard = GetShard(key);
+	uint64_t epoch = 0;
+	{
+		std::lock_guard<std::mutex> auto_lock(shard.lock);
+		auto pending = shard.pending.find(key);
+		if (pending != shard.pending.end())
+		{
+			hits_++;
+			if (pending->second.exists && value != NULL)
+				*value = pending->second.value;
+			return pending->second.exists;
+		}
+		auto cached = shard.cache.Get(key);
+		if (cached != shard.cache.end())
+		{
+			if (cached->second.exists)
+				hits_++;
+			else
+				negative_hits_++;
+			if (cached->second.exists && value != NULL)
+				*value = cached->second.value;
+			return cached->second.exists;
+		}
+		epoch = shard.epoch;
+	}
+
+	// 不持锁读数据库，同一分片的其他键不用等待
+	misses_++;
+	Shard::Entry entry;
+	int r = ReadFromDB(key, &entry.value);
+	if (r != SQLITE_ROW && r != SQLITE_DONE)
+		return false;
+	entry.exists = (r == SQLITE_ROW);
+	{
+		std::lock_guard<std::mutex> auto_lock(shard.lock);
+		if (shard.epoch == epoch)
+			shard.cache.Put(key, entry);
+	}
+	if (entry.exists && value != NULL)
+		*value = entry.value;
+	return entry.exists;
+}
+
+bool SQLiteKVStore::Contains(const std::string& key)
+{
+	return Get(key, NULL);
+}
+
+int64_t SQLiteKVStore::GetInt64(const std::string& key, int64_t default_value/* = 0*/)
+{
+	SQLiteKVValue value;
+	if (!Get(key, &value) || value.type != SQLiteKVValue::kTypeInt64)
+		return default_value;
+	return value.int_value;
+}
+
+double SQLiteKVStore::GetDouble(const std::string& key, double default_value/* = 0*/)
+{
+	SQLiteKVValue value;
+	if (!Get(key, &value))
+		return default_value;
+	if (value.type == SQLiteKVValue::kTypeDouble)
+		return value.double_value;
+	if (value.type == SQLiteKVValue::kTypeInt64)
+		return (double)value.int_value;
+	return default_value;
+}
+
+bool SQLiteKVStore::GetBool(const std::string& key, bool default_value/* = false*/)
+{
+	SQLiteKVValue value;
+	if (!Get(key, &value) || value.type != SQLiteKVValue::kTypeInt64)
+		return default_value;
+	return value.int_value != 0;
+}
+
+std::string SQLiteKVStore::GetString(const std::string& key, const std::string& default_value/* = std::string()*/)
+{
+	SQLiteKVValue value;
+	if (!Get(key, &value) || value.type != SQLiteKVValue::kTypeString)
+		return default_value;
+	return value.string_value;
+}
+
+std::string SQLiteKVStore::GetBlob(const std::string& key, const std::string& default_value/* = std::string()*/)
+{
+	SQLiteKVValue value;
+	if (!Get(key, &value) || value.type != SQLiteKVValue::kTypeBlob)
+		return default_value;
+	return value.string_value;
+}
+
+bool SQLiteKVStore::Set(const std::string& key, const SQLiteKVValue& value)
+{
+	return Write(key, &value);
+}
+
+bool SQLiteKVStore::SetInt64(const std::string& key, int64_t value)
+{
+	SQLiteKVValue kv_value;
+	kv_value.type      = SQLiteKVValue::kTypeInt64;
+	kv_value.int_value = value;
+	return Write(key, &kv_value);
+}
+
+bool SQLiteKVStore::SetDouble(const std::string& key, double value)
+{
+	SQLiteKVValue kv_value;
+	kv_value.type         = SQLiteKVValue::kTypeDouble;
+	kv_value.double_value = value;
+	return Write(key, &kv_value);
+}
+
+bool SQLiteKVStore::SetBool(const std::string& key, bool value)
+{
+	return SetInt64(key, value ? 1 : 0);
+}
+
+bool SQLiteKVStore::SetString(const std::string& key, const std::string& value)
+{
+	SQLiteKVValue kv_value;
+	kv_value.type         = SQLiteKVValue::kTypeString;
+	kv_value.string_value = value;
+	return Write(key, &kv_value);
+}
+
+bool SQLiteKVStore::SetBlob(const std::string& key, const void* data, size_t size)
+{
+	SQLiteKVValue kv_value;
+	kv_value.type = SQLiteKVValue::kTypeBlob;
+	kv_value.string_value.assign((const char*)data, size);
+	return Write(key, &kv_value);
+}
+
+bool SQLiteKVStore::Remove(const std::string& key)
+{
+	return Write(key, NULL);
+}
+
+bool SQLiteKVStore::Write(const std::string& key, const SQLiteKVValue* value)
+{
+	if (db_ == NULL && writer_ == NULL)
+		return false;
+
+	Shard& shard = GetShard(key);
+	Shard::Entry entry;
+	entry.exists = (value != NULL);
+	if (value != NULL)
+		entry.value = *value;
+	uint64_t sequence = 0;
+	{
+		std::lock_guard<std::mutex> auto_lock(shard.lock);
+		sequence = ++shard.next_sequence;
+		shard.epoch++;
+		Shard::PendingWrite& pending = shard.pending[key];
+		pending.sequence = sequence;
+		pending.exists   = entry.exists;
+		pending.value    = entry.value;
+		shard.cache.Put(key, entry);
+	}
+	writes_++;
+
+	std::string sql = entry.exists ? replace_sql_ : delete_sql_;
+	SQLiteBatchWriter::Mutation mutation = [sql, key, entry](SQLiteDB* db) {
+		SQLiteStatement statement;
+		int r = db->Query(statement, sql.c_str(), (int)sql.size());
+		if (r != SQLITE_OK)
+			return r;
+		r = statement.BindText(1, key.data(), key.size());
+		if (r == SQLITE_OK && entry.exists)
+			r = BindValue(statement, 2, entry.value);
+		if (r != SQLITE_OK)
+			return r;
+		return statement.NextRow();
+	};
+	SQLiteBatchWriter::CompletionCallback callback = [this, &shard, key, sequence](int result) {
+		if (result == SQLITE_DONE)
+			result = SQLITE_OK;
+		std::lock_guard<std::mutex> auto_lock(shard.lock);
+		auto pending = shard.pending.find(key);
+		if (pending != shard.pending.end() && pending->second.sequence == sequence)
+			shard.pending.erase(pending);
+		if (result != SQLITE_OK)
+		{
+			// 写失败时缓存的值不再可信，下次从数据库读
+			write_errors_++;
+			shard.epoch++;
+			auto cached = shard.cache.Peek(key);
+			if (cached != shard.cache.end())
+				shard.cache.Erase(cached);
+		}
+	};
+
+	if (writer_ != NULL && writer_->IsRunning() && writer_->Post(mutation, callback))
+		return true;
+
+	int r = (db_ != NULL) ? mutation(db_) : SQLITE_MISUSE;
+	callback(r);
+	return r == SQLITE_DONE || r == SQLITE_OK;
+}
+
+int SQLiteKVStore::ReadFromDB(const std::string& key, SQLiteKVValue* value)
+{
+	if (db_ == NULL || !db_->IsValid())
+		return SQLITE_MISUSE;
+
+	SQLiteStatement statement;
+	int r = db_->Query(statement, select_sql_.c_str(), (int)select_sql_.size());
+	if (r != SQLITE_OK)
+		return r;
+	statement.BindText(1, key.data(), key.size());
+	r = statement.NextRow();
+	if (r != SQLITE_ROW)
+		return r;
+
+	switch (statement.GetTypeField(0))
+	{
+	case SQLITE_INTEGER:
+		value->type      = SQLiteKVValue::kTypeInt64;
+		value->int_value = statement.GetInt64Field(0);
+		break;
+	case SQLITE_FLOAT:
+		value->type         = SQLiteKVValue::kTypeDouble;
+		value->double_value = statement.GetDoubleField(0);
+		break;
+	case SQLITE_TEXT:
+		value->type = SQLiteKVValue::kTypeString;
+		value->string_value.assign(statement.GetTextField(0), statement.GetFieldBytes(0));
+		break;
+	case SQLITE_BLOB:
+		value->type = SQLiteKVValue::kTypeBlob;
+		value->string_value.assign((const char*)statement.GetBlobField(0), statement.GetFieldBytes(0));
+		break;
+	default:
+		// NULL当作不存在
+		return SQLITE_DONE;
+	}
+	return SQLITE_ROW;
+}
+
+void SQLiteKVStore::Flush()
+{
+	if (writer_ != NULL)
+		writer_->Flush();
+}
+
+void SQLiteKVStore::Invalidate(const std::string& key/* = std::string()*/)
+{
+	if (!key.empty())
+	{
+		Shard& shard = GetShard(key);
+		std::lock_guard<std::mutex> auto_lock(shard.lock);
+		shard.epoch++;
+		auto cached = shard.cache.Peek(key);
+		if (cached != shard.cache.end())
+			shard.cache.Erase(cached);
+		return;
+	}
+	for (auto& shard : shards_)
+	{
+		std::lock_guard<std::mutex> auto_lock(shard->lock);
+		shard->epoch++;
+		shard->cache.Clear();
+	}
+}
+
+SQLiteKVStats SQLiteKVStore::GetStats() const
+{
+	SQLiteKVStats stats;
+	stats.hits          = hits_;
+	stats.negative_hits = negative_hits_;
+	stats.misses        = misses_;
+	stats.writes        = writes_;
+	stats.write_errors  = write_errors_;
+	return stats;
+}
+
+DB_END_DECLS
@@ -0,0 +1,147 @@
+#ifndef __BASE_DB_KV_STORE_H__
+#define __BASE_DB_KV_STORE_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+DB_BEGIN_DECLS
+
+class SQLiteBatchWriter;
+
+/*
+    *  Purpose     A value of SQLiteKVStore
+    */
+struct DB_EXPORT SQLiteKVValue
+{
+    enum Type
+    {
+        kTypeInt64 = SQLITE_INTEGER,
+        kTypeDouble = SQLITE_FLOAT,
+        kTypeString = SQLITE_TEXT,
+        kTypeBlob = SQLITE_BLOB,
+    };
+
+    SQLiteKVValue() : type(kTypeInt64), int_value(0), double_value(0) {}
+
+    Type            type;
+    int64_t         int_value;
+    double          double_value;
+    std::string     string_value;       // kTypeString and kTypeBlob
+};
+
+/*
+    *  Purpose     Hit counters of SQLiteKVStore
+    */
+struct SQLiteKVStats
+{
+    uint64_t    hits;               // Found in the cache or in the writes not committed yet
+    uint64_t    negative_hits;      // The cache knows the key does not exist
+    uint64_t    misses;             // Read from the database
+    uint64_t    writes;
+    uint64_t    write_errors;
+};
+
+/*
+    *  Purpose     Typed key-value store in a table, with an in-memory LRU cache in front of it
+    *  Remark      Reads are answered by the cache when possible, keys known to be missing are cached too,
+    *              so the repeated lookups of hot settings do not query the database.
+    *              Writes update the cache at once and are written through the SQLiteBatchWriter, they are
+    *              visible to Get() before they are committed. Without a running writer they are written
+    *              to db directly.
+    *              The cache is split into shards by key hash, every shard has its own lock, the store can
+    *              be used from any thread. db is used to read on the calling threads, it can be the database
+    *              of the writer opened with SQLiteDB::modeSerialized, or another connection of the same file.
+    *              Only writes through the store are cached correctly, other writers of the table should
+    *              call Invalidate().
+    */
+class DB_EXPORT SQLiteKVStore
+{
+public:
+
+    /*
+        *  db              Read the table, and write it when writer is NULL or not running
+        *  writer          Group commit of the writes
+        *  table           Name of the table, created by Init()
+        *  cache_entries   Max count of the cached keys including the missing ones
+        *  shards          Count of the cache shards
+        */
+    SQLiteKVStore(SQLiteDB* db, SQLiteBatchWriter* writer, const std::string& table = "nim_kv",
+        size_t cache_entries = 1024, size_t shards = 8);
+    virtual ~SQLiteKVStore();
+
+    /*
+        *  Purpose     Create the table if it does not exist
+        */
+    int Init();
+
+    /*
+        *  Purpose     Read a value, return false if the key does not exist
+        */
+    bool Get(const std::string& key, SQLiteKVValue* value);
+    bool Contains(const std::string& key);
+
+    /*
+        *  Purpose     Typed reads, return default_value if the key does not exist or has another type.
+        *              An integer is converted to double by GetDouble(), GetBool() reads an integer.
+        */
+    int64_t         GetInt64(const std::string& key, int64_t default_value = 0);
+    double          GetDouble(const std::string& key, double default_value = 0);
+    bool            GetBool(const std::string& key, bool default_value = false);
+    std::string     GetString(const std::string& key, const std::string& default_value = std::string());
+    std::string     GetBlob(const std::string& key, const std::string& default_value = std::string());
+
+    /*
+        *  Purpose     Writes, return false if the write could not be queued or written
+        */
+    bool Set(const std::string& key, const SQLiteKVValue& value);
+    bool SetInt64(const std::string& key, int64_t value);
+    bool SetDouble(const std::string& key, double value);
+    bool SetBool(const std::string& key, bool value);
+    bool SetString(const std::string& key, const std::string& value);
+    bool SetBlob(const std::string& key, const void* data, size_t size);
+    bool Remove(const std::string& key);
+
+    /*
+        *  Purpose     Wait until the queued writes are committed
+        */
+    void Flush();
+
+    /*
+        *  Purpose     Forget the cached value of key, or all the cached values if key is empty
+        */
+    void Invalidate(const std::string& key = std::string());
+
+    SQLiteKVStats GetStats() const;
+
+private:
+
+    struct Shard;
+
+    SQLiteKVStore(const SQLiteKVStore&);
+    SQLiteKVStore& operator=(const SQLiteKVStore&);
+
+    Shard& GetShard(const std::string& key);
+    // value为NULL表示删除
+    bool Write(const std::string& key, const SQLiteKVValue* value);
+    // 读数据库，返回SQLITE_ROW、SQLITE_DONE（不存在）或错误
+    int ReadFromDB(const std::string& key, SQLiteKVValue* value);
+
+    SQLiteDB*                               db_;
+    SQLiteBatchWriter*                      writer_;
+    std::string                             table_;
+    std::string                             select_sql_;
+    std::string                             replace_sql_;
+    std::string                             delete_sql_;
+    std::vector<std::unique_ptr<Shard>>     shards_;
+    std::atomic<uint64_t>                   hits_;
+    std::atomic<uint64_t>                   negative_hits_;
+    std::atomic<uint64_t>                   misses_;
+    std::atomic<uint64_t>                   writes_;
+    std::atomic<uint64_t>                   write_errors_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_KV_STORE_H__
@@ -0,0 +1,12 @@
+#ifndef __BASE_DB_LOG_H__
+#define __BASE_DB_LOG_H__
+#include "nim_log/wrapper/log.h"
+
+#define DB_QLOG_PRO(Logger,fmt) __NIM_MODULE_LOG_PRO(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_APP(Logger,fmt) __NIM_MODULE_LOG_APP(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_WAR(Logger,fmt) __NIM_MODULE_LOG_WAR(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_ERR(Logger,fmt) __NIM_MODULE_LOG_ERR(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_KER(Logger,fmt) __NIM_MODULE_LOG_KER(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_ASS(Logger,fmt) __NIM_MODULE_LOG_ASS(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#define DB_QLOG_INT(Logger,fmt) __NIM_MODULE_LOG_INT(fmt,Logger,NS_NIMLOG::LOG_MODULE::LM_DB)
+#endif // __BASE_DB_LOG_H__
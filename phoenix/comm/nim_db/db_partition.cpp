@@ -0,0 +1,323 @@
+// Database partitions per user/conversation
+
+#include "nim_db/db_partition.h"
+#include <assert.h>
+
+DB_BEGIN_DECLS
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLitePartition
+SQLitePartition::SQLitePartition()
+{
+	manager_ = NULL;
+	db_      = NULL;
+}
+
+SQLitePartition::SQLitePartition(SQLitePartition& src)
+{
+	manager_     = src.manager_;
+	db_          = src.db_;
+	key_.swap(src.key_);
+	src.manager_ = NULL;
+	src.db_      = NULL;
+}
+
+SQLitePartition::~SQLitePartition()
+{
+	Release();
+}
+
+SQLitePartition& SQLitePartition::operator=(SQLitePartition& src)
+{
+	Release();
+
+	manager_     = src.manager_;
+	db_          = src.db_;
+	key_.swap(src.key_);
+	src.manager_ = NULL;
+	src.db_      = NULL;
+	return *this;
+}
+
+void SQLitePartition::Release()
+{
+	if (manager_ != NULL && db_ != NULL)
+		manager_->ReleasePartition(key_);
+	manager_ = NULL;
+	db_      = NULL;
+	key_.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLitePartitionManager
+SQLitePartitionManager::SQLitePartitionManager()
+{
+	opened_   = false;
+	stopping_ = false;
+}
+
+SQLitePartitionManager::~SQLitePartitionManager()
+{
+	Close();
+}
+
+bool SQLitePartitionManager::Open(const SQLitePartitionOptions& options, const OpenCallback& on_open/* = OpenCallback()*/)
+{
+	if (!Close())
+		return false;
+	if (options.directory.empty())
+		return false;
+
+	options_  = options;
+	on_open_  = on_open;
+	stopping_ = false;
+	for (size_t i = 0; i < options_.worker_count; i++)
+		workers_.push_back(std::thread(&SQLitePartitionManager::RunWorker, this));
+	opened_ = true;
+	return true;
+}
+
+bool SQLitePartitionManager::Close()
+{
+	if (!opened_)
+		return true;
+
+	std::map<std::string, std::unique_ptr<Entry>> entries;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		// 还有分区被借出时不能关闭
+		if (idle_.size() != entries_.size())
+			return false;
+		entries.swap(entries_);
+		idle_.clear();
+	}
+	entries.clear();
+
+	{
+		std::lock_guard<std::mutex> auto_lock(task_mutex_);
+		stopping_ = true;
+	}
+	task_cond_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+	workers_.clear();
+	opened_ = false;
+	return true;
+}
+
+bool SQLitePartitionManager::Acquire(const std::string& partition_key, SQLitePartition& partition, bool create/* = true*/)
+{
+	partition.Release();
+	if (!opened_ || partition_key.empty())
+		return false;
+
+	Entry* entry = NULL;
+	std::vector<std::unique_ptr<Entry>> evicted;
+	{
+		std::unique_lock<std::mutex> auto_lock(mutex_);
+		for (;;)
+		{
+			auto it = entries_.find(partition_key);
+			if (it == entries_.end())
+			{
+				// 新分区先占位，打开期间其他线程等待它
+				std::unique_ptr<Entry> new_entry(new Entry);
+				new_entry->key    = partition_key;
+				new_entry->leased = true;
+				entry = new_entry.get();
+				entries_[partition_key] = std::move(new_entry);
+				break;
+			}
+			if (!it->second->leased)
+			{
+				entry = it->second.get();
+				entry->leased = true;
+				idle_.erase(entry->idle_it);
+				partition.manager_ = this;
+				partition.db_      = entry->db.get();
+				partition.key_     = partition_key;
+				return true;
+			}
+			idle_cond_.wait(auto_lock);
+		}
+		EvictIdle(evicted);
+	}
+	evicted.clear();
+
+	// 在锁外打开，其他分区不用等待
+	std::unique_ptr<SQLiteDB> db(new SQLiteDB);
+	int flags = SQLiteDB::modeReadWrite | SQLiteDB::modeMultiThread;
+	if (create)
+		flags |= SQLiteDB::modeCreate;
+	std::string path = GetPartitionPath(partition_key);
+	bool succeeded = db->Open(path.c_str(), options_.key, options_.open_options, flags);
+	if (succeeded && on_open_)
+		succeeded = on_open_(db.get(), partition_key);
+	if (!succeeded)
+	{
+		db->Close();
+		{
+			std::lock_guard<std::mutex> auto_lock(mutex_);
+			entries_.erase(partition_key);
+		}
+		idle_cond_.notify_all();
+		return false;
+	}
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	entry->db = std::move(db);
+	partition.manager_ = this;
+	partition.db_      = entry->db.get();
+	partition.key_     = partition_key;
+	return true;
+}
+
+bool SQLitePartitionManager::ClosePartition(const std::string& partition_key)
+{
+	std::unique_ptr<Entry> entry;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		auto it = entries_.find(partition_key);
+		if (it == entries_.end())
+			return true;
+		if (it->second->leased)
+			return false;
+		idle_.erase(it->second->idle_it);
+		entry = std::move(it->second);
+		entries_.erase(it);
+	}
+	return true;
+}
+
+std::string SQLitePartitionManager::GetPartitionPath(const std::string& partition_key) const
+{
+	static const char kHexDigits[] = "0123456789abcdef";
+
+	std::string path = options_.directory;
+	char last = path.empty() ? 0 : path[path.size() - 1];
+	if (last != '/' && last != '\\')
+		path.push_back('/');
+	path.append(options_.file_prefix);
+	// 文件名不区分大小写的系统上大写字母也要转义，否则"A"和"a"是同一个文件
+	for (size_t i = 0; i < partition_key.size(); i++)
+	{
+		unsigned char c = (unsigned char)partition_key[i];
+		if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-')
+		{
+			path.push_back((char)c);
+		}
+		else
+		{
+			path.push_back('_');
+			path.push_back(kHexDigits[c >> 4]);
+			path.push_back(kHexDigits[c & 0x0F]);
+		}
+	}
+	path.append(options_.file_suffix);
+	return path;
+}
+
+size_t SQLitePartitionManager::ForEach(const std::vector<std::string>& partition_keys, const PartitionTask& task)
+{
+	if (!opened_ || !task)
+		return 0;
+
+	// 所有任务共享的计数，等待全部完成后返回
+	struct FanOut
+	{
+		std::mutex              mutex;
+		std::condition_variable done_cond;
+		size_t                  remaining;
+		size_t                  ran;
+	};
+	std::shared_ptr<FanOut> fan_out(new FanOut);
+	fan_out->remaining = partition_keys.size();
+	fan_out->ran       = 0;
+
+	auto run_one = [this, fan_out, task](const std::string& partition_key) {
+		SQLitePartition partition;
+		bool ran = Acquire(partition_key, partition, false);
+		if (ran)
+			task(partition.Get(), partition_key);
+		partition.Release();
+
+		std::lock_guard<std::mutex> auto_lock(fan_out->mutex);
+		if (ran)
+			fan_out->ran++;
+		if (--fan_out->remaining == 0)
+			fan_out->done_cond.notify_all();
+	};
+
+	if (workers_.empty())
+	{
+		for (size_t i = 0; i < partition_keys.size(); i++)
+			run_one(partition_keys[i]);
+		return fan_out->ran;
+	}
+
+	{
+		std::lock_guard<std::mutex> auto_lock(task_mutex_);
+		for (size_t i = 0; i < partition_keys.size(); i++)
+			tasks_.push_back(std::bind(run_one, partition_keys[i]));
+	}
+	task_cond_.notify_all();
+
+	std::unique_lock<std::mutex> auto_lock(fan_out->mutex);
+	fan_out->done_cond.wait(auto_lock, [&fan_out]() { return fan_out->remaining == 0; });
+	return fan_out->ran;
+}
+
+size_t SQLitePartitionManager::GetOpenCount()
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	return entries_.size();
+}
+
+void SQLitePartitionManager::ReleasePartition(const std::string& partition_key)
+{
+	std::vector<std::unique_ptr<Entry>> evicted;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		auto it = entries_.find(partition_key);
+		assert(it != entries_.end() && it->second->leased);
+		if (it == entries_.end())
+			return;
+		Entry* entry = it->second.get();
+		entry->leased  = false;
+		entry->idle_it = idle_.insert(idle_.begin(), entry);
+		EvictIdle(evicted);
+	}
+	idle_cond_.notify_all();
+}
+
+void SQLitePartitionManager::EvictIdle(std::vector<std::unique_ptr<Entry>>& evicted)
+{
+	size_t max_open = options_.max_open_partitions > 0 ? options_.max_open_partitions : 1;
+	while (entries_.size() > max_open && !idle_.empty())
+	{
+		Entry* entry = idle_.back();
+		idle_.pop_back();
+		auto it = entries_.find(entry->key);
+		evicted.push_back(std::move(it->second));
+		entries_.erase(it);
+	}
+}
+
+void SQLitePartitionManager::RunWorker()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> auto_lock(task_mutex_);
+			task_cond_.wait(auto_lock, [this]() { return stopping_ || !tasks_.empty(); });
+			if (tasks_.empty())
+				return;
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+	}
+}
+
+DB_END_DECLS
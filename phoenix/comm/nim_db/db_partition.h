@@ -0,0 +1,185 @@
+#ifndef __BASE_DB_PARTITION_H__
+#define __BASE_DB_PARTITION_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+DB_BEGIN_DECLS
+
+class SQLitePartitionManager;
+
+/*
+    *  Purpose     A partition leased from SQLitePartitionManager
+    *  Remark      The partition is used by the current thread only and goes back to the manager
+    *              when the object destruct. Copying transfers the lease like SQLiteConnection.
+    */
+class DB_EXPORT SQLitePartition
+{
+    friend class SQLitePartitionManager;
+
+public:
+
+    SQLitePartition();
+    SQLitePartition(SQLitePartition& src);
+    virtual ~SQLitePartition();
+
+    SQLitePartition& operator=(SQLitePartition& src);
+
+    bool IsValid() const { return db_ != NULL; }
+    SQLiteDB* operator->() const { return db_; }
+    SQLiteDB& operator*() const { return *db_; }
+    SQLiteDB* Get() const { return db_; }
+    const std::string& GetKey() const { return key_; }
+
+    /*
+        *  Purpose     Return the partition to the manager before destruct
+        */
+    void Release();
+
+private:
+
+    SQLitePartitionManager* manager_;
+    SQLiteDB*               db_;
+    std::string             key_;
+};
+
+/*
+    *  Purpose     Options of SQLitePartitionManager::Open
+    */
+struct DB_EXPORT SQLitePartitionOptions
+{
+    SQLitePartitionOptions() : file_prefix("part_"), file_suffix(".db"), max_open_partitions(16), worker_count(4) {}
+
+    std::string         directory;              // Directory of the partition files, it must exist
+    std::string         file_prefix;
+    std::string         file_suffix;
+    std::string         key;                    // Encrypt key of every partition, see SQLiteDB::Open
+    SQLiteOpenOptions   open_options;           // Applied to every partition when it is opened
+    size_t              max_open_partitions;    // Idle partitions beyond it are closed, least recently used first
+    size_t              worker_count;           // Threads of ForEach, 0 runs the tasks on the calling thread
+};
+
+/*
+    *  Purpose     Route the tables of different users/conversations into separate database files
+    *  Remark      A partition is a database file named by its key, e.g. the id of a conversation.
+    *              It is opened by the first Acquire() and stays open while it is used recently,
+    *              when more than max_open_partitions are open the least recently used idle ones
+    *              are closed, leased partitions are never closed so the limit may be exceeded.
+    *              Every partition has one connection opened with modeMultiThread, a partition is
+    *              used by one thread at a time through SQLitePartition, Acquire() waits while it
+    *              is leased by another thread. Small files keep vacuum, backup and query plans cheap,
+    *              and ForEach() reads many of them in parallel.
+    */
+class DB_EXPORT SQLitePartitionManager
+{
+    friend class SQLitePartition;
+
+public:
+
+    /*
+        *  Purpose     Called when a partition is opened, before it is leased
+        *  Remark      Create or upgrade the tables here, the partition is not opened if it returns false.
+        *              It runs on the thread acquiring the partition without the lock of the manager.
+        */
+    typedef std::function<bool(SQLiteDB* db, const std::string& partition_key)> OpenCallback;
+
+    /*
+        *  Purpose     Run by ForEach on a worker thread for every partition
+        */
+    typedef std::function<void(SQLiteDB* db, const std::string& partition_key)> PartitionTask;
+
+    SQLitePartitionManager();
+    virtual ~SQLitePartitionManager();
+
+    /*
+        *  Purpose     Start the workers, no partition is opened here
+        */
+    bool Open(const SQLitePartitionOptions& options, const OpenCallback& on_open = OpenCallback());
+
+    /*
+        *  Purpose     Stop the workers and close all the partitions
+        *  Remark      It returns false and closes nothing if any partition is still leased
+        */
+    bool Close();
+
+    bool IsValid() const { return opened_; }
+
+    /*
+        *  Purpose     Lease the partition of partition_key, open it if it is not open
+        *  partition   Return the leased partition, the partition leased before is released first
+        *  create      Create the file if it does not exist, otherwise it fails for a missing partition
+        *  Remark      A thread should not lease a partition it is already holding, it waits forever.
+        */
+    bool Acquire(const std::string& partition_key, SQLitePartition& partition, bool create = true);
+
+    /*
+        *  Purpose     Close the partition if it is open and not leased, e.g. before the file is
+        *              deleted or copied
+        *  Remark      It returns false if the partition is leased
+        */
+    bool ClosePartition(const std::string& partition_key);
+
+    /*
+        *  Purpose     File of the partition, the characters other than lowercase letters, digits and '-'
+        *              are escaped so any key can be used on a case-insensitive file system
+        */
+    std::string GetPartitionPath(const std::string& partition_key) const;
+
+    /*
+        *  Purpose     Run task on every existing partition of partition_keys in parallel and wait
+        *  Remark      Missing partitions are skipped. The tasks run on the worker threads at the same
+        *              time, merging their results must be synchronized by the task. Do not call it in
+        *              a PartitionTask or while holding one of the partitions.
+        *  Return      Count of the partitions the task ran on
+        */
+    size_t ForEach(const std::vector<std::string>& partition_keys, const PartitionTask& task);
+
+    size_t GetOpenCount();
+
+private:
+
+    struct Entry
+    {
+        Entry() : leased(false) {}
+
+        std::string                         key;
+        std::unique_ptr<SQLiteDB>           db;
+        bool                                leased;     // Also set while it is being opened
+        std::list<Entry*>::iterator         idle_it;    // Position in idle_, valid when not leased
+    };
+
+    SQLitePartitionManager(const SQLitePartitionManager&);
+    SQLitePartitionManager& operator=(const SQLitePartitionManager&);
+
+    void ReleasePartition(const std::string& partition_key);
+    // Called with mutex_ locked, the closed connections are returned to be deleted without the lock
+    void EvictIdle(std::vector<std::unique_ptr<Entry>>& evicted);
+    void RunWorker();
+
+    SQLitePartitionOptions                          options_;
+    OpenCallback                                    on_open_;
+    bool                                            opened_;
+
+    std::mutex                                      mutex_;             // 保护以下成员
+    std::condition_variable                         idle_cond_;         // 有分区归还
+    std::map<std::string, std::unique_ptr<Entry>>   entries_;
+    std::list<Entry*>                               idle_;              // 空闲的已打开分区，最近用过的在前
+
+    std::vector<std::thread>                        workers_;
+    std::mutex                                      task_mutex_;        // 保护以下成员
+    std::condition_variable                         task_cond_;
+    std::deque<std::function<void()>>               tasks_;
+    bool                                            stopping_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_PARTITION_H__
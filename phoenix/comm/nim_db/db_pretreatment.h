@@ -3,11 +3,21 @@
 #define DB_DB_PRETREATMENT_H_
 
 #include "db/db_sqlite3.h"
+#include "nim_db/db_backup.h"
+#include "nim_db/db_recovery.h"
 #include "extension/strings/string_util.h"
+#include "extension/memory/memory_trimmer.h"
+#include "base/trace_event/trace_event.h"
 #include <map>
+#include <algorithm>
+#include <ctime>
 #include <functional>
 #include <list>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 DB_BEGIN_DECLS
 	template<typename TDBVersionType>
@@ -80,6 +90,7 @@ DB_BEGIN_DECLS
 		public:
 			virtual bool FilePathIsExist(const std::string& file_path, bool is_directory) = 0;
 			virtual bool DeleteFile(const std::string& file_path) = 0;
+			//恢复时整个拷贝备份文件，实现可直接调用NS_EXTENSION::CopyFile/MoveFile，支持时会克隆文件或在内核中拷贝
 			virtual bool CopyFile(const std::string &from_path, const std::string &to_path, bool fail_if_exists = false) = 0;
 			virtual bool CreateDir(const std::string& dir_path) = 0;
 			virtual bool GetDirFromPath(const std::string& file_path, std::string& dir) = 0;//dir 含未尾的"/" or "\\"
@@ -93,10 +104,10 @@ DB_BEGIN_DECLS
 		class DefaultDBRestore
 		{
 		public:
-			DefaultDBRestore() : file_system_(nullptr)
+			DefaultDBRestore() : file_system_(nullptr), cancel_backup_(false)
 			{
 			}
-			virtual ~DefaultDBRestore(){}
+			virtual ~DefaultDBRestore(){ WaitBackup(true); }
 		public:
 			void SetRestoreInfo(IOSFileSystem* file_system, const std::string& db_path, const std::string& back_db_dir)
 			{
@@ -119,41 +130,25 @@ DB_BEGIN_DECLS
 					back_db_path_ = back_db_dir_ + back_db_file_name_;
 				}
 			}
-			bool DoBackup()
+			//在后台线程上用sqlite3_backup分批备份，不阻塞对db的读写，db在备份完成前必须保持打开
+			bool DoBackup(SQLiteDB* db, const std::string& db_password)
 			{
-				if (file_system_ == nullptr)
+				if (file_system_ == nullptr || db == nullptr || !db->IsValid())
 					return false;
-				file_system_->ClearTLSLastError();
-				if (file_system_->FilePathIsExist(db_path_, false))
-				{
-					if (!file_system_->FilePathIsExist(back_db_dir_, true) && !file_system_->CreateDir(back_db_dir_) && !file_system_->FilePathIsExist(back_db_dir_, true))
-						return false;
-					auto back_db_file_bk = back_db_path_ + ("_bk");
-					bool has_back_file = file_system_->FilePathIsExist(back_db_path_, false);
-					if (has_back_file)
-						file_system_->MoveFileX(back_db_path_, back_db_file_bk);		
-					auto backup_ret = false;
-					{
-						file_system_->LockDBFile();
-						backup_ret = file_system_->CopyFile(db_path_, back_db_path_);
-						if (backup_ret)
-						{
-							if (has_back_file)
-								file_system_->DeleteFile(back_db_file_bk);
-						}
-						else
-						{
-							if (file_system_->FilePathIsExist(back_db_file_bk, false))
-							{
-								file_system_->DeleteFile(back_db_path_);
-								file_system_->MoveFileX(back_db_file_bk, back_db_path_);
-							}
-						}
-						file_system_->UnLockDBFile();
-					}					
-					return backup_ret;
-				}
-				return false;
+				WaitBackup(false);
+				cancel_backup_ = false;
+				backup_thread_ = std::thread([this, db, db_password]() {
+					RunBackup(db, db_password);
+				});
+				return true;
+			}
+			//等待后台备份结束，cancel为true时中止未完成的备份，关闭db前必须调用
+			void WaitBackup(bool cancel)
+			{
+				if (cancel)
+					cancel_backup_ = true;
+				if (backup_thread_.joinable())
+					backup_thread_.join();
 			}
 			bool DoRestore()
 			{
@@ -205,7 +200,40 @@ DB_BEGIN_DECLS
 				back_db_file_ext_ = "";
 			}
 		private:
+			bool RunBackup(SQLiteDB* db, const std::string& db_password)
+			{
+				file_system_->ClearTLSLastError();
+				if (!file_system_->FilePathIsExist(back_db_dir_, true) && !file_system_->CreateDir(back_db_dir_) && !file_system_->FilePathIsExist(back_db_dir_, true))
+					return false;
+				//先备份到临时文件，完成后再替换原有的备份文件，备份中途失败时原有的备份依然可用
+				auto back_db_file_bk = back_db_path_ + ("_bk");
+				auto backup_ret = false;
+				{
+					SQLiteBackup backup;
+					backup_ret = backup.Begin(db, back_db_file_bk.c_str(), db_password) &&
+						backup.Run(kBackupPagesPerStep, kBackupStepIntervalMs, &cancel_backup_) == SQLITE_DONE &&
+						backup.Finish() == SQLITE_OK;
+				}
+				if (backup_ret)
+				{
+					file_system_->LockDBFile();
+					if (file_system_->FilePathIsExist(back_db_path_, false))
+						file_system_->DeleteFile(back_db_path_);
+					backup_ret = file_system_->MoveFileX(back_db_file_bk, back_db_path_);
+					file_system_->UnLockDBFile();
+				}
+				else if (file_system_->FilePathIsExist(back_db_file_bk, false))
+				{
+					file_system_->DeleteFile(back_db_file_bk);
+				}
+				return backup_ret;
+			}
+		private:
+			static const int kBackupPagesPerStep = 64;
+			static const int kBackupStepIntervalMs = 10;
 			IOSFileSystem* file_system_;
+			std::thread backup_thread_;
+			std::atomic_bool cancel_backup_;
 			std::string db_path_;
 			std::string db_dir_;
 			std::string db_file_name_;
@@ -222,6 +250,28 @@ DB_BEGIN_DECLS
 		typedef std::pair<DBVersionType, DBUpdateFunc> DBUpdateFunItem;
 		typedef std::map<typename DBUpdateFunItem::first_type, typename DBUpdateFunItem::second_type> DBUpdateFuncList;
 		typedef IOSFileSystem FileSystem;
+		//后台升级每次处理一小批数据，在后台线程自己的连接上、单独的事务中执行，提交后下次从剩余的数据继续，
+		//因此每一批都要能从上次提交的位置继续（例如只处理新字段仍为NULL的行）。
+		//执行期间数据库已经可用，其他连接的写入可能要等待这一批提交，它们应设置SQLiteDB::SetBusyTimeout
+		enum BackgroundUpdateResult
+		{
+			kBackgroundUpdateMore,//还有数据，稍后再次调用
+			kBackgroundUpdateDone,//已完成，记录后以后不再调用
+			kBackgroundUpdateFailed,//失败，回滚这一批，下次打开数据库时重试
+		};
+		typedef std::function<BackgroundUpdateResult(SQLiteDB* db)> DBBackgroundUpdateFunc;
+		typedef std::pair<std::string, DBBackgroundUpdateFunc> DBBackgroundUpdateItem;
+		typedef std::vector<DBBackgroundUpdateItem> DBBackgroundUpdateList;
+		//一个升级步骤的耗时
+		struct DBUpdateStepTiming
+		{
+			DBVersionType version;//同步升级的版本号
+			std::string name;//后台升级的名字
+			bool background;
+			bool succeeded;
+			int batches;//后台升级执行的批数，同步升级为1
+			int64_t duration_ms;
+		};
 		class FileSystemAutoUnLock {
 		public:
 			FileSystemAutoUnLock(FileSystem*file_system) :file_system_(file_system) { file_system_->LockDBFile(); }
@@ -235,6 +285,8 @@ DB_BEGIN_DECLS
 			PretreatmentConfig() :
 				db_path_(""), back_db_dir_(""),
 				enable_def_restore_(false), enable_backup_(true), enable_restore_(false),
+				update_in_transaction_(true), background_update_interval_ms_(10),
+				enable_recover_(true), integrity_check_budget_ms_(0), warm_up_budget_ms_(0),
 				newest_version_(1), base_version_(1), db_version_now_(1)
 			{
 			}
@@ -246,6 +298,12 @@ DB_BEGIN_DECLS
 				enable_def_restore_ = false;
 				enable_backup_ = true;
 				enable_restore_ = false;
+				update_in_transaction_ = true;
+				background_update_interval_ms_ = 10;
+				enable_recover_ = true;
+				integrity_check_budget_ms_ = 0;
+				warm_up_budget_ms_ = 0;
+				warm_up_objects_.clear();
 				newest_version_ = base_version_ = db_version_now_ = 1;
 			}
 		public:
@@ -254,13 +312,20 @@ DB_BEGIN_DECLS
 			bool enable_def_restore_;//是否使用缺省的恢复处理
 			bool enable_backup_;//是否开启备份功能
 			bool enable_restore_;//是否开启恢复功能
+			bool update_in_transaction_;//所有待执行的升级步骤在一个事务中执行，任一步失败时全部回滚；升级函数自己使用事务时关闭
+			int background_update_interval_ms_;//后台升级两批之间的间隔，让出数据库给其他读写
+			bool enable_recover_;//数据文件损坏时先把能读出的表复制到新文件，失败时才恢复备份或调用OnDBFileBroken
+			int integrity_check_budget_ms_;//打开后在后台执行PRAGMA quick_check的时间预算，0不检查；检查期间持有读事务，非WAL模式下写入要等待它
+			int warm_up_budget_ms_;//打开后在后台把热点表和索引的页读入系统的页缓存的时间预算，0不预热，新创建的数据文件不预热；同完整性检查，非WAL模式下写入要等待它扫描完一个表
+			std::vector<std::string> warm_up_objects_;//要预热的表和索引，按顺序预热，之后是AddWarmUpObjects记录的
 			DBVersionType newest_version_;	//数据库最新版本
 			DBVersionType base_version_;//数据库最初版本
 			DBVersionType db_version_now_;//数据库当前版本
 		};
 	public:
 		DBPretreatment() :
-			file_system_(nullptr), ready_(false)
+			ready_(false), file_system_(nullptr), cancel_background_update_(false), background_update_finished_(true),
+			cancel_integrity_check_(false), cancel_warm_up_(false), memory_trim_id_(0)
 		{
 		}
 		virtual ~DBPretreatment()
@@ -283,6 +348,11 @@ DB_BEGIN_DECLS
 		}
 		virtual bool CloseDB()
 		{
+			WaitWarmUp(true);
+			WaitIntegrityCheck(true);
+			WaitBackgroundUpdate(true);
+			db_restore_.WaitBackup(true);
+			UnregisterMemoryTrim();
 			db_.Close();
 			Clear();
 			return true;
@@ -290,18 +360,91 @@ DB_BEGIN_DECLS
 		DBVersionType GetNewestDBVersion() const { return config_.newest_version_; } 
 		DBVersionType GetDBVersion() const { return config_.db_version_now_; }
 		DBVersionType GetDBBaseVersion() const { return config_.base_version_; }	
+		//同步和后台升级每一步的耗时，按完成的顺序
+		std::vector<DBUpdateStepTiming> GetUpdateTimings() const
+		{
+			std::lock_guard<std::mutex> auto_lock(update_timings_lock_);
+			return update_timings_;
+		}
+		bool IsBackgroundUpdateFinished() const { return background_update_finished_; }
+		//等待后台升级结束，cancel为true时在当前这一批之后停止，没有完成的下次打开时继续
+		void WaitBackgroundUpdate(bool cancel)
+		{
+			if (cancel)
+				cancel_background_update_ = true;
+			if (background_update_thread_.joinable())
+				background_update_thread_.join();
+		}
+		//等待后台完整性检查结束，cancel为true时中止检查，结果不再报告
+		void WaitIntegrityCheck(bool cancel)
+		{
+			if (cancel)
+				cancel_integrity_check_ = true;
+			if (integrity_check_thread_.joinable())
+				integrity_check_thread_.join();
+		}
+		//等待后台预热结束，cancel为true时在当前这一批行之后停止
+		void WaitWarmUp(bool cancel)
+		{
+			if (cancel)
+				cancel_warm_up_ = true;
+			if (warm_up_thread_.joinable())
+				warm_up_thread_.join();
+		}
+		//记录要预热的表和索引，例如SQLiteProfiler::GetSlowQueryObjects()，下次打开时在warm_up_objects_之后预热。
+		//kWarmUpObjectKeepDays天内没有再记录的不再预热
+		bool AddWarmUpObjects(const std::vector<std::string>& names)
+		{
+			if (!db_.IsValid() || db_.Query("CREATE TABLE IF NOT EXISTS version_warm_up(name TEXT PRIMARY KEY, update_time INTEGER)") != SQLITE_OK)
+				return false;
+			int64_t now = (int64_t)time(NULL);
+			SQLiteAutoTransaction transaction(&db_);
+			for (const auto& name : names)
+			{
+				SQLiteStatement stmt;
+				if (db_.Query(stmt, "INSERT OR REPLACE INTO version_warm_up(name, update_time) VALUES(?, ?)") != SQLITE_OK)
+					return false;
+				stmt.BindText(1, name.c_str());
+				stmt.BindInt64(2, now);
+				if (stmt.NextRow() != SQLITE_DONE)
+					return false;
+			}
+			SQLiteStatement stmt;
+			if (db_.Query(stmt, "DELETE FROM version_warm_up WHERE update_time<?") == SQLITE_OK)
+			{
+				stmt.BindInt64(1, now - kWarmUpObjectKeepDays * 24 * 3600);
+				stmt.NextRow();
+			}
+			return transaction.Commit();
+		}
 	protected:
 		virtual bool OnDBFileBroken(){ return false; };		
 		virtual bool OnDoOtheUpdate(){ return true; }
 		virtual void OnOpenDB(bool new_db){};
 		virtual void OnNoVersionToBaseVersion(){};		
 		virtual void OnClear(){};		
+		//每个同步升级步骤完成后调用，finished_steps/total_steps为本次打开时要执行的步骤
+		virtual void OnUpdateProgress(const DBUpdateStepTiming& step, size_t finished_steps, size_t total_steps){};
+		//在后台升级线程上调用
+		virtual void OnBackgroundUpdateFinished(const DBUpdateStepTiming& step){};
+		//在后台检查线程上调用，不能在这里关闭数据库；发现损坏时可以在其他线程上调用RecoverDBFile
+		virtual void OnIntegrityChecked(const SQLiteIntegrityResult& result){};
+		//恢复出了新的数据文件，返回false时放弃它，改为恢复备份。
+		//result.skipped_tables中的虚表（例如SQLiteFtsIndex）需要重新创建
+		virtual bool OnDBRecovered(const SQLiteRecoveryResult& result){ return true; };
 	protected:
+		//注册数据量大、可以在数据库可用之后再执行的升级，DoPretreatment之前调用。
+		//新创建的数据文件没有旧数据，直接记为已完成
+		void SetBackgroundUpdates(const DBBackgroundUpdateList& updates)
+		{
+			background_updates_ = updates;
+		}
 		bool DoPretreatment(FileSystem* file_system, const std::string& db_password, std::list<std::string> createdb_sqls, const DBUpdateFuncList& updatefun_list = DBUpdateFuncList())
 		{			
 			bool ret = false;
 			if (ready_)
 				return true;
+			TRACE_EVENT1("nim.db", "DBPretreatment::DoPretreatment", "path", TRACE_STR_COPY(config_.db_path_.c_str()));
 			FileSystemAutoUnLock filesystemautounlock(file_system);
 			file_system_ = file_system;
 			try
@@ -312,7 +455,7 @@ DB_BEGIN_DECLS
 				bool new_dbfile = true;
 				auto OpenDBTask = [&]()->bool {
 					//打开数据文件失败，并且处理且解决了文件损坏会再次打开数据文件
-					if (!OpenDB(config_.db_path_, db_password, new_dbfile) && CatchDBFileBroken() && !OpenDB(config_.db_path_, db_password, new_dbfile))
+					if (!OpenDB(config_.db_path_, db_password, new_dbfile) && CatchDBFileBroken(db_password) && !OpenDB(config_.db_path_, db_password, new_dbfile))
 						throw false;
 					if (new_dbfile)//新创建的数据文件
 					{
@@ -336,14 +479,14 @@ DB_BEGIN_DECLS
 							db_result &= db_.Query(sql.c_str());
 							});
 					}
-					throw true;
+					return true;
 				};
 				if (!OpenDBTask())//打开数据文件失败并且没有进行修复，或者修复已后依然无法打开数据文件
 					throw false;
 				config_.db_version_now_ = VersionOpration::CheckVersion(&db_);//如果OpenDBTask执行成功db_version_now_应该是相应的版本号
 				if (config_.db_version_now_ == VersionOpration::GetInvalidVersionValue())
 				{
-					if (!(CatchDBFileBroken() && OpenDBTask()))
+					if (!(CatchDBFileBroken(db_password) && OpenDBTask()))
 					{
 						throw false;
 					}
@@ -358,8 +501,19 @@ DB_BEGIN_DECLS
 				if (update_ret)
 				{
 					if (config_.enable_backup_)
-						db_restore_.DoBackup();
+					{
+						TRACE_EVENT0("nim.db", "DBPretreatment::DoBackup");
+						db_restore_.DoBackup(&db_, db_password);
+					}
 					OnOpenDB(new_dbfile);
+					RegisterMemoryTrim();
+					StartBackgroundUpdate(new_dbfile, db_password);
+					if (!new_dbfile)
+					{
+						//先于完整性检查开始，首屏的查询要读的页先进缓存
+						StartWarmUp(db_password);
+						StartIntegrityCheck(db_password);
+					}
 				}
 				throw true;
 			}
@@ -370,6 +524,57 @@ DB_BEGIN_DECLS
 			}			
 			return ret;
 		}	
+		//关闭数据库，把损坏的数据文件中能读出的数据复制到新文件并替换它，之后要再次调用DoPretreatment打开。
+		//比恢复备份快，也保留了备份之后写入的数据，只丢失损坏的页上的行
+		bool RecoverDBFile(const std::string& db_password)
+		{
+			if (file_system_ == nullptr)
+				return false;
+			TRACE_EVENT0("nim.db", "DBPretreatment::RecoverDBFile");
+			WaitIntegrityCheck(true);
+			WaitBackgroundUpdate(true);
+			db_restore_.WaitBackup(true);
+			UnregisterMemoryTrim();
+			db_.Close();
+			ready_ = false;
+			if (!file_system_->FilePathIsExist(config_.db_path_, false))
+				return false;
+			FileSystemAutoUnLock filesystemautounlock(file_system_);
+			auto recover_path = config_.db_path_ + ("_recover");
+			DeleteDBFile(recover_path);
+			SQLiteRecoveryResult result;
+			int recover_ret = SQLITE_CANTOPEN;
+			{
+				//以读写方式打开，日志中已提交的数据也能读出
+				SQLiteDB broken_db;
+				if (broken_db.Open(config_.db_path_.c_str(), db_password, SQLiteDB::modeReadWrite | SQLiteDB::modeMultiThread))
+					recover_ret = SQLiteRecovery::Recover(&broken_db, recover_path.c_str(), db_password, &result);
+				broken_db.Close();
+			}
+			if (recover_ret != SQLITE_OK || !OnDBRecovered(result))
+			{
+				DeleteDBFile(recover_path);
+				return false;
+			}
+			//损坏文件的日志不能留给新文件
+			auto db_file_bk = config_.db_path_ + ("_bk");
+			if (file_system_->FilePathIsExist(db_file_bk, false))
+				file_system_->DeleteFile(db_file_bk);
+			if (!file_system_->MoveFileX(config_.db_path_, db_file_bk))
+			{
+				DeleteDBFile(recover_path);
+				return false;
+			}
+			DeleteDBFile(config_.db_path_);
+			if (!file_system_->MoveFileX(recover_path, config_.db_path_))
+			{
+				file_system_->MoveFileX(db_file_bk, config_.db_path_);
+				DeleteDBFile(recover_path);
+				return false;
+			}
+			file_system_->DeleteFile(db_file_bk);
+			return true;
+		}
 		bool CheckFieldExist(const std::string& table, const std::string& field) const
 		{
 			SQLiteStatement stmt;
@@ -407,15 +612,26 @@ DB_BEGIN_DECLS
 		virtual void Clear()
 		{			
 			updatefunctions_.clear();
+			background_updates_.clear();
+			cancel_background_update_ = false;
+			cancel_integrity_check_ = false;
+			cancel_warm_up_ = false;
 			file_system_ = nullptr;
 			createdb_sqls_.clear();
 			config_.Clear();
 			db_restore_.Clear();
 			OnClear();
 		};
-		bool CatchDBFileBroken()
+		bool CatchDBFileBroken(const std::string& db_password)
 		{
+			WaitWarmUp(true);
+			WaitIntegrityCheck(true);
+			WaitBackgroundUpdate(true);
+			db_restore_.WaitBackup(true);
+			UnregisterMemoryTrim();
 			db_.Close();
+			if (config_.enable_recover_ && RecoverDBFile(db_password))
+				return true;
 			if (config_.enable_restore_)
 			{
 				if (config_.enable_def_restore_ && db_restore_.DoRestore())
@@ -424,24 +640,276 @@ DB_BEGIN_DECLS
 			return OnDBFileBroken();
 		}
 
+		//db_以modeSerialized打开，可以在发出内存警告的线程上直接释放
+		void RegisterMemoryTrim()
+		{
+			if (memory_trim_id_ != 0)
+				return;
+			memory_trim_id_ = NS_EXTENSION::MemoryTrimmer::Register("nim_db.pretreatment", [this](NS_EXTENSION::MemoryTrimLevel level) {
+				db_.ReleaseMemory(level == NS_EXTENSION::kMemoryTrimCritical);
+			});
+		}
+		void UnregisterMemoryTrim()
+		{
+			if (memory_trim_id_ == 0)
+				return;
+			NS_EXTENSION::MemoryTrimmer::Unregister(memory_trim_id_);
+			memory_trim_id_ = 0;
+		}
+		//删除数据文件和它的日志文件
+		void DeleteDBFile(const std::string& db_path)
+		{
+			static const char* const kSuffixes[] = { "", "-journal", "-wal", "-shm" };
+			for (auto suffix : kSuffixes)
+			{
+				auto path = db_path + suffix;
+				if (file_system_->FilePathIsExist(path, false))
+					file_system_->DeleteFile(path);
+			}
+		}
+		//在后台线程自己的只读连接上检查，不阻塞打开
+		void StartIntegrityCheck(const std::string& db_password)
+		{
+			if (config_.integrity_check_budget_ms_ <= 0)
+				return;
+			cancel_integrity_check_ = false;
+			integrity_check_thread_ = std::thread([this, db_password]() {
+				SQLiteDB db;
+				if (db.Open(config_.db_path_.c_str(), db_password, SQLiteDB::modeReadOnly | SQLiteDB::modeMultiThread))
+				{
+					TRACE_EVENT0("nim.db", "DBPretreatment::IntegrityCheck");
+					SQLiteIntegrityResult result;
+					int check_ret = SQLiteRecovery::QuickCheck(&db, &result, config_.integrity_check_budget_ms_,
+						kIntegrityCheckMaxErrors, &cancel_integrity_check_);
+					//数据库被锁等其他错误不能说明文件损坏
+					if (check_ret == SQLITE_OK || check_ret == SQLITE_CORRUPT || check_ret == SQLITE_NOTADB)
+						OnIntegrityChecked(result);
+				}
+				db.Close();
+			});
+		}
+
+		//在后台线程自己的只读连接上按顺序扫描热点表和索引。连接的页缓存不共用，预热的是系统的页缓存，
+		//db_之后读这些页时不再有磁盘的随机读，使用mmap_size时映射的也是这些页
+		void StartWarmUp(const std::string& db_password)
+		{
+			if (config_.warm_up_budget_ms_ <= 0)
+				return;
+			std::vector<std::string> objects = config_.warm_up_objects_;
+			{
+				SQLiteStatement stmt;
+				if (db_.Query(stmt, "SELECT name FROM version_warm_up ORDER BY update_time DESC") == SQLITE_OK)
+				{
+					while (stmt.NextRow() == SQLITE_ROW)
+					{
+						const char* name = stmt.GetTextField(0);
+						if (name != NULL && std::find(objects.begin(), objects.end(), name) == objects.end())
+							objects.push_back(name);
+					}
+				}
+			}
+			if (objects.empty())
+				return;
+			cancel_warm_up_ = false;
+			warm_up_thread_ = std::thread([this, objects, db_password]() {
+				SQLiteDB db;
+				if (db.Open(config_.db_path_.c_str(), db_password, SQLiteDB::modeReadOnly | SQLiteDB::modeMultiThread))
+				{
+					TRACE_EVENT0("nim.db", "DBPretreatment::WarmUp");
+					RunWarmUp(&db, objects);
+				}
+				db.Close();
+			});
+		}
+		void RunWarmUp(SQLiteDB* db, const std::vector<std::string>& objects)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.warm_up_budget_ms_);
+			for (const auto& name : objects)
+			{
+				if (cancel_warm_up_ || std::chrono::steady_clock::now() >= deadline)
+					break;
+				std::string sql = BuildWarmUpSql(db, name);
+				SQLiteStatement stmt;
+				if (sql.empty() || db->Query(stmt, sql.c_str()) != SQLITE_OK)
+					continue;
+				int rows = 0;
+				while (stmt.NextRow() == SQLITE_ROW)
+				{
+					if (++rows % kWarmUpCheckRows == 0 && (cancel_warm_up_ || std::chrono::steady_clock::now() >= deadline))
+						break;
+				}
+			}
+		}
+		//表不用索引全表扫描，索引按它的第一列排序并指定它，只读索引的页
+		static std::string BuildWarmUpSql(SQLiteDB* db, const std::string& name)
+		{
+			auto quote = [](const std::string& identifier) {
+				std::string quoted("\"");
+				for (auto c : identifier)
+				{
+					if (c == '"')
+						quoted.push_back('"');
+					quoted.push_back(c);
+				}
+				return quoted.append("\"");
+			};
+			std::string type, table;
+			{
+				SQLiteStatement stmt;
+				if (db->Query(stmt, "SELECT type, tbl_name FROM sqlite_master WHERE name=?") != SQLITE_OK)
+					return std::string();
+				stmt.BindText(1, name.c_str());
+				if (stmt.NextRow() != SQLITE_ROW || stmt.GetTextField(0) == NULL || stmt.GetTextField(1) == NULL)
+					return std::string();
+				type = stmt.GetTextField(0);
+				table = stmt.GetTextField(1);
+			}
+			if (type == "table")
+				return "SELECT 1 FROM " + quote(table) + " NOT INDEXED";
+			if (type != "index")
+				return std::string();
+			SQLiteStatement stmt;
+			std::string sql = "PRAGMA index_info(" + quote(name) + ")";
+			if (db->Query(stmt, sql.c_str()) != SQLITE_OK || stmt.NextRow() != SQLITE_ROW || stmt.GetTextField(2) == NULL)
+				return std::string();
+			std::string column = quote(stmt.GetTextField(2));
+			return "SELECT " + column + " FROM " + quote(table) + " INDEXED BY " + quote(name) + " ORDER BY " + column;
+		}
+
 		/****************升级相关接口********************/
 		bool UpdateDataBase()
 		{
+			TRACE_EVENT0("nim.db", "DBPretreatment::UpdateDataBase");
 			//增量升级DB。例如1->2,2->3, 3->4
-			bool ret = true;
-			std::for_each(std::find_if(updatefunctions_.begin(), updatefunctions_.end(), [&](const DBUpdateFunItem& item){return item.first > config_.db_version_now_ ; }),
-									 std::find_if(updatefunctions_.begin(), updatefunctions_.end(), [&](const DBUpdateFunItem& item){return item.first > config_.newest_version_; }),
-				[&](const DBUpdateFunItem& item)->bool{
-				if (!ret) return false;
-				if (item.second(item.first))
-					UpdateVersion(item.first);
-				else
-					ret = false;
-				return ret;
-			});
+			auto begin = std::find_if(updatefunctions_.begin(), updatefunctions_.end(), [&](const DBUpdateFunItem& item){return item.first > config_.db_version_now_ ; });
+			auto end = std::find_if(updatefunctions_.begin(), updatefunctions_.end(), [&](const DBUpdateFunItem& item){return item.first > config_.newest_version_; });
+			size_t total_steps = std::distance(begin, end);
+			if (total_steps > 0)
+			{
+				//逐条语句提交时每条语句都要同步一次文件，放在一个事务中只在最后同步一次，失败时也不会停在中间版本
+				auto version_before = config_.db_version_now_;
+				bool in_transaction = config_.update_in_transaction_ && db_.Query("BEGIN") == SQLITE_OK;
+				bool ret = true;
+				size_t finished_steps = 0;
+				for (auto it = begin; it != end && ret; ++it)
+				{
+					TRACE_EVENT0("nim.db", "DBPretreatment::UpdateStep");
+					auto step_begin = std::chrono::steady_clock::now();
+					ret = it->second(it->first) && UpdateVersion(it->first);
+					DBUpdateStepTiming step;
+					step.version = it->first;
+					step.background = false;
+					step.succeeded = ret;
+					step.batches = 1;
+					step.duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - step_begin).count();
+					AddUpdateTiming(step);
+					OnUpdateProgress(step, ++finished_steps, total_steps);
+				}
+				if (in_transaction)
+				{
+					if (ret && db_.Query("COMMIT") != SQLITE_OK)
+						ret = false;
+					if (!ret)
+					{
+						db_.Query("ROLLBACK");
+						config_.db_version_now_ = version_before;
+					}
+				}
+			}
 			//全量升级DB。例如1->4, 2->4, 3->4
 			return DoOtherUpdate();
 		}
+
+		/****************后台升级********************/
+		void AddUpdateTiming(const DBUpdateStepTiming& step)
+		{
+			std::lock_guard<std::mutex> auto_lock(update_timings_lock_);
+			update_timings_.push_back(step);
+		}
+		void StartBackgroundUpdate(bool new_dbfile, const std::string& db_password)
+		{
+			if (background_updates_.empty())
+				return;
+			if (db_.Query("CREATE TABLE IF NOT EXISTS version_background_update(name TEXT PRIMARY KEY)") != SQLITE_OK)
+				return;
+			DBBackgroundUpdateList pending;
+			for (const auto& item : background_updates_)
+			{
+				if (new_dbfile)
+				{
+					MarkBackgroundUpdateDone(&db_, item.first);
+					continue;
+				}
+				SQLiteStatement stmt;
+				db_.Query(stmt, "SELECT name FROM version_background_update WHERE name=?");
+				stmt.BindText(1, item.first.c_str());
+				if (stmt.NextRow() != SQLITE_ROW)
+					pending.push_back(item);
+			}
+			if (pending.empty())
+				return;
+			cancel_background_update_ = false;
+			background_update_finished_ = false;
+			background_update_thread_ = std::thread([this, pending, db_password]() {
+				SQLiteDB db;
+				if (db.Open(config_.db_path_.c_str(), db_password, SQLiteDB::modeReadWrite | SQLiteDB::modeMultiThread))
+				{
+					db.SetBusyTimeout(kBackgroundUpdateBusyTimeoutMs);
+					RunBackgroundUpdate(&db, pending);
+				}
+				db.Close();
+				background_update_finished_ = true;
+			});
+		}
+		void RunBackgroundUpdate(SQLiteDB* db, const DBBackgroundUpdateList& updates)
+		{
+			for (const auto& item : updates)
+			{
+				if (cancel_background_update_)
+					break;
+				TRACE_EVENT1("nim.db", "DBPretreatment::BackgroundUpdate", "name", TRACE_STR_COPY(item.first.c_str()));
+				DBUpdateStepTiming step;
+				step.version = config_.db_version_now_;
+				step.name = item.first;
+				step.background = true;
+				step.succeeded = false;
+				step.batches = 0;
+				auto step_begin = std::chrono::steady_clock::now();
+				BackgroundUpdateResult result = kBackgroundUpdateMore;
+				while (result == kBackgroundUpdateMore && !cancel_background_update_)
+				{
+					//每一批单独提交，和完成记录在同一个事务中
+					SQLiteAutoTransaction transaction(db);
+					result = item.second(db);
+					step.batches++;
+					if (result == kBackgroundUpdateDone && !MarkBackgroundUpdateDone(db, item.first))
+						result = kBackgroundUpdateFailed;
+					if (result == kBackgroundUpdateFailed)
+						transaction.Rollback();
+					else if (!transaction.Commit())
+						result = kBackgroundUpdateFailed;
+					if (result == kBackgroundUpdateMore && config_.background_update_interval_ms_ > 0)
+						std::this_thread::sleep_for(std::chrono::milliseconds(config_.background_update_interval_ms_));
+				}
+				if (result == kBackgroundUpdateMore)//被取消
+					break;
+				step.succeeded = (result == kBackgroundUpdateDone);
+				step.duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - step_begin).count();
+				AddUpdateTiming(step);
+				OnBackgroundUpdateFinished(step);
+				//后面的升级可能依赖前面的结果，失败时不再继续
+				if (!step.succeeded)
+					break;
+			}
+		}
+		bool MarkBackgroundUpdateDone(SQLiteDB* db, const std::string& name)
+		{
+			SQLiteStatement stmt;
+			if (db->Query(stmt, "INSERT OR REPLACE INTO version_background_update(name) VALUES(?)") != SQLITE_OK)
+				return false;
+			stmt.BindText(1, name.c_str());
+			return stmt.NextRow() == SQLITE_DONE;
+		}
 		
 	private:
 		void NoVersionToBaseVersion()
@@ -489,6 +957,21 @@ DB_BEGIN_DECLS
 		FileSystem* file_system_;
 		DefaultDBRestore db_restore_;		
 		DBUpdateFuncList updatefunctions_;
+		static const int kBackgroundUpdateBusyTimeoutMs = 5000;
+		static const int kIntegrityCheckMaxErrors = 10;
+		static const int kWarmUpCheckRows = 256;
+		static const int kWarmUpObjectKeepDays = 30;
+		DBBackgroundUpdateList background_updates_;
+		std::thread background_update_thread_;
+		std::atomic_bool cancel_background_update_;
+		std::atomic_bool background_update_finished_;
+		mutable std::mutex update_timings_lock_;
+		std::vector<DBUpdateStepTiming> update_timings_;
+		std::thread integrity_check_thread_;
+		std::atomic_bool cancel_integrity_check_;
+		std::thread warm_up_thread_;
+		std::atomic_bool cancel_warm_up_;
+		int memory_trim_id_;
 		
 	};
 DB_END_DECLS
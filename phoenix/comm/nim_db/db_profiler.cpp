@@ -0,0 +1,241 @@
+// SQLite statement profiling
+
+#include "nim_db/db_profiler.h"
+#include "nim_db/db_log.h"
+#include <algorithm>
+#include <climits>
+#include "base/metrics/histogram.h"
+
+DB_BEGIN_DECLS
+
+SQLiteProfiler::SQLiteProfiler()
+{
+	db_                  = NULL;
+	slow_query_us_       = 0;
+	time_histogram_      = base::Histogram::FactoryGet("SQLite.QueryTimeUs", 1, 10 * 1000 * 1000, 50,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+	full_scan_histogram_ = base::Histogram::FactoryGet("SQLite.FullScanSteps", 1, 10 * 1000 * 1000, 50,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+	vm_step_histogram_   = base::Histogram::FactoryGet("SQLite.VMSteps", 1, 100 * 1000 * 1000, 50,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+	cache_hit_histogram_ = base::LinearHistogram::FactoryGet("SQLite.CacheHitPercent", 1, 100, 101,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+}
+
+SQLiteProfiler::~SQLiteProfiler()
+{
+	Detach();
+}
+
+bool SQLiteProfiler::Attach(SQLiteDB* db, int slow_query_ms/* = 100*/)
+{
+	Detach();
+
+	if (db == NULL || !db->IsValid())
+		return false;
+
+	// 清零连接的缓存计数，第一条语句的命中率不包含之前的查询
+	int current = 0, highwater = 0;
+	sqlite3_db_status(db->sqlite3_, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1);
+	sqlite3_db_status(db->sqlite3_, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1);
+
+	db_            = db;
+	slow_query_us_ = (int64_t)slow_query_ms * 1000;
+	Install();
+	return true;
+}
+
+void SQLiteProfiler::Detach()
+{
+	if (db_ == NULL)
+		return;
+
+	if (db_->IsValid())
+		Uninstall();
+	db_ = NULL;
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	pending_full_scans_.clear();
+}
+
+void SQLiteProfiler::Install()
+{
+	sqlite3_profile(db_->sqlite3_, &SQLiteProfiler::OnProfile, this);
+	db_->SetStatementObserver(&SQLiteProfiler::OnStatementDone, this);
+}
+
+void SQLiteProfiler::Uninstall()
+{
+	sqlite3_profile(db_->sqlite3_, NULL, NULL);
+	db_->SetStatementObserver(NULL, NULL);
+}
+
+void SQLiteProfiler::OnProfile(void* context, const char* sql, sqlite3_uint64 time_ns)
+{
+	static_cast<SQLiteProfiler*>(context)->RecordTime(sql, (int64_t)(time_ns / 1000));
+}
+
+void SQLiteProfiler::OnStatementDone(void* context, sqlite3_stmt* stmt)
+{
+	static_cast<SQLiteProfiler*>(context)->RecordCounters(stmt);
+}
+
+void SQLiteProfiler::RecordTime(const char* sql, int64_t time_us)
+{
+	time_histogram_->Add((int)(time_us > INT_MAX ? INT_MAX : time_us));
+
+	if (time_us < slow_query_us_ || sql == NULL)
+		return;
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	auto it = slow_queries_.find(sql);
+	if (it == slow_queries_.end())
+	{
+		if (slow_queries_.size() >= kMaxSlowQueries)
+			return;
+		it = slow_queries_.insert(std::make_pair(std::string(sql), SlowQuery())).first;
+	}
+	SlowQuery& query = it->second;
+	query.count++;
+	if (time_us > query.max_time_us)
+	{
+		// 回调里只有SQL文本，这次执行的全表扫描数由随后的RecordCounters补上；
+		// sqlite3_exec等不经过SQLiteStatement执行的语句没有计数，保持上一次的值
+		query.max_time_us = time_us;
+		if (std::find(pending_full_scans_.begin(), pending_full_scans_.end(), sql) == pending_full_scans_.end())
+		{
+			if (pending_full_scans_.size() >= kMaxSlowQueries)
+				pending_full_scans_.erase(pending_full_scans_.begin());
+			pending_full_scans_.push_back(sql);
+		}
+	}
+}
+
+void SQLiteProfiler::RecordCounters(sqlite3_stmt* stmt)
+{
+	// 语句的计数是累计值，取出后清零，下次执行只统计自己的部分
+	int full_scan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+	int vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+	int cache_hit = 0, cache_miss = 0, highwater = 0;
+	sqlite3* db = sqlite3_db_handle(stmt);
+	sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &cache_hit, &highwater, 1);
+	sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &cache_miss, &highwater, 1);
+
+	full_scan_histogram_->Add(full_scan_steps);
+	vm_step_histogram_->Add(vm_steps);
+	if (cache_hit + cache_miss > 0)
+		cache_hit_histogram_->Add((int)((int64_t)cache_hit * 100 / (cache_hit + cache_miss)));
+
+	// 回调的SQL文本就是sqlite3_sql()返回的那一份
+	const char* sql = sqlite3_sql(stmt);
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	auto pending = std::find(pending_full_scans_.begin(), pending_full_scans_.end(), sql);
+	if (sql == NULL || pending == pending_full_scans_.end())
+		return;
+	pending_full_scans_.erase(pending);
+	auto it = slow_queries_.find(sql);
+	if (it != slow_queries_.end())
+		it->second.full_scan_steps = full_scan_steps;
+}
+
+void SQLiteProfiler::ReportSlowQueries()
+{
+	std::map<std::string, SlowQuery> slow_queries;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		slow_queries.swap(slow_queries_);
+		pending_full_scans_.clear();
+	}
+	for (auto& it : slow_queries)
+	{
+		DB_QLOG_WAR(GetLogger(), "[db] slow query {0} times, max {1}us, full scan steps {2}, sql: {3}, plan: {4}")
+			<< it.second.count << it.second.max_time_us << it.second.full_scan_steps
+			<< it.first << ExplainQueryPlan(it.first);
+	}
+}
+
+std::map<std::string, SQLiteProfiler::SlowQuery> SQLiteProfiler::GetSlowQueries()
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	return slow_queries_;
+}
+
+std::vector<std::string> SQLiteProfiler::GetSlowQueryObjects()
+{
+	std::vector<std::string> sqls;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		for (auto& it : slow_queries_)
+			sqls.push_back(it.first);
+	}
+	std::vector<std::string> names;
+	for (auto& sql : sqls)
+		ParseQueryPlanObjects(ExplainQueryPlan(sql), names);
+	return names;
+}
+
+void SQLiteProfiler::ParseQueryPlanObjects(const std::string& plan, std::vector<std::string>& names)
+{
+	std::vector<std::string> tokens;
+	size_t begin = 0;
+	while (begin < plan.size())
+	{
+		size_t end = plan.find_first_of(" ;", begin);
+		if (end == std::string::npos)
+			end = plan.size();
+		if (end > begin)
+			tokens.push_back(plan.substr(begin, end - begin));
+		begin = end + 1;
+	}
+
+	auto add_name = [&names](const std::string& name) {
+		if (std::find(names.begin(), names.end(), name) == names.end())
+			names.push_back(name);
+	};
+	for (size_t i = 0; i + 1 < tokens.size(); i++)
+	{
+		// "SCAN TABLE msg AS m"，新版本的 SQLite 没有 TABLE
+		if (tokens[i] == "SCAN" || tokens[i] == "SEARCH")
+		{
+			size_t j = (tokens[i + 1] == "TABLE") ? i + 2 : i + 1;
+			if (j < tokens.size() && tokens[j] != "SUBQUERY" && tokens[j] != "CONSTANT")
+				add_name(tokens[j]);
+		}
+		// 自动索引是执行时临时建的，文件中没有它的页
+		else if (tokens[i] == "INDEX" && !(i >= 1 && tokens[i - 1] == "AUTOMATIC")
+			&& !(i >= 2 && tokens[i - 2] == "AUTOMATIC"))
+		{
+			add_name(tokens[i + 1]);
+		}
+	}
+}
+
+std::string SQLiteProfiler::ExplainQueryPlan(const std::string& sql)
+{
+	if (db_ == NULL || !db_->IsValid())
+		return std::string();
+
+	std::string explain_sql("EXPLAIN QUERY PLAN ");
+	explain_sql.append(sql);
+
+	// 查询计划本身不应再被统计
+	Uninstall();
+	std::string plan;
+	{
+		SQLiteStatement statement;
+		if (SQLITE_OK == db_->Query(statement, explain_sql.c_str(), (int)explain_sql.size()))
+		{
+			// 每行的最后一列是计划的描述，如"SCAN TABLE msg"
+			for (SQLiteRow row : db_->Rows(statement))
+			{
+				if (!plan.empty())
+					plan.append("; ");
+				plan.append(row.GetText(row.GetColumnCount() - 1));
+			}
+		}
+	}
+	Install();
+	return plan;
+}
+
+DB_END_DECLS
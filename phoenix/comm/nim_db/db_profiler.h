@@ -0,0 +1,106 @@
+#ifndef __BASE_DB_PROFILER_H__
+#define __BASE_DB_PROFILER_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <map>
+#include <mutex>
+#include <vector>
+#include "nim_log/wrapper/log.h"
+
+namespace base {
+class HistogramBase;
+}
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Per-statement profiling of a SQLiteDB by sqlite3_profile
+    *  Remark      Every finished statement records into histograms:
+    *                  SQLite.QueryTimeUs          execution time in microseconds
+    *                  SQLite.FullScanSteps        rows stepped by full table scans
+    *                  SQLite.VMSteps              virtual machine steps
+    *                  SQLite.CacheHitPercent      page cache hit ratio of the connection since the last statement
+    *              The time is of every statement, the bundled SQLite 3.8.7 measures it in milliseconds.
+    *              The step counters are only of the statements run by SQLiteDB::Query(SQLiteStatement&, ...),
+    *              the profile callback of 3.8.7 has the SQL text but not the statement.
+    *              Statements slower than the threshold are collected, ReportSlowQueries() writes them to
+    *              the logger with their query plans. It is not done in the profile callback because SQLite
+    *              does not allow the callback to use the connection which invoked it.
+    *              Bound values are never logged, only the SQL text.
+    */
+class DB_EXPORT SQLiteProfiler : public NS_NIMLOG::LoggerSetter
+{
+public:
+
+    struct SlowQuery
+    {
+        SlowQuery() : count(0), max_time_us(0), full_scan_steps(0) {}
+
+        uint32_t    count;
+        int64_t     max_time_us;
+        int         full_scan_steps;        // Of the slowest execution
+    };
+
+    SQLiteProfiler();
+    virtual ~SQLiteProfiler();
+
+    /*
+        *  Purpose     Install the profile callback to db, the profiler must be detached before db is closed
+        *  slow_query_ms   Threshold of a slow query
+        */
+    bool Attach(SQLiteDB* db, int slow_query_ms = 100);
+    void Detach();
+
+    /*
+        *  Purpose     Write the collected slow queries with EXPLAIN QUERY PLAN to the logger and clear them
+        *  Remark      Call it on a thread which may use the attached db, e.g. after a batch of queries
+        */
+    void ReportSlowQueries();
+
+    /*
+        *  Purpose     The collected slow queries keyed by SQL text
+        */
+    std::map<std::string, SlowQuery> GetSlowQueries();
+
+    /*
+        *  Purpose     The tables and indexes read by the collected slow queries, told by their query plans,
+        *              e.g. for DBPretreatment::AddWarmUpObjects
+        *  Remark      Call it on a thread which may use the attached db, the slow queries are kept
+        */
+    std::vector<std::string> GetSlowQueryObjects();
+
+    /*
+        *  Purpose     Append the tables and indexes of an EXPLAIN QUERY PLAN text like
+        *              "SEARCH TABLE msg USING INDEX msg_time (time>?)" to names, without duplicates
+        */
+    static void ParseQueryPlanObjects(const std::string& plan, std::vector<std::string>& names);
+
+private:
+
+    SQLiteProfiler(const SQLiteProfiler&);
+    SQLiteProfiler& operator=(const SQLiteProfiler&);
+
+    static void OnProfile(void* context, const char* sql, sqlite3_uint64 time_ns);
+    static void OnStatementDone(void* context, sqlite3_stmt* stmt);
+    void RecordTime(const char* sql, int64_t time_us);
+    void RecordCounters(sqlite3_stmt* stmt);
+    void Install();
+    void Uninstall();
+    std::string ExplainQueryPlan(const std::string& sql);
+
+    static const size_t kMaxSlowQueries = 64;
+
+    SQLiteDB*                           db_;
+    int64_t                             slow_query_us_;
+    base::HistogramBase*                time_histogram_;
+    base::HistogramBase*                full_scan_histogram_;
+    base::HistogramBase*                vm_step_histogram_;
+    base::HistogramBase*                cache_hit_histogram_;
+    std::mutex                          mutex_;             // 保护slow_queries_、pending_full_scans_
+    std::map<std::string, SlowQuery>    slow_queries_;
+    // 刷新了最长时间、还在等执行计数的慢查询，即sqlite3_sql()的指针
+    std::vector<const char*>            pending_full_scans_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_PROFILER_H__
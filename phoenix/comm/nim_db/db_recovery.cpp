@@ -0,0 +1,411 @@
+// Integrity check and recovery of damaged databases
+
+#include "nim_db/db_recovery.h"
+#include <chrono>
+#include <limits>
+#include <string.h>
+
+DB_BEGIN_DECLS
+
+namespace
+{
+
+// 进度回调的间隔（虚拟机指令数）
+const int kProgressOps = 1000;
+// 读到损坏的页后rowid向后跳的次数，每次距离乘以kSkipGrowth
+const int kMaxSkipAttempts = 16;
+const sqlite3_int64 kSkipGrowth = 8;
+
+struct ProgressBudget
+{
+	bool                                    has_deadline;
+	std::chrono::steady_clock::time_point   deadline;
+	const std::atomic_bool*                 cancel;
+	bool                                    expired;
+};
+
+int OnProgress(void* param)
+{
+	ProgressBudget* budget = (ProgressBudget*)param;
+	if (budget->cancel != NULL && *budget->cancel)
+		return 1;
+	if (budget->has_deadline && std::chrono::steady_clock::now() >= budget->deadline)
+	{
+		budget->expired = true;
+		return 1;
+	}
+	return 0;
+}
+
+struct SchemaItem
+{
+	std::string type;
+	std::string name;
+	std::string table;
+	std::string sql;
+};
+
+enum CopyResult
+{
+	kCopyComplete,
+	kCopyPartial,
+	kCopyFailed,
+};
+
+std::string GetText(SQLiteStatement& statement, int col)
+{
+	const char* text = statement.GetTextField(col);
+	return text != NULL ? std::string(text) : std::string();
+}
+
+bool StartsWithNoCase(const std::string& text, const std::string& prefix)
+{
+	return text.size() >= prefix.size() && sqlite3_strnicmp(text.c_str(), prefix.c_str(), (int)prefix.size()) == 0;
+}
+
+bool ContainsNoCase(const std::string& text, const std::string& word)
+{
+	if (word.empty() || text.size() < word.size())
+		return false;
+	for (size_t i = 0; i + word.size() <= text.size(); i++)
+	{
+		if (sqlite3_strnicmp(text.c_str() + i, word.c_str(), (int)word.size()) == 0)
+			return true;
+	}
+	return false;
+}
+
+std::string QuoteIdentifier(const std::string& name)
+{
+	std::string result("\"");
+	for (char c : name)
+	{
+		if (c == '"')
+			result.push_back('"');
+		result.push_back(c);
+	}
+	result.push_back('"');
+	return result;
+}
+
+int ReadSchema(SQLiteDB* source, std::vector<SchemaItem>& schema)
+{
+	SQLiteStatement statement;
+	int r = source->Query(statement, "SELECT type, name, tbl_name, sql FROM sqlite_master WHERE sql IS NOT NULL");
+	if (r != SQLITE_OK)
+		return r;
+	while ((r = statement.NextRow()) == SQLITE_ROW)
+	{
+		SchemaItem item;
+		item.type  = GetText(statement, 0);
+		item.name  = GetText(statement, 1);
+		item.table = GetText(statement, 2);
+		item.sql   = GetText(statement, 3);
+		schema.push_back(item);
+	}
+	return r == SQLITE_DONE ? SQLITE_OK : r;
+}
+
+bool ReadColumns(SQLiteDB* source, const std::string& quoted_table, std::vector<std::string>& columns)
+{
+	std::string sql = "PRAGMA table_info(" + quoted_table + ")";
+	SQLiteStatement statement;
+	if (source->Query(statement, sql.c_str(), (int)sql.size()) != SQLITE_OK)
+		return false;
+	int r = SQLITE_OK;
+	while ((r = statement.NextRow()) == SQLITE_ROW)
+		columns.push_back(GetText(statement, 1));
+	return r == SQLITE_DONE;
+}
+
+bool HasRowid(SQLiteDB* source, const std::string& quoted_table)
+{
+	// WITHOUT ROWID的表没有rowid列，编译语句就会失败
+	std::string sql = "SELECT rowid FROM " + quoted_table + " LIMIT 0";
+	SQLiteStatement statement;
+	return source->Query(statement, sql.c_str(), (int)sql.size()) == SQLITE_OK;
+}
+
+CopyResult CopyTable(SQLiteDB* source, SQLiteDB* dest, const std::string& table, SQLiteRecoveryResult* result)
+{
+	std::string quoted = QuoteIdentifier(table);
+	std::vector<std::string> columns;
+	if (!ReadColumns(source, quoted, columns) || columns.empty())
+		return kCopyFailed;
+
+	bool has_rowid = HasRowid(source, quoted);
+	std::string column_list = has_rowid ? "rowid" : "";
+	std::string placeholders = has_rowid ? "?" : "";
+	for (const auto& column : columns)
+	{
+		if (!column_list.empty())
+		{
+			column_list.append(", ");
+			placeholders.append(", ");
+		}
+		column_list.append(QuoteIdentifier(column));
+		placeholders.append("?");
+	}
+	int value_count = (int)columns.size() + (has_rowid ? 1 : 0);
+
+	std::string select_sql = "SELECT " + column_list + " FROM " + quoted;
+	if (has_rowid)
+		select_sql.append(" WHERE rowid>=? ORDER BY rowid");
+	std::string insert_sql = "INSERT INTO " + quoted + "(" + column_list + ") VALUES(" + placeholders + ")";
+	SQLiteStatement insert;
+	if (dest->Query(insert, insert_sql.c_str(), (int)insert_sql.size()) != SQLITE_OK)
+		return kCopyFailed;
+
+	sqlite3_int64 next_rowid = (std::numeric_limits<sqlite3_int64>::min)();
+	sqlite3_int64 last_rowid = 0;
+	sqlite3_int64 skip = 1;
+	int skip_attempts = 0;
+	bool has_row = false;
+	bool damaged = false;
+	for (;;)
+	{
+		int r = SQLITE_OK;
+		bool progressed = false;
+		{
+			SQLiteStatement select;
+			r = source->Query(select, select_sql.c_str(), (int)select_sql.size());
+			if (r == SQLITE_OK && has_rowid)
+				r = select.BindInt64(1, next_rowid);
+			while (r == SQLITE_OK && (r = select.NextRow()) == SQLITE_ROW)
+			{
+				// sqlite3_bind_value复制值，不依赖源语句的下一步
+				for (int i = 0; i < value_count; i++)
+					insert.BindValue(i + 1, select.GetFieldValue(i));
+				if (insert.NextRow() == SQLITE_DONE)
+					result->rows_recovered++;
+				else
+					result->rows_failed++;
+				insert.Rewind();
+				if (has_rowid)
+					last_rowid = select.GetInt64Field(0);
+				has_row = true;
+				progressed = true;
+				r = SQLITE_OK;
+			}
+		}
+		if (r == SQLITE_DONE)
+			break;
+
+		// 读到损坏的页，从更大的rowid重新定位，跳过损坏的部分
+		if (progressed || !damaged)
+			result->damaged_ranges++;
+		damaged = true;
+		if (!has_rowid)
+			break;
+		if (progressed)
+		{
+			skip = 1;
+			skip_attempts = 0;
+		}
+		if (++skip_attempts > kMaxSkipAttempts)
+			break;
+		sqlite3_int64 from = has_row ? last_rowid : 0;
+		if (from > (std::numeric_limits<sqlite3_int64>::max)() - skip)
+			break;
+		next_rowid = from + skip;
+		if (skip <= (std::numeric_limits<sqlite3_int64>::max)() / kSkipGrowth)
+			skip *= kSkipGrowth;
+	}
+
+	if (!damaged)
+		return kCopyComplete;
+	return has_row ? kCopyPartial : kCopyFailed;
+}
+
+void CopySequences(SQLiteDB* source, SQLiteDB* dest)
+{
+	if (!dest->DoesTableExist("sqlite_sequence"))
+		return;
+	SQLiteStatement select;
+	if (source->Query(select, "SELECT name, seq FROM sqlite_sequence") != SQLITE_OK)
+		return;
+	// 复制数据时新库已经记下了最大的rowid，只会调大
+	SQLiteStatement update;
+	SQLiteStatement insert;
+	if (dest->Query(update, "UPDATE sqlite_sequence SET seq=?2 WHERE name=?1 AND seq<?2") != SQLITE_OK ||
+		dest->Query(insert, "INSERT INTO sqlite_sequence(name, seq) SELECT ?1, ?2 WHERE NOT EXISTS "
+			"(SELECT 1 FROM sqlite_sequence WHERE name=?1)") != SQLITE_OK)
+		return;
+	while (select.NextRow() == SQLITE_ROW)
+	{
+		update.BindValue(1, select.GetFieldValue(0));
+		update.BindValue(2, select.GetFieldValue(1));
+		update.NextRow();
+		update.Rewind();
+		insert.BindValue(1, select.GetFieldValue(0));
+		insert.BindValue(2, select.GetFieldValue(1));
+		insert.NextRow();
+		insert.Rewind();
+	}
+}
+
+int GetUserVersion(SQLiteDB* db)
+{
+	SQLiteStatement statement;
+	if (db->Query(statement, "PRAGMA user_version") != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+		return 0;
+	return statement.GetIntField(0);
+}
+
+}
+
+int SQLiteRecovery::QuickCheck(SQLiteDB* db, SQLiteIntegrityResult* result, int budget_ms/* = 0*/, int max_errors/* = 10*/,
+	const std::atomic_bool* cancel/* = NULL*/)
+{
+	if (db == NULL || !db->IsValid() || result == NULL)
+		return SQLITE_MISUSE;
+
+	*result = SQLiteIntegrityResult();
+	auto begin = std::chrono::steady_clock::now();
+	ProgressBudget budget;
+	budget.has_deadline = budget_ms > 0;
+	budget.deadline     = begin + std::chrono::milliseconds(budget_ms);
+	budget.cancel       = cancel;
+	budget.expired      = false;
+	sqlite3_progress_handler(db->sqlite3_, kProgressOps, &OnProgress, &budget);
+
+	std::string sql = "PRAGMA quick_check(" + std::to_string(max_errors > 0 ? max_errors : 1) + ")";
+	int r = SQLITE_OK;
+	{
+		SQLiteStatement statement;
+		r = db->Query(statement, sql.c_str(), (int)sql.size());
+		while (r == SQLITE_OK && (r = statement.NextRow()) == SQLITE_ROW)
+		{
+			std::string text = GetText(statement, 0);
+			if (text != "ok")
+				result->errors.push_back(text);
+			r = SQLITE_OK;
+		}
+	}
+	if (r != SQLITE_DONE && r != SQLITE_INTERRUPT)
+		result->errors.push_back(db->GetLastErrorMessage());
+	db->InstallCancellationHandler();
+	result->duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+	if (r == SQLITE_INTERRUPT && !budget.expired)
+		return SQLITE_INTERRUPT;
+	// 预算用完时只说明已检查的部分没有问题
+	result->completed = (r != SQLITE_INTERRUPT);
+	result->ok        = result->errors.empty();
+	if (r == SQLITE_DONE || r == SQLITE_INTERRUPT)
+		return SQLITE_OK;
+	return r;
+}
+
+int SQLiteRecovery::Recover(SQLiteDB* source, const char* dest_path, const std::string& key, SQLiteRecoveryResult* result)
+{
+	if (source == NULL || !source->IsValid() || dest_path == NULL || result == NULL)
+		return SQLITE_MISUSE;
+
+	*result = SQLiteRecoveryResult();
+	// sqlite_master损坏时无法知道有哪些表，只能整个恢复备份
+	std::vector<SchemaItem> schema;
+	int r = ReadSchema(source, schema);
+	if (r != SQLITE_OK)
+		return r;
+
+	SQLiteDB dest;
+	if (!dest.Open(dest_path, key, SQLiteDB::modeReadWrite | SQLiteDB::modeCreate | SQLiteDB::modeMultiThread))
+		return SQLITE_CANTOPEN;
+	// auto_vacuum要在建第一个表之前设置
+	int auto_vacuum = source->GetAutoVacuumMode();
+	if (auto_vacuum != 0)
+		dest.Query(("PRAGMA auto_vacuum=" + std::to_string(auto_vacuum)).c_str());
+
+	// 虚表的影子表以虚表名加下划线开头，它们和虚表一起跳过
+	std::vector<std::string> virtual_tables;
+	for (const auto& item : schema)
+	{
+		if (item.type == "table" && StartsWithNoCase(item.sql, "CREATE VIRTUAL TABLE"))
+			virtual_tables.push_back(item.name);
+	}
+	auto IsVirtualTable = [&virtual_tables](const std::string& name) {
+		for (const auto& table : virtual_tables)
+		{
+			if (sqlite3_stricmp(name.c_str(), table.c_str()) == 0 || StartsWithNoCase(name, table + "_"))
+				return true;
+		}
+		return false;
+	};
+	auto UsesVirtualTable = [&virtual_tables](const std::string& sql) {
+		for (const auto& table : virtual_tables)
+		{
+			if (ContainsNoCase(sql, table))
+				return true;
+		}
+		return false;
+	};
+
+	r = dest.Query("BEGIN");
+	if (r != SQLITE_OK)
+		return r;
+
+	bool has_sequence = false;
+	for (const auto& item : schema)
+	{
+		if (item.type != "table")
+			continue;
+		if (StartsWithNoCase(item.name, "sqlite_"))
+		{
+			// sqlite_sequence由AUTOINCREMENT的表自动创建，sqlite_stat*可以用ANALYZE重新生成
+			has_sequence |= (sqlite3_stricmp(item.name.c_str(), "sqlite_sequence") == 0);
+			continue;
+		}
+		if (IsVirtualTable(item.name))
+		{
+			if (StartsWithNoCase(item.sql, "CREATE VIRTUAL TABLE"))
+				result->skipped_tables.push_back(item.name);
+			continue;
+		}
+		if (dest.Query(item.sql.c_str()) != SQLITE_OK)
+		{
+			result->failed_tables.push_back(item.name);
+			continue;
+		}
+		switch (CopyTable(source, &dest, item.name, result))
+		{
+		case kCopyComplete:
+			result->recovered_tables.push_back(item.name);
+			break;
+		case kCopyPartial:
+			result->partial_tables.push_back(item.name);
+			break;
+		case kCopyFailed:
+			result->failed_tables.push_back(item.name);
+			break;
+		}
+	}
+
+	// 索引、视图和触发器在数据之后创建，复制时不用维护索引，触发器也不会被复制的数据触发
+	for (const auto& item : schema)
+	{
+		if (item.type == "table" || StartsWithNoCase(item.name, "sqlite_"))
+			continue;
+		if (IsVirtualTable(item.table) || UsesVirtualTable(item.sql))
+			continue;
+		if (dest.Query(item.sql.c_str()) != SQLITE_OK)
+			result->failed_schema.push_back(item.name);
+	}
+
+	if (has_sequence)
+		CopySequences(source, &dest);
+	int user_version = GetUserVersion(source);
+	if (user_version != 0)
+		dest.Query(("PRAGMA user_version=" + std::to_string(user_version)).c_str());
+
+	r = dest.Query("COMMIT");
+	if (r != SQLITE_OK)
+	{
+		dest.Query("ROLLBACK");
+		return r;
+	}
+	dest.Close();
+	return SQLITE_OK;
+}
+
+DB_END_DECLS
@@ -0,0 +1,86 @@
+#ifndef __BASE_DB_RECOVERY_H__
+#define __BASE_DB_RECOVERY_H__
+
+#include "nim_db/db_sqlite3.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Result of SQLiteRecovery::QuickCheck
+    */
+struct SQLiteIntegrityResult
+{
+    SQLiteIntegrityResult() : ok(false), completed(false), duration_ms(0) {}
+
+    bool                        ok;             // No problem was found, it may be found later if completed is false
+    bool                        completed;      // The check covered the whole file within the budget
+    std::vector<std::string>    errors;         // Problems reported by PRAGMA quick_check
+    int64_t                     duration_ms;
+};
+
+/*
+    *  Purpose     Result of SQLiteRecovery::Recover
+    */
+struct SQLiteRecoveryResult
+{
+    SQLiteRecoveryResult() : rows_recovered(0), rows_failed(0), damaged_ranges(0) {}
+
+    std::vector<std::string>    recovered_tables;   // Every row was read
+    std::vector<std::string>    partial_tables;     // Some rows were lost on the damaged pages
+    std::vector<std::string>    failed_tables;      // Nothing could be read or the table could not be created
+    std::vector<std::string>    skipped_tables;     // Virtual tables, e.g. SQLiteFtsIndex, they must be created again
+    std::vector<std::string>    failed_schema;      // Indexes, views and triggers which could not be created
+    int64_t                     rows_recovered;
+    int64_t                     rows_failed;        // Rows read but rejected by the new table
+    int64_t                     damaged_ranges;     // Count of the places where reading stopped and had to skip ahead
+
+    bool IsComplete() const { return partial_tables.empty() && failed_tables.empty() && rows_failed == 0; }
+};
+
+/*
+    *  Purpose     Integrity check and table level recovery of a damaged database, instead of
+    *              replacing the whole file by an old backup
+    */
+class DB_EXPORT SQLiteRecovery
+{
+public:
+
+    /*
+        *  Purpose     Run PRAGMA quick_check, stop after budget_ms
+        *  budget_ms   0 means no limit, otherwise the check is interrupted and completed is false
+        *  max_errors  Stop after so many problems were found
+        *  cancel      Stop the check when it becomes true, can be NULL
+        *  Remark      quick_check reads every page of the file but skips the index content check of
+        *              integrity_check, it holds a read transaction on db while it runs, so it should
+        *              run on its own connection of a WAL database, or writers have to wait for it.
+        *  Return      SQLITE_OK if the check finished or the budget ran out, SQLITE_INTERRUPT if canceled,
+        *              otherwise the error which stopped it (SQLITE_CORRUPT/SQLITE_NOTADB means not ok)
+        */
+    static int QuickCheck(SQLiteDB* db, SQLiteIntegrityResult* result, int budget_ms = 0, int max_errors = 10,
+        const std::atomic_bool* cancel = NULL);
+
+    /*
+        *  Purpose     Copy every readable row of every table of source into a new database
+        *  source      Damaged database, it is only read
+        *  dest_path   Destination file, it must not exist
+        *  key         Encrypt key of the destination, see SQLiteDB::Open
+        *  Remark      The schema is read from sqlite_master, so it must be readable. Tables are copied
+        *              in rowid order, when a damaged page stops the reading, it goes on from larger and
+        *              larger rowids after the damage, so the rows on the intact pages are kept. Rowids are
+        *              kept, indexes, views and triggers are created after the data and user_version is copied.
+        *              Virtual tables, their shadow tables and the triggers referring to them are not copied,
+        *              SQLiteFtsIndex::Create() creates them again and indexes the recovered rows.
+        *  Return      SQLITE_OK if the destination was written, the tables may still be partial, see result
+        */
+    static int Recover(SQLiteDB* source, const char* dest_path, const std::string& key, SQLiteRecoveryResult* result);
+
+private:
+
+    SQLiteRecovery();
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_RECOVERY_H__
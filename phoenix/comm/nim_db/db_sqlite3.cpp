@@ -8,37 +8,181 @@
 
 #include "nim_db/db_sqlite3.h"
 #include <assert.h>
+#include <mutex>
+#include "base/containers/mru_cache.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/memory/memory_accounting.h"
 
 static const char kNULL[] = "\0\0\0";
 
 DB_BEGIN_DECLS
-	
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteStatementCache
+class SQLiteStatementCache
+{
+	struct StatementDeletor
+	{
+		void operator()(sqlite3_stmt* stmt) const { sqlite3_finalize(stmt); }
+	};
+	typedef base::MRUCacheBase<std::string, sqlite3_stmt*, StatementDeletor> StatementMap;
+
+public:
+	explicit SQLiteStatementCache(size_t capacity)
+		: capacity_(capacity), statements_(StatementMap::NO_AUTO_EVICT), observer_(NULL), observer_context_(NULL)
+	{
+	}
+
+	// 取出一个已缓存的语句，同一条SQL同时被多处使用时，只有第一处能取到
+	sqlite3_stmt* Take(const std::string& sql)
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		StatementMap::iterator it = statements_.Peek(sql);
+		if (it == statements_.end())
+			return NULL;
+		sqlite3_stmt* stmt = it->second;
+		it->second = NULL;
+		statements_.Erase(it);
+		return stmt;
+	}
+
+	// 重置语句并清空绑定后放回缓存，超出容量时淘汰最久未使用的语句；
+	// 返回sqlite3_reset的结果，即上一次执行的错误码，与sqlite3_finalize的返回值相同
+	int Give(const std::string& sql, sqlite3_stmt* stmt)
+	{
+		int r = sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		// 没有执行完就放回的语句，计数不要带到下一次执行里
+		sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+		sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (capacity_ == 0)
+		{
+			sqlite3_finalize(stmt);
+			return r;
+		}
+		statements_.Put(sql, stmt);
+		statements_.ShrinkToSize(capacity_);
+		return r;
+	}
+
+	void SetCapacity(size_t capacity)
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		capacity_ = capacity;
+		statements_.ShrinkToSize(capacity_);
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		statements_.Clear();
+	}
+
+	// 在锁内调用observer，SetObserver(NULL)返回后不会再有调用
+	void SetObserver(SQLiteStatementObserver observer, void* context)
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		observer_         = observer;
+		observer_context_ = context;
+	}
+
+	void OnStatementDone(sqlite3_stmt* stmt)
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (observer_ != NULL)
+			observer_(observer_context_, stmt);
+	}
+
+private:
+	std::mutex mutex_;
+	size_t capacity_;
+	StatementMap statements_;
+	SQLiteStatementObserver observer_;
+	void* observer_context_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteOpenOptions
+SQLiteOpenOptions SQLiteOpenOptions::Durable()
+{
+	SQLiteOpenOptions options;
+	options.journal_mode = "WAL";
+	options.synchronous  = kSynchronousFull;
+	return options;
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::FastCache()
+{
+	SQLiteOpenOptions options;
+	options.journal_mode  = "WAL";
+	options.synchronous   = kSynchronousNormal;
+	options.cache_size_kb = 16 * 1024;
+	options.temp_store    = kTempStoreMemory;
+	return options;
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::ReadMostly()
+{
+	SQLiteOpenOptions options;
+	options.synchronous   = kSynchronousNormal;
+	options.cache_size_kb = 8 * 1024;
+	options.mmap_size     = 256 * 1024 * 1024;
+	options.page_size     = 4096;
+	return options;
+}
+
+bool SQLiteOpenOptions::GetPreset(const std::string& name, SQLiteOpenOptions& options)
+{
+	if (name == "durable")
+		options = Durable();
+	else if (name == "fast-cache")
+		options = FastCache();
+	else if (name == "read-mostly")
+		options = ReadMostly();
+	else
+		return false;
+	return true;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // SQLiteDB
 SQLiteDB::SQLiteDB()
 {
-	sqlite3_ = NULL;
+	sqlite3_    = NULL;
+	stmt_cache_ = new SQLiteStatementCache(kDefaultStatementCacheSize);
 }
 	
 SQLiteDB::SQLiteDB(SQLiteDB& src)
 {
-	sqlite3_     = src.sqlite3_;
-	src.sqlite3_ = NULL;
+	sqlite3_        = src.sqlite3_;
+	stmt_cache_     = src.stmt_cache_;
+	src.sqlite3_    = NULL;
+	src.stmt_cache_ = NULL;
+	cancellation_token_ = src.cancellation_token_;
+	InstallCancellationHandler();
 }
 	
 SQLiteDB::~SQLiteDB()
 {
 	Interrupt();
-	Close();
+	// 关闭失败时还有语句未释放，它们仍会访问缓存，缓存随连接一起保留
+	if (Close())
+		delete stmt_cache_;
 }
 	
 SQLiteDB& SQLiteDB::operator=(SQLiteDB& src)
 {
 	Interrupt();
-	Close();
+	if (Close())
+		delete stmt_cache_;
 		
-	sqlite3_     = src.sqlite3_;
-	src.sqlite3_ = NULL;
+	sqlite3_        = src.sqlite3_;
+	stmt_cache_     = src.stmt_cache_;
+	src.sqlite3_    = NULL;
+	src.stmt_cache_ = NULL;
+	cancellation_token_ = src.cancellation_token_;
+	InstallCancellationHandler();
 	return *this;
 }
 	
@@ -56,30 +200,136 @@ bool SQLiteDB::Open(const char* filename,
 		
 	if (filename == NULL)
 		return false;
+	TRACE_EVENT1("nim.db", "SQLiteDB::Open", "path", TRACE_STR_COPY(filename));
+	// SQLite的内存（页缓存、预编译语句等）是全进程共用的，只注册一次；
+	// 附带的3.8.7没有sqlite3_status64，sqlite3_memory_used即SQLITE_STATUS_MEMORY_USED
+	static int memory_account_id = NS_EXTENSION::MemoryAccounting::Register("nim_db.sqlite", []() {
+		return (int64_t)sqlite3_memory_used();
+	});
+	(void)memory_account_id;
 		
 	int r = sqlite3_open_v2(filename, &sqlite3_, flags, NULL);
 	if (r != SQLITE_OK)
 	{
 		Close();
+		return false;
 	}
-#if defined (OS_WIN)
-	else
+	InstallCancellationHandler();
+	return SetKey(key, SQLiteCipherOptions());
+}
+
+bool SQLiteDB::Open(const char* filename,
+	const std::string &key,
+	const SQLiteOpenOptions& options,
+	int flags/* = modeReadWrite|modeCreate|modeSerialized*/)
+{
+	if (!Open(filename, std::string(), flags))
+		return false;
+
+	if (!SetKey(key, options.cipher))
 	{
-		if (key.length()) 
-		{
-			if( SQLITE_OK != sqlite3_key(sqlite3_,key.c_str(),(int)key.length()))
-				r = sqlite3_rekey(sqlite3_,key.c_str(),(int)key.length());
-		}
+		Close();
+		return false;
 	}
-		
-#endif
+	TRACE_EVENT0("nim.db", "SQLiteDB::ApplyOptions");
+	if (!ApplyOptions(options))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SQLiteDB::SetKey(const std::string& key, const SQLiteCipherOptions& cipher)
+{
+	if (key.empty())
+		return true;
+#if defined (OS_WIN)
+	TRACE_EVENT0("nim.db", "SQLiteDB::SetKey");
+	if (!ApplyCipher(cipher))
+		return false;
+	int r = sqlite3_key(sqlite3_, key.c_str(), (int)key.length());
+	if (SQLITE_OK != r)
+		r = sqlite3_rekey(sqlite3_, key.c_str(), (int)key.length());
 	return r == SQLITE_OK;
+#else
+	// 其他平台链接的SQLite没有编解码器，不加密；要求特定算法时不能当作已加密
+	return cipher.IsDefault();
+#endif
+}
+
+bool SQLiteDB::ApplyCipher(const SQLiteCipherOptions& cipher)
+{
+	if (cipher.IsDefault())
+		return true;
+
+	// 支持选择算法的编解码器查询PRAGMA cipher时返回当前算法，旧版wxsqlite3不认识它，不返回任何行，
+	// 此时不能悄悄地用默认算法加密
+	{
+		SQLiteStatement statement;
+		if (Query(statement, "PRAGMA cipher") != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+			return false;
+	}
+	std::string sql;
+	if (!cipher.cipher.empty())
+		sql.append("PRAGMA cipher='").append(cipher.cipher).append("';");
+	if (cipher.kdf_iter > 0)
+		sql.append("PRAGMA kdf_iter=").append(std::to_string(cipher.kdf_iter)).append(";");
+	if (SQLITE_OK != Query(sql.c_str()))
+		return false;
+
+	// 算法名写错时编解码器保持原来的算法
+	if (cipher.cipher.empty())
+		return true;
+	SQLiteStatement statement;
+	if (Query(statement, "PRAGMA cipher") != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+		return false;
+	const char* current = statement.GetTextField(0);
+	return current != NULL && sqlite3_stricmp(current, cipher.cipher.c_str()) == 0;
+}
+
+bool SQLiteDB::ApplyOptions(const SQLiteOpenOptions& options)
+{
+	if (sqlite3_ == NULL)
+		return false;
+
+	// page_size要在journal_mode之前设置，切换到WAL之后就不能再修改页大小
+	std::string sql;
+	if (options.page_size > 0)
+		sql.append("PRAGMA page_size=").append(std::to_string(options.page_size)).append(";");
+	if (options.cache_size_kb > 0)
+		sql.append("PRAGMA cache_size=-").append(std::to_string(options.cache_size_kb)).append(";");
+	if (options.mmap_size > 0)
+		sql.append("PRAGMA mmap_size=").append(std::to_string(options.mmap_size)).append(";");
+	if (options.synchronous != SQLiteOpenOptions::kSynchronousDefault)
+		sql.append("PRAGMA synchronous=").append(std::to_string((int)options.synchronous)).append(";");
+	if (options.temp_store != SQLiteOpenOptions::kTempStoreDefault)
+		sql.append("PRAGMA temp_store=").append(std::to_string((int)options.temp_store)).append(";");
+	if (!sql.empty() && SQLITE_OK != Query(sql.c_str()))
+		return false;
+
+	if (options.journal_mode.empty())
+		return true;
+
+	// journal_mode返回切换后的模式，内存数据库等情况下可能与要求的不同
+	std::string journal_sql("PRAGMA journal_mode=");
+	journal_sql.append(options.journal_mode);
+	SQLiteStatement statement;
+	if (SQLITE_OK != Query(statement, journal_sql.c_str(), (int)journal_sql.size()) ||
+		statement.NextRow() != SQLITE_ROW)
+		return false;
+	const char* mode = statement.GetTextField(0);
+	return mode != NULL && sqlite3_stricmp(mode, options.journal_mode.c_str()) == 0;
 }
 
 bool SQLiteDB::Close()
 {
 	if (sqlite3_ == NULL)
 		return true;
+
+	// 缓存中的语句也是未释放的语句，需要先释放
+	if (stmt_cache_ != NULL)
+		stmt_cache_->Clear();
 		
 	/*
 		* If sqlite3_close() is called on a database connection that still has
@@ -100,6 +350,64 @@ bool SQLiteDB::Compact()
 	return true;
 }
 	
+int SQLiteDB::ReleaseMemory(bool clear_statement_cache/* = false*/)
+{
+	if (sqlite3_ == NULL)
+		return SQLITE_MISUSE;
+	// 缓存中的语句持有自己的内存，先释放它们，页缓存才能多释放一些
+	if (clear_statement_cache && stmt_cache_ != NULL)
+		stmt_cache_->Clear();
+	return sqlite3_db_release_memory(sqlite3_);
+}
+
+bool SQLiteDB::EnableIncrementalVacuum(bool vacuum_if_needed)
+{
+	if (GetAutoVacuumMode() == 2)
+		return true;
+
+	if (SQLITE_OK != Query("PRAGMA auto_vacuum=INCREMENTAL"))
+		return false;
+
+	// 已有表的数据库要在一次完整的VACUUM之后才会切换模式
+	if (GetAutoVacuumMode() != 2 && vacuum_if_needed && !Compact())
+		return false;
+	return GetAutoVacuumMode() == 2 || !vacuum_if_needed;
+}
+
+int SQLiteDB::IncrementalVacuum(int pages)
+{
+	if (!sqlite3_)
+		return SQLITE_MISUSE;
+
+	std::string sql("PRAGMA incremental_vacuum(");
+	sql.append(std::to_string(pages < 0 ? 0 : pages));
+	sql.append(")");
+
+	// incremental_vacuum每释放一页返回一行，要一直执行到结束
+	SQLiteStatement statement;
+	int r = Query(statement, sql.c_str(), (int)sql.size());
+	if (r != SQLITE_OK)
+		return r;
+	while ((r = statement.NextRow()) == SQLITE_ROW);
+	return r == SQLITE_DONE ? SQLITE_OK : r;
+}
+
+int SQLiteDB::GetFreePageCount() const
+{
+	SQLiteStatement statement;
+	if (Query(statement, "PRAGMA freelist_count") != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+		return 0;
+	return statement.GetIntField(0);
+}
+
+int SQLiteDB::GetAutoVacuumMode() const
+{
+	SQLiteStatement statement;
+	if (Query(statement, "PRAGMA auto_vacuum") != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+		return 0;
+	return statement.GetIntField(0);
+}
+
 bool SQLiteDB::IsValid() const
 {
 	return sqlite3_ != NULL;
@@ -210,8 +518,26 @@ int SQLiteDB::Query(SQLiteStatement& statement, const char* sql_text, int length
 		*/
 	if (length < 0)
 		length = (int)strlen(sql_text) + 1;
-		
-	return sqlite3_prepare_v2(sqlite3_, sql_text, length, &statement.stmt_, NULL);
+
+	if (stmt_cache_ == NULL)
+		return sqlite3_prepare_v2(sqlite3_, sql_text, length, &statement.stmt_, NULL);
+
+	std::string sql(sql_text, length);
+	size_t nul = sql.find('\0');
+	if (nul != std::string::npos)
+		sql.resize(nul);
+
+	statement.stmt_ = stmt_cache_->Take(sql);
+	if (statement.stmt_ == NULL)
+	{
+		int r = sqlite3_prepare_v2(sqlite3_, sql_text, length, &statement.stmt_, NULL);
+		// 空语句（如只有注释）prepare成功但没有语句
+		if (r != SQLITE_OK || statement.stmt_ == NULL)
+			return r;
+	}
+	statement.cache_ = stmt_cache_;
+	statement.cache_key_.swap(sql);
+	return SQLITE_OK;
 }
 	
 int SQLiteDB::Query(const char* sql_text, SQLiteQueryDelegate delegate, void* param) const
@@ -241,6 +567,28 @@ void SQLiteDB::Interrupt()
 	sqlite3_interrupt(sqlite3_);
 }
 	
+void SQLiteDB::SetCancellationToken(const NS_EXTENSION::CancellationToken& token)
+{
+	cancellation_token_ = token;
+	InstallCancellationHandler();
+}
+
+void SQLiteDB::InstallCancellationHandler()
+{
+	if (!sqlite3_)
+		return;
+	if (cancellation_token_.IsValid())
+		sqlite3_progress_handler(sqlite3_, kCancellationCheckOps, &SQLiteDB::OnCancellationCheck, this);
+	else
+		sqlite3_progress_handler(sqlite3_, 0, NULL, NULL);
+}
+
+int SQLiteDB::OnCancellationCheck(void* param)
+{
+	// 返回非0时 SQLite 中断当前语句，返回 SQLITE_INTERRUPT
+	return static_cast<SQLiteDB*>(param)->cancellation_token_.IsCancelled() ? 1 : 0;
+}
+	
 int SQLiteDB::SetBusyTimeout(int ms)
 {
 	if (!sqlite3_)
@@ -248,6 +596,150 @@ int SQLiteDB::SetBusyTimeout(int ms)
 	return sqlite3_busy_timeout(sqlite3_, ms);
 }
 	
+void SQLiteDB::SetStatementCacheSize(size_t size)
+{
+	if (stmt_cache_ != NULL)
+		stmt_cache_->SetCapacity(size);
+}
+
+void SQLiteDB::SetStatementObserver(SQLiteStatementObserver observer, void* context)
+{
+	if (stmt_cache_ != NULL)
+		stmt_cache_->SetObserver(observer, context);
+}
+
+template<typename T>
+static void DeleteFunctionData(void* data)
+{
+	delete (T*)data;
+}
+
+static void OnScalarFunction(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+	SQLiteFunctionCall call(context, argc, argv);
+	(*(SQLiteScalarFunction*)sqlite3_user_data(context))(call);
+}
+
+static void OnAggregateStep(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+	// 聚合上下文只存对象的指针，第一次 Step 时由 SQLite 清零分配
+	SQLiteAggregate** aggregate = (SQLiteAggregate**)sqlite3_aggregate_context(context, sizeof(SQLiteAggregate*));
+	if (aggregate == NULL)
+	{
+		sqlite3_result_error_nomem(context);
+		return;
+	}
+	if (*aggregate == NULL)
+		*aggregate = (*(SQLiteAggregateFactory*)sqlite3_user_data(context))().release();
+	SQLiteFunctionCall call(context, argc, argv);
+	(*aggregate)->Step(call);
+}
+
+static void OnAggregateFinal(sqlite3_context* context)
+{
+	// 语句中途被重置时 SQLite 也会调用 xFinal，对象总在这里释放
+	SQLiteAggregate** slot = (SQLiteAggregate**)sqlite3_aggregate_context(context, 0);
+	std::unique_ptr<SQLiteAggregate> aggregate(slot != NULL ? *slot : NULL);
+	if (!aggregate)
+		aggregate = (*(SQLiteAggregateFactory*)sqlite3_user_data(context))();
+	if (!aggregate)
+		return;
+	SQLiteFunctionCall call(context, 0, NULL);
+	aggregate->Final(call);
+}
+
+static int OnCollationCompare(void* param, int size1, const void* data1, int size2, const void* data2)
+{
+	return (*(SQLiteCollation*)param)(std::string_view((const char*)data1, size1),
+		std::string_view((const char*)data2, size2));
+}
+
+int SQLiteDB::CreateFunction(const char* name, int arg_count, const SQLiteScalarFunction& function,
+							 bool deterministic/* = true*/)
+{
+	if (!sqlite3_ || name == NULL || !function)
+		return SQLITE_MISUSE;
+	// 注册失败时 SQLite 也会调用析构回调
+	return sqlite3_create_function_v2(sqlite3_, name, arg_count, SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0),
+		new SQLiteScalarFunction(function), &OnScalarFunction, NULL, NULL, &DeleteFunctionData<SQLiteScalarFunction>);
+}
+
+int SQLiteDB::CreateAggregateFunction(const char* name, int arg_count, const SQLiteAggregateFactory& factory,
+									  bool deterministic/* = true*/)
+{
+	if (!sqlite3_ || name == NULL || !factory)
+		return SQLITE_MISUSE;
+	return sqlite3_create_function_v2(sqlite3_, name, arg_count, SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0),
+		new SQLiteAggregateFactory(factory), NULL, &OnAggregateStep, &OnAggregateFinal,
+		&DeleteFunctionData<SQLiteAggregateFactory>);
+}
+
+int SQLiteDB::CreateCollation(const char* name, const SQLiteCollation& compare)
+{
+	if (!sqlite3_ || name == NULL || !compare)
+		return SQLITE_MISUSE;
+	SQLiteCollation* data = new SQLiteCollation(compare);
+	int r = sqlite3_create_collation_v2(sqlite3_, name, SQLITE_UTF8, data, &OnCollationCompare,
+		&DeleteFunctionData<SQLiteCollation>);
+	// 与函数不同，注册失败时 SQLite 不调用析构回调
+	if (r != SQLITE_OK)
+		delete data;
+	return r;
+}
+
+int SQLiteDB::RemoveFunction(const char* name, int arg_count)
+{
+	if (!sqlite3_ || name == NULL)
+		return SQLITE_MISUSE;
+	return sqlite3_create_function_v2(sqlite3_, name, arg_count, SQLITE_UTF8, NULL, NULL, NULL, NULL, NULL);
+}
+
+int SQLiteDB::RemoveCollation(const char* name)
+{
+	if (!sqlite3_ || name == NULL)
+		return SQLITE_MISUSE;
+	return sqlite3_create_collation_v2(sqlite3_, name, SQLITE_UTF8, NULL, NULL, NULL);
+}
+
+size_t SQLiteDB::GetBulkInsertChunkRows(size_t column_count) const
+{
+	// 早于3.8.8的版本中多行VALUES受SQLITE_LIMIT_COMPOUND_SELECT（默认500）限制
+	static const size_t kMaxRowsPerStatement = 500;
+	size_t max_variables = (size_t)sqlite3_limit(sqlite3_, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+	size_t rows = max_variables / column_count;
+	if (rows > kMaxRowsPerStatement)
+		rows = kMaxRowsPerStatement;
+	return rows == 0 ? 1 : rows;
+}
+
+std::string SQLiteDB::BuildBulkInsertSql(const char* table, const std::vector<std::string>& columns, size_t row_count)
+{
+	std::string sql("INSERT INTO ");
+	sql.append(table);
+	sql.append(" (");
+	for (size_t i = 0; i < columns.size(); i++)
+	{
+		if (i > 0)
+			sql.append(",");
+		sql.append(columns[i]);
+	}
+	sql.append(") VALUES ");
+
+	std::string values("(");
+	for (size_t i = 0; i < columns.size(); i++)
+		values.append(i > 0 ? ",?" : "?");
+	values.append(")");
+
+	sql.reserve(sql.size() + row_count * (values.size() + 1));
+	for (size_t i = 0; i < row_count; i++)
+	{
+		if (i > 0)
+			sql.append(",");
+		sql.append(values);
+	}
+	return sql;
+}
+
 int SQLiteDB::GetVersion()
 {
 	return sqlite3_libversion_number();
@@ -350,16 +842,20 @@ const char* SQLiteResultTable::GetColumnName(int col) const
 // SQLiteStatement
 SQLiteStatement::SQLiteStatement()
 {
-	stmt_ = NULL;
-	eof_  = true;
+	stmt_  = NULL;
+	eof_   = true;
+	cache_ = NULL;
 }
 	
 SQLiteStatement::SQLiteStatement(SQLiteStatement& src)
 {
-	stmt_     = src.stmt_;
-	eof_      = src.eof_;
-	src.stmt_ = NULL;
-	src.eof_  = true;
+	stmt_      = src.stmt_;
+	eof_       = src.eof_;
+	cache_     = src.cache_;
+	cache_key_.swap(src.cache_key_);
+	src.stmt_  = NULL;
+	src.eof_   = true;
+	src.cache_ = NULL;
 }
 	
 SQLiteStatement::~SQLiteStatement()
@@ -371,10 +867,13 @@ SQLiteStatement& SQLiteStatement::operator=(SQLiteStatement& src)
 {
 	Finalize();
 		
-	stmt_     = src.stmt_;
-	eof_      = src.eof_;
-	src.stmt_ = NULL;
-	src.eof_  = true;
+	stmt_      = src.stmt_;
+	eof_       = src.eof_;
+	cache_     = src.cache_;
+	cache_key_.swap(src.cache_key_);
+	src.stmt_  = NULL;
+	src.eof_   = true;
+	src.cache_ = NULL;
 		
 	return *this;
 }
@@ -382,7 +881,16 @@ SQLiteStatement& SQLiteStatement::operator=(SQLiteStatement& src)
 int SQLiteStatement::Finalize()
 {
 	int r = SQLITE_OK;
-	if (stmt_ != NULL)
+	if (stmt_ != NULL && cache_ != NULL)
+	{
+		// 放回缓存供下一次Query复用，执行失败的语句同样返回错误码
+		r = cache_->Give(cache_key_, stmt_);
+		stmt_  = NULL;
+		eof_   = true;
+		cache_ = NULL;
+		cache_key_.clear();
+	}
+	else if (stmt_ != NULL)
 	{
 		r = sqlite3_finalize(stmt_);
 		if (r == SQLITE_OK)
@@ -418,6 +926,9 @@ int SQLiteStatement::NextRow()
 		
 	if (r == SQLITE_DONE)
 		eof_ = true;
+	// 执行结束，与sqlite3_profile的回调同时
+	if (r != SQLITE_ROW && cache_ != NULL)
+		cache_->OnStatementDone(stmt_);
 		
 	return r;
 }
@@ -595,6 +1106,150 @@ int SQLiteStatement::BindZeroBlob(int index, int size)
 	return SQLITE_MISUSE;
 }   
 
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteRow
+int SQLiteRow::GetColumnCount() const
+{
+	if (statement_->stmt_ == NULL)
+		return 0;
+	return sqlite3_column_count(statement_->stmt_);
+}
+
+bool SQLiteRow::IsNull(int col) const
+{
+	return statement_->GetTypeField(col) == SQLITE_NULL;
+}
+
+int64_t SQLiteRow::GetInt64(int col) const
+{
+	return statement_->GetInt64Field(col);
+}
+
+double SQLiteRow::GetDouble(int col) const
+{
+	return statement_->GetDoubleField(col);
+}
+
+std::string_view SQLiteRow::GetText(int col) const
+{
+	// 先取值再取长度，长度才是转换后文本的长度
+	const char* text = statement_->GetTextField(col);
+	if (text == NULL)
+		return std::string_view();
+	return std::string_view(text, statement_->GetBytesField(col));
+}
+
+SQLiteBlob SQLiteRow::GetBlob(int col) const
+{
+	SQLiteBlob blob;
+	blob.data = statement_->GetBlobField(col);
+	blob.size = blob.data == NULL ? 0 : statement_->GetBytesField(col);
+	return blob;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteFunctionCall
+int SQLiteFunctionCall::GetArgType(int arg) const
+{
+	if (arg < 0 || arg >= argc_)
+		return SQLITE_NULL;
+	return sqlite3_value_type(argv_[arg]);
+}
+
+bool SQLiteFunctionCall::IsNull(int arg) const
+{
+	return GetArgType(arg) == SQLITE_NULL;
+}
+
+int64_t SQLiteFunctionCall::GetInt64(int arg) const
+{
+	if (arg < 0 || arg >= argc_)
+		return 0;
+	return sqlite3_value_int64(argv_[arg]);
+}
+
+double SQLiteFunctionCall::GetDouble(int arg) const
+{
+	if (arg < 0 || arg >= argc_)
+		return 0;
+	return sqlite3_value_double(argv_[arg]);
+}
+
+std::string_view SQLiteFunctionCall::GetText(int arg) const
+{
+	if (arg < 0 || arg >= argc_)
+		return std::string_view();
+	// 与 SQLiteRow::GetText 一样先取值再取长度
+	const char* text = (const char*)sqlite3_value_text(argv_[arg]);
+	if (text == NULL)
+		return std::string_view();
+	return std::string_view(text, sqlite3_value_bytes(argv_[arg]));
+}
+
+SQLiteBlob SQLiteFunctionCall::GetBlob(int arg) const
+{
+	SQLiteBlob blob;
+	blob.data = NULL;
+	blob.size = 0;
+	if (arg < 0 || arg >= argc_)
+		return blob;
+	blob.data = sqlite3_value_blob(argv_[arg]);
+	blob.size = blob.data == NULL ? 0 : sqlite3_value_bytes(argv_[arg]);
+	return blob;
+}
+
+void SQLiteFunctionCall::SetNull()
+{
+	sqlite3_result_null(context_);
+}
+
+void SQLiteFunctionCall::SetInt64(int64_t value)
+{
+	sqlite3_result_int64(context_, value);
+}
+
+void SQLiteFunctionCall::SetDouble(double value)
+{
+	sqlite3_result_double(context_, value);
+}
+
+void SQLiteFunctionCall::SetText(std::string_view value)
+{
+	// 空的 view 可能没有数据指针，sqlite3_result_text 会把 NULL 当作 SQL NULL
+	sqlite3_result_text(context_, value.data() != NULL ? value.data() : kNULL, (int)value.size(), SQLITE_TRANSIENT);
+}
+
+void SQLiteFunctionCall::SetBlob(const void* data, size_t size)
+{
+	if (data == NULL)
+		sqlite3_result_zeroblob(context_, 0);
+	else
+		sqlite3_result_blob(context_, data, (int)size, SQLITE_TRANSIENT);
+}
+
+void SQLiteFunctionCall::SetError(const char* message)
+{
+	sqlite3_result_error(context_, message != NULL ? message : "", -1);
+}
+
+void* SQLiteFunctionCall::GetAuxData(int arg) const
+{
+	return sqlite3_get_auxdata(context_, arg);
+}
+
+void SQLiteFunctionCall::SetAuxData(int arg, void* data, void (*destroy)(void*))
+{
+	sqlite3_set_auxdata(context_, arg, data, destroy);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SQLiteRowRange
+bool SQLiteRowRange::Step()
+{
+	result_ = statement_->NextRow();
+	return result_ == SQLITE_ROW;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // SQLiteAutoTransaction
 
@@ -7,7 +7,17 @@
 
 #include "nim_db/db_export.h"
 #include "nim_db/build/build_config.h"
+#include "extension/callback/cancellation_token.h"
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <type_traits>
 
 #if defined(OS_WIN)
 #include "sqlite3.h"
@@ -20,6 +30,10 @@ DB_BEGIN_DECLS
 typedef int (*SQLiteQueryDelegate)(void*, int, char**, char**);
     
 class SQLiteDB;
+class SQLiteStatementCache;
+
+// Called when a statement of SQLiteDB::Query(SQLiteStatement&, ...) finishes executing
+typedef void (*SQLiteStatementObserver)(void* context, sqlite3_stmt* stmt);
     
 /*
     *  Purpose     Query result class
@@ -65,6 +79,7 @@ private:
 class DB_EXPORT SQLiteStatement
 {
     friend class SQLiteDB;
+    friend class SQLiteRow;
         
 public:
         
@@ -142,8 +157,325 @@ private:
         
     bool            eof_;
     sqlite3_stmt*   stmt_;
+    SQLiteStatementCache* cache_;       // Not NULL means stmt_ is returned to the cache by Finalize()
+    std::string     cache_key_;
 };
     
+/*
+    *  Purpose     A blob column value, data points into the statement and is valid until the next step
+    */
+struct SQLiteBlob
+{
+    const void* data;
+    size_t      size;
+};
+
+/*
+    *  Purpose     The current row of a statement, returned by SQLiteRowRange
+    *  Remark      Values are read directly from the statement without copying or converting to
+    *              C strings, a string_view or SQLiteBlob is valid only until the next step.
+    */
+class DB_EXPORT SQLiteRow
+{
+public:
+
+    explicit SQLiteRow(SQLiteStatement* statement) : statement_(statement) {}
+
+    int                 GetColumnCount() const;
+    bool                IsNull(int col) const;
+    int64_t             GetInt64(int col) const;
+    double              GetDouble(int col) const;
+    std::string_view    GetText(int col) const;
+    SQLiteBlob          GetBlob(int col) const;
+
+    /*
+        *  Purpose     Typed column value, T can be bool/int/int64_t/double/std::string_view/std::string/SQLiteBlob
+        */
+    template<typename T>
+    T Get(int col) const;
+
+    /*
+        *  Purpose     Read the first sizeof...(Ts) columns into a tuple, e.g.
+        *              auto [id, name] = row.Columns<int64_t, std::string_view>();
+        */
+    template<typename... Ts>
+    std::tuple<Ts...> Columns() const
+    {
+        return ColumnsImpl<Ts...>(std::index_sequence_for<Ts...>());
+    }
+
+private:
+
+    template<typename... Ts, size_t... Is>
+    std::tuple<Ts...> ColumnsImpl(std::index_sequence<Is...>) const
+    {
+        return std::tuple<Ts...>(Get<Ts>((int)Is)...);
+    }
+
+    SQLiteStatement*    statement_;
+};
+
+template<> inline bool SQLiteRow::Get<bool>(int col) const { return GetInt64(col) != 0; }
+template<> inline int SQLiteRow::Get<int>(int col) const { return (int)GetInt64(col); }
+template<> inline int64_t SQLiteRow::Get<int64_t>(int col) const { return GetInt64(col); }
+template<> inline double SQLiteRow::Get<double>(int col) const { return GetDouble(col); }
+template<> inline std::string_view SQLiteRow::Get<std::string_view>(int col) const { return GetText(col); }
+template<> inline std::string SQLiteRow::Get<std::string>(int col) const { return std::string(GetText(col)); }
+template<> inline SQLiteBlob SQLiteRow::Get<SQLiteBlob>(int col) const { return GetBlob(col); }
+
+/*
+    *  Purpose     Arguments and result of a call to a function registered by SQLiteDB::CreateFunction
+    *  Remark      Like SQLiteRow, a string_view or SQLiteBlob argument is valid only during the call.
+    *              The result is NULL if none is set, text and blob results are copied by SQLite.
+    */
+class DB_EXPORT SQLiteFunctionCall
+{
+public:
+
+    SQLiteFunctionCall(sqlite3_context* context, int argc, sqlite3_value** argv)
+        : context_(context), argc_(argc), argv_(argv) {}
+
+    int                 GetArgCount() const { return argc_; }
+    int                 GetArgType(int arg) const;      // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+    bool                IsNull(int arg) const;
+    int64_t             GetInt64(int arg) const;
+    double              GetDouble(int arg) const;
+    std::string_view    GetText(int arg) const;
+    SQLiteBlob          GetBlob(int arg) const;
+
+    /*
+        *  Purpose     Typed argument, T can be bool/int/int64_t/double/std::string_view/std::string/SQLiteBlob
+        */
+    template<typename T>
+    T Get(int arg) const;
+
+    void                SetNull();
+    void                SetInt64(int64_t value);
+    void                SetDouble(double value);
+    void                SetText(std::string_view value);
+    void                SetBlob(const void* data, size_t size);
+    void                SetError(const char* message);
+
+    /*
+        *  Purpose     Data cached with a constant argument (sqlite3_get_auxdata), e.g. a parsed pattern,
+        *              SQLite keeps it for the next rows of the same statement while the argument is unchanged
+        *  destroy     Called by SQLite on data when it is dropped, also when SetAuxData fails
+        */
+    void*               GetAuxData(int arg) const;
+    void                SetAuxData(int arg, void* data, void (*destroy)(void*));
+
+    sqlite3_context*    GetContext() const { return context_; }
+
+private:
+
+    sqlite3_context*    context_;
+    int                 argc_;
+    sqlite3_value**     argv_;
+};
+
+template<> inline bool SQLiteFunctionCall::Get<bool>(int arg) const { return GetInt64(arg) != 0; }
+template<> inline int SQLiteFunctionCall::Get<int>(int arg) const { return (int)GetInt64(arg); }
+template<> inline int64_t SQLiteFunctionCall::Get<int64_t>(int arg) const { return GetInt64(arg); }
+template<> inline double SQLiteFunctionCall::Get<double>(int arg) const { return GetDouble(arg); }
+template<> inline std::string_view SQLiteFunctionCall::Get<std::string_view>(int arg) const { return GetText(arg); }
+template<> inline std::string SQLiteFunctionCall::Get<std::string>(int arg) const { return std::string(GetText(arg)); }
+template<> inline SQLiteBlob SQLiteFunctionCall::Get<SQLiteBlob>(int arg) const { return GetBlob(arg); }
+
+/*
+    *  Purpose     Step a statement row by row with range-based for:
+    *              for (auto row : db.Rows(stmt)) { ... }
+    *  Remark      The statement is stepped when the loop starts, so it should be rewound before
+    *              iterating again. GetResult() returns SQLITE_DONE after all rows are read,
+    *              or the error code which stopped the loop.
+    */
+class DB_EXPORT SQLiteRowRange
+{
+public:
+
+    class Iterator
+    {
+    public:
+        Iterator() : range_(NULL) {}
+        explicit Iterator(SQLiteRowRange* range) : range_(range) {}
+
+        SQLiteRow operator*() const { return SQLiteRow(range_->statement_); }
+        Iterator& operator++() { if (!range_->Step()) range_ = NULL; return *this; }
+        bool operator==(const Iterator& other) const { return range_ == other.range_; }
+        bool operator!=(const Iterator& other) const { return range_ != other.range_; }
+
+    private:
+        SQLiteRowRange* range_;
+    };
+
+    explicit SQLiteRowRange(SQLiteStatement* statement) : statement_(statement), result_(SQLITE_OK) {}
+
+    Iterator begin() { return Step() ? Iterator(this) : Iterator(); }
+    Iterator end() { return Iterator(); }
+
+    int GetResult() const { return result_; }
+
+private:
+
+    bool Step();
+
+    SQLiteStatement*    statement_;
+    int                 result_;
+};
+
+/*
+    *  Purpose     Decode a row into a struct, specialize it for the struct:
+    *              template<> struct SQLiteRowMapper<Message> {
+    *                  static void Map(const SQLiteRow& row, Message& msg) { msg.id = row.Get<int64_t>(0); ... }
+    *              };
+    */
+template<typename T>
+struct SQLiteRowMapper;
+
+/*
+    *  Purpose     Decode all the remaining rows of statement into values by SQLiteRowMapper<T>
+    *  Return      SQLITE_DONE if all rows are read, otherwise the error code
+    */
+template<typename T>
+int SQLiteReadRows(SQLiteStatement& statement, std::vector<T>& values)
+{
+    SQLiteRowRange rows(&statement);
+    for (SQLiteRow row : rows)
+    {
+        values.emplace_back();
+        SQLiteRowMapper<T>::Map(row, values.back());
+    }
+    return rows.GetResult();
+}
+
+/*
+    *  Purpose     Bind a value by its type, used by SQLiteDB::BulkInsert
+    *  Remark      Text and blob are bound without copying, they must be valid until the statement is stepped.
+    *              An integer fitting in int is bound by BindInt, the others by BindInt64, a uint64_t above
+    *              INT64_MAX is stored negative like a cast to int64_t
+    */
+template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+inline int SQLiteBind(SQLiteStatement& statement, int index, T value)
+{
+    if (sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed<T>::value))
+        return statement.BindInt(index, (int)value);
+    return statement.BindInt64(index, (int64_t)value);
+}
+inline int SQLiteBind(SQLiteStatement& statement, int index, bool value) { return statement.BindInt(index, value ? 1 : 0); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, double value) { return statement.BindDouble(index, value); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, const char* value) { return value == NULL ? statement.BindNull(index) : statement.BindText(index, value); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, const std::string& value) { return statement.BindText(index, value.data(), value.size()); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, std::string_view value) { return statement.BindText(index, value.data(), value.size()); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, const SQLiteBlob& value) { return statement.BindBlob(index, value.data, (int)value.size); }
+inline int SQLiteBind(SQLiteStatement& statement, int index, std::nullptr_t) { return statement.BindNull(index); }
+
+/*
+    *  Purpose     Set the result of a function call by its type, used by SQLiteDB::CreateScalarFunction
+    *              and SQLiteDB::CreateAggregateFunction, an empty optional is NULL
+    */
+template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+inline void SQLiteSetResult(SQLiteFunctionCall& call, T value) { call.SetInt64((int64_t)value); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, bool value) { call.SetInt64(value ? 1 : 0); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, double value) { call.SetDouble(value); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, const char* value) { if (value == NULL) call.SetNull(); else call.SetText(value); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, const std::string& value) { call.SetText(value); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, std::string_view value) { call.SetText(value); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, const SQLiteBlob& value) { call.SetBlob(value.data, value.size); }
+inline void SQLiteSetResult(SQLiteFunctionCall& call, std::nullptr_t) { call.SetNull(); }
+template<typename T>
+void SQLiteSetResult(SQLiteFunctionCall& call, const std::optional<T>& value)
+{
+    if (value)
+        SQLiteSetResult(call, *value);
+    else
+        call.SetNull();
+}
+
+/*
+    *  Purpose     A C++ SQL function, it must not throw
+    */
+typedef std::function<void(SQLiteFunctionCall& call)> SQLiteScalarFunction;
+
+/*
+    *  Purpose     A C++ collation, returns < 0, 0 or > 0 like memcmp, it must not throw
+    */
+typedef std::function<int(std::string_view a, std::string_view b)> SQLiteCollation;
+
+/*
+    *  Purpose     State of an aggregate function for one group of rows
+    *  Remark      Created by the SQLiteAggregateFactory of the function when the group starts,
+    *              Final is called once at the end to set the result, also for an empty group,
+    *              then the object is deleted.
+    */
+class SQLiteAggregate
+{
+public:
+    virtual ~SQLiteAggregate() {}
+    virtual void Step(SQLiteFunctionCall& call) = 0;
+    virtual void Final(SQLiteFunctionCall& call) = 0;
+};
+
+typedef std::function<std::unique_ptr<SQLiteAggregate>()> SQLiteAggregateFactory;
+
+namespace internal
+{
+
+// 从函数对象的 operator() 推导参数和返回值
+template<typename F>
+struct SQLiteFunctionTraits : SQLiteFunctionTraits<decltype(&F::operator())> {};
+
+template<typename R, typename... Args>
+struct SQLiteFunctionTraits<R(*)(Args...)>
+{
+    typedef R Result;
+    typedef std::tuple<typename std::decay<Args>::type...> ArgTuple;
+    static const int kArgCount = (int)sizeof...(Args);
+};
+
+template<typename R, typename... Args>
+struct SQLiteFunctionTraits<R(Args...)> : SQLiteFunctionTraits<R(*)(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct SQLiteFunctionTraits<R(C::*)(Args...) const> : SQLiteFunctionTraits<R(*)(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct SQLiteFunctionTraits<R(C::*)(Args...)> : SQLiteFunctionTraits<R(*)(Args...)> {};
+
+// 以调用的参数 0..N-1 调用 function，prefix 为放在它们之前的参数个数（聚合函数的状态）
+template<size_t Prefix, typename ArgTuple, typename F, typename... Ts, size_t... Is>
+decltype(auto) SQLiteInvoke(F& function, SQLiteFunctionCall& call, std::index_sequence<Is...>, Ts&... prefix)
+{
+    return function(prefix..., call.Get<typename std::tuple_element<Is + Prefix, ArgTuple>::type>((int)Is)...);
+}
+
+template<typename F, typename... Ts>
+void SQLiteInvokeAndSetResult(F& function, SQLiteFunctionCall& call, Ts&... prefix)
+{
+    typedef SQLiteFunctionTraits<F> Traits;
+    typedef std::make_index_sequence<Traits::kArgCount - sizeof...(Ts)> Indexes;
+    if constexpr (std::is_void<typename Traits::Result>::value)
+        SQLiteInvoke<sizeof...(Ts), typename Traits::ArgTuple>(function, call, Indexes(), prefix...);
+    else
+        SQLiteSetResult(call, SQLiteInvoke<sizeof...(Ts), typename Traits::ArgTuple>(function, call, Indexes(), prefix...));
+}
+
+template<typename State, typename StepFunction, typename FinalFunction>
+class SQLiteTypedAggregate : public SQLiteAggregate
+{
+public:
+    SQLiteTypedAggregate(StepFunction& step, FinalFunction& final) : step_(step), final_(final), state_() {}
+
+    virtual void Step(SQLiteFunctionCall& call) override { SQLiteInvokeAndSetResult(step_, call, state_); }
+    virtual void Final(SQLiteFunctionCall& call) override { SQLiteInvokeAndSetResult(final_, call, state_); }
+
+private:
+    // 属于注册的工厂，它比每一组的聚合对象活得更久
+    StepFunction&   step_;
+    FinalFunction&  final_;
+    State           state_;
+};
+
+} // namespace internal
+
 /*
     *  Purpose     Auto transaction class
     *  Remark      The transaction will be update when the object destruct.
@@ -167,6 +499,76 @@ private:
 };
     
     
+/*
+    *  Purpose     Page codec of an encrypted database
+    */
+struct DB_EXPORT SQLiteCipherOptions
+{
+    SQLiteCipherOptions() : kdf_iter(0) {}
+
+    bool IsDefault() const { return cipher.empty() && kdf_iter <= 0; }
+
+    /*
+        *  Purpose     Cipher of the page codec, e.g. "aes256cbc", "chacha20", "sqlcipher".
+        *              Empty means the default of the linked codec.
+        *  Remark      The names are those of PRAGMA cipher of SQLite3 Multiple Ciphers (wxSQLite3 4.x),
+        *              which uses AES-NI/ARMv8 crypto instructions when the CPU has them. The legacy
+        *              wxsqlite3 codec only has its compile-time AES cipher, opening fails if another
+        *              cipher or kdf_iter is required with it.
+        */
+    std::string     cipher;
+    int             kdf_iter;       // Key derivation iterations of the cipher, 0 means its default
+};
+
+/*
+    *  Purpose     PRAGMA profile applied by SQLiteDB::Open after the key is set
+    *  Remark      A value of 0 (or empty string) keeps the SQLite default.
+    *              page_size only takes effect on a new database or after a full VACUUM, for a database
+    *              encrypted by the wxsqlite3 codec it must be the same every time the database is opened.
+    *              mmap_size is ignored by SQLite when the database is encrypted.
+    */
+struct DB_EXPORT SQLiteOpenOptions
+{
+    enum Synchronous
+    {
+        kSynchronousDefault = -1,
+        kSynchronousOff     = 0,
+        kSynchronousNormal  = 1,
+        kSynchronousFull    = 2,
+    };
+    enum TempStore
+    {
+        kTempStoreDefault   = 0,
+        kTempStoreFile      = 1,
+        kTempStoreMemory    = 2,
+    };
+
+    SQLiteOpenOptions()
+        : page_size(0), cache_size_kb(0), mmap_size(0),
+          synchronous(kSynchronousDefault), temp_store(kTempStoreDefault)
+    {
+    }
+
+    /*
+        *  Purpose     Presets
+        *              "durable"      journal_mode=WAL, synchronous=FULL
+        *              "fast-cache"   journal_mode=WAL, synchronous=NORMAL, 16MB page cache, temp_store=MEMORY
+        *              "read-mostly"  synchronous=NORMAL, 8MB page cache, 256MB mmap, 4KB pages
+        */
+    static SQLiteOpenOptions Durable();
+    static SQLiteOpenOptions FastCache();
+    static SQLiteOpenOptions ReadMostly();
+    static bool GetPreset(const std::string& name, SQLiteOpenOptions& options);
+
+    int             page_size;          // PRAGMA page_size, bytes, power of 2 in [512, 65536]
+    int             cache_size_kb;      // PRAGMA cache_size=-N, KB
+    int64_t         mmap_size;          // PRAGMA mmap_size, bytes
+    std::string     journal_mode;       // PRAGMA journal_mode, e.g. "WAL", "DELETE", "TRUNCATE", "MEMORY"
+    Synchronous     synchronous;        // PRAGMA synchronous
+    TempStore       temp_store;         // PRAGMA temp_store
+    SQLiteCipherOptions cipher;         // Codec of the encrypted database, applied before the key
+};
+
 /*
     *  Purpose     DB operation by sqlite3
     *  Remark      UTF-8 encoding
@@ -174,6 +576,11 @@ private:
 class DB_EXPORT SQLiteDB
 {
     friend class SQLiteStatement;
+    friend class SQLiteBackup;
+    friend class SQLiteProfiler;
+    friend class SQLiteFtsIndex;
+    friend class SQLiteRecovery;
+    friend class SQLiteBlobStream;
         
 public:
         
@@ -213,6 +620,21 @@ public:
     bool Open(const char* filename,
 				const std::string &key,
 				int flags = modeReadWrite|modeCreate|modeSerialized);
+
+    /*
+        *  Purpose     Open/Create an database file and apply the PRAGMA profile of options
+        *  Remark      It fails and the database is closed if any PRAGMA fails, or options.cipher
+        *              can not be used by the linked codec
+        */
+    bool Open(const char* filename,
+				const std::string &key,
+				const SQLiteOpenOptions& options,
+				int flags = modeReadWrite|modeCreate|modeSerialized);
+
+    /*
+        *  Purpose     Apply the PRAGMA profile of options to the opened database
+        */
+    bool ApplyOptions(const SQLiteOpenOptions& options);
         
     /*
         *  Purpose     Close database
@@ -223,6 +645,39 @@ public:
         *  Purpose     Compact database for memory fragment
         */
     bool Compact();
+
+    /*
+        *  Purpose     Release the memory of the page cache not used by a running statement (sqlite3_db_release_memory)
+        *  clear_statement_cache   Finalize the cached prepared statements too
+        *  Remark      Called under memory pressure, see NS_EXTENSION::MemoryTrimmer. A database opened with
+        *              modeMultiThread must call it on the thread using it.
+        */
+    int ReleaseMemory(bool clear_statement_cache = false);
+
+    /*
+        *  Purpose     Switch the database to auto_vacuum=INCREMENTAL so free pages can be released by IncrementalVacuum()
+        *  Remark      auto_vacuum of an existing database only changes after a full VACUUM, it is run when
+        *              vacuum_if_needed is true, otherwise the new mode takes effect on the next Compact().
+        *              A new database takes the mode before its first table is created.
+        */
+    bool EnableIncrementalVacuum(bool vacuum_if_needed);
+
+    /*
+        *  Purpose     Release up to pages free pages at the end of the file (PRAGMA incremental_vacuum)
+        *  pages       0 means release all the free pages
+        *  Remark      Take effect only when auto_vacuum is INCREMENTAL
+        */
+    int IncrementalVacuum(int pages);
+
+    /*
+        *  Purpose     Count of unused pages in the database file (PRAGMA freelist_count)
+        */
+    int GetFreePageCount() const;
+
+    /*
+        *  Purpose     Current auto_vacuum mode : 0 NONE, 1 FULL, 2 INCREMENTAL
+        */
+    int GetAutoVacuumMode() const;
         
     bool IsValid() const;
         
@@ -259,31 +714,211 @@ public:
         *  Purpose     Execute the SQL command and put the result into result table.
         *  sql_text    SQL command
         *  table       Result table
-        *  Remark      This function is low efficiency
+        *  Remark      This function is low efficiency, use Rows() for large results
         */
     int Query(const char* sql_text, SQLiteResultTable& table) const;
+
+    /*
+        *  Purpose     Iterate the result rows of a prepared statement without materializing them,
+        *              see SQLiteRowRange. It is recommended instead of SQLiteResultTable.
+        */
+    SQLiteRowRange Rows(SQLiteStatement& statement) const { return SQLiteRowRange(&statement); }
         
     /*
         *  Purpose     Interrupt all the operation
         */
     void Interrupt();
+
+    /*
+        *  Purpose     Interrupt the running and the later statements once token is cancelled or its deadline passes
+        *  Remark      Checked by sqlite3_progress_handler every kCancellationCheckOps virtual machine instructions,
+        *              the statement then fails with SQLITE_INTERRUPT. The token is kept when the database is
+        *              reopened, an empty token detaches the handler. Pass NS_EXTENSION::CancellationToken::Current()
+        *              to stop the queries of a task posted with a token.
+        */
+    void SetCancellationToken(const NS_EXTENSION::CancellationToken& token);
+
+    static const int kCancellationCheckOps = 1000;
         
     /*
         *  Purpose     Set the waiting time that will return SQLITE_BUSY when the database is locked by a thread. 
         *  ms          Waiting time, the function will disable when ms is less then 0.
         */
     int SetBusyTimeout(int ms);
-        
+
+    /*
+        *  Purpose     Set the max count of prepared statements cached by Query(SQLiteStatement&, ...)
+        *  size        0 means disable the cache, the default size is kDefaultStatementCacheSize
+        *  Remark      The cache is keyed by SQL text, a cached statement is handed out already reset
+        *              and with bindings cleared, and it goes back to the cache when the SQLiteStatement
+        *              is finalized or destructed.
+        */
+    void SetStatementCacheSize(size_t size);
+
+    static const size_t kDefaultStatementCacheSize = 32;
+
+    /*
+        *  Purpose     Register a C++ SQL function on this connection (sqlite3_create_function_v2)
+        *  arg_count   Count of the arguments, -1 means any count
+        *  deterministic   The same arguments always give the same result, so SQLite may factor
+        *                  the call out of a loop and it can be used in an index on an expression
+        *  Remark      The function is kept by SQLite until it is replaced or removed, or the connection
+        *              is closed. A function with the same name and arg_count replaces the old one.
+        *              Registered per connection like SQLiteFtsIndex::RegisterTokenizer, every connection
+        *              of a pool running the SQL must register it.
+        */
+    int CreateFunction(const char* name, int arg_count, const SQLiteScalarFunction& function, bool deterministic = true);
+
+    /*
+        *  Purpose     Register a C++ aggregate function, factory creates the state of every group of rows
+        */
+    int CreateAggregateFunction(const char* name, int arg_count, const SQLiteAggregateFactory& factory, bool deterministic = true);
+
+    /*
+        *  Purpose     Register a C++ collation used by ORDER BY x COLLATE name, or in a column or index definition
+        *  Remark      An index built with a collation has to be rebuilt (REINDEX) when the order of the
+        *              collation is changed.
+        */
+    int CreateCollation(const char* name, const SQLiteCollation& compare);
+
+    int RemoveFunction(const char* name, int arg_count);
+    int RemoveCollation(const char* name);
+
+    /*
+        *  Purpose     Register a function, a lambda or a function pointer, its arguments are converted from
+        *              the SQL values by SQLiteFunctionCall::Get and its return value is set by SQLiteSetResult, e.g.
+        *              db.CreateScalarFunction("is_vip", [](int64_t level, std::string_view tag) { return level > 3; });
+        *  Remark      The argument count is that of the parameters, a function returning void gives NULL
+        */
+    template<typename F>
+    int CreateScalarFunction(const char* name, F function, bool deterministic = true)
+    {
+        return CreateFunction(name, internal::SQLiteFunctionTraits<F>::kArgCount,
+            [function](SQLiteFunctionCall& call) mutable { internal::SQLiteInvokeAndSetResult(function, call); },
+            deterministic);
+    }
+
+    /*
+        *  Purpose     Register an aggregate function by a step and a final function of a State which is
+        *              value-initialized for every group, e.g.
+        *              db.CreateAggregateFunction<int64_t>("total_len",
+        *                  [](int64_t& total, std::string_view text) { total += text.size(); },
+        *                  [](int64_t& total) { return total; });
+        *  Remark      The arguments of step follow its State&, final returns the result of the group
+        */
+    template<typename State, typename StepFunction, typename FinalFunction>
+    int CreateAggregateFunction(const char* name, StepFunction step, FinalFunction final, bool deterministic = true)
+    {
+        typedef internal::SQLiteTypedAggregate<State, StepFunction, FinalFunction> Aggregate;
+        // 每一组的聚合对象引用工厂中的 step 和 final，工厂由 SQLite 持有到函数被删除
+        auto functions = std::make_shared<std::pair<StepFunction, FinalFunction>>(std::move(step), std::move(final));
+        return CreateAggregateFunction(name, internal::SQLiteFunctionTraits<StepFunction>::kArgCount - 1,
+            [functions]() -> std::unique_ptr<SQLiteAggregate> {
+                return std::unique_ptr<SQLiteAggregate>(new Aggregate(functions->first, functions->second));
+            }, deterministic);
+    }
+
     /*
         *  Purpose     SQLite Version
         */
     static int GetVersion();
+
+    /*
+        *  Purpose     Insert many rows with multi-row INSERT ... VALUES (?,?),(?,?)... statements in one transaction
+        *  table       Table name
+        *  columns     Column names, the count must be the same as the tuple size of every row
+        *  rows        A range of std::tuple (or std::pair), values are bound by SQLiteBind
+        *  Remark      Rows per statement are limited by SQLITE_LIMIT_VARIABLE_NUMBER, the statement of a full
+        *              chunk is prepared once and reused. The transaction is rolled back on any error.
+        *  Return      SQLITE_OK or the error code
+        */
+    template<typename Range>
+    int BulkInsert(const char* table, const std::vector<std::string>& columns, const Range& rows)
+    {
+        if (!sqlite3_ || !table || columns.empty())
+            return SQLITE_MISUSE;
+
+        size_t chunk_rows = GetBulkInsertChunkRows(columns.size());
+        SQLiteAutoTransaction transaction(this);
+        SQLiteStatement full_chunk;
+        SQLiteStatement tail_chunk;
+        SQLiteStatement* statement = NULL;
+        size_t row_in_chunk = 0;
+        size_t remain_rows = std::distance(std::begin(rows), std::end(rows));
+        int r = SQLITE_OK;
+        for (auto it = std::begin(rows); it != std::end(rows); ++it)
+        {
+            if (std::tuple_size<typename std::decay<decltype(*it)>::type>::value != columns.size())
+            {
+                r = SQLITE_MISUSE;
+                break;
+            }
+            if (row_in_chunk == 0)
+            {
+                // 足够一整块时复用同一条语句，只有最后不足一块的部分单独准备
+                if (remain_rows >= chunk_rows)
+                {
+                    statement = &full_chunk;
+                    if (full_chunk.IsValid())
+                        r = full_chunk.Rewind();
+                    else
+                        r = Query(full_chunk, BuildBulkInsertSql(table, columns, chunk_rows).c_str());
+                }
+                else
+                {
+                    statement = &tail_chunk;
+                    r = Query(tail_chunk, BuildBulkInsertSql(table, columns, remain_rows).c_str());
+                }
+                if (r != SQLITE_OK)
+                    break;
+            }
+
+            int index = (int)(row_in_chunk * columns.size()) + 1;
+            std::apply([&](const auto&... values) {
+                ((r = (r == SQLITE_OK ? SQLiteBind(*statement, index++, values) : r)), ...);
+            }, *it);
+            if (r != SQLITE_OK)
+                break;
+
+            remain_rows--;
+            if (++row_in_chunk == chunk_rows || remain_rows == 0)
+            {
+                r = statement->NextRow();
+                if (r != SQLITE_DONE)
+                    break;
+                r = SQLITE_OK;
+                row_in_chunk = 0;
+            }
+        }
+
+        full_chunk.Finalize();
+        tail_chunk.Finalize();
+        if (r != SQLITE_OK)
+        {
+            transaction.Rollback();
+            return r;
+        }
+        return transaction.Commit() ? SQLITE_OK : GetLastErrorCode();
+    }
         
 private:
 
+    size_t GetBulkInsertChunkRows(size_t column_count) const;
+    static std::string BuildBulkInsertSql(const char* table, const std::vector<std::string>& columns, size_t row_count);
+
 	bool DoesTableOrIndexExist(const char* name, const char* type) const;
+    // 语句执行结束时调用observer，NULL表示取消，供SQLiteProfiler取语句的计数
+    void SetStatementObserver(SQLiteStatementObserver observer, void* context);
+    // 选择编解码器的算法并设置密钥，要在第一次读写文件之前调用
+    bool SetKey(const std::string& key, const SQLiteCipherOptions& cipher);
+    bool ApplyCipher(const SQLiteCipherOptions& cipher);
+    // 按 cancellation_token_ 设置或清除进度回调，它以本对象的地址为参数，连接移交给别的对象后要重新设置
+    void InstallCancellationHandler();
+    static int OnCancellationCheck(void* param);
         
     mutable sqlite3*   sqlite3_;
+    SQLiteStatementCache* stmt_cache_;
+    NS_EXTENSION::CancellationToken cancellation_token_;
 };
 
 
@@ -0,0 +1,88 @@
+// Background incremental vacuum
+
+#include "nim_db/db_vacuum_scheduler.h"
+
+DB_BEGIN_DECLS
+
+SQLiteVacuumScheduler::SQLiteVacuumScheduler(AsyncSQLiteDB* db, int pages_per_step/* = 256*/, int min_free_pages/* = 1024*/)
+	: db_(db), state_(std::make_shared<State>()), attached_(false)
+{
+	state_->running        = false;
+	state_->alive          = true;
+	state_->pages_per_step = pages_per_step > 0 ? pages_per_step : 1;
+	state_->min_free_pages = min_free_pages > 0 ? min_free_pages : 1;
+}
+
+SQLiteVacuumScheduler::~SQLiteVacuumScheduler()
+{
+	DetachNotificationCenter();
+	state_->running = false;
+	state_->alive   = false;
+}
+
+void SQLiteVacuumScheduler::AttachNotificationCenter()
+{
+	if (attached_)
+		return;
+	NS_EXTENSION::NotificaionCenter::GetInstance()->AddObserver(this);
+	attached_ = true;
+}
+
+void SQLiteVacuumScheduler::DetachNotificationCenter()
+{
+	if (!attached_)
+		return;
+	NS_EXTENSION::NotificaionCenter::GetInstance()->RemoveObserver(this);
+	attached_ = false;
+}
+
+void SQLiteVacuumScheduler::Start()
+{
+	if (db_ == NULL || state_->running.exchange(true))
+		return;
+	PostStep(db_, state_, true);
+}
+
+void SQLiteVacuumScheduler::Stop()
+{
+	// 已投递的步骤执行时发现已停止就不再继续
+	state_->running = false;
+}
+
+bool SQLiteVacuumScheduler::IsRunning() const
+{
+	return state_->running;
+}
+
+void SQLiteVacuumScheduler::enterBackground()
+{
+	Start();
+}
+
+void SQLiteVacuumScheduler::enterForeground()
+{
+	Stop();
+}
+
+void SQLiteVacuumScheduler::PostStep(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, bool first_step)
+{
+	bool posted = db->PostTask(AsyncSQLiteDB::kPriorityLow, [db, state, first_step](SQLiteDB* sqlite) {
+		if (!state->alive || !state->running)
+			return;
+
+		// 空闲页不多时不值得整理，第一步之后则一直整理到没有空闲页
+		int free_pages = sqlite->GetFreePageCount();
+		if (free_pages == 0 || (first_step && free_pages < state->min_free_pages) ||
+			sqlite->IncrementalVacuum(state->pages_per_step) != SQLITE_OK ||
+			free_pages <= state->pages_per_step)
+		{
+			state->running = false;
+			return;
+		}
+		PostStep(db, state, false);
+	});
+	if (!posted)
+		state->running = false;
+}
+
+DB_END_DECLS
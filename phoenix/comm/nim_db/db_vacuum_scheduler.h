@@ -0,0 +1,67 @@
+#ifndef __BASE_DB_VACUUM_SCHEDULER_H__
+#define __BASE_DB_VACUUM_SCHEDULER_H__
+
+#include "nim_db/db_async.h"
+#include <atomic>
+#include <memory>
+#include "extension/notification_center/notification_center.h"
+
+DB_BEGIN_DECLS
+
+/*
+    *  Purpose     Release free pages of an AsyncSQLiteDB in small incremental_vacuum steps when the app is idle
+    *  Remark      Steps start when the app enters background (NotificaionCenter) or Start() is called,
+    *              and stop when the app enters foreground, Stop() is called or no free page is left.
+    *              Every step is a low priority task on the database thread, so queries queued between
+    *              steps run first. The database should be switched by SQLiteDB::EnableIncrementalVacuum().
+    */
+class DB_EXPORT SQLiteVacuumScheduler : public NS_EXTENSION::NotificaionObserver
+{
+public:
+
+    /*
+        *  pages_per_step  Free pages released by one step
+        *  min_free_pages  Steps do not start until the free pages reach this count
+        */
+    SQLiteVacuumScheduler(AsyncSQLiteDB* db, int pages_per_step = 256, int min_free_pages = 1024);
+    virtual ~SQLiteVacuumScheduler();
+
+    /*
+        *  Purpose     Observe enterBackground/enterForeground of NotificaionCenter
+        */
+    void AttachNotificationCenter();
+    void DetachNotificationCenter();
+
+    /*
+        *  Purpose     Start/stop the steps manually, e.g. when the UI has been idle for a while
+        */
+    void Start();
+    void Stop();
+
+    bool IsRunning() const;
+
+protected:
+
+    virtual void enterBackground() override;
+    virtual void enterForeground() override;
+
+private:
+
+    // 任务可能在调度器析构之后才执行，共享的状态随任务一起保留
+    struct State
+    {
+        std::atomic_bool    running;
+        std::atomic_bool    alive;
+        int                 pages_per_step;
+        int                 min_free_pages;
+    };
+
+    static void PostStep(AsyncSQLiteDB* db, const std::shared_ptr<State>& state, bool first_step);
+
+    AsyncSQLiteDB*          db_;
+    std::shared_ptr<State>  state_;
+    bool                    attached_;
+};
+
+DB_END_DECLS
+#endif // __BASE_DB_VACUUM_SCHEDULER_H__
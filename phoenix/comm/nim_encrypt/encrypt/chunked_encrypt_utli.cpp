@@ -0,0 +1,173 @@
+#include "nim_encrypt/encrypt/chunked_encrypt_utli.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <openssl/rand.h>
+
+NIMENCRYPT_BEGIN_DECLS
+namespace {
+const char kMagic[4] = { 'N', 'E', 'C', '1' };
+const size_t kNonceSize = 12;
+const size_t kNonceOffset = 20;
+const int kMaxUpdateSize = 1 << 30;
+
+void WriteBigEndian(uint64_t value, size_t bytes, unsigned char *out)
+{
+	for (size_t i = bytes; i > 0; i--)
+	{
+		out[i - 1] = (unsigned char)(value & 0xFF);
+		value >>= 8;
+	}
+}
+uint64_t ReadBigEndian(const unsigned char *in, size_t bytes)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; i++)
+		value = (value << 8) | in[i];
+	return value;
+}
+void ChunkNonce(const unsigned char *header, uint64_t index, unsigned char *nonce)
+{
+	memcpy(nonce, header + kNonceOffset, kNonceSize);
+	for (size_t i = 0; i < 8; i++)
+		nonce[kNonceSize - 1 - i] ^= (unsigned char)(index >> (i * 8));
+}
+uint64_t ChunkCount(uint64_t plain_size, uint32_t chunk_size)
+{
+	// An empty buffer has an empty chunk, to authenticate the header
+	return plain_size == 0 ? 1 : (plain_size + chunk_size - 1) / chunk_size;
+}
+// Calls |task| with the indexes of [0, count) on |threads| threads, each
+// thread gets its own cipher context. Returns false if any call fails
+bool ParallelFor(uint64_t count, int threads, const std::function<bool(EVP_CIPHER_CTX*, uint64_t)> &task)
+{
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	threads = (int)std::min<uint64_t>((uint64_t)threads, count);
+	std::atomic<uint64_t> next(0);
+	std::atomic<bool> failed(false);
+	auto worker = [&]() {
+		EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+		if (ctx == nullptr) {
+			failed = true;
+			return;
+		}
+		while (!failed)
+		{
+			uint64_t index = next++;
+			if (index >= count)
+				break;
+			if (!task(ctx, index))
+				failed = true;
+		}
+		EVP_CIPHER_CTX_free(ctx);
+	};
+	// The calling thread is one of the workers
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	for (int i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto &thread : pool)
+		thread.join();
+	return !failed;
+}
+bool InitChunk(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *chiper, const std::string &key,
+	const unsigned char *header, uint64_t index, bool encrypt)
+{
+	unsigned char nonce[kNonceSize];
+	ChunkNonce(header, index, nonce);
+	int lout = 0;
+	// The whole header is authenticated by each chunk
+	return EVP_CipherInit_ex(ctx, chiper, nullptr, nullptr, nullptr, encrypt ? 1 : 0)
+		&& EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, (int)kNonceSize, nullptr)
+		&& EVP_CipherInit_ex(ctx, nullptr, nullptr, (const unsigned char *)key.data(), nonce, encrypt ? 1 : 0)
+		&& EVP_CipherUpdate(ctx, nullptr, &lout, header, (int)ChunkedEncryptUtli::kHeaderSize);
+}
+bool CipherChunk(EVP_CIPHER_CTX *ctx, const unsigned char *in, size_t isize, unsigned char *out)
+{
+	int lout = 0;
+	for (size_t offset = 0; offset < isize; offset += kMaxUpdateSize)
+	{
+		int lin = (int)std::min(isize - offset, (size_t)kMaxUpdateSize);
+		if (!EVP_CipherUpdate(ctx, out + offset, &lout, in + offset, lin))
+			return false;
+	}
+	return true;
+}
+}
+bool ChunkedEncryptUtli::Encrypt(const EVP_CIPHER *chiper, uint8_t method, const std::string &key,
+	const void *sdata, size_t ssize, std::string &ddata, uint32_t chunk_size, int threads)
+{
+	ddata.clear();
+	if (chiper == nullptr || chunk_size == 0 || key.size() != (size_t)EVP_CIPHER_key_length(chiper))
+		return false;
+	uint64_t count = ChunkCount(ssize, chunk_size);
+	ddata.resize(kHeaderSize + ssize + (size_t)count * kTagSize);
+	unsigned char *header = (unsigned char *)&ddata[0];
+	memcpy(header, kMagic, sizeof(kMagic));
+	header[4] = method;
+	WriteBigEndian(chunk_size, 4, header + 8);
+	WriteBigEndian(ssize, 8, header + 12);
+	if (RAND_bytes(header + kNonceOffset, (int)kNonceSize) != 1) {
+		ddata.clear();
+		return false;
+	}
+	const unsigned char *src = (const unsigned char *)sdata;
+	bool ret = ParallelFor(count, threads, [&](EVP_CIPHER_CTX *ctx, uint64_t index) {
+		size_t offset = (size_t)(index * chunk_size);
+		size_t length = std::min(ssize - offset, (size_t)chunk_size);
+		unsigned char *out = header + kHeaderSize + offset + (size_t)index * kTagSize;
+		int lout = 0;
+		return InitChunk(ctx, chiper, key, header, index, true)
+			&& CipherChunk(ctx, src + offset, length, out)
+			&& EVP_EncryptFinal_ex(ctx, out + length, &lout)
+			&& EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, (int)kTagSize, out + length) == 1;
+	});
+	if (!ret)
+		ddata.clear();
+	return ret;
+}
+bool ChunkedEncryptUtli::Decrypt(const EVP_CIPHER *chiper, uint8_t method, const std::string &key,
+	const void *sdata, size_t ssize, std::string &ddata, int threads)
+{
+	ddata.clear();
+	if (chiper == nullptr || ssize < kHeaderSize || key.size() != (size_t)EVP_CIPHER_key_length(chiper))
+		return false;
+	const unsigned char *header = (const unsigned char *)sdata;
+	if (memcmp(header, kMagic, sizeof(kMagic)) != 0 || header[4] != method)
+		return false;
+	uint32_t chunk_size = (uint32_t)ReadBigEndian(header + 8, 4);
+	uint64_t plain_size = ReadBigEndian(header + 12, 8);
+	if (chunk_size == 0 || plain_size > ssize)
+		return false;
+	uint64_t count = ChunkCount(plain_size, chunk_size);
+	if (kHeaderSize + plain_size + count * kTagSize != ssize)
+		return false;
+	// One more byte for an empty buffer
+	ddata.resize((size_t)plain_size + 1);
+	unsigned char *dst = (unsigned char *)&ddata[0];
+	bool ret = ParallelFor(count, threads, [&](EVP_CIPHER_CTX *ctx, uint64_t index) {
+		size_t offset = (size_t)(index * chunk_size);
+		size_t length = std::min((size_t)plain_size - offset, (size_t)chunk_size);
+		const unsigned char *in = header + kHeaderSize + offset + (size_t)index * kTagSize;
+		unsigned char tag[kTagSize];
+		memcpy(tag, in + length, kTagSize);
+		int lout = 0;
+		// Fails if the tag does not match
+		return InitChunk(ctx, chiper, key, header, index, false)
+			&& EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, (int)kTagSize, tag)
+			&& CipherChunk(ctx, in, length, dst + offset)
+			&& EVP_DecryptFinal_ex(ctx, dst + offset + length, &lout) == 1;
+	});
+	if (!ret) {
+		ddata.clear();
+		return false;
+	}
+	ddata.resize((size_t)plain_size);
+	return true;
+}
+NIMENCRYPT_END_DECLS
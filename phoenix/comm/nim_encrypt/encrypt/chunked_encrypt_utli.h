@@ -0,0 +1,34 @@
+#ifndef COMM_NIM_ENCRYPT_ENCRYPT_CHUNKED_ENCRYPT_UTLI_H_
+#define COMM_NIM_ENCRYPT_ENCRYPT_CHUNKED_ENCRYPT_UTLI_H_
+
+#include "nim_encrypt/config/build_config.h"
+#include <stdint.h>
+#include <string>
+#include <openssl/evp.h>
+
+NIMENCRYPT_BEGIN_DECLS
+// Encrypts a large buffer by chunks with an AEAD cipher on several threads.
+// The container is
+//   header(32): "NEC1" | method(1) | 0(3) | chunk size(4) | plain size(8) | nonce(12)
+//   chunks: ciphertext | tag(16), the last chunk may be shorter
+// The nonce of the chunk i is the nonce of the header with i XORed into its
+// last 8 bytes, and the header is the AAD of each chunk, so the chunks can
+// not be reordered, dropped or moved to another container.
+// The integers are big endian.
+class ChunkedEncryptUtli
+{
+public:
+	static const size_t kHeaderSize = 32;
+	static const size_t kTagSize = 16;
+	static const uint32_t kDefaultChunkSize = 4 * 1024 * 1024;
+
+	// |key| has the key length of |chiper|, |threads| 0 for the number of
+	// the CPUs
+	static bool Encrypt(const EVP_CIPHER *chiper, uint8_t method, const std::string &key,
+		const void *sdata, size_t ssize, std::string &ddata, uint32_t chunk_size, int threads);
+	static bool Decrypt(const EVP_CIPHER *chiper, uint8_t method, const std::string &key,
+		const void *sdata, size_t ssize, std::string &ddata, int threads);
+};
+NIMENCRYPT_END_DECLS
+
+#endif//COMM_NIM_ENCRYPT_ENCRYPT_CHUNKED_ENCRYPT_UTLI_H_
@@ -0,0 +1,216 @@
+#include "nim_encrypt/encrypt/encrypt_file_utli.h"
+#include <algorithm>
+#include <cstdio>
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+NIMENCRYPT_BEGIN_DECLS
+namespace {
+// A multiple of the allocation granularity and the page size
+const uint64_t kMapWindowSize = 64 * 1024 * 1024;
+// The size of the parts passed to the cipher
+const size_t kUpdateSize = 1024 * 1024;
+
+#if defined(OS_WIN)
+std::wstring UTF8ToWide(const std::string &utf8)
+{
+	int length = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), (int)utf8.size(), NULL, 0);
+	std::wstring wide(length, L'\0');
+	if (length > 0)
+		MultiByteToWideChar(CP_UTF8, 0, utf8.data(), (int)utf8.size(), &wide[0], length);
+	return wide;
+}
+#endif
+
+// Maps the windows of a read only file one by one
+class MappedFile
+{
+public:
+	MappedFile() : size_(0), view_(nullptr), view_size_(0)
+#if defined(OS_WIN)
+		, file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+#else
+		, fd_(-1)
+#endif
+	{
+	}
+	~MappedFile()
+	{
+		Unmap();
+#if defined(OS_WIN)
+		if (mapping_ != NULL)
+			CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+#else
+		if (fd_ >= 0)
+			close(fd_);
+#endif
+	}
+	bool Open(const std::string &path)
+	{
+#if defined(OS_WIN)
+		file_ = CreateFileW(UTF8ToWide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file_ == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size))
+			return false;
+		size_ = (uint64_t)size.QuadPart;
+		// A file of no bytes can not be mapped
+		if (size_ > 0)
+			mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+		return size_ == 0 || mapping_ != NULL;
+#else
+		fd_ = open(path.c_str(), O_RDONLY);
+		if (fd_ < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd_, &st) != 0)
+			return false;
+		size_ = (uint64_t)st.st_size;
+		return true;
+#endif
+	}
+	// Maps the window at |offset|, a multiple of kMapWindowSize
+	const unsigned char* Map(uint64_t offset, size_t &length)
+	{
+		Unmap();
+		length = (size_t)std::min<uint64_t>(size_ - offset, kMapWindowSize);
+#if defined(OS_WIN)
+		view_ = MapViewOfFile(mapping_, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, length);
+#else
+		view_ = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd_, (off_t)offset);
+		if (view_ == MAP_FAILED)
+			view_ = nullptr;
+		else
+			madvise(view_, length, MADV_SEQUENTIAL);
+#endif
+		view_size_ = view_ != nullptr ? length : 0;
+		return (const unsigned char*)view_;
+	}
+	uint64_t size() const { return size_; }
+
+private:
+	void Unmap()
+	{
+		if (view_ == nullptr)
+			return;
+#if defined(OS_WIN)
+		UnmapViewOfFile(view_);
+#else
+		munmap(view_, view_size_);
+#endif
+		view_ = nullptr;
+		view_size_ = 0;
+	}
+
+	uint64_t size_;
+	void *view_;
+	size_t view_size_;
+#if defined(OS_WIN)
+	HANDLE file_;
+	HANDLE mapping_;
+#else
+	int fd_;
+#endif
+};
+
+FILE* OpenOutputFile(const std::string &path)
+{
+#if defined(OS_WIN)
+	return _wfopen(UTF8ToWide(path).c_str(), L"wb");
+#else
+	return fopen(path.c_str(), "wb");
+#endif
+}
+
+void RemoveOutputFile(const std::string &path)
+{
+#if defined(OS_WIN)
+	_wremove(UTF8ToWide(path).c_str());
+#else
+	remove(path.c_str());
+#endif
+}
+
+bool TransformFile(ISymmetricEncryptMethod *method, bool encrypt, MappedFile &src, FILE *dst)
+{
+	if (!(encrypt ? method->EncryptBegin() : method->DecryptBegin()))
+		return false;
+	std::string output;
+	output.reserve(kUpdateSize + 64);
+	for (uint64_t offset = 0; offset < src.size(); offset += kMapWindowSize)
+	{
+		size_t length = 0;
+		const unsigned char *data = src.Map(offset, length);
+		if (data == nullptr)
+			return false;
+		for (size_t pos = 0; pos < length; pos += kUpdateSize)
+		{
+			size_t part = std::min(length - pos, kUpdateSize);
+			output.clear();
+			bool ret = encrypt ? method->EncryptUpdate(data + pos, part, output)
+				: method->DecryptUpdate(data + pos, part, output);
+			if (!ret || fwrite(output.data(), 1, output.size(), dst) != output.size())
+				return false;
+		}
+	}
+	output.clear();
+	if (!(encrypt ? method->EncryptFinal(output) : method->DecryptFinal(output)))
+		return false;
+	return fwrite(output.data(), 1, output.size(), dst) == output.size();
+}
+}
+
+bool EncryptFileUtli::Transform(ISymmetricEncryptMethod *method, bool encrypt,
+	const std::string &src_path, const std::string &dst_path)
+{
+	if (method == nullptr || src_path == dst_path)
+		return false;
+	MappedFile src;
+	if (!src.Open(src_path))
+		return false;
+	FILE *dst = OpenOutputFile(dst_path);
+	if (dst == nullptr)
+		return false;
+	bool ret = TransformFile(method, encrypt, src, dst);
+	if (fclose(dst) != 0)
+		ret = false;
+	if (!ret)
+		RemoveOutputFile(dst_path);
+	return ret;
+}
+bool EncryptFileUtli::Digest(ISymmetricEncryptMethod *method, const std::string &path, std::string &digest)
+{
+	digest.clear();
+	if (method == nullptr)
+		return false;
+	MappedFile src;
+	if (!src.Open(path) || !method->EncryptBegin())
+		return false;
+	// The hash methods output nothing before EncryptFinal()
+	for (uint64_t offset = 0; offset < src.size(); offset += kMapWindowSize)
+	{
+		size_t length = 0;
+		const unsigned char *data = src.Map(offset, length);
+		if (data == nullptr || !method->EncryptUpdate(data, length, digest)) {
+			method->EncryptFinal(digest);
+			digest.clear();
+			return false;
+		}
+	}
+	if (!method->EncryptFinal(digest)) {
+		digest.clear();
+		return false;
+	}
+	return true;
+}
+NIMENCRYPT_END_DECLS
@@ -0,0 +1,23 @@
+#ifndef COMM_NIM_ENCRYPT_ENCRYPT_ENCRYPT_FILE_UTLI_H_
+#define COMM_NIM_ENCRYPT_ENCRYPT_ENCRYPT_FILE_UTLI_H_
+
+#include "nim_encrypt/config/build_config.h"
+#include <string>
+#include "nim_encrypt/wrapper/nim_encrypt_interface.h"
+
+NIMENCRYPT_BEGIN_DECLS
+// Encrypts or decrypts a file to another one by the streaming interface of
+// |method|. The source is mapped to memory by windows of kMapWindowSize and
+// the output is written by parts, so neither file is held in memory.
+// The paths are UTF-8, the destination is removed if failed.
+class EncryptFileUtli
+{
+public:
+	static bool Transform(ISymmetricEncryptMethod *method, bool encrypt,
+		const std::string &src_path, const std::string &dst_path);
+	// The digest of the file by a hash |method|, it replaces |digest|
+	static bool Digest(ISymmetricEncryptMethod *method, const std::string &path, std::string &digest);
+};
+NIMENCRYPT_END_DECLS
+
+#endif//COMM_NIM_ENCRYPT_ENCRYPT_ENCRYPT_FILE_UTLI_H_
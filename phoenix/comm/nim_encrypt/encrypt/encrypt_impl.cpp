@@ -1,9 +1,14 @@
 #include "nim_encrypt/wrapper/nim_encrypt_interface.h"
+#include <algorithm>
 #include "nim_encrypt/encrypt/encrypt_impl.h"
 #include "nim_encrypt/encrypt/symmetricEncryptImp_hash.h"
 #include "nim_encrypt/encrypt/encrypt_utli.h"
 
 NIMENCRYPT_BEGIN_DECLS
+namespace {
+// EVP_CipherUpdate() takes an int size, a multiple of the block sizes
+const size_t kMaxUpdateSize = 1 << 30;
+}
 
  void SymmetricEncryptBase::ExpandKey(uint32_t ksize, std::string &key)
 {
@@ -21,6 +26,75 @@ NIMENCRYPT_BEGIN_DECLS
 	if (key.size() > ksize)
 		key.resize(ksize);
 }
+bool SymmetricEncryptBase::EncryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets)
+{
+	return TransformBatch(true, sdata, count, arena, offsets);
+}
+bool SymmetricEncryptBase::DecryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets)
+{
+	return TransformBatch(false, sdata, count, arena, offsets);
+}
+bool SymmetricEncryptBase::TransformBatch(bool encrypt, const CryptoBuffer *sdata, size_t count,
+	std::string &arena, std::vector<size_t> &offsets)
+{
+	offsets.resize(count + 1);
+	size_t max_size = 0;
+	for (size_t i = 0; i < count; i++)
+		max_size += encrypt ? MaxEncryptedSize(sdata[i].size) : MaxDecryptedSize(sdata[i].size);
+	// One more byte so the pointer of an empty output is valid
+	arena.resize(max_size + 1);
+	size_t offset = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		offsets[i] = offset;
+		size_t dsize = max_size - offset;
+		bool ret = encrypt ? Encrypt(sdata[i].data, sdata[i].size, &arena[offset], dsize)
+			: Decrypt(sdata[i].data, sdata[i].size, &arena[offset], dsize);
+		if (!ret)
+		{
+			arena.clear();
+			offsets.clear();
+			return false;
+		}
+		offset += dsize;
+	}
+	offsets[count] = offset;
+	arena.resize(offset);
+	return true;
+}
+bool SymmetricEncryptBase::CipherUpdate(EVP_CIPHER_CTX *ctx, const void *sdata, size_t ssize, std::string &ddata)
+{
+	size_t offset = 0;
+	while (offset < ssize)
+	{
+		int lin = (int)std::min(ssize - offset, kMaxUpdateSize);
+		size_t old_size = ddata.size();
+		// EVP_CipherUpdate() writes a block more than it is given at most
+		ddata.resize(old_size + lin + EVP_CIPHER_CTX_block_size(ctx));
+		int lout = 0;
+		if (!EVP_CipherUpdate(ctx, (unsigned char *)&ddata[old_size], &lout, (const unsigned char *)sdata + offset, lin))
+		{
+			ddata.resize(old_size);
+			return false;
+		}
+		ddata.resize(old_size + lout);
+		offset += lin;
+	}
+	return true;
+}
+bool SymmetricEncryptBase::CipherFinal(EVP_CIPHER_CTX *ctx, std::string &ddata)
+{
+	size_t old_size = ddata.size();
+	ddata.resize(old_size + EVP_CIPHER_CTX_block_size(ctx));
+	int lout = 0;
+	if (!EVP_CipherFinal_ex(ctx, (unsigned char *)&ddata[old_size], &lout))
+	{
+		ddata.resize(old_size);
+		return false;
+	}
+	ddata.resize(old_size + lout);
+	return true;
+}
 SymmetricEncryptBase::SymmetricEncryptBase(EncryptMethod method) :
 	method_(method), key_(""), enable_padding_(false), padding_mode_(0), iv_parameter_spec_("")
 {
@@ -46,6 +120,7 @@ std::string SymmetricEncryptBase::GetKey() const
 void SymmetricEncryptBase::SetIvParameterSpec(const std::string &iv)
 {
 	iv_parameter_spec_ = iv;
+	OnSetIvParameterSpec();
 }
 std::string SymmetricEncryptBase::GetIvParameterSpec() const
 {
@@ -55,9 +130,11 @@ void SymmetricEncryptBase::EnableEncryptPadding(bool enable, int padding_mode)
 {
 	enable_padding_ = enable;
 	padding_mode_ = padding_mode;
+	OnSetPadding();
 }
 void SymmetricEncryptBase::UpdatePaddingMode(int padding_mode)
 {
 	padding_mode_ = padding_mode;
+	OnSetPadding();
 }
 NIMENCRYPT_END_DECLS
\ No newline at end of file
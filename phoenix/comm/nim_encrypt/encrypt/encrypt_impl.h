@@ -21,9 +21,18 @@ public:
 	virtual std::string GetIvParameterSpec() const override;
 	virtual void EnableEncryptPadding(bool enable, int padding_mode) override;
 	virtual void UpdatePaddingMode(int padding_mode) override;
+	// By the buffer Encrypt()/Decrypt() of the implementation
+	virtual bool EncryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets) override;
+	virtual bool DecryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets) override;
 protected:
 	static void ExpandKey(uint32_t ksize, std::string &key);
+	// Append the output of |ctx| to |ddata|
+	static bool CipherUpdate(EVP_CIPHER_CTX *ctx, const void *sdata, size_t ssize, std::string &ddata);
+	static bool CipherFinal(EVP_CIPHER_CTX *ctx, std::string &ddata);
+	bool TransformBatch(bool encrypt, const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets);
 	virtual void OnSetKey() {};
+	virtual void OnSetIvParameterSpec() {};
+	virtual void OnSetPadding() {};
 protected:
 	EncryptMethod method_;
 	std::string key_;
@@ -2,7 +2,10 @@
 #define COMM_NIM_ENCRYPT_ENCRYPT_RSA_ENCRYPT_IMP_H_
 
 #include "nim_encrypt/config/build_config.h"
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
@@ -11,6 +14,9 @@
 
 NIMENCRYPT_BEGIN_DECLS
 
+// The key is parsed once by SetPublicKey()/SetPirvateKey(), the RSA keeps the
+// Montgomery contexts after the first use. The cipher calls may be made on
+// several threads, each uses the key set when it starts.
 class RSAEncryptMethodImp : public IRSAEncryptMethod
 {
 public:
@@ -23,13 +29,24 @@ public:
 	virtual bool PrivateKeyDecrypt(const std::string& raw_content, std::string& decrypted_content) override;
 	virtual bool PrivateKeyEncrypt(const std::string& raw_content, std::string& encrypted_content) override;
 	virtual bool PublicKeyDecrypt(const std::string& raw_content, std::string& decrypted_content) override;
+private:
+	using RSAFunction = int(*)(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
+	// Builds the RSA of the hex strings, |lock_| is held
+	void UpdateKey();
+	std::shared_ptr<RSA> GetKey() const;
+	// Calls |function| on the blocks of |raw_content|, |padded| if the padding
+	// is added to the blocks
+	bool Transform(RSAFunction function, bool padded, bool private_key,
+		const std::string& raw_content, std::string& output) const;
 private:
 	static const std::map<RSAPaddingMode, int> padding_size_list_;
 	static const std::map<RSAPaddingMode, int> nim_padding_mode_openssl_padding_mode_;
 	std::string public_key_mode_;
 	std::string public_key_exp_;
 	std::string private_key_;
-	RSAPaddingMode padding_mode_;
+	std::atomic<RSAPaddingMode> padding_mode_;
+	mutable std::mutex lock_;
+	std::shared_ptr<RSA> rsa_;
 };
 
 NIMENCRYPT_END_DECLS
@@ -1,4 +1,5 @@
 #include "nim_encrypt/encrypt/sm2_encrypt_imp.h"
+#include <cstring>
 NIMENCRYPT_BEGIN_DECLS
 const int SM2EncryptMethodImp::kSM2_STRING_KEY_X_LENGTH = 64;//ԿX
 const int SM2EncryptMethodImp::kSM2_STRING_KEY_Y_LENGTH = 64;//ԿY
@@ -6,19 +7,69 @@ const int SM2EncryptMethodImp::kSM2_STRING_KEY_D_LENGTH = 64;//˽Կ
 const int SM2EncryptMethodImp::kSM2_KEY_PUBLIC_LENGTH = 65;//Կ
 const int SM2EncryptMethodImp::kSM2_KEY_PRIVATE_LENGTH = 32;//˽Կ
 const int SM2EncryptMethodImp::kSM2_SM3DIGEST_BUFFER_LENGTH = 32;//sm3ժҪ
-SM2EncryptMethodImp::SM2EncryptMethodImp()
+namespace {
+void HexToBinary(const std::string& hex, int length, std::string& binary)
 {
-
+	binary.resize(length);
+	for (int index = 0; index < length; index++)
+		sscanf_s(hex.substr(2 * index, 2).c_str(), "%x", (unsigned int*)&binary[index]);
+}
+}
+bool SM2EncryptMethodImp::Workspace::Init(const EC_GROUP* group)
+{
+	return (ctx = BN_CTX_new()) != NULL
+		&& (c1_pt = EC_POINT_new(group)) != NULL
+		&& (s_pt = EC_POINT_new(group)) != NULL
+		&& (ec_pt = EC_POINT_new(group)) != NULL
+		&& (md_ctx = EVP_MD_CTX_new()) != NULL;
+}
+SM2EncryptMethodImp::Workspace::~Workspace()
+{
+	if (ctx)
+		BN_CTX_free(ctx);
+	if (c1_pt)
+		EC_POINT_free(c1_pt);
+	if (s_pt)
+		EC_POINT_free(s_pt);
+	if (ec_pt)
+		EC_POINT_free(ec_pt);
+	if (md_ctx)
+		EVP_MD_CTX_free(md_ctx);
+}
+SM2EncryptMethodImp::SM2EncryptMethodImp() :
+	group_(NULL), public_key_pt_(NULL), private_key_bn_(NULL)
+{
+	group_ = EC_GROUP_new_by_curve_name(NID_sm2);
+	if (group_ == NULL)
+		return;
+	// The multiples of the generator make k * G of each encryption faster
+	BN_CTX* ctx = BN_CTX_new();
+	if (ctx != NULL)
+	{
+		EC_GROUP_precompute_mult(group_, ctx);
+		BN_CTX_free(ctx);
+	}
 }
 SM2EncryptMethodImp::~SM2EncryptMethodImp()
 {
-
+	if (public_key_pt_)
+		EC_POINT_free(public_key_pt_);
+	if (private_key_bn_)
+		BN_clear_free(private_key_bn_);
+	if (group_)
+		EC_GROUP_free(group_);
 }
 void SM2EncryptMethodImp::SetPublicKey(const std::string& hex_x, const std::string& hex_y)
 {
+	if (public_key_pt_)
+	{
+		EC_POINT_free(public_key_pt_);
+		public_key_pt_ = NULL;
+	}
+	if (group_ == NULL)
+		return;
 	std::string public_key_x_ = hex_x;
 	std::string public_key_y_ = hex_y;
-	//빫Կ
 	std::string public_hex_key = "04";
 	if (public_key_x_.length() < kSM2_STRING_KEY_X_LENGTH)
 		public_key_x_.append(kSM2_STRING_KEY_X_LENGTH - public_key_x_.length(), '0');
@@ -26,151 +77,130 @@ void SM2EncryptMethodImp::SetPublicKey(const std::string& hex_x, const std::stri
 	if (public_key_y_.length() < kSM2_STRING_KEY_Y_LENGTH)
 		public_key_y_.append(kSM2_STRING_KEY_Y_LENGTH - public_key_y_.length(), '0');
 	public_hex_key.append(public_key_y_.c_str(), kSM2_STRING_KEY_Y_LENGTH);
-	//ƹԿ
-	public_key_.resize(kSM2_KEY_PUBLIC_LENGTH);
-	for (int index = 0; index < kSM2_KEY_PUBLIC_LENGTH; index++)
-		sscanf_s(public_hex_key.substr(2 * index, 2).c_str(), "%x", (unsigned int*)&public_key_[index]);
+	std::string public_key;
+	HexToBinary(public_hex_key, kSM2_KEY_PUBLIC_LENGTH, public_key);
+
+	const int coordinate_length = (kSM2_KEY_PUBLIC_LENGTH - 1) / 2;
+	Workspace workspace;
+	if (!workspace.Init(group_))
+		return;
+	BN_CTX_start(workspace.ctx);
+	BIGNUM* bn_x = BN_CTX_get(workspace.ctx);
+	BIGNUM* bn_y = BN_CTX_get(workspace.ctx);
+	EC_POINT* point = EC_POINT_new(group_);
+	// The point is checked once here instead of by each encryption
+	bool ret = bn_y != NULL && point != NULL
+		&& BN_bin2bn((const unsigned char*)public_key.data() + 1, coordinate_length, bn_x)
+		&& BN_bin2bn((const unsigned char*)public_key.data() + 1 + coordinate_length, coordinate_length, bn_y)
+		&& EC_POINT_set_affine_coordinates_GFp(group_, point, bn_x, bn_y, workspace.ctx)
+		&& EC_POINT_mul(group_, workspace.s_pt, NULL, point, EC_GROUP_get0_cofactor(group_), workspace.ctx)
+		&& !EC_POINT_is_at_infinity(group_, workspace.s_pt);
+	BN_CTX_end(workspace.ctx);
+	if (ret)
+		public_key_pt_ = point;
+	else if (point)
+		EC_POINT_free(point);
 }
 void SM2EncryptMethodImp::SetPirvateKey(const std::string hex_key)
 {
-	private_key_ = "";
-	private_key_.resize(kSM2_KEY_PRIVATE_LENGTH);
-	for (int index = 0; index < kSM2_KEY_PRIVATE_LENGTH; index++)
-		sscanf_s(hex_key.substr(2 * index, 2).c_str(), "%x", (unsigned int*)&private_key_[index]);
+	std::string private_key;
+	HexToBinary(hex_key, kSM2_KEY_PRIVATE_LENGTH, private_key);
+	if (private_key_bn_ == NULL)
+		private_key_bn_ = BN_secure_new();
+	if (private_key_bn_ && !BN_bin2bn((const unsigned char*)private_key.data(), kSM2_KEY_PRIVATE_LENGTH, private_key_bn_))
+	{
+		BN_clear_free(private_key_bn_);
+		private_key_bn_ = NULL;
+	}
+	OPENSSL_cleanse(&private_key[0], private_key.size());
 }
 bool SM2EncryptMethodImp::PublicKeyEncrypt(const std::string& raw_content, std::string& encrypted_content)
 {	
+	Workspace workspace;
+	if (public_key_pt_ == NULL || !workspace.Init(group_))
+		return false;
+	return EncryptMessage(raw_content, workspace, encrypted_content);
+}
+bool SM2EncryptMethodImp::PublicKeyEncrypt(const std::vector<std::string>& raw_contents, std::vector<std::string>& encrypted_contents)
+{
+	encrypted_contents.clear();
+	Workspace workspace;
+	if (public_key_pt_ == NULL || !workspace.Init(group_))
+		return false;
+	encrypted_contents.resize(raw_contents.size());
+	for (size_t index = 0; index < raw_contents.size(); index++)
+	{
+		if (!EncryptMessage(raw_contents[index], workspace, encrypted_contents[index]))
+		{
+			encrypted_contents.clear();
+			return false;
+		}
+	}
+	return true;
+}
+bool SM2EncryptMethodImp::EncryptMessage(const std::string& raw_content, Workspace& workspace, std::string& encrypted_content)
+{
 	std::string c1(""), c2(""), c3("");
 	c2.resize(raw_content.length());
 	c3.resize(kSM2_SM3DIGEST_BUFFER_LENGTH);
-	if(nim_sm2_encrypt(raw_content, public_key_, c1, c2, c3) == SM2Error::SUCCESS)
+	if(nim_sm2_encrypt(raw_content, workspace, c1, c2, c3) == SM2Error::SUCCESS)
 		encrypted_content.append(c1).append(c2).append(c3);
 	return encrypted_content.size() > 0;
 }
 bool SM2EncryptMethodImp::PrivateKeyDecrypt(const std::string& raw_content, std::string& decrypted_content)
 {
-	std::string text_buf("");
-	std::string private_key_arr("");
 	decrypted_content.clear();
-	decrypted_content.resize(raw_content.size());
+	if (private_key_bn_ == NULL || raw_content.size() < (size_t)(kSM2_KEY_PUBLIC_LENGTH + kSM2_SM3DIGEST_BUFFER_LENGTH))
+		return false;
 	std::string c1(""), c2(""), c3("");
 	c1.append(raw_content.substr(0, kSM2_KEY_PUBLIC_LENGTH));
 	c3.append(raw_content.substr(raw_content.size() - kSM2_SM3DIGEST_BUFFER_LENGTH, kSM2_SM3DIGEST_BUFFER_LENGTH).data(), kSM2_SM3DIGEST_BUFFER_LENGTH);
 	c2.append(raw_content.substr((kSM2_KEY_PUBLIC_LENGTH ), (raw_content.length() - kSM2_KEY_PUBLIC_LENGTH - kSM2_SM3DIGEST_BUFFER_LENGTH)));
 	decrypted_content.resize(c2.size());
-	return (nim_sm2_decrypt(c1, c2, c3, private_key_, decrypted_content) == SM2Error::SUCCESS);
+	return (nim_sm2_decrypt(c1, c2, c3, decrypted_content) == SM2Error::SUCCESS);
 }
-SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_encrypt(const std::string& raw_content,const std::string& pub_key,
+SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_encrypt(const std::string& raw_content, Workspace& workspace,
 	std::string& c1,std::string& c2,	std::string& c3)
 {
 	SM2Error error_code = SM2Error::SUCCESS;
-	unsigned char pub_key_x[32], pub_key_y[32], c1_x[32], c1_y[32], x2[32], y2[32];
+	unsigned char c1_x[32], c1_y[32], x2[32], y2[32];
 	unsigned char c1_point[65], x2_y2[64];
 	unsigned char *t = NULL;
-	BN_CTX *ctx = NULL;
+	BN_CTX *ctx = workspace.ctx;
 	BIGNUM *bn_k = NULL, *bn_c1_x = NULL, *bn_c1_y = NULL;
-	BIGNUM *bn_pub_key_x = NULL, *bn_pub_key_y = NULL;
 	BIGNUM *bn_x2 = NULL, *bn_y2 = NULL;
-	const BIGNUM *bn_order, *bn_cofactor;
-	EC_GROUP *group = NULL;
-	const EC_POINT *generator;
-	EC_POINT *pub_key_pt = NULL, *c1_pt = NULL, *s_pt = NULL, *ec_pt = NULL;
+	const BIGNUM *bn_order;
+	// The group, its generator tables and the checked public key are cached
+	const EC_GROUP *group = group_;
+	const EC_POINT *pub_key_pt = public_key_pt_;
+	EC_POINT *c1_pt = workspace.c1_pt, *ec_pt = workspace.ec_pt;
 	const EVP_MD *md;
-	EVP_MD_CTX *md_ctx = NULL;
+	EVP_MD_CTX *md_ctx = workspace.md_ctx;
 	int i, flag;
-
-	memcpy(pub_key_x, (pub_key.data() + 1), sizeof(pub_key_x));
-	memcpy(pub_key_y, (pub_key.data() + 1 + sizeof(pub_key_x)), sizeof(pub_key_y));
+	bool started = false;
 
 	error_code = SM2Error::ALLOCATION_MEMORY_FAIL;
-	if (!(t = (unsigned char *)malloc(raw_content.size())))
-	{
-		goto clean_up;
-	}
-	if (!(ctx = BN_CTX_new()))
+	if (!(t = (unsigned char *)malloc(raw_content.size() > 0 ? raw_content.size() : 1)))
 	{
 		goto clean_up;
 	}
 	BN_CTX_start(ctx);
+	started = true;
 	bn_k = BN_CTX_get(ctx);
 	bn_c1_x = BN_CTX_get(ctx);
 	bn_c1_y = BN_CTX_get(ctx);
-	bn_pub_key_x = BN_CTX_get(ctx);
-	bn_pub_key_y = BN_CTX_get(ctx);
 	bn_x2 = BN_CTX_get(ctx);
 	bn_y2 = BN_CTX_get(ctx);
 	if (!(bn_y2))
 	{
 		goto clean_up;
 	}
-	if (!(group = EC_GROUP_new_by_curve_name(NID_sm2)))
-	{
-		goto clean_up;
-	}
-
-	if (!(pub_key_pt = EC_POINT_new(group)))
-	{
-		goto clean_up;
-	}
-	if (!(c1_pt = EC_POINT_new(group)))
-	{
-		goto clean_up;
-	}
-	if (!(s_pt = EC_POINT_new(group)))
-	{
-		goto clean_up;
-	}
-	if (!(ec_pt = EC_POINT_new(group)))
-	{
-		goto clean_up;
-	}
-
-	if (!(md_ctx = EVP_MD_CTX_new()))
-	{
-		goto clean_up;
-	}
 
 	error_code = SM2Error::COMPUTE_SM2_CIPHERTEXT_FAIL;
-	if (!(BN_bin2bn(pub_key_x, sizeof(pub_key_x), bn_pub_key_x)))
-	{
-		goto clean_up;
-	}
-	if (!(BN_bin2bn(pub_key_y, sizeof(pub_key_y), bn_pub_key_y)))
-	{
-		goto clean_up;
-	}
-
 	if (!(bn_order = EC_GROUP_get0_order(group)))
 	{
 		goto clean_up;
 	}
-	if (!(bn_cofactor = EC_GROUP_get0_cofactor(group)))
-	{
-		goto clean_up;
-	}
-	if (!(generator = EC_GROUP_get0_generator(group)))
-	{
-		goto clean_up;
-	}
-
-	if (!(EC_POINT_set_affine_coordinates_GFp(group,
-		pub_key_pt,
-		bn_pub_key_x,
-		bn_pub_key_y,
-		ctx)))
-	{
-		goto clean_up;
-	}
-
-	if (!(EC_POINT_mul(group, s_pt, NULL, pub_key_pt, bn_cofactor, ctx)))
-	{
-		goto clean_up;
-	}
-	if (EC_POINT_is_at_infinity(group, s_pt))
-	{
-		error_code = SM2Error::EC_POINT_IS_AT_INFINITY;
-		goto clean_up;
-	}
 	md = EVP_sm3();
 
 	do
@@ -279,40 +309,13 @@ clean_up:
 	{
 		free(t);
 	}
-	if (ctx)
+	if (started)
 	{
 		BN_CTX_end(ctx);
-		BN_CTX_free(ctx);
-	}
-	if (group)
-	{
-		EC_GROUP_free(group);
-	}
-
-	if (pub_key_pt)
-	{
-		EC_POINT_free(pub_key_pt);
-	}
-	if (c1_pt)
-	{
-		EC_POINT_free(c1_pt);
-	}
-	if (s_pt)
-	{
-		EC_POINT_free(s_pt);
-	}
-	if (ec_pt)
-	{
-		EC_POINT_free(ec_pt);
-	}
-	if (md_ctx)
-	{
-		EVP_MD_CTX_free(md_ctx);
 	}
 	return error_code;
 }
 SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_decrypt(const std::string&c1, const std::string&c2, const std::string&c3, 
-	const std::string&pri_key, 
 	std::string& decrypted_content)
 {
 	SM2Error error_code = SM2Error::SUCCESS;
@@ -320,10 +323,11 @@ SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_decrypt(const std::st
 	unsigned char x2_y2[64], digest[32];
 	unsigned char *t = NULL, *M = NULL;
 	BN_CTX *ctx = NULL;
-	BIGNUM *bn_d = NULL, *bn_c1_x = NULL, *bn_c1_y = NULL;
+	BIGNUM *bn_c1_x = NULL, *bn_c1_y = NULL;
+	const BIGNUM *bn_d = private_key_bn_;
 	BIGNUM *bn_x2 = NULL, *bn_y2 = NULL;
 	const BIGNUM *bn_cofactor;
-	EC_GROUP *group = NULL;
+	const EC_GROUP *group = group_;
 	EC_POINT *c1_pt = NULL, *s_pt = NULL, *ec_pt = NULL;
 	const EVP_MD *md;
 	EVP_MD_CTX *md_ctx = NULL;
@@ -339,7 +343,6 @@ SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_decrypt(const std::st
 		goto clean_up;
 	}
 	BN_CTX_start(ctx);
-	bn_d = BN_CTX_get(ctx);
 	bn_c1_x = BN_CTX_get(ctx);
 	bn_c1_y = BN_CTX_get(ctx);
 	bn_x2 = BN_CTX_get(ctx);
@@ -348,11 +351,6 @@ SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_decrypt(const std::st
 	{
 		goto clean_up;
 	}
-	if (!(group = EC_GROUP_new_by_curve_name(NID_sm2)))
-	{
-		goto clean_up;
-	}
-
 	if (!(c1_pt = EC_POINT_new(group)))
 	{
 		goto clean_up;
@@ -372,10 +370,6 @@ SM2EncryptMethodImp::SM2Error SM2EncryptMethodImp::nim_sm2_decrypt(const std::st
 	}
 
 	error_code = SM2Error::SM2_DECRYPT_FAIL;
-	if (!(BN_bin2bn((unsigned char*)pri_key.data(), 32, bn_d)))
-	{
-		goto clean_up;
-	}
 	if (!(BN_bin2bn(c1_x, sizeof(c1_x), bn_c1_x)))
 	{
 		goto clean_up;
@@ -501,11 +495,6 @@ clean_up:
 		BN_CTX_end(ctx);
 		BN_CTX_free(ctx);
 	}
-	if (group)
-	{
-		EC_GROUP_free(group);
-	}
-
 	if (c1_pt)
 	{
 		EC_POINT_free(c1_pt);
@@ -6,10 +6,15 @@
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
 #include <openssl/rand.h>
+#include <openssl/ec.h>
+#include <vector>
 #include "nim_encrypt/wrapper/nim_encrypt_interface.h"
 
 NIMENCRYPT_BEGIN_DECLS
 
+// The SM2 group with its generator tables is created once, the keys are
+// parsed and checked by SetPublicKey()/SetPirvateKey().
+// Set the keys before the object is shared by the threads.
 class SM2EncryptMethodImp : public ISM2EncryptMethod
 {
 	enum class SM2Error
@@ -37,13 +42,28 @@ public:
 	virtual void SetPublicKey(const std::string& hex_x, const std::string& hex_y) override;
 	virtual void SetPirvateKey(const std::string hex_key) override;
 	virtual bool PublicKeyEncrypt(const std::string& raw_content, std::string& encrypted_content) override;
+	virtual bool PublicKeyEncrypt(const std::vector<std::string>& raw_contents, std::vector<std::string>& encrypted_contents) override;
 	virtual bool PrivateKeyDecrypt(const std::string& raw_content, std::string& decrypted_content) override;
 private:
-	SM2Error nim_sm2_encrypt(const std::string& raw_content,const std::string& pub_key,std::string& c1,std::string& c2,std::string& c3);
-	SM2Error nim_sm2_decrypt(const std::string&c1, const std::string&c2, const std::string&c3,const std::string&pri_key,std::string& decrypted_content);
+	// The objects of a message, reused by the messages of a batch
+	struct Workspace
+	{
+		Workspace() : ctx(NULL), c1_pt(NULL), s_pt(NULL), ec_pt(NULL), md_ctx(NULL) {}
+		~Workspace();
+		bool Init(const EC_GROUP* group);
+		BN_CTX* ctx;
+		EC_POINT* c1_pt;
+		EC_POINT* s_pt;
+		EC_POINT* ec_pt;
+		EVP_MD_CTX* md_ctx;
+	};
+	bool EncryptMessage(const std::string& raw_content, Workspace& workspace, std::string& encrypted_content);
+	SM2Error nim_sm2_encrypt(const std::string& raw_content, Workspace& workspace, std::string& c1, std::string& c2, std::string& c3);
+	SM2Error nim_sm2_decrypt(const std::string&c1, const std::string&c2, const std::string&c3, std::string& decrypted_content);
 private:
-	std::string public_key_;
-	std::string private_key_;
+	EC_GROUP* group_;
+	EC_POINT* public_key_pt_;
+	BIGNUM* private_key_bn_;
 private:
 	static const int kSM2_STRING_KEY_X_LENGTH;//ԿX
 	static const int kSM2_STRING_KEY_Y_LENGTH;	//ԿY
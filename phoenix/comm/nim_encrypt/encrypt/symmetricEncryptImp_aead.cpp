@@ -0,0 +1,352 @@
+#include "nim_encrypt/encrypt/symmetricEncryptImp_aead.h"
+#include "nim_encrypt/encrypt/chunked_encrypt_utli.h"
+#include <algorithm>
+#include <cstring>
+#if defined(ARCH_CPU_X86_FAMILY)
+#if defined(COMPILER_MSVC)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(ARCH_CPU_ARM_FAMILY) && (defined(OS_ANDROID) || defined(OS_LINUX))
+#include <sys/auxv.h>
+#endif
+
+NIMENCRYPT_BEGIN_DECLS
+namespace {
+const int kMaxUpdateSize = 1 << 30;
+}
+SymmetricEncryptImp_AEAD::SymmetricEncryptImp_AEAD(EncryptMethod method) :
+	SymmetricEncryptBase(method), encrypt_ctx_(nullptr), decrypt_ctx_(nullptr),
+	encrypt_streaming_(false), decrypt_streaming_(false), nonce_pending_(false), nonce_read_(false)
+{
+
+}
+SymmetricEncryptImp_AEAD::~SymmetricEncryptImp_AEAD()
+{
+	FreeContexts();
+}
+bool SymmetricEncryptImp_AEAD::HasAESHardware()
+{
+#if defined(ARCH_CPU_X86_FAMILY)
+	// CPUID.1:ECX.AESNI[bit 25]
+#if defined(COMPILER_MSVC)
+	int info[4] = { 0 };
+	__cpuid(info, 1);
+	return (info[2] & (1 << 25)) != 0;
+#else
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 25)) != 0;
+#endif
+#elif defined(ARCH_CPU_ARM_FAMILY) && (defined(OS_IOS) || defined(OS_MACOSX))
+	// All the 64-bit Apple CPUs have the crypto extensions
+#if defined(ARCH_CPU_ARM64)
+	return true;
+#else
+	return false;
+#endif
+#elif defined(ARCH_CPU_ARM_FAMILY) && (defined(OS_ANDROID) || defined(OS_LINUX))
+#if defined(ARCH_CPU_ARM64)
+	// HWCAP_AES
+	return (getauxval(AT_HWCAP) & (1 << 3)) != 0;
+#else
+	// HWCAP2_AES
+	return (getauxval(AT_HWCAP2) & (1 << 0)) != 0;
+#endif
+#else
+	return false;
+#endif
+}
+const EVP_CIPHER* SymmetricEncryptImp_AEAD::CreateChiper(EncryptMethod method)
+{
+	switch (method)
+	{
+	case EncryptMethod::ENC_AES128_GCM:
+		return EVP_aes_128_gcm();
+	case EncryptMethod::ENC_AES256_GCM:
+		return EVP_aes_256_gcm();
+	case EncryptMethod::ENC_CHACHA20_POLY1305:
+		return EVP_chacha20_poly1305();
+	default:
+		return nullptr;
+	}
+	return nullptr;
+}
+std::string SymmetricEncryptImp_AEAD::ChiperKey(const EVP_CIPHER *chiper) const
+{
+	std::string key = key_;
+	ExpandKey(EVP_CIPHER_key_length(chiper), key);
+	return key;
+}
+void SymmetricEncryptImp_AEAD::FreeContexts()
+{
+	encrypt_streaming_ = false;
+	decrypt_streaming_ = false;
+	if (encrypt_ctx_ != nullptr) {
+		EVP_CIPHER_CTX_free(encrypt_ctx_);
+		encrypt_ctx_ = nullptr;
+	}
+	if (decrypt_ctx_ != nullptr) {
+		EVP_CIPHER_CTX_free(decrypt_ctx_);
+		decrypt_ctx_ = nullptr;
+	}
+}
+EVP_CIPHER_CTX* SymmetricEncryptImp_AEAD::PrepareContext(bool encrypt, const unsigned char *nonce)
+{
+	EVP_CIPHER_CTX *&ctx = encrypt ? encrypt_ctx_ : decrypt_ctx_;
+	(encrypt ? encrypt_streaming_ : decrypt_streaming_) = false;
+	// Without the cipher and the key only the nonce is set
+	if (ctx != nullptr && EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, nonce, encrypt ? 1 : 0))
+		return ctx;
+	if (ctx != nullptr) {
+		EVP_CIPHER_CTX_free(ctx);
+		ctx = nullptr;
+	}
+	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return nullptr;
+	std::string key = ChiperKey(chiper);
+	ctx = EVP_CIPHER_CTX_new();
+	if (ctx == nullptr)
+		return nullptr;
+	if (!EVP_CipherInit_ex(ctx, chiper, nullptr, nullptr, nullptr, encrypt ? 1 : 0)
+		|| !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, (int)kNonceSize, nullptr)
+		|| !EVP_CipherInit_ex(ctx, nullptr, nullptr, (const unsigned char*)key.c_str(), nonce, encrypt ? 1 : 0)) {
+		EVP_CIPHER_CTX_free(ctx);
+		ctx = nullptr;
+		return nullptr;
+	}
+	return ctx;
+}
+bool SymmetricEncryptImp_AEAD::EncryptMessage(const unsigned char *in, size_t isize, unsigned char *out)
+{
+	unsigned char nonce[kNonceSize];
+	if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+		return false;
+	auto ctx = PrepareContext(true, nonce);
+	if (ctx == nullptr)
+		return false;
+	// memmove() as |in| may be right after the nonce
+	memmove(out + kNonceSize, in, isize);
+	memcpy(out, nonce, kNonceSize);
+	unsigned char *text = out + kNonceSize;
+	int lout = 0;
+	for (size_t offset = 0; offset < isize; offset += kMaxUpdateSize)
+	{
+		int lin = (int)std::min(isize - offset, (size_t)kMaxUpdateSize);
+		if (!EVP_EncryptUpdate(ctx, text + offset, &lout, text + offset, lin))
+			return false;
+	}
+	if (!EVP_EncryptFinal_ex(ctx, text + isize, &lout))
+		return false;
+	return EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, (int)kTagSize, text + isize) == 1;
+}
+bool SymmetricEncryptImp_AEAD::DecryptMessage(const unsigned char *in, size_t isize, unsigned char *out)
+{
+	if (isize < kNonceSize + kTagSize)
+		return false;
+	auto ctx = PrepareContext(false, in);
+	if (ctx == nullptr)
+		return false;
+	size_t text_size = isize - kNonceSize - kTagSize;
+	const unsigned char *text = in + kNonceSize;
+	unsigned char tag[kTagSize];
+	memcpy(tag, text + text_size, kTagSize);
+	if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, (int)kTagSize, tag))
+		return false;
+	// The output may not overlap the input partially, so |out| is either
+	// apart from |text| or the same
+	int lout = 0;
+	for (size_t offset = 0; offset < text_size; offset += kMaxUpdateSize)
+	{
+		int lin = (int)std::min(text_size - offset, (size_t)kMaxUpdateSize);
+		if (!EVP_DecryptUpdate(ctx, out + offset, &lout, text + offset, lin))
+			return false;
+	}
+	// Fails if the tag does not match
+	return EVP_DecryptFinal_ex(ctx, out + text_size, &lout) == 1;
+}
+bool SymmetricEncryptImp_AEAD::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < MaxEncryptedSize(ssize))
+		return false;
+	if (!EncryptMessage((const unsigned char *)sdata, ssize, (unsigned char *)ddata))
+		return false;
+	dsize = MaxEncryptedSize(ssize);
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::Encrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	ddata.resize(MaxEncryptedSize(ssize));
+	if (!EncryptMessage((const unsigned char *)sdata, ssize, (unsigned char *)&ddata[0])) {
+		ddata.clear();
+		return false;
+	}
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::Encrypt(const std::string &sdata, std::string &ddata)
+{
+	return Encrypt(sdata.data(), sdata.size(), ddata);
+}
+bool SymmetricEncryptImp_AEAD::Encrypt(std::string &data)
+{
+	size_t isize = data.size();
+	data.resize(MaxEncryptedSize(isize));
+	unsigned char *buffer = (unsigned char *)&data[0];
+	if (!EncryptMessage(buffer, isize, buffer)) {
+		data.clear();
+		return false;
+	}
+	return true;
+}
+size_t SymmetricEncryptImp_AEAD::MaxDecryptedSize(size_t ssize) const
+{
+	return ssize > kNonceSize + kTagSize ? ssize - kNonceSize - kTagSize : 0;
+}
+bool SymmetricEncryptImp_AEAD::Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (ssize < kNonceSize + kTagSize || dsize < MaxDecryptedSize(ssize))
+		return false;
+	if (!DecryptMessage((const unsigned char *)sdata, ssize, (unsigned char *)ddata))
+		return false;
+	dsize = MaxDecryptedSize(ssize);
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::Decrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	if (ssize < kNonceSize + kTagSize)
+		return false;
+	// One more byte for an empty message
+	ddata.resize(MaxDecryptedSize(ssize) + 1);
+	if (!DecryptMessage((const unsigned char *)sdata, ssize, (unsigned char *)&ddata[0])) {
+		ddata.clear();
+		return false;
+	}
+	ddata.resize(MaxDecryptedSize(ssize));
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::Decrypt(const std::string &sdata, std::string &ddata)
+{
+	return Decrypt(sdata.data(), sdata.size(), ddata);
+}
+bool SymmetricEncryptImp_AEAD::Decrypt(std::string &data)
+{
+	size_t isize = data.size();
+	if (isize < kNonceSize + kTagSize)
+		return false;
+	// Decrypted at the place of the ciphertext, then moved to the front
+	unsigned char *buffer = (unsigned char *)&data[0];
+	if (!DecryptMessage(buffer, isize, buffer + kNonceSize)) {
+		data.clear();
+		return false;
+	}
+	data.erase(0, kNonceSize);
+	data.resize(MaxDecryptedSize(isize));
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::EncryptBegin()
+{
+	if (RAND_bytes(nonce_, sizeof(nonce_)) != 1 || PrepareContext(true, nonce_) == nullptr)
+		return false;
+	encrypt_streaming_ = true;
+	nonce_pending_ = true;
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	if (!encrypt_streaming_)
+		return false;
+	if (nonce_pending_) {
+		ddata.append((const char *)nonce_, kNonceSize);
+		nonce_pending_ = false;
+	}
+	return CipherUpdate(encrypt_ctx_, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_AEAD::EncryptFinal(std::string &ddata)
+{
+	if (!encrypt_streaming_)
+		return false;
+	encrypt_streaming_ = false;
+	if (nonce_pending_) {
+		ddata.append((const char *)nonce_, kNonceSize);
+		nonce_pending_ = false;
+	}
+	if (!CipherFinal(encrypt_ctx_, ddata))
+		return false;
+	unsigned char tag[kTagSize];
+	if (EVP_CIPHER_CTX_ctrl(encrypt_ctx_, EVP_CTRL_AEAD_GET_TAG, (int)kTagSize, tag) != 1)
+		return false;
+	ddata.append((const char *)tag, kTagSize);
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::DecryptBegin()
+{
+	decrypt_streaming_ = true;
+	nonce_read_ = false;
+	decrypt_pending_.clear();
+	return CreateChiper(method_) != nullptr;
+}
+bool SymmetricEncryptImp_AEAD::DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	if (!decrypt_streaming_)
+		return false;
+	const char *in = (const char *)sdata;
+	if (!nonce_read_) {
+		size_t take = std::min(kNonceSize - decrypt_pending_.size(), ssize);
+		decrypt_pending_.append(in, take);
+		in += take;
+		ssize -= take;
+		if (decrypt_pending_.size() < kNonceSize)
+			return true;
+		if (PrepareContext(false, (const unsigned char *)decrypt_pending_.data()) == nullptr)
+			return false;
+		// PrepareContext() has ended the message
+		decrypt_streaming_ = true;
+		nonce_read_ = true;
+		decrypt_pending_.clear();
+	}
+	// The last kTagSize bytes are kept, they may be the tag
+	if (decrypt_pending_.size() + ssize <= kTagSize) {
+		decrypt_pending_.append(in, ssize);
+		return true;
+	}
+	size_t release = decrypt_pending_.size() + ssize - kTagSize;
+	size_t from_pending = std::min(release, decrypt_pending_.size());
+	if (!CipherUpdate(decrypt_ctx_, decrypt_pending_.data(), from_pending, ddata))
+		return false;
+	decrypt_pending_.erase(0, from_pending);
+	size_t from_input = release - from_pending;
+	if (!CipherUpdate(decrypt_ctx_, in, from_input, ddata))
+		return false;
+	decrypt_pending_.append(in + from_input, ssize - from_input);
+	return true;
+}
+bool SymmetricEncryptImp_AEAD::DecryptFinal(std::string &ddata)
+{
+	if (!decrypt_streaming_)
+		return false;
+	decrypt_streaming_ = false;
+	if (!nonce_read_ || decrypt_pending_.size() != kTagSize)
+		return false;
+	if (!EVP_CIPHER_CTX_ctrl(decrypt_ctx_, EVP_CTRL_AEAD_SET_TAG, (int)kTagSize, &decrypt_pending_[0]))
+		return false;
+	decrypt_pending_.clear();
+	return CipherFinal(decrypt_ctx_, ddata);
+}
+bool SymmetricEncryptImp_AEAD::EncryptChunked(const void *sdata, size_t ssize, std::string &ddata,
+	uint32_t chunk_size, int threads)
+{
+	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return false;
+	return ChunkedEncryptUtli::Encrypt(chiper, (uint8_t)method_, ChiperKey(chiper), sdata, ssize, ddata,
+		chunk_size, threads);
+}
+bool SymmetricEncryptImp_AEAD::DecryptChunked(const void *sdata, size_t ssize, std::string &ddata, int threads)
+{
+	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return false;
+	return ChunkedEncryptUtli::Decrypt(chiper, (uint8_t)method_, ChiperKey(chiper), sdata, ssize, ddata, threads);
+}
+NIMENCRYPT_END_DECLS
@@ -0,0 +1,72 @@
+#ifndef COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_AEAD_H_
+#define COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_AEAD_H_
+
+#include "nim_encrypt/config/build_config.h"
+#include <openssl/evp.h>
+#include "nim_encrypt/encrypt/encrypt_impl.h"
+
+NIMENCRYPT_BEGIN_DECLS
+// AES-GCM and ChaCha20-Poly1305. Each message gets a random nonce, the
+// output is nonce + ciphertext + tag, so no separate MAC is needed.
+// The IV parameter spec and the padding are not used.
+// DecryptUpdate() returns data not authenticated until DecryptFinal().
+// The contexts keep the key schedule like SymmetricEncryptImp_Block.
+// Not thread safe, use one object per thread.
+class SymmetricEncryptImp_AEAD : public SymmetricEncryptBase
+{
+public:
+	static const size_t kNonceSize = 12;
+	static const size_t kTagSize = 16;
+
+	SymmetricEncryptImp_AEAD(EncryptMethod method);
+	~SymmetricEncryptImp_AEAD();
+	// True if the CPU supports the AES instructions (AES-NI, ARMv8 Crypto)
+	static bool HasAESHardware();
+public:
+	virtual bool Encrypt(std::string &data) override;
+	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override { return ssize + kNonceSize + kTagSize; }
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
+	virtual bool Decrypt(std::string &data) override;
+	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override;
+	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxDecryptedSize(size_t ssize) const override;
+	virtual bool DecryptBegin() override;
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool DecryptFinal(std::string &ddata) override;
+	// Encrypts by chunks on |threads| threads to the container of
+	// ChunkedEncryptUtli, for the buffers of hundreds of MB
+	bool EncryptChunked(const void *sdata, size_t ssize, std::string &ddata, uint32_t chunk_size, int threads);
+	bool DecryptChunked(const void *sdata, size_t ssize, std::string &ddata, int threads);
+protected:
+	virtual void OnSetKey() override { FreeContexts(); }
+private:
+	static const EVP_CIPHER* CreateChiper(EncryptMethod method);
+	std::string ChiperKey(const EVP_CIPHER *chiper) const;
+	// Returns the context ready for a message of |nonce|, nullptr if failed
+	EVP_CIPHER_CTX* PrepareContext(bool encrypt, const unsigned char *nonce);
+	void FreeContexts();
+	// |in| may be |out|, never ahead of it
+	bool EncryptMessage(const unsigned char *in, size_t isize, unsigned char *out);
+	bool DecryptMessage(const unsigned char *in, size_t isize, unsigned char *out);
+private:
+	EVP_CIPHER_CTX *encrypt_ctx_;
+	EVP_CIPHER_CTX *decrypt_ctx_;
+	bool encrypt_streaming_;
+	bool decrypt_streaming_;
+	// Not written to the output of the streaming encryption yet
+	bool nonce_pending_;
+	unsigned char nonce_[kNonceSize];
+	// The nonce, then the last bytes which may be the tag, of the streaming
+	// decryption
+	bool nonce_read_;
+	std::string decrypt_pending_;
+};
+NIMENCRYPT_END_DECLS
+
+#endif//COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_AEAD_H_
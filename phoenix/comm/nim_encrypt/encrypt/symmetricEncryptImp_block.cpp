@@ -1,14 +1,20 @@
 #include "nim_encrypt/encrypt/symmetricEncryptImp_block.h"
+#include <algorithm>
 
 NIMENCRYPT_BEGIN_DECLS
+namespace {
+// EVP_CipherUpdate() takes an int size, a multiple of the block sizes
+const size_t kMaxUpdateSize = 1 << 30;
+}
 SymmetricEncryptImp_Block::SymmetricEncryptImp_Block(EncryptMethod method) :
-	SymmetricEncryptBase(method)
+	SymmetricEncryptBase(method), encrypt_ctx_(nullptr), decrypt_ctx_(nullptr),
+	encrypt_streaming_(false), decrypt_streaming_(false)
 {
 
 }
 SymmetricEncryptImp_Block::~SymmetricEncryptImp_Block()
 {
-
+	FreeContexts();
 }
 const EVP_CIPHER* SymmetricEncryptImp_Block::CreateChiper(EncryptMethod method)
 {
@@ -35,96 +41,178 @@ const EVP_CIPHER* SymmetricEncryptImp_Block::CreateChiper(EncryptMethod method)
 	}
 	return nullptr;
 }
-bool SymmetricEncryptImp_Block::Encrypt(std::string &data)
-{
-	std::string src = data;
-	return Encrypt(src.data(), src.size(), data);
-}
-bool SymmetricEncryptImp_Block::Decrypt(std::string &data)
+void SymmetricEncryptImp_Block::FreeContexts()
 {
-	std::string src = data;
-	return Decrypt(src.data(), src.size(), data);
+	encrypt_streaming_ = false;
+	decrypt_streaming_ = false;
+	if (encrypt_ctx_ != nullptr) {
+		EVP_CIPHER_CTX_free(encrypt_ctx_);
+		encrypt_ctx_ = nullptr;
+	}
+	if (decrypt_ctx_ != nullptr) {
+		EVP_CIPHER_CTX_free(decrypt_ctx_);
+		decrypt_ctx_ = nullptr;
+	}
 }
-bool SymmetricEncryptImp_Block::Encrypt(const void *sdata, size_t ssize, std::string &ddata)
+EVP_CIPHER_CTX* SymmetricEncryptImp_Block::PrepareContext(bool encrypt)
 {
+	EVP_CIPHER_CTX *&ctx = encrypt ? encrypt_ctx_ : decrypt_ctx_;
+	(encrypt ? encrypt_streaming_ : decrypt_streaming_) = false;
+	const unsigned char *iv = iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str();
+	// Without the cipher and the key only the IV and the buffered data are reset
+	if (ctx != nullptr && EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, iv, encrypt ? 1 : 0))
+		return ctx;
+	if (ctx != nullptr) {
+		EVP_CIPHER_CTX_free(ctx);
+		ctx = nullptr;
+	}
 	auto chiper = CreateChiper(method_);
-	if (!ddata.empty())
-		ddata.clear();
-	auto ctx = EVP_CIPHER_CTX_new();
-	if (!EVP_EncryptInit(ctx, chiper, (const unsigned char*)key_.c_str(), (iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str()))) {
+	if (chiper == nullptr)
+		return nullptr;
+	ctx = EVP_CIPHER_CTX_new();
+	if (ctx == nullptr)
+		return nullptr;
+	if (!EVP_CipherInit_ex(ctx, chiper, nullptr, (const unsigned char*)key_.c_str(), iv, encrypt ? 1 : 0)) {
 		EVP_CIPHER_CTX_free(ctx);
-		return 0;
+		ctx = nullptr;
+		return nullptr;
 	}
-	unsigned char out[256];
 	if (enable_padding_)
 		EVP_CIPHER_CTX_set_padding(ctx, padding_mode_);
-	uint32_t osize = sizeof(out);
-	int block_size = EVP_CIPHER_block_size(chiper);
-	if (block_size > 0)
-		osize = (sizeof(out) / block_size) * block_size;
-	uint32_t block = ((uint32_t)ssize + osize - 1) / osize;
-	uint32_t elen = 0;
-	int      lout;
-	for (uint32_t i = 0; i < block; i++)
+	return ctx;
+}
+size_t SymmetricEncryptImp_Block::MaxEncryptedSize(size_t ssize) const
+{
+	auto chiper = CreateChiper(method_);
+	return chiper == nullptr ? 0 : ssize + EVP_CIPHER_block_size(chiper);
+}
+size_t SymmetricEncryptImp_Block::MaxDecryptedSize(size_t ssize) const
+{
+	// EVP_DecryptUpdate() may write a block more than it is given
+	return MaxEncryptedSize(ssize);
+}
+bool SymmetricEncryptImp_Block::Transform(bool encrypt, const unsigned char *in, size_t isize, unsigned char *out, size_t &osize)
+{
+	auto ctx = PrepareContext(encrypt);
+	if (ctx == nullptr)
+		return false;
+	// In place the output never passes the input, as EVP requires
+	size_t offset = 0;
+	size_t written = 0;
+	int lout = 0;
+	do
 	{
-		int lin = ((uint32_t)ssize - elen) > osize ? osize : (uint32_t)ssize - elen;
-		if (!EVP_EncryptUpdate(ctx, out, &lout, ((const unsigned char*)sdata) + elen, lin))
-		{
-			EVP_CIPHER_CTX_free(ctx);
+		int lin = (int)std::min(isize - offset, kMaxUpdateSize);
+		if (!EVP_CipherUpdate(ctx, out + written, &lout, in + offset, lin))
 			return false;
-		}		
-		elen += lin;
-		ddata.append((const char *)out, lout);
-	}
-	if (!EVP_EncryptFinal(ctx, out, &lout))
-	{
-		EVP_CIPHER_CTX_free(ctx);
-		return 0;
-	}
-	ddata.append((const char *)out, lout);
-	EVP_CIPHER_CTX_free(ctx);
+		offset += lin;
+		written += lout;
+	} while (offset < isize);
+	if (!EVP_CipherFinal_ex(ctx, out + written, &lout))
+		return false;
+	osize = written + lout;
 	return true;
 }
-bool SymmetricEncryptImp_Block::Decrypt(const void *sdata, size_t ssize, std::string &ddata)
+bool SymmetricEncryptImp_Block::Transform(bool encrypt, const void *sdata, size_t ssize, std::string &ddata)
 {
-	auto chiper = CreateChiper(method_);
-	if (!ddata.empty())
+	// The capacity of |ddata| is reused, it is not cleared first
+	size_t osize = encrypt ? MaxEncryptedSize(ssize) : MaxDecryptedSize(ssize);
+	ddata.resize(osize);
+	if (osize == 0 || !Transform(encrypt, (const unsigned char*)sdata, ssize, (unsigned char*)&ddata[0], osize)) {
 		ddata.clear();
-	auto ctx = EVP_CIPHER_CTX_new();
-	if (!EVP_DecryptInit(ctx, chiper, (const unsigned char*)key_.c_str(), (iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str()))) {
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
-	if (enable_padding_)
-		EVP_CIPHER_CTX_set_padding(ctx, padding_mode_);
-	unsigned char out[256];
-	uint32_t      osize = sizeof(out); 
-	int block_size = EVP_CIPHER_block_size(chiper);
-	if (block_size > 0)
-		osize = (sizeof(out) / block_size - 1) * block_size;
-	uint32_t block = ((uint32_t)ssize + osize - 1) / osize;
-	uint32_t elen = 0;
-	int      lout;
-	for (uint32_t i = 0; i < block; i++)
-	{
-		int lin = (uint32_t)ssize - elen > osize ? osize : ((uint32_t)ssize - elen);
-		if (!EVP_DecryptUpdate(ctx, out, &lout, ((const unsigned char*)sdata) + elen, lin))
-		{
-			EVP_CIPHER_CTX_free(ctx);
-			return false;
-		}
-		elen += lin;
-		ddata.append((const char *)out, lout);
-	}
-	if (!EVP_DecryptFinal(ctx, out, &lout))
-	{
-		EVP_CIPHER_CTX_free(ctx);
+	ddata.resize(osize);
+	return true;
+}
+bool SymmetricEncryptImp_Block::TransformInPlace(bool encrypt, std::string &data)
+{
+	size_t isize = data.size();
+	size_t osize = encrypt ? MaxEncryptedSize(isize) : MaxDecryptedSize(isize);
+	if (osize == 0)
+		return false;
+	data.resize(osize);
+	unsigned char *buffer = (unsigned char*)&data[0];
+	if (!Transform(encrypt, buffer, isize, buffer, osize)) {
+		data.clear();
 		return false;
 	}
-	ddata.append((const char *)out, lout);
-	EVP_CIPHER_CTX_free(ctx);
+	data.resize(osize);
 	return true;
 }
+bool SymmetricEncryptImp_Block::StreamBegin(bool encrypt)
+{
+	if (PrepareContext(encrypt) == nullptr)
+		return false;
+	(encrypt ? encrypt_streaming_ : decrypt_streaming_) = true;
+	return true;
+}
+bool SymmetricEncryptImp_Block::StreamUpdate(bool encrypt, const void *sdata, size_t ssize, std::string &ddata)
+{
+	if (!(encrypt ? encrypt_streaming_ : decrypt_streaming_))
+		return false;
+	return CipherUpdate(encrypt ? encrypt_ctx_ : decrypt_ctx_, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Block::StreamFinal(bool encrypt, std::string &ddata)
+{
+	bool &streaming = encrypt ? encrypt_streaming_ : decrypt_streaming_;
+	if (!streaming)
+		return false;
+	streaming = false;
+	return CipherFinal(encrypt ? encrypt_ctx_ : decrypt_ctx_, ddata);
+}
+bool SymmetricEncryptImp_Block::EncryptBegin()
+{
+	return StreamBegin(true);
+}
+bool SymmetricEncryptImp_Block::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return StreamUpdate(true, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Block::EncryptFinal(std::string &ddata)
+{
+	return StreamFinal(true, ddata);
+}
+bool SymmetricEncryptImp_Block::DecryptBegin()
+{
+	return StreamBegin(false);
+}
+bool SymmetricEncryptImp_Block::DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return StreamUpdate(false, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Block::DecryptFinal(std::string &ddata)
+{
+	return StreamFinal(false, ddata);
+}
+bool SymmetricEncryptImp_Block::Encrypt(std::string &data)
+{
+	return TransformInPlace(true, data);
+}
+bool SymmetricEncryptImp_Block::Decrypt(std::string &data)
+{
+	return TransformInPlace(false, data);
+}
+bool SymmetricEncryptImp_Block::Encrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return Transform(true, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Block::Decrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return Transform(false, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Block::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < MaxEncryptedSize(ssize))
+		return false;
+	return Transform(true, (const unsigned char*)sdata, ssize, (unsigned char*)ddata, dsize);
+}
+bool SymmetricEncryptImp_Block::Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < MaxDecryptedSize(ssize))
+		return false;
+	return Transform(false, (const unsigned char*)sdata, ssize, (unsigned char*)ddata, dsize);
+}
 bool SymmetricEncryptImp_Block::Encrypt(const std::string &sdata, std::string &ddata)
 {
 	return Encrypt(sdata.data(), sdata.size(), ddata);
@@ -134,4 +222,4 @@ bool SymmetricEncryptImp_Block::Decrypt(const std::string &sdata, std::string &d
 	return Decrypt(sdata.data(), sdata.size(), ddata);
 }
 
-NIMENCRYPT_END_DECLS
\ No newline at end of file
+NIMENCRYPT_END_DECLS
@@ -6,6 +6,9 @@
 #include "nim_encrypt/encrypt/encrypt_impl.h"
 
 NIMENCRYPT_BEGIN_DECLS
+// The cipher contexts are initialized once for the key, the IV and the
+// padding, each message only resets them, so the key is not expanded again.
+// Not thread safe, use one object per thread.
 class SymmetricEncryptImp_Block : public SymmetricEncryptBase
 {
 public:
@@ -15,11 +18,41 @@ public:
 	virtual bool Encrypt(std::string &data) override;
 	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override;
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
 	virtual bool Decrypt(std::string &data) override;
 	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxDecryptedSize(size_t ssize) const override;
+	virtual bool DecryptBegin() override;
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool DecryptFinal(std::string &ddata) override;
+protected:
+	virtual void OnSetKey() override { FreeContexts(); }
+	virtual void OnSetIvParameterSpec() override { FreeContexts(); }
+	virtual void OnSetPadding() override { FreeContexts(); }
 private:
 	static const EVP_CIPHER* CreateChiper(EncryptMethod method);
+	// Returns the context ready for a message, nullptr if failed
+	EVP_CIPHER_CTX* PrepareContext(bool encrypt);
+	void FreeContexts();
+	// |out| has MaxEncryptedSize() or MaxDecryptedSize() bytes, it may be |in|
+	bool Transform(bool encrypt, const unsigned char *in, size_t isize, unsigned char *out, size_t &osize);
+	bool Transform(bool encrypt, const void *sdata, size_t ssize, std::string &ddata);
+	bool TransformInPlace(bool encrypt, std::string &data);
+	bool StreamBegin(bool encrypt);
+	bool StreamUpdate(bool encrypt, const void *sdata, size_t ssize, std::string &ddata);
+	bool StreamFinal(bool encrypt, std::string &ddata);
+private:
+	EVP_CIPHER_CTX *encrypt_ctx_;
+	EVP_CIPHER_CTX *decrypt_ctx_;
+	// Between Begin() and Final() of a message
+	bool encrypt_streaming_;
+	bool decrypt_streaming_;
 };
 NIMENCRYPT_END_DECLS
 
@@ -3,13 +3,14 @@
 NIMENCRYPT_BEGIN_DECLS
 
 SymmetricEncryptImp_Hash::SymmetricEncryptImp_Hash(EncryptMethod method) :
-	SymmetricEncryptBase(method)
+	SymmetricEncryptBase(method), md_ctx_(nullptr)
 {
 
 }
 SymmetricEncryptImp_Hash::~SymmetricEncryptImp_Hash()
 {
-
+	if (md_ctx_ != nullptr)
+		EVP_MD_CTX_free(md_ctx_);
 }
 const EVP_MD* SymmetricEncryptImp_Hash::CreateMD(EncryptMethod method)
 {
@@ -23,6 +24,8 @@ const EVP_MD* SymmetricEncryptImp_Hash::CreateMD(EncryptMethod method)
 		return EVP_sha1();
 	case EncryptMethod::ENC_SM3:
 		return EVP_sm3();
+	case EncryptMethod::ENC_SHA256:
+		return EVP_sha256();
 	default:
 		return nullptr;
 	}
@@ -90,4 +93,58 @@ bool SymmetricEncryptImp_Hash::Decrypt(const void *sdata, size_t ssize, std::str
 {
 	return false;
 }
+size_t SymmetricEncryptImp_Hash::MaxEncryptedSize(size_t ssize) const
+{
+	auto md = CreateMD(method_);
+	return md == nullptr ? 0 : (size_t)EVP_MD_size(md);
+}
+bool SymmetricEncryptImp_Hash::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	auto md = CreateMD(method_);
+	if (md == nullptr || dsize < (size_t)EVP_MD_size(md))
+		return false;
+	unsigned int olen = 0;
+	if (!EVP_Digest(sdata, ssize, (unsigned char *)ddata, &olen, md, NULL))
+		return false;
+	dsize = olen;
+	return true;
+}
+bool SymmetricEncryptImp_Hash::Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	return false;
+}
+bool SymmetricEncryptImp_Hash::EncryptBegin()
+{
+	auto md = CreateMD(method_);
+	if (md == nullptr)
+		return false;
+	if (md_ctx_ == nullptr)
+		md_ctx_ = EVP_MD_CTX_new();
+	if (md_ctx_ == nullptr)
+		return false;
+	if (!EVP_DigestInit_ex(md_ctx_, md, NULL))
+	{
+		EVP_MD_CTX_free(md_ctx_);
+		md_ctx_ = nullptr;
+		return false;
+	}
+	return true;
+}
+bool SymmetricEncryptImp_Hash::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return md_ctx_ != nullptr && EVP_DigestUpdate(md_ctx_, sdata, ssize);
+}
+bool SymmetricEncryptImp_Hash::EncryptFinal(std::string &ddata)
+{
+	if (md_ctx_ == nullptr)
+		return false;
+	unsigned char obuf[EVP_MAX_MD_SIZE];
+	unsigned int olen = 0;
+	bool ret = EVP_DigestFinal_ex(md_ctx_, obuf, &olen) != 0;
+	if (ret)
+		ddata.append((const char *)obuf, olen);
+	EVP_MD_CTX_free(md_ctx_);
+	md_ctx_ = nullptr;
+	return ret;
+}
 NIMENCRYPT_END_DECLS
\ No newline at end of file
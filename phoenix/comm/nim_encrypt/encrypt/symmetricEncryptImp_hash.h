@@ -15,11 +15,24 @@ public:
 	virtual bool Encrypt(std::string &data) override;
 	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override;
+	// The digest of the parts is appended by EncryptFinal()
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
 	virtual bool Decrypt(std::string &data) override;
 	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxDecryptedSize(size_t ssize) const override { return 0; }
+	virtual bool DecryptBegin() override { return false; }
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override { return false; }
+	virtual bool DecryptFinal(std::string &ddata) override { return false; }
 private:
 	static const EVP_MD* CreateMD(EncryptMethod method);
+private:
+	EVP_MD_CTX *md_ctx_;
 };
 NIMENCRYPT_END_DECLS
 
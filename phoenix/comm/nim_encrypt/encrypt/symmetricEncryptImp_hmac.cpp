@@ -0,0 +1,151 @@
+#include "nim_encrypt/encrypt/symmetricEncryptImp_hmac.h"
+#include <cstring>
+#include <openssl/crypto.h>
+
+NIMENCRYPT_BEGIN_DECLS
+namespace {
+const unsigned char kInnerPad = 0x36;
+const unsigned char kOuterPad = 0x5C;
+// The block sizes of SHA-1, SHA-256 and SM3 are 64
+const size_t kMaxBlockSize = 128;
+}
+
+SymmetricEncryptImp_HMAC::SymmetricEncryptImp_HMAC(EncryptMethod method) :
+	SymmetricEncryptBase(method), md_(CreateMD(method)), keyed_(false), streaming_(false),
+	inner_ctx_(nullptr), outer_ctx_(nullptr), work_ctx_(nullptr)
+{
+
+}
+SymmetricEncryptImp_HMAC::~SymmetricEncryptImp_HMAC()
+{
+	if (inner_ctx_ != nullptr)
+		EVP_MD_CTX_free(inner_ctx_);
+	if (outer_ctx_ != nullptr)
+		EVP_MD_CTX_free(outer_ctx_);
+	if (work_ctx_ != nullptr)
+		EVP_MD_CTX_free(work_ctx_);
+}
+const EVP_MD* SymmetricEncryptImp_HMAC::CreateMD(EncryptMethod method)
+{
+	switch (method)
+	{
+	case EncryptMethod::ENC_HMAC_SHA1:
+		return EVP_sha1();
+	case EncryptMethod::ENC_HMAC_SHA256:
+		return EVP_sha256();
+	case EncryptMethod::ENC_HMAC_SM3:
+		return EVP_sm3();
+	default:
+		return nullptr;
+	}
+}
+bool SymmetricEncryptImp_HMAC::PrepareKey()
+{
+	if (keyed_)
+		return true;
+	if (md_ == nullptr)
+		return false;
+	size_t block_size = (size_t)EVP_MD_block_size(md_);
+	if (block_size == 0 || block_size > kMaxBlockSize)
+		return false;
+	if (inner_ctx_ == nullptr)
+		inner_ctx_ = EVP_MD_CTX_new();
+	if (outer_ctx_ == nullptr)
+		outer_ctx_ = EVP_MD_CTX_new();
+	if (work_ctx_ == nullptr)
+		work_ctx_ = EVP_MD_CTX_new();
+	if (inner_ctx_ == nullptr || outer_ctx_ == nullptr || work_ctx_ == nullptr)
+		return false;
+	// A key longer than a block is replaced by its digest
+	unsigned char block[kMaxBlockSize] = { 0 };
+	if (key_.size() > block_size) {
+		unsigned int digest_size = 0;
+		if (!EVP_Digest(key_.data(), key_.size(), block, &digest_size, md_, nullptr))
+			return false;
+	}
+	else if (!key_.empty()) {
+		memcpy(block, key_.data(), key_.size());
+	}
+	unsigned char inner[kMaxBlockSize];
+	unsigned char outer[kMaxBlockSize];
+	for (size_t i = 0; i < block_size; i++)
+	{
+		inner[i] = block[i] ^ kInnerPad;
+		outer[i] = block[i] ^ kOuterPad;
+	}
+	bool ret = EVP_DigestInit_ex(inner_ctx_, md_, nullptr)
+		&& EVP_DigestUpdate(inner_ctx_, inner, block_size)
+		&& EVP_DigestInit_ex(outer_ctx_, md_, nullptr)
+		&& EVP_DigestUpdate(outer_ctx_, outer, block_size);
+	OPENSSL_cleanse(block, sizeof(block));
+	OPENSSL_cleanse(inner, sizeof(inner));
+	OPENSSL_cleanse(outer, sizeof(outer));
+	keyed_ = ret;
+	return ret;
+}
+bool SymmetricEncryptImp_HMAC::FinishMac(unsigned char *mac, unsigned int &mac_size)
+{
+	unsigned char inner_digest[EVP_MAX_MD_SIZE];
+	unsigned int inner_size = 0;
+	return EVP_DigestFinal_ex(work_ctx_, inner_digest, &inner_size)
+		&& EVP_MD_CTX_copy_ex(work_ctx_, outer_ctx_)
+		&& EVP_DigestUpdate(work_ctx_, inner_digest, inner_size)
+		&& EVP_DigestFinal_ex(work_ctx_, mac, &mac_size);
+}
+bool SymmetricEncryptImp_HMAC::Encrypt(std::string &data)
+{
+	std::string src = data;
+	return Encrypt(src.data(), src.size(), data);
+}
+bool SymmetricEncryptImp_HMAC::Encrypt(const std::string &sdata, std::string &ddata)
+{
+	return Encrypt(sdata.data(), sdata.size(), ddata);
+}
+bool SymmetricEncryptImp_HMAC::Encrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	ddata.clear();
+	unsigned char mac[EVP_MAX_MD_SIZE];
+	size_t mac_size = sizeof(mac);
+	if (!Encrypt(sdata, ssize, mac, mac_size))
+		return false;
+	ddata.append((const char *)mac, mac_size);
+	return true;
+}
+bool SymmetricEncryptImp_HMAC::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (streaming_ || !PrepareKey() || dsize < (size_t)EVP_MD_size(md_))
+		return false;
+	unsigned int mac_size = 0;
+	if (!EVP_MD_CTX_copy_ex(work_ctx_, inner_ctx_)
+		|| !EVP_DigestUpdate(work_ctx_, sdata, ssize)
+		|| !FinishMac((unsigned char *)ddata, mac_size))
+		return false;
+	dsize = mac_size;
+	return true;
+}
+size_t SymmetricEncryptImp_HMAC::MaxEncryptedSize(size_t ssize) const
+{
+	return md_ == nullptr ? 0 : (size_t)EVP_MD_size(md_);
+}
+bool SymmetricEncryptImp_HMAC::EncryptBegin()
+{
+	streaming_ = PrepareKey() && EVP_MD_CTX_copy_ex(work_ctx_, inner_ctx_);
+	return streaming_;
+}
+bool SymmetricEncryptImp_HMAC::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return streaming_ && EVP_DigestUpdate(work_ctx_, sdata, ssize);
+}
+bool SymmetricEncryptImp_HMAC::EncryptFinal(std::string &ddata)
+{
+	if (!streaming_)
+		return false;
+	streaming_ = false;
+	unsigned char mac[EVP_MAX_MD_SIZE];
+	unsigned int mac_size = 0;
+	if (!FinishMac(mac, mac_size))
+		return false;
+	ddata.append((const char *)mac, mac_size);
+	return true;
+}
+NIMENCRYPT_END_DECLS
@@ -0,0 +1,57 @@
+#ifndef COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_HMAC_H_
+#define COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_HMAC_H_
+
+#include "nim_encrypt/config/build_config.h"
+#include <openssl/evp.h>
+#include "nim_encrypt/encrypt/encrypt_impl.h"
+
+NIMENCRYPT_BEGIN_DECLS
+// HMAC-SHA1, HMAC-SHA256 and HMAC-SM3 (RFC 2104) of the key set by SetKey().
+// The digest states after the inner and the outer padded keys are computed
+// once per key, each message copies them instead of hashing the key again,
+// so a short message costs the hash of itself and of one digest.
+// The key is used as it is, not expanded. Not thread safe, use one object
+// per thread.
+class SymmetricEncryptImp_HMAC : public SymmetricEncryptBase
+{
+public:
+	SymmetricEncryptImp_HMAC(EncryptMethod method);
+	~SymmetricEncryptImp_HMAC();
+public:
+	virtual bool Encrypt(std::string &data) override;
+	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override;
+	// The MAC of the parts is appended by EncryptFinal()
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
+	virtual bool Decrypt(std::string &data) override { return false; }
+	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override { return false; }
+	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override { return false; }
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override { return false; }
+	virtual size_t MaxDecryptedSize(size_t ssize) const override { return 0; }
+	virtual bool DecryptBegin() override { return false; }
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override { return false; }
+	virtual bool DecryptFinal(std::string &ddata) override { return false; }
+protected:
+	virtual void OnSetKey() override { keyed_ = false; }
+private:
+	static const EVP_MD* CreateMD(EncryptMethod method);
+	// Computes the padded key states of the key if not yet
+	bool PrepareKey();
+	// Finishes the message hashed by |work_ctx_| to the MAC in |mac|
+	bool FinishMac(unsigned char *mac, unsigned int &mac_size);
+private:
+	const EVP_MD *md_;
+	bool keyed_;
+	bool streaming_;
+	// The states after hashing key ^ ipad and key ^ opad
+	EVP_MD_CTX *inner_ctx_;
+	EVP_MD_CTX *outer_ctx_;
+	EVP_MD_CTX *work_ctx_;
+};
+NIMENCRYPT_END_DECLS
+
+#endif//COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_HMAC_H_
@@ -1,13 +1,16 @@
 #include "nim_encrypt/encrypt/symmetricEncryptImp_stream.h"
 NIMENCRYPT_BEGIN_DECLS
 SymmetricEncryptImp_Stream::SymmetricEncryptImp_Stream(EncryptMethod method) :
-	SymmetricEncryptBase(method)
+	SymmetricEncryptBase(method), encrypt_ctx_(nullptr), decrypt_ctx_(nullptr)
 {
 
 }
 SymmetricEncryptImp_Stream::~SymmetricEncryptImp_Stream()
 {
-
+	if (encrypt_ctx_ != nullptr)
+		EVP_CIPHER_CTX_free(encrypt_ctx_);
+	if (decrypt_ctx_ != nullptr)
+		EVP_CIPHER_CTX_free(decrypt_ctx_);
 }
 const EVP_CIPHER* SymmetricEncryptImp_Stream::CreateChiper(EncryptMethod method)
 {
@@ -45,7 +48,7 @@ bool SymmetricEncryptImp_Stream::Encrypt(const void *sdata, size_t isize, std::s
 	size_t sz = Encrypt((const char *)sdata, isize, ptr, osize);
 	if (ddata.size() > osize)
 		ddata.resize(osize);
-	return true;
+	return isize == 0 || sz > 0;
 }
 bool SymmetricEncryptImp_Stream::Decrypt(const void *sdata, size_t isize, std::string &ddata)
 {
@@ -56,7 +59,21 @@ bool SymmetricEncryptImp_Stream::Decrypt(const void *sdata, size_t isize, std::s
 	size_t sz = Decrypt((const char *)sdata, isize, ptr, osize);
 	if (ddata.size() > osize)
 		ddata.resize(osize);
-	return true;
+	return isize == 0 || sz > 0;
+}
+bool SymmetricEncryptImp_Stream::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < EncodeSize(ssize))
+		return false;
+	dsize = Encrypt((const char *)sdata, ssize, (char *)ddata, dsize);
+	return ssize == 0 || dsize > 0;
+}
+bool SymmetricEncryptImp_Stream::Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < DecodeSize(ssize))
+		return false;
+	dsize = Decrypt((const char *)sdata, ssize, (char *)ddata, dsize);
+	return ssize == 0 || dsize > 0;
 }
 bool SymmetricEncryptImp_Stream::Encrypt(const std::string &sdata, std::string &ddata)
 {
@@ -71,18 +88,27 @@ size_t SymmetricEncryptImp_Stream::Encrypt(const char *ibuf, size_t isize, char
 	if (isize == 0)
 		return 0;
 	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return 0;
 	ExpandKey(EVP_CIPHER_key_length(chiper), key_);
 	auto ctx = EVP_CIPHER_CTX_new();
+	if (ctx == nullptr)
+		return 0;
 	if (!EVP_EncryptInit(ctx, chiper, (const unsigned char*)key_.c_str(), (iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str())))
+	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
+	}
 	int lout;
 	if (!EVP_EncryptUpdate(ctx, (unsigned char *)obuf, &lout, (const unsigned char *)ibuf, (int)isize))
 	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
 	}
 	size_t osize = lout;
 	if (!EVP_EncryptFinal(ctx, (unsigned char *)&obuf[lout], &lout))
 	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
 	}
 	osize += (size_t)lout;
@@ -94,22 +120,85 @@ size_t SymmetricEncryptImp_Stream::Decrypt(const char *ibuf, size_t isize, char
 	if (isize == 0)
 		return 0;
 	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return 0;
 	ExpandKey(EVP_CIPHER_key_length(chiper), key_);
 	auto ctx = EVP_CIPHER_CTX_new();
+	if (ctx == nullptr)
+		return 0;
 	if (!EVP_DecryptInit(ctx, chiper, (const unsigned char*)key_.c_str(), (iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str())))
+	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
+	}
 	int lout;
 	if (!EVP_DecryptUpdate(ctx, (unsigned char *)obuf, &lout, (const unsigned char *)ibuf, (int)isize))
 	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
 	}
 	size_t osize = (size_t)lout;
 	if (!EVP_DecryptFinal(ctx, (unsigned char *)&obuf[lout], &lout))
 	{
+		EVP_CIPHER_CTX_free(ctx);
 		return 0;
 	}
 	osize += (size_t)lout;
 	EVP_CIPHER_CTX_free(ctx);
 	return osize;
 }
+EVP_CIPHER_CTX* SymmetricEncryptImp_Stream::StreamBegin(bool encrypt)
+{
+	EVP_CIPHER_CTX *&ctx = encrypt ? encrypt_ctx_ : decrypt_ctx_;
+	auto chiper = CreateChiper(method_);
+	if (chiper == nullptr)
+		return nullptr;
+	ExpandKey(EVP_CIPHER_key_length(chiper), key_);
+	if (ctx == nullptr)
+		ctx = EVP_CIPHER_CTX_new();
+	else
+		EVP_CIPHER_CTX_reset(ctx);
+	if (ctx == nullptr)
+		return nullptr;
+	if (!EVP_CipherInit_ex(ctx, chiper, nullptr, (const unsigned char*)key_.c_str(),
+		(iv_parameter_spec_.empty() ? nullptr : (const unsigned char*)iv_parameter_spec_.c_str()), encrypt ? 1 : 0))
+	{
+		EVP_CIPHER_CTX_free(ctx);
+		ctx = nullptr;
+	}
+	return ctx;
+}
+bool SymmetricEncryptImp_Stream::StreamFinal(EVP_CIPHER_CTX *&ctx, std::string &ddata)
+{
+	if (ctx == nullptr)
+		return false;
+	bool ret = CipherFinal(ctx, ddata);
+	EVP_CIPHER_CTX_free(ctx);
+	ctx = nullptr;
+	return ret;
+}
+bool SymmetricEncryptImp_Stream::EncryptBegin()
+{
+	return StreamBegin(true) != nullptr;
+}
+bool SymmetricEncryptImp_Stream::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return encrypt_ctx_ != nullptr && CipherUpdate(encrypt_ctx_, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Stream::EncryptFinal(std::string &ddata)
+{
+	return StreamFinal(encrypt_ctx_, ddata);
+}
+bool SymmetricEncryptImp_Stream::DecryptBegin()
+{
+	return StreamBegin(false) != nullptr;
+}
+bool SymmetricEncryptImp_Stream::DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	return decrypt_ctx_ != nullptr && CipherUpdate(decrypt_ctx_, sdata, ssize, ddata);
+}
+bool SymmetricEncryptImp_Stream::DecryptFinal(std::string &ddata)
+{
+	return StreamFinal(decrypt_ctx_, ddata);
+}
 NIMENCRYPT_END_DECLS
\ No newline at end of file
@@ -16,15 +16,31 @@ public:
 	virtual bool Encrypt(std::string &data) override;
 	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override { return ssize; }
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
 	virtual bool Decrypt(std::string &data) override;
 	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override;
 	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxDecryptedSize(size_t ssize) const override { return ssize; }
+	virtual bool DecryptBegin() override;
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool DecryptFinal(std::string &ddata) override;
 private:
 	static const EVP_CIPHER* CreateChiper(EncryptMethod method);
 	size_t EncodeSize(size_t size);
 	size_t DecodeSize(size_t size);
 	size_t Encrypt(const char *ibuf, size_t isize, char *obuf, size_t obsize);
 	size_t Decrypt(const char *ibuf, size_t isize, char *obuf, size_t obsize);
+	EVP_CIPHER_CTX* StreamBegin(bool encrypt);
+	bool StreamFinal(EVP_CIPHER_CTX *&ctx, std::string &ddata);
+private:
+	// The contexts of the messages being encrypted by parts
+	EVP_CIPHER_CTX *encrypt_ctx_;
+	EVP_CIPHER_CTX *decrypt_ctx_;
 };
 
 NIMENCRYPT_END_DECLS
@@ -0,0 +1,187 @@
+#include "nim_encrypt/encrypt/symmetricEncryptImp_xxhash.h"
+#include <cstring>
+
+NIMENCRYPT_BEGIN_DECLS
+namespace {
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+// Little endian whatever the CPU is, the data may be unaligned
+inline uint64_t Read64(const unsigned char *p)
+{
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+inline uint32_t Read32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+	acc += input * kPrime2;
+	acc = RotateLeft(acc, 31);
+	return acc * kPrime1;
+}
+inline uint64_t MergeRound(uint64_t acc, uint64_t value)
+{
+	acc ^= Round(0, value);
+	return acc * kPrime1 + kPrime4;
+}
+}
+SymmetricEncryptImp_XXHash::SymmetricEncryptImp_XXHash(EncryptMethod method) :
+	SymmetricEncryptBase(method), hashing_(false)
+{
+	Reset();
+}
+SymmetricEncryptImp_XXHash::~SymmetricEncryptImp_XXHash()
+{
+
+}
+void SymmetricEncryptImp_XXHash::Reset()
+{
+	total_size_ = 0;
+	acc_[0] = kPrime1 + kPrime2;
+	acc_[1] = kPrime2;
+	acc_[2] = 0;
+	acc_[3] = 0 - kPrime1;
+	buffer_size_ = 0;
+}
+void SymmetricEncryptImp_XXHash::Update(const unsigned char *data, size_t size)
+{
+	total_size_ += size;
+	if (buffer_size_ + size < sizeof(buffer_)) {
+		memcpy(buffer_ + buffer_size_, data, size);
+		buffer_size_ += size;
+		return;
+	}
+	if (buffer_size_ > 0) {
+		size_t fill = sizeof(buffer_) - buffer_size_;
+		memcpy(buffer_ + buffer_size_, data, fill);
+		for (int i = 0; i < 4; i++)
+			acc_[i] = Round(acc_[i], Read64(buffer_ + i * 8));
+		data += fill;
+		size -= fill;
+		buffer_size_ = 0;
+	}
+	const unsigned char *end = data + size;
+	uint64_t v1 = acc_[0], v2 = acc_[1], v3 = acc_[2], v4 = acc_[3];
+	while (end - data >= 32)
+	{
+		v1 = Round(v1, Read64(data));
+		v2 = Round(v2, Read64(data + 8));
+		v3 = Round(v3, Read64(data + 16));
+		v4 = Round(v4, Read64(data + 24));
+		data += 32;
+	}
+	acc_[0] = v1; acc_[1] = v2; acc_[2] = v3; acc_[3] = v4;
+	buffer_size_ = (size_t)(end - data);
+	memcpy(buffer_, data, buffer_size_);
+}
+uint64_t SymmetricEncryptImp_XXHash::Digest() const
+{
+	uint64_t hash = 0;
+	if (total_size_ >= 32) {
+		hash = RotateLeft(acc_[0], 1) + RotateLeft(acc_[1], 7) + RotateLeft(acc_[2], 12) + RotateLeft(acc_[3], 18);
+		for (int i = 0; i < 4; i++)
+			hash = MergeRound(hash, acc_[i]);
+	}
+	else {
+		hash = acc_[2] + kPrime5;
+	}
+	hash += total_size_;
+	const unsigned char *p = buffer_;
+	const unsigned char *end = buffer_ + buffer_size_;
+	while (end - p >= 8)
+	{
+		hash ^= Round(0, Read64(p));
+		hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+	if (end - p >= 4) {
+		hash ^= (uint64_t)Read32(p) * kPrime1;
+		hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		hash ^= (*p) * kPrime5;
+		hash = RotateLeft(hash, 11) * kPrime1;
+		p++;
+	}
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+void SymmetricEncryptImp_XXHash::ToBigEndian(uint64_t digest, unsigned char *out)
+{
+	for (int i = (int)kDigestSize - 1; i >= 0; i--)
+	{
+		out[i] = (unsigned char)(digest & 0xFF);
+		digest >>= 8;
+	}
+}
+bool SymmetricEncryptImp_XXHash::Encrypt(std::string &data)
+{
+	std::string src = data;
+	return Encrypt(src.data(), src.size(), data);
+}
+bool SymmetricEncryptImp_XXHash::Encrypt(const std::string &sdata, std::string &ddata)
+{
+	return Encrypt(sdata.data(), sdata.size(), ddata);
+}
+bool SymmetricEncryptImp_XXHash::Encrypt(const void *sdata, size_t ssize, std::string &ddata)
+{
+	ddata.resize(kDigestSize);
+	size_t dsize = kDigestSize;
+	return Encrypt(sdata, ssize, &ddata[0], dsize);
+}
+bool SymmetricEncryptImp_XXHash::Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize)
+{
+	if (dsize < kDigestSize)
+		return false;
+	// A whole buffer ends the message being hashed by parts
+	hashing_ = false;
+	Reset();
+	Update((const unsigned char *)sdata, ssize);
+	ToBigEndian(Digest(), (unsigned char *)ddata);
+	dsize = kDigestSize;
+	Reset();
+	return true;
+}
+bool SymmetricEncryptImp_XXHash::EncryptBegin()
+{
+	Reset();
+	hashing_ = true;
+	return true;
+}
+bool SymmetricEncryptImp_XXHash::EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata)
+{
+	if (!hashing_)
+		return false;
+	Update((const unsigned char *)sdata, ssize);
+	return true;
+}
+bool SymmetricEncryptImp_XXHash::EncryptFinal(std::string &ddata)
+{
+	if (!hashing_)
+		return false;
+	hashing_ = false;
+	unsigned char digest[kDigestSize];
+	ToBigEndian(Digest(), digest);
+	ddata.append((const char *)digest, kDigestSize);
+	Reset();
+	return true;
+}
+NIMENCRYPT_END_DECLS
@@ -0,0 +1,53 @@
+#ifndef COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_XXHASH_H_
+#define COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_XXHASH_H_
+
+#include "nim_encrypt/config/build_config.h"
+#include <stdint.h>
+#include "nim_encrypt/encrypt/encrypt_impl.h"
+
+NIMENCRYPT_BEGIN_DECLS
+// xxHash64 with the seed 0, the digest is 8 bytes big endian as the
+// canonical form of the reference implementation.
+// It is not cryptographic, use it only to compare the contents, e.g. to
+// find the duplicated files before uploading.
+class SymmetricEncryptImp_XXHash : public SymmetricEncryptBase
+{
+public:
+	static const size_t kDigestSize = 8;
+
+	SymmetricEncryptImp_XXHash(EncryptMethod method);
+	~SymmetricEncryptImp_XXHash();
+public:
+	virtual bool Encrypt(std::string &data) override;
+	virtual bool Encrypt(const std::string &sdata, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override;
+	virtual size_t MaxEncryptedSize(size_t ssize) const override { return kDigestSize; }
+	// The digest of the parts is appended by EncryptFinal()
+	virtual bool EncryptBegin() override;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override;
+	virtual bool EncryptFinal(std::string &ddata) override;
+	virtual bool Decrypt(std::string &data) override { return false; }
+	virtual bool Decrypt(const std::string &sdata, std::string &ddata) override { return false; }
+	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) override { return false; }
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) override { return false; }
+	virtual size_t MaxDecryptedSize(size_t ssize) const override { return 0; }
+	virtual bool DecryptBegin() override { return false; }
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) override { return false; }
+	virtual bool DecryptFinal(std::string &ddata) override { return false; }
+private:
+	void Reset();
+	void Update(const unsigned char *data, size_t size);
+	uint64_t Digest() const;
+	static void ToBigEndian(uint64_t digest, unsigned char *out);
+private:
+	bool hashing_;
+	uint64_t total_size_;
+	uint64_t acc_[4];
+	// The bytes after the last stripe of 32 bytes
+	unsigned char buffer_[32];
+	size_t buffer_size_;
+};
+NIMENCRYPT_END_DECLS
+
+#endif//COMM_NIM_ENCRYPT_ENCRYPT_SYMMETRICENCRYPTIMP_XXHASH_H_
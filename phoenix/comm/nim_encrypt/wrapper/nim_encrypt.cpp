@@ -1,10 +1,15 @@
 #include "nim_encrypt/wrapper/nim_encrypt.h"
 #include "nim_encrypt/encrypt/encrypt_utli.h"
+#include "nim_encrypt/encrypt/encrypt_file_utli.h"
+#include "nim_encrypt/encrypt/chunked_encrypt_utli.h"
 #include "nim_encrypt/encrypt/rsa_encrypt_imp.h"
 #include "nim_encrypt/encrypt/sm2_encrypt_imp.h"
 #include "nim_encrypt/encrypt/symmetricEncryptImp_block.h"
 #include "nim_encrypt/encrypt/symmetricEncryptImp_stream.h"
 #include "nim_encrypt/encrypt/symmetricEncryptImp_hash.h"
+#include "nim_encrypt/encrypt/symmetricEncryptImp_aead.h"
+#include "nim_encrypt/encrypt/symmetricEncryptImp_xxhash.h"
+#include "nim_encrypt/encrypt/symmetricEncryptImp_hmac.h"
 
 NIMENCRYPT_BEGIN_DECLS
 
@@ -13,6 +18,43 @@ std::string NIMEncrypt::BinaryToHexString(const std::string& binary)
 	return EncryptUtli::BinaryToHexString(binary);
 }
 
+bool NIMEncrypt::EncryptFileToFile(const SymmetricEncryptMethod& method, const std::string& src_path, const std::string& dst_path)
+{
+	return EncryptFileUtli::Transform(method.get(), true, src_path, dst_path);
+}
+
+bool NIMEncrypt::DecryptFileToFile(const SymmetricEncryptMethod& method, const std::string& src_path, const std::string& dst_path)
+{
+	return EncryptFileUtli::Transform(method.get(), false, src_path, dst_path);
+}
+
+bool NIMEncrypt::EncryptParallel(const SymmetricEncryptMethod& method, const void* sdata, size_t ssize, std::string& ddata, int threads)
+{
+	auto aead = std::dynamic_pointer_cast<SymmetricEncryptImp_AEAD>(method);
+	if (aead == nullptr)
+		return false;
+	return aead->EncryptChunked(sdata, ssize, ddata, ChunkedEncryptUtli::kDefaultChunkSize, threads);
+}
+
+bool NIMEncrypt::DecryptParallel(const SymmetricEncryptMethod& method, const void* sdata, size_t ssize, std::string& ddata, int threads)
+{
+	auto aead = std::dynamic_pointer_cast<SymmetricEncryptImp_AEAD>(method);
+	if (aead == nullptr)
+		return false;
+	return aead->DecryptChunked(sdata, ssize, ddata, threads);
+}
+
+bool NIMEncrypt::DigestFile(const SymmetricEncryptMethod& method, const std::string& file_path, std::string& digest)
+{
+	return EncryptFileUtli::Digest(method.get(), file_path, digest);
+}
+
+EncryptMethod NIMEncrypt::PreferredAEADMethod()
+{
+	// ChaCha20-Poly1305 is faster than AES-GCM in software
+	return SymmetricEncryptImp_AEAD::HasAESHardware() ? EncryptMethod::ENC_AES128_GCM : EncryptMethod::ENC_CHACHA20_POLY1305;
+}
+
 SymmetricEncryptMethod NIMEncrypt::CreateMethod(EncryptMethod method)
 {
 	switch (method)
@@ -33,7 +75,18 @@ SymmetricEncryptMethod NIMEncrypt::CreateMethod(EncryptMethod method)
 	case EncryptMethod::ENC_MD5:
 	case EncryptMethod::ENC_SHA1:
 	case EncryptMethod::ENC_SM3:
+	case EncryptMethod::ENC_SHA256:
 		return std::make_shared<SymmetricEncryptImp_Hash>(method);
+	case EncryptMethod::ENC_AES128_GCM:
+	case EncryptMethod::ENC_AES256_GCM:
+	case EncryptMethod::ENC_CHACHA20_POLY1305:
+		return std::make_shared<SymmetricEncryptImp_AEAD>(method);
+	case EncryptMethod::ENC_XXH64:
+		return std::make_shared<SymmetricEncryptImp_XXHash>(method);
+	case EncryptMethod::ENC_HMAC_SHA1:
+	case EncryptMethod::ENC_HMAC_SHA256:
+	case EncryptMethod::ENC_HMAC_SM3:
+		return std::make_shared<SymmetricEncryptImp_HMAC>(method);
 	}
 	return nullptr;
 }
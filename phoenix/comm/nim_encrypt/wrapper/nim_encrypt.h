@@ -16,9 +16,24 @@ class NIMEncrypt
 {
 public:
 	static SymmetricEncryptMethod CreateMethod(EncryptMethod method);
+	// AES-128-GCM if the CPU has the AES instructions, otherwise
+	// ChaCha20-Poly1305. The peer must be told the method chosen
+	static EncryptMethod PreferredAEADMethod();
 	static RSAEncryptMethod CreateRSAMethod();
 	static SM2EncryptMethod CreateSM2Method();
 	static std::string BinaryToHexString(const std::string& binary);
+	// Encrypts the file at |src_path| to |dst_path| by parts, neither file is
+	// read to memory as a whole. The paths are UTF-8
+	static bool EncryptFileToFile(const SymmetricEncryptMethod& method, const std::string& src_path, const std::string& dst_path);
+	static bool DecryptFileToFile(const SymmetricEncryptMethod& method, const std::string& src_path, const std::string& dst_path);
+	// The binary digest of the file by a hash method, e.g. ENC_SHA256 or
+	// ENC_XXH64. The file is mapped to memory by windows
+	// Encrypts a large buffer by chunks on |threads| threads, 0 for the
+	// number of the CPUs. Only for the AEAD methods, e.g. ENC_AES256_GCM, the
+	// output is decrypted by DecryptParallel() only
+	static bool EncryptParallel(const SymmetricEncryptMethod& method, const void* sdata, size_t ssize, std::string& ddata, int threads = 0);
+	static bool DecryptParallel(const SymmetricEncryptMethod& method, const void* sdata, size_t ssize, std::string& ddata, int threads = 0);
+	static bool DigestFile(const SymmetricEncryptMethod& method, const std::string& file_path, std::string& digest);
 };
 NIMENCRYPT_END_DECLS
 
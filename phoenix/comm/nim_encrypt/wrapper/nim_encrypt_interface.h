@@ -3,6 +3,7 @@
 #include "nim_encrypt/config/build_config.h"
 #include <string>
 #include <memory>
+#include <vector>
 NIMENCRYPT_BEGIN_DECLS
 
 enum class EncryptMethod
@@ -25,9 +26,27 @@ enum class EncryptMethod
 	ENC_MD5,
 	ENC_SHA1,
 	ENC_SM3,
+	//aead, the output is nonce(12) + ciphertext + tag(16)
+	ENC_AES128_GCM,
+	ENC_AES256_GCM,
+	ENC_CHACHA20_POLY1305,
+	//hash
+	ENC_SHA256,
+	// xxHash64, not cryptographic, to compare the contents fast
+	ENC_XXH64,
+	// hmac, the key is the secret, the output is the MAC of the message
+	ENC_HMAC_SHA1,
+	ENC_HMAC_SHA256,
+	ENC_HMAC_SM3,
 	ENC_END
 };
 
+// A message of the batch interfaces, not owned
+struct CryptoBuffer
+{
+	const void *data;
+	size_t size;
+};
 class ISymmetricCipher
 {
 public:
@@ -46,6 +65,20 @@ public:
 	virtual bool Encrypt(std::string &data) = 0;
 	virtual bool Encrypt(const std::string &sdata, std::string &ddata) = 0;
 	virtual bool Encrypt(const void *sdata, size_t ssize, std::string &ddata) = 0;
+	// Encrypts to the buffer of the caller, |dsize| is the size of |ddata| on
+	// input and the size written on output, see MaxEncryptedSize()
+	virtual bool Encrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) = 0;
+	virtual size_t MaxEncryptedSize(size_t ssize) const = 0;
+	// Encrypts a message by parts, the output of each call is appended to
+	// |ddata|. One message at a time, a whole buffer encrypted between
+	// EncryptBegin() and EncryptFinal() ends the message.
+	virtual bool EncryptBegin() = 0;
+	virtual bool EncryptUpdate(const void *sdata, size_t ssize, std::string &ddata) = 0;
+	virtual bool EncryptFinal(std::string &ddata) = 0;
+	// Encrypts |count| messages one by one to |arena|, the output of the
+	// message i is arena[offsets[i], offsets[i + 1]). Both are replaced and
+	// keep their capacity, so reusing them avoids the allocations.
+	virtual bool EncryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets) = 0;
 };
 // interface of decrypt algorithm
 class ISymmetricDecryptInterface : virtual public ISymmetricCipher
@@ -54,6 +87,12 @@ public:
 	virtual bool Decrypt(std::string &data) = 0;
 	virtual bool Decrypt(const std::string &sdata, std::string &ddata) = 0;
 	virtual bool Decrypt(const void *sdata, size_t ssize, std::string &ddata) = 0;
+	virtual bool Decrypt(const void *sdata, size_t ssize, void *ddata, size_t &dsize) = 0;
+	virtual size_t MaxDecryptedSize(size_t ssize) const = 0;
+	virtual bool DecryptBegin() = 0;
+	virtual bool DecryptUpdate(const void *sdata, size_t ssize, std::string &ddata) = 0;
+	virtual bool DecryptFinal(std::string &ddata) = 0;
+	virtual bool DecryptBatch(const CryptoBuffer *sdata, size_t count, std::string &arena, std::vector<size_t> &offsets) = 0;
 };
 class ISymmetricEncryptMethod : public ISymmetricEncryptInterface, public ISymmetricDecryptInterface
 {
@@ -90,6 +129,9 @@ public:
 	virtual void SetPublicKey(const std::string& hex_x, const std::string& hex_y) = 0;
 	virtual void SetPirvateKey(const std::string hex_key) = 0;
 	virtual bool PublicKeyEncrypt(const std::string& raw_content, std::string& encrypted_content) = 0;
+	// Encrypts each of |raw_contents| to |encrypted_contents| in order, faster
+	// than a call for each
+	virtual bool PublicKeyEncrypt(const std::vector<std::string>& raw_contents, std::vector<std::string>& encrypted_contents) = 0;
 	virtual bool PrivateKeyDecrypt(const std::string& raw_content, std::string& decrypted_content) = 0;
 };
 class ISM2EncryptMethod : public ISM2Cipher
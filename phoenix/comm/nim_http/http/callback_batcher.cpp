@@ -0,0 +1,53 @@
+#include "nim_http/http/callback_batcher.h"
+
+#include "base/location.h"
+#include "extension/callback/post_task.h"
+
+HTTP_BEGIN_DECLS
+
+CallbackBatcher* CallbackBatcher::GetInstance()
+{
+	// Leaked, the batches may be run while the process exits
+	static CallbackBatcher* instance = new CallbackBatcher;
+	return instance;
+}
+
+void CallbackBatcher::Post(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner,
+	const StdClosure& callback)
+{
+	CallbackBatcher* batcher = GetInstance();
+	{
+		std::lock_guard<std::mutex> lock(batcher->mutex_);
+		auto& batch = batcher->batches_[task_runner.get()];
+		batch.push_back(callback);
+		// The task of the batch is posted already
+		if (batch.size() > 1)
+			return;
+	}
+	// The task holds |task_runner|, so its address is not reused by another
+	// one before the batch runs
+	if (!NS_EXTENSION::PostTask(task_runner.get(), FROM_HERE,
+		[batcher, task_runner]() { batcher->RunBatch(task_runner); }))
+	{
+		std::lock_guard<std::mutex> lock(batcher->mutex_);
+		batcher->batches_.erase(task_runner.get());
+	}
+}
+
+void CallbackBatcher::RunBatch(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner)
+{
+	std::vector<StdClosure> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = batches_.find(task_runner.get());
+		if (it == batches_.end())
+			return;
+		callbacks.swap(it->second);
+		batches_.erase(it);
+	}
+	// The callbacks posted by these ones go to the next batch
+	for (const auto& callback : callbacks)
+		callback();
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,33 @@
+#ifndef __BASE_HTTP_CALLBACK_BATCHER_H__
+#define __BASE_HTTP_CALLBACK_BATCHER_H__
+
+#include "nim_http/config/build_config.h"
+#include <map>
+#include <mutex>
+#include <vector>
+#include "extension/callback/callback.h"
+#include "google_base/base/single_thread_task_runner.h"
+
+HTTP_BEGIN_DECLS
+
+// Posts the callbacks of the requests to the task runners of the callers in
+// batches: the callbacks posted before a task runner gets to its batch run in
+// one task, so a burst of completions on the transfer thread posts a single
+// task. The callbacks to a task runner run in the order posted. Thread safe.
+class CallbackBatcher
+{
+public:
+	static void Post(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner,
+		const StdClosure& callback);
+
+private:
+	static CallbackBatcher* GetInstance();
+	void RunBatch(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner);
+
+	std::mutex mutex_;
+	std::map<base::SingleThreadTaskRunner*, std::vector<StdClosure>> batches_;
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CALLBACK_BATCHER_H__
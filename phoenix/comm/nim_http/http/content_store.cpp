@@ -0,0 +1,392 @@
+#include "nim_http/http/content_store.h"
+#include <memory>
+#include <vector>
+#include "base/files/file_path.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/file_deleter.h"
+#include "nim_http/http/download_file_util.h"
+#include "nim_http/http/http_log.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <sys/ioctl.h>
+#elif defined(OS_MACOSX)
+#include <sys/clonefile.h>
+#endif
+#endif
+
+#if (defined(OS_LINUX) || defined(OS_ANDROID)) && !defined(FICLONE)
+// <linux/fs.h> of the older kernels does not have it
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+HTTP_BEGIN_DECLS
+
+namespace {
+const char kCreateContentTableSql[] =
+	"CREATE TABLE IF NOT EXISTS content("
+	"content_key TEXT PRIMARY KEY NOT NULL, "
+	"size INTEGER NOT NULL, "
+	"refs INTEGER NOT NULL)";
+const char kCreateFileTableSql[] =
+	"CREATE TABLE IF NOT EXISTS content_file("
+	"path TEXT PRIMARY KEY NOT NULL, "
+	"content_key TEXT NOT NULL)";
+const char kCreateFileKeyIndexSql[] =
+	"CREATE INDEX IF NOT EXISTS content_file_key ON content_file(content_key)";
+
+const char* DigestName(HTTP_DIGEST type)
+{
+	switch (type) {
+	case DIGEST_MD5:
+		return "md5";
+	case DIGEST_SHA256:
+		return "sha256";
+	default:
+		return nullptr;
+	}
+}
+
+// "<type>/<hex>", empty if |hex| is not a digest, so it is safe as a path
+std::string ContentKey(HTTP_DIGEST type, const std::string& hex)
+{
+	const char* name = DigestName(type);
+	if (name == nullptr || hex.size() < 2)
+		return std::string();
+	for (char c : hex) {
+		if ((c < '0' || c > '9') && (c < 'a' || c > 'f'))
+			return std::string();
+	}
+	return std::string(name) + "/" + hex;
+}
+
+bool HashFile(const std::string& file_path, HTTP_DIGEST type, std::string& hex)
+{
+	long long size = NS_EXTENSION::GetFileSize(file_path);
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file(NS_EXTENSION::OpenFile(file_path, "rb"));
+	if (size < 0 || !file)
+		return false;
+	DownloadDigest digest(type);
+	if (!digest.UpdateFromFile(file.get(), size))
+		return false;
+	hex = digest.Finish();
+	return !hex.empty();
+}
+
+// A copy-on-write clone, shares the blocks until either file is modified
+bool CloneFile(const std::string& from_path, const std::string& to_path)
+{
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+	int from = open(from_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (from < 0)
+		return false;
+	int to = open(to_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (to < 0) {
+		close(from);
+		return false;
+	}
+	bool result = ioctl(to, FICLONE, from) == 0;
+	close(to);
+	close(from);
+	if (!result)
+		unlink(to_path.c_str());
+	return result;
+#elif defined(OS_MACOSX)
+	return clonefile(from_path.c_str(), to_path.c_str(), 0) == 0;
+#else
+	return false;
+#endif
+}
+
+bool HardLinkFile(const std::string& from_path, const std::string& to_path)
+{
+#if defined(OS_WIN)
+	return ::CreateHardLinkW(base::FilePath::FromUTF8Unsafe(to_path).value().c_str(),
+		base::FilePath::FromUTF8Unsafe(from_path).value().c_str(), NULL) != FALSE;
+#else
+	return link(from_path.c_str(), to_path.c_str()) == 0;
+#endif
+}
+
+// Makes |to_path| a file of the content of |from_path| by a clone, a hard
+// link or a copy, the one it replaces is kept until the new one is complete
+bool PlaceFile(const std::string& from_path, const std::string& to_path)
+{
+	std::string temp_path = to_path + ".tmp";
+	NS_EXTENSION::DeleteFile(temp_path);
+	if (!CloneFile(from_path, temp_path) && !HardLinkFile(from_path, temp_path)
+		&& !NS_EXTENSION::CopyFile(from_path, temp_path))
+		return false;
+	if (!NS_EXTENSION::MoveFile(temp_path, to_path)) {
+		NS_EXTENSION::DeleteFile(temp_path);
+		return false;
+	}
+	return true;
+}
+}
+
+ContentStore::ContentStore()
+{
+}
+
+ContentStore::~ContentStore()
+{
+	Close();
+}
+
+bool ContentStore::Open(const std::string& directory)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (db_.IsValid())
+		db_.Close();
+	directory_ = directory;
+	if (directory_.empty())
+		return false;
+	char last = directory_.back();
+	if (last != '/' && last != '\\')
+		directory_.push_back('/');
+	if (!NS_EXTENSION::CreateDirectory(directory_ + "objects")) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] create content store failed: {0}") << directory_;
+		return false;
+	}
+
+	std::string index_path = directory_ + "index.db";
+	if (!db_.Open(index_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateContentTableSql) != SQLITE_OK
+		|| db_.Query(kCreateFileTableSql) != SQLITE_OK
+		|| db_.Query(kCreateFileKeyIndexSql) != SQLITE_OK) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] open content store index failed: {0}, {1}")
+			<< index_path << (db_.IsValid() ? db_.GetLastErrorMessage() : "");
+		db_.Close();
+		return false;
+	}
+	return true;
+}
+
+void ContentStore::Close()
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (db_.IsValid())
+		db_.Close();
+}
+
+bool ContentStore::Contains(HTTP_DIGEST type, const std::string& hex)
+{
+	std::string key = ContentKey(type, hex);
+	if (key.empty())
+		return false;
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	return StoredSizeLocked(key) >= 0;
+}
+
+bool ContentStore::LinkTo(HTTP_DIGEST type, const std::string& hex, const std::string& file_path)
+{
+	std::string key = ContentKey(type, hex);
+	if (key.empty() || file_path.empty())
+		return false;
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (StoredSizeLocked(key) < 0)
+		return false;
+	std::string directory;
+	NS_EXTENSION::FilePathApartDirectory(file_path, directory);
+	if (!directory.empty())
+		NS_EXTENSION::CreateDirectory(directory);
+	if (!PlaceFile(ObjectPathOf(key), file_path)) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] link stored content failed: {0}") << file_path;
+		return false;
+	}
+	return AddReferenceLocked(file_path, key);
+}
+
+std::string ContentStore::AddFile(const std::string& file_path, HTTP_DIGEST type, const std::string& hex/* = ""*/)
+{
+	// Hashed before locking, a large file takes a while
+	std::string digest = hex;
+	if (digest.empty() && (DigestName(type) == nullptr || !HashFile(file_path, type, digest)))
+		return std::string();
+	std::string key = ContentKey(type, digest);
+	long long size = NS_EXTENSION::GetFileSize(file_path);
+	if (key.empty() || size < 0)
+		return std::string();
+
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (!db_.IsValid())
+		return std::string();
+	std::string object_path = ObjectPathOf(key);
+	long long stored_size = StoredSizeLocked(key);
+	if (stored_size >= 0) {
+		// The copy is dropped for a link of the stored content, or kept if it
+		// can not be replaced, e.g. it is open
+		if (stored_size == size && !PlaceFile(object_path, file_path))
+			HTTP_QLOG_WAR(GetLogger(), "[net][http] link stored content failed: {0}") << file_path;
+	} else {
+		std::string directory;
+		NS_EXTENSION::FilePathApartDirectory(object_path, directory);
+		if (!NS_EXTENSION::CreateDirectory(directory) || !PlaceFile(file_path, object_path)) {
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] store content failed: {0}") << file_path;
+			return std::string();
+		}
+		// A content whose file was lost keeps its references
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "INSERT OR IGNORE INTO content(content_key, size, refs) VALUES(?, ?, 0)") != SQLITE_OK)
+			return std::string();
+		statement.BindText(1, key.data(), key.size());
+		statement.BindInt64(2, size);
+		if (statement.NextRow() != SQLITE_DONE
+			|| db_.Query(statement, "UPDATE content SET size=? WHERE content_key=?") != SQLITE_OK)
+			return std::string();
+		statement.BindInt64(1, size);
+		statement.BindText(2, key.data(), key.size());
+		if (statement.NextRow() != SQLITE_DONE)
+			return std::string();
+	}
+	if (!AddReferenceLocked(file_path, key))
+		return std::string();
+	return digest;
+}
+
+void ContentStore::Release(const std::string& file_path)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (!db_.IsValid())
+		return;
+	base::db::SQLiteAutoTransaction transaction(&db_);
+	ReleaseLocked(file_path);
+}
+
+size_t ContentStore::Prune()
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (!db_.IsValid())
+		return 0;
+	std::vector<std::string> deleted;
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT path FROM content_file") != SQLITE_OK)
+			return 0;
+		while (statement.NextRow() == SQLITE_ROW) {
+			std::string path(statement.GetTextField(0), statement.GetFieldBytes(0));
+			if (!NS_EXTENSION::FilePathIsExist(path, false))
+				deleted.push_back(path);
+		}
+	}
+	base::db::SQLiteAutoTransaction transaction(&db_);
+	for (auto& path : deleted)
+		ReleaseLocked(path);
+	return deleted.size();
+}
+
+HttpContentStoreStats ContentStore::GetStats()
+{
+	HttpContentStoreStats stats;
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (!db_.IsValid())
+		return stats;
+	base::db::SQLiteStatement statement;
+	const char sql[] = "SELECT COUNT(*), COALESCE(SUM(size), 0), COALESCE(SUM(refs), 0), "
+		"COALESCE(SUM(size * refs), 0) FROM content";
+	if (db_.Query(statement, sql) == SQLITE_OK && statement.NextRow() == SQLITE_ROW) {
+		stats.content_count = statement.GetInt64Field(0);
+		stats.stored_bytes = statement.GetInt64Field(1);
+		stats.file_count = statement.GetInt64Field(2);
+		stats.file_bytes = statement.GetInt64Field(3);
+	}
+	return stats;
+}
+
+long long ContentStore::StoredSizeLocked(const std::string& key)
+{
+	if (!db_.IsValid())
+		return -1;
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "SELECT size FROM content WHERE content_key=?") != SQLITE_OK)
+		return -1;
+	statement.BindText(1, key.data(), key.size());
+	if (statement.NextRow() != SQLITE_ROW)
+		return -1;
+	long long size = statement.GetInt64Field(0);
+	// Deleted or modified through a hard link of it
+	if (NS_EXTENSION::GetFileSize(ObjectPathOf(key)) != size)
+		return -1;
+	return size;
+}
+
+std::string ContentStore::ObjectPathOf(const std::string& key) const
+{
+	size_t slash = key.find('/');
+	return directory_ + "objects/" + key.substr(0, slash + 1) + key.substr(slash + 1, 2) + "/" + key.substr(slash + 1);
+}
+
+bool ContentStore::AddReferenceLocked(const std::string& file_path, const std::string& key)
+{
+	base::db::SQLiteAutoTransaction transaction(&db_);
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT content_key FROM content_file WHERE path=?") != SQLITE_OK)
+			return false;
+		statement.BindText(1, file_path.data(), file_path.size());
+		if (statement.NextRow() == SQLITE_ROW) {
+			if (std::string(statement.GetTextField(0), statement.GetFieldBytes(0)) == key)
+				return true;
+			statement.Finalize();
+			// The file was made of another content before
+			ReleaseLocked(file_path);
+		}
+	}
+	base::db::SQLiteStatement insert;
+	if (db_.Query(insert, "INSERT INTO content_file(path, content_key) VALUES(?, ?)") != SQLITE_OK)
+		return false;
+	insert.BindText(1, file_path.data(), file_path.size());
+	insert.BindText(2, key.data(), key.size());
+	if (insert.NextRow() != SQLITE_DONE)
+		return false;
+	base::db::SQLiteStatement update;
+	if (db_.Query(update, "UPDATE content SET refs=refs+1 WHERE content_key=?") != SQLITE_OK)
+		return false;
+	update.BindText(1, key.data(), key.size());
+	return update.NextRow() == SQLITE_DONE;
+}
+
+void ContentStore::ReleaseLocked(const std::string& file_path)
+{
+	std::string key;
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT content_key FROM content_file WHERE path=?") != SQLITE_OK)
+			return;
+		statement.BindText(1, file_path.data(), file_path.size());
+		if (statement.NextRow() != SQLITE_ROW)
+			return;
+		key.assign(statement.GetTextField(0), statement.GetFieldBytes(0));
+	}
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "DELETE FROM content_file WHERE path=?") != SQLITE_OK)
+		return;
+	statement.BindText(1, file_path.data(), file_path.size());
+	statement.NextRow();
+	statement.Finalize();
+	if (db_.Query(statement, "UPDATE content SET refs=refs-1 WHERE content_key=?") != SQLITE_OK)
+		return;
+	statement.BindText(1, key.data(), key.size());
+	statement.NextRow();
+	statement.Finalize();
+
+	// The last reference deletes the content
+	if (db_.Query(statement, "SELECT refs FROM content WHERE content_key=?") != SQLITE_OK)
+		return;
+	statement.BindText(1, key.data(), key.size());
+	if (statement.NextRow() != SQLITE_ROW || statement.GetInt64Field(0) > 0)
+		return;
+	statement.Finalize();
+	if (db_.Query(statement, "DELETE FROM content WHERE content_key=?") != SQLITE_OK)
+		return;
+	statement.BindText(1, key.data(), key.size());
+	if (statement.NextRow() == SQLITE_DONE)
+		NS_EXTENSION::DeleteFile(ObjectPathOf(key));
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,54 @@
+#ifndef __BASE_HTTP_CONTENT_STORE_H__
+#define __BASE_HTTP_CONTENT_STORE_H__
+
+#include "nim_http/config/build_config.h"
+#include <mutex>
+#include <string>
+#include "nim_db/db_sqlite3.h"
+#include "nim_log/wrapper/log.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The content store of NIMHttp::CreateContentStore.
+// The contents are in "objects/<digest type>/<2 hex>/<hex>" of the
+// directory. "index.db" has a row per content with its size and the count
+// of its references, and a row per file referencing it, so the files can be
+// released by their paths.
+// A new file is hard linked into the store where it can be, so adding it
+// does not copy it.
+class ContentStore : public IHttpContentStore, public NS_NIMLOG::LoggerSetter
+{
+public:
+	ContentStore();
+	virtual ~ContentStore();
+
+	bool Open(const std::string& directory);
+	void Close();
+
+	virtual bool Contains(HTTP_DIGEST type, const std::string& hex) override;
+	virtual bool LinkTo(HTTP_DIGEST type, const std::string& hex, const std::string& file_path) override;
+	virtual std::string AddFile(const std::string& file_path, HTTP_DIGEST type, const std::string& hex = "") override;
+	virtual void Release(const std::string& file_path) override;
+	virtual size_t Prune() override;
+	virtual HttpContentStoreStats GetStats() override;
+
+private:
+	// The methods below are called with |mutex_| locked
+	// The size of a content whose file is intact, negative if it is not stored
+	long long StoredSizeLocked(const std::string& key);
+	std::string ObjectPathOf(const std::string& key) const;
+	// Makes |file_path| a reference of |key|, the one it had is released
+	bool AddReferenceLocked(const std::string& file_path, const std::string& key);
+	void ReleaseLocked(const std::string& file_path);
+
+	std::string directory_;
+	std::mutex mutex_;
+	base::db::SQLiteDB db_;
+
+	DISALLOW_COPY_AND_ASSIGN(ContentStore);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CONTENT_STORE_H__
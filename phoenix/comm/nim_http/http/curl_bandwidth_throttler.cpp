@@ -0,0 +1,162 @@
+#include "nim_http/http/curl_bandwidth_throttler.h"
+#include <algorithm>
+
+HTTP_BEGIN_DECLS
+
+// A bucket refilled for long holds at most this much of its rate
+const int64_t kMaxBurstMs = 500;
+
+void CurlBandwidthThrottler::Bucket::Reset(long long bytes_per_second, bool limit)
+{
+	limited = limit;
+	rate = bytes_per_second > 0 ? bytes_per_second : 0;
+	tokens = static_cast<double>(rate) * kMaxBurstMs / 1000;
+}
+
+void CurlBandwidthThrottler::Bucket::Refill(double seconds)
+{
+	if (!limited)
+		return;
+	tokens = std::min(tokens + rate * seconds, static_cast<double>(rate) * kMaxBurstMs / 1000);
+}
+
+CurlBandwidthThrottler::CurlBandwidthThrottler() : enabled_(false)
+{
+}
+
+CurlBandwidthThrottler::~CurlBandwidthThrottler()
+{
+}
+
+HTTP_PRIORITY CurlBandwidthThrottler::ClampPriority(HTTP_PRIORITY priority)
+{
+	if (priority < PRIORITY_BACKGROUND || priority >= PRIORITY_COUNT)
+		return PRIORITY_NORMAL;
+	return priority;
+}
+
+bool CurlBandwidthThrottler::SetLimit(const HttpBandwidthLimit &limit)
+{
+	limit_ = limit;
+	total_[kDownload].Reset(limit_.max_download_rate, limit_.max_download_rate > 0);
+	total_[kUpload].Reset(limit_.max_upload_rate, limit_.max_upload_rate > 0);
+	enabled_ = total_[kDownload].limited || total_[kUpload].limited;
+	for (int i = PRIORITY_BACKGROUND; i < PRIORITY_COUNT; i++) {
+		priority_[i][kDownload].Reset(limit_.priority_download_rate[i], limit_.priority_download_rate[i] > 0);
+		priority_[i][kUpload].Reset(limit_.priority_upload_rate[i], limit_.priority_upload_rate[i] > 0);
+		enabled_ = enabled_ || priority_[i][kDownload].limited || priority_[i][kUpload].limited;
+	}
+	// A zero yield rate pauses the background sessions
+	yield_[kDownload].Reset(limit_.background_yield_rate, limit_.background_yield_rate >= 0);
+	yield_[kUpload].Reset(limit_.background_yield_rate, limit_.background_yield_rate >= 0);
+	enabled_ = enabled_ || yield_[kDownload].limited;
+	budget_.limited = limit_.background_budget >= 0;
+	budget_.rate = 0;
+	budget_.tokens = budget_.limited ? static_cast<double>(limit_.background_budget) : 0;
+	enabled_ = enabled_ || budget_.limited;
+	last_update_ = NS_EXTENSION::TimeTicks();
+
+	if (enabled_)
+		return false;
+	bool resumed = false;
+	for (auto iter = meters_.begin(); iter != meters_.end(); iter++)
+		resumed = SetPauseMask(iter->first, iter->second, CURLPAUSE_CONT) || resumed;
+	meters_.clear();
+	return resumed;
+}
+
+bool CurlBandwidthThrottler::IsExhausted(HTTP_PRIORITY priority, Direction direction, bool yielding) const
+{
+	if (total_[direction].Exhausted() || priority_[priority][direction].Exhausted())
+		return true;
+	if (IsBackground(priority) && budget_.Exhausted())
+		return true;
+	return yielding && IsBackground(priority) && yield_[direction].Exhausted();
+}
+
+bool CurlBandwidthThrottler::Update(const SessionSet &sessions)
+{
+	if (!enabled_)
+		return false;
+
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	double seconds = last_update_.is_null() ? 0 : (now - last_update_).InSecondsF();
+	last_update_ = now;
+	for (int direction = kDownload; direction < kDirectionCount; direction++) {
+		total_[direction].Refill(seconds);
+		yield_[direction].Refill(seconds);
+		for (int i = PRIORITY_BACKGROUND; i < PRIORITY_COUNT; i++)
+			priority_[i][direction].Refill(seconds);
+	}
+
+	// The background sessions yield while a foreground one is running
+	bool yielding = false;
+	if (yield_[kDownload].limited) {
+		for (auto iter = sessions.begin(); iter != sessions.end() && !yielding; iter++)
+			yielding = !IsBackground(ClampPriority((*iter)->GetSessionPriority()));
+	}
+
+	// Charge all the sessions before pausing any of them
+	static const CURLINFO kTransferredInfo[kDirectionCount] = { CURLINFO_SIZE_DOWNLOAD_T, CURLINFO_SIZE_UPLOAD_T };
+	for (auto iter = sessions.begin(); iter != sessions.end(); iter++) {
+		CurlNetworkSession *session = iter->get();
+		if (session->easy_handle_ == nullptr)
+			continue;
+		HTTP_PRIORITY priority = ClampPriority(session->GetSessionPriority());
+		Meter &meter = meters_[session];
+		for (int direction = kDownload; direction < kDirectionCount; direction++) {
+			curl_off_t transferred = 0;
+			if (CURLE_OK != curl_easy_getinfo(session->easy_handle_, kTransferredInfo[direction], &transferred))
+				continue;
+			// The counters start over for a redirection
+			curl_off_t bytes = transferred >= meter.transferred[direction] ?
+				transferred - meter.transferred[direction] : transferred;
+			meter.transferred[direction] = transferred;
+			total_[direction].Charge(bytes);
+			priority_[priority][direction].Charge(bytes);
+			if (yielding && IsBackground(priority))
+				yield_[direction].Charge(bytes);
+			if (IsBackground(priority))
+				budget_.Charge(bytes);
+		}
+	}
+
+	bool resumed = false;
+	for (auto iter = sessions.begin(); iter != sessions.end(); iter++) {
+		CurlNetworkSession *session = iter->get();
+		auto meter = meters_.find(session);
+		if (meter == meters_.end())
+			continue;
+		HTTP_PRIORITY priority = ClampPriority(session->GetSessionPriority());
+		int pause_mask = CURLPAUSE_CONT;
+		if (IsExhausted(priority, kDownload, yielding))
+			pause_mask |= CURLPAUSE_RECV;
+		if (IsExhausted(priority, kUpload, yielding))
+			pause_mask |= CURLPAUSE_SEND;
+		resumed = SetPauseMask(session, meter->second, pause_mask) || resumed;
+	}
+	return resumed;
+}
+
+void CurlBandwidthThrottler::RemoveSession(CurlNetworkSession *session)
+{
+	auto iter = meters_.find(session);
+	if (iter == meters_.end())
+		return;
+	// A recycled easy handle must not stay paused
+	SetPauseMask(session, iter->second, CURLPAUSE_CONT);
+	meters_.erase(iter);
+}
+
+bool CurlBandwidthThrottler::SetPauseMask(CurlNetworkSession *session, Meter &meter, int pause_mask)
+{
+	if (meter.pause_mask == pause_mask || session->easy_handle_ == nullptr)
+		return false;
+	bool resumed = (meter.pause_mask & ~pause_mask) != 0;
+	if (CURLE_OK != curl_easy_pause(session->easy_handle_, pause_mask))
+		return false;
+	meter.pause_mask = pause_mask;
+	return resumed;
+}
+
+HTTP_END_DECLS
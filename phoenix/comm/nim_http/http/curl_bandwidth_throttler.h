@@ -0,0 +1,93 @@
+#ifndef HTTP_CURL_CURL_BANDWIDTH_THROTTLER_H_
+#define HTTP_CURL_CURL_BANDWIDTH_THROTTLER_H_
+#include "nim_http/config/build_config.h"
+#include <map>
+#include <memory>
+#include "extension/containers/flat_hash_map.h"
+#include "extension/time/time.h"
+#include "nim_http/http/curl_network_session.h"
+
+HTTP_BEGIN_DECLS
+
+typedef std::shared_ptr<CurlNetworkSession> SessionScopedRefPtr;
+// The running sessions of a manager, hashed by the session pointer
+typedef NS_EXTENSION::FlatHashSet<SessionScopedRefPtr> SessionSet;
+
+// The bandwidth limiter of CurlNetworkSessionManager.
+// Every cap of HttpBandwidthLimit is a token bucket holding up to
+// kMaxBurstMs of bytes. Update() charges the bytes the running sessions
+// transferred since the last one to the buckets of the manager, of their
+// priority, of the background yield and of the background budget, which is
+// never refilled, then pauses a session by
+// curl_easy_pause in the direction whose bucket is in debt and resumes it
+// once the bucket is refilled. The sessions sharing a bucket share its rate.
+// Not thread safe, used on the thread of the manager only.
+class CurlBandwidthThrottler
+{
+public:
+	CurlBandwidthThrottler();
+	~CurlBandwidthThrottler();
+
+	// Returns true if a paused session is resumed, e.g. the limit is lifted
+	bool SetLimit(const HttpBandwidthLimit &limit);
+	bool enabled() const { return enabled_; }
+
+	// Returns true if a paused session is resumed, curl has to be driven
+	// to go on with it
+	bool Update(const SessionSet &sessions);
+
+	// Resumes |session| if it is paused and forgets it, called before the
+	// session is removed from curl
+	void RemoveSession(CurlNetworkSession *session);
+
+private:
+	enum Direction
+	{
+		kDownload = 0,
+		kUpload,
+		kDirectionCount
+	};
+
+	struct Bucket
+	{
+		Bucket() : limited(false), rate(0), tokens(0) {}
+		void Reset(long long bytes_per_second, bool limit);
+		void Refill(double seconds);
+		void Charge(curl_off_t bytes) { if (limited) tokens -= static_cast<double>(bytes); }
+		bool Exhausted() const { return limited && tokens <= 0; }
+
+		bool limited;
+		long long rate;
+		double tokens;
+	};
+
+	struct Meter
+	{
+		Meter() : pause_mask(CURLPAUSE_CONT) { transferred[kDownload] = transferred[kUpload] = 0; }
+		curl_off_t transferred[kDirectionCount];
+		int pause_mask;
+	};
+
+	static HTTP_PRIORITY ClampPriority(HTTP_PRIORITY priority);
+	static bool IsBackground(HTTP_PRIORITY priority) { return priority < PRIORITY_NORMAL; }
+	bool IsExhausted(HTTP_PRIORITY priority, Direction direction, bool yielding) const;
+	// Returns true if the session is resumed in any direction
+	static bool SetPauseMask(CurlNetworkSession *session, Meter &meter, int pause_mask);
+
+	HttpBandwidthLimit limit_;
+	bool enabled_;
+	Bucket total_[kDirectionCount];
+	Bucket priority_[PRIORITY_COUNT][kDirectionCount];
+	// Shared by the background sessions while a foreground one is running
+	Bucket yield_[kDirectionCount];
+	// Shared by both directions of the background sessions, not refilled
+	Bucket budget_;
+	std::map<CurlNetworkSession *, Meter> meters_;
+	NS_EXTENSION::TimeTicks last_update_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlBandwidthThrottler);
+};
+
+HTTP_END_DECLS
+
+#endif // HTTP_CURL_CURL_BANDWIDTH_THROTTLER_H_
@@ -0,0 +1,411 @@
+#include "nim_http/http/curl_chunked_upload.h"
+#include <algorithm>
+#include "base/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "extension/callback/post_task.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/chained_buffer.h"
+#include "extension/memory/file_deleter.h"
+#include "nim_http/http/download_file_util.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+// Smaller parts cost more requests than they save on a retry
+const long long kMinPartSize = 256 * 1024;
+const int kMaxConcurrency = 8;
+
+const char kCreateUploadTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_upload("
+	"upload_id TEXT PRIMARY KEY NOT NULL, "
+	"total_size INTEGER NOT NULL, "
+	"part_size INTEGER NOT NULL, "
+	"update_time INTEGER NOT NULL)";
+const char kCreatePartTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_upload_part("
+	"upload_id TEXT NOT NULL, "
+	"part_index INTEGER NOT NULL, "
+	"tag TEXT NOT NULL DEFAULT '', "
+	"PRIMARY KEY(upload_id, part_index))";
+
+bool SeekFile(FILE* file, long long offset)
+{
+#if defined(OS_WIN)
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+bool ReadPart(const std::string& file_path, const HttpUploadPart& part, std::string& data)
+{
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file(NS_EXTENSION::OpenFile(file_path, "rb"));
+	if (!file || !SeekFile(file.get(), part.offset))
+		return false;
+	data.resize((size_t)part.size);
+	return fread(&data[0], 1, data.size(), file.get()) == data.size();
+}
+}
+
+CurlChunkedUpload::CurlChunkedUpload(const HttpManager& manager,
+									 const std::string& url,
+									 const std::string& upload_file_path,
+									 const HttpChunkedUploadConfig& config,
+									 const ChunkedUploadCallback& complete_cb,
+									 const ProgressCallback& progress_cb) :
+	manager_(manager), url_(url), upload_file_path_(upload_file_path), config_(config),
+	complete_callback_(complete_cb), progress_callback_(progress_cb),
+	running_(false), canceled_(false), failed_(false), result_code_(0),
+	total_size_(0), accepted_size_(0), reported_size_(0), running_parts_(0), digest_offset_(0)
+{
+	config_.part_size = std::max(config_.part_size, kMinPartSize);
+	config_.concurrency = std::min(std::max(config_.concurrency, 1), kMaxConcurrency);
+}
+
+CurlChunkedUpload::~CurlChunkedUpload()
+{
+	db_.Close();
+}
+
+bool CurlChunkedUpload::Start()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (running_ || manager_ == nullptr)
+		return false;
+
+	long long total_size = NS_EXTENSION::GetFileSize(upload_file_path_);
+	if (total_size <= 0)
+		return false;
+
+	running_ = true;
+	canceled_ = false;
+	failed_ = false;
+	result_code_ = 0;
+	total_size_ = total_size;
+	accepted_size_ = 0;
+	reported_size_ = 0;
+	if (base::ThreadTaskRunnerHandle::IsSet())
+		reply_task_runner_ = base::ThreadTaskRunnerHandle::Get();
+
+	int part_count = (int)((total_size + config_.part_size - 1) / config_.part_size);
+	parts_.clear();
+	parts_.resize(part_count);
+	for (int index = 0; index < part_count; index++) {
+		HttpUploadPart& part = parts_[index].part;
+		part.index = index;
+		part.offset = config_.part_size * index;
+		part.size = std::min(config_.part_size, total_size - part.offset);
+		part.total_size = total_size;
+	}
+
+	// Without the database the upload still works, it just can not be resumed
+	if (OpenDatabase() && !LoadParts(total_size)) {
+		DeleteSavedParts();
+		LoadParts(total_size);
+	}
+	pending_parts_.clear();
+	for (size_t index = 0; index < parts_.size(); index++) {
+		if (parts_[index].accepted)
+			accepted_size_ += parts_[index].part.size;
+		else
+			pending_parts_.push_back(index);
+	}
+	digest_.reset();
+	digest_offset_ = 0;
+	if (config_.content_digest != DIGEST_NONE && accepted_size_ == 0 && manager_->GetContentStore() != nullptr)
+		digest_.reset(new DownloadDigest(config_.content_digest));
+
+	if (pending_parts_.empty()) {
+		// Every part was accepted before
+		Complete(true, 200);
+		return true;
+	}
+	if (!StartNextParts()) {
+		// The parts posted already complete the upload when they are canceled
+		CancelParts();
+		if (running_parts_ > 0)
+			return true;
+		Complete(false, result_code_);
+		return false;
+	}
+	return true;
+}
+
+void CurlChunkedUpload::Cancel()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (!running_ || canceled_)
+		return;
+
+	canceled_ = true;
+	pending_parts_.clear();
+	CancelParts();
+}
+
+bool CurlChunkedUpload::IsRunning() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return running_;
+}
+
+bool CurlChunkedUpload::Reset()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (running_)
+		return false;
+	if (OpenDatabase())
+		DeleteSavedParts();
+	return true;
+}
+
+bool CurlChunkedUpload::OpenDatabase()
+{
+	if (db_.IsValid())
+		return true;
+	if (config_.db_path.empty() || config_.upload_id.empty())
+		return false;
+	if (!db_.Open(config_.db_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateUploadTableSql) != SQLITE_OK
+		|| db_.Query(kCreatePartTableSql) != SQLITE_OK) {
+		db_.Close();
+		return false;
+	}
+	return true;
+}
+
+bool CurlChunkedUpload::LoadParts(long long total_size)
+{
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "SELECT total_size, part_size FROM http_upload WHERE upload_id = ?") != SQLITE_OK)
+		return false;
+	statement.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+	if (statement.NextRow() != SQLITE_ROW) {
+		// A new upload, its parts are recorded from now on
+		base::db::SQLiteStatement insert;
+		if (db_.Query(insert, "INSERT INTO http_upload(upload_id, total_size, part_size, update_time) VALUES(?, ?, ?, ?)") != SQLITE_OK)
+			return false;
+		insert.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+		insert.BindInt64(2, total_size);
+		insert.BindInt64(3, config_.part_size);
+		insert.BindInt64(4, base::Time::Now().ToTimeT());
+		return insert.NextRow() == SQLITE_DONE;
+	}
+	// The parts of another file or of another size can not be reused
+	if (statement.GetInt64Field(0) != total_size || statement.GetInt64Field(1) != config_.part_size)
+		return false;
+	statement.Finalize();
+
+	if (db_.Query(statement, "SELECT part_index, tag FROM http_upload_part WHERE upload_id = ?") != SQLITE_OK)
+		return false;
+	statement.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+	while (statement.NextRow() == SQLITE_ROW) {
+		sqlite3_int64 index = statement.GetInt64Field(0);
+		if (index < 0 || index >= (sqlite3_int64)parts_.size())
+			continue;
+		const char* tag = statement.GetTextField(1);
+		parts_[(size_t)index].accepted = true;
+		parts_[(size_t)index].tag = tag != nullptr ? tag : "";
+	}
+	return true;
+}
+
+bool CurlChunkedUpload::SavePart(const Part& part)
+{
+	if (!db_.IsValid())
+		return false;
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "INSERT OR REPLACE INTO http_upload_part(upload_id, part_index, tag) VALUES(?, ?, ?)") != SQLITE_OK)
+		return false;
+	statement.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+	statement.BindInt64(2, part.part.index);
+	statement.BindText(3, part.tag.data(), part.tag.size());
+	return statement.NextRow() == SQLITE_DONE;
+}
+
+void CurlChunkedUpload::DeleteSavedParts()
+{
+	if (!db_.IsValid())
+		return;
+	base::db::SQLiteAutoTransaction transaction(&db_);
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "DELETE FROM http_upload_part WHERE upload_id = ?") == SQLITE_OK) {
+		statement.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+		statement.NextRow();
+	}
+	statement.Finalize();
+	if (db_.Query(statement, "DELETE FROM http_upload WHERE upload_id = ?") == SQLITE_OK) {
+		statement.BindText(1, config_.upload_id.data(), config_.upload_id.size());
+		statement.NextRow();
+	}
+}
+
+bool CurlChunkedUpload::StartNextParts()
+{
+	while (!canceled_ && !failed_ && !pending_parts_.empty() && running_parts_ < (size_t)config_.concurrency) {
+		size_t index = pending_parts_.front();
+		pending_parts_.pop_front();
+		if (!StartPart(index)) {
+			failed_ = true;
+			result_code_ = CURLE_READ_ERROR;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CurlChunkedUpload::StartPart(size_t index)
+{
+	Part& part = parts_[index];
+	std::string data;
+	if (!ReadPart(upload_file_path_, part.part, data))
+		return false;
+	if (digest_ != nullptr && part.part.offset == digest_offset_) {
+		digest_->Update(data.data(), data.size());
+		digest_offset_ += (long long)data.size();
+	}
+
+	// The parts keep the upload alive until they are completed
+	auto self = shared_from_this();
+	std::string url = config_.part_url_cb ? config_.part_url_cb(part.part) : url_;
+	part.sent = 0;
+	part.request = std::make_shared<CurlHttpRequest>(url,
+		[self, index](const std::shared_ptr<std::string>& content, bool succeed, int response_code) {
+		self->OnPartCompleted(index, content, succeed, response_code);
+	},
+		[self, index](double, double uploaded, double, double) {
+		self->OnPartProgress(index, uploaded);
+	});
+	part.request->SetMethod(POST);
+	// The chain can be rewound, so a retry sends the part again
+	NS_EXTENSION::ChainedBuffer body;
+	body.append(std::move(data));
+	part.request->SetPostChain(body);
+	std::string content_range = "bytes " + std::to_string(part.part.offset) + "-" +
+		std::to_string(part.part.offset + part.part.size - 1) + "/" + std::to_string(part.part.total_size);
+	part.request->AddHeaderField("Content-Range", content_range);
+	part.request->SetRetryPolicy(config_.retry_policy);
+	HttpRequest request = part.request;
+	if (config_.part_request_cb)
+		config_.part_request_cb(part.part, request);
+	running_parts_++;
+	manager_->PostRequest(request);
+	return true;
+}
+
+void CurlChunkedUpload::OnPartProgress(size_t index, double uploaded)
+{
+	long long progress = 0;
+	long long total_size = 0;
+	{
+		std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+		if (!running_ || index >= parts_.size() || parts_[index].request == nullptr)
+			return;
+		parts_[index].sent = std::min((long long)uploaded, parts_[index].part.size);
+		progress = accepted_size_;
+		for (auto& part : parts_) {
+			if (part.request != nullptr)
+				progress += part.sent;
+		}
+		// Report every 1% at most
+		if (progress - reported_size_ < total_size_ / 100)
+			return;
+		reported_size_ = progress;
+		total_size = total_size_;
+	}
+	NotifyProgress(progress, total_size);
+}
+
+void CurlChunkedUpload::OnPartCompleted(size_t index, const std::shared_ptr<std::string>& content, bool succeed, int response_code)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (index >= parts_.size() || parts_[index].request == nullptr)
+		return;
+
+	Part& part = parts_[index];
+	std::shared_ptr<CurlHttpRequest> request;
+	request.swap(part.request);
+	running_parts_--;
+	if (!canceled_ && !failed_) {
+		std::string tag;
+		bool accepted = false;
+		if (succeed && config_.part_result_cb) {
+			accepted = config_.part_result_cb(part.part, response_code, content != nullptr ? *content : std::string(), tag);
+		}
+		else if (succeed && response_code >= 200 && response_code < 300) {
+			accepted = true;
+			request->FindResponseHeader("ETag", tag);
+		}
+		if (accepted) {
+			part.accepted = true;
+			part.tag = tag;
+			accepted_size_ += part.part.size;
+			SavePart(part);
+		}
+		else {
+			failed_ = true;
+			result_code_ = response_code;
+			pending_parts_.clear();
+			CancelParts();
+		}
+	}
+
+	if (!StartNextParts())
+		CancelParts();
+	if (running_parts_ > 0)
+		return;
+	if (canceled_ || failed_) {
+		Complete(false, result_code_);
+		return;
+	}
+	NotifyProgress(total_size_, total_size_);
+	Complete(true, response_code);
+}
+
+void CurlChunkedUpload::CancelParts()
+{
+	for (auto& part : parts_) {
+		if (part.request != nullptr)
+			manager_->RemoveRequest(part.request->GetRequestID());
+	}
+}
+
+void CurlChunkedUpload::Complete(bool succeed, int response_code)
+{
+	std::vector<std::string> tags;
+	if (succeed) {
+		for (auto& part : parts_)
+			tags.push_back(part.tag);
+		// The server has the whole file, nothing is left to resume
+		DeleteSavedParts();
+	}
+	if (succeed && digest_ != nullptr && digest_offset_ == total_size_) {
+		// A download of the same content, e.g. the file forwarded back, links it
+		HttpContentStore store = manager_->GetContentStore();
+		if (store != nullptr)
+			store->AddFile(upload_file_path_, digest_->type(), digest_->Finish());
+	}
+	digest_.reset();
+	parts_.clear();
+	pending_parts_.clear();
+	total_size_ = 0;
+	running_ = false;
+
+	if (!complete_callback_)
+		return;
+	if (reply_task_runner_ != nullptr)
+		NS_EXTENSION::PostTask(reply_task_runner_.get(), FROM_HERE, NS_EXTENSION::Bind(complete_callback_, succeed, response_code, tags));
+	else
+		complete_callback_(succeed, response_code, tags);
+}
+
+void CurlChunkedUpload::NotifyProgress(long long uploaded, long long total_size)
+{
+	if (!progress_callback_)
+		return;
+	if (reply_task_runner_ != nullptr)
+		NS_EXTENSION::PostTask(reply_task_runner_.get(), FROM_HERE, NS_EXTENSION::Bind(progress_callback_, (double)total_size, (double)uploaded, 0.0, 0.0));
+	else
+		progress_callback_((double)total_size, (double)uploaded, 0.0, 0.0);
+}
+
+HTTP_END_DECLS
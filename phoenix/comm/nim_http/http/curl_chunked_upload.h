@@ -0,0 +1,102 @@
+#ifndef __BASE_HTTP_CURL_CHUNKED_UPLOAD_H__
+#define __BASE_HTTP_CURL_CHUNKED_UPLOAD_H__
+
+#include "nim_http/config/build_config.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "nim_db/db_sqlite3.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+class DownloadDigest;
+// Splits the file into the parts of |config|, posts |config.concurrency| of
+// them at a time to |manager| and records every accepted part in the
+// "http_upload" and "http_upload_part" tables of |config.db_path|. The saved
+// parts are dropped if the size of the file or of the parts changed.
+// A part is read into memory before it is posted, so that a retry can send
+// it again, at most |concurrency| parts are in memory.
+// The file is hashed by the parts read in order, an upload resumed with
+// some parts accepted before is not added to the content store.
+// The callbacks run on the thread calling Start() if it has a task runner,
+// otherwise on the transfer thread.
+class CurlChunkedUpload : public IChunkedUpload,
+	public std::enable_shared_from_this<CurlChunkedUpload>
+{
+public:
+	CurlChunkedUpload(const HttpManager& manager,
+					  const std::string& url,
+					  const std::string& upload_file_path,
+					  const HttpChunkedUploadConfig& config,
+					  const ChunkedUploadCallback& complete_cb,
+					  const ProgressCallback& progress_cb = ProgressCallback());
+	virtual ~CurlChunkedUpload();
+
+	virtual bool Start() override;
+	virtual void Cancel() override;
+	virtual bool IsRunning() const override;
+	virtual bool Reset() override;
+
+private:
+	struct Part
+	{
+		Part() : accepted(false), sent(0) {}
+		HttpUploadPart part;
+		bool accepted;
+		std::string tag;
+		// Bytes of the running request sent, for the progress
+		long long sent;
+		std::shared_ptr<CurlHttpRequest> request;
+	};
+
+	// Called with |mutex_| locked
+	bool OpenDatabase();
+	bool LoadParts(long long total_size);
+	bool SavePart(const Part& part);
+	void DeleteSavedParts();
+	bool StartNextParts();
+	bool StartPart(size_t index);
+	void OnPartProgress(size_t index, double uploaded);
+	void OnPartCompleted(size_t index, const std::shared_ptr<std::string>& content, bool succeed, int response_code);
+	void CancelParts();
+	// Called with |mutex_| locked
+	void Complete(bool succeed, int response_code);
+	void NotifyProgress(long long uploaded, long long total_size);
+
+	HttpManager manager_;
+	std::string url_;
+	std::string upload_file_path_;
+	HttpChunkedUploadConfig config_;
+	ChunkedUploadCallback complete_callback_;
+	ProgressCallback progress_callback_;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner_;
+
+	// Recursive, the completion callback may start the upload again
+	mutable std::recursive_mutex mutex_;
+	bool running_;
+	bool canceled_;
+	bool failed_;
+	int result_code_;
+	long long total_size_;
+	// Bytes of the accepted parts
+	long long accepted_size_;
+	long long reported_size_;
+	size_t running_parts_;
+	std::vector<Part> parts_;
+	// Indexes of the parts not accepted and not running
+	std::deque<size_t> pending_parts_;
+	// Of the content store, null if the manager has none
+	std::unique_ptr<DownloadDigest> digest_;
+	// The bytes hashed, the parts are read from the start of the file
+	long long digest_offset_;
+	base::db::SQLiteDB db_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlChunkedUpload);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CURL_CHUNKED_UPLOAD_H__
@@ -0,0 +1,578 @@
+#include "nim_http/http/curl_download_manager.h"
+#include <algorithm>
+#include "base/files/file_path.h"
+#include "base/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "extension/callback/post_task.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/file_deleter.h"
+#include "extension/strings/string_util.h"
+#include "extension/tools/tool.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+HTTP_BEGIN_DECLS
+
+namespace {
+const int kMaxDownloads = 16;
+const int64_t kBytesPerMB = 1024 * 1024;
+
+const char kCreateDownloadTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_download("
+	"download_id INTEGER PRIMARY KEY NOT NULL, "
+	"url TEXT NOT NULL, "
+	"file_path TEXT NOT NULL, "
+	"expected_size INTEGER NOT NULL, "
+	"digest_type INTEGER NOT NULL, "
+	"digest TEXT NOT NULL DEFAULT '', "
+	"priority INTEGER NOT NULL, "
+	"add_time INTEGER NOT NULL)";
+
+std::string TempFilePath(const std::string& file_path)
+{
+	return file_path + ".tmp";
+}
+
+std::string CfgFilePath(const std::string& file_path)
+{
+	return file_path + ".cfg";
+}
+
+std::string DirectoryOf(const std::string& file_path)
+{
+	std::string directory;
+	NS_EXTENSION::FilePathApartDirectory(file_path, directory);
+	return directory;
+}
+
+// The downloads of the same key are the same content
+std::string ContentKey(const HttpDownloadTask& task)
+{
+	if (task.digest_type != DIGEST_NONE && !task.digest.empty())
+		return std::to_string((int)task.digest_type) + ":" + NS_EXTENSION::MakeLowerString(task.digest);
+	return "url:" + task.url;
+}
+
+// The disk |directory| is on, the directory has to exist
+std::string StorageDeviceOf(const std::string& directory)
+{
+#if defined(OS_WIN)
+	wchar_t volume[MAX_PATH] = { 0 };
+	if (::GetVolumePathNameW(base::FilePath::FromUTF8Unsafe(directory).value().c_str(), volume, MAX_PATH))
+		return NS_EXTENSION::MakeLowerString(NS_EXTENSION::UTF16ToUTF8(volume, wcslen(volume)));
+#else
+	struct stat info;
+	if (stat(directory.c_str(), &info) == 0)
+		return std::to_string((unsigned long long)info.st_dev);
+#endif
+	return directory;
+}
+
+// The bytes of the temp file written by the last attempt, recorded in the
+// cfg file by CurlHttpRequest, -1 if there is none
+long long ReadRangeStart(const std::string& file_path)
+{
+	long long range_start = -1;
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> cfg_file(NS_EXTENSION::OpenFile(CfgFilePath(file_path), "rb"));
+	if (!cfg_file || fread(&range_start, 1, sizeof(range_start), cfg_file.get()) != sizeof(range_start))
+		return -1;
+	// The temp file may be preallocated longer
+	if (range_start < 0 || NS_EXTENSION::GetFileSize(TempFilePath(file_path)) < range_start)
+		return -1;
+	return range_start;
+}
+
+// Returns where the download resumes, the temp and the cfg files which a
+// resume request opens are created for a download from the start
+long long PrepareResume(const std::string& file_path)
+{
+	long long range_start = ReadRangeStart(file_path);
+	if (range_start >= 0)
+		return range_start;
+
+	range_start = 0;
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> temp_file(NS_EXTENSION::OpenFile(TempFilePath(file_path), "wb"));
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> cfg_file(NS_EXTENSION::OpenFile(CfgFilePath(file_path), "wb"));
+	if (!temp_file || !cfg_file || fwrite(&range_start, 1, sizeof(range_start), cfg_file.get()) != sizeof(range_start))
+		return -1;
+	return range_start;
+}
+
+std::string TextField(base::db::SQLiteStatement& statement, int index)
+{
+	const char* text = statement.GetTextField(index);
+	return text != nullptr ? std::string(text) : std::string();
+}
+}
+
+CurlDownloadManager::CurlDownloadManager(const HttpManager& manager, const HttpDownloadManagerConfig& config) :
+	manager_(manager), config_(config), next_id_(1)
+{
+	config_.max_downloads = std::min(std::max(config_.max_downloads, 1), kMaxDownloads);
+	config_.max_downloads_per_device = std::min(std::max(config_.max_downloads_per_device, 1), config_.max_downloads);
+	config_.reserved_disk_mb = std::max<int64_t>(config_.reserved_disk_mb, 0);
+}
+
+CurlDownloadManager::~CurlDownloadManager()
+{
+	db_.Close();
+}
+
+void CurlDownloadManager::Restore()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (!OpenDatabase())
+		return;
+
+	std::vector<std::pair<HttpDownloadID, HttpDownloadTask>> saved;
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT download_id, url, file_path, expected_size, digest_type, digest, priority "
+			"FROM http_download ORDER BY download_id") != SQLITE_OK)
+			return;
+		while (statement.NextRow() == SQLITE_ROW) {
+			HttpDownloadTask task;
+			task.url = TextField(statement, 1);
+			task.file_path = TextField(statement, 2);
+			task.expected_size = statement.GetInt64Field(3);
+			task.digest_type = (HTTP_DIGEST)statement.GetIntField(4);
+			task.digest = TextField(statement, 5);
+			int priority = statement.GetIntField(6);
+			task.priority = priority >= PRIORITY_BACKGROUND && priority < PRIORITY_COUNT ? (HTTP_PRIORITY)priority : PRIORITY_BACKGROUND;
+			saved.emplace_back(statement.GetInt64Field(0), task);
+		}
+	}
+	for (const auto& item : saved) {
+		// A row of a download added twice, the first one is kept
+		if (item.second.url.empty() || item.second.file_path.empty() || Enqueue(item.second, item.first, nullptr) != item.first)
+			DeleteSavedDownload(item.first);
+	}
+	ScheduleLocked();
+}
+
+HttpDownloadID CurlDownloadManager::Add(const HttpDownloadTask& task,
+										const CompletionCallback& complete_cb,
+										const ProgressCallback& progress_cb)
+{
+	if (task.url.empty() || task.file_path.empty() || manager_ == nullptr)
+		return 0;
+
+	Callbacks callbacks;
+	callbacks.complete_cb = complete_cb;
+	callbacks.progress_cb = progress_cb;
+	if (base::ThreadTaskRunnerHandle::IsSet())
+		callbacks.reply_task_runner = base::ThreadTaskRunnerHandle::Get();
+
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	size_t count = downloads_.size();
+	HttpDownloadID id = Enqueue(task, 0, &callbacks);
+	if (downloads_.size() > count && OpenDatabase())
+		SaveDownload(*downloads_[id]);
+	ScheduleLocked();
+	return id;
+}
+
+void CurlDownloadManager::Cancel(HttpDownloadID id)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	auto iter = downloads_.find(id);
+	if (iter == downloads_.end())
+		return;
+
+	DownloadPtr download = iter->second;
+	downloads_.erase(iter);
+	DeleteSavedDownload(id);
+	auto leader = leaders_.find(download->key);
+	if (leader == leaders_.end() || leader->second != download) {
+		if (leader != leaders_.end()) {
+			auto& followers = leader->second->followers;
+			followers.erase(std::remove(followers.begin(), followers.end(), download), followers.end());
+		}
+		return;
+	}
+
+	leaders_.erase(leader);
+	download->callbacks.clear();
+	if (download->running) {
+		download->canceled = true;
+		manager_->RemoveRequest(download->request->GetRequestID());
+	}
+	else {
+		queue_.remove(download);
+	}
+	// The first follower downloads for the others
+	if (!download->followers.empty()) {
+		DownloadPtr next = download->followers.front();
+		next->followers.assign(download->followers.begin() + 1, download->followers.end());
+		download->followers.clear();
+		leaders_[next->key] = next;
+		InsertQueued(next);
+	}
+	ScheduleLocked();
+}
+
+void CurlDownloadManager::Schedule()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	ScheduleLocked();
+}
+
+size_t CurlDownloadManager::GetRunningCount() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return running_.size();
+}
+
+size_t CurlDownloadManager::GetQueuedCount() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return queue_.size();
+}
+
+bool CurlDownloadManager::OpenDatabase()
+{
+	if (db_.IsValid())
+		return true;
+	if (config_.db_path.empty())
+		return false;
+	if (!db_.Open(config_.db_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateDownloadTableSql) != SQLITE_OK) {
+		db_.Close();
+		return false;
+	}
+	return true;
+}
+
+bool CurlDownloadManager::SaveDownload(const Download& download)
+{
+	if (!db_.IsValid())
+		return false;
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "INSERT OR REPLACE INTO http_download(download_id, url, file_path, expected_size, "
+		"digest_type, digest, priority, add_time) VALUES(?, ?, ?, ?, ?, ?, ?, ?)") != SQLITE_OK)
+		return false;
+	const HttpDownloadTask& task = download.task;
+	statement.BindInt64(1, download.id);
+	statement.BindText(2, task.url.data(), task.url.size());
+	statement.BindText(3, task.file_path.data(), task.file_path.size());
+	statement.BindInt64(4, task.expected_size);
+	statement.BindInt(5, task.digest_type);
+	statement.BindText(6, task.digest.data(), task.digest.size());
+	statement.BindInt(7, task.priority);
+	statement.BindInt64(8, base::Time::Now().ToTimeT());
+	return statement.NextRow() == SQLITE_DONE;
+}
+
+void CurlDownloadManager::DeleteSavedDownload(HttpDownloadID id)
+{
+	if (!db_.IsValid())
+		return;
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "DELETE FROM http_download WHERE download_id = ?") == SQLITE_OK) {
+		statement.BindInt64(1, id);
+		statement.NextRow();
+	}
+}
+
+HttpDownloadID CurlDownloadManager::Enqueue(const HttpDownloadTask& task, HttpDownloadID id, const Callbacks* callbacks)
+{
+	std::string key = ContentKey(task);
+	auto leader = leaders_.find(key);
+	if (leader != leaders_.end()) {
+		DownloadPtr same_file;
+		if (leader->second->task.file_path == task.file_path)
+			same_file = leader->second;
+		for (const auto& follower : leader->second->followers) {
+			if (same_file == nullptr && follower->task.file_path == task.file_path)
+				same_file = follower;
+		}
+		// The transfer is made for the highest priority waiting for it
+		DownloadPtr transfer = leader->second;
+		if (task.priority > transfer->task.priority) {
+			transfer->task.priority = task.priority;
+			if (transfer->running) {
+				manager_->SetRequestPriority(transfer->request->GetRequestID(), task.priority);
+			}
+			else {
+				queue_.remove(transfer);
+				InsertQueued(transfer);
+			}
+		}
+		if (same_file != nullptr) {
+			if (callbacks != nullptr)
+				same_file->callbacks.push_back(*callbacks);
+			return same_file->id;
+		}
+	}
+
+	auto download = std::make_shared<Download>();
+	download->id = id > 0 ? id : next_id_;
+	next_id_ = std::max(next_id_, download->id + 1);
+	download->task = task;
+	download->key = key;
+	if (callbacks != nullptr)
+		download->callbacks.push_back(*callbacks);
+	downloads_[download->id] = download;
+	if (leader != leaders_.end()) {
+		leader->second->followers.push_back(download);
+	}
+	else {
+		leaders_[key] = download;
+		InsertQueued(download);
+	}
+	return download->id;
+}
+
+void CurlDownloadManager::InsertQueued(const DownloadPtr& download)
+{
+	auto iter = queue_.begin();
+	while (iter != queue_.end() && (*iter)->task.priority >= download->task.priority)
+		++iter;
+	queue_.insert(iter, download);
+}
+
+void CurlDownloadManager::ScheduleLocked()
+{
+	// Completed after the loop, the callbacks may change the queue
+	std::vector<std::pair<DownloadPtr, bool>> completed;
+	for (auto iter = queue_.begin(); iter != queue_.end() && running_.size() < (size_t)config_.max_downloads;) {
+		DownloadPtr download = *iter;
+		if (LinkFromContentStore(*download)) {
+			iter = queue_.erase(iter);
+			completed.emplace_back(download, true);
+			continue;
+		}
+		if (download->device.empty()) {
+			std::string directory = DirectoryOf(download->task.file_path);
+			NS_EXTENSION::CreateDirectory(directory);
+			download->device = StorageDeviceOf(directory);
+		}
+		// A download of a smaller file or on another disk may go first
+		auto device = running_per_device_.find(download->device);
+		if ((device != running_per_device_.end() && device->second >= config_.max_downloads_per_device)
+			|| IsFileBusy(download->task.file_path) || !HasDiskSpace(*download)) {
+			++iter;
+			continue;
+		}
+		iter = queue_.erase(iter);
+		if (!StartDownload(download))
+			completed.emplace_back(download, false);
+	}
+	for (const auto& item : completed)
+		Complete(item.first, item.second, item.second ? 200 : CURLE_WRITE_ERROR);
+}
+
+bool CurlDownloadManager::IsFileBusy(const std::string& file_path) const
+{
+	// A canceled request may still be writing the temp file
+	for (const auto& item : running_) {
+		if (item.second->task.file_path == file_path)
+			return true;
+	}
+	return false;
+}
+
+bool CurlDownloadManager::HasDiskSpace(Download& download)
+{
+	std::string directory = DirectoryOf(download.task.file_path);
+	int64_t free_mb = NS_EXTENSION::GetDiskSpaceInfo(directory);
+	// 0 is also returned if the space can not be told
+	if (free_mb <= 0 && !NS_EXTENSION::FilePathIsExist(directory, true))
+		return true;
+
+	int64_t required_bytes = RemainingBytesOnDevice(download.device);
+	if (download.task.expected_size > 0)
+		required_bytes += std::max<int64_t>(download.task.expected_size - std::max(ReadRangeStart(download.task.file_path), 0LL), 0);
+	int64_t required_mb = (required_bytes + kBytesPerMB - 1) / kBytesPerMB + config_.reserved_disk_mb;
+	if (free_mb >= required_mb)
+		return true;
+
+	if (!download.disk_full_reported && config_.disk_full_cb) {
+		download.disk_full_reported = true;
+		config_.disk_full_cb(download.id, directory, required_mb, free_mb);
+	}
+	return false;
+}
+
+int64_t CurlDownloadManager::RemainingBytesOnDevice(const std::string& device) const
+{
+	int64_t remaining = 0;
+	for (const auto& item : running_) {
+		const Download& download = *item.second;
+		if (download.device == device && download.task.expected_size > 0)
+			remaining += std::max<int64_t>(download.task.expected_size - download.range_start - download.downloaded, 0);
+	}
+	return remaining;
+}
+
+bool CurlDownloadManager::LinkFromContentStore(const Download& download)
+{
+	HttpContentStore store = manager_->GetContentStore();
+	if (store == nullptr || download.task.digest_type == DIGEST_NONE || download.task.digest.empty())
+		return false;
+	std::string hex = NS_EXTENSION::MakeLowerString(download.task.digest);
+	if (!store->Contains(download.task.digest_type, hex))
+		return false;
+	NS_EXTENSION::CreateDirectory(DirectoryOf(download.task.file_path));
+	if (!store->LinkTo(download.task.digest_type, hex, download.task.file_path))
+		return false;
+	// The bytes written before are not needed any more
+	NS_EXTENSION::DeleteFile(TempFilePath(download.task.file_path));
+	NS_EXTENSION::DeleteFile(CfgFilePath(download.task.file_path));
+	return true;
+}
+
+bool CurlDownloadManager::StartDownload(const DownloadPtr& download)
+{
+	long long range_start = PrepareResume(download->task.file_path);
+	if (range_start < 0)
+		return false;
+
+	download->range_start = range_start;
+	download->downloaded = 0;
+	download->disk_full_reported = false;
+	// The request keeps the manager alive until it is completed
+	auto self = shared_from_this();
+	HttpDownloadID id = download->id;
+	download->request = std::make_shared<CurlHttpRequest>(download->task.url, download->task.file_path, range_start,
+		[self, id](bool succeed, int response_code) {
+		self->OnDownloadCompleted(id, succeed, response_code);
+	},
+		[self, id](double, double, double total, double downloaded) {
+		self->OnDownloadProgress(id, downloaded, total);
+	});
+	if (download->task.digest_type != DIGEST_NONE)
+		download->request->SetContentDigest(download->task.digest_type, download->task.digest);
+	download->request->SetPriority(download->task.priority);
+	download->running = true;
+	running_[id] = download;
+	running_per_device_[download->device]++;
+
+	HttpRequest request = download->request;
+	manager_->PostRequest(request);
+	return true;
+}
+
+void CurlDownloadManager::OnDownloadProgress(HttpDownloadID id, double downloaded, double total)
+{
+	std::vector<Callbacks> callbacks;
+	long long range_start = 0;
+	{
+		std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+		auto iter = running_.find(id);
+		if (iter == running_.end() || iter->second->canceled)
+			return;
+		Download& download = *iter->second;
+		download.downloaded = (long long)downloaded;
+		range_start = download.range_start;
+		callbacks = download.callbacks;
+		for (const auto& follower : download.followers)
+			callbacks.insert(callbacks.end(), follower->callbacks.begin(), follower->callbacks.end());
+	}
+	// Of the whole file, the bytes written before included
+	double file_total = total > 0 ? total + range_start : 0.0;
+	double file_downloaded = downloaded + range_start;
+	for (const auto& item : callbacks) {
+		if (!item.progress_cb)
+			continue;
+		if (item.reply_task_runner != nullptr)
+			NS_EXTENSION::PostTask(item.reply_task_runner.get(), FROM_HERE, NS_EXTENSION::Bind(item.progress_cb, 0.0, 0.0, file_total, file_downloaded));
+		else
+			item.progress_cb(0.0, 0.0, file_total, file_downloaded);
+	}
+}
+
+void CurlDownloadManager::OnDownloadCompleted(HttpDownloadID id, bool succeed, int response_code)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	auto iter = running_.find(id);
+	if (iter == running_.end())
+		return;
+
+	DownloadPtr download = iter->second;
+	running_.erase(iter);
+	auto device = running_per_device_.find(download->device);
+	if (device != running_per_device_.end() && --device->second <= 0)
+		running_per_device_.erase(device);
+	download->running = false;
+	if (!download->canceled)
+		Complete(download, succeed, response_code);
+	download->request.reset();
+	ScheduleLocked();
+}
+
+bool CurlDownloadManager::FinishFile(const Download& download)
+{
+	const std::string& file_path = download.task.file_path;
+	std::string temp_path = TempFilePath(file_path);
+	if (!NS_EXTENSION::FilePathIsExist(temp_path, false)) {
+		// Linked from the content store
+		return NS_EXTENSION::FilePathIsExist(file_path, false);
+	}
+	NS_EXTENSION::DeleteFile(file_path);
+	if (!NS_EXTENSION::MoveFile(temp_path, file_path))
+		return false;
+	NS_EXTENSION::DeleteFile(CfgFilePath(file_path));
+
+	// The request does not add a resumed download, its file is moved here
+	HttpContentStore store = manager_->GetContentStore();
+	if (store != nullptr && download.request != nullptr && download.task.digest_type != DIGEST_NONE) {
+		std::string digest = download.request->GetContentDigest();
+		if (!digest.empty())
+			store->AddFile(file_path, download.task.digest_type, digest);
+	}
+	return true;
+}
+
+bool CurlDownloadManager::CopyToFollower(const Download& download, const Download& follower)
+{
+	const std::string& file_path = follower.task.file_path;
+	NS_EXTENSION::CreateDirectory(DirectoryOf(file_path));
+	HttpContentStore store = manager_->GetContentStore();
+	if (store != nullptr && download.task.digest_type != DIGEST_NONE && !download.task.digest.empty()
+		&& store->LinkTo(download.task.digest_type, NS_EXTENSION::MakeLowerString(download.task.digest), file_path))
+		return true;
+	NS_EXTENSION::DeleteFile(file_path);
+	return NS_EXTENSION::CopyFile(download.task.file_path, file_path);
+}
+
+void CurlDownloadManager::Complete(const DownloadPtr& download, bool succeed, int response_code)
+{
+	auto leader = leaders_.find(download->key);
+	if (leader != leaders_.end() && leader->second == download)
+		leaders_.erase(leader);
+	downloads_.erase(download->id);
+	DeleteSavedDownload(download->id);
+	if (succeed && !FinishFile(*download)) {
+		succeed = false;
+		response_code = CURLE_WRITE_ERROR;
+	}
+	std::vector<DownloadPtr> followers;
+	followers.swap(download->followers);
+	Notify(*download, succeed, response_code);
+
+	for (const auto& follower : followers) {
+		downloads_.erase(follower->id);
+		DeleteSavedDownload(follower->id);
+		bool copied = succeed && CopyToFollower(*download, *follower);
+		Notify(*follower, copied, succeed && !copied ? CURLE_WRITE_ERROR : response_code);
+	}
+}
+
+void CurlDownloadManager::Notify(const Download& download, bool succeed, int response_code)
+{
+	for (const auto& item : download.callbacks) {
+		if (!item.complete_cb)
+			continue;
+		if (item.reply_task_runner != nullptr)
+			NS_EXTENSION::PostTask(item.reply_task_runner.get(), FROM_HERE, NS_EXTENSION::Bind(item.complete_cb, succeed, response_code));
+		else
+			item.complete_cb(succeed, response_code);
+	}
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,120 @@
+#ifndef __BASE_HTTP_CURL_DOWNLOAD_MANAGER_H__
+#define __BASE_HTTP_CURL_DOWNLOAD_MANAGER_H__
+
+#include "nim_http/config/build_config.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+#include "nim_db/db_sqlite3.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// Runs the queued downloads as resume requests posted to |manager|. A
+// download is started when the total and the per device slots of |config|
+// allow it and the disk of its file has room for the rest of it, the
+// remaining bytes of the running downloads on the disk and
+// |config.reserved_disk_mb| counted as taken. The disk is told by the
+// device of the directory on POSIX and by the volume on Windows.
+// The downloads of the same content share the transfer of the first one,
+// the others wait for it as its followers.
+// The queue is recorded in the "http_download" table of |config.db_path|,
+// a row is deleted when its download is completed or canceled.
+class CurlDownloadManager : public IHttpDownloadManager,
+	public std::enable_shared_from_this<CurlDownloadManager>
+{
+public:
+	CurlDownloadManager(const HttpManager& manager, const HttpDownloadManagerConfig& config);
+	virtual ~CurlDownloadManager();
+
+	// Queues the downloads persisted by the last run and starts them
+	void Restore();
+
+	virtual HttpDownloadID Add(const HttpDownloadTask& task,
+		const CompletionCallback& complete_cb,
+		const ProgressCallback& progress_cb = ProgressCallback()) override;
+	virtual void Cancel(HttpDownloadID id) override;
+	virtual void Schedule() override;
+	virtual size_t GetRunningCount() const override;
+	virtual size_t GetQueuedCount() const override;
+
+private:
+	struct Callbacks
+	{
+		CompletionCallback complete_cb;
+		ProgressCallback progress_cb;
+		scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner;
+	};
+	struct Download
+	{
+		Download() : id(0), running(false), canceled(false), disk_full_reported(false), range_start(0), downloaded(0) {}
+		HttpDownloadID id;
+		HttpDownloadTask task;
+		std::string key;
+		std::string device;
+		std::vector<Callbacks> callbacks;
+		// Of the same content to other paths, they get the file when this
+		// download succeeds
+		std::vector<std::shared_ptr<Download>> followers;
+		bool running;
+		// Canceled while running, it keeps its slot until the request is
+		// completed
+		bool canceled;
+		bool disk_full_reported;
+		long long range_start;
+		// Bytes of the running request, for the disk space still needed
+		long long downloaded;
+		std::shared_ptr<CurlHttpRequest> request;
+	};
+	using DownloadPtr = std::shared_ptr<Download>;
+
+	// Called with |mutex_| locked
+	bool OpenDatabase();
+	bool SaveDownload(const Download& download);
+	void DeleteSavedDownload(HttpDownloadID id);
+	HttpDownloadID Enqueue(const HttpDownloadTask& task, HttpDownloadID id, const Callbacks* callbacks);
+	void InsertQueued(const DownloadPtr& download);
+	void ScheduleLocked();
+	bool IsFileBusy(const std::string& file_path) const;
+	bool HasDiskSpace(Download& download);
+	int64_t RemainingBytesOnDevice(const std::string& device) const;
+	bool LinkFromContentStore(const Download& download);
+	bool StartDownload(const DownloadPtr& download);
+	void OnDownloadProgress(HttpDownloadID id, double downloaded, double total);
+	void OnDownloadCompleted(HttpDownloadID id, bool succeed, int response_code);
+	// Moves the temp file of a completed download into place, false if the
+	// file is not there
+	bool FinishFile(const Download& download);
+	bool CopyToFollower(const Download& download, const Download& follower);
+	// Called with |mutex_| locked, the download and its followers are dropped
+	void Complete(const DownloadPtr& download, bool succeed, int response_code);
+	void Notify(const Download& download, bool succeed, int response_code);
+
+	HttpManager manager_;
+	HttpDownloadManagerConfig config_;
+
+	// Recursive, a completion callback run on the transfer thread may add
+	// or cancel a download
+	mutable std::recursive_mutex mutex_;
+	HttpDownloadID next_id_;
+	// The downloads by their ids, followers included
+	std::map<HttpDownloadID, DownloadPtr> downloads_;
+	// The first download of every content key, which runs the transfer
+	std::map<std::string, DownloadPtr> leaders_;
+	// The leaders not running, by priority then by the order added
+	std::list<DownloadPtr> queue_;
+	std::map<HttpDownloadID, DownloadPtr> running_;
+	std::map<std::string, int> running_per_device_;
+	base::db::SQLiteDB db_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlDownloadManager);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CURL_DOWNLOAD_MANAGER_H__
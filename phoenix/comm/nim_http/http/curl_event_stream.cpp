@@ -0,0 +1,402 @@
+#include "nim_http/http/curl_event_stream.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iterator>
+#include "base/thread_task_runner_handle.h"
+#include "extension/callback/post_task.h"
+#include "nim_http/http/http_log.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+// The low speed time of a stream without an idle timeout, curl can not
+// disable it for a single request
+const long kNoIdleTimeoutSeconds = 24 * 3600;
+// The reconnect delay stops doubling after it
+const int kMaxBackoffShift = 16;
+
+bool IsStreamAccepted(long response_code)
+{
+	return response_code / 100 == 2 && response_code != 204;
+}
+}
+
+HttpEventStreamParser::HttpEventStreamParser(HTTP_EVENT_STREAM_FORMAT format, size_t max_event_size) :
+	format_(format), max_event_size_(max_event_size), after_cr_(false), stream_started_(false), retry_ms_(-1)
+{
+}
+
+void HttpEventStreamParser::Reset()
+{
+	line_.clear();
+	after_cr_ = false;
+	stream_started_ = false;
+	event_type_.clear();
+	event_data_.clear();
+}
+
+bool HttpEventStreamParser::Feed(const char* data, size_t size, std::vector<HttpStreamEvent>& events)
+{
+	const char* end = data + size;
+	// A UTF-8 BOM may start the stream, it may come in pieces
+	while (!stream_started_ && data != end) {
+		static const char kBom[] = "\xEF\xBB\xBF";
+		if (line_.size() < 3 && *data == kBom[line_.size()]) {
+			line_.push_back(*data++);
+			if (line_.size() == 3) {
+				line_.clear();
+				stream_started_ = true;
+			}
+			continue;
+		}
+		stream_started_ = true;
+	}
+	while (data != end) {
+		if (after_cr_) {
+			after_cr_ = false;
+			if (*data == '\n') {
+				data++;
+				continue;
+			}
+		}
+		const char* eol = data;
+		while (eol != end && *eol != '\n' && *eol != '\r')
+			eol++;
+		line_.append(data, eol);
+		if (line_.size() + event_data_.size() > max_event_size_)
+			return false;
+		if (eol == end)
+			break;
+		after_cr_ = *eol == '\r';
+		data = eol + 1;
+		ProcessLine(events);
+	}
+	return true;
+}
+
+void HttpEventStreamParser::Finish(std::vector<HttpStreamEvent>& events)
+{
+	if (format_ == EVENT_STREAM_NDJSON && !line_.empty())
+		ProcessLine(events);
+	Reset();
+}
+
+void HttpEventStreamParser::ProcessLine(std::vector<HttpStreamEvent>& events)
+{
+	std::string line;
+	line.swap(line_);
+	if (format_ == EVENT_STREAM_NDJSON) {
+		if (line.find_first_not_of(" \t") == std::string::npos)
+			return;
+		HttpStreamEvent event;
+		event.data = std::move(line);
+		events.push_back(std::move(event));
+		return;
+	}
+
+	if (line.empty()) {
+		DispatchEvent(events);
+		return;
+	}
+	// A comment, e.g. a heartbeat
+	if (line[0] == ':')
+		return;
+	size_t colon = line.find(':');
+	if (colon == std::string::npos) {
+		ProcessField(line, std::string());
+		return;
+	}
+	size_t value_start = colon + 1;
+	if (value_start < line.size() && line[value_start] == ' ')
+		value_start++;
+	ProcessField(line.substr(0, colon), line.substr(value_start));
+}
+
+void HttpEventStreamParser::ProcessField(const std::string& field, const std::string& value)
+{
+	if (field == "event") {
+		event_type_ = value;
+	} else if (field == "data") {
+		event_data_.append(value).push_back('\n');
+	} else if (field == "id") {
+		if (value.find('\0') == std::string::npos)
+			last_event_id_ = value;
+	} else if (field == "retry") {
+		if (!value.empty() && value.find_first_not_of("0123456789") == std::string::npos)
+			retry_ms_ = (int)std::min<long long>(std::strtoll(value.c_str(), nullptr, 10), INT_MAX);
+	}
+}
+
+void HttpEventStreamParser::DispatchEvent(std::vector<HttpStreamEvent>& events)
+{
+	std::string type;
+	type.swap(event_type_);
+	if (event_data_.empty())
+		return;
+	HttpStreamEvent event;
+	event.id = last_event_id_;
+	event.type = type == "message" ? std::string() : std::move(type);
+	event.data.swap(event_data_);
+	event.data.pop_back();
+	events.push_back(std::move(event));
+}
+
+CurlEventStream::CurlEventStream(const HttpManager& manager,
+								 const std::string& url,
+								 const HttpEventStreamConfig& config,
+								 const EventStreamCallback& event_cb,
+								 const EventStreamStateCallback& state_cb) :
+	manager_(manager), url_(url), config_(config), event_callback_(event_cb), state_callback_(state_cb),
+	running_(false), generation_(0), parser_(config.format, config.max_event_size),
+	response_checked_(false), connected_(false), failures_(0), delivery_posted_(false)
+{
+	parser_.set_last_event_id(config.last_event_id);
+}
+
+CurlEventStream::~CurlEventStream()
+{
+}
+
+bool CurlEventStream::Start()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (running_ || manager_ == nullptr)
+		return false;
+
+	running_ = true;
+	generation_++;
+	failures_ = 0;
+	pending_events_.clear();
+	delivery_posted_ = false;
+	reply_task_runner_ = base::ThreadTaskRunnerHandle::IsSet() ? base::ThreadTaskRunnerHandle::Get() : nullptr;
+	Connect();
+	return true;
+}
+
+void CurlEventStream::Stop()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (!running_)
+		return;
+
+	running_ = false;
+	generation_++;
+	if (request_ != nullptr) {
+		manager_->RemoveRequest(request_->GetRequestID());
+		request_.reset();
+	}
+	pending_events_.clear();
+	delivery_posted_ = false;
+}
+
+bool CurlEventStream::IsRunning() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return running_;
+}
+
+std::string CurlEventStream::GetLastEventID() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return parser_.last_event_id();
+}
+
+void CurlEventStream::Connect()
+{
+	parser_.Reset();
+	response_checked_ = false;
+	connected_ = false;
+
+	// The request keeps the stream alive until it is completed or removed
+	auto self = shared_from_this();
+	int generation = generation_;
+	request_ = std::make_shared<CurlHttpRequest>(url_,
+		[self, generation](const std::shared_ptr<std::string>&, bool succeed, int response_code) {
+		self->OnCompleted(generation, succeed, response_code);
+	});
+	CurlHttpRequest* request = request_.get();
+	request_->SetDataCallback([self, generation, request](const char* data, size_t size) {
+		return self->OnData(generation, request, data, size);
+	});
+	request_->AddHeaderField("Accept", config_.format == EVENT_STREAM_SSE ? "text/event-stream" : "application/x-ndjson");
+	request_->AddHeaderField("Cache-Control", "no-cache");
+	if (!parser_.last_event_id().empty())
+		request_->AddHeaderField("Last-Event-ID", parser_.last_event_id());
+	// The idle timeout is the low speed time of the connection
+	request_->SetLowSpeed(1, config_.idle_timeout_ms > 0 ? (config_.idle_timeout_ms + 999) / 1000 : kNoIdleTimeoutSeconds);
+	request_->SetPriority(config_.priority);
+	HttpRequest http_request = request_;
+	if (config_.request_cb)
+		config_.request_cb(http_request);
+	manager_->PostRequest(http_request);
+}
+
+bool CurlEventStream::OnData(int generation, CurlHttpRequest* request, const char* data, size_t size)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (generation != generation_ || !running_)
+		return false;
+
+	if (!response_checked_) {
+		response_checked_ = true;
+		long response_code = request->GetCurrentResponseCode();
+		if (IsStreamAccepted(response_code)) {
+			connected_ = true;
+			failures_ = 0;
+			NotifyState(EVENT_STREAM_CONNECTED, (int)response_code);
+		}
+	}
+	// The body of an error response is not a stream
+	if (!connected_)
+		return true;
+
+	std::vector<HttpStreamEvent> events;
+	bool parsed = parser_.Feed(data, size, events);
+	QueueEvents(events);
+	if (!parsed)
+		HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Event stream {0}, an event exceeds {1} bytes")
+			<< url_ << (int64_t)config_.max_event_size;
+	return parsed;
+}
+
+void CurlEventStream::OnCompleted(int generation, bool succeed, int response_code)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (generation != generation_ || !running_)
+		return;
+
+	logger_ = request_->GetLogger();
+	request_.reset();
+	if (connected_) {
+		std::vector<HttpStreamEvent> events;
+		parser_.Finish(events);
+		QueueEvents(events);
+	}
+	if (!succeed) {
+		Reconnect(response_code);
+		return;
+	}
+	// 204 tells the client to stop reconnecting
+	if (IsStreamAccepted(response_code)) {
+		if (!connected_) {
+			// Ended before a byte, as a failure so that it backs off
+			Reconnect(response_code);
+		} else if (config_.long_poll) {
+			ScheduleConnect(0);
+		} else {
+			NotifyState(EVENT_STREAM_RECONNECTING, response_code);
+			ScheduleConnect(parser_.retry_ms() >= 0 ? parser_.retry_ms() : config_.reconnect_delay_ms);
+		}
+		return;
+	}
+	if (response_code == 408 || response_code == 429 || response_code >= 500) {
+		Reconnect(response_code);
+		return;
+	}
+	Close(response_code);
+}
+
+void CurlEventStream::Reconnect(int response_code)
+{
+	failures_++;
+	if (config_.max_reconnects >= 0 && failures_ > config_.max_reconnects) {
+		Close(response_code);
+		return;
+	}
+	long long delay_ms = parser_.retry_ms() >= 0 ? parser_.retry_ms() : config_.reconnect_delay_ms;
+	delay_ms <<= std::min(failures_ - 1, kMaxBackoffShift);
+	if (delay_ms > config_.max_reconnect_delay_ms)
+		delay_ms = std::max(config_.max_reconnect_delay_ms, 0);
+	HTTP_QLOG_APP(logger_, "[net][http] Event stream {0} dropped {1}, reconnect in {2}ms")
+		<< url_ << response_code << (int64_t)delay_ms;
+	NotifyState(EVENT_STREAM_RECONNECTING, response_code);
+	ScheduleConnect((int)delay_ms);
+}
+
+void CurlEventStream::Close(int response_code)
+{
+	running_ = false;
+	NotifyState(EVENT_STREAM_CLOSED, response_code);
+}
+
+void CurlEventStream::ScheduleConnect(int delay_ms)
+{
+	PostToReply(generation_, [this]() {
+		std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+		if (running_ && request_ == nullptr)
+			Connect();
+	}, delay_ms);
+}
+
+void CurlEventStream::QueueEvents(std::vector<HttpStreamEvent>& events)
+{
+	if (events.empty() || !event_callback_)
+		return;
+	if (pending_events_.empty())
+		pending_events_.swap(events);
+	else
+		std::move(events.begin(), events.end(), std::back_inserter(pending_events_));
+	if (delivery_posted_)
+		return;
+	delivery_posted_ = true;
+	int generation = generation_;
+	PostToReply(generation, [this, generation]() { DeliverEvents(generation); }, config_.batch_interval_ms);
+}
+
+void CurlEventStream::DeliverEvents(int generation)
+{
+	std::vector<HttpStreamEvent> events;
+	{
+		std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+		if (generation != generation_)
+			return;
+		delivery_posted_ = false;
+		events.swap(pending_events_);
+	}
+	if (!events.empty())
+		event_callback_(events);
+}
+
+void CurlEventStream::NotifyState(HTTP_EVENT_STREAM_STATE state, int response_code)
+{
+	if (!state_callback_)
+		return;
+	// The events received before the change are delivered before it
+	int generation = generation_;
+	if (!pending_events_.empty())
+		PostToReply(generation, [this, generation]() { DeliverEvents(generation); });
+	EventStreamStateCallback callback = state_callback_;
+	PostToReply(generation, [callback, state, response_code]() { callback(state, response_code); });
+}
+
+void CurlEventStream::PostToReply(int generation, const StdClosure& task, int delay_ms)
+{
+	// Without the thread of Start() the tasks run on the transfer thread
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner = reply_task_runner_;
+	if (task_runner == nullptr && base::ThreadTaskRunnerHandle::IsSet())
+		task_runner = base::ThreadTaskRunnerHandle::Get();
+	if (task_runner == nullptr) {
+		task();
+		return;
+	}
+	std::weak_ptr<CurlEventStream> weak_self = shared_from_this();
+	auto checked_task = [weak_self, generation, task]() {
+		auto self = weak_self.lock();
+		if (self == nullptr)
+			return;
+		{
+			std::lock_guard<std::recursive_mutex> auto_lock(self->mutex_);
+			if (self->generation_ != generation)
+				return;
+		}
+		task();
+	};
+	if (delay_ms <= 0)
+		NS_EXTENSION::PostTask(task_runner.get(), FROM_HERE, checked_task);
+	else
+		NS_EXTENSION::PostDelayedTask(task_runner.get(), FROM_HERE, checked_task,
+			NS_EXTENSION::TimeDelta::FromMilliseconds(delay_ms));
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,122 @@
+#ifndef __BASE_HTTP_CURL_EVENT_STREAM_H__
+#define __BASE_HTTP_CURL_EVENT_STREAM_H__
+
+#include "nim_http/config/build_config.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// Splits the body of an event stream into events chunk by chunk, the
+// chunks may break anywhere, even inside a CRLF or a UTF-8 sequence.
+// SSE follows the parsing rules of the HTML spec: lines end by CR, LF or
+// CRLF, a blank line dispatches the event, an event without data is
+// dropped and so is an incomplete one at the end of the stream.
+class HttpEventStreamParser
+{
+public:
+	HttpEventStreamParser(HTTP_EVENT_STREAM_FORMAT format, size_t max_event_size);
+
+	// Forgets the partial line and event of the last connection, the last
+	// event id and the retry delay are kept
+	void Reset();
+	// Appends the events completed by |data| to |events|, false if a line
+	// or an event exceeds the max size
+	bool Feed(const char* data, size_t size, std::vector<HttpStreamEvent>& events);
+	// Called at the end of a response, a NDJSON line without the last
+	// newline is an event too
+	void Finish(std::vector<HttpStreamEvent>& events);
+
+	const std::string& last_event_id() const { return last_event_id_; }
+	void set_last_event_id(const std::string& id) { last_event_id_ = id; }
+	// Set by the "retry:" field, negative if none
+	int retry_ms() const { return retry_ms_; }
+
+private:
+	void ProcessLine(std::vector<HttpStreamEvent>& events);
+	void ProcessField(const std::string& field, const std::string& value);
+	void DispatchEvent(std::vector<HttpStreamEvent>& events);
+
+	HTTP_EVENT_STREAM_FORMAT format_;
+	size_t max_event_size_;
+	std::string line_;
+	// The last chunk ended by a CR, a LF starting the next one belongs to it
+	bool after_cr_;
+	bool stream_started_;
+	std::string event_type_;
+	std::string event_data_;
+	std::string last_event_id_;
+	int retry_ms_;
+};
+
+// Posts a long-lived request to |manager| and parses its response by
+// HttpEventStreamParser while it is received, see IHttpEventStream.
+// The events of the transfer thread are gathered in |pending_events_| and
+// delivered by one task per |config.batch_interval_ms|. A connection which
+// ends is posted again after the delay of HttpEventStreamConfig, with the
+// Last-Event-ID of the last event.
+class CurlEventStream : public IHttpEventStream,
+	public std::enable_shared_from_this<CurlEventStream>
+{
+public:
+	CurlEventStream(const HttpManager& manager,
+					const std::string& url,
+					const HttpEventStreamConfig& config,
+					const EventStreamCallback& event_cb,
+					const EventStreamStateCallback& state_cb = EventStreamStateCallback());
+	virtual ~CurlEventStream();
+
+	virtual bool Start() override;
+	virtual void Stop() override;
+	virtual bool IsRunning() const override;
+	virtual std::string GetLastEventID() const override;
+
+private:
+	// Called with |mutex_| locked
+	void Connect();
+	bool OnData(int generation, CurlHttpRequest* request, const char* data, size_t size);
+	void OnCompleted(int generation, bool succeed, int response_code);
+	// Called with |mutex_| locked
+	void Reconnect(int response_code);
+	void Close(int response_code);
+	void ScheduleConnect(int delay_ms);
+	void QueueEvents(std::vector<HttpStreamEvent>& events);
+	void DeliverEvents(int generation);
+	void NotifyState(HTTP_EVENT_STREAM_STATE state, int response_code);
+	// Runs |task| on the thread of the callbacks if it is a stream of
+	// |generation| then, called with |mutex_| locked
+	void PostToReply(int generation, const StdClosure& task, int delay_ms = 0);
+
+	HttpManager manager_;
+	std::string url_;
+	HttpEventStreamConfig config_;
+	EventStreamCallback event_callback_;
+	EventStreamStateCallback state_callback_;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner_;
+
+	// Recursive, PostRequest() may complete a request at once
+	mutable std::recursive_mutex mutex_;
+	bool running_;
+	// Increased by Start() and Stop(), the callbacks of an older one are dropped
+	int generation_;
+	std::shared_ptr<CurlHttpRequest> request_;
+	// Of the last request, set by the manager
+	NS_NIMLOG::Logger logger_;
+	HttpEventStreamParser parser_;
+	// The response of |request_| is checked on its first chunk
+	bool response_checked_;
+	bool connected_;
+	int failures_;
+	std::vector<HttpStreamEvent> pending_events_;
+	bool delivery_posted_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlEventStream);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CURL_EVENT_STREAM_H__
@@ -2,23 +2,57 @@
 #include "nim_http/http/curl_http_request.h"
 
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
 
 #include "base/thread_task_runner_handle.h"
 #include "base/files/file_util.h"
 
 #include "extension/strings/string_util.h"
+#include "extension/strings/string_format.h"
 #include "extension/callback/post_task.h"
 #include "extension/file_util/utf8_file_util.h"
+#include "extension/network/address_selector.h"
+#include "extension/network/network_quality_estimator.h"
+#include "extension/time/coarse_clock.h"
 #include "nim_log/wrapper/log.h"
+#include "nim_http/http/callback_batcher.h"
+#include "nim_http/http/download_file_util.h"
+#include "nim_http/http/http_metrics.h"
 
 USING_NS_EXTENSION;
 
 HTTP_BEGIN_DECLS
 
+// A larger Content-Length is not trusted to reserve the memory at once
+const double kMaxReservedContentLength = 64 * 1024 * 1024;
+const int kDefaultProgressIntervalMs = 100;
+// The transfer waits for the disk when more is written but not completed
+const size_t kMaxPendingWriteBytes = 16 * 1024 * 1024;
+// The chunks of curl, 16KB at most, are written to the file in blocks of it
+const size_t kFileWriteBufferSize = 256 * 1024;
+// The capacity of the content buffers of all the requests alive
+std::atomic<int64_t> g_live_content_bytes(0);
+// A range download records its offset after this is written, not per chunk
+const long long kRangeCheckpointBytes = 1024 * 1024;
+
 CurlHttpRequest::~CurlHttpRequest()
 {
 	if (on_release_callback_ != nullptr)
 		on_release_callback_(this);
+	g_live_content_bytes -= (int64_t)accounted_content_bytes_;
+}
+int64_t CurlHttpRequest::GetLiveContentBytes()
+{
+	return g_live_content_bytes;
+}
+void CurlHttpRequest::AccountContent()
+{
+	size_t bytes = content_ != nullptr ? content_->capacity() : 0;
+	if (bytes == accounted_content_bytes_)
+		return;
+	g_live_content_bytes += (int64_t)bytes - (int64_t)accounted_content_bytes_;
+	accounted_content_bytes_ = bytes;
 }
 size_t CurlHttpRequest::WriteHeader(void* ptr,size_t size,	size_t count,void* param)
 {
@@ -26,20 +60,9 @@ size_t CurlHttpRequest::WriteHeader(void* ptr,size_t size,	size_t count,void* pa
 	CurlHttpRequest *request = static_cast<CurlHttpRequest *>(param);
 	if (bytes_to_store > 0 && request != nullptr)
 	{
-		std::string response_head_item;
-		response_head_item.append(static_cast<char *>(ptr), bytes_to_store);
-		int rsp_code = request->IncludeResponseCode(response_head_item);
-		if (rsp_code > 0)
-		{
-			if(request->response_code_ == 0)
-				request->response_code_ = rsp_code;			
-		}
-		else
-		{
-			NS_EXTENSION::StringReplaceAll(std::string("\r\n"), std::string(""), response_head_item);
-			if (!response_head_item.empty())
-				request->rsp_head_list_.emplace_back(std::forward<std::string>(response_head_item));			
-		}
+		int rsp_code = request->response_headers_.AppendLine(static_cast<const char *>(ptr), bytes_to_store);
+		if (rsp_code > 0 && request->response_code_ == 0)
+			request->response_code_ = rsp_code;
 	}	
 	return bytes_to_store;
 }
@@ -68,6 +91,17 @@ size_t CurlHttpRequest::WriteOSFile(void* ptr,
 	if (!request->OpenFileForWrite()) {
 		return 0;
 	}
+	if (request->digest_ != nullptr)
+		request->digest_->Update(ptr, bytes_to_write);
+
+	if (request->async_file_) {
+		request->write_buffer_.append(static_cast<const char *>(ptr), bytes_to_write);
+		if (request->write_buffer_.size() >= kFileWriteBufferSize && !request->FlushWriteBuffer()) {
+			HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Write file error {0}") << request->url_;
+			return 0;
+		}
+		return bytes_to_write;
+	}
 
 	size_t bytes_written =
 		fwrite(ptr, 1, bytes_to_write, request->file_handle_.get());
@@ -91,6 +125,17 @@ size_t CurlHttpRequest::WriteOSFileRange( void *ptr, size_t size, size_t count,
 		return 0;
 	}
 	
+	// The whole file is returned if the server ignores the range, it is
+	// written from the start instead of after the bytes kept
+	if (!request->file_handle_ && request->range_start_ > 0) {
+		long response_code = 0;
+		curl_easy_getinfo(request->easy_handle_, CURLINFO_RESPONSE_CODE, &response_code);
+		if (response_code == 200) {
+			HTTP_QLOG_WAR(request->GetLogger(), "[net][http] Range is ignored {0}, download from the start") << request->url_;
+			request->range_start_ = 0;
+		}
+	}
+
 	// to make sure the temp_file_handle and cfg_file_handle is valid
 	if (!request->OpenFileForRangeWrite()) {
 		return 0;
@@ -102,17 +147,15 @@ size_t CurlHttpRequest::WriteOSFileRange( void *ptr, size_t size, size_t count,
 		HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Write file (Range) error {0}") << request->url_;
 		return 0; // on error
 	}
-	if(fflush(request->file_handle_.get()) != 0)
-	{
-		HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Flush temp file  (Range) error {0}") << request->url_;
-		return 0; 
-	}
+	if (request->digest_ != nullptr)
+		request->digest_->Update(ptr, bytes_to_write);
 	request->range_start_ += static_cast<long long>(bytes_to_write);
 
-	// to record position
-	size_t bytes_cfg_written = request->WriteCfgFile();
-	if(bytes_cfg_written == 0){
-		HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Write cfg file (Range) error {0}") << request->url_;
+	// to record position, the data before it is flushed first
+	if (request->range_start_ - request->checkpoint_offset_ >= kRangeCheckpointBytes
+		&& !request->CheckpointRange()) {
+		HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Flush temp file (Range) error {0}") << request->url_;
+		return 0;
 	}
 
 	return bytes_written;
@@ -125,10 +168,39 @@ size_t CurlHttpRequest::WriteMemory(void* ptr,
 {
 	size_t bytes_to_store = size * count;
 	CurlHttpRequest *request = static_cast<CurlHttpRequest *>(param);
+	if (request->memory_ && request->range_start_ >= 0) {
+		// The whole file is returned if the server ignores the range
+		long response_code = 0;
+		curl_easy_getinfo(request->easy_handle_, CURLINFO_RESPONSE_CODE, &response_code);
+		if (response_code != 206) {
+			HTTP_QLOG_ERR(request->GetLogger(), "[net][http] Range is not satisfied {0}, response code {1}") << request->url_ << response_code;
+			return 0;
+		}
+	}
+	if (request->data_callback_) {
+		request->data_received_ = true;
+		// Returning a different count aborts the transfer
+		return request->data_callback_(static_cast<char *>(ptr), bytes_to_store) ? bytes_to_store : 0;
+	}
+	if (!request->content_reserved_)
+		request->ReserveContent();
 	request->content_->append(static_cast<char *>(ptr), bytes_to_store);
+	request->AccountContent();
 	return bytes_to_store;
 }
 
+void CurlHttpRequest::ReserveContent()
+{
+	// Called on the first chunk, when the headers have been received
+	content_reserved_ = true;
+	double content_length = -1;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &content_length) &&
+		content_length > 0 && content_length <= kMaxReservedContentLength) {
+		content_->reserve(content_->size() + (size_t)content_length);
+		AccountContent();
+	}
+}
+
 int CurlHttpRequest::ProgressCB(
 	void *clientp, double dltotal, double dlnow, double ultotal, double ulnow)
 {
@@ -145,10 +217,14 @@ CurlHttpRequest::CurlHttpRequest(const std::string &url,
 								 const TransferCallback &transfer_callback,
 								 METHODS method) :
 	CurlHttpRequestBase(url, method), memory_(false),
-	range_start_(-1), response_code_(0), content_(new std::string), task_runner_(nullptr),
+	range_start_(-1), range_end_(-1), response_code_(0), content_(new std::string), accounted_content_bytes_(0), content_reserved_(false),
+	content_start_size_(0), data_received_(false), is_hedge_(false), timing_collected_(false), task_runner_(nullptr),
 	file_callback_(file_callback), progress_callback_(progress_callback),
 	speed_callback_(speed_callback), transfer_callback_(transfer_callback),
-	download_old_(0.0), upload_old_(0.0),
+	progress_interval_ms_(kDefaultProgressIntervalMs), progress_time_ms_(0), progress_ultotal_(0), progress_ulnow_(0),
+	progress_dltotal_(0), progress_dlnow_(0), progress_delivered_(true), pending_progress_(new PendingProgress),
+	async_file_offset_(0), pending_writes_(new PendingWrites), preallocated_size_(-1), checkpoint_offset_(0),
+	download_old_(0.0), upload_old_(0.0), speed_time_ms_(0),
 	download_size_(0.0),	upload_size_(0.0),	download_speed_(0.0),	upload_speed_(0.0),
 	on_release_callback_(nullptr)
 {
@@ -166,10 +242,14 @@ CurlHttpRequest::CurlHttpRequest( const std::string &url,
 								  const TransferCallback &transfer_callback,
 								  METHODS method) :
 	CurlHttpRequestBase(url, method), memory_(false), task_runner_(nullptr),
-	range_start_(range_start > 0 ? range_start : 0), response_code_(0), content_(new std::string),
+	range_start_(range_start > 0 ? range_start : 0), range_end_(-1), response_code_(0), content_(new std::string), accounted_content_bytes_(0), content_reserved_(false),
+	content_start_size_(0), data_received_(false), is_hedge_(false), timing_collected_(false),
 	file_callback_(file_callback), progress_callback_(progress_callback),
 	speed_callback_(speed_callback), transfer_callback_(transfer_callback),
-	download_old_(0.0), upload_old_(0.0),
+	progress_interval_ms_(kDefaultProgressIntervalMs), progress_time_ms_(0), progress_ultotal_(0), progress_ulnow_(0),
+	progress_dltotal_(0), progress_dlnow_(0), progress_delivered_(true), pending_progress_(new PendingProgress),
+	async_file_offset_(0), pending_writes_(new PendingWrites), preallocated_size_(-1), checkpoint_offset_(0),
+	download_old_(0.0), upload_old_(0.0), speed_time_ms_(0),
 	download_size_(0.0), upload_size_(0.0), download_speed_(0.0), upload_speed_(0.0),
 	on_release_callback_(nullptr)
 {
@@ -185,10 +265,14 @@ CurlHttpRequest::CurlHttpRequest(const std::string &url,
 								 const TransferCallback &transfer_callback,
 								 METHODS method) :
 	CurlHttpRequestBase(url, method), memory_(true), task_runner_(nullptr),
-	range_start_(-1), response_code_(0), content_(new std::string),
+	range_start_(-1), range_end_(-1), response_code_(0), content_(new std::string), accounted_content_bytes_(0), content_reserved_(false),
+	content_start_size_(0), data_received_(false), is_hedge_(false), timing_collected_(false),
 	content_callback_(content_callback), progress_callback_(progress_callback),
 	speed_callback_(speed_callback), transfer_callback_(transfer_callback),
-	download_old_(0.0), upload_old_(0.0),
+	progress_interval_ms_(kDefaultProgressIntervalMs), progress_time_ms_(0), progress_ultotal_(0), progress_ulnow_(0),
+	progress_dltotal_(0), progress_dlnow_(0), progress_delivered_(true), pending_progress_(new PendingProgress),
+	async_file_offset_(0), pending_writes_(new PendingWrites), preallocated_size_(-1), checkpoint_offset_(0),
+	download_old_(0.0), upload_old_(0.0), speed_time_ms_(0),
 	download_size_(0.0), upload_size_(0.0), download_speed_(0.0), upload_speed_(0.0),
 	on_release_callback_(nullptr)
 {
@@ -198,6 +282,20 @@ void CurlHttpRequest::attach_release(const ReleaseCallback& cb)
 {
 	on_release_callback_ = cb;
 }
+void CurlHttpRequest::SetContentDigest(HTTP_DIGEST type, const std::string& expected_hex/* = ""*/)
+{
+	digest_.reset(type != DIGEST_NONE ? new DownloadDigest(type) : nullptr);
+	expected_digest_ = NS_EXTENSION::MakeLowerString(expected_hex);
+	content_digest_.clear();
+}
+void CurlHttpRequest::SetContentBuffer(const std::shared_ptr<std::string>& buffer)
+{
+	if (buffer != nullptr) {
+		content_ = buffer;
+		content_start_size_ = buffer->size();
+		AccountContent();
+	}
+}
 const void* CurlHttpRequest::content() const
 {
 	if (!memory_ || content_ == nullptr)
@@ -219,14 +317,23 @@ bool CurlHttpRequest::OnEasyHandleCreated()
 
 	curl_easy_setopt(easy_handle_, CURLOPT_HEADERDATA, this);
 	curl_easy_setopt(easy_handle_, CURLOPT_HEADERFUNCTION, WriteHeader);
+	// Ranges and the size probed by HEAD are of the file, not of an encoded response
+	if (range_start_ >= 0 || method_ == HEAD)
+		curl_easy_setopt(easy_handle_, CURLOPT_ACCEPT_ENCODING, NULL);
 
 	if (memory_) {
+		content_reserved_ = false;
+		if (range_start_ >= 0) {
+			std::string range = std::to_string(range_start_) + "-";
+			if (range_end_ >= range_start_)
+				range.append(std::to_string(range_end_));
+			curl_easy_setopt(easy_handle(), CURLOPT_RANGE, range.c_str());
+		}
 		curl_easy_setopt(easy_handle_, CURLOPT_WRITEDATA, this);
 		curl_easy_setopt(easy_handle_, CURLOPT_WRITEFUNCTION, WriteMemory);
 	} else {
 		if(range_start_ >= 0) {
-			std::string range;
-			NS_EXTENSION::StringPrintf(range, "%I64d-", range_start_);
+			std::string range = NS_EXTENSION::StringFormat(EXTENSION_FORMAT("{}-"), range_start_);
 			curl_easy_setopt(easy_handle(), CURLOPT_RANGE, range.c_str());
 			curl_easy_setopt(easy_handle(), CURLOPT_WRITEDATA, this);
 			curl_easy_setopt(easy_handle(), CURLOPT_WRITEFUNCTION, WriteOSFileRange);
@@ -249,7 +356,7 @@ bool CurlHttpRequest::OnEasyHandleCreated()
 
 bool CurlHttpRequest::OpenFileForWrite()
 {
-	if (!file_handle_) {
+	if (!file_handle_ && !async_file_) {
 		// create the directory first
 		UTF8String directory;
 		NS_EXTENSION::FilePathApartDirectory(download_file_path_, directory);
@@ -262,6 +369,20 @@ bool CurlHttpRequest::OpenFileForWrite()
 #endif
 		}
 
+		// Every attempt writes the file from the start
+		if (digest_ != nullptr)
+			digest_->Reset();
+		async_file_ = NS_EXTENSION::AsyncFile::Open(download_file_path_, NS_EXTENSION::AsyncFile::kWrite);
+		if (async_file_) {
+			// The completions only update |pending_writes_|, no need to go
+			// through the transfer thread
+			async_file_->set_reply_task_runner(nullptr);
+			async_file_offset_ = 0;
+			write_buffer_.reserve(kFileWriteBufferSize);
+			PreallocateDownload(async_file_->platform_file(), 0);
+			return true;
+		}
+
 		file_handle_.reset(NS_EXTENSION::OpenFile(download_file_path_, "wb"));
 		if (!file_handle_) {
 #ifdef OS_WIN
@@ -271,6 +392,10 @@ bool CurlHttpRequest::OpenFileForWrite()
 #endif
 			return false;
 		}
+		if (file_buffer_ == nullptr)
+			file_buffer_.reset(new char[kFileWriteBufferSize]);
+		setvbuf(file_handle_.get(), file_buffer_.get(), _IOFBF, kFileWriteBufferSize);
+		PreallocateDownload(PlatformFileOf(file_handle_.get()), 0);
 	}
 	return true;
 }
@@ -291,6 +416,21 @@ bool CurlHttpRequest::OpenFileForRangeWrite()
 			HTTP_QLOG_ERR(GetLogger(), "[net][[http] Open local file (Range) failed, %s") << temp_path;
 			return false;
 		}
+		// Set before any other operation on the stream
+		if (file_buffer_ == nullptr)
+			file_buffer_.reset(new char[kFileWriteBufferSize]);
+		setvbuf(file_handle_.get(), file_buffer_.get(), _IOFBF, kFileWriteBufferSize);
+		checkpoint_offset_ = range_start_;
+		// The part kept from the last attempt is hashed once, the rest while it is written
+		if (digest_ != nullptr) {
+			digest_->Reset();
+			if (!digest_->UpdateFromFile(file_handle_.get(), range_start_)) {
+				HTTP_QLOG_ERR(GetLogger(), "[net][http] Read local file (Range) failed, {0}") << temp_path;
+				file_handle_.reset(nullptr);
+				return false;
+			}
+		}
+		PreallocateDownload(PlatformFileOf(file_handle_.get()), range_start_ > 0 ? range_start_ : 0);
 
 		if( range_start_ >= 0)
 		{
@@ -324,6 +464,102 @@ bool CurlHttpRequest::OpenFileForRangeWrite()
 	return true;
 }
 
+bool CurlHttpRequest::WriteFileAsync(std::string data)
+{
+	size_t size = data.size();
+	std::shared_ptr<PendingWrites> pending = pending_writes_;
+	{
+		std::unique_lock<std::mutex> lock(pending->mutex);
+		pending->changed.wait(lock, [&pending]() { return pending->failed || pending->bytes < kMaxPendingWriteBytes; });
+		if (pending->failed)
+			return false;
+		pending->bytes += size;
+	}
+	// |pending| instead of |this|, the request may be gone when it completes
+	async_file_->Write(async_file_offset_, std::move(data), [pending, size](int64_t result) {
+		std::lock_guard<std::mutex> lock(pending->mutex);
+		pending->bytes -= size;
+		if (result != (int64_t)size)
+			pending->failed = true;
+		pending->changed.notify_all();
+	});
+	async_file_offset_ += (long long)size;
+	return true;
+}
+
+bool CurlHttpRequest::FlushWriteBuffer()
+{
+	if (write_buffer_.empty())
+		return true;
+	std::string data;
+	data.swap(write_buffer_);
+	bool queued = WriteFileAsync(std::move(data));
+	write_buffer_.reserve(kFileWriteBufferSize);
+	return queued;
+}
+
+void CurlHttpRequest::PreallocateDownload(base::PlatformFile file, long long offset)
+{
+	preallocated_size_ = -1;
+	double length = -1;
+	if (easy_handle_ == NULL
+		|| curl_easy_getinfo(easy_handle_, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length) != CURLE_OK
+		|| length <= 0)
+		return;
+	// A decoded body may be longer, the writes past it grow the file as usual
+	long long size = offset + (long long)length;
+	if (PreallocateFile(file, size))
+		preallocated_size_ = size;
+}
+
+bool CurlHttpRequest::CheckpointRange()
+{
+	if (fflush(file_handle_.get()) != 0)
+		return false;
+	checkpoint_offset_ = range_start_;
+	if (WriteCfgFile() == 0)
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] Write cfg file (Range) error {0}") << url_;
+	return true;
+}
+
+void CurlHttpRequest::CloseDownloadFile()
+{
+	if (!file_handle_)
+		return;
+	long long written = range_start_;
+	if (cfg_file_handle_) {
+		if (!CheckpointRange())
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] Flush temp file (Range) error {0}") << url_;
+	} else {
+		fflush(file_handle_.get());
+#if defined(OS_WIN)
+		written = _ftelli64(file_handle_.get());
+#else
+		written = ftello(file_handle_.get());
+#endif
+	}
+	if (preallocated_size_ > written && written >= 0)
+		TruncateFile(PlatformFileOf(file_handle_.get()), written);
+	preallocated_size_ = -1;
+	file_handle_.reset(nullptr);
+	cfg_file_handle_.reset(nullptr);
+}
+
+bool CurlHttpRequest::FinishFileAsync()
+{
+	bool failed = false;
+	{
+		std::unique_lock<std::mutex> lock(pending_writes_->mutex);
+		pending_writes_->changed.wait(lock, [this]() { return pending_writes_->bytes == 0; });
+		failed = pending_writes_->failed;
+		pending_writes_->failed = false;
+	}
+	// Not flushed by a failed or canceled download
+	write_buffer_.clear();
+	async_file_ = nullptr;
+	return !failed;
+}
+
 size_t CurlHttpRequest::WriteCfgFile()
 {
 	if(!cfg_file_handle_) 
@@ -357,11 +593,31 @@ void CurlHttpRequest::OnTransferDone()
 		&response_code_);
 	CurlHttpRequestBase::OnTransferDone();
 
+	if (async_file_) {
+		scoped_refptr<NS_EXTENSION::AsyncFile> file = async_file_;
+		bool queued = FlushWriteBuffer();
+		if (!FinishFileAsync() || !queued) {
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] Write file error {0}") << url_;
+			result_ = CURLE_WRITE_ERROR;
+		} else if (preallocated_size_ > async_file_offset_) {
+			TruncateFile(file->platform_file(), async_file_offset_);
+		}
+		preallocated_size_ = -1;
+	}
 	if (!memory_ && file_handle_) {
-		file_handle_.reset(nullptr);
-		if(cfg_file_handle_){
-			cfg_file_handle_.reset(nullptr);
+		CloseDownloadFile();
+	}
+	if (!memory_ && digest_ != nullptr && result_ == CURLE_OK) {
+		content_digest_ = digest_->Finish();
+		if (!expected_digest_.empty() && content_digest_ != expected_digest_) {
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] Digest mismatch {0} {1}") << url_ << content_digest_;
+			result_ = CURLE_WRITE_ERROR;
 		}
+		// The next download of the content links the stored one. A resumed
+		// download is in the temp file, its caller adds it when it is moved.
+		if (result_ == CURLE_OK && content_store_ != nullptr && response_code_ >= 200 && response_code_ < 300
+			&& range_start_ < 0)
+			content_store_->AddFile(download_file_path_, digest_->type(), content_digest_);
 	}
 
 	curl_easy_getinfo(easy_handle_,
@@ -379,13 +635,17 @@ void CurlHttpRequest::OnTransferDone()
 	curl_easy_getinfo(easy_handle_,
 		CURLINFO_SPEED_UPLOAD,
 		&upload_speed_);
+	CollectTiming();
+	RecordAddressHistory();
 }
 
 void CurlHttpRequest::OnEasyHandleDestroyed()
 {
 	CurlHttpRequestBase::OnEasyHandleDestroyed();
-	if (file_handle_)
-		file_handle_.reset(nullptr);
+	if (async_file_)
+		FinishFileAsync();
+	// A canceled range download records how far it got
+	CloseDownloadFile();
 	if (cfg_file_handle_)
 		cfg_file_handle_.reset(nullptr);
 
@@ -396,28 +656,214 @@ void CurlHttpRequest::OnError()
 {
 	CurlHttpRequestBase::OnError();
 
+	if (async_file_) {
+		FinishFileAsync();
+		NS_EXTENSION::DeleteFile(download_file_path_);
+	}
 	if (file_handle_) {
-		file_handle_.reset(nullptr);
 		// break point transfer should not
 		// delete temp file while http error occurred.
-		if(!cfg_file_handle_){
+		bool range = cfg_file_handle_ != nullptr;
+		CloseDownloadFile();
+		if(!range){
 			NS_EXTENSION::DeleteFile(download_file_path_);
 		}
 	}
 	if(cfg_file_handle_) {
 		cfg_file_handle_.reset(nullptr);
 	}
+	CollectTiming();
+}
+
+bool CurlHttpRequest::ShouldRetry(NS_EXTENSION::TimeDelta &delay)
+{
+	if (is_hedge_ || retry_count_ >= retry_policy_.max_retries)
+		return false;
+	if (method_ == POST && !retry_policy_.retry_non_idempotent)
+		return false;
+	// The content got by the caller can not be taken back
+	if (data_received_ || !CanResendBody() || !IsTransientFailure(response_code_))
+		return false;
+
+	long long retry_after_ms = -1;
+	std::string retry_after;
+	if ((response_code_ == 429 || response_code_ == 503) && FindResponseHeader("Retry-After", retry_after))
+		retry_after_ms = std::strtoll(retry_after.c_str(), nullptr, 10) * 1000;
+	delay = NextRetryDelay(retry_after_ms);
+	retry_count_++;
+	return true;
+}
+
+void CurlHttpRequest::OnRetry()
+{
+	CurlHttpRequestBase::OnRetry();
+	// A range download goes on from |range_start_|, the others start over
+	result_ = CURLE_FAILED_INIT;
+	response_code_ = 0;
+	rsp_head_.clear();
+	response_headers_.Clear();
+	if (memory_ && content_ != nullptr)
+		content_->resize(content_start_size_);
+}
+
+bool CurlHttpRequest::CanRestart() const
+{
+	// A request nobody answered may still have reached the server
+	if (method_ == POST && !retry_policy_.retry_non_idempotent)
+		return false;
+	return !data_received_ && CanResendBody();
+}
+
+bool CurlHttpRequest::CanReconnect() const
+{
+	return !data_received_ && CanResendBody();
+}
+
+bool CurlHttpRequest::GetAltSvc(std::string &alt_svc) const
+{
+	return FindResponseHeader("Alt-Svc", alt_svc);
+}
+
+bool CurlHttpRequest::GetHedgeDelay(NS_EXTENSION::TimeDelta &delay) const
+{
+	if (!hedge_policy_.enabled || is_hedge_ || method_ != GET || !IsContentRequest())
+		return false;
+	delay = NS_EXTENSION::TimeDelta::FromMilliseconds(hedge_policy_.delay_ms);
+	return true;
+}
+
+std::shared_ptr<CurlNetworkSession> CurlHttpRequest::CreateHedgeSession()
+{
+	// No callbacks, the response is taken by AdoptHedgeResponse()
+	auto hedge = std::make_shared<CurlHttpRequest>(url_, ContentCallback());
+	hedge->is_hedge_ = true;
+	for (curl_slist *item = header_list_; item != NULL; item = item->next)
+		hedge->header_list_ = curl_slist_append(hedge->header_list_, item->data);
+	hedge->template_options_ = template_options_;
+	hedge->cached_header_host_ = cached_header_host_;
+	hedge->timeout_ms_ = timeout_ms_;
+	hedge->low_speed_limit_ = low_speed_limit_;
+	hedge->low_speed_time_ = low_speed_time_;
+	hedge->ipresolve_ = ipresolve_;
+	hedge->http_version_ = http_version_;
+	hedge->proxy_ = proxy_;
+	hedge->auto_decompress_ = auto_decompress_;
+	hedge->priority_ = GetSessionPriority();
+	hedge->connect_to_address_ = hedge_policy_.alternate_address;
+	hedge->fresh_connect_ = true;
+	hedge->SetLogger(GetLogger());
+	return hedge;
+}
+
+void CurlHttpRequest::AdoptHedgeResponse(CurlNetworkSession *hedge)
+{
+	CurlHttpRequest *winner = dynamic_cast<CurlHttpRequest *>(hedge);
+	if (winner == nullptr)
+		return;
+	result_ = winner->result_;
+	response_code_ = winner->response_code_;
+	response_headers_ = winner->response_headers_;
+	download_size_ = winner->download_size_;
+	download_speed_ = winner->download_speed_;
+	timing_ = winner->timing_;
+	timing_collected_ = winner->timing_collected_;
+	content_->resize(content_start_size_);
+	content_->append(*winner->content_);
+	AccountContent();
+}
+
+void CurlHttpRequest::CollectTiming()
+{
+	if (easy_handle_ == NULL)
+		return;
+	double seconds = 0;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_NAMELOOKUP_TIME, &seconds))
+		timing_.namelookup_ms = seconds * 1000;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_CONNECT_TIME, &seconds))
+		timing_.connect_ms = seconds * 1000;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_APPCONNECT_TIME, &seconds))
+		timing_.appconnect_ms = seconds * 1000;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_PRETRANSFER_TIME, &seconds))
+		timing_.pretransfer_ms = seconds * 1000;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_STARTTRANSFER_TIME, &seconds))
+		timing_.starttransfer_ms = seconds * 1000;
+	if (CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_TOTAL_TIME, &seconds))
+		timing_.total_ms = seconds * 1000;
+	curl_easy_getinfo(easy_handle_, CURLINFO_REDIRECT_COUNT, &timing_.redirect_count);
+	// No new connection is made for a reused one
+	long connects = 0;
+	timing_.connection_reused = CURLE_OK == curl_easy_getinfo(easy_handle_, CURLINFO_NUM_CONNECTS, &connects)
+		&& connects == 0 && timing_.pretransfer_ms > 0;
+	timing_.response_code = response_code_;
+	timing_collected_ = true;
+}
+
+void CurlHttpRequest::NotifyTiming()
+{
+	// A hedge is reported by the request adopting it
+	if (!timing_collected_ || is_hedge_)
+		return;
+	timing_collected_ = false;
+	// A preconnect has no response, its phases after the handshake are empty
+	if (!connect_only_) {
+		HttpMetrics::Record(url_, timing_);
+		RecordNetworkQuality();
+	}
+	if (!timing_callback_)
+		return;
+	TimingCallback cb = timing_callback_;
+	timing_callback_ = nullptr;
+	if (task_runner_ != nullptr) {
+		PostCallback(NS_EXTENSION::Bind(cb, timing_));
+	} else {
+		cb(timing_);
+	}
+}
+
+void CurlHttpRequest::RecordNetworkQuality()
+{
+	// The phases of a redirected request add up over the hops, and a request
+	// failed before the response tells nothing about the RTT
+	if (timing_.redirect_count > 0 || timing_.starttransfer_ms <= 0)
+		return;
+	auto estimator = NS_EXTENSION::NetworkQualityEstimator::GetInstance();
+	std::string host = HttpMetrics::HostOfURL(url_);
+	if (!timing_.connection_reused && timing_.connect_ms > timing_.namelookup_ms)
+		estimator->AddTransportRTT(host, static_cast<int>(timing_.connect_ms - timing_.namelookup_ms));
+	estimator->AddHttpSample(host,
+		static_cast<int>(timing_.starttransfer_ms - timing_.pretransfer_ms),
+		static_cast<int64_t>(download_size_),
+		static_cast<int>(timing_.total_ms - timing_.starttransfer_ms));
+}
+
+void CurlHttpRequest::RecordAddressHistory()
+{
+	// Through a proxy the handshake is with the proxy, and a reused
+	// connection has no handshake
+	if (easy_handle_ == NULL || proxy_.Valid() || timing_.connection_reused)
+		return;
+	char *ip = NULL;
+	if (CURLE_OK != curl_easy_getinfo(easy_handle_, CURLINFO_PRIMARY_IP, &ip) || ip == NULL || *ip == '\0')
+		return;
+	auto selector = NS_EXTENSION::AddressSelector::GetInstance();
+	if (result_ == CURLE_COULDNT_CONNECT || (result_ == CURLE_OPERATION_TIMEDOUT && timing_.connect_ms <= 0))
+		selector->ReportFailure(ip);
+	else if (timing_.connect_ms > timing_.namelookup_ms)
+		selector->ReportSuccess(ip, static_cast<int>(timing_.connect_ms - timing_.namelookup_ms));
 }
 
 void CurlHttpRequest::NotifyCompletion()
 {
+	if (!progress_delivered_)
+		DeliverProgress();
+	NotifyTiming();
 	if (transfer_callback_)
 	{
 		TransferCallback cb = transfer_callback_;
 		transfer_callback_ = nullptr;
 
 		if (task_runner_ != nullptr) {
-			PostTask(task_runner_.get(),FROM_HERE, NS_EXTENSION::Bind(cb, upload_size_, upload_speed_, download_size_, download_speed_));
+			PostCallback(NS_EXTENSION::Bind(cb, upload_size_, upload_speed_, download_size_, download_speed_));
 		}
 		else {
 			cb(upload_size_, upload_speed_, download_size_, download_speed_);
@@ -434,9 +880,15 @@ void CurlHttpRequest::NotifyCompletion()
 		if (!succeed_
 			&& (response_code_ == 200 || response_code_ == 206 || response_code_ == 0))//到达设置的超时时间条件CURLOPT_LOW_SPEED_TIME会出现这个情况,暂时针对具体问题修复 litianyi 20160908
 			response_code_ = result_;
+		if (response_filter_) {
+			ResponseFilter filter = response_filter_;
+			response_filter_ = nullptr;
+			filter(this, content_, succeed_, response_code_);
+			AccountContent();
+		}
 		HTTP_QLOG_ERR(GetLogger(), "[net][http] Completion ID {0} succeed : {1} response code:{2}") << this->GetRequestID() << succeed_ << response_code_;
 		if (task_runner_ != nullptr) {
-			PostTask(task_runner_.get(),FROM_HERE, NS_EXTENSION::Bind(cb, content_, succeed_, response_code_));
+			PostCallback(NS_EXTENSION::Bind(cb, content_, succeed_, response_code_));
 		} else {
 			// Run the callback on current thread
 			cb(content_, succeed_, response_code_);
@@ -453,52 +905,139 @@ void CurlHttpRequest::NotifyCompletion()
 			response_code_ = result_;
 		HTTP_QLOG_ERR(GetLogger(), "[net][http] Completion ID {0} succeed : {1} response code:{2}") << this->GetRequestID() << succeed_ << response_code_;
 		if (task_runner_ != nullptr) {
-			PostTask(task_runner_.get(),FROM_HERE, NS_EXTENSION::Bind(cb, succeed_, response_code_));
+			PostCallback(NS_EXTENSION::Bind(cb, succeed_, response_code_));
 		} else {
 			cb(succeed_, response_code_);
 		}
 	}
 	progress_callback_ = nullptr;
 }
-int CurlHttpRequest::IncludeResponseCode(const std::string& text)
+void CurlHttpRequest::CompleteWithContent(const std::string& content, int response_code)
 {
-	std::string response_code("-1");
-	auto first_space_pos = text.find(" ");
-	if (first_space_pos != std::string::npos) {
-		auto second_space_pos = text.find(" ", first_space_pos + 1);
-		if (second_space_pos != std::string::npos) {
-			response_code = text.substr(first_space_pos + 1, second_space_pos - first_space_pos - 1);
-		}
+	result_ = CURLE_OK;
+	response_code_ = response_code;
+	content_->assign(content);
+	AccountContent();
+	response_filter_ = nullptr;
+	NotifyCompletion();
+}
+bool CurlHttpRequest::CompleteFromContentStore()
+{
+	if (memory_ || content_store_ == nullptr || digest_ == nullptr || expected_digest_.empty() || range_end_ >= 0)
+		return false;
+	if (!content_store_->LinkTo(digest_->type(), expected_digest_, download_file_path_))
+		return false;
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Completed from content store {0}") << url_;
+	result_ = CURLE_OK;
+	response_code_ = 200;
+	content_digest_ = expected_digest_;
+	NotifyCompletion();
+	return true;
+}
+std::string CurlHttpRequest::InflightKey() const
+{
+	if (method_ != GET || !IsContentRequest() || range_end_ >= 0
+		|| form_post_ != NULL || post_source_ != nullptr || !post_fields_.empty())
+		return std::string();
+	std::string key = url_;
+	for (curl_slist* item = header_list_; item != NULL; item = item->next)
+		key.append("\n").append(item->data);
+	// The requests of different templates send different headers
+	key.append("\n").append(std::to_string((uintptr_t)template_options_.get()));
+	return key;
+}
+void CurlHttpRequest::CompleteWithResponseOf(const CurlHttpRequest* leader, const std::shared_ptr<std::string>& content,
+	bool succeed, int response_code)
+{
+	result_ = succeed ? CURLE_OK : (leader->result_ != CURLE_OK ? leader->result_ : CURLE_HTTP_RETURNED_ERROR);
+	response_code_ = response_code;
+	rsp_head_ = leader->rsp_head_;
+	response_headers_ = leader->response_headers_;
+	if (content != nullptr) {
+		if (content_.use_count() == 1 && content_start_size_ == 0)
+			content_ = content;
+		else
+			content_->append(*content);
+		AccountContent();
 	}
-	return std::atoi(response_code.c_str());
+	response_filter_ = nullptr;
+	NotifyCompletion();
 }
+void CurlHttpRequest::PostCallback(const StdClosure& callback)
+{
+	CallbackBatcher::Post(task_runner_, callback);
+}
+
+void CurlHttpRequest::DeliverProgress()
+{
+	progress_delivered_ = true;
+	if (!progress_callback_)
+		return;
+	if (task_runner_ == nullptr) {
+		progress_callback_(progress_ultotal_, progress_ulnow_, progress_dltotal_, progress_dlnow_);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(pending_progress_->mutex);
+		pending_progress_->ultotal = progress_ultotal_;
+		pending_progress_->ulnow = progress_ulnow_;
+		pending_progress_->dltotal = progress_dltotal_;
+		pending_progress_->dlnow = progress_dlnow_;
+		if (pending_progress_->posted)
+			return;
+		pending_progress_->posted = true;
+	}
+	PostCallback(NS_EXTENSION::Bind(&CurlHttpRequest::RunPendingProgress, progress_callback_, pending_progress_));
+}
+
+void CurlHttpRequest::RunPendingProgress(const ProgressCallback& cb, const std::shared_ptr<PendingProgress>& pending)
+{
+	double ultotal, ulnow, dltotal, dlnow;
+	{
+		std::lock_guard<std::mutex> lock(pending->mutex);
+		pending->posted = false;
+		ultotal = pending->ultotal;
+		ulnow = pending->ulnow;
+		dltotal = pending->dltotal;
+		dlnow = pending->dlnow;
+	}
+	cb(ultotal, ulnow, dltotal, dlnow);
+}
+
 void CurlHttpRequest::NotifyProgress(
 	double dltotal, double dlnow, double ultotal, double ulnow)
 {
-	if (progress_callback_)
+	if (progress_callback_ && (dltotal != progress_dltotal_ || dlnow != progress_dlnow_
+		|| ultotal != progress_ultotal_ || ulnow != progress_ulnow_))
 	{
-		if (task_runner_ != nullptr) {
-			PostTask(task_runner_.get(),FROM_HERE, NS_EXTENSION::Bind(progress_callback_, ultotal, ulnow, dltotal, dlnow));
-		}
-		else {
-			progress_callback_(ultotal, ulnow, dltotal, dlnow);
+		progress_ultotal_ = ultotal;
+		progress_ulnow_ = ulnow;
+		progress_dltotal_ = dltotal;
+		progress_dlnow_ = dlnow;
+		progress_delivered_ = false;
+		// curl reports the progress many times a second, the skipped ones are
+		// replaced by the next one or delivered before the completion
+		int64_t now_ms = NS_EXTENSION::CoarseClock::MonotonicMs();
+		if (progress_interval_ms_ == 0 || now_ms - progress_time_ms_ >= progress_interval_ms_) {
+			progress_time_ms_ = now_ms;
+			DeliverProgress();
 		}
 	}
 
 	if (speed_callback_)
 	{
-		NS_EXTENSION::Time time_now = NS_EXTENSION::Time::Now();
-		NS_EXTENSION::TimeDelta time_delta = time_now - time_old_;
-		if (time_delta.InMicroseconds() > (NS_EXTENSION::Time::kMicrosecondsPerSecond / 2)) {
-			double upload_speed = (ulnow - upload_old_) * NS_EXTENSION::Time::kMicrosecondsPerSecond / time_delta.InMicroseconds();
-			double download_speed = (dlnow - download_old_) * NS_EXTENSION::Time::kMicrosecondsPerSecond / time_delta.InMicroseconds();
+		int64_t now_ms = NS_EXTENSION::CoarseClock::MonotonicMs();
+		int64_t elapsed_ms = now_ms - speed_time_ms_;
+		if (elapsed_ms > NS_EXTENSION::Time::kMillisecondsPerSecond / 2) {
+			double upload_speed = (ulnow - upload_old_) * NS_EXTENSION::Time::kMillisecondsPerSecond / elapsed_ms;
+			double download_speed = (dlnow - download_old_) * NS_EXTENSION::Time::kMillisecondsPerSecond / elapsed_ms;
 
 			upload_old_ = ulnow;
 			download_old_ = dlnow;
-			time_old_ = time_now;
+			speed_time_ms_ = now_ms;
 
 			if (task_runner_ != nullptr) {
-				PostTask(task_runner_.get(),FROM_HERE, NS_EXTENSION::Bind(speed_callback_, upload_speed, download_speed));
+				PostCallback(NS_EXTENSION::Bind(speed_callback_, upload_speed, download_speed));
 			}
 			else {
 				speed_callback_(upload_speed, download_speed);
@@ -508,16 +1047,34 @@ void CurlHttpRequest::NotifyProgress(
 }
 void CurlHttpRequest::GetResponseHead(std::list<std::string> &head) const
 {
-	head = rsp_head_list_;
+	response_headers_.GetLines(head);
+}
+bool CurlHttpRequest::FindResponseHeader(const std::string& name, std::string& value) const
+{
+	std::string_view found;
+	if (!response_headers_.Find(name, &found))
+		return false;
+	value.assign(found.data(), found.size());
+	return true;
+}
+bool CurlHttpRequest::FindResponseHeader(std::string_view name, std::string_view* value) const
+{
+	return response_headers_.Find(name, value);
+}
+bool CurlHttpRequest::GetResponseHeader(const std::string& name, std::string& value) const
+{
+	return FindResponseHeader(name, value);
+}
+long CurlHttpRequest::GetCurrentResponseCode() const
+{
+	long response_code = 0;
+	if (easy_handle_ != nullptr)
+		curl_easy_getinfo(easy_handle_, CURLINFO_RESPONSE_CODE, &response_code);
+	return response_code;
 }
 std::string CurlHttpRequest::GetResponseHead() const
 {
-	std::string ret;
-	for (auto it : rsp_head_list_)
-	{
-		ret.append(it).append("\r\n");
-	}
-	return ret;
+	return response_headers_.raw();
 }
 
 HTTP_END_DECLS
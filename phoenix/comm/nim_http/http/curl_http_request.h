@@ -6,20 +6,28 @@
 #include "nim_http/config/build_config.h"
 #include <memory>
 #include <map>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
+#include "extension/file_util/async_file.h"
 #include "extension/memory/file_deleter.h"
 #include "extension/time/time.h"
 #include "extension/thread/framework_thread.h"
 #include "nim_http/http/curl_http_request_base.h"
+#include "nim_http/http/http_response_headers.h"
 #include "nim_http/wrapper/http_def.h"
 HTTP_BEGIN_DECLS
 
+class DownloadDigest;
 class HTTP_EXPORT CurlHttpRequest : public CurlHttpRequestBase
 {
 public:
 	
 	//called when deconstructing
 	using ReleaseCallback =  std::function<void(CurlHttpRequest*)> ;
+	// Called on the transfer thread before the content callback of a content
+	// request, it may replace the content, the result and the response code
+	using ResponseFilter = std::function<void(CurlHttpRequest*, std::shared_ptr<std::string>&, bool&, int&)>;
 
 	// * This version of constructor create an instance which will make a http
 	//   or https request and store the server's response to the file whose path
@@ -78,8 +86,20 @@ public:
 	const std::string& download_file_path() const { return download_file_path_; }
 	virtual void GetResponseHead(std::list<std::string> &head) const override;
 	virtual std::string GetResponseHead() const override;
+	// Finds the value of the last |name| header, responses of the
+	// redirections are in the head too
+	bool FindResponseHeader(const std::string& name, std::string& value) const;
+	// As above without a copy, |value| is valid until the request is retried
+	bool FindResponseHeader(std::string_view name, std::string_view* value) const;
+	virtual bool GetResponseHeader(const std::string& name, std::string& value) const override;
+	// The status of the response being received, e.g. in the data callback
+	// before the transfer is done, 0 before the status line
+	long GetCurrentResponseCode() const;
 	void add_header_field(const std::map<std::string,std::string>& fields); 
 	void SetRangeStart(long long range_start) { range_start_ = range_start > 0 ? range_start : 0; };
+	// The last byte of the range, a negative one means to the end of the file.
+	// A content request with a range fails unless the server returns 206.
+	void SetRangeEnd(long long range_end) { range_end_ = range_end; }
 	long long GetRangeStart(long long range_start) const {	return range_start_ ;};
 	void SetProgressCallback(const ProgressCallback& cb) { progress_callback_ = cb; }
 	//ProgressCallback GetProgressCallback() const { return progress_callback_; }
@@ -89,6 +109,38 @@ public:
 	//TransferCallback GetTransferCallback() const { return transfer_callback_; }
 	void SetTaskRunner(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner) { task_runner_ = task_runner; }
 	scoped_refptr<base::SingleThreadTaskRunner> GetTaskRunner() const { return task_runner_; }
+	virtual void SetDataCallback(const DataCallback& data_cb) override { data_callback_ = data_cb; }
+	virtual void SetContentBuffer(const std::shared_ptr<std::string>& buffer) override;
+	virtual void SetContentDigest(HTTP_DIGEST type, const std::string& expected_hex = "") override;
+	virtual std::string GetContentDigest() const override { return content_digest_; }
+	// Set by the manager, see IHttpManager::SetContentStore
+	void SetContentStore(const HttpContentStore& store) { content_store_ = store; }
+	const HttpContentStore& GetContentStore() const { return content_store_; }
+	// Completes a file download whose expected digest is in the content
+	// store by a link of the stored content without transferring
+	bool CompleteFromContentStore();
+	// A content request stores the whole response in memory, a preconnect
+	// has none so it is not cached, merged or hedged
+	bool IsContentRequest() const { return memory_ && !data_callback_ && range_start_ < 0 && !connect_only_; }
+	void SetResponseFilter(const ResponseFilter& filter) { response_filter_ = filter; }
+	const ResponseFilter& GetResponseFilter() const { return response_filter_; }
+	virtual void SetTimingCallback(const TimingCallback& timing_cb) override { timing_callback_ = timing_cb; }
+	virtual void SetProgressInterval(int interval_ms) override { progress_interval_ms_ = interval_ms > 0 ? interval_ms : 0; }
+	// Completes the request with a copy of |content| without transferring,
+	// e.g. by a cached response
+	void CompleteWithContent(const std::string& content, int response_code);
+	// Identifies the GET content requests which get the same response, by the
+	// URL and the headers, empty if the request can not share a response
+	std::string InflightKey() const;
+	// Completes the request without transferring by the response of |leader|
+	// to an identical request, |content| is shared unless the request has a
+	// content buffer of its own
+	void CompleteWithResponseOf(const CurlHttpRequest* leader, const std::shared_ptr<std::string>& content,
+		bool succeed, int response_code);
+	// The capacity of the content buffers held by all the requests alive, a
+	// buffer shared by several requests is counted by each of them, one kept
+	// by the content callback is not counted after the request is released
+	static int64_t GetLiveContentBytes();
 protected:
 	// Called immediately after the easy handle created
 	// You can do `curl_easy_setopt` work as you like,
@@ -100,6 +152,15 @@ protected:
 	virtual void OnError();
 	// Called after the easy handle destroyed.
 	virtual void OnEasyHandleDestroyed();
+	// Retries and hedging, see CurlNetworkSession
+	virtual bool ShouldRetry(NS_EXTENSION::TimeDelta &delay) override;
+	virtual void OnRetry() override;
+	virtual bool CanRestart() const override;
+	virtual bool CanReconnect() const override;
+	virtual bool GetAltSvc(std::string &alt_svc) const override;
+	virtual bool GetHedgeDelay(NS_EXTENSION::TimeDelta &delay) const override;
+	virtual std::shared_ptr<CurlNetworkSession> CreateHedgeSession() override;
+	virtual void AdoptHedgeResponse(CurlNetworkSession *hedge) override;
 
 	static size_t WriteHeader(void *ptr, size_t size, size_t count, void *data);
 	static size_t WriteOSFile(void *ptr, size_t size, size_t count, void *param);
@@ -108,35 +169,127 @@ protected:
 	static int ProgressCB(void *clientp,
 		double dltotal, double dlnow, double ultotal, double ulnow);
 
+	void ReserveContent();
+	// Updates GetLiveContentBytes() by the capacity of |content_|
+	void AccountContent();
 	bool OpenFileForWrite();
+	// Queues the chunk to |async_file_|, waits only while too much is pending
+	bool WriteFileAsync(std::string data);
+	// Queues the chunks gathered in |write_buffer_| as one write
+	bool FlushWriteBuffer();
+	// Reserves the file for the Content-Length after |offset|
+	void PreallocateDownload(base::PlatformFile file, long long offset);
+	// Flushes the range file and records |range_start_| in the cfg file
+	bool CheckpointRange();
+	// Closes |file_handle_|, cuts the preallocated space not written
+	void CloseDownloadFile();
+	// Waits for the queued chunks and closes |async_file_|, false if any failed
+	bool FinishFileAsync();
 	bool OpenFileForRangeWrite();
 	size_t WriteCfgFile();
 
+	// Called before the easy handle is released
+	void CollectTiming();
+	void NotifyTiming();
+	// Feeds the RTT and throughput of the request to NetworkQualityEstimator
+	void RecordNetworkQuality();
+	// Reports the handshake or the connect failure of the address connected
+	// to AddressSelector, called before the easy handle is released
+	void RecordAddressHistory();
 	void NotifyCompletion();
 	void NotifyProgress(double, double, double, double);
-	int IncludeResponseCode(const std::string& text);
+	void DeliverProgress();
+	// Posts the callbacks of the request, see CallbackBatcher
+	void PostCallback(const StdClosure& callback);
 protected:
+	// The latest progress not delivered to the task runner yet, a new one
+	// replaces it instead of posting another task
+	struct PendingProgress
+	{
+		PendingProgress() : posted(false), ultotal(0), ulnow(0), dltotal(0), dlnow(0) {}
+		std::mutex mutex;
+		bool posted;
+		double ultotal;
+		double ulnow;
+		double dltotal;
+		double dlnow;
+	};
+	static void RunPendingProgress(const ProgressCallback& cb, const std::shared_ptr<PendingProgress>& pending);
+	// The writes of |async_file_| not completed yet, updated on the completion
+	// thread of AsyncFile
+	struct PendingWrites
+	{
+		PendingWrites() : bytes(0), failed(false) {}
+		std::mutex mutex;
+		std::condition_variable changed;
+		size_t bytes;
+		bool failed;
+	};
+
 	bool memory_;
 	long long range_start_;
+	long long range_end_;
 	std::string download_file_path_;
+	// The stdio buffer of |file_handle_|, declared first as fclose() flushes it
+	std::unique_ptr<char[]> file_buffer_;
 	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file_handle_;
+	// A download without a range is written by AsyncFile instead of
+	// |file_handle_|, so a slow disk does not hold the transfer thread
+	scoped_refptr<NS_EXTENSION::AsyncFile> async_file_;
+	long long async_file_offset_;
+	std::shared_ptr<PendingWrites> pending_writes_;
 	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> cfg_file_handle_;
+	// The chunks of curl not queued to |async_file_| yet
+	std::string write_buffer_;
+	// The size the file is preallocated to, negative if it is not
+	long long preallocated_size_;
+	// |range_start_| last recorded in the cfg file
+	long long checkpoint_offset_;
+	std::unique_ptr<DownloadDigest> digest_;
+	std::string expected_digest_;
+	std::string content_digest_;
+	HttpContentStore content_store_;
 	int response_code_;
 
 	std::string rsp_head_;
 	std::shared_ptr<std::string> content_;
+	// The capacity of |content_| added to GetLiveContentBytes()
+	size_t accounted_content_bytes_;
 	ContentCallback content_callback_;
+	DataCallback data_callback_;
+	ResponseFilter response_filter_;
+	TimingCallback timing_callback_;
+	HttpRequestTiming timing_;
+	bool timing_collected_;
+	bool content_reserved_;
+	// The size of the content buffer before the transfer, kept by a retry
+	size_t content_start_size_;
+	// Content has been passed to |data_callback_|
+	bool data_received_;
+	// Made by CreateHedgeSession() of another request
+	bool is_hedge_;
 	CompletionCallback file_callback_;
 	ProgressCallback progress_callback_;
 	SpeedCallback speed_callback_;
 	TransferCallback transfer_callback_;
 	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
 	ReleaseCallback on_release_callback_;
-	std::list<std::string> rsp_head_list_;
+	HttpResponseHeaders response_headers_;
+
+	int progress_interval_ms_;
+	// By NS_EXTENSION::CoarseClock::MonotonicMs()
+	int64_t progress_time_ms_;
+	// The latest progress of curl and whether it is delivered
+	double progress_ultotal_;
+	double progress_ulnow_;
+	double progress_dltotal_;
+	double progress_dlnow_;
+	bool progress_delivered_;
+	std::shared_ptr<PendingProgress> pending_progress_;
 
 	double download_old_;
 	double upload_old_;
-	NS_EXTENSION::Time time_old_;
+	int64_t speed_time_ms_;
 
 	double download_size_;
 	double upload_size_;
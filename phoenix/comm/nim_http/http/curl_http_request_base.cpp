@@ -3,49 +3,143 @@
 #include <openssl/ssl.h>
 #include <openssl/x509_vfy.h>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
 #include "base/files/file_util.h"
+#include "base/rand_util.h"
 #include "base/strings/utf_string_conversions.h"
 #if defined(OS_WIN)
 #include "base/strings/sys_string_conversions.h"
 #endif
 
 #include "extension/file_util/utf8_file_util.h"
+#include "extension/network/network_quality_estimator.h"
 #include "extension/strings/string_util.h"
+#include "extension/zip/compression.h"
 #include "nim_log/wrapper/log.h"
 
 #include "nim_http/http/curl_http_request_base.h"
+#include "nim_http/http/curl_ssl_trust_store.h"
+#include "nim_http/http/http_alt_svc_cache.h"
+#include "nim_http/http/http_metrics.h"
 
 HTTP_BEGIN_DECLS
 
 namespace
 {
 
-static size_t ReadOSFile(void *ptr, size_t size, size_t nmemb, void *userdata)
+// Smaller bodies are not worth compressing
+const size_t kMinCompressSize = 1024;
+const char kDefaultUserAgent[] = "NEngine/1.0 (compatible; MSIE 6.0; Windows NT 5.1)";
+// The connect timeout tuned by the network quality if the request has no
+// shorter timeout, curl waits 300 seconds by default
+const long kDefaultConnectTimeoutMs = 30000;
+
+// Joins "name: value" on the stack for the usual short headers, curl copies it
+curl_slist *AppendHeaderField(curl_slist *list, const char *name, size_t name_length,
+	const char *value, size_t value_length)
+{
+	char buffer[256];
+	size_t length = name_length + 2 + value_length;
+	if (length >= sizeof(buffer)) {
+		std::string header_field;
+		header_field.reserve(length);
+		header_field.append(name, name_length).append(": ").append(value, value_length);
+		return curl_slist_append(list, header_field.c_str());
+	}
+	memcpy(buffer, name, name_length);
+	buffer[name_length] = ':';
+	buffer[name_length + 1] = ' ';
+	memcpy(buffer + name_length + 2, value, value_length);
+	buffer[length] = '\0';
+	return curl_slist_append(list, buffer);
+}
+
+curl_slist *CopyHeaderList(curl_slist *list, const curl_slist *source)
 {
-	size_t ret = CURL_SEEKFUNC_OK;
-	try
-	{
-		std::list<FILE *> *handle_list = (std::list<FILE *> *)userdata;
-		if (handle_list == nullptr || handle_list->empty()) {
-			throw( CURL_READFUNC_ABORT);
-		}
-		auto pFile = handle_list->front();
-		if (feof(pFile)) {
-			fclose(pFile);
-			handle_list->pop_front();
-		}
-		else
-		{
-			ret = fread(ptr, 1, size * nmemb, pFile);
-			if (ferror(pFile) != CURL_SEEKFUNC_OK)
-				throw (CURLE_READ_ERROR);
-		}		
+	for (; source != NULL; source = source->next)
+		list = curl_slist_append(list, source->data);
+	return list;
+}
+
+// |userdata| is the CurlUploadSource of the body or of a form part
+static size_t ReadUploadSource(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	CurlUploadSource *source = static_cast<CurlUploadSource *>(userdata);
+	if (source == nullptr)
+		return CURL_READFUNC_ABORT;
+
+	if (source->mapped) {
+		size_t left = source->mapped->length() - source->mapped_offset;
+		size_t ret = left < size * nmemb ? left : size * nmemb;
+		memcpy(ptr, source->mapped->data() + source->mapped_offset, ret);
+		// Each byte is sent once unless rewound, keep the sent pages out of the working set
+		source->mapped->Release(source->mapped_offset, ret);
+		source->mapped_offset += ret;
+		return ret;
 	}
-	catch (int err)
-	{
-		ret =  err; 
+	if (source->file != nullptr) {
+		size_t ret = fread(ptr, 1, size * nmemb, source->file);
+		if (ferror(source->file))
+			return CURL_READFUNC_ABORT;
+		return ret;
+	}
+	if (source->is_chain) {
+		size_t ret = source->chain_left.copy_to(0, static_cast<char *>(ptr), size * nmemb);
+		source->chain_left.consume(ret);
+		return ret;
+	}
+	if (!source->read_callback)
+		return CURL_READFUNC_ABORT;
+	long long ret = source->read_callback(static_cast<char *>(ptr), size * nmemb);
+	if (ret < 0 || ret > (long long)(size * nmemb))
+		return CURL_READFUNC_ABORT;
+	return (size_t)ret;
+}
+
+// Curl rewinds the body to send it again, e.g. after a 307 redirection
+static int SeekUploadSource(void *userdata, curl_off_t offset, int origin)
+{
+	CurlUploadSource *source = static_cast<CurlUploadSource *>(userdata);
+	if (source != nullptr && source->is_chain) {
+		if (origin != SEEK_SET || offset < 0 || offset > (curl_off_t)source->chain.size())
+			return CURL_SEEKFUNC_CANTSEEK;
+		source->chain_left = source->chain;
+		source->chain_left.consume((size_t)offset);
+		return CURL_SEEKFUNC_OK;
 	}
-	return ret;	
+	if (source != nullptr && source->mapped) {
+		if (origin != SEEK_SET || offset < 0 || offset > (curl_off_t)source->mapped->length())
+			return CURL_SEEKFUNC_CANTSEEK;
+		source->mapped_offset = (size_t)offset;
+		return CURL_SEEKFUNC_OK;
+	}
+	if (source == nullptr || source->file == nullptr)
+		return CURL_SEEKFUNC_CANTSEEK;
+#if defined(OS_WIN)
+	return _fseeki64(source->file, offset, origin) == 0 ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+#else
+	return fseeko(source->file, offset, origin) == 0 ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+#endif
+}
+
+// Maps the file, or opens it to be read when it cannot be mapped
+static bool OpenUploadFile(CurlUploadSource *source, const std::string& file_path)
+{
+	std::unique_ptr<NS_EXTENSION::MappedFile> mapped(new NS_EXTENSION::MappedFile);
+	if (mapped->Open(file_path, NS_EXTENSION::MappedFile::kSequential, false) && mapped->IsMapped()) {
+		source->size = (long long)mapped->length();
+		source->mapped = std::move(mapped);
+		return true;
+	}
+	source->file = NS_EXTENSION::OpenFile(file_path, "rb");
+	if (source->file == nullptr)
+		return false;
+	source->size = NS_EXTENSION::GetFileSize(file_path);
+	return true;
 }
 
 } // anonymous namespace
@@ -61,15 +155,30 @@ CurlHttpRequestBase::CurlHttpRequestBase(const std::string &url, METHODS method)
 	  form_post_(NULL),
 	  form_post_last_(NULL),
 	  timeout_ms_(0),
-	  ipresolve_(IPRESOLVE::IPRESOLVE_WHATEVER)
+	  cancel_callback_id_(0),
+	  ipresolve_(IPRESOLVE::IPRESOLVE_WHATEVER),
+	  http_version_(HTTP_PROTOCOL_DEFAULT),
+	  auto_decompress_(true),
+	  compress_post_fields_(false),
+	  retry_count_(0),
+	  fresh_connect_(false),
+	  connect_to_list_(NULL),
+	  merged_header_list_(NULL),
+	  deferrable_(false),
+	  connect_only_(false)
 {
 
 }
 
 CurlHttpRequestBase::~CurlHttpRequestBase()
 {
+	cancellation_token_.RemoveCancelCallback(cancel_callback_id_);
 	ClearHeaderFields();
 	ClearForms();
+	if (connect_to_list_ != NULL)
+		curl_slist_free_all(connect_to_list_);
+	if (merged_header_list_ != NULL)
+		curl_slist_free_all(merged_header_list_);
 }
 
 void CurlHttpRequestBase::AddHeaderField(const char *name, const char *value)
@@ -77,11 +186,7 @@ void CurlHttpRequestBase::AddHeaderField(const char *name, const char *value)
 	if (strcmp(name, "Host") == 0)
 		cached_header_host_ = value;
 
-	std::string header_field;
-	header_field.append(name);
-	header_field.append(": ");
-	header_field.append(value);
-	header_list_ = curl_slist_append(header_list_, header_field.c_str());
+	header_list_ = AppendHeaderField(header_list_, name, strlen(name), value, strlen(value));
 }
 
 void CurlHttpRequestBase::AddHeaderField(
@@ -89,11 +194,52 @@ void CurlHttpRequestBase::AddHeaderField(
 {
 	if (name == "Host")
 		cached_header_host_ = value;
-	std::string header_field;
-	header_field.append(name);
-	header_field.append(": ");
-	header_field.append(value);
-	header_list_ = curl_slist_append(header_list_, header_field.c_str());
+	header_list_ = AppendHeaderField(header_list_, name.data(), name.size(), value.data(), value.size());
+}
+
+void CurlHttpRequestBase::AddTransferHeader(const char *field)
+{
+	for (curl_slist *item = header_list_; item != NULL; item = item->next) {
+		if (strcmp(item->data, field) == 0)
+			return;
+	}
+	header_list_ = curl_slist_append(header_list_, field);
+	ApplyHeaderList();
+}
+
+void CurlHttpRequestBase::ApplyHeaderList()
+{
+	if (merged_header_list_ != NULL) {
+		curl_slist_free_all(merged_header_list_);
+		merged_header_list_ = NULL;
+	}
+	curl_slist *header_list = header_list_;
+	if (template_options_ != nullptr && template_options_->header_list != NULL) {
+		// The list of the template is used as it is unless the request has
+		// headers of its own
+		if (header_list_ == NULL) {
+			header_list = template_options_->header_list;
+		} else {
+			merged_header_list_ = CopyHeaderList(NULL, template_options_->header_list);
+			merged_header_list_ = CopyHeaderList(merged_header_list_, header_list_);
+			header_list = merged_header_list_;
+		}
+	}
+	curl_easy_setopt(easy_handle_, CURLOPT_HTTPHEADER, header_list);
+}
+
+void CurlHttpRequestBase::SetTemplateOptions(const std::shared_ptr<const CurlTemplateOptions>& options)
+{
+	template_options_ = options;
+	if (options == nullptr)
+		return;
+	if (!options->header_host.empty())
+		cached_header_host_ = options->header_host;
+	timeout_ms_ = options->timeout_ms;
+	if (options->low_speed_limit > 0)
+		SetLowSpeed(options->low_speed_limit, options->low_speed_time);
+	ipresolve_ = options->ipresolve;
+	priority_ = options->priority;
 }
 
 void CurlHttpRequestBase::ClearHeaderFields()
@@ -114,6 +260,43 @@ bool CurlHttpRequestBase::SetPostFields(const void *data, size_t size)
 	return true;
 }
 
+bool CurlHttpRequestBase::SetPostFile(const std::string& file_path)
+{
+	std::unique_ptr<CurlUploadSource> source(new CurlUploadSource);
+	if (!OpenUploadFile(source.get(), file_path)) {
+		int err = errno;
+		HTTP_QLOG_ERR(GetLogger(), "[net][http]Open file failed({0}): `{1}`") << err << file_path;
+		return false;
+	}
+	post_fields_.clear();
+	post_source_ = std::move(source);
+	return true;
+}
+
+bool CurlHttpRequestBase::SetPostStream(const UploadReadCallback& read_cb, long long size/* = -1*/)
+{
+	if (!read_cb)
+		return false;
+	std::unique_ptr<CurlUploadSource> source(new CurlUploadSource);
+	source->read_callback = read_cb;
+	source->size = size;
+	post_fields_.clear();
+	post_source_ = std::move(source);
+	return true;
+}
+
+bool CurlHttpRequestBase::SetPostChain(const NS_EXTENSION::ChainedBuffer& body)
+{
+	std::unique_ptr<CurlUploadSource> source(new CurlUploadSource);
+	source->chain = body;
+	source->chain_left = body;
+	source->is_chain = true;
+	source->size = (long long)body.size();
+	post_fields_.clear();
+	post_source_ = std::move(source);
+	return true;
+}
+
 bool CurlHttpRequestBase::AddForm(const std::string& name, const std::string& value, const std::string& content_type/* = ""*/)
 {
 	if (name.empty() || value.empty())
@@ -141,7 +324,7 @@ bool CurlHttpRequestBase::AddForm(const std::string& name, const std::string& va
 
 bool CurlHttpRequestBase::AddFormWithBuffer(const std::string& name, const void *buffer,size_t buffer_length, const std::string& content_type/* = ""*/)
 {
-	if (name.empty() || buffer || buffer_length == 0)
+	if (name.empty() || buffer == nullptr || buffer_length == 0)
 		return false;
 	return content_type.empty() ?
 		(CURL_FORMADD_OK == curl_formadd(&form_post_,
@@ -181,55 +364,64 @@ bool CurlHttpRequestBase::AddFormWithFilePath(const std::string& name,const std:
 		return false;
 	}
 
-	FILE *file = NS_EXTENSION::OpenFile(file_path, "rb");
-	if (file == nullptr) {
+	std::unique_ptr<CurlUploadSource> source(new CurlUploadSource);
+	if (!OpenUploadFile(source.get(), file_path)) {
 		int err = errno;
 		HTTP_QLOG_ERR(GetLogger(), "[net][http]Open file failed({0}): `{1}`") << err << file_path;
 		return false;
 	}
+	return AddFormWithSource(name, filename, std::move(source), content_type);
+}
 
-	fseek(file, 0, SEEK_END);
-	int file_size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+bool CurlHttpRequestBase::AddFormWithStream(const std::string& name, const std::string& file_name, const UploadReadCallback& read_cb,
+	long long size, const std::string& content_type/* = ""*/)
+{
+	if (name.empty() || !read_cb)
+		return false;
+
+	std::unique_ptr<CurlUploadSource> source(new CurlUploadSource);
+	source->read_callback = read_cb;
+	source->size = size;
+	return AddFormWithSource(name, file_name, std::move(source), content_type);
+}
 
-	CURLFORMcode rc = 
-		content_type.empty() 
+bool CurlHttpRequestBase::AddFormWithSource(const std::string& name, const std::string& file_name,
+	std::unique_ptr<CurlUploadSource> source, const std::string& content_type)
+{
+	// The part is read by ReadUploadSource with |source| while uploading
+	CURLFORMcode rc = source->size >= 0
 		?
-		(curl_formadd(&form_post_,
+		curl_formadd(&form_post_,
 			&form_post_last_,
 			CURLFORM_COPYNAME,
 			name.c_str(),
 			CURLFORM_FILENAME,
-			filename.c_str(),
+			file_name.c_str(),
 			CURLFORM_STREAM,
-			&upload_file_handles_,
+			source.get(),
 			CURLFORM_CONTENTTYPE,
-			"application/octet-stream",
-			CURLFORM_CONTENTSLENGTH,
-			file_size,
-			CURLFORM_END))
+			content_type.empty() ? "application/octet-stream" : content_type.c_str(),
+			CURLFORM_CONTENTLEN,
+			(curl_off_t)source->size,
+			CURLFORM_END)
 		:
-		(curl_formadd(&form_post_,
+		curl_formadd(&form_post_,
 			&form_post_last_,
 			CURLFORM_COPYNAME,
 			name.c_str(),
 			CURLFORM_FILENAME,
-			filename.c_str(),
+			file_name.c_str(),
 			CURLFORM_STREAM,
-			&upload_file_handles_,
+			source.get(),
 			CURLFORM_CONTENTTYPE,
-			content_type.c_str(),
-			CURLFORM_CONTENTSLENGTH,
-			file_size,
-			CURLFORM_END));
+			content_type.empty() ? "application/octet-stream" : content_type.c_str(),
+			CURLFORM_END);
 	if (CURL_FORMADD_OK != rc) {
 		HTTP_QLOG_ERR(GetLogger(), "[net][http] Add form error {0}") << rc;
-		base::CloseFile(file);
 		return false;
 	}
 
-	upload_file_handles_.push_back(file);
-
+	upload_sources_.push_back(std::move(source));
 	return true;
 }
 
@@ -240,11 +432,7 @@ void CurlHttpRequestBase::ClearForms()
 		form_post_ = NULL;
 		form_post_last_ = NULL;
 	}
-	for (auto iter = upload_file_handles_.begin();
-		iter != upload_file_handles_.end(); iter++) {
-		fclose(*iter);
-	}
-	upload_file_handles_.clear();
+	upload_sources_.clear();
 }
 bool CurlHttpRequestBase::SetCookie(const std::string &cookie)
 {
@@ -314,7 +502,21 @@ bool CurlHttpRequestBase::SetReferer(const std::string &referer)
 }
 bool CurlHttpRequestBase::ProxyValid() const
 {
-	return proxy_.Valid();
+	return proxy_.Valid() || (template_options_ != nullptr && template_options_->proxy.Valid());
+}
+bool CurlHttpRequestBase::ProxyIsSystem() const
+{
+	return proxy_.IsSystem() || (!proxy_.Valid() && template_options_ != nullptr && template_options_->proxy.IsSystem());
+}
+bool CurlHttpRequestBase::GetHttp3Origin(std::string &origin, bool &required) const
+{
+	if ((http_version_ != HTTP_PROTOCOL_DEFAULT && http_version_ != HTTP_PROTOCOL_3) ||
+		connect_only_ || ProxyValid())
+		return false;
+	if (!HttpAltSvcCache::OriginOfURL(url_, origin))
+		return false;
+	required = http_version_ == HTTP_PROTOCOL_3;
+	return true;
 }
 void CurlHttpRequestBase::SetProxy(const NS_NET::ProxyInfo &proxy)
 {
@@ -328,6 +530,29 @@ void CurlHttpRequestBase::SetTimeout(long timeout_ms)
 {
 	timeout_ms_ = timeout_ms;
 }
+void CurlHttpRequestBase::SetCancellationToken(const NS_EXTENSION::CancellationToken& token)
+{
+	cancellation_token_.RemoveCancelCallback(cancel_callback_id_);
+	cancel_callback_id_ = 0;
+	cancellation_token_ = token;
+}
+void CurlHttpRequestBase::WatchCancellation(const std::function<void(HttpRequestID)>& remove_request)
+{
+	cancellation_token_.RemoveCancelCallback(cancel_callback_id_);
+	HttpRequestID request_id = GetRequestID();
+	cancel_callback_id_ = cancellation_token_.AddCancelCallback([remove_request, request_id]() {
+		remove_request(request_id);
+	});
+}
+long CurlHttpRequestBase::LimitTimeoutByDeadline(long timeout_ms) const
+{
+	if (!cancellation_token_.HasDeadline())
+		return timeout_ms;
+	// 0 is no timeout to curl, an expired deadline times out at once
+	long remaining_ms = (long)std::min<int64_t>(cancellation_token_.GetRemainingTime().InMilliseconds(), LONG_MAX);
+	remaining_ms = std::max(remaining_ms, 1L);
+	return timeout_ms > 0 ? std::min(timeout_ms, remaining_ms) : remaining_ms;
+}
 void CurlHttpRequestBase::SetIPResolve(IPRESOLVE ipresolve)
 {
 	ipresolve_ = ipresolve;
@@ -366,7 +591,8 @@ static int ConvertProxyType(NS_NET::ProxyType type)
 
 static void ConfigProxy(CURL *easy_handle, const NS_NET::ProxyInfo& proxy)
 {
-	if (proxy.type_ == NS_NET::kProxyNone)
+	// kProxySystem is resolved before the request is posted
+	if (!proxy.Valid())
 		return;
 
 	// "Daniel Stenberg"<daniel@haxx.se> tells me by mail that we are using
@@ -512,40 +738,83 @@ bool CurlHttpRequestBase::OnEasyHandleCreated()
 
 	curl_easy_setopt(easy_handle_, CURLOPT_ERRORBUFFER, error_buffer_);
 	curl_easy_setopt(easy_handle_, CURLOPT_URL, url_.c_str());
-	curl_easy_setopt(easy_handle_, CURLOPT_HTTPHEADER, header_list_);
+	ApplyHeaderList();
 	curl_easy_setopt(easy_handle_, CURLOPT_SSL_VERIFYPEER, false);
 	curl_easy_setopt(easy_handle_, CURLOPT_MAXREDIRS, 20);//设置重定向的最大次数	  
 	curl_easy_setopt(easy_handle_, CURLOPT_AUTOREFERER, 1);// 设置自动设置refer字段
+	if (connect_only_)
+		curl_easy_setopt(easy_handle_, CURLOPT_CONNECT_ONLY, 1L);
 	curl_easy_setopt(easy_handle_, CURLOPT_FOLLOWLOCATION, 1);//设置301、302跳转跟随location
 	curl_easy_setopt(easy_handle_, CURLOPT_COOKIEFILE, ""); // enable cookie
 	curl_easy_setopt(easy_handle_, CURLOPT_IPRESOLVE, ipresolve_);
+	if (http_version_ == HTTP_PROTOCOL_1_0)
+		curl_easy_setopt(easy_handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+	else if (http_version_ == HTTP_PROTOCOL_1_1)
+		curl_easy_setopt(easy_handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	else if (http_version_ == HTTP_PROTOCOL_2)
+		curl_easy_setopt(easy_handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+	else if (http_version_ == HTTP_PROTOCOL_3)
+		// The fallback, the manager switches it to HTTP/3 if curl supports it
+		curl_easy_setopt(easy_handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
 	curl_easy_setopt(easy_handle_,
 					 CURLOPT_USERAGENT,
-					 "NEngine/1.0 (compatible; MSIE 6.0; Windows NT 5.1)");
+					 template_options_ != nullptr && !template_options_->user_agent.empty() ?
+					 template_options_->user_agent.c_str() : kDefaultUserAgent);
 	// Timeout in milliseconds  
-	if (timeout_ms_ > 0) {
-		curl_easy_setopt(easy_handle_, CURLOPT_TIMEOUT_MS, timeout_ms_);
+	long timeout_ms = LimitTimeoutByDeadline(timeout_ms_);
+	if (timeout_ms > 0) {
+		curl_easy_setopt(easy_handle_, CURLOPT_TIMEOUT_MS, timeout_ms);
 	}
 
+	// An empty string offers all the encodings curl is built with
+	curl_easy_setopt(easy_handle_, CURLOPT_ACCEPT_ENCODING, auto_decompress_ ? "" : NULL);
+
+	if (method_ == HEAD)
+		curl_easy_setopt(easy_handle_, CURLOPT_NOBODY, 1);
 	if (method_ != POST)
 		curl_easy_setopt(easy_handle_, CURLOPT_POST, 0);
 	else {
 		curl_easy_setopt(easy_handle_, CURLOPT_POST, 1);
-		if (form_post_ != NULL)
+		bool chunked = false;
+		if (form_post_ != NULL) {
 			curl_easy_setopt(easy_handle_, CURLOPT_HTTPPOST, form_post_);
+			for (auto& source : upload_sources_)
+				chunked = chunked || source->size < 0;
+		}
+		else if (post_source_ != nullptr) {
+			curl_easy_setopt(easy_handle_, CURLOPT_READDATA, post_source_.get());
+			curl_easy_setopt(easy_handle_, CURLOPT_SEEKDATA, post_source_.get());
+			curl_easy_setopt(easy_handle_, CURLOPT_SEEKFUNCTION, SeekUploadSource);
+			if (post_source_->size >= 0)
+				curl_easy_setopt(easy_handle_, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)post_source_->size);
+			else
+				chunked = true;
+		}
 		else {
-			if (!post_fields_.empty()) {
+			const std::string *post_fields = &post_fields_;
+			compressed_post_fields_.clear();
+			if (compress_post_fields_ && post_fields_.size() >= kMinCompressSize
+				&& NS_EXTENSION::Compressor::Compress(post_fields_.data(), post_fields_.size(),
+					&compressed_post_fields_, NS_EXTENSION::CompressionFormat::kGzip)
+				&& compressed_post_fields_.size() < post_fields_.size()) {
+				post_fields = &compressed_post_fields_;
+				AddTransferHeader("Content-Encoding: gzip");
+			}
+			if (!post_fields->empty()) {
 				curl_easy_setopt(easy_handle_,
 								 CURLOPT_POSTFIELDS,
-								 post_fields_.data());
+								 post_fields->data());
 			}
 			curl_easy_setopt(easy_handle_,
 							 CURLOPT_POSTFIELDSIZE,
-							 post_fields_.size());
+							 post_fields->size());
 		}
-		// we have files to upload
-		if (!upload_file_handles_.empty())
-			curl_easy_setopt(easy_handle_, CURLOPT_READFUNCTION, ReadOSFile);
+		// we have streams to upload
+		if (!upload_sources_.empty() || post_source_ != nullptr)
+			curl_easy_setopt(easy_handle_, CURLOPT_READFUNCTION, ReadUploadSource);
+		// The size is unknown, HTTP/1.1 needs chunked transfer encoding
+		if (chunked)
+			AddTransferHeader("Transfer-Encoding: chunked");
 	}
     
 	if (url_.length() > 8 && url_.substr(0,8) == "https://") {
@@ -560,6 +829,11 @@ bool CurlHttpRequestBase::OnEasyHandleCreated()
 #endif
 		// we don't verify the authenticity of the peer's certificate
 		curl_easy_setopt(easy_handle_, CURLOPT_SSL_VERIFYPEER, 0);
+		if (template_options_ != nullptr && template_options_->verify_peer) {
+			curl_easy_setopt(easy_handle_, CURLOPT_SSL_VERIFYPEER, 1);
+			// The CA file is parsed once for the process instead of for every connection
+			CurlSSLTrustStore::Apply(easy_handle_, template_options_->ca_file);
+		}
 		if (/*post_ && */cached_header_host_ == "nosup-hz1.127.net")
 		{
 			//if neither is not set to 0, curl will return 51 //ignore this 20170802
@@ -575,11 +849,43 @@ bool CurlHttpRequestBase::OnEasyHandleCreated()
 		}
 	}
 
-	ConfigProxy(easy_handle_, proxy_);
+	ConfigProxy(easy_handle_, proxy_.Valid() || template_options_ == nullptr ? proxy_ : template_options_->proxy);
+
+	if (connect_to_list_ != NULL) {
+		curl_slist_free_all(connect_to_list_);
+		connect_to_list_ = NULL;
+	}
+	if (!connect_to_address_.empty()) {
+		// "HOST:PORT:CONNECT-TO-HOST:CONNECT-TO-PORT", empty ones match any
+		std::string connect_to("::");
+		if (connect_to_address_.find(':') != std::string::npos)
+			connect_to.append("[").append(connect_to_address_).append("]:");
+		else
+			connect_to.append(connect_to_address_).append(":");
+		connect_to_list_ = curl_slist_append(NULL, connect_to.c_str());
+		curl_easy_setopt(easy_handle_, CURLOPT_CONNECT_TO, connect_to_list_);
+	}
+	if (fresh_connect_)
+		curl_easy_setopt(easy_handle_, CURLOPT_FRESH_CONNECT, 1L);
 
 	return true;
 }
 
+void CurlHttpRequestBase::TuneForNetworkQuality()
+{
+	CurlNetworkSession::TuneForNetworkQuality();
+	auto estimator = NS_EXTENSION::NetworkQualityEstimator::GetInstance();
+	long connect_timeout_ms = kDefaultConnectTimeoutMs;
+	// The deadline of the token is not extended by the network quality
+	long timeout_ms = LimitTimeoutByDeadline(timeout_ms_ > 0 ? estimator->TuneTimeout(timeout_ms_) : 0);
+	if (timeout_ms > 0) {
+		curl_easy_setopt(easy_handle_, CURLOPT_TIMEOUT_MS, timeout_ms);
+		connect_timeout_ms = std::min(connect_timeout_ms, timeout_ms);
+	}
+	curl_easy_setopt(easy_handle_, CURLOPT_CONNECTTIMEOUT_MS,
+		estimator->TuneConnectTimeout(HttpMetrics::HostOfURL(url_), connect_timeout_ms));
+}
+
 void CurlHttpRequestBase::OnTransferDone()
 {
 	if (!proxy_.Valid())
@@ -603,6 +909,8 @@ void CurlHttpRequestBase::OnEasyHandleDestroyed()
 	ClearHeaderFields();
 	ClearForms();
 	post_fields_.clear();
+	compressed_post_fields_.clear();
+	post_source_.reset();
 }
 
 void CurlHttpRequestBase::OnError()
@@ -610,4 +918,59 @@ void CurlHttpRequestBase::OnError()
 
 }
 
+void CurlHttpRequestBase::OnRetry()
+{
+	if (post_source_ != nullptr && (post_source_->file != nullptr || post_source_->is_chain))
+		SeekUploadSource(post_source_.get(), 0, SEEK_SET);
+	for (auto& source : upload_sources_)
+		SeekUploadSource(source.get(), 0, SEEK_SET);
+}
+
+bool CurlHttpRequestBase::CanResendBody() const
+{
+	if (post_source_ != nullptr && post_source_->file == nullptr && !post_source_->is_chain)
+		return false;
+	for (auto& source : upload_sources_) {
+		if (source->file == nullptr)
+			return false;
+	}
+	return true;
+}
+
+bool CurlHttpRequestBase::IsTransientFailure(long response_code) const
+{
+	switch (result_) {
+	case CURLE_OK:
+		return response_code == 408 || response_code == 429 ||
+			response_code == 502 || response_code == 503 || response_code == 504;
+	case CURLE_COULDNT_RESOLVE_HOST:
+	case CURLE_COULDNT_CONNECT:
+	case CURLE_OPERATION_TIMEDOUT:
+	case CURLE_SSL_CONNECT_ERROR:
+	case CURLE_SEND_ERROR:
+	case CURLE_RECV_ERROR:
+	case CURLE_GOT_NOTHING:
+	case CURLE_PARTIAL_FILE:
+	case CURLE_HTTP2:
+	case CURLE_HTTP2_STREAM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+NS_EXTENSION::TimeDelta CurlHttpRequestBase::NextRetryDelay(long long retry_after_ms) const
+{
+	double delay_ms = retry_policy_.initial_backoff_ms *
+		std::pow(std::max(retry_policy_.backoff_multiplier, 1.0), retry_count_);
+	delay_ms = std::min(delay_ms, (double)retry_policy_.max_backoff_ms);
+	// Spreads the retries of the requests failed together
+	double jitter = std::min(std::max(retry_policy_.jitter, 0.0), 1.0);
+	if (jitter > 0)
+		delay_ms *= 1.0 + jitter * (2.0 * base::RandDouble() - 1.0);
+	if (retry_after_ms > delay_ms)
+		delay_ms = (double)std::min<long long>(retry_after_ms, retry_policy_.max_backoff_ms);
+	return NS_EXTENSION::TimeDelta::FromMilliseconds((int64_t)std::max(delay_ms, 0.0));
+}
+
 HTTP_END_DECLS
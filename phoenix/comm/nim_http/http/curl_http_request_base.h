@@ -5,8 +5,12 @@
 #include "nim_http/config/build_config.h"
 
 #include <list>
+#include <memory>
 #include <string>
 #include "proxy_config/proxy_config/proxy_info.h"
+#include "extension/callback/cancellation_token.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/chained_buffer.h"
 #include "nim_log/log/log_def.h"
 #include "nim_http/http/curl_network_session.h"
 #include "nim_http/wrapper/http_def.h"
@@ -17,7 +21,47 @@
 
 HTTP_BEGIN_DECLS
 
+// An upload body read while transferring, from a file, a chained buffer or
+// the caller
+struct CurlUploadSource
+{
+	CurlUploadSource() : file(nullptr), mapped_offset(0), is_chain(false), size(-1) {}
+	~CurlUploadSource() { if (file != nullptr) fclose(file); }
+	FILE *file;
+	// A file is mapped when possible and copied to curl from the mapping,
+	// |file| is only used for those which cannot be mapped
+	std::unique_ptr<NS_EXTENSION::MappedFile> mapped;
+	size_t mapped_offset;
+	UploadReadCallback read_callback;
+	// |chain| keeps the whole body for rewinding, |chain_left| is what is
+	// left to be read
+	NS_EXTENSION::ChainedBuffer chain;
+	NS_EXTENSION::ChainedBuffer chain_left;
+	bool is_chain;
+	// Negative if unknown
+	long long size;
+};
 
+// The options of the requests created by a HttpRequestTemplateImp, shared by
+// them and never changed once shared
+struct CurlTemplateOptions
+{
+	CurlTemplateOptions() : header_list(NULL), verify_peer(false), timeout_ms(0),
+		low_speed_limit(0), low_speed_time(0), ipresolve(IPRESOLVE_WHATEVER), priority(PRIORITY_NORMAL) {}
+	~CurlTemplateOptions() { if (header_list != NULL) curl_slist_free_all(header_list); }
+	curl_slist *header_list;
+	// The value of the "Host" header if any
+	std::string header_host;
+	std::string user_agent;
+	NS_NET::ProxyInfo proxy;
+	bool verify_peer;
+	std::string ca_file;
+	long timeout_ms;
+	long low_speed_limit;
+	long low_speed_time;
+	IPRESOLVE ipresolve;
+	HTTP_PRIORITY priority;
+};
 
 class HTTP_EXPORT CurlHttpRequestBase : public CurlNetworkSession,public IHttpRequest
 {	
@@ -36,9 +80,14 @@ public:
 	virtual void AddHeaderField(const std::string &name, const std::string &value) override;
 	virtual void ClearHeaderFields() override;
 	virtual bool SetPostFields(const void *data, size_t size) override;
+	virtual bool SetPostFile(const std::string& file_path) override;
+	virtual bool SetPostStream(const UploadReadCallback& read_cb, long long size = -1) override;
+	virtual bool SetPostChain(const NS_EXTENSION::ChainedBuffer& body) override;
 	virtual bool AddForm(const std::string& name, const std::string& value, const std::string& content_type = "") override;
 	virtual bool AddFormWithBuffer(const std::string& name, const void *buffer, size_t buffer_length, const std::string& content_type = "") override;
 	virtual bool AddFormWithFilePath(const std::string& name, const std::string& file_path, const std::string& content_type = "") override;
+	virtual bool AddFormWithStream(const std::string& name, const std::string& file_name, const UploadReadCallback& read_cb,
+		long long size, const std::string& content_type = "") override;
 	virtual void ClearForms() override;	
 	// |cookie| should be in the format of
 	// "name1=content1[;name2=content2[;name3=content3...]]"
@@ -48,13 +97,48 @@ public:
 	virtual bool SetReferer(const char *referer) override;
 	virtual bool SetReferer(const std::string &referer) override;
 	virtual bool ProxyValid() const override;
+	// A proxy of type kProxySystem is to be resolved before posting, by the
+	// request or by its template
+	bool ProxyIsSystem() const;
 	virtual void SetProxy(const NS_NET::ProxyInfo &proxy) override;
 	virtual void SetProxy(NS_NET::ProxyInfo&& proxy) override;
 	// Set the transfer timeout in milliseconds.
 	virtual void SetTimeout(long timeout_ms) override;
+	virtual void SetCancellationToken(const NS_EXTENSION::CancellationToken& token) override;
+	const NS_EXTENSION::CancellationToken& GetCancellationToken() const { return cancellation_token_; }
+	// Calls |remove_request| with the ID of the request when the token is
+	// cancelled, until the request is destructed
+	void WatchCancellation(const std::function<void(HttpRequestID)>& remove_request);
 	virtual void SetLowSpeed(long low_speed_limit, long low_speed_time) override;
 	virtual void SetIPResolve(IPRESOLVE ipresolve) override;
+	virtual void SetHttpVersion(HTTP_PROTOCOL_VERSION version) override { http_version_ = version; }
+	virtual bool HasHttpVersion() const override { return http_version_ != HTTP_PROTOCOL_DEFAULT; }
+	// An HTTPS request of the default version or of HTTP_PROTOCOL_3 without
+	// a proxy, the proxies are not reached over QUIC
+	virtual bool GetHttp3Origin(std::string &origin, bool &required) const override;
+	// Adds the connect timeout and the total timeout by the network quality
+	virtual void TuneForNetworkQuality() override;
+	virtual void SetPriority(HTTP_PRIORITY priority) override { priority_ = priority; }
+	virtual HTTP_PRIORITY GetPriority() const override { return priority_; }
+	virtual void SetAutoDecompress(bool enable) override { auto_decompress_ = enable; }
+	virtual void SetCompressPostFields(bool enable) override { compress_post_fields_ = enable; }
+	virtual void SetRetryPolicy(const HttpRetryPolicy& policy) override { retry_policy_ = policy; }
+	virtual void SetHedgePolicy(const HttpHedgePolicy& policy) override { hedge_policy_ = policy; }
+	// Takes the options of a template, the setters called later override them
+	void SetTemplateOptions(const std::shared_ptr<const CurlTemplateOptions>& options);
+	virtual void SetDeferrable(bool deferrable, const std::string& coalesce_key = "") override
+	{
+		deferrable_ = deferrable;
+		coalesce_key_ = coalesce_key;
+	}
+	bool IsDeferrable() const { return deferrable_; }
+	// Connects and completes the TLS handshake only, the connection stays in
+	// the connection cache of the transfer loop for the next requests
+	void SetConnectOnly(bool connect_only) { connect_only_ = connect_only; }
+	bool IsConnectOnly() const { return connect_only_; }
 protected:
+	friend class HttpOutbox;
+
 	// Called immediately after the easy handle created
 	// You can do `curl_easy_setopt` work as you like,
 	// such as setting url, setting cookies, etc.
@@ -65,20 +149,68 @@ protected:
 	virtual void OnError();
 	// Called after the easy handle destroyed.
 	virtual void OnEasyHandleDestroyed();
+	// Rewinds the upload files for the next attempt
+	virtual void OnRetry();
+
+	// Appends |field| to the headers of the transfer unless it is there
+	// already, e.g. by the last attempt of a retry
+	void AddTransferHeader(const char *field);
+	// Whether the body can be sent again, a body read by a callback can not
+	bool CanResendBody() const;
+	// Fails with a retriable error or status
+	bool IsTransientFailure(long response_code) const;
+	// Backoff of the next retry by |retry_policy_|, |retry_after_ms| is
+	// asked by the server, negative if not
+	NS_EXTENSION::TimeDelta NextRetryDelay(long long retry_after_ms) const;
+
+	// Sets CURLOPT_HTTPHEADER to the headers of the template followed by the
+	// ones of the request
+	void ApplyHeaderList();
+
+	// |timeout_ms| cut to what is left before the deadline of the
+	// cancellation token, 0 is no timeout
+	long LimitTimeoutByDeadline(long timeout_ms) const;
+
+	bool AddFormWithSource(const std::string& name, const std::string& file_name,
+		std::unique_ptr<CurlUploadSource> source, const std::string& content_type);
 
 	METHODS method_;
 	long response_code_;
 	long timeout_ms_;
+	NS_EXTENSION::CancellationToken cancellation_token_;
+	NS_EXTENSION::CancellationToken::CallbackID cancel_callback_id_;
 	IPRESOLVE ipresolve_;
+	HTTP_PROTOCOL_VERSION http_version_;
 	std::string url_;
 	NS_NET::ProxyInfo proxy_;
 	curl_slist *header_list_;
+	std::shared_ptr<const CurlTemplateOptions> template_options_;
+	// The copy of the headers of the template and the request, if both have
+	// any, used while transferring
+	curl_slist *merged_header_list_;
 	curl_httppost *form_post_;
 	curl_httppost *form_post_last_;
 	std::string post_fields_;
-	std::list<FILE *> upload_file_handles_;
+	bool auto_decompress_;
+	bool compress_post_fields_;
+	// Sent instead of |post_fields_| while transferring
+	std::string compressed_post_fields_;
+	// Streamed parts of |form_post_|, each part reads its own source
+	std::list<std::unique_ptr<CurlUploadSource>> upload_sources_;
+	// Streamed body instead of |post_fields_|
+	std::unique_ptr<CurlUploadSource> post_source_;
+	HttpRetryPolicy retry_policy_;
+	int retry_count_;
+	HttpHedgePolicy hedge_policy_;
+	// A hedge connects to |connect_to_address_| with a new connection
+	std::string connect_to_address_;
+	bool fresh_connect_;
+	curl_slist *connect_to_list_;
 	char error_buffer_[CURL_ERROR_SIZE];
 	std::string cached_header_host_;
+	bool deferrable_;
+	std::string coalesce_key_;
+	bool connect_only_;
 };
 
 NET_END_DECLS
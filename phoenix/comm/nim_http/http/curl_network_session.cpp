@@ -1,5 +1,6 @@
 #include "nim_http/http/curl_network_session.h"
 #include "nim_log/wrapper/log.h"
+#include "extension/network/network_quality_estimator.h"
 
 HTTP_BEGIN_DECLS
 //#ifdef OS_WIN
@@ -18,8 +19,11 @@ CurlNetworkSession::CurlNetworkSession()
 	: easy_handle_(nullptr),
 	  result_(CURLE_FAILED_INIT),
 	  num_active_watchers_(0),
+	  resolve_list_(nullptr),
+	  http3_fallback_(false),
 	  low_speed_limit_(10),
 	  low_speed_time_(60),
+	  priority_(PRIORITY_NORMAL),
 	  transfer_done_(true),
 	  session_id_(CalcSessionID())
 {
@@ -31,11 +35,11 @@ CurlNetworkSession::~CurlNetworkSession()
 	DestroyCurlEasyHandle();
 }
 
-bool CurlNetworkSession::CreateCurlEasyHandle()
+bool CurlNetworkSession::CreateCurlEasyHandle(CURL *reused_handle/* = nullptr*/)
 {
 	//DCHECK(easy_handle_ == nullptr);
 
-	easy_handle_ = curl_easy_init();
+	easy_handle_ = reused_handle != nullptr ? reused_handle : curl_easy_init();
 	if (easy_handle_ == nullptr) {
 		HTTP_QLOG_ERR( GetLogger(),"[net][http] CurlNetworkSession create easy handle failed.");
 		return false;
@@ -47,13 +51,45 @@ bool CurlNetworkSession::CreateCurlEasyHandle()
 	return OnEasyHandleCreated();
 }
 
-void CurlNetworkSession::DestroyCurlEasyHandle()
+void CurlNetworkSession::TuneForNetworkQuality()
+{
+	curl_easy_setopt(easy_handle_, CURLOPT_LOW_SPEED_TIME,
+		NS_EXTENSION::NetworkQualityEstimator::GetInstance()->TuneLowSpeedTime(low_speed_time_));
+}
+
+void CurlNetworkSession::SetResolveList(curl_slist *resolve_list)
+{
+	if (easy_handle_ != nullptr)
+		curl_easy_setopt(easy_handle_, CURLOPT_RESOLVE, resolve_list);
+	if (resolve_list_ != nullptr)
+		curl_slist_free_all(resolve_list_);
+	resolve_list_ = resolve_list;
+}
+
+void CurlNetworkSession::DestroyCurlEasyHandle(bool notify/* = true*/)
 {
 	if (easy_handle_ != nullptr) {
 		curl_easy_cleanup(easy_handle_);
 		easy_handle_ = nullptr;
-		OnEasyHandleDestroyed();
+		SetResolveList(nullptr);
+		if (notify)
+			OnEasyHandleDestroyed();
+	}
+}
+
+CURL *CurlNetworkSession::ReleaseCurlEasyHandle(bool notify/* = true*/)
+{
+	CURL *easy_handle = easy_handle_;
+	if (easy_handle != nullptr) {
+		// Cookies are not cleared by curl_easy_reset
+		curl_easy_setopt(easy_handle, CURLOPT_COOKIELIST, "ALL");
+		curl_easy_reset(easy_handle);
+		easy_handle_ = nullptr;
+		SetResolveList(nullptr);
+		if (notify)
+			OnEasyHandleDestroyed();
 	}
+	return easy_handle;
 }
 
 HTTP_END_DECLS
@@ -3,7 +3,9 @@
 #include "nim_http/config/build_config.h"
 #include <memory>
 #include <atomic>
+#include <string>
 #include "base/macros.h"
+#include "extension/time/time.h"
 #include "nim_log/log/log_def.h"
 #include "nim_http/http_export.h"
 #include "nim_http/wrapper/http_def.h"
@@ -26,6 +28,7 @@ public:
 	explicit CurlNetworkSession();  
 	virtual ~CurlNetworkSession();
 	CurlNetworkSessionID GetSessioinID() const { return session_id_; }	
+	HTTP_PRIORITY GetSessionPriority() const { return priority_; }
 	// Called immediately after the easy handle created
 	// You can do `curl_easy_setopt` work as you like,
 	// such as setting url, setting cookies, etc.
@@ -41,6 +44,39 @@ public:
 	virtual void OnRegistered() {}
 	// Called when deregistered
 	virtual void OnDeregisterd() {}
+	// Called after OnTransferDone() or OnError(), returns true to run the
+	// session again after |delay| instead of finishing it
+	virtual bool ShouldRetry(NS_EXTENSION::TimeDelta &delay) { return false; }
+	// Called before the session is run again by a retry
+	virtual void OnRetry() {}
+	// Returns true if the session can start over on a new connection when
+	// the network changed before any response arrived, see
+	// CurlNetworkSessionManager::ResetConnections()
+	virtual bool CanRestart() const { return false; }
+	// Returns true if the session can start over after it failed to connect,
+	// nothing has reached the server then
+	virtual bool CanReconnect() const { return false; }
+	// Returns true if a duplicate is started when the session is still
+	// running after |delay|, a zero |delay| is chosen by the manager
+	virtual bool GetHedgeDelay(NS_EXTENSION::TimeDelta &delay) const { return false; }
+	// Returns the duplicate racing the session, nullptr if not hedged
+	virtual std::shared_ptr<CurlNetworkSession> CreateHedgeSession() { return nullptr; }
+	// Called when the duplicate made by CreateHedgeSession() wins, the
+	// session takes the response of |hedge| before it is removed
+	virtual void AdoptHedgeResponse(CurlNetworkSession *hedge) {}
+	// Returns true if the session chose its HTTP version, the default one of
+	// the manager is not applied then
+	virtual bool HasHttpVersion() const { return false; }
+	// Returns true with the origin ("host:port") of the session if it may go
+	// over HTTP/3, |required| if the session asked for HTTP/3 itself instead
+	// of by the Alt-Svc of the origin, see HttpAltSvcCache
+	virtual bool GetHttp3Origin(std::string &origin, bool &required) const { return false; }
+	// Returns true with the Alt-Svc header of the response
+	virtual bool GetAltSvc(std::string &alt_svc) const { return false; }
+	// Called by a manager with the network quality tuning enabled after the
+	// options of the session are set, see
+	// CurlNetworkSessionManager::EnableNetworkQualityTuning()
+	virtual void TuneForNetworkQuality();
 
 protected:
 	// Session result
@@ -51,21 +87,44 @@ protected:
 	long low_speed_limit_;
 	long low_speed_time_;
 
+	// Changed by the manager on its own thread once the session is added
+	std::atomic<HTTP_PRIORITY> priority_;
+
 private:
 	friend class CurlNetworkSessionManager;
+	friend class CurlSessionScheduler;
+	friend class CurlBandwidthThrottler;
 
 	// Whether the session has been done by Curl
 	bool transfer_done_;
 	// Number of active watchers owned by libuv
 	int num_active_watchers_;
+	// When the session was handed to curl
+	NS_EXTENSION::TimeTicks start_time_;
+	// CURLOPT_RESOLVE list set by the manager, it must live as long as the
+	// easy handle uses it
+	curl_slist *resolve_list_;
+	// The origin of the attempt over HTTP/3, empty if it is on TCP
+	std::string http3_origin_;
+	// HTTP/3 failed to connect, the next attempts go on TCP
+	bool http3_fallback_;
 
 	bool CanBeSafelyRemoved() const
 	{
 		return transfer_done_ && !num_active_watchers_;
 	}
 
-	bool CreateCurlEasyHandle();
-	void DestroyCurlEasyHandle();
+	// |reused_handle| is a handle given up by ReleaseCurlEasyHandle(),
+	// a new one is created if it is nullptr
+	bool CreateCurlEasyHandle(CURL *reused_handle = nullptr);
+	void SetResolveList(curl_slist *resolve_list);
+	// OnEasyHandleDestroyed() is not called if |notify| is false, e.g. the
+	// session is going to be retried
+	void DestroyCurlEasyHandle(bool notify = true);
+	// Gives up the easy handle without cleaning it, so that the manager can
+	// reuse it for another session. Options and cookies of the session are
+	// cleared, the connections and caches of the handle are kept.
+	CURL *ReleaseCurlEasyHandle(bool notify = true);
 public:
 	static const CurlNetworkSessionID kINVALID_SESSIONID;
 private:
@@ -1,19 +1,23 @@
 #include "nim_http/http/curl_network_session_manager_uv.h"
 #include "extension/callback/post_task.h"
+#include "extension/network/network_quality_estimator.h"
+#include "nim_http/http/http_alt_svc_cache.h"
 #include "nim_log/wrapper/log.h"
 #include "libuv/uv.h"
 #include <algorithm>
+#include <vector>
 
 USING_NS_EXTENSION
 
 HTTP_BEGIN_DECLS
 
-#if defined(OS_WIN)
-const size_t kMaxSockets = WSA_MAXIMUM_WAIT_EVENTS;
-#else
-const size_t kMaxSockets = 64;
-#endif
 const long kDefaultTimeout = 1000;
+const size_t kMaxIdleEasyHandles = 16;
+// The hedge delay is the p95 of the latencies once there are enough samples
+const size_t kMaxLatencySamples = 128;
+const size_t kMinLatencySamples = 16;
+const int64_t kDefaultHedgeDelayMs = 1000;
+const int64_t kThrottleIntervalMs = 100;
 
 struct CurlNetworkSessionManager::CurlWatcher :
 	public MessagePumpForUV::Watcher
@@ -46,7 +50,9 @@ struct CurlNetworkSessionManager::CurlWatcher :
 };
 
 CurlNetworkSessionManager::CurlNetworkSessionManager(std::weak_ptr<MessageLoopCurrentForUV> message_loop_current) : initialized_(false),
-	still_running_(0), message_loop_current_(message_loop_current)
+	still_running_(0), multi_handle_(nullptr), share_handle_(nullptr),
+	http2_supported_(false), http3_supported_(false), http3_enabled_(false), network_quality_tuning_(false), quality_observer_index_(0),
+	message_loop_current_(message_loop_current)
 {
 	//DCHECK(message_loop_ != nullptr);
 	auto current = message_loop_current_.lock();
@@ -78,26 +84,124 @@ void CurlNetworkSessionManager::DoInit()
 		curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this);
 		curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, CurlTimerCB);
 		curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this);
-		//curl_multi_setopt(multi_handle_, CURLMOPT_PIPELINING, 0);
-		curl_multi_setopt(multi_handle_,
-						  CURLMOPT_MAX_TOTAL_CONNECTIONS,
-						  kMaxSockets-1);
+		// Requests to the same host share one HTTP/2 connection
+		curl_multi_setopt(multi_handle_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
 	}
 
+	share_handle_ = CreateShareHandle();
+
+	curl_version_info_data *version_info = curl_version_info(CURLVERSION_NOW);
+	http2_supported_ = version_info != nullptr && (version_info->features & CURL_VERSION_HTTP2) != 0;
+#if LIBCURL_VERSION_NUM >= 0x074200 && defined(CURL_VERSION_HTTP3)
+	// The header may be newer than the library linked
+	http3_supported_ = version_info != nullptr && (version_info->features & CURL_VERSION_HTTP3) != 0;
+#endif
+	DoSetConcurrency(concurrency_);
+
 	initialized_ = true;
 }
 
 CurlNetworkSessionManager::~CurlNetworkSessionManager()
 {
+	if (quality_observer_index_ != 0)
+		NS_EXTENSION::NetworkQualityEstimator::GetInstance()->DetachTypeChanged(quality_observer_index_);
 	std::for_each(
 		sessions_.begin(), sessions_.end(), [&](SessionScopedRefPtr session) {
 		curl_multi_remove_handle(multi_handle_, session->easy_handle_);
 		session->DestroyCurlEasyHandle();
 	});
 	sessions_.clear();
+	hedge_sessions_.clear();
+	hedged_sessions_.clear();
+	retrying_sessions_.clear();
+	restarting_sessions_.clear();
+	while (!pending_sessions_.empty())
+		pending_sessions_.Pop()->DestroyCurlEasyHandle();
+	std::for_each(
+		idle_easy_handles_.begin(), idle_easy_handles_.end(), [](CURL *easy_handle) {
+		curl_easy_cleanup(easy_handle);
+	});
+	idle_easy_handles_.clear();
 	if (multi_handle_ != nullptr) {
 		curl_multi_cleanup(multi_handle_);
 	}
+	// All the easy handles using the share have been cleaned up
+	if (share_handle_ != nullptr) {
+		curl_share_cleanup(share_handle_);
+	}
+	CleanupRetiredShares();
+}
+
+CURLSH *CurlNetworkSessionManager::CreateShareHandle()
+{
+	CURLSH *share_handle = curl_share_init();
+	if (share_handle != nullptr) {
+		curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, CurlShareLockCB);
+		curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, CurlShareUnlockCB);
+		curl_share_setopt(share_handle, CURLSHOPT_USERDATA, this);
+		curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+		curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+	return share_handle;
+}
+
+void CurlNetworkSessionManager::CleanupRetiredShares()
+{
+	// A share is in use until the last easy handle leaves it
+	for (auto iter = retired_share_handles_.begin(); iter != retired_share_handles_.end();) {
+		if (curl_share_cleanup(*iter) == CURLSHE_OK)
+			iter = retired_share_handles_.erase(iter);
+		else
+			iter++;
+	}
+}
+
+void CurlNetworkSessionManager::CurlShareLockCB(CURL *handle, curl_lock_data data,
+												curl_lock_access access, void *userp)
+{
+	// Sessions run on the loop thread, but a session released by its owner
+	// may clean its easy handle up on another thread
+	CurlNetworkSessionManager *manager =
+		reinterpret_cast<CurlNetworkSessionManager *>(userp);
+	if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+		manager->share_locks_[data].lock();
+}
+
+void CurlNetworkSessionManager::CurlShareUnlockCB(CURL *handle, curl_lock_data data, void *userp)
+{
+	CurlNetworkSessionManager *manager =
+		reinterpret_cast<CurlNetworkSessionManager *>(userp);
+	if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+		manager->share_locks_[data].unlock();
+}
+
+CURL *CurlNetworkSessionManager::TakeEasyHandle()
+{
+	if (idle_easy_handles_.empty())
+		return nullptr;
+	CURL *easy_handle = idle_easy_handles_.back();
+	idle_easy_handles_.pop_back();
+	return easy_handle;
+}
+
+void CurlNetworkSessionManager::RecycleEasyHandle(CurlNetworkSession *session, bool notify/* = true*/)
+{
+	if (idle_easy_handles_.size() >= kMaxIdleEasyHandles) {
+		session->DestroyCurlEasyHandle(notify);
+		if (!retired_share_handles_.empty())
+			CleanupRetiredShares();
+		return;
+	}
+	CURL *easy_handle = session->ReleaseCurlEasyHandle(notify);
+	if (easy_handle == nullptr)
+		return;
+	idle_easy_handles_.push_back(easy_handle);
+	if (!retired_share_handles_.empty()) {
+		// The handle leaves the share of the old network
+		curl_easy_setopt(easy_handle, CURLOPT_SHARE, share_handle_);
+		CleanupRetiredShares();
+	}
 }
 
 void CurlNetworkSessionManager::ConfigureSession(
@@ -109,6 +213,29 @@ void CurlNetworkSessionManager::ConfigureSession(
 	curl_easy_setopt(easy_handle, CURLOPT_VERBOSE, 0L);
 #endif
 	curl_easy_setopt(easy_handle, CURLOPT_PRIVATE, session);
+	if (share_handle_ != nullptr)
+		curl_easy_setopt(easy_handle, CURLOPT_SHARE, share_handle_);
+	if (http2_supported_ && !session->HasHttpVersion()) {
+		// HTTP/2 over TLS, HTTP/1.1 for plain HTTP and the servers not supporting it.
+		// Wait for a connection to multiplex on instead of opening a new one
+		curl_easy_setopt(easy_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+		curl_easy_setopt(easy_handle, CURLOPT_PIPEWAIT, 1L);
+	}
+	session->http3_origin_.clear();
+#if LIBCURL_VERSION_NUM >= 0x074200
+	// CURL_HTTP_VERSION_3 came with curl 7.66.0
+	std::string origin;
+	bool required = false;
+	if (http3_supported_ && !session->http3_fallback_ && session->GetHttp3Origin(origin, required)) {
+		HttpAltSvcCache *alt_svc_cache = HttpAltSvcCache::GetInstance();
+		if (required ? !alt_svc_cache->IsBroken(origin) : (http3_enabled_ && alt_svc_cache->ShouldUseHttp3(origin))) {
+			curl_easy_setopt(easy_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_3);
+			session->http3_origin_ = origin;
+		}
+	}
+#endif
+	if (network_quality_tuning_)
+		session->TuneForNetworkQuality();
 }
 
 void CurlNetworkSessionManager::AddSession(const SessionScopedRefPtr &session)
@@ -124,7 +251,7 @@ void CurlNetworkSessionManager::AddSession(const SessionScopedRefPtr &session)
 	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoAddSession, this, session);
 	auto current = message_loop_current_.lock();
 	if (current != nullptr) {
-		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+		current->GetMessagePump()->PostOperation(closure);
 	}
 }
 
@@ -138,7 +265,7 @@ void CurlNetworkSessionManager::DoAddSession(
 	if (session == nullptr || !multi_handle_)
 		return;
 
-	if (!session->CreateCurlEasyHandle()) {
+	if (!session->CreateCurlEasyHandle(TakeEasyHandle())) {
 		session->OnError();
 		return;
 	}
@@ -146,7 +273,7 @@ void CurlNetworkSessionManager::DoAddSession(
 	// We will overwrite the following options even modified by the session
 	ConfigureSession(session->easy_handle_, session.get());
 
-	pending_sessions_.push_back(session);
+	pending_sessions_.Push(session);
 	session->OnRegistered();
 
 	StartNextSession();
@@ -162,25 +289,336 @@ void CurlNetworkSessionManager::StartNextSession()
 	}
 }
 
-void CurlNetworkSessionManager::DoStartNextSession()
+void CurlNetworkSessionManager::SetConcurrency(const HttpConcurrency &concurrency)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoSetConcurrency, this, concurrency);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoSetConcurrency(const HttpConcurrency &concurrency)
+{
+	concurrency_ = concurrency;
+	ApplyConnectionLimits();
+}
+
+void CurlNetworkSessionManager::ApplyConnectionLimits()
 {
-	if (sessions_.size() >= kMaxSockets-1)
+	if (multi_handle_ == nullptr)
 		return;
 
-	if (pending_sessions_.empty())
+	long max_host_connections = concurrency_.max_host_connections;
+	if (network_quality_tuning_)
+		max_host_connections = NS_EXTENSION::NetworkQualityEstimator::GetInstance()->TuneMaxHostConnections(max_host_connections);
+	// The sessions over the connection limits are queued by curl and
+	// started as soon as a connection is available
+	curl_multi_setopt(multi_handle_,
+					  CURLMOPT_MAX_TOTAL_CONNECTIONS,
+					  concurrency_.max_total_connections);
+	curl_multi_setopt(multi_handle_,
+					  CURLMOPT_MAX_HOST_CONNECTIONS,
+					  max_host_connections);
+
+	// The running limit may be raised
+	StartNextSession();
+}
+
+void CurlNetworkSessionManager::EnableNetworkQualityTuning(bool enable)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoEnableNetworkQualityTuning, this, enable);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::EnableHttp3(bool enable)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoEnableHttp3, this, enable);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoEnableHttp3(bool enable)
+{
+	http3_enabled_ = enable;
+}
+
+void CurlNetworkSessionManager::DoEnableNetworkQualityTuning(bool enable)
+{
+	if (network_quality_tuning_ == enable)
 		return;
+	network_quality_tuning_ = enable;
+	auto estimator = NS_EXTENSION::NetworkQualityEstimator::GetInstance();
+	if (enable) {
+		// The estimator calls back on the thread reporting the sample, the
+		// limits are applied on ours
+		std::weak_ptr<MessageLoopCurrentForUV> message_loop_current = message_loop_current_;
+		StdClosure weak_closure = ToWeakCallback(NS_EXTENSION::Bind(&CurlNetworkSessionManager::ApplyConnectionLimits, this));
+		quality_observer_index_ = estimator->AttachTypeChanged(
+			[message_loop_current, weak_closure](NS_EXTENSION::EffectiveConnectionType) {
+			auto current = message_loop_current.lock();
+			if (current != nullptr)
+				PostTask(current->GetTaskRunner().get(), FROM_HERE, weak_closure);
+		});
+	} else if (quality_observer_index_ != 0) {
+		estimator->DetachTypeChanged(quality_observer_index_);
+		quality_observer_index_ = 0;
+	}
+	ApplyConnectionLimits();
+}
+
+void CurlNetworkSessionManager::SetBandwidthLimit(const HttpBandwidthLimit &limit)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoSetBandwidthLimit, this, limit);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
 
-	SessionScopedRefPtr session = *pending_sessions_.begin();
-	sessions_.insert(session);
-	pending_sessions_.erase(pending_sessions_.begin());
+void CurlNetworkSessionManager::DoSetBandwidthLimit(const HttpBandwidthLimit &limit)
+{
+	if (throttler_.SetLimit(limit) && multi_handle_ != nullptr)
+		PerformTimeoutAction();
+	if (!throttler_.enabled())
+		throttle_cb_weakflag_.Cancel();
+	ScheduleThrottle();
+}
+
+void CurlNetworkSessionManager::ScheduleThrottle()
+{
+	if (!throttler_.enabled() || sessions_.empty() || throttle_cb_weakflag_.HasUsed())
+		return;
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoThrottle, this);
+	StdClosure weak_closure = throttle_cb_weakflag_.ToWeakCallback(closure);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostDelayedTask(current->GetTaskRunner().get(), FROM_HERE, weak_closure,
+			NS_EXTENSION::TimeDelta::FromMilliseconds(kThrottleIntervalMs));
+	}
+}
 
-	CURLMcode rc = curl_multi_add_handle(multi_handle_, session->easy_handle_);
+void CurlNetworkSessionManager::DoThrottle()
+{
+	throttle_cb_weakflag_.Cancel();
+	// A resumed transfer goes on by the timeout action, curl does not
+	// notify the sockets of a paused one
+	if (throttler_.Update(sessions_))
+		PerformTimeoutAction();
+	ScheduleThrottle();
+}
 
-	if (CURLM_OK != rc) {
-		HTTP_QLOG_ERR(GetLogger(), "[net][http] Add easy handle failed{0}") << rc;
-		DoRemoveSession(session.get());
+void CurlNetworkSessionManager::SetSessionPriority(CurlNetworkSessionID session_id, HTTP_PRIORITY priority)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoSetSessionPriority, this, session_id, priority);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoSetSessionPriority(CurlNetworkSessionID session_id, HTTP_PRIORITY priority)
+{
+	if (pending_sessions_.Reprioritize(session_id, priority))
+		return;
+
+	// Curl sends a PRIORITY frame for a running HTTP/2 stream whose weight
+	// changed, it makes no difference to HTTP/1.x
+	for (auto iter = sessions_.begin(); iter != sessions_.end(); iter++) {
+		if ((*iter)->GetSessioinID() == session_id) {
+			(*iter)->priority_ = priority;
+			curl_easy_setopt((*iter)->easy_handle_, CURLOPT_STREAM_WEIGHT, StreamWeight(priority));
+			break;
+		}
+	}
+}
+
+void CurlNetworkSessionManager::SetResolvedHost(const std::string &host, int port,
+												const std::string &address, int ttl_seconds)
+{
+	if (host.empty() || port <= 0)
 		return;
+
+	std::string host_port = host + ":" + std::to_string(port);
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoSetResolvedHost, this, host_port, address, ttl_seconds);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoSetResolvedHost(const std::string &host_port,
+												  const std::string &address, int ttl_seconds)
+{
+	ResolvedHost &resolved = resolved_hosts_[host_port];
+	resolved.address = address;
+	resolved.changed = true;
+	// An expired entry is removed by the next session
+	resolved.expire_time = NS_EXTENSION::TimeTicks::Now();
+	if (!address.empty() && ttl_seconds > 0)
+		resolved.expire_time += NS_EXTENSION::TimeDelta::FromSeconds(ttl_seconds);
+}
+
+void CurlNetworkSessionManager::ApplyResolvedHosts(CurlNetworkSession *session)
+{
+	if (resolved_hosts_.empty())
+		return;
+
+	// Curl loads the list to the DNS cache when the session starts. An
+	// existing entry is not replaced by curl, so it is removed first.
+	curl_slist *resolve_list = nullptr;
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	for (auto iter = resolved_hosts_.begin(); iter != resolved_hosts_.end();) {
+		ResolvedHost &resolved = iter->second;
+		if (now >= resolved.expire_time) {
+			resolve_list = curl_slist_append(resolve_list, ("-" + iter->first).c_str());
+			iter = resolved_hosts_.erase(iter);
+			continue;
+		}
+		if (resolved.changed) {
+			resolve_list = curl_slist_append(resolve_list, ("-" + iter->first).c_str());
+			resolve_list = curl_slist_append(resolve_list, (iter->first + ":" + resolved.address).c_str());
+			resolved.changed = false;
+		}
+		iter++;
 	}
+	if (resolve_list != nullptr)
+		session->SetResolveList(resolve_list);
+}
+
+void CurlNetworkSessionManager::TrimMemory(NS_EXTENSION::MemoryTrimLevel level)
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoTrimMemory, this, level);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoTrimMemory(NS_EXTENSION::MemoryTrimLevel level)
+{
+	if (!initialized_)
+		return;
+
+	// An idle easy handle keeps its receive buffer and the parsed options
+	std::for_each(
+		idle_easy_handles_.begin(), idle_easy_handles_.end(), [](CURL *easy_handle) {
+		curl_easy_cleanup(easy_handle);
+	});
+	idle_easy_handles_.clear();
+	CleanupRetiredShares();
+	if (level < NS_EXTENSION::kMemoryTrimCritical || !sessions_.empty() || !pending_sessions_.empty() ||
+		!retrying_sessions_.empty())
+		return;
+
+	// Nothing is running, the pooled connections, the DNS cache and the TLS
+	// sessions go with the share, the seeded addresses are loaded to the new one
+	CURLSH *share_handle = CreateShareHandle();
+	if (share_handle == nullptr)
+		return;
+	if (share_handle_ != nullptr)
+		retired_share_handles_.push_back(share_handle_);
+	share_handle_ = share_handle;
+	for (auto &item : resolved_hosts_)
+		item.second.changed = true;
+	CleanupRetiredShares();
+}
+
+void CurlNetworkSessionManager::ResetConnections()
+{
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoResetConnections, this);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+	}
+}
+
+void CurlNetworkSessionManager::DoResetConnections()
+{
+	if (!initialized_)
+		return;
+
+	// The running sessions keep the old share until they finish, the new
+	// ones connect and resolve again on the new network
+	CURLSH *share_handle = CreateShareHandle();
+	if (share_handle == nullptr)
+		return;
+	if (share_handle_ != nullptr)
+		retired_share_handles_.push_back(share_handle_);
+	share_handle_ = share_handle;
+	std::for_each(
+		idle_easy_handles_.begin(), idle_easy_handles_.end(), [](CURL *easy_handle) {
+		curl_easy_cleanup(easy_handle);
+	});
+	idle_easy_handles_.clear();
+	// The addresses seeded for the old network may be unreachable now
+	resolved_hosts_.clear();
+	HttpAltSvcCache::GetInstance()->OnNetworkChanged();
+
+	// A session without any response byte is most likely waiting on a dead
+	// connection, it would hang until its timeout
+	std::vector<SessionScopedRefPtr> stalled;
+	for (auto &session : sessions_) {
+		long header_size = 0;
+		if (hedged_sessions_.count(session.get()) != 0 || restarting_sessions_.count(session) != 0 ||
+			!session->CanRestart())
+			continue;
+		if (curl_easy_getinfo(session->easy_handle_, CURLINFO_HEADER_SIZE, &header_size) == CURLE_OK &&
+			header_size == 0)
+			stalled.push_back(session);
+	}
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Reset connections, restart {0} sessions") << (int)stalled.size();
+	for (auto &session : stalled) {
+		CancelHedge(session.get());
+		curl_multi_remove_handle(multi_handle_, session->easy_handle_);
+		// The watchers of the closed sockets are destroyed later, the session
+		// is restarted by DoCheckSessionOrRemoveSafely() then
+		if (session->num_active_watchers_ > 0)
+			restarting_sessions_.insert(session);
+		else
+			RetrySessionLater(session, NS_EXTENSION::TimeDelta());
+	}
+	CleanupRetiredShares();
+}
+
+long CurlNetworkSessionManager::StreamWeight(HTTP_PRIORITY priority)
+{
+	// HTTP/2 weights range in [1, 256], 16 by default
+	static const long kStreamWeights[PRIORITY_COUNT] = { 1, 8, 16, 128 };
+	if (priority < PRIORITY_BACKGROUND || priority >= PRIORITY_COUNT)
+		return kStreamWeights[PRIORITY_NORMAL];
+	return kStreamWeights[priority];
+}
+
+void CurlNetworkSessionManager::DoStartNextSession()
+{
+	while (!pending_sessions_.empty()) {
+		if (concurrency_.max_running_sessions > 0 &&
+			sessions_.size() >= concurrency_.max_running_sessions)
+			return;
+
+		SessionScopedRefPtr session = pending_sessions_.Pop();
+		sessions_.insert(session);
+		curl_easy_setopt(session->easy_handle_, CURLOPT_STREAM_WEIGHT,
+						 StreamWeight(session->GetSessionPriority()));
+		ApplyResolvedHosts(session.get());
+
+		CURLMcode rc = curl_multi_add_handle(multi_handle_, session->easy_handle_);
+
+		if (CURLM_OK != rc) {
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] Add easy handle failed{0}") << rc;
+			DoRemoveSession(session.get());
+			return;
+		}
+		session->start_time_ = NS_EXTENSION::TimeTicks::Now();
+		ScheduleHedge(session);
+	}
+	ScheduleThrottle();
 
 	// Note that the add_handle() will set a time-out to trigger
 	// very soon so that the necessary socket_action() call will be called by
@@ -195,7 +633,7 @@ void CurlNetworkSessionManager::RemoveSession(CurlNetworkSession *session)
 	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoRemoveSession, this, session);
 	auto current = message_loop_current_.lock();
 	if (current != nullptr) {
-		PostTask(current->GetTaskRunner().get(), FROM_HERE, closure);
+		current->GetMessagePump()->PostOperation(closure);
 	}
 }
 
@@ -204,18 +642,41 @@ void CurlNetworkSessionManager::DoRemoveSession(CurlNetworkSession* session)
 	//	DCHECK(initialized_);
 	//	DCHECK(message_loop_->BelongsToCurrentThread());
 
-	auto init_size = sessions_.size();
-	for (auto iter = sessions_.begin(); iter != sessions_.end(); iter++)
-	{
-		if (iter->get() == session)
-		{
-			curl_multi_remove_handle(multi_handle_, session->easy_handle_);
-			session->DestroyCurlEasyHandle();
-			sessions_.erase(iter);			
+	CancelHedge(session);
+
+	for (auto iter = restarting_sessions_.begin(); iter != restarting_sessions_.end(); iter++) {
+		if (iter->get() == session) {
+			restarting_sessions_.erase(iter);
 			break;
 		}
 	}
 
+	// A session waiting for a retry finishes with its last result
+	for (auto iter = retrying_sessions_.begin(); iter != retrying_sessions_.end(); iter++) {
+		if (iter->get() == session) {
+			SessionScopedRefPtr retrying = *iter;
+			retrying_sessions_.erase(iter);
+			retrying->OnEasyHandleDestroyed();
+			return;
+		}
+	}
+
+	// A session removed before it is started
+	if (pending_sessions_.Remove(session)) {
+		RecycleEasyHandle(session);
+		return;
+	}
+
+	// A non-owning key for the lookup, the set hashes and compares the pointer only
+	auto iter = sessions_.find(SessionScopedRefPtr(SessionScopedRefPtr(), session));
+	if (iter != sessions_.end())
+	{
+		throttler_.RemoveSession(session);
+		curl_multi_remove_handle(multi_handle_, session->easy_handle_);
+		RecycleEasyHandle(session);
+		sessions_.erase(iter);
+	}
+
 	StartNextSession();
 }
 
@@ -234,15 +695,201 @@ void CurlNetworkSessionManager::CompleteSessionAndRemoveSoon(
 void CurlNetworkSessionManager::DoCheckSessionOrRemoveSafely(const SessionScopedRefPtr& session)
 {
 	// Check and remove
-	if (session->CanBeSafelyRemoved()) {
-		if (session->result_ != CURLE_OK)
-			session->OnError();
-		else
-			session->OnTransferDone();
+	if (!session->CanBeSafelyRemoved())
+		return;
+
+	if (restarting_sessions_.erase(session) != 0) {
+		RetrySessionLater(session, NS_EXTENSION::TimeDelta());
+		return;
+	}
+
+#if LIBCURL_VERSION_NUM < 0x075800
+	// HTTP_VERSION_3 does not fall back to TCP by itself before curl 7.88.0,
+	// the session starts over on TCP if the QUIC connection failed. A hedge
+	// is left to the session it races.
+	if (!session->http3_origin_.empty() && session->result_ != CURLE_OK && IsHttp3ConnectError(session.get())) {
+		HttpAltSvcCache::GetInstance()->MarkBroken(session->http3_origin_);
+		if (hedged_sessions_.count(session.get()) == 0 && session->CanReconnect()) {
+			HTTP_QLOG_APP(GetLogger(), "[net][http] HTTP/3 of ID {0} failed, result {1}, fall back to TCP")
+				<< session->GetSessioinID() << session->result_;
+			session->http3_fallback_ = true;
+			CancelHedge(session.get());
+			RetrySessionLater(session, NS_EXTENSION::TimeDelta());
+			return;
+		}
+	}
+#endif
+
+	if (session->result_ != CURLE_OK) {
+		session->OnError();
+	} else {
+		if (http3_supported_)
+			RecordHttp3Result(session.get());
+		session->OnTransferDone();
+	}
+
+	auto hedged_iter = hedged_sessions_.find(session.get());
+	if (hedged_iter != hedged_sessions_.end()) {
+		// A duplicate finished first, it is never retried
+		SessionScopedRefPtr hedged = hedged_iter->second;
+		hedged_sessions_.erase(hedged_iter);
+		hedge_sessions_.erase(hedged.get());
+		if (session->result_ == CURLE_OK) {
+			HTTP_QLOG_APP(GetLogger(), "[net][http] Hedge of ID {0} wins") << hedged->GetSessioinID();
+			RecordLatency(session);
+			hedged->AdoptHedgeResponse(session.get());
+			DoRemoveSession(hedged.get());
+		}
 		DoRemoveSession(session.get());
+		return;
+	}
+
+	// The duplicate loses whatever the result is
+	CancelHedge(session.get());
+	if (session->result_ == CURLE_OK)
+		RecordLatency(session);
+
+	NS_EXTENSION::TimeDelta delay;
+	if (session->ShouldRetry(delay)) {
+		RetrySessionLater(session, delay);
+		return;
+	}
+	DoRemoveSession(session.get());
+}
+
+bool CurlNetworkSessionManager::IsHttp3ConnectError(CurlNetworkSession *session) const
+{
+	switch (session->result_) {
+	case CURLE_COULDNT_CONNECT:
+#if LIBCURL_VERSION_NUM >= 0x074500
+	case CURLE_HTTP3:
+	case CURLE_QUIC_CONNECT_ERROR:
+#endif
+		return true;
+	case CURLE_OPERATION_TIMEDOUT: {
+		// Timed out in the QUIC handshake, UDP may be blocked
+		double connect_time = 0;
+		return curl_easy_getinfo(session->easy_handle_, CURLINFO_CONNECT_TIME, &connect_time) == CURLE_OK &&
+			connect_time <= 0;
+	}
+	default:
+		return false;
+	}
+}
+
+void CurlNetworkSessionManager::RecordHttp3Result(CurlNetworkSession *session)
+{
+	HttpAltSvcCache *alt_svc_cache = HttpAltSvcCache::GetInstance();
+#if LIBCURL_VERSION_NUM >= 0x074200
+	long http_version = 0;
+	if (!session->http3_origin_.empty() &&
+		curl_easy_getinfo(session->easy_handle_, CURLINFO_HTTP_VERSION, &http_version) == CURLE_OK &&
+		http_version == CURL_HTTP_VERSION_3)
+		alt_svc_cache->MarkWorking(session->http3_origin_);
+#endif
+	// The origin of the last response if redirected
+	std::string alt_svc;
+	std::string origin;
+	char *url = nullptr;
+	if (session->GetAltSvc(alt_svc) &&
+		curl_easy_getinfo(session->easy_handle_, CURLINFO_EFFECTIVE_URL, &url) == CURLE_OK && url != nullptr &&
+		HttpAltSvcCache::OriginOfURL(url, origin))
+		alt_svc_cache->OnAltSvc(origin, alt_svc);
+}
+
+void CurlNetworkSessionManager::RetrySessionLater(const SessionScopedRefPtr &session,
+												  NS_EXTENSION::TimeDelta delay)
+{
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Retry ID {0} in {1}ms, result {2}")
+		<< session->GetSessioinID() << (int)delay.InMilliseconds() << session->result_;
+	throttler_.RemoveSession(session.get());
+	curl_multi_remove_handle(multi_handle_, session->easy_handle_);
+	// The request keeps its state for the next attempt
+	RecycleEasyHandle(session.get(), false);
+	sessions_.erase(session);
+	retrying_sessions_.insert(session);
+
+	// Delayed tasks are run by the uv timer of MessagePumpForUV
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoRetrySession, this, session);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostDelayedTask(current->GetTaskRunner().get(), FROM_HERE, closure, delay);
+	}
+
+	StartNextSession();
+}
+
+void CurlNetworkSessionManager::DoRetrySession(const SessionScopedRefPtr &session)
+{
+	// Removed while waiting
+	if (retrying_sessions_.erase(session) == 0)
+		return;
+	session->OnRetry();
+	DoAddSession(session);
+}
+
+void CurlNetworkSessionManager::ScheduleHedge(const SessionScopedRefPtr &session)
+{
+	NS_EXTENSION::TimeDelta delay;
+	if (hedged_sessions_.count(session.get()) != 0 || !session->GetHedgeDelay(delay))
+		return;
+	if (delay <= NS_EXTENSION::TimeDelta())
+		delay = HedgeDelay();
+
+	std::weak_ptr<CurlNetworkSession> weak_session(session);
+	StdClosure closure = NS_EXTENSION::Bind(&CurlNetworkSessionManager::DoStartHedge, this, weak_session, session->start_time_);
+	auto current = message_loop_current_.lock();
+	if (current != nullptr) {
+		PostDelayedTask(current->GetTaskRunner().get(), FROM_HERE, closure, delay);
 	}
 }
 
+void CurlNetworkSessionManager::DoStartHedge(const std::weak_ptr<CurlNetworkSession> &weak_session,
+											 NS_EXTENSION::TimeTicks start_time)
+{
+	SessionScopedRefPtr session = weak_session.lock();
+	// Finished or already hedged, or it is another attempt of a retry
+	if (session == nullptr || sessions_.count(session) == 0 ||
+		hedge_sessions_.count(session.get()) != 0 || session->start_time_ != start_time)
+		return;
+
+	SessionScopedRefPtr hedge = session->CreateHedgeSession();
+	if (hedge == nullptr)
+		return;
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Hedge ID {0} by ID {1}") << session->GetSessioinID() << hedge->GetSessioinID();
+	hedge_sessions_[session.get()] = hedge;
+	hedged_sessions_[hedge.get()] = session;
+	DoAddSession(hedge);
+}
+
+void CurlNetworkSessionManager::CancelHedge(CurlNetworkSession *session)
+{
+	auto iter = hedge_sessions_.find(session);
+	if (iter == hedge_sessions_.end())
+		return;
+	SessionScopedRefPtr hedge = iter->second;
+	hedge_sessions_.erase(iter);
+	hedged_sessions_.erase(hedge.get());
+	DoRemoveSession(hedge.get());
+}
+
+void CurlNetworkSessionManager::RecordLatency(const SessionScopedRefPtr &session)
+{
+	latency_samples_.push_back((NS_EXTENSION::TimeTicks::Now() - session->start_time_).InMilliseconds());
+	if (latency_samples_.size() > kMaxLatencySamples)
+		latency_samples_.pop_front();
+}
+
+NS_EXTENSION::TimeDelta CurlNetworkSessionManager::HedgeDelay() const
+{
+	if (latency_samples_.size() < kMinLatencySamples)
+		return NS_EXTENSION::TimeDelta::FromMilliseconds(kDefaultHedgeDelayMs);
+	std::vector<int64_t> samples(latency_samples_.begin(), latency_samples_.end());
+	auto p95 = samples.begin() + samples.size() * 95 / 100;
+	std::nth_element(samples.begin(), p95, samples.end());
+	return NS_EXTENSION::TimeDelta::FromMilliseconds(*p95);
+}
+
 int CurlNetworkSessionManager::CurlSocketEventCB(CURL *e,
 												 curl_socket_t s,
 												 int action,
@@ -1,18 +1,23 @@
 #ifndef HTTP_CURL_CURL_NETWORK_SESSION_MANAGER_UV_H_
 #define HTTP_CURL_CURL_NETWORK_SESSION_MANAGER_UV_H_
 #include "nim_http/config/build_config.h"
+#include <deque>
 #include <list>
 #include <map>
 #include <set>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "extension/callback/callback.h"
+#include "extension/memory/memory_trimmer.h"
 #include "nim_http/http/message_pump_for_uv.h"
 #include "nim_http/http/curl_network_session.h"
+#include "nim_http/http/curl_bandwidth_throttler.h"
+#include "nim_http/http/curl_session_scheduler.h"
+#include "nim_http/wrapper/http_def.h"
 
 HTTP_BEGIN_DECLS
 
-typedef std::shared_ptr<CurlNetworkSession> SessionScopedRefPtr;
-
 class CurlNetworkSessionManager :  public NS_NIMLOG::LoggerSetter, public NS_EXTENSION::SupportWeakCallback
 {
 public:
@@ -27,6 +32,45 @@ public:
 	// the manager will give the session's ownership up
 	void RemoveSession(CurlNetworkSession *session);
 
+	// Limits of the connections and the running sessions, takes effect
+	// for the sessions started after it
+	void SetConcurrency(const HttpConcurrency &concurrency);
+
+	// Caps of the bandwidth of the running sessions, see CurlBandwidthThrottler
+	void SetBandwidthLimit(const HttpBandwidthLimit &limit);
+
+	// Moves a pending session in the priority queue, or changes the
+	// stream weight of a running one
+	void SetSessionPriority(CurlNetworkSessionID session_id, HTTP_PRIORITY priority);
+
+	// Seeds the shared DNS cache with |address| for |host|:|port|, the entry
+	// is removed after |ttl_seconds| and the host is resolved by curl again.
+	// An empty |address| removes the entry at once.
+	void SetResolvedHost(const std::string &host, int port,
+						 const std::string &address, int ttl_seconds);
+
+	// Drops the pooled connections, the DNS cache and the TLS sessions, e.g.
+	// after the network changed. The running sessions which have got no
+	// response yet and CanRestart() start over at once instead of waiting
+	// on a dead connection, the others go on with the old share until
+	// they finish. Addresses seeded by SetResolvedHost() are dropped too.
+	void ResetConnections();
+
+	// Releases the idle easy handles, at kMemoryTrimCritical also the pooled
+	// connections, the DNS cache and the TLS sessions if no session is running
+	void TrimMemory(NS_EXTENSION::MemoryTrimLevel level);
+
+	// Tunes the sessions started after it and the per host connection limit
+	// by NS_EXTENSION::NetworkQualityEstimator, the limit follows the changes
+	// of the effective connection type
+	void EnableNetworkQualityTuning(bool enable);
+
+	// Sends the sessions of the default version to the origins advertising
+	// HTTP/3 by Alt-Svc over QUIC, see HttpAltSvcCache. The sessions asking
+	// for HTTP/3 themselves get it either way. Takes effect if curl is built
+	// with HTTP/3.
+	void EnableHttp3(bool enable);
+
 	// The count of sessions still running
 	int still_running() const { return still_running_; }
 
@@ -38,16 +82,51 @@ private:
 								 void *userp,
 								 void *sockp);
 	static void CurlTimerCB(CURLM *multi, long timeout_ms, void *userp);
+	static void CurlShareLockCB(CURL *handle, curl_lock_data data,
+								curl_lock_access access, void *userp);
+	static void CurlShareUnlockCB(CURL *handle, curl_lock_data data, void *userp);
 
 	void DoInit();
 	void DoAddSession(const SessionScopedRefPtr &session);
 	void DoRemoveSession(CurlNetworkSession* session);
+	void DoSetConcurrency(const HttpConcurrency &concurrency);
+	void DoSetBandwidthLimit(const HttpBandwidthLimit &limit);
+	void ScheduleThrottle();
+	void DoThrottle();
+	void DoSetSessionPriority(CurlNetworkSessionID session_id, HTTP_PRIORITY priority);
+	void DoSetResolvedHost(const std::string &host_port,
+						   const std::string &address, int ttl_seconds);
+	void ApplyResolvedHosts(CurlNetworkSession *session);
+	void DoResetConnections();
+	void DoTrimMemory(NS_EXTENSION::MemoryTrimLevel level);
+	void DoEnableNetworkQualityTuning(bool enable);
+	void DoEnableHttp3(bool enable);
+	// Applies the connection limits of |concurrency_| tuned by the network quality
+	void ApplyConnectionLimits();
+	CURLSH *CreateShareHandle();
+	// Cleans up the retired shares no easy handle uses any more
+	void CleanupRetiredShares();
 
 	void StartNextSession();
 	void DoStartNextSession();
+
+	// Retries and hedging
+	void RetrySessionLater(const SessionScopedRefPtr &session, NS_EXTENSION::TimeDelta delay);
+	void DoRetrySession(const SessionScopedRefPtr &session);
+	void ScheduleHedge(const SessionScopedRefPtr &session);
+	void DoStartHedge(const std::weak_ptr<CurlNetworkSession> &weak_session,
+					  NS_EXTENSION::TimeTicks start_time);
+	void CancelHedge(CurlNetworkSession *session);
+	void RecordLatency(const SessionScopedRefPtr &session);
+	NS_EXTENSION::TimeDelta HedgeDelay() const;
 	void CompleteSessionAndRemoveSoon(const SessionScopedRefPtr& session,
 									  CURLcode result);
 	void DoCheckSessionOrRemoveSafely(const SessionScopedRefPtr& session);
+	// Whether the HTTP/3 attempt of |session| failed before a QUIC connection
+	// was made, TCP may still work
+	bool IsHttp3ConnectError(CurlNetworkSession *session) const;
+	// Takes the Alt-Svc header and the HTTP version of a succeeded session
+	void RecordHttp3Result(CurlNetworkSession *session);
 
 	void CheckMultiRunningStatus();
 	void PerformMultiSocketAction(const SessionScopedRefPtr& session,
@@ -64,10 +143,47 @@ private:
 
 	// Common helpers
 	void ConfigureSession(CURL *easy_handle, CurlNetworkSession *session);
+	static long StreamWeight(HTTP_PRIORITY priority);
+
+	// Easy handle pool
+	CURL *TakeEasyHandle();
+	// OnEasyHandleDestroyed() of the session is not called if |notify| is false
+	void RecycleEasyHandle(CurlNetworkSession *session, bool notify = true);
 
 	bool initialized_;
 	int still_running_;
 	CURLM *multi_handle_;
+	// The connection, DNS and TLS session caches shared by all the sessions
+	CURLSH *share_handle_;
+	// Shares replaced by ResetConnections(), still used by the easy handles
+	// of the sessions running on the old network
+	std::vector<CURLSH *> retired_share_handles_;
+	std::mutex share_locks_[CURL_LOCK_DATA_LAST];
+	bool http2_supported_;
+	bool http3_supported_;
+	bool http3_enabled_;
+	// Easy handles given up by the finished sessions
+	std::vector<CURL *> idle_easy_handles_;
+
+	// Entries added by CURLOPT_RESOLVE never expire in curl, the manager
+	// removes them when their TTL is over
+	struct ResolvedHost
+	{
+		std::string address;
+		NS_EXTENSION::TimeTicks expire_time;
+		// Not loaded to the DNS cache yet
+		bool changed;
+	};
+	// Keyed by "host:port"
+	std::map<std::string, ResolvedHost> resolved_hosts_;
+	HttpConcurrency concurrency_;
+	bool network_quality_tuning_;
+	// Returned by NetworkQualityEstimator::AttachTypeChanged(), 0 if not attached
+	int quality_observer_index_;
+	CurlBandwidthThrottler throttler_;
+	// Cancelable throttle callback, run every kThrottleIntervalMs while
+	// any session is running under a limit
+	NS_EXTENSION::WeakCallbackFlag throttle_cb_weakflag_;
 
 	// Cancelable timeout callback
 	NS_EXTENSION::WeakCallbackFlag timeout_cb_weakflag_;
@@ -75,11 +191,22 @@ private:
 	// The sessions will be insert to the |sessions_| once AddSession called.
 	// When a socket for the session is opened, the socket and session then
 	// will be insert to the |sockets_| map.
-	std::set<SessionScopedRefPtr> sessions_;
-
-	// We allow WSA_MAXIMUM_WAIT_EVENTS-1 sessions to run simultaneously
-	// at most, the remaining will be in the pending set
-	std::list<SessionScopedRefPtr> pending_sessions_;
+	SessionSet sessions_;
+
+	// We allow |concurrency_.max_running_sessions| sessions to run
+	// simultaneously at most, the remaining wait in the priority queue
+	CurlSessionScheduler pending_sessions_;
+
+	// Sessions waiting for the backoff of a retry, they own no easy handle
+	std::set<SessionScopedRefPtr> retrying_sessions_;
+	// Sessions restarted by ResetConnections(), waiting for the watchers of
+	// their old sockets to be destroyed
+	std::set<SessionScopedRefPtr> restarting_sessions_;
+	// The duplicates racing the hedged sessions, and the reverse
+	std::map<CurlNetworkSession *, SessionScopedRefPtr> hedge_sessions_;
+	std::map<CurlNetworkSession *, SessionScopedRefPtr> hedged_sessions_;
+	// Latencies of the recent succeeded sessions in milliseconds
+	std::deque<int64_t> latency_samples_;
 
 	// The proxy of the message loop in which we are running
 	std::weak_ptr<MessageLoopCurrentForUV> message_loop_current_;
@@ -0,0 +1,378 @@
+#include "nim_http/http/curl_segmented_download.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include "base/thread_task_runner_handle.h"
+#include "extension/callback/post_task.h"
+#include "extension/file_util/utf8_file_util.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+// Ranges smaller than it are not worth another connection
+const long long kMinSegmentSize = 1024 * 1024;
+const int kMaxSegmentCount = 16;
+// "NSEG", the header of the segment file is followed by the segments
+const uint32_t kSegmentFileMagic = 0x4745534E;
+struct SegmentFileHeader
+{
+	uint32_t magic;
+	uint32_t segment_count;
+	int64_t total_size;
+};
+struct SegmentFileRecord
+{
+	int64_t first;
+	int64_t last;
+	int64_t downloaded;
+};
+
+bool SeekFile(FILE* file, long long offset)
+{
+#if defined(OS_WIN)
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+}
+
+CurlSegmentedDownload::CurlSegmentedDownload(const HttpManager& manager,
+											 const std::string& url,
+											 const std::string& download_file_path,
+											 int segment_count,
+											 const CompletionCallback& complete_cb,
+											 const ProgressCallback& progress_cb) :
+	manager_(manager), url_(url), download_file_path_(download_file_path),
+	segment_count_(std::min(std::max(segment_count, 1), kMaxSegmentCount)),
+	complete_callback_(complete_cb), progress_callback_(progress_cb),
+	running_(false), canceled_(false), failed_(false), result_code_(0),
+	total_size_(0), downloaded_size_(0), reported_size_(0), running_segments_(0)
+{
+}
+
+CurlSegmentedDownload::~CurlSegmentedDownload()
+{
+}
+
+bool CurlSegmentedDownload::Start()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (running_ || manager_ == nullptr)
+		return false;
+
+	running_ = true;
+	canceled_ = false;
+	failed_ = false;
+	result_code_ = 0;
+	if (base::ThreadTaskRunnerHandle::IsSet())
+		reply_task_runner_ = base::ThreadTaskRunnerHandle::Get();
+
+	// The requests keep the download alive until they are completed
+	auto self = shared_from_this();
+	probe_request_ = std::make_shared<CurlHttpRequest>(url_,
+		[self](const std::shared_ptr<std::string>&, bool succeed, int response_code) {
+		self->OnProbed(succeed, response_code);
+	});
+	probe_request_->SetMethod(HEAD);
+	HttpRequest request = probe_request_;
+	manager_->PostRequest(request);
+	return true;
+}
+
+void CurlSegmentedDownload::Cancel()
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (!running_ || canceled_)
+		return;
+
+	canceled_ = true;
+	if (probe_request_ != nullptr)
+		manager_->RemoveRequest(probe_request_->GetRequestID());
+	if (single_request_ != nullptr)
+		manager_->RemoveRequest(single_request_->GetRequestID());
+	CancelSegments();
+}
+
+bool CurlSegmentedDownload::IsRunning() const
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return running_;
+}
+
+void CurlSegmentedDownload::OnProbed(bool succeed, int response_code)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	std::shared_ptr<CurlHttpRequest> probe_request;
+	probe_request.swap(probe_request_);
+	if (canceled_) {
+		Complete(false, response_code);
+		return;
+	}
+
+	long long total_size = -1;
+	std::string value;
+	if (succeed && probe_request != nullptr && probe_request->FindResponseHeader("Content-Length", value))
+		total_size = std::strtoll(value.c_str(), nullptr, 10);
+	bool accept_ranges = probe_request != nullptr && probe_request->FindResponseHeader("Accept-Ranges", value)
+		&& value.find("bytes") != std::string::npos;
+
+	if (total_size < kMinSegmentSize * 2 || !accept_ranges) {
+		StartSingleDownload();
+		return;
+	}
+	if (!PrepareSegments(total_size)) {
+		Complete(false, CURLE_WRITE_ERROR);
+		return;
+	}
+
+	auto self = shared_from_this();
+	for (size_t index = 0; index < segments_.size(); index++) {
+		Segment& segment = segments_[index];
+		if (segment.first + segment.downloaded > segment.last)
+			continue;
+
+		segment.file.reset(NS_EXTENSION::OpenFile(TempFilePath(), "rb+"));
+		if (!segment.file || !SeekFile(segment.file.get(), segment.first + segment.downloaded)) {
+			failed_ = true;
+			result_code_ = CURLE_WRITE_ERROR;
+			break;
+		}
+		segment.request = std::make_shared<CurlHttpRequest>(url_,
+			[self, index](const std::shared_ptr<std::string>&, bool succeed, int response_code) {
+			self->OnSegmentCompleted(index, succeed, response_code);
+		});
+		segment.request->SetRangeStart(segment.first + segment.downloaded);
+		segment.request->SetRangeEnd(segment.last);
+		segment.request->SetDataCallback([self, index](const char* data, size_t size) {
+			return self->OnSegmentData(index, data, size);
+		});
+		running_segments_++;
+	}
+	if (failed_) {
+		running_segments_ = 0;
+		Complete(false, result_code_);
+		return;
+	}
+	if (running_segments_ == 0) {
+		// Every segment was downloaded before
+		Complete(true, 200);
+		return;
+	}
+	for (auto& segment : segments_) {
+		if (segment.request != nullptr) {
+			HttpRequest request = segment.request;
+			manager_->PostRequest(request);
+		}
+	}
+}
+
+void CurlSegmentedDownload::StartSingleDownload()
+{
+	auto self = shared_from_this();
+	single_request_ = std::make_shared<CurlHttpRequest>(url_, download_file_path_,
+		[self](bool succeed, int response_code) {
+		std::lock_guard<std::recursive_mutex> auto_lock(self->mutex_);
+		self->single_request_.reset();
+		self->Complete(succeed, response_code);
+	},
+		progress_callback_);
+	HttpRequest request = single_request_;
+	manager_->PostRequest(request);
+}
+
+bool CurlSegmentedDownload::PrepareSegments(long long total_size)
+{
+	total_size_ = total_size;
+	downloaded_size_ = 0;
+	reported_size_ = 0;
+	segments_.clear();
+
+	std::string directory;
+	NS_EXTENSION::FilePathApartDirectory(download_file_path_, directory);
+	NS_EXTENSION::CreateDirectory(directory);
+
+	if (LoadSegments(total_size)) {
+		for (auto& segment : segments_)
+			downloaded_size_ += segment.downloaded;
+		return true;
+	}
+
+	// Preallocate the file, so every segment writes to its own place
+	{
+		std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file(NS_EXTENSION::OpenFile(TempFilePath(), "wb"));
+		if (!file || !SeekFile(file.get(), total_size - 1) || fputc(0, file.get()) == EOF)
+			return false;
+	}
+
+	int segment_count = (int)std::min<long long>(segment_count_, total_size / kMinSegmentSize);
+	long long segment_size = total_size / segment_count;
+	segments_.resize(segment_count);
+	for (int index = 0; index < segment_count; index++) {
+		segments_[index].first = segment_size * index;
+		segments_[index].last = index == segment_count - 1 ? total_size - 1 : segment_size * (index + 1) - 1;
+		segments_[index].downloaded = 0;
+	}
+
+	segment_file_handle_.reset(NS_EXTENSION::OpenFile(SegmentFilePath(), "wb+"));
+	if (!segment_file_handle_)
+		return false;
+	SegmentFileHeader header = { kSegmentFileMagic, (uint32_t)segment_count, total_size };
+	if (fwrite(&header, sizeof(header), 1, segment_file_handle_.get()) != 1)
+		return false;
+	for (size_t index = 0; index < segments_.size(); index++) {
+		SegmentFileRecord record = { segments_[index].first, segments_[index].last, 0 };
+		if (fwrite(&record, sizeof(record), 1, segment_file_handle_.get()) != 1)
+			return false;
+	}
+	return fflush(segment_file_handle_.get()) == 0;
+}
+
+bool CurlSegmentedDownload::LoadSegments(long long total_size)
+{
+	if (NS_EXTENSION::GetFileSize(TempFilePath()) != total_size)
+		return false;
+
+	segment_file_handle_.reset(NS_EXTENSION::OpenFile(SegmentFilePath(), "rb+"));
+	if (!segment_file_handle_)
+		return false;
+
+	SegmentFileHeader header;
+	if (fread(&header, sizeof(header), 1, segment_file_handle_.get()) != 1 ||
+		header.magic != kSegmentFileMagic || header.total_size != total_size ||
+		header.segment_count == 0 || header.segment_count > kMaxSegmentCount) {
+		segment_file_handle_.reset();
+		return false;
+	}
+
+	segments_.resize(header.segment_count);
+	long long next_first = 0;
+	for (auto& segment : segments_) {
+		SegmentFileRecord record;
+		if (fread(&record, sizeof(record), 1, segment_file_handle_.get()) != 1 ||
+			record.first != next_first || record.last < record.first ||
+			record.downloaded < 0 || record.downloaded > record.last - record.first + 1) {
+			segments_.clear();
+			segment_file_handle_.reset();
+			return false;
+		}
+		segment.first = record.first;
+		segment.last = record.last;
+		segment.downloaded = record.downloaded;
+		next_first = record.last + 1;
+	}
+	if (next_first != total_size) {
+		segments_.clear();
+		segment_file_handle_.reset();
+		return false;
+	}
+	return true;
+}
+
+bool CurlSegmentedDownload::WriteSegmentProgress(size_t index)
+{
+	if (!segment_file_handle_)
+		return false;
+
+	long long offset = sizeof(SegmentFileHeader) + sizeof(SegmentFileRecord) * index + offsetof(SegmentFileRecord, downloaded);
+	int64_t downloaded = segments_[index].downloaded;
+	return SeekFile(segment_file_handle_.get(), offset) &&
+		fwrite(&downloaded, sizeof(downloaded), 1, segment_file_handle_.get()) == 1 &&
+		fflush(segment_file_handle_.get()) == 0;
+}
+
+bool CurlSegmentedDownload::OnSegmentData(size_t index, const char* data, size_t size)
+{
+	long long downloaded = 0;
+	long long total_size = 0;
+	{
+		std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+		if (canceled_ || failed_ || index >= segments_.size())
+			return false;
+
+		Segment& segment = segments_[index];
+		if (!segment.file || segment.first + segment.downloaded + (long long)size > segment.last + 1)
+			return false;
+		if (fwrite(data, 1, size, segment.file.get()) != size || fflush(segment.file.get()) != 0)
+			return false;
+
+		// The data is flushed before its progress is recorded
+		segment.downloaded += size;
+		downloaded_size_ += size;
+		WriteSegmentProgress(index);
+		// Report every 1% at most
+		if (downloaded_size_ - reported_size_ < total_size_ / 100 && downloaded_size_ != total_size_)
+			return true;
+		reported_size_ = downloaded_size_;
+		downloaded = downloaded_size_;
+		total_size = total_size_;
+	}
+	NotifyProgress(downloaded, total_size);
+	return true;
+}
+
+void CurlSegmentedDownload::OnSegmentCompleted(size_t index, bool succeed, int response_code)
+{
+	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	if (index >= segments_.size() || segments_[index].request == nullptr)
+		return;
+
+	Segment& segment = segments_[index];
+	segment.file.reset();
+	segment.request.reset();
+	if (!failed_ && (!succeed || segment.first + segment.downloaded != segment.last + 1)) {
+		failed_ = true;
+		result_code_ = response_code;
+		CancelSegments();
+	}
+
+	if (--running_segments_ > 0)
+		return;
+	if (canceled_ || failed_) {
+		Complete(false, result_code_);
+		return;
+	}
+	Complete(true, response_code);
+}
+
+void CurlSegmentedDownload::CancelSegments()
+{
+	for (auto& segment : segments_) {
+		if (segment.request != nullptr)
+			manager_->RemoveRequest(segment.request->GetRequestID());
+	}
+}
+
+void CurlSegmentedDownload::Complete(bool succeed, int response_code)
+{
+	segments_.clear();
+	segment_file_handle_.reset();
+	if (succeed && total_size_ > 0) {
+		// The segments are not needed any more, the file is complete
+		NS_EXTENSION::DeleteFile(download_file_path_);
+		succeed = NS_EXTENSION::MoveFile(TempFilePath(), download_file_path_);
+		if (succeed)
+			NS_EXTENSION::DeleteFile(SegmentFilePath());
+	}
+	total_size_ = 0;
+	running_ = false;
+
+	if (!complete_callback_)
+		return;
+	if (reply_task_runner_ != nullptr)
+		NS_EXTENSION::PostTask(reply_task_runner_.get(), FROM_HERE, NS_EXTENSION::Bind(complete_callback_, succeed, response_code));
+	else
+		complete_callback_(succeed, response_code);
+}
+
+void CurlSegmentedDownload::NotifyProgress(long long downloaded, long long total_size)
+{
+	if (!progress_callback_)
+		return;
+	if (reply_task_runner_ != nullptr)
+		NS_EXTENSION::PostTask(reply_task_runner_.get(), FROM_HERE, NS_EXTENSION::Bind(progress_callback_, 0.0, 0.0, (double)total_size, (double)downloaded));
+	else
+		progress_callback_(0.0, 0.0, (double)total_size, (double)downloaded);
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,88 @@
+#ifndef __BASE_HTTP_CURL_SEGMENTED_DOWNLOAD_H__
+#define __BASE_HTTP_CURL_SEGMENTED_DOWNLOAD_H__
+
+#include "nim_http/config/build_config.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "extension/memory/file_deleter.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// Probes the size of the file with HEAD, then fetches |segment_count| byte
+// ranges by the requests posted to |manager|. Falls back to a plain download
+// if the server does not accept ranges or the file is small.
+// The callbacks run on the thread calling Start() if it has a task runner,
+// otherwise on the transfer thread.
+class CurlSegmentedDownload : public ISegmentedDownload,
+	public std::enable_shared_from_this<CurlSegmentedDownload>
+{
+public:
+	CurlSegmentedDownload(const HttpManager& manager,
+						  const std::string& url,
+						  const std::string& download_file_path,
+						  int segment_count,
+						  const CompletionCallback& complete_cb,
+						  const ProgressCallback& progress_cb = ProgressCallback());
+	virtual ~CurlSegmentedDownload();
+
+	virtual bool Start() override;
+	virtual void Cancel() override;
+	virtual bool IsRunning() const override;
+
+private:
+	struct Segment
+	{
+		long long first;
+		long long last;
+		long long downloaded;
+		std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file;
+		std::shared_ptr<CurlHttpRequest> request;
+	};
+
+	void OnProbed(bool succeed, int response_code);
+	void StartSingleDownload();
+	bool PrepareSegments(long long total_size);
+	bool LoadSegments(long long total_size);
+	bool WriteSegmentProgress(size_t index);
+	bool OnSegmentData(size_t index, const char* data, size_t size);
+	void OnSegmentCompleted(size_t index, bool succeed, int response_code);
+	void CancelSegments();
+	// Called with |mutex_| locked
+	void Complete(bool succeed, int response_code);
+	void NotifyProgress(long long downloaded, long long total_size);
+
+	std::string TempFilePath() const { return download_file_path_ + ".tmp"; }
+	std::string SegmentFilePath() const { return download_file_path_ + ".seg"; }
+
+	HttpManager manager_;
+	std::string url_;
+	std::string download_file_path_;
+	int segment_count_;
+	CompletionCallback complete_callback_;
+	ProgressCallback progress_callback_;
+	scoped_refptr<base::SingleThreadTaskRunner> reply_task_runner_;
+
+	// Recursive, the completion callback may start the download again
+	mutable std::recursive_mutex mutex_;
+	bool running_;
+	bool canceled_;
+	bool failed_;
+	int result_code_;
+	long long total_size_;
+	long long downloaded_size_;
+	long long reported_size_;
+	size_t running_segments_;
+	std::shared_ptr<CurlHttpRequest> probe_request_;
+	std::shared_ptr<CurlHttpRequest> single_request_;
+	std::vector<Segment> segments_;
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> segment_file_handle_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlSegmentedDownload);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CURL_SEGMENTED_DOWNLOAD_H__
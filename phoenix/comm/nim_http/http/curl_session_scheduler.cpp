@@ -0,0 +1,103 @@
+#include "nim_http/http/curl_session_scheduler.h"
+
+HTTP_BEGIN_DECLS
+
+CurlSessionScheduler::CurlSessionScheduler(NS_EXTENSION::TimeDelta aging_interval)
+	: aging_interval_(aging_interval), size_(0)
+{
+}
+
+CurlSessionScheduler::~CurlSessionScheduler()
+{
+}
+
+HTTP_PRIORITY CurlSessionScheduler::ClampPriority(HTTP_PRIORITY priority)
+{
+	if (priority < PRIORITY_BACKGROUND)
+		return PRIORITY_BACKGROUND;
+	if (priority >= PRIORITY_COUNT)
+		return PRIORITY_HIGH;
+	return priority;
+}
+
+void CurlSessionScheduler::Push(const SessionScopedRefPtr &session)
+{
+	if (session == nullptr)
+		return;
+
+	PendingSession pending;
+	pending.session = session;
+	pending.queued_time = NS_EXTENSION::TimeTicks::Now();
+	queues_[ClampPriority(session->GetSessionPriority())].push_back(pending);
+	size_++;
+}
+
+SessionScopedRefPtr CurlSessionScheduler::Pop()
+{
+	if (size_ == 0)
+		return nullptr;
+
+	Age(NS_EXTENSION::TimeTicks::Now());
+
+	for (int priority = PRIORITY_COUNT - 1; priority >= PRIORITY_BACKGROUND; priority--) {
+		PendingQueue &queue = queues_[priority];
+		if (!queue.empty()) {
+			SessionScopedRefPtr session = queue.front().session;
+			queue.pop_front();
+			size_--;
+			return session;
+		}
+	}
+	return nullptr;
+}
+
+bool CurlSessionScheduler::Remove(CurlNetworkSession *session)
+{
+	for (auto &queue : queues_) {
+		for (auto iter = queue.begin(); iter != queue.end(); iter++) {
+			if (iter->session.get() == session) {
+				queue.erase(iter);
+				size_--;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool CurlSessionScheduler::Reprioritize(CurlNetworkSessionID session_id, HTTP_PRIORITY priority)
+{
+	priority = ClampPriority(priority);
+	for (auto &queue : queues_) {
+		for (auto iter = queue.begin(); iter != queue.end(); iter++) {
+			if (iter->session->GetSessioinID() == session_id) {
+				PendingSession pending = *iter;
+				queue.erase(iter);
+				pending.session->priority_ = priority;
+				pending.queued_time = NS_EXTENSION::TimeTicks::Now();
+				queues_[priority].push_back(pending);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void CurlSessionScheduler::Age(NS_EXTENSION::TimeTicks now)
+{
+	// Each queue is ordered by |queued_time|, only the fronts need checking.
+	// Going from the top down, a promoted session is moved at most one
+	// priority each time.
+	for (int priority = PRIORITY_COUNT - 2; priority >= PRIORITY_BACKGROUND; priority--) {
+		PendingQueue &queue = queues_[priority];
+		while (!queue.empty() && now - queue.front().queued_time >= aging_interval_) {
+			PendingSession pending = queue.front();
+			queue.pop_front();
+			// The session keeps its own priority, only its place is promoted
+			pending.queued_time = now;
+			queues_[priority + 1].push_back(pending);
+		}
+	}
+}
+
+HTTP_END_DECLS
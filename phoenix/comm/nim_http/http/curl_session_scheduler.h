@@ -0,0 +1,62 @@
+#ifndef HTTP_CURL_CURL_SESSION_SCHEDULER_H_
+#define HTTP_CURL_CURL_SESSION_SCHEDULER_H_
+#include "nim_http/config/build_config.h"
+#include <list>
+#include <memory>
+#include "extension/time/time.h"
+#include "nim_http/http/curl_network_session.h"
+
+HTTP_BEGIN_DECLS
+
+typedef std::shared_ptr<CurlNetworkSession> SessionScopedRefPtr;
+
+// The pending queue of CurlNetworkSessionManager.
+// Sessions are queued by priority, FIFO in the same priority. A session
+// waiting longer than |aging_interval| in a queue is promoted to the next
+// priority, so the background sessions are started even under a steady
+// stream of high priority ones.
+// Not thread safe, used on the thread of the manager only.
+class CurlSessionScheduler
+{
+public:
+	explicit CurlSessionScheduler(
+		NS_EXTENSION::TimeDelta aging_interval = NS_EXTENSION::TimeDelta::FromSeconds(2));
+	~CurlSessionScheduler();
+
+	void Push(const SessionScopedRefPtr &session);
+
+	// Returns the pending session of the highest priority, nullptr if empty
+	SessionScopedRefPtr Pop();
+
+	// Returns false if the session is not pending
+	bool Remove(CurlNetworkSession *session);
+
+	// Moves a pending session to the end of the queue of |priority|,
+	// returns false if the session is not pending
+	bool Reprioritize(CurlNetworkSessionID session_id, HTTP_PRIORITY priority);
+
+	bool empty() const { return size_ == 0; }
+	size_t size() const { return size_; }
+
+private:
+	struct PendingSession
+	{
+		SessionScopedRefPtr session;
+		// When the session entered its current queue
+		NS_EXTENSION::TimeTicks queued_time;
+	};
+	typedef std::list<PendingSession> PendingQueue;
+
+	static HTTP_PRIORITY ClampPriority(HTTP_PRIORITY priority);
+	void Age(NS_EXTENSION::TimeTicks now);
+
+	NS_EXTENSION::TimeDelta aging_interval_;
+	PendingQueue queues_[PRIORITY_COUNT];
+	size_t size_;
+
+	DISALLOW_COPY_AND_ASSIGN(CurlSessionScheduler);
+};
+
+HTTP_END_DECLS
+
+#endif // HTTP_CURL_CURL_SESSION_SCHEDULER_H_
@@ -0,0 +1,178 @@
+#include "nim_http/http/curl_ssl_trust_store.h"
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/x509_vfy.h>
+
+#include <algorithm>
+
+HTTP_BEGIN_DECLS
+
+void CurlSSLTrustStore::Apply(CURL* easy_handle, const std::string& ca_file)
+{
+	Store* store = GetInstance()->GetStore(ca_file);
+	// curl parses no CA file into the new SSL_CTX then, the store replaces its empty one.
+	// Without a CA file the default bundle of curl is kept, only the verification is cached.
+	if (!ca_file.empty()) {
+		curl_easy_setopt(easy_handle, CURLOPT_CAINFO, (const char*)NULL);
+		curl_easy_setopt(easy_handle, CURLOPT_CAPATH, (const char*)NULL);
+	}
+	curl_easy_setopt(easy_handle, CURLOPT_SSL_CTX_FUNCTION, &CurlSSLTrustStore::SSLCtxFunc);
+	curl_easy_setopt(easy_handle, CURLOPT_SSL_CTX_DATA, store);
+}
+
+CurlSSLTrustStore* CurlSSLTrustStore::GetInstance()
+{
+	// Never deleted, the SSL_CTX of a connection may still use the stores at exit
+	static CurlSSLTrustStore* instance = new CurlSSLTrustStore;
+	return instance;
+}
+
+CurlSSLTrustStore::CurlSSLTrustStore() : memory_trim_id_(0)
+{
+	memory_trim_id_ = NS_EXTENSION::MemoryTrimmer::Register("nim_http.ssl", [this](NS_EXTENSION::MemoryTrimLevel level) {
+		TrimMemory(level);
+	});
+}
+
+CurlSSLTrustStore::Store* CurlSSLTrustStore::GetStore(const std::string& ca_file)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	std::unique_ptr<Store>& store = stores_[ca_file];
+	if (store == nullptr) {
+		store.reset(new Store);
+		store->ca_file = ca_file;
+	}
+	return store.get();
+}
+
+X509_STORE* CurlSSLTrustStore::AcquireStore(Store* store)
+{
+	if (store->ca_file.empty())
+		return nullptr;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (store->store != nullptr) {
+			X509_STORE_up_ref(store->store);
+			return store->store;
+		}
+	}
+	// Parsed without the lock, the handshakes with a loaded store do not wait
+	X509_STORE* loaded = X509_STORE_new();
+	if (loaded == nullptr)
+		return nullptr;
+	if (X509_STORE_load_locations(loaded, store->ca_file.c_str(), NULL) != 1) {
+		X509_STORE_free(loaded);
+		return nullptr;
+	}
+	X509_STORE_set_flags(loaded, X509_V_FLAG_TRUSTED_FIRST);
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	// Another thread may have loaded it at the same time
+	if (store->store == nullptr)
+		store->store = loaded;
+	else
+		X509_STORE_free(loaded);
+	X509_STORE_up_ref(store->store);
+	return store->store;
+}
+
+bool CurlSSLTrustStore::IsVerified(const std::string& key)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	auto it = verified_.find(key);
+	if (it == verified_.end())
+		return false;
+	if (it->second.expiry <= base::TimeTicks::Now()) {
+		verified_lru_.erase(it->second.lru_it);
+		verified_.erase(it);
+		return false;
+	}
+	verified_lru_.splice(verified_lru_.begin(), verified_lru_, it->second.lru_it);
+	return true;
+}
+
+void CurlSSLTrustStore::AddVerified(const std::string& key, base::TimeDelta ttl)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	auto it = verified_.find(key);
+	if (it != verified_.end()) {
+		verified_lru_.erase(it->second.lru_it);
+		verified_.erase(it);
+	}
+	Verified& verified = verified_[key];
+	verified.expiry = base::TimeTicks::Now() + ttl;
+	verified.lru_it = verified_lru_.insert(verified_lru_.begin(), key);
+	while (verified_.size() > kMaxVerified) {
+		verified_.erase(verified_lru_.back());
+		verified_lru_.pop_back();
+	}
+}
+
+void CurlSSLTrustStore::TrimMemory(NS_EXTENSION::MemoryTrimLevel level)
+{
+	if (level == NS_EXTENSION::kMemoryTrimBackground)
+		return;
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	verified_.clear();
+	verified_lru_.clear();
+	if (level != NS_EXTENSION::kMemoryTrimCritical)
+		return;
+	// The connections keep their references, the next handshake loads the file again
+	for (auto& item : stores_) {
+		if (item.second->store != nullptr) {
+			X509_STORE_free(item.second->store);
+			item.second->store = nullptr;
+		}
+	}
+}
+
+CURLcode CurlSSLTrustStore::SSLCtxFunc(CURL* curl, void* ssl_ctx, void* param)
+{
+	Store* store = (Store*)param;
+	if (store == nullptr)
+		return CURLE_OK;
+	if (!store->ca_file.empty()) {
+		X509_STORE* x509_store = GetInstance()->AcquireStore(store);
+		if (x509_store == nullptr)
+			return CURLE_SSL_CACERT_BADFILE;
+		// Takes the reference
+		SSL_CTX_set_cert_store((SSL_CTX*)ssl_ctx, x509_store);
+	}
+	SSL_CTX_set_cert_verify_callback((SSL_CTX*)ssl_ctx, &CurlSSLTrustStore::VerifyCallback, store);
+	return CURLE_OK;
+}
+
+int CurlSSLTrustStore::VerifyCallback(X509_STORE_CTX* ctx, void* param)
+{
+	Store* store = (Store*)param;
+	X509* leaf = X509_STORE_CTX_get0_cert(ctx);
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_size = 0;
+	if (leaf == nullptr || X509_digest(leaf, EVP_sha256(), digest, &digest_size) != 1)
+		return X509_verify_cert(ctx);
+
+	std::string key = store->ca_file;
+	key.push_back('\n');
+	key.append((const char*)digest, digest_size);
+	CurlSSLTrustStore* instance = GetInstance();
+	if (instance->IsVerified(key)) {
+		X509_STORE_CTX_set_error(ctx, X509_V_OK);
+		return 1;
+	}
+
+	int valid = X509_verify_cert(ctx);
+	if (valid != 1)
+		return valid;
+	int days = 0;
+	int seconds = 0;
+	if (ASN1_TIME_diff(&days, &seconds, NULL, X509_get0_notAfter(leaf)) != 1)
+		return valid;
+	long long remaining = (long long)days * 86400 + seconds;
+	long long ttl = std::min<long long>(remaining, kVerifiedTTLSeconds);
+	if (ttl > 0)
+		instance->AddVerified(key, base::TimeDelta::FromSeconds(ttl));
+	return valid;
+}
+
+HTTP_END_DECLS
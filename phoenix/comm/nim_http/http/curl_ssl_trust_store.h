@@ -0,0 +1,76 @@
+#ifndef __BASE_HTTP_CURL_SSL_TRUST_STORE_H__
+#define __BASE_HTTP_CURL_SSL_TRUST_STORE_H__
+
+#include "nim_http/config/build_config.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <curl/curl.h>
+#include "base/time/time.h"
+#include "extension/memory/memory_trimmer.h"
+
+struct x509_store_st;
+struct x509_store_ctx_st;
+
+HTTP_BEGIN_DECLS
+
+// The CA stores of the requests verifying the peer, shared by the process.
+// curl 7.57 makes a new SSL_CTX for every connection and parses the CA file
+// into it, instead the file is parsed once here and the store is attached to
+// the new SSL_CTX by CURLOPT_SSL_CTX_FUNCTION. The chains verified by a store
+// are remembered by the SHA-256 of the leaf certificate for kVerifiedTTL, not
+// beyond the expiry of the leaf, so the next handshakes with the server skip
+// the verification. The host name is still checked by curl every time.
+// Thread safe.
+class CurlSSLTrustStore
+{
+public:
+	static const int kVerifiedTTLSeconds = 3600;
+	static const size_t kMaxVerified = 256;
+
+	// Sets the options of |easy_handle| to use the shared store of |ca_file|,
+	// the default store of OpenSSL if it is empty
+	static void Apply(CURL* easy_handle, const std::string& ca_file);
+
+private:
+	struct Store
+	{
+		Store() : store(nullptr) {}
+		std::string ca_file;
+		// Loaded by the first handshake and after a trim, owned by |mutex_|
+		x509_store_st* store;
+	};
+	struct Verified
+	{
+		base::TimeTicks expiry;
+		std::list<std::string>::iterator lru_it;
+	};
+
+	static CurlSSLTrustStore* GetInstance();
+	CurlSSLTrustStore();
+
+	Store* GetStore(const std::string& ca_file);
+	// Returns the store with a reference added, it is released by SSL_CTX
+	x509_store_st* AcquireStore(Store* store);
+	bool IsVerified(const std::string& key);
+	void AddVerified(const std::string& key, base::TimeDelta ttl);
+	void TrimMemory(NS_EXTENSION::MemoryTrimLevel level);
+
+	static CURLcode SSLCtxFunc(CURL* curl, void* ssl_ctx, void* param);
+	static int VerifyCallback(x509_store_ctx_st* ctx, void* param);
+
+	std::mutex mutex_;
+	// Never deleted, a Store is the data of CURLOPT_SSL_CTX_FUNCTION
+	std::map<std::string, std::unique_ptr<Store>> stores_;
+	// By the CA file and the fingerprint of the leaf
+	std::map<std::string, Verified> verified_;
+	// The keys of |verified_|, the latest used first
+	std::list<std::string> verified_lru_;
+	int memory_trim_id_;
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_CURL_SSL_TRUST_STORE_H__
@@ -0,0 +1,145 @@
+#include "nim_http/http/download_file_util.h"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+
+#if defined(OS_WIN)
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+HTTP_BEGIN_DECLS
+
+namespace
+{
+const size_t kReadChunkSize = 256 * 1024;
+
+const EVP_MD* DigestOf(HTTP_DIGEST type)
+{
+	switch (type) {
+	case DIGEST_MD5:
+		return EVP_md5();
+	case DIGEST_SHA256:
+		return EVP_sha256();
+	default:
+		return nullptr;
+	}
+}
+}
+
+DownloadDigest::DownloadDigest(HTTP_DIGEST type) : type_(type), ctx_(nullptr)
+{
+	if (DigestOf(type_) != nullptr)
+		ctx_ = EVP_MD_CTX_new();
+	Reset();
+}
+
+DownloadDigest::~DownloadDigest()
+{
+	if (ctx_ != nullptr)
+		EVP_MD_CTX_free(ctx_);
+}
+
+void DownloadDigest::Reset()
+{
+	if (ctx_ != nullptr)
+		EVP_DigestInit_ex(ctx_, DigestOf(type_), nullptr);
+}
+
+void DownloadDigest::Update(const void* data, size_t size)
+{
+	if (ctx_ != nullptr && size > 0)
+		EVP_DigestUpdate(ctx_, data, size);
+}
+
+bool DownloadDigest::UpdateFromFile(FILE* file, long long size)
+{
+	if (ctx_ == nullptr || size <= 0)
+		return true;
+#if defined(OS_WIN)
+	if (_fseeki64(file, 0, SEEK_SET) != 0)
+#else
+	if (fseeko(file, 0, SEEK_SET) != 0)
+#endif
+		return false;
+	std::string buffer(kReadChunkSize, '\0');
+	while (size > 0) {
+		size_t to_read = (size_t)std::min<long long>(size, (long long)buffer.size());
+		size_t read = fread(&buffer[0], 1, to_read, file);
+		if (read != to_read)
+			return false;
+		EVP_DigestUpdate(ctx_, buffer.data(), read);
+		size -= (long long)read;
+	}
+	return true;
+}
+
+std::string DownloadDigest::Finish()
+{
+	static const char kHexDigits[] = "0123456789abcdef";
+	if (ctx_ == nullptr)
+		return std::string();
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_size = 0;
+	EVP_DigestFinal_ex(ctx_, digest, &digest_size);
+	Reset();
+	std::string hex;
+	hex.reserve(digest_size * 2);
+	for (unsigned int i = 0; i < digest_size; i++) {
+		hex.push_back(kHexDigits[digest[i] >> 4]);
+		hex.push_back(kHexDigits[digest[i] & 0x0F]);
+	}
+	return hex;
+}
+
+base::PlatformFile PlatformFileOf(FILE* file)
+{
+#if defined(OS_WIN)
+	return (HANDLE)_get_osfhandle(_fileno(file));
+#else
+	return fileno(file);
+#endif
+}
+
+bool PreallocateFile(base::PlatformFile file, long long length)
+{
+	if (length <= 0)
+		return true;
+#if defined(OS_WIN)
+	// NTFS allocates the clusters without zeroing them until they are written
+	LARGE_INTEGER size;
+	size.QuadPart = length;
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile = size;
+	return SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof(info)) != FALSE;
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+	return posix_fallocate(file, 0, (off_t)length) == 0;
+#elif defined(OS_MACOSX)
+	fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)length, 0 };
+	if (fcntl(file, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(file, F_PREALLOCATE, &store) == -1)
+			return false;
+	}
+	return ftruncate(file, (off_t)length) == 0;
+#else
+	return ftruncate(file, (off_t)length) == 0;
+#endif
+}
+
+bool TruncateFile(base::PlatformFile file, long long length)
+{
+#if defined(OS_WIN)
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile.QuadPart = length;
+	return SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof(info)) != FALSE;
+#else
+	return ftruncate(file, (off_t)length) == 0;
+#endif
+}
+
+HTTP_END_DECLS
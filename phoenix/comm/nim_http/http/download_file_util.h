@@ -0,0 +1,48 @@
+#ifndef __BASE_HTTP_DOWNLOAD_FILE_UTIL_H__
+#define __BASE_HTTP_DOWNLOAD_FILE_UTIL_H__
+
+#include "nim_http/config/build_config.h"
+#include <stdio.h>
+#include <string>
+#include "base/files/file.h"
+#include "nim_http/wrapper/http_def.h"
+
+struct evp_md_ctx_st;
+
+HTTP_BEGIN_DECLS
+
+// Hashes a download while it is written, so the file is not read again to
+// check it
+class DownloadDigest
+{
+public:
+	explicit DownloadDigest(HTTP_DIGEST type);
+	~DownloadDigest();
+
+	HTTP_DIGEST type() const { return type_; }
+	// Starts over, e.g. before a retry writes the file again
+	void Reset();
+	void Update(const void* data, size_t size);
+	// Hashes the first |size| bytes of |file| which a resumed download keeps,
+	// the position of |file| is changed
+	bool UpdateFromFile(FILE* file, long long size);
+	// Lower case hex, the digest is reset
+	std::string Finish();
+
+private:
+	HTTP_DIGEST type_;
+	evp_md_ctx_st* ctx_;
+
+	DISALLOW_COPY_AND_ASSIGN(DownloadDigest);
+};
+
+base::PlatformFile PlatformFileOf(FILE* file);
+// Reserves the disk blocks of |length| bytes so that the writes do not grow
+// the file piece by piece, the file may look |length| long until
+// TruncateFile() cuts it to the bytes written
+bool PreallocateFile(base::PlatformFile file, long long length);
+bool TruncateFile(base::PlatformFile file, long long length);
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_DOWNLOAD_FILE_UTIL_H__
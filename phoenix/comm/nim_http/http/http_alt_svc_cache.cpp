@@ -0,0 +1,265 @@
+#include "nim_http/http/http_alt_svc_cache.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+HTTP_BEGIN_DECLS
+
+namespace {
+
+// The max age of an alternative without "ma"
+const int64_t kDefaultMaxAgeSeconds = 86400;
+const int64_t kInitialBrokenSeconds = 5 * 60;
+const int64_t kMaxBrokenSeconds = 48 * 3600;
+
+std::string Trim(const std::string& value)
+{
+	size_t begin = value.find_first_not_of(" \t");
+	if (begin == std::string::npos)
+		return std::string();
+	size_t end = value.find_last_not_of(" \t");
+	return value.substr(begin, end - begin + 1);
+}
+
+std::string ToLower(std::string value)
+{
+	std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return (char)tolower(c); });
+	return value;
+}
+
+std::string Unquote(const std::string& value)
+{
+	if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+		return value.substr(1, value.size() - 2);
+	return value;
+}
+
+// Splits |value| at |separator| outside the quoted strings
+std::vector<std::string> Split(const std::string& value, char separator)
+{
+	std::vector<std::string> parts;
+	std::string part;
+	bool quoted = false;
+	for (char c : value)
+	{
+		if (c == '"')
+			quoted = !quoted;
+		if (c == separator && !quoted)
+		{
+			parts.push_back(Trim(part));
+			part.clear();
+			continue;
+		}
+		part.push_back(c);
+	}
+	parts.push_back(Trim(part));
+	return parts;
+}
+
+// |origin| is "host:port", the host of IPv6 in brackets
+bool SplitOrigin(const std::string& origin, std::string& host, int& port)
+{
+	size_t colon = origin.rfind(':');
+	if (colon == std::string::npos || colon == 0 || origin.back() == ']')
+		return false;
+	host = origin.substr(0, colon);
+	port = atoi(origin.c_str() + colon + 1);
+	return port > 0;
+}
+
+}
+
+HttpAltSvcCache* HttpAltSvcCache::GetInstance()
+{
+	// Leaked, requests may complete while the process exits
+	static HttpAltSvcCache* instance = new HttpAltSvcCache;
+	return instance;
+}
+
+void HttpAltSvcCache::OnAltSvc(const std::string& origin, const std::string& alt_svc)
+{
+	std::string host;
+	int port = 0;
+	if (alt_svc.empty() || !SplitOrigin(origin, host, port))
+		return;
+	int64_t max_age_seconds = 0;
+	bool clear = false;
+	bool http3 = ParseHttp3(alt_svc, host, port, max_age_seconds, clear);
+
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = entries_.find(origin);
+	if (!http3 || clear || max_age_seconds <= 0)
+	{
+		// The alternatives advertised before are replaced by none
+		if (iter != entries_.end())
+			iter->second.http3_expire = NS_EXTENSION::TimeTicks();
+		return;
+	}
+	if (iter == entries_.end())
+	{
+		TrimLocked(now);
+		iter = entries_.emplace(origin, Entry()).first;
+	}
+	iter->second.http3_expire = now + NS_EXTENSION::TimeDelta::FromSeconds(max_age_seconds);
+}
+
+bool HttpAltSvcCache::ShouldUseHttp3(const std::string& origin)
+{
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = entries_.find(origin);
+	if (iter == entries_.end())
+		return false;
+	const Entry& entry = iter->second;
+	return !entry.http3_expire.is_null() && entry.http3_expire > now && entry.broken_until <= now;
+}
+
+bool HttpAltSvcCache::IsBroken(const std::string& origin)
+{
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = entries_.find(origin);
+	return iter != entries_.end() && iter->second.broken_until > now;
+}
+
+void HttpAltSvcCache::MarkBroken(const std::string& origin)
+{
+	NS_EXTENSION::TimeTicks now = NS_EXTENSION::TimeTicks::Now();
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = entries_.find(origin);
+	if (iter == entries_.end())
+	{
+		// Required by the request, never advertised
+		TrimLocked(now);
+		iter = entries_.emplace(origin, Entry()).first;
+	}
+	Entry& entry = iter->second;
+	int64_t seconds = kInitialBrokenSeconds;
+	for (int i = 0; i < entry.broken_count && seconds < kMaxBrokenSeconds; i++)
+		seconds *= 2;
+	entry.broken_count++;
+	entry.broken_until = now + NS_EXTENSION::TimeDelta::FromSeconds(std::min(seconds, kMaxBrokenSeconds));
+}
+
+void HttpAltSvcCache::MarkWorking(const std::string& origin)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto iter = entries_.find(origin);
+	if (iter == entries_.end())
+		return;
+	iter->second.broken_count = 0;
+	iter->second.broken_until = NS_EXTENSION::TimeTicks();
+}
+
+void HttpAltSvcCache::OnNetworkChanged()
+{
+	// A network blocking UDP says nothing about the next one
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& pair : entries_)
+	{
+		pair.second.broken_count = 0;
+		pair.second.broken_until = NS_EXTENSION::TimeTicks();
+	}
+}
+
+void HttpAltSvcCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+}
+
+void HttpAltSvcCache::TrimLocked(NS_EXTENSION::TimeTicks now)
+{
+	if (entries_.size() < kMaxEntries)
+		return;
+	// The expired ones first, then the one expiring soonest
+	auto oldest = entries_.end();
+	for (auto iter = entries_.begin(); iter != entries_.end();)
+	{
+		const Entry& entry = iter->second;
+		if (entry.http3_expire <= now && entry.broken_until <= now)
+		{
+			iter = entries_.erase(iter);
+			continue;
+		}
+		if (oldest == entries_.end() || entry.http3_expire < oldest->second.http3_expire)
+			oldest = iter;
+		iter++;
+	}
+	if (entries_.size() >= kMaxEntries && oldest != entries_.end())
+		entries_.erase(oldest);
+}
+
+bool HttpAltSvcCache::OriginOfURL(const std::string& url, std::string& origin)
+{
+	static const char kScheme[] = "https://";
+	const size_t scheme_size = sizeof(kScheme) - 1;
+	if (url.size() <= scheme_size || ToLower(url.substr(0, scheme_size)) != kScheme)
+		return false;
+	size_t end = url.find_first_of("/?#", scheme_size);
+	std::string authority = url.substr(scheme_size, end == std::string::npos ? std::string::npos : end - scheme_size);
+	size_t at = authority.rfind('@');
+	if (at != std::string::npos)
+		authority.erase(0, at + 1);
+
+	std::string host = authority;
+	std::string port = "443";
+	size_t colon = authority.rfind(':');
+	size_t bracket = authority.rfind(']');
+	if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket))
+	{
+		host = authority.substr(0, colon);
+		if (colon + 1 < authority.size())
+			port = authority.substr(colon + 1);
+	}
+	if (host.empty() || port.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	origin = ToLower(host) + ":" + port;
+	return true;
+}
+
+bool HttpAltSvcCache::ParseHttp3(const std::string& alt_svc, const std::string& host, int port,
+	int64_t& max_age_seconds, bool& clear)
+{
+	max_age_seconds = 0;
+	clear = false;
+	std::string value = Trim(alt_svc);
+	if (ToLower(value) == "clear")
+	{
+		clear = true;
+		return true;
+	}
+
+	// alt-value = alpn-id "=" alt-authority *( OWS ";" OWS parameter )
+	bool found = false;
+	for (const std::string& alternative : Split(value, ','))
+	{
+		std::vector<std::string> params = Split(alternative, ';');
+		size_t equal = params[0].find('=');
+		if (equal == std::string::npos || Trim(params[0].substr(0, equal)) != "h3")
+			continue;
+		// ":443" is on the same host
+		std::string authority = Unquote(Trim(params[0].substr(equal + 1)));
+		size_t colon = authority.rfind(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string alt_host = ToLower(authority.substr(0, colon));
+		if ((!alt_host.empty() && alt_host != host) || atoi(authority.c_str() + colon + 1) != port)
+			continue;
+
+		int64_t max_age = kDefaultMaxAgeSeconds;
+		for (size_t i = 1; i < params.size(); i++)
+		{
+			size_t param_equal = params[i].find('=');
+			if (param_equal != std::string::npos && ToLower(Trim(params[i].substr(0, param_equal))) == "ma")
+				max_age = atoll(Unquote(Trim(params[i].substr(param_equal + 1))).c_str());
+		}
+		max_age_seconds = found ? std::max(max_age_seconds, max_age) : max_age;
+		found = true;
+	}
+	return found;
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,70 @@
+#ifndef __BASE_HTTP_HTTP_ALT_SVC_CACHE_H__
+#define __BASE_HTTP_HTTP_ALT_SVC_CACHE_H__
+
+#include "nim_http/config/build_config.h"
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include "extension/time/time.h"
+
+HTTP_BEGIN_DECLS
+
+// The HTTPS origins which advertised HTTP/3 by their Alt-Svc headers
+// (RFC 7838), and the ones HTTP/3 failed for. An origin is "host:port" with
+// the host in lower case. Only an alternative on the same host and port is
+// taken, curl connects to the port of the URL over QUIC.
+// An origin HTTP/3 failed for is left on TCP for 5 minutes, doubled at each
+// failure up to 2 days, until it works again or the network changes.
+// Shared by the transfer loops, thread safe.
+class HttpAltSvcCache
+{
+public:
+	static const size_t kMaxEntries = 256;
+
+	static HttpAltSvcCache* GetInstance();
+
+	// Takes the Alt-Svc header |alt_svc| of a response from |origin|, it
+	// replaces what the origin advertised before
+	void OnAltSvc(const std::string& origin, const std::string& alt_svc);
+	// True if |origin| advertised HTTP/3 and it is not marked broken
+	bool ShouldUseHttp3(const std::string& origin);
+	// True if HTTP/3 failed for |origin| lately, whether advertised or not
+	bool IsBroken(const std::string& origin);
+	void MarkBroken(const std::string& origin);
+	// An HTTP/3 response came from |origin|, the backoff starts over
+	void MarkWorking(const std::string& origin);
+	// The broken marks were made on the old network
+	void OnNetworkChanged();
+	void Clear();
+
+	// The origin of an HTTPS |url|, false for the other schemes
+	static bool OriginOfURL(const std::string& url, std::string& origin);
+	// Parses |alt_svc| of a response from |host|:|port|, true if it has "h3"
+	// on the same host and port with its max age, or is "clear" with |clear| set
+	static bool ParseHttp3(const std::string& alt_svc, const std::string& host, int port,
+		int64_t& max_age_seconds, bool& clear);
+
+private:
+	struct Entry
+	{
+		Entry() : broken_count(0) {}
+
+		// Null if HTTP/3 is not advertised
+		NS_EXTENSION::TimeTicks http3_expire;
+		NS_EXTENSION::TimeTicks broken_until;
+		int broken_count;
+	};
+
+	HttpAltSvcCache() {}
+
+	// Makes room for an entry, needs |mutex_|
+	void TrimLocked(NS_EXTENSION::TimeTicks now);
+
+	std::mutex mutex_;
+	std::map<std::string, Entry> entries_;
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_ALT_SVC_CACHE_H__
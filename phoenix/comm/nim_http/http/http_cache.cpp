@@ -0,0 +1,431 @@
+#include "nim_http/http/http_cache.h"
+#include <cstdlib>
+#include <list>
+#include <vector>
+#include "base/sha1.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/memory_accounting.h"
+#include "extension/strings/string_util.h"
+#include "nim_http/http/http_log.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+// Larger responses are not worth caching
+const size_t kMaxEntrySize = 8 * 1024 * 1024;
+// Entries evicted in a round
+const int kEvictBatchCount = 32;
+
+const char kCreateTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_cache("
+	"url TEXT PRIMARY KEY, "
+	"body_hash TEXT NOT NULL, "
+	"body_size INTEGER NOT NULL, "
+	"etag TEXT NOT NULL DEFAULT '', "
+	"last_modified TEXT NOT NULL DEFAULT '', "
+	"expire_time INTEGER NOT NULL, "
+	"last_access INTEGER NOT NULL)";
+const char kCreateHashIndexSql[] =
+	"CREATE INDEX IF NOT EXISTS http_cache_body_hash ON http_cache(body_hash)";
+const char kCreateAccessIndexSql[] =
+	"CREATE INDEX IF NOT EXISTS http_cache_last_access ON http_cache(last_access)";
+
+std::string FieldText(base::db::SQLiteStatement& statement, int col)
+{
+	const char* text = statement.GetTextField(col);
+	return text != nullptr ? std::string(text) : std::string();
+}
+}
+
+HttpCache::HttpCache()
+	: disk_size_(0), memory_size_(0),
+	memory_bodies_(base::MRUCache<std::string, std::shared_ptr<std::string>>::NO_AUTO_EVICT)
+{
+	memory_account_id_ = NS_EXTENSION::MemoryAccounting::Register("nim_http.cache", [this]() {
+		return (int64_t)memory_size_.load();
+	});
+}
+
+HttpCache::~HttpCache()
+{
+	NS_EXTENSION::MemoryAccounting::Unregister(memory_account_id_);
+	Close();
+}
+
+bool HttpCache::Open(const HttpCacheConfig& config)
+{
+	Close();
+
+	config_ = config;
+	if (config_.directory.empty())
+		return false;
+	char last = config_.directory.back();
+	if (last != '/' && last != '\\')
+		config_.directory.push_back('/');
+	if (!NS_EXTENSION::CreateDirectory(config_.directory + "bodies")) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] create cache directory failed: {0}") << config_.directory;
+		return false;
+	}
+
+	std::string index_path = config_.directory + "index.db";
+	if (!db_.Open(index_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateTableSql) != SQLITE_OK
+		|| db_.Query(kCreateHashIndexSql) != SQLITE_OK
+		|| db_.Query(kCreateAccessIndexSql) != SQLITE_OK) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] open cache index failed: {0}, {1}")
+			<< index_path << (db_.IsValid() ? db_.GetLastErrorMessage() : "");
+		db_.Close();
+		return false;
+	}
+
+	// A body shared by several URLs is counted once
+	base::db::SQLiteStatement statement;
+	const char sql[] = "SELECT SUM(body_size) FROM "
+		"(SELECT MAX(body_size) AS body_size FROM http_cache GROUP BY body_hash)";
+	if (db_.Query(statement, sql) == SQLITE_OK && statement.NextRow() == SQLITE_ROW)
+		disk_size_ = statement.GetInt64Field(0);
+	statement.Finalize();
+
+	EvictIfNeeded();
+	return true;
+}
+
+void HttpCache::Close()
+{
+	memory_bodies_.Clear();
+	memory_size_ = 0;
+	disk_size_ = 0;
+	if (db_.IsValid())
+		db_.Close();
+}
+
+bool HttpCache::OnRequest(const std::shared_ptr<CurlHttpRequest>& request)
+{
+	if (!db_.IsValid() || request == nullptr
+		|| request->GetMethod() != GET || !request->IsContentRequest())
+		return false;
+
+	const std::string& url = request->URL();
+	int64_t now = base::Time::Now().ToTimeT();
+	Entry entry;
+	bool cached = LookupEntry(url, entry);
+	if (cached && entry.expire_time > now) {
+		auto body = LoadBody(entry);
+		if (body != nullptr) {
+			TouchEntry(url, now);
+			request->CompleteWithContent(*body, 200);
+			return true;
+		}
+		RemoveEntry(url, entry);
+		cached = false;
+	}
+	if (cached) {
+		if (!entry.etag.empty())
+			request->AddHeaderField("If-None-Match", entry.etag);
+		if (!entry.last_modified.empty())
+			request->AddHeaderField("If-Modified-Since", entry.last_modified);
+	}
+
+	std::weak_ptr<HttpCache> weak_cache = shared_from_this();
+	request->SetResponseFilter([weak_cache, url, entry, cached](CurlHttpRequest* completed,
+		std::shared_ptr<std::string>& content, bool& succeed, int& response_code) {
+		auto cache = weak_cache.lock();
+		if (cache != nullptr && cache->db_.IsValid())
+			cache->OnResponse(url, cached ? &entry : nullptr, completed, content, succeed, response_code);
+	});
+	return false;
+}
+
+void HttpCache::OnResponse(const std::string& url, const Entry* cached, CurlHttpRequest* request,
+	std::shared_ptr<std::string>& content, bool& succeed, int& response_code)
+{
+	int64_t now = base::Time::Now().ToTimeT();
+	if (cached != nullptr && succeed && response_code == 304) {
+		auto body = LoadBody(*cached);
+		if (body == nullptr) {
+			RemoveEntry(url, *cached);
+			return;
+		}
+		// A 304 refreshes the freshness and may carry new validators
+		Entry entry = *cached;
+		int64_t expire_time = 0;
+		if (ParseFreshness(request, now, expire_time))
+			entry.expire_time = expire_time;
+		request->FindResponseHeader("ETag", entry.etag);
+		request->FindResponseHeader("Last-Modified", entry.last_modified);
+		UpdateEntry(url, entry, now);
+		content->assign(*body);
+		response_code = 200;
+		return;
+	}
+	if (!succeed || response_code != 200 || content == nullptr)
+		return;
+
+	Entry entry;
+	request->FindResponseHeader("ETag", entry.etag);
+	request->FindResponseHeader("Last-Modified", entry.last_modified);
+	bool storable = ParseFreshness(request, now, entry.expire_time)
+		&& content->size() <= kMaxEntrySize
+		// A stale response without validators is never used
+		&& (entry.expire_time > now || !entry.etag.empty() || !entry.last_modified.empty());
+	if (storable)
+		StoreEntry(url, entry, *content, now);
+	else if (cached != nullptr)
+		RemoveEntry(url, *cached);
+}
+
+bool HttpCache::ParseFreshness(const CurlHttpRequest* request, int64_t now, int64_t& expire_time)
+{
+	std::string value;
+	// The cache is keyed by URL only
+	if (request->FindResponseHeader("Vary", value)) {
+		value = NS_EXTENSION::MakeLowerString(NS_EXTENSION::StringTrim(value));
+		if (!value.empty() && value != "accept-encoding")
+			return false;
+	}
+
+	long long max_age = -1;
+	bool no_cache = false;
+	if (request->FindResponseHeader("Cache-Control", value)) {
+		std::list<std::string> directives = NS_EXTENSION::StringTokenize(
+			NS_EXTENSION::MakeLowerString(value).c_str(), ",");
+		for (auto& item : directives) {
+			std::string directive = NS_EXTENSION::StringTrim(item);
+			if (directive == "no-store")
+				return false;
+			if (directive == "no-cache")
+				no_cache = true;
+			else if (directive.compare(0, 8, "max-age=") == 0)
+				max_age = std::strtoll(directive.c_str() + 8, nullptr, 10);
+		}
+	}
+	else if (request->FindResponseHeader("Pragma", value)
+		&& NS_EXTENSION::MakeLowerString(value).find("no-cache") != std::string::npos) {
+		no_cache = true;
+	}
+
+	// No freshness means revalidating every time
+	expire_time = 0;
+	base::Time expires;
+	if (no_cache)
+		return true;
+	if (max_age >= 0)
+		expire_time = now + max_age;
+	else if (request->FindResponseHeader("Expires", value) && base::Time::FromString(value.c_str(), &expires))
+		expire_time = expires.ToTimeT();
+	return true;
+}
+
+bool HttpCache::LookupEntry(const std::string& url, Entry& entry)
+{
+	base::db::SQLiteStatement statement;
+	const char sql[] = "SELECT body_hash, body_size, etag, last_modified, expire_time "
+		"FROM http_cache WHERE url = ?";
+	if (db_.Query(statement, sql) != SQLITE_OK)
+		return false;
+	statement.BindText(1, url.c_str(), url.size());
+	if (statement.NextRow() != SQLITE_ROW)
+		return false;
+	entry.body_hash = FieldText(statement, 0);
+	entry.body_size = statement.GetInt64Field(1);
+	entry.etag = FieldText(statement, 2);
+	entry.last_modified = FieldText(statement, 3);
+	entry.expire_time = statement.GetInt64Field(4);
+	return true;
+}
+
+void HttpCache::StoreEntry(const std::string& url, Entry& entry, const std::string& body, int64_t now)
+{
+	std::string hash = base::SHA1HashString(body);
+	entry.body_hash = base::HexEncode(hash.data(), hash.size());
+	entry.body_size = (long long)body.size();
+
+	// The same body may be stored already by another URL
+	std::string body_path = BodyPath(entry.body_hash);
+	if (!NS_EXTENSION::FilePathIsExist(body_path, false)) {
+		std::string body_dir = config_.directory + "bodies/" + entry.body_hash.substr(0, 2);
+		std::string temp_path = body_path + ".tmp";
+		if (!NS_EXTENSION::CreateDirectory(body_dir)
+			|| NS_EXTENSION::WriteFile(temp_path, body) != (int)body.size()
+			|| !NS_EXTENSION::MoveFile(temp_path, body_path)) {
+			HTTP_QLOG_ERR(GetLogger(), "[net][http] write cache body failed: {0}") << body_path;
+			NS_EXTENSION::DeleteFile(temp_path);
+			return;
+		}
+		disk_size_ += entry.body_size;
+	}
+
+	Entry old_entry;
+	bool replaced = LookupEntry(url, old_entry);
+
+	base::db::SQLiteStatement statement;
+	const char sql[] = "INSERT OR REPLACE INTO http_cache"
+		"(url, body_hash, body_size, etag, last_modified, expire_time, last_access) "
+		"VALUES(?, ?, ?, ?, ?, ?, ?)";
+	if (db_.Query(statement, sql) == SQLITE_OK) {
+		statement.BindText(1, url.c_str(), url.size());
+		statement.BindText(2, entry.body_hash.c_str(), entry.body_hash.size());
+		statement.BindInt64(3, entry.body_size);
+		statement.BindText(4, entry.etag.c_str(), entry.etag.size());
+		statement.BindText(5, entry.last_modified.c_str(), entry.last_modified.size());
+		statement.BindInt64(6, entry.expire_time);
+		statement.BindInt64(7, now);
+		statement.NextRow();
+	}
+	statement.Finalize();
+
+	if (replaced && old_entry.body_hash != entry.body_hash)
+		RemoveBodyIfUnused(old_entry.body_hash);
+	KeepBodyInMemory(entry.body_hash, std::make_shared<std::string>(body));
+	EvictIfNeeded();
+}
+
+void HttpCache::UpdateEntry(const std::string& url, const Entry& entry, int64_t now)
+{
+	base::db::SQLiteStatement statement;
+	const char sql[] = "UPDATE http_cache SET etag = ?, last_modified = ?, expire_time = ?, last_access = ? "
+		"WHERE url = ?";
+	if (db_.Query(statement, sql) != SQLITE_OK)
+		return;
+	statement.BindText(1, entry.etag.c_str(), entry.etag.size());
+	statement.BindText(2, entry.last_modified.c_str(), entry.last_modified.size());
+	statement.BindInt64(3, entry.expire_time);
+	statement.BindInt64(4, now);
+	statement.BindText(5, url.c_str(), url.size());
+	statement.NextRow();
+}
+
+void HttpCache::TouchEntry(const std::string& url, int64_t now)
+{
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "UPDATE http_cache SET last_access = ? WHERE url = ?") != SQLITE_OK)
+		return;
+	statement.BindInt64(1, now);
+	statement.BindText(2, url.c_str(), url.size());
+	statement.NextRow();
+}
+
+void HttpCache::RemoveEntry(const std::string& url, const Entry& entry)
+{
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "DELETE FROM http_cache WHERE url = ?") != SQLITE_OK)
+			return;
+		statement.BindText(1, url.c_str(), url.size());
+		statement.NextRow();
+	}
+	RemoveBodyIfUnused(entry.body_hash);
+}
+
+void HttpCache::RemoveBodyIfUnused(const std::string& body_hash)
+{
+	{
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT 1 FROM http_cache WHERE body_hash = ? LIMIT 1") != SQLITE_OK)
+			return;
+		statement.BindText(1, body_hash.c_str(), body_hash.size());
+		if (statement.NextRow() == SQLITE_ROW)
+			return;
+	}
+
+	auto iter = memory_bodies_.Peek(body_hash);
+	if (iter != memory_bodies_.end()) {
+		memory_size_ -= iter->second->size();
+		memory_bodies_.Erase(iter);
+	}
+	std::string body_path = BodyPath(body_hash);
+	int64_t size = NS_EXTENSION::GetFileSize(body_path);
+	if (size > 0 && NS_EXTENSION::DeleteFile(body_path))
+		disk_size_ = disk_size_ > size ? disk_size_ - size : 0;
+}
+
+void HttpCache::EvictIfNeeded()
+{
+	while (disk_size_ > config_.max_disk_size) {
+		std::vector<std::pair<std::string, Entry>> entries;
+		{
+			base::db::SQLiteStatement statement;
+			const char sql[] = "SELECT url, body_hash FROM http_cache ORDER BY last_access LIMIT ?";
+			if (db_.Query(statement, sql) != SQLITE_OK)
+				return;
+			statement.BindInt(1, kEvictBatchCount);
+			while (statement.NextRow() == SQLITE_ROW) {
+				Entry entry;
+				entry.body_hash = FieldText(statement, 1);
+				entries.emplace_back(FieldText(statement, 0), entry);
+			}
+		}
+		if (entries.empty()) {
+			// Bodies without entries, e.g. left by a crash, are not tracked
+			disk_size_ = 0;
+			return;
+		}
+
+		base::db::SQLiteAutoTransaction transaction(&db_);
+		transaction.Begin();
+		for (auto& item : entries) {
+			RemoveEntry(item.first, item.second);
+			if (disk_size_ <= config_.max_disk_size)
+				break;
+		}
+		transaction.Commit();
+	}
+}
+
+std::shared_ptr<std::string> HttpCache::LoadBody(const Entry& entry)
+{
+	auto iter = memory_bodies_.Get(entry.body_hash);
+	if (iter != memory_bodies_.end())
+		return iter->second;
+
+	auto body = std::make_shared<std::string>();
+	if (!NS_EXTENSION::ReadFileToString(BodyPath(entry.body_hash), *body)
+		|| (long long)body->size() != entry.body_size)
+		return nullptr;
+	KeepBodyInMemory(entry.body_hash, body);
+	return body;
+}
+
+void HttpCache::KeepBodyInMemory(const std::string& body_hash, const std::shared_ptr<std::string>& body)
+{
+	if (body->size() > config_.max_memory_size)
+		return;
+
+	auto iter = memory_bodies_.Peek(body_hash);
+	if (iter != memory_bodies_.end())
+		memory_size_ -= iter->second->size();
+	memory_bodies_.Put(body_hash, body);
+	memory_size_ += body->size();
+	ShrinkMemoryTo(config_.max_memory_size);
+}
+
+void HttpCache::ShrinkMemoryTo(size_t size)
+{
+	while (memory_size_ > size && !memory_bodies_.empty()) {
+		auto oldest = memory_bodies_.rbegin();
+		memory_size_ -= oldest->second->size();
+		memory_bodies_.Erase(oldest);
+	}
+}
+
+void HttpCache::TrimMemory(NS_EXTENSION::MemoryTrimLevel level)
+{
+	// In background only the recently used half is kept, the bodies can be
+	// read from the disk again
+	if (level == NS_EXTENSION::kMemoryTrimBackground) {
+		ShrinkMemoryTo(config_.max_memory_size / 2);
+		return;
+	}
+	ShrinkMemoryTo(0);
+	if (db_.IsValid())
+		db_.ReleaseMemory(level == NS_EXTENSION::kMemoryTrimCritical);
+}
+
+std::string HttpCache::BodyPath(const std::string& body_hash) const
+{
+	return config_.directory + "bodies/" + body_hash.substr(0, 2) + "/" + body_hash;
+}
+
+HTTP_END_DECLS
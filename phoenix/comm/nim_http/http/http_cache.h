@@ -0,0 +1,82 @@
+#ifndef __BASE_HTTP_HTTP_CACHE_H__
+#define __BASE_HTTP_HTTP_CACHE_H__
+
+#include "nim_http/config/build_config.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include "base/containers/mru_cache.h"
+#include "extension/memory/memory_trimmer.h"
+#include "nim_db/db_sqlite3.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The response cache of URLSessionManager.
+// The responses are indexed by URL in "index.db" of the cache directory, the
+// bodies are stored in "bodies/" by their SHA-1, so a body shared by several
+// URLs is stored once. The recently used bodies are kept in memory too.
+// Not thread safe, used on the transfer thread only.
+class HttpCache : public NS_NIMLOG::LoggerSetter, public std::enable_shared_from_this<HttpCache>
+{
+public:
+	HttpCache();
+	~HttpCache();
+
+	bool Open(const HttpCacheConfig& config);
+	void Close();
+
+	// Returns true if |request| is completed by a fresh cached response.
+	// Otherwise the validators of a stale response are added to |request|,
+	// and its response is stored or replaced by the cached one when done.
+	bool OnRequest(const std::shared_ptr<CurlHttpRequest>& request);
+
+	// Drops the bodies kept in memory, a half of them in background
+	void TrimMemory(NS_EXTENSION::MemoryTrimLevel level);
+
+private:
+	struct Entry
+	{
+		Entry() : body_size(0), expire_time(0) {}
+		std::string body_hash;
+		long long body_size;
+		std::string etag;
+		std::string last_modified;
+		// Seconds since the epoch, the response is revalidated after it
+		int64_t expire_time;
+	};
+
+	void OnResponse(const std::string& url, const Entry* cached, CurlHttpRequest* request,
+		std::shared_ptr<std::string>& content, bool& succeed, int& response_code);
+	// Returns false if the response must not be stored
+	static bool ParseFreshness(const CurlHttpRequest* request, int64_t now, int64_t& expire_time);
+
+	bool LookupEntry(const std::string& url, Entry& entry);
+	void StoreEntry(const std::string& url, Entry& entry, const std::string& body, int64_t now);
+	void UpdateEntry(const std::string& url, const Entry& entry, int64_t now);
+	void TouchEntry(const std::string& url, int64_t now);
+	void RemoveEntry(const std::string& url, const Entry& entry);
+	void RemoveBodyIfUnused(const std::string& body_hash);
+	void EvictIfNeeded();
+
+	std::shared_ptr<std::string> LoadBody(const Entry& entry);
+	void KeepBodyInMemory(const std::string& body_hash, const std::shared_ptr<std::string>& body);
+	void ShrinkMemoryTo(size_t size);
+	std::string BodyPath(const std::string& body_hash) const;
+
+	HttpCacheConfig config_;
+	base::db::SQLiteDB db_;
+	long long disk_size_;
+	// Read by MemoryAccounting on other threads
+	std::atomic<size_t> memory_size_;
+	int memory_account_id_;
+	// Bodies by their hash
+	base::MRUCache<std::string, std::shared_ptr<std::string>> memory_bodies_;
+
+	DISALLOW_COPY_AND_ASSIGN(HttpCache);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_CACHE_H__
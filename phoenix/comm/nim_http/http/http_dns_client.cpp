@@ -0,0 +1,254 @@
+#include "nim_http/http/http_dns_client.h"
+#include <cctype>
+#include <cstdlib>
+#include "base/time/time.h"
+#include "extension/json/json_document.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/http/http_log.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+const char kHostPlaceholder[] = "{host}";
+// DoH record types
+const int kTypeA = 1;
+const int kTypeAAAA = 28;
+
+const char kCreateTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_dns("
+	"host TEXT PRIMARY KEY, "
+	"ips TEXT NOT NULL, "
+	"ttl INTEGER NOT NULL, "
+	"update_time INTEGER NOT NULL)";
+
+// Rejects what can not be an IPv4 or IPv6 literal, e.g. a CNAME of DoH
+bool LooksLikeIP(const std::string& text)
+{
+	if (text.empty() || text.size() > 45)
+		return false;
+	for (char c : text) {
+		if (!isxdigit((unsigned char)c) && c != '.' && c != ':')
+			return false;
+	}
+	return true;
+}
+
+std::list<std::string> SplitIPs(const std::string& text)
+{
+	std::list<std::string> ip_list;
+	size_t begin = 0;
+	while (begin <= text.size()) {
+		size_t end = text.find(';', begin);
+		if (end == std::string::npos)
+			end = text.size();
+		std::string ip = text.substr(begin, end - begin);
+		if (LooksLikeIP(ip))
+			ip_list.push_back(ip);
+		begin = end + 1;
+	}
+	return ip_list;
+}
+
+std::string JoinIPs(const std::list<std::string>& ip_list)
+{
+	std::string text;
+	for (const auto& ip : ip_list) {
+		if (!text.empty())
+			text.push_back(';');
+		text.append(ip);
+	}
+	return text;
+}
+}
+
+HttpDnsClientImp::HttpDnsClientImp(const HttpManager& manager, const HttpDnsConfig& config)
+	: manager_(manager), config_(config), db_opened_(false)
+{
+	memory_trim_id_ = NS_EXTENSION::MemoryTrimmer::Register("nim_http.dns", [this](NS_EXTENSION::MemoryTrimLevel level) {
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (db_opened_ && db_.IsValid())
+			db_.ReleaseMemory(level == NS_EXTENSION::kMemoryTrimCritical);
+	});
+}
+
+HttpDnsClientImp::~HttpDnsClientImp()
+{
+	NS_EXTENSION::MemoryTrimmer::Unregister(memory_trim_id_);
+	db_.Close();
+}
+
+void HttpDnsClientImp::SetLogger(const NS_NIMLOG::Logger& logger)
+{
+	LoggerSetter::SetLogger(logger);
+}
+
+void HttpDnsClientImp::Resolve(const std::string& host, const HttpDnsCallback& callback)
+{
+	std::string url = config_.url;
+	size_t pos = url.find(kHostPlaceholder);
+	if (manager_ == nullptr || pos == std::string::npos || host.empty()) {
+		if (callback)
+			callback(false, std::list<std::string>(), 0);
+		return;
+	}
+	url.replace(pos, sizeof(kHostPlaceholder) - 1, host);
+
+	// The request keeps the client alive until it is completed
+	auto self = shared_from_this();
+	auto request = std::make_shared<CurlHttpRequest>(url,
+		[self, host, callback](const std::shared_ptr<std::string>& content, bool succeed, int response_code) {
+		self->OnResponse(host, callback, content, succeed, response_code);
+	});
+	request->SetTimeout(config_.timeout_ms);
+	request->SetPriority(PRIORITY_HIGH);
+	HttpRequest http_request = request;
+	manager_->PostRequest(http_request);
+}
+
+void HttpDnsClientImp::OnResponse(const std::string& host, const HttpDnsCallback& callback,
+	const std::shared_ptr<std::string>& content, bool succeed, int response_code)
+{
+	std::list<std::string> ip_list;
+	int ttl_seconds = config_.default_ttl_seconds;
+	if (!succeed || response_code != 200 || content == nullptr
+		|| !ParseResponse(*content, ip_list, ttl_seconds) || ip_list.empty()) {
+		HTTP_QLOG_WAR(GetLogger(), "[net][http] httpdns lookup of {0} failed: {1}") << host << response_code;
+		if (callback)
+			callback(false, std::list<std::string>(), 0);
+		return;
+	}
+	if (ttl_seconds <= 0)
+		ttl_seconds = config_.default_ttl_seconds;
+
+	Persist(host, ip_list, ttl_seconds);
+	if (callback)
+		callback(true, ip_list, ttl_seconds);
+}
+
+bool HttpDnsClientImp::ParseResponse(const std::string& body, std::list<std::string>& ip_list, int& ttl_seconds)
+{
+	ip_list.clear();
+	NS_EXTENSION::JsonDocument document;
+	if (!document.Parse(body) || !document.root().is_object()) {
+		// "ip;ip,ttl"
+		std::string text = body;
+		while (!text.empty() && isspace((unsigned char)text.back()))
+			text.pop_back();
+		size_t comma = text.find(',');
+		if (comma != std::string::npos) {
+			ttl_seconds = std::atoi(text.c_str() + comma + 1);
+			text.resize(comma);
+		}
+		ip_list = SplitIPs(text);
+		return !ip_list.empty();
+	}
+
+	const NS_EXTENSION::JsonValue& root = document.root();
+	if (root["ips"].is_array()) {
+		for (const NS_EXTENSION::JsonValue& item : root["ips"]) {
+			std::string ip(item.AsString());
+			if (LooksLikeIP(ip))
+				ip_list.push_back(ip);
+		}
+		if (root["ttl"].is_int())
+			ttl_seconds = root["ttl"].AsInt(ttl_seconds);
+		return true;
+	}
+	if (root["Answer"].is_array()) {
+		// The shortest TTL of the address records
+		int min_ttl = -1;
+		for (const NS_EXTENSION::JsonValue& answer : root["Answer"]) {
+			int type = answer["type"].is_int() ? answer["type"].AsInt() : 0;
+			std::string ip(answer["data"].AsString());
+			if ((type != kTypeA && type != kTypeAAAA) || !LooksLikeIP(ip))
+				continue;
+			ip_list.push_back(ip);
+			if (answer["TTL"].is_int()) {
+				int ttl = answer["TTL"].AsInt();
+				if (min_ttl < 0 || ttl < min_ttl)
+					min_ttl = ttl;
+			}
+		}
+		if (min_ttl >= 0)
+			ttl_seconds = min_ttl;
+		return true;
+	}
+	return false;
+}
+
+void HttpDnsClientImp::Load(const HttpDnsLoadCallback& callback)
+{
+	struct Record
+	{
+		std::string host;
+		std::list<std::string> ip_list;
+		int ttl_seconds;
+	};
+	std::list<Record> records;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (!OpenDatabase())
+			return;
+
+		int64_t now = base::Time::Now().ToTimeT();
+		base::db::SQLiteStatement statement;
+		if (db_.Query(statement, "SELECT host, ips, ttl, update_time FROM http_dns WHERE update_time >= ?") == SQLITE_OK) {
+			statement.BindInt64(1, now - config_.max_persisted_age_seconds);
+			while (statement.NextRow() == SQLITE_ROW) {
+				const char* host = statement.GetTextField(0);
+				const char* ips = statement.GetTextField(1);
+				if (host == nullptr || ips == nullptr)
+					continue;
+				Record record;
+				record.host = host;
+				record.ip_list = SplitIPs(ips);
+				record.ttl_seconds = (int)(statement.GetInt64Field(3) + statement.GetInt64Field(2) - now);
+				if (!record.ip_list.empty())
+					records.push_back(record);
+			}
+		}
+		statement.Finalize();
+	}
+
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Load {0} httpdns results") << (int)records.size();
+	for (const auto& record : records)
+		callback(record.host, record.ip_list, record.ttl_seconds);
+}
+
+bool HttpDnsClientImp::OpenDatabase()
+{
+	if (db_opened_)
+		return db_.IsValid();
+
+	db_opened_ = true;
+	if (config_.db_path.empty())
+		return false;
+	if (!db_.Open(config_.db_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateTableSql) != SQLITE_OK) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] open httpdns database failed: {0}, {1}")
+			<< config_.db_path << (db_.IsValid() ? db_.GetLastErrorMessage() : "");
+		db_.Close();
+		return false;
+	}
+	return true;
+}
+
+void HttpDnsClientImp::Persist(const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	if (!OpenDatabase())
+		return;
+
+	std::string ips = JoinIPs(ip_list);
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "INSERT OR REPLACE INTO http_dns(host, ips, ttl, update_time) VALUES(?, ?, ?, ?)") == SQLITE_OK) {
+		statement.BindText(1, host.c_str(), host.size());
+		statement.BindText(2, ips.c_str(), ips.size());
+		statement.BindInt(3, ttl_seconds);
+		statement.BindInt64(4, base::Time::Now().ToTimeT());
+		statement.NextRow();
+	}
+	statement.Finalize();
+}
+
+HTTP_END_DECLS
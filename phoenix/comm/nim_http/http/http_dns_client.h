@@ -0,0 +1,54 @@
+#ifndef __BASE_HTTP_HTTP_DNS_CLIENT_H__
+#define __BASE_HTTP_HTTP_DNS_CLIENT_H__
+
+#include "nim_http/config/build_config.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "base/macros.h"
+#include "extension/memory/memory_trimmer.h"
+#include "nim_db/db_sqlite3.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The HTTPDNS client created by NIMHttp::CreateHttpDnsClient.
+// The results are persisted to the "http_dns" table, one row per host, the
+// database is opened on first use.
+class HttpDnsClientImp : public IHttpDnsClient, public NS_NIMLOG::LoggerSetter,
+	public std::enable_shared_from_this<HttpDnsClientImp>
+{
+public:
+	HttpDnsClientImp(const HttpManager& manager, const HttpDnsConfig& config);
+	virtual ~HttpDnsClientImp();
+
+	virtual void SetLogger(const NS_NIMLOG::Logger& logger) override;
+	virtual void Resolve(const std::string& host, const HttpDnsCallback& callback) override;
+	virtual void Load(const HttpDnsLoadCallback& callback) override;
+
+	// Parses the response body by the formats of HttpDnsConfig::url, |ttl_seconds|
+	// is left unchanged if the body carries none
+	static bool ParseResponse(const std::string& body, std::list<std::string>& ip_list, int& ttl_seconds);
+
+private:
+	void OnResponse(const std::string& host, const HttpDnsCallback& callback,
+		const std::shared_ptr<std::string>& content, bool succeed, int response_code);
+	// Called with |mutex_| locked
+	bool OpenDatabase();
+	void Persist(const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds);
+
+	HttpManager manager_;
+	HttpDnsConfig config_;
+	std::mutex mutex_;
+	base::db::SQLiteDB db_;
+	bool db_opened_;
+	// The page cache and the statements of |db_| are released under memory pressure
+	int memory_trim_id_;
+
+	DISALLOW_COPY_AND_ASSIGN(HttpDnsClientImp);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_DNS_CLIENT_H__
@@ -1,40 +1,135 @@
 #include "nim_http/http/http_manager_imp.h"
+#include <algorithm>
+#include "base/trace_event/trace_event.h"
+#include "extension/thread/power_scheduler.h"
 #include "nim_http/http/curl_http_request.h"
 #include "nim_http/http/url_session_manager.h"
+#include "proxy_config/proxy_config/proxy_resolver.h"
 
 HTTP_BEGIN_DECLS
 HttpManagerImp::HttpManagerImp() :
-	logger_(nullptr), url_manager_(nullptr)
+	transfer_threads_(1), network_alive_(true), network_quality_tuning_(false), request_coalescing_(false), http3_(false), logger_(nullptr), url_manager_(nullptr),
+	request_remover_(std::make_shared<RequestRemover>()), proxy_resolved_(std::make_shared<RequestRemover>())
 {
-
+	request_remover_->manager = this;
+	proxy_resolved_->manager = this;
+	power_observer_id_ = NS_EXTENSION::PowerScheduler::GetInstance()->AddObserver([this](bool) {
+		if (url_manager_ != nullptr)
+			url_manager_->SetBandwidthLimit(EffectiveBandwidthLimit());
+	});
 }
 HttpManagerImp::~HttpManagerImp()
 {
-
+	// Waits for the notification being handled
+	NS_EXTENSION::PowerScheduler::GetInstance()->RemoveObserver(power_observer_id_);
+	{
+		std::lock_guard<std::mutex> auto_lock(proxy_resolved_->lock);
+		proxy_resolved_->manager = nullptr;
+	}
+	std::lock_guard<std::mutex> auto_lock(request_remover_->lock);
+	request_remover_->manager = nullptr;
 }
 void HttpManagerImp::SetLogger(const NS_NIMLOG::Logger& logger)
 {
 	logger_ = logger;
 }
-void HttpManagerImp::PostRequest(const HttpRequest& request)
+void HttpManagerImp::EnsureURLSessionManager()
 {
 	std::call_once(url_manager_init_flag_, [this]() {
+		TRACE_EVENT0("nim.http", "HttpManagerImp::CreateURLSessionManager");
 		if (url_manager_ == nullptr)
 		{
-			auto manager = std::make_unique<URLSessionManager>();
+			auto manager = std::make_unique<URLSessionManager>(transfer_threads_);
 			if (manager != nullptr && manager->Init())
 			{
 				manager->SetLogger(logger_);
+				manager->SetConcurrency(concurrency_);
+				manager->SetBandwidthLimit(EffectiveBandwidthLimit());
+				if (!cache_config_.directory.empty())
+					manager->EnableCache(cache_config_);
+				if (!network_alive_)
+					manager->SetNetworkAlive(false);
+				if (!outbox_config_.db_path.empty())
+					manager->EnableOutbox(outbox_config_);
+				if (network_quality_tuning_)
+					manager->EnableNetworkQualityTuning(true);
+				if (request_coalescing_)
+					manager->EnableRequestCoalescing(true);
+				if (http3_)
+					manager->EnableHttp3(true);
 				url_manager_ = std::move(manager);
 			}
 		}
 	});
+}
+void HttpManagerImp::Preconnect(const std::string& url, size_t count/* = 1*/)
+{
+	// The spare ones only idle out, a host rarely gets more at once
+	static const size_t kMaxPreconnects = 6;
+	EnsureURLSessionManager();
+	if (url_manager_ == nullptr || url.empty())
+		return;
+	TRACE_EVENT1("nim.http", "HttpManagerImp::Preconnect", "count", (int)count);
+	for (size_t i = 0; i < std::min(count, kMaxPreconnects); i++)
+	{
+		// Completes silently, the connection is what it leaves
+		auto request = std::make_shared<CurlHttpRequest>(url, ContentCallback());
+		request->SetConnectOnly(true);
+		request->SetPriority(PRIORITY_HIGH);
+		if (logger_ != nullptr)
+			request->SetLogger(logger_);
+		if (proxy_info_.Valid() || proxy_info_.IsSystem())
+			request->SetProxy(proxy_info_);
+		if (request->ProxyIsSystem())
+			ResolveProxyAndPost(request);
+		else
+			url_manager_->PostRequest(request);
+	}
+}
+void HttpManagerImp::Prewarm()
+{
+	EnsureURLSessionManager();
+}
+void HttpManagerImp::PostRequest(const HttpRequest& request)
+{
+	EnsureURLSessionManager();
 	auto req = std::dynamic_pointer_cast<CurlHttpRequest>(request);
 	if (logger_ != nullptr && req != nullptr)
 		req->SetLogger(logger_);
-	if (!req->ProxyValid() && proxy_info_.Valid())
+	if (!req->ProxyValid() && !req->ProxyIsSystem() && (proxy_info_.Valid() || proxy_info_.IsSystem()))
 		req->SetProxy(proxy_info_);
+	if (content_store_ != nullptr && req->GetContentStore() == nullptr)
+		req->SetContentStore(content_store_);
+	if (req->ProxyIsSystem())
+		ResolveProxyAndPost(req);
+	else
+		PostResolvedRequest(req);
+}
+void HttpManagerImp::ResolveProxyAndPost(const std::shared_ptr<CurlHttpRequest>& request)
+{
+	// At once when the result for the scheme, host and port is cached, on the
+	// resolver thread otherwise
+	std::shared_ptr<RequestRemover> poster = proxy_resolved_;
+	NS_NET::NimProxyResolver::GetInstance()->Resolve(request->URL(), [poster, request](const NS_NET::ProxyInfo& proxy) {
+		request->SetProxy(proxy);
+		std::lock_guard<std::mutex> auto_lock(poster->lock);
+		if (poster->manager != nullptr)
+			poster->manager->PostResolvedRequest(request);
+	});
+}
+void HttpManagerImp::PostResolvedRequest(std::shared_ptr<CurlHttpRequest> req)
+{
 	url_manager_->PostRequest(req);
+	// Watched after posting so that a cancelled token removes the request at once
+	if (req->GetCancellationToken().IsValid())
+	{
+		std::shared_ptr<RequestRemover> remover = request_remover_;
+		req->WatchCancellation([remover](HttpRequestID request_id) {
+			std::lock_guard<std::mutex> auto_lock(remover->lock);
+			if (remover->manager != nullptr)
+				remover->manager->RemoveRequest(request_id);
+		});
+	}
 }
 void HttpManagerImp::SetProxy(const NS_NET::ProxyInfo& proxy_info)
 {
@@ -44,6 +139,33 @@ void HttpManagerImp::SetProxy(NS_NET::ProxyInfo&& proxy_info)
 {
 	proxy_info_ = std::move(proxy_info);
 }
+void HttpManagerImp::SetConcurrency(const HttpConcurrency& concurrency)
+{
+	concurrency_ = concurrency;
+	if (url_manager_ != nullptr)
+		url_manager_->SetConcurrency(concurrency_);
+}
+void HttpManagerImp::SetBandwidthLimit(const HttpBandwidthLimit& limit)
+{
+	bandwidth_limit_ = limit;
+	if (url_manager_ != nullptr)
+		url_manager_->SetBandwidthLimit(EffectiveBandwidthLimit());
+}
+HttpBandwidthLimit HttpManagerImp::EffectiveBandwidthLimit() const
+{
+	HttpBandwidthLimit limit = bandwidth_limit_;
+	if (!NS_EXTENSION::PowerScheduler::IsBackground())
+		return limit;
+	// The budget starts over every time the app enters background
+	long long budget = NS_EXTENSION::PowerScheduler::GetInstance()->GetPolicy().http_background_budget;
+	if (budget >= 0 && (limit.background_budget < 0 || budget < limit.background_budget))
+		limit.background_budget = budget;
+	return limit;
+}
+void HttpManagerImp::SetTransferThreads(size_t count)
+{
+	transfer_threads_ = count > 0 ? count : 1;
+}
 void HttpManagerImp::RemoveRequest(const HttpRequest& request)
 {
 	if (url_manager_ == nullptr)
@@ -56,4 +178,67 @@ void HttpManagerImp::RemoveRequest(HttpRequestID request_id)
 		return;
 	url_manager_->RemoveRequest(request_id);
 }
+void HttpManagerImp::SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority)
+{
+	if (url_manager_ == nullptr)
+		return;
+	url_manager_->SetRequestPriority(request_id, priority);
+}
+void HttpManagerImp::SetResolvedHost(const std::string& host, int port,
+	const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	if (url_manager_ == nullptr)
+		return;
+	url_manager_->SetResolvedHost(host, port, ip_list, ttl_seconds);
+}
+void HttpManagerImp::EnableCache(const HttpCacheConfig& config)
+{
+	cache_config_ = config;
+	if (url_manager_ != nullptr)
+		url_manager_->EnableCache(cache_config_);
+}
+void HttpManagerImp::EnableOutbox(const HttpOutboxConfig& config)
+{
+	outbox_config_ = config;
+	if (url_manager_ != nullptr)
+		url_manager_->EnableOutbox(outbox_config_);
+}
+void HttpManagerImp::SetContentStore(const HttpContentStore& store)
+{
+	content_store_ = store;
+}
+HttpContentStore HttpManagerImp::GetContentStore() const
+{
+	return content_store_;
+}
+void HttpManagerImp::SetNetworkAlive(bool alive)
+{
+	network_alive_ = alive;
+	if (url_manager_ != nullptr)
+		url_manager_->SetNetworkAlive(network_alive_);
+}
+void HttpManagerImp::ResetConnections()
+{
+	if (url_manager_ == nullptr)
+		return;
+	url_manager_->ResetConnections();
+}
+void HttpManagerImp::EnableNetworkQualityTuning(bool enable)
+{
+	network_quality_tuning_ = enable;
+	if (url_manager_ != nullptr)
+		url_manager_->EnableNetworkQualityTuning(network_quality_tuning_);
+}
+void HttpManagerImp::EnableRequestCoalescing(bool enable)
+{
+	request_coalescing_ = enable;
+	if (url_manager_ != nullptr)
+		url_manager_->EnableRequestCoalescing(request_coalescing_);
+}
+void HttpManagerImp::EnableHttp3(bool enable)
+{
+	http3_ = enable;
+	if (url_manager_ != nullptr)
+		url_manager_->EnableHttp3(http3_);
+}
 HTTP_END_DECLS
\ No newline at end of file
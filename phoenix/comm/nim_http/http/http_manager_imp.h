@@ -12,6 +12,7 @@
 HTTP_BEGIN_DECLS
 
 class IURLSessionManager;
+class CurlHttpRequest;
 class HttpManagerImp : public IHttpManager
 {
 public:
@@ -22,13 +23,64 @@ public:
 	virtual void PostRequest(const HttpRequest& request) override;
 	virtual void SetProxy(const NS_NET::ProxyInfo& proxy_info) override;
 	virtual void SetProxy(NS_NET::ProxyInfo&& proxy_info) override;
+	virtual void SetConcurrency(const HttpConcurrency& concurrency) override;
+	virtual void SetBandwidthLimit(const HttpBandwidthLimit& limit) override;
+	virtual void SetTransferThreads(size_t count) override;
 	virtual void RemoveRequest(const HttpRequest& request) override;
 	virtual void RemoveRequest(HttpRequestID request_id) override;
+	virtual void SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority) override;
+	virtual void SetResolvedHost(const std::string& host, int port,
+		const std::list<std::string>& ip_list, int ttl_seconds) override;
+	virtual void EnableCache(const HttpCacheConfig& config) override;
+	virtual void EnableOutbox(const HttpOutboxConfig& config) override;
+	virtual void SetContentStore(const HttpContentStore& store) override;
+	virtual HttpContentStore GetContentStore() const override;
+	virtual void SetNetworkAlive(bool alive) override;
+	virtual void ResetConnections() override;
+	virtual void EnableNetworkQualityTuning(bool enable) override;
+	virtual void EnableRequestCoalescing(bool enable) override;
+	virtual void EnableHttp3(bool enable) override;
+	virtual void Preconnect(const std::string& url, size_t count = 1) override;
+	virtual void Prewarm() override;
 private:
+	// Creates |url_manager_| with the settings so far, once
+	void EnsureURLSessionManager();
+	// |bandwidth_limit_| with the background budget of the power policy while
+	// the app is in background
+	HttpBandwidthLimit EffectiveBandwidthLimit() const;
+	// Posts |request| once NimProxyResolver resolves its system proxy
+	void ResolveProxyAndPost(const std::shared_ptr<CurlHttpRequest>& request);
+	// Posts |request| with its proxy decided
+	void PostResolvedRequest(std::shared_ptr<CurlHttpRequest> request);
+
+	// The cancellation callbacks of the posted requests may run on any thread
+	// after the manager is gone, they reach the manager through it
+	struct RequestRemover
+	{
+		std::mutex lock;
+		HttpManagerImp* manager;
+	};
+
 	NS_NET::ProxyInfo proxy_info_;
+	HttpConcurrency concurrency_;
+	HttpBandwidthLimit bandwidth_limit_;
+	size_t transfer_threads_;
+	HttpCacheConfig cache_config_;
+	HttpOutboxConfig outbox_config_;
+	// Set to the requests when they are posted
+	HttpContentStore content_store_;
+	bool network_alive_;
+	bool network_quality_tuning_;
+	bool request_coalescing_;
+	bool http3_;
 	NS_NIMLOG::Logger logger_;
 	std::once_flag url_manager_init_flag_;
 	std::unique_ptr<IURLSessionManager> url_manager_;
+	std::shared_ptr<RequestRemover> request_remover_;
+	// The same for the callbacks of the proxy resolution, a request posted by
+	// them may call the cancellation callback at once
+	std::shared_ptr<RequestRemover> proxy_resolved_;
+	int power_observer_id_;
 };
 
 HTTP_END_DECLS
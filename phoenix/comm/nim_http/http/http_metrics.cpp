@@ -0,0 +1,103 @@
+#include "nim_http/http/http_metrics.h"
+
+#include "base/metrics/histogram.h"
+#include "extension/strings/string_util.h"
+
+HTTP_BEGIN_DECLS
+
+namespace
+{
+const int kMaxTimingMs = 60 * 1000;
+const size_t kTimingBuckets = 50;
+
+base::HistogramBase* TimingHistogram(const std::string& phase, const std::string& host)
+{
+	return base::Histogram::FactoryGet("Http." + phase + "Ms." + host, 1, kMaxTimingMs, kTimingBuckets,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+}
+
+void AddTiming(base::HistogramBase* histogram, double ms)
+{
+	if (ms > 0)
+		histogram->Add(static_cast<int>(ms + 0.5));
+}
+}
+
+HttpMetrics* HttpMetrics::GetInstance()
+{
+	// Leaked, requests may complete while the process exits
+	static HttpMetrics* instance = new HttpMetrics;
+	return instance;
+}
+
+const HttpMetrics::HostHistograms& HttpMetrics::GetHostHistograms(const std::string& host)
+{
+	auto it = hosts_.find(host);
+	if (it != hosts_.end())
+		return it->second;
+	std::string name = host;
+	if (name.empty() || hosts_.size() >= kMaxHosts)
+	{
+		name = "other";
+		it = hosts_.find(name);
+		if (it != hosts_.end())
+			return it->second;
+	}
+
+	HostHistograms histograms;
+	histograms.namelookup = TimingHistogram("NameLookup", name);
+	histograms.connect = TimingHistogram("Connect", name);
+	histograms.tls = TimingHistogram("Tls", name);
+	histograms.server = TimingHistogram("Server", name);
+	histograms.total = TimingHistogram("Total", name);
+	histograms.reused = base::BooleanHistogram::FactoryGet("Http.ConnectionReused." + name,
+		base::HistogramBase::kUmaTargetedHistogramFlag);
+	return hosts_.insert(std::make_pair(name, histograms)).first->second;
+}
+
+void HttpMetrics::Record(const std::string& url, const HttpRequestTiming& timing)
+{
+	std::string host = HostOfURL(url);
+	HttpMetrics* metrics = GetInstance();
+	std::lock_guard<std::mutex> lock(metrics->mutex_);
+	const HostHistograms& histograms = metrics->GetHostHistograms(host);
+
+	// The phases are cumulative, a reused connection has no DNS, TCP or TLS
+	if (!timing.connection_reused)
+	{
+		AddTiming(histograms.namelookup, timing.namelookup_ms);
+		AddTiming(histograms.connect, timing.connect_ms - timing.namelookup_ms);
+		if (timing.appconnect_ms > 0)
+			AddTiming(histograms.tls, timing.appconnect_ms - timing.connect_ms);
+	}
+	if (timing.starttransfer_ms > 0)
+		AddTiming(histograms.server, timing.starttransfer_ms - timing.pretransfer_ms);
+	AddTiming(histograms.total, timing.total_ms);
+	histograms.reused->AddBoolean(timing.connection_reused);
+}
+
+std::string HttpMetrics::HostOfURL(const std::string& url)
+{
+	size_t begin = url.find("://");
+	begin = begin == std::string::npos ? 0 : begin + 3;
+	size_t end = url.find_first_of("/?#", begin);
+	std::string authority = url.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+	size_t at = authority.rfind('@');
+	if (at != std::string::npos)
+		authority.erase(0, at + 1);
+
+	std::string host;
+	if (!authority.empty() && authority[0] == '[')
+	{
+		// IPv6 literal
+		size_t close = authority.find(']');
+		host = authority.substr(0, close == std::string::npos ? std::string::npos : close + 1);
+	}
+	else
+	{
+		host = authority.substr(0, authority.find(':'));
+	}
+	return NS_EXTENSION::MakeLowerString(host);
+}
+
+HTTP_END_DECLS
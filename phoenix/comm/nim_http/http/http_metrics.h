@@ -0,0 +1,51 @@
+#ifndef __BASE_HTTP_HTTP_METRICS_H__
+#define __BASE_HTTP_HTTP_METRICS_H__
+
+#include "nim_http/config/build_config.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include "nim_http/wrapper/http_def.h"
+
+namespace base {
+class HistogramBase;
+}
+
+HTTP_BEGIN_DECLS
+
+// Records the timing of the requests to the histograms of base/metrics per
+// host, e.g. "Http.ConnectMs.example.com":
+//   Http.NameLookupMs, Http.ConnectMs (TCP), Http.TlsMs, Http.ServerMs (from
+//   the request sent to the first byte), Http.TotalMs and Http.ConnectionReused.
+// At most kMaxHosts hosts get their own histograms, the others are recorded
+// as "other". Thread safe.
+class HttpMetrics
+{
+public:
+	static const size_t kMaxHosts = 64;
+
+	static void Record(const std::string& url, const HttpRequestTiming& timing);
+	// The lower case host of |url| without the port, empty if it has none
+	static std::string HostOfURL(const std::string& url);
+
+private:
+	struct HostHistograms
+	{
+		base::HistogramBase* namelookup;
+		base::HistogramBase* connect;
+		base::HistogramBase* tls;
+		base::HistogramBase* server;
+		base::HistogramBase* total;
+		base::HistogramBase* reused;
+	};
+
+	static HttpMetrics* GetInstance();
+	const HostHistograms& GetHostHistograms(const std::string& host);
+
+	std::mutex mutex_;
+	std::map<std::string, HostHistograms> hosts_;
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_METRICS_H__
@@ -0,0 +1,295 @@
+#include "nim_http/http/http_outbox.h"
+#include "base/location.h"
+#include "base/sha1.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "extension/callback/post_task.h"
+#include "nim_http/http/http_log.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+// The deferred requests are written together after it
+const int64_t kFlushDelayMs = 200;
+// Between the batches of a replay
+const int64_t kReplayIntervalMs = 100;
+
+const char kCreateTableSql[] =
+	"CREATE TABLE IF NOT EXISTS http_outbox("
+	"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+	"coalesce_key TEXT NOT NULL UNIQUE, "
+	"url TEXT NOT NULL, "
+	"method INTEGER NOT NULL, "
+	"headers TEXT NOT NULL DEFAULT '', "
+	"body BLOB, "
+	"priority INTEGER NOT NULL, "
+	"timeout_ms INTEGER NOT NULL, "
+	"create_time INTEGER NOT NULL)";
+
+std::string FieldText(base::db::SQLiteStatement& statement, int col)
+{
+	const char* text = statement.GetTextField(col);
+	return text != nullptr ? std::string(text) : std::string();
+}
+}
+
+HttpOutbox::HttpOutbox(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner,
+	const PostCallback& post_cb, const NetworkAliveCallback& network_alive_cb)
+	: task_runner_(task_runner), post_callback_(post_cb), network_alive_callback_(network_alive_cb),
+	flush_scheduled_(false), replaying_(false)
+{
+}
+
+HttpOutbox::~HttpOutbox()
+{
+	Close();
+}
+
+bool HttpOutbox::Open(const HttpOutboxConfig& config)
+{
+	Close();
+
+	config_ = config;
+	if (config_.replay_batch_size == 0)
+		config_.replay_batch_size = 1;
+	if (config_.db_path.empty()
+		|| !db_.Open(config_.db_path.c_str(), std::string(), base::db::SQLiteOpenOptions::FastCache())
+		|| db_.Query(kCreateTableSql) != SQLITE_OK) {
+		HTTP_QLOG_ERR(GetLogger(), "[net][http] open outbox failed: {0}, {1}")
+			<< config_.db_path << (db_.IsValid() ? db_.GetLastErrorMessage() : "");
+		db_.Close();
+		return false;
+	}
+	return true;
+}
+
+void HttpOutbox::Close()
+{
+	if (db_.IsValid()) {
+		Flush();
+		db_.Close();
+	}
+	requests_.clear();
+}
+
+std::string HttpOutbox::CoalesceKey(const CurlHttpRequest* request)
+{
+	if (!request->coalesce_key_.empty())
+		return request->coalesce_key_;
+	std::string text = std::to_string(request->method_);
+	text.append("\n").append(request->url_).append("\n").append(request->post_fields_);
+	std::string hash = base::SHA1HashString(text);
+	return base::HexEncode(hash.data(), hash.size());
+}
+
+bool HttpOutbox::Defer(const std::shared_ptr<CurlHttpRequest>& request)
+{
+	// Only the requests which can be rebuilt from the database are deferred
+	if (!db_.IsValid() || request == nullptr || !request->IsDeferrable() || !request->IsContentRequest()
+		|| request->form_post_ != NULL || request->post_source_ != nullptr)
+		return false;
+
+	Record record;
+	record.coalesce_key = CoalesceKey(request.get());
+	record.url = request->url_;
+	record.method = request->method_;
+	for (curl_slist* item = request->header_list_; item != NULL; item = item->next) {
+		if (!record.headers.empty())
+			record.headers.push_back('\n');
+		record.headers.append(item->data);
+	}
+	record.body = request->post_fields_;
+	record.priority = request->GetPriority();
+	record.timeout_ms = request->timeout_ms_;
+	record.create_time = base::Time::Now().ToTimeT();
+
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Defer ID {0} to the outbox") << request->GetRequestID();
+	// A duplicate deferred before is replaced
+	requests_[record.coalesce_key] = request;
+	pending_records_.push_back(record);
+	ScheduleFlush();
+	return true;
+}
+
+void HttpOutbox::Remove(HttpRequestID request_id)
+{
+	for (auto iter = requests_.begin(); iter != requests_.end(); iter++) {
+		if (iter->second->GetRequestID() == request_id) {
+			std::string coalesce_key = iter->first;
+			requests_.erase(iter);
+			DeleteRecord(coalesce_key);
+			return;
+		}
+	}
+}
+
+void HttpOutbox::ScheduleFlush()
+{
+	if (flush_scheduled_)
+		return;
+	flush_scheduled_ = true;
+	NS_EXTENSION::PostDelayedTask(task_runner_.get(), FROM_HERE,
+		NS_EXTENSION::Bind(&HttpOutbox::Flush, this), NS_EXTENSION::TimeDelta::FromMilliseconds(kFlushDelayMs));
+}
+
+void HttpOutbox::Flush()
+{
+	flush_scheduled_ = false;
+	if (pending_records_.empty() || !db_.IsValid())
+		return;
+
+	base::db::SQLiteAutoTransaction transaction(&db_);
+	transaction.Begin();
+	base::db::SQLiteStatement statement;
+	// The replaced row is deleted, the newest one goes to the end
+	const char sql[] = "INSERT OR REPLACE INTO http_outbox(coalesce_key, url, method, headers, body, priority, "
+		"timeout_ms, create_time) VALUES(?, ?, ?, ?, ?, ?, ?, ?)";
+	if (db_.Query(statement, sql) == SQLITE_OK) {
+		for (const auto& record : pending_records_) {
+			statement.BindText(1, record.coalesce_key.c_str(), record.coalesce_key.size());
+			statement.BindText(2, record.url.c_str(), record.url.size());
+			statement.BindInt(3, record.method);
+			statement.BindText(4, record.headers.c_str(), record.headers.size());
+			statement.BindBlob(5, record.body.data(), (int)record.body.size());
+			statement.BindInt(6, record.priority);
+			statement.BindInt64(7, record.timeout_ms);
+			statement.BindInt64(8, record.create_time);
+			statement.NextRow();
+			statement.Rewind();
+		}
+	}
+	statement.Finalize();
+	pending_records_.clear();
+	Trim();
+	transaction.Commit();
+}
+
+void HttpOutbox::Trim()
+{
+	base::db::SQLiteStatement statement;
+	int64_t count = 0;
+	if (db_.Query(statement, "SELECT COUNT(*) FROM http_outbox") == SQLITE_OK && statement.NextRow() == SQLITE_ROW)
+		count = statement.GetInt64Field(0);
+	statement.Finalize();
+	if (count <= (int64_t)config_.max_requests)
+		return;
+
+	std::vector<std::string> dropped;
+	if (db_.Query(statement, "SELECT coalesce_key FROM http_outbox ORDER BY id LIMIT ?") == SQLITE_OK) {
+		statement.BindInt64(1, count - (int64_t)config_.max_requests);
+		while (statement.NextRow() == SQLITE_ROW)
+			dropped.push_back(FieldText(statement, 0));
+	}
+	statement.Finalize();
+	HTTP_QLOG_WAR(GetLogger(), "[net][http] outbox is full, {0} requests dropped") << (int)dropped.size();
+	for (const auto& coalesce_key : dropped)
+		DeleteRecord(coalesce_key);
+}
+
+void HttpOutbox::DeleteRecord(const std::string& coalesce_key)
+{
+	requests_.erase(coalesce_key);
+	for (auto iter = pending_records_.begin(); iter != pending_records_.end();) {
+		if (iter->coalesce_key == coalesce_key)
+			iter = pending_records_.erase(iter);
+		else
+			iter++;
+	}
+	base::db::SQLiteStatement statement;
+	if (db_.Query(statement, "DELETE FROM http_outbox WHERE coalesce_key = ?") != SQLITE_OK)
+		return;
+	statement.BindText(1, coalesce_key.c_str(), coalesce_key.size());
+	statement.NextRow();
+}
+
+void HttpOutbox::Replay()
+{
+	if (replaying_ || !db_.IsValid())
+		return;
+	replaying_ = true;
+	Flush();
+	ReplayBatch();
+}
+
+void HttpOutbox::ReplayBatch()
+{
+	if (!db_.IsValid() || !network_alive_callback_()) {
+		replaying_ = false;
+		return;
+	}
+
+	std::vector<Record> records;
+	int64_t last_id = 0;
+	base::db::SQLiteStatement statement;
+	const char sql[] = "SELECT id, coalesce_key, url, method, headers, body, priority, timeout_ms, create_time "
+		"FROM http_outbox ORDER BY id LIMIT ?";
+	if (db_.Query(statement, sql) == SQLITE_OK) {
+		statement.BindInt64(1, (int64_t)config_.replay_batch_size);
+		while (statement.NextRow() == SQLITE_ROW) {
+			Record record;
+			last_id = statement.GetInt64Field(0);
+			record.coalesce_key = FieldText(statement, 1);
+			record.url = FieldText(statement, 2);
+			record.method = statement.GetIntField(3);
+			record.headers = FieldText(statement, 4);
+			const char* body = static_cast<const char*>(statement.GetBlobField(5));
+			if (body != nullptr)
+				record.body.assign(body, statement.GetFieldBytes(5));
+			record.priority = statement.GetIntField(6);
+			record.timeout_ms = (long)statement.GetInt64Field(7);
+			record.create_time = statement.GetInt64Field(8);
+			records.push_back(record);
+		}
+	}
+	statement.Finalize();
+	if (records.empty()) {
+		replaying_ = false;
+		return;
+	}
+	if (db_.Query(statement, "DELETE FROM http_outbox WHERE id <= ?") == SQLITE_OK) {
+		statement.BindInt64(1, last_id);
+		statement.NextRow();
+	}
+	statement.Finalize();
+
+	HTTP_QLOG_APP(GetLogger(), "[net][http] Replay {0} requests of the outbox") << (int)records.size();
+	int64_t now = base::Time::Now().ToTimeT();
+	for (const auto& record : records) {
+		std::shared_ptr<CurlHttpRequest> request;
+		auto iter = requests_.find(record.coalesce_key);
+		if (iter != requests_.end()) {
+			request = iter->second;
+			requests_.erase(iter);
+		} else if (now - record.create_time <= config_.max_age_seconds) {
+			request = Restore(record);
+		}
+		if (request != nullptr)
+			post_callback_(request);
+	}
+
+	NS_EXTENSION::PostDelayedTask(task_runner_.get(), FROM_HERE,
+		NS_EXTENSION::Bind(&HttpOutbox::ReplayBatch, this), NS_EXTENSION::TimeDelta::FromMilliseconds(kReplayIntervalMs));
+}
+
+std::shared_ptr<CurlHttpRequest> HttpOutbox::Restore(const Record& record)
+{
+	auto request = std::make_shared<CurlHttpRequest>(record.url, ContentCallback());
+	request->SetMethod(static_cast<METHODS>(record.method));
+	size_t begin = 0;
+	while (begin < record.headers.size()) {
+		size_t end = record.headers.find('\n', begin);
+		if (end == std::string::npos)
+			end = record.headers.size();
+		request->header_list_ = curl_slist_append(request->header_list_, record.headers.substr(begin, end - begin).c_str());
+		begin = end + 1;
+	}
+	if (!record.body.empty())
+		request->SetPostFields(record.body.data(), record.body.size());
+	request->SetPriority(static_cast<HTTP_PRIORITY>(record.priority));
+	request->SetTimeout(record.timeout_ms);
+	request->SetDeferrable(true, record.coalesce_key);
+	request->SetLogger(GetLogger());
+	return request;
+}
+
+HTTP_END_DECLS
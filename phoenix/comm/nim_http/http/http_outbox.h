@@ -0,0 +1,85 @@
+#ifndef __BASE_HTTP_HTTP_OUTBOX_H__
+#define __BASE_HTTP_HTTP_OUTBOX_H__
+
+#include "nim_http/config/build_config.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "extension/callback/callback.h"
+#include "google_base/base/single_thread_task_runner.h"
+#include "nim_db/db_sqlite3.h"
+#include "nim_http/http/curl_http_request.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The outbox of URLSessionManager.
+// The deferrable requests posted while the network is down are stored to
+// the "http_outbox" table, the writes are batched into one transaction.
+// Replay() posts them back by batches of |replay_batch_size|, the oldest
+// first. A request deferred by this run is posted as it is with its
+// callbacks, the ones restored from the last run are rebuilt without any.
+// Not thread safe, used on the first transfer thread only.
+class HttpOutbox : public NS_NIMLOG::LoggerSetter, public NS_EXTENSION::SupportWeakCallback
+{
+public:
+	using PostCallback = std::function<void(std::shared_ptr<CurlHttpRequest>&)>;
+	using NetworkAliveCallback = std::function<bool()>;
+
+	HttpOutbox(const scoped_refptr<base::SingleThreadTaskRunner>& task_runner,
+		const PostCallback& post_cb, const NetworkAliveCallback& network_alive_cb);
+	~HttpOutbox();
+
+	bool Open(const HttpOutboxConfig& config);
+	void Close();
+
+	// Returns false if |request| can not be stored, it is sent then
+	bool Defer(const std::shared_ptr<CurlHttpRequest>& request);
+	// A removed request is not sent
+	void Remove(HttpRequestID request_id);
+	// Posts the stored requests while the network is alive
+	void Replay();
+
+private:
+	struct Record
+	{
+		Record() : method(GET), priority(PRIORITY_NORMAL), timeout_ms(0), create_time(0) {}
+		std::string coalesce_key;
+		std::string url;
+		int method;
+		// Header lines separated by '\n'
+		std::string headers;
+		std::string body;
+		int priority;
+		long timeout_ms;
+		int64_t create_time;
+	};
+
+	static std::string CoalesceKey(const CurlHttpRequest* request);
+	void ScheduleFlush();
+	void Flush();
+	void Trim();
+	void DeleteRecord(const std::string& coalesce_key);
+	void ReplayBatch();
+	std::shared_ptr<CurlHttpRequest> Restore(const Record& record);
+
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+	PostCallback post_callback_;
+	NetworkAliveCallback network_alive_callback_;
+	HttpOutboxConfig config_;
+	base::db::SQLiteDB db_;
+	// Not written to the database yet
+	std::vector<Record> pending_records_;
+	bool flush_scheduled_;
+	bool replaying_;
+	// The requests deferred by this run by their coalescing keys
+	std::map<std::string, std::shared_ptr<CurlHttpRequest>> requests_;
+
+	DISALLOW_COPY_AND_ASSIGN(HttpOutbox);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_OUTBOX_H__
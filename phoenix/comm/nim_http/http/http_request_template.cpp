@@ -0,0 +1,121 @@
+#include "nim_http/http/http_request_template.h"
+#include "nim_http/http/curl_http_request.h"
+
+HTTP_BEGIN_DECLS
+
+HttpRequestTemplateImp::HttpRequestTemplateImp()
+{
+}
+
+HttpRequestTemplateImp::~HttpRequestTemplateImp()
+{
+}
+
+void HttpRequestTemplateImp::AddHeaderField(const std::string& name, const std::string& value)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (name == "Host")
+		settings_.header_host = value;
+	header_fields_.push_back(name + ": " + value);
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::ClearHeaderFields()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.header_host.clear();
+	header_fields_.clear();
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetUserAgent(const std::string& user_agent)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.user_agent = user_agent;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetProxy(const NS_NET::ProxyInfo& proxy)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.proxy = proxy;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetVerifyPeer(bool verify, const std::string& ca_file/* = ""*/)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.verify_peer = verify;
+	settings_.ca_file = ca_file;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetTimeout(long timeout_ms)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.timeout_ms = timeout_ms;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetLowSpeed(long low_speed_limit, long low_speed_time)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.low_speed_limit = low_speed_limit;
+	settings_.low_speed_time = low_speed_time;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetIPResolve(IPRESOLVE ipresolve)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.ipresolve = ipresolve;
+	options_ = nullptr;
+}
+
+void HttpRequestTemplateImp::SetPriority(HTTP_PRIORITY priority)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	settings_.priority = priority;
+	options_ = nullptr;
+}
+
+std::shared_ptr<const CurlTemplateOptions> HttpRequestTemplateImp::GetOptions()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (options_ != nullptr)
+		return options_;
+
+	// The requests running keep the options they were created with
+	auto options = std::make_shared<CurlTemplateOptions>();
+	options->header_host = settings_.header_host;
+	options->user_agent = settings_.user_agent;
+	options->proxy = settings_.proxy;
+	options->verify_peer = settings_.verify_peer;
+	options->ca_file = settings_.ca_file;
+	options->timeout_ms = settings_.timeout_ms;
+	options->low_speed_limit = settings_.low_speed_limit;
+	options->low_speed_time = settings_.low_speed_time;
+	options->ipresolve = settings_.ipresolve;
+	options->priority = settings_.priority;
+	for (const auto& field : header_fields_)
+		options->header_list = curl_slist_append(options->header_list, field.c_str());
+	options_ = options;
+	return options_;
+}
+
+HttpRequest HttpRequestTemplateImp::CreateRequest(const std::string& url, const ResponseCallback& response_cb)
+{
+	auto request = std::make_shared<CurlHttpRequest>(url, response_cb);
+	request->SetTemplateOptions(GetOptions());
+	return request;
+}
+
+HttpRequest HttpRequestTemplateImp::CreateDownloadRequest(const std::string& url, const std::string& download_file_path,
+	const CompletedCallback& complete_cb)
+{
+	auto request = std::make_shared<CurlHttpRequest>(url, download_file_path, complete_cb);
+	request->SetTemplateOptions(GetOptions());
+	return request;
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,52 @@
+#ifndef __BASE_HTTP_HTTP_REQUEST_TEMPLATE_H__
+#define __BASE_HTTP_HTTP_REQUEST_TEMPLATE_H__
+
+#include "nim_http/config/build_config.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "nim_http/http/curl_http_request_base.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The options are built into a CurlTemplateOptions by the first request
+// created after a change, the next requests share it.
+class HttpRequestTemplateImp : public IHttpRequestTemplate
+{
+public:
+	HttpRequestTemplateImp();
+	virtual ~HttpRequestTemplateImp();
+
+	virtual void AddHeaderField(const std::string& name, const std::string& value) override;
+	virtual void ClearHeaderFields() override;
+	virtual void SetUserAgent(const std::string& user_agent) override;
+	virtual void SetProxy(const NS_NET::ProxyInfo& proxy) override;
+	virtual void SetVerifyPeer(bool verify, const std::string& ca_file = "") override;
+	virtual void SetTimeout(long timeout_ms) override;
+	virtual void SetLowSpeed(long low_speed_limit, long low_speed_time) override;
+	virtual void SetIPResolve(IPRESOLVE ipresolve) override;
+	virtual void SetPriority(HTTP_PRIORITY priority) override;
+
+	virtual HttpRequest CreateRequest(const std::string& url, const ResponseCallback& response_cb) override;
+	virtual HttpRequest CreateDownloadRequest(const std::string& url, const std::string& download_file_path,
+		const CompletedCallback& complete_cb) override;
+
+private:
+	std::shared_ptr<const CurlTemplateOptions> GetOptions();
+
+	std::mutex mutex_;
+	// "name: value"
+	std::list<std::string> header_fields_;
+	// The options except the header list
+	CurlTemplateOptions settings_;
+	// Built from the above, nullptr after a change
+	std::shared_ptr<const CurlTemplateOptions> options_;
+
+	DISALLOW_COPY_AND_ASSIGN(HttpRequestTemplateImp);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_REQUEST_TEMPLATE_H__
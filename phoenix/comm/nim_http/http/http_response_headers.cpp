@@ -0,0 +1,149 @@
+#include "nim_http/http/http_response_headers.h"
+
+#include <string.h>
+
+HTTP_BEGIN_DECLS
+
+namespace {
+
+bool IsHeaderSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+std::string_view TrimHeaderSpaces(std::string_view text)
+{
+	while (!text.empty() && IsHeaderSpace(text.front()))
+		text.remove_prefix(1);
+	while (!text.empty() && IsHeaderSpace(text.back()))
+		text.remove_suffix(1);
+	return text;
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		char x = a[i], y = b[i];
+		if (x >= 'A' && x <= 'Z')
+			x += 'a' - 'A';
+		if (y >= 'A' && y <= 'Z')
+			y += 'a' - 'A';
+		if (x != y)
+			return false;
+	}
+	return true;
+}
+
+}  // namespace
+
+HttpResponseHeaders::HttpResponseHeaders()
+	: indexed_size_(0)
+{
+}
+
+HttpResponseHeaders::HttpResponseHeaders(const HttpResponseHeaders& other)
+	: raw_(other.raw_), indexed_size_(0)
+{
+}
+
+HttpResponseHeaders& HttpResponseHeaders::operator=(const HttpResponseHeaders& other)
+{
+	if (this != &other) {
+		raw_ = other.raw_;
+		std::lock_guard<std::mutex> lock(index_mutex_);
+		index_.clear();
+		indexed_size_ = 0;
+	}
+	return *this;
+}
+
+int HttpResponseHeaders::AppendLine(const char* line, size_t size)
+{
+	std::string_view text(line, size);
+	while (!text.empty() && (text.back() == '\r' || text.back() == '\n'))
+		text.remove_suffix(1);
+	if (text.empty())
+		return 0;
+	int status_code = ParseStatusCode(text);
+	if (status_code > 0)
+		return status_code;
+	raw_.append(text.data(), text.size()).append("\r\n");
+	return 0;
+}
+
+void HttpResponseHeaders::Clear()
+{
+	raw_.clear();
+	std::lock_guard<std::mutex> lock(index_mutex_);
+	index_.clear();
+	indexed_size_ = 0;
+}
+
+bool HttpResponseHeaders::Find(std::string_view name, std::string_view* value) const
+{
+	std::lock_guard<std::mutex> lock(index_mutex_);
+	if (indexed_size_ < raw_.size())
+		BuildIndexLocked();
+	for (auto it = index_.rbegin(); it != index_.rend(); ++it) {
+		if (it->name_size == it->size)
+			continue;
+		std::string_view line(raw_.data() + it->offset, it->size);
+		if (!EqualsIgnoreCase(TrimHeaderSpaces(line.substr(0, it->name_size)), name))
+			continue;
+		if (value != nullptr)
+			*value = TrimHeaderSpaces(line.substr(it->name_size + 1));
+		return true;
+	}
+	return false;
+}
+
+void HttpResponseHeaders::GetLines(std::list<std::string>& lines) const
+{
+	lines.clear();
+	size_t start = 0;
+	while (start < raw_.size()) {
+		size_t end = raw_.find("\r\n", start);
+		if (end == std::string::npos)
+			end = raw_.size();
+		lines.emplace_back(raw_, start, end - start);
+		start = end + 2;
+	}
+}
+
+int HttpResponseHeaders::ParseStatusCode(std::string_view line)
+{
+	// "HTTP/1.1 200 OK", "HTTP/2 200"
+	if (line.size() < 5 || line.compare(0, 5, "HTTP/") != 0)
+		return 0;
+	size_t pos = line.find(' ');
+	if (pos == std::string_view::npos)
+		return 0;
+	int status_code = 0;
+	size_t digits = 0;
+	for (pos++; pos < line.size() && line[pos] >= '0' && line[pos] <= '9' && digits < 3; pos++, digits++)
+		status_code = status_code * 10 + (line[pos] - '0');
+	return digits == 3 ? status_code : 0;
+}
+
+void HttpResponseHeaders::BuildIndexLocked() const
+{
+	// The lines appended since the last lookup
+	size_t start = indexed_size_;
+	while (start < raw_.size()) {
+		size_t end = raw_.find("\r\n", start);
+		if (end == std::string::npos)
+			end = raw_.size();
+		Line line;
+		line.offset = (uint32_t)start;
+		line.size = (uint32_t)(end - start);
+		const char* colon = (const char*)memchr(raw_.data() + start, ':', end - start);
+		line.name_size = colon != nullptr ? (uint32_t)(colon - raw_.data() - start) : line.size;
+		index_.push_back(line);
+		start = end + 2;
+	}
+	indexed_size_ = raw_.size();
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,62 @@
+#ifndef __BASE_HTTP_HTTP_RESPONSE_HEADERS_H__
+#define __BASE_HTTP_HTTP_RESPONSE_HEADERS_H__
+
+#include "nim_http/config/build_config.h"
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+HTTP_BEGIN_DECLS
+
+// The header lines of the responses of a request, the redirections included,
+// kept as received in one buffer with the status lines left out. The lines
+// are indexed by the lookups, the ones appended since the last lookup at a
+// time, and only the headers looked up are parsed, so the headers nobody asks
+// for cost an append each. Appends are made on the transfer thread, lookups
+// may be made on any thread after them.
+class HttpResponseHeaders
+{
+public:
+	HttpResponseHeaders();
+	HttpResponseHeaders(const HttpResponseHeaders& other);
+	HttpResponseHeaders& operator=(const HttpResponseHeaders& other);
+
+	// Appends a line passed to CURLOPT_HEADERFUNCTION, returns its status code
+	// if it is a status line, which is not kept, else 0
+	int AppendLine(const char* line, size_t size);
+	void Clear();
+	bool empty() const { return raw_.empty(); }
+
+	// The lines, each one ended by CRLF
+	const std::string& raw() const { return raw_; }
+	// Finds the value of the last |name| header, case-insensitive. |value| is
+	// trimmed and points into the buffer, valid until the headers change.
+	bool Find(std::string_view name, std::string_view* value) const;
+	void GetLines(std::list<std::string>& lines) const;
+
+	// The status code of a line like "HTTP/1.1 200 OK", 0 if it is not one
+	static int ParseStatusCode(std::string_view line);
+
+private:
+	struct Line
+	{
+		uint32_t offset;
+		uint32_t size;			// CRLF excluded
+		uint32_t name_size;		// Up to the colon, |size| if there is none
+	};
+
+	// Indexes the lines after |indexed_size_|
+	void BuildIndexLocked() const;
+
+	std::string raw_;
+	mutable std::mutex index_mutex_;
+	mutable std::vector<Line> index_;
+	mutable size_t indexed_size_;
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_HTTP_RESPONSE_HEADERS_H__
@@ -0,0 +1,332 @@
+#include "nim_http/http/log_uploader.h"
+#include <algorithm>
+#include <cstdio>
+#include "third_party/zlib/include/zlib.h"
+#include "extension/callback/post_task.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/file_deleter.h"
+#include "extension/strings/string_util.h"
+#include "extension/thread/framework_thread.h"
+#include "extension/time/coarse_clock.h"
+#include "extension/zip/compression.h"
+#include "nim_http/http/http_log.h"
+#include "nim_http/wrapper/nim_http.h"
+#include "nim_log/wrapper/log.h"
+
+HTTP_BEGIN_DECLS
+
+namespace {
+const char kBundlePrefix[] = "log_";
+const char kBundleExt[] = ".zip";
+const char kListExt[] = ".list";
+const char kUploadedList[] = "uploaded.list";
+const char kSnapshotExt[] = ".snap";
+// The head hashed for the key of a segment
+const size_t kKeyHeadSize = 4096;
+// Below the 4GB of ZipWriter, the segments left go to the next bundle
+const uint64_t kMaxBundleSize = 1024 * 1024 * 1024;
+}
+
+LogUploaderImp::LogUploaderImp(const HttpManager& manager,
+							   const HttpLogUploadConfig& config,
+							   const LogUploadCallback& complete_cb) :
+	manager_(manager), config_(config), complete_callback_(complete_cb), uploading_(false)
+{
+	config_.compress_level = std::min(std::max(config_.compress_level, 0), 9);
+}
+
+LogUploaderImp::~LogUploaderImp()
+{
+	Stop();
+}
+
+bool LogUploaderImp::Start()
+{
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (thread_ != nullptr)
+			return true;
+		if (manager_ == nullptr || config_.log_path.empty() || config_.staging_directory.empty() || config_.url.empty())
+			return false;
+		if (!NS_EXTENSION::FilePathIsExist(config_.staging_directory, true) &&
+			!NS_EXTENSION::CreateDirectory(config_.staging_directory))
+			return false;
+		auto thread = std::make_unique<NS_EXTENSION::FrameworkThread>("nim_log_upload");
+		NS_EXTENSION::FrameworkThreadOptions options;
+		options.qos = NS_EXTENSION::ThreadQoS::kBackground;
+		if (!thread->StartWithOptions(options))
+			return false;
+		task_runner_ = thread->task_runner();
+		thread_ = std::move(thread);
+	}
+	if (config_.interval_seconds > 0)
+		PostUpload(config_.interval_seconds, true);
+	return true;
+}
+
+void LogUploaderImp::Stop()
+{
+	std::unique_ptr<NS_EXTENSION::FrameworkThread> thread;
+	ChunkedUpload upload;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		thread = std::move(thread_);
+		task_runner_ = nullptr;
+		upload = std::move(upload_);
+	}
+	// The parts accepted are kept, the bundle is resumed by the next Start()
+	if (upload != nullptr)
+		upload->Cancel();
+	if (thread != nullptr)
+		thread->Stop();
+	uploading_ = false;
+}
+
+bool LogUploaderImp::UploadNow()
+{
+	if (uploading_.exchange(true))
+		return false;
+	if (PostUpload(0, false))
+		return true;
+	uploading_ = false;
+	return false;
+}
+
+bool LogUploaderImp::PostUpload(int64_t delay_seconds, bool scheduled)
+{
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		task_runner = task_runner_;
+	}
+	if (task_runner == nullptr)
+		return false;
+	std::weak_ptr<LogUploaderImp> weak_self = shared_from_this();
+	auto task = [weak_self, scheduled]() {
+		auto self = weak_self.lock();
+		if (self == nullptr)
+			return;
+		// A scheduled run is skipped while UploadNow() is uploading
+		if (!scheduled || !self->uploading_.exchange(true))
+			self->RunUpload();
+		if (scheduled)
+			self->PostUpload(self->config_.interval_seconds, true);
+	};
+	if (delay_seconds <= 0)
+		return NS_EXTENSION::PostTask(task_runner.get(), FROM_HERE, task);
+	return NS_EXTENSION::PostDelayedTask(task_runner.get(), FROM_HERE, task,
+		NS_EXTENSION::TimeDelta::FromSeconds(delay_seconds));
+}
+
+void LogUploaderImp::RunUpload()
+{
+	std::string bundle_path;
+	std::vector<Segment> segments;
+	if (!FindPendingBundle(bundle_path, segments) && !Snapshot(bundle_path, segments)) {
+		// Nothing new to upload
+		uploading_ = false;
+		return;
+	}
+	UploadBundle(bundle_path, segments);
+}
+
+bool LogUploaderImp::FindPendingBundle(std::string& bundle_path, std::vector<Segment>& segments)
+{
+	NS_EXTENSION::FileEnumerator enumerator(config_.staging_directory, false, base::FileEnumerator::FILES,
+		std::string(kBundlePrefix) + "*" + kBundleExt);
+	std::vector<std::string> bundles;
+	for (base::FilePath path = enumerator.Next(); !path.empty(); path = enumerator.Next())
+		bundles.push_back(path.AsUTF8Unsafe());
+	// The names carry the time, the oldest bundle first
+	std::sort(bundles.begin(), bundles.end());
+	for (auto& bundle : bundles) {
+		std::vector<Segment> bundle_segments;
+		if (!ReadList(bundle + kListExt, bundle_segments) || bundle_segments.empty()) {
+			NS_EXTENSION::DeleteFile(bundle);
+			NS_EXTENSION::DeleteFile(bundle + kListExt);
+			continue;
+		}
+		bundle_path = bundle;
+		segments.swap(bundle_segments);
+		return true;
+	}
+	return false;
+}
+
+bool LogUploaderImp::Snapshot(std::string& bundle_path, std::vector<Segment>& segments)
+{
+	// "<log_path>.0" is the newest segment
+	std::vector<std::string> paths;
+	for (int index = 0; NS_EXTENSION::FilePathIsExist(config_.log_path + "." + std::to_string(index), false); index++)
+		paths.push_back(config_.log_path + "." + std::to_string(index));
+	std::reverse(paths.begin(), paths.end());
+	if (config_.logger != nullptr) {
+		config_.logger->FlushNow();
+		paths.push_back(config_.log_path);
+	}
+
+	std::vector<Segment> uploaded;
+	ReadList(GetStagingPath(kUploadedList), uploaded);
+	std::set<std::string> uploaded_keys;
+	for (auto& segment : uploaded)
+		uploaded_keys.insert(segment.key);
+	// Forget the segments deleted by the rolls since
+	std::vector<Segment> kept;
+	std::vector<Segment> candidates;
+	for (auto& path : paths) {
+		Segment segment;
+		segment.key = GetSegmentKey(path);
+		segment.path = path;
+		if (segment.key.empty())
+			continue;
+		if (uploaded_keys.count(segment.key) > 0)
+			kept.push_back(segment);
+		else
+			candidates.push_back(segment);
+	}
+	if (kept.size() != uploaded.size())
+		WriteList(GetStagingPath(kUploadedList), kept);
+	if (candidates.empty())
+		return false;
+
+	std::string name = kBundlePrefix + std::to_string(NS_EXTENSION::CoarseClock::NowMs());
+	bundle_path = GetStagingPath(name + kBundleExt);
+	std::string snapshot_path = GetStagingPath(name + kSnapshotExt);
+	NS_EXTENSION::ZipWriter zip(bundle_path);
+	if (!zip.IsValid())
+		return false;
+	for (auto& segment : candidates) {
+		if (zip.size() >= kMaxBundleSize)
+			break;
+		// Zipped from a copy, a roll renames the segments while they are read
+		std::string file_name;
+		if (!NS_EXTENSION::FilePathApartFileName(segment.path, file_name) ||
+			!NS_EXTENSION::CopyFile(segment.path, snapshot_path))
+			continue;
+		bool added = zip.AddFile(file_name, snapshot_path, config_.compress_level);
+		NS_EXTENSION::DeleteFile(snapshot_path);
+		if (!added)
+			break;
+		segments.push_back(segment);
+	}
+	if (segments.empty() || !zip.Finish() || !WriteList(bundle_path + kListExt, segments)) {
+		HTTP_QLOG_ERR(config_.logger, "[net][http] snapshot logs to {0} failed") << bundle_path;
+		segments.clear();
+		NS_EXTENSION::DeleteFile(bundle_path);
+		NS_EXTENSION::DeleteFile(bundle_path + kListExt);
+		return false;
+	}
+	return true;
+}
+
+void LogUploaderImp::UploadBundle(const std::string& bundle_path, const std::vector<Segment>& segments)
+{
+	std::string bundle_name;
+	NS_EXTENSION::FilePathApartFileName(bundle_path, bundle_name);
+	HttpChunkedUploadConfig chunk_config = config_.chunk_config;
+	chunk_config.upload_id = bundle_name;
+	HTTP_PRIORITY priority = config_.priority;
+	UploadPartRequestCallback part_request_cb = config_.chunk_config.part_request_cb;
+	chunk_config.part_request_cb = [priority, part_request_cb](const HttpUploadPart& part, const HttpRequest& request) {
+		request->SetPriority(priority);
+		if (part_request_cb)
+			part_request_cb(part, request);
+	};
+	std::weak_ptr<LogUploaderImp> weak_self = shared_from_this();
+	auto upload = NIMHttp::CreateChunkedUpload(manager_, config_.url, bundle_path, chunk_config,
+		[weak_self, bundle_path, segments](bool succeed, int response_code, const std::vector<std::string>&) {
+			auto self = weak_self.lock();
+			if (self != nullptr)
+				self->OnUploadCompleted(bundle_path, segments, succeed, response_code);
+		});
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		if (task_runner_ == nullptr) {
+			uploading_ = false;
+			return;
+		}
+		upload_ = upload;
+	}
+	// The bundle is never empty, so a failed Start() still completes by the callback
+	upload->Start();
+}
+
+void LogUploaderImp::OnUploadCompleted(const std::string& bundle_path, const std::vector<Segment>& segments,
+									   bool succeed, int response_code)
+{
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		upload_.reset();
+	}
+	if (succeed) {
+		std::vector<Segment> uploaded;
+		ReadList(GetStagingPath(kUploadedList), uploaded);
+		uploaded.insert(uploaded.end(), segments.begin(), segments.end());
+		WriteList(GetStagingPath(kUploadedList), uploaded);
+		NS_EXTENSION::DeleteFile(bundle_path);
+		NS_EXTENSION::DeleteFile(bundle_path + kListExt);
+	}
+	Finish(succeed, response_code, segments);
+}
+
+void LogUploaderImp::Finish(bool succeed, int response_code, const std::vector<Segment>& segments)
+{
+	uploading_ = false;
+	if (!complete_callback_)
+		return;
+	std::vector<std::string> paths;
+	for (auto& segment : segments)
+		paths.push_back(segment.path);
+	complete_callback_(succeed, response_code, paths);
+}
+
+std::string LogUploaderImp::GetStagingPath(const std::string& name) const
+{
+	std::string path;
+	NS_EXTENSION::FilePathCompose(config_.staging_directory, name, path);
+	return path;
+}
+
+std::string LogUploaderImp::GetSegmentKey(const std::string& path)
+{
+	int64_t size = NS_EXTENSION::GetFileSize(path);
+	if (size <= 0)
+		return std::string();
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file(NS_EXTENSION::OpenFile(path, "rb"));
+	if (!file)
+		return std::string();
+	char head[kKeyHeadSize];
+	size_t length = fread(head, 1, sizeof(head), file.get());
+	uint32_t crc = (uint32_t)crc32(0L, (const Bytef*)head, (uInt)length);
+	char key[48];
+	snprintf(key, sizeof(key), "%lld-%08x", (long long)size, crc);
+	return key;
+}
+
+bool LogUploaderImp::ReadList(const std::string& path, std::vector<Segment>& segments)
+{
+	std::string data;
+	if (!NS_EXTENSION::ReadFileToString(path, data))
+		return false;
+	// A line is "key\tpath"
+	for (std::string_view line : NS_EXTENSION::StringTokens(data, "\n")) {
+		size_t pos = line.find('\t');
+		if (pos == std::string_view::npos || pos == 0)
+			continue;
+		Segment segment;
+		segment.key = std::string(line.substr(0, pos));
+		segment.path = std::string(line.substr(pos + 1));
+		segments.push_back(segment);
+	}
+	return true;
+}
+
+bool LogUploaderImp::WriteList(const std::string& path, const std::vector<Segment>& segments)
+{
+	std::string data;
+	for (auto& segment : segments)
+		data.append(segment.key).append(1, '\t').append(segment.path).append(1, '\n');
+	return NS_EXTENSION::WriteFile(path, data) == (int)data.length();
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,84 @@
+#ifndef __BASE_HTTP_LOG_UPLOADER_H__
+#define __BASE_HTTP_LOG_UPLOADER_H__
+
+#include "nim_http/config/build_config.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "google_base/base/single_thread_task_runner.h"
+#include "nim_http/wrapper/http_def.h"
+
+EXTENSION_BEGIN_DECLS
+class FrameworkThread;
+EXTENSION_END_DECLS
+
+HTTP_BEGIN_DECLS
+
+// The uploader of NIMHttp::CreateLogUploader.
+// The staging directory holds the bundles "log_<time>.zip", each with a
+// "<bundle>.list" of the keys and paths of its segments written once the
+// zip is complete, and "uploaded.list" of the segments uploaded which still
+// exist. A bundle without its list was interrupted while zipping and is
+// deleted.
+// The segments are copied and zipped one at a time, so the disk holds at
+// most one extra copy of a segment and the memory a chunk of the zip
+// stream and the parts of the chunked upload.
+// Start(), Stop(), UploadNow() and IsUploading() are thread safe, the rest
+// runs on the thread of the uploader. Stop() must not be called from the
+// callback.
+class LogUploaderImp : public ILogUploader,
+	public std::enable_shared_from_this<LogUploaderImp>
+{
+public:
+	LogUploaderImp(const HttpManager& manager,
+				   const HttpLogUploadConfig& config,
+				   const LogUploadCallback& complete_cb);
+	virtual ~LogUploaderImp();
+
+	virtual bool Start() override;
+	virtual void Stop() override;
+	virtual bool UploadNow() override;
+	virtual bool IsUploading() const override { return uploading_; }
+
+private:
+	struct Segment
+	{
+		// "<size>-<crc32 of the head>"
+		std::string key;
+		std::string path;
+	};
+
+	bool PostUpload(int64_t delay_seconds, bool scheduled);
+	void RunUpload();
+	bool FindPendingBundle(std::string& bundle_path, std::vector<Segment>& segments);
+	bool Snapshot(std::string& bundle_path, std::vector<Segment>& segments);
+	void UploadBundle(const std::string& bundle_path, const std::vector<Segment>& segments);
+	void OnUploadCompleted(const std::string& bundle_path, const std::vector<Segment>& segments,
+		bool succeed, int response_code);
+	void Finish(bool succeed, int response_code, const std::vector<Segment>& segments);
+	std::string GetStagingPath(const std::string& name) const;
+
+	static std::string GetSegmentKey(const std::string& path);
+	static bool ReadList(const std::string& path, std::vector<Segment>& segments);
+	static bool WriteList(const std::string& path, const std::vector<Segment>& segments);
+
+	HttpManager manager_;
+	HttpLogUploadConfig config_;
+	LogUploadCallback complete_callback_;
+
+	// Protects |thread_|, |task_runner_| and |upload_|
+	mutable std::mutex mutex_;
+	std::unique_ptr<NS_EXTENSION::FrameworkThread> thread_;
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+	ChunkedUpload upload_;
+	std::atomic_bool uploading_;
+
+	DISALLOW_COPY_AND_ASSIGN(LogUploaderImp);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_LOG_UPLOADER_H__
@@ -24,15 +24,15 @@
 
 HTTP_BEGIN_DECLS
 
-static void OnUVAsync(uv_async_t* handle)
+static void OnUVTimer(uv_timer_t* handle)
 {
 	// Nothing to do
 }
 
-static void OnUVTimer(uv_timer_t* handle)
+struct MessagePumpForUV::Operation : public NS_EXTENSION::MpscQueueNode
 {
-	// Nothing to do
-}
+	NS_EXTENSION::OnceClosure task;
+};
 
 MessagePumpForUV::Watcher::Watcher(int fd, bool socket)
 	: fd_(fd), is_socket_(socket),
@@ -128,6 +128,7 @@ MessagePumpForUV::MessagePumpForUV() :keep_running_(true)
 	timer_ = new uv_timer_t();
 	uv_loop_init(loop_);
 	uv_async_init(loop_, wakuper_, OnUVAsync);
+	wakuper_->data = this;
 	uv_timer_init(loop_, timer_);
 }
 
@@ -136,6 +137,11 @@ MessagePumpForUV::~MessagePumpForUV()
 	uv_stop(loop_);
 	uv_close((uv_handle_t*)wakuper_,0);
 	uv_timer_stop(timer_);
+	for (Operation *operation = operations_.PopAll(); operation != nullptr;) {
+		Operation *next = NS_EXTENSION::MpscQueue<Operation>::Next(operation);
+		delete operation;
+		operation = next;
+	}
 	//uv_loop_delete(loop_);
 	uv_loop_close(loop_);
 
@@ -150,7 +156,10 @@ MessagePumpForUV::~MessagePumpForUV()
 void MessagePumpForUV::Run(Delegate* delegate) {
 	base::AutoReset<bool> auto_reset_keep_running(&keep_running_, true);
 	for (;;) {
-		bool did_work = delegate->DoWork();
+		bool did_work = DrainOperations();
+		if (!keep_running_)
+			break;
+		did_work |= delegate->DoWork();
 		if (!keep_running_ || loop_ == nullptr)
 			break;
 		// Poll for new events once but don't block if there are no pending
@@ -233,6 +242,37 @@ void MessagePumpForUV::SetTimerSlack(base::TimerSlack timer_slack) {
 }
 #endif
 
+void MessagePumpForUV::PostOperation(NS_EXTENSION::OnceClosure task)
+{
+	if (!task)
+		return;
+	Operation *operation = new Operation;
+	operation->task = std::move(task);
+	if (operations_.Push(operation))
+		uv_async_send(wakuper_);
+}
+
+void MessagePumpForUV::OnUVAsync(uv_async_t* handle)
+{
+	MessagePumpForUV *pump = static_cast<MessagePumpForUV *>(handle->data);
+	if (pump != nullptr)
+		pump->DrainOperations();
+}
+
+bool MessagePumpForUV::DrainOperations()
+{
+	Operation *operation = operations_.PopAll();
+	if (operation == nullptr)
+		return false;
+	while (operation != nullptr) {
+		Operation *next = NS_EXTENSION::MpscQueue<Operation>::Next(operation);
+		operation->task();
+		delete operation;
+		operation = next;
+	}
+	return true;
+}
+
 bool MessagePumpForUV::WatchFileDescriptor(Watcher *watcher, Event mode)
 {
 	if (watcher == nullptr)
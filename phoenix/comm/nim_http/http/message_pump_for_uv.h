@@ -9,6 +9,8 @@
 #include "base/message_loop/message_loop_current.h"
 
 #include "extension/time/time.h"
+#include "extension/callback/once_closure.h"
+#include "extension/thread/mpsc_queue.h"
 
 
 struct uv_poll_s;
@@ -105,9 +107,24 @@ public:
 		// The pump will NOT own the |watcher| after this method called,
 		// thus to stop watching, you should call the watcher's |Close| method.
 	bool WatchFileDescriptor(Watcher *watcher, Event mode);
+	// Runs |task| on the thread that the pump is running on, can be called on
+	// any thread. Unlike posting a task to the message loop, this takes no lock:
+	// the operations are pushed onto a lock-free queue, only the post that finds
+	// the queue empty wakes up the uv loop, and the whole burst is drained in
+	// posting order by that one wakeup. Operations still queued when the pump
+	// is destroyed are dropped without running.
+	void PostOperation(NS_EXTENSION::OnceClosure task);
+	// The internal uv loop, only valid on the thread that the pump is running on.
+	// Used to share the loop with other libuv based modules (e.g. net::UVLoopHost).
+	uv_loop_t* loop() const { return loop_; }
 
 private:
+	struct Operation;
+
 	static void OnLibuvNotification(uv_poll_t *req, int status, int events);
+	static void OnUVAsync(uv_async_t* handle);
+	// Runs the operations queued so far, returns true if there was any
+	bool DrainOperations();
 
 private:
 	// This flag is set to false when Run should return.
@@ -119,6 +136,8 @@ private:
 	uv_async_t *wakuper_;
 	// Used by uv_timer_start
 	uv_timer_t *timer_;
+	// Operations posted by PostOperation
+	NS_EXTENSION::MpscQueue<Operation> operations_;
 
 	DISALLOW_COPY_AND_ASSIGN(MessagePumpForUV);
 };
@@ -0,0 +1,97 @@
+#include "nim_http/http/query_signer.h"
+#include <algorithm>
+#include <vector>
+#include "extension/encrypt/url_encode.h"
+
+HTTP_BEGIN_DECLS
+
+namespace
+{
+// Enough for the parameters of an API request without allocating
+const size_t kInlineParams = 32;
+
+bool LessParam(const std::pair<std::string, std::string>* a, const std::pair<std::string, std::string>* b)
+{
+	int ret = a->first.compare(b->first);
+	return ret != 0 ? ret < 0 : a->second < b->second;
+}
+}
+
+QuerySignerImp::QuerySignerImp(NS_NIMENCRYPT::EncryptMethod method, const std::string& secret)
+	: hmac_(NS_NIMENCRYPT::NIMEncrypt::CreateMethod(method))
+{
+	// The padded key states are computed by the first signature
+	if (hmac_ != nullptr)
+		hmac_->SetKey(secret);
+}
+
+bool QuerySignerImp::IsHMACMethod(NS_NIMENCRYPT::EncryptMethod method)
+{
+	switch (method) {
+	case NS_NIMENCRYPT::EncryptMethod::ENC_HMAC_SHA1:
+	case NS_NIMENCRYPT::EncryptMethod::ENC_HMAC_SHA256:
+	case NS_NIMENCRYPT::EncryptMethod::ENC_HMAC_SM3:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void QuerySignerImp::CanonicalizeQuery(const HttpQueryParams& params, std::string& query)
+{
+	query.clear();
+	const std::pair<std::string, std::string>* inline_params[kInlineParams];
+	std::vector<const std::pair<std::string, std::string>*> heap_params;
+	const std::pair<std::string, std::string>** sorted = inline_params;
+	if (params.size() > kInlineParams) {
+		heap_params.resize(params.size());
+		sorted = &heap_params[0];
+	}
+	size_t plain_size = 0;
+	for (size_t i = 0; i < params.size(); i++) {
+		sorted[i] = &params[i];
+		plain_size += params[i].first.size() + params[i].second.size() + 2;
+	}
+	std::sort(sorted, sorted + params.size(), LessParam);
+	// Most of a query needs no escaping, reserve a little more than it
+	query.reserve(plain_size + plain_size / 4);
+	for (size_t i = 0; i < params.size(); i++) {
+		if (i > 0)
+			query.push_back('&');
+		NS_EXTENSION::URLEncodeAppend(sorted[i]->first, query);
+		query.push_back('=');
+		NS_EXTENSION::URLEncodeAppend(sorted[i]->second, query);
+	}
+}
+
+std::string QuerySignerImp::SignQuery(const HttpQueryParams& params, std::string& query,
+	const std::string& prefix/* = ""*/)
+{
+	CanonicalizeQuery(params, query);
+	return SignParts(prefix, query);
+}
+
+std::string QuerySignerImp::Sign(const std::string& message)
+{
+	return SignParts(std::string(), message);
+}
+
+std::string QuerySignerImp::SignParts(const std::string& prefix, const std::string& message)
+{
+	if (hmac_ == nullptr)
+		return std::string();
+	std::string mac;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		bool ret = prefix.empty() ? hmac_->Encrypt(message, mac)
+			: hmac_->EncryptBegin()
+				&& hmac_->EncryptUpdate(prefix.data(), prefix.size(), mac)
+				&& hmac_->EncryptUpdate(message.data(), message.size(), mac)
+				&& hmac_->EncryptFinal(mac);
+		if (!ret)
+			return std::string();
+	}
+	return NS_NIMENCRYPT::NIMEncrypt::BinaryToHexString(mac);
+}
+
+HTTP_END_DECLS
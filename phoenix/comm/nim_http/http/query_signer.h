@@ -0,0 +1,39 @@
+#ifndef __BASE_HTTP_QUERY_SIGNER_H__
+#define __BASE_HTTP_QUERY_SIGNER_H__
+
+#include "nim_http/config/build_config.h"
+#include <mutex>
+#include <string>
+#include "nim_encrypt/wrapper/nim_encrypt.h"
+#include "nim_http/wrapper/http_def.h"
+
+HTTP_BEGIN_DECLS
+
+// The signer of NIMHttp::CreateQuerySigner. The query is canonicalized
+// without the lock, only the HMAC of the shared method is serialized
+class QuerySignerImp : public IHttpQuerySigner
+{
+public:
+	QuerySignerImp(NS_NIMENCRYPT::EncryptMethod method, const std::string& secret);
+
+	virtual std::string SignQuery(const HttpQueryParams& params, std::string& query,
+		const std::string& prefix = "") override;
+	virtual std::string Sign(const std::string& message) override;
+
+	// Sorts and URL encodes |params| to |query| for SignQuery()
+	static void CanonicalizeQuery(const HttpQueryParams& params, std::string& query);
+	static bool IsHMACMethod(NS_NIMENCRYPT::EncryptMethod method);
+
+private:
+	// The hex HMAC of |prefix| followed by |message|
+	std::string SignParts(const std::string& prefix, const std::string& message);
+
+	std::mutex mutex_;
+	NS_NIMENCRYPT::SymmetricEncryptMethod hmac_;
+
+	DISALLOW_COPY_AND_ASSIGN(QuerySignerImp);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_QUERY_SIGNER_H__
@@ -0,0 +1,309 @@
+#include "nim_http/http/upload_pipeline.h"
+#include <string.h>
+#include <algorithm>
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/zip/compression.h"
+#include "nim_http/http/download_file_util.h"
+
+HTTP_BEGIN_DECLS
+
+UploadBlockQueue::UploadBlockQueue(size_t capacity)
+	: capacity_(std::max<size_t>(capacity, 1)), closed_(false), aborted_(false)
+{
+}
+
+bool UploadBlockQueue::Push(std::string& block)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this]() { return aborted_ || blocks_.size() < capacity_; });
+	if (aborted_)
+		return false;
+	blocks_.emplace_back();
+	blocks_.back().swap(block);
+	if (!spares_.empty()) {
+		block.swap(spares_.back());
+		spares_.pop_back();
+	}
+	block.clear();
+	cond_.notify_all();
+	return true;
+}
+
+bool UploadBlockQueue::Pop(std::string& block)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this]() { return aborted_ || closed_ || !blocks_.empty(); });
+	if (aborted_ || blocks_.empty())
+		return false;
+	if (block.capacity() > 0 && spares_.size() < capacity_) {
+		spares_.emplace_back();
+		spares_.back().swap(block);
+	}
+	block.swap(blocks_.front());
+	blocks_.pop_front();
+	cond_.notify_all();
+	return true;
+}
+
+void UploadBlockQueue::Close()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	closed_ = true;
+	cond_.notify_all();
+}
+
+void UploadBlockQueue::Abort()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	aborted_ = true;
+	cond_.notify_all();
+}
+
+UploadPipelineImp::UploadPipelineImp(const HttpUploadPipelineConfig& config)
+	: config_(config), body_size_(-1), body_offset_(0), body_ended_(false),
+	plain_queue_(config.queue_blocks), body_queue_(config.queue_blocks), threads_started_(false),
+	failed_(false), finished_(false)
+{
+	config_.block_size = std::max<size_t>(config_.block_size, 4096);
+}
+
+UploadPipelineImp::~UploadPipelineImp()
+{
+	plain_queue_.Abort();
+	body_queue_.Abort();
+	if (reader_.joinable())
+		reader_.join();
+	if (transformer_.joinable())
+		transformer_.join();
+}
+
+bool UploadPipelineImp::IsAEADMethod(NS_NIMENCRYPT::EncryptMethod method)
+{
+	switch (method) {
+	case NS_NIMENCRYPT::EncryptMethod::ENC_AES128_GCM:
+	case NS_NIMENCRYPT::EncryptMethod::ENC_AES256_GCM:
+	case NS_NIMENCRYPT::EncryptMethod::ENC_CHACHA20_POLY1305:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool UploadPipelineImp::Init()
+{
+	int64_t source_size = NS_EXTENSION::GetFileSize(config_.source_path);
+	file_.reset(NS_EXTENSION::OpenFile(config_.source_path, "rb"));
+	if (file_ == nullptr || source_size < 0)
+		return false;
+	source_hasher_.reset(new DownloadDigest(config_.source_digest));
+	body_hasher_.reset(new DownloadDigest(config_.body_digest));
+	body_size_ = source_size;
+	if (config_.compress_level >= 0) {
+		compressor_.reset(new NS_EXTENSION::Compressor(NS_EXTENSION::CompressionFormat::kZlib,
+			std::min(config_.compress_level, (int)NS_EXTENSION::kCompressionBest)));
+		if (!compressor_->IsValid())
+			return false;
+		body_size_ = -1;
+	}
+	if (!config_.encrypt_key.empty()) {
+		if (!IsAEADMethod(config_.encrypt_method))
+			return false;
+		encryptor_ = NS_NIMENCRYPT::NIMEncrypt::CreateMethod(config_.encrypt_method);
+		if (encryptor_ == nullptr)
+			return false;
+		encryptor_->SetKey(config_.encrypt_key);
+		if (!encryptor_->EncryptBegin())
+			return false;
+		// Exact for the AEAD methods: the nonce and the tag
+		if (body_size_ >= 0)
+			body_size_ = (long long)encryptor_->MaxEncryptedSize((size_t)body_size_);
+	}
+	return true;
+}
+
+bool UploadPipelineImp::AttachTo(const HttpRequest& request)
+{
+	if (request == nullptr)
+		return false;
+	return request->SetPostStream(GetReadCallback(), body_size_);
+}
+
+UploadReadCallback UploadPipelineImp::GetReadCallback()
+{
+	auto self = shared_from_this();
+	return [self](char* buffer, size_t size) { return self->Read(buffer, size); };
+}
+
+std::string UploadPipelineImp::GetSourceDigest() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return finished_ ? source_digest_ : std::string();
+}
+
+std::string UploadPipelineImp::GetBodyDigest() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return finished_ ? body_digest_ : std::string();
+}
+
+long long UploadPipelineImp::Read(char* buffer, size_t size)
+{
+	if (size == 0)
+		return 0;
+	// A block may be compressed to nothing yet
+	while (body_offset_ == body_.size() && !body_ended_ && !failed_) {
+		body_offset_ = 0;
+		if (!NextBody()) {
+			body_.clear();
+			body_ended_ = true;
+		}
+	}
+	if (failed_)
+		return -1;
+	if (body_offset_ == body_.size()) {
+		finished_ = true;
+		return 0;
+	}
+	size_t copied = std::min(size, body_.size() - body_offset_);
+	memcpy(buffer, body_.data() + body_offset_, copied);
+	body_offset_ += copied;
+	return (long long)copied;
+}
+
+bool UploadPipelineImp::NextBody()
+{
+	if (config_.pipeline_threads) {
+		if (!threads_started_)
+			StartThreads();
+		return body_queue_.Pop(body_);
+	}
+	if (!ReadBlock(plain_)) {
+		Fail();
+		return false;
+	}
+	bool last = plain_.empty();
+	if (!TransformBlock(plain_, last, body_)) {
+		Fail();
+		return false;
+	}
+	if (last) {
+		FinishSource();
+		FinishBody();
+		// |body_| holds the tail of the streams
+		body_ended_ = true;
+	}
+	return true;
+}
+
+bool UploadPipelineImp::ReadBlock(std::string& block)
+{
+	block.resize(config_.block_size);
+	size_t read = fread(&block[0], 1, block.size(), file_.get());
+	block.resize(read);
+	if (ferror(file_.get()))
+		return false;
+	source_hasher_->Update(block.data(), block.size());
+	return true;
+}
+
+bool UploadPipelineImp::TransformBlock(const std::string& plain, bool last, std::string& body)
+{
+	body.clear();
+	const std::string* data = &plain;
+	if (compressor_ != nullptr) {
+		compressed_.clear();
+		auto sink = NS_EXTENSION::AppendTo(&compressed_);
+		if (!plain.empty() && !compressor_->Write(plain.data(), plain.size(), sink))
+			return false;
+		if (last && !compressor_->Finish(sink))
+			return false;
+		data = &compressed_;
+	}
+	if (encryptor_ != nullptr) {
+		if (!data->empty() && !encryptor_->EncryptUpdate(data->data(), data->size(), body))
+			return false;
+		if (last && !encryptor_->EncryptFinal(body))
+			return false;
+	}
+	else if (compressor_ != nullptr) {
+		body.swap(compressed_);
+	}
+	else {
+		body.assign(plain);
+	}
+	body_hasher_->Update(body.data(), body.size());
+	return true;
+}
+
+void UploadPipelineImp::StartThreads()
+{
+	threads_started_ = true;
+	reader_ = std::thread([this]() { RunReader(); });
+	transformer_ = std::thread([this]() { RunTransformer(); });
+}
+
+void UploadPipelineImp::RunReader()
+{
+	std::string block;
+	while (!failed_) {
+		if (!ReadBlock(block)) {
+			Fail();
+			return;
+		}
+		if (block.empty())
+			break;
+		if (!plain_queue_.Push(block))
+			return;
+	}
+	FinishSource();
+	plain_queue_.Close();
+}
+
+void UploadPipelineImp::RunTransformer()
+{
+	std::string plain;
+	std::string body;
+	// Popping fails at the end of the file or when aborted, the latter is
+	// told by |failed_| or by the body queue refusing the last block
+	while (plain_queue_.Pop(plain)) {
+		if (!TransformBlock(plain, false, body)) {
+			Fail();
+			return;
+		}
+		if (!body.empty() && !body_queue_.Push(body))
+			return;
+	}
+	if (failed_)
+		return;
+	if (!TransformBlock(std::string(), true, body)) {
+		Fail();
+		return;
+	}
+	if (!body.empty() && !body_queue_.Push(body))
+		return;
+	FinishBody();
+	body_queue_.Close();
+}
+
+void UploadPipelineImp::Fail()
+{
+	failed_ = true;
+	plain_queue_.Abort();
+	body_queue_.Abort();
+}
+
+void UploadPipelineImp::FinishSource()
+{
+	std::string digest = source_hasher_->Finish();
+	std::lock_guard<std::mutex> lock(mutex_);
+	source_digest_ = digest;
+}
+
+void UploadPipelineImp::FinishBody()
+{
+	std::string digest = body_hasher_->Finish();
+	std::lock_guard<std::mutex> lock(mutex_);
+	body_digest_ = digest;
+}
+
+HTTP_END_DECLS
@@ -0,0 +1,136 @@
+#ifndef __BASE_HTTP_UPLOAD_PIPELINE_H__
+#define __BASE_HTTP_UPLOAD_PIPELINE_H__
+
+#include "nim_http/config/build_config.h"
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "extension/memory/file_deleter.h"
+#include "nim_encrypt/wrapper/nim_encrypt.h"
+#include "nim_http/wrapper/http_def.h"
+
+EXTENSION_BEGIN_DECLS
+class Compressor;
+EXTENSION_END_DECLS
+
+HTTP_BEGIN_DECLS
+
+class DownloadDigest;
+
+// A bounded queue of blocks between two stages of a pipeline. The buffers
+// are swapped in and out rather than copied, so their capacity goes round
+// between the stages and nothing is allocated once every buffer exists.
+class UploadBlockQueue
+{
+public:
+	explicit UploadBlockQueue(size_t capacity);
+
+	// Queues |block| and gives back a spare buffer in it, waits while the
+	// queue is full. False if aborted.
+	bool Push(std::string& block);
+	// Takes the next block, the buffer in |block| is kept as a spare. Waits
+	// while the queue is empty, false once it is closed and empty or aborted.
+	bool Pop(std::string& block);
+	// No more blocks, the blocks queued are still popped
+	void Close();
+	// Both ends stop at once
+	void Abort();
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<std::string> blocks_;
+	std::vector<std::string> spares_;
+	size_t capacity_;
+	bool closed_;
+	bool aborted_;
+
+	DISALLOW_COPY_AND_ASSIGN(UploadBlockQueue);
+};
+
+// The pipeline of NIMHttp::CreateUploadPipeline: source -> digest -> zlib
+// -> AEAD -> digest -> body. Without the pipeline threads every call of the
+// read callback runs the stages for a block once the last one is copied
+// out. With them the file is read by a reader thread and transformed by
+// another one, two queues of |queue_blocks| blocks connect the threads and
+// the read callback, the threads are started by the first read.
+// The read callback runs on the transfer thread, the digests can be got
+// on any thread.
+class UploadPipelineImp : public IHttpUploadPipeline,
+	public std::enable_shared_from_this<UploadPipelineImp>
+{
+public:
+	explicit UploadPipelineImp(const HttpUploadPipelineConfig& config);
+	virtual ~UploadPipelineImp();
+
+	// Opens the file and prepares the stages, false if any of them fails
+	bool Init();
+
+	virtual bool AttachTo(const HttpRequest& request) override;
+	virtual UploadReadCallback GetReadCallback() override;
+	virtual long long GetBodySize() const override { return body_size_; }
+	virtual bool IsFinished() const override { return finished_; }
+	virtual std::string GetSourceDigest() const override;
+	virtual std::string GetBodyDigest() const override;
+
+	long long Read(char* buffer, size_t size);
+
+	static bool IsAEADMethod(NS_NIMENCRYPT::EncryptMethod method);
+
+private:
+	// Reads the next block of the file to |block| and hashes it, an empty
+	// block at the end of the file
+	bool ReadBlock(std::string& block);
+	// Compresses and encrypts |plain| to |body|, which is replaced. |last|
+	// ends the streams, |plain| is empty then.
+	bool TransformBlock(const std::string& plain, bool last, std::string& body);
+	// Replaces |body_| with the next part of the body, false at the end
+	bool NextBody();
+	void StartThreads();
+	void RunReader();
+	void RunTransformer();
+	void Fail();
+	void FinishSource();
+	void FinishBody();
+
+	HttpUploadPipelineConfig config_;
+	std::unique_ptr<FILE, NS_EXTENSION::DeleterFile> file_;
+	long long body_size_;
+	std::unique_ptr<DownloadDigest> source_hasher_;
+	std::unique_ptr<DownloadDigest> body_hasher_;
+	std::unique_ptr<NS_EXTENSION::Compressor> compressor_;
+	NS_NIMENCRYPT::SymmetricEncryptMethod encryptor_;
+	// The output of the compressor for the block being transformed
+	std::string compressed_;
+
+	// Of the read callback
+	std::string plain_;
+	std::string body_;
+	size_t body_offset_;
+	bool body_ended_;
+
+	UploadBlockQueue plain_queue_;
+	UploadBlockQueue body_queue_;
+	std::thread reader_;
+	std::thread transformer_;
+	bool threads_started_;
+
+	std::atomic_bool failed_;
+	std::atomic_bool finished_;
+	// Protects the digests
+	mutable std::mutex mutex_;
+	std::string source_digest_;
+	std::string body_digest_;
+
+	DISALLOW_COPY_AND_ASSIGN(UploadPipelineImp);
+};
+
+HTTP_END_DECLS
+
+#endif // __BASE_HTTP_UPLOAD_PIPELINE_H__
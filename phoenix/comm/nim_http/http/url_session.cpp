@@ -22,9 +22,9 @@ std::shared_ptr<IURLSessionManager> GlobalURLSessionManager()
 	}
 	return manager;
 }
-std::shared_ptr<IURLSessionManager> CreateURLSessionManager()
+std::shared_ptr<IURLSessionManager> CreateURLSessionManager(size_t loop_count/* = 1*/)
 {
-	auto manager = std::make_shared<URLSessionManager>();
+	auto manager = std::make_shared<URLSessionManager>(loop_count);
 	if (!manager->Init()) {
 		assert(0);
 		return nullptr;
@@ -14,10 +14,23 @@ public:
 	virtual HttpRequestID PostRequest(std::shared_ptr<CurlHttpRequest>& request) = 0;
 	virtual void RemoveRequest(HttpRequestID request_id) = 0;
 	virtual std::shared_ptr<CurlHttpRequest> GetRequestByID(HttpRequestID request_id) = 0;
+	virtual void SetConcurrency(const HttpConcurrency& concurrency) = 0;
+	virtual void SetBandwidthLimit(const HttpBandwidthLimit& limit) = 0;
+	virtual void SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority) = 0;
+	virtual void SetResolvedHost(const std::string& host, int port,
+		const std::list<std::string>& ip_list, int ttl_seconds) = 0;
+	virtual void EnableCache(const HttpCacheConfig& config) = 0;
+	virtual void EnableOutbox(const HttpOutboxConfig& config) = 0;
+	virtual void SetNetworkAlive(bool alive) = 0;
+	virtual void ResetConnections() = 0;
+	virtual void EnableNetworkQualityTuning(bool enable) = 0;
+	virtual void EnableRequestCoalescing(bool enable) = 0;
+	virtual void EnableHttp3(bool enable) = 0;
 };
 
 HTTP_EXPORT std::shared_ptr<IURLSessionManager> GlobalURLSessionManager();
-HTTP_EXPORT std::shared_ptr<IURLSessionManager> CreateURLSessionManager();
+// |loop_count| transfer threads, see URLSessionManager
+HTTP_EXPORT std::shared_ptr<IURLSessionManager> CreateURLSessionManager(size_t loop_count = 1);
 
 HTTP_EXPORT int32_t GlobalPostRequest(std::shared_ptr<CurlHttpRequest>& request);
 HTTP_EXPORT void GlobalRemoveRequest(int32_t request_id);
@@ -1,11 +1,19 @@
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include "base/bind.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/trace_event/trace_event.h"
 #include "extension/callback/post_task.h"
+#include "extension/memory/memory_accounting.h"
+#include "extension/network/address_selector.h"
 #include "nim_log/wrapper/log.h"
 #include "nim_http/http/url_session_manager.h"
 #include "nim_http/http/message_pump_for_uv.h"
 #include "nim_http/http/curl_network_session_manager.h"
+#include "nim_http/http/http_cache.h"
+#include "nim_http/http/http_metrics.h"
+#include "nim_http/http/http_outbox.h"
 USING_NS_EXTENSION;
 
 HTTP_BEGIN_DECLS
@@ -14,41 +22,76 @@ base::scoped_ptr<base::MessagePump> CreateMessagePumpForUV() {
 	return base::make_scoped_ptr<MessagePumpForUV>(new MessagePumpForUV);
 }
 
-URLSessionManager::URLSessionManager()
+URLSessionManager::URLSessionManager(size_t loop_count/* = 1*/) :
+	cache_enabled_(false),
+	outbox_enabled_(false),
+	network_alive_(true),
+	network_quality_tuning_(false),
+	request_coalescing_(false),
+	http3_(false),
+	memory_trim_id_(0),
+	memory_account_id_(0)
 {
+	for (size_t i = 0; i < std::max<size_t>(loop_count, 1); i++)
+		loops_.push_back(std::make_unique<TransferLoop>());
 }
 
 URLSessionManager::~URLSessionManager()
 {
+	// A trim running on another thread is waited for, it uses the loops
+	if (memory_trim_id_ != 0)
+		MemoryTrimmer::Unregister(memory_trim_id_);
+	if (memory_account_id_ != 0)
+		MemoryAccounting::Unregister(memory_account_id_);
 	DestroyThreads();
 }
 
 bool URLSessionManager::Init()
 {
+	TRACE_EVENT1("nim.http", "URLSessionManager::Init", "threads", (int)loops_.size());
 	if (!PreCreateThreads())
 	{
 		//LOG_ERR();
 		return false;
 	}
+	if (memory_trim_id_ == 0)
+		memory_trim_id_ = MemoryTrimmer::Register("nim_http", [this](MemoryTrimLevel level) {
+			TrimMemory(level);
+		});
+	// The content buffers are counted by all the managers together
+	static int content_account_id = MemoryAccounting::Register("nim_http.content", &CurlHttpRequest::GetLiveContentBytes);
+	(void)content_account_id;
+	if (memory_account_id_ == 0)
+		memory_account_id_ = MemoryAccounting::Register("nim_http.requests", [this]() {
+			base::AutoLock autolock(lock_);
+			return (int64_t)(request_list_.size() * (sizeof(CurlHttpRequest) + sizeof(RequestPair)));
+		});
 	return true;
 }
 HttpRequestID URLSessionManager::PostRequest(std::shared_ptr<CurlHttpRequest>& request)
 {	
 	//base::AutoLock autolock(lock_);
-	if (message_loop_current_){
+	size_t loop_index = LoopIndexOf(request);
+	TransferLoop* loop = loops_[loop_index].get();
+	if (loop->message_loop_current){
 		if(request->GetTaskRunner() == nullptr)
-			request->SetTaskRunner(message_loop_current_->GetUVMessageLoopTaskRunner());
-		StdClosure closure = NS_EXTENSION::Bind(&URLSessionManager::DoPostRequest,this, request);
-		PostTask(message_loop_current_->GetUVMessageLoopTaskRunner().get(),FROM_HERE,closure);
+			request->SetTaskRunner(loop->message_loop_current->GetUVMessageLoopTaskRunner());
+		StdClosure closure = NS_EXTENSION::Bind(&URLSessionManager::DoPostRequest,this, loop_index, request);
+		// Requests submitted from many threads at once share one wakeup of the loop
+		loop->message_loop_current->GetMessagePump()->PostOperation(closure);
 		//PostDelayedTask(message_loop_current_->GetTaskRunner().get(),FROM_HERE,closure,base::TimeDelta::FromSeconds(4));
 	}
-	return AddSession(request);
+	return AddSession(request, loop_index);
 }
 void URLSessionManager::RemoveRequest(HttpRequestID request_id)
 {
-	if (message_loop_current_)
+	size_t loop_index = 0;
+	if (!FindRequestLoop(request_id, loop_index))
+		return;
+	auto& message_loop_current = loops_[loop_index]->message_loop_current;
+	if (message_loop_current)
 	{
-		PostTask(message_loop_current_->GetTaskRunner().get(),FROM_HERE, NS_EXTENSION::Bind(&URLSessionManager::DoRemoveRequest,this, request_id));
+		message_loop_current->GetMessagePump()->PostOperation(NS_EXTENSION::Bind(&URLSessionManager::DoRemoveRequest, this, request_id));
 	}
 }
 std::shared_ptr<CurlHttpRequest> URLSessionManager::GetRequestByID(HttpRequestID request_id)
@@ -56,58 +99,397 @@ std::shared_ptr<CurlHttpRequest> URLSessionManager::GetRequestByID(HttpRequestID
 	auto weak_request = internalGetRequestByID(request_id);
 	return  weak_request.lock();
 }
+void URLSessionManager::SetConcurrency(const HttpConcurrency& concurrency)
+{
+	concurrency_ = concurrency;
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->SetConcurrency(LoopConcurrency());
+	}
+}
+void URLSessionManager::SetBandwidthLimit(const HttpBandwidthLimit& limit)
+{
+	bandwidth_limit_ = limit;
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->SetBandwidthLimit(LoopBandwidthLimit());
+	}
+}
+void URLSessionManager::SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority)
+{
+	size_t loop_index = 0;
+	if (!FindRequestLoop(request_id, loop_index))
+		return;
+	if (loops_[loop_index]->manager != nullptr)
+		loops_[loop_index]->manager->SetSessionPriority(request_id, priority);
+}
+void URLSessionManager::SetResolvedHost(const std::string& host, int port,
+	const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	// Only one address for a host is supported by CURLOPT_RESOLVE of curl 7.57,
+	// it is the historically fastest one not failed recently. The cacheable
+	// requests to the host run on the first loop, so every loop gets the address.
+	std::list<std::string> sorted = ip_list;
+	NS_EXTENSION::AddressSelector::GetInstance()->Sort(sorted);
+	std::string address = sorted.empty() ? std::string() : sorted.front();
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->SetResolvedHost(host, port, address, ttl_seconds);
+	}
+}
+void URLSessionManager::EnableCache(const HttpCacheConfig& config)
+{
+	cache_enabled_ = !config.directory.empty();
+	auto& message_loop_current = loops_.front()->message_loop_current;
+	if (message_loop_current)
+	{
+		PostTask(message_loop_current->GetUVMessageLoopTaskRunner().get(), FROM_HERE,
+			NS_EXTENSION::Bind(&URLSessionManager::DoEnableCache, this, config));
+	}
+}
+void URLSessionManager::EnableOutbox(const HttpOutboxConfig& config)
+{
+	outbox_enabled_ = !config.db_path.empty();
+	auto& message_loop_current = loops_.front()->message_loop_current;
+	if (message_loop_current)
+	{
+		PostTask(message_loop_current->GetUVMessageLoopTaskRunner().get(), FROM_HERE,
+			NS_EXTENSION::Bind(&URLSessionManager::DoEnableOutbox, this, config));
+	}
+}
+void URLSessionManager::SetNetworkAlive(bool alive)
+{
+	if (network_alive_.exchange(alive) == alive || !alive)
+		return;
+	auto& message_loop_current = loops_.front()->message_loop_current;
+	if (message_loop_current)
+	{
+		PostTask(message_loop_current->GetUVMessageLoopTaskRunner().get(), FROM_HERE,
+			NS_EXTENSION::Bind(&URLSessionManager::DoReplayOutbox, this));
+	}
+}
+void URLSessionManager::ResetConnections()
+{
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->ResetConnections();
+	}
+}
+void URLSessionManager::EnableNetworkQualityTuning(bool enable)
+{
+	network_quality_tuning_ = enable;
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->EnableNetworkQualityTuning(enable);
+	}
+}
+void URLSessionManager::EnableRequestCoalescing(bool enable)
+{
+	// The groups in flight still complete their followers
+	request_coalescing_ = enable;
+}
+void URLSessionManager::EnableHttp3(bool enable)
+{
+	http3_ = enable;
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->EnableHttp3(enable);
+	}
+}
+void URLSessionManager::TrimMemory(MemoryTrimLevel level)
+{
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->TrimMemory(level);
+	}
+	auto& message_loop_current = loops_.front()->message_loop_current;
+	if (message_loop_current)
+	{
+		PostTask(message_loop_current->GetUVMessageLoopTaskRunner().get(), FROM_HERE,
+			NS_EXTENSION::Bind(&URLSessionManager::DoTrimCache, this, level));
+	}
+}
 void URLSessionManager::OnSetLogger()
 {
-	if (manager_ != nullptr)
-		manager_->SetLogger(logger_);
+	for (auto& loop : loops_)
+	{
+		if (loop->manager != nullptr)
+			loop->manager->SetLogger(logger_);
+	}
 }
 bool URLSessionManager::PreCreateThreads()
 {
-	if (trans_thread_ == nullptr)	{
-		trans_thread_ = std::make_shared<NS_EXTENSION::FrameworkThread>("http_trans_thread");
-		trans_thread_->RegisterInitCallback([&](){
-			message_loop_current_ = MessageLoopCurrentForUV::Get();
-			manager_ = std::make_unique<CurlNetworkSessionManager>(message_loop_current_);
+	for (size_t i = 0; i < loops_.size(); i++)	{
+		TransferLoop* loop = loops_[i].get();
+		if (loop->trans_thread != nullptr)
+			continue;
+		std::string name = "http_trans_thread";
+		if (i > 0)
+			name += "_" + std::to_string(i);
+		loop->trans_thread = std::make_shared<NS_EXTENSION::FrameworkThread>(name);
+		loop->trans_thread->RegisterInitCallback([this, loop](){
+			TRACE_EVENT0("nim.http", "URLSessionManager::InitTransferLoop");
+			loop->message_loop_current = MessageLoopCurrentForUV::Get();
+			loop->manager = std::make_unique<CurlNetworkSessionManager>(loop->message_loop_current);
 			if (logger_ != nullptr)
-				manager_->SetLogger(logger_);
+				loop->manager->SetLogger(logger_);
+			loop->manager->SetConcurrency(LoopConcurrency());
+			loop->manager->SetBandwidthLimit(LoopBandwidthLimit());
+			if (network_quality_tuning_)
+				loop->manager->EnableNetworkQualityTuning(true);
+			if (http3_)
+				loop->manager->EnableHttp3(true);
 		});
-		trans_thread_->RegisterCleanupCallback([&](){
-			message_loop_current_ = nullptr;
+		loop->trans_thread->RegisterCleanupCallback([this, i, loop](){
+			if (i == 0) {
+				cache_.reset();
+				outbox_.reset();
+			}
+			loop->inflight.clear();
+			loop->message_loop_current = nullptr;
 		});
 	}
 
-	DCHECK(!trans_thread_->IsRunning());
-	base::Thread::Options options;
-	//create message pump for libuv
-	options.message_pump_factory = base::Bind(CreateMessagePumpForUV);
-	trans_thread_->StartWithOptions(options);
-	return trans_thread_->WaitUntilThreadStarted();
+	for (auto& loop : loops_) {
+		DCHECK(!loop->trans_thread->IsRunning());
+		NS_EXTENSION::FrameworkThreadOptions options;
+		//create message pump for libuv
+		options.message_pump_factory = base::Bind(CreateMessagePumpForUV);
+		//transfers are latency sensitive, keep them ahead of the background threads
+		options.qos = NS_EXTENSION::ThreadQoS::kUserInteractive;
+		loop->trans_thread->StartWithOptions(options);
+	}
+	//the threads set up their uv loops and curl handles at the same time
+	for (auto& loop : loops_) {
+		if (!loop->trans_thread->WaitUntilThreadStarted())
+			return false;
+	}
+	return true;
 }
 void URLSessionManager::DestroyThreads()
 {
-	if (trans_thread_ != nullptr) {
-		//trans_thread_->Stop();
-		trans_thread_ = nullptr;
+	for (auto& loop : loops_) {
+		//loop->trans_thread->Stop();
+		loop->trans_thread = nullptr;
+	}
+}
+size_t URLSessionManager::LoopIndexOf(const std::shared_ptr<CurlHttpRequest>& request) const
+{
+	if (loops_.size() == 1)
+		return 0;
+	// The response cache is not shared by the loops
+	if (cache_enabled_ && request->GetMethod() == GET && request->IsContentRequest())
+		return 0;
+	// The outbox is not shared by the loops either
+	if (outbox_enabled_ && !network_alive_ && request->IsDeferrable())
+		return 0;
+	return std::hash<std::string>()(HttpMetrics::HostOfURL(request->URL())) % loops_.size();
+}
+bool URLSessionManager::FindRequestLoop(HttpRequestID request_id, size_t& loop_index)
+{
+	base::AutoLock autolock(lock_);
+	auto it = request_list_.find(request_id);
+	if (it == request_list_.end())
+		return false;
+	loop_index = it->second.loop_index;
+	return true;
+}
+HttpConcurrency URLSessionManager::LoopConcurrency() const
+{
+	// A host runs on one loop, its limit is kept
+	HttpConcurrency concurrency = concurrency_;
+	size_t count = loops_.size();
+	if (concurrency.max_total_connections > 0)
+		concurrency.max_total_connections = (concurrency.max_total_connections + (long)count - 1) / (long)count;
+	if (concurrency.max_running_sessions > 0)
+		concurrency.max_running_sessions = (concurrency.max_running_sessions + count - 1) / count;
+	return concurrency;
+}
+HttpBandwidthLimit URLSessionManager::LoopBandwidthLimit() const
+{
+	// The background requests only yield to the foreground ones on the same loop
+	HttpBandwidthLimit limit = bandwidth_limit_;
+	long long count = (long long)loops_.size();
+	auto split = [count](long long& rate) {
+		if (rate > 0)
+			rate = (rate + count - 1) / count;
+	};
+	split(limit.max_download_rate);
+	split(limit.max_upload_rate);
+	for (int i = 0; i < PRIORITY_COUNT; i++) {
+		split(limit.priority_download_rate[i]);
+		split(limit.priority_upload_rate[i]);
 	}
+	split(limit.background_yield_rate);
+	split(limit.background_budget);
+	return limit;
 }
 ////////////////////////////////////////////////
-void URLSessionManager::DoPostRequest(std::shared_ptr<CurlHttpRequest>& request)
+void URLSessionManager::DoPostRequest(size_t loop_index, std::shared_ptr<CurlHttpRequest>& request)
 {
-	if (manager_ != nullptr)
+	auto& manager = loops_[loop_index]->manager;
+	if (manager != nullptr)
 	{
-		manager_->AddSession(request);
+		// So does a download of a content already stored
+		if (request->GetContentStore() != nullptr && request->CompleteFromContentStore())
+			return;
+		// A fresh cached response completes the request here
+		if (loop_index == 0 && cache_ != nullptr && cache_->OnRequest(request))
+			return;
+		// Stored until the network is alive again
+		if (loop_index == 0 && outbox_ != nullptr && !network_alive_ && outbox_->Defer(request))
+			return;
+		// The identical requests go to the same loop
+		std::string key = request_coalescing_ ? request->InflightKey() : std::string();
+		if (!key.empty()) {
+			CoalesceRequest(loop_index, key, request);
+			return;
+		}
+		manager->AddSession(request);
+	}
+}
+
+void URLSessionManager::CoalesceRequest(size_t loop_index, const std::string& key, std::shared_ptr<CurlHttpRequest>& request)
+{
+	TRACE_EVENT0("nim.http", "URLSessionManager::CoalesceRequest");
+	auto& inflight = loops_[loop_index]->inflight;
+	auto it = inflight.find(key);
+	// A leader released without being removed never completes its group
+	if (it != inflight.end() && GetRequestByID(it->second.leader_id) != nullptr) {
+		it->second.followers.push_back(request);
+		auto leader = GetRequestByID(it->second.leader_id);
+		if (request->GetPriority() > leader->GetPriority()) {
+			leader->SetPriority(request->GetPriority());
+			loops_[loop_index]->manager->SetSessionPriority(it->second.leader_id, request->GetPriority());
+		}
+		return;
+	}
+	std::vector<std::shared_ptr<CurlHttpRequest>> followers;
+	if (it != inflight.end())
+		followers.swap(it->second.followers);
+	CoalescedGroup& group = inflight[key];
+	group.leader_id = request->GetRequestID();
+	group.followers.swap(followers);
+	StartCoalescedLeader(loop_index, key, request);
+}
+
+void URLSessionManager::StartCoalescedLeader(size_t loop_index, const std::string& key, std::shared_ptr<CurlHttpRequest>& request)
+{
+	// Chained after the filter of the cache, the followers get the response
+	// the cache made of a 304
+	CurlHttpRequest::ResponseFilter filter = request->GetResponseFilter();
+	auto weak_flag = GetWeakFlag();
+	request->SetResponseFilter([this, weak_flag, loop_index, key, filter](CurlHttpRequest* completed,
+		std::shared_ptr<std::string>& content, bool& succeed, int& response_code) {
+		if (filter)
+			filter(completed, content, succeed, response_code);
+		if (!weak_flag.expired())
+			CompleteCoalescedGroup(loop_index, key, completed, content, succeed, response_code);
+	});
+	loops_[loop_index]->manager->AddSession(request);
+}
+
+void URLSessionManager::CompleteCoalescedGroup(size_t loop_index, const std::string& key, CurlHttpRequest* leader,
+	const std::shared_ptr<std::string>& content, bool succeed, int response_code)
+{
+	auto& inflight = loops_[loop_index]->inflight;
+	auto it = inflight.find(key);
+	if (it == inflight.end() || it->second.leader_id != leader->GetRequestID())
+		return;
+	std::vector<std::shared_ptr<CurlHttpRequest>> followers;
+	followers.swap(it->second.followers);
+	inflight.erase(it);
+	for (auto& follower : followers)
+		follower->CompleteWithResponseOf(leader, content, succeed, response_code);
+}
+
+void URLSessionManager::RemoveCoalescedRequest(size_t loop_index, const std::shared_ptr<CurlHttpRequest>& request)
+{
+	auto& inflight = loops_[loop_index]->inflight;
+	for (auto it = inflight.begin(); it != inflight.end(); ++it) {
+		auto& followers = it->second.followers;
+		if (it->second.leader_id != request->GetRequestID()) {
+			auto follower = std::find(followers.begin(), followers.end(), request);
+			if (follower == followers.end())
+				continue;
+			followers.erase(follower);
+			return;
+		}
+		if (followers.empty()) {
+			inflight.erase(it);
+			return;
+		}
+		std::shared_ptr<CurlHttpRequest> next = followers.front();
+		followers.erase(followers.begin());
+		it->second.leader_id = next->GetRequestID();
+		StartCoalescedLeader(loop_index, it->first, next);
+		return;
 	}
 }
 
+void URLSessionManager::DoTrimCache(MemoryTrimLevel level)
+{
+	if (cache_ != nullptr)
+		cache_->TrimMemory(level);
+}
+void URLSessionManager::DoEnableCache(const HttpCacheConfig& config)
+{
+	cache_.reset();
+	if (config.directory.empty())
+		return;
+	auto cache = std::make_shared<HttpCache>();
+	if (logger_ != nullptr)
+		cache->SetLogger(logger_);
+	if (cache->Open(config))
+		cache_ = cache;
+}
+
+void URLSessionManager::DoEnableOutbox(const HttpOutboxConfig& config)
+{
+	outbox_.reset();
+	if (config.db_path.empty())
+		return;
+	auto& message_loop_current = loops_.front()->message_loop_current;
+	if (!message_loop_current)
+		return;
+	auto outbox = std::make_shared<HttpOutbox>(message_loop_current->GetUVMessageLoopTaskRunner(),
+		[this](std::shared_ptr<CurlHttpRequest>& request) { PostRequest(request); },
+		[this]() { return network_alive_.load(); });
+	if (logger_ != nullptr)
+		outbox->SetLogger(logger_);
+	if (!outbox->Open(config))
+		return;
+	outbox_ = outbox;
+	// The requests stored by the last run
+	DoReplayOutbox();
+}
+
+void URLSessionManager::DoReplayOutbox()
+{
+	if (outbox_ != nullptr && network_alive_)
+		outbox_->Replay();
+}
+
 void URLSessionManager::DoRemoveRequest(HttpRequestID request_id)
 {
 	auto request = GetRequestByID(request_id);
 	if (!request)
 		return;
-	if (manager_)
+	size_t loop_index = 0;
+	if (FindRequestLoop(request_id, loop_index) && loops_[loop_index]->manager)
 	{
-		manager_->RemoveSession(request.get());
+		loops_[loop_index]->manager->RemoveSession(request.get());
+		RemoveCoalescedRequest(loop_index, request);
 	}
+	if (loop_index == 0 && outbox_ != nullptr)
+		outbox_->Remove(request_id);
 
 	RemoveSession(request);
 }
@@ -119,17 +501,19 @@ std::weak_ptr<CurlHttpRequest> URLSessionManager::internalGetRequestByID(HttpReq
 	auto it = request_list_.find(request_id);
 	if (it != request_list_.end())
 	{
-		if (!it->second.expired())
-			ret = it->second;
+		if (!it->second.request.expired())
+			ret = it->second.request;
 		else
 			request_list_.erase(it);
 	}
 	return ret;
 }
-HttpRequestID URLSessionManager::AddSession(std::shared_ptr<CurlHttpRequest>& request)
+HttpRequestID URLSessionManager::AddSession(std::shared_ptr<CurlHttpRequest>& request, size_t loop_index)
 {
 	base::AutoLock autolock(lock_);
-	request_list_[request->GetRequestID()] = request;
+	RequestEntry& entry = request_list_[request->GetRequestID()];
+	entry.request = request;
+	entry.loop_index = loop_index;
 	request->attach_release(ToWeakCallback(std::bind(&URLSessionManager::OnRequestDestruct, this,std::placeholders::_1)));
 	return request->GetRequestID();
 }
@@ -142,11 +526,9 @@ HttpRequestID URLSessionManager::RemoveSession(CurlHttpRequest* request)
 {
 	HttpRequestID ret = CurlHttpRequest::kINVALID_SESSIONID;
 	base::AutoLock autolock(lock_);
-	auto it = std::find_if(request_list_.begin(), request_list_.end(), [&](const RequestPair& item) {
-		auto s = item.second.lock();
-		return s !=nullptr && s.get() == request;
-	});
-	if (it != request_list_.end())
+	// Called from the request's destructor too, when the weak entry has already expired
+	auto it = request_list_.find(request->GetSessioinID());
+	if (it != request_list_.end() && (it->second.request.expired() || it->second.request.lock().get() == request))
 	{
 		ret = it->first;
 		request_list_.erase(it);
@@ -4,6 +4,11 @@
 #include "nim_http/http_export.h"
 #include "nim_http/config/build_config.h"
 
+#include <atomic>
+#include <map>
+#include <vector>
+#include "extension/containers/flat_hash_map.h"
+#include "extension/memory/memory_trimmer.h"
 #include "extension/thread/framework_thread.h"
 
 #include "nim_http/http/url_session.h"
@@ -12,36 +17,114 @@
 HTTP_BEGIN_DECLS
 
 class CurlNetworkSessionManager;
+class HttpCache;
+class HttpOutbox;
 class MessageLoopCurrentForUV;
+// Runs the requests on |loop_count| transfer threads, each with its own uv
+// loop and curl multi handle. A request goes to the loop of the hash of its
+// host, so the connections to a host are reused by one loop. The cacheable
+// requests go to the first loop which owns the response cache, so do the
+// deferrable ones while the network is down, the outbox is there too.
 class URLSessionManager : public virtual NS_NIMLOG::LoggerSetter, public IURLSessionManager, NS_EXTENSION::SupportWeakCallback
 {
 public:
-	URLSessionManager();
+	explicit URLSessionManager(size_t loop_count = 1);
 	virtual ~URLSessionManager();
 
 	virtual bool Init() override ;
 	virtual HttpRequestID PostRequest(std::shared_ptr<CurlHttpRequest>& request)override ;
 	virtual void RemoveRequest(HttpRequestID request_id)override ;
 	virtual std::shared_ptr<CurlHttpRequest> GetRequestByID(HttpRequestID request_id)override ;
+	virtual void SetConcurrency(const HttpConcurrency& concurrency) override;
+	virtual void SetBandwidthLimit(const HttpBandwidthLimit& limit) override;
+	virtual void SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority) override;
+	virtual void SetResolvedHost(const std::string& host, int port,
+		const std::list<std::string>& ip_list, int ttl_seconds) override;
+	virtual void EnableCache(const HttpCacheConfig& config) override;
+	virtual void EnableOutbox(const HttpOutboxConfig& config) override;
+	virtual void SetNetworkAlive(bool alive) override;
+	virtual void ResetConnections() override;
+	virtual void EnableNetworkQualityTuning(bool enable) override;
+	virtual void EnableRequestCoalescing(bool enable) override;
+	virtual void EnableHttp3(bool enable) override;
 protected:
 	virtual void OnSetLogger() override;
 private:
-	void DoPostRequest(std::shared_ptr<CurlHttpRequest>& request);
+	// The identical requests waiting for the one transferring, the leader is
+	// kept by its ID, it is owned by the session manager
+	struct CoalescedGroup
+	{
+		HttpRequestID leader_id;
+		std::vector<std::shared_ptr<CurlHttpRequest>> followers;
+	};
+	// A transfer thread running its uv loop
+	struct TransferLoop
+	{
+		std::shared_ptr<NS_EXTENSION::FrameworkThread> trans_thread;
+		std::shared_ptr<MessageLoopCurrentForUV> message_loop_current;
+		std::unique_ptr<CurlNetworkSessionManager> manager;
+		// By CurlHttpRequest::InflightKey(), used on the loop only
+		std::map<std::string, CoalescedGroup> inflight;
+	};
+	struct RequestEntry
+	{
+		std::weak_ptr<CurlHttpRequest> request;
+		size_t loop_index;
+	};
+
+	void DoPostRequest(size_t loop_index, std::shared_ptr<CurlHttpRequest>& request);
+	// Merges |request| into the group of |key| if one is in flight, otherwise
+	// starts it as the leader of a new group
+	void CoalesceRequest(size_t loop_index, const std::string& key, std::shared_ptr<CurlHttpRequest>& request);
+	void StartCoalescedLeader(size_t loop_index, const std::string& key, std::shared_ptr<CurlHttpRequest>& request);
+	void CompleteCoalescedGroup(size_t loop_index, const std::string& key, CurlHttpRequest* leader,
+		const std::shared_ptr<std::string>& content, bool succeed, int response_code);
+	// A removed leader hands the transfer to its first follower
+	void RemoveCoalescedRequest(size_t loop_index, const std::shared_ptr<CurlHttpRequest>& request);
+	void DoEnableCache(const HttpCacheConfig& config);
+	void DoEnableOutbox(const HttpOutboxConfig& config);
+	void DoReplayOutbox();
+	// Registered to MemoryTrimmer by Init(), the cache is trimmed on its loop
+	void TrimMemory(NS_EXTENSION::MemoryTrimLevel level);
+	void DoTrimCache(NS_EXTENSION::MemoryTrimLevel level);
 	void DoRemoveRequest(HttpRequestID request_id);
+	size_t LoopIndexOf(const std::shared_ptr<CurlHttpRequest>& request) const;
+	bool FindRequestLoop(HttpRequestID request_id, size_t& loop_index);
+	// The limits of the manager are split by the loops
+	HttpConcurrency LoopConcurrency() const;
+	HttpBandwidthLimit LoopBandwidthLimit() const;
 	std::weak_ptr<CurlHttpRequest> internalGetRequestByID(HttpRequestID request_id);
-	HttpRequestID AddSession(std::shared_ptr<CurlHttpRequest>& request);
+	HttpRequestID AddSession(std::shared_ptr<CurlHttpRequest>& request, size_t loop_index);
 	HttpRequestID RemoveSession(std::shared_ptr<CurlHttpRequest>&  request);
 	HttpRequestID RemoveSession(CurlHttpRequest* request);
 	void OnRequestDestruct(CurlHttpRequest* request);
 	bool PreCreateThreads();
 	void DestroyThreads();
-	std::unique_ptr<CurlNetworkSessionManager> manager_;
+	std::vector<std::unique_ptr<TransferLoop>> loops_;
 	base::Lock lock_;
-	std::shared_ptr<MessageLoopCurrentForUV> message_loop_current_;
-	std::shared_ptr<NS_EXTENSION::FrameworkThread> trans_thread_;
-	using RequestPair = std::pair<HttpRequestID, std::weak_ptr<CurlHttpRequest>>;
-	using RequestMap = std::map<HttpRequestID, std::weak_ptr<CurlHttpRequest>>;
+	// The requests of all the loops, looked up by id on every add, cancel and completion
+	using RequestMap = NS_EXTENSION::FlatHashMap<HttpRequestID, RequestEntry>;
+	using RequestPair = RequestMap::value_type;
 	RequestMap request_list_;
+	HttpConcurrency concurrency_;
+	HttpBandwidthLimit bandwidth_limit_;
+	// Set by EnableCache(), the cache itself is used on the first loop only
+	std::atomic<bool> cache_enabled_;
+	std::shared_ptr<HttpCache> cache_;
+	// Set by EnableOutbox(), the outbox is used on the first loop only
+	std::atomic<bool> outbox_enabled_;
+	std::atomic<bool> network_alive_;
+	// Set by EnableNetworkQualityTuning(), applied to the loops started later too
+	std::atomic<bool> network_quality_tuning_;
+	// Set by EnableRequestCoalescing()
+	std::atomic<bool> request_coalescing_;
+	// Set by EnableHttp3(), applied to the loops started later too
+	std::atomic<bool> http3_;
+	std::shared_ptr<HttpOutbox> outbox_;
+	int memory_trim_id_;
+	// Registered to MemoryAccounting by Init(), the requests posted and not
+	// released yet, without their bodies
+	int memory_account_id_;
 };
 
 HTTP_END_DECLS
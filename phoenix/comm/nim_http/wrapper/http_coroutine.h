@@ -0,0 +1,94 @@
+#ifndef NETWORK_HTTP_WRAPPER_HTTP_COROUTINE_H_
+#define NETWORK_HTTP_WRAPPER_HTTP_COROUTINE_H_
+#include "nim_http/config/build_config.h"
+#include "extension/thread/coroutine.h"
+
+#if defined(EXTENSION_HAS_COROUTINE)
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "extension/callback/post_task.h"
+#include "nim_http/wrapper/nim_http.h"
+
+HTTP_BEGIN_DECLS
+
+// What a ResponseCallback receives, handed out by co_await
+struct HttpResult
+{
+	bool succeed = false;
+	int response_code = 0;
+	std::shared_ptr<std::string> content;
+};
+
+// Creates the request to await with the callback it must be given, so that
+// the headers and options can be set as usual before it is posted
+using HttpRequestFactory = std::function<HttpRequest(const ResponseCallback&)>;
+
+// co_await on it posts the request to |manager| and resumes the coroutine with
+// the HttpResult on the thread that awaited, or on the http thread when the
+// awaiting thread has no message loop. A request that never completes (the
+// manager is destroyed first) leaves the coroutine suspended.
+//
+//	NS_EXTENSION::Async Refresh(HttpManager manager)
+//	{
+//		HttpResult result = co_await Fetch(manager, "https://example.com/list");
+//		if (result.succeed)
+//			Apply(*result.content);
+//	}
+class HttpAwaiter
+{
+public:
+	HttpAwaiter(HttpManager manager, HttpRequestFactory factory) :
+		manager_(std::move(manager)), factory_(std::move(factory)) {}
+
+	bool await_ready() const { return false; }
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		scoped_refptr<base::SingleThreadTaskRunner> reply_runner;
+		if (base::ThreadTaskRunnerHandle::IsSet())
+			reply_runner = base::ThreadTaskRunnerHandle::Get();
+		HttpAwaiter* self = this;
+		HttpRequest request = factory_([self, handle, reply_runner](const std::shared_ptr<std::string>& content,
+			bool succeed, int response_code) {
+			self->result_.succeed = succeed;
+			self->result_.response_code = response_code;
+			self->result_.content = content;
+			if (!reply_runner || reply_runner->RunsTasksOnCurrentThread())
+				handle.resume();
+			else
+				NS_EXTENSION::PostTask(reply_runner.get(), FROM_HERE, NS_EXTENSION::internal::ResumeTask(handle));
+		});
+		if (!request || !manager_)
+			return false;
+		// The coroutine may be resumed and |this| destroyed before PostRequest returns
+		HttpManager manager = manager_;
+		manager->PostRequest(request);
+		return true;
+	}
+	HttpResult await_resume() { return std::move(result_); }
+
+private:
+	HttpManager manager_;
+	HttpRequestFactory factory_;
+	HttpResult result_;
+};
+
+inline HttpAwaiter AwaitRequest(HttpManager manager, HttpRequestFactory factory)
+{
+	return HttpAwaiter(std::move(manager), std::move(factory));
+}
+
+// A plain GET of |url|
+inline HttpAwaiter Fetch(HttpManager manager, const std::string& url)
+{
+	return HttpAwaiter(std::move(manager), [url](const ResponseCallback& response_cb) {
+		return NIMHttp::CreateRequest(url, response_cb);
+	});
+}
+
+HTTP_END_DECLS
+
+#endif // EXTENSION_HAS_COROUTINE
+
+#endif // NETWORK_HTTP_WRAPPER_HTTP_COROUTINE_H_
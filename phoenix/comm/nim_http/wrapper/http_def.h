@@ -1,11 +1,21 @@
 #ifndef NETWORK_HTTP_WRAPPER_HTTP_DEF_H_
 #define NETWORK_HTTP_WRAPPER_HTTP_DEF_H_
 #include "nim_http/config/build_config.h"
+#include "extension/config/build_config.h"
 #include <functional>
 #include <memory>
 #include <list>
+#include <string>
+#include <utility>
+#include <vector>
 #include "proxy_config/proxy_config/proxy_info.h"
 #include "nim_log/wrapper/log.h"
+#include "nim_encrypt/wrapper/nim_encrypt_interface.h"
+
+EXTENSION_BEGIN_DECLS
+class ChainedBuffer;
+class CancellationToken;
+EXTENSION_END_DECLS
 
 HTTP_BEGIN_DECLS
 
@@ -36,6 +46,40 @@ using SpeedCallback = std::function<void(double, double)>;
 // * Total bytes actual to download
 // * Average download speed(Bps)
 using TransferCallback = std::function<void(double, double, double, double)>;
+
+// Receives the response body chunk by chunk, on the transfer thread and
+// before the chunk is released, so it should not block. Return false to
+// abort the request.
+using DataCallback = std::function<bool(const char*, size_t)>;
+
+// Fills the buffer with at most the given bytes of an upload body, on the
+// transfer thread. Returns the bytes filled, 0 at the end of the body or a
+// negative value to abort the request.
+using UploadReadCallback = std::function<long long(char*, size_t)>;
+
+// Where the time of a request went, from CURLINFO_*_TIME. The phases are in
+// milliseconds since the transfer started and cumulative, e.g. the TLS
+// handshake takes appconnect_ms - connect_ms. They are 0 for a reused
+// connection, or if the request failed before the phase.
+struct HttpRequestTiming
+{
+	HttpRequestTiming() :
+		namelookup_ms(0), connect_ms(0), appconnect_ms(0), pretransfer_ms(0), starttransfer_ms(0),
+		total_ms(0), redirect_count(0), connection_reused(false), response_code(0) {}
+	double namelookup_ms;
+	double connect_ms;
+	double appconnect_ms;
+	// The request is about to be sent
+	double pretransfer_ms;
+	// The first byte of the response is received
+	double starttransfer_ms;
+	double total_ms;
+	long redirect_count;
+	bool connection_reused;
+	long response_code;
+};
+// Invoked before the completion callback with the timing of the request
+using TimingCallback = std::function<void(const HttpRequestTiming&)>;
 enum HttpMultipartFormType
 {
 	FormType_Internal_Begin = 0,
@@ -52,10 +96,40 @@ enum IPRESOLVE
 	IPRESOLVE_V6 = 2, /* resolve to IPv6 addresses */
 };
 
+enum HTTP_PROTOCOL_VERSION
+{
+	HTTP_PROTOCOL_DEFAULT = 0,/* HTTP/2 over TLS if curl supports it, otherwise HTTP/1.1 */
+	HTTP_PROTOCOL_1_0 = 1,
+	HTTP_PROTOCOL_1_1 = 2,
+	HTTP_PROTOCOL_2 = 3, /* HTTP/2 for plain HTTP too, falls back to HTTP/1.1 */
+	HTTP_PROTOCOL_3 = 4, /* HTTP/3 over QUIC for HTTPS if curl supports it, falls back to HTTP/2 or HTTP/1.1 over TCP */
+};
+
+// Pending requests are started in the order of their priorities, a request
+// waiting too long is promoted to the next priority, so the background ones
+// are not starved.
+enum HTTP_PRIORITY
+{
+	PRIORITY_BACKGROUND = 0,/* bulk transfers, e.g. large file downloads */
+	PRIORITY_LOW = 1,
+	PRIORITY_NORMAL = 2, /* default */
+	PRIORITY_HIGH = 3, /* user initiated, e.g. avatar fetches */
+	PRIORITY_COUNT
+};
+
+// Hash of a downloaded file computed while it is written
+enum HTTP_DIGEST
+{
+	DIGEST_NONE = 0,
+	DIGEST_MD5 = 1,
+	DIGEST_SHA256 = 2,
+};
+
 enum METHODS
 {
 	GET,
-	POST
+	POST,
+	HEAD
 };
 
 class IHttpMultipartForm
@@ -83,6 +157,72 @@ public:
 };
 
 
+// Retries of a failed request, see IHttpRequest::SetRetryPolicy.
+// * max_retries: 0 disables retrying
+// * initial_backoff_ms, backoff_multiplier, max_backoff_ms: the n-th retry
+//   waits min(initial_backoff_ms * backoff_multiplier^(n-1), max_backoff_ms)
+// * jitter: the wait is randomized by up to +-jitter of itself, in [0, 1]
+// * retry_non_idempotent: POST is retried too, only if the server tolerates
+//   the same request twice
+// Connection failures, timeouts, 408, 429, 502, 503 and 504 are retried, the
+// Retry-After of a response is honored up to max_backoff_ms.
+struct HttpRetryPolicy
+{
+	HttpRetryPolicy() :
+		max_retries(0), initial_backoff_ms(200), max_backoff_ms(10000),
+		backoff_multiplier(2.0), jitter(0.2), retry_non_idempotent(false) {}
+	explicit HttpRetryPolicy(int retries) :
+		max_retries(retries), initial_backoff_ms(200), max_backoff_ms(10000),
+		backoff_multiplier(2.0), jitter(0.2), retry_non_idempotent(false) {}
+	int max_retries;
+	int initial_backoff_ms;
+	int max_backoff_ms;
+	double backoff_multiplier;
+	double jitter;
+	bool retry_non_idempotent;
+};
+
+// Hedging of a slow GET content request, see IHttpRequest::SetHedgePolicy.
+// * delay_ms: a duplicate is started if the request is still running after
+//   it, 0 means the p95 latency of the recent requests of the manager
+// * alternate_address: the duplicate connects to it instead of the resolved
+//   address, e.g. another address from NimNetUtil::GetIPByName. An empty one
+//   makes the duplicate open a new connection to the same host.
+// The first response wins and the other transfer is canceled.
+struct HttpHedgePolicy
+{
+	HttpHedgePolicy() : enabled(false), delay_ms(0) {}
+	HttpHedgePolicy(const std::string& address, int delay = 0) :
+		enabled(true), delay_ms(delay), alternate_address(address) {}
+	bool enabled;
+	int delay_ms;
+	std::string alternate_address;
+};
+
+// HTTPDNS or DNS-over-HTTPS (JSON) lookups, see NIMHttp::CreateHttpDnsClient.
+// * url: "{host}" in it is replaced by the queried host name, e.g.
+//   "https://203.0.113.1/d?host={host}" or "https://dns.google/resolve?name={host}&type=A".
+//   Better an IP address endpoint, a host name is resolved by the system DNS.
+//   The response is either JSON of {"ips": [...], "ttl": n}, JSON of DoH
+//   {"Answer": [{"type": 1, "data": "...", "TTL": n}, ...]}, or the text "ip;ip,ttl".
+// * db_path: the nim_db database the results are persisted to, they are
+//   reported by IHttpDnsClient::Load() on the next launch. Empty to disable.
+// * default_ttl_seconds: used if the response carries no TTL
+// * max_persisted_age_seconds: older persisted results are not loaded
+struct HttpDnsConfig
+{
+	HttpDnsConfig() : timeout_ms(3000), default_ttl_seconds(300), max_persisted_age_seconds(7 * 24 * 3600) {}
+	std::string url;
+	std::string db_path;
+	long timeout_ms;
+	int default_ttl_seconds;
+	int max_persisted_age_seconds;
+};
+// |ip_list| is empty if it fails
+using HttpDnsCallback = std::function<void(bool succeed, const std::list<std::string>& ip_list, int ttl_seconds)>;
+// |ttl_seconds| is what is left of the TTL, negative if it has expired
+using HttpDnsLoadCallback = std::function<void(const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds)>;
+
 using HttpRequestID = uint32_t;
 class IHttpRequest
 {
@@ -96,12 +236,25 @@ public:
 	virtual void AddHeaderField(const std::string &name, const std::string &value) = 0;
 	virtual void ClearHeaderFields() = 0;
 	virtual bool SetPostFields(const void *data, size_t size) = 0;
+	// The body is read from the file or |read_cb| while uploading instead of
+	// being copied to memory. A body of unknown |size| (negative) is sent with
+	// chunked transfer encoding.
+	virtual bool SetPostFile(const std::string& file_path) = 0;
+	virtual bool SetPostStream(const UploadReadCallback& read_cb, long long size = -1) = 0;
+	// The segments of |body| are shared rather than copied and uploaded in
+	// place, so |body| may be changed or released after the call.
+	virtual bool SetPostChain(const NS_EXTENSION::ChainedBuffer& body) = 0;
 	virtual bool AddForm(const std::string& name, const std::string& value, const std::string& content_type = "") = 0;
 	virtual bool AddFormWithBuffer(const std::string& name, const void *buffer, size_t buffer_length, const std::string& content_type = "") = 0;
 	virtual bool AddFormWithFilePath(const std::string& name, const std::string& file_path, const std::string& content_type = "") = 0;
+	virtual bool AddFormWithStream(const std::string& name, const std::string& file_name, const UploadReadCallback& read_cb,
+		long long size, const std::string& content_type = "") = 0;
 	virtual void ClearForms() = 0;
 	virtual void GetResponseHead(std::list<std::string> &head) const = 0;
 	virtual std::string GetResponseHead() const = 0;
+	// Finds the value of the last |name| header, case-insensitive, without
+	// joining the whole head
+	virtual bool GetResponseHeader(const std::string& name, std::string& value) const = 0;
 	virtual bool SetCookie(const std::string &cookie) = 0;
 	virtual bool GetCookieList(std::list<std::string> &cookies) = 0;
 	virtual bool SetCookieList(const std::list<std::string> &cookies) = 0;
@@ -111,21 +264,717 @@ public:
 	virtual void SetProxy(const NS_NET::ProxyInfo &proxy) = 0;
 	virtual void SetProxy(NS_NET::ProxyInfo&& proxy) = 0;
 	virtual void SetTimeout(long timeout_ms) = 0;
+	// The posted request is removed from the manager as by
+	// IHttpManager::RemoveRequest() when |token| is cancelled, the callbacks
+	// are not invoked. A request posted with a cancelled token is removed at
+	// once.
+	// The transfer timeout of each attempt is cut to what is left before the
+	// deadline of the token, the request then fails with
+	// CURLE_OPERATION_TIMEDOUT.
+	virtual void SetCancellationToken(const NS_EXTENSION::CancellationToken& token) = 0;
 	virtual void SetLowSpeed(long low_speed_limit, long low_speed_time) = 0;
 	virtual void SetIPResolve(IPRESOLVE ipresolve) = 0;
+	virtual void SetHttpVersion(HTTP_PROTOCOL_VERSION version) = 0;
+	// Takes effect when the request is posted, use
+	// IHttpManager::SetRequestPriority() for a posted request
+	virtual void SetPriority(HTTP_PRIORITY priority) = 0;
+	virtual HTTP_PRIORITY GetPriority() const = 0;
+	// The body is passed to |data_cb| instead of being stored, the
+	// ContentCallback then gets an empty content
+	virtual void SetDataCallback(const DataCallback& data_cb) = 0;
+	// The body is appended to |buffer| which is then passed to the
+	// ContentCallback. The buffer is reserved by Content-Length if known.
+	virtual void SetContentBuffer(const std::shared_ptr<std::string>& buffer) = 0;
+	// Offers the encodings curl is built with (gzip, deflate, brotli) and
+	// decodes the response, enabled by default. Disabled for range requests
+	// as the range of an encoded response is not the range of the file.
+	virtual void SetAutoDecompress(bool enable) = 0;
+	// Sends the body set by SetPostFields() gzipped with
+	// "Content-Encoding: gzip" if it gets smaller, the server must accept it.
+	// Forms and streamed bodies are sent as they are.
+	virtual void SetCompressPostFields(bool enable) = 0;
+	// The request is posted again by the manager after a backoff instead of
+	// failing, the callbacks are invoked once with the last result. A request
+	// whose data callback has got any content is not retried.
+	virtual void SetRetryPolicy(const HttpRetryPolicy& policy) = 0;
+	virtual void SetHedgePolicy(const HttpHedgePolicy& policy) = 0;
+	// The timing is also recorded to the "Http.*" histograms of the host, see
+	// HttpMetrics. Not invoked for a request completed by the response cache.
+	virtual void SetTimingCallback(const TimingCallback& timing_cb) = 0;
+	// The progress callback is invoked at most once per |interval_ms|, 100 by
+	// default, with the latest progress. The last progress is always delivered
+	// before the completion callback. 0 delivers every change.
+	virtual void SetProgressInterval(int interval_ms) = 0;
+	// A deferrable request posted while the network is down is kept in the
+	// outbox of the manager and sent when the network is back, see
+	// IHttpManager::EnableOutbox. The deferred requests with the same
+	// |coalesce_key| are merged, the newest one is sent. An empty key is made
+	// of the method, the URL and the body.
+	// Forms, streamed bodies, downloads and data callbacks are not deferred.
+	virtual void SetDeferrable(bool deferrable, const std::string& coalesce_key = "") = 0;
+	// Hashes a file download while it is written, a resumed one hashes the
+	// part kept from before first. If |expected_hex| is not empty a download
+	// of another digest fails with CURLE_WRITE_ERROR. Content requests are
+	// not hashed.
+	virtual void SetContentDigest(HTTP_DIGEST type, const std::string& expected_hex = "") = 0;
+	// The lower case hex digest of the completed download, empty before
+	virtual std::string GetContentDigest() const = 0;
 };
 using HttpRequest = std::shared_ptr<IHttpRequest>;
+
+// Options prepared once for many requests, e.g. the frequent API calls to a
+// server, see NIMHttp::CreateRequestTemplate. The requests share the header
+// list and the options of the template instead of building their own, a
+// change affects the requests created after it. Thread safe.
+class IHttpRequestTemplate
+{
+public:
+	// Sent before the headers added to a request
+	virtual void AddHeaderField(const std::string& name, const std::string& value) = 0;
+	virtual void ClearHeaderFields() = 0;
+	virtual void SetUserAgent(const std::string& user_agent) = 0;
+	// Used by the requests without a proxy of their own
+	virtual void SetProxy(const NS_NET::ProxyInfo& proxy) = 0;
+	// Verifies the certificate of HTTPS servers, by |ca_file| if it is not
+	// empty or by the CA bundle curl is built with. Not verified by default.
+	virtual void SetVerifyPeer(bool verify, const std::string& ca_file = "") = 0;
+	virtual void SetTimeout(long timeout_ms) = 0;
+	virtual void SetLowSpeed(long low_speed_limit, long low_speed_time) = 0;
+	virtual void SetIPResolve(IPRESOLVE ipresolve) = 0;
+	virtual void SetPriority(HTTP_PRIORITY priority) = 0;
+
+	virtual HttpRequest CreateRequest(const std::string& url, const ResponseCallback& response_cb) = 0;
+	virtual HttpRequest CreateDownloadRequest(const std::string& url, const std::string& download_file_path,
+		const CompletedCallback& complete_cb) = 0;
+};
+using HttpRequestTemplate = std::shared_ptr<IHttpRequestTemplate>;
+
+// Limits of the simultaneous transfers of a manager, 0 means unlimited.
+// * max_total_connections: connections opened to all hosts (CURLMOPT_MAX_TOTAL_CONNECTIONS)
+// * max_host_connections: connections opened to a single host (CURLMOPT_MAX_HOST_CONNECTIONS)
+// * max_running_sessions: requests handed to curl at the same time, the
+//   remaining wait in the priority queue of the manager
+// Requests over the connection limits are queued by curl itself.
+struct HttpConcurrency
+{
+	HttpConcurrency() :
+		max_total_connections(256), max_host_connections(16), max_running_sessions(32) {}
+	HttpConcurrency(long total_connections, long host_connections, size_t running_sessions = 0) :
+		max_total_connections(total_connections), max_host_connections(host_connections),
+		max_running_sessions(running_sessions) {}
+	long max_total_connections;
+	long max_host_connections;
+	size_t max_running_sessions;
+};
+
+// Bandwidth caps of a manager in bytes per second, 0 means unlimited, see
+// IHttpManager::SetBandwidthLimit.
+// * max_download_rate, max_upload_rate: all the transfers
+// * priority_download_rate, priority_upload_rate: the transfers of a priority
+// * background_yield_rate: while a transfer of PRIORITY_NORMAL or higher is
+//   running, the PRIORITY_BACKGROUND and PRIORITY_LOW ones share at most this
+//   rate in each direction, 0 pauses them. A negative one disables it.
+// * background_budget: bytes the PRIORITY_BACKGROUND and PRIORITY_LOW
+//   transfers may still move in both directions, they are paused once it is
+//   used up. A negative one disables it. Set by the manager from
+//   NS_EXTENSION::PowerPolicy::http_background_budget while the app is in
+//   background, and lifted in foreground.
+// The low speed limit of a throttled request should be below its caps.
+struct HttpBandwidthLimit
+{
+	HttpBandwidthLimit() : max_download_rate(0), max_upload_rate(0), background_yield_rate(-1), background_budget(-1)
+	{
+		for (int i = 0; i < PRIORITY_COUNT; i++)
+			priority_download_rate[i] = priority_upload_rate[i] = 0;
+	}
+	long long max_download_rate;
+	long long max_upload_rate;
+	long long priority_download_rate[PRIORITY_COUNT];
+	long long priority_upload_rate[PRIORITY_COUNT];
+	long long background_yield_rate;
+	long long background_budget;
+};
+
+// The response cache of GET content requests, see IHttpManager::EnableCache.
+// * directory: where the index database and the response bodies are stored
+// * max_disk_size: bytes of the bodies on disk, the least recently used
+//   responses are evicted over it
+// * max_memory_size: bytes of the bodies also kept in memory
+struct HttpCacheConfig
+{
+	HttpCacheConfig() : max_disk_size(64 * 1024 * 1024), max_memory_size(4 * 1024 * 1024) {}
+	HttpCacheConfig(const std::string& cache_directory, long long disk_size, size_t memory_size) :
+		directory(cache_directory), max_disk_size(disk_size), max_memory_size(memory_size) {}
+	std::string directory;
+	long long max_disk_size;
+	size_t max_memory_size;
+};
+
+// The outbox of the deferrable requests, see IHttpManager::EnableOutbox.
+// * db_path: the nim_db database the requests are stored to
+// * max_requests: the oldest requests are dropped over it
+// * max_age_seconds: a request restored from the last run is dropped after it
+// * replay_batch_size: requests posted at once when the network is back,
+//   the next batch follows shortly after
+struct HttpOutboxConfig
+{
+	HttpOutboxConfig() : max_requests(1000), max_age_seconds(24 * 3600), replay_batch_size(16) {}
+	std::string db_path;
+	size_t max_requests;
+	int max_age_seconds;
+	size_t replay_batch_size;
+};
+
+// Keeps one copy of every file content on disk by its digest, see
+// NIMHttp::CreateContentStore. A file added to the store or made of a stored
+// content is a reference of the content, so the same attachment forwarded
+// to many conversations is downloaded once and takes the disk space of one
+// file: the files are copy-on-write clones of the stored content where the
+// file system supports them, hard links where it does not, copies across
+// volumes. The stored content is deleted with its last reference.
+// The files of the store must not be modified in place, a hard link would
+// change the stored content too; replace them with new files instead.
+// Thread safe.
+struct HttpContentStoreStats
+{
+	HttpContentStoreStats() : content_count(0), stored_bytes(0), file_count(0), file_bytes(0) {}
+	long long content_count;
+	long long stored_bytes;
+	// The files referencing the contents and their bytes, file_bytes -
+	// stored_bytes is what the store saves
+	long long file_count;
+	long long file_bytes;
+};
+class IHttpContentStore
+{
+public:
+	virtual ~IHttpContentStore() {}
+	virtual bool Contains(HTTP_DIGEST type, const std::string& hex) = 0;
+	// Makes |file_path| a file of the stored content, an existing file is
+	// replaced. False if the content is not stored.
+	virtual bool LinkTo(HTTP_DIGEST type, const std::string& hex, const std::string& file_path) = 0;
+	// Adds |file_path| hashed by |type|, e.g. a completed download with its
+	// GetContentDigest(). The file is hashed here if |hex| is empty. If the
+	// content is stored already the file is replaced by a link of it.
+	// Returns the lower case hex digest, empty if failed.
+	virtual std::string AddFile(const std::string& file_path, HTTP_DIGEST type, const std::string& hex = "") = 0;
+	// Drops the reference of |file_path|, e.g. before the attachment is
+	// deleted, the file itself is kept
+	virtual void Release(const std::string& file_path) = 0;
+	// Drops the references of the files deleted without Release(), returns
+	// how many were dropped
+	virtual size_t Prune() = 0;
+	virtual HttpContentStoreStats GetStats() = 0;
+};
+using HttpContentStore = std::shared_ptr<IHttpContentStore>;
+
 class IHttpManager
 {
 public:
 	virtual void SetLogger(const NS_NIMLOG::Logger& logger) = 0;
 	virtual void PostRequest(const HttpRequest& request) = 0;
+	// Used by the requests without a proxy of their own. A proxy of type
+	// NS_NET::kProxySystem is resolved for each request from the system
+	// settings or PAC by NS_NET::NimProxyResolver before the request is posted.
 	virtual void SetProxy(const NS_NET::ProxyInfo& proxy_info ) = 0;
 	virtual void SetProxy(NS_NET::ProxyInfo&& proxy_info) = 0;
+	virtual void SetConcurrency(const HttpConcurrency& concurrency) = 0;
+	// Paces the running transfers by pausing and resuming them, so that
+	// background syncs do not starve the foreground requests
+	virtual void SetBandwidthLimit(const HttpBandwidthLimit& limit) = 0;
+	// Runs the requests on |count| transfer threads, 1 by default, the
+	// requests to a host share a thread. Lets heavy HTTPS transfers use more
+	// than one core. The total limits of SetConcurrency() and
+	// SetBandwidthLimit() are split by the threads.
+	// Takes effect only if called before the first request is posted.
+	virtual void SetTransferThreads(size_t count) = 0;
 	virtual void RemoveRequest(const HttpRequest& request) = 0;
 	virtual void RemoveRequest(HttpRequestID request_id) = 0;
+	// Re-prioritize a pending or running request, a running HTTP/2 stream
+	// gets the weight of the new priority
+	virtual void SetRequestPriority(HttpRequestID request_id, HTTP_PRIORITY priority) = 0;
+	// Seeds the DNS cache shared by the requests, e.g. with the result of
+	// NimNetUtil::GetIPByName. The address used is the first of |ip_list|
+	// ordered by NS_EXTENSION::AddressSelector, the historically fastest one
+	// not failed recently.
+	// The entry expires after |ttl_seconds|, an empty |ip_list| removes it.
+	virtual void SetResolvedHost(const std::string& host, int port,
+		const std::list<std::string>& ip_list, int ttl_seconds) = 0;
+	// Caches the responses of GET content requests by Cache-Control and
+	// Expires. A fresh response completes the request without transferring,
+	// a stale one is revalidated by If-None-Match/If-Modified-Since and a 304
+	// is completed with the cached body as a 200.
+	// Requests with a data callback or a range are not cached.
+	// An empty |config.directory| disables the cache.
+	virtual void EnableCache(const HttpCacheConfig& config) = 0;
+	// Keeps the deferrable requests posted while the network is down in
+	// |config.db_path| and replays them when it is back. A request deferred
+	// by this run keeps its callbacks, the ones restored from the last run
+	// are sent without any. An empty |config.db_path| disables the outbox.
+	virtual void EnableOutbox(const HttpOutboxConfig& config) = 0;
+	// File downloads write through |store|: a download whose expected
+	// digest is set by SetContentDigest() and stored completes with a 200 by
+	// a link of the stored content without transferring, a completed one
+	// with a digest is added to the store. So do the chunked uploads of the
+	// manager, see HttpChunkedUploadConfig. Null disables it.
+	virtual void SetContentStore(const HttpContentStore& store) = 0;
+	virtual HttpContentStore GetContentStore() const = 0;
+	// Tells the state of the network, e.g. by NimNetUtil::IsNetworkAlive() in
+	// the callback of NimNetUtil::AttachConnectionTypeChanged(). Alive until
+	// told otherwise.
+	virtual void SetNetworkAlive(bool alive) = 0;
+	// Drops the pooled connections, the DNS cache and the TLS sessions after
+	// the network changed, e.g. in the kNetworkTransitionFlushCaches stage of
+	// NimNetworkTransition. The running requests which have got no response
+	// yet start over on the new network instead of waiting for their
+	// timeouts, a POST one only if its HttpRetryPolicy retries
+	// non-idempotent requests. The addresses set by
+	// SetResolvedHost() are dropped too.
+	virtual void ResetConnections() = 0;
+	// Tunes the requests by the effective connection type estimated by
+	// NS_EXTENSION::NetworkQualityEstimator: the timeout and the low speed
+	// time of a request get longer on 2G and 3G, the low speed time and the
+	// connect timeout get shorter on a fast network, and the connections per
+	// host are capped on a slow one. Off by default, the estimator is fed by
+	// the requests either way.
+	virtual void EnableNetworkQualityTuning(bool enable) = 0;
+	// Merges the GET content requests posted while an identical one, by the
+	// URL and the headers, is in flight: they are not transferred and get
+	// the response of the first one, which keeps its own timeout and retry
+	// policy. The callbacks share the same content buffer, it must not be
+	// modified, unless a request has its own by SetContentBuffer().
+	// Requests with a data callback, a range or a body are not merged.
+	// Off by default.
+	virtual void EnableRequestCoalescing(bool enable) = 0;
+	// Sends the HTTPS requests of the default version over HTTP/3 (QUIC) to
+	// the origins which advertised it by Alt-Svc, if the linked curl supports
+	// it. A request failing to connect over QUIC starts over on TCP before
+	// any response arrives, and the origin stays on TCP for a while, longer
+	// at each failure, until the network changes. Requests through a proxy
+	// are not upgraded. Off by default, a request set to HTTP_PROTOCOL_3
+	// tries HTTP/3 either way unless it failed for the origin lately.
+	virtual void EnableHttp3(bool enable) = 0;
+	// Resolves the host of |url|, connects and completes the TLS handshake
+	// on |count| connections ahead of the requests, e.g. to the API and CDN
+	// hosts right after login. The connections are kept in the connection
+	// cache of the transfer thread of the host, so the next requests to it
+	// reuse them until they idle out. The proxy of SetProxy() is used.
+	virtual void Preconnect(const std::string& url, size_t count = 1) = 0;
+	// Starts the transfer threads now instead of on the first PostRequest(),
+	// e.g. as a parallel step of NS_EXTENSION::StartupGraph, so that the
+	// first request does not wait for them. Call it after the settings above
+	// which take effect only before the first request.
+	virtual void Prewarm() = 0;
 };
 using HttpManager = std::shared_ptr<IHttpManager>;
 
+// A download split into byte ranges which are fetched concurrently and
+// written to their places in a preallocated file.
+// The progress of every range is recorded in "<file>.seg", so a download
+// failed or canceled is resumed by the next Start().
+class ISegmentedDownload
+{
+public:
+	virtual bool Start() = 0;
+	virtual void Cancel() = 0;
+	virtual bool IsRunning() const = 0;
+};
+using SegmentedDownload = std::shared_ptr<ISegmentedDownload>;
+
+// A part of a chunked upload, |index| counts from 0 and the bytes of the
+// part are [offset, offset + size) of the file of |total_size| bytes
+struct HttpUploadPart
+{
+	HttpUploadPart() : index(0), offset(0), size(0), total_size(0) {}
+	int index;
+	long long offset;
+	long long size;
+	long long total_size;
+};
+// Returns the URL a part is posted to, e.g. with the part number of the
+// server's protocol in the query
+using UploadPartUrlCallback = std::function<std::string(const HttpUploadPart&)>;
+// Called before a part is posted, e.g. to add the headers of the server's protocol
+using UploadPartRequestCallback = std::function<void(const HttpUploadPart&, const HttpRequest&)>;
+// Tells whether the server accepted a part by its response code and body,
+// and sets what has to be kept of it, e.g. the ETag, to |tag|
+using UploadPartResultCallback = std::function<bool(const HttpUploadPart&, int response_code,
+	const std::string& response, std::string& tag)>;
+// |tags| are those of the parts in order, e.g. for the request completing a
+// multipart upload
+using ChunkedUploadCallback = std::function<void(bool succeed, int response_code, const std::vector<std::string>& tags)>;
+
+// A chunked upload, see NIMHttp::CreateChunkedUpload.
+// * upload_id: names the upload in |db_path|, e.g. the id the server gave
+//   to the upload session. The parts sent under it before are not sent again.
+// * db_path: the nim_db database the accepted parts are persisted to
+// * part_size: the bytes of every part but the last one
+// * concurrency: the parts uploaded at the same time
+// * retry_policy: of every part, a part can always be sent again so POST is
+//   retried, as are the parts broken by IHttpManager::ResetConnections()
+// * part_url_cb: the URL of the upload is used for every part if not set
+// * part_result_cb: a 2xx response is accepted with the ETag as the tag if
+//   not set
+// * content_digest: the file is hashed by it while its parts are read and
+//   added to the content store of the manager when the upload succeeds, so
+//   a download of the same content is not transferred, see
+//   IHttpManager::SetContentStore. Set DIGEST_NONE for a file not owned by
+//   the application, it may be replaced by a link of the stored content.
+// Every part is POSTed with "Content-Range: bytes first-last/total".
+struct HttpChunkedUploadConfig
+{
+	HttpChunkedUploadConfig() : part_size(4 * 1024 * 1024), concurrency(3), retry_policy(3), content_digest(DIGEST_SHA256)
+	{
+		retry_policy.retry_non_idempotent = true;
+	}
+	std::string upload_id;
+	std::string db_path;
+	long long part_size;
+	int concurrency;
+	HttpRetryPolicy retry_policy;
+	UploadPartUrlCallback part_url_cb;
+	UploadPartRequestCallback part_request_cb;
+	UploadPartResultCallback part_result_cb;
+	HTTP_DIGEST content_digest;
+};
+
+// A file upload split into parts which are sent concurrently. The accepted
+// parts are persisted, so an upload failed, canceled or interrupted by a
+// restart or a change of the network is resumed by the next Start() with
+// the same upload id. The parts are persisted until the upload succeeds or
+// Reset() is called.
+class IChunkedUpload
+{
+public:
+	virtual bool Start() = 0;
+	virtual void Cancel() = 0;
+	virtual bool IsRunning() const = 0;
+	// Forgets the accepted parts, the next Start() sends the whole file.
+	// Fails while it is running.
+	virtual bool Reset() = 0;
+};
+using ChunkedUpload = std::shared_ptr<IChunkedUpload>;
+
+// The body of an upload produced by a single pass over a file, see
+// NIMHttp::CreateUploadPipeline. Each block of the file is read once, then
+// hashed, compressed, encrypted and hashed again as the body while it is
+// still in the cache, instead of reading the file again for every step.
+// * source_path: the UTF-8 path of the file
+// * block_size: the bytes read at a time, small enough for a block to stay
+//   in the cache through the stages
+// * source_digest: of the file as it is, e.g. the MD5 of CalculateFileMd5
+// * compress_level: 0~9 of the zlib (RFC 1950) stream the file is
+//   compressed to, negative to send it uncompressed
+// * encrypt_key: the body is encrypted by |encrypt_method| of nim_encrypt
+//   if set, which has to be an AEAD method. The body is then nonce +
+//   ciphertext + tag, decrypted by the Decrypt() of the same method and key.
+// * body_digest: of the body as sent, e.g. for the server to check it
+// * pipeline_threads: the file is read on a thread of the pipeline and the
+//   blocks are compressed and encrypted on another one, the transfer thread
+//   only copies the body out. Otherwise every stage runs on the transfer
+//   thread in the read callback.
+// * queue_blocks: the blocks queued between two threads, the memory held
+//   is a few blocks whatever the size of the file
+struct HttpUploadPipelineConfig
+{
+	HttpUploadPipelineConfig() : block_size(256 * 1024), source_digest(DIGEST_MD5), compress_level(-1),
+		encrypt_method(NS_NIMENCRYPT::EncryptMethod::ENC_AES256_GCM), body_digest(DIGEST_NONE),
+		pipeline_threads(false), queue_blocks(4) {}
+	std::string source_path;
+	size_t block_size;
+	HTTP_DIGEST source_digest;
+	int compress_level;
+	NS_NIMENCRYPT::EncryptMethod encrypt_method;
+	std::string encrypt_key;
+	HTTP_DIGEST body_digest;
+	bool pipeline_threads;
+	size_t queue_blocks;
+};
+
+// The body is produced while it is read and can not be rewound, so a
+// request retried or redirected with it fails, create another pipeline for
+// another attempt. The read callback holds the pipeline.
+class IHttpUploadPipeline
+{
+public:
+	// Sets the body of |request| to the pipeline, with its size if known
+	virtual bool AttachTo(const HttpRequest& request) = 0;
+	// The body as a callback, e.g. for IHttpRequest::AddFormWithStream()
+	virtual UploadReadCallback GetReadCallback() = 0;
+	// -1 if compressed, the size is known once the whole body is read
+	virtual long long GetBodySize() const = 0;
+	// The whole body is read and the digests are ready
+	virtual bool IsFinished() const = 0;
+	// Lower case hex, empty before the whole body is read
+	virtual std::string GetSourceDigest() const = 0;
+	virtual std::string GetBodyDigest() const = 0;
+};
+using HttpUploadPipeline = std::shared_ptr<IHttpUploadPipeline>;
+
+// The parameters of a query, in any order, a name may repeat
+using HttpQueryParams = std::vector<std::pair<std::string, std::string>>;
+
+// Signs the API requests by an HMAC of the app secret, see
+// NIMHttp::CreateQuerySigner. The states of the padded secret are computed
+// once, a signature only hashes the message. Thread safe.
+class IHttpQuerySigner
+{
+public:
+	// Sorts |params| by name then value, URL encodes the names and values
+	// and joins them as "name=value&name=value" to |query|, which is
+	// replaced. Returns the lower case hex HMAC of |prefix| followed by
+	// |query|, |prefix| is e.g. the method and the path of the request as
+	// the protocol of the server wants. Empty if failed.
+	virtual std::string SignQuery(const HttpQueryParams& params, std::string& query,
+		const std::string& prefix = "") = 0;
+	// The lower case hex HMAC of |message|
+	virtual std::string Sign(const std::string& message) = 0;
+};
+using HttpQuerySigner = std::shared_ptr<IHttpQuerySigner>;
+
+// The formats of an event stream, see NIMHttp::CreateEventStream.
+// * EVENT_STREAM_SSE: text/event-stream of Server-Sent Events
+// * EVENT_STREAM_NDJSON: newline-delimited JSON, every non-empty line is an
+//   event whose data is the line
+enum HTTP_EVENT_STREAM_FORMAT
+{
+	EVENT_STREAM_SSE = 0,
+	EVENT_STREAM_NDJSON = 1,
+};
+
+enum HTTP_EVENT_STREAM_STATE
+{
+	// The server accepted the connection with a 2xx and sent the first bytes
+	EVENT_STREAM_CONNECTED = 0,
+	// The connection is dropped and will be opened again after a delay
+	EVENT_STREAM_RECONNECTING = 1,
+	// The stream gave up: the server answered 204 or a client error, or the
+	// reconnections failed max_reconnects times in a row. Start() opens it again.
+	EVENT_STREAM_CLOSED = 2,
+};
+
+// An event of an event stream. |id| is the last "id:" field received, so
+// an event without one carries the id of an earlier event. |type| is the
+// "event:" field, empty for "message" and for NDJSON. |data| is the "data:"
+// lines joined by "\n".
+struct HttpStreamEvent
+{
+	std::string id;
+	std::string type;
+	std::string data;
+};
+// The events received in a batch, in order
+using EventStreamCallback = std::function<void(const std::vector<HttpStreamEvent>& events)>;
+// |response_code| is the HTTP status, or the curl error if the connection
+// failed before a response
+using EventStreamStateCallback = std::function<void(HTTP_EVENT_STREAM_STATE state, int response_code)>;
+
+// An event stream, see NIMHttp::CreateEventStream.
+// * last_event_id: sent as Last-Event-ID by the first connection, e.g. the
+//   IHttpEventStream::GetLastEventID() persisted by the last run. The
+//   reconnections send the id of the last event received.
+// * reconnect_delay_ms: the wait before reconnecting, replaced by the
+//   "retry:" field of an SSE stream
+// * max_reconnect_delay_ms: the wait doubles with every connection failed
+//   in a row up to it
+// * max_reconnects: connections failed in a row before the stream is
+//   closed, negative for unlimited
+// * long_poll: a response which ends normally is one poll, the next one
+//   is sent at once instead of after reconnect_delay_ms
+// * idle_timeout_ms: the connection is dropped and opened again if no byte,
+//   e.g. an SSE comment used as a heartbeat, is received for it. 0 disables.
+//   It is the low speed time of the connections, so the network quality
+//   tuning of the manager scales it too, keep it a few heartbeats long.
+// * batch_interval_ms: the events received within it are delivered by one
+//   callback, 0 delivers them as soon as the task runner gets to them
+// * max_event_size: bytes of a line or an event, a larger one drops the
+//   connection
+// * priority: of the connections
+// * request_cb: called before every connection is posted, e.g. to add the
+//   auth headers of the server's protocol
+// The connections have no overall timeout and are neither retried nor
+// cached by the manager, the stream reconnects by itself.
+struct HttpEventStreamConfig
+{
+	HttpEventStreamConfig() :
+		format(EVENT_STREAM_SSE), reconnect_delay_ms(3000), max_reconnect_delay_ms(60000),
+		max_reconnects(-1), long_poll(false), idle_timeout_ms(90000), batch_interval_ms(50),
+		max_event_size(1024 * 1024), priority(PRIORITY_NORMAL) {}
+	HTTP_EVENT_STREAM_FORMAT format;
+	std::string last_event_id;
+	int reconnect_delay_ms;
+	int max_reconnect_delay_ms;
+	int max_reconnects;
+	bool long_poll;
+	long idle_timeout_ms;
+	int batch_interval_ms;
+	size_t max_event_size;
+	HTTP_PRIORITY priority;
+	std::function<void(const HttpRequest&)> request_cb;
+};
+
+// A long-lived request whose response is parsed into events while it is
+// received and reopened after it ends or fails, replacing repeated short
+// polling. The callbacks run on the thread calling Start() if it has a
+// task runner, otherwise on the transfer thread. Once Stop() is called on
+// the thread of the callbacks no more callbacks run.
+class IHttpEventStream
+{
+public:
+	virtual bool Start() = 0;
+	virtual void Stop() = 0;
+	virtual bool IsRunning() const = 0;
+	// The id of the last event received, to resume the stream after a restart
+	virtual std::string GetLastEventID() const = 0;
+};
+using HttpEventStream = std::shared_ptr<IHttpEventStream>;
+
+// Uploads the closed segments of a nim_log log file in the background, see
+// NIMHttp::CreateLogUploader.
+// * log_path: the file of NS_NIMLOG::ILogger::SetLogFile, its segments
+//   "<log_path>.0", "<log_path>.1", ... are uploaded from the oldest. A
+//   segment uploaded before is skipped, it is known by its size and the
+//   CRC-32 of its head even after it is renamed by a roll.
+// * logger: its current file is uploaded too after FlushNow() if set, the
+//   whole file every time as it keeps growing
+// * staging_directory: the segments are copied to it, so that a roll is
+//   not blocked, then zipped into a bundle one by one. A bundle whose
+//   upload failed or was interrupted is kept and sent before the next
+//   snapshot.
+// * url, chunk_config: of the chunked upload of a bundle, its upload_id is
+//   set to the name of the bundle so an interrupted upload is resumed if
+//   chunk_config.db_path is set
+// * priority: of the parts, so that the caps of
+//   IHttpManager::SetBandwidthLimit for it and the background yield pace
+//   the upload
+// * interval_seconds: uploads on this schedule besides UploadNow(), 0 for
+//   on demand only
+// * compress_level: 0~9 of the zip entries, fastest by default as logs
+//   compress well anyway
+struct HttpLogUploadConfig
+{
+	HttpLogUploadConfig() : priority(PRIORITY_BACKGROUND), interval_seconds(0), compress_level(1)
+	{
+		chunk_config.content_digest = DIGEST_NONE;
+	}
+	std::string log_path;
+	NS_NIMLOG::Logger logger;
+	std::string staging_directory;
+	std::string url;
+	HttpChunkedUploadConfig chunk_config;
+	HTTP_PRIORITY priority;
+	int64_t interval_seconds;
+	int compress_level;
+};
+// |segments| are the paths the segments in the bundle had when they were
+// copied, the oldest first
+using LogUploadCallback = std::function<void(bool succeed, int response_code, const std::vector<std::string>& segments)>;
+
+// The snapshot, the compression and the upload run on a background thread
+// of the uploader, so do the callbacks. At most one bundle is uploaded at a
+// time.
+class ILogUploader
+{
+public:
+	// Starts the thread and the schedule
+	virtual bool Start() = 0;
+	// Cancels the running upload, the bundle is resumed by the next Start()
+	virtual void Stop() = 0;
+	// Uploads the pending bundle or a new snapshot now, false if not
+	// started or an upload is running
+	virtual bool UploadNow() = 0;
+	virtual bool IsUploading() const = 0;
+};
+using LogUploader = std::shared_ptr<ILogUploader>;
+
+// Queries the HTTPDNS endpoint by the requests posted to a manager, it can
+// be the backend of NimHostResolver in google_net. Thread safe, the
+// callbacks of Resolve() run on the transfer thread.
+class IHttpDnsClient
+{
+public:
+	virtual void SetLogger(const NS_NIMLOG::Logger& logger) = 0;
+	// A succeeded result is also persisted to |config.db_path|
+	virtual void Resolve(const std::string& host, const HttpDnsCallback& callback) = 0;
+	// Reports the results persisted by the last runs, on the calling thread
+	virtual void Load(const HttpDnsLoadCallback& callback) = 0;
+};
+using HttpDnsClient = std::shared_ptr<IHttpDnsClient>;
+
+// A file download of a download manager, see IHttpDownloadManager::Add.
+// * expected_size: the bytes of the file if known, -1 if not. The download
+//   starts when the disk of |file_path| has room for the rest of it.
+// * digest_type, digest: the expected content digest, see
+//   IHttpRequest::SetContentDigest. The downloads of the same digest, or of
+//   the same URL if there is none, are transferred once.
+struct HttpDownloadTask
+{
+	HttpDownloadTask() : expected_size(-1), digest_type(DIGEST_NONE), priority(PRIORITY_BACKGROUND) {}
+	std::string url;
+	std::string file_path;
+	long long expected_size;
+	HTTP_DIGEST digest_type;
+	std::string digest;
+	HTTP_PRIORITY priority;
+};
+using HttpDownloadID = int64_t;
+// A download deferred as the disk of |directory| has |free_mb| free and it
+// needs |required_mb|, reported once until it is started
+using DownloadDiskFullCallback = std::function<void(HttpDownloadID id, const std::string& directory,
+	int64_t required_mb, int64_t free_mb)>;
+
+// The download manager, see NIMHttp::CreateDownloadManager.
+// * db_path: the nim_db database the queue is persisted to, empty to keep
+//   it in memory only
+// * max_downloads: the downloads running at the same time
+// * max_downloads_per_device: of them, the ones writing to the same disk, so
+//   that a slow disk, e.g. a USB drive or a network share, does not take
+//   all the slots, and a fast one is not thrashed by parallel writes
+// * reserved_disk_mb: left free on a disk by the downloads
+// * disk_full_cb: runs on the transfer thread or the thread calling
+//   Schedule()
+struct HttpDownloadManagerConfig
+{
+	HttpDownloadManagerConfig() : max_downloads(4), max_downloads_per_device(2), reserved_disk_mb(100) {}
+	std::string db_path;
+	int max_downloads;
+	int max_downloads_per_device;
+	int64_t reserved_disk_mb;
+	DownloadDiskFullCallback disk_full_cb;
+};
+
+// Queues file downloads and runs them through a manager in the order of
+// their priorities. Every download is a resumable one writing
+// "<file>.tmp", so a download failed, canceled by Cancel() or interrupted
+// by a restart is resumed from the bytes written when it is added again.
+// The queue is persisted, the downloads restored from the last run are
+// resumed without callbacks, adding one of them again gives it callbacks.
+// Thread safe, the callbacks of a download run on the thread calling Add()
+// if it has a task runner, otherwise on the transfer thread.
+class IHttpDownloadManager
+{
+public:
+	virtual ~IHttpDownloadManager() {}
+	// Returns the id of the download, 0 if |task| has no URL or file path.
+	// A download of |task.file_path| with the same content queued already
+	// gets the callbacks too and its id is returned. One of the same content
+	// to another path waits for it and gets a copy, or a link if the manager
+	// has a content store.
+	virtual HttpDownloadID Add(const HttpDownloadTask& task,
+		const CompletionCallback& complete_cb,
+		const ProgressCallback& progress_cb = ProgressCallback()) = 0;
+	// Drops the download without calling its callbacks, the bytes written
+	// are kept for the next Add(). A download of the same content waiting for
+	// it takes the transfer over.
+	virtual void Cancel(HttpDownloadID id) = 0;
+	// Starts the queued downloads which have room now, e.g. after the disk
+	// space was freed. Done by Add() and when a download completes anyway.
+	virtual void Schedule() = 0;
+	virtual size_t GetRunningCount() const = 0;
+	// Those waiting for a slot or for disk space
+	virtual size_t GetQueuedCount() const = 0;
+};
+using HttpDownloadManager = std::shared_ptr<IHttpDownloadManager>;
+
 HTTP_END_DECLS
 #endif//NETWORK_HTTP_WRAPPER_HTTP_DEF_H_
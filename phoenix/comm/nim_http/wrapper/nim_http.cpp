@@ -1,6 +1,16 @@
 #include "nim_http/wrapper/nim_http.h"
 #include "nim_http/http/http_manager_imp.h"
 #include "nim_http/http/curl_http_request.h"
+#include "nim_http/http/content_store.h"
+#include "nim_http/http/curl_chunked_upload.h"
+#include "nim_http/http/curl_download_manager.h"
+#include "nim_http/http/curl_event_stream.h"
+#include "nim_http/http/curl_segmented_download.h"
+#include "nim_http/http/http_dns_client.h"
+#include "nim_http/http/log_uploader.h"
+#include "nim_http/http/query_signer.h"
+#include "nim_http/http/upload_pipeline.h"
+#include "nim_http/http/http_request_template.h"
 HTTP_BEGIN_DECLS
 
 HttpManager NIMHttp::CreateHttpManager()
@@ -80,4 +90,69 @@ HttpRequest NIMHttp::CreateResumeRequest(const std::string& url, const std::stri
 		std::make_shared<CurlHttpRequest>(url, download_file_path, range_start,complete_cb, progress_cb, speed_cb, transfer_cb);
 	return http_request;
 }
+HttpRequestTemplate NIMHttp::CreateRequestTemplate()
+{
+	return std::make_shared<HttpRequestTemplateImp>();
+}
+SegmentedDownload NIMHttp::CreateSegmentedDownload(const HttpManager& manager,
+	const std::string& url, const std::string& download_file_path,
+	int segment_count,
+	const CompletedCallback& complete_cb,
+	const ProgressCallback& progress_cb/* = ProgressCallback()*/)
+{
+	return std::make_shared<CurlSegmentedDownload>(manager, url, download_file_path, segment_count, complete_cb, progress_cb);
+}
+ChunkedUpload NIMHttp::CreateChunkedUpload(const HttpManager& manager,
+	const std::string& url, const std::string& upload_file_path,
+	const HttpChunkedUploadConfig& config,
+	const ChunkedUploadCallback& complete_cb,
+	const ProgressCallback& progress_cb/* = ProgressCallback()*/)
+{
+	return std::make_shared<CurlChunkedUpload>(manager, url, upload_file_path, config, complete_cb, progress_cb);
+}
+HttpUploadPipeline NIMHttp::CreateUploadPipeline(const HttpUploadPipelineConfig& config)
+{
+	auto pipeline = std::make_shared<UploadPipelineImp>(config);
+	if (!pipeline->Init())
+		return nullptr;
+	return pipeline;
+}
+HttpQuerySigner NIMHttp::CreateQuerySigner(NS_NIMENCRYPT::EncryptMethod method, const std::string& secret)
+{
+	if (!QuerySignerImp::IsHMACMethod(method))
+		return nullptr;
+	return std::make_shared<QuerySignerImp>(method, secret);
+}
+LogUploader NIMHttp::CreateLogUploader(const HttpManager& manager,
+	const HttpLogUploadConfig& config,
+	const LogUploadCallback& complete_cb)
+{
+	return std::make_shared<LogUploaderImp>(manager, config, complete_cb);
+}
+HttpEventStream NIMHttp::CreateEventStream(const HttpManager& manager,
+	const std::string& url,
+	const HttpEventStreamConfig& config,
+	const EventStreamCallback& event_cb,
+	const EventStreamStateCallback& state_cb/* = EventStreamStateCallback()*/)
+{
+	return std::make_shared<CurlEventStream>(manager, url, config, event_cb, state_cb);
+}
+HttpDnsClient NIMHttp::CreateHttpDnsClient(const HttpManager& manager, const HttpDnsConfig& config)
+{
+	return std::make_shared<HttpDnsClientImp>(manager, config);
+}
+HttpContentStore NIMHttp::CreateContentStore(const std::string& directory)
+{
+	auto store = std::make_shared<ContentStore>();
+	if (!store->Open(directory))
+		return nullptr;
+	return store;
+}
+HttpDownloadManager NIMHttp::CreateDownloadManager(const HttpManager& manager,
+	const HttpDownloadManagerConfig& config)
+{
+	auto download_manager = std::make_shared<CurlDownloadManager>(manager, config);
+	download_manager->Restore();
+	return download_manager;
+}
 HTTP_END_DECLS
\ No newline at end of file
@@ -43,6 +43,52 @@ public:
 		const ProgressCallback& progress_cb = ProgressCallback(),
 		const SpeedCallback& speed_cb = SpeedCallback(), 
 		const TransferCallback& transfer_cb = TransferCallback());
+	// The requests created by the template share its headers and options
+	static HttpRequestTemplate CreateRequestTemplate();
+	// Downloads |url| by |segment_count| concurrent range requests posted to
+	// |manager|, call Start() on the returned object to begin or resume
+	static SegmentedDownload CreateSegmentedDownload(const HttpManager& manager,
+		const std::string& url, const std::string& download_file_path,
+		int segment_count,
+		const CompletedCallback& complete_cb,
+		const ProgressCallback& progress_cb = ProgressCallback());
+	// Uploads |upload_file_path| to |url| by the parts of |config| posted to
+	// |manager|, call Start() on the returned object to begin or resume
+	static ChunkedUpload CreateChunkedUpload(const HttpManager& manager,
+		const std::string& url, const std::string& upload_file_path,
+		const HttpChunkedUploadConfig& config,
+		const ChunkedUploadCallback& complete_cb,
+		const ProgressCallback& progress_cb = ProgressCallback());
+	// The body of an upload of |config.source_path| read, compressed and
+	// encrypted in one pass, null if the file can not be opened or the
+	// method is not an AEAD one
+	static HttpUploadPipeline CreateUploadPipeline(const HttpUploadPipelineConfig& config);
+	// Signs queries by |method|, one of the ENC_HMAC_* methods of
+	// nim_encrypt, keyed by |secret|. Null for another method.
+	static HttpQuerySigner CreateQuerySigner(NS_NIMENCRYPT::EncryptMethod method, const std::string& secret);
+	// Uploads the log segments of |config| by chunked uploads posted to
+	// |manager|, call Start() on the returned object to begin
+	static LogUploader CreateLogUploader(const HttpManager& manager,
+		const HttpLogUploadConfig& config,
+		const LogUploadCallback& complete_cb);
+	// Opens a long-lived request to |url| by |manager| whose response is
+	// parsed into events as it arrives and reopened when it ends, call
+	// Start() on the returned object to begin
+	static HttpEventStream CreateEventStream(const HttpManager& manager,
+		const std::string& url,
+		const HttpEventStreamConfig& config,
+		const EventStreamCallback& event_cb,
+		const EventStreamStateCallback& state_cb = EventStreamStateCallback());
+	// The lookups are posted to |manager| with PRIORITY_HIGH
+	static HttpDnsClient CreateHttpDnsClient(const HttpManager& manager, const HttpDnsConfig& config);
+	// The contents and their index are kept in |directory|, e.g. a directory
+	// of the user data shared by the managers of a user. Null if it can not
+	// be opened.
+	static HttpContentStore CreateContentStore(const std::string& directory);
+	// Runs the downloads queued to it by resume requests posted to |manager|,
+	// the downloads persisted in |config.db_path| by the last run are resumed
+	static HttpDownloadManager CreateDownloadManager(const HttpManager& manager,
+		const HttpDownloadManagerConfig& config);
 };
 
 HTTP_END_DECLS
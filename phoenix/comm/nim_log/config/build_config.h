@@ -7,4 +7,10 @@
 #define NIMLOG_END_DECLS }
 #define NS_NIMLOG nim_log
 #define USING_NS_NIMLOG using namespace nim_log;
+
+//编译期保留的最详细的日志级别（LOG_LEVEL的值），更详细的__NIM_LOG_*调用点在编译期被剔除，不生成任何代码
+//如发布版只保留LV_APP及以上：NIM_LOG_COMPILE_LEVEL=5
+#ifndef NIM_LOG_COMPILE_LEVEL
+#define NIM_LOG_COMPILE_LEVEL 6
+#endif
 #endif //COMM_NIMLOG_BUILD_CONFIG_H__
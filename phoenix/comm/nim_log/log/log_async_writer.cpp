@@ -0,0 +1,319 @@
+#include "nim_log/log/log_async_writer.h"
+#include <algorithm>
+#include <map>
+#include "nim_log/log/log_file.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/thread/framework_thread.h"
+#include "extension/callback/post_task.h"
+#include "extension/process/process_util.h"
+
+NIMLOG_BEGIN_DECLS
+
+namespace {
+std::atomic<uint64_t> g_next_writer_id(1);
+//线程退出时标记本线程的所有环，由写线程在收割完剩余数据后释放
+class ThreadRingHolder
+{
+public:
+	~ThreadRingHolder()
+	{
+		for (auto& it : rings_)
+			it.second->Orphan();
+	}
+	std::map<uint64_t, std::shared_ptr<LogStagingRing>> rings_;
+};
+thread_local ThreadRingHolder tls_thread_rings;
+}
+
+LogAsyncWriter::LogAsyncWriter(LogFile* log_file) :
+	log_file_(log_file),
+	thread_(nullptr),
+	task_runner_(nullptr),
+	thread_id_(0),
+	queued_bytes_(0),
+	drain_posted_(false),
+	writer_id_(g_next_writer_id++),
+	harvest_posted_(false),
+	running_(false),
+	dropped_count_(0)
+{
+}
+
+LogAsyncWriter::~LogAsyncWriter()
+{
+	Stop();
+}
+
+bool LogAsyncWriter::Start(const LogAsyncConfig& config)
+{
+	if (running_)
+		return true;
+	TRACE_EVENT0("nim.log", "LogAsyncWriter::Start");
+	config_ = config;
+	if (config_.max_queue_size_ == 0)
+		config_.max_queue_size_ = 1;
+	if (config_.max_batch_size_ == 0)
+		config_.max_batch_size_ = 1;
+	thread_ = std::make_unique<NS_EXTENSION::FrameworkThread>("nim_log_writer");
+	NS_EXTENSION::FrameworkThreadOptions options;
+	options.qos = NS_EXTENSION::ThreadQoS::kBackground;
+	if (!thread_->StartWithOptions(options))
+	{
+		thread_.reset();
+		return false;
+	}
+	task_runner_ = thread_->task_runner();
+	thread_id_ = thread_->GetThreadId();
+	running_ = true;
+	return true;
+}
+
+void LogAsyncWriter::Stop()
+{
+	if (!running_)
+		return;
+	TRACE_EVENT0("nim.log", "LogAsyncWriter::Stop");
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		running_ = false;
+	}
+	not_full_.notify_all();
+	thread_->Stop();
+	thread_.reset();
+	thread_id_ = 0;
+	//写线程停止时没执行的收割任务不会再执行
+	harvest_posted_ = false;
+	//先让各线程的环不再接受写入，之后的日志由写日志的线程自己写入，最后一次收割就不会漏掉数据
+	{
+		std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+		for (auto& ring : rings_)
+			ring->Detach();
+	}
+	//写线程退出后可能还有未写入的日志
+	DoDrain();
+	std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+	rings_.clear();
+}
+
+void LogAsyncWriter::Push(LOG_LEVEL lv, const char* log, size_t length)
+{
+	if (config_.enable_thread_staging_ && running_ && PushToThreadRing(log, length))
+		return;
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_ || IsWriterThread())
+	{
+		lock.unlock();
+		WriteDirect(log, length);
+		return;
+	}
+	if (queue_.size() >= config_.max_queue_size_)
+	{
+		switch (config_.policy_)
+		{
+		case LBP_BLOCK:
+			not_full_.wait(lock, [this]() {
+				return queue_.size() < config_.max_queue_size_ || !running_;
+			});
+			if (!running_)
+			{
+				lock.unlock();
+				WriteDirect(log, length);
+				return;
+			}
+			break;
+		case LBP_DROP_LOWEST_LEVEL:
+		{
+			//LOG_LEVEL的值越大级别越低
+			auto lowest = std::max_element(queue_.begin(), queue_.end(), [](const LogRecord& left, const LogRecord& right) {
+				return left.level_ < right.level_;
+			});
+			dropped_count_++;
+			if (lowest->level_ <= lv)
+				return;
+			queued_bytes_ -= lowest->text_.size();
+			queue_.erase(lowest);
+		}
+			break;
+		case LBP_SPILL:
+		default:
+			lock.unlock();
+			//先把队列里的日志写掉，保证日志的先后顺序
+			DoDrain();
+			WriteDirect(log, length);
+			return;
+		}
+	}
+	queue_.emplace_back(lv, log, length);
+	queued_bytes_ += length;
+	if (!drain_posted_)
+	{
+		drain_posted_ = true;
+		PostDrainTask();
+	}
+}
+
+void LogAsyncWriter::Drain()
+{
+	DoDrain();
+}
+
+size_t LogAsyncWriter::GetBufferedBytes()
+{
+	size_t bytes = 0;
+	{
+		std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+		for (auto& ring : rings_)
+			bytes += ring->Capacity();
+	}
+	std::lock_guard<std::mutex> auto_lock(mutex_);
+	return bytes + queued_bytes_ + queue_.size() * sizeof(LogRecord);
+}
+
+bool LogAsyncWriter::PostDelayedTask(int64_t delay_ms, const std::function<void()>& task)
+{
+	if (!running_ || task_runner_ == nullptr)
+		return false;
+	if (delay_ms <= 0)
+		return NS_EXTENSION::PostTask(task_runner_.get(), FROM_HERE, task);
+	return NS_EXTENSION::PostDelayedTask(task_runner_.get(), FROM_HERE, task, NS_EXTENSION::TimeDelta::FromMilliseconds(delay_ms));
+}
+
+bool LogAsyncWriter::IsWriterThread() const
+{
+	return thread_id_ == NS_EXTENSION::PlatformThread::CurrentId();
+}
+
+bool LogAsyncWriter::PushToThreadRing(const char* log, size_t length)
+{
+	if (IsWriterThread())
+		return false;
+	auto ring = GetThreadRing();
+	if (ring == nullptr)
+		return false;
+	if (ring->Write(log, length))
+	{
+		PostHarvestTask();
+		return true;
+	}
+	//环满了或写线程已停止，本线程较早的日志还在环里，不能改放进queue_，否则与收割的顺序不定
+	FlushThreadRing(*ring, log, length);
+	return true;
+}
+
+void LogAsyncWriter::FlushThreadRing(LogStagingRing& ring, const char* log, size_t length)
+{
+	std::string batch;
+	std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+	ring.Read(batch);
+	batch.append(log, length);
+	WriteDirect(batch.data(), batch.length());
+}
+
+std::shared_ptr<LogStagingRing> LogAsyncWriter::GetThreadRing()
+{
+	auto& rings = tls_thread_rings.rings_;
+	auto it = rings.find(writer_id_);
+	//写线程重新启动后，停止前的环不再被收割，换一个新的
+	if (it != rings.end() && (!it->second->IsDetached() || !running_))
+		return it->second;
+	//顺便清理已停止的写线程留下的环
+	for (auto iter = rings.begin(); iter != rings.end();)
+	{
+		if (iter->second->IsDetached())
+			iter = rings.erase(iter);
+		else
+			iter++;
+	}
+	auto ring = std::make_shared<LogStagingRing>(config_.thread_staging_size_);
+	{
+		std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+		if (!running_)
+			return nullptr;
+		rings_.push_back(ring);
+	}
+	rings.emplace(writer_id_, ring);
+	return ring;
+}
+
+void LogAsyncWriter::PostDrainTask()
+{
+	if (task_runner_ == nullptr || !NS_EXTENSION::PostTask(task_runner_.get(), FROM_HERE, [this]() {
+		DoDrain();
+	}))
+	{
+		drain_posted_ = false;
+	}
+}
+
+void LogAsyncWriter::PostHarvestTask()
+{
+	if (harvest_posted_.exchange(true))
+		return;
+	//写线程正在停止时投递失败，Stop中的最后一次收割会取走环里的数据
+	if (!NS_EXTENSION::PostTask(task_runner_.get(), FROM_HERE, [this]() {
+		harvest_posted_ = false;
+		HarvestThreadRings();
+	}))
+	{
+		harvest_posted_ = false;
+	}
+}
+
+void LogAsyncWriter::HarvestThreadRings()
+{
+	std::string batch;
+	//持有rings_mutex_写入，FlushThreadRing取出同一个环剩余的日志时，收割到的较早的日志已经写入
+	std::lock_guard<std::mutex> auto_lock(rings_mutex_);
+	for (auto it = rings_.begin(); it != rings_.end();)
+	{
+		(*it)->Read(batch);
+		if ((*it)->IsOrphaned() && (*it)->IsEmpty())
+			it = rings_.erase(it);
+		else
+			it++;
+	}
+	if (!batch.empty())
+		WriteDirect(batch.data(), batch.length());
+}
+
+void LogAsyncWriter::DoDrain()
+{
+	HarvestThreadRings();
+	std::deque<LogRecord> pending;
+	{
+		std::lock_guard<std::mutex> auto_lock(mutex_);
+		pending.swap(queue_);
+		queued_bytes_ = 0;
+		drain_posted_ = false;
+	}
+	not_full_.notify_all();
+	if (!pending.empty())
+		WriteBatch(pending);
+}
+
+void LogAsyncWriter::WriteBatch(std::deque<LogRecord>& records)
+{
+	std::lock_guard<std::mutex> auto_lock(write_mutex_);
+	std::string batch;
+	size_t count = 0;
+	for (auto& record : records)
+	{
+		batch.append(record.text_);
+		if (++count >= config_.max_batch_size_)
+		{
+			log_file_->WriteLog(batch);
+			batch.clear();
+			count = 0;
+		}
+	}
+	if (!batch.empty())
+		log_file_->WriteLog(batch);
+}
+
+void LogAsyncWriter::WriteDirect(const char* log, size_t length)
+{
+	std::lock_guard<std::mutex> auto_lock(write_mutex_);
+	log_file_->WriteLog(log, length);
+}
+
+NIMLOG_END_DECLS
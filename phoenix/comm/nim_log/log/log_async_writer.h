@@ -0,0 +1,85 @@
+#ifndef __BASE_EXTENSION_LOG_ASYNC_WRITER_H__
+#define __BASE_EXTENSION_LOG_ASYNC_WRITER_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <list>
+#include <functional>
+#include "extension/config/build_config.h"
+#include "extension/process/process_util.h"
+#include "base/single_thread_task_runner.h"
+#include "nim_log/log/log_staging_ring.h"
+
+EXTENSION_BEGIN_DECLS
+class FrameworkThread;
+EXTENSION_END_DECLS
+
+NIMLOG_BEGIN_DECLS
+
+class LogFile;
+//异步写日志：写日志的线程只把格式化好的日志放入有界队列，由独立的写线程批量写入mmap文件
+class NIMLOG_EXPORT LogAsyncWriter
+{
+	struct LogRecord
+	{
+		LogRecord(LOG_LEVEL level, const char* text, size_t length) : level_(level), text_(text, length) {}
+		LOG_LEVEL level_;
+		std::string text_;
+	};
+public:
+	explicit LogAsyncWriter(LogFile* log_file);
+	~LogAsyncWriter();
+public:
+	bool Start(const LogAsyncConfig& config);
+	void Stop();
+	bool IsRunning() const { return running_; }
+	void Push(LOG_LEVEL lv, const char* log, size_t length);
+	//在调用线程上把队列中的日志全部写入文件
+	void Drain();
+	//因队列满而被丢弃的日志条数
+	uint64_t GetDroppedCount() const { return dropped_count_; }
+	//各线程的暂存环和队列中的日志占用的字节数
+	size_t GetBufferedBytes();
+	//在写线程上延迟delay_ms执行task，排在此前写入的日志之后；写线程未运行时返回false
+	bool PostDelayedTask(int64_t delay_ms, const std::function<void()>& task);
+private:
+	bool IsWriterThread() const;
+	bool PushToThreadRing(const char* log, size_t length);
+	//在写日志的线程上把ring中剩余的日志和这一条一起写入文件
+	void FlushThreadRing(LogStagingRing& ring, const char* log, size_t length);
+	std::shared_ptr<LogStagingRing> GetThreadRing();
+	void PostDrainTask();
+	void PostHarvestTask();
+	void DoDrain();
+	void HarvestThreadRings();
+	void WriteBatch(std::deque<LogRecord>& records);
+	void WriteDirect(const char* log, size_t length);
+private:
+	LogFile* log_file_;
+	LogAsyncConfig config_;
+	std::unique_ptr<NS_EXTENSION::FrameworkThread> thread_;
+	scoped_refptr<base::SingleThreadTaskRunner> task_runner_;//Start之后不再修改
+	std::atomic<base::PlatformThreadId> thread_id_;
+	std::mutex mutex_;//保护queue_/drain_posted_
+	std::condition_variable not_full_;
+	std::deque<LogRecord> queue_;
+	size_t queued_bytes_;//queue_中日志的长度之和
+	bool drain_posted_;
+	std::mutex write_mutex_;//保证批次按顺序写入文件
+	const uint64_t writer_id_;//用于在线程局部存储中区分不同的写线程
+	std::mutex rings_mutex_;//保护rings_，同时保证每个环只有一个消费者；先于write_mutex_加锁
+	std::list<std::shared_ptr<LogStagingRing>> rings_;
+	std::atomic_bool harvest_posted_;
+	std::atomic_bool running_;
+	std::atomic<uint64_t> dropped_count_;
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_ASYNC_WRITER_H__
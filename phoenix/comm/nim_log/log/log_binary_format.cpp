@@ -0,0 +1,309 @@
+#include "nim_log/log/log_binary_format.h"
+#include <cstdio>
+#include <cstring>
+#include <shared_mutex>
+#include "extension/time/coarse_clock.h"
+
+NIMLOG_BEGIN_DECLS
+
+namespace {
+const char* const kLEVEL_TEXT_LIST[] = {
+	"LV_KER", "LV_ASS", "LV_ERR", "LV_WAR", "LV_INT", "LV_APP", "LV_PRO"
+};
+//Pack的replace系列接口是protected的，写完记录体后需要通过它回填长度
+class LogRecordPack : public NS_EXTENSION::Pack
+{
+public:
+	explicit LogRecordPack(NS_EXTENSION::PackBuffer& buffer) : NS_EXTENSION::Pack(buffer) {}
+	void ReplaceLength(size_t pos, uint32_t length) { replace_uint32(pos, length); }
+};
+uint64_t DoubleToBits(double value)
+{
+	uint64_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+double BitsToDouble(uint64_t bits)
+{
+	double value = 0;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+}
+
+uint32_t LogFormatRegistry::Register(const std::string& fmt, bool& is_new)
+{
+	//同一格式串只在第一次出现时写入，之后每条日志都只是查表，读锁下并发查找
+	{
+		std::shared_lock<NS_EXTENSION::ProfiledLock<NS_EXTENSION::RWLock>> auto_lock(lock_);
+		auto it = ids_.find(fmt);
+		if (it != ids_.end())
+		{
+			is_new = !unwritten_.empty() && unwritten_.count(it->second) != 0;
+			return it->second;
+		}
+	}
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::RWLock>> auto_lock(lock_);
+	is_new = true;
+	auto it = ids_.find(fmt);
+	if (it != ids_.end())
+	{
+		is_new = unwritten_.count(it->second) != 0;
+		return it->second;
+	}
+	//FNV-1a，Unpack::pop_varint最多只能读出28位
+	uint32_t id = 2166136261u;
+	for (size_t i = 0; i < fmt.length(); i++)
+		id = (id ^ (uint8_t)fmt[i]) * 16777619u;
+	id &= 0x0FFFFFFF;
+	while (formats_.find(id) != formats_.end())
+		id = (id + 1) & 0x0FFFFFFF;
+	auto ret = ids_.emplace(fmt, id);
+	formats_[id] = &ret.first->first;
+	unwritten_.insert(id);
+	return id;
+}
+
+void LogFormatRegistry::MarkWritten(uint32_t id)
+{
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::RWLock>> auto_lock(lock_);
+	unwritten_.erase(id);
+}
+
+std::string LogFormatRegistry::DumpDictionary()
+{
+	NS_EXTENSION::PackBuffer buffer;
+	LogBinaryEncoder encoder(buffer);
+	//包括还没有写入的，它们的字典记录可能写进了滚动之前的文件
+	{
+		std::shared_lock<NS_EXTENSION::ProfiledLock<NS_EXTENSION::RWLock>> auto_lock(lock_);
+		for (auto& it : formats_)
+			encoder.PackFormat(it.first, it.second->data(), it.second->length());
+	}
+	return std::string(buffer.data(), buffer.size());
+}
+
+LogBinaryEncoder::LogBinaryEncoder(NS_EXTENSION::PackBuffer& buffer) :
+	buffer_(buffer), message_begin_(0)
+{
+}
+
+size_t LogBinaryEncoder::BeginRecord(LOG_BINARY_RECORD_TYPE type)
+{
+	size_t record_begin = buffer_.size();
+	LogRecordPack pack(buffer_);
+	pack.push_uint16(kRECORD_MAGIC).push_uint8((uint8_t)type).push_uint32(0);
+	return record_begin;
+}
+
+void LogBinaryEncoder::EndRecord(size_t record_begin)
+{
+	size_t body_length = buffer_.size() - record_begin - kRECORD_HEADER_LENGTH;
+	LogRecordPack pack(buffer_);
+	pack.ReplaceLength(record_begin + 3, (uint32_t)body_length);
+}
+
+void LogBinaryEncoder::PackFormat(uint32_t format_id, const char* fmt, size_t length)
+{
+	size_t record_begin = BeginRecord(LBR_FORMAT);
+	LogRecordPack pack(buffer_);
+	pack.push_varint(format_id).push_varstr(fmt, length);
+	EndRecord(record_begin);
+}
+
+void LogBinaryEncoder::BeginMessage(uint32_t format_id, LOG_LEVEL lv, int64_t time_ms, uint32_t pid, uint32_t tid)
+{
+	message_begin_ = BeginRecord(LBR_MESSAGE);
+	LogRecordPack pack(buffer_);
+	pack.push_varint(format_id).push_uint8((uint8_t)lv).push_uint64((uint64_t)time_ms).push_uint32(pid).push_uint32(tid);
+}
+
+void LogBinaryEncoder::AppendString(const char* data, size_t length)
+{
+	LogRecordPack pack(buffer_);
+	pack.push_uint8(LBA_STRING).push_varstr(data, length);
+}
+
+void LogBinaryEncoder::AppendBool(bool value)
+{
+	LogRecordPack pack(buffer_);
+	pack.push_uint8(LBA_BOOL).push_bool(value);
+}
+
+void LogBinaryEncoder::AppendSigned(int64_t value)
+{
+	LogRecordPack pack(buffer_);
+	pack.push_uint8(LBA_SIGNED).push_uint64((uint64_t)value);
+}
+
+void LogBinaryEncoder::AppendUnsigned(uint64_t value)
+{
+	LogRecordPack pack(buffer_);
+	pack.push_uint8(LBA_UNSIGNED).push_uint64(value);
+}
+
+void LogBinaryEncoder::AppendDouble(double value)
+{
+	LogRecordPack pack(buffer_);
+	pack.push_uint8(LBA_DOUBLE).push_uint64(DoubleToBits(value));
+}
+
+void LogBinaryEncoder::EndMessage()
+{
+	EndRecord(message_begin_);
+}
+
+int LogBinaryDecoder::Decode(const char* data, size_t size, std::string& text)
+{
+	//先收集全部字典记录，多线程写日志时字典记录不一定先于使用它的日志写入
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t record_length = 0;
+		uint8_t type = 0;
+		const char* body = nullptr;
+		size_t body_length = 0;
+		if (!ReadRecord(data + pos, size - pos, record_length, type, body, body_length))
+		{
+			pos++;
+			continue;
+		}
+		if (type == LBR_FORMAT)
+			LoadFormat(body, body_length);
+		pos += record_length;
+	}
+	int count = 0;
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t record_length = 0;
+		uint8_t type = 0;
+		const char* body = nullptr;
+		size_t body_length = 0;
+		if (!ReadRecord(data + pos, size - pos, record_length, type, body, body_length))
+		{
+			skipped_bytes_++;
+			pos++;
+			continue;
+		}
+		if (type == LBR_MESSAGE && RenderMessage(body, body_length, text))
+			count++;
+		pos += record_length;
+	}
+	return count;
+}
+
+bool LogBinaryDecoder::ReadRecord(const char* data, size_t size, size_t& record_length, uint8_t& type, const char*& body, size_t& body_length) const
+{
+	if (size < LogBinaryEncoder::kRECORD_HEADER_LENGTH)
+		return false;
+	NS_EXTENSION::Unpack unpack(data, size);
+	if (unpack.pop_uint16() != LogBinaryEncoder::kRECORD_MAGIC)
+		return false;
+	type = unpack.pop_uint8();
+	if (type != LBR_FORMAT && type != LBR_MESSAGE)
+		return false;
+	body_length = unpack.pop_uint32();
+	//文件尾部被截断的记录直接丢弃
+	if (body_length > unpack.size())
+		return false;
+	body = unpack.data();
+	record_length = LogBinaryEncoder::kRECORD_HEADER_LENGTH + body_length;
+	return true;
+}
+
+void LogBinaryDecoder::LoadFormat(const char* body, size_t length)
+{
+	try
+	{
+		NS_EXTENSION::Unpack unpack(body, length);
+		uint32_t id = unpack.pop_varint();
+		formats_[id] = unpack.pop_varstr();
+	}
+	catch (const NS_EXTENSION::NException&)
+	{
+	}
+}
+
+bool LogBinaryDecoder::RenderMessage(const char* body, size_t length, std::string& text) const
+{
+	std::vector<std::string> args;
+	uint32_t format_id = 0;
+	uint8_t level = 0;
+	int64_t time_ms = 0;
+	uint32_t pid = 0;
+	uint32_t tid = 0;
+	try
+	{
+		NS_EXTENSION::Unpack unpack(body, length);
+		format_id = unpack.pop_varint();
+		level = unpack.pop_uint8();
+		time_ms = (int64_t)unpack.pop_uint64();
+		pid = unpack.pop_uint32();
+		tid = unpack.pop_uint32();
+		char buffer[64];
+		while (!unpack.empty())
+		{
+			switch (unpack.pop_uint8())
+			{
+			case LBA_STRING:
+				args.emplace_back(unpack.pop_varstr());
+				break;
+			case LBA_BOOL:
+				args.emplace_back(unpack.pop_bool() ? "true" : "false");
+				break;
+			case LBA_SIGNED:
+				args.emplace_back(std::to_string((int64_t)unpack.pop_uint64()));
+				break;
+			case LBA_UNSIGNED:
+				args.emplace_back(std::to_string(unpack.pop_uint64()));
+				break;
+			case LBA_DOUBLE:
+				snprintf(buffer, sizeof(buffer), "%f", BitsToDouble(unpack.pop_uint64()));
+				args.emplace_back(buffer);
+				break;
+			default:
+				return false;
+			}
+		}
+	}
+	catch (const NS_EXTENSION::NException&)
+	{
+		return false;
+	}
+	//与文本模式的日志头保持一致
+	NS_EXTENSION::TimeStruct qt;
+	NS_EXTENSION::CoarseClock::LocalExplode(time_ms / 1000, &qt);
+	char header[128];
+	snprintf(header, sizeof(header), "[%02d-%02d %02d:%02d:%02d.%03d %u-%u] [%s] ",
+		qt.month, qt.day_of_month, qt.hour, qt.minute, qt.second, (int)(time_ms % 1000),
+		pid, tid, level <= LV_PRO ? kLEVEL_TEXT_LIST[level] : "LV_PRO");
+	text.append(header);
+	auto it = formats_.find(format_id);
+	if (it == formats_.end())
+	{
+		//字典记录所在的文件已被删除
+		text.append("<unknown format ").append(std::to_string(format_id)).append(">");
+		for (auto& arg : args)
+			text.append(" ").append(arg);
+		text.append(" \n");
+		return true;
+	}
+	//按LogMessageImpl的规则依次替换"{x}"：第i个参数替换当前位置之后第一个"{i}"
+	const std::string& fmt = it->second;
+	size_t cursor = 0;
+	for (size_t index = 0; index < args.size(); index++)
+	{
+		std::string holder("{");
+		holder.append(std::to_string(index)).append("}");
+		size_t pos = fmt.find(holder, cursor);
+		if (pos == std::string::npos)
+			continue;
+		text.append(fmt, cursor, pos - cursor);
+		text.append(args[index]);
+		cursor = pos + holder.length();
+	}
+	text.append(fmt, cursor, std::string::npos);
+	text.append(" \n");
+	return true;
+}
+
+NIMLOG_END_DECLS
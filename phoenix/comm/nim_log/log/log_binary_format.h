@@ -0,0 +1,104 @@
+#ifndef __BASE_EXTENSION_LOG_BINARY_FORMAT_H__
+#define __BASE_EXTENSION_LOG_BINARY_FORMAT_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "extension/memory/packet.h"
+#include "extension/synchronization/adaptive_lock.h"
+#include "extension/synchronization/lock_profiler.h"
+
+NIMLOG_BEGIN_DECLS
+
+//二进制日志记录：magic(uint16) + 类型(uint8) + 记录体长度(uint32) + 记录体，全部为小端序
+//记录体的长度使解码时可以跳过无法识别的数据（如从mmap文件恢复时插入的文本）重新同步
+enum LOG_BINARY_RECORD_TYPE
+{
+	LBR_FORMAT = 1,		//格式串字典：varint编号 + varstr格式串
+	LBR_MESSAGE = 2		//日志：varint格式串编号 + uint8级别 + uint64毫秒时间 + uint32进程ID + uint32线程ID + 参数列表
+};
+//参数类型，每个参数以uint8类型开头
+enum LOG_BINARY_ARG_TYPE
+{
+	LBA_STRING = 0,		//varstr
+	LBA_BOOL = 1,		//uint8
+	LBA_SIGNED = 2,		//uint64
+	LBA_UNSIGNED = 3,	//uint64
+	LBA_DOUBLE = 4		//uint64，double的位模式
+};
+
+//格式串字典，编号由格式串的哈希值得到，同一格式串在不同进程中的编号相同，
+//因此多次运行追加到同一文件的日志可以共用字典
+class NIMLOG_EXPORT LogFormatRegistry
+{
+public:
+	LogFormatRegistry() : lock_("nim_log.LogFormatRegistry") {}
+	~LogFormatRegistry() = default;
+public:
+	//返回格式串的编号，字典记录还没有写入文件时is_new为true，调用方写入后调用MarkWritten；
+	//在此之前其他线程取到同一编号时is_new同样为true，字典记录可能重复写入，内容相同，解码不受影响
+	uint32_t Register(const std::string& fmt, bool& is_new);
+	void MarkWritten(uint32_t id);
+	//全部字典记录，每个新日志文件开头写入一份，保证每个文件都可以单独解码
+	std::string DumpDictionary();
+private:
+	NS_EXTENSION::ProfiledLock<NS_EXTENSION::RWLock> lock_;
+	std::unordered_map<std::string, uint32_t> ids_;
+	std::unordered_map<uint32_t, const std::string*> formats_;//编号 -> ids_中的键
+	std::unordered_set<uint32_t> unwritten_;//字典记录还没有写入文件的编号
+};
+
+//在PackBuffer上逐个追加二进制记录
+class NIMLOG_EXPORT LogBinaryEncoder
+{
+public:
+	static const uint16_t kRECORD_MAGIC = 0x4C4E;
+	static const size_t kRECORD_HEADER_LENGTH = 7;
+public:
+	explicit LogBinaryEncoder(NS_EXTENSION::PackBuffer& buffer);
+	~LogBinaryEncoder() = default;
+public:
+	void PackFormat(uint32_t format_id, const char* fmt, size_t length);
+	void BeginMessage(uint32_t format_id, LOG_LEVEL lv, int64_t time_ms, uint32_t pid, uint32_t tid);
+	void AppendString(const char* data, size_t length);
+	void AppendBool(bool value);
+	void AppendSigned(int64_t value);
+	void AppendUnsigned(uint64_t value);
+	void AppendDouble(double value);
+	//回填当前记录的长度
+	void EndMessage();
+private:
+	size_t BeginRecord(LOG_BINARY_RECORD_TYPE type);
+	void EndRecord(size_t record_begin);
+private:
+	NS_EXTENSION::PackBuffer& buffer_;
+	size_t message_begin_;
+};
+
+//把二进制日志还原成与文本模式相同格式的文本
+class NIMLOG_EXPORT LogBinaryDecoder
+{
+public:
+	LogBinaryDecoder() = default;
+	~LogBinaryDecoder() = default;
+public:
+	//解码data中的全部记录并追加到text，返回解码出的日志条数
+	//同一个解码器先后解码多个文件时，前面文件中的字典对后面的文件同样有效
+	int Decode(const char* data, size_t size, std::string& text);
+	//被跳过的无法识别的字节数
+	size_t GetSkippedBytes() const { return skipped_bytes_; }
+private:
+	bool ReadRecord(const char* data, size_t size, size_t& record_length, uint8_t& type, const char*& body, size_t& body_length) const;
+	void LoadFormat(const char* body, size_t length);
+	bool RenderMessage(const char* body, size_t length, std::string& text) const;
+private:
+	std::unordered_map<uint32_t, std::string> formats_;
+	size_t skipped_bytes_ = 0;
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_BINARY_FORMAT_H__
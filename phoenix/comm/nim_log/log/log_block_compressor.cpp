@@ -0,0 +1,117 @@
+#include "nim_log/log/log_block_compressor.h"
+#include <cstring>
+#include "extension/memory/packet.h"
+#include "third_party/zlib/include/zlib.h"
+
+NIMLOG_BEGIN_DECLS
+
+struct LogBlockCompressor::Stream
+{
+	Stream() : inited(false) { memset(&stream, 0, sizeof(stream)); }
+	z_stream stream;
+	bool inited;
+};
+
+namespace {
+//尝试在data处解出一个块并追加到text，返回块的总长度，不是有效的块时返回0
+size_t InflateBlock(const char* data, size_t size, std::string& text)
+{
+	if (size < LogBlockCompressor::kBLOCK_HEADER_LENGTH)
+		return 0;
+	NS_EXTENSION::Unpack unpack(data, size);
+	if (unpack.pop_uint32() != LogBlockCompressor::kBLOCK_MAGIC)
+		return 0;
+	uint32_t raw_length = unpack.pop_uint32();
+	uint32_t compressed_length = unpack.pop_uint32();
+	uint32_t crc = unpack.pop_uint32();
+	//deflate的压缩比不会超过1032:1，超出时说明块头已损坏
+	if (compressed_length > unpack.size() || raw_length > (uint64_t)compressed_length * 1032 + 64)
+		return 0;
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		return 0;
+	size_t offset = text.length();
+	text.resize(offset + raw_length);
+	stream.next_in = (Bytef*)unpack.data();
+	stream.avail_in = compressed_length;
+	stream.next_out = (Bytef*)&text[offset];
+	stream.avail_out = raw_length;
+	int ret = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+	if (ret != Z_STREAM_END || stream.total_out != raw_length ||
+		crc32(0L, (const Bytef*)text.data() + offset, raw_length) != crc)
+	{
+		text.resize(offset);
+		return 0;
+	}
+	return LogBlockCompressor::kBLOCK_HEADER_LENGTH + compressed_length;
+}
+}
+
+LogBlockCompressor::LogBlockCompressor(int level) :
+	stream_(std::make_unique<Stream>())
+{
+	stream_->inited = (deflateInit2(&stream_->stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+}
+
+LogBlockCompressor::~LogBlockCompressor()
+{
+	if (stream_->inited)
+		deflateEnd(&stream_->stream);
+}
+
+bool LogBlockCompressor::Compress(const char* data, size_t length, std::string& block)
+{
+	if (!stream_->inited || deflateReset(&stream_->stream) != Z_OK)
+		return false;
+	z_stream& stream = stream_->stream;
+	size_t offset = block.length();
+	uLong bound = deflateBound(&stream, (uLong)length);
+	block.resize(offset + kBLOCK_HEADER_LENGTH + bound);
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = (uInt)length;
+	stream.next_out = (Bytef*)&block[offset + kBLOCK_HEADER_LENGTH];
+	stream.avail_out = (uInt)bound;
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+	{
+		block.resize(offset);
+		return false;
+	}
+	uint32_t compressed_length = (uint32_t)stream.total_out;
+	NS_EXTENSION::PackBuffer buffer;
+	NS_EXTENSION::Pack pack(buffer);
+	pack.push_uint32(kBLOCK_MAGIC).push_uint32((uint32_t)length).push_uint32(compressed_length)
+		.push_uint32((uint32_t)crc32(0L, (const Bytef*)data, (uInt)length));
+	memcpy(&block[offset], pack.data(), kBLOCK_HEADER_LENGTH);
+	block.resize(offset + kBLOCK_HEADER_LENGTH + compressed_length);
+	return true;
+}
+
+int LogBlockCompressor::Decompress(const char* data, size_t size, std::string& text)
+{
+	int count = 0;
+	size_t plain_begin = 0;
+	std::string block_text;
+	for (size_t pos = 0; pos < size;)
+	{
+		block_text.clear();
+		size_t block_length = InflateBlock(data + pos, size - pos, block_text);
+		if (block_length == 0)
+		{
+			pos++;
+			continue;
+		}
+		if (plain_begin < pos)
+			text.append(data + plain_begin, pos - plain_begin);
+		text.append(block_text);
+		pos += block_length;
+		plain_begin = pos;
+		count++;
+	}
+	if (plain_begin < size)
+		text.append(data + plain_begin, size - plain_begin);
+	return count;
+}
+
+NIMLOG_END_DECLS
@@ -0,0 +1,34 @@
+#ifndef __BASE_EXTENSION_LOG_BLOCK_COMPRESSOR_H__
+#define __BASE_EXTENSION_LOG_BLOCK_COMPRESSOR_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include <string>
+#include <memory>
+
+NIMLOG_BEGIN_DECLS
+
+//mmap缓冲区写入日志文件时按块压缩
+//块格式：magic(uint32) + 原始长度(uint32) + 压缩后长度(uint32) + 原始数据crc32(uint32) + raw deflate数据，全部为小端序
+//每个块都是独立的deflate流，文件被截断或局部损坏时，其余的块仍然可以解压
+class NIMLOG_EXPORT LogBlockCompressor
+{
+	struct Stream;
+public:
+	static const uint32_t kBLOCK_MAGIC = 0x425A4C4E;
+	static const size_t kBLOCK_HEADER_LENGTH = 16;
+public:
+	explicit LogBlockCompressor(int level = -1);
+	~LogBlockCompressor();
+public:
+	//把data压缩成一个块追加到block，失败时返回false且block不变
+	bool Compress(const char* data, size_t length, std::string& block);
+	//解压data中的全部块并追加到text，无法识别的字节（如未开启压缩时写入的文本）原样保留
+	//返回解压出的块数
+	static int Decompress(const char* data, size_t size, std::string& text);
+private:
+	std::unique_ptr<Stream> stream_;//压缩流跨块复用，每块开始时重置
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_BLOCK_COMPRESSOR_H__
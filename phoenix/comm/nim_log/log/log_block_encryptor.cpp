@@ -0,0 +1,93 @@
+#include "nim_log/log/log_block_encryptor.h"
+#include <cstring>
+#include "extension/memory/packet.h"
+
+NIMLOG_BEGIN_DECLS
+
+LogBlockEncryptor::LogBlockEncryptor(const std::string& key) :
+	method_(NS_NIMENCRYPT::NIMEncrypt::CreateMethod(NS_NIMENCRYPT::EncryptMethod::ENC_AES256_GCM))
+{
+	if (method_ != nullptr)
+		method_->SetKey(key);
+}
+
+LogBlockEncryptor::~LogBlockEncryptor()
+{
+}
+
+bool LogBlockEncryptor::Encrypt(const char* data, size_t length, std::string& block)
+{
+	if (method_ == nullptr)
+		return false;
+	size_t offset = block.length();
+	size_t sealed_length = method_->MaxEncryptedSize(length);
+	block.resize(offset + kBLOCK_HEADER_LENGTH + sealed_length);
+	//直接加密到block中，nonce与tag由nim_encrypt写在密文前后
+	if (!method_->Encrypt(data, length, &block[offset + kBLOCK_HEADER_LENGTH], sealed_length))
+	{
+		block.resize(offset);
+		return false;
+	}
+	NS_EXTENSION::PackBuffer buffer;
+	NS_EXTENSION::Pack pack(buffer);
+	pack.push_uint32(kBLOCK_MAGIC).push_uint32((uint32_t)sealed_length);
+	memcpy(&block[offset], pack.data(), kBLOCK_HEADER_LENGTH);
+	block.resize(offset + kBLOCK_HEADER_LENGTH + sealed_length);
+	return true;
+}
+
+size_t LogBlockEncryptor::DecryptBlock(const char* data, size_t size, std::string& text)
+{
+	if (size < kBLOCK_HEADER_LENGTH + kNONCE_LENGTH + kTAG_LENGTH)
+		return 0;
+	NS_EXTENSION::Unpack unpack(data, size);
+	if (unpack.pop_uint32() != kBLOCK_MAGIC)
+		return 0;
+	uint32_t sealed_length = unpack.pop_uint32();
+	if (sealed_length < kNONCE_LENGTH + kTAG_LENGTH || sealed_length > unpack.size())
+		return 0;
+	size_t offset = text.length();
+	size_t plain_length = method_->MaxDecryptedSize(sealed_length);
+	//多留一个字节，空块时&text[offset]仍然有效
+	text.resize(offset + plain_length + 1);
+	if (!method_->Decrypt(unpack.data(), sealed_length, &text[offset], plain_length))
+	{
+		text.resize(offset);
+		return 0;
+	}
+	text.resize(offset + plain_length);
+	return kBLOCK_HEADER_LENGTH + sealed_length;
+}
+
+int LogBlockEncryptor::Decrypt(const char* data, size_t size, std::string& text)
+{
+	if (method_ == nullptr)
+	{
+		text.append(data, size);
+		return 0;
+	}
+	int count = 0;
+	size_t plain_begin = 0;
+	std::string block_text;
+	for (size_t pos = 0; pos < size;)
+	{
+		block_text.clear();
+		size_t block_length = DecryptBlock(data + pos, size - pos, block_text);
+		if (block_length == 0)
+		{
+			pos++;
+			continue;
+		}
+		if (plain_begin < pos)
+			text.append(data + plain_begin, pos - plain_begin);
+		text.append(block_text);
+		pos += block_length;
+		plain_begin = pos;
+		count++;
+	}
+	if (plain_begin < size)
+		text.append(data + plain_begin, size - plain_begin);
+	return count;
+}
+
+NIMLOG_END_DECLS
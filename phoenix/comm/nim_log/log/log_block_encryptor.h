@@ -0,0 +1,41 @@
+#ifndef __BASE_EXTENSION_LOG_BLOCK_ENCRYPTOR_H__
+#define __BASE_EXTENSION_LOG_BLOCK_ENCRYPTOR_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include <string>
+#include "nim_encrypt/wrapper/nim_encrypt.h"
+
+NIMLOG_BEGIN_DECLS
+
+//mmap缓冲区写入日志文件时按块加密，每次写入文件的数据（开启压缩时为压缩后的块）加密成一个AES-256-GCM块
+//块格式：magic(uint32) + 密文长度(uint32) + nonce(12字节) + 密文 + tag(16字节)，长度字段为小端序，包含nonce与tag
+//每块使用随机的nonce，块之间相互独立，文件被截断或局部损坏时，其余的块仍然可以解密
+//注意mmap缓冲区文件本身仍是明文，只保留最近一个缓冲区的内容
+class NIMLOG_EXPORT LogBlockEncryptor
+{
+public:
+	static const uint32_t kBLOCK_MAGIC = 0x45474C4E;
+	static const size_t kBLOCK_HEADER_LENGTH = 8;
+	static const size_t kNONCE_LENGTH = 12;
+	static const size_t kTAG_LENGTH = 16;
+public:
+	//key不足32字节时按nim_encrypt的规则扩展，加解密需使用相同的key
+	explicit LogBlockEncryptor(const std::string& key);
+	~LogBlockEncryptor();
+public:
+	bool IsValid() const { return method_ != nullptr; }
+	//把data加密成一个块追加到block，失败时返回false且block不变
+	bool Encrypt(const char* data, size_t length, std::string& block);
+	//解密data中的全部块并追加到text，无法识别或校验失败的字节（如未开启加密时写入的文本）原样保留
+	//返回解密出的块数
+	int Decrypt(const char* data, size_t size, std::string& text);
+private:
+	//尝试在data处解出一个块并追加到text，返回块的总长度，不是有效的块时返回0
+	size_t DecryptBlock(const char* data, size_t size, std::string& text);
+private:
+	NS_NIMENCRYPT::SymmetricEncryptMethod method_;//加解密上下文跨块复用，保留密钥扩展的结果
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_BLOCK_ENCRYPTOR_H__
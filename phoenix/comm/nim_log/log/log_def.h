@@ -2,6 +2,7 @@
 #define __BASE_EXTENSION_LOGDEF_H__
 #include "nim_log/config/build_config.h"
 #include "nim_log/nim_log_export.h"
+#include <atomic>
 #include <memory>
 #include <string>
 NIMLOG_BEGIN_DECLS
@@ -16,6 +17,80 @@ enum LOG_LEVEL
 	LV_APP = 5,
 	LV_PRO = 6
 };
+//异步模式下写入队列已满时的处理策略
+enum LOG_BACKPRESSURE_POLICY
+{
+	LBP_BLOCK = 0,				//阻塞写日志的线程直到队列有空余
+	LBP_DROP_LOWEST_LEVEL = 1,	//丢弃队列中（含本条）级别最低的一条日志
+	LBP_SPILL = 2				//由写日志的线程同步写入文件
+};
+struct LogAsyncConfig
+{
+	LogAsyncConfig() :
+		enable_(false), max_queue_size_(4096), max_batch_size_(256), policy_(LBP_BLOCK),
+		enable_thread_staging_(false), thread_staging_size_(64 * 1024)
+	{
+	}
+	bool enable_;//是否开启异步写日志
+	size_t max_queue_size_;//队列中最多缓存的日志条数
+	size_t max_batch_size_;//写线程每次最多合并写入的日志条数
+	LOG_BACKPRESSURE_POLICY policy_;//队列满时的处理策略
+	bool enable_thread_staging_;//是否为每个写日志的线程分配独立的无锁缓冲区
+	size_t thread_staging_size_;//每个线程缓冲区的字节数，缓冲区满时退回到队列模式
+};
+//日志文件的记录格式
+enum LOG_FILE_FORMAT
+{
+	LFF_TEXT = 0,	//格式化好的文本
+	LFF_BINARY = 1	//格式串编号+原始参数，需要用LogBinaryDecoder解码后查看
+};
+struct LogFileConfig
+{
+	LogFileConfig() :
+		mmap_length_(64 * 1024), max_file_length_(8 * 1024 * 1024),
+		enable_segment_(false), max_segment_count_(5), segment_interval_seconds_(0),
+		format_(LFF_TEXT), enable_compress_(false), enable_multi_process_(false)
+	{
+	}
+	int mmap_length_;//mmap缓冲区的大小，缓冲区写满后才会写入日志文件
+	int64_t max_file_length_;//单个日志文件的最大长度
+	bool enable_segment_;//是否开启分段模式：日志文件写满后滚动为 log.0, log.1, ...（log.0最新）；未开启时只保留一个历史文件log.0
+	int max_segment_count_;//分段模式下保留的历史分段个数
+	int64_t segment_interval_seconds_;//分段模式下按时间滚动的间隔，0表示只按大小滚动
+	LOG_FILE_FORMAT format_;//日志记录的格式
+	bool enable_compress_;//mmap缓冲区写入日志文件时是否按块deflate压缩，需要用LogBlockCompressor::Decompress解压后查看
+	std::string encrypt_key_;//不为空时mmap缓冲区写入日志文件时按块AES-GCM加密（在压缩之后），需要用LogBlockEncryptor::Decrypt解密后查看
+	bool enable_multi_process_;//多个进程是否写同一个日志文件：每个进程使用自己的mmap缓冲区，以追加方式整块写入日志文件，滚动时加跨进程的锁
+};
+struct LogRateLimitConfig
+{
+	LogRateLimitConfig() :
+		enable_(false), messages_per_second_(20), burst_(50)
+	{
+	}
+	bool enable_;//是否按调用点（__FILE__/__LINE__）限制日志频率
+	uint32_t messages_per_second_;//每个调用点每秒补充的令牌数
+	uint32_t burst_;//每个调用点最多积攒的令牌数，即允许的突发条数
+};
+//mmap缓冲区写入日志文件的时机，缓冲区写满和Close时总会写入
+enum LOG_FLUSH_POLICY
+{
+	LFP_ALWAYS = 0,		//每次Flush都立即写入日志文件，清空缓冲区后同步mmap文件
+	LFP_NEVER = 1,		//Flush只写完异步队列，依靠mmap文件保证进程崩溃后日志不丢，下次启动时补写
+	LFP_PERIODIC = 2,	//有日志写入后最迟flush_interval_ms_写入一次，异步模式下由写线程定时执行，Flush同LFP_NEVER
+	LFP_ON_LEVEL = 3,	//写入级别不低于flush_level_的日志后立即写入，连续的多条只写一次，Flush同LFP_NEVER
+	LFP_GROUP = 4		//合并间隔小于flush_interval_ms_的Flush：距上次写入已超过间隔时立即写入，否则推迟到间隔结束时写一次
+};
+struct LogFlushConfig
+{
+	LogFlushConfig() :
+		policy_(LFP_ALWAYS), flush_interval_ms_(1000), flush_level_(LV_ERR)
+	{
+	}
+	LOG_FLUSH_POLICY policy_;
+	int64_t flush_interval_ms_;//LFP_PERIODIC/LFP_GROUP的间隔
+	LOG_LEVEL flush_level_;//LFP_ON_LEVEL触发写入的最低级别
+};
 class NIMLOG_EXPORT ILogMessage
 {
 public:
@@ -45,11 +120,29 @@ public:
 	virtual ~ILogger() = default;
 public:
 	virtual void SetLogFile(const std::string &file_path) = 0;
+	virtual void SetLogFile(const std::string &file_path, const LogFileConfig& config) = 0;
 	virtual std::string GetLogFile() = 0;
 	virtual void SetLogLevel(LOG_LEVEL lv) = 0;
 	virtual LOG_LEVEL GetLogLevel() = 0;
+	virtual void SetAsyncMode(const LogAsyncConfig& config) = 0;
+	virtual void SetRateLimit(const LogRateLimitConfig& config) = 0;
+	//按调用点限流，被抑制的日志返回false；调用点恢复输出时先写一条"suppressed N messages"的汇总日志
+	virtual bool AllowLog(const char* file, long line, LOG_LEVEL lv) = 0;
+	//只有LFP_ALWAYS在清空mmap缓冲区后同步mmap文件，其它策略交给系统回写
+	virtual void SetFlushPolicy(const LogFlushConfig& config) = 0;
+	//写完异步队列，按刷新策略决定是否把mmap缓冲区写入日志文件
 	virtual bool Flush() = 0;
+	//不受刷新策略影响，立即把mmap缓冲区写入日志文件，用于退出和打包上传前
+	virtual bool FlushNow() = 0;
 	virtual void Release() = 0;
+public:
+	//不经过虚函数判断是否开启了限流，未开启时日志宏不调用AllowLog
+	bool IsRateLimitEnabled() const { return rate_limit_enabled_.load(std::memory_order_relaxed); }
+protected:
+	//由实现的SetRateLimit调用
+	void SetRateLimitEnabled(bool enabled) { rate_limit_enabled_.store(enabled, std::memory_order_relaxed); }
+private:
+	std::atomic_bool rate_limit_enabled_{ false };
 };
 using Logger = std::shared_ptr<ILogger>;
 template<class T>
@@ -60,7 +153,7 @@ class NIMLOG_EXPORT ILogWriter
 public:
 	virtual ~ILogWriter() = default;
 protected:
-	virtual void WriteLog(LOG_LEVEL lv, const std::string &log) = 0;
+	virtual void WriteLog(LOG_LEVEL lv, const char* log, size_t length) = 0;
 };
 template<typename T>
 using LogWriter = std::shared_ptr<ILogWriter<T>>;
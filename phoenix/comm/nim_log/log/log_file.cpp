@@ -1,8 +1,12 @@
 #include "nim_log/log/log_file.h"
+#include <cstring>
+#include <vector>
 #include "nim_log/config/build_config.h"
-#include <fstream>
 #include "extension/file_util/utf8_file_util.h"
 #include "extension/strings/string_util.h"
+#include "extension/time/coarse_clock.h"
+#include "base/trace_event/trace_event.h"
+#include "base/process/process_handle.h"
 #include "nim_log/config/build_config.h"
 #include "nim_log/log/log_file.h"
 
@@ -10,22 +14,50 @@
 NIMLOG_BEGIN_DECLS
 
 LogFile::LogFile() :
-	mmap_file_(nullptr)
+	mmap_file_(nullptr),
+	log_file_handle_(INVALID_LOG_FILE_HANDLE),
+	lock_file_handle_(INVALID_LOG_FILE_HANDLE),
+	sync_mapping_(true),
+	log_file_length_(0),
+	segment_begin_time_(0)
 {
 }
 LogFile::~LogFile()
 {
-
+	CloseLogFile();
 }
 const int LogFile::kMAX_LOGFILE_LENGTH = 8 * 1024*1024;
 bool LogFile::Init(const std::string& log_file_path)
 {
+	return Init(log_file_path, config_);
+}
+bool LogFile::Init(const std::string& log_file_path, const LogFileConfig& config)
+{
+	TRACE_EVENT1("nim.log", "LogFile::Init", "path", TRACE_STR_COPY(log_file_path.c_str()));
 	log_file_path_ = log_file_path;
+	config_ = config;
+	if (config_.max_file_length_ <= 0)
+		config_.max_file_length_ = kMAX_LOGFILE_LENGTH;
+	if (config_.max_segment_count_ <= 0)
+		config_.max_segment_count_ = 1;
+	if (config_.enable_compress_ && compressor_ == nullptr)
+		compressor_ = std::make_unique<LogBlockCompressor>();
+	else if (!config_.enable_compress_)
+		compressor_.reset();
+	if (!config_.encrypt_key_.empty())
+		encryptor_ = std::make_unique<LogBlockEncryptor>(config_.encrypt_key_);
+	else
+		encryptor_.reset();
+	OpenLogFile();
 	if (mmap_file_ == nullptr)
 	{
-		mmap_file_ = std::make_unique<MMapFile>();
+		//还没有开始写日志，这时合并不会与写日志的线程同时写文件
+		if (config_.enable_multi_process_)
+			MergeOrphanMMapFiles();
+		mmap_file_ = std::make_unique<MMapFile>(config_.mmap_length_);
 		mmap_file_->AttachOverflowException(std::bind(&LogFile::OnMappingFileOverflow, this, std::placeholders::_1));
-		if (!mmap_file_->Create(log_file_path_))
+		mmap_file_->SetSyncOnReset(sync_mapping_);
+		if (!mmap_file_->Create(GetMMapLogPath(), config_.enable_multi_process_))
 			return false;
 	}
 	if (!mmap_file_->IsInited())
@@ -37,63 +69,242 @@ void LogFile::WriteLog(const std::string& msg)
 	mmap_file_->Write(msg);
 }
 
+void LogFile::WriteLog(const char* msg, size_t length)
+{
+	mmap_file_->Write(msg, (int)length);
+}
+
 bool LogFile::Flush()
 {
 	return mmap_file_->Flush();
 }
 
+void LogFile::SetSyncMapping(bool sync)
+{
+	sync_mapping_ = sync;
+	if (mmap_file_ != nullptr)
+		mmap_file_->SetSyncOnReset(sync);
+}
+
+bool LogFile::OpenLogFile()
+{
+	if (log_file_handle_ != INVALID_LOG_FILE_HANDLE)
+		return true;
+	log_file_handle_ = OSFileSysUtil::CreateOSFile(log_file_path_, true);
+	if (log_file_handle_ == INVALID_LOG_FILE_HANDLE)
+		return false;
+	log_file_length_ = OSFileSysUtil::GetFileLength(log_file_handle_);
+	segment_begin_time_ = NS_EXTENSION::CoarseClock::NowMs() / 1000;
+	if (log_file_length_ == 0 && file_header_callback_ != nullptr)
+	{
+		std::string header = file_header_callback_();
+		if (!header.empty())
+			WriteLogFile(header.data(), header.length());
+	}
+	return true;
+}
+
+bool LogFile::WriteLogFile(const char* data, size_t length)
+{
+	if (compressor_ != nullptr)
+	{
+		compress_buffer_.clear();
+		//压缩失败时退回到写入原文，解压时会原样保留
+		if (compressor_->Compress(data, length, compress_buffer_))
+		{
+			data = compress_buffer_.data();
+			length = compress_buffer_.length();
+		}
+	}
+	if (encryptor_ != nullptr)
+	{
+		encrypt_buffer_.clear();
+		//加密失败时不能退回到写入明文，返回false，mmap缓冲区不会被清空
+		if (!encryptor_->Encrypt(data, length, encrypt_buffer_))
+			return false;
+		data = encrypt_buffer_.data();
+		length = encrypt_buffer_.length();
+	}
+	if (!OSFileSysUtil::WriteFile(log_file_handle_, data, length))
+		return false;
+	log_file_length_ += length;
+	return true;
+}
+
+void LogFile::CloseLogFile()
+{
+	if (log_file_handle_ == INVALID_LOG_FILE_HANDLE)
+		return;
+	OSFileSysUtil::CloseFile(log_file_handle_);
+	log_file_handle_ = INVALID_LOG_FILE_HANDLE;
+}
+
 bool LogFile::OnMappingFileOverflow(const std::string& text)
 {
-	std::ofstream log_file(log_file_path_, std::ios::app | std::ios::out);
-	if (log_file.is_open())
+	if (config_.enable_multi_process_)
+		return WriteSharedLogFile(text);
+	if (config_.enable_segment_ && NeedRollSegment())
+		RollSegment(config_.max_segment_count_);
+	if (!OpenLogFile())
+		return false;
+	if (!WriteLogFile(text.data(), text.length()))
+		return false;
+	if (config_.enable_segment_)
 	{
-		log_file << text;
-		log_file.close();
+		if (NeedRollSegment())
+			RollSegment(config_.max_segment_count_);
+		return true;
 	}
+	if (log_file_length_ < config_.max_file_length_ / 2)
+		return true;
 	return ShrinkLogFile();
 }
-bool LogFile::ShrinkLogFile()
+
+bool LogFile::WriteSharedLogFile(const std::string& text)
+{
+	//各进程都以追加方式整块写入，块之间不会交错；其它进程滚动后当前句柄指向的是log.0，需要重新打开
+	if (log_file_handle_ != INVALID_LOG_FILE_HANDLE && !OSFileSysUtil::IsSameFile(log_file_handle_, log_file_path_))
+		CloseLogFile();
+	if (!OpenLogFile())
+		return false;
+	if (!WriteLogFile(text.data(), text.length()))
+		return false;
+	//文件长度包含其它进程写入的部分
+	log_file_length_ = OSFileSysUtil::GetFileLength(log_file_handle_);
+	bool need_roll = config_.enable_segment_ ? NeedRollSegment() : log_file_length_ >= config_.max_file_length_ / 2;
+	if (!need_roll || !LockSharedLogFile())
+		return true;
+	//等锁期间其它进程可能已经滚动过，这时只需重新打开
+	if (OSFileSysUtil::IsSameFile(log_file_handle_, log_file_path_))
+	{
+		RollSegment(config_.enable_segment_ ? config_.max_segment_count_ : 1);
+	}
+	else
+	{
+		CloseLogFile();
+		OpenLogFile();
+	}
+	UnlockSharedLogFile();
+	return true;
+}
+
+void LogFile::MergeOrphanMMapFiles()
 {
-	bool ret = true;		
-	std::fstream fin(log_file_path_, std::ios::in | std::ios::out /*| std::ios::_Nocreate*/);
-		
-	if (fin.is_open() )
+	std::string directory, file_name;
+	if (!NS_EXTENSION::FilePathApartDirectory(log_file_path_, directory) ||
+		!NS_EXTENSION::FilePathApartFileName(log_file_path_, file_name))
+		return;
+	std::vector<std::string> paths;
+	//未开启多进程模式时留下的 log.nim_mmap 与其它进程的 log.<pid>.nim_mmap
+	paths.push_back(MMapFile::GetFilePath(log_file_path_));
+	NS_EXTENSION::FileEnumerator enumerator(directory, false, base::FileEnumerator::FILES, MMapFile::GetFilePath(file_name + ".*"));
+	for (base::FilePath path = enumerator.Next(); !path.empty(); path = enumerator.Next())
+		paths.push_back(path.AsUTF8Unsafe());
+	std::string own_path = MMapFile::GetFilePath(GetMMapLogPath());
+	for (auto& path : paths)
 	{
-		fin.seekg(0, std::ios::end);                      // 设置指针到文件流尾部
-		int len = fin.tellg();                  // 指针距离文件头部的距离，即为文件流大小		
-		if (len >= kMAX_LOGFILE_LENGTH)
+		if (path == own_path || !NS_EXTENSION::FilePathIsExist(path, false))
+			continue;
+		//进程还在运行时持有它的mmap文件的锁，拿不到锁的跳过
+		LOG_FILE_HANDLE file = OSFileSysUtil::CreateOSFile(path, false, false);
+		if (file == INVALID_LOG_FILE_HANDLE)
+			continue;
+		if (!OSFileSysUtil::LockFile(file, false))
 		{
-			std::string temp(log_file_path_);
-			temp.append(".tmp");
-			std::fstream fout(temp, std::ios::out | std::ios::trunc);
-			if (fout.is_open())
+			OSFileSysUtil::CloseFile(file);
+			continue;
+		}
+		std::string data;
+		const size_t header_length = sizeof(int);
+		if (NS_EXTENSION::ReadFileToString(path, data) && data.length() > header_length)
+		{
+			int text_length;
+			memcpy(&text_length, data.data(), header_length);
+			if (text_length > 0 && (size_t)text_length <= data.length() - header_length)
 			{
-				fin.seekg(0, std::ios::beg);
-				fin.seekg(-kMAX_LOGFILE_LENGTH / 2, std::ios::end);
-				char buffer[1024 * 8];
-				static const int buffer_legth = 1024 * 8;
-				memset(buffer, 0, buffer_legth * sizeof(char));
-				while (!fin.eof())
-				{
-					fin.read(buffer, buffer_legth);
-					fout << buffer;
-					memset(buffer, 0, buffer_legth * sizeof(char));
-				}
-				fout.close();
-				fin.close();
-				NS_EXTENSION::DeleteFile(log_file_path_);
-				NS_EXTENSION::MoveFile(temp,log_file_path_);
+				std::string text("\r\n -----------------------load from mmap file of exited process begin-----------------------\r\n");
+				text.append(data, header_length, text_length);
+				text.append("\r\n -----------------------load from mmap file of exited process end-----------------------\r\n");
+				WriteSharedLogFile(text);
 			}
 		}
-		if(fin.is_open())
-			fin.close();
+		//持有锁时删除，不会被两个进程重复合并
+		NS_EXTENSION::DeleteFile(path);
+		OSFileSysUtil::CloseFile(file);
+	}
+}
+
+bool LogFile::LockSharedLogFile()
+{
+	if (lock_file_handle_ == INVALID_LOG_FILE_HANDLE)
+		lock_file_handle_ = OSFileSysUtil::CreateOSFile(log_file_path_ + ".lock", true, false);
+	return OSFileSysUtil::LockFile(lock_file_handle_, true);
+}
+
+void LogFile::UnlockSharedLogFile()
+{
+	OSFileSysUtil::UnlockFile(lock_file_handle_);
+}
+
+bool LogFile::NeedRollSegment() const
+{
+	if (log_file_length_ >= config_.max_file_length_)
+		return true;
+	if (config_.segment_interval_seconds_ > 0 && log_file_length_ > 0)
+		return NS_EXTENSION::CoarseClock::NowMs() / 1000 - segment_begin_time_ >= config_.segment_interval_seconds_;
+	return false;
+}
+
+std::string LogFile::GetMMapLogPath() const
+{
+	//多进程模式下每个进程使用自己的mmap缓冲区：log.<pid>.nim_mmap
+	if (!config_.enable_multi_process_)
+		return log_file_path_;
+	return log_file_path_ + "." + std::to_string((int64_t)base::GetCurrentProcId());
+}
+
+std::string LogFile::GetSegmentPath(int index) const
+{
+	std::string path(log_file_path_);
+	path.append(".").append(std::to_string(index));
+	return path;
+}
+
+bool LogFile::RollSegment(int segment_count)
+{
+	TRACE_EVENT1("nim.log", "LogFile::RollSegment", "segments", segment_count);
+	CloseLogFile();
+	//log.(n-1)被删除，log.i -> log.(i+1)，当前日志文件 -> log.0
+	std::string oldest = GetSegmentPath(segment_count - 1);
+	if (NS_EXTENSION::FilePathIsExist(oldest, false))
+		NS_EXTENSION::DeleteFile(oldest);
+	for (int index = segment_count - 2; index >= 0; index--)
+	{
+		std::string from = GetSegmentPath(index);
+		if (NS_EXTENSION::FilePathIsExist(from, false))
+			NS_EXTENSION::MoveFile(from, GetSegmentPath(index + 1));
 	}
+	bool ret = NS_EXTENSION::MoveFile(log_file_path_, GetSegmentPath(0));
+	OpenLogFile();
 	return ret;
 }
+
+bool LogFile::ShrinkLogFile()
+{
+	//不再读出后半部分重写文件，而是把当前文件整体改名为log.0并重新开始写，代价与文件大小无关
+	//每个文件只写到上限的一半，这样log与log.0加起来仍接近原来的上限
+	return RollSegment(1);
+}
 void LogFile::Close()
 {
 	mmap_file_->Close();
 	mmap_file_.release();
+	CloseLogFile();
+	if (lock_file_handle_ != INVALID_LOG_FILE_HANDLE)
+	{
+		OSFileSysUtil::CloseFile(lock_file_handle_);
+		lock_file_handle_ = INVALID_LOG_FILE_HANDLE;
+	}
 }
 
 NIMLOG_END_DECLS
@@ -2,10 +2,16 @@
 #define __BASE_EXTENSION_LOG_FILE_H__
 #include "nim_log/nim_log_export.h"
 #include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
 #include <string>
 #include <atomic>
 #include <mutex>
 #include <memory>
+#include <functional>
+#include "nim_log/log/log_block_compressor.h"
+#include "nim_log/log/log_block_encryptor.h"
+#include "extension/synchronization/adaptive_lock.h"
+#include "extension/synchronization/lock_profiler.h"
 
 NIMLOG_BEGIN_DECLS
 
@@ -21,10 +27,11 @@ class NIMLOG_EXPORT LogFile
 	class NIMLOG_EXPORT MMapFile
 	{
 	public:
-		MMapFile();
+		explicit MMapFile(int max_length = kMAX_LENGTH_);
 		~MMapFile();
 	public:
-		bool Create(const std::string& log_path);
+		//lock为true时持有mmap文件的跨进程锁直到Close，多进程模式下其它进程据此判断该缓冲区的进程是否还在运行
+		bool Create(const std::string& log_path, bool lock = false);
 		bool Close();
 		int UpdateCurrentLength(int length);
 		bool Init();
@@ -32,18 +39,27 @@ class NIMLOG_EXPORT LogFile
 		bool Flush();
 		bool Reset();
 		int Write(const std::string& text);
+		int Write(const char* text, int length);
 		int Length();
+		//清空缓冲区后是否同步mmap文件，见LOG_FLUSH_POLICY
+		void SetSyncOnReset(bool sync) { sync_on_reset_ = sync; }
+		static std::string GetFilePath(const std::string& log_path);
 		void AttachOverflowException(const std::function<bool(const std::string& text)>& callback)
 		{
 			overflow_callback_ = callback;
 		}
 	private:
 		int Read(std::string& data);
+		//以下需持有 mutex_
+		int ReadLocked(std::string& data);
+		int LengthLocked();
+		void ResetLocked();
 		bool CheckMMapLogFile(const std::string& mmap_file_path,int max_length);
 	private:
-		const static int kMAX_LENGTH_;//最大的长度
+		const static int kMAX_LENGTH_;//缺省的最大长度
 		const static std::string kMMapFileExt_;
-		std::recursive_mutex mutex_;
+		const int max_length_;//最大的长度
+		NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock> mutex_;//非递归，加锁后只调用 *Locked 版本
 		bool inited_;
 		int current_length_;//当前长度
 		char* current_cursor_;//当前游标地址
@@ -52,6 +68,7 @@ class NIMLOG_EXPORT LogFile
 		LOG_FILE_HANDLE file_handle_;//被映射文件的句柄
 		LOG_FILE_HANDLE mapped_file_handle_;//映射文件的句柄
 		int data_offset_;//数据起始的偏移量
+		std::atomic_bool sync_on_reset_;
 		std::function<bool(const std::string& text)> overflow_callback_;
 	};
 public:
@@ -65,21 +82,59 @@ public:
 		static bool MappingFile(LOG_FILE_HANDLE, int length, LOG_FILE_HANDLE& mapfile, char*& map_addr);
 		static void UnMappingFile(LOG_FILE_HANDLE mapfile, void* map_addr, int size);
 		static bool FlushMappingFile(LOG_FILE_HANDLE file);
+		static bool WriteFile(LOG_FILE_HANDLE file, const char* data, size_t length);
+		//文件的跨进程互斥锁，进程退出时由系统释放；wait为false时不等待，被其它进程持有时返回false
+		static bool LockFile(LOG_FILE_HANDLE file, bool wait);
+		static void UnlockFile(LOG_FILE_HANDLE file);
+		//file_path当前是否仍指向file打开的文件，文件被改名或删除后返回false
+		static bool IsSameFile(LOG_FILE_HANDLE file, const std::string& file_path);
 	};
 public:
 	LogFile();
 	~LogFile();
 	bool Init(const std::string& log_file_path_);
+	bool Init(const std::string& log_file_path_, const LogFileConfig& config);
 	void WriteLog(const std::string& msg);
+	void WriteLog(const char* msg, size_t length);
 	bool Flush();
 	void Close();
+	void SetSyncMapping(bool sync);
+	//每个新创建的日志文件开头写入的内容，二进制格式用它在每个文件中写入格式串字典
+	void AttachFileHeader(const std::function<std::string()>& callback)
+	{
+		file_header_callback_ = callback;
+	}
 private:
 	bool OnMappingFileOverflow(const std::string& text);
+	//多进程模式下写入日志文件并在需要时滚动，见LogFileConfig::enable_multi_process_
+	bool WriteSharedLogFile(const std::string& text);
+	//合并已退出的进程留下的mmap缓冲区
+	void MergeOrphanMMapFiles();
+	bool LockSharedLogFile();
+	void UnlockSharedLogFile();
 	bool ShrinkLogFile();
+	bool OpenLogFile();
+	void CloseLogFile();
+	bool WriteLogFile(const char* data, size_t length);
+	bool NeedRollSegment() const;
+	bool RollSegment(int segment_count);
+	std::string GetSegmentPath(int index) const;
+	std::string GetMMapLogPath() const;
 private:
 	const static int kMAX_LOGFILE_LENGTH;//最大的长度
 	std::unique_ptr< MMapFile> mmap_file_;
 	std::string log_file_path_;
+	LogFileConfig config_;
+	LOG_FILE_HANDLE log_file_handle_;//日志文件保持打开，避免每次溢出都重新打开
+	LOG_FILE_HANDLE lock_file_handle_;//多进程模式下滚动日志文件时持有的锁文件
+	bool sync_mapping_;//mmap_file_创建之前设置的值，创建时传给mmap_file_
+	int64_t log_file_length_;
+	int64_t segment_begin_time_;//当前分段开始的时间(秒)
+	std::function<std::string()> file_header_callback_;
+	std::unique_ptr<LogBlockCompressor> compressor_;
+	std::string compress_buffer_;
+	std::unique_ptr<LogBlockEncryptor> encryptor_;
+	std::string encrypt_buffer_;
 };
 
 NIMLOG_END_DECLS
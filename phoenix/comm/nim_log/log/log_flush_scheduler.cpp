@@ -0,0 +1,88 @@
+#include "nim_log/log/log_flush_scheduler.h"
+#include "extension/time/coarse_clock.h"
+
+NIMLOG_BEGIN_DECLS
+
+LogFlushScheduler::LogFlushScheduler() :
+	policy_(LFP_ALWAYS),
+	interval_ms_(1000),
+	flush_level_(LV_ERR),
+	last_flush_ms_(0),
+	pending_(false)
+{
+}
+
+void LogFlushScheduler::SetConfig(const LogFlushConfig& config)
+{
+	interval_ms_ = config.flush_interval_ms_ > 0 ? config.flush_interval_ms_ : 1;
+	flush_level_ = config.flush_level_;
+	pending_ = false;
+	policy_ = config.policy_;
+}
+
+LogFlushScheduler::FLUSH_ACTION LogFlushScheduler::OnFlushRequest(bool can_defer, int64_t& delay_ms)
+{
+	switch (GetPolicy())
+	{
+	case LFP_ALWAYS:
+		return FA_NOW;
+	case LFP_GROUP:
+	{
+		int64_t now_ms = NS_EXTENSION::CoarseClock::MonotonicMs();
+		//距上次写入已超过间隔，立即写入；同时到达的请求只有一个写入
+		if (now_ms - last_flush_ms_ >= interval_ms_ && !pending_.exchange(true))
+			return FA_NOW;
+		return WaitInterval(now_ms, can_defer, delay_ms);
+	}
+	default:
+		return FA_SKIP;
+	}
+}
+
+LogFlushScheduler::FLUSH_ACTION LogFlushScheduler::OnWriteSlow(int policy, LOG_LEVEL lv, bool can_defer, int64_t& delay_ms)
+{
+	switch (policy)
+	{
+	case LFP_ON_LEVEL:
+		//LOG_LEVEL的值越小级别越高，上一次写入开始之前的多条只写一次
+		if ((int)lv <= flush_level_.load(std::memory_order_relaxed) && !pending_.exchange(true))
+			return FA_NOW;
+		return FA_SKIP;
+	case LFP_PERIODIC:
+		return WaitInterval(NS_EXTENSION::CoarseClock::MonotonicMs(), can_defer, delay_ms);
+	case LFP_GROUP:
+		//只执行已经推迟的写入
+		if (!can_defer && pending_.load(std::memory_order_relaxed))
+			return WaitInterval(NS_EXTENSION::CoarseClock::MonotonicMs(), false, delay_ms);
+		return FA_SKIP;
+	default:
+		return FA_SKIP;
+	}
+}
+
+LogFlushScheduler::FLUSH_ACTION LogFlushScheduler::WaitInterval(int64_t now_ms, bool can_defer, int64_t& delay_ms)
+{
+	int64_t remaining_ms = last_flush_ms_ + interval_ms_ - now_ms;
+	if (can_defer)
+	{
+		if (pending_.exchange(true))
+			return FA_SKIP;
+		delay_ms = remaining_ms > 0 ? remaining_ms : 0;
+		return FA_DEFER;
+	}
+	if (remaining_ms > 0)
+	{
+		pending_ = true;
+		return FA_SKIP;
+	}
+	//间隔已过，多个线程同时到达时可能各写一次，写入本身是加锁的
+	return FA_NOW;
+}
+
+void LogFlushScheduler::BeginFlush()
+{
+	last_flush_ms_ = NS_EXTENSION::CoarseClock::MonotonicMs();
+	pending_ = false;
+}
+
+NIMLOG_END_DECLS
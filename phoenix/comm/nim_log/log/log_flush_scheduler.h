@@ -0,0 +1,54 @@
+#ifndef __BASE_EXTENSION_LOG_FLUSH_SCHEDULER_H__
+#define __BASE_EXTENSION_LOG_FLUSH_SCHEDULER_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <atomic>
+
+NIMLOG_BEGIN_DECLS
+
+//按LogFlushConfig决定什么时候把mmap缓冲区写入日志文件，只做判断，写入由调用者执行
+//can_defer表示调用者能在delay_ms后执行一次写入（异步模式下的写线程）；不能时推迟的写入由间隔结束后的下一次调用执行
+class NIMLOG_EXPORT LogFlushScheduler
+{
+public:
+	enum FLUSH_ACTION
+	{
+		FA_SKIP = 0,	//不需要写入
+		FA_NOW = 1,		//立即写入
+		FA_DEFER = 2	//在delay_ms后写入一次
+	};
+public:
+	LogFlushScheduler();
+	~LogFlushScheduler() = default;
+public:
+	void SetConfig(const LogFlushConfig& config);
+	LOG_FLUSH_POLICY GetPolicy() const { return (LOG_FLUSH_POLICY)policy_.load(std::memory_order_relaxed); }
+	//调用者请求Flush
+	FLUSH_ACTION OnFlushRequest(bool can_defer, int64_t& delay_ms);
+	//写入一条级别为lv的日志之后
+	inline FLUSH_ACTION OnWrite(LOG_LEVEL lv, bool can_defer, int64_t& delay_ms)
+	{
+		//LFP_ALWAYS/LFP_NEVER只读一次原子变量
+		int policy = policy_.load(std::memory_order_relaxed);
+		if (policy == LFP_ALWAYS || policy == LFP_NEVER)
+			return FA_SKIP;
+		return OnWriteSlow(policy, lv, can_defer, delay_ms);
+	}
+	//开始写入前调用，之后的请求会再触发一次写入，保证写入开始前的日志都包含在本次写入中
+	void BeginFlush();
+private:
+	FLUSH_ACTION OnWriteSlow(int policy, LOG_LEVEL lv, bool can_defer, int64_t& delay_ms);
+	//等待间隔结束：还没有推迟的写入时登记一次
+	FLUSH_ACTION WaitInterval(int64_t now_ms, bool can_defer, int64_t& delay_ms);
+private:
+	std::atomic<int> policy_;
+	std::atomic<int64_t> interval_ms_;
+	std::atomic<int> flush_level_;
+	std::atomic<int64_t> last_flush_ms_;//上次开始写入的单调时间
+	std::atomic_bool pending_;//已经决定写入但还没有开始
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_FLUSH_SCHEDULER_H__
@@ -1,24 +1,54 @@
 #include "nim_log/log/log_imp.h"
+#include "nim_log/log/log_module_level.h"
 #include <cassert>
-#include <map>
+#include <cstdio>
+#include <cstring>
 #ifdef _DEBUG
 #include <iostream>
 #endif
+#include "extension/memory/memory_accounting.h"
+#include "extension/memory/memory_trimmer.h"
+#include "extension/time/coarse_clock.h"
 #include "extension/time/time.h"
 #include "extension/strings/string_util.h"
 #include "extension/process/process_util.h"
+#include "extension/thread/thread_manager.h"
+#include "base/trace_event/trace_event.h"
 
 NIMLOG_BEGIN_DECLS
 
 QLogImpl::QLogImpl() :
-	instance_(std::make_unique<LogFile>())
+	instance_(std::make_unique<LogFile>()),
+	async_writer_(nullptr),
+	log_level_(LV_PRO),
+	shutdown_flush_id_(0),
+	memory_trim_id_(0),
+	memory_account_id_(0)
 {
 
 }
 void QLogImpl::SetLogFile(const std::string &file_path)
+{
+	SetLogFile(file_path, LogFileConfig());
+}
+
+void QLogImpl::SetLogFile(const std::string &file_path, const LogFileConfig& config)
 {
 	log_file_ = file_path;
-	instance_->Init(file_path);
+	std::shared_ptr<LogFormatRegistry> registry;
+	if (config.format_ == LFF_BINARY)
+	{
+		registry = std::make_shared<LogFormatRegistry>();
+		instance_->AttachFileHeader([registry]() {
+			return registry->DumpDictionary();
+		});
+	}
+	else
+	{
+		instance_->AttachFileHeader(nullptr);
+	}
+	std::atomic_store(&format_registry_, registry);
+	instance_->Init(file_path, config);
 }
 
 std::string QLogImpl::GetLogFile()
@@ -26,13 +56,162 @@ std::string QLogImpl::GetLogFile()
 	return log_file_;
 }
 
+void QLogImpl::SetAsyncMode(const LogAsyncConfig& config)
+{
+	auto async_writer = std::atomic_load(&async_writer_);
+	if (config.enable_)
+	{
+		if (async_writer != nullptr)
+			return;
+		async_writer = std::make_shared<LogAsyncWriter>(instance_.get());
+		if (async_writer->Start(config))
+		{
+			std::atomic_store(&async_writer_, async_writer);
+			// 退出时和其他组件同时写完队列中的日志
+			std::weak_ptr<QLogImpl> weak_self = shared_from_this();
+			shutdown_flush_id_ = NS_EXTENSION::ThreadManager::RegisterShutdownFlush("nim_log", NS_EXTENSION::TimeDelta::FromMilliseconds(500), [weak_self]() {
+				auto self = weak_self.lock();
+				if (self != nullptr)
+					self->FlushNow();
+			});
+			// 内存紧张时写完队列，释放排队的日志占用的缓冲
+			memory_trim_id_ = NS_EXTENSION::MemoryTrimmer::Register("nim_log", [weak_self](NS_EXTENSION::MemoryTrimLevel) {
+				auto self = weak_self.lock();
+				if (self != nullptr)
+					self->Flush();
+			});
+			//暂存环和队列占用的内存，写线程停止后不再统计
+			std::weak_ptr<LogAsyncWriter> weak_writer = async_writer;
+			memory_account_id_ = NS_EXTENSION::MemoryAccounting::Register("nim_log.async_buffers", [weak_writer]() {
+				auto writer = weak_writer.lock();
+				return writer != nullptr ? (int64_t)writer->GetBufferedBytes() : 0;
+			});
+		}
+	}
+	else if (async_writer != nullptr)
+	{
+		UnregisterAsyncHooks();
+		std::atomic_store(&async_writer_, std::shared_ptr<LogAsyncWriter>());
+		async_writer->Stop();
+	}
+}
+
+void QLogImpl::UnregisterAsyncHooks()
+{
+	if (memory_trim_id_ != 0)
+	{
+		NS_EXTENSION::MemoryTrimmer::Unregister(memory_trim_id_);
+		memory_trim_id_ = 0;
+	}
+	if (memory_account_id_ != 0)
+	{
+		NS_EXTENSION::MemoryAccounting::Unregister(memory_account_id_);
+		memory_account_id_ = 0;
+	}
+	if (shutdown_flush_id_ == 0)
+		return;
+	NS_EXTENSION::ThreadManager::UnregisterShutdownFlush(shutdown_flush_id_);
+	shutdown_flush_id_ = 0;
+}
+
+void QLogImpl::SetRateLimit(const LogRateLimitConfig& config)
+{
+	rate_limiter_.SetConfig(config);
+	SetRateLimitEnabled(config.enable_);
+}
+
+bool QLogImpl::AllowLog(const char* file, long line, LOG_LEVEL lv)
+{
+	if (!rate_limiter_.IsEnabled())
+		return true;
+	uint64_t suppressed_count = 0;
+	if (!rate_limiter_.Acquire(file, line, lv, suppressed_count))
+		return false;
+	if (suppressed_count > 0)
+		WriteSuppressedSummary(file, line, lv, suppressed_count);
+	return true;
+}
+
+void QLogImpl::WriteSuppressedSummary(const char* file, long line, LOG_LEVEL lv, uint64_t count)
+{
+	LogMessageImpl message(file, line, shared_from_this());
+	message.VLog(lv, "[rate limit] suppressed {0} messages from {1}:{2}") << count << file << line;
+}
+
+void QLogImpl::SetFlushPolicy(const LogFlushConfig& config)
+{
+	flush_scheduler_.SetConfig(config);
+	instance_->SetSyncMapping(config.policy_ == LFP_ALWAYS);
+}
+
+void QLogImpl::WritePendingSummaries()
+{
+	//已停止输出的调用点不会再触发汇总，在这里补写
+	if (rate_limiter_.IsEnabled())
+	{
+		rate_limiter_.TakeSuppressed([this](const char* file, long line, LOG_LEVEL lv, uint64_t count) {
+			WriteSuppressedSummary(file, line, lv, count);
+		});
+	}
+}
+
 bool QLogImpl::Flush()
 {
+	TRACE_EVENT0("nim.log", "QLogImpl::Flush");
+	WritePendingSummaries();
+	auto async_writer = std::atomic_load(&async_writer_);
+	int64_t delay_ms = 0;
+	LogFlushScheduler::FLUSH_ACTION action = flush_scheduler_.OnFlushRequest(async_writer != nullptr, delay_ms);
+	if (action == LogFlushScheduler::FA_NOW)
+		return FlushFile();
+	if (async_writer != nullptr)
+		async_writer->Drain();
+	RunFlushAction(action, delay_ms, async_writer);
+	return true;
+}
+
+bool QLogImpl::FlushNow()
+{
+	TRACE_EVENT0("nim.log", "QLogImpl::FlushNow");
+	WritePendingSummaries();
+	return FlushFile();
+}
+
+bool QLogImpl::FlushFile()
+{
+	flush_scheduler_.BeginFlush();
+	auto async_writer = std::atomic_load(&async_writer_);
+	if (async_writer != nullptr)
+		async_writer->Drain();
 	return instance_->Flush();
 }
 
+void QLogImpl::RunFlushAction(LogFlushScheduler::FLUSH_ACTION action, int64_t delay_ms, const std::shared_ptr<LogAsyncWriter>& async_writer)
+{
+	if (action == LogFlushScheduler::FA_SKIP)
+		return;
+	if (async_writer != nullptr)
+	{
+		std::weak_ptr<QLogImpl> weak_self = shared_from_this();
+		bool posted = async_writer->PostDelayedTask(action == LogFlushScheduler::FA_NOW ? 0 : delay_ms, [weak_self]() {
+			auto self = weak_self.lock();
+			if (self != nullptr)
+				self->FlushFile();
+		});
+		if (posted)
+			return;
+	}
+	//同步模式或写线程已停止时在当前线程写入
+	FlushFile();
+}
+
 void QLogImpl::Release()
 {
+	TRACE_EVENT0("nim.log", "QLogImpl::Release");
+	UnregisterAsyncHooks();
+	auto async_writer = std::atomic_exchange(&async_writer_, std::shared_ptr<LogAsyncWriter>());
+	if (async_writer != nullptr)
+		async_writer->Stop();
 	instance_->Close();
 }
 
@@ -42,150 +221,394 @@ void QLogImpl::SetLogLevel(LOG_LEVEL lv)
 }
 
 void QLogImpl::WriteLog(LOG_LEVEL lv, const std::string &log)
+{
+	WriteLog(lv, log.data(), log.length());
+}
+
+void QLogImpl::WriteLog(LOG_LEVEL lv, const char* log, size_t length)
 {
 #ifdef _DEBUG
-	std::cout << log.c_str() << std::endl;
+	if (GetFormatRegistry() == nullptr)
+		std::cout.write(log, length) << std::endl;
 #endif
-	if (lv > log_level_)
+	//按模块调高了级别的日志已经在写日志的宏中过滤过，这里同样放行
+	if (lv > log_level_ && (int)lv > LogModuleLevel::GetMaxLevel())
 		return;
 	if (log_file_.empty())
 		return;
-	instance_->WriteLog(log);
+	auto async_writer = std::atomic_load(&async_writer_);
+	if (async_writer != nullptr)
+		async_writer->Push(lv, log, length);
+	else
+		instance_->WriteLog(log, length);
+	int64_t delay_ms = 0;
+	LogFlushScheduler::FLUSH_ACTION action = flush_scheduler_.OnWrite(lv, async_writer != nullptr, delay_ms);
+	if (action != LogFlushScheduler::FA_SKIP)
+		RunFlushAction(action, delay_ms, async_writer);
 }
 
-LogMessageImpl::LogMessageImpl(const char* file, long line, const Logger& writer) :
-	writer_(std::dynamic_pointer_cast<QLogImpl>(writer)), index_(0), level_(LV_PRO)
+void QLogImpl::WriteFormat(const std::shared_ptr<LogFormatRegistry>& registry, uint32_t format_id, const std::string& fmt)
 {
-	NS_EXTENSION::TimeStruct qt;
-	NS_EXTENSION::Time::Now().LocalExplode(&qt);
-	time_ = NS_EXTENSION::StringPrintf("%02d-%02d %02d:%02d:%02d.%03d",
-		qt.month, qt.day_of_month, qt.hour, qt.minute, qt.second, qt.millisecond);
+	if (log_file_.empty())
+		return;
+	NS_EXTENSION::PackBuffer buffer;
+	LogBinaryEncoder encoder(buffer);
+	encoder.PackFormat(format_id, fmt.data(), fmt.length());
+	instance_->WriteLog(buffer.data(), buffer.size());
+	registry->MarkWritten(format_id);
+}
+
+namespace {
+const char* const kLEVEL_TEXT_LIST[] = {
+	"LV_KER", "LV_ASS", "LV_ERR", "LV_WAR", "LV_INT", "LV_APP", "LV_PRO"
+};
+//每个线程缓存进程/线程ID以及精确到秒的时间前缀，避免每条日志都重新格式化
+struct ThreadLogContext
+{
+	ThreadLogContext() : second(-1), time_prefix_length(0), process_thread_length(0), pid(0), tid(0)
+	{
 #if !defined(OS_IOS)
-	process_thread_.append(std::to_string(NS_EXTENSION::Process::Current().Pid())).append("-").
-		append(std::to_string(NS_EXTENSION::PlatformThread::CurrentId()));
+		pid = (uint32_t)NS_EXTENSION::Process::Current().Pid();
+		tid = (uint32_t)NS_EXTENSION::PlatformThread::CurrentId();
+		process_thread_length = snprintf(process_thread, sizeof(process_thread), "%lld-%lld",
+			(long long)NS_EXTENSION::Process::Current().Pid(), (long long)NS_EXTENSION::PlatformThread::CurrentId());
 #endif
+	}
+	int64_t second;
+	char time_prefix[32];
+	size_t time_prefix_length;
+	char process_thread[48];
+	size_t process_thread_length;
+	uint32_t pid;
+	uint32_t tid;
+};
+thread_local ThreadLogContext tls_log_context;
+//每个线程保留一块LogMessageImpl大小的内存供下一条日志复用
+thread_local void* tls_log_message_block = nullptr;
+}
+
+struct LogMessageImpl::BinaryBlock
+{
+	BinaryBlock() : encoder(buffer) {}
+	NS_EXTENSION::PackBuffer buffer;
+	LogBinaryEncoder encoder;
+};
+
+std::unique_ptr<LogMessageImpl::BinaryBlock>& LogMessageImpl::CachedBinaryBlock()
+{
+	thread_local std::unique_ptr<BinaryBlock> tls_binary_block;
+	return tls_binary_block;
 }
+
+void* LogMessageImpl::operator new(size_t size)
+{
+	if (size == sizeof(LogMessageImpl) && tls_log_message_block != nullptr)
+	{
+		void* ptr = tls_log_message_block;
+		tls_log_message_block = nullptr;
+		return ptr;
+	}
+	return ::operator new(size);
+}
+
+void LogMessageImpl::operator delete(void* ptr)
+{
+	if (ptr != nullptr && tls_log_message_block == nullptr)
+	{
+		tls_log_message_block = ptr;
+		return;
+	}
+	::operator delete(ptr);
+}
+
+LogMessageImpl::LogMessageImpl(const char* file, long line, const Logger& writer) :
+	writer_(std::dynamic_pointer_cast<QLogImpl>(writer)), arg_count_(0), next_arg_(0), fmt_cursor_(0), index_(0), level_(LV_PRO)
+{
+	if (writer_ != nullptr)
+		format_registry_ = std::static_pointer_cast<QLogImpl>(writer_)->GetFormatRegistry();
+}
+
+void LogMessageImpl::AppendHeader()
+{
+	ThreadLogContext& context = tls_log_context;
+	int64_t now_ms = NS_EXTENSION::CoarseClock::NowMs();
+	int64_t second = now_ms / 1000;
+	if (second != context.second)
+	{
+		//每个线程每秒取一次，同一秒的本地时间在进程内只转换一次
+		NS_EXTENSION::TimeStruct qt;
+		NS_EXTENSION::CoarseClock::LocalExplode(second, &qt);
+		context.time_prefix_length = snprintf(context.time_prefix, sizeof(context.time_prefix), "%02d-%02d %02d:%02d:%02d",
+			qt.month, qt.day_of_month, qt.hour, qt.minute, qt.second);
+		context.second = second;
+	}
+	int millisecond = (int)(now_ms % 1000);
+	char ms_text[4] = { '.', (char)('0' + millisecond / 100), (char)('0' + millisecond / 10 % 10), (char)('0' + millisecond % 10) };
+	string_.Append('[');
+	string_.Append(context.time_prefix, context.time_prefix_length);
+	string_.Append(ms_text, sizeof(ms_text));
+	string_.Append(' ');
+	string_.Append(context.process_thread, context.process_thread_length);
+	string_.Append("] [", 3);
+	string_.Append(kLEVEL_TEXT_LIST[level_]);
+	string_.Append("] ", 2);
+}
+
+void LogMessageImpl::AppendTail()
+{
+	if (fmt_cursor_ < fmt_.length())
+		string_.Append(fmt_.data() + fmt_cursor_, fmt_.length() - fmt_cursor_);
+	fmt_cursor_ = fmt_.length();
+	string_.Append(" \n", 2);
+}
+
 std::string LogMessageImpl::TLog()
 {
-	static const char log_format[] = "[%s %s] [%s] %s \n";
-	std::string log_text;
-	if (string_.empty())
-		string_ = fmt_;
-	else if (!fmt_.empty())
-		string_.append(fmt_);
-	return NS_EXTENSION::StringPrintf(log_text, log_format, time_.c_str(), process_thread_.c_str(), lv_.c_str(), string_.c_str());
+	if (binary_ != nullptr)
+		return std::string(binary_->buffer.data(), binary_->buffer.size());
+	std::string log_text(string_.data(), string_.length());
+	if (fmt_cursor_ < fmt_.length())
+		log_text.append(fmt_.data() + fmt_cursor_, fmt_.length() - fmt_cursor_);
+	log_text.append(" \n");
+	return log_text;
 }
 
 LogMessageImpl::~LogMessageImpl()
 {
-	if(writer_ != nullptr)
-		writer_->WriteLog(level_, TLog());
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.EndMessage();
+		writer_->WriteLog(level_, binary_->buffer.data(), binary_->buffer.size());
+		binary_->buffer.resize(0);
+		auto& cached = CachedBinaryBlock();
+		if (cached == nullptr)
+			cached = std::move(binary_);
+	}
+	else if (writer_ != nullptr)
+	{
+		AppendTail();
+		writer_->WriteLog(level_, string_.data(), string_.length());
+	}
 }
 
 ILogMessage& LogMessageImpl::VLog(LOG_LEVEL lv, const std::string &fmt)
 {
-	static std::map< LOG_LEVEL, std::string> kLEVEL_TEXT_LIST = {
-		{LV_KER,"LV_KER"},	{LV_ASS,"LV_ASS"},{LV_ERR,"LV_ERR"},
-		{LV_WAR,"LV_WAR"},{LV_INT,"LV_INT"},{LV_APP,"LV_APP"},
-		{LV_PRO,"LV_PRO"}
-	};
-	level_ = lv;
-	fmt_ = fmt;
-	lv_.append(kLEVEL_TEXT_LIST[level_]);
+	level_ = (lv >= LV_KER && lv <= LV_PRO) ? lv : LV_PRO;
+	if (format_registry_ != nullptr)
+	{
+		BeginBinary(fmt);
+		return *((ILogMessage*)this);
+	}
+	fmt_.Clear();
+	fmt_.Append(fmt.data(), fmt.length());
+	fmt_cursor_ = 0;
+	ParseArgs();
+	AppendHeader();
 	return *((ILogMessage*)this);
 }
 
-ILogMessage& LogMessageImpl::operator<<(const std::string &str)
+void LogMessageImpl::BeginBinary(const std::string &fmt)
 {
-	int len = 0;
-	size_t pos = FindArg(len);
-	if (pos == std::string::npos)
+	if (binary_ == nullptr)
+	{
+		auto& cached = CachedBinaryBlock();
+		if (cached != nullptr)
+			binary_ = std::move(cached);
+		else
+			binary_ = std::make_unique<BinaryBlock>();
+	}
+	binary_->buffer.resize(0);
+	bool is_new = false;
+	uint32_t format_id = format_registry_->Register(fmt, is_new);
+	//字典记录写入文件之后才把日志交给writer_，异步模式下日志被丢弃也不影响之后同一格式串的日志解码
+	if (is_new)
+		std::static_pointer_cast<QLogImpl>(writer_)->WriteFormat(format_registry_, format_id, fmt);
+	const ThreadLogContext& context = tls_log_context;
+	binary_->encoder.BeginMessage(format_id, level_, NS_EXTENSION::CoarseClock::NowMs(), context.pid, context.tid);
+}
+
+void LogMessageImpl::ParseArgs()
+{
+	arg_count_ = 0;
+	next_arg_ = 0;
+	const char* data = fmt_.data();
+	size_t length = fmt_.length();
+	for (size_t pos = 0; pos + 2 < length && arg_count_ < kMAX_ARG_COUNT; pos++)
+	{
+		if (data[pos] != '{')
+			continue;
+		size_t end = pos + 1;
+		int index = 0;
+		while (end < length && data[end] >= '0' && data[end] <= '9')
+			index = index * 10 + (data[end++] - '0');
+		if (end == pos + 1 || end >= length || data[end] != '}')
+			continue;
+		args_[arg_count_].pos = pos;
+		args_[arg_count_].length = end - pos + 1;
+		args_[arg_count_].index = index;
+		arg_count_++;
+		pos = end;
+	}
+}
+
+ILogMessage& LogMessageImpl::AppendArg(const char* data, size_t length)
+{
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.AppendString(data, length);
+		index_++;
+		return *((ILogMessage*)this);
+	}
+	assert(index_ >= 0 && index_ <= 20);
+	//与逐次查找"{index_}"等价：从当前位置向后找第一个编号匹配的占位符
+	int arg = next_arg_;
+	while (arg < arg_count_ && (args_[arg].index != index_ || args_[arg].pos < fmt_cursor_))
+		arg++;
+	if (arg >= arg_count_)
 	{
 		assert(0);
 	}
 	else
 	{
-		string_.append(fmt_.substr(0, pos));
-		string_.append(str);
-		fmt_.erase(0, pos + len);
+		const ArgPlaceholder& holder = args_[arg];
+		string_.Append(fmt_.data() + fmt_cursor_, holder.pos - fmt_cursor_);
+		string_.Append(data, length);
+		fmt_cursor_ = holder.pos + holder.length;
+		next_arg_ = arg + 1;
 	}
 	index_++;
 	return *((ILogMessage*)this);
 }
 
+ILogMessage& LogMessageImpl::AppendSigned(int64_t value)
+{
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.AppendSigned(value);
+		index_++;
+		return *((ILogMessage*)this);
+	}
+	if (value >= 0)
+		return AppendUnsigned((uint64_t)value);
+	char buffer[24];
+	char* end = buffer + sizeof(buffer);
+	char* cursor = end;
+	uint64_t abs_value = (uint64_t)0 - (uint64_t)value;
+	do
+	{
+		*--cursor = (char)('0' + abs_value % 10);
+		abs_value /= 10;
+	} while (abs_value != 0);
+	*--cursor = '-';
+	return AppendArg(cursor, end - cursor);
+}
+
+ILogMessage& LogMessageImpl::AppendUnsigned(uint64_t value)
+{
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.AppendUnsigned(value);
+		index_++;
+		return *((ILogMessage*)this);
+	}
+	char buffer[24];
+	char* end = buffer + sizeof(buffer);
+	char* cursor = end;
+	do
+	{
+		*--cursor = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	return AppendArg(cursor, end - cursor);
+}
+
+ILogMessage& LogMessageImpl::operator<<(const std::string &str)
+{
+	return AppendArg(str.data(), str.length());
+}
+
 ILogMessage&LogMessageImpl::operator<<(const char* temp)
 {
-	return this->operator<<(std::string(temp));
+	if (temp == nullptr)
+		return AppendArg("", 0);
+	return AppendArg(temp, strlen(temp));
 }
 
 ILogMessage& LogMessageImpl::operator<<(const bool temp)
 {
-	return this->operator<<(std::string(temp ? "true" : "false"));
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.AppendBool(temp);
+		index_++;
+		return *((ILogMessage*)this);
+	}
+	return temp ? AppendArg("true", 4) : AppendArg("false", 5);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const int8_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendSigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const uint8_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendUnsigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const int16_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendSigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const uint16_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendUnsigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const int32_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendSigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const uint32_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendUnsigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const int64_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendSigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const uint64_t temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendUnsigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const long temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendSigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const unsigned long temp)
 {
-	return this->operator<<(std::to_string(temp));
+	return AppendUnsigned(temp);
 }
 
 ILogMessage& LogMessageImpl::operator<<(const double db)
 {
-	return this->operator<<(std::to_string(db));
-}
-
-size_t LogMessageImpl::FindArg(int &len)
-{
-	assert(!fmt_.empty());
-	assert(index_ >= 0 && index_ <= 20);
-
-	std::string str("{");
-	str.append(std::to_string(index_)).append("}");
-	len = str.length();
-	return fmt_.find(str);
+	if (binary_ != nullptr)
+	{
+		binary_->encoder.AppendDouble(db);
+		index_++;
+		return *((ILogMessage*)this);
+	}
+	char buffer[64];
+	int length = snprintf(buffer, sizeof(buffer), "%f", db);
+	if (length < 0)
+		length = 0;
+	else if (length >= (int)sizeof(buffer))
+		length = sizeof(buffer) - 1;
+	return AppendArg(buffer, length);
 }
 NIMLOG_END_DECLS
\ No newline at end of file
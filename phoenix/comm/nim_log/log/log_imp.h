@@ -4,33 +4,78 @@
 #include <string>
 #include "nim_log/log/log_def.h"
 #include "nim_log/log/log_file.h"
+#include "nim_log/log/log_async_writer.h"
+#include "nim_log/log/log_line_buffer.h"
+#include "nim_log/log/log_binary_format.h"
+#include "nim_log/log/log_rate_limiter.h"
+#include "nim_log/log/log_flush_scheduler.h"
 
 NIMLOG_BEGIN_DECLS
 
 class LogMessageImpl;
-class NIMLOG_EXPORT QLogImpl : public ILogger, public ILogWriter<LogMessageImpl>
+class NIMLOG_EXPORT QLogImpl : public ILogger, public ILogWriter<LogMessageImpl>, public std::enable_shared_from_this<QLogImpl>
 {
 public:
 	QLogImpl();
 public:
 	virtual void SetLogFile(const std::string &file_path) override;
+	virtual void SetLogFile(const std::string &file_path, const LogFileConfig& config) override;
 	virtual std::string GetLogFile() override;
 	virtual void SetLogLevel(LOG_LEVEL lv) override;
 	virtual LOG_LEVEL GetLogLevel() override { return log_level_; }
+	virtual void SetAsyncMode(const LogAsyncConfig& config) override;
+	virtual void SetRateLimit(const LogRateLimitConfig& config) override;
+	virtual bool AllowLog(const char* file, long line, LOG_LEVEL lv) override;
+	virtual void SetFlushPolicy(const LogFlushConfig& config) override;
 	virtual bool Flush() override;
+	virtual bool FlushNow() override;
 	virtual void Release() override;
 public:
 	void WriteLog(LOG_LEVEL lv, const std::string &log);
+	virtual void WriteLog(LOG_LEVEL lv, const char* log, size_t length) override;
+	//二进制格式时返回格式串字典，文本格式时返回nullptr
+	std::shared_ptr<LogFormatRegistry> GetFormatRegistry() const { return std::atomic_load(&format_registry_); }
+	//把格式串的字典记录直接写入文件并标记为已写入，不经过异步队列：队列满时不会被丢弃，也先于使用它的日志写入
+	void WriteFormat(const std::shared_ptr<LogFormatRegistry>& registry, uint32_t format_id, const std::string& fmt);
+private:
+	void WriteSuppressedSummary(const char* file, long line, LOG_LEVEL lv, uint64_t count);
+	void WritePendingSummaries();
+	//写完异步队列后把mmap缓冲区写入日志文件
+	bool FlushFile();
+	//执行刷新策略的判断结果，异步模式下推迟的写入交给写线程
+	void RunFlushAction(LogFlushScheduler::FLUSH_ACTION action, int64_t delay_ms, const std::shared_ptr<LogAsyncWriter>& async_writer);
+	//注销异步模式下注册的退出写盘、内存释放和内存统计函数
+	void UnregisterAsyncHooks();
 private:
 	std::unique_ptr<LogFile> instance_;
+	std::shared_ptr<LogAsyncWriter> async_writer_;//必须在instance_之后声明，保证先于instance_析构
+	std::shared_ptr<LogFormatRegistry> format_registry_;
+	LogRateLimiter rate_limiter_;
+	LogFlushScheduler flush_scheduler_;
 	std::string log_file_;
 	LOG_LEVEL	 log_level_;
+	int shutdown_flush_id_;//ThreadManager::RegisterShutdownFlush 返回的id，0表示未注册
+	int memory_trim_id_;//MemoryTrimmer::Register 返回的id，0表示未注册
+	int memory_account_id_;//MemoryAccounting::Register 返回的id，0表示未注册
 };
 class NIMLOG_EXPORT LogMessageImpl : public ILogMessage
 {
+	//日志中"{x}"的最大个数
+	static const int kMAX_ARG_COUNT = 21;
+	struct ArgPlaceholder
+	{
+		size_t pos;//"{x}"在fmt_中的位置
+		size_t length;//"{x}"的长度
+		int index;
+	};
+	//二进制格式使用的缓冲区，同一线程上的日志对象复用
+	struct BinaryBlock;
 public:
 	LogMessageImpl(const char* file, long line,const Logger& writer);
 	virtual ~LogMessageImpl();
+	//同一线程上创建和销毁的日志对象会复用内存
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
 	std::string TLog();
 	virtual ILogMessage& VLog(LOG_LEVEL lv, const std::string &fmt) override; 
 	virtual ILogMessage& operator<<(const std::string &str)  override;
@@ -48,17 +93,26 @@ public:
 	virtual ILogMessage& operator<<(const unsigned long temp)  override;
 	virtual ILogMessage& operator<<(const double temp)  override;
 private:
-	size_t FindArg(int &len); //返回"{x}"的索引，len代表"{x}"的长度
+	void ParseArgs();//一次性解析出fmt_中所有的"{x}"
+	ILogMessage& AppendArg(const char* data, size_t length);
+	ILogMessage& AppendSigned(int64_t value);
+	ILogMessage& AppendUnsigned(uint64_t value);
+	void AppendHeader();
+	void AppendTail();
+	void BeginBinary(const std::string &fmt);
+	static std::unique_ptr<BinaryBlock>& CachedBinaryBlock();
 private:
 	LogWriter<LogMessageImpl> writer_;
-	std::string fmt_;
-	std::string string_;
+	std::shared_ptr<LogFormatRegistry> format_registry_;
+	std::unique_ptr<BinaryBlock> binary_;//非空时表示本条日志按二进制格式记录
+	LogLineBuffer<256> fmt_;
+	LogLineBuffer<1024> string_;
+	ArgPlaceholder args_[kMAX_ARG_COUNT];
+	int			 arg_count_;
+	int			 next_arg_;//下一个待匹配的args_下标
+	size_t		 fmt_cursor_;//fmt_中已经输出到string_的位置
 	int			 index_;
-	std::string time_;
-	std::string file_line_;
-	std::string process_thread_;
 	LOG_LEVEL	 level_;
-	std::string lv_;
 };
 NIMLOG_END_DECLS
 
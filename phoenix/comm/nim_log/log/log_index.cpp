@@ -0,0 +1,370 @@
+#include "nim_log/log/log_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include "third_party/zlib/include/zlib.h"
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/packet.h"
+
+NIMLOG_BEGIN_DECLS
+
+namespace {
+const int64_t kDAY_MS = 24 * 3600 * 1000LL;
+const char* const kINDEX_FILE_EXT = ".nim_idx";
+const char* const kLEVEL_TEXT_LIST[] = {
+	"LV_KER", "LV_ASS", "LV_ERR", "LV_WAR", "LV_INT", "LV_APP", "LV_PRO"
+};
+
+int64_t MakeTime(int month, int day, int hour, int minute, int second, int millisecond)
+{
+	return ((((int64_t)(month * 31 + day) * 24 + hour) * 60 + minute) * 60 + second) * 1000 + millisecond;
+}
+
+//读取固定位数的十进制数
+bool ParseDigits(const char* text, int count, int& value)
+{
+	value = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (text[i] < '0' || text[i] > '9')
+			return false;
+		value = value * 10 + (text[i] - '0');
+	}
+	return true;
+}
+
+const char* ParseUInt32(const char* begin, const char* end, uint32_t& value)
+{
+	value = 0;
+	while (begin < end && *begin >= '0' && *begin <= '9')
+		value = value * 10 + (uint32_t)(*begin++ - '0');
+	return begin;
+}
+
+int64_t GetLineLength(const char* line, int64_t remaining)
+{
+	const char* newline = (const char*)memchr(line, '\n', (size_t)remaining);
+	return newline != nullptr ? newline - line + 1 : remaining;
+}
+}
+
+LogIndex::LogIndex() :
+	indexed_length_(0),
+	fingerprint_(0)
+{
+}
+
+LogIndex::~LogIndex()
+{
+}
+
+std::string LogIndex::GetIndexPath(const std::string& log_path)
+{
+	return log_path + kINDEX_FILE_EXT;
+}
+
+bool LogIndex::Build(const std::string& log_path, bool save)
+{
+	NS_EXTENSION::MappedFile file;
+	if (!file.Open(log_path, NS_EXTENSION::MappedFile::kSequential))
+		return false;
+	const char* data = (const char*)file.data();
+	int64_t length = (int64_t)file.length();
+	log_path_ = log_path;
+	bool loaded = Load();
+	if (loaded && indexed_length_ == length && fingerprint_ == Fingerprint(data, length))
+		return true;
+	//文件开头没有变化说明只是追加了日志，最后一块可能不完整，从它开始重新索引
+	if (loaded && indexed_length_ <= length && fingerprint_ == Fingerprint(data, indexed_length_) && !blocks_.empty())
+	{
+		indexed_length_ = blocks_.back().offset_;
+		blocks_.pop_back();
+	}
+	else
+	{
+		indexed_length_ = 0;
+		blocks_.clear();
+	}
+	IndexFrom(data, length);
+	fingerprint_ = Fingerprint(data, length);
+	return !save || Save();
+}
+
+bool LogIndex::Rebuild(const std::string& log_path, bool save)
+{
+	NS_EXTENSION::DeleteFile(GetIndexPath(log_path));
+	indexed_length_ = 0;
+	fingerprint_ = 0;
+	blocks_.clear();
+	return Build(log_path, save);
+}
+
+bool LogIndex::Load()
+{
+	std::string data;
+	if (!NS_EXTENSION::ReadFileToString(GetIndexPath(log_path_), data))
+		return false;
+	try
+	{
+		NS_EXTENSION::Unpack unpack(data.data(), data.length());
+		if (unpack.pop_uint32() != kINDEX_MAGIC || unpack.pop_uint32() != kINDEX_VERSION)
+			return false;
+		int64_t indexed_length = (int64_t)unpack.pop_uint64();
+		uint32_t fingerprint = unpack.pop_uint32();
+		uint32_t count = unpack.pop_varint();
+		std::vector<LogIndexBlock> blocks(count);
+		for (auto& block : blocks)
+		{
+			block.offset_ = (int64_t)unpack.pop_uint64();
+			block.length_ = (int64_t)unpack.pop_uint64();
+			block.begin_time_ = (int64_t)unpack.pop_uint64();
+			block.end_time_ = (int64_t)unpack.pop_uint64();
+			block.level_mask_ = unpack.pop_uint32();
+			block.record_count_ = unpack.pop_uint32();
+			unpack.pop_varint_array(block.threads_);
+		}
+		indexed_length_ = indexed_length;
+		fingerprint_ = fingerprint;
+		blocks_.swap(blocks);
+	}
+	catch (const NS_EXTENSION::NException&)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool LogIndex::Save() const
+{
+	NS_EXTENSION::PackBuffer buffer;
+	NS_EXTENSION::Pack pack(buffer);
+	pack.push_uint32(kINDEX_MAGIC).push_uint32(kINDEX_VERSION)
+		.push_uint64((uint64_t)indexed_length_).push_uint32(fingerprint_)
+		.push_varint((uint32_t)blocks_.size());
+	for (auto& block : blocks_)
+	{
+		pack.push_uint64((uint64_t)block.offset_).push_uint64((uint64_t)block.length_)
+			.push_uint64((uint64_t)block.begin_time_).push_uint64((uint64_t)block.end_time_)
+			.push_uint32(block.level_mask_).push_uint32(block.record_count_)
+			.push_varint_array(block.threads_);
+	}
+	std::string data(pack.data(), pack.size());
+	return NS_EXTENSION::WriteFile(GetIndexPath(log_path_), data) == (int)data.length();
+}
+
+void LogIndex::IndexFrom(const char* data, int64_t length)
+{
+	LogIndexBlock block = { indexed_length_, 0, -1, -1, 0, 0 };
+	for (int64_t pos = indexed_length_; pos < length;)
+	{
+		const char* line = data + pos;
+		int64_t line_length = GetLineLength(line, length - pos);
+		LogLineHeader header;
+		if (ParseLineHeader(line, (size_t)line_length, header))
+		{
+			if (pos - block.offset_ >= kBLOCK_LENGTH)
+			{
+				block.length_ = pos - block.offset_;
+				blocks_.push_back(std::move(block));
+				block = { pos, 0, -1, -1, 0, 0 };
+			}
+			if (block.begin_time_ < 0 || header.time_ < block.begin_time_)
+				block.begin_time_ = header.time_;
+			if (header.time_ > block.end_time_)
+				block.end_time_ = header.time_;
+			block.level_mask_ |= 1u << header.level_;
+			block.record_count_++;
+			uint64_t thread = ((uint64_t)header.pid_ << 32) | header.tid_;
+			auto it = std::lower_bound(block.threads_.begin(), block.threads_.end(), thread);
+			if (it == block.threads_.end() || *it != thread)
+				block.threads_.insert(it, thread);
+		}
+		pos += line_length;
+	}
+	if (length > block.offset_)
+	{
+		block.length_ = length - block.offset_;
+		blocks_.push_back(std::move(block));
+	}
+	indexed_length_ = length;
+}
+
+uint32_t LogIndex::Fingerprint(const char* data, int64_t length)
+{
+	return (uint32_t)crc32(0L, (const Bytef*)data, (uInt)std::min(length, kFINGERPRINT_LENGTH));
+}
+
+int LogIndex::Query(const LogQuery& query, const RecordCallback& callback, size_t* scanned_blocks) const
+{
+	if (scanned_blocks != nullptr)
+		*scanned_blocks = 0;
+	NS_EXTENSION::MappedFile file;
+	if (!file.Open(log_path_, NS_EXTENSION::MappedFile::kRandom))
+		return 0;
+	const char* data = (const char*)file.data();
+	//索引之后文件可能被截断，只读取仍然存在的部分
+	int64_t file_length = std::min((int64_t)file.length(), indexed_length_);
+	int count = 0;
+	for (auto& block : blocks_)
+	{
+		if (block.offset_ >= file_length)
+			break;
+		if (!MatchBlock(block, query))
+			continue;
+		if (scanned_blocks != nullptr)
+			(*scanned_blocks)++;
+		int64_t block_end = std::min(block.offset_ + block.length_, file_length);
+		file.Prefetch((size_t)block.offset_, (size_t)(block_end - block.offset_));
+		//块内逐行扫描，不是日志开头的行属于前一条日志
+		int64_t record_begin = -1;
+		LogLineHeader header;
+		for (int64_t pos = block.offset_; pos <= block_end;)
+		{
+			LogLineHeader next_header;
+			int64_t line_length = 0;
+			bool is_record = true;
+			if (pos < block_end)
+			{
+				line_length = GetLineLength(data + pos, block_end - pos);
+				is_record = ParseLineHeader(data + pos, (size_t)line_length, next_header);
+			}
+			if (is_record)
+			{
+				if (record_begin >= 0 && MatchRecord(header, data + record_begin, (size_t)(pos - record_begin), query))
+				{
+					count++;
+					if (!callback(data + record_begin, (size_t)(pos - record_begin)))
+						return count;
+				}
+				record_begin = pos;
+				header = next_header;
+			}
+			if (pos == block_end)
+				break;
+			pos += line_length;
+		}
+		file.Release((size_t)block.offset_, (size_t)(block_end - block.offset_));
+	}
+	return count;
+}
+
+bool LogIndex::MatchBlock(const LogIndexBlock& block, const LogQuery& query)
+{
+	if (block.record_count_ == 0)
+		return false;
+	if ((block.level_mask_ & ((2u << query.max_level_) - 1)) == 0)
+		return false;
+	if (query.pid_ != 0 || query.tid_ != 0)
+	{
+		if (std::none_of(block.threads_.begin(), block.threads_.end(), [&query](uint64_t thread) {
+			return (query.pid_ == 0 || (uint32_t)(thread >> 32) == query.pid_) && (query.tid_ == 0 || (uint32_t)thread == query.tid_);
+		}))
+			return false;
+	}
+	return MatchTime(block.begin_time_, block.end_time_, query);
+}
+
+bool LogIndex::MatchTime(int64_t begin_time, int64_t end_time, const LogQuery& query)
+{
+	if (query.begin_time_ < 0 && query.end_time_ < 0)
+		return true;
+	if (!query.time_of_day_)
+		return (query.end_time_ < 0 || begin_time <= query.end_time_) && (query.begin_time_ < 0 || end_time >= query.begin_time_);
+	//跨天的范围无法按一天中的时间判断，需要逐条比较
+	if (begin_time / kDAY_MS != end_time / kDAY_MS)
+		return true;
+	int64_t begin = begin_time % kDAY_MS;
+	int64_t end = end_time % kDAY_MS;
+	int64_t query_begin = query.begin_time_ < 0 ? 0 : query.begin_time_ % kDAY_MS;
+	int64_t query_end = query.end_time_ < 0 ? kDAY_MS - 1 : query.end_time_ % kDAY_MS;
+	if (query_begin <= query_end)
+		return begin <= query_end && end >= query_begin;
+	//如23:00到01:00，跨过零点
+	return end >= query_begin || begin <= query_end;
+}
+
+bool LogIndex::MatchRecord(const LogLineHeader& header, const char* record, size_t length, const LogQuery& query)
+{
+	if (header.level_ > query.max_level_)
+		return false;
+	if ((query.pid_ != 0 && header.pid_ != query.pid_) || (query.tid_ != 0 && header.tid_ != query.tid_))
+		return false;
+	if (!MatchTime(header.time_, header.time_, query))
+		return false;
+	return query.keyword_.empty() || std::string_view(record, length).find(query.keyword_) != std::string_view::npos;
+}
+
+bool LogIndex::ParseLineHeader(const char* line, size_t length, LogLineHeader& header)
+{
+	//"[MM-DD HH:MM:SS.mmm "固定20个字符
+	if (length < 20 + 11 || line[0] != '[' || line[3] != '-' || line[6] != ' ' || line[9] != ':' || line[12] != ':' || line[15] != '.' || line[19] != ' ')
+		return false;
+	int month, day, hour, minute, second, millisecond;
+	if (!ParseDigits(line + 1, 2, month) || !ParseDigits(line + 4, 2, day) || !ParseDigits(line + 7, 2, hour) ||
+		!ParseDigits(line + 10, 2, minute) || !ParseDigits(line + 13, 2, second) || !ParseDigits(line + 16, 3, millisecond))
+		return false;
+	header.time_ = MakeTime(month, day, hour, minute, second, millisecond);
+	//iOS上没有进程-线程号
+	const char* end = line + length;
+	const char* cursor = ParseUInt32(line + 20, end, header.pid_);
+	header.tid_ = 0;
+	if (cursor < end && *cursor == '-')
+		cursor = ParseUInt32(cursor + 1, end, header.tid_);
+	if (end - cursor < 11 || memcmp(cursor, "] [", 3) != 0 || cursor[9] != ']')
+		return false;
+	for (int lv = LV_KER; lv <= LV_PRO; lv++)
+	{
+		if (memcmp(cursor + 3, kLEVEL_TEXT_LIST[lv], 6) == 0)
+		{
+			header.level_ = (LOG_LEVEL)lv;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LogIndex::ParseTime(const std::string& text, int64_t& time, bool& time_of_day, bool round_up)
+{
+	int month = 0, day = 0, hour = 0, minute = 0, second = -1, millisecond = -1;
+	int count = sscanf(text.c_str(), "%d-%d %d:%d:%d.%d", &month, &day, &hour, &minute, &second, &millisecond);
+	time_of_day = count < 4;
+	if (time_of_day)
+	{
+		month = day = 0;
+		count = sscanf(text.c_str(), "%d:%d:%d.%d", &hour, &minute, &second, &millisecond);
+		if (count < 2)
+			return false;
+	}
+	else if (month < 1 || month > 12 || day < 1 || day > 31)
+	{
+		return false;
+	}
+	if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second > 59 || millisecond > 999)
+		return false;
+	//没有给出的秒和毫秒，作为范围的结束时取最大值
+	if (second < 0)
+		second = round_up ? 59 : 0;
+	if (millisecond < 0)
+		millisecond = round_up ? 999 : 0;
+	time = MakeTime(month, day, hour, minute, second, millisecond);
+	return true;
+}
+
+std::string LogIndex::FormatTime(int64_t time)
+{
+	if (time < 0)
+		return std::string();
+	int64_t day_number = time / kDAY_MS;
+	int64_t ms = time % kDAY_MS;
+	char buffer[32];
+	int hour = (int)(ms / 3600000), minute = (int)(ms / 60000 % 60), second = (int)(ms / 1000 % 60), millisecond = (int)(ms % 1000);
+	if (day_number == 0)
+		snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%03d", hour, minute, second, millisecond);
+	else
+		snprintf(buffer, sizeof(buffer), "%02d-%02d %02d:%02d:%02d.%03d", (int)((day_number - 1) / 31), (int)((day_number - 1) % 31 + 1),
+			hour, minute, second, millisecond);
+	return buffer;
+}
+
+NIMLOG_END_DECLS
@@ -0,0 +1,96 @@
+#ifndef __BASE_EXTENSION_LOG_INDEX_H__
+#define __BASE_EXTENSION_LOG_INDEX_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <string>
+#include <vector>
+#include <functional>
+
+NIMLOG_BEGIN_DECLS
+
+//一行日志开头"[MM-DD HH:MM:SS.mmm pid-tid] [LV_XXX] "中的字段
+struct LogLineHeader
+{
+	int64_t time_;//见LogIndex::ParseTime
+	LOG_LEVEL level_;
+	uint32_t pid_;
+	uint32_t tid_;
+};
+//索引中的一块，块总是从一条日志的开头开始，多行的日志不会跨块
+struct LogIndexBlock
+{
+	int64_t offset_;//块在日志文件中的起始位置
+	int64_t length_;
+	int64_t begin_time_;//块中最早和最晚的日志时间，没有可解析的日志时为-1
+	int64_t end_time_;
+	uint32_t level_mask_;//第lv位表示块中有该级别的日志
+	uint32_t record_count_;
+	std::vector<uint64_t> threads_;//块中出现的(pid << 32 | tid)，已排序去重
+};
+struct LogQuery
+{
+	LogQuery() :
+		begin_time_(-1), end_time_(-1), time_of_day_(false), max_level_(LV_PRO), pid_(0), tid_(0)
+	{
+	}
+	int64_t begin_time_;//时间范围（含两端），-1表示不限
+	int64_t end_time_;
+	bool time_of_day_;//为true时时间范围只比较一天中的时间，不限日期
+	LOG_LEVEL max_level_;//只查级别不低于它的日志，如LV_ERR查LV_KER/LV_ASS/LV_ERR
+	uint32_t pid_;//0表示不限
+	uint32_t tid_;//0表示不限
+	std::string keyword_;//不为空时只查包含它的日志
+};
+//文本格式日志文件的旁路索引，保存为"<日志文件>.nim_idx"，按块记录时间范围、出现的级别和进程-线程，
+//查询时只读取可能命中的块，不需要扫描整个文件
+//日志文件只追加时Build只索引新增的部分，文件被滚动或替换后重新建立
+//压缩、加密或二进制格式的日志需要先用nim_log_decoder还原成文本
+class NIMLOG_EXPORT LogIndex
+{
+public:
+	static const uint32_t kINDEX_MAGIC = 0x5844494E;
+	static const uint32_t kINDEX_VERSION = 1;
+	static const int64_t kBLOCK_LENGTH = 64 * 1024;//块的最小长度，在其后的第一条日志开头处分块
+	static const int64_t kFINGERPRINT_LENGTH = 4096;//校验文件开头的长度，用于发现文件被替换
+	using RecordCallback = std::function<bool(const char* record, size_t length)>;
+public:
+	LogIndex();
+	~LogIndex();
+public:
+	static std::string GetIndexPath(const std::string& log_path);
+	//加载已有的索引并补充索引新增的日志，需要时保存；返回false表示日志文件无法读取
+	bool Build(const std::string& log_path, bool save = true);
+	//从头重新建立索引
+	bool Rebuild(const std::string& log_path, bool save = true);
+	bool Save() const;
+	//按在文件中的顺序对每条命中的日志（含多行日志的后续行）调用callback，callback返回false时停止
+	//返回命中的条数，scanned_blocks返回实际读取的块数
+	int Query(const LogQuery& query, const RecordCallback& callback, size_t* scanned_blocks = nullptr) const;
+	const std::vector<LogIndexBlock>& GetBlocks() const { return blocks_; }
+	int64_t GetIndexedLength() const { return indexed_length_; }
+public:
+	static bool ParseLineHeader(const char* line, size_t length, LogLineHeader& header);
+	//"MM-DD HH:MM[:SS[.mmm]]"或"HH:MM[:SS[.mmm]]"，转换为可比较的毫秒数；只有时间时time_of_day返回true
+	//round_up为true时省略的秒和毫秒取最大值，用于范围的结束时间
+	//日志中不带年份，按每月31天计算，只保证同一年内的大小关系
+	static bool ParseTime(const std::string& text, int64_t& time, bool& time_of_day, bool round_up = false);
+	static std::string FormatTime(int64_t time);
+private:
+	bool Load();
+	//从indexed_length_开始把data中的日志加入索引
+	void IndexFrom(const char* data, int64_t length);
+	static uint32_t Fingerprint(const char* data, int64_t length);
+	static bool MatchBlock(const LogIndexBlock& block, const LogQuery& query);
+	static bool MatchTime(int64_t begin_time, int64_t end_time, const LogQuery& query);
+	static bool MatchRecord(const LogLineHeader& header, const char* record, size_t length, const LogQuery& query);
+private:
+	std::string log_path_;
+	int64_t indexed_length_;
+	uint32_t fingerprint_;
+	std::vector<LogIndexBlock> blocks_;
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_INDEX_H__
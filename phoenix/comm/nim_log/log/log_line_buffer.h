@@ -0,0 +1,53 @@
+#ifndef __BASE_EXTENSION_LOG_LINE_BUFFER_H__
+#define __BASE_EXTENSION_LOG_LINE_BUFFER_H__
+#include "nim_log/config/build_config.h"
+#include <cstring>
+#include <string>
+
+NIMLOG_BEGIN_DECLS
+
+//格式化日志使用的缓冲区，内容不超过kCapacity时不会申请堆内存
+template<size_t kCapacity>
+class LogLineBuffer
+{
+public:
+	LogLineBuffer() : length_(0), spilled_(false) {}
+public:
+	void Append(const char* data, size_t length)
+	{
+		if (!spilled_ && length_ + length <= kCapacity)
+		{
+			memcpy(inline_ + length_, data, length);
+			length_ += length;
+			return;
+		}
+		if (!spilled_)
+		{
+			overflow_.reserve((length_ + length) * 2);
+			overflow_.assign(inline_, length_);
+			spilled_ = true;
+		}
+		overflow_.append(data, length);
+		length_ = overflow_.length();
+	}
+	void Append(char c) { Append(&c, 1); }
+	void Append(const char* text) { Append(text, strlen(text)); }
+	void Clear()
+	{
+		length_ = 0;
+		spilled_ = false;
+		overflow_.clear();
+	}
+	const char* data() const { return spilled_ ? overflow_.data() : inline_; }
+	size_t length() const { return length_; }
+	bool empty() const { return length_ == 0; }
+private:
+	char inline_[kCapacity];
+	size_t length_;
+	bool spilled_;
+	std::string overflow_;
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_LINE_BUFFER_H__
@@ -7,7 +7,9 @@ NIMLOG_BEGIN_DECLS
 const int LogFile::MMapFile::kMAX_LENGTH_ = 64 * 1024;
 const std::string LogFile::MMapFile::kMMapFileExt_ = ".nim_mmap";
 
-LogFile::MMapFile::MMapFile() :
+LogFile::MMapFile::MMapFile(int max_length) :
+	max_length_(max_length < 4 * 1024 ? 4 * 1024 : max_length),
+	mutex_("nim_log.MMapFile"),
 	inited_(false),
 	current_length_(0),
 	current_cursor_(nullptr),
@@ -15,6 +17,7 @@ LogFile::MMapFile::MMapFile() :
 	file_handle_(INVALID_LOG_FILE_HANDLE),
 	mapped_file_handle_(INVALID_LOG_FILE_HANDLE),
 	data_offset_(0),
+	sync_on_reset_(true),
 	overflow_callback_(nullptr)
 {
 
@@ -25,16 +28,33 @@ LogFile::MMapFile::~MMapFile()
 
 }
 
-bool LogFile::MMapFile::Create(const std::string& log_path)
+std::string LogFile::MMapFile::GetFilePath(const std::string& log_path)
 {
-	file_path_ = log_path;
-	file_path_.append(kMMapFileExt_);
-	if (!CheckMMapLogFile(file_path_, kMAX_LENGTH_))
+	return log_path + kMMapFileExt_;
+}
+
+bool LogFile::MMapFile::Create(const std::string& log_path, bool lock)
+{
+	file_path_ = GetFilePath(log_path);
+	if (!CheckMMapLogFile(file_path_, max_length_))
 		return false;
 	file_handle_ = LogFile::OSFileSysUtil::CreateOSFile(file_path_, true);
 	if (file_handle_ == INVALID_LOG_FILE_HANDLE)
 		return false;
-	if (LogFile::OSFileSysUtil::MappingFile(file_handle_, kMAX_LENGTH_, mapped_file_handle_, mapped_addr_))
+	if (lock)
+	{
+		//其它进程可能正把它当作已退出进程的缓冲区合并，等它合并完（文件已被删除）后重新创建
+		if (!LogFile::OSFileSysUtil::LockFile(file_handle_, true))
+			return false;
+		if (!LogFile::OSFileSysUtil::IsSameFile(file_handle_, file_path_))
+		{
+			LogFile::OSFileSysUtil::CloseFile(file_handle_);
+			file_handle_ = LogFile::OSFileSysUtil::CreateOSFile(file_path_, true);
+			if (!LogFile::OSFileSysUtil::LockFile(file_handle_, false))
+				return false;
+		}
+	}
+	if (LogFile::OSFileSysUtil::MappingFile(file_handle_, max_length_, mapped_file_handle_, mapped_addr_))
 	{
 		return Init();
 	}
@@ -50,19 +70,28 @@ bool LogFile::MMapFile::CheckMMapLogFile(const std::string& mmap_file_path, int
 		auto file_size = NS_EXTENSION::GetFileSize(mmap_file_path);
 		if (file_size != max_length)
 		{
-			std::string log_file_text;
-
-			NS_EXTENSION::ReadFileToString(mmap_file_path, log_file_text);
-			int text_length;
-			memcpy(&text_length, log_file_text.data(), sizeof(decltype(data_offset_)));
-			log_file_text = log_file_text.substr(sizeof(decltype(data_offset_)), text_length);
-			if (!log_file_text.empty())
+			// Only the text written is copied out of the mapping instead of the whole file,
+			// the mapping is closed before the file is deleted
 			{
-				std::string text("\r\n -----------------------load from mmap file begin-----------------------\r\n");
-				text.append(log_file_text);
-				text.append("\r\n -----------------------load from mmap file end-----------------------\r\n");
-				if(overflow_callback_ != nullptr)
-					overflow_callback_(text);
+				NS_EXTENSION::MappedFile mapped_file;
+				mapped_file.Open(mmap_file_path, NS_EXTENSION::MappedFile::kSequential);
+				const size_t header_length = sizeof(decltype(data_offset_));
+				if (mapped_file.IsValid() && mapped_file.length() >= header_length)
+				{
+					int text_length;
+					memcpy(&text_length, mapped_file.data(), header_length);
+					std::string_view log_file_text = mapped_file.view().substr(header_length);
+					if (text_length >= 0 && (size_t)text_length < log_file_text.size())
+						log_file_text = log_file_text.substr(0, text_length);
+					if (!log_file_text.empty())
+					{
+						std::string text("\r\n -----------------------load from mmap file begin-----------------------\r\n");
+						text.append(log_file_text.data(), log_file_text.size());
+						text.append("\r\n -----------------------load from mmap file end-----------------------\r\n");
+						if(overflow_callback_ != nullptr)
+							overflow_callback_(text);
+					}
+				}
 			}
 			if (!NS_EXTENSION::DeleteFile(mmap_file_path))
 				return false;
@@ -73,7 +102,7 @@ bool LogFile::MMapFile::CheckMMapLogFile(const std::string& mmap_file_path, int
 bool LogFile::MMapFile::Close()
 {
 	Flush();
-	LogFile::OSFileSysUtil::UnMappingFile(mapped_file_handle_, mapped_addr_,kMAX_LENGTH_);
+	LogFile::OSFileSysUtil::UnMappingFile(mapped_file_handle_, mapped_addr_,max_length_);
 	LogFile::OSFileSysUtil::CloseFile(file_handle_);
 	return true;
 }
@@ -88,22 +117,22 @@ bool LogFile::MMapFile::Init()
 {
 	if (inited_)
 		return true;
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
 	if (inited_)
 		return true;
-	int len = Length();
+	int len = LengthLocked();
 	data_offset_ = sizeof(int);
 	current_cursor_ = mapped_addr_ + len + data_offset_;
 	current_length_ = len;
 	if (len > 0 && overflow_callback_ != nullptr)
 	{
 		std::string text("\r\n -----------------------load from mmap file begin-----------------------\r\n");
-		if (Read(text) == len)
+		if (ReadLocked(text) == len)
 		{
 			text.append("\r\n -----------------------load from mmap file end-----------------------\r\n");
 		}
 		if (overflow_callback_(text))
-			Reset();
+			ResetLocked();
 	}
 	inited_ = true;
 	return inited_;
@@ -113,7 +142,7 @@ bool LogFile::MMapFile::IsInited()
 {
 	if (inited_)
 		return true;
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
 	return inited_;
 }
 
@@ -121,11 +150,13 @@ bool LogFile::MMapFile::Flush()
 {
 	if (IsInited())
 	{
+		//读取与清空之间不能有其它线程写入，否则写入的日志会被清掉
+		std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
 		std::string log_text;
-		if (current_length_ > 0 && Read(log_text) == current_length_ && overflow_callback_ != nullptr)
+		if (current_length_ > 0 && ReadLocked(log_text) == current_length_ && overflow_callback_ != nullptr)
 		{
 			if (overflow_callback_(log_text))
-				Reset();
+				ResetLocked();
 		}
 		return true;
 	}
@@ -139,37 +170,48 @@ bool LogFile::MMapFile::Flush()
 
 bool LogFile::MMapFile::Reset()
 {
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
+	ResetLocked();
+	return true;
+}
+
+void LogFile::MMapFile::ResetLocked()
+{
 	current_cursor_ = mapped_addr_ + data_offset_;
 	current_length_ = 0;
-	memset(mapped_addr_, 0, kMAX_LENGTH_);
+	memset(mapped_addr_, 0, max_length_);
 	UpdateCurrentLength(0);
-	LogFile::OSFileSysUtil::FlushMappingFile(file_handle_);
-	return true;
+	if (sync_on_reset_)
+		LogFile::OSFileSysUtil::FlushMappingFile(file_handle_);
 }
 
 int LogFile::MMapFile::Write(const std::string& text)
 {
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	return Write(text.data(), (int)text.length());
+}
+
+int LogFile::MMapFile::Write(const char* text, int text_length)
+{
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
 	if (!inited_)
 		return 0;
-	int length = current_length_ + text.length() + sizeof(int);
-	if (length >= kMAX_LENGTH_)
+	int length = current_length_ + text_length + sizeof(int);
+	if (length >= max_length_)
 	{
 		std::string log_text;
-		if (Read(log_text) == current_length_)
+		if (ReadLocked(log_text) == current_length_)
 		{
-			log_text.append(text);
+			log_text.append(text, text_length);
 		}
 		if (overflow_callback_(log_text))
-			Reset();
+			ResetLocked();
 	}
 	else
 	{
-		current_length_ += text.length();
-		memcpy(current_cursor_, text.c_str(), text.length());
+		current_length_ += text_length;
+		memcpy(current_cursor_, text, text_length);
 		UpdateCurrentLength(current_length_);
-		current_cursor_ += text.length();
+		current_cursor_ += text_length;
 		//LogFile::OSFileSysUtil::FlushMappingFile(file_handle_);
 	}
 	return 0;
@@ -177,14 +219,25 @@ int LogFile::MMapFile::Write(const std::string& text)
 
 int LogFile::MMapFile::Read(std::string& data)
 {
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
-	data.append((mapped_addr_ + data_offset_), Length());
-	return Length();
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
+	return ReadLocked(data);
+}
+
+int LogFile::MMapFile::ReadLocked(std::string& data)
+{
+	int length = LengthLocked();
+	data.append((mapped_addr_ + data_offset_), length);
+	return length;
 }
 
 int LogFile::MMapFile::Length()
 {
-	std::lock_guard<std::recursive_mutex> auto_lock(mutex_);
+	std::lock_guard<NS_EXTENSION::ProfiledLock<NS_EXTENSION::AdaptiveLock>> auto_lock(mutex_);
+	return LengthLocked();
+}
+
+int LogFile::MMapFile::LengthLocked()
+{
 	int length = 0;
 	memcpy(&length, mapped_addr_, sizeof(length));
 	return length;
@@ -0,0 +1,117 @@
+#include "nim_log/log/log_module_level.h"
+#include <cstdlib>
+#include "extension/strings/string_util.h"
+
+NIMLOG_BEGIN_DECLS
+
+//保存的是级别+1，0表示未设置，这样零初始化即为全部未设置，其它全局对象的构造函数写日志时也不依赖初始化顺序
+std::atomic<int> LogModuleLevel::levels_[LM_COUNT] = {};
+std::atomic<int> LogModuleLevel::max_level_(0);
+
+namespace {
+const char* const kMODULE_NAME_LIST[] = {
+	"default", "http", "db", "net", "encrypt"
+};
+const char* const kLEVEL_TEXT_LIST[] = {
+	"LV_KER", "LV_ASS", "LV_ERR", "LV_WAR", "LV_INT", "LV_APP", "LV_PRO"
+};
+
+bool ParseNumber(std::string_view text, int& value)
+{
+	if (text.empty() || text.length() > 3)
+		return false;
+	std::string number(text);
+	char* end = nullptr;
+	value = (int)strtol(number.c_str(), &end, 10);
+	return end == number.c_str() + number.length();
+}
+
+bool ParseModule(std::string_view text, LOG_MODULE& module)
+{
+	for (size_t i = 0; i < sizeof(kMODULE_NAME_LIST) / sizeof(kMODULE_NAME_LIST[0]); i++)
+	{
+		if (text == kMODULE_NAME_LIST[i])
+		{
+			module = (LOG_MODULE)i;
+			return true;
+		}
+	}
+	int value = 0;
+	if (!ParseNumber(text, value) || value < 0 || value >= LM_COUNT)
+		return false;
+	module = (LOG_MODULE)value;
+	return true;
+}
+
+bool ParseLevel(std::string_view text, int& level)
+{
+	for (int i = LV_KER; i <= LV_PRO; i++)
+	{
+		if (text == kLEVEL_TEXT_LIST[i])
+		{
+			level = i;
+			return true;
+		}
+	}
+	return ParseNumber(text, level) && level >= LogModuleLevel::kUNSET && level <= LV_PRO;
+}
+}
+
+void LogModuleLevel::SetLevel(LOG_MODULE module, LOG_LEVEL lv)
+{
+	if ((unsigned)module >= LM_COUNT)
+		return;
+	levels_[module].store((int)lv + 1, std::memory_order_relaxed);
+	UpdateMaxLevel();
+}
+
+void LogModuleLevel::ResetLevel(LOG_MODULE module)
+{
+	if ((unsigned)module >= LM_COUNT)
+		return;
+	levels_[module].store(0, std::memory_order_relaxed);
+	UpdateMaxLevel();
+}
+
+void LogModuleLevel::ResetAll()
+{
+	for (auto& level : levels_)
+		level.store(0, std::memory_order_relaxed);
+	max_level_.store(0, std::memory_order_relaxed);
+}
+
+int LogModuleLevel::SetLevels(const std::string& spec)
+{
+	int count = 0;
+	for (std::string_view item : NS_EXTENSION::StringTokens(spec, ", "))
+	{
+		size_t pos = item.find('=');
+		if (pos == std::string_view::npos)
+			continue;
+		LOG_MODULE module;
+		int level;
+		if (!ParseModule(item.substr(0, pos), module) || !ParseLevel(item.substr(pos + 1), level))
+			continue;
+		if (level == kUNSET)
+			ResetLevel(module);
+		else
+			SetLevel(module, (LOG_LEVEL)level);
+		count++;
+	}
+	return count;
+}
+
+void LogModuleLevel::UpdateMaxLevel()
+{
+	//设置很少发生，直接重新计算；并发设置时以最后一次计算的结果为准
+	int max_level = 0;
+	for (auto& level : levels_)
+	{
+		int value = level.load(std::memory_order_relaxed);
+		if (value > max_level)
+			max_level = value;
+	}
+	max_level_.store(max_level, std::memory_order_relaxed);
+}
+
+NIMLOG_END_DECLS
@@ -0,0 +1,56 @@
+#ifndef __BASE_EXTENSION_LOG_MODULE_LEVEL_H__
+#define __BASE_EXTENSION_LOG_MODULE_LEVEL_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <atomic>
+#include <string>
+
+NIMLOG_BEGIN_DECLS
+
+//日志所属的模块，编译期确定，作为LogModuleLevel的下标
+//应用自己的模块从LM_USER_BEGIN开始编号，不超过LM_COUNT
+enum LOG_MODULE
+{
+	LM_DEFAULT = 0,	//未指定模块的__NIM_LOG_*
+	LM_HTTP = 1,
+	LM_DB = 2,
+	LM_NET = 3,
+	LM_ENCRYPT = 4,
+	LM_USER_BEGIN = 16,
+	LM_COUNT = 64
+};
+
+//按模块设置的日志级别，进程内共用，运行期可随时修改
+//未设置的模块沿用logger的级别；设置后该模块的日志只按这里的级别过滤，可以比logger更详细也可以更简略
+//读写都是一次原子操作，写日志的宏在构造LogMessage之前读取
+class NIMLOG_EXPORT LogModuleLevel
+{
+public:
+	static const int kUNSET = -1;
+public:
+	static inline int GetLevel(LOG_MODULE module)
+	{
+		return (unsigned)module < LM_COUNT ? levels_[module].load(std::memory_order_relaxed) - 1 : kUNSET;
+	}
+	//各模块设置的级别中最详细的一个，没有设置时为kUNSET，写日志文件前的级别过滤用它放行被调高的模块
+	static inline int GetMaxLevel()
+	{
+		return max_level_.load(std::memory_order_relaxed) - 1;
+	}
+	static void SetLevel(LOG_MODULE module, LOG_LEVEL lv);
+	static void ResetLevel(LOG_MODULE module);
+	static void ResetAll();
+	//按"模块=级别"的列表设置，以逗号分隔，如"http=6,db=2"；模块可以是内置模块名(default/http/db/net/encrypt)或模块编号，
+	//级别为0~6或LV_KER~LV_PRO，"-1"表示恢复沿用logger的级别。返回成功设置的个数
+	static int SetLevels(const std::string& spec);
+private:
+	static void UpdateMaxLevel();
+private:
+	static std::atomic<int> levels_[LM_COUNT];//级别+1，0表示未设置
+	static std::atomic<int> max_level_;
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_MODULE_LEVEL_H__
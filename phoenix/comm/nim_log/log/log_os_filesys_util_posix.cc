@@ -1,4 +1,4 @@
-#include "extension/log/log_file.h"
+#include "nim_log/log/log_file.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -6,8 +6,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
-namespace nbase
-{
+#include <sys/file.h>
+NIMLOG_BEGIN_DECLS
+
 	LogFile::LOG_FILE_HANDLE LogFile::OSFileSysUtil::CreateOSFile(const std::string& file_path, bool create, bool append /*= true*/, bool lock/* = false*/)
 	{
 		LogFile::LOG_FILE_HANDLE ret = INVALID_LOG_FILE_HANDLE;
@@ -111,4 +112,47 @@ namespace nbase
 		}
 		return false;
 	}
-};//nbase
+	bool LogFile::OSFileSysUtil::WriteFile(LogFile::LOG_FILE_HANDLE file, const char* data, size_t length)
+	{
+		if (file == INVALID_LOG_FILE_HANDLE)
+			return false;
+		while (length > 0)
+		{
+			ssize_t written = write(file, data, length);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			data += written;
+			length -= written;
+		}
+		return true;
+	}
+	bool LogFile::OSFileSysUtil::LockFile(LogFile::LOG_FILE_HANDLE file, bool wait)
+	{
+		if (file == INVALID_LOG_FILE_HANDLE)
+			return false;
+		//flock锁属于打开的文件描述，同一进程重新open的描述之间同样互斥
+		int operation = wait ? LOCK_EX : (LOCK_EX | LOCK_NB);
+		int ret;
+		do
+		{
+			ret = flock(file, operation);
+		} while (ret != 0 && errno == EINTR);
+		return ret == 0;
+	}
+	void LogFile::OSFileSysUtil::UnlockFile(LogFile::LOG_FILE_HANDLE file)
+	{
+		if (file != INVALID_LOG_FILE_HANDLE)
+			flock(file, LOCK_UN);
+	}
+	bool LogFile::OSFileSysUtil::IsSameFile(LogFile::LOG_FILE_HANDLE file, const std::string& file_path)
+	{
+		struct stat file_stats, path_stats;
+		if (file == INVALID_LOG_FILE_HANDLE || fstat(file, &file_stats) != 0 || stat(file_path.c_str(), &path_stats) != 0)
+			return false;
+		return file_stats.st_dev == path_stats.st_dev && file_stats.st_ino == path_stats.st_ino;
+	}
+NIMLOG_END_DECLS
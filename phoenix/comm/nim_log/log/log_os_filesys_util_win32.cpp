@@ -116,4 +116,63 @@ bool LogFile::OSFileSysUtil::FlushMappingFile(LogFile::LOG_FILE_HANDLE file)
 	}
 	return true;
 }
+bool LogFile::OSFileSysUtil::WriteFile(LogFile::LOG_FILE_HANDLE file, const char* data, size_t length)
+{
+	if (file == INVALID_LOG_FILE_HANDLE)
+		return false;
+	//以GENERIC_WRITE打开的文件不是追加模式，偏移为0xFFFFFFFF:0xFFFFFFFF时写到文件末尾，
+	//定位与写入是一次原子操作，多个进程同时写同一个文件时不会互相覆盖
+	while (length > 0)
+	{
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = 0xFFFFFFFF;
+		overlapped.OffsetHigh = 0xFFFFFFFF;
+		DWORD written = 0;
+		DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+		if (!::WriteFile(file, data, chunk, &written, &overlapped) || written == 0)
+			return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+namespace {
+//锁住远超文件末尾的一个字节，不影响mmap缓冲区文件的映射与读写
+const DWORD kLOCK_OFFSET_HIGH = 0x40000000;
+}
+bool LogFile::OSFileSysUtil::LockFile(LogFile::LOG_FILE_HANDLE file, bool wait)
+{
+	if (file == INVALID_LOG_FILE_HANDLE)
+		return false;
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.OffsetHigh = kLOCK_OFFSET_HIGH;
+	DWORD flags = LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+	return ::LockFileEx(file, flags, 0, 1, 0, &overlapped) == TRUE;
+}
+void LogFile::OSFileSysUtil::UnlockFile(LogFile::LOG_FILE_HANDLE file)
+{
+	if (file == INVALID_LOG_FILE_HANDLE)
+		return;
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.OffsetHigh = kLOCK_OFFSET_HIGH;
+	::UnlockFileEx(file, 0, 1, 0, &overlapped);
+}
+bool LogFile::OSFileSysUtil::IsSameFile(LogFile::LOG_FILE_HANDLE file, const std::string& file_path)
+{
+	if (file == INVALID_LOG_FILE_HANDLE)
+		return false;
+	HANDLE path_file = CreateFileW(NS_EXTENSION::UTF8ToUTF16(file_path).c_str(), 0,
+		FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (path_file == INVALID_HANDLE_VALUE)
+		return false;
+	BY_HANDLE_FILE_INFORMATION file_info, path_info;
+	bool same = ::GetFileInformationByHandle(file, &file_info) && ::GetFileInformationByHandle(path_file, &path_info) &&
+		file_info.dwVolumeSerialNumber == path_info.dwVolumeSerialNumber &&
+		file_info.nFileIndexHigh == path_info.nFileIndexHigh && file_info.nFileIndexLow == path_info.nFileIndexLow;
+	::CloseHandle(path_file);
+	return same;
+}
 NIMLOG_END_DECLS
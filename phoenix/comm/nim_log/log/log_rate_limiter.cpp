@@ -0,0 +1,81 @@
+#include "nim_log/log/log_rate_limiter.h"
+#include <vector>
+#include "extension/time/time.h"
+
+NIMLOG_BEGIN_DECLS
+
+LogRateLimiter::LogRateLimiter() :
+	enabled_(false),
+	messages_per_second_(0),
+	burst_(0)
+{
+}
+
+void LogRateLimiter::SetConfig(const LogRateLimitConfig& config)
+{
+	messages_per_second_ = config.messages_per_second_;
+	burst_ = config.burst_ == 0 ? 1 : config.burst_;
+	enabled_ = config.enable_;
+}
+
+bool LogRateLimiter::Acquire(const char* file, long line, LOG_LEVEL lv, uint64_t& suppressed_count)
+{
+	suppressed_count = 0;
+	CallSiteKey key = { file, line };
+	Shard& shard = shards_[CallSiteKeyHash()(key) % kSHARD_COUNT];
+	int64_t now_ms = (NS_EXTENSION::TimeTicks::Now() - NS_EXTENSION::TimeTicks()).InMilliseconds();
+	double burst = (double)burst_;
+	std::lock_guard<std::mutex> auto_lock(shard.mutex);
+	auto it = shard.sites.find(key);
+	if (it == shard.sites.end())
+	{
+		CallSite site = { burst, now_ms, 0, lv };
+		it = shard.sites.emplace(key, site).first;
+	}
+	CallSite& site = it->second;
+	if (now_ms > site.last_refill_ms)
+	{
+		site.tokens += (double)(now_ms - site.last_refill_ms) * messages_per_second_ / 1000;
+		if (site.tokens > burst)
+			site.tokens = burst;
+		site.last_refill_ms = now_ms;
+	}
+	if (site.tokens < 1)
+	{
+		if (site.suppressed_count == 0 || lv < site.suppressed_level)
+			site.suppressed_level = lv;
+		site.suppressed_count++;
+		return false;
+	}
+	site.tokens -= 1;
+	suppressed_count = site.suppressed_count;
+	site.suppressed_count = 0;
+	return true;
+}
+
+void LogRateLimiter::TakeSuppressed(const SuppressedCallback& callback)
+{
+	struct Suppressed
+	{
+		CallSiteKey key;
+		LOG_LEVEL level;
+		uint64_t count;
+	};
+	std::vector<Suppressed> pending;
+	for (auto& shard : shards_)
+	{
+		std::lock_guard<std::mutex> auto_lock(shard.mutex);
+		for (auto& it : shard.sites)
+		{
+			if (it.second.suppressed_count == 0)
+				continue;
+			pending.push_back({ it.first, it.second.suppressed_level, it.second.suppressed_count });
+			it.second.suppressed_count = 0;
+		}
+	}
+	//回调中会写日志，不能持有分片的锁
+	for (auto& it : pending)
+		callback(it.key.file, it.key.line, it.level, it.count);
+}
+
+NIMLOG_END_DECLS
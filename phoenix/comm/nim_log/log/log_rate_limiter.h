@@ -0,0 +1,63 @@
+#ifndef __BASE_EXTENSION_LOG_RATE_LIMITER_H__
+#define __BASE_EXTENSION_LOG_RATE_LIMITER_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include "nim_log/log/log_def.h"
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+NIMLOG_BEGIN_DECLS
+
+//按调用点的令牌桶限流，调用点以CreateLogMessage收到的__FILE__指针和__LINE__区分
+class NIMLOG_EXPORT LogRateLimiter
+{
+	struct CallSiteKey
+	{
+		const char* file;
+		long line;
+		bool operator==(const CallSiteKey& other) const { return file == other.file && line == other.line; }
+	};
+	struct CallSiteKeyHash
+	{
+		size_t operator()(const CallSiteKey& key) const
+		{
+			return std::hash<const void*>()(key.file) ^ ((size_t)key.line * 2654435761u);
+		}
+	};
+	struct CallSite
+	{
+		double tokens;
+		int64_t last_refill_ms;
+		uint64_t suppressed_count;
+		LOG_LEVEL suppressed_level;//被抑制的日志中级别最高的一条
+	};
+	//按调用点分片加锁，减少多线程写日志时的竞争
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<CallSiteKey, CallSite, CallSiteKeyHash> sites;
+	};
+	static const size_t kSHARD_COUNT = 16;
+public:
+	using SuppressedCallback = std::function<void(const char* file, long line, LOG_LEVEL lv, uint64_t count)>;
+	LogRateLimiter();
+	~LogRateLimiter() = default;
+public:
+	void SetConfig(const LogRateLimitConfig& config);
+	bool IsEnabled() const { return enabled_; }
+	//取一个令牌，成功时suppressed_count返回该调用点此前被抑制的条数
+	bool Acquire(const char* file, long line, LOG_LEVEL lv, uint64_t& suppressed_count);
+	//取出所有调用点尚未汇报的抑制条数，用于调用点不再输出日志时补写汇总
+	void TakeSuppressed(const SuppressedCallback& callback);
+private:
+	std::atomic_bool enabled_;
+	std::atomic<uint32_t> messages_per_second_;
+	std::atomic<uint32_t> burst_;
+	Shard shards_[kSHARD_COUNT];
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_RATE_LIMITER_H__
@@ -0,0 +1,114 @@
+#include "nim_log/log/log_staging_ring.h"
+#include <cstring>
+#include <cstdint>
+#include <thread>
+
+NIMLOG_BEGIN_DECLS
+
+namespace {
+size_t RoundUpToPowerOfTwo(size_t value)
+{
+	size_t ret = 1;
+	while (ret < value)
+		ret <<= 1;
+	return ret;
+}
+}
+
+LogStagingRing::LogStagingRing(size_t capacity) :
+	buffer_(RoundUpToPowerOfTwo(capacity < 1024 ? 1024 : capacity)),
+	mask_(buffer_.size() - 1),
+	head_(0),
+	tail_(0),
+	orphaned_(false),
+	detached_(false),
+	writing_(false)
+{
+}
+
+bool LogStagingRing::Write(const char* text, size_t text_length)
+{
+	//先置writing_再检查detached_，Detach的顺序相反，两者都是seq_cst，不会同时错过对方
+	writing_.store(true);
+	if (detached_.load())
+	{
+		writing_.store(false, std::memory_order_release);
+		return false;
+	}
+	uint32_t length = (uint32_t)text_length;
+	size_t need = sizeof(length) + length;
+	size_t head = head_.load(std::memory_order_relaxed);
+	size_t tail = tail_.load(std::memory_order_acquire);
+	bool written = need <= buffer_.size() - (head - tail);
+	if (written)
+	{
+		CopyIn(head, (const char*)&length, sizeof(length));
+		CopyIn(head + sizeof(length), text, length);
+		head_.store(head + need, std::memory_order_release);
+	}
+	writing_.store(false, std::memory_order_release);
+	return written;
+}
+
+void LogStagingRing::Detach()
+{
+	detached_.store(true);
+	while (writing_.load(std::memory_order_acquire))
+		std::this_thread::yield();
+}
+
+size_t LogStagingRing::Read(std::string& data)
+{
+	size_t count = 0;
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	size_t head = head_.load(std::memory_order_acquire);
+	while (tail < head)
+	{
+		uint32_t length = 0;
+		CopyOut(tail, (char*)&length, sizeof(length));
+		size_t offset = data.length();
+		data.resize(offset + length);
+		CopyOut(tail + sizeof(length), &data[offset], length);
+		tail += sizeof(length) + length;
+		count++;
+	}
+	tail_.store(tail, std::memory_order_release);
+	return count;
+}
+
+bool LogStagingRing::IsEmpty() const
+{
+	return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+}
+
+void LogStagingRing::CopyIn(size_t pos, const char* data, size_t length)
+{
+	size_t begin = pos & mask_;
+	size_t first = buffer_.size() - begin;
+	if (first >= length)
+	{
+		memcpy(&buffer_[begin], data, length);
+	}
+	else
+	{
+		memcpy(&buffer_[begin], data, first);
+		memcpy(&buffer_[0], data + first, length - first);
+	}
+}
+
+void LogStagingRing::CopyOut(size_t pos, char* data, size_t length) const
+{
+	size_t begin = pos & mask_;
+	size_t first = buffer_.size() - begin;
+	if (first >= length)
+	{
+		memcpy(data, &buffer_[begin], length);
+	}
+	else
+	{
+		memcpy(data, &buffer_[begin], first);
+		memcpy(data + first, &buffer_[0], length - first);
+	}
+}
+
+NIMLOG_END_DECLS
@@ -0,0 +1,48 @@
+#ifndef __BASE_EXTENSION_LOG_STAGING_RING_H__
+#define __BASE_EXTENSION_LOG_STAGING_RING_H__
+#include "nim_log/nim_log_export.h"
+#include "nim_log/config/build_config.h"
+#include <string>
+#include <vector>
+#include <atomic>
+
+NIMLOG_BEGIN_DECLS
+
+//单生产者/单消费者的无锁环形缓冲区
+//每个写日志的线程拥有一个，写日志时只写自己的环，由异步写线程统一收割
+class NIMLOG_EXPORT LogStagingRing
+{
+public:
+	explicit LogStagingRing(size_t capacity);
+	~LogStagingRing() = default;
+public:
+	//生产者调用，空间不足或已Detach时返回false
+	bool Write(const char* text, size_t length);
+	//消费者调用，把环中的日志全部追加到data中，返回读取的条数
+	size_t Read(std::string& data);
+	bool IsEmpty() const;
+	//环占用的字节数，无论是否有数据
+	size_t Capacity() const { return buffer_.size(); }
+	//写日志的线程已退出，不会再有新的数据写入
+	void Orphan() { orphaned_ = true; }
+	bool IsOrphaned() const { return orphaned_; }
+	//所属的写线程已停止，环不会再被收割；等正在进行的Write结束后返回，
+	//之后的Write都返回false，所以Detach之后收割一次就不会漏掉数据
+	void Detach();
+	bool IsDetached() const { return detached_; }
+private:
+	void CopyIn(size_t pos, const char* data, size_t length);
+	void CopyOut(size_t pos, char* data, size_t length) const;
+private:
+	std::vector<char> buffer_;
+	size_t mask_;
+	std::atomic<size_t> head_;//写位置，只由生产者修改
+	std::atomic<size_t> tail_;//读位置，只由消费者修改
+	std::atomic_bool orphaned_;
+	std::atomic_bool detached_;
+	std::atomic_bool writing_;//生产者正在Write，与detached_一起保证Detach之后不再有写入
+};
+
+NIMLOG_END_DECLS
+
+#endif//__BASE_EXTENSION_LOG_STAGING_RING_H__
@@ -1,5 +1,11 @@
 #include "nim_log/wrapper/log.h"
 #include "nim_log/log/log_imp.h"
+#include <vector>
+#include "extension/file_util/utf8_file_util.h"
+#include "extension/memory/memory_accounting.h"
+#include "extension/metrics/metrics_registry.h"
+#include "extension/thread/task_instrumentation.h"
+#include "extension/zip/compression.h"
 NIMLOG_BEGIN_DECLS
 Logger NIMLog::CreateLogger()
 {
@@ -9,4 +15,65 @@ LogMessage NIMLog::CreateLogMessage(const char* file, long line, const Logger& l
 {
 	return std::make_unique<LogMessageImpl>(file, line, logger);
 }
+void NIMLog::ReportLongTasks(const Logger& logger)
+{
+	NS_EXTENSION::TaskInstrumentation::SetLongTaskHandler([logger](const NS_EXTENSION::LongTaskInfo& info) {
+		__NIM_LOG_WAR("long task on thread {0} posted from {1}: ran {2}ms, queued {3}ms", logger)
+			<< info.thread_name << info.posted_from.ToString()
+			<< info.run_time.InMilliseconds() << info.queue_delay.InMilliseconds();
+	});
+}
+void NIMLog::WriteMetricsSnapshot(const Logger& logger)
+{
+	if (!IsLevelEnabled(logger, LOG_LEVEL::LV_APP))
+		return;
+	std::string line = NS_EXTENSION::MetricsRegistry::GetInstance()->Snapshot().ToLogLine();
+	if (!line.empty())
+		__NIM_LOG_APP("metrics {0}", logger) << line;
+}
+void NIMLog::WriteMemorySnapshot(const Logger& logger)
+{
+	if (!IsLevelEnabled(logger, LOG_LEVEL::LV_APP))
+		return;
+	__NIM_LOG_APP("memory {0}", logger) << NS_EXTENSION::MemoryAccounting::Snapshot().ToLogLine();
+}
+bool NIMLog::StartMemoryReport(const Logger& logger, NS_EXTENSION::TimeDelta interval)
+{
+	if (logger == nullptr)
+		return false;
+	std::weak_ptr<ILogger> weak_logger = logger;
+	return NS_EXTENSION::MemoryAccounting::StartPeriodicReport(interval, [weak_logger](const NS_EXTENSION::MemoryUsageSnapshot& snapshot) {
+		auto logger = weak_logger.lock();
+		if (IsLevelEnabled(logger, LOG_LEVEL::LV_APP))
+			__NIM_LOG_APP("memory {0}", logger) << snapshot.ToLogLine();
+	});
+}
+bool NIMLog::PackLogFiles(const Logger& logger, const std::string& zip_path)
+{
+	if (logger == nullptr)
+		return false;
+	logger->FlushNow();
+	std::string log_file = logger->GetLogFile();
+	std::string log_name;
+	if (log_file.empty() || !NS_EXTENSION::FilePathApartFileName(log_file, log_name))
+		return false;
+	//当前文件在前，分段文件从log.0开始连续编号，与LogFile::GetSegmentPath一致
+	std::vector<std::string> suffixes;
+	if (NS_EXTENSION::FilePathIsExist(log_file, false))
+		suffixes.push_back(std::string());
+	for (int index = 0; NS_EXTENSION::FilePathIsExist(log_file + "." + std::to_string(index), false); index++)
+		suffixes.push_back("." + std::to_string(index));
+	bool ret = false;
+	{
+		NS_EXTENSION::ZipWriter zip(zip_path);
+		ret = zip.IsValid();
+		//日志以文本为主，最快的等级已经能压到原来的几分之一，不值得多花CPU
+		for (auto it = suffixes.begin(); ret && it != suffixes.end(); ++it)
+			ret = zip.AddFile(log_name + *it, log_file + *it, NS_EXTENSION::kCompressionFastest);
+		ret = ret && zip.Finish();
+	}
+	if (!ret)
+		NS_EXTENSION::DeleteFile(zip_path);
+	return ret;
+}
 NIMLOG_END_DECLS
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define __BASE_EXTENSION_LOG_H__
 #include "nim_log/config/build_config.h"
 #include "nim_log/log/log_def.h"
+#include "nim_log/log/log_module_level.h"
+#include <type_traits>
+#include "extension/time/time.h"
 
 NIMLOG_BEGIN_DECLS
 
@@ -13,6 +16,52 @@ private:
 public:
 	static Logger CreateLogger();
 	static LogMessage CreateLogMessage(const char* file, long line, const Logger& logger);
+	//把开启了任务统计的线程上的长任务以警告级别写入logger，替换默认的LOG(WARNING)
+	static void ReportLongTasks(const Logger& logger);
+	//把MetricsRegistry当前所有指标写成一行应用级日志"metrics ..."，用于定时或退出前记录一次统计
+	static void WriteMetricsSnapshot(const Logger& logger);
+	//把MemoryAccounting统计的各模块内存写成一行应用级日志"memory ..."
+	static void WriteMemorySnapshot(const Logger& logger);
+	//每隔interval在全局定时器线程上WriteMemorySnapshot，不延长logger的生命期；替换MemoryAccounting之前的定时报告
+	static bool StartMemoryReport(const Logger& logger, NS_EXTENSION::TimeDelta interval);
+	//把当前的日志文件和分段文件log.0, log.1, ...打包成zip_path，用于上传；打包前先FlushNow
+	//文件按块流式压缩，不需要一次读入内存。开启了enable_compress_的日志在zip中仍是压缩块，解压后要再用LogBlockCompressor::Decompress
+	static bool PackLogFiles(const Logger& logger, const std::string& zip_path);
+	//在构造LogMessage之前判断日志级别，被过滤掉的日志不会计算任何参数
+	static inline bool IsLevelEnabled(const Logger& logger, LOG_LEVEL lv)
+	{
+		return logger != nullptr && lv <= logger->GetLogLevel();
+	}
+	//模块设置了级别时按模块的级别判断，否则按logger的级别
+	static inline bool IsLevelEnabled(const Logger& logger, LOG_LEVEL lv, LOG_MODULE module)
+	{
+		if (logger == nullptr)
+			return false;
+		int level = LogModuleLevel::GetLevel(module);
+		return level != LogModuleLevel::kUNSET ? (int)lv <= level : lv <= logger->GetLogLevel();
+	}
+	//编译期的级别判断，见NIM_LOG_COMPILE_LEVEL
+	static constexpr bool IsLevelCompiled(LOG_LEVEL lv)
+	{
+		return (int)lv <= NIM_LOG_COMPILE_LEVEL;
+	}
+	//按调用点限流，在构造LogMessage之前判断，被抑制的日志同样不会计算参数；未开启限流时不调用虚函数AllowLog
+	static inline bool IsCallSiteAllowed(const Logger& logger, const char* file, long line, LOG_LEVEL lv)
+	{
+		return !logger->IsRateLimitEnabled() || logger->AllowLog(file, line, lv);
+	}
+	//日志宏在构造LogMessage之前的全部运行期判断，logger只求值一次后按引用传入
+	static inline bool ShouldLog(const Logger& logger, const char* file, long line, LOG_LEVEL lv, LOG_MODULE module)
+	{
+		return IsLevelEnabled(logger, lv, module) && IsCallSiteAllowed(logger, file, line, lv);
+	}
+};
+//用于把日志表达式转换成void，丢弃operator<<链的结果
+class LogMessageVoidify
+{
+public:
+	LogMessageVoidify() = default;
+	void operator&(ILogMessage&) {}
 };
 
 class LoggerSetter : public virtual ILoggerSetter
@@ -30,12 +79,32 @@ protected:
 };
 NIMLOG_END_DECLS
 
-#define __NIM_LOG_PRO(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_PRO, fmt)
-#define __NIM_LOG_APP(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_APP, fmt)
-#define __NIM_LOG_WAR(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_WAR, fmt)
-#define __NIM_LOG_ERR(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_ERR, fmt)
-#define __NIM_LOG_KER(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_KER, fmt)
-#define __NIM_LOG_ASS(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_ASS, fmt)
-#define __NIM_LOG_INT(fmt,Logger) NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__,Logger)->VLog(NS_NIMLOG::LOG_LEVEL::LV_INT, fmt)
+//第一个条件是编译期常量，被NIM_LOG_COMPILE_LEVEL剔除的调用点连同Logger、格式串、参数表达式都不会生成代码
+//Logger可以是GetLogger()这样的表达式，for的初始化部分只求值一次并延长临时对象的生命期；__nim_log_once在循环体执行一次后置空
+//宏展开为一条完整的if/else语句，用在外层的if/else中不会错配
+#define __NIM_MODULE_LOG_LEVEL(fmt,Logger,lv,module) \
+	if (!std::integral_constant<bool, NS_NIMLOG::NIMLog::IsLevelCompiled(lv)>::value) ; else \
+	for (const std::shared_ptr<NS_NIMLOG::ILogger>& __nim_log_logger = (Logger), *__nim_log_once = &__nim_log_logger; \
+		__nim_log_once != nullptr && NS_NIMLOG::NIMLog::ShouldLog(__nim_log_logger, __FILE__, __LINE__, lv, module); __nim_log_once = nullptr) \
+	NS_NIMLOG::LogMessageVoidify() & NS_NIMLOG::NIMLog::CreateLogMessage(__FILE__, __LINE__, __nim_log_logger)->VLog(lv, fmt)
+
+#define __NIM_LOG_LEVEL(fmt,Logger,lv) __NIM_MODULE_LOG_LEVEL(fmt,Logger,lv,NS_NIMLOG::LOG_MODULE::LM_DEFAULT)
+
+#define __NIM_LOG_PRO(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_PRO)
+#define __NIM_LOG_APP(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_APP)
+#define __NIM_LOG_WAR(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_WAR)
+#define __NIM_LOG_ERR(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_ERR)
+#define __NIM_LOG_KER(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_KER)
+#define __NIM_LOG_ASS(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_ASS)
+#define __NIM_LOG_INT(fmt,Logger) __NIM_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_INT)
+
+//按模块过滤的版本，module为LOG_MODULE，级别可用LogModuleLevel单独调整
+#define __NIM_MODULE_LOG_PRO(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_PRO,module)
+#define __NIM_MODULE_LOG_APP(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_APP,module)
+#define __NIM_MODULE_LOG_WAR(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_WAR,module)
+#define __NIM_MODULE_LOG_ERR(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_ERR,module)
+#define __NIM_MODULE_LOG_KER(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_KER,module)
+#define __NIM_MODULE_LOG_ASS(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_ASS,module)
+#define __NIM_MODULE_LOG_INT(fmt,Logger,module) __NIM_MODULE_LOG_LEVEL(fmt,Logger,NS_NIMLOG::LOG_LEVEL::LV_INT,module)
 
 #endif//__BASE_EXTENSION_LOG_H__
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "net/base/address_family.h"
 
 #include "base/logging.h"
+#include "net/base/ip_address.h"
 #include "net/base/sys_addrinfo.h"
 #include "net/base/net_util.h"
 
@@ -21,6 +22,14 @@ AddressFamily GetAddressFamily(const IPAddressNumber& address) {
   }
 }
 
+AddressFamily GetAddressFamily(const IPAddress& address) {
+  if (address.IsIPv4())
+    return ADDRESS_FAMILY_IPV4;
+  if (address.IsIPv6())
+    return ADDRESS_FAMILY_IPV6;
+  return ADDRESS_FAMILY_UNSPECIFIED;
+}
+
 int ConvertAddressFamily(AddressFamily address_family) {
   switch (address_family) {
     case ADDRESS_FAMILY_UNSPECIFIED:
@@ -10,6 +10,8 @@
 
 namespace net {
 
+class IPAddress;
+
 // Enum wrapper around the address family types supported by host resolver
 // procedures.
 enum AddressFamily {
@@ -35,6 +37,7 @@ typedef int HostResolverFlags;
 
 // Returns AddressFamily for |address|.
 NET_EXPORT AddressFamily GetAddressFamily(const IPAddressNumber& address);
+NET_EXPORT AddressFamily GetAddressFamily(const IPAddress& address);
 
 // Maps the given AddressFamily to either AF_INET, AF_INET6 or AF_UNSPEC.
 NET_EXPORT int ConvertAddressFamily(AddressFamily address_family);
@@ -4,23 +4,93 @@
 
 #include "net/base/ip_address.h"
 
+#include <limits.h>
+#include <string.h>
+
+#include <type_traits>
+
 #include "net/base/ip_address_number.h"
+#include "net/url/url_canon_ip.h"
 //#include "url/gurl.h"
 //#include "url/url_canon_ip.h"
 
 namespace net {
 
+namespace {
+
+static_assert(std::is_trivially_copyable<IPAddressBytes>::value,
+              "IPAddressBytes must stay inline and trivially copyable");
+static_assert(std::is_trivially_copyable<IPAddress>::value,
+              "IPAddress must stay inline and trivially copyable");
+
+const uint8_t kIPv4MappedPrefix[] =
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+// Longer than any IPv6 literal with an embedded IPv4 address and brackets.
+const size_t kMaxIPv6LiteralSize = 64;
+
+bool IPAddressPrefixCheck(const IPAddressBytes& ip_address,
+                          const uint8_t* ip_prefix,
+                          size_t prefix_length_in_bits) {
+  // Compare all the bytes that fall entirely within the prefix.
+  size_t num_entire_bytes_in_prefix = prefix_length_in_bits / 8;
+  if (memcmp(ip_address.data(), ip_prefix, num_entire_bytes_in_prefix) != 0)
+    return false;
+
+  // In case the prefix was not a multiple of 8, there will be 1 byte
+  // which is only partially masked.
+  size_t remaining_bits = prefix_length_in_bits % 8;
+  if (remaining_bits != 0) {
+    uint8_t mask = static_cast<uint8_t>(0xFF << (8 - remaining_bits));
+    size_t i = num_entire_bytes_in_prefix;
+    if ((ip_address[i] & mask) != (ip_prefix[i] & mask))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const size_t IPAddressBytes::kMaxSize;
+
+void IPAddressBytes::Assign(const uint8_t* data, size_t data_len) {
+  DCHECK_LE(data_len, kMaxSize);
+  if (data_len > kMaxSize)
+    data_len = 0;
+  size_ = static_cast<uint8_t>(data_len);
+  if (data_len > 0)
+    memcpy(bytes_, data, data_len);
+}
+
+bool IPAddressBytes::operator<(const IPAddressBytes& other) const {
+  if (size_ != other.size_)
+    return size_ < other.size_;
+  return memcmp(bytes_, other.bytes_, size_) < 0;
+}
+
+bool IPAddressBytes::operator==(const IPAddressBytes& other) const {
+  return size_ == other.size_ && memcmp(bytes_, other.bytes_, size_) == 0;
+}
+
+size_t IPAddressBytes::Hash() const {
+  // FNV-1a over the size and the bytes.
+  uint32_t hash = 2166136261u;
+  hash = (hash ^ size_) * 16777619u;
+  for (size_t i = 0; i < size_; ++i)
+    hash = (hash ^ bytes_[i]) * 16777619u;
+  return hash;
+}
+
 const size_t IPAddress::kIPv4AddressSize = 4;
 const size_t IPAddress::kIPv6AddressSize = 16;
 
 IPAddress::IPAddress() {}
 
-IPAddress::IPAddress(const IPAddressNumber& address) : ip_address_(address) {}
+IPAddress::IPAddress(const IPAddressNumber& address)
+    : ip_address_(address.empty() ? nullptr : &address[0], address.size()) {}
 
 IPAddress::IPAddress(const uint8_t* address, size_t address_len)
-    : ip_address_(address, address + address_len) {}
-
-IPAddress::~IPAddress() {}
+    : ip_address_(address, address_len) {}
 
 bool IPAddress::IsIPv4() const {
   return ip_address_.size() == kIPv4AddressSize;
@@ -35,25 +105,52 @@ bool IPAddress::IsValid() const {
 }
 
 bool IPAddress::IsReserved() const {
-  return IsIPAddressReserved(ip_address_);
+  return IsIPAddressReserved(ToIPAddressNumber());
 }
 
 bool IPAddress::IsIPv4Mapped() const {
-  return net::IsIPv4Mapped(ip_address_);
+  if (!IsIPv6())
+    return false;
+  return memcmp(ip_address_.data(), kIPv4MappedPrefix,
+                sizeof(kIPv4MappedPrefix)) == 0;
 }
 
 std::string IPAddress::ToString() const {
-  return IPAddressToString(ip_address_);
+  return IPAddressToString(ip_address_.data(), ip_address_.size());
+}
+
+IPAddressNumber IPAddress::ToIPAddressNumber() const {
+  return IPAddressNumber(ip_address_.begin(), ip_address_.end());
 }
 
 // static
 bool IPAddress::FromIPLiteral(const base::StringPiece& ip_literal,
                               IPAddress* ip_address) {
-  std::vector<uint8_t> number;
-  if (!ParseIPLiteralToNumber(ip_literal, &number))
-    return false;
+  IPAddressBytes bytes;
+  // |ip_literal| could be either a IPv4 or an IPv6 literal. If it contains
+  // a colon however, it must be an IPv6 address.
+  if (ip_literal.find(':') != base::StringPiece::npos) {
+    // The IPv6 parser expects the literal to be surrounded with brackets.
+    if (ip_literal.size() + 2 > kMaxIPv6LiteralSize)
+      return false;
+    char host_brackets[kMaxIPv6LiteralSize];
+    host_brackets[0] = '[';
+    memcpy(host_brackets + 1, ip_literal.data(), ip_literal.size());
+    host_brackets[ip_literal.size() + 1] = ']';
+    url::Component host_comp(0, static_cast<int>(ip_literal.size() + 2));
+    bytes.Resize(kIPv6AddressSize);
+    if (!url::IPv6AddressToNumber(host_brackets, host_comp, bytes.data()))
+      return false;
+  } else {
+    url::Component host_comp(0, static_cast<int>(ip_literal.size()));
+    int num_components;
+    bytes.Resize(kIPv4AddressSize);
+    if (url::IPv4AddressToNumber(ip_literal.data(), host_comp, bytes.data(),
+                                 &num_components) != url::CanonHostInfo::IPV4)
+      return false;
+  }
 
-  std::swap(number, ip_address->ip_address_);
+  ip_address->ip_address_ = bytes;
   return true;
 }
 
@@ -63,11 +160,66 @@ bool IPAddress::operator==(const IPAddress& that) const {
 
 bool IPAddress::operator<(const IPAddress& that) const {
   // Sort IPv4 before IPv6.
-  if (ip_address_.size() != that.ip_address_.size()) {
-    return ip_address_.size() < that.ip_address_.size();
+  return ip_address_ < that.ip_address_;
+}
+
+IPAddress ConvertIPv4ToIPv4MappedIPv6(const IPAddress& address) {
+  DCHECK(address.IsIPv4());
+  // IPv4-mapped addresses are formed by:
+  // <80 bits of zeros>  + <16 bits of ones> + <32-bit IPv4 address>.
+  uint8_t bytes[IPAddressBytes::kMaxSize];
+  memcpy(bytes, kIPv4MappedPrefix, sizeof(kIPv4MappedPrefix));
+  memcpy(bytes + sizeof(kIPv4MappedPrefix), address.bytes().data(),
+         IPAddress::kIPv4AddressSize);
+  return IPAddress(bytes);
+}
+
+IPAddress ConvertIPv4MappedIPv6ToIPv4(const IPAddress& address) {
+  DCHECK(address.IsIPv4Mapped());
+  return IPAddress(address.bytes().data() + sizeof(kIPv4MappedPrefix),
+                   IPAddress::kIPv4AddressSize);
+}
+
+bool IPAddressMatchesPrefix(const IPAddress& ip_address,
+                            const IPAddress& ip_prefix,
+                            size_t prefix_length_in_bits) {
+  // Both the input IP address and the prefix IP address should be either IPv4
+  // or IPv6.
+  DCHECK(ip_address.IsValid());
+  DCHECK(ip_prefix.IsValid());
+
+  DCHECK_LE(prefix_length_in_bits, ip_prefix.size() * 8);
+
+  // In case we have an IPv6 / IPv4 mismatch, convert the IPv4 addresses to
+  // IPv6 addresses in order to do the comparison.
+  if (ip_address.size() != ip_prefix.size()) {
+    if (ip_address.IsIPv4()) {
+      return IPAddressMatchesPrefix(ConvertIPv4ToIPv4MappedIPv6(ip_address),
+                                    ip_prefix, prefix_length_in_bits);
+    }
+    return IPAddressMatchesPrefix(ip_address,
+                                  ConvertIPv4ToIPv4MappedIPv6(ip_prefix),
+                                  96 + prefix_length_in_bits);
   }
 
-  return ip_address_ < that.ip_address_;
+  return IPAddressPrefixCheck(ip_address.bytes(), ip_prefix.bytes().data(),
+                              prefix_length_in_bits);
+}
+
+unsigned MaskPrefixLength(const IPAddress& mask) {
+  const IPAddressBytes& bytes = mask.bytes();
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    unsigned diff = bytes[i] ^ 0xFF;
+    if (!diff)
+      continue;
+    for (unsigned j = 0; j < CHAR_BIT; ++j) {
+      if (diff & (1 << (CHAR_BIT - 1)))
+        return static_cast<unsigned>(i * CHAR_BIT + j);
+      diff <<= 1;
+    }
+    NOTREACHED();
+  }
+  return static_cast<unsigned>(bytes.size() * CHAR_BIT);
 }
 
 }  // namespace net
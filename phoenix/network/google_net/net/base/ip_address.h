@@ -12,12 +12,63 @@
 #include <vector>
 
 #include "base/compiler_specific.h"
+#include "base/containers/hash_tables.h"
+#include "base/logging.h"
 #include "base/strings/string_piece.h"
 #include "net/base/ip_address_number.h"
 #include "net/net_export.h"
 
 namespace net {
 
+// The bytes of an IP address kept inline, so creating and copying an address
+// never allocates. The size doubles as the family tag: 4 for IPv4, 16 for
+// IPv6 and 0 for an invalid address. Trivially copyable, the bytes past
+// size() are undefined and never compared.
+class NET_EXPORT IPAddressBytes {
+ public:
+  static const size_t kMaxSize = 16;
+
+  IPAddressBytes() : size_(0) {}
+  IPAddressBytes(const uint8_t* data, size_t data_len) { Assign(data, data_len); }
+
+  // Copies |data_len| elements from |data| into this object.
+  void Assign(const uint8_t* data, size_t data_len);
+
+  // Sets the size to |size| bytes, the bytes added are undefined.
+  void Resize(size_t size) {
+    DCHECK_LE(size, kMaxSize);
+    size_ = static_cast<uint8_t>(size);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const uint8_t* data() const { return bytes_; }
+  uint8_t* data() { return bytes_; }
+  const uint8_t* begin() const { return bytes_; }
+  const uint8_t* end() const { return bytes_ + size_; }
+
+  uint8_t operator[](size_t pos) const {
+    DCHECK_LT(pos, size_);
+    return bytes_[pos];
+  }
+  uint8_t& operator[](size_t pos) {
+    DCHECK_LT(pos, size_);
+    return bytes_[pos];
+  }
+
+  // Orders by size first, so does IPAddress.
+  bool operator<(const IPAddressBytes& other) const;
+  bool operator==(const IPAddressBytes& other) const;
+  bool operator!=(const IPAddressBytes& other) const { return !(*this == other); }
+
+  size_t Hash() const;
+
+ private:
+  uint8_t bytes_[kMaxSize];
+  uint8_t size_;
+};
+
 class NET_EXPORT IPAddress {
  public:
   static const size_t kIPv4AddressSize;
@@ -29,6 +80,8 @@ class NET_EXPORT IPAddress {
   // Creates an IP address from a deprecated IPAddressNumber.
   explicit IPAddress(const IPAddressNumber& address);
 
+  explicit IPAddress(const IPAddressBytes& address) : ip_address_(address) {}
+
   // Copies the input address to |ip_address_|. The input is expected to be in
   // network byte order.
   template <size_t N>
@@ -39,8 +92,6 @@ class NET_EXPORT IPAddress {
   // parameter. The input is expected to be in network byte order.
   IPAddress(const uint8_t* address, size_t address_len);
 
-  ~IPAddress();
-
   // Returns true if the IP has |kIPv4AddressSize| elements.
   bool IsIPv4() const;
 
@@ -75,20 +126,51 @@ class NET_EXPORT IPAddress {
   static bool FromIPLiteral(const base::StringPiece& ip_literal,
                             IPAddress* ip_address) WARN_UNUSED_RESULT;
 
-  // Returns the underlying byte vector.
-  const std::vector<uint8_t>& bytes() const { return ip_address_; };
+  // Returns the underlying bytes.
+  const IPAddressBytes& bytes() const { return ip_address_; };
+
+  // Copies the bytes to a deprecated IPAddressNumber, for the code not
+  // migrated to IPAddress yet. Allocates, keep it off the hot paths.
+  IPAddressNumber ToIPAddressNumber() const;
 
   bool operator==(const IPAddress& that) const;
+  bool operator!=(const IPAddress& that) const { return !(*this == that); }
   bool operator<(const IPAddress& that) const;
 
  private:
   // IPv4 addresses will have length kIPv4AddressSize, whereas IPv6 address
   // will have length kIPv6AddressSize.
-  std::vector<uint8_t> ip_address_;
+  IPAddressBytes ip_address_;
 
   // This class is copyable and assignable.
 };
 
+// Returns the IPv4 address mapped into an IPv6 one (::ffff:a.b.c.d).
+NET_EXPORT IPAddress ConvertIPv4ToIPv4MappedIPv6(const IPAddress& address);
+
+// Returns the IPv4 address of an IPv4-mapped IPv6 one.
+NET_EXPORT IPAddress ConvertIPv4MappedIPv6ToIPv4(const IPAddress& address);
+
+// Compares the first |prefix_length_in_bits| bits of the addresses, an IPv4
+// address is compared as mapped into IPv6 with an IPv6 prefix, and vice versa.
+NET_EXPORT bool IPAddressMatchesPrefix(const IPAddress& ip_address,
+                                       const IPAddress& ip_prefix,
+                                       size_t prefix_length_in_bits);
+
+// Returns the number of leading 1 bits of a netmask.
+NET_EXPORT unsigned MaskPrefixLength(const IPAddress& mask);
+
 }  // namespace net
 
+namespace BASE_HASH_NAMESPACE {
+
+template <>
+struct hash<net::IPAddress> {
+  std::size_t operator()(const net::IPAddress& address) const {
+    return address.bytes().Hash();
+  }
+};
+
+}  // namespace BASE_HASH_NAMESPACE
+
 #endif  // NET_BASE_IP_ADDRESS_NET_H_
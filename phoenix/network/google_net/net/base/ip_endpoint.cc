@@ -83,19 +83,12 @@ bool GetIPAddressFromSockAddr(const struct sockaddr* sock_addr,
 
 IPEndPoint::IPEndPoint() : port_(0) {}
 
-IPEndPoint::~IPEndPoint() {}
-
 IPEndPoint::IPEndPoint(const IPAddressNumber& address, uint16_t port)
     : address_(address), port_(port) {
 }
 
 IPEndPoint::IPEndPoint(const IPAddress& address, uint16_t port)
-    : address_(address.bytes()), port_(port) {
-}
-
-IPEndPoint::IPEndPoint(const IPEndPoint& endpoint) {
-  address_ = endpoint.address_;
-  port_ = endpoint.port_;
+    : address_(address), port_(port) {
 }
 
 AddressFamily IPEndPoint::GetFamily() const {
@@ -127,7 +120,7 @@ bool IPEndPoint::ToSockAddr(struct sockaddr* address,
       memset(addr, 0, sizeof(struct sockaddr_in));
       addr->sin_family = AF_INET;
       addr->sin_port = base::HostToNet16(port_);
-      memcpy(&addr->sin_addr, &address_[0], kIPv4AddressSize);
+      memcpy(&addr->sin_addr, address_.bytes().data(), kIPv4AddressSize);
       break;
     }
     case kIPv6AddressSize: {
@@ -139,7 +132,7 @@ bool IPEndPoint::ToSockAddr(struct sockaddr* address,
       memset(addr6, 0, sizeof(struct sockaddr_in6));
       addr6->sin6_family = AF_INET6;
       addr6->sin6_port = base::HostToNet16(port_);
-      memcpy(&addr6->sin6_addr, &address_[0], kIPv6AddressSize);
+      memcpy(&addr6->sin6_addr, address_.bytes().data(), kIPv6AddressSize);
       break;
     }
     default:
@@ -160,24 +153,22 @@ bool IPEndPoint::FromSockAddr(const struct sockaddr* sock_addr,
     return false;
   }
 
-  address_.assign(address, address + address_len);
+  address_ = IPAddress(address, address_len);
   port_ = port;
   return true;
 }
 
 std::string IPEndPoint::ToString() const {
-  return IPAddressToStringWithPort(address_, port_);
+  return IPAddressToStringWithPort(address_.bytes().data(), address_.size(),
+                                   port_);
 }
 
 std::string IPEndPoint::ToStringWithoutPort() const {
-  return IPAddressToString(address_);
+  return address_.ToString();
 }
 
 bool IPEndPoint::operator<(const IPEndPoint& other) const {
-  // Sort IPv4 before IPv6.
-  if (address_.size() != other.address_.size()) {
-    return address_.size() < other.address_.size();
-  }
+  // Sort IPv4 before IPv6, IPAddress orders by size first.
   return std::tie(address_, port_) < std::tie(other.address_, other.port_);
 }
 
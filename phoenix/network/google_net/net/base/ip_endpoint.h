@@ -11,6 +11,7 @@
 
 #include "base/compiler_specific.h"
 #include "net/base/address_family.h"
+#include "net/base/ip_address.h"
 #include "net/base/ip_address_number.h"
 #include "net/net_export.h"
 #include "net/base/sys_addrinfo.h"
@@ -19,21 +20,19 @@ struct sockaddr;
 
 namespace net {
 
-class IPAddress;
-
 // An IPEndPoint represents the address of a transport endpoint:
 //  * IP address (either v4 or v6)
 //  * Port
+// The address is stored inline, so IPEndPoint is trivially copyable and an
+// AddressList of them is one contiguous allocation.
 class NET_EXPORT IPEndPoint {
  public:
   IPEndPoint();
-  ~IPEndPoint();
   // DEPRECATED(crbug.com/496258): Use the ctor that takes IPAddress instead.
   IPEndPoint(const IPAddressNumber& address, uint16_t port);
   IPEndPoint(const IPAddress& address, uint16_t port);
-  IPEndPoint(const IPEndPoint& endpoint);
 
-  const IPAddressNumber& address() const { return address_; }
+  const IPAddress& address() const { return address_; }
   uint16_t port() const { return port_; }
 
   // Returns AddressFamily of the address.
@@ -68,9 +67,10 @@ class NET_EXPORT IPEndPoint {
 
   bool operator<(const IPEndPoint& that) const;
   bool operator==(const IPEndPoint& that) const;
+  bool operator!=(const IPEndPoint& that) const { return !(*this == that); }
 
  private:
-  IPAddressNumber address_;
+  IPAddress address_;
   uint16_t port_;
 };
 
@@ -59,12 +59,17 @@ IPPattern::IPPattern() : is_ipv4_(true) {}
 IPPattern::~IPPattern() {}
 
 bool IPPattern::Match(const IPAddressNumber& address) const {
+  return Match(IPAddress(address));
+}
+
+bool IPPattern::Match(const IPAddress& ip_address) const {
   if (ip_mask_.empty())
     return false;
-  bool address_is_ipv4 = address.size() == kIPv4AddressSize;
-  if (address_is_ipv4 != is_ipv4_)
+  if (ip_address.IsIPv4() != is_ipv4_ || !ip_address.IsValid())
     return false;
 
+  const IPAddressBytes& address = ip_address.bytes();
+
   ComponentPatternList::const_iterator pattern_it(component_patterns_.begin());
   int fixed_value_index = 0;
   // IPv6 |address| vectors have 16 pieces, while our  |ip_mask_| has only
@@ -13,6 +13,7 @@
 #include "base/macros.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "net/base/ip_address.h"
 #include "net/base/ip_address_number.h"
 #include "net/net_export.h"
 
@@ -30,6 +31,8 @@ class NET_EXPORT IPPattern {
   bool ParsePattern(const std::string& ip_pattern);
   // Test to see if the current pattern in |this| matches the given |address|
   // and return true if it matches.
+  bool Match(const IPAddress& address) const;
+  // DEPRECATED(crbug.com/496258): Use the method above that takes IPAddress.
   bool Match(const IPAddressNumber& address) const;
 
   bool is_ipv4() const { return is_ipv4_; }
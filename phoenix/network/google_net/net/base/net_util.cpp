@@ -9,6 +9,7 @@
 
 #include <assert.h>
 #include "extension/strings/string_util.h"
+#include "extension/strings/string_format.h"
 
 #if defined(OS_POSIX)
 #include <fcntl.h>
@@ -53,10 +54,10 @@ std::string NetAddressToStringWithPort(
 
 	if (ip_address_string.find(':') != std::string::npos) {
 		// Surround with square brackets to avoid ambiguity.
-		return NS_EXTENSION::StringPrintf("[%s]:%d", ip_address_string.c_str(), port);
+		return NS_EXTENSION::StringFormat(EXTENSION_FORMAT("[{}]:{}"), ip_address_string, port);
 	}
 
-	return NS_EXTENSION::StringPrintf("%s:%d", ip_address_string.c_str(), port);
+	return NS_EXTENSION::StringFormat(EXTENSION_FORMAT("{}:{}"), ip_address_string, port);
 }
 // 
 // std::string GetHostName()
@@ -712,6 +712,11 @@ bool NetworkChangeNotifier::IsOffline() {
    return GetConnectionType() == CONNECTION_NONE;
 }
 
+// static
+bool NetworkChangeNotifier::HasNetworkChangeNotifier() {
+  return g_network_change_notifier != NULL;
+}
+
 // static
 bool NetworkChangeNotifier::IsConnectionCellular(ConnectionType type) {
   bool is_cellular = false;
@@ -965,6 +970,7 @@ NetworkChangeNotifier::GetCurrentDefaultNetwork() const {
 
 // static
 void NetworkChangeNotifier::NotifyObserversOfIPAddressChange() {
+  InvalidateCachedNetworkList();
   if (g_network_change_notifier &&
       !NetworkChangeNotifier::test_notifications_only_) {
     g_network_change_notifier->NotifyObserversOfIPAddressChangeImpl();
@@ -973,6 +979,7 @@ void NetworkChangeNotifier::NotifyObserversOfIPAddressChange() {
 
 // static
 void NetworkChangeNotifier::NotifyObserversOfConnectionTypeChange() {
+  InvalidateCachedNetworkList();
   if (g_network_change_notifier &&
       !NetworkChangeNotifier::test_notifications_only_) {
     g_network_change_notifier->NotifyObserversOfConnectionTypeChangeImpl(
@@ -983,6 +990,7 @@ void NetworkChangeNotifier::NotifyObserversOfConnectionTypeChange() {
 // static
 void NetworkChangeNotifier::NotifyObserversOfNetworkChange(
     ConnectionType type) {
+  InvalidateCachedNetworkList();
   if (g_network_change_notifier &&
       !NetworkChangeNotifier::test_notifications_only_) {
     g_network_change_notifier->NotifyObserversOfNetworkChangeImpl(type);
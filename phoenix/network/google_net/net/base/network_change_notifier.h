@@ -342,6 +342,10 @@ class NET_EXPORT NetworkChangeNotifier {
   // will be successfully.
   static bool IsOffline();
 
+  // Returns true if a NetworkChangeNotifier has been created and is delivering
+  // notifications.
+  static bool HasNetworkChangeNotifier();
+
   // Returns true if |type| is a cellular connection.
   // Returns false if |type| is CONNECTION_UNKNOWN, and thus, depending on the
   // implementation of GetConnectionType(), it is possible that
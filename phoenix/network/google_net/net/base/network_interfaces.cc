@@ -3,10 +3,33 @@
 // found in the LICENSE file.
 
 #include "net/base/network_interfaces.h"
+
+#include "base/synchronization/lock.h"
 #include "tnet.h"
 
 namespace net {
 
+namespace {
+
+// Snapshots kept by GetCachedNetworkList(), one per
+// HostAddressSelectionPolicy. |generation| is bumped on every invalidation so
+// that an enumeration racing with a change does not store a stale list.
+struct NetworkListCache {
+  NetworkListCache() : generation(0) {}
+
+  base::Lock lock;
+  uint64_t generation;
+  std::shared_ptr<const NetworkInterfaceList> lists[2];
+};
+
+NetworkListCache* GetNetworkListCache() {
+  // Leaked on purpose: may be used from notifier threads during shutdown.
+  static NetworkListCache* cache = new NetworkListCache();
+  return cache;
+}
+
+}  // namespace
+
 
 int NetStartup()
 {
@@ -43,4 +66,45 @@ NetworkInterface::~NetworkInterface() {
 ScopedWifiOptions::~ScopedWifiOptions() {
 }
 
+std::shared_ptr<const NetworkInterfaceList> GetCachedNetworkList(int policy) {
+  // Without change notifications there is nothing to invalidate the snapshot.
+  if (!NetworkChangeNotifier::HasNetworkChangeNotifier()) {
+    std::shared_ptr<NetworkInterfaceList> networks =
+        std::make_shared<NetworkInterfaceList>();
+    if (!GetNetworkList(networks.get(), policy))
+      return nullptr;
+    return networks;
+  }
+
+  size_t index = (policy & EXCLUDE_HOST_SCOPE_VIRTUAL_INTERFACES) ? 1 : 0;
+  NetworkListCache* cache = GetNetworkListCache();
+  uint64_t generation;
+  {
+    base::AutoLock lock(cache->lock);
+    if (cache->lists[index])
+      return cache->lists[index];
+    generation = cache->generation;
+  }
+
+  // Enumerate without holding the lock, GetAdaptersAddresses() can take
+  // tens of milliseconds with many virtual adapters.
+  std::shared_ptr<NetworkInterfaceList> networks =
+      std::make_shared<NetworkInterfaceList>();
+  if (!GetNetworkList(networks.get(), policy))
+    return nullptr;
+
+  base::AutoLock lock(cache->lock);
+  if (cache->generation == generation)
+    cache->lists[index] = networks;
+  return networks;
+}
+
+void InvalidateCachedNetworkList() {
+  NetworkListCache* cache = GetNetworkListCache();
+  base::AutoLock lock(cache->lock);
+  cache->generation++;
+  cache->lists[0].reset();
+  cache->lists[1].reset();
+}
+
 }  // namespace net
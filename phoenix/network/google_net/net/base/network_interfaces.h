@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -79,6 +80,19 @@ enum HostAddressSelectionPolicy {
 NET_EXPORT bool GetNetworkList(NetworkInterfaceList* networks,
                                int policy);
 
+// Returns the result of GetNetworkList(|policy|) as a snapshot shared by all
+// callers. The list is only enumerated again after NetworkChangeNotifier
+// reports an IP address, connection type or network change, so this is cheap
+// enough to poll from timers. Without a NetworkChangeNotifier every call
+// enumerates, like GetNetworkList(). Returns NULL if enumeration failed.
+// Can be called on any thread; enumeration needs a thread that allows IO.
+NET_EXPORT std::shared_ptr<const NetworkInterfaceList> GetCachedNetworkList(
+    int policy);
+
+// Drops the snapshots kept by GetCachedNetworkList(). Called by
+// NetworkChangeNotifier before notifying observers.
+NET_EXPORT void InvalidateCachedNetworkList();
+
 // Gets the SSID of the currently associated WiFi access point if there is one.
 // Otherwise, returns empty string.
 // Currently only implemented on Linux, ChromeOS, Android and Windows.
@@ -216,10 +216,11 @@ bool GetNetworkList(NetworkInterfaceList* networks, int policy) {
 }
 
 std::string GetWifiSSID() {
-  NetworkInterfaceList networks;
-  if (GetNetworkList(&networks, INCLUDE_HOST_SCOPE_VIRTUAL_INTERFACES)) {
+  std::shared_ptr<const NetworkInterfaceList> networks =
+      GetCachedNetworkList(INCLUDE_HOST_SCOPE_VIRTUAL_INTERFACES);
+  if (networks) {
     return internal::GetWifiSSIDFromInterfaceListInternal(
-        networks, internal::GetInterfaceSSID);
+        *networks, internal::GetInterfaceSSID);
   }
   return "";
 }
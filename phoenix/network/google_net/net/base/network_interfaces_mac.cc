@@ -210,7 +210,8 @@ bool GetNetworkListImpl(NetworkInterfaceList* networks,
       }
       networks->push_back(NetworkInterface(
           name, name, if_nametoindex(name.c_str()), connection_type,
-          address.address(), prefix_length, ip_attributes));
+          address.address().ToIPAddressNumber(), prefix_length,
+          ip_attributes));
     }
   }
 
@@ -184,9 +184,9 @@ bool GetNetworkListImpl(NetworkInterfaceList* networks,
               if (prefix_family == family &&
                   network_endpoint.FromSockAddr(prefix->Address.lpSockaddr,
                       prefix->Address.iSockaddrLength) &&
-                  IPNumberMatchesPrefix(endpoint.address(),
-                                        network_endpoint.address(),
-                                        prefix->PrefixLength)) {
+                  IPAddressMatchesPrefix(endpoint.address(),
+                                         network_endpoint.address(),
+                                         prefix->PrefixLength)) {
                 prefix_length =
                     std::max<size_t>(prefix_length, prefix->PrefixLength);
               }
@@ -218,7 +218,7 @@ bool GetNetworkListImpl(NetworkInterfaceList* networks,
           }
 		  NetworkInterface net_work_interface(adapter->AdapterName,
 			  base::SysWideToNativeMB(adapter->FriendlyName), index,
-			  GetNetworkInterfaceType(adapter->IfType), endpoint.address(),
+			  GetNetworkInterfaceType(adapter->IfType), endpoint.address().ToIPAddressNumber(),
 			  prefix_length, ip_address_attributes);
 		  net_work_interface.mac_address.resize(adapter->PhysicalAddressLength);
 		  memcpy(&net_work_interface.mac_address.front(), adapter->PhysicalAddress, adapter->PhysicalAddressLength);
@@ -70,7 +70,7 @@ void NameServerClassifier::AddRule(const char* pattern_string,
 }
 
 NameServerClassifier::NameServersType NameServerClassifier::GetNameServerType(
-    const IPAddressNumber& address) const {
+    const IPAddress& address) const {
   for (ScopedVector<NameServerTypeRule>::const_iterator it = rules_.begin();
        it != rules_.end();
        ++it) {
@@ -56,7 +56,7 @@ class NET_EXPORT_PRIVATE NameServerClassifier {
   struct NameServerTypeRule;
 
   void AddRule(const char* pattern_string, NameServersType type);
-  NameServersType GetNameServerType(const IPAddressNumber& address) const;
+  NameServersType GetNameServerType(const IPAddress& address) const;
   static NameServersType MergeNameServersTypes(NameServersType a,
                                                NameServersType b);
 
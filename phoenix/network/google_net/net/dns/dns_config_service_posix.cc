@@ -542,7 +542,8 @@ ConfigParsePosixResult ConvertResStateToDnsConfig(const struct __res_state& res,
 
   // If any name server is 0.0.0.0, assume the configuration is invalid.
   // TODO(szym): Measure how often this happens. http://crbug.com/125599
-  const IPAddressNumber kEmptyAddress(kIPv4AddressSize);
+  const uint8_t kEmptyAddressBytes[] = { 0, 0, 0, 0 };
+  const IPAddress kEmptyAddress(kEmptyAddressBytes);
   for (unsigned i = 0; i < dns_config->nameservers.size(); ++i) {
     if (dns_config->nameservers[i].address() == kEmptyAddress)
       return CONFIG_PARSE_POSIX_NULL_ADDRESS;
@@ -237,10 +237,8 @@ HostsParseWinResult AddLocalhostEntries(DnsHosts* hosts) {
   const unsigned char kIPv4Localhost[] = { 127, 0, 0, 1 };
   const unsigned char kIPv6Localhost[] = { 0, 0, 0, 0, 0, 0, 0, 0,
                                            0, 0, 0, 0, 0, 0, 0, 1 };
-  IPAddressNumber loopback_ipv4(kIPv4Localhost,
-                                kIPv4Localhost + arraysize(kIPv4Localhost));
-  IPAddressNumber loopback_ipv6(kIPv6Localhost,
-                                kIPv6Localhost + arraysize(kIPv6Localhost));
+  IPAddress loopback_ipv4(kIPv4Localhost);
+  IPAddress loopback_ipv6(kIPv6Localhost);
 
   // This does not override any pre-existing entries from the HOSTS file.
   hosts->insert(std::make_pair(DnsHostsKey("localhost", ADDRESS_FAMILY_IPV4),
@@ -344,15 +342,16 @@ class RegistryWatcher : public base::NonThreadSafe {
 // Returns true iff |address| is DNS address from IPv6 stateless discovery,
 // i.e., matches fec0:0:0:ffff::{1,2,3}.
 // http://tools.ietf.org/html/draft-ietf-ipngwg-dns-discovery
-bool IsStatelessDiscoveryAddress(const IPAddressNumber& address) {
-  if (address.size() != kIPv6AddressSize)
+bool IsStatelessDiscoveryAddress(const IPAddress& address) {
+  if (!address.IsIPv6())
     return false;
   const uint8_t kPrefix[] = {
       0xfe, 0xc0, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
   };
   return std::equal(kPrefix, kPrefix + arraysize(kPrefix),
-                    address.begin()) && (address.back() < 4);
+                    address.bytes().begin()) &&
+         (address.bytes()[kIPv6AddressSize - 1] < 4);
 }
 
 // Returns the path to the HOSTS file.
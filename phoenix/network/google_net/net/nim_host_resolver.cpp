@@ -0,0 +1,276 @@
+#include "net/nim_host_resolver.h"
+#include "net/nim_net_util.h"
+#include "net/base/net_errors.h"
+#include "extension/strings/string_util.h"
+#include <future>
+
+NET_BEGIN_DECLS
+
+NimHostResolver* NimHostResolver::GetInstance()
+{
+	static NimHostResolver *instance = new NimHostResolver;
+	return instance;
+}
+
+NimHostResolver::NimHostResolver() :
+	workers_("nim_host_resolver", options_.thread_count),
+	generation_(0)
+{
+}
+
+void NimHostResolver::SetOptions(const NimHostResolverOptions& options)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	options_ = options;
+	if (options_.thread_count == 0)
+		options_.thread_count = 1;
+	workers_.SetMaxThreads(options_.thread_count);
+	TrimLocked();
+}
+
+void NimHostResolver::SetBackend(const Backend& backend)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	backend_ = backend;
+}
+
+void NimHostResolver::SetPrefetchHosts(const std::list<std::string>& hosts)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		prefetch_hosts_ = hosts;
+	}
+	Prefetch();
+}
+
+void NimHostResolver::Prefetch()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto now = std::chrono::steady_clock::now();
+	for (auto& host : prefetch_hosts_)
+	{
+		std::string key = MakeKey(host, HOST_RESOLVER_SYSTEM_ONLY, ADDRESS_FAMILY_UNSPECIFIED);
+		auto it = cache_.find(key);
+		if (it != cache_.end() && now < it->second.expires)
+			continue;
+		StartJobLocked(key, host, HOST_RESOLVER_SYSTEM_ONLY, ADDRESS_FAMILY_UNSPECIFIED, nullptr);
+	}
+}
+
+void NimHostResolver::Seed(const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	if (ip_list.empty())
+		return;
+
+	std::lock_guard<std::mutex> guard(lock_);
+	std::string key = MakeKey(host, HOST_RESOLVER_SYSTEM_ONLY, ADDRESS_FAMILY_UNSPECIFIED);
+	//已有本次运行解析到的结果时不覆盖
+	if (cache_.find(key) != cache_.end())
+		return;
+	CacheEntry& entry = cache_[key];
+	entry.error = OK;
+	entry.ip_list = ip_list;
+	entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(ttl_seconds);
+	TrimLocked();
+}
+
+std::string NimHostResolver::MakeKey(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family)
+{
+	return NS_EXTENSION::StringPrintf("%s|%d|%d", host.c_str(), host_resolver_flags, (int)addr_family);
+}
+
+void NimHostResolver::Resolve(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, const ResolveCallback& callback)
+{
+	std::string key = MakeKey(host, host_resolver_flags, addr_family);
+	int error = OK;
+	std::list<std::string> ip_list;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto it = cache_.find(key);
+		auto now = std::chrono::steady_clock::now();
+		bool usable = false;
+		if (it != cache_.end())
+		{
+			if (now < it->second.expires)
+				usable = true;
+			else if (it->second.error == OK && now < it->second.expires + std::chrono::seconds(options_.max_stale_seconds))
+			{
+				//过期不久的结果先返回，同时在后台刷新
+				usable = true;
+				if (inflight_.find(key) == inflight_.end())
+					StartJobLocked(key, host, host_resolver_flags, addr_family, nullptr);
+			}
+		}
+		if (!usable)
+		{
+			StartJobLocked(key, host, host_resolver_flags, addr_family, callback);
+			return;
+		}
+		error = it->second.error;
+		ip_list = it->second.ip_list;
+	}
+	if (callback)
+		callback(error, ip_list);
+}
+
+int NimHostResolver::ResolveSync(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, std::list<std::string>& ip_list)
+{
+	auto result = std::make_shared<std::promise<std::pair<int, std::list<std::string>>>>();
+	auto future = result->get_future();
+	Resolve(host, host_resolver_flags, addr_family, [result](int error, const std::list<std::string>& ip_list) {
+		result->set_value(std::make_pair(error, ip_list));
+	});
+	auto value = future.get();
+	ip_list = value.second;
+	return value.first;
+}
+
+void NimHostResolver::Clear()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	cache_.clear();
+	//进行中的解析仍会回调等待者，但新的请求不再合并到旧网络上发起的解析里
+	inflight_.clear();
+	generation_++;
+}
+
+void NimHostResolver::StartJobLocked(const std::string& key, const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, const ResolveCallback& callback)
+{
+	auto it = inflight_.find(key);
+	if (it != inflight_.end())
+	{
+		if (callback)
+			it->second->callbacks.push_back(callback);
+		return;
+	}
+
+	auto job = std::make_shared<Job>();
+	job->key = key;
+	job->host = host;
+	job->host_resolver_flags = host_resolver_flags;
+	job->addr_family = addr_family;
+	job->generation = generation_;
+	job->backend_tried = false;
+	if (callback)
+		job->callbacks.push_back(callback);
+	inflight_[key] = job;
+	QueueJobLocked(job);
+}
+
+void NimHostResolver::QueueJobLocked(const std::shared_ptr<Job>& job)
+{
+	workers_.PostTask([this, job]() { RunJob(job); });
+}
+
+void NimHostResolver::RunJob(const std::shared_ptr<Job>& job)
+{
+	Backend backend;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!job->backend_tried)
+			backend = backend_;
+		job->backend_tried = true;
+	}
+
+	if (backend)
+	{
+		backend(job->host, job->addr_family, [this, job](int error, const std::list<std::string>& ip_list, int ttl_seconds) {
+			OnBackendResolved(job, error, ip_list, ttl_seconds);
+		});
+	}
+	else
+	{
+		std::list<std::string> ip_list;
+		int error = NimNetUtil::SystemResolve(job->host, job->host_resolver_flags, job->addr_family, ip_list);
+		CompleteJob(job, error, ip_list, 0);
+	}
+}
+
+void NimHostResolver::OnBackendResolved(const std::shared_ptr<Job>& job, int error, const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	std::list<std::string> filtered;
+	if (error == OK)
+	{
+		for (auto& ip : ip_list)
+		{
+			bool ipv6 = ip.find(':') != std::string::npos;
+			if ((job->addr_family == ADDRESS_FAMILY_IPV4 && ipv6) || (job->addr_family == ADDRESS_FAMILY_IPV6 && !ipv6))
+				continue;
+			filtered.push_back(ip);
+		}
+	}
+	if (filtered.empty())
+	{
+		//后端不可用时改用系统解析
+		std::lock_guard<std::mutex> guard(lock_);
+		QueueJobLocked(job);
+		return;
+	}
+	CompleteJob(job, OK, filtered, ttl_seconds);
+}
+
+void NimHostResolver::CompleteJob(const std::shared_ptr<Job>& job, int error, const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	std::vector<ResolveCallback> callbacks;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (job->generation == generation_)
+		{
+			StoreLocked(job->key, error, ip_list, ttl_seconds);
+			inflight_.erase(job->key);
+		}
+		callbacks.swap(job->callbacks);
+	}
+	for (auto& callback : callbacks)
+		callback(error, ip_list);
+}
+
+void NimHostResolver::StoreLocked(const std::string& key, int error, const std::list<std::string>& ip_list, int ttl_seconds)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto it = cache_.find(key);
+	if (error != OK && it != cache_.end() && it->second.error == OK &&
+		now < it->second.expires + std::chrono::seconds(options_.max_stale_seconds))
+	{
+		//刷新失败时保留旧结果，弱网下继续使用
+		return;
+	}
+
+	CacheEntry& entry = cache_[key];
+	entry.error = error;
+	entry.ip_list = ip_list;
+	if (error != OK)
+		ttl_seconds = options_.negative_ttl_seconds;
+	else if (ttl_seconds <= 0)
+		ttl_seconds = options_.ttl_seconds;
+	entry.expires = now + std::chrono::seconds(ttl_seconds);
+	TrimLocked();
+}
+
+void NimHostResolver::TrimLocked()
+{
+	if (cache_.size() <= options_.max_entries)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	auto stale = std::chrono::seconds(options_.max_stale_seconds);
+	for (auto it = cache_.begin(); it != cache_.end();)
+	{
+		if (now >= it->second.expires + stale)
+			it = cache_.erase(it);
+		else
+			++it;
+	}
+	while (cache_.size() > options_.max_entries)
+	{
+		auto oldest = cache_.begin();
+		for (auto it = cache_.begin(); it != cache_.end(); ++it)
+		{
+			if (it->second.expires < oldest->second.expires)
+				oldest = it;
+		}
+		cache_.erase(oldest);
+	}
+}
+
+NET_END_DECLS
@@ -0,0 +1,123 @@
+#ifndef _NET_NIM_HOST_RESOLVER_H_
+#define _NET_NIM_HOST_RESOLVER_H_
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/base/address_family.h"
+#include "extension/thread/background_thread.h"
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+struct NimHostResolverOptions
+{
+	NimHostResolverOptions() :
+		thread_count(2),
+		ttl_seconds(60),
+		negative_ttl_seconds(5),
+		max_stale_seconds(600),
+		max_entries(512)
+	{
+	}
+
+	size_t thread_count;		// 执行 getaddrinfo 的线程数
+	int ttl_seconds;			// getaddrinfo 拿不到记录的 TTL，解析成功的结果统一缓存这么久
+	int negative_ttl_seconds;	// 解析失败的结果缓存时间
+	int max_stale_seconds;		// 过期后仍可先返回旧结果、同时后台刷新的时长
+	size_t max_entries;
+};
+
+// 异步的域名解析器
+// 带缓存，同一域名同时只发起一次解析，过期不久的结果先返回再在后台刷新。
+// 网络切换时由 NimNetworkTransition 清空缓存，新网络可用后重新预取 SetPrefetchHosts 设置的域名。
+// 可通过 SetBackend 接入 HTTPDNS/DoH，例如 nim_http 的 IHttpDnsClient：
+//   resolver->SetBackend([client](const std::string& host, AddressFamily, const NimHostResolver::BackendCallback& done) {
+//       client->Resolve(host, [done](bool succeed, const std::list<std::string>& ip_list, int ttl_seconds) {
+//           done(succeed ? net::OK : net::ERR_NAME_NOT_RESOLVED, ip_list, ttl_seconds);
+//       });
+//   });
+//   client->Load([resolver](const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds) {
+//       resolver->Seed(host, ip_list, ttl_seconds);
+//   });
+// 解析在 BackgroundWorkerPool 上执行，线程数为 NimHostResolverOptions::thread_count。
+class NET_EXPORT NimHostResolver
+{
+public:
+	// error 为 net::OK 或 net 错误码
+	typedef std::function<void(int error, const std::list<std::string>& ip_list)> ResolveCallback;
+	// ttl_seconds <= 0 时使用 NimHostResolverOptions::ttl_seconds
+	typedef std::function<void(int error, const std::list<std::string>& ip_list, int ttl_seconds)> BackendCallback;
+	// 可在任意线程回调 callback；失败或没有所需地址族的结果时改用系统 getaddrinfo
+	typedef std::function<void(const std::string& host, AddressFamily addr_family, const BackendCallback& callback)> Backend;
+
+	static NimHostResolver* GetInstance();
+
+	void SetOptions(const NimHostResolverOptions& options);
+	void SetBackend(const Backend& backend);
+	// 设置需要预取的域名并立即预取一次
+	void SetPrefetchHosts(const std::list<std::string>& hosts);
+	// 预取缓存中没有或已过期的 SetPrefetchHosts 域名
+	void Prefetch();
+	// 写入缓存，用于启动时恢复上次持久化的结果；ttl_seconds <= 0 的结果直接按过期处理，仍可在 max_stale_seconds 内使用
+	// 只作用于默认的 HOST_RESOLVER_SYSTEM_ONLY 与 ADDRESS_FAMILY_UNSPECIFIED 查询
+	void Seed(const std::string& host, const std::list<std::string>& ip_list, int ttl_seconds);
+
+	// 命中缓存时在调用线程上同步回调，否则在解析线程上回调
+	void Resolve(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, const ResolveCallback& callback);
+	// 阻塞等待解析结果，不要在 ResolveCallback 中调用
+	int ResolveSync(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, std::list<std::string>& ip_list);
+
+	void Clear();
+
+private:
+	struct CacheEntry
+	{
+		int error;
+		std::list<std::string> ip_list;
+		std::chrono::steady_clock::time_point expires;
+	};
+	struct Job
+	{
+		std::string key;
+		std::string host;
+		HostResolverFlags host_resolver_flags;
+		AddressFamily addr_family;
+		uint64_t generation;
+		bool backend_tried;
+		std::vector<ResolveCallback> callbacks;
+	};
+
+	NimHostResolver();
+
+	static std::string MakeKey(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family);
+
+	void RunJob(const std::shared_ptr<Job>& job);
+	void OnBackendResolved(const std::shared_ptr<Job>& job, int error, const std::list<std::string>& ip_list, int ttl_seconds);
+	void CompleteJob(const std::shared_ptr<Job>& job, int error, const std::list<std::string>& ip_list, int ttl_seconds);
+	// 以下需持有 lock_
+	void StartJobLocked(const std::string& key, const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, const ResolveCallback& callback);
+	void QueueJobLocked(const std::shared_ptr<Job>& job);
+	void StoreLocked(const std::string& key, int error, const std::list<std::string>& ip_list, int ttl_seconds);
+	void TrimLocked();
+
+private:
+	std::mutex lock_;
+	NimHostResolverOptions options_;
+	NS_EXTENSION::BackgroundWorkerPool workers_;
+	Backend backend_;
+	std::list<std::string> prefetch_hosts_;
+	std::map<std::string, CacheEntry> cache_;
+	std::map<std::string, std::shared_ptr<Job>> inflight_;
+	// Clear 后递增，之前发起的解析结果不再写入缓存
+	uint64_t generation_;
+};
+
+NET_END_DECLS
+#endif
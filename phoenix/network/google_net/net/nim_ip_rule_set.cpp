@@ -0,0 +1,323 @@
+#include "net/nim_ip_rule_set.h"
+#include "net/base/ip_pattern.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include <functional>
+#include <map>
+#include <mutex>
+
+NET_BEGIN_DECLS
+
+namespace
+{
+const size_t kIPv4Bytes = 4;
+const size_t kIPv6Bytes = 16;
+// 编译结果缓存的条数，一般只有一两份代理例外列表
+const size_t kMaxCompiledRuleSets = 8;
+
+struct ComponentRange
+{
+	uint32_t min;
+	uint32_t max;
+};
+typedef std::vector<ComponentRange> ComponentRanges;
+
+// 按 IPPattern 的语法解析出每个分量的取值范围，IPv4 为十进制，IPv6 为十六进制
+bool ParseComponents(const std::string& rule, bool ipv4, std::vector<ComponentRanges>& components)
+{
+	uint32_t limit = ipv4 ? 0xFF : 0xFFFF;
+	auto to_int = [ipv4, limit](const base::StringPiece& text, uint32_t* value) {
+		bool ok = ipv4 ? base::StringToUint(text, value) : base::HexStringToUInt(text, value);
+		return ok && *value <= limit;
+	};
+	for (auto& component : base::SplitStringPiece(rule, ipv4 ? "." : ":", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL))
+	{
+		ComponentRanges ranges;
+		if (component == "*")
+		{
+			ranges.push_back({ 0, limit });
+		}
+		else if (component.size() > 2 && component[0] == '[' && component[component.size() - 1] == ']')
+		{
+			for (auto& range : base::SplitStringPiece(component.substr(1, component.size() - 2), ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL))
+			{
+				size_t dash = range.find('-');
+				ComponentRange value;
+				if (!to_int(range.substr(0, dash), &value.min))
+					return false;
+				value.max = value.min;
+				if (dash != base::StringPiece::npos && !to_int(range.substr(dash + 1), &value.max))
+					return false;
+				if (value.min > value.max)
+					return false;
+				ranges.push_back(value);
+			}
+		}
+		else
+		{
+			uint32_t value = 0;
+			if (!to_int(component, &value))
+				return false;
+			ranges.push_back({ value, value });
+		}
+		components.push_back(ranges);
+	}
+	return components.size() == (ipv4 ? 4u : 8u);
+}
+
+// 把 [min, max] 拆成若干个对齐的块，每块对应一个前缀，block_bits 为块内可变的低位数
+template <typename Callback>
+void ForEachBlock(uint32_t min, uint32_t max, const Callback& callback)
+{
+	uint64_t low = min;
+	while (low <= max)
+	{
+		int block_bits = 0;
+		while (block_bits < 16 && (low & ((1ull << (block_bits + 1)) - 1)) == 0 && low + (1ull << (block_bits + 1)) - 1 <= max)
+			block_bits++;
+		callback((uint32_t)low, block_bits);
+		low += 1ull << block_bits;
+	}
+}
+
+void SetComponent(IPAddressNumber& address, size_t index, bool ipv4, uint32_t value)
+{
+	if (ipv4)
+	{
+		address[index] = (unsigned char)value;
+	}
+	else
+	{
+		address[index * 2] = (unsigned char)(value >> 8);
+		address[index * 2 + 1] = (unsigned char)value;
+	}
+}
+}
+
+NimIPRuleSet::NimIPRuleSet() :
+	rule_count_(0)
+{
+	roots_[0] = roots_[1] = kNoChild;
+}
+
+NimIPRuleSet::~NimIPRuleSet()
+{
+}
+
+int32_t NimIPRuleSet::Root(bool ipv4)
+{
+	int32_t& root = roots_[ipv4 ? 0 : 1];
+	if (root == kNoChild)
+	{
+		root = (int32_t)nodes_.size();
+		nodes_.push_back(Node());
+	}
+	return root;
+}
+
+void NimIPRuleSet::AddPrefix(const IPAddressNumber& prefix, size_t prefix_bits, int value)
+{
+	IPAddressNumber address = prefix;
+	//::ffff:0:0/96 以内的前缀按 IPv4 存
+	if (address.size() == kIPv6Bytes && prefix_bits >= 96 && IsIPv4Mapped(address))
+	{
+		address = ConvertIPv4MappedToIPv4(address);
+		prefix_bits -= 96;
+	}
+
+	int32_t node = Root(address.size() == kIPv4Bytes);
+	for (size_t i = 0; i < prefix_bits; i++)
+	{
+		int bit = (address[i / 8] >> (7 - i % 8)) & 1;
+		int32_t next = nodes_[node].child[bit];
+		if (next == kNoChild)
+		{
+			//push_back 可能使引用失效，先取下标
+			next = (int32_t)nodes_.size();
+			nodes_.push_back(Node());
+			nodes_[node].child[bit] = next;
+		}
+		node = next;
+	}
+	nodes_[node].has_value = true;
+	nodes_[node].value = value;
+}
+
+bool NimIPRuleSet::AddRule(const std::string& rule, int value/* = 0*/)
+{
+	IPAddressNumber address;
+	size_t prefix_bits = 0;
+	if (rule.find('/') != std::string::npos)
+	{
+		if (!ParseCIDRBlock(rule, &address, &prefix_bits))
+			return false;
+	}
+	else if (ParseIPLiteralToNumber(rule, &address))
+	{
+		prefix_bits = address.size() * 8;
+	}
+	else
+	{
+		if (!AddPattern(rule, value))
+			return false;
+		rule_count_++;
+		return true;
+	}
+	AddPrefix(address, prefix_bits, value);
+	rule_count_++;
+	return true;
+}
+
+size_t NimIPRuleSet::AddRules(const std::string& rules, int value/* = 0*/)
+{
+	size_t count = 0;
+	for (auto& rule : base::SplitString(rules, ";, \t\r\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY))
+	{
+		if (AddRule(rule, value))
+			count++;
+	}
+	return count;
+}
+
+bool NimIPRuleSet::AddPattern(const std::string& rule, int value)
+{
+	bool ipv4 = rule.find(':') == std::string::npos;
+	std::vector<ComponentRanges> components;
+	if (!ParseComponents(rule, ipv4, components))
+		return false;
+
+	//最后一个不是 * 的分量拆成对齐的块，它之前的分量逐个取值，之后的都是 *
+	uint32_t limit = ipv4 ? 0xFF : 0xFFFF;
+	size_t component_bits = ipv4 ? 8 : 16;
+	int last = -1;
+	for (int i = 0; i < (int)components.size(); i++)
+	{
+		if (components[i].size() != 1 || components[i][0].min != 0 || components[i][0].max != limit)
+			last = i;
+	}
+	uint64_t prefix_count = 1;
+	for (int i = 0; i <= last && prefix_count <= kMaxPatternPrefixes; i++)
+	{
+		uint64_t count = 0;
+		for (auto& range : components[i])
+		{
+			if (i < last)
+				count += range.max - range.min + 1;
+			else
+				ForEachBlock(range.min, range.max, [&count](uint32_t, int) { count++; });
+		}
+		prefix_count *= count;
+	}
+	if (prefix_count > kMaxPatternPrefixes)
+	{
+		std::shared_ptr<IPPattern> pattern = std::make_shared<IPPattern>();
+		if (!pattern->ParsePattern(rule))
+			return false;
+		FallbackPattern fallback;
+		fallback.pattern = pattern;
+		fallback.value = value;
+		fallback_patterns_.push_back(fallback);
+		return true;
+	}
+
+	IPAddressNumber address(ipv4 ? kIPv4Bytes : kIPv6Bytes, 0);
+	std::function<void(int)> expand = [&](int index) {
+		if (index == last || last < 0)
+		{
+			if (last < 0)
+			{
+				AddPrefix(address, 0, value);
+				return;
+			}
+			for (auto& range : components[index])
+			{
+				ForEachBlock(range.min, range.max, [&](uint32_t low, int block_bits) {
+					SetComponent(address, index, ipv4, low);
+					AddPrefix(address, index * component_bits + component_bits - block_bits, value);
+				});
+			}
+			return;
+		}
+		for (auto& range : components[index])
+		{
+			for (uint32_t v = range.min; v <= range.max; v++)
+			{
+				SetComponent(address, index, ipv4, v);
+				expand(index + 1);
+			}
+		}
+	};
+	expand(0);
+	return true;
+}
+
+bool NimIPRuleSet::Match(const IPAddress& ip_address, int* value/* = nullptr*/) const
+{
+	// IPAddress 是定长的，这里转换和比较都不分配内存
+	IPAddress address = ip_address.IsIPv4Mapped() ? ConvertIPv4MappedIPv6ToIPv4(ip_address) : ip_address;
+	if (!address.IsValid())
+		return false;
+
+	const IPAddressBytes& bytes = address.bytes();
+	const Node* found = nullptr;
+	int32_t node = roots_[address.IsIPv4() ? 0 : 1];
+	size_t bits = bytes.size() * 8;
+	for (size_t i = 0; node != kNoChild; i++)
+	{
+		if (nodes_[node].has_value)
+			found = &nodes_[node];
+		if (i == bits)
+			break;
+		node = nodes_[node].child[(bytes[i / 8] >> (7 - i % 8)) & 1];
+	}
+	if (found != nullptr)
+	{
+		if (value != nullptr)
+			*value = found->value;
+		return true;
+	}
+
+	for (auto& fallback : fallback_patterns_)
+	{
+		if (fallback.pattern->Match(address))
+		{
+			if (value != nullptr)
+				*value = fallback.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool NimIPRuleSet::Match(const IPAddressNumber& address, int* value/* = nullptr*/) const
+{
+	return Match(IPAddress(address), value);
+}
+
+bool NimIPRuleSet::Match(const std::string& ip, int* value/* = nullptr*/) const
+{
+	IPAddress address;
+	if (!IPAddress::FromIPLiteral(ip, &address))
+		return false;
+	return Match(address, value);
+}
+
+std::shared_ptr<const NimIPRuleSet> NimIPRuleSet::GetCompiled(const std::string& rules)
+{
+	static std::mutex* lock = new std::mutex;
+	static std::map<std::string, std::shared_ptr<const NimIPRuleSet>>* compiled = new std::map<std::string, std::shared_ptr<const NimIPRuleSet>>;
+
+	std::lock_guard<std::mutex> guard(*lock);
+	auto it = compiled->find(rules);
+	if (it != compiled->end())
+		return it->second;
+
+	std::shared_ptr<NimIPRuleSet> rule_set = std::make_shared<NimIPRuleSet>();
+	rule_set->AddRules(rules);
+	if (compiled->size() >= kMaxCompiledRuleSets)
+		compiled->clear();
+	(*compiled)[rules] = rule_set;
+	return rule_set;
+}
+
+NET_END_DECLS
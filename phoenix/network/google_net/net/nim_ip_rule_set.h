@@ -0,0 +1,79 @@
+#ifndef _NET_NIM_IP_RULE_SET_H_
+#define _NET_NIM_IP_RULE_SET_H_
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/base/ip_address.h"
+#include "net/base/ip_address_number.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+class IPPattern;
+
+// 编译后的 IP 规则集，用于代理例外列表、按网段选择接入点等场景
+// 规则支持：
+//   IP 字面量       10.1.2.3、fd00::1
+//   CIDR            10.0.0.0/8、fd00::/8
+//   IPPattern       192.168.*.*、10.[1-3,8].*.*、2001:db8:*:*:*:*:*:[0-ff]
+// 所有规则展开为前缀存入按位的前缀树，匹配只需沿地址的位走一遍（IPv4 最多 32 步、IPv6 128 步），与规则数量无关。
+// 展开后前缀过多的 IPPattern（如多个分量都是范围）退回逐条匹配，见 kMaxPatternPrefixes。
+// IPv4 映射的 IPv6 地址（::ffff:a.b.c.d）按 IPv4 处理。
+// 规则集建好后只读，可在多个线程上同时 Match。
+class NET_EXPORT NimIPRuleSet
+{
+public:
+	NimIPRuleSet();
+	~NimIPRuleSet();
+
+	// value 为 Match 命中该规则时返回的值；同一前缀重复添加时以后加的为准
+	bool AddRule(const std::string& rule, int value = 0);
+	// 以分号、逗号或空白分隔的多条规则，跳过无法解析的规则（如域名），返回添加成功的条数
+	size_t AddRules(const std::string& rules, int value = 0);
+
+	// 最长前缀匹配，命中时 value 为该前缀的值；没有前缀命中时再试退回逐条匹配的 IPPattern
+	bool Match(const IPAddress& address, int* value = nullptr) const;
+	bool Match(const IPAddressNumber& address, int* value = nullptr) const;
+	bool Match(const std::string& ip, int* value = nullptr) const;
+
+	bool empty() const { return rule_count_ == 0; }
+	size_t rule_count() const { return rule_count_; }
+
+	// 按规则文本缓存编译结果，同一份代理例外列表不必每次连接都重新编译
+	static std::shared_ptr<const NimIPRuleSet> GetCompiled(const std::string& rules);
+
+private:
+	// 单个 IPPattern 最多展开的前缀数
+	static const size_t kMaxPatternPrefixes = 256;
+	static const int32_t kNoChild = -1;
+
+	struct Node
+	{
+		Node() : has_value(false), value(0) { child[0] = child[1] = kNoChild; }
+
+		int32_t child[2];
+		bool has_value;
+		int value;
+	};
+	struct FallbackPattern
+	{
+		std::shared_ptr<IPPattern> pattern;
+		int value;
+	};
+
+	void AddPrefix(const IPAddressNumber& prefix, size_t prefix_bits, int value);
+	bool AddPattern(const std::string& rule, int value);
+	// 前缀树的根，0 为 IPv4，1 为 IPv6
+	int32_t Root(bool ipv4);
+
+private:
+	std::vector<Node> nodes_;
+	int32_t roots_[2];
+	std::vector<FallbackPattern> fallback_patterns_;
+	size_t rule_count_;
+};
+
+NET_END_DECLS
+#endif
@@ -5,12 +5,16 @@
 #include "base/threading/platform_thread.h"
 //#include "base/threading/scoped_blocking_call.h"
 #include "base/sys_byteorder.h"
+#include "base/trace_event/trace_event.h"
+#include "extension/device/platform_device.h"
 #include "extension/thread/framework_thread.h"
 #include "extension/callback/bind_extension.h"
 #include "extension/strings/string_util.h"
 #include "extension/thread/thread_manager.h"
 #include "net/sys_addrinfo.h"
 #include "net/nim_network_change_observer.h"
+#include "net/nim_host_resolver.h"
+#include "net/nim_network_transition.h"
 #include "net/base/net_errors.h"
 #include "net/base/address_list.h"
 #include "net/base/ip_address.h"
@@ -101,11 +105,10 @@ NimNetUtil::~NimNetUtil()
 	}
 }
 std::atomic_bool NimNetUtil::connection_type_changed_(true);
-NS_EXTENSION::NLock NimNetUtil::connection_type_changed_observer_list_lock_;
-std::map<int, std::function<void()>> NimNetUtil::connection_type_changed_observer_list_;
 void NimNetUtil::StartNetWorkStateChangeObserver()
 {
 	std::call_once(start_of_, [this]() {
+		TRACE_EVENT0("nim.net", "NimNetUtil::StartNetWorkStateChangeObserver");
 		if(net::NetworkChangeNotifier::GetFactory() == nullptr)
 			net::NetworkChangeNotifier::SetFactory(new NimNetworkChangeNotifierFactory);
 		
@@ -123,6 +126,7 @@ void NimNetUtil::StartNetWorkStateChangeObserver()
 			notifier_thread_->Start();
 		}
 		notifier_thread_->RegisterInitCallback([this]() {
+			TRACE_EVENT0("nim.net", "NimNetUtil::InitNetworkChangeNotifier");
 			if (notifier_ == nullptr)
 				notifier_.reset(net::NetworkChangeNotifier::Create());
 			if (network_chg_observer_ == nullptr)
@@ -134,7 +138,11 @@ void NimNetUtil::StartNetWorkStateChangeObserver()
 			notifier_->AddNetworkChangeObserver(network_chg_observer_.get());
 			notifier_->AddConnectionTypeObserver(connection_type_observer_.get());
 			connection_type_observer_->Init();
-			//notifier_->AddNetworkObserver(network_observer_.get());功能没的实现，加了也没的啥子用
+			//之后网络变化都会通知到，IsNetworkAlive、GetMacAddress 的缓存改为由变化驱动刷新
+			NS_EXTENSION::NotifyNetworkChanged();
+			//只有部分平台（Android）支持 NetworkHandle，其他平台加了也收不到通知
+			if (net::NetworkChangeNotifier::AreNetworkHandlesSupported())
+				notifier_->AddNetworkObserver(network_observer_.get());
 			//QLOG_PRO("[net] Start network state change observer is offline:{0} connection type:{1}") << net::NetworkChangeNotifier::IsOffline() <<
 			//	net::NetworkChangeNotifier::ConnectionTypeToString(net::NetworkChangeNotifier::ConnectionType());
 		});
@@ -293,61 +301,54 @@ int NimNetUtil::SystemHostResolverCall(const std::string& host,
 	 }		
 }
  int NimNetUtil::GetIPByName(const std::string& host, std::list<std::string>& ip_list,net::HostResolverFlags host_resolver_flags/* = net::HOST_RESOLVER_SYSTEM_ONLY*/, net::AddressFamily addr_family/* = ADDRESS_FAMILY_UNSPECIFIED*/)
+ {
+	 ip_list.clear();
+	 AddressFamily family;
+	 if (GetAddressFamily(host, family))
+	 {
+		 ip_list.emplace_back(host);
+		 return OK;
+	 }
+	 return NimHostResolver::GetInstance()->ResolveSync(host, host_resolver_flags, addr_family, ip_list);
+ }
+ void NimNetUtil::GetIPByNameAsync(const std::string& host, const std::function<void(int error, const std::list<std::string>& ip_list)>& callback, net::HostResolverFlags host_resolver_flags/* = net::HOST_RESOLVER_SYSTEM_ONLY*/, net::AddressFamily addr_family/* = ADDRESS_FAMILY_UNSPECIFIED*/)
+ {
+	 AddressFamily family;
+	 if (GetAddressFamily(host, family))
+	 {
+		 callback(OK, std::list<std::string>(1, host));
+		 return;
+	 }
+	 NimHostResolver::GetInstance()->Resolve(host, host_resolver_flags, addr_family, callback);
+ }
+ int NimNetUtil::SystemResolve(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, std::list<std::string>& ip_list)
  {	 
-	 int ret = OK;
 	 net::AddressList addlist;	
 	 ip_list.clear();
-	 if (SystemHostResolverCall(host, addr_family, host_resolver_flags, &addlist, &ret) == OK && addlist.size() > 0)
+	 int ret = SystemHostResolverCall(host, addr_family, host_resolver_flags, &addlist, nullptr);
+	 if (ret == OK && addlist.size() > 0)
 	 {
-		 SockaddrStorage storage;
-		
+		 // 地址是定长存放的，直接格式化，不再经 sockaddr 转换，也不用非线程安全的 inet_ntoa
 		 for (auto& it : addlist)
 		 {
-			 if (it.ToSockAddr(storage.addr, &storage.addr_len))
-			 {
-				 switch (it.GetFamily())
-				 {
-					 case AddressFamily::ADDRESS_FAMILY_IPV4:
-					 {
-						 in_addr addr;
-						 addr.s_addr = ((sockaddr_in*)(storage.addr))->sin_addr.s_addr;
-						 ip_list.emplace_back(inet_ntoa(addr));
-					 }
-					 break;
-					 case AddressFamily::ADDRESS_FAMILY_IPV6:
-					 {
-						 //char ip[INET6_ADDRSTRLEN] = {0};
-						 //ip_list.emplace_back(inet_ntop(storage.addr->sa_family, (void*)it.address().bytes().data(), ip, INET6_ADDRSTRLEN));
-                    
-						 ip_list.emplace_back(it.ToString());
-					 }
-					 break;
-					}
-				}
-		}			 
+			 if (it.GetFamily() != AddressFamily::ADDRESS_FAMILY_UNSPECIFIED)
+				 ip_list.emplace_back(it.ToStringWithoutPort());
+		 }
 	 }
+	 if (ret == OK && ip_list.empty())
+		 ret = ERR_NAME_NOT_RESOLVED;
 	 return ret;
  }
  int NimNetUtil::AttachConnectionTypeChanged(const std::function<void()>& cb)
  {
-	 NS_EXTENSION::NAutoLock auto_lock(&connection_type_changed_observer_list_lock_);
-	 static int index = 0;
-	 index += 1;
-	 connection_type_changed_observer_list_.insert(std::make_pair(index, cb));
-	 return index;
+	 //在统一的网络切换流程中按默认优先级回调，见 NimNetworkTransition
+	 return NimNetworkTransition::GetInstance()->Attach(kNetworkTransitionReconnect, 0, [cb](NetworkChangeNotifier::ConnectionType) {
+		 cb();
+	 });
  }
  void NimNetUtil::DetachConnectionTypeChanged(int index)
  {
-	 NS_EXTENSION::NAutoLock auto_lock(&connection_type_changed_observer_list_lock_);
-	 connection_type_changed_observer_list_.erase(index);
- }
- void NimNetUtil::NotifyConnectionTypeChanged()
- {
-	 NS_EXTENSION::NAutoLock auto_lock(&connection_type_changed_observer_list_lock_);
-	 for (auto& it : connection_type_changed_observer_list_)
-	 {
-		 it.second();
-	 }
+	 NimNetworkTransition::GetInstance()->Detach(index);
  }
  bool NimNetUtil::GetAddressFamily(const std::string& host, AddressFamily& family)
  {	 
@@ -24,13 +24,17 @@ class AddressList;
 class NET_EXPORT NimNetUtil : public NS_EXTENSION::Singleton<NimNetUtil,true>
 {
 	friend class NimConnectionTypeObserver;
+	friend class NimHostResolver;
 public:
 	NimNetUtil();
 	~NimNetUtil();
 public:
 	static  int GetIPByName(const std::string& host, std::string& ip, net::HostResolverFlags host_resolver_flags = net::HOST_RESOLVER_SYSTEM_ONLY, net::AddressFamily addr_family = ADDRESS_FAMILY_UNSPECIFIED);
 	static  int GetIPByName(const std::string& host, std::list<std::string>& ip_list, net::HostResolverFlags host_resolver_flags = net::HOST_RESOLVER_SYSTEM_ONLY, net::AddressFamily addr_family = ADDRESS_FAMILY_UNSPECIFIED);
+	// 不阻塞调用线程，命中缓存时同步回调，否则在解析线程上回调，详见 NimHostResolver
+	static void GetIPByNameAsync(const std::string& host, const std::function<void(int error, const std::list<std::string>& ip_list)>& callback, net::HostResolverFlags host_resolver_flags = net::HOST_RESOLVER_SYSTEM_ONLY, net::AddressFamily addr_family = ADDRESS_FAMILY_UNSPECIFIED);
 	static bool GetAddressFamily(const std::string& host, AddressFamily& family);
+	// 网络切换后在 NimNetworkTransition 的重连阶段回调，需要指定阶段或优先级时直接使用 NimNetworkTransition
 	static int AttachConnectionTypeChanged(const std::function<void()>& cb);
 	static void DetachConnectionTypeChanged(int index);
 public:
@@ -38,7 +42,6 @@ public:
 	bool IsNetworkAlive();	
 private:
 	static std::string NotifierThreadName() ;
-	static void NotifyConnectionTypeChanged();
 	// Resolves |host| to an address list, using the system's default host resolver.
 // (i.e. this calls out to getaddrinfo()). If successful returns OK and fills
 // |addrlist| with a list of socket addresses. Otherwise returns a
@@ -50,6 +53,8 @@ private:
 		HostResolverFlags host_resolver_flags,
 		AddressList* addrlist,
 		int* os_error);
+	// 调用 SystemHostResolverCall 并把结果转为 IP 字符串，只由 NimHostResolver 的解析线程调用
+	static int SystemResolve(const std::string& host, HostResolverFlags host_resolver_flags, AddressFamily addr_family, std::list<std::string>& ip_list);
 private:
 	std::once_flag start_of_;
 	std::unique_ptr<net::NetworkChangeNotifier> notifier_;
@@ -58,8 +63,6 @@ private:
 	std::unique_ptr<NimNetworkObserver> network_observer_;
 	std::unique_ptr< NS_EXTENSION::FrameworkThread> notifier_thread_;
 	static std::atomic_bool connection_type_changed_;
-	static NS_EXTENSION::NLock connection_type_changed_observer_list_lock_;
-	static std::map<int,std::function<void()>> connection_type_changed_observer_list_;
 };
 
 NET_END_DECLS
@@ -1,5 +1,6 @@
 #include "net/nim_network_change_observer.h"
 #include "net/nim_net_util.h"
+#include "net/nim_network_transition.h"
 
 #if defined(OS_ANDROID)
 #include "base/metrics/histogram_functions.h"
@@ -58,7 +59,9 @@ void NimNetworkObserver::OnNetworkSoonToDisconnect(NetworkChangeNotifier::Networ
 }
 void NimNetworkObserver::OnNetworkMadeDefault(NetworkChangeNotifier::NetworkHandle network)
 {
+	//默认网络换了而类型不变（如换了一个 Wi-Fi）时也要重建连接
 	network_ = network;
+	NimNetworkTransition::GetInstance()->Notify(NetworkChangeNotifier::GetNetworkConnectionType(network));
 }
 void NimConnectionTypeObserver::Init()
 {
@@ -68,10 +71,11 @@ void NimConnectionTypeObserver::OnConnectionTypeChanged(net::NetworkChangeNotifi
 {
 	type_ = type;
 	NimNetUtil::connection_type_changed_ = true;
-	NimNetUtil::NotifyConnectionTypeChanged();
+	NimNetworkTransition::GetInstance()->Notify(type);
 }
 void NimNetworkChangeObserver::OnNetworkChanged(net::NetworkChangeNotifier::ConnectionType type) 
 {
-
+	//与同一次切换的 OnConnectionTypeChanged 合并处理，网络可用后会预取常用域名
+	NimNetworkTransition::GetInstance()->Notify(type);
 }
 NET_END_DECLS
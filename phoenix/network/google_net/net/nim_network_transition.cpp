@@ -0,0 +1,187 @@
+#include "net/nim_network_transition.h"
+#include "net/nim_host_resolver.h"
+#include "proxy_config/proxy_config/proxy_resolver.h"
+#include "extension/device/platform_device.h"
+#include "extension/network/address_selector.h"
+#include "extension/network/network_quality_estimator.h"
+#include "extension/thread/background_thread.h"
+#include <algorithm>
+
+NET_BEGIN_DECLS
+
+NimNetworkTransition* NimNetworkTransition::GetInstance()
+{
+	static NimNetworkTransition *instance = new NimNetworkTransition;
+	return instance;
+}
+
+NimNetworkTransition::NimNetworkTransition() :
+	next_index_(0),
+	thread_started_(false),
+	running_index_(0),
+	pending_(false),
+	pending_type_(NetworkChangeNotifier::CONNECTION_UNKNOWN),
+	sequence_(0)
+{
+}
+
+void NimNetworkTransition::SetOptions(const NimNetworkTransitionOptions& options)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	options_ = options;
+	if (options_.max_delay_ms < options_.debounce_ms)
+		options_.max_delay_ms = options_.debounce_ms;
+}
+
+int NimNetworkTransition::Attach(NimNetworkTransitionStage stage, int priority, const Handler& handler)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	Entry& entry = entries_[++next_index_];
+	entry.stage = stage;
+	entry.priority = priority;
+	entry.handler = handler;
+	return next_index_;
+}
+
+void NimNetworkTransition::Detach(int index)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	entries_.erase(index);
+	if (std::this_thread::get_id() == thread_id_)
+		return;
+	while (running_index_ == index)
+		handler_done_.wait(lock);
+}
+
+void NimNetworkTransition::Notify(ConnectionType type)
+{
+	//网卡状态的缓存不等去抖，切换过程中的查询重新枚举
+	NS_EXTENSION::NotifyNetworkChanged();
+	std::lock_guard<std::mutex> guard(lock_);
+	auto now = std::chrono::steady_clock::now();
+	if (!pending_)
+		first_event_ = now;
+	last_event_ = now;
+	pending_ = true;
+	pending_type_ = type;
+	sequence_++;
+	if (!thread_started_)
+	{
+		thread_started_ = true;
+		NS_EXTENSION::BackgroundThread::Start("nim_network_transition", [this]() { Run(); });
+	}
+	else
+		cond_.notify_one();
+}
+
+void NimNetworkTransition::Run()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	thread_id_ = std::this_thread::get_id();
+	for (;;)
+	{
+		if (!pending_)
+		{
+			cond_.wait(lock);
+			continue;
+		}
+		//最后一次事件后 debounce_ms 内没有新事件，或距第一次事件已超过 max_delay_ms
+		auto deadline = std::min(last_event_ + std::chrono::milliseconds(options_.debounce_ms),
+			first_event_ + std::chrono::milliseconds(options_.max_delay_ms));
+		if (std::chrono::steady_clock::now() < deadline)
+		{
+			cond_.wait_until(lock, deadline);
+			continue;
+		}
+		pending_ = false;
+		ConnectionType type = pending_type_;
+		uint64_t sequence = sequence_;
+		lock.unlock();
+		RunTransition(type, sequence);
+		lock.lock();
+	}
+}
+
+void NimNetworkTransition::RunTransition(ConnectionType type, uint64_t sequence)
+{
+	//切换网络后旧的解析结果可能不再可用（如内网域名、运营商调度）
+	NimHostResolver::GetInstance()->Clear();
+	//代理设置和 WPAD 找到的 PAC 脚本往往随网络变化
+	NimProxyResolver::GetInstance()->Clear();
+	//旧网络的 RTT、吞吐样本不能用来估计新网络
+	NS_EXTENSION::NetworkQualityEstimator::GetInstance()->Reset(type == NetworkChangeNotifier::CONNECTION_NONE);
+	//旧网络上的连接失败不代表新网络上不可达
+	NS_EXTENSION::AddressSelector::GetInstance()->OnNetworkChanged();
+
+	std::vector<int> flush, cancel;
+	//重连的回调按优先级分组，从高到低
+	std::map<int, std::vector<int>, std::greater<int>> reconnect;
+	int reconnect_interval_ms = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		flush = CollectLocked(kNetworkTransitionFlushCaches);
+		cancel = CollectLocked(kNetworkTransitionCancelStalled);
+		for (auto index : CollectLocked(kNetworkTransitionReconnect))
+			reconnect[entries_[index].priority].push_back(index);
+		reconnect_interval_ms = options_.reconnect_interval_ms;
+	}
+	//缓存的清理和连接的关闭总是做完
+	RunHandlers(flush, type, sequence, false);
+	RunHandlers(cancel, type, sequence, false);
+	if (type == NetworkChangeNotifier::CONNECTION_NONE)
+		return;
+
+	//先解析常用域名，重连时不用再等 DNS
+	NimHostResolver::GetInstance()->Prefetch();
+	for (auto it = reconnect.begin(); it != reconnect.end(); ++it)
+	{
+		if (it != reconnect.begin() && reconnect_interval_ms > 0)
+		{
+			std::unique_lock<std::mutex> lock(lock_);
+			cond_.wait_for(lock, std::chrono::milliseconds(reconnect_interval_ms), [this, sequence]() { return sequence_ != sequence; });
+		}
+		if (!RunHandlers(it->second, type, sequence, true))
+			return;
+	}
+}
+
+std::vector<int> NimNetworkTransition::CollectLocked(NimNetworkTransitionStage stage)
+{
+	std::vector<int> indexes;
+	for (auto& it : entries_)
+	{
+		if (it.second.stage == stage)
+			indexes.push_back(it.first);
+	}
+	std::stable_sort(indexes.begin(), indexes.end(), [this](int left, int right) {
+		return entries_[left].priority > entries_[right].priority;
+	});
+	return indexes;
+}
+
+bool NimNetworkTransition::RunHandlers(const std::vector<int>& indexes, ConnectionType type, uint64_t sequence, bool abortable)
+{
+	for (auto index : indexes)
+	{
+		Handler handler;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (abortable && sequence_ != sequence)
+				return false;
+			auto it = entries_.find(index);
+			if (it == entries_.end())
+				continue;
+			handler = it->second.handler;
+			running_index_ = index;
+		}
+		handler(type);
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			running_index_ = 0;
+		}
+		handler_done_.notify_all();
+	}
+	return true;
+}
+
+NET_END_DECLS
@@ -0,0 +1,108 @@
+#ifndef _NET_NIM_NETWORK_TRANSITION_H_
+#define _NET_NIM_NETWORK_TRANSITION_H_
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/base/network_change_notifier.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+// 网络切换后的处理阶段，按顺序执行，前一阶段的回调全部返回后才进入下一阶段
+enum NimNetworkTransitionStage
+{
+	kNetworkTransitionFlushCaches = 0,	// 清理与旧网络相关的缓存，如 HTTP 连接池、TLS 会话
+	kNetworkTransitionCancelStalled,	// 关闭旧网络上的连接，避免等到超时才发现断开
+	kNetworkTransitionReconnect,		// 在新网络上按优先级重新建连，新网络不可用时跳过
+	kNetworkTransitionStageCount,
+};
+
+struct NimNetworkTransitionOptions
+{
+	NimNetworkTransitionOptions() :
+		debounce_ms(500),
+		max_delay_ms(2000),
+		reconnect_interval_ms(200)
+	{
+	}
+
+	int debounce_ms;			// 最后一次网络事件后等待这么久才处理，切换过程中的多次事件只处理一次
+	int max_delay_ms;			// 网络持续抖动时，距第一次事件最多等待这么久
+	int reconnect_interval_ms;	// 重连阶段相邻两个优先级之间的间隔，先让高优先级连接用上网络
+};
+
+// 网络切换的统一处理流程
+// NimConnectionTypeObserver::OnConnectionTypeChanged、NimNetworkObserver::OnNetworkMadeDefault 和
+// NimNetworkChangeObserver::OnNetworkChanged 通过 Notify 上报，防抖后在一个 BackgroundThread 上依次执行：
+//   1. 清空 NimHostResolver、NimProxyResolver 的缓存和 NetworkQualityEstimator 的样本，执行 kNetworkTransitionFlushCaches 的回调
+//   2. 执行 kNetworkTransitionCancelStalled 的回调
+//   3. 新网络可用时预取 NimHostResolver::SetPrefetchHosts 的域名，再按 priority 从高到低执行 kNetworkTransitionReconnect 的回调
+// 重连阶段中又有新的网络事件时放弃剩余回调，由下一轮重新处理。
+// 回调在处理线程上执行，应尽快返回，耗时的操作请投递到自己的线程。
+// nim_http 的 IHttpManager::ResetConnections 可挂在 kNetworkTransitionFlushCaches 阶段：
+//   NimNetworkTransition::GetInstance()->Attach(kNetworkTransitionFlushCaches, 0, [manager](NetworkChangeNotifier::ConnectionType) {
+//       manager->ResetConnections();
+//   });
+class NET_EXPORT NimNetworkTransition
+{
+public:
+	typedef NetworkChangeNotifier::ConnectionType ConnectionType;
+	// type 为新网络的类型
+	typedef std::function<void(ConnectionType type)> Handler;
+
+	static NimNetworkTransition* GetInstance();
+
+	void SetOptions(const NimNetworkTransitionOptions& options);
+
+	// priority 越大越先执行，同一阶段同一优先级按 Attach 的顺序执行，返回值用于 Detach
+	int Attach(NimNetworkTransitionStage stage, int priority, const Handler& handler);
+	// 返回后 handler 不会再被调用；在 handler 中调用时不等待其返回
+	void Detach(int index);
+
+	void Notify(ConnectionType type);
+
+private:
+	struct Entry
+	{
+		NimNetworkTransitionStage stage;
+		int priority;
+		Handler handler;
+	};
+
+	NimNetworkTransition();
+
+	void Run();
+	void RunTransition(ConnectionType type, uint64_t sequence);
+	// 按 priority 从高到低排列 stage 阶段的回调
+	std::vector<int> CollectLocked(NimNetworkTransitionStage stage);
+	// 依次执行；abortable 时一旦 sequence 不再是最新的事件就停下并返回 false
+	bool RunHandlers(const std::vector<int>& indexes, ConnectionType type, uint64_t sequence, bool abortable);
+
+private:
+	std::mutex lock_;
+	std::condition_variable cond_;
+	// 通知 Detach 正在执行的回调已返回
+	std::condition_variable handler_done_;
+	NimNetworkTransitionOptions options_;
+	std::map<int, Entry> entries_;
+	int next_index_;
+	bool thread_started_;
+	std::thread::id thread_id_;
+	// 正在执行的回调，没有时为 0
+	int running_index_;
+
+	bool pending_;
+	ConnectionType pending_type_;
+	// 每次 Notify 递增，用于发现处理过程中到达的新事件
+	uint64_t sequence_;
+	std::chrono::steady_clock::time_point first_event_;
+	std::chrono::steady_clock::time_point last_event_;
+};
+
+NET_END_DECLS
+#endif
@@ -10,14 +10,19 @@
 NET_BEGIN_DECLS
 
 PhoenixLinkService::PhoenixLinkService() :
-	link_socket_(nullptr)
+	link_socket_(nullptr),
+	heartbeat_id_(0),
+	udp_pending_(false)
 {
 	
 }
 
 PhoenixLinkService::~PhoenixLinkService()
 {
+	StopHeartbeat(false);
 	link_socket_.reset();
+	failed_socket_.reset();
+	pooled_handler_.reset();
 }
 
 bool PhoenixLinkService::Create(const ConnectCallback &callback)
@@ -33,7 +38,13 @@ bool PhoenixLinkService::Create(const ConnectCallback &callback)
 	return ret;
 }
 
-bool PhoenixLinkService::Connect(const std::string &host, uint16_t port, uint32_t timeout, ProxyInfo proxy_config/* = nbase::ProxyInfo()*/)
+void PhoenixLinkService::SetLinkPool(const std::shared_ptr<PhoenixLinkPool> &link_pool)
+{
+	link_pool_ = link_pool;
+}
+
+bool PhoenixLinkService::Connect(const std::string &host, uint16_t port, uint32_t timeout, ProxyInfo proxy_config/* = nbase::ProxyInfo()*/,
+	PhoenixLinkTransport transport/* = kPhoenixLinkTransportTCP*/)
 {
 	if (link_socket_) 
 	{
@@ -41,15 +52,85 @@ bool PhoenixLinkService::Connect(const std::string &host, uint16_t port, uint32_
 		port_ = port;
 		timeout_ = timeout;
 		proxy_config_ = proxy_config;
+		udp_pending_ = false;
+		failed_socket_.reset();
+		if (transport == kPhoenixLinkTransportReliableUDP && !proxy_config.Valid())
+		{
+			//UDP 连接不进连接池，也不取池中的 TCP 连接
+			auto udp_socket = std::make_shared<TcpClientSocket>(kSocketBackendReliableUDP);
+			link_socket_->UnregisterCallback();
+			link_socket_ = udp_socket;
+			pooled_handler_.reset();
+			udp_pending_ = true;
+			link_socket_->RegisterCallback(this);
+			if (link_socket_->Init(host, port))
+				return true;
+			return FallbackToTcp();
+		}
 		if(proxy_config.Valid())
 			link_socket_->SetProxy(&proxy_config_);
+		else if (link_pool_)
+		{
+			//池中有已连接的备用连接时直接使用，省去建连耗时
+			PhoenixPooledLink link;
+			if (link_pool_->Acquire(host, port, link))
+			{
+				link_socket_->UnregisterCallback();
+				link_socket_ = link.socket;
+				pooled_handler_ = link.handler;
+				host_ = link.host;
+				port_ = link.port;
+				link_socket_->RegisterCallback(this);
+				OnConnect(ERROR_SUCCESS);
+				return true;
+			}
+		}
 		return link_socket_->Init(host, port/*, timeout, proxy_config*/);
 	}
 	return false;
 }
 
+void PhoenixLinkService::EnableHeartbeat(const PhoenixHeartbeatScheduler::HeartbeatCallback &callback)
+{
+	heartbeat_callback_ = callback;
+}
+
+bool PhoenixLinkService::Send(const void *data, size_t size)
+{
+	if (!link_socket_)
+		return false;
+	int heartbeat_id = heartbeat_id_;
+	if (heartbeat_id != 0)
+		PhoenixHeartbeatScheduler::GetInstance()->OnDataSent(heartbeat_id);
+	return link_socket_->Send(data, size);
+}
+
+void PhoenixLinkService::StopHeartbeat(bool lost)
+{
+	int heartbeat_id = heartbeat_id_.exchange(0);
+	if (heartbeat_id == 0)
+		return;
+	if (lost)
+		PhoenixHeartbeatScheduler::GetInstance()->OnLinkLost(heartbeat_id);
+	else
+		PhoenixHeartbeatScheduler::GetInstance()->Unregister(heartbeat_id);
+}
+
+bool PhoenixLinkService::FallbackToTcp()
+{
+	udp_pending_ = false;
+	//可能在 UDP 连接自己的定时器线程上，旧连接先保存起来，不在这里释放
+	link_socket_->UnregisterCallback();
+	failed_socket_ = link_socket_;
+	link_socket_ = std::make_shared<TcpClientSocket>();
+	link_socket_->RegisterCallback(this);
+	return link_socket_->Init(host_, port_);
+}
+
 bool PhoenixLinkService::Close()
 {
+	udp_pending_ = false;
+	StopHeartbeat(false);
 	if (link_socket_)
 	{
 		link_socket_->Close();
@@ -60,16 +141,30 @@ bool PhoenixLinkService::Close()
 
 void PhoenixLinkService::OnClose(int error_code)
 {
+	StopHeartbeat(true);
 	if (callback_ != nullptr)
 		callback_(kPhoenixLinkEventDisconnected, (PhoenixNetErrorCode)error_code, host_.c_str(), port_);
 }
 void PhoenixLinkService::OnConnect(int error_code)
 {
+	if (error_code != ERROR_SUCCESS && udp_pending_.exchange(false))
+	{
+		//UDP 握手失败时改用 TCP，只回调 TCP 的结果
+		if (FallbackToTcp())
+			return;
+	}
+	udp_pending_ = false;
+	StopHeartbeat(false);
+	if (error_code == ERROR_SUCCESS && heartbeat_callback_)
+		heartbeat_id_ = PhoenixHeartbeatScheduler::GetInstance()->Register(heartbeat_callback_);
 	if (callback_ != nullptr)
 		callback_(kPhoenixLinkEventConnected, (PhoenixNetErrorCode)error_code, host_.c_str(), port_);
 }
 void PhoenixLinkService::OnReceive(int error_code, const void *data, size_t size)//接收到的数据直接传输过来
 {
+	int heartbeat_id = heartbeat_id_;
+	if (heartbeat_id != 0 && error_code == NO_ERROR)
+		PhoenixHeartbeatScheduler::GetInstance()->OnDataReceived(heartbeat_id);
 
 }
 void PhoenixLinkService::OnSend(int error_code)
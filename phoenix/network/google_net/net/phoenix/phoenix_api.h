@@ -9,11 +9,14 @@
 #define PHOENIX_OPEN_LINK_API_H_
 
 #include "net/config/build_config.h"
+#include <atomic>
 #include <functional>
 #include "net/socket/socket_handler.h"
 #include "net/phoenix/phoenix_def.h"
 #include "proxy_config/proxy_config/proxy_info.h"
 #include "net/socket/tcp_client_socket.h"
+#include "net/phoenix/phoenix_link_pool.h"
+#include "net/phoenix/phoenix_heartbeat_scheduler.h"
 NET_BEGIN_DECLS
 class TcpClientSocket;
 class PhoenixLinkService : public TcpClientHandler
@@ -26,14 +29,29 @@ public:
 
 public:
 	bool Create(const ConnectCallback &callback);
-	bool Connect(const std::string &host, uint16_t port, uint32_t timeout, ProxyInfo proxy_config = ProxyInfo());
+	// 设置备用连接池，未使用代理时 Connect 优先从池中取已建立的连接；host 为空时取 RTT 最低的 endpoint
+	void SetLinkPool(const std::shared_ptr<PhoenixLinkPool> &link_pool);
+	// transport 为 kPhoenixLinkTransportReliableUDP 时先用 UDP 连接同一个端口，握手失败再用 TCP 连接，
+	// 期间只回调最终的结果；此时不使用连接池
+	bool Connect(const std::string &host, uint16_t port, uint32_t timeout, ProxyInfo proxy_config = ProxyInfo(),
+		PhoenixLinkTransport transport = kPhoenixLinkTransportTCP);
 	bool Close();
+	// 由 PhoenixHeartbeatScheduler 统一调度心跳，需在 Connect 之前调用；callback 应通过 Send 发出心跳包
+	void EnableHeartbeat(const PhoenixHeartbeatScheduler::HeartbeatCallback &callback);
+	// 发送的数据会推迟下一次心跳
+	bool Send(const void *data, size_t size);
 	
 	virtual void OnClose(int error_code) override;
 	virtual void OnConnect(int error_code) override;
 	virtual void OnReceive(int error_code, const void *data, size_t size) override;//接收到的数据直接传输过来
 	virtual void OnSend(int error_code) override;
 
+private:
+	// lost 为 true 时按意外断开上报给调度器
+	void StopHeartbeat(bool lost);
+	// UDP 握手失败后改用 TCP 连接，返回 false 表示 TCP 也无法发起
+	bool FallbackToTcp();
+
 private:
 	std::shared_ptr< TcpClientSocket>      link_socket_;
 	ConnectCallback callback_;
@@ -41,6 +59,12 @@ private:
 	uint16_t port_;
 	uint32_t timeout_;
 	ProxyInfo proxy_config_;
+	std::shared_ptr<PhoenixLinkPool> link_pool_;
+	std::shared_ptr<TcpClientHandler> pooled_handler_;//取自连接池的连接在池中时的回调对象，需与 link_socket_ 一起持有
+	PhoenixHeartbeatScheduler::HeartbeatCallback heartbeat_callback_;
+	std::atomic<int> heartbeat_id_;//连接建立后在调度器中登记的 id，未登记时为 0
+	std::atomic<bool> udp_pending_;//正在尝试 UDP，失败时改用 TCP
+	std::shared_ptr<TcpClientSocket> failed_socket_;//握手失败的 UDP 连接，不能在它自己的回调里释放，留到下次 Connect 或析构
 
 };
 
@@ -18,6 +18,12 @@ enum PhoenixLinkEvent
 	kPhoenixLinkEventDisconnected,        // 链接断开
 };
 
+enum PhoenixLinkTransport
+{
+	kPhoenixLinkTransportTCP		= 0, // TCP
+	kPhoenixLinkTransportReliableUDP,	 // UDP 上的可靠传输，连接失败时自动改用 TCP；使用代理时总是 TCP
+};
+
 // linksocket数据收发事件的回调接口
 struct IPhoenixLinkSocketCallback
 {
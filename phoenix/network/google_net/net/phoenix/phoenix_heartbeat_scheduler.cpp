@@ -0,0 +1,205 @@
+// Copyright (c) 2011, NetEase Inc. All rights reserved.
+//
+// 该文件实现了 link 连接共用的心跳调度
+#include "net/phoenix/phoenix_heartbeat_scheduler.h"
+#include "net/nim_network_transition.h"
+#include "extension/thread/background_thread.h"
+#include <algorithm>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+PhoenixHeartbeatScheduler* PhoenixHeartbeatScheduler::GetInstance()
+{
+	static PhoenixHeartbeatScheduler *instance = new PhoenixHeartbeatScheduler;
+	return instance;
+}
+
+PhoenixHeartbeatScheduler::PhoenixHeartbeatScheduler() :
+	next_id_(0),
+	thread_started_(false),
+	running_id_(0),
+	interval_(std::chrono::milliseconds(options_.initial_interval_ms)),
+	probing_(true),
+	successes_(0)
+{
+	//NAT 超时是网络的属性，换了网络要重新探测
+	NimNetworkTransition::GetInstance()->Attach(kNetworkTransitionFlushCaches, 0, [this](NetworkChangeNotifier::ConnectionType) {
+		OnNetworkChanged();
+	});
+}
+
+void PhoenixHeartbeatScheduler::SetOptions(const PhoenixHeartbeatOptions& options)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	options_ = options;
+	if (options_.max_interval_ms < options_.min_interval_ms)
+		options_.max_interval_ms = options_.min_interval_ms;
+	options_.initial_interval_ms = std::min(std::max(options_.initial_interval_ms, options_.min_interval_ms), options_.max_interval_ms);
+	interval_ = std::chrono::milliseconds(options_.initial_interval_ms);
+	probing_ = true;
+	successes_ = 0;
+	cond_.notify_one();
+}
+
+int PhoenixHeartbeatScheduler::Register(const HeartbeatCallback& callback)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto now = Clock::now();
+	Link& link = links_[++next_id_];
+	link.callback = callback;
+	link.last_sent = now;
+	link.last_received = now;
+	if (!thread_started_)
+	{
+		thread_started_ = true;
+		NS_EXTENSION::BackgroundThread::Start("phoenix_heartbeat_scheduler", [this]() { Run(); });
+	}
+	else
+		cond_.notify_one();
+	return next_id_;
+}
+
+void PhoenixHeartbeatScheduler::Unregister(int id)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	links_.erase(id);
+	if (std::this_thread::get_id() == thread_id_)
+		return;
+	while (running_id_ == id)
+		callback_done_.wait(lock);
+}
+
+void PhoenixHeartbeatScheduler::OnDataSent(int id)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = links_.find(id);
+	if (it != links_.end())
+		it->second.last_sent = Clock::now();
+}
+
+void PhoenixHeartbeatScheduler::OnDataReceived(int id)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = links_.find(id);
+	if (it == links_.end())
+		return;
+	it->second.last_received = Clock::now();
+	if (it->second.heartbeat_pending)
+		OnHeartbeatAckedLocked(it->second);
+}
+
+void PhoenixHeartbeatScheduler::OnLinkLost(int id)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto it = links_.find(id);
+		if (it == links_.end())
+			return;
+		const Link& link = it->second;
+		//心跳没有应答，或在连接空闲期间断开，说明 NAT 没能保持这么久；连接正在收发时断开与 NAT 无关
+		auto now = Clock::now();
+		Clock::duration idle = link.heartbeat_pending ? link.heartbeat_idle : now - std::max(link.last_sent, link.last_received);
+		auto min_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(options_.min_interval_ms));
+		if (link.heartbeat_pending || idle >= min_interval)
+		{
+			auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(options_.step_ms));
+			Clock::duration backoff = std::max(idle - step, min_interval);
+			interval_ = std::min(interval_, backoff);
+			probing_ = false;
+			successes_ = 0;
+		}
+	}
+	Unregister(id);
+}
+
+uint32_t PhoenixHeartbeatScheduler::interval_ms()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(interval_).count();
+}
+
+void PhoenixHeartbeatScheduler::Run()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	thread_id_ = std::this_thread::get_id();
+	for (;;)
+	{
+		if (links_.empty())
+		{
+			cond_.wait(lock);
+			continue;
+		}
+		auto now = Clock::now();
+		auto earliest = Clock::time_point::max();
+		for (auto& item : links_)
+			earliest = std::min(earliest, DueTimeLocked(item.second));
+		if (now < earliest)
+		{
+			cond_.wait_until(lock, earliest);
+			continue;
+		}
+
+		//已经醒来了，对齐窗口内快到期的连接一起提前发送
+		auto align_end = now + interval_ * options_.align_percent / 100;
+		std::vector<int> due_ids;
+		for (auto& item : links_)
+		{
+			Link& link = item.second;
+			if (DueTimeLocked(link) > align_end)
+				continue;
+			if (!link.heartbeat_pending)
+			{
+				link.heartbeat_pending = true;
+				link.heartbeat_idle = now - link.last_sent;
+			}
+			//回调没有调用 OnDataSent 时也不会立即再次到期
+			link.last_sent = now;
+			due_ids.push_back(item.first);
+		}
+
+		for (auto id : due_ids)
+		{
+			auto it = links_.find(id);
+			if (it == links_.end())
+				continue;
+			HeartbeatCallback callback = it->second.callback;
+			running_id_ = id;
+			lock.unlock();
+			if (callback)
+				callback();
+			lock.lock();
+			running_id_ = 0;
+			callback_done_.notify_all();
+		}
+	}
+}
+
+void PhoenixHeartbeatScheduler::OnNetworkChanged()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	interval_ = std::chrono::milliseconds(options_.initial_interval_ms);
+	probing_ = true;
+	successes_ = 0;
+	cond_.notify_one();
+}
+
+PhoenixHeartbeatScheduler::Clock::time_point PhoenixHeartbeatScheduler::DueTimeLocked(const Link& link) const
+{
+	return link.last_sent + interval_;
+}
+
+void PhoenixHeartbeatScheduler::OnHeartbeatAckedLocked(Link& link)
+{
+	link.heartbeat_pending = false;
+	//只有空闲接近一个间隔的心跳才算验证了当前间隔，对齐时提前发送的不算
+	if (!probing_ || link.heartbeat_idle < interval_ * 3 / 4)
+		return;
+	if (++successes_ < options_.stable_count)
+		return;
+	successes_ = 0;
+	auto max_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(options_.max_interval_ms));
+	interval_ = std::min(interval_ + std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(options_.step_ms)), max_interval);
+}
+
+NET_END_DECLS
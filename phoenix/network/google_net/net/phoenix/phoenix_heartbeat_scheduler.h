@@ -0,0 +1,116 @@
+// Copyright (c) 2011, NetEase Inc. All rights reserved.
+//
+// Heartbeat scheduler header file
+// 所有 link 连接共用的心跳调度，对齐各连接的心跳唤醒并按 NAT 超时自适应调整间隔
+
+#ifndef PHOENIX_OPEN_HEARTBEAT_SCHEDULER_H_
+#define PHOENIX_OPEN_HEARTBEAT_SCHEDULER_H_
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+NET_BEGIN_DECLS
+
+struct PhoenixHeartbeatOptions
+{
+	PhoenixHeartbeatOptions() :
+		initial_interval_ms(90 * 1000),
+		min_interval_ms(30 * 1000),
+		max_interval_ms(300 * 1000),
+		step_ms(30 * 1000),
+		stable_count(3),
+		align_percent(25)
+	{
+	}
+
+	uint32_t initial_interval_ms;	// 新网络上的初始间隔
+	uint32_t min_interval_ms;
+	uint32_t max_interval_ms;
+	uint32_t step_ms;				// 探测时每次增加、断开后回退的幅度
+	uint32_t stable_count;			// 当前间隔下连续这么多次心跳成功后才继续增加
+	uint32_t align_percent;			// 到期时间在本次唤醒后 interval * align_percent% 内的连接提前一起发送
+};
+
+// 心跳调度
+// 每个连接的下次心跳时间是最后一次发送数据的时间加上间隔，发送业务数据即推迟心跳，
+// 最近发过数据的连接不会再发心跳。调度线程只在最早的到期时间唤醒，并把此后对齐窗口内
+// 到期的连接一起提前发送，之后这些连接的到期时间相同，始终在同一次唤醒中发送，减少射频唤醒。
+// 间隔按网络自适应：心跳维持住连接就逐步加大，连接在只有心跳的空闲期断开时认为超过了 NAT
+// 超时，回退一个 step 并停止探测；网络切换后恢复为初始间隔重新探测。
+// 回调在调度线程（一个 BackgroundThread）上执行，应尽快返回。
+class NET_EXPORT PhoenixHeartbeatScheduler
+{
+public:
+	// 发送一个心跳包，发送后应调用 OnDataSent
+	typedef std::function<void()> HeartbeatCallback;
+
+	static PhoenixHeartbeatScheduler* GetInstance();
+
+	void SetOptions(const PhoenixHeartbeatOptions& options);
+
+	// 连接建立后登记，返回值用于之后的调用
+	int Register(const HeartbeatCallback& callback);
+	// 返回后 callback 不会再被调用；在 callback 中调用时不等待其返回
+	void Unregister(int id);
+
+	void OnDataSent(int id);
+	// 收到任意数据都说明连接仍然可用，也作为心跳的应答
+	void OnDataReceived(int id);
+	// 连接意外断开，据此推测 NAT 超时，之后该连接被注销
+	void OnLinkLost(int id);
+
+	uint32_t interval_ms();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Link
+	{
+		Link() : heartbeat_pending(false) {}
+
+		HeartbeatCallback callback;
+		Clock::time_point last_sent;
+		Clock::time_point last_received;
+		// 已发出心跳但还没有收到数据
+		bool heartbeat_pending;
+		// 发出心跳前已空闲的时长，心跳成功即说明 NAT 能保持这么久
+		Clock::duration heartbeat_idle;
+	};
+
+	PhoenixHeartbeatScheduler();
+
+	void Run();
+	void OnNetworkChanged();
+	// 需持有 lock_
+	Clock::time_point DueTimeLocked(const Link& link) const;
+	void OnHeartbeatAckedLocked(Link& link);
+
+private:
+	std::mutex lock_;
+	std::condition_variable cond_;
+	// 通知 Unregister 正在执行的回调已返回
+	std::condition_variable callback_done_;
+	PhoenixHeartbeatOptions options_;
+	std::map<int, Link> links_;
+	int next_id_;
+	bool thread_started_;
+	std::thread::id thread_id_;
+	// 正在执行的回调，没有时为 0
+	int running_id_;
+
+	Clock::duration interval_;
+	// 还在向上探测间隔，断开过一次后停止，直到网络切换
+	bool probing_;
+	uint32_t successes_;
+};
+
+NET_END_DECLS
+
+#endif // PHOENIX_OPEN_HEARTBEAT_SCHEDULER_H_
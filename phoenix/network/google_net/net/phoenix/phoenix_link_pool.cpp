@@ -0,0 +1,283 @@
+// Copyright (c) 2011, NetEase Inc. All rights reserved.
+//
+// 该文件实现了 link 服务器的备用连接池
+#include "net/phoenix/phoenix_link_pool.h"
+#include "net/nim_network_transition.h"
+#include <chrono>
+
+NET_BEGIN_DECLS
+
+// 连接在池中时的回调对象，记录建连耗时，连接断开或收到意外数据时通知连接池
+class PhoenixLinkPool::PooledLinkHandler : public TcpClientHandler
+{
+public:
+	PooledLinkHandler(const std::weak_ptr<PhoenixLinkPool> &pool)
+		: pool_(pool), start_time_(std::chrono::steady_clock::now())
+	{
+	}
+
+	virtual void OnClose(int error_code) override
+	{
+		auto pool = pool_.lock();
+		if (pool)
+			pool->OnLinkLost(this);
+	}
+
+	virtual void OnConnect(int error_code) override
+	{
+		auto pool = pool_.lock();
+		if (!pool)
+			return;
+		if (error_code != ERROR_SUCCESS)
+		{
+			pool->OnLinkLost(this);
+			return;
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_);
+		pool->OnLinkConnected(this, (uint32_t)elapsed.count());
+	}
+
+	//备用连接上不应有数据，收到说明连接状态不可预期，丢弃
+	virtual void OnReceive(int error_code, const void *data, size_t size) override
+	{
+		auto pool = pool_.lock();
+		if (pool)
+			pool->OnLinkLost(this);
+	}
+
+	virtual void OnSend(int error_code) override
+	{
+	}
+
+private:
+	std::weak_ptr<PhoenixLinkPool> pool_;
+	std::chrono::steady_clock::time_point start_time_;
+};
+
+PhoenixLinkPool::PhoenixLinkPool() :
+	spare_count_(1),
+	running_(false),
+	refill_(false),
+	network_observer_index_(0)
+{
+}
+
+PhoenixLinkPool::~PhoenixLinkPool()
+{
+	Stop();
+}
+
+void PhoenixLinkPool::SetEndpoints(const std::vector<PhoenixLinkEndpoint> &endpoints, size_t spare_count/* = 1*/)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	endpoints_ = endpoints;
+	spare_count_ = spare_count;
+	refill_ = true;
+	cond_.notify_one();
+}
+
+void PhoenixLinkPool::Start()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (running_)
+			return;
+		running_ = true;
+		refill_ = true;
+	}
+	weak_self_ = shared_from_this();
+	std::weak_ptr<PhoenixLinkPool> weak_pool = weak_self_;
+	//link 连接是登录和收消息的前提，先于其他连接重建
+	network_observer_index_ = NimNetworkTransition::GetInstance()->Attach(kNetworkTransitionReconnect, kReconnectPriority, [weak_pool](NetworkChangeNotifier::ConnectionType) {
+		auto pool = weak_pool.lock();
+		if (pool)
+			pool->OnNetworkChanged();
+	});
+	worker_ = std::thread(&PhoenixLinkPool::Run, this);
+}
+
+void PhoenixLinkPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!running_)
+			return;
+		running_ = false;
+	}
+	NimNetworkTransition::GetInstance()->Detach(network_observer_index_);
+	cond_.notify_one();
+	if (worker_.joinable())
+		worker_.join();
+
+	std::list<Entry> entries;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		entries.swap(entries_);
+		entries.splice(entries.end(), dead_entries_);
+	}
+	for (auto &entry : entries)
+	{
+		entry.socket->UnregisterCallback();
+		entry.socket->Close();
+	}
+}
+
+bool PhoenixLinkPool::Acquire(const std::string &host, uint16_t port, PhoenixPooledLink &link)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto best = entries_.end();
+	for (auto it = entries_.begin(); it != entries_.end(); ++it)
+	{
+		if (!it->ready)
+			continue;
+		const PhoenixLinkEndpoint &endpoint = endpoints_[it->endpoint_index];
+		if (!host.empty() && (endpoint.host != host || endpoint.port != port))
+			continue;
+		if (best == entries_.end() || it->rtt_ms < best->rtt_ms)
+			best = it;
+	}
+	if (best == entries_.end())
+		return false;
+
+	link.socket = best->socket;
+	link.handler = best->handler;
+	link.host = endpoints_[best->endpoint_index].host;
+	link.port = endpoints_[best->endpoint_index].port;
+	link.rtt_ms = best->rtt_ms;
+	entries_.erase(best);
+	refill_ = true;
+	cond_.notify_one();
+	return true;
+}
+
+size_t PhoenixLinkPool::ready_count()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	size_t count = 0;
+	for (auto &entry : entries_)
+	{
+		if (entry.ready)
+			count++;
+	}
+	return count;
+}
+
+void PhoenixLinkPool::Run()
+{
+	static const auto kRetryInterval = std::chrono::seconds(1);
+
+	auto next_retry = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(lock_);
+	while (running_)
+	{
+		std::list<Entry> dead_entries;
+		dead_entries.swap(dead_entries_);
+		std::vector<size_t> missing;
+		auto now = std::chrono::steady_clock::now();
+		//连接失败的 endpoint 每隔 kRetryInterval 才重试一次，避免网络不可用时空转
+		if (refill_ || now >= next_retry)
+		{
+			refill_ = false;
+			missing = CollectMissingLocked();
+			next_retry = now + kRetryInterval;
+		}
+
+		lock.unlock();
+		for (auto &entry : dead_entries)
+			entry.socket->Close();
+		dead_entries.clear();
+		for (auto index : missing)
+			StartLink(index);
+		lock.lock();
+
+		if (running_ && !refill_ && dead_entries_.empty())
+			cond_.wait_until(lock, next_retry);
+	}
+}
+
+std::vector<size_t> PhoenixLinkPool::CollectMissingLocked()
+{
+	std::vector<size_t> counts(endpoints_.size(), 0);
+	for (auto &entry : entries_)
+	{
+		if (entry.endpoint_index < counts.size())
+			counts[entry.endpoint_index]++;
+	}
+	std::vector<size_t> missing;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		for (size_t n = counts[i]; n < spare_count_; n++)
+			missing.push_back(i);
+	}
+	return missing;
+}
+
+void PhoenixLinkPool::StartLink(size_t endpoint_index)
+{
+	PhoenixLinkEndpoint endpoint;
+	Entry entry;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (endpoint_index >= endpoints_.size())
+			return;
+		endpoint = endpoints_[endpoint_index];
+	}
+	entry.socket = std::make_shared<TcpClientSocket>();
+	entry.handler = std::make_shared<PooledLinkHandler>(weak_self_);
+	entry.endpoint_index = endpoint_index;
+	entry.socket->RegisterCallback(entry.handler.get());
+	{
+		//先登记再发起连接，连接事件可能在 Init 返回前到达
+		std::lock_guard<std::mutex> guard(lock_);
+		entries_.push_back(entry);
+	}
+	if (!entry.socket->Init(endpoint.host, endpoint.port))
+		OnLinkLost(entry.handler.get());
+}
+
+void PhoenixLinkPool::OnLinkConnected(PooledLinkHandler *handler, uint32_t rtt_ms)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	for (auto &entry : entries_)
+	{
+		if (entry.handler.get() == handler)
+		{
+			entry.ready = true;
+			entry.rtt_ms = rtt_ms;
+			break;
+		}
+	}
+}
+
+void PhoenixLinkPool::OnLinkLost(PooledLinkHandler *handler)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	for (auto it = entries_.begin(); it != entries_.end(); ++it)
+	{
+		if (it->handler.get() == handler)
+		{
+			//已连接的备用连接断开时立即补充，连接失败的等下次重试
+			Discard(it, it->ready);
+			break;
+		}
+	}
+}
+
+void PhoenixLinkPool::OnNetworkChanged()
+{
+	//网络切换后原有连接大多已不可用，全部丢弃并按新网络重建
+	std::lock_guard<std::mutex> guard(lock_);
+	while (!entries_.empty())
+		Discard(entries_.begin(), true);
+}
+
+void PhoenixLinkPool::Discard(std::list<Entry>::iterator it, bool refill)
+{
+	it->socket->UnregisterCallback();
+	dead_entries_.splice(dead_entries_.end(), entries_, it);
+	if (refill)
+		refill_ = true;
+	cond_.notify_one();
+}
+
+NET_END_DECLS
@@ -0,0 +1,106 @@
+// Copyright (c) 2011, NetEase Inc. All rights reserved.
+//
+// Link pool header file
+// 预先建立到 link 服务器的备用连接，Connect 时直接取出 RTT 最低的一条
+
+#ifndef PHOENIX_OPEN_LINK_POOL_H_
+#define PHOENIX_OPEN_LINK_POOL_H_
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/socket/tcp_client_socket.h"
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+struct PhoenixLinkEndpoint
+{
+	PhoenixLinkEndpoint() : port(0) {}
+	PhoenixLinkEndpoint(const std::string &link_host, uint16_t link_port) : host(link_host), port(link_port) {}
+
+	std::string host;
+	uint16_t port;
+};
+
+// 从连接池中取出的连接
+// handler 是连接在池中时使用的回调对象，取出后仍要与 socket 一起持有，
+// 直到 socket 关闭，防止传输线程上正在进行的回调访问到已释放的对象。
+struct PhoenixPooledLink
+{
+	PhoenixPooledLink() : port(0), rtt_ms(0) {}
+
+	std::shared_ptr<TcpClientSocket> socket;
+	std::shared_ptr<TcpClientHandler> handler;
+	std::string host;
+	uint16_t port;
+	uint32_t rtt_ms;	// 建立连接所用的时间，近似一次往返
+};
+
+class NET_EXPORT PhoenixLinkPool : public std::enable_shared_from_this<PhoenixLinkPool>
+{
+public:
+	PhoenixLinkPool();
+	~PhoenixLinkPool();
+
+	// 每个 endpoint 保持 spare_count 条已连接的备用连接，需在 Start 之前调用
+	void SetEndpoints(const std::vector<PhoenixLinkEndpoint> &endpoints, size_t spare_count = 1);
+	// 启动后台补充线程，并在网络切换（NimNetworkTransition 的重连阶段）后重建所有备用连接
+	void Start();
+	void Stop();
+
+	// 取出一条已连接的备用连接；host 为空时在所有 endpoint 中选 RTT 最低的，
+	// 否则只在匹配 host/port 的连接中选。没有可用连接时返回 false。
+	bool Acquire(const std::string &host, uint16_t port, PhoenixPooledLink &link);
+
+	size_t ready_count();
+
+private:
+	// 在 NimNetworkTransition 重连阶段的优先级
+	static const int kReconnectPriority = 100;
+
+	class PooledLinkHandler;
+	struct Entry
+	{
+		Entry() : endpoint_index(0), ready(false), rtt_ms(0) {}
+
+		std::shared_ptr<TcpClientSocket> socket;
+		std::shared_ptr<PooledLinkHandler> handler;
+		size_t endpoint_index;
+		bool ready;
+		uint32_t rtt_ms;
+	};
+
+	void Run();
+	// 需持有 lock_，返回需要新建连接的 endpoint 下标
+	std::vector<size_t> CollectMissingLocked();
+	void StartLink(size_t endpoint_index);
+	void OnLinkConnected(PooledLinkHandler *handler, uint32_t rtt_ms);
+	void OnLinkLost(PooledLinkHandler *handler);
+	void OnNetworkChanged();
+	// 需持有 lock_，refill 为 true 时立即补充，否则等到下次重试
+	void Discard(std::list<Entry>::iterator it, bool refill);
+
+private:
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::vector<PhoenixLinkEndpoint> endpoints_;
+	size_t spare_count_;
+	std::list<Entry> entries_;
+	// 失效的连接不能在它自己的回调线程里释放，统一交给后台线程
+	std::list<Entry> dead_entries_;
+	std::weak_ptr<PhoenixLinkPool> weak_self_;
+	std::thread worker_;
+	bool running_;
+	bool refill_;
+	int network_observer_index_;
+};
+
+NET_END_DECLS
+
+#endif // PHOENIX_OPEN_LINK_POOL_H_
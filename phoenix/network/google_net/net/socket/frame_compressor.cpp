@@ -0,0 +1,95 @@
+#include "net/socket/frame_compressor.h"
+#include "extension/zip/compression.h"
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+FrameCompressor::FrameCompressor(const FrameFormat &format, const FrameCompressionOptions &options)
+	: format_(format)
+	, options_(options)
+	, compressor_(new NS_EXTENSION::Compressor(NS_EXTENSION::CompressionFormat::kRawDeflate, options.level))
+	//还原后的帧不会超过分帧允许的最大长度
+	, decompressor_(new NS_EXTENSION::Decompressor(NS_EXTENSION::CompressionFormat::kRawDeflate, format.max_frame_size))
+{
+	if (!options_.dictionary.empty())
+	{
+		compressor_->SetDictionary(options_.dictionary);
+		decompressor_->SetDictionary(options_.dictionary);
+	}
+}
+
+FrameCompressor::~FrameCompressor()
+{
+}
+
+bool FrameCompressor::Compress(const void *frame, size_t size, std::string &out)
+{
+	size_t header_size = format_.HeaderSize();
+	if (size < header_size)
+		return false;
+	const char *data = (const char *)frame;
+	const char *body = data + header_size;
+	size_t body_size = size - header_size;
+
+	out.assign(data, header_size);
+	out.push_back((char)kFlagRaw);
+	if (body_size >= options_.min_size)
+	{
+		std::lock_guard<std::mutex> guard(compress_lock_);
+		compressor_->Reset();
+		NS_EXTENSION::CompressionSink sink = NS_EXTENSION::AppendTo(&out);
+		if (compressor_->Write(body, body_size, sink) && compressor_->Finish(sink) && out.size() < size)
+			out[header_size] = (char)kFlagCompressed;
+		else
+			out.resize(header_size + 1);
+	}
+	if (out[header_size] == (char)kFlagRaw)
+		out.append(body, body_size);
+	return WriteLength(out);
+}
+
+bool FrameCompressor::Decompress(const void *frame, size_t size, std::string &out)
+{
+	size_t header_size = format_.HeaderSize();
+	if (size < header_size + 1)
+		return false;
+	const char *data = (const char *)frame;
+	const char *body = data + header_size + 1;
+	size_t body_size = size - header_size - 1;
+
+	out.assign(data, header_size);
+	char flag = data[header_size];
+	if (flag == (char)kFlagRaw)
+	{
+		out.append(body, body_size);
+	}
+	else if (flag == (char)kFlagCompressed)
+	{
+		decompressor_->Reset();
+		if (!decompressor_->Write(body, body_size, NS_EXTENSION::AppendTo(&out)) || !decompressor_->finished())
+			return false;
+	}
+	else
+	{
+		return false;
+	}
+	return WriteLength(out);
+}
+
+bool FrameCompressor::WriteLength(std::string &frame) const
+{
+	uint64_t length = format_.length_includes_header ? frame.size() : frame.size() - format_.HeaderSize();
+	if (format_.length_size < 4 && length >> (8 * format_.length_size) != 0)
+		return false;
+	char *p = &frame[format_.length_offset];
+	for (size_t i = 0; i < format_.length_size; i++)
+	{
+		size_t shift = format_.byte_order == 1 ? 8 * (format_.length_size - 1 - i) : 8 * i;
+		p[i] = (char)(length >> shift);
+	}
+	return true;
+}
+
+}
+NET_END_DECLS
@@ -0,0 +1,69 @@
+#ifndef __BASE_NET_FRAME_COMPRESSOR_H__
+#define __BASE_NET_FRAME_COMPRESSOR_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "extension/config/build_config.h"
+#include "net/socket/frame_decoder.h"
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+EXTENSION_BEGIN_DECLS
+class Compressor;
+class Decompressor;
+EXTENSION_END_DECLS
+
+NET_BEGIN_DECLS
+
+struct NET_EXPORT FrameCompressionOptions
+{
+	FrameCompressionOptions()
+		: enabled(false)
+		, level(6)
+		, min_size(128) {}
+
+	bool		enabled;
+	int			level;			// zlib 压缩等级 0~9
+	size_t		min_size;		// 帧体小于该长度时不压缩，省去 CPU，也避免越压越大
+	std::string	dictionary;		// 按协议预先训练的字典，收发双方必须一致，为空时不使用字典
+};
+
+namespace internal{
+
+// 逐帧压缩，每帧独立（不跨帧保留上下文），丢帧、重连都不影响之后的帧。
+// 压缩后的帧格式：原帧头（长度字段改为新长度） + 1 字节标记 + 帧体，
+// 标记为 kFlagCompressed 时帧体是带预置字典的原始 deflate 数据，否则是原始帧体。
+// 压缩后不比原来小的帧按原样发送。解压得到的帧与发送方压缩前的帧完全相同。
+// Compress 可能在多个线程调用，内部加锁；Decompress 只在接收线程调用。
+class NET_EXPORT FrameCompressor
+{
+public:
+	enum Flag
+	{
+		kFlagRaw = 0,
+		kFlagCompressed = 1,
+	};
+
+	FrameCompressor(const FrameFormat &format, const FrameCompressionOptions &options);
+	~FrameCompressor();
+
+	// frame 是一个完整的帧，结果写入 out；帧不完整或新长度超出长度字段范围时返回 false
+	bool Compress(const void *frame, size_t size, std::string &out);
+	// frame 是收到的一个完整的帧，还原后的帧写入 out；数据非法时返回 false
+	bool Decompress(const void *frame, size_t size, std::string &out);
+
+private:
+	bool WriteLength(std::string &frame) const;
+
+	FrameFormat							format_;
+	FrameCompressionOptions				options_;
+	std::mutex							compress_lock_;
+	std::unique_ptr<NS_EXTENSION::Compressor>	compressor_;
+	std::unique_ptr<NS_EXTENSION::Decompressor>	decompressor_;
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_FRAME_COMPRESSOR_H__
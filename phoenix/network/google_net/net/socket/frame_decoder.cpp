@@ -0,0 +1,106 @@
+#include "net/socket/frame_decoder.h"
+#include <string.h>
+
+NET_BEGIN_DECLS
+
+FrameDecoder::FrameDecoder(const FrameFormat &format) : format_(format), pending_size_(0)
+{
+	if (format_.length_size != 2)
+		format_.length_size = 4;
+}
+
+void FrameDecoder::Reset()
+{
+	pending_size_ = 0;
+}
+
+size_t FrameDecoder::FrameSize(const char *data, size_t size) const
+{
+	size_t header_size = format_.HeaderSize();
+	if (size < header_size)
+		return 0;
+
+	const uint8_t *p = (const uint8_t *)data + format_.length_offset;
+	uint32_t length = 0;
+	for (size_t i = 0; i < format_.length_size; i++)
+	{
+		size_t shift = format_.byte_order ? (format_.length_size - 1 - i) * 8 : i * 8;
+		length |= (uint32_t)p[i] << shift;
+	}
+
+	size_t frame_size = format_.length_includes_header ? length : length + header_size;
+	if (frame_size < header_size || frame_size > format_.max_frame_size)
+		return npos;
+	return frame_size;
+}
+
+size_t FrameDecoder::Drain(const char *data, size_t size, const FrameCallback &callback) const
+{
+	size_t consumed = 0;
+	while (consumed < size)
+	{
+		size_t frame_size = FrameSize(data + consumed, size - consumed);
+		if (frame_size == npos)
+			return npos;
+		if (frame_size == 0 || frame_size > size - consumed)
+			break;
+		callback(data + consumed, frame_size);
+		consumed += frame_size;
+	}
+	return consumed;
+}
+
+size_t FrameDecoder::Fill(const char *data, size_t size, size_t target)
+{
+	size_t n = target > pending_size_ ? target - pending_size_ : 0;
+	if (n > size)
+		n = size;
+	if (n == 0)
+		return 0;
+	if (buffer_.size() < pending_size_ + n)
+		buffer_.resize(pending_size_ + n);
+	memcpy(&buffer_[0] + pending_size_, data, n);
+	pending_size_ += n;
+	return n;
+}
+
+bool FrameDecoder::Feed(const void *data, size_t size, const FrameCallback &callback)
+{
+	const char *p = (const char *)data;
+
+	// 先补齐上次留下的半包，补齐后缓冲区里恰好是一帧
+	if (pending_size_ > 0)
+	{
+		size_t used = Fill(p, size, format_.HeaderSize());
+		p += used;
+		size -= used;
+
+		size_t frame_size = FrameSize(&buffer_[0], pending_size_);
+		if (frame_size == npos)
+		{
+			pending_size_ = 0;
+			return false;
+		}
+		if (frame_size == 0)
+			return true;
+
+		used = Fill(p, size, frame_size);
+		p += used;
+		size -= used;
+		if (pending_size_ < frame_size)
+			return true;
+
+		pending_size_ = 0;
+		callback(&buffer_[0], frame_size);
+	}
+
+	// 剩下的完整帧直接在传输层的数据上回调，不做拷贝
+	size_t consumed = Drain(p, size, callback);
+	if (consumed == npos)
+		return false;
+
+	Fill(p + consumed, size - consumed, size - consumed);
+	return true;
+}
+
+NET_END_DECLS
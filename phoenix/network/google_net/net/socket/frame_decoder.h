@@ -0,0 +1,75 @@
+#ifndef __BASE_NET_FRAME_DECODER_H__
+#define __BASE_NET_FRAME_DECODER_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+// 长度前缀分帧格式，与 extension/memory/packet.h 的 Unpack 兼容：
+// 帧头从 length_offset 处开始，是一个 length_size 字节（2 或 4）的长度字段，
+// 字节序与 Unpack 的 bo 参数含义相同（0 : le; 1 : be）。
+struct NET_EXPORT FrameFormat
+{
+	FrameFormat()
+		: length_offset(0)
+		, length_size(4)
+		, byte_order(0)
+		, length_includes_header(true)
+		, max_frame_size(16 * 1024 * 1024) {}
+
+	size_t	length_offset;			// 长度字段在帧头中的偏移
+	size_t	length_size;			// 长度字段字节数，2 或 4
+	int		byte_order;				// 0 : le; 1 : be;
+	bool	length_includes_header;	// 长度值是否包含帧头（length_offset + length_size）本身
+	size_t	max_frame_size;			// 超过该长度的帧视为协议错误
+
+	size_t HeaderSize() const { return length_offset + length_size; }
+};
+
+// 把 TCP 字节流切分成完整的帧。
+// 帧以 (data, size) 视图的形式回调出去，视图指向传输层的原始数据或解码器
+// 自己的接收缓冲区，仅在回调期间有效，需要保留时由上层自行拷贝。
+// 只有跨越多次接收的半包才会被拷贝进接收缓冲区，且缓冲区里最多只有一个
+// 半包；缓冲区只增不减，稳态下不再分配内存。
+// 解码器只在传输层的回调线程中使用，不加锁。
+class NET_EXPORT FrameDecoder
+{
+public:
+	typedef std::function<void(const void *frame, size_t size)> FrameCallback;
+
+	explicit FrameDecoder(const FrameFormat &format);
+
+	// 输入一段接收到的数据，每解出一个完整帧就回调一次。
+	// 遇到非法长度（小于帧头或超过 max_frame_size）时返回 false，
+	// 此后的数据无法再对齐，调用方应当断开连接。
+	bool Feed(const void *data, size_t size, const FrameCallback &callback);
+
+	// 丢弃缓冲区中的半包，连接重建时调用
+	void Reset();
+
+	const FrameFormat& format() const { return format_; }
+	size_t buffered_size() const { return pending_size_; }
+
+private:
+	// 从 data 开头解析一帧的总长度，数据不足帧头时返回 0，长度非法时返回 npos
+	size_t FrameSize(const char *data, size_t size) const;
+	// 从 data 中连续取出完整帧，返回已消费的字节数，出错时返回 npos
+	size_t Drain(const char *data, size_t size, const FrameCallback &callback) const;
+	// 把数据追加到半包缓冲区，最多补到 target 字节，返回拷贝的字节数
+	size_t Fill(const char *data, size_t size, size_t target);
+
+private:
+	static const size_t npos = static_cast<size_t>(-1);
+
+	FrameFormat			format_;
+	std::vector<char>	buffer_;
+	size_t				pending_size_;
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_FRAME_DECODER_H__
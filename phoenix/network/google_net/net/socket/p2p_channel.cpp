@@ -0,0 +1,366 @@
+#include "net/socket/p2p_channel.h"
+#include "net/socket/reliable_udp_client.h"
+#include "net/base/net_errors.h"
+#include "tnet_utils.h"
+#include "tnet_transport.h"
+#include "ice/tnet_ice_ctx.h"
+#include "ice/tnet_ice_event.h"
+#include "ice/tnet_ice_candidate.h"
+#include <string.h>
+
+NET_BEGIN_DECLS
+
+namespace
+{
+// RFC 5389：STUN 报文头 20 字节，前两位为 0，第 4~7 字节是固定的 magic cookie
+bool IsStunMessage(const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	return size >= 20 && (p[0] & 0xC0) == 0 && p[4] == 0x21 && p[5] == 0x12 && p[6] == 0xA4 && p[7] == 0x42;
+}
+
+std::shared_ptr<P2PChannel> LockChannel(const void *callback_data)
+{
+	auto weak_channel = (const std::weak_ptr<P2PChannel> *)callback_data;
+	return weak_channel ? weak_channel->lock() : nullptr;
+}
+}
+
+// 直连路径：选中的本地候选地址的套接字和对端地址，对端地址随收到的报文更新
+struct P2PChannel::Peer
+{
+	tnet_fd_t				fd;
+	struct sockaddr_storage	addr;
+};
+
+// tinyNET 的 C 回调，转给 P2PChannel 的私有方法
+struct P2PChannelCallbacks
+{
+	static int OnIceEvent(const tnet_ice_event_t *e)
+	{
+		auto channel = LockChannel(e->userdata);
+		if (!channel)
+			return 0;
+		switch (e->type)
+		{
+		case tnet_ice_event_type_gathering_completed:
+			channel->OnGatheringCompleted(true);
+			break;
+		case tnet_ice_event_type_start_failed:
+		case tnet_ice_event_type_gathering_host_candidates_failed:
+			channel->OnGatheringCompleted(false);
+			break;
+		case tnet_ice_event_type_conncheck_succeed:
+			channel->OnConncheckSucceeded();
+			break;
+		case tnet_ice_event_type_conncheck_failed:
+			channel->OnConncheckFailed();
+			break;
+		case tnet_ice_event_type_turn_connection_broken:
+		{
+			std::shared_ptr<internal::ReliableUdpClientImpl> reliable;
+			{
+				std::lock_guard<std::mutex> guard(channel->lock_);
+				if (channel->relayed_)
+					reliable = channel->reliable_;
+			}
+			if (reliable)
+				reliable->OnLinkLost();
+			break;
+		}
+		default:
+			break;
+		}
+		return 0;
+	}
+
+	//TURN 中转路径上收到的数据
+	static int OnIceData(const void *callback_data, const uint8_t *data, tsk_size_t size, tnet_fd_t local_fd, const struct sockaddr_storage *remote_addr)
+	{
+		auto channel = LockChannel(callback_data);
+		if (channel)
+			channel->OnRelayDatagram(data, size);
+		return 0;
+	}
+
+	static int OnTransportEvent(const tnet_transport_event_t *e)
+	{
+		auto channel = LockChannel(e->callback_data);
+		if (channel && e->type == event_data)
+			channel->OnDirectDatagram(e->data, e->size, e);
+		return 0;
+	}
+};
+
+P2PChannel::P2PChannel()
+	: handler_(nullptr)
+	, ice_ctx_(nullptr)
+	, transport_(nullptr)
+	, callback_data_(nullptr)
+	, controlling_(false)
+	, relayed_(false)
+{
+}
+
+P2PChannel::~P2PChannel()
+{
+	Close();
+}
+
+void P2PChannel::SetHandler(P2PChannelHandler *handler)
+{
+	handler_ = handler;
+}
+
+bool P2PChannel::Start(const P2POptions &options)
+{
+	struct tnet_ice_ctx_s *ice_ctx = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (ice_ctx_)
+			return false;
+		options_ = options;
+		callback_data_ = new std::weak_ptr<P2PChannel>(shared_from_this());
+		//数据通道只需要一个分量，不用 RTCP
+		ice_ctx_ = tnet_ice_ctx_create(tsk_false, options.use_ipv6 ? tsk_true : tsk_false, tsk_false, tsk_false,
+			&P2PChannelCallbacks::OnIceEvent, callback_data_);
+		if (!ice_ctx_)
+			return false;
+		ice_ctx = (struct tnet_ice_ctx_s *)tsk_object_ref(ice_ctx_);
+	}
+	tnet_ice_ctx_rtp_callback(ice_ctx, &P2PChannelCallbacks::OnIceData, callback_data_);
+	tnet_ice_ctx_set_concheck_timeout(ice_ctx, options.concheck_timeout_ms);
+	bool has_turn = false;
+	for (auto &server : options.servers)
+	{
+		tnet_ice_ctx_add_server(ice_ctx, "udp", server.host.c_str(), server.port,
+			server.turn ? tsk_true : tsk_false, server.turn ? tsk_false : tsk_true,
+			server.username.empty() ? tsk_null : server.username.c_str(),
+			server.password.empty() ? tsk_null : server.password.c_str());
+		has_turn = has_turn || server.turn;
+	}
+	tnet_ice_ctx_set_turn_enabled(ice_ctx, has_turn ? tsk_true : tsk_false);
+	tnet_ice_ctx_set_stun_enabled(ice_ctx, options.servers.empty() ? tsk_false : tsk_true);
+	//事件在 ICE 的线程上回调，不持有 lock_ 调用
+	bool ret = tnet_ice_ctx_start(ice_ctx) == 0;
+	TSK_OBJECT_SAFE_FREE(ice_ctx);
+	return ret;
+}
+
+bool P2PChannel::SetRemoteDescription(const P2PDescription &description, bool controlling)
+{
+	std::string candidates;
+	for (auto &candidate : description.candidates)
+	{
+		if (!candidates.empty())
+			candidates.append("\r\n");
+		candidates.append(candidate);
+	}
+	struct tnet_ice_ctx_s *ice_ctx = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!ice_ctx_)
+			return false;
+		controlling_ = controlling;
+		ice_ctx = (struct tnet_ice_ctx_s *)tsk_object_ref(ice_ctx_);
+	}
+	//设置对端候选地址后 ICE 自动开始连通性检查
+	bool ret = tnet_ice_ctx_set_remote_candidates(ice_ctx, candidates.c_str(), description.ufrag.c_str(),
+		description.pwd.c_str(), controlling ? tsk_true : tsk_false, tsk_false) == 0;
+	TSK_OBJECT_SAFE_FREE(ice_ctx);
+	return ret;
+}
+
+bool P2PChannel::Send(const void *data, size_t size)
+{
+	std::shared_ptr<internal::ReliableUdpClientImpl> reliable;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		reliable = reliable_;
+	}
+	return reliable && reliable->Send(data, size);
+}
+
+void P2PChannel::Close()
+{
+	struct tnet_ice_ctx_s *ice_ctx = nullptr;
+	struct tnet_transport_s *transport = nullptr;
+	void *callback_data = nullptr;
+	std::shared_ptr<internal::ReliableUdpClientImpl> reliable;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		ice_ctx = ice_ctx_;
+		transport = transport_;
+		callback_data = callback_data_;
+		reliable.swap(reliable_);
+		ice_ctx_ = nullptr;
+		transport_ = nullptr;
+		callback_data_ = nullptr;
+		peer_.reset();
+		relayed_ = false;
+	}
+	if (reliable)
+	{
+		reliable->SetHandler(nullptr);
+		reliable->Close();
+	}
+	//释放时会等回调线程退出，之后才能删除回调数据
+	TSK_OBJECT_SAFE_FREE(transport);
+	if (ice_ctx)
+	{
+		tnet_ice_ctx_stop(ice_ctx);
+		TSK_OBJECT_SAFE_FREE(ice_ctx);
+	}
+	delete (std::weak_ptr<P2PChannel> *)callback_data;
+}
+
+bool P2PChannel::IsRelayed() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return relayed_;
+}
+
+void P2PChannel::OnGatheringCompleted(bool succeeded)
+{
+	P2PDescription description;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!ice_ctx_)
+			return;
+		if (succeeded)
+		{
+			tsk_size_t count = tnet_ice_ctx_count_local_candidates(ice_ctx_);
+			for (tsk_size_t i = 0; i < count; i++)
+			{
+				auto candidate = const_cast<tnet_ice_candidate_t *>(tnet_ice_ctx_get_local_candidate_at(ice_ctx_, i));
+				const char *value = candidate ? tnet_ice_candidate_tostring(candidate) : nullptr;
+				if (value)
+					description.candidates.push_back(value);
+			}
+			const char *ufrag = tnet_ice_ctx_get_ufrag(ice_ctx_);
+			const char *pwd = tnet_ice_ctx_get_pwd(ice_ctx_);
+			description.ufrag = ufrag ? ufrag : "";
+			description.pwd = pwd ? pwd : "";
+			succeeded = !description.candidates.empty();
+		}
+	}
+	if (handler_)
+		handler_->OnLocalDescription(succeeded ? NO_ERROR : net::ERR_ADDRESS_UNREACHABLE, description);
+}
+
+void P2PChannel::OnConncheckSucceeded()
+{
+	auto reliable = std::make_shared<internal::ReliableUdpClientImpl>();
+	bool passive = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!ice_ctx_ || reliable_)
+			return;
+		relayed_ = tnet_ice_ctx_is_turn_rtp_active(ice_ctx_) == tsk_true;
+		if (!relayed_)
+		{
+			const tnet_ice_candidate_t *offer = nullptr, *answer_src = nullptr, *answer_dest = nullptr;
+			if (tnet_ice_ctx_get_nominated_symetric_candidates(ice_ctx_, TNET_ICE_CANDIDATE_COMPID_RTP, &offer, &answer_src, &answer_dest) == 0)
+			{
+				//本地候选地址带有套接字，对端的只有地址
+				const tnet_ice_candidate_t *local = (offer && offer->socket) ? offer : answer_src;
+				const tnet_ice_candidate_t *remote = (local == offer) ? answer_dest : offer;
+				std::unique_ptr<Peer> peer(new Peer);
+				memset(&peer->addr, 0, sizeof(peer->addr));
+				if (local && local->socket && remote &&
+					tnet_sockaddr_init(remote->connection_addr, remote->port, local->socket->type, &peer->addr) == 0)
+				{
+					peer->fd = local->socket->fd;
+					//选中的套接字交给自己的 transport 读，ICE 的检查此时已经结束
+					transport_ = tnet_transport_create_2(local->socket, "P2P/UDP TRANSPORT");
+					if (transport_)
+					{
+						tnet_transport_set_callback(transport_, &P2PChannelCallbacks::OnTransportEvent, callback_data_);
+						if (tnet_transport_start(transport_) == 0)
+							peer_ = std::move(peer);
+						else
+							TSK_OBJECT_SAFE_FREE(transport_);
+					}
+				}
+			}
+			if (!peer_)
+				reliable.reset();
+		}
+		if (reliable)
+		{
+			reliable->SetHandler(handler_);
+			reliable->SetSendQueue(options_.send_queue);
+			reliable_ = reliable;
+		}
+		passive = !controlling_;
+	}
+	if (!reliable)
+	{
+		ReportConnectFailed(net::ERR_CONNECTION_FAILED);
+		return;
+	}
+	std::weak_ptr<P2PChannel> weak_this = shared_from_this();
+	auto output = [weak_this](const char *data, size_t size) {
+		auto channel = weak_this.lock();
+		return channel && channel->Output(data, size);
+	};
+	reliable->Attach(output, passive);
+}
+
+void P2PChannel::OnConncheckFailed()
+{
+	ReportConnectFailed(net::ERR_CONNECTION_FAILED);
+}
+
+void P2PChannel::OnDirectDatagram(const void *data, size_t size, const struct tnet_transport_event_s *e)
+{
+	std::shared_ptr<internal::ReliableUdpClientImpl> reliable;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!ice_ctx_)
+			return;
+		if (IsStunMessage(data, size))
+		{
+			tsk_bool_t role_conflict = tsk_false;
+			tnet_ice_ctx_recv_stun_message(ice_ctx_, data, size, e->local_fd, &e->remote_addr, &role_conflict);
+			return;
+		}
+		//对端的 NAT 映射可能变化，按最近一次收到数据的地址回复
+		if (peer_)
+			peer_->addr = e->remote_addr;
+		reliable = reliable_;
+	}
+	if (reliable)
+		reliable->Input(data, size);
+}
+
+void P2PChannel::OnRelayDatagram(const void *data, size_t size)
+{
+	std::shared_ptr<internal::ReliableUdpClientImpl> reliable;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		reliable = reliable_;
+	}
+	if (reliable)
+		reliable->Input(data, size);
+}
+
+bool P2PChannel::Output(const char *data, size_t size)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	if (!ice_ctx_)
+		return false;
+	if (relayed_)
+		return tnet_ice_ctx_send_turn_rtp(ice_ctx_, data, size) > 0;
+	if (!peer_)
+		return false;
+	return tnet_sockfd_sendto(peer_->fd, (const struct sockaddr *)&peer_->addr, data, size) > 0;
+}
+
+void P2PChannel::ReportConnectFailed(int error_code)
+{
+	if (handler_)
+		handler_->OnConnect(error_code);
+}
+
+NET_END_DECLS
@@ -0,0 +1,112 @@
+#ifndef __BASE_NET_P2P_CHANNEL_H__
+#define __BASE_NET_P2P_CHANNEL_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/socket/socket_handler.h"
+#include "net/socket/send_queue.h"
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct tnet_ice_ctx_s;
+struct tnet_transport_s;
+struct tnet_transport_event_s;
+
+NET_BEGIN_DECLS
+
+namespace internal
+{
+	class ReliableUdpClientImpl;
+}
+
+struct NET_EXPORT P2PServer
+{
+	P2PServer() : port(3478), turn(false) {}
+
+	std::string	host;
+	uint16_t	port;
+	bool		turn;		// false 为 STUN 服务器，只用于获取公网地址；true 为 TURN，直连不通时中转
+	std::string	username;
+	std::string	password;
+};
+
+struct NET_EXPORT P2POptions
+{
+	P2POptions() : use_ipv6(false), concheck_timeout_ms(10000) {}
+
+	std::vector<P2PServer>	servers;
+	bool		use_ipv6;
+	uint32_t	concheck_timeout_ms;	// 连通性检查的超时
+	SendQueueOptions send_queue;
+};
+
+// 一方的 ICE 参数，由上层通过自己的信令（如 link 消息）交给对端
+struct NET_EXPORT P2PDescription
+{
+	std::string	ufrag;
+	std::string	pwd;
+	std::vector<std::string> candidates;	// RFC 5245 的 candidate 属性值
+};
+
+class NET_EXPORT P2PChannelHandler : public TcpClientHandler
+{
+public:
+	//本地候选地址收集完成，error_code 非 0 时收集失败，通道不可用
+	virtual void OnLocalDescription(int error_code, const P2PDescription &description) = 0;
+};
+
+// 基于 tinyNET ICE 的点对点数据通道。
+// 流程：Start 收集本地候选地址（主机、STUN 反射、TURN 中转）→ OnLocalDescription 回调后
+// 上层把描述发给对端 → 收到对端的描述后调用 SetRemoteDescription 开始连通性检查。
+// 检查成功后优先使用直连路径，同一局域网或 NAT 兼容时不经过服务器；都不通时经 TURN 中转。
+// 选出的路径上跑 ReliableUdpSession 得到可靠的字节流，握手完成后回调 OnConnect，
+// 之后 Send 的数据经发送队列按窗口发出，积压时回调 OnSendBackpressure。
+// 双方中 controlling 为 true 的一方发起可靠会话的握手，另一方为 false。
+// 回调在 tinyNET 的线程上执行，不要在回调里调用 Close。
+class NET_EXPORT P2PChannel : public std::enable_shared_from_this<P2PChannel>
+{
+public:
+	P2PChannel();
+	~P2PChannel();
+
+	void SetHandler(P2PChannelHandler *handler);
+	bool Start(const P2POptions &options);
+	bool SetRemoteDescription(const P2PDescription &description, bool controlling);
+	bool Send(const void *data, size_t size);
+	void Close();
+
+	// 连通后是否经 TURN 中转
+	bool IsRelayed() const;
+
+private:
+	friend struct P2PChannelCallbacks;
+	struct Peer;
+
+	void OnGatheringCompleted(bool succeeded);
+	void OnConncheckSucceeded();
+	void OnConncheckFailed();
+	// 直连路径上收到的报文可能是对端迟到的 STUN 检查，需要交还给 ICE
+	void OnDirectDatagram(const void *data, size_t size, const struct tnet_transport_event_s *e);
+	void OnRelayDatagram(const void *data, size_t size);
+	bool Output(const char *data, size_t size);
+	void ReportConnectFailed(int error_code);
+
+private:
+	P2PChannelHandler			*handler_;
+	P2POptions					options_;
+	mutable std::mutex			lock_;
+	struct tnet_ice_ctx_s		*ice_ctx_;
+	struct tnet_transport_s		*transport_;
+	// ICE 和 transport 回调的 userdata，指向 weak_ptr<P2PChannel>，释放它们之后再删除
+	void						*callback_data_;
+	std::unique_ptr<Peer>		peer_;
+	bool						controlling_;
+	bool						relayed_;
+	std::shared_ptr<internal::ReliableUdpClientImpl> reliable_;
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_P2P_CHANNEL_H__
@@ -0,0 +1,380 @@
+#include "net/socket/reliable_udp_client.h"
+#include "net/socket/socket_wrapper.h"
+#include "net/base/net_errors.h"
+#include <condition_variable>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+// UDP 传输的回调对象，只持有弱引用，UDPClientImpl 释放前的回调不会访问到已析构的连接
+class ReliableUdpClientImpl::UdpHandler : public UdpClientHandler
+{
+public:
+	explicit UdpHandler(const std::weak_ptr<ReliableUdpClientImpl> &owner) : owner_(owner) {}
+
+	virtual void OnClose(int error_code) override
+	{
+		auto owner = owner_.lock();
+		if (owner)
+			owner->OnTransportClosed();
+	}
+
+	virtual void OnConnect(int error_code) override
+	{
+	}
+
+	virtual void OnReceive(int error_code, const void *data, size_t size) override
+	{
+		auto owner = owner_.lock();
+		if (owner && error_code == NO_ERROR)
+			owner->OnDatagram(data, size);
+	}
+
+private:
+	std::weak_ptr<ReliableUdpClientImpl> owner_;
+};
+
+// 所有连接共用的重传定时器
+class ReliableUdpClientImpl::Scheduler
+{
+public:
+	static Scheduler* GetInstance()
+	{
+		static Scheduler *instance = new Scheduler;
+		return instance;
+	}
+
+	void Schedule(const std::weak_ptr<ReliableUdpClientImpl> &client, Clock::time_point when)
+	{
+		Task task;
+		task.when = when;
+		task.client = client;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			tasks_.push(task);
+		}
+		cond_.notify_one();
+	}
+
+private:
+	struct Task
+	{
+		Clock::time_point when;
+		std::weak_ptr<ReliableUdpClientImpl> client;
+
+		bool operator>(const Task &other) const { return when > other.when; }
+	};
+
+	Scheduler()
+	{
+		std::thread(&Scheduler::Run, this).detach();
+	}
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(lock_);
+		for (;;)
+		{
+			if (tasks_.empty())
+			{
+				cond_.wait(lock);
+				continue;
+			}
+			auto when = tasks_.top().when;
+			if (Clock::now() < when)
+			{
+				cond_.wait_until(lock, when);
+				continue;
+			}
+			auto client = tasks_.top().client.lock();
+			tasks_.pop();
+			lock.unlock();
+			if (client)
+				client->OnTimer();
+			client.reset();
+			lock.lock();
+		}
+	}
+
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::priority_queue<Task, std::vector<Task>, std::greater<Task>> tasks_;
+};
+
+ReliableUdpClientImpl::ReliableUdpClientImpl()
+	: epoch_(Clock::now())
+	, reported_state_(ReliableUdpSession::kStateConnecting)
+	, scheduled_(false)
+{
+}
+
+ReliableUdpClientImpl::~ReliableUdpClientImpl()
+{
+	Close();
+	handler_ = nullptr;
+}
+
+void ReliableUdpClientImpl::SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password)
+{
+	proxyinfo_.host_ = host;
+	proxyinfo_.port_ = port;
+	proxyinfo_.user_ = user;
+	proxyinfo_.password_ = password;
+	proxyinfo_.type_ = type;
+}
+
+bool ReliableUdpClientImpl::Init(const std::string& host, int port)
+{
+	if (proxyinfo_.Valid() || udp_)
+		return false;
+
+	auto udp = std::make_shared<UDPClientImpl>();
+	auto udp_handler = std::make_shared<UdpHandler>(std::static_pointer_cast<ReliableUdpClientImpl>(shared_from_this()));
+	udp->SetHandler(udp_handler.get());
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		udp_ = udp;
+		udp_handler_ = udp_handler;
+	}
+	if (!udp->Init(host, port))
+		return false;
+
+	std::weak_ptr<UDPClientImpl> weak_udp = udp;
+	auto output = [weak_udp](const char *data, size_t size) {
+		auto udp = weak_udp.lock();
+		return udp && udp->Write(data, size) != SOCKET_ERROR;
+	};
+	StartSession(output, false);
+	return true;
+}
+
+bool ReliableUdpClientImpl::Attach(const ReliableUdpSession::Output& output, bool passive)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (udp_ || session_)
+			return false;
+	}
+	StartSession(output, passive);
+	return true;
+}
+
+void ReliableUdpClientImpl::Input(const void *data, size_t size)
+{
+	OnDatagram(data, size);
+}
+
+void ReliableUdpClientImpl::OnLinkLost()
+{
+	OnTransportClosed();
+}
+
+void ReliableUdpClientImpl::StartSession(const ReliableUdpSession::Output& output, bool passive)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		reported_state_ = ReliableUdpSession::kStateConnecting;
+		if (passive)
+		{
+			//conv 由发起方决定
+			session_.reset(new ReliableUdpSession(0, output));
+			session_->Accept(NowMs());
+		}
+		else
+		{
+			std::random_device random;
+			session_.reset(new ReliableUdpSession(random(), output));
+			session_->Connect(NowMs());
+		}
+	}
+	Reschedule();
+}
+
+int	ReliableUdpClientImpl::Write(const void *data, size_t size)
+{
+	SendQueue::Slice slice = { (const char *)data, size };
+	return WriteV(&slice, 1);
+}
+
+int ReliableUdpClientImpl::WriteV(const SendQueue::Slice *slices, size_t count)
+{
+	size_t written = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!session_ || session_->state() == ReliableUdpSession::kStateClosed)
+			return SOCKET_ERROR;
+		//握手完成前数据留在发送队列里
+		if (session_->state() != ReliableUdpSession::kStateEstablished)
+			return 0;
+		//未确认的数据超过两个窗口时按 would block 处理，由发送队列稍后重试
+		if (session_->pending_segments() >= session_->send_window() * 2)
+			return 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			session_->Send(slices[i].data, slices[i].size);
+			written += slices[i].size;
+		}
+		session_->Update(NowMs());
+	}
+	Reschedule();
+	return (int)written;
+}
+
+int	ReliableUdpClientImpl::Read(const void *data, size_t size)
+{
+	return (int)size;
+}
+
+void ReliableUdpClientImpl::Close()
+{
+	if (send_queue_)
+		send_queue_->Clear();
+	std::shared_ptr<UDPClientImpl> udp;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (session_)
+			session_->Close(NowMs());
+		session_.reset();
+		udp.swap(udp_);
+	}
+	if (udp)
+	{
+		udp->SetHandler(nullptr);
+		udp->Close();
+	}
+	is_connected_ = false;
+}
+
+bool ReliableUdpClientImpl::GetSocketInfo(TcpSocketInfo& info)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	if (!session_ || session_->state() != ReliableUdpSession::kStateEstablished)
+		return false;
+	info = TcpSocketInfo();
+	info.rtt_us = session_->srtt_ms() * 1000;
+	info.rtt_var_us = session_->rttvar_ms() * 1000;
+	info.cwnd_bytes = (uint32_t)(session_->cwnd() * session_->mss());
+	info.mss = (uint32_t)session_->mss();
+	info.retransmits = session_->retransmits();
+	return true;
+}
+
+uint32_t ReliableUdpClientImpl::NowMs() const
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch_).count();
+}
+
+void ReliableUdpClientImpl::OnDatagram(const void *data, size_t size)
+{
+	std::string plain;
+	bool connected = false, connect_failed = false, closed = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!session_)
+			return;
+		uint32_t now = NowMs();
+		//不属于本会话的报文直接丢弃
+		if (!session_->Input((const char *)data, size, now))
+			return;
+		//立即回 ACK，并按新的窗口发出排队的数据
+		session_->Update(now);
+		session_->Recv(plain);
+		CollectEventsLocked(connected, connect_failed, closed);
+	}
+	if (connected)
+		DispatchEvents(true, false, false);
+	if (!plain.empty())
+		OnReceive(NO_ERROR, plain.data(), plain.size());
+	if (closed)
+		DispatchEvents(false, false, true);
+	Reschedule();
+}
+
+void ReliableUdpClientImpl::OnTransportClosed()
+{
+	bool connect_failed = false, closed = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!session_)
+			return;
+		if (reported_state_ == ReliableUdpSession::kStateConnecting)
+			connect_failed = true;
+		else if (reported_state_ == ReliableUdpSession::kStateEstablished)
+			closed = true;
+		reported_state_ = ReliableUdpSession::kStateClosed;
+		session_->Close(NowMs());
+	}
+	DispatchEvents(false, connect_failed, closed);
+}
+
+void ReliableUdpClientImpl::OnTimer()
+{
+	bool connected = false, connect_failed = false, closed = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!session_)
+			return;
+		if (scheduled_ && Clock::now() >= scheduled_when_)
+			scheduled_ = false;
+		session_->Update(NowMs());
+		CollectEventsLocked(connected, connect_failed, closed);
+	}
+	DispatchEvents(connected, connect_failed, closed);
+	Reschedule();
+}
+
+void ReliableUdpClientImpl::CollectEventsLocked(bool& connected, bool& connect_failed, bool& closed)
+{
+	ReliableUdpSession::State state = session_->dead() ? ReliableUdpSession::kStateClosed : session_->state();
+	if (state == reported_state_)
+		return;
+	if (reported_state_ == ReliableUdpSession::kStateConnecting)
+	{
+		if (state == ReliableUdpSession::kStateEstablished)
+			connected = true;
+		else
+			connect_failed = true;
+	}
+	else if (reported_state_ == ReliableUdpSession::kStateEstablished)
+		closed = true;
+	reported_state_ = state;
+}
+
+void ReliableUdpClientImpl::DispatchEvents(bool connected, bool connect_failed, bool closed)
+{
+	if (connected)
+		OnConnect(ERROR_SUCCESS);
+	if (connect_failed)
+		OnConnect(net::ERR_CONNECTION_TIMED_OUT);
+	if (closed)
+		OnClose(NO_ERROR);
+}
+
+void ReliableUdpClientImpl::Reschedule()
+{
+	Clock::time_point when;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!session_)
+			return;
+		uint32_t now = NowMs();
+		uint32_t when_ms = 0;
+		if (!session_->NextUpdate(now, when_ms))
+			return;
+		when = epoch_ + std::chrono::milliseconds(when_ms);
+		//已有更早的定时器时不重复投递
+		if (scheduled_ && scheduled_when_ <= when)
+			return;
+		scheduled_ = true;
+		scheduled_when_ = when;
+	}
+	Scheduler::GetInstance()->Schedule(std::static_pointer_cast<ReliableUdpClientImpl>(shared_from_this()), when);
+}
+
+}
+NET_END_DECLS
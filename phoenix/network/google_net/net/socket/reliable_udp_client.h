@@ -0,0 +1,77 @@
+#ifndef __BASE_NET_RELIABLE_UDP_CLIENT_H__
+#define __BASE_NET_RELIABLE_UDP_CLIENT_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "proxy_config/proxy_config/proxy_info.h"
+#include "net/socket/tcp_client_base.h"
+#include "net/socket/reliable_udp_session.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+class UDPClientImpl;
+
+// 基于 UDPClientImpl 和 ReliableUdpSession 的可靠传输，与 TcpClientImpl 接口一致，
+// 分帧、发送队列和 TLS 都照常工作。握手在 3 秒内没有完成时 OnConnect 回调
+// ERR_CONNECTION_TIMED_OUT，上层可以改用 TCP。不支持代理，设置了有效代理时 Init 返回 false。
+// 重传定时器由进程内共享的一个线程驱动，收到数据时在 tinyNET 的回调线程上立即回 ACK。
+class NET_EXPORT ReliableUdpClientImpl :public TcpClientBase
+{
+public:
+	ReliableUdpClientImpl();
+
+	virtual ~ReliableUdpClientImpl();
+
+	virtual void SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password) override;
+
+	virtual bool Init(const std::string& host, int port) override;
+	// 不用自己的 UDP 套接字，而是跑在外部的报文通道上（如 P2PChannel 选出的路径），
+	// 收到的报文通过 Input 送入；passive 为 true 时等待对端发起握手
+	bool Attach(const ReliableUdpSession::Output& output, bool passive);
+	void Input(const void *data, size_t size);
+	// 外部通道断开
+	void OnLinkLost();
+	virtual int	Write(const void *data, size_t size) override;
+	virtual int	Read(const void *data, size_t size) override;
+	virtual void Close() override;
+	virtual bool GetSocketInfo(TcpSocketInfo& info) override;
+
+protected:
+	virtual int WriteV(const SendQueue::Slice *slices, size_t count) override;
+
+private:
+	class UdpHandler;
+	class Scheduler;
+	typedef std::chrono::steady_clock Clock;
+
+	uint32_t NowMs() const;
+	void StartSession(const ReliableUdpSession::Output& output, bool passive);
+	void OnDatagram(const void *data, size_t size);
+	void OnTransportClosed();
+	void OnTimer();
+	// 需持有 lock_，根据会话状态的变化决定要回调的事件
+	void CollectEventsLocked(bool& connected, bool& connect_failed, bool& closed);
+	void DispatchEvents(bool connected, bool connect_failed, bool closed);
+	void Reschedule();
+
+	ProxyInfo							proxyinfo_;
+	std::mutex							lock_;
+	std::shared_ptr<UDPClientImpl>		udp_;
+	std::shared_ptr<UdpHandler>			udp_handler_;
+	std::unique_ptr<ReliableUdpSession>	session_;
+	Clock::time_point					epoch_;
+	// 已回调给上层的状态，每个事件只回调一次
+	ReliableUdpSession::State			reported_state_;
+	bool								scheduled_;
+	Clock::time_point					scheduled_when_;
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_RELIABLE_UDP_CLIENT_H__
@@ -0,0 +1,441 @@
+#include "net/socket/reliable_udp_session.h"
+#include <algorithm>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+namespace
+{
+// 序号和时间都会回绕，按差值的符号比较
+inline int32_t Diff(uint32_t later, uint32_t earlier)
+{
+	return (int32_t)(later - earlier);
+}
+
+inline void Put16(std::string& out, uint16_t value)
+{
+	out.push_back((char)(value >> 8));
+	out.push_back((char)(value & 0xFF));
+}
+
+inline void Put32(std::string& out, uint32_t value)
+{
+	out.push_back((char)(value >> 24));
+	out.push_back((char)((value >> 16) & 0xFF));
+	out.push_back((char)((value >> 8) & 0xFF));
+	out.push_back((char)(value & 0xFF));
+}
+
+inline uint16_t Get16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t Get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+}
+
+//std::min/max 按引用取这些常量，需要类外定义
+const size_t ReliableUdpSession::kHeaderSize;
+const size_t ReliableUdpSession::kDefaultMtu;
+const uint32_t ReliableUdpSession::kRtoMin;
+const uint32_t ReliableUdpSession::kRtoDefault;
+const uint32_t ReliableUdpSession::kRtoMax;
+const uint32_t ReliableUdpSession::kFastResend;
+const uint32_t ReliableUdpSession::kDeadLinkXmit;
+const uint32_t ReliableUdpSession::kWindowSize;
+const uint32_t ReliableUdpSession::kInterval;
+const uint32_t ReliableUdpSession::kSynTimeout;
+
+ReliableUdpSession::ReliableUdpSession(uint32_t conv, const Output& output)
+	: output_(output)
+	, conv_(conv)
+	, mtu_(kDefaultMtu)
+	, mss_(kDefaultMtu - kHeaderSize)
+	, state_(kStateConnecting)
+	, passive_(false)
+	, dead_(false)
+	, connect_start_(0)
+	, syn_resend_ts_(0)
+	, syn_rto_(kRtoDefault)
+	, snd_una_(0)
+	, snd_nxt_(0)
+	, rcv_nxt_(0)
+	, snd_wnd_(kWindowSize)
+	, rcv_wnd_(kWindowSize)
+	, rmt_wnd_(kWindowSize)
+	, srtt_(0)
+	, rttvar_(0)
+	, rto_(kRtoDefault)
+	, cwnd_(2)
+	, ssthresh_(kWindowSize)
+	, cwnd_acked_(0)
+	, retransmits_(0)
+{
+}
+
+void ReliableUdpSession::Connect(uint32_t now_ms)
+{
+	passive_ = false;
+	state_ = kStateConnecting;
+	connect_start_ = now_ms;
+	syn_resend_ts_ = now_ms;
+	syn_rto_ = kRtoDefault;
+	Update(now_ms);
+}
+
+void ReliableUdpSession::Accept(uint32_t now_ms)
+{
+	passive_ = true;
+	state_ = kStateConnecting;
+	connect_start_ = now_ms;
+}
+
+void ReliableUdpSession::Send(const char *data, size_t size)
+{
+	//字节流模式，先填满上一个还未发出的段
+	if (!snd_queue_.empty() && snd_queue_.back().data.size() < mss_)
+	{
+		Segment& last = snd_queue_.back();
+		size_t n = std::min(size, mss_ - last.data.size());
+		last.data.append(data, n);
+		data += n;
+		size -= n;
+	}
+	while (size > 0)
+	{
+		size_t n = std::min(size, mss_);
+		Segment segment;
+		segment.data.assign(data, n);
+		snd_queue_.push_back(std::move(segment));
+		data += n;
+		size -= n;
+	}
+}
+
+bool ReliableUdpSession::Input(const char *data, size_t size, uint32_t now_ms)
+{
+	if (size < kHeaderSize || state_ == kStateClosed)
+		return false;
+
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t prev_una = snd_una_;
+	bool has_ack = false;
+	uint32_t max_ack = 0;
+	while (size >= kHeaderSize)
+	{
+		uint32_t conv = Get32(p);
+		uint8_t cmd = p[4];
+		uint16_t wnd = Get16(p + 6);
+		uint32_t ts = Get32(p + 8);
+		uint32_t sn = Get32(p + 12);
+		uint32_t una = Get32(p + 16);
+		uint32_t len = Get32(p + 20);
+		if (passive_ && conv_ == 0 && state_ == kStateConnecting && cmd == kCmdSyn)
+			conv_ = conv;
+		if (conv != conv_ || len > size - kHeaderSize || cmd < kCmdPush || cmd > kCmdFin)
+			return false;
+		p += kHeaderSize;
+		size -= kHeaderSize;
+		rmt_wnd_ = wnd;
+
+		//被动方对每个 SYN 都回 SYN_ACK，之前的 SYN_ACK 可能丢了
+		if (passive_ && cmd == kCmdSyn)
+		{
+			state_ = kStateEstablished;
+			AppendSegment(kCmdSynAck, ts, 0, nullptr, 0);
+			FlushBuffer();
+		}
+		//SYN_ACK 丢失时服务器的数据也说明握手已完成
+		if (state_ == kStateConnecting && cmd != kCmdSyn)
+		{
+			state_ = kStateEstablished;
+			if (cmd == kCmdSynAck && Diff(now_ms, ts) >= 0)
+				UpdateRtt(now_ms - ts);
+		}
+		if (cmd == kCmdPush || cmd == kCmdAck)
+			ParseUna(una);
+		if (cmd == kCmdAck)
+		{
+			if (Diff(now_ms, ts) >= 0)
+				UpdateRtt(now_ms - ts);
+			ParseAck(sn);
+			if (!has_ack || Diff(sn, max_ack) > 0)
+				max_ack = sn;
+			has_ack = true;
+		}
+		else if (cmd == kCmdPush)
+			OnPush(sn, ts, (const char *)p, len);
+		else if (cmd == kCmdFin)
+			state_ = kStateClosed;
+		p += len;
+		size -= len;
+	}
+	if (has_ack)
+		ParseFastAck(max_ack);
+	if (Diff(snd_una_, prev_una) > 0)
+		OnAcked(snd_una_ - prev_una);
+	return true;
+}
+
+void ReliableUdpSession::Recv(std::string& out)
+{
+	if (out.empty())
+		out.swap(rcv_data_);
+	else
+		out.append(rcv_data_);
+	rcv_data_.clear();
+}
+
+void ReliableUdpSession::Update(uint32_t now_ms)
+{
+	if (state_ == kStateConnecting)
+	{
+		if (Diff(now_ms, connect_start_) >= (int32_t)kSynTimeout)
+		{
+			dead_ = true;
+			state_ = kStateClosed;
+			return;
+		}
+		if (!passive_ && Diff(now_ms, syn_resend_ts_) >= 0)
+		{
+			AppendSegment(kCmdSyn, now_ms, 0, nullptr, 0);
+			FlushBuffer();
+			syn_resend_ts_ = now_ms + syn_rto_;
+			syn_rto_ = std::min(syn_rto_ + syn_rto_ / 2, kSynTimeout);
+		}
+		return;
+	}
+	if (state_ != kStateEstablished)
+		return;
+
+	for (auto& ack : acklist_)
+		AppendSegment(kCmdAck, ack.second, ack.first, nullptr, 0);
+	acklist_.clear();
+
+	//对端窗口为 0 时仍允许一个段在途，作为窗口探测
+	uint32_t wnd = std::min(std::min(snd_wnd_, std::max(rmt_wnd_, 1u)), cwnd_);
+	while (!snd_queue_.empty() && Diff(snd_nxt_, snd_una_ + wnd) < 0)
+	{
+		Segment segment = std::move(snd_queue_.front());
+		snd_queue_.pop_front();
+		segment.sn = snd_nxt_++;
+		snd_buf_.push_back(std::move(segment));
+	}
+
+	bool fast_resent = false;
+	bool lost = false;
+	for (auto& segment : snd_buf_)
+	{
+		bool send = false;
+		if (segment.xmit == 0)
+		{
+			send = true;
+			segment.rto = rto_;
+			segment.resend_ts = now_ms + segment.rto;
+		}
+		else if (Diff(now_ms, segment.resend_ts) >= 0)
+		{
+			send = true;
+			lost = true;
+			//每次只增加一半，连续丢包时不会像 TCP 那样很快退避到秒级
+			segment.rto = std::min(segment.rto + segment.rto / 2, kRtoMax);
+			segment.resend_ts = now_ms + segment.rto;
+		}
+		else if (segment.fastack >= kFastResend)
+		{
+			send = true;
+			fast_resent = true;
+			segment.fastack = 0;
+			segment.resend_ts = now_ms + segment.rto;
+		}
+		if (!send)
+			continue;
+		if (segment.xmit > 0)
+			retransmits_++;
+		segment.xmit++;
+		segment.ts = now_ms;
+		AppendSegment(kCmdPush, now_ms, segment.sn, segment.data.data(), segment.data.size());
+		if (segment.xmit >= kDeadLinkXmit)
+			dead_ = true;
+	}
+	FlushBuffer();
+
+	if (fast_resent)
+	{
+		uint32_t inflight = snd_nxt_ - snd_una_;
+		ssthresh_ = std::max(inflight / 2, 2u);
+		cwnd_ = ssthresh_ + kFastResend;
+		cwnd_acked_ = 0;
+	}
+	if (lost)
+	{
+		ssthresh_ = std::max(cwnd_ / 2, 2u);
+		cwnd_ = 1;
+		cwnd_acked_ = 0;
+	}
+}
+
+bool ReliableUdpSession::NextUpdate(uint32_t now_ms, uint32_t& when_ms)
+{
+	if (state_ == kStateConnecting)
+	{
+		when_ms = Diff(syn_resend_ts_, now_ms) > 0 ? syn_resend_ts_ : now_ms;
+		//握手超时也要按时判定，被动方不发 SYN，只等超时
+		uint32_t deadline = connect_start_ + kSynTimeout;
+		if (passive_ || Diff(deadline, when_ms) < 0)
+			when_ms = deadline;
+		return true;
+	}
+	if (state_ != kStateEstablished)
+		return false;
+	uint32_t wnd = std::min(std::min(snd_wnd_, std::max(rmt_wnd_, 1u)), cwnd_);
+	if (!acklist_.empty() || (!snd_queue_.empty() && Diff(snd_nxt_, snd_una_ + wnd) < 0))
+	{
+		when_ms = now_ms;
+		return true;
+	}
+	if (snd_buf_.empty())
+		return false;
+	bool found = false;
+	for (auto& segment : snd_buf_)
+	{
+		if (!found || Diff(segment.resend_ts, when_ms) < 0)
+			when_ms = segment.resend_ts;
+		found = true;
+	}
+	if (Diff(when_ms, now_ms) < 0)
+		when_ms = now_ms;
+	return true;
+}
+
+void ReliableUdpSession::Close(uint32_t now_ms)
+{
+	if (state_ == kStateEstablished)
+	{
+		AppendSegment(kCmdFin, now_ms, snd_nxt_, nullptr, 0);
+		FlushBuffer();
+	}
+	state_ = kStateClosed;
+}
+
+void ReliableUdpSession::UpdateRtt(uint32_t rtt)
+{
+	//RFC 6298
+	if (srtt_ == 0)
+	{
+		srtt_ = std::max(rtt, 1u);
+		rttvar_ = rtt / 2;
+	}
+	else
+	{
+		uint32_t delta = rtt > srtt_ ? rtt - srtt_ : srtt_ - rtt;
+		rttvar_ = (3 * rttvar_ + delta) / 4;
+		srtt_ = std::max((7 * srtt_ + rtt) / 8, 1u);
+	}
+	uint32_t rto = srtt_ + std::max(kInterval, 4 * rttvar_);
+	rto_ = std::min(std::max(rto, kRtoMin), kRtoMax);
+}
+
+void ReliableUdpSession::ParseUna(uint32_t una)
+{
+	while (!snd_buf_.empty() && Diff(una, snd_buf_.front().sn) > 0)
+		snd_buf_.pop_front();
+	snd_una_ = snd_buf_.empty() ? snd_nxt_ : snd_buf_.front().sn;
+}
+
+void ReliableUdpSession::ParseAck(uint32_t sn)
+{
+	if (Diff(sn, snd_una_) < 0 || Diff(sn, snd_nxt_) >= 0)
+		return;
+	for (auto it = snd_buf_.begin(); it != snd_buf_.end(); ++it)
+	{
+		if (it->sn == sn)
+		{
+			snd_buf_.erase(it);
+			break;
+		}
+		if (Diff(sn, it->sn) < 0)
+			break;
+	}
+	snd_una_ = snd_buf_.empty() ? snd_nxt_ : snd_buf_.front().sn;
+}
+
+void ReliableUdpSession::ParseFastAck(uint32_t sn)
+{
+	for (auto& segment : snd_buf_)
+	{
+		if (Diff(sn, segment.sn) <= 0)
+			break;
+		segment.fastack++;
+	}
+}
+
+void ReliableUdpSession::OnPush(uint32_t sn, uint32_t ts, const char *data, size_t size)
+{
+	//窗口外的段不确认，对端会重传
+	if (Diff(sn, rcv_nxt_ + rcv_wnd_) >= 0)
+		return;
+	acklist_.push_back(std::make_pair(sn, ts));
+	if (Diff(sn, rcv_nxt_) < 0)
+		return;
+	if (rcv_buf_.find(sn) == rcv_buf_.end())
+		rcv_buf_[sn].assign(data, size);
+	for (auto it = rcv_buf_.find(rcv_nxt_); it != rcv_buf_.end(); it = rcv_buf_.find(rcv_nxt_))
+	{
+		rcv_data_.append(it->second);
+		rcv_buf_.erase(it);
+		rcv_nxt_++;
+	}
+}
+
+void ReliableUdpSession::OnAcked(uint32_t acked)
+{
+	for (uint32_t i = 0; i < acked; i++)
+	{
+		if (cwnd_ < ssthresh_)
+			cwnd_++;
+		else if (++cwnd_acked_ >= cwnd_)
+		{
+			cwnd_++;
+			cwnd_acked_ = 0;
+		}
+	}
+	cwnd_ = std::min(cwnd_, std::max(rmt_wnd_, 1u));
+}
+
+uint16_t ReliableUdpSession::ReceiveWindow() const
+{
+	return (uint16_t)(rcv_buf_.size() < rcv_wnd_ ? rcv_wnd_ - rcv_buf_.size() : 0);
+}
+
+void ReliableUdpSession::AppendSegment(uint8_t cmd, uint32_t ts, uint32_t sn, const char *data, size_t size)
+{
+	if (!buffer_.empty() && buffer_.size() + kHeaderSize + size > mtu_)
+		FlushBuffer();
+	Put32(buffer_, conv_);
+	buffer_.push_back((char)cmd);
+	buffer_.push_back(0);
+	Put16(buffer_, ReceiveWindow());
+	Put32(buffer_, ts);
+	Put32(buffer_, sn);
+	Put32(buffer_, rcv_nxt_);
+	Put32(buffer_, (uint32_t)size);
+	if (size > 0)
+		buffer_.append(data, size);
+}
+
+void ReliableUdpSession::FlushBuffer()
+{
+	if (buffer_.empty())
+		return;
+	if (output_)
+		output_(buffer_.data(), buffer_.size());
+	buffer_.clear();
+}
+
+}
+NET_END_DECLS
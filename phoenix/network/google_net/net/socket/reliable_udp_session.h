@@ -0,0 +1,160 @@
+#ifndef __BASE_NET_RELIABLE_UDP_SESSION_H__
+#define __BASE_NET_RELIABLE_UDP_SESSION_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+// UDP 上的可靠字节流，KCP 风格的 ARQ，只实现协议，不做 IO 也不加锁。
+// 报文由若干个段拼成，每段的头部 24 字节，网络字节序：
+//   conv(4) cmd(1) reserved(1) wnd(2) ts(4) sn(4) una(4) len(4)，其后是 len 字节的数据
+// conv 由客户端随机生成，标识一个会话；cmd 为 kCmd* 之一；wnd 是发送方剩余的接收窗口（段数）；
+// ts 是发送时间，ACK 把它原样带回用于计算 RTT；una 是发送方期待的下一个 sn，之前的段都已收到。
+// 客户端重复发送 SYN 直到收到服务器同一 conv 的 SYN_ACK，之后双方用 PUSH/ACK 传输，FIN 表示关闭。
+// 与 TCP 相比：每个段单独确认并立即回 ACK（没有延迟确认），收到后续段的 ACK 两次即快速重传，
+// 超时重传的 RTO 每次只增加一半而不是翻倍，最小 RTO 30ms，丢包时的尾延迟明显更低。
+// 拥塞控制为 AIMD：慢启动、拥塞避免，快速重传时窗口减半，超时时回到 1。
+class NET_EXPORT ReliableUdpSession
+{
+public:
+	enum Command
+	{
+		kCmdPush = 1,
+		kCmdAck,
+		kCmdSyn,
+		kCmdSynAck,
+		kCmdFin,
+	};
+
+	enum State
+	{
+		kStateConnecting,
+		kStateEstablished,
+		kStateClosed,
+	};
+
+	static const size_t kHeaderSize = 24;
+	// 移动网络和 IPv6 隧道下都不会分片的大小
+	static const size_t kDefaultMtu = 1200;
+
+	// 返回 false 表示发送失败，段会按超时重传
+	typedef std::function<bool(const char *data, size_t size)> Output;
+
+	ReliableUdpSession(uint32_t conv, const Output& output);
+
+	// 开始握手，now_ms 为单调时钟的毫秒数，后续调用使用同一时钟
+	void Connect(uint32_t now_ms);
+	// 被动的一方：等待对端的 SYN 并回 SYN_ACK，用于 P2P 这类没有固定服务器的场景。
+	// conv 为 0 时采用收到的第一个 SYN 的 conv；kSynTimeout 内没有收到 SYN 即失败
+	void Accept(uint32_t now_ms);
+	// 数据按 MSS 切分后排队，由 Update 按窗口发出
+	void Send(const char *data, size_t size);
+	// 输入收到的一个 UDP 报文，格式非法或不属于本会话时返回 false
+	bool Input(const char *data, size_t size, uint32_t now_ms);
+	// 取出按序到达的数据
+	void Recv(std::string& out);
+	// 发送 ACK、新数据和需要重传的段
+	void Update(uint32_t now_ms);
+	// 下一次需要调用 Update 的时间，没有待发送、待确认的数据时返回 false
+	bool NextUpdate(uint32_t now_ms, uint32_t& when_ms);
+	// 尽量通知对端关闭，之后状态为 kStateClosed
+	void Close(uint32_t now_ms);
+
+	State state() const { return state_; }
+	// 某个段重传超过 kDeadLinkXmit 次，或握手超时
+	bool dead() const { return dead_; }
+	// 还未发出和未确认的段数，用于发送端背压
+	size_t pending_segments() const { return snd_queue_.size() + snd_buf_.size(); }
+	size_t send_window() const { return snd_wnd_; }
+	uint32_t conv() const { return conv_; }
+
+	uint32_t srtt_ms() const { return srtt_; }
+	uint32_t rttvar_ms() const { return rttvar_; }
+	uint32_t cwnd() const { return cwnd_; }
+	size_t mss() const { return mss_; }
+	uint32_t retransmits() const { return retransmits_; }
+
+private:
+	struct Segment
+	{
+		Segment() : sn(0), ts(0), resend_ts(0), rto(0), fastack(0), xmit(0) {}
+
+		uint32_t sn;
+		uint32_t ts;
+		uint32_t resend_ts;
+		uint32_t rto;
+		uint32_t fastack;
+		uint32_t xmit;
+		std::string data;
+	};
+
+	static const uint32_t kRtoMin = 30;
+	static const uint32_t kRtoDefault = 200;
+	static const uint32_t kRtoMax = 60000;
+	static const uint32_t kFastResend = 2;
+	static const uint32_t kDeadLinkXmit = 20;
+	static const uint32_t kWindowSize = 256;
+	static const uint32_t kInterval = 10;
+	static const uint32_t kSynTimeout = 3000;
+
+	void UpdateRtt(uint32_t rtt);
+	void ParseUna(uint32_t una);
+	void ParseAck(uint32_t sn);
+	void ParseFastAck(uint32_t sn);
+	void OnPush(uint32_t sn, uint32_t ts, const char *data, size_t size);
+	void OnAcked(uint32_t acked);
+	uint16_t ReceiveWindow() const;
+	// 段追加到 buffer_，超过 MTU 时先发出已有的部分
+	void AppendSegment(uint8_t cmd, uint32_t ts, uint32_t sn, const char *data, size_t size);
+	void FlushBuffer();
+
+	Output output_;
+	uint32_t conv_;
+	size_t mtu_;
+	size_t mss_;
+	State state_;
+	bool passive_;
+	bool dead_;
+	uint32_t connect_start_;
+	uint32_t syn_resend_ts_;
+	uint32_t syn_rto_;
+
+	uint32_t snd_una_;
+	uint32_t snd_nxt_;
+	uint32_t rcv_nxt_;
+	uint32_t snd_wnd_;
+	uint32_t rcv_wnd_;
+	uint32_t rmt_wnd_;
+
+	uint32_t srtt_;
+	uint32_t rttvar_;
+	uint32_t rto_;
+
+	uint32_t cwnd_;
+	uint32_t ssthresh_;
+	// 拥塞避免阶段累计确认的段数，满一个窗口时 cwnd_ 加一
+	uint32_t cwnd_acked_;
+	uint32_t retransmits_;
+
+	std::deque<Segment> snd_queue_;
+	std::deque<Segment> snd_buf_;
+	std::map<uint32_t, std::string> rcv_buf_;
+	std::string rcv_data_;
+	// 待发送的 ACK：sn 和对应段的 ts
+	std::vector<std::pair<uint32_t, uint32_t>> acklist_;
+	std::string buffer_;
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_RELIABLE_UDP_SESSION_H__
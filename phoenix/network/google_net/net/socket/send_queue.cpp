@@ -0,0 +1,301 @@
+#include "net/socket/send_queue.h"
+#include "net/socket/socket_handler.h"
+#include "extension/memory/packet.h"
+#include "extension/memory/chained_buffer.h"
+#include "extension/thread/background_thread.h"
+#include <chrono>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+// 所有 SendQueue 共用一个 BackgroundThread 来实现合并窗口，避免每个连接多一个线程。
+class SendQueueScheduler
+{
+public:
+	static SendQueueScheduler* GetInstance()
+	{
+		static SendQueueScheduler *instance = new SendQueueScheduler;
+		return instance;
+	}
+
+	void Schedule(const std::weak_ptr<SendQueue> &queue, uint32_t delay_ms)
+	{
+		Task task;
+		task.when = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms);
+		task.queue = queue;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			tasks_.push(task);
+		}
+		cond_.notify_one();
+	}
+
+private:
+	struct Task
+	{
+		std::chrono::steady_clock::time_point when;
+		std::weak_ptr<SendQueue> queue;
+
+		bool operator>(const Task &other) const { return when > other.when; }
+	};
+
+	SendQueueScheduler()
+	{
+		NS_EXTENSION::BackgroundThread::Start("send_queue_scheduler", [this]() { Run(); });
+	}
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(lock_);
+		for (;;)
+		{
+			if (tasks_.empty())
+			{
+				cond_.wait(lock);
+				continue;
+			}
+			auto when = tasks_.top().when;
+			if (std::chrono::steady_clock::now() < when)
+			{
+				cond_.wait_until(lock, when);
+				continue;
+			}
+			auto queue = tasks_.top().queue.lock();
+			tasks_.pop();
+			lock.unlock();
+			if (queue)
+				queue->OnFlushTimer();
+			queue.reset();
+			lock.lock();
+		}
+	}
+
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::priority_queue<Task, std::vector<Task>, std::greater<Task>> tasks_;
+};
+
+SendQueue::SendQueue(const SendQueueOptions &options, const Writer &writer, const BackpressureCallback &backpressure)
+	: options_(options)
+	, writer_(writer)
+	, backpressure_(backpressure)
+	, head_offset_(0)
+	, queued_size_(0)
+	, blocked_(false)
+	, scheduled_(false)
+	, failed_(false)
+{
+	if (options_.low_watermark > options_.high_watermark)
+		options_.low_watermark = options_.high_watermark;
+}
+
+bool SendQueue::Push(const std::shared_ptr<NS_EXTENSION::PackBuffer> &buffer, size_t offset)
+{
+	if (!buffer || offset >= buffer->size())
+		return true;
+
+	Chunk chunk;
+	chunk.data = buffer->data() + offset;
+	chunk.size = buffer->size() - offset;
+	chunk.owner = buffer;
+	return Enqueue(std::move(chunk));
+}
+
+bool SendQueue::Push(const NS_EXTENSION::ChainedBuffer &buffer)
+{
+	if (buffer.empty())
+		return true;
+
+	std::vector<Chunk> chunks;
+	chunks.reserve(buffer.slice_count());
+	buffer.visit([&chunks](const std::shared_ptr<const void> &owner, const char *data, size_t size) {
+		Chunk chunk;
+		chunk.owner = owner;
+		chunk.data = data;
+		chunk.size = size;
+		chunks.push_back(std::move(chunk));
+	});
+	return Enqueue(chunks.data(), chunks.size());
+}
+
+bool SendQueue::Push(std::string &&data)
+{
+	if (data.empty())
+		return true;
+
+	auto owner = std::make_shared<std::string>(std::move(data));
+	Chunk chunk;
+	chunk.data = owner->data();
+	chunk.size = owner->size();
+	chunk.owner = owner;
+	return Enqueue(std::move(chunk));
+}
+
+bool SendQueue::Push(const void *data, size_t size)
+{
+	return Push(std::string((const char *)data, size));
+}
+
+bool SendQueue::Flush()
+{
+	bool ret = false;
+	bool changed = false;
+	bool blocked = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (failed_)
+			return false;
+		ret = FlushLocked();
+		if (ret && !chunks_.empty())
+			ScheduleLocked();
+		changed = UpdateBackpressureLocked();
+		blocked = blocked_;
+	}
+	NotifyBackpressure(changed, blocked);
+	return ret;
+}
+
+void SendQueue::Clear()
+{
+	bool changed = false;
+	bool blocked = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		chunks_.clear();
+		head_offset_ = 0;
+		queued_size_ = 0;
+		failed_ = false;
+		changed = UpdateBackpressureLocked();
+		blocked = blocked_;
+	}
+	NotifyBackpressure(changed, blocked);
+}
+
+size_t SendQueue::queued_size() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return queued_size_;
+}
+
+bool SendQueue::Enqueue(Chunk &&chunk)
+{
+	return Enqueue(&chunk, 1);
+}
+
+bool SendQueue::Enqueue(Chunk *chunks, size_t count)
+{
+	bool ret = true;
+	bool changed = false;
+	bool blocked = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (failed_)
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			queued_size_ += chunks[i].size;
+			chunks_.push_back(std::move(chunks[i]));
+		}
+		if (queued_size_ >= options_.coalesce_bytes || options_.delay_ms == 0)
+			ret = FlushLocked();
+		if (ret && !chunks_.empty())
+			ScheduleLocked();
+		changed = UpdateBackpressureLocked();
+		blocked = blocked_;
+	}
+	NotifyBackpressure(changed, blocked);
+	return ret;
+}
+
+bool SendQueue::FlushLocked()
+{
+	static const size_t kMaxSlices = 64;
+	Slice slices[kMaxSlices];
+
+	while (!chunks_.empty())
+	{
+		size_t count = 0;
+		for (auto it = chunks_.begin(); it != chunks_.end() && count < kMaxSlices; ++it, ++count)
+		{
+			size_t skip = (count == 0) ? head_offset_ : 0;
+			slices[count].data = it->data + skip;
+			slices[count].size = it->size - skip;
+		}
+
+		int n = writer_(slices, count);
+		if (n < 0)
+		{
+			failed_ = true;
+			chunks_.clear();
+			head_offset_ = 0;
+			queued_size_ = 0;
+			return false;
+		}
+		if (n == 0)
+			break;
+
+		size_t left = (size_t)n;
+		queued_size_ -= left;
+		while (left > 0)
+		{
+			size_t remain = chunks_.front().size - head_offset_;
+			if (left < remain)
+			{
+				head_offset_ += left;
+				left = 0;
+			}
+			else
+			{
+				left -= remain;
+				head_offset_ = 0;
+				chunks_.pop_front();
+			}
+		}
+	}
+	return true;
+}
+
+void SendQueue::ScheduleLocked()
+{
+	if (scheduled_)
+		return;
+	scheduled_ = true;
+	SendQueueScheduler::GetInstance()->Schedule(shared_from_this(), options_.delay_ms > 0 ? options_.delay_ms : 1);
+}
+
+void SendQueue::OnFlushTimer()
+{
+	bool changed = false;
+	bool blocked = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		scheduled_ = false;
+		if (failed_ || chunks_.empty())
+			return;
+		if (FlushLocked() && !chunks_.empty())
+			ScheduleLocked();
+		changed = UpdateBackpressureLocked();
+		blocked = blocked_;
+	}
+	NotifyBackpressure(changed, blocked);
+}
+
+bool SendQueue::UpdateBackpressureLocked()
+{
+	bool blocked = blocked_ ? (queued_size_ > options_.low_watermark) : (queued_size_ >= options_.high_watermark);
+	if (blocked == blocked_)
+		return false;
+	blocked_ = blocked;
+	return true;
+}
+
+void SendQueue::NotifyBackpressure(bool changed, bool blocked)
+{
+	if (changed && backpressure_)
+		backpressure_(blocked);
+}
+
+NET_END_DECLS
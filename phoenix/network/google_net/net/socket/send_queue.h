@@ -0,0 +1,106 @@
+#ifndef __BASE_NET_SEND_QUEUE_H__
+#define __BASE_NET_SEND_QUEUE_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "extension/config/build_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+EXTENSION_BEGIN_DECLS
+class PackBuffer;
+class ChainedBuffer;
+EXTENSION_END_DECLS
+
+NET_BEGIN_DECLS
+
+struct NET_EXPORT SendQueueOptions
+{
+	SendQueueOptions()
+		: coalesce_bytes(16 * 1024)
+		, delay_ms(2)
+		, high_watermark(4 * 1024 * 1024)
+		, low_watermark(1024 * 1024) {}
+
+	size_t		coalesce_bytes;	// 排队数据达到该大小时立即发送，否则等待 delay_ms 合并小包
+	uint32_t	delay_ms;		// 类 Nagle 的合并窗口，0 表示每次 Push 都立即发送
+	size_t		high_watermark;	// 排队数据超过该值时回调 backpressure(true)
+	size_t		low_watermark;	// 排队数据降到该值以下时回调 backpressure(false)
+};
+
+class SendQueueScheduler;
+
+// TCP 发送队列
+// Push 只持有数据的所有权而不拷贝，Flush 时把排队的多个缓冲区用一次
+// scatter/gather 写（writev/WSASend）发出去；发送缓冲区满（would block）时
+// 未发完的数据留在队列里，由合并窗口的定时器稍后重试。
+// Push 与定时 Flush 可能在不同线程，内部以锁串行化，回调在锁外执行。
+class NET_EXPORT SendQueue : public std::enable_shared_from_this<SendQueue>
+{
+public:
+	struct Slice
+	{
+		const char	*data;
+		size_t		size;
+	};
+	// 返回写出的字节数，would block 时返回 0，出错时返回 SOCKET_ERROR
+	typedef std::function<int(const Slice *slices, size_t count)> Writer;
+	typedef std::function<void(bool blocked)> BackpressureCallback;
+
+	SendQueue(const SendQueueOptions &options, const Writer &writer, const BackpressureCallback &backpressure);
+
+	// 数据发送完成前 buffer 会被一直持有，调用方不能再修改它
+	bool Push(const std::shared_ptr<NS_EXTENSION::PackBuffer> &buffer, size_t offset = 0);
+	// 每个分片引用 buffer 的段，不拷贝，Push 之后 buffer 可以继续修改或释放
+	bool Push(const NS_EXTENSION::ChainedBuffer &buffer);
+	bool Push(std::string &&data);
+	bool Push(const void *data, size_t size);
+
+	// 立即尽可能多地发送，出错时返回 false 并清空队列
+	bool Flush();
+	void Clear();
+
+	size_t queued_size() const;
+
+private:
+	friend class SendQueueScheduler;
+
+	struct Chunk
+	{
+		std::shared_ptr<const void>	owner;
+		const char					*data;
+		size_t						size;
+	};
+
+	bool Enqueue(Chunk &&chunk);
+	// 多个 chunk 在同一次加锁内入队，不会与其他线程的 Push 交错
+	bool Enqueue(Chunk *chunks, size_t count);
+	// 需持有 lock_，返回 false 表示写出错
+	bool FlushLocked();
+	void ScheduleLocked();
+	void OnFlushTimer();
+	// 需持有 lock_，按高低水位更新 blocked_，状态变化时返回 true
+	bool UpdateBackpressureLocked();
+	void NotifyBackpressure(bool changed, bool blocked);
+
+private:
+	SendQueueOptions		options_;
+	Writer					writer_;
+	BackpressureCallback	backpressure_;
+
+	mutable std::mutex		lock_;
+	std::deque<Chunk>		chunks_;
+	size_t					head_offset_;	// chunks_.front() 已发送的字节数
+	size_t					queued_size_;
+	bool					blocked_;
+	bool					scheduled_;
+	bool					failed_;
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_SEND_QUEUE_H__
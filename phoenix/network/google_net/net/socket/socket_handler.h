@@ -24,16 +24,32 @@ public:
 	virtual void OnConnect(int error_code) = 0;
 	virtual void OnReceive(int error_code, const void *data, size_t size) = 0;//接收到的数据直接传输过来
 	virtual void OnSend(int error_code) = 0;
+	//设置了 FrameFormat 后，完整的帧通过这里回调，frame 只在回调期间有效
+	virtual void OnReceiveFrame(const void *frame, size_t size) {}
+	//启用发送队列后，排队数据超过高水位时回调 blocked = true，降到低水位以下时回调 blocked = false
+	virtual void OnSendBackpressure(bool blocked) {}
 
 };
 
 
+struct UdpDatagram
+{
+	const void	*data;
+	size_t		size;
+};
+
 class NET_EXPORT UdpClientHandler
 {
 public:
 	virtual void OnClose(int error_code) = 0;
 	virtual void OnConnect(int error_code) = 0;
 	virtual void OnReceive(int error_code, const void *data, size_t size) = 0;//接收到的数据直接传输过来
+	//开启批量接收后，一次可读到的多个报文通过这里回调，数据只在回调期间有效；默认逐个转给 OnReceive
+	virtual void OnReceiveBatch(const UdpDatagram *datagrams, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			OnReceive(NO_ERROR, datagrams[i].data, datagrams[i].size);
+	}
 };
 
 NET_END_DECLS
@@ -0,0 +1,118 @@
+#include "net/socket/socket_options.h"
+
+#if defined(OS_WIN)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if (defined(OS_LINUX) || defined(OS_ANDROID)) && !defined(TCP_NOTSENT_LOWAT)
+#define TCP_NOTSENT_LOWAT 25
+#endif
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+namespace
+{
+bool SetIntOption(NativeSocket fd, int level, int name, int value)
+{
+#if defined(OS_WIN)
+	return setsockopt((SOCKET)fd, level, name, (const char*)&value, sizeof(value)) == 0;
+#else
+	return setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+#endif
+}
+
+bool ApplyKeepalive(NativeSocket fd, const TcpSocketOptions& options)
+{
+	int interval_s = options.keepalive_interval_s > 0 ? options.keepalive_interval_s : options.keepalive_idle_s;
+#if defined(OS_WIN)
+	//Windows 的探测次数固定为 10
+	struct tcp_keepalive keepalive;
+	keepalive.onoff = 1;
+	keepalive.keepalivetime = (ULONG)options.keepalive_idle_s * 1000;
+	keepalive.keepaliveinterval = (ULONG)interval_s * 1000;
+	DWORD returned = 0;
+	return WSAIoctl((SOCKET)fd, SIO_KEEPALIVE_VALS, &keepalive, sizeof(keepalive), nullptr, 0, &returned, nullptr, nullptr) == 0;
+#else
+	bool ret = SetIntOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+#if defined(OS_MACOSX) || defined(OS_IOS)
+	ret = SetIntOption(fd, IPPROTO_TCP, TCP_KEEPALIVE, options.keepalive_idle_s) && ret;
+#else
+	ret = SetIntOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options.keepalive_idle_s) && ret;
+#endif
+	ret = SetIntOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, interval_s) && ret;
+	if (options.keepalive_count > 0)
+		ret = SetIntOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options.keepalive_count) && ret;
+	return ret;
+#endif
+}
+}
+
+bool ApplyTcpSocketOptions(NativeSocket fd, const TcpSocketOptions& options)
+{
+	bool ret = true;
+	if (options.no_delay)
+		ret = SetIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1) && ret;
+	if (options.send_buffer_size > 0)
+		ret = SetIntOption(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer_size) && ret;
+	if (options.receive_buffer_size > 0)
+		ret = SetIntOption(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer_size) && ret;
+	if (options.keepalive_idle_s > 0)
+		ret = ApplyKeepalive(fd, options) && ret;
+#if defined(TCP_NOTSENT_LOWAT)
+	if (options.not_sent_lowat > 0)
+		ret = SetIntOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.not_sent_lowat) && ret;
+#endif
+	return ret;
+}
+
+bool QueryTcpSocketInfo(NativeSocket fd, TcpSocketInfo& info)
+{
+	info = TcpSocketInfo();
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+	struct tcp_info tcp_info;
+	socklen_t len = sizeof(tcp_info);
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &tcp_info, &len) != 0)
+		return false;
+	info.rtt_us = tcp_info.tcpi_rtt;
+	info.rtt_var_us = tcp_info.tcpi_rttvar;
+	info.cwnd_bytes = tcp_info.tcpi_snd_cwnd * tcp_info.tcpi_snd_mss;
+	info.mss = tcp_info.tcpi_snd_mss;
+	info.retransmits = tcp_info.tcpi_total_retrans;
+	return true;
+#elif (defined(OS_MACOSX) || defined(OS_IOS)) && defined(TCP_CONNECTION_INFO)
+	struct tcp_connection_info tcp_info;
+	socklen_t len = sizeof(tcp_info);
+	if (getsockopt(fd, IPPROTO_TCP, TCP_CONNECTION_INFO, &tcp_info, &len) != 0)
+		return false;
+	//RTT 的单位是毫秒
+	info.rtt_us = tcp_info.tcpi_srtt * 1000;
+	info.rtt_var_us = tcp_info.tcpi_rttvar * 1000;
+	info.cwnd_bytes = tcp_info.tcpi_snd_cwnd;
+	info.mss = tcp_info.tcpi_maxseg;
+	info.retransmits = (uint32_t)tcp_info.tcpi_txretransmitpackets;
+	return true;
+#elif defined(OS_WIN) && defined(SIO_TCP_INFO)
+	DWORD version = 0;
+	TCP_INFO_v0 tcp_info;
+	DWORD returned = 0;
+	if (WSAIoctl((SOCKET)fd, SIO_TCP_INFO, &version, sizeof(version), &tcp_info, sizeof(tcp_info), &returned, nullptr, nullptr) != 0)
+		return false;
+	info.rtt_us = tcp_info.RttUs;
+	info.cwnd_bytes = tcp_info.Cwnd;
+	info.mss = tcp_info.Mss;
+	return true;
+#else
+	return false;
+#endif
+}
+
+}
+NET_END_DECLS
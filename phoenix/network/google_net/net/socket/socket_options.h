@@ -0,0 +1,66 @@
+#ifndef __BASE_NET_SOCKET_OPTIONS_H__
+#define __BASE_NET_SOCKET_OPTIONS_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include <stdint.h>
+
+NET_BEGIN_DECLS
+
+// TCP 连接的 socket 选项，连接发起时设置；取值为 0 或 false 的项保持系统默认
+struct NET_EXPORT TcpSocketOptions
+{
+	TcpSocketOptions()
+		: no_delay(false)
+		, send_buffer_size(0)
+		, receive_buffer_size(0)
+		, keepalive_idle_s(0)
+		, keepalive_interval_s(0)
+		, keepalive_count(0)
+		, not_sent_lowat(0) {}
+
+	bool		no_delay;				// 关闭 Nagle，小包请求/应答不再被延迟确认拖慢；libuv 实现总是关闭
+	int			send_buffer_size;		// SO_SNDBUF
+	// SO_RCVBUF。tinyNET 实现在 connect 发出后才能设置，窗口扩大因子已按系统默认协商，
+	// 超过 64KB 的部分可能用不上
+	int			receive_buffer_size;
+	int			keepalive_idle_s;		// 大于 0 时开启 TCP keepalive，空闲这么久后开始探测
+	int			keepalive_interval_s;	// 探测间隔
+	int			keepalive_count;		// 探测失败这么多次后断开，Windows 上不支持
+	// TCP_NOTSENT_LOWAT，内核中未发出的数据超过该值时 socket 不可写，减少排队延迟；Windows 上不支持
+	int			not_sent_lowat;
+};
+
+// 内核统计的连接状态，取不到的字段为 0
+struct NET_EXPORT TcpSocketInfo
+{
+	TcpSocketInfo()
+		: rtt_us(0)
+		, rtt_var_us(0)
+		, cwnd_bytes(0)
+		, mss(0)
+		, retransmits(0) {}
+
+	uint32_t	rtt_us;			// 平滑 RTT
+	uint32_t	rtt_var_us;
+	uint32_t	cwnd_bytes;		// 拥塞窗口
+	uint32_t	mss;
+	uint32_t	retransmits;	// 累计重传的报文数
+};
+
+namespace internal{
+
+#if defined(OS_WIN)
+typedef uintptr_t NativeSocket;
+#else
+typedef int NativeSocket;
+#endif
+
+// 各项尽量设置，返回 false 表示有选项设置失败
+bool ApplyTcpSocketOptions(NativeSocket fd, const TcpSocketOptions& options);
+// Linux/Android 用 TCP_INFO，macOS/iOS 用 TCP_CONNECTION_INFO，Windows 用 SIO_TCP_INFO（Windows 10 1703 及以上）
+bool QueryTcpSocketInfo(NativeSocket fd, TcpSocketInfo& info);
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_SOCKET_OPTIONS_H__
@@ -1,10 +1,25 @@
 #include "net/socket/socket_wrapper.h"
 #include "extension/strings/string_util.h"
+#include "extension/network/address_selector.h"
+#include "extension/network/network_quality_estimator.h"
 #include "tnet_utils.h"
 #include "tsk_debug.h"
 #include "tnet_transport.h"
 #include "tnet_proxydetect.h"
 #include "net/nim_net_util.h"
+#include "net/base/net_errors.h"
+#if !defined(OS_WIN)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+#endif
 
 NET_BEGIN_DECLS
 
@@ -118,7 +133,9 @@ static int OnNetLogCallback(const void* arg, const char* fmt, ...)
 	return 0;
 }
 
-TcpClientImpl::TcpClientImpl() : handler_(nullptr), socket_handle_(nullptr), fd_(TNET_INVALID_FD), is_connected_(false)
+TcpClientImpl::TcpClientImpl() : socket_handle_(nullptr), fd_(TNET_INVALID_FD),
+	backup_handle_(nullptr), backup_fd_(TNET_INVALID_FD), racing_(false), primary_failed_(false), backup_failed_(false),
+	transport_connected_(false)
 {
 }
 
@@ -128,11 +145,6 @@ TcpClientImpl::~TcpClientImpl()
 	handler_ = nullptr;
 }
 
-void TcpClientImpl::SetHandler(TcpClientHandler *handler)
-{
-	handler_ = handler;
-}
-
 void TcpClientImpl::SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password)
 {
 	proxyinfo_.host_ = host;
@@ -142,14 +154,15 @@ void TcpClientImpl::SetProxy(ProxyType type, const std::string& host, int port,
 	proxyinfo_.type_ = type;
 
 }
+
 int TcpClientImpl::OnTcpCallback(const tnet_transport_event_t* e)
 {
-	auto weak_tcp_client = (std::weak_ptr<TcpClientImpl>*)(e->callback_data);
-	auto tcp_client = ((weak_tcp_client != nullptr && !weak_tcp_client->expired()) ? weak_tcp_client->lock() : nullptr);
+	auto context = (TransportContext*)(e->callback_data);
+	auto tcp_client = ((context != nullptr && !context->client.expired()) ? context->client.lock() : nullptr);
 	if (nullptr == tcp_client)
 	{
-		delete weak_tcp_client;
-		weak_tcp_client = nullptr;
+		delete context;
+		context = nullptr;
 		return -1;
 	}
 	switch (e->type) {
@@ -161,14 +174,20 @@ int TcpClientImpl::OnTcpCallback(const tnet_transport_event_t* e)
 	case event_error:
 	case event_closed:
 	{
-		tcp_client->OnClose(NO_ERROR);
-		delete weak_tcp_client;
-		weak_tcp_client = nullptr;
+		tcp_client->RecordConnectFailure(context->backup);
+		if (tcp_client->OnRaceClosed(context->backup))
+			tcp_client->OnClose(NO_ERROR);
+		delete context;
+		context = nullptr;
 	}
 	break;
 	case event_connected:
 	{
-		tcp_client->OnConnect(ERROR_SUCCESS);
+		if (tcp_client->OnRaceConnected(context->backup))
+		{
+			tcp_client->RecordConnectRTT(context->backup);
+			tcp_client->OnConnect(ERROR_SUCCESS);
+		}
 	}
 	break;
 	default:
@@ -193,39 +212,248 @@ tnet_socket_type_e TcpClientImpl::CalcSocketType(const std::string& host, std::s
 	}	
 	return socket_type;
 }
-bool TcpClientImpl::Init(const std::string& host, int port)
+void* TcpClientImpl::StartTransport(tnet_socket_type_e socket_type, const char* description, bool backup)
 {
-	InitLog();	
-	std::string description;
-	auto socket_type = CalcSocketType(host, description);
-	socket_handle_ = tnet_transport_create(TNET_SOCKET_HOST_ANY, TNET_SOCKET_PORT_ANY, socket_type, description.c_str());
-	if (nullptr == socket_handle_)
+	void* socket_handle = tnet_transport_create(TNET_SOCKET_HOST_ANY, TNET_SOCKET_PORT_ANY, socket_type, description);
+	if (nullptr == socket_handle)
 	{
-		return false;
+		return nullptr;
 	}
 	// Set our callback function
-	tnet_transport_set_callback(socket_handle_, &TcpClientImpl::OnTcpCallback, new std::weak_ptr<TcpClientImpl>(shared_from_this()));
+	TransportContext* context = new TransportContext;
+	context->client = std::static_pointer_cast<TcpClientImpl>(shared_from_this());
+	context->backup = backup;
+	tnet_transport_set_callback(socket_handle, &TcpClientImpl::OnTcpCallback, context);
 	// Set proxy
 	if (proxyinfo_.Valid())
 	{
-		((tnet_transport_t*)(socket_handle_))->proxy.auto_detect = tsk_false;
-		((tnet_transport_t*)(socket_handle_))->proxy.info = createProxyInfo(proxyinfo_);
+		((tnet_transport_t*)(socket_handle))->proxy.auto_detect = tsk_false;
+		((tnet_transport_t*)(socket_handle))->proxy.info = createProxyInfo(proxyinfo_);
 	}
 
-	if (tnet_transport_start(socket_handle_))
-	{		
-		return false;
+	if (tnet_transport_start(socket_handle))
+	{
+		ReleaseTransport(socket_handle);
+		return nullptr;
 	}
+	return socket_handle;
+}
+
+void TcpClientImpl::ReleaseTransport(void*& socket_handle)
+{
+	if (socket_handle != nullptr)
+		tnet_transport_set_callback(socket_handle, nullptr, nullptr);
+	TSK_OBJECT_SAFE_FREE(socket_handle);
+}
 
+bool TcpClientImpl::ConnectTransport(void* socket_handle, const std::string& host, int port, int& fd)
+{
 	//Connect to server. tnet_socket_type_t type = tnet_socket_type_tcp_ipv4;
-	if (((fd_ = tnet_transport_connectto_2(socket_handle_, host.c_str(), port)) == TNET_INVALID_FD) 
+	if (((fd = tnet_transport_connectto_2(socket_handle, host.c_str(), port)) == TNET_INVALID_FD)
 		&&	!would_block(true))//连接过程中判断是否阻塞
 	{
 		return false;
 	}
+	//tinyNET 创建 socket 后立即 connect，选项只能在握手进行中设置
+	if (fd != TNET_INVALID_FD)
+		ApplyTcpSocketOptions((NativeSocket)fd, socket_options_);
 	return true;
 }
 
+bool TcpClientImpl::WaitConnected(int fd, long timeout_ms)
+{
+	if (fd == TNET_INVALID_FD || tnet_sockfd_waitUntilWritable(fd, timeout_ms))
+		return false;
+	int error = 0;
+#if defined(OS_WIN)
+	int len = sizeof(error);
+#else
+	socklen_t len = sizeof(error);
+#endif
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&error, &len) != 0)
+		return false;
+	return error == 0;
+}
+
+bool TcpClientImpl::Init(const std::string& host, int port)
+{
+	InitLog();	
+	{
+		std::lock_guard<std::mutex> guard(race_lock_);
+		racing_ = false;
+		primary_failed_ = false;
+		backup_failed_ = false;
+	}
+	connect_host_ = host;
+	connect_ip_.clear();
+	backup_ip_.clear();
+	transport_connected_ = false;
+	connect_start_ = std::chrono::steady_clock::now();
+
+	//代理和 IP 字面量不需要双栈竞速，走原来的单次连接
+	net::AddressFamily addr_family;
+	if (proxyinfo_.Valid() || NimNetUtil::GetAddressFamily(host, addr_family))
+		return ConnectSingle(host, port);
+
+	//RFC 8305 Happy Eyeballs：先连排序后的第一个地址，kHappyEyeballsDelayMs 内未连上再并行连另一地址族的第一个，先连上的胜出。
+	//排序见 AddressSelector：最近连接失败的排到最后，连接过的按历史握手耗时从快到慢，都没有历史时 IPv6 在前
+	std::list<std::string> ip_list;
+	std::string primary, backup;
+	if (NimNetUtil::GetIPByName(host, ip_list) == net::OK)
+	{
+		NS_EXTENSION::AddressSelector::GetInstance()->Sort(ip_list);
+		net::AddressFamily primary_family = ADDRESS_FAMILY_UNSPECIFIED;
+		for (auto& ip : ip_list)
+		{
+			if (!NimNetUtil::GetAddressFamily(ip, addr_family))
+				continue;
+			if (primary.empty())
+			{
+				primary = ip;
+				primary_family = addr_family;
+			}
+			else if (addr_family != primary_family)
+			{
+				backup = ip;
+				break;
+			}
+		}
+	}
+	//解析失败时交给 tinyNET 自己解析；只有一种地址时不需要竞速
+	if (primary.empty())
+		return ConnectSingle(host, port);
+	if (backup.empty())
+		return ConnectSingle(primary, port);
+
+	{
+		std::lock_guard<std::mutex> guard(race_lock_);
+		racing_ = true;
+	}
+	std::string description;
+	tnet_socket_type_e socket_type = CalcSocketType(primary, description);
+	connect_ip_ = primary;
+	socket_handle_ = StartTransport(socket_type, description.c_str(), false);
+	if (socket_handle_ == nullptr || !ConnectTransport(socket_handle_, primary, port, fd_))
+	{
+		//第一个地址立即失败，只连备用地址
+		{
+			std::lock_guard<std::mutex> guard(race_lock_);
+			racing_ = false;
+		}
+		if (socket_handle_ != nullptr)
+			NS_EXTENSION::AddressSelector::GetInstance()->ReportFailure(primary);
+		ReleaseTransport(socket_handle_);
+		fd_ = TNET_INVALID_FD;
+		return ConnectSingle(backup, port);
+	}
+	if (WaitConnected(fd_, kHappyEyeballsDelayMs))
+		return true;
+
+	{
+		std::lock_guard<std::mutex> guard(race_lock_);
+		if (!racing_)//等待期间第一个地址已经连上
+			return true;
+	}
+	socket_type = CalcSocketType(backup, description);
+	backup_ip_ = backup;
+	void* backup_handle = StartTransport(socket_type, description.c_str(), true);
+	bool ret = true;
+	{
+		//持锁发起连接，保证备用连接的事件到来时 backup_handle_ 已经就绪
+		std::lock_guard<std::mutex> guard(race_lock_);
+		backup_connect_start_ = std::chrono::steady_clock::now();
+		if (!racing_)
+		{
+			//启动备用连接期间第一个地址已经连上
+		}
+		else if (backup_handle != nullptr && ConnectTransport(backup_handle, backup, port, backup_fd_))
+		{
+			backup_handle_ = backup_handle;
+			backup_handle = nullptr;
+		}
+		else
+		{
+			racing_ = false;
+			backup_fd_ = TNET_INVALID_FD;
+			ret = !primary_failed_;
+		}
+	}
+	//不能持锁释放，传输线程可能正阻塞在竞速回调里
+	ReleaseTransport(backup_handle);
+	return ret;
+}
+
+bool TcpClientImpl::ConnectSingle(const std::string& host, int port)
+{
+	std::string description;
+	auto socket_type = CalcSocketType(host, description);
+	connect_ip_ = host;
+	socket_handle_ = StartTransport(socket_type, description.c_str(), false);
+	if (socket_handle_ == nullptr)
+		return false;
+	if (ConnectTransport(socket_handle_, host, port, fd_))
+		return true;
+	if (!proxyinfo_.Valid())
+		NS_EXTENSION::AddressSelector::GetInstance()->ReportFailure(host);
+	return false;
+}
+
+bool TcpClientImpl::OnRaceConnected(bool backup)
+{
+	std::lock_guard<std::mutex> guard(race_lock_);
+	if (!racing_)
+		return true;
+
+	racing_ = false;
+	if (backup)
+	{
+		std::swap(socket_handle_, backup_handle_);
+		std::swap(fd_, backup_fd_);
+	}
+	//落败的连接不再回调，Close 时释放，避免在回调线程里释放另一个传输线程
+	if (backup_handle_ != nullptr)
+		tnet_transport_set_callback(backup_handle_, nullptr, nullptr);
+	return true;
+}
+
+bool TcpClientImpl::OnRaceClosed(bool backup)
+{
+	std::lock_guard<std::mutex> guard(race_lock_);
+	if (!racing_)
+		return true;
+
+	if (backup)
+		backup_failed_ = true;
+	else
+		primary_failed_ = true;
+	//两个连接都失败才算连接失败；备用连接还没开始时由 Init 接着发起
+	if (primary_failed_ && backup_failed_)
+	{
+		racing_ = false;
+		return true;
+	}
+	return false;
+}
+
+void TcpClientImpl::RecordConnectRTT(bool backup)
+{
+	transport_connected_ = true;
+	if (proxyinfo_.Valid())
+		return;
+	auto elapsed = std::chrono::steady_clock::now() - (backup ? backup_connect_start_ : connect_start_);
+	int rtt_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+	NS_EXTENSION::NetworkQualityEstimator::GetInstance()->AddTransportRTT(connect_host_, rtt_ms);
+	NS_EXTENSION::AddressSelector::GetInstance()->ReportSuccess(backup ? backup_ip_ : connect_ip_, rtt_ms);
+}
+
+void TcpClientImpl::RecordConnectFailure(bool backup)
+{
+	//连上之后的断开（含 TLS 握手失败）与地址是否可达无关
+	if (transport_connected_ || proxyinfo_.Valid())
+		return;
+	NS_EXTENSION::AddressSelector::GetInstance()->ReportFailure(backup ? backup_ip_ : connect_ip_);
+}
+
 void TcpClientImpl::InitLog()
 {
 	tsk_debug_set_level(DEBUG_LEVEL_INFO);
@@ -254,6 +482,57 @@ int	TcpClientImpl::Write(const void *data, size_t size)
 	return n;
 }
 
+bool TcpClientImpl::GetSocketInfo(TcpSocketInfo& info)
+{
+	int fd = fd_;
+	if (fd == TNET_INVALID_FD || !is_connected_)
+		return false;
+	return QueryTcpSocketInfo((NativeSocket)fd, info);
+}
+
+int TcpClientImpl::WriteV(const SendQueue::Slice *slices, size_t count)
+{
+	if (nullptr == socket_handle_ || fd_ == TNET_INVALID_FD)
+		return SOCKET_ERROR;
+	//连接（含代理握手）完成前数据留在队列里，OnConnect 时再发送
+	if (!is_connected_)
+		return 0;
+
+#if defined(OS_WIN)
+	WSABUF buffers[64];
+	DWORD buffer_count = 0;
+	for (; buffer_count < count && buffer_count < 64; buffer_count++)
+	{
+		buffers[buffer_count].buf = (CHAR*)slices[buffer_count].data;
+		buffers[buffer_count].len = (ULONG)slices[buffer_count].size;
+	}
+	DWORD sent = 0;
+	if (WSASend(fd_, buffers, buffer_count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+		return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : SOCKET_ERROR;
+	return (int)sent;
+#else
+	struct iovec buffers[64];
+	size_t buffer_count = 0;
+	for (; buffer_count < count && buffer_count < 64; buffer_count++)
+	{
+		buffers[buffer_count].iov_base = (void*)slices[buffer_count].data;
+		buffers[buffer_count].iov_len = slices[buffer_count].size;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = buffers;
+	msg.msg_iovlen = buffer_count;
+#if defined(MSG_NOSIGNAL)
+	ssize_t sent = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+#else
+	ssize_t sent = sendmsg(fd_, &msg, 0);
+#endif
+	if (sent < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : SOCKET_ERROR;
+	return (int)sent;
+#endif
+}
+
 int	TcpClientImpl::Read(const void *data, size_t size)
 {
 	int n = (int)size;//接收失败时返回0
@@ -270,51 +549,28 @@ int	TcpClientImpl::Read(const void *data, size_t size)
 
 void TcpClientImpl::Close()
 {
-	if (socket_handle_ != nullptr)
-		tnet_transport_set_callback(socket_handle_, nullptr, nullptr);//将BizTcpClient作为回调数据传到回调函数里，方便接口访问。
-	TSK_OBJECT_SAFE_FREE(socket_handle_);//该释放操作会执行close fd，无需在上层显示关闭
+	if (send_queue_)
+		send_queue_->Clear();//等待定时线程上正在进行的发送结束
+	ReleaseTransport(socket_handle_);//该释放操作会执行close fd，无需在上层显示关闭
 	fd_ = TNET_INVALID_FD;//上层定义的句柄需要置为无效。modified by HarrisonFeng, 2014.9.23
-}
-
-bool TcpClientImpl::IsConnected()
-{
-	return is_connected_;
-}
-
-void TcpClientImpl::OnClose(int error_code)
-{
-	is_connected_ = false;
 
-	if (handler_)
-		handler_->OnClose(error_code);
-}
-
-void TcpClientImpl::OnConnect(int error_code)
-{
-	is_connected_ = (error_code == ERROR_SUCCESS);
-
-	if (handler_)
-		handler_->OnConnect(error_code);
+	void* backup_handle = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(race_lock_);
+		racing_ = false;
+		std::swap(backup_handle, backup_handle_);
+		backup_fd_ = TNET_INVALID_FD;
+	}
+	ReleaseTransport(backup_handle);
 }
 
 void TcpClientImpl::OnAccept(int error_code)
 {
 }
 
-void TcpClientImpl::OnReceive(int error_code, const void *data, size_t size)
-{
-	if (handler_)
-		handler_->OnReceive(error_code, data, size);
-}
-
-void TcpClientImpl::OnSend(int error_code)
-{
-	if (handler_)
-		handler_->OnSend(error_code);
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////
-UDPClientImpl::UDPClientImpl() : handler_(nullptr), socket_handle_(nullptr),fd_(TNET_INVALID_FD), is_connected_(false)
+UDPClientImpl::UDPClientImpl() : handler_(nullptr), socket_handle_(nullptr),fd_(TNET_INVALID_FD), is_connected_(false),
+	batch_size_(0), max_datagram_size_(0), gso_enabled_(true)
 {
 }
 
@@ -329,6 +585,23 @@ void UDPClientImpl::SetHandler(UdpClientHandler *handler)
 	handler_ = handler;
 }
 
+void UDPClientImpl::SetBatchReceive(size_t max_batch, size_t max_datagram_size/* = 2048*/)
+{
+	batch_size_ = max_batch < kMaxBatchDatagrams ? max_batch : kMaxBatchDatagrams;
+	max_datagram_size_ = max_datagram_size;
+	if (batch_size_ > 1 && max_datagram_size_ > 0)
+	{
+		batch_buffer_.resize((batch_size_ - 1) * max_datagram_size_);
+		batch_datagrams_.resize(batch_size_);
+	}
+	else
+	{
+		batch_size_ = 0;
+		batch_buffer_.clear();
+		batch_datagrams_.clear();
+	}
+}
+
 int UDPClientImpl::OnUDPCallback(const tnet_transport_event_t* e)
 {
 	auto weak_udp_client = (std::weak_ptr<UDPClientImpl>*)(e->callback_data);
@@ -409,6 +682,107 @@ int	UDPClientImpl::Write(const void *data, size_t size)
 	return n;
 }
 
+int	UDPClientImpl::WriteBatch(const UdpDatagram *datagrams, size_t count)
+{
+	if (nullptr == socket_handle_ || fd_ == TNET_INVALID_FD)
+		return SOCKET_ERROR;
+
+	size_t sent = 0;
+	while (sent < count)
+	{
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+		int n = gso_enabled_ ? WriteSegments(datagrams + sent, count - sent) : 0;
+		if (0 == n)
+			n = WriteMultiple(datagrams + sent, count - sent);
+#else
+		int n = Write(datagrams[sent].data, datagrams[sent].size);
+		if (n != SOCKET_ERROR)
+			n = (0 == n && datagrams[sent].size != 0) ? 0 : 1;
+#endif
+		if (n <= 0)
+		{
+			if (0 == sent && SOCKET_ERROR == n)
+				return SOCKET_ERROR;
+			break;
+		}
+		sent += n;
+	}
+	return (int)sent;
+}
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+int UDPClientImpl::WriteSegments(const UdpDatagram *datagrams, size_t count)
+{
+	//GSO 由内核按 segment_size 切分，要求除最后一个外所有报文等长，取开头连续可合并的一段
+	size_t segment_size = datagrams[0].size;
+	if (0 == segment_size)
+		return 0;
+	size_t segments = 1;
+	size_t total = segment_size;
+	while (segments < count && segments < kMaxBatchDatagrams)
+	{
+		size_t size = datagrams[segments].size;
+		if (0 == size || size > segment_size || total + size > kMaxGsoBytes)
+			break;
+		total += size;
+		segments++;
+		if (size < segment_size)
+			break;//较短的报文只能作为最后一段
+	}
+	if (segments < 2)
+		return 0;
+
+	struct iovec buffers[kMaxBatchDatagrams];
+	for (size_t i = 0; i < segments; i++)
+	{
+		buffers[i].iov_base = (void*)datagrams[i].data;
+		buffers[i].iov_len = datagrams[i].size;
+	}
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	memset(control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = buffers;
+	msg.msg_iovlen = segments;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = IPPROTO_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	uint16_t gso_size = (uint16_t)segment_size;
+	memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+	if (sendmsg(fd_, &msg, 0) < 0)
+	{
+		//内核或网卡不支持 UDP GSO 时之后都改用 sendmmsg
+		if (errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP || errno == EIO)
+			gso_enabled_ = false;
+		return 0;
+	}
+	return (int)segments;
+}
+
+int UDPClientImpl::WriteMultiple(const UdpDatagram *datagrams, size_t count)
+{
+	size_t batch = count < kMaxBatchDatagrams ? count : kMaxBatchDatagrams;
+	struct mmsghdr msgs[kMaxBatchDatagrams];
+	struct iovec buffers[kMaxBatchDatagrams];
+	memset(msgs, 0, sizeof(msgs[0]) * batch);
+	for (size_t i = 0; i < batch; i++)
+	{
+		buffers[i].iov_base = (void*)datagrams[i].data;
+		buffers[i].iov_len = datagrams[i].size;
+		msgs[i].msg_hdr.msg_iov = &buffers[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int sent = sendmmsg(fd_, msgs, (unsigned int)batch, 0);
+	if (sent < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : SOCKET_ERROR;
+	return sent;
+}
+#endif
+
 int	UDPClientImpl::Read(const void *data, size_t size)
 {
 	int n = (int)size;//接收失败时返回0
@@ -455,10 +829,84 @@ void UDPClientImpl::OnAccept(int error_code)
 
 void UDPClientImpl::OnReceive(int error_code, const void *data, size_t size)
 {
-	if (handler_)
+	if (nullptr == handler_)
+		return;
+	if (batch_size_ > 1 && NO_ERROR == error_code)
+	{
+		size_t count = DrainDatagrams(data, size);
+		handler_->OnReceiveBatch(&batch_datagrams_[0], count);
+	}
+	else
 		handler_->OnReceive(error_code, data, size);
 }
 
+size_t UDPClientImpl::DrainDatagrams(const void *first, size_t first_size)
+{
+	batch_datagrams_[0].data = first;
+	batch_datagrams_[0].size = first_size;
+	size_t count = 1;
+	if (fd_ == TNET_INVALID_FD)
+		return count;
+
+	//与 tinyNET 的轮询线程并发读同一 fd，UDP 按报文原子读取，只可能打乱少量报文的先后顺序
+	size_t wanted = batch_size_ - 1;
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+	struct mmsghdr msgs[kMaxBatchDatagrams];
+	struct iovec buffers[kMaxBatchDatagrams];
+	memset(msgs, 0, sizeof(msgs[0]) * wanted);
+	for (size_t i = 0; i < wanted; i++)
+	{
+		buffers[i].iov_base = &batch_buffer_[i * max_datagram_size_];
+		buffers[i].iov_len = max_datagram_size_;
+		msgs[i].msg_hdr.msg_iov = &buffers[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int received = recvmmsg(fd_, msgs, (unsigned int)wanted, MSG_DONTWAIT, nullptr);
+	for (int i = 0; i < received; i++)
+	{
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			continue;//超过 max_datagram_size 被截断的报文丢弃
+		batch_datagrams_[count].data = buffers[i].iov_base;
+		batch_datagrams_[count].size = msgs[i].msg_len;
+		count++;
+	}
+#else
+	for (size_t i = 0; i < wanted; i++)
+	{
+		char *buffer = &batch_buffer_[i * max_datagram_size_];
+#if defined(OS_WIN)
+		u_long pending = 0;
+		if (ioctlsocket(fd_, FIONREAD, &pending) == SOCKET_ERROR || 0 == pending)
+			break;
+		int received = recv(fd_, buffer, (int)max_datagram_size_, 0);
+		if (received == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() == WSAEMSGSIZE)
+				continue;//超过 max_datagram_size 被截断的报文丢弃
+			break;
+		}
+#else
+		struct iovec iov;
+		iov.iov_base = buffer;
+		iov.iov_len = max_datagram_size_;
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		ssize_t received = recvmsg(fd_, &msg, MSG_DONTWAIT);
+		if (received < 0)
+			break;
+		if (msg.msg_flags & MSG_TRUNC)
+			continue;//超过 max_datagram_size 被截断的报文丢弃
+#endif
+		batch_datagrams_[count].data = buffer;
+		batch_datagrams_[count].size = (size_t)received;
+		count++;
+	}
+#endif
+	return count;
+}
+
 void UDPClientImpl::OnSend(int error_code)
 {
 }
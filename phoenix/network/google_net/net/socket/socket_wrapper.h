@@ -6,7 +6,13 @@
 #include "proxy_config/proxy_config/proxy_info.h"
 #include "tnet_transport.h"
 #include "net/socket/socket_handler.h"
+#include "net/socket/tcp_client_base.h"
 #include <memory.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 NET_BEGIN_DECLS
 
@@ -14,39 +20,68 @@ bool would_block(bool connecting = false);
 
 namespace internal{
 
-class NET_EXPORT TcpClientImpl:public std::enable_shared_from_this<TcpClientImpl>
+class NET_EXPORT TcpClientImpl :public TcpClientBase
 {
 public:
 	TcpClientImpl();
 
 	virtual ~TcpClientImpl();
 
-	void SetHandler(TcpClientHandler *handler);
-	void SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password);
+	virtual void SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password) override;
 
-	bool Init(const std::string& host, int port);
-	int	Write(const void *data, size_t size);
-	int	Read(const void *data, size_t size);
-	void Close();
-
-	bool IsConnected();
+	virtual bool Init(const std::string& host, int port) override;
+	virtual int	Write(const void *data, size_t size) override;
+	virtual int	Read(const void *data, size_t size) override;
+	virtual void Close() override;
+	virtual bool GetSocketInfo(TcpSocketInfo& info) override;
 
 protected:
-	void OnClose(int error_code);
-	void OnConnect(int error_code);
 	void OnAccept(int error_code);
-	void OnReceive(int error_code, const void *data, size_t size);
-	void OnSend(int error_code);
+	virtual int WriteV(const SendQueue::Slice *slices, size_t count) override;
     static int OnTcpCallback(const tnet_transport_event_t* e);
 private:
 	void InitLog();
 	tnet_socket_type_e CalcSocketType(const std::string& host, std::string& description);
+	void* StartTransport(tnet_socket_type_e socket_type, const char* description, bool backup);
+	void ReleaseTransport(void*& socket_handle);
+	bool ConnectTransport(void* socket_handle, const std::string& host, int port, int& fd);
+	bool WaitConnected(int fd, long timeout_ms);
+	bool ConnectSingle(const std::string& host, int port);
+	// 双栈竞速期间过滤两个连接的事件，返回 true 表示需要通知上层
+	bool OnRaceConnected(bool backup);
+	bool OnRaceClosed(bool backup);
+	// 握手耗时上报给 NetworkQualityEstimator 和 AddressSelector，经过代理时不准，不上报
+	void RecordConnectRTT(bool backup);
+	// 传输层连上之前就关闭的地址上报给 AddressSelector，之后一段时间排到最后
+	void RecordConnectFailure(bool backup);
 private:
-	TcpClientHandler		*handler_;
+	// 作为 tinyNET 的 callback_data，区分竞速中的两个连接
+	struct TransportContext
+	{
+		std::weak_ptr<TcpClientImpl> client;
+		bool backup;
+	};
+
+	static const long kHappyEyeballsDelayMs = 250;
+
 	void                    *socket_handle_;
 	ProxyInfo             proxyinfo_;
 	int				        fd_;
-	bool					is_connected_;
+	// Happy Eyeballs 的另一地址族的备用连接，竞速结束后落败的一方留到 Close 时释放
+	std::mutex				race_lock_;
+	void                    *backup_handle_;
+	int				        backup_fd_;
+	bool					racing_;
+	bool					primary_failed_;
+	bool					backup_failed_;
+	// 发起连接的时间，用于计算握手耗时
+	std::string				connect_host_;
+	// 两个连接实际连的地址，域名交给 tinyNET 解析时为域名
+	std::string				connect_ip_;
+	std::string				backup_ip_;
+	std::atomic<bool>		transport_connected_;
+	std::chrono::steady_clock::time_point connect_start_;
+	std::chrono::steady_clock::time_point backup_connect_start_;
 };
 
 class NET_EXPORT UDPClientImpl :public std::enable_shared_from_this<UDPClientImpl>
@@ -58,8 +93,16 @@ public:
 
 	void SetHandler(UdpClientHandler *handler);
 
+	// 开启批量接收：每次有数据到达时再尽量多读出 max_batch - 1 个报文，一起通过 OnReceiveBatch 回调
+	// 超过 max_datagram_size 的报文会被截断丢弃；max_batch <= 1 时恢复逐个回调 OnReceive
+	// 需在 Init 之前调用
+	void SetBatchReceive(size_t max_batch, size_t max_datagram_size = 2048);
+
 	bool Init(const std::string& host, int port);
 	int	 Write(const void *data, size_t size);
+	// 一次发送多个报文，Linux/Android 上使用 UDP GSO 或 sendmmsg，其他平台逐个发送
+	// 返回已发送的报文个数，一个都未发出且不是阻塞时返回 SOCKET_ERROR
+	int	 WriteBatch(const UdpDatagram *datagrams, size_t count);
 	int	 Read(const void *data, size_t size);
 
 	void Close();
@@ -74,10 +117,27 @@ protected:
 	void OnSend(int error_code);
 	static int OnUDPCallback(const tnet_transport_event_t* e);
 private:
+	// 以 first 为第一个报文，从 fd_ 中非阻塞地读出其余已到达的报文，返回报文个数
+	size_t DrainDatagrams(const void *first, size_t first_size);
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+	// 返回发出的报文个数，不适用 GSO 或阻塞时返回 0
+	int WriteSegments(const UdpDatagram *datagrams, size_t count);
+	int WriteMultiple(const UdpDatagram *datagrams, size_t count);
+#endif
+
+	static const size_t kMaxBatchDatagrams = 64;
+	static const size_t kMaxGsoBytes = 65000;
+
 	UdpClientHandler		*handler_;
 	void                    *socket_handle_;
 	int				        fd_;
 	bool					is_connected_;
+	// 批量接收，只在 tinyNET 回调线程上访问
+	size_t					batch_size_;
+	size_t					max_datagram_size_;
+	std::vector<char>		batch_buffer_;
+	std::vector<UdpDatagram> batch_datagrams_;
+	std::atomic<bool>		gso_enabled_;
 };
 }
 NET_END_DECLS
@@ -0,0 +1,374 @@
+#include "net/socket/stream_mux.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/base/net_errors.h"
+#include <limits>
+
+NET_BEGIN_DECLS
+
+namespace
+{
+uint32_t ReadUint32(const char *data)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void AppendUint32(std::string &out, uint32_t value)
+{
+	char buf[4] = { (char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value };
+	out.append(buf, sizeof(buf));
+}
+}
+
+StreamMux::StreamMux(const std::shared_ptr<TcpClientSocket> &socket, StreamMuxHandler *handler, const StreamMuxOptions &options/* = StreamMuxOptions()*/)
+	: socket_(socket)
+	, handler_(handler)
+	, options_(options)
+	, connected_(false)
+	, pump_again_(false)
+	, blocked_(false)
+{
+	if (options_.max_frame_payload == 0)
+		options_.max_frame_payload = StreamMuxOptions().max_frame_payload;
+	FrameFormat format;
+	format.length_size = 4;
+	format.byte_order = 1;
+	format.length_includes_header = true;
+	format.max_frame_size = kHeaderSize + options_.max_frame_payload;
+	socket_->SetFrameFormat(format);
+	socket_->SetSendQueue(options_.send_queue);
+	socket_->RegisterCallback(this);
+}
+
+StreamMux::~StreamMux()
+{
+	socket_->UnregisterCallback();
+}
+
+void StreamMux::OpenStream(uint32_t stream_id, uint32_t weight)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	GetStreamLocked(stream_id).weight = weight > 0 ? weight : 1;
+}
+
+bool StreamMux::Send(uint32_t stream_id, const void *data, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		Stream &stream = GetStreamLocked(stream_id);
+		if (stream.reset || stream.queued_size + size > options_.max_stream_buffer)
+			return false;
+		Message message;
+		message.data.assign((const char *)data, size);
+		message.offset = 0;
+		stream.messages.push_back(std::move(message));
+		stream.queued_size += size;
+	}
+	Pump();
+	return true;
+}
+
+void StreamMux::ResetStream(uint32_t stream_id)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		Stream &stream = GetStreamLocked(stream_id);
+		if (stream.reset)
+			return;
+		stream.reset = true;
+		stream.messages.clear();
+		stream.queued_size = 0;
+		if (connected_)
+			PushControlLocked(stream_id, kFrameReset, 0);
+	}
+	Pump();
+}
+
+void StreamMux::Consume(uint32_t stream_id, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto it = streams_.find(stream_id);
+		if (it == streams_.end() || it->second.reset || !connected_)
+			return;
+		ConsumeLocked(stream_id, it->second, size);
+	}
+	Pump();
+}
+
+size_t StreamMux::queued_size(uint32_t stream_id) const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = streams_.find(stream_id);
+	return it == streams_.end() ? 0 : it->second.queued_size;
+}
+
+void StreamMux::OnClose(int error_code)
+{
+	bool connected = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		connected = connected_;
+		connected_ = false;
+		//对端的流状态随连接一起丢失，未发出的数据不再保留
+		for (auto &it : streams_)
+		{
+			it.second.messages.clear();
+			it.second.queued_size = 0;
+		}
+		control_frames_.clear();
+	}
+	if (connected && handler_)
+		handler_->OnClose(error_code);
+}
+
+void StreamMux::OnConnect(int error_code)
+{
+	if (error_code == ERROR_SUCCESS)
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		connected_ = true;
+		blocked_ = false;
+		ResetWindowsLocked();
+	}
+	if (handler_)
+		handler_->OnConnect(error_code);
+	if (error_code == ERROR_SUCCESS)
+		Pump();
+}
+
+void StreamMux::OnReceive(int error_code, const void *data, size_t size)
+{
+	//分帧模式下只有长度非法时才会走到这里，后续数据无法对齐，断开连接
+	if (error_code == NO_ERROR)
+		return;
+	socket_->Close();
+	OnClose(net::ERR_INVALID_RESPONSE);
+}
+
+void StreamMux::OnSend(int error_code)
+{
+
+}
+
+void StreamMux::OnReceiveFrame(const void *frame, size_t size)
+{
+	if (size < kHeaderSize)
+		return;
+	const char *p = (const char *)frame;
+	uint32_t stream_id = ReadUint32(p + 4);
+	uint8_t type = (uint8_t)p[8];
+	uint8_t flags = (uint8_t)p[9];
+	const char *payload = p + kHeaderSize;
+	size_t payload_size = size - kHeaderSize;
+
+	bool deliver = false, notify_reset = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!connected_)
+			return;
+		Stream &stream = GetStreamLocked(stream_id);
+		if (type == kFrameData)
+		{
+			if (stream.reset)
+				return;
+			if (payload_size > stream.recv_window)
+			{
+				//对端超出了流控窗口，只重置这一个流
+				stream.reset = true;
+				stream.messages.clear();
+				stream.queued_size = 0;
+				PushControlLocked(stream_id, kFrameReset, 0);
+				notify_reset = true;
+			}
+			else
+			{
+				stream.recv_window -= (uint32_t)payload_size;
+				if (options_.auto_window_update)
+					ConsumeLocked(stream_id, stream, payload_size);
+				deliver = true;
+			}
+		}
+		else if (type == kFrameWindowUpdate)
+		{
+			if (payload_size < 4)
+				return;
+			uint64_t window = (uint64_t)stream.send_window + ReadUint32(payload);
+			stream.send_window = window > std::numeric_limits<uint32_t>::max() ? std::numeric_limits<uint32_t>::max() : (uint32_t)window;
+		}
+		else if (type == kFrameReset)
+		{
+			if (stream.reset)
+				return;
+			stream.reset = true;
+			stream.messages.clear();
+			stream.queued_size = 0;
+			notify_reset = true;
+		}
+		else
+		{
+			//未知类型留给以后扩展，直接忽略
+			return;
+		}
+	}
+	if (handler_)
+	{
+		if (deliver)
+			handler_->OnStreamData(stream_id, payload, payload_size, (flags & kFlagMessageEnd) != 0);
+		if (notify_reset)
+			handler_->OnStreamReset(stream_id);
+	}
+	Pump();
+}
+
+void StreamMux::OnSendBackpressure(bool blocked)
+{
+	blocked_ = blocked;
+	if (!blocked)
+		Pump();
+}
+
+StreamMux::Stream& StreamMux::GetStreamLocked(uint32_t stream_id)
+{
+	auto it = streams_.find(stream_id);
+	if (it != streams_.end())
+		return it->second;
+	Stream &stream = streams_[stream_id];
+	stream.weight = options_.default_weight > 0 ? options_.default_weight : 1;
+	stream.send_window = options_.initial_window;
+	stream.recv_window = options_.initial_window;
+	return stream;
+}
+
+void StreamMux::ResetWindowsLocked()
+{
+	control_frames_.clear();
+	for (auto &it : streams_)
+	{
+		Stream &stream = it.second;
+		stream.current_weight = 0;
+		stream.send_window = options_.initial_window;
+		stream.recv_window = options_.initial_window;
+		stream.unacked_consumed = 0;
+		stream.reset = false;
+	}
+}
+
+void StreamMux::PushControlLocked(uint32_t stream_id, uint8_t type, uint32_t value)
+{
+	std::string frame;
+	if (type == kFrameWindowUpdate)
+	{
+		AppendHeader(frame, kHeaderSize + 4, stream_id, type, 0);
+		AppendUint32(frame, value);
+	}
+	else
+	{
+		AppendHeader(frame, kHeaderSize, stream_id, type, 0);
+	}
+	control_frames_.push_back(std::move(frame));
+}
+
+void StreamMux::ConsumeLocked(uint32_t stream_id, Stream &stream, size_t size)
+{
+	stream.unacked_consumed += (uint32_t)size;
+	//攒够半个窗口再归还，避免每帧都回一个 WINDOW_UPDATE
+	if (stream.unacked_consumed < options_.initial_window / 2)
+		return;
+	stream.recv_window += stream.unacked_consumed;
+	PushControlLocked(stream_id, kFrameWindowUpdate, stream.unacked_consumed);
+	stream.unacked_consumed = 0;
+}
+
+bool StreamMux::NextFrameLocked(std::string &frame)
+{
+	if (!connected_)
+		return false;
+	if (!control_frames_.empty())
+	{
+		frame.swap(control_frames_.front());
+		control_frames_.pop_front();
+		return true;
+	}
+
+	//平滑加权轮询：每轮所有可发送的流加上自己的权重，取最大的发一帧，再减去总权重
+	Stream *selected = nullptr;
+	uint32_t selected_id = 0;
+	int64_t total_weight = 0;
+	for (auto &it : streams_)
+	{
+		Stream &stream = it.second;
+		if (stream.reset || stream.messages.empty() || stream.send_window == 0)
+			continue;
+		stream.current_weight += stream.weight;
+		total_weight += stream.weight;
+		if (!selected || stream.current_weight > selected->current_weight)
+		{
+			selected = &stream;
+			selected_id = it.first;
+		}
+	}
+	if (!selected)
+		return false;
+	selected->current_weight -= total_weight;
+
+	Message &message = selected->messages.front();
+	size_t remain = message.data.size() - message.offset;
+	size_t payload = remain;
+	if (payload > options_.max_frame_payload)
+		payload = options_.max_frame_payload;
+	if (payload > selected->send_window)
+		payload = selected->send_window;
+	bool message_end = payload == remain;
+
+	frame.clear();
+	frame.reserve(kHeaderSize + payload);
+	AppendHeader(frame, (uint32_t)(kHeaderSize + payload), selected_id, kFrameData, message_end ? kFlagMessageEnd : 0);
+	frame.append(message.data, message.offset, payload);
+	message.offset += payload;
+	selected->send_window -= (uint32_t)payload;
+	selected->queued_size -= payload;
+	if (message_end)
+		selected->messages.pop_front();
+	return true;
+}
+
+void StreamMux::Pump()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> pump_guard(pump_lock_, std::try_to_lock);
+			if (!pump_guard.owns_lock())
+			{
+				//正在发送的线程退出前会再检查一次
+				pump_again_ = true;
+				return;
+			}
+			pump_again_ = false;
+			std::string frame;
+			while (!blocked_)
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock_);
+					if (!NextFrameLocked(frame))
+						break;
+				}
+				if (!socket_->SendFrame(frame.data(), frame.size()))
+					break;
+			}
+		}
+		if (!pump_again_.exchange(false))
+			return;
+	}
+}
+
+void StreamMux::AppendHeader(std::string &frame, uint32_t length, uint32_t stream_id, uint8_t type, uint8_t flags)
+{
+	AppendUint32(frame, length);
+	AppendUint32(frame, stream_id);
+	char tail[4] = { (char)type, (char)flags, 0, 0 };
+	frame.append(tail, sizeof(tail));
+}
+
+NET_END_DECLS
@@ -0,0 +1,154 @@
+#ifndef __BASE_NET_STREAM_MUX_H__
+#define __BASE_NET_STREAM_MUX_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/socket/socket_handler.h"
+#include "net/socket/send_queue.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+class TcpClientSocket;
+
+struct NET_EXPORT StreamMuxOptions
+{
+	StreamMuxOptions()
+		: max_frame_payload(16 * 1024)
+		, initial_window(256 * 1024)
+		, max_stream_buffer(4 * 1024 * 1024)
+		, default_weight(1)
+		, auto_window_update(true)
+	{
+		//发送队列只保留少量数据，交错的顺序由复用器决定，而不是在队列里排死
+		send_queue.high_watermark = 256 * 1024;
+		send_queue.low_watermark = 64 * 1024;
+	}
+
+	size_t		max_frame_payload;	// 每帧最多携带的数据，也是高优先级帧最多需要等待的数据量
+	uint32_t	initial_window;		// 每个流的初始流控窗口，双方必须一致
+	size_t		max_stream_buffer;	// 单个流排队未发送的数据上限，超过时 Send 返回 false
+	uint32_t	default_weight;		// 收到未 OpenStream 的流的数据时使用的权重
+	bool		auto_window_update;	// 为 true 时数据回调后即视为已消费，否则需调用 Consume
+	SendQueueOptions send_queue;
+};
+
+class NET_EXPORT StreamMuxHandler
+{
+public:
+	virtual void OnConnect(int error_code) = 0;
+	virtual void OnClose(int error_code) = 0;
+	//一条消息可能分成多帧回调，message_end 为 true 时是该消息的最后一段，data 只在回调期间有效
+	virtual void OnStreamData(uint32_t stream_id, const void *data, size_t size, bool message_end) = 0;
+	//对端重置了流，或对端超出了流控窗口
+	virtual void OnStreamReset(uint32_t stream_id) {}
+};
+
+// 在一条 TCP 连接上复用多个逻辑流（信令、消息同步、文件分片等），省去每个通道单独建连的开销。
+// 每帧 12 字节的头部，网络字节序：
+//   length(4，含头部) stream_id(4) type(1) flags(1) reserved(2)，其后是数据
+// type 为 kFrame* 之一；DATA 帧的 flags 带 kFlagMessageEnd 表示消息结束；
+// WINDOW_UPDATE 的数据是 4 字节的窗口增量；RESET 没有数据。
+// 流 id 由双方约定，无需建立；每个流按 initial_window 做流控，接收方消费一半窗口后回 WINDOW_UPDATE。
+// 发送时按权重做平滑加权轮询，每次只发一帧，大的文件分片不会长时间阻塞信令；
+// 控制帧（WINDOW_UPDATE、RESET）总是先于数据帧发送。重置的流在本次连接内不再收发，重连后恢复。
+// 构造时接管 socket 的回调，并为它开启分帧和发送队列，之后再调用 socket 的 Init；
+// 需要压缩时在构造之后调用 socket 的 SetFrameCompression，帧都经 SendFrame 发出。
+class NET_EXPORT StreamMux : public TcpClientHandler
+{
+public:
+	enum FrameType
+	{
+		kFrameData = 0,
+		kFrameWindowUpdate,
+		kFrameReset,
+	};
+
+	enum FrameFlag
+	{
+		kFlagMessageEnd = 0x01,
+	};
+
+	static const size_t kHeaderSize = 12;
+
+	StreamMux(const std::shared_ptr<TcpClientSocket> &socket, StreamMuxHandler *handler, const StreamMuxOptions &options = StreamMuxOptions());
+	virtual ~StreamMux();
+
+	// weight 越大分到的带宽越多，可以在连接前后任意时刻调用
+	void OpenStream(uint32_t stream_id, uint32_t weight);
+	// 整条消息排队发送，返回 false 表示流已重置或排队的数据超过 max_stream_buffer
+	bool Send(uint32_t stream_id, const void *data, size_t size);
+	// 丢弃流上未发出的数据并通知对端，本次连接内该流不再可用
+	void ResetStream(uint32_t stream_id);
+	// auto_window_update 为 false 时，上层处理完数据后调用，归还流控窗口
+	void Consume(uint32_t stream_id, size_t size);
+	// 流上排队未发出的字节数
+	size_t queued_size(uint32_t stream_id) const;
+
+	// TcpClientHandler
+	virtual void OnClose(int error_code) override;
+	virtual void OnConnect(int error_code) override;
+	virtual void OnReceive(int error_code, const void *data, size_t size) override;
+	virtual void OnSend(int error_code) override;
+	virtual void OnReceiveFrame(const void *frame, size_t size) override;
+	virtual void OnSendBackpressure(bool blocked) override;
+
+private:
+	struct Message
+	{
+		std::string	data;
+		size_t		offset;
+	};
+
+	struct Stream
+	{
+		Stream() : weight(1), current_weight(0), queued_size(0), send_window(0),
+			recv_window(0), unacked_consumed(0), reset(false) {}
+
+		uint32_t			weight;
+		int64_t				current_weight;	// 平滑加权轮询的当前值
+		std::deque<Message>	messages;
+		size_t				queued_size;
+		uint32_t			send_window;	// 对端还允许发送的字节数
+		uint32_t			recv_window;	// 还允许对端发送的字节数
+		uint32_t			unacked_consumed;	// 已消费但还未通过 WINDOW_UPDATE 归还的字节数
+		bool				reset;
+	};
+
+	// 需持有 lock_
+	Stream& GetStreamLocked(uint32_t stream_id);
+	void ResetWindowsLocked();
+	void PushControlLocked(uint32_t stream_id, uint8_t type, uint32_t value);
+	void ConsumeLocked(uint32_t stream_id, Stream &stream, size_t size);
+	// 需持有 lock_，取出下一帧，没有可发送的帧时返回 false
+	bool NextFrameLocked(std::string &frame);
+	// 在发送队列未阻塞时尽可能多地发出帧，多个线程同时调用时只有一个在发送
+	void Pump();
+
+	static void AppendHeader(std::string &frame, uint32_t length, uint32_t stream_id, uint8_t type, uint8_t flags);
+
+private:
+	std::shared_ptr<TcpClientSocket>	socket_;
+	StreamMuxHandler					*handler_;
+	StreamMuxOptions					options_;
+
+	mutable std::mutex					lock_;
+	std::map<uint32_t, Stream>			streams_;
+	std::deque<std::string>				control_frames_;
+	bool								connected_;
+
+	std::mutex							pump_lock_;
+	std::atomic<bool>					pump_again_;
+	std::atomic<bool>					blocked_;
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_STREAM_MUX_H__
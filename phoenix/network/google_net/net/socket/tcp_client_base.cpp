@@ -0,0 +1,266 @@
+#include "net/socket/tcp_client_base.h"
+#include "extension/memory/packet.h"
+#include "extension/memory/chained_buffer.h"
+#include "net/base/net_errors.h"
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+TcpClientBase::TcpClientBase() : handler_(nullptr), is_connected_(false)
+{
+}
+
+TcpClientBase::~TcpClientBase()
+{
+	handler_ = nullptr;
+}
+
+void TcpClientBase::SetHandler(TcpClientHandler *handler)
+{
+	handler_ = handler;
+}
+
+void TcpClientBase::SetFrameFormat(const FrameFormat& format)
+{
+	frame_decoder_.reset(new FrameDecoder(format));
+}
+
+void TcpClientBase::SetFrameCompression(const FrameCompressionOptions& options)
+{
+	if (!frame_decoder_ || !options.enabled)
+	{
+		frame_compressor_.reset();
+		return;
+	}
+	frame_compressor_.reset(new FrameCompressor(frame_decoder_->format(), options));
+}
+
+void TcpClientBase::SetSendQueue(const SendQueueOptions& options)
+{
+	std::weak_ptr<TcpClientBase> weak_this = shared_from_this();
+	auto writer = [weak_this](const SendQueue::Slice *slices, size_t count) {
+		auto tcp_client = weak_this.lock();
+		return tcp_client ? tcp_client->WriteSlices(slices, count) : SOCKET_ERROR;
+	};
+	auto backpressure = [weak_this](bool blocked) {
+		auto tcp_client = weak_this.lock();
+		if (tcp_client && tcp_client->handler_)
+			tcp_client->handler_->OnSendBackpressure(blocked);
+	};
+	send_queue_ = std::make_shared<SendQueue>(options, writer, backpressure);
+}
+
+void TcpClientBase::SetSocketOptions(const TcpSocketOptions& options)
+{
+	socket_options_ = options;
+}
+
+void TcpClientBase::SetTls(const TlsOptions& options, const std::string& session_key)
+{
+	tls_options_ = options;
+	tls_session_key_ = session_key;
+}
+
+int TcpClientBase::WriteData(const void *data, size_t size)
+{
+	auto tls = std::atomic_load(&tls_);
+	if (!tls)
+		return Write(data, size);
+	SendQueue::Slice slice = { (const char *)data, size };
+	return tls->Write(&slice, 1);
+}
+
+int TcpClientBase::WriteSlices(const SendQueue::Slice *slices, size_t count)
+{
+	auto tls = std::atomic_load(&tls_);
+	if (!tls)
+		return WriteV(slices, count);
+	//握手未完成时 TlsLayer 返回 0，数据留在队列里，握手完成后再发送
+	return tls->Write(slices, count);
+}
+
+bool TcpClientBase::Send(const std::shared_ptr<NS_EXTENSION::PackBuffer>& buffer, size_t offset)
+{
+	if (!send_queue_)
+	{
+		if (!buffer || offset >= buffer->size())
+			return true;
+		return WriteData(buffer->data() + offset, buffer->size() - offset) != SOCKET_ERROR;
+	}
+	return send_queue_->Push(buffer, offset);
+}
+
+bool TcpClientBase::Send(const NS_EXTENSION::ChainedBuffer& buffer)
+{
+	if (!send_queue_)
+	{
+		bool ret = true;
+		buffer.visit([this, &ret](const std::shared_ptr<const void> &, const char *data, size_t size) {
+			if (ret && WriteData(data, size) == SOCKET_ERROR)
+				ret = false;
+		});
+		return ret;
+	}
+	return send_queue_->Push(buffer);
+}
+
+bool TcpClientBase::Send(const void *data, size_t size)
+{
+	if (!send_queue_)
+		return WriteData(data, size) != SOCKET_ERROR;
+	return send_queue_->Push(data, size);
+}
+
+bool TcpClientBase::SendFrame(const void *frame, size_t size)
+{
+	if (!frame_compressor_)
+		return Send(frame, size);
+	std::string compressed;
+	if (!frame_compressor_->Compress(frame, size, compressed))
+		return false;
+	if (!send_queue_)
+		return WriteData(compressed.data(), compressed.size()) != SOCKET_ERROR;
+	return send_queue_->Push(std::move(compressed));
+}
+
+bool TcpClientBase::IsConnected()
+{
+	if (!is_connected_)
+		return false;
+	auto tls = std::atomic_load(&tls_);
+	return !tls || tls->IsEstablished();
+}
+
+void TcpClientBase::OnClose(int error_code)
+{
+	is_connected_ = false;
+	std::atomic_store(&tls_, std::shared_ptr<TlsLayer>());
+
+	if (handler_)
+		handler_->OnClose(error_code);
+}
+
+void TcpClientBase::OnConnect(int error_code)
+{
+	is_connected_ = (error_code == ERROR_SUCCESS);
+	if (frame_decoder_)
+		frame_decoder_->Reset();
+
+	if (is_connected_ && tls_options_.enabled)
+	{
+		OnTlsConnect();
+		return;
+	}
+
+	if (handler_)
+		handler_->OnConnect(error_code);
+
+	//发送连接建立前排队的数据
+	if (is_connected_ && send_queue_)
+		send_queue_->Flush();
+}
+
+void TcpClientBase::OnTlsConnect()
+{
+	std::weak_ptr<TcpClientBase> weak_this = shared_from_this();
+	auto writer = [weak_this](const char *data, size_t size) {
+		auto tcp_client = weak_this.lock();
+		return tcp_client ? tcp_client->Write(data, size) : SOCKET_ERROR;
+	};
+	auto tls = std::make_shared<TlsLayer>(tls_options_, tls_session_key_, writer);
+	std::atomic_store(&tls_, tls);
+	if (!tls->Start())
+	{
+		is_connected_ = false;
+		if (handler_)
+			handler_->OnConnect(net::ERR_SSL_PROTOCOL_ERROR);
+	}
+}
+
+void TcpClientBase::OnReceive(int error_code, const void *data, size_t size)
+{
+	auto tls = std::atomic_load(&tls_);
+	if (!tls)
+	{
+		DeliverReceive(error_code, data, size);
+		return;
+	}
+
+	std::string plain;
+	bool established = tls->IsEstablished();
+	TlsLayer::FeedResult result = tls->Feed(data, size, plain);
+	if (result == TlsLayer::kFeedError)
+	{
+		//握手失败按连接失败上报，已建立的连接按接收出错交由上层断开
+		if (!established)
+			is_connected_ = false;
+		if (handler_)
+		{
+			if (!established)
+				handler_->OnConnect(net::ERR_SSL_PROTOCOL_ERROR);
+			else
+				handler_->OnReceive(SOCKET_ERROR, nullptr, 0);
+		}
+		return;
+	}
+	if (result == TlsLayer::kFeedHandshakeDone)
+	{
+		if (handler_)
+			handler_->OnConnect(ERROR_SUCCESS);
+		if (send_queue_)
+			send_queue_->Flush();
+	}
+	if (!plain.empty())
+		DeliverReceive(error_code, plain.data(), plain.size());
+}
+
+void TcpClientBase::DeliverReceive(int error_code, const void *data, size_t size)
+{
+	if (!handler_)
+		return;
+
+	if (!frame_decoder_)
+	{
+		handler_->OnReceive(error_code, data, size);
+		return;
+	}
+
+	//分帧模式下完整帧直接以视图形式交给上层，只有半包才会被缓存
+	TcpClientHandler *handler = handler_;
+	bool ret = true;
+	if (!frame_compressor_)
+	{
+		ret = frame_decoder_->Feed(data, size, [handler](const void *frame, size_t frame_size) {
+			handler->OnReceiveFrame(frame, frame_size);
+		});
+	}
+	else
+	{
+		//解压失败后同一批的后续帧也不再回调
+		bool decompressed = true;
+		ret = frame_decoder_->Feed(data, size, [this, handler, &decompressed](const void *frame, size_t frame_size) {
+			if (!decompressed)
+				return;
+			decompressed = frame_compressor_->Decompress(frame, frame_size, decompressed_frame_);
+			if (decompressed)
+				handler->OnReceiveFrame(decompressed_frame_.data(), decompressed_frame_.size());
+		});
+		ret = ret && decompressed;
+	}
+	if (!ret)
+	{
+		//长度字段非法或帧无法解压，后续数据已不可信，交由上层断开连接
+		frame_decoder_->Reset();
+		handler_->OnReceive(SOCKET_ERROR, data, size);
+	}
+}
+
+void TcpClientBase::OnSend(int error_code)
+{
+	if (handler_)
+		handler_->OnSend(error_code);
+}
+
+}
+NET_END_DECLS
@@ -0,0 +1,86 @@
+#ifndef __BASE_NET_TCP_CLIENT_BASE_H__
+#define __BASE_NET_TCP_CLIENT_BASE_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "proxy_config/proxy_config/proxy_info.h"
+#include "net/socket/socket_handler.h"
+#include "net/socket/frame_decoder.h"
+#include "net/socket/frame_compressor.h"
+#include "net/socket/send_queue.h"
+#include "net/socket/tls_layer.h"
+#include "net/socket/socket_options.h"
+#include <memory>
+#include <string>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+// TCP 客户端的公共部分：回调分发、分帧接收和发送队列。
+// 具体的传输（tinyNET、libuv）由子类实现 Init/Write/WriteV/Close 等接口。
+class NET_EXPORT TcpClientBase :public std::enable_shared_from_this<TcpClientBase>
+{
+public:
+	TcpClientBase();
+
+	virtual ~TcpClientBase();
+
+	void SetHandler(TcpClientHandler *handler);
+	void SetFrameFormat(const FrameFormat& format);
+	//需在 SetFrameFormat 之后调用，之后 SendFrame 的帧逐帧压缩，收到的帧解压后再回调
+	void SetFrameCompression(const FrameCompressionOptions& options);
+	void SetSendQueue(const SendQueueOptions& options);
+	//需在 Init 之前调用
+	void SetSocketOptions(const TcpSocketOptions& options);
+	//开启 TLS，需在连接建立前调用；session_key 相同的连接共享会话票据
+	void SetTls(const TlsOptions& options, const std::string& session_key);
+	virtual void SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password) = 0;
+
+	virtual bool Init(const std::string& host, int port) = 0;
+	virtual int	Write(const void *data, size_t size) = 0;
+	//开启 TLS 时加密后写出，否则同 Write
+	int WriteData(const void *data, size_t size);
+	bool Send(const std::shared_ptr<NS_EXTENSION::PackBuffer>& buffer, size_t offset);
+	bool Send(const NS_EXTENSION::ChainedBuffer& buffer);
+	bool Send(const void *data, size_t size);
+	//发送一个完整的帧，开启了帧压缩时压缩后发送，否则同 Send
+	bool SendFrame(const void *frame, size_t size);
+	virtual int	Read(const void *data, size_t size) = 0;
+	virtual void Close() = 0;
+
+	bool IsConnected();
+	//连接建立后才能取到
+	virtual bool GetSocketInfo(TcpSocketInfo& info) = 0;
+
+protected:
+	void OnClose(int error_code);
+	void OnConnect(int error_code);
+	void OnReceive(int error_code, const void *data, size_t size);
+	void OnSend(int error_code);
+	// 发送队列的 scatter/gather 写，语义见 SendQueue::Writer
+	virtual int WriteV(const SendQueue::Slice *slices, size_t count) = 0;
+
+private:
+	int WriteSlices(const SendQueue::Slice *slices, size_t count);
+	void OnTlsConnect();
+	void DeliverReceive(int error_code, const void *data, size_t size);
+
+protected:
+	TcpClientHandler		*handler_;
+	bool					is_connected_;
+	std::unique_ptr<FrameDecoder> frame_decoder_;
+	std::unique_ptr<FrameCompressor> frame_compressor_;
+	//解压后的帧，只在接收线程使用，复用以免每帧分配
+	std::string				decompressed_frame_;
+	std::shared_ptr<SendQueue> send_queue_;
+	TcpSocketOptions		socket_options_;
+	TlsOptions				tls_options_;
+	std::string				tls_session_key_;
+	//传输层连接建立后创建，握手完成前 OnConnect 不回调给上层
+	std::shared_ptr<TlsLayer> tls_;
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_TCP_CLIENT_BASE_H__
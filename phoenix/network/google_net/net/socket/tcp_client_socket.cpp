@@ -1,8 +1,14 @@
 #include "proxy_config/proxy_config/proxy_info.h"
+#include "proxy_config/proxy_config/proxy_resolver.h"
 #include "net/socket/tcp_client_socket.h"
 
 
 #include "net/socket/socket_wrapper.h"
+#include "net/socket/uv_socket_wrapper.h"
+#include "net/socket/reliable_udp_client.h"
+#include "net/nim_ip_rule_set.h"
+#include "net/nim_net_util.h"
+#include "net/base/net_errors.h"
 
 NET_BEGIN_DECLS
 
@@ -11,9 +17,14 @@ bool TcpClientSocket::WouldBlock(bool connecting/* = false*/)
 	return would_block(connecting);
 }
 
-TcpClientSocket::TcpClientSocket()
+TcpClientSocket::TcpClientSocket(SocketBackend backend/* = kSocketBackendTinyNet*/)
 {
-	tcp_client_ = std::make_shared<internal::TcpClientImpl>();
+	if (backend == kSocketBackendUV)
+		tcp_client_ = std::make_shared<internal::UVTcpClientImpl>();
+	else if (backend == kSocketBackendReliableUDP)
+		tcp_client_ = std::make_shared<internal::ReliableUdpClientImpl>();
+	else
+		tcp_client_ = std::make_shared<internal::TcpClientImpl>();
 }
 void TcpClientSocket::RegisterCallback(TcpClientHandler *handler)
 {
@@ -34,6 +45,30 @@ bool TcpClientSocket::Init(const std::string& host, int port)
 	if (!tcp_client_)
 		return false;
 
+	if (proxy_.IsSystem())
+	{
+		//系统代理按目标解析，结果有缓存，PAC 只在缓存过期后才重新执行
+		std::string address = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+		ProxyInfo proxy = NimProxyResolver::GetInstance()->ResolveSync("https://" + address + ":" + std::to_string(port) + "/");
+		if (proxy.Valid())
+			tcp_client_->SetProxy(proxy.type_, proxy.host_, proxy.port_, proxy.user_, proxy.password_);
+		else
+			tcp_client_->SetProxy(kProxyNone, std::string(), 0, std::string(), std::string());
+	}
+	else if (proxy_bypass_ != nullptr)
+	{
+		if (ShouldBypassProxy(host))
+			tcp_client_->SetProxy(kProxyNone, std::string(), 0, std::string(), std::string());
+		else
+			tcp_client_->SetProxy(proxy_.type_, proxy_.host_, proxy_.port_, proxy_.user_, proxy_.password_);
+	}
+	if (tls_options_.enabled)
+	{
+		TlsOptions options = tls_options_;
+		if (options.server_name.empty())
+			options.server_name = host;
+		tcp_client_->SetTls(options, options.server_name + ":" + std::to_string(port));
+	}
 	return tcp_client_->Init(host, port);
 }
 void TcpClientSocket::SetProxy(const ProxyInfo* proxyinfo)
@@ -42,7 +77,71 @@ void TcpClientSocket::SetProxy(const ProxyInfo* proxyinfo)
 	{
 		return;
 	}
-	tcp_client_->SetProxy(proxyinfo->type_,proxyinfo->host_,proxyinfo->port_,proxyinfo->user_,proxyinfo->password_);
+	//系统代理在 Init 时按目标解析
+	if (proxyinfo->IsSystem())
+		tcp_client_->SetProxy(kProxyNone, std::string(), 0, std::string(), std::string());
+	else
+		tcp_client_->SetProxy(proxyinfo->type_,proxyinfo->host_,proxyinfo->port_,proxyinfo->user_,proxyinfo->password_);
+	//例外列表按文本缓存编译结果，大量连接共用同一份
+	proxy_ = *proxyinfo;
+	proxy_bypass_ = nullptr;
+	if (proxyinfo->Valid() && !proxyinfo->bypass_list_.empty())
+	{
+		proxy_bypass_ = NimIPRuleSet::GetCompiled(proxyinfo->bypass_list_);
+		if (proxy_bypass_->empty())
+			proxy_bypass_ = nullptr;
+	}
+}
+bool TcpClientSocket::ShouldBypassProxy(const std::string& host) const
+{
+	net::AddressFamily addr_family;
+	if (NimNetUtil::GetAddressFamily(host, addr_family))
+		return proxy_bypass_->Match(host);
+
+	//解析失败时仍走代理，内网域名可能只有代理能解析
+	std::list<std::string> ip_list;
+	if (NimNetUtil::GetIPByName(host, ip_list) != net::OK)
+		return false;
+	for (auto& ip : ip_list)
+	{
+		if (proxy_bypass_->Match(ip))
+			return true;
+	}
+	return false;
+}
+void TcpClientSocket::SetFrameFormat(const FrameFormat& format)
+{
+	if (!tcp_client_)
+		return;
+	tcp_client_->SetFrameFormat(format);
+}
+void TcpClientSocket::SetFrameCompression(const FrameCompressionOptions& options)
+{
+	if (!tcp_client_)
+		return;
+	tcp_client_->SetFrameCompression(options);
+}
+void TcpClientSocket::SetSendQueue(const SendQueueOptions& options)
+{
+	if (!tcp_client_)
+		return;
+	tcp_client_->SetSendQueue(options);
+}
+void TcpClientSocket::SetTls(const TlsOptions& options)
+{
+	tls_options_ = options;
+}
+void TcpClientSocket::SetSocketOptions(const TcpSocketOptions& options)
+{
+	if (!tcp_client_)
+		return;
+	tcp_client_->SetSocketOptions(options);
+}
+bool TcpClientSocket::GetSocketInfo(TcpSocketInfo& info)
+{
+	if (!tcp_client_)
+		return false;
+	return tcp_client_->GetSocketInfo(info);
 }
 int	TcpClientSocket::Read(const void *data, size_t size)
 {
@@ -55,7 +154,35 @@ int	TcpClientSocket::Write(const void *data, size_t size)
 {
 	if (!tcp_client_)
 		return -1;
-	return tcp_client_->Write(data, size);
+	return tcp_client_->WriteData(data, size);
+}
+
+bool TcpClientSocket::Send(const std::shared_ptr<NS_EXTENSION::PackBuffer>& buffer, size_t offset/* = 0*/)
+{
+	if (!tcp_client_)
+		return false;
+	return tcp_client_->Send(buffer, offset);
+}
+
+bool TcpClientSocket::Send(const NS_EXTENSION::ChainedBuffer& buffer)
+{
+	if (!tcp_client_)
+		return false;
+	return tcp_client_->Send(buffer);
+}
+
+bool TcpClientSocket::Send(const void *data, size_t size)
+{
+	if (!tcp_client_)
+		return false;
+	return tcp_client_->Send(data, size);
+}
+
+bool TcpClientSocket::SendFrame(const void *frame, size_t size)
+{
+	if (!tcp_client_)
+		return false;
+	return tcp_client_->SendFrame(frame, size);
 }
 
 void TcpClientSocket::Close()
@@ -3,6 +3,11 @@
 
 #include "proxy_config/proxy_config/proxy_info.h"
 #include "net/socket/socket_handler.h"
+#include "net/socket/frame_decoder.h"
+#include "net/socket/frame_compressor.h"
+#include "net/socket/send_queue.h"
+#include "net/socket/tls_layer.h"
+#include "net/socket/socket_options.h"
 #include <string>
 #include <memory>
 
@@ -10,25 +15,62 @@ NET_BEGIN_DECLS
 
 namespace internal
 {
-	class TcpClientImpl;
+	class TcpClientBase;
 }
+class NimIPRuleSet;
+
+enum SocketBackend
+{
+	kSocketBackendTinyNet = 0,	//每个连接一个 tinyNET 传输线程，支持代理
+	kSocketBackendUV,			//多个连接复用 UVLoopPool 的 libuv 事件循环，不支持代理
+	kSocketBackendReliableUDP,	//UDP 上的可靠传输（ReliableUdpSession），丢包时尾延迟低于 TCP，需服务器支持，不支持代理
+};
+
 class NET_EXPORT TcpClientSocket
 {
 public:
-	TcpClientSocket();
+	explicit TcpClientSocket(SocketBackend backend = kSocketBackendTinyNet);
 	virtual ~TcpClientSocket(){}
 
 	static bool WouldBlock(bool connecting = false);
 	void RegisterCallback(TcpClientHandler *handler);
 	void UnregisterCallback();
 	bool Init(const std::string& host, int port);
+	//proxyinfo 的 bypass_list_ 在 Init 时匹配目标地址，命中则直连
+	//类型为 kProxySystem 时在 Init 时由 NimProxyResolver 按目标解析，系统设置已包含例外列表
 	void SetProxy(const ProxyInfo* proxyinfo);
+	//开启长度前缀分帧，需在 Init 之前调用，之后数据通过 TcpClientHandler::OnReceiveFrame 回调
+	void SetFrameFormat(const FrameFormat& format);
+	//开启逐帧压缩，需在 SetFrameFormat 之后、Init 之前调用；压缩只作用于 SendFrame 发送的帧
+	void SetFrameCompression(const FrameCompressionOptions& options);
+	//开启发送队列，Send 的数据会合并后用 scatter/gather 写发送，积压通过 TcpClientHandler::OnSendBackpressure 通知
+	void SetSendQueue(const SendQueueOptions& options);
+	//开启 TLS，需在 Init 之前调用；连接建立且握手完成后才回调 OnConnect，收发的都是明文。
+	//同一 host:port 的重连恢复之前的会话，省去完整握手
+	void SetTls(const TlsOptions& options);
+	//设置 TCP_NODELAY、缓冲区、keepalive 等选项，需在 Init 之前调用
+	void SetSocketOptions(const TcpSocketOptions& options);
+	//取内核统计的 RTT、拥塞窗口等，连接建立后可用，平台不支持时返回 false
+	bool GetSocketInfo(TcpSocketInfo& info);
 	int	Read(const void *data, size_t size);
 	int	Write(const void *data, size_t size);
+	//未开启发送队列时等同于 Write；buffer 在发送完成前会被持有，不做拷贝
+	bool Send(const std::shared_ptr<NS_EXTENSION::PackBuffer>& buffer, size_t offset = 0);
+	//buffer 的段被引用计数共享，调用后可以继续修改或释放 buffer
+	bool Send(const NS_EXTENSION::ChainedBuffer& buffer);
+	bool Send(const void *data, size_t size);
+	//frame 是一个完整的帧（含帧头），开启了帧压缩时压缩后发送
+	bool SendFrame(const void *frame, size_t size);
 	void Close();
 
 private:
-	std::shared_ptr<internal::TcpClientImpl> tcp_client_;
+	//host 为 IP 字面量时直接匹配，域名按解析到的地址匹配
+	bool ShouldBypassProxy(const std::string& host) const;
+
+	std::shared_ptr<internal::TcpClientBase> tcp_client_;
+	ProxyInfo proxy_;
+	TlsOptions tls_options_;
+	std::shared_ptr<const NimIPRuleSet> proxy_bypass_;
 
 };
 NET_END_DECLS
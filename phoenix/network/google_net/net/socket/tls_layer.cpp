@@ -0,0 +1,373 @@
+#include "net/socket/tls_layer.h"
+#include "net/socket/socket_handler.h"
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <map>
+#include <memory>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+namespace
+{
+const size_t kBioBufferSize = 64 * 1024;
+const size_t kMaxCachedSessions = 64;
+
+// SSL_CTX 按根证书和是否校验在进程内共享，从不释放，已建立的连接可能还在使用
+SSL_CTX* GetContext(const TlsOptions& options, int (*new_session_cb)(SSL*, SSL_SESSION*))
+{
+	static std::mutex lock;
+	static std::map<std::string, SSL_CTX*> contexts;
+
+	std::string key = (options.verify_peer ? "1" : "0") + options.ca_file;
+	std::lock_guard<std::mutex> auto_lock(lock);
+	auto it = contexts.find(key);
+	if (it != contexts.end())
+		return it->second;
+
+	SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+	if (ctx == nullptr)
+		return nullptr;
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_RELEASE_BUFFERS);
+	if (options.verify_peer)
+	{
+		bool loaded = options.ca_file.empty() ?
+			SSL_CTX_set_default_verify_paths(ctx) == 1 :
+			SSL_CTX_load_verify_locations(ctx, options.ca_file.c_str(), nullptr) == 1;
+		if (!loaded)
+		{
+			SSL_CTX_free(ctx);
+			return nullptr;
+		}
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+	}
+	//会话由下面的缓存按 host:port 管理，OpenSSL 客户端侧不查内部缓存
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+	contexts[key] = ctx;
+	return ctx;
+}
+
+// 缓存的会话，每个 key 只保留最新的一个票据
+class SessionCache
+{
+public:
+	static SessionCache* GetInstance()
+	{
+		static SessionCache* instance = new SessionCache;
+		return instance;
+	}
+
+	// 返回的会话带一个引用
+	SSL_SESSION* Get(const std::string& key)
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		auto it = sessions_.find(key);
+		if (it == sessions_.end())
+			return nullptr;
+		SSL_SESSION_up_ref(it->second);
+		return it->second;
+	}
+
+	// 接管 session 的引用
+	void Put(const std::string& key, SSL_SESSION *session)
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		auto it = sessions_.find(key);
+		if (it != sessions_.end())
+		{
+			SSL_SESSION_free(it->second);
+			sessions_.erase(it);
+		}
+		//连接的服务器通常只有几个，满了随意淘汰一个即可
+		if (sessions_.size() >= kMaxCachedSessions)
+		{
+			SSL_SESSION_free(sessions_.begin()->second);
+			sessions_.erase(sessions_.begin());
+		}
+		sessions_[key] = session;
+	}
+
+	void Remove(const std::string& key)
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		auto it = sessions_.find(key);
+		if (it == sessions_.end())
+			return;
+		SSL_SESSION_free(it->second);
+		sessions_.erase(it);
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> auto_lock(lock_);
+		for (auto& item : sessions_)
+			SSL_SESSION_free(item.second);
+		sessions_.clear();
+	}
+
+private:
+	std::mutex lock_;
+	std::map<std::string, SSL_SESSION*> sessions_;
+};
+}
+
+TlsLayer::TlsLayer(const TlsOptions& options, const std::string& session_key, const TransportWriter& writer)
+	: writer_(writer)
+	, session_key_(session_key)
+	, ssl_(nullptr)
+	, network_bio_(nullptr)
+	, established_(false)
+	, failed_(false)
+{
+	SSL_CTX *ctx = GetContext(options, &TlsLayer::OnNewSession);
+	if (ctx == nullptr)
+		return;
+	ssl_ = SSL_new(ctx);
+	if (ssl_ == nullptr)
+		return;
+	SSL_set_app_data(ssl_, this);
+
+	BIO *internal_bio = nullptr;
+	if (BIO_new_bio_pair(&internal_bio, kBioBufferSize, &network_bio_, kBioBufferSize) != 1)
+	{
+		SSL_free(ssl_);
+		ssl_ = nullptr;
+		network_bio_ = nullptr;
+		return;
+	}
+	SSL_set_bio(ssl_, internal_bio, internal_bio);
+	SSL_set_connect_state(ssl_);
+
+	//IP 字面量校验证书里的 IP，不发送 SNI
+	X509_VERIFY_PARAM *param = SSL_get0_param(ssl_);
+	if (X509_VERIFY_PARAM_set1_ip_asc(param, options.server_name.c_str()) != 1)
+	{
+		SSL_set_tlsext_host_name(ssl_, options.server_name.c_str());
+		if (options.verify_peer)
+		{
+			X509_VERIFY_PARAM_set_hostflags(param, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+			X509_VERIFY_PARAM_set1_host(param, options.server_name.c_str(), 0);
+		}
+	}
+
+	SSL_SESSION *session = SessionCache::GetInstance()->Get(session_key_);
+	if (session != nullptr)
+	{
+		SSL_set_session(ssl_, session);
+		SSL_SESSION_free(session);
+	}
+}
+
+TlsLayer::~TlsLayer()
+{
+	if (network_bio_ != nullptr)
+		BIO_free(network_bio_);
+	if (ssl_ != nullptr)
+	{
+		//连接多是直接断开的，未经 SSL_shutdown 释放时 OpenSSL 会把会话标记为不可恢复
+		if (established_ && !failed_)
+			SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		SSL_free(ssl_);
+	}
+}
+
+bool TlsLayer::Start()
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	if (ssl_ == nullptr)
+	{
+		failed_ = true;
+		return false;
+	}
+	bool done = false;
+	return DriveHandshakeLocked(done) && FlushLocked();
+}
+
+TlsLayer::FeedResult TlsLayer::Feed(const void *data, size_t size, std::string& plain)
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	if (failed_ || ssl_ == nullptr)
+		return kFeedError;
+
+	FeedResult result = kFeedOk;
+	const char *input = (const char *)data;
+	size_t offset = 0;
+	char buffer[16 * 1024];
+	do
+	{
+		//内存 BIO 的容量有限，大块输入分几次写入，每次把能解的记录全部解完
+		if (offset < size)
+		{
+			int written = BIO_write(network_bio_, input + offset, (int)(size - offset));
+			if (written <= 0)
+			{
+				failed_ = true;
+				return kFeedError;
+			}
+			offset += (size_t)written;
+		}
+		if (!established_)
+		{
+			bool done = false;
+			if (!DriveHandshakeLocked(done))
+				return kFeedError;
+			if (done)
+				result = kFeedHandshakeDone;
+		}
+		if (established_)
+		{
+			int n = 0;
+			while ((n = SSL_read(ssl_, buffer, sizeof(buffer))) > 0)
+				plain.append(buffer, (size_t)n);
+			int error = SSL_get_error(ssl_, n);
+			//close_notify 也按出错处理，上层随后会收到连接关闭
+			if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+			{
+				failed_ = true;
+				ERR_clear_error();
+				return kFeedError;
+			}
+			//TLS 1.3 的 NewSessionTicket 等握手后消息可能产生待发送的数据
+			MovePendingLocked();
+		}
+	} while (offset < size);
+
+	if (!FlushLocked())
+		return kFeedError;
+	return result;
+}
+
+int TlsLayer::Write(const SendQueue::Slice *slices, size_t count)
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	if (failed_ || ssl_ == nullptr)
+		return SOCKET_ERROR;
+	if (!established_)
+		return 0;
+	if (!FlushLocked())
+		return SOCKET_ERROR;
+	//上次的密文还没发完时不再加密新数据，避免密文无限堆积
+	if (!pending_out_.empty())
+		return 0;
+
+	size_t accepted = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const char *data = slices[i].data;
+		size_t remaining = slices[i].size;
+		while (remaining > 0)
+		{
+			int n = SSL_write(ssl_, data, (int)remaining);
+			if (n <= 0)
+			{
+				int error = SSL_get_error(ssl_, n);
+				if (error == SSL_ERROR_WANT_WRITE)
+				{
+					//BIO 满了，取出密文后继续加密
+					MovePendingLocked();
+					continue;
+				}
+				failed_ = true;
+				ERR_clear_error();
+				return SOCKET_ERROR;
+			}
+			data += n;
+			remaining -= (size_t)n;
+			accepted += (size_t)n;
+			MovePendingLocked();
+		}
+	}
+	//明文已经加密进 pending_out_，传输层暂时写不下的部分由下次 Write 或 Feed 发出
+	if (!FlushLocked())
+		return SOCKET_ERROR;
+	return (int)accepted;
+}
+
+bool TlsLayer::IsEstablished()
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return established_;
+}
+
+bool TlsLayer::IsResumed()
+{
+	std::lock_guard<std::mutex> auto_lock(lock_);
+	return established_ && SSL_session_reused(ssl_) == 1;
+}
+
+void TlsLayer::ClearSessionCache()
+{
+	SessionCache::GetInstance()->Clear();
+}
+
+bool TlsLayer::DriveHandshakeLocked(bool& done)
+{
+	done = false;
+	int ret = SSL_do_handshake(ssl_);
+	MovePendingLocked();
+	if (ret == 1)
+	{
+		established_ = true;
+		done = true;
+		return true;
+	}
+	int error = SSL_get_error(ssl_, ret);
+	if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+		return true;
+	//缓存的会话可能已被服务器拒绝或证书已变化，下次重新完整握手
+	failed_ = true;
+	ERR_clear_error();
+	SessionCache::GetInstance()->Remove(session_key_);
+	return false;
+}
+
+bool TlsLayer::FlushLocked()
+{
+	while (!pending_out_.empty())
+	{
+		int n = writer_(pending_out_.data(), pending_out_.size());
+		if (n == SOCKET_ERROR)
+		{
+			failed_ = true;
+			return false;
+		}
+		if (n == 0)
+			break;
+		pending_out_.erase(0, (size_t)n);
+	}
+	return true;
+}
+
+void TlsLayer::MovePendingLocked()
+{
+	size_t pending = 0;
+	while ((pending = BIO_ctrl_pending(network_bio_)) > 0)
+	{
+		size_t old_size = pending_out_.size();
+		pending_out_.resize(old_size + pending);
+		int n = BIO_read(network_bio_, &pending_out_[old_size], (int)pending);
+		pending_out_.resize(old_size + (n > 0 ? (size_t)n : 0));
+		if (n <= 0)
+			break;
+	}
+}
+
+int TlsLayer::OnNewSession(SSL *ssl, SSL_SESSION *session)
+{
+	TlsLayer *layer = (TlsLayer *)SSL_get_app_data(ssl);
+	if (layer == nullptr || layer->session_key_.empty())
+		return 0;
+	//返回 1 表示接管 session 的引用
+	SessionCache::GetInstance()->Put(layer->session_key_, session);
+	return 1;
+}
+
+}
+NET_END_DECLS
@@ -0,0 +1,86 @@
+#ifndef __BASE_NET_TLS_LAYER_H__
+#define __BASE_NET_TLS_LAYER_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "net/socket/send_queue.h"
+#include <functional>
+#include <mutex>
+#include <string>
+
+struct ssl_st;
+struct bio_st;
+struct ssl_session_st;
+
+NET_BEGIN_DECLS
+
+struct NET_EXPORT TlsOptions
+{
+	TlsOptions() : enabled(false), verify_peer(true) {}
+
+	bool		enabled;
+	std::string	server_name;	// SNI 和证书校验的主机名，为空时使用 Init 的 host
+	std::string	ca_file;		// 为空时使用系统默认的根证书路径
+	bool		verify_peer;
+};
+
+namespace internal{
+
+// TCP 之上的 TLS 客户端，用内存 BIO 与传输层解耦，tinyNET 和 libuv 实现共用。
+// 优先协商 TLS 1.3（OpenSSL 1.1.1 及以上），否则为 TLS 1.2。
+// 会话票据按 session_key（host:port）在进程内缓存，断线重连时恢复会话，省去证书校验和
+// 非对称运算。未启用 0-RTT：长连接建连后的首包是登录等不可重放的请求。
+// 所有方法可在任意线程调用，内部以锁串行化；transport 写出时也持有锁，保证记录顺序。
+class NET_EXPORT TlsLayer
+{
+public:
+	// 语义同 SendQueue::Writer：返回写出的字节数，would block 时返回 0，出错时返回 SOCKET_ERROR
+	typedef std::function<int(const char *data, size_t size)> TransportWriter;
+
+	enum FeedResult
+	{
+		kFeedOk,
+		kFeedHandshakeDone,		// 本次输入完成了握手
+		kFeedError,
+	};
+
+	TlsLayer(const TlsOptions& options, const std::string& session_key, const TransportWriter& writer);
+	~TlsLayer();
+
+	// 发出 ClientHello，传输层连接建立后调用
+	bool Start();
+	// 输入收到的密文，解出的明文追加到 plain
+	FeedResult Feed(const void *data, size_t size, std::string& plain);
+	// 加密并写出，返回接收的明文字节数；之前的密文还未写完时返回 0，调用方稍后重试
+	int Write(const SendQueue::Slice *slices, size_t count);
+	bool IsEstablished();
+	// 握手是否恢复了缓存的会话
+	bool IsResumed();
+
+	// 丢弃缓存的全部会话，如网络切换后服务器可能不同
+	static void ClearSessionCache();
+
+private:
+	// 需持有 lock_
+	bool DriveHandshakeLocked(bool& done);
+	bool FlushLocked();
+	void MovePendingLocked();
+
+	static int OnNewSession(ssl_st *ssl, ssl_session_st *session);
+
+	TransportWriter		writer_;
+	std::string			session_key_;
+	std::mutex			lock_;
+	ssl_st				*ssl_;
+	bio_st				*network_bio_;		// 密文的内存 BIO，ssl_ 持有另一端
+	std::string			pending_out_;		// 传输层还未接收的密文
+	bool				established_;
+	bool				failed_;
+
+	TlsLayer(const TlsLayer&);
+	TlsLayer& operator=(const TlsLayer&);
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_TLS_LAYER_H__
@@ -0,0 +1,120 @@
+#include "net/socket/uv_loop_host.h"
+#include "libuv/uv.h"
+#include "extension/thread/background_thread.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+namespace {
+
+// 内部创建的事件循环线程，由 BackgroundThread 启动
+class UVLoopThread : public UVLoopHost
+{
+public:
+	UVLoopThread()
+	{
+		uv_loop_init(&loop_);
+		uv_async_init(&loop_, &async_, &UVLoopThread::OnAsync);
+		async_.data = this;
+		NS_EXTENSION::BackgroundThread::Start("uv_loop_host", [this]() { Run(); });
+	}
+
+	virtual uv_loop_t* loop() override
+	{
+		return &loop_;
+	}
+
+	virtual void PostTask(const std::function<void()> &task) override
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			tasks_.push_back(task);
+		}
+		uv_async_send(&async_);
+	}
+
+	virtual bool RunsTasksOnCurrentThread() override
+	{
+		return std::this_thread::get_id() == thread_id_;
+	}
+
+private:
+	void Run()
+	{
+		thread_id_ = std::this_thread::get_id();
+		uv_run(&loop_, UV_RUN_DEFAULT);
+	}
+
+	static void OnAsync(uv_async_t *handle)
+	{
+		UVLoopThread *self = (UVLoopThread *)handle->data;
+		std::vector<std::function<void()>> tasks;
+		{
+			std::lock_guard<std::mutex> guard(self->lock_);
+			tasks.swap(self->tasks_);
+		}
+		for (auto &task : tasks)
+			task();
+	}
+
+private:
+	uv_loop_t loop_;
+	uv_async_t async_;
+	//线程启动前为空，不在循环线程上的调用都返回 false
+	std::atomic<std::thread::id> thread_id_;
+	std::mutex lock_;
+	std::vector<std::function<void()>> tasks_;
+};
+
+struct UVLoopPoolState
+{
+	UVLoopPoolState() : thread_count(2), next(0) {}
+
+	std::mutex lock;
+	size_t thread_count;
+	std::atomic<size_t> next;
+	std::vector<std::shared_ptr<UVLoopHost>> hosts;
+	std::shared_ptr<UVLoopHost> external_host;
+};
+
+UVLoopPoolState* GetPoolState()
+{
+	static UVLoopPoolState *state = new UVLoopPoolState;
+	return state;
+}
+
+}
+
+void UVLoopPool::SetThreadCount(size_t count)
+{
+	auto state = GetPoolState();
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->thread_count = count > 0 ? count : 1;
+}
+
+void UVLoopPool::SetExternalHost(const std::shared_ptr<UVLoopHost> &host)
+{
+	auto state = GetPoolState();
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->external_host = host;
+}
+
+std::shared_ptr<UVLoopHost> UVLoopPool::Pick()
+{
+	auto state = GetPoolState();
+	std::lock_guard<std::mutex> guard(state->lock);
+	if (state->external_host)
+		return state->external_host;
+
+	if (state->hosts.empty())
+	{
+		for (size_t i = 0; i < state->thread_count; i++)
+			state->hosts.push_back(std::make_shared<UVLoopThread>());
+	}
+	return state->hosts[state->next++ % state->hosts.size()];
+}
+
+NET_END_DECLS
@@ -0,0 +1,44 @@
+#ifndef __BASE_NET_UV_LOOP_HOST_H__
+#define __BASE_NET_UV_LOOP_HOST_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+struct uv_loop_s;
+typedef struct uv_loop_s uv_loop_t;
+
+NET_BEGIN_DECLS
+
+// 运行 libuv 事件循环的线程
+// libuv 不是线程安全的，所有 uv_* 调用都要经 PostTask 投递到循环线程上执行。
+// 默认由 UVLoopPool 创建少量线程复用；已有 libuv 循环（如 nim_http 的
+// MessagePumpForUV）的模块可以实现该接口并通过 UVLoopPool::SetExternalHost
+// 接入，让 socket 与 HTTP 共用同一个事件循环。
+class NET_EXPORT UVLoopHost
+{
+public:
+	virtual ~UVLoopHost() {}
+
+	// 只能在循环线程上使用
+	virtual uv_loop_t* loop() = 0;
+	// 可在任意线程调用，task 在循环线程上按投递顺序执行
+	virtual void PostTask(const std::function<void()> &task) = 0;
+	virtual bool RunsTasksOnCurrentThread() = 0;
+};
+
+class NET_EXPORT UVLoopPool
+{
+public:
+	// 需在第一次 Pick 之前调用，默认 2 个线程
+	static void SetThreadCount(size_t count);
+	// 设置后所有新连接都使用 host，不再创建内部线程
+	static void SetExternalHost(const std::shared_ptr<UVLoopHost> &host);
+	// 按轮转方式为新连接挑选一个事件循环
+	static std::shared_ptr<UVLoopHost> Pick();
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_UV_LOOP_HOST_H__
@@ -0,0 +1,593 @@
+#include "net/socket/uv_socket_wrapper.h"
+#include "net/socket/socket_options.h"
+#include "libuv/uv.h"
+#include "base/trace_event/trace_event.h"
+#include <string.h>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+static const size_t kUVReadBufferSize = 64 * 1024;
+
+static bool ResolveHost(uv_loop_t *loop, uv_getaddrinfo_t *req, uv_getaddrinfo_cb callback, const std::string &host, int port, int socktype)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socktype;
+	std::string service = std::to_string(port);
+	return uv_getaddrinfo(loop, req, callback, host.c_str(), service.c_str(), &hints) == 0;
+}
+
+// 连接在循环线程上的状态，UVTcpClientImpl 只通过 PostTask 访问它。
+// 句柄打开期间通过 self_ 保活，OnClosed 时释放，因此 UVTcpClientImpl 可以先于它析构。
+class UVTcpConnection : public std::enable_shared_from_this<UVTcpConnection>
+{
+public:
+	UVTcpConnection(const std::weak_ptr<UVTcpClientImpl> &owner, const TcpSocketOptions &options)
+		: owner_(owner), options_(options), tcp_(nullptr), closing_(false), connected_(false)
+	{
+	}
+
+	void Connect(uv_loop_t *loop, const std::string &host, int port)
+	{
+		TRACE_EVENT_ASYNC_BEGIN2("nim.net", "UVTcpConnection::Connect", this, "host", TRACE_STR_COPY(host.c_str()), "port", port);
+		ResolveRequest *req = new ResolveRequest;
+		req->connection = shared_from_this();
+		if (!ResolveHost(loop, &req->req, &UVTcpConnection::OnResolved, host, port, SOCK_STREAM))
+		{
+			delete req;
+			NotifyConnect(UV_EINVAL);
+		}
+	}
+
+	void Write(const char *data, size_t size)
+	{
+		if (closing_)
+			return;
+		if (!connected_)
+		{
+			pending_.append(data, size);
+			return;
+		}
+
+		// 先尝试直接写，发送缓冲区满时才拷贝剩余部分交给 uv_write
+		uv_buf_t buf = uv_buf_init((char *)data, (unsigned int)size);
+		int n = uv_try_write((uv_stream_t *)tcp_, &buf, 1);
+		if (n == UV_EAGAIN)
+			n = 0;
+		if (n < 0 || (size_t)n == size)
+			return;
+
+		WriteRequest *req = new WriteRequest;
+		req->data.assign(data + n, size - n);
+		buf = uv_buf_init(&req->data[0], (unsigned int)req->data.size());
+		if (uv_write(&req->req, (uv_stream_t *)tcp_, &buf, 1, &UVTcpConnection::OnWritten) != 0)
+			delete req;
+	}
+
+	int TryWrite(const SendQueue::Slice *slices, size_t count)
+	{
+		if (closing_)
+			return SOCKET_ERROR;
+		if (!connected_ || !pending_.empty())
+			return 0;
+
+		uv_buf_t bufs[64];
+		unsigned int buf_count = 0;
+		for (; buf_count < count && buf_count < 64; buf_count++)
+			bufs[buf_count] = uv_buf_init((char *)slices[buf_count].data, (unsigned int)slices[buf_count].size);
+		int n = uv_try_write((uv_stream_t *)tcp_, bufs, buf_count);
+		if (n == UV_EAGAIN || n == UV_ENOSYS)
+			return 0;
+		return n < 0 ? SOCKET_ERROR : n;
+	}
+
+	void Close()
+	{
+		if (closing_)
+			return;
+		closing_ = true;
+		if (tcp_ && !uv_is_closing((uv_handle_t *)tcp_))
+			uv_close((uv_handle_t *)tcp_, &UVTcpConnection::OnClosed);
+	}
+
+private:
+	struct ResolveRequest
+	{
+		uv_getaddrinfo_t req;
+		std::shared_ptr<UVTcpConnection> connection;
+	};
+
+	struct WriteRequest
+	{
+		uv_write_t req;
+		std::string data;
+	};
+
+	static void OnResolved(uv_getaddrinfo_t *req, int status, struct addrinfo *res)
+	{
+		ResolveRequest *resolve = (ResolveRequest *)req;
+		std::shared_ptr<UVTcpConnection> self = resolve->connection;
+		uv_loop_t *loop = req->loop;
+		delete resolve;
+
+		if (status != 0 || res == nullptr || self->closing_)
+		{
+			if (res)
+				uv_freeaddrinfo(res);
+			if (!self->closing_)
+				self->NotifyConnect(status != 0 ? status : UV_EAI_NONAME);
+			else
+				self->TraceConnectEnd(UV_ECANCELED);
+			return;
+		}
+		TRACE_EVENT_ASYNC_STEP_INTO0("nim.net", "UVTcpConnection::Connect", self.get(), "tcp_connect");
+
+		self->tcp_ = new uv_tcp_t;
+		//按地址族先创建 socket，在 SYN 发出前设置选项，接收缓冲区才能参与窗口扩大因子的协商
+		if (uv_tcp_init_ex(loop, self->tcp_, res->ai_family) != 0)
+			uv_tcp_init(loop, self->tcp_);
+		self->tcp_->data = self.get();
+		self->self_ = self;
+		uv_tcp_nodelay(self->tcp_, 1);
+		self->ApplyOptions();
+
+		uv_connect_t *connect_req = new uv_connect_t;
+		int r = uv_tcp_connect(connect_req, self->tcp_, res->ai_addr, &UVTcpConnection::OnConnected);
+		uv_freeaddrinfo(res);
+		if (r != 0)
+		{
+			delete connect_req;
+			self->NotifyConnect(r);
+			self->Close();
+		}
+	}
+
+	static void OnConnected(uv_connect_t *req, int status)
+	{
+		UVTcpConnection *self = (UVTcpConnection *)req->handle->data;
+		delete req;
+		if (self->closing_)
+		{
+			self->TraceConnectEnd(UV_ECANCELED);
+			return;
+		}
+		if (status != 0)
+		{
+			self->NotifyConnect(status);
+			self->Close();
+			return;
+		}
+
+		self->connected_ = true;
+		self->read_buffer_.resize(kUVReadBufferSize);
+		uv_read_start((uv_stream_t *)self->tcp_, &UVTcpConnection::OnAlloc, &UVTcpConnection::OnRead);
+		if (!self->pending_.empty())
+		{
+			std::string pending;
+			pending.swap(self->pending_);
+			self->Write(pending.data(), pending.size());
+		}
+		self->NotifyConnect(ERROR_SUCCESS);
+	}
+
+	static void OnAlloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+	{
+		UVTcpConnection *self = (UVTcpConnection *)handle->data;
+		*buf = uv_buf_init(&self->read_buffer_[0], (unsigned int)self->read_buffer_.size());
+	}
+
+	static void OnRead(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+	{
+		UVTcpConnection *self = (UVTcpConnection *)stream->data;
+		if (self->closing_)
+			return;
+		if (nread > 0)
+		{
+			auto owner = self->owner_.lock();
+			if (owner)
+				owner->OnReceive(NO_ERROR, buf->base, (size_t)nread);
+		}
+		else if (nread < 0)
+		{
+			auto owner = self->owner_.lock();
+			self->Close();
+			if (owner)
+				owner->OnClose(NO_ERROR);
+		}
+	}
+
+	static void OnWritten(uv_write_t *req, int status)
+	{
+		delete (WriteRequest *)req;
+	}
+
+	static void OnClosed(uv_handle_t *handle)
+	{
+		UVTcpConnection *self = (UVTcpConnection *)handle->data;
+		delete (uv_tcp_t *)handle;
+		self->tcp_ = nullptr;
+		self->self_.reset();
+	}
+
+	void ApplyOptions()
+	{
+		uv_os_fd_t fd;
+		if (uv_fileno((uv_handle_t *)tcp_, &fd) != 0)
+			return;
+		NativeSocket socket = (NativeSocket)(uintptr_t)fd;
+		ApplyTcpSocketOptions(socket, options_);
+		auto owner = owner_.lock();
+		if (owner)
+			owner->native_socket_ = socket;
+	}
+
+	// 解析和连接两个阶段在 trace 中是同一个异步事件
+	void TraceConnectEnd(int error_code)
+	{
+		TRACE_EVENT_ASYNC_END1("nim.net", "UVTcpConnection::Connect", this, "error", error_code);
+	}
+
+	void NotifyConnect(int error_code)
+	{
+		TraceConnectEnd(error_code);
+		auto owner = owner_.lock();
+		if (owner)
+			owner->OnConnect(error_code);
+	}
+
+private:
+	std::weak_ptr<UVTcpClientImpl>		owner_;
+	TcpSocketOptions					options_;
+	uv_tcp_t							*tcp_;
+	bool								closing_;
+	bool								connected_;
+	std::string							pending_;		// 连接建立前写入的数据
+	std::vector<char>					read_buffer_;
+	std::shared_ptr<UVTcpConnection>	self_;
+};
+
+UVTcpClientImpl::UVTcpClientImpl() : native_socket_((NativeSocket)-1)
+{
+}
+
+UVTcpClientImpl::~UVTcpClientImpl()
+{
+	Close();
+	handler_ = nullptr;
+}
+
+void UVTcpClientImpl::SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password)
+{
+	proxyinfo_.host_ = host;
+	proxyinfo_.port_ = port;
+	proxyinfo_.user_ = user;
+	proxyinfo_.password_ = password;
+	proxyinfo_.type_ = type;
+}
+
+bool UVTcpClientImpl::Init(const std::string& host, int port)
+{
+	if (proxyinfo_.Valid() || connection_)
+		return false;
+
+	loop_host_ = UVLoopPool::Pick();
+	native_socket_ = (NativeSocket)-1;
+	connection_ = std::make_shared<UVTcpConnection>(std::static_pointer_cast<UVTcpClientImpl>(shared_from_this()), socket_options_);
+	auto connection = connection_;
+	auto loop_host = loop_host_;
+	loop_host_->PostTask([connection, loop_host, host, port]() {
+		connection->Connect(loop_host->loop(), host, port);
+	});
+	return true;
+}
+
+int	UVTcpClientImpl::Write(const void *data, size_t size)
+{
+	if (!connection_)
+		return SOCKET_ERROR;
+
+	auto connection = connection_;
+	if (loop_host_->RunsTasksOnCurrentThread())
+	{
+		connection->Write((const char *)data, size);
+		return (int)size;
+	}
+
+	auto buffer = std::make_shared<std::string>((const char *)data, size);
+	loop_host_->PostTask([connection, buffer]() {
+		connection->Write(buffer->data(), buffer->size());
+	});
+	return (int)size;
+}
+
+bool UVTcpClientImpl::GetSocketInfo(TcpSocketInfo& info)
+{
+	NativeSocket socket = native_socket_;
+	if (socket == (NativeSocket)-1 || !is_connected_)
+		return false;
+	return QueryTcpSocketInfo(socket, info);
+}
+
+int UVTcpClientImpl::WriteV(const SendQueue::Slice *slices, size_t count)
+{
+	if (!connection_)
+		return SOCKET_ERROR;
+	//连接建立前数据留在发送队列里，OnConnect 时再发送
+	if (!is_connected_)
+		return 0;
+
+	if (loop_host_->RunsTasksOnCurrentThread())
+		return connection_->TryWrite(slices, count);
+
+	//不在循环线程上时只能合并成一块投递过去
+	auto buffer = std::make_shared<std::string>();
+	for (size_t i = 0; i < count; i++)
+		buffer->append(slices[i].data, slices[i].size);
+	auto connection = connection_;
+	loop_host_->PostTask([connection, buffer]() {
+		connection->Write(buffer->data(), buffer->size());
+	});
+	return (int)buffer->size();
+}
+
+int	UVTcpClientImpl::Read(const void *data, size_t size)
+{
+	return (int)size;
+}
+
+void UVTcpClientImpl::Close()
+{
+	if (send_queue_)
+		send_queue_->Clear();
+	if (connection_)
+	{
+		auto connection = connection_;
+		connection_.reset();
+		loop_host_->PostTask([connection]() {
+			connection->Close();
+		});
+	}
+	is_connected_ = false;
+	native_socket_ = (NativeSocket)-1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+class UVUdpConnection : public std::enable_shared_from_this<UVUdpConnection>
+{
+public:
+	UVUdpConnection(const std::weak_ptr<UVUDPClientImpl> &owner)
+		: owner_(owner), udp_(nullptr), closing_(false)
+	{
+		memset(&remote_addr_, 0, sizeof(remote_addr_));
+	}
+
+	void Connect(uv_loop_t *loop, const std::string &host, int port)
+	{
+		ResolveRequest *req = new ResolveRequest;
+		req->connection = shared_from_this();
+		if (!ResolveHost(loop, &req->req, &UVUdpConnection::OnResolved, host, port, SOCK_DGRAM))
+		{
+			delete req;
+			NotifyConnect(UV_EINVAL);
+		}
+	}
+
+	void Write(const char *data, size_t size)
+	{
+		if (closing_ || udp_ == nullptr)
+			return;
+
+		uv_buf_t buf = uv_buf_init((char *)data, (unsigned int)size);
+		int n = uv_udp_try_send(udp_, &buf, 1, (const struct sockaddr *)&remote_addr_);
+		if (n != UV_EAGAIN && n != UV_ENOSYS)
+			return;
+
+		SendRequest *req = new SendRequest;
+		req->data.assign(data, size);
+		buf = uv_buf_init(&req->data[0], (unsigned int)req->data.size());
+		if (uv_udp_send(&req->req, udp_, &buf, 1, (const struct sockaddr *)&remote_addr_, &UVUdpConnection::OnSent) != 0)
+			delete req;
+	}
+
+	void Close()
+	{
+		if (closing_)
+			return;
+		closing_ = true;
+		if (udp_ && !uv_is_closing((uv_handle_t *)udp_))
+			uv_close((uv_handle_t *)udp_, &UVUdpConnection::OnClosed);
+	}
+
+private:
+	struct ResolveRequest
+	{
+		uv_getaddrinfo_t req;
+		std::shared_ptr<UVUdpConnection> connection;
+	};
+
+	struct SendRequest
+	{
+		uv_udp_send_t req;
+		std::string data;
+	};
+
+	static void OnResolved(uv_getaddrinfo_t *req, int status, struct addrinfo *res)
+	{
+		ResolveRequest *resolve = (ResolveRequest *)req;
+		std::shared_ptr<UVUdpConnection> self = resolve->connection;
+		uv_loop_t *loop = req->loop;
+		delete resolve;
+
+		if (status != 0 || res == nullptr || self->closing_)
+		{
+			if (res)
+				uv_freeaddrinfo(res);
+			if (!self->closing_)
+				self->NotifyConnect(status != 0 ? status : UV_EAI_NONAME);
+			return;
+		}
+
+		memcpy(&self->remote_addr_, res->ai_addr, res->ai_addrlen);
+		uv_freeaddrinfo(res);
+
+		self->udp_ = new uv_udp_t;
+		uv_udp_init(loop, self->udp_);
+		self->udp_->data = self.get();
+		self->self_ = self;
+		self->read_buffer_.resize(kUVReadBufferSize);
+		uv_udp_recv_start(self->udp_, &UVUdpConnection::OnAlloc, &UVUdpConnection::OnReceived);
+		self->NotifyConnect(ERROR_SUCCESS);
+	}
+
+	static void OnAlloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+	{
+		UVUdpConnection *self = (UVUdpConnection *)handle->data;
+		*buf = uv_buf_init(&self->read_buffer_[0], (unsigned int)self->read_buffer_.size());
+	}
+
+	static void OnReceived(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const struct sockaddr *addr, unsigned flags)
+	{
+		UVUdpConnection *self = (UVUdpConnection *)handle->data;
+		if (self->closing_)
+			return;
+		auto owner = self->owner_.lock();
+		if (!owner)
+			return;
+		if (nread > 0)
+			owner->OnReceive(NO_ERROR, buf->base, (size_t)nread);
+		else if (nread < 0)
+		{
+			self->Close();
+			owner->OnClose(NO_ERROR);
+		}
+	}
+
+	static void OnSent(uv_udp_send_t *req, int status)
+	{
+		delete (SendRequest *)req;
+	}
+
+	static void OnClosed(uv_handle_t *handle)
+	{
+		UVUdpConnection *self = (UVUdpConnection *)handle->data;
+		delete (uv_udp_t *)handle;
+		self->udp_ = nullptr;
+		self->self_.reset();
+	}
+
+	void NotifyConnect(int error_code)
+	{
+		auto owner = owner_.lock();
+		if (owner)
+			owner->OnConnect(error_code);
+	}
+
+private:
+	std::weak_ptr<UVUDPClientImpl>		owner_;
+	uv_udp_t							*udp_;
+	bool								closing_;
+	struct sockaddr_storage				remote_addr_;
+	std::vector<char>					read_buffer_;
+	std::shared_ptr<UVUdpConnection>	self_;
+};
+
+UVUDPClientImpl::UVUDPClientImpl() : handler_(nullptr), is_connected_(false)
+{
+}
+
+UVUDPClientImpl::~UVUDPClientImpl()
+{
+	Close();
+	handler_ = nullptr;
+}
+
+void UVUDPClientImpl::SetHandler(UdpClientHandler *handler)
+{
+	handler_ = handler;
+}
+
+bool UVUDPClientImpl::Init(const std::string& host, int port)
+{
+	if (connection_)
+		return false;
+
+	loop_host_ = UVLoopPool::Pick();
+	connection_ = std::make_shared<UVUdpConnection>(shared_from_this());
+	auto connection = connection_;
+	auto loop_host = loop_host_;
+	loop_host_->PostTask([connection, loop_host, host, port]() {
+		connection->Connect(loop_host->loop(), host, port);
+	});
+	return true;
+}
+
+int	UVUDPClientImpl::Write(const void *data, size_t size)
+{
+	if (!connection_)
+		return SOCKET_ERROR;
+
+	auto connection = connection_;
+	if (loop_host_->RunsTasksOnCurrentThread())
+	{
+		connection->Write((const char *)data, size);
+		return (int)size;
+	}
+
+	auto buffer = std::make_shared<std::string>((const char *)data, size);
+	loop_host_->PostTask([connection, buffer]() {
+		connection->Write(buffer->data(), buffer->size());
+	});
+	return (int)size;
+}
+
+int	UVUDPClientImpl::Read(const void *data, size_t size)
+{
+	return (int)size;
+}
+
+void UVUDPClientImpl::Close()
+{
+	if (connection_)
+	{
+		auto connection = connection_;
+		connection_.reset();
+		loop_host_->PostTask([connection]() {
+			connection->Close();
+		});
+	}
+	is_connected_ = false;
+}
+
+bool UVUDPClientImpl::IsConnected()
+{
+	return is_connected_;
+}
+
+void UVUDPClientImpl::OnClose(int error_code)
+{
+	is_connected_ = false;
+
+	if (handler_)
+		handler_->OnClose(error_code);
+}
+
+void UVUDPClientImpl::OnConnect(int error_code)
+{
+	is_connected_ = (error_code == ERROR_SUCCESS);
+
+	if (handler_)
+		handler_->OnConnect(error_code);
+}
+
+void UVUDPClientImpl::OnReceive(int error_code, const void *data, size_t size)
+{
+	if (handler_)
+		handler_->OnReceive(error_code, data, size);
+}
+
+}
+NET_END_DECLS
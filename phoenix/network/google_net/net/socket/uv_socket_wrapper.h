@@ -0,0 +1,86 @@
+#ifndef __BASE_NET_UV_SOCKET_WRAPPER_H__
+#define __BASE_NET_UV_SOCKET_WRAPPER_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "proxy_config/proxy_config/proxy_info.h"
+#include "net/socket/socket_handler.h"
+#include "net/socket/tcp_client_base.h"
+#include "net/socket/uv_loop_host.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
+NET_BEGIN_DECLS
+
+namespace internal{
+
+class UVTcpConnection;
+class UVUdpConnection;
+
+// 基于 libuv 的 TCP 客户端，与 TcpClientImpl 接口一致
+// 多个连接复用 UVLoopPool 中的少量事件循环线程，回调都在循环线程上触发。
+// 不支持代理，设置了有效代理时 Init 返回 false，需改用 tinyNET 实现。
+class NET_EXPORT UVTcpClientImpl :public TcpClientBase
+{
+public:
+	UVTcpClientImpl();
+
+	virtual ~UVTcpClientImpl();
+
+	virtual void SetProxy(ProxyType type, const std::string& host, int port, const std::string& user, const std::string& password) override;
+
+	virtual bool Init(const std::string& host, int port) override;
+	virtual int	Write(const void *data, size_t size) override;
+	virtual int	Read(const void *data, size_t size) override;
+	virtual void Close() override;
+	virtual bool GetSocketInfo(TcpSocketInfo& info) override;
+
+protected:
+	virtual int WriteV(const SendQueue::Slice *slices, size_t count) override;
+
+private:
+	friend class UVTcpConnection;
+
+	ProxyInfo							proxyinfo_;
+	std::shared_ptr<UVLoopHost>			loop_host_;
+	std::shared_ptr<UVTcpConnection>	connection_;
+	// 循环线程创建 socket 后写入，连接关闭后不再可用
+	std::atomic<NativeSocket>			native_socket_;
+};
+
+// 基于 libuv 的 UDP 客户端，与 UDPClientImpl 接口一致
+class NET_EXPORT UVUDPClientImpl :public std::enable_shared_from_this<UVUDPClientImpl>
+{
+public:
+	UVUDPClientImpl();
+
+	virtual ~UVUDPClientImpl();
+
+	void SetHandler(UdpClientHandler *handler);
+
+	bool Init(const std::string& host, int port);
+	int	 Write(const void *data, size_t size);
+	int	 Read(const void *data, size_t size);
+
+	void Close();
+
+	bool IsConnected();
+
+protected:
+	void OnClose(int error_code);
+	void OnConnect(int error_code);
+	void OnReceive(int error_code, const void *data, size_t size);
+
+private:
+	friend class UVUdpConnection;
+
+	UdpClientHandler					*handler_;
+	bool								is_connected_;
+	std::shared_ptr<UVLoopHost>			loop_host_;
+	std::shared_ptr<UVUdpConnection>	connection_;
+};
+
+}
+NET_END_DECLS
+#endif // __BASE_NET_UV_SOCKET_WRAPPER_H__
@@ -0,0 +1,953 @@
+#include "net/socket/websocket_client.h"
+#include "net/phoenix/phoenix_heartbeat_scheduler.h"
+#include "net/base/net_errors.h"
+#include "base/base64.h"
+#include "base/rand_util.h"
+#include "base/sha1.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "extension/memory/chained_buffer.h"
+#include "extension/zip/compression.h"
+#include <string.h>
+#include <algorithm>
+
+NET_BEGIN_DECLS
+
+namespace
+{
+const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+//permessage-deflate 每条消息去掉、收到时补回的 Z_SYNC_FLUSH 尾部（RFC 7692 7.2.1）
+const char kDeflateTail[] = { '\x00', '\x00', '\xff', '\xff' };
+const size_t kMaxControlPayload = 125;
+const size_t kMaxHandshakeSize = 16 * 1024;
+
+bool IsValidCloseCode(uint16_t code)
+{
+	//1004~1006、1015 只用于本地报告，不能出现在关闭帧中
+	if (code >= 3000 && code <= 4999)
+		return true;
+	return code >= 1000 && code <= 1014 && code != 1004 && code != 1005 && code != 1006;
+}
+}
+
+namespace internal{
+
+WebSocketFrameParser::WebSocketFrameParser(size_t max_frame_size)
+	: max_frame_size_(max_frame_size)
+	, allow_rsv1_(false)
+{
+}
+
+void WebSocketFrameParser::Reset()
+{
+	buffer_.clear();
+}
+
+int64_t WebSocketFrameParser::ParseFrame(const char *data, size_t size, Frame &frame, uint16_t &close_code) const
+{
+	if (size < 2)
+		return 0;
+	const uint8_t *p = (const uint8_t *)data;
+	frame.fin = (p[0] & 0x80) != 0;
+	frame.rsv1 = (p[0] & 0x40) != 0;
+	frame.opcode = (WebSocketOpcode)(p[0] & 0x0f);
+	bool control = (frame.opcode & 0x08) != 0;
+	close_code = kWebSocketCloseProtocolError;
+	if (p[0] & 0x30)
+		return -1;
+	if (frame.opcode != kWebSocketContinuation && frame.opcode != kWebSocketText && frame.opcode != kWebSocketBinary
+		&& frame.opcode != kWebSocketClose && frame.opcode != kWebSocketPing && frame.opcode != kWebSocketPong)
+		return -1;
+	if (frame.rsv1 && (!allow_rsv1_ || control))
+		return -1;
+	//服务器发出的帧不能加掩码
+	if (p[1] & 0x80)
+		return -1;
+
+	uint64_t length = p[1] & 0x7f;
+	size_t header_size = 2;
+	if (length == 126)
+	{
+		if (size < 4)
+			return 0;
+		length = ((uint64_t)p[2] << 8) | p[3];
+		header_size = 4;
+	}
+	else if (length == 127)
+	{
+		if (size < 10)
+			return 0;
+		length = 0;
+		for (int i = 2; i < 10; i++)
+			length = (length << 8) | p[i];
+		if (length >> 63)
+			return -1;
+		header_size = 10;
+	}
+	if (control && (!frame.fin || length > kMaxControlPayload))
+		return -1;
+	if (length > max_frame_size_)
+	{
+		close_code = kWebSocketCloseMessageTooBig;
+		return -1;
+	}
+	if (size < header_size + length)
+		return 0;
+	frame.payload = data + header_size;
+	frame.size = (size_t)length;
+	return (int64_t)(header_size + length);
+}
+
+bool WebSocketFrameParser::Feed(const char *data, size_t size, const FrameCallback &callback, uint16_t &close_code)
+{
+	Frame frame;
+	size_t offset = 0;
+	//先补齐上次剩下的半帧：每次只追加到头部完整或该帧结束为止，之后的完整帧仍在原处解析
+	while (!buffer_.empty())
+	{
+		int64_t ret = ParseFrame(buffer_.data(), buffer_.size(), frame, close_code);
+		if (ret < 0)
+			return false;
+		if (ret > 0)
+		{
+			bool go_on = callback(frame);
+			buffer_.clear();
+			if (!go_on)
+				return true;
+			break;
+		}
+		if (offset == size)
+			return true;
+		size_t wanted = PendingFrameSize();
+		buffer_.reserve(wanted);
+		size_t take = std::min(wanted - buffer_.size(), size - offset);
+		buffer_.append(data + offset, take);
+		offset += take;
+	}
+
+	while (offset < size)
+	{
+		int64_t ret = ParseFrame(data + offset, size - offset, frame, close_code);
+		if (ret < 0)
+			return false;
+		if (ret == 0)
+		{
+			buffer_.assign(data + offset, size - offset);
+			return true;
+		}
+		if (!callback(frame))
+			return true;
+		offset += (size_t)ret;
+	}
+	return true;
+}
+
+size_t WebSocketFrameParser::PendingFrameSize() const
+{
+	if (buffer_.size() < 2)
+		return 2;
+	const uint8_t *p = (const uint8_t *)buffer_.data();
+	uint8_t length = p[1] & 0x7f;
+	size_t header_size = length == 126 ? 4 : (length == 127 ? 10 : 2);
+	if (buffer_.size() < header_size)
+		return header_size;
+	uint64_t payload = length;
+	if (length == 126)
+		payload = ((uint64_t)p[2] << 8) | p[3];
+	else if (length == 127)
+	{
+		payload = 0;
+		for (int i = 2; i < 10; i++)
+			payload = (payload << 8) | p[i];
+	}
+	//ParseFrame 已校验过长度不超过 max_frame_size_
+	return header_size + (size_t)payload;
+}
+
+void AppendWebSocketFrame(std::string &out, WebSocketOpcode opcode, bool fin, bool rsv1,
+	const char *payload, size_t size, uint32_t mask)
+{
+	char header[14];
+	size_t header_size = 2;
+	header[0] = (char)((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | (opcode & 0x0f));
+	if (size < 126)
+		header[1] = (char)(0x80 | size);
+	else if (size <= 0xffff)
+	{
+		header[1] = (char)(0x80 | 126);
+		header[2] = (char)(size >> 8);
+		header[3] = (char)size;
+		header_size = 4;
+	}
+	else
+	{
+		header[1] = (char)(0x80 | 127);
+		for (int i = 0; i < 8; i++)
+			header[2 + i] = (char)((uint64_t)size >> (56 - 8 * i));
+		header_size = 10;
+	}
+	char *key = header + header_size;
+	key[0] = (char)(mask >> 24);
+	key[1] = (char)(mask >> 16);
+	key[2] = (char)(mask >> 8);
+	key[3] = (char)mask;
+	header_size += 4;
+
+	size_t start = out.size();
+	out.reserve(start + header_size + size);
+	out.append(header, header_size);
+	out.append(payload, size);
+
+	//按 8 字节一组异或，掩码在内存中的排列与逐字节时相同
+	char *p = &out[start + header_size];
+	char key8[8];
+	memcpy(key8, key, 4);
+	memcpy(key8 + 4, key, 4);
+	uint64_t key64;
+	memcpy(&key64, key8, sizeof(key64));
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, p + i, sizeof(word));
+		word ^= key64;
+		memcpy(p + i, &word, sizeof(word));
+	}
+	for (; i < size; i++)
+		p[i] ^= key[i & 3];
+}
+
+std::string ComputeWebSocketAccept(const std::string &key)
+{
+	std::string accept;
+	base::Base64Encode(base::SHA1HashString(key + kWebSocketGuid), &accept);
+	return accept;
+}
+
+}
+
+WebSocketClient::WebSocketClient(WebSocketHandler *handler, const WebSocketOptions &options/* = WebSocketOptions()*/)
+	: handler_(handler)
+	, options_(options)
+	, state_(kStateClosed)
+	, port_(0)
+	, secure_(false)
+	, heartbeat_id_(0)
+	, message_opcode_(kWebSocketContinuation)
+	, message_compressed_(false)
+	, peer_closed_(false)
+	, pong_pending_(false)
+	, peer_close_code_(kWebSocketCloseAbnormal)
+	, close_sent_(false)
+{
+	if (options_.max_message_size == 0)
+		options_.max_message_size = WebSocketOptions().max_message_size;
+}
+
+WebSocketClient::~WebSocketClient()
+{
+	int heartbeat_id = 0;
+	std::shared_ptr<TcpClientSocket> socket;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		state_ = kStateClosed;
+		std::swap(heartbeat_id, heartbeat_id_);
+		socket = socket_;
+	}
+	//等待正在执行的心跳回调返回
+	if (heartbeat_id != 0)
+		PhoenixHeartbeatScheduler::GetInstance()->Unregister(heartbeat_id);
+	if (socket)
+	{
+		socket->UnregisterCallback();
+		socket->Close();
+	}
+}
+
+bool WebSocketClient::Connect(const std::string &url, const ProxyInfo *proxy/* = nullptr*/)
+{
+	//ws://host[:port][/path][?query]，IPv6 地址带方括号
+	bool secure = false;
+	size_t pos = std::string::npos;
+	if (base::StartsWith(url, "ws://", base::CompareCase::INSENSITIVE_ASCII))
+		pos = 5;
+	else if (base::StartsWith(url, "wss://", base::CompareCase::INSENSITIVE_ASCII))
+	{
+		secure = true;
+		pos = 6;
+	}
+	if (pos == std::string::npos)
+		return false;
+	size_t resource_pos = url.find_first_of("/?#", pos);
+	std::string authority = url.substr(pos, resource_pos == std::string::npos ? std::string::npos : resource_pos - pos);
+	std::string resource = resource_pos == std::string::npos ? "/" : url.substr(resource_pos);
+	resource = resource.substr(0, resource.find('#'));
+	if (resource.empty() || resource[0] != '/')
+		resource.insert(0, "/");
+	if (authority.find('@') != std::string::npos)
+		return false;
+
+	std::string host = authority;
+	int port = secure ? 443 : 80;
+	size_t colon = authority.rfind(':');
+	size_t bracket = authority.rfind(']');
+	if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket))
+	{
+		if (!base::StringToInt(authority.substr(colon + 1), &port) || port <= 0 || port > 65535)
+			return false;
+		host = authority.substr(0, colon);
+	}
+	if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+	if (host.empty())
+		return false;
+
+	bool use_proxy = proxy && proxy->Valid();
+	std::shared_ptr<TcpClientSocket> socket = std::make_shared<TcpClientSocket>(use_proxy ? kSocketBackendTinyNet : options_.backend);
+	std::shared_ptr<TcpClientSocket> old_socket;
+	{
+		std::lock_guard<std::mutex> send_guard(send_lock_);
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ != kStateClosed)
+			return false;
+		state_ = kStateConnecting;
+		host_ = host;
+		port_ = port;
+		resource_ = resource;
+		secure_ = secure;
+		protocol_.clear();
+		deflate_ = DeflateParams();
+		old_socket = socket_;
+		socket_ = socket;
+
+		std::string key = base::RandBytesAsString(16);
+		key_.clear();
+		base::Base64Encode(key, &key_);
+		//掩码只防止中间代理的缓存投毒（RFC 6455 10.3），不需要每帧读系统熵源
+		mask_generator_.seed((std::mt19937::result_type)base::RandUint64());
+		close_sent_ = false;
+		compressor_.reset();
+
+		handshake_buffer_.clear();
+		parser_.reset(new internal::WebSocketFrameParser(options_.max_message_size));
+		message_opcode_ = kWebSocketContinuation;
+		message_compressed_ = false;
+		peer_closed_ = false;
+		message_.clear();
+		decompressor_.reset();
+		pong_pending_ = false;
+		peer_close_code_ = kWebSocketCloseAbnormal;
+		peer_close_reason_.clear();
+	}
+	if (old_socket)
+	{
+		old_socket->UnregisterCallback();
+		old_socket->Close();
+	}
+
+	socket->RegisterCallback(this);
+	socket->SetSendQueue(options_.send_queue);
+	if (secure)
+	{
+		TlsOptions tls = options_.tls;
+		tls.enabled = true;
+		if (tls.server_name.empty())
+			tls.server_name = host;
+		socket->SetTls(tls);
+	}
+	if (use_proxy)
+		socket->SetProxy(proxy);
+	if (!socket->Init(host, port))
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (socket_ == socket)
+			state_ = kStateClosed;
+		return false;
+	}
+	return true;
+}
+
+bool WebSocketClient::SendText(const std::string &text, size_t max_fragment_size/* = 0*/)
+{
+	return SendMessage(kWebSocketText, text.data(), text.size(), max_fragment_size);
+}
+
+bool WebSocketClient::SendBinary(const void *data, size_t size, size_t max_fragment_size/* = 0*/)
+{
+	return SendMessage(kWebSocketBinary, (const char *)data, size, max_fragment_size);
+}
+
+bool WebSocketClient::Ping(const void *data/* = nullptr*/, size_t size/* = 0*/)
+{
+	if (size > kMaxControlPayload)
+		return false;
+	return SendMessage(kWebSocketPing, (const char *)data, size, 0);
+}
+
+void WebSocketClient::Close(uint16_t code/* = kWebSocketCloseNormal*/, const std::string &reason/* = std::string()*/)
+{
+	std::shared_ptr<TcpClientSocket> socket;
+	State state;
+	{
+		std::lock_guard<std::mutex> send_guard(send_lock_);
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			state = state_;
+			socket = socket_;
+			if (state_ == kStateOpen)
+				state_ = kStateClosing;
+		}
+		if (state == kStateOpen)
+			SendCloseLocked(socket.get(), code, reason);
+	}
+	//握手还未完成，没有关闭握手可做
+	if (state == kStateConnecting)
+		Shutdown(net::ERR_ABORTED, kWebSocketCloseAbnormal, std::string(), false);
+}
+
+WebSocketClient::State WebSocketClient::state() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return state_;
+}
+
+std::string WebSocketClient::protocol() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return protocol_;
+}
+
+bool WebSocketClient::deflate_enabled() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return deflate_.enabled;
+}
+
+bool WebSocketClient::SendMessage(WebSocketOpcode opcode, const char *data, size_t size, size_t max_fragment_size)
+{
+	std::lock_guard<std::mutex> send_guard(send_lock_);
+	std::shared_ptr<TcpClientSocket> socket;
+	bool deflate = false;
+	bool no_context_takeover = false;
+	int heartbeat_id = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ != kStateOpen)
+			return false;
+		socket = socket_;
+		deflate = deflate_.enabled && !(opcode & 0x08) && size >= options_.deflate_min_size;
+		no_context_takeover = deflate_.client_no_context_takeover;
+		heartbeat_id = heartbeat_id_;
+	}
+
+	const char *payload = data;
+	size_t payload_size = size;
+	if (deflate)
+	{
+		if (!compressor_)
+			compressor_.reset(new NS_EXTENSION::Compressor(NS_EXTENSION::CompressionFormat::kRawDeflate, options_.deflate_level));
+		deflated_.clear();
+		auto sink = NS_EXTENSION::AppendTo(&deflated_);
+		if (compressor_->Write(data, size, sink) && compressor_->Flush(sink)
+			&& deflated_.size() >= sizeof(kDeflateTail)
+			&& memcmp(deflated_.data() + deflated_.size() - sizeof(kDeflateTail), kDeflateTail, sizeof(kDeflateTail)) == 0)
+		{
+			//压缩上下文已包含这条消息，即使没有变小也要按压缩发送，否则与对端的窗口不一致
+			deflated_.resize(deflated_.size() - sizeof(kDeflateTail));
+			payload = deflated_.data();
+			payload_size = deflated_.size();
+			if (no_context_takeover)
+				compressor_->Reset();
+		}
+		else
+		{
+			//之前的消息都以完整的块结束，新开一个流对对端仍是合法的后续数据
+			compressor_->Reset();
+			deflate = false;
+		}
+	}
+
+	bool ret = true;
+	if (max_fragment_size == 0 || payload_size <= max_fragment_size || (opcode & 0x08))
+		ret = SendFrameLocked(socket.get(), opcode, true, deflate, payload, payload_size);
+	else
+	{
+		size_t offset = 0;
+		while (ret && offset < payload_size)
+		{
+			size_t fragment = std::min(max_fragment_size, payload_size - offset);
+			ret = SendFrameLocked(socket.get(), offset == 0 ? opcode : kWebSocketContinuation,
+				offset + fragment == payload_size, deflate && offset == 0, payload + offset, fragment);
+			offset += fragment;
+		}
+	}
+	if (deflated_.capacity() > 64 * 1024)
+		std::string().swap(deflated_);
+	if (ret && heartbeat_id != 0)
+		PhoenixHeartbeatScheduler::GetInstance()->OnDataSent(heartbeat_id);
+	return ret;
+}
+
+bool WebSocketClient::SendFrameLocked(TcpClientSocket *socket, WebSocketOpcode opcode, bool fin, bool rsv1, const char *payload, size_t size)
+{
+	if (!socket)
+		return false;
+	std::string frame;
+	internal::AppendWebSocketFrame(frame, opcode, fin, rsv1, payload, size, (uint32_t)mask_generator_());
+	//帧的内存直接交给发送队列，不再拷贝
+	NS_EXTENSION::ChainedBuffer buffer;
+	buffer.append(std::move(frame));
+	return socket->Send(buffer);
+}
+
+void WebSocketClient::SendCloseLocked(TcpClientSocket *socket, uint16_t code, const std::string &reason)
+{
+	if (close_sent_)
+		return;
+	close_sent_ = true;
+	std::string payload;
+	if (IsValidCloseCode(code))
+	{
+		payload.push_back((char)(code >> 8));
+		payload.push_back((char)code);
+		payload.append(reason, 0, kMaxControlPayload - 2);
+	}
+	SendFrameLocked(socket, kWebSocketClose, true, false, payload.data(), payload.size());
+}
+
+std::string WebSocketClient::BuildHandshakeRequest()
+{
+	std::string host = host_.find(':') != std::string::npos ? "[" + host_ + "]" : host_;
+	if (port_ != (secure_ ? 443 : 80))
+		host += ":" + base::IntToString(port_);
+
+	std::string request = "GET " + resource_ + " HTTP/1.1\r\n";
+	request += "Host: " + host + "\r\n";
+	request += "Upgrade: websocket\r\n";
+	request += "Connection: Upgrade\r\n";
+	request += "Sec-WebSocket-Key: " + key_ + "\r\n";
+	request += "Sec-WebSocket-Version: 13\r\n";
+	if (!options_.origin.empty())
+		request += "Origin: " + options_.origin + "\r\n";
+	if (!options_.protocols.empty())
+		request += "Sec-WebSocket-Protocol: " + base::JoinString(options_.protocols, ", ") + "\r\n";
+	//不提供 client_max_window_bits：压缩固定使用 32KB 窗口，服务器就不能要求更小的窗口
+	if (options_.permessage_deflate)
+	{
+		request += "Sec-WebSocket-Extensions: permessage-deflate";
+		if (options_.no_context_takeover)
+			request += "; client_no_context_takeover; server_no_context_takeover";
+		request += "\r\n";
+	}
+	for (auto &header : options_.headers)
+		request += header.first + ": " + header.second + "\r\n";
+	request += "\r\n";
+	return request;
+}
+
+int WebSocketClient::ParseHandshakeResponse(const std::string &response)
+{
+	std::vector<std::string> lines = base::SplitString(response, "\r\n", base::KEEP_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+	if (lines.empty())
+		return net::ERR_INVALID_RESPONSE;
+	std::vector<std::string> status = base::SplitString(lines[0], " ", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+	int status_code = 0;
+	if (status.size() < 2 || !base::StartsWith(status[0], "HTTP/1.1", base::CompareCase::INSENSITIVE_ASCII)
+		|| !base::StringToInt(status[1], &status_code) || status_code != 101)
+		return net::ERR_INVALID_RESPONSE;
+
+	bool upgrade = false, connection = false, accepted = false;
+	std::string protocol, extensions;
+	for (size_t i = 1; i < lines.size(); i++)
+	{
+		size_t colon = lines[i].find(':');
+		if (colon == std::string::npos)
+			return net::ERR_INVALID_RESPONSE;
+		std::string name = base::ToLowerASCII(base::TrimWhitespaceASCII(lines[i].substr(0, colon), base::TRIM_ALL).as_string());
+		std::string value = base::TrimWhitespaceASCII(lines[i].substr(colon + 1), base::TRIM_ALL).as_string();
+		if (name == "upgrade")
+			upgrade = base::EqualsCaseInsensitiveASCII(value, "websocket");
+		else if (name == "connection")
+		{
+			for (auto &token : base::SplitString(value, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY))
+				connection = connection || base::EqualsCaseInsensitiveASCII(token, "upgrade");
+		}
+		else if (name == "sec-websocket-accept")
+			accepted = value == internal::ComputeWebSocketAccept(key_);
+		else if (name == "sec-websocket-protocol")
+		{
+			if (!protocol.empty())
+				return net::ERR_WS_PROTOCOL_ERROR;
+			protocol = value;
+		}
+		else if (name == "sec-websocket-extensions")
+			extensions += (extensions.empty() ? "" : ", ") + value;
+	}
+	if (!upgrade || !connection || !accepted)
+		return net::ERR_WS_PROTOCOL_ERROR;
+	//只能选中请求中提供的子协议
+	if (!protocol.empty() && std::find(options_.protocols.begin(), options_.protocols.end(), protocol) == options_.protocols.end())
+		return net::ERR_WS_PROTOCOL_ERROR;
+	if (!extensions.empty() && !ParseExtensions(extensions))
+		return net::ERR_WS_PROTOCOL_ERROR;
+
+	std::lock_guard<std::mutex> guard(lock_);
+	protocol_ = protocol;
+	return net::OK;
+}
+
+bool WebSocketClient::ParseExtensions(const std::string &value)
+{
+	DeflateParams params;
+	for (auto &extension : base::SplitString(value, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY))
+	{
+		std::vector<std::string> tokens = base::SplitString(extension, ";", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+		//没有请求的扩展、重复的 permessage-deflate 都要拒绝
+		if (tokens.empty() || tokens[0] != "permessage-deflate" || !options_.permessage_deflate || params.enabled)
+			return false;
+		params.enabled = true;
+		for (size_t i = 1; i < tokens.size(); i++)
+		{
+			std::string name = tokens[i].substr(0, tokens[i].find('='));
+			name = base::TrimWhitespaceASCII(name, base::TRIM_ALL).as_string();
+			bool has_value = tokens[i].find('=') != std::string::npos;
+			if (name == "server_no_context_takeover" && !has_value)
+				params.server_no_context_takeover = true;
+			else if (name == "client_no_context_takeover" && !has_value)
+				params.client_no_context_takeover = true;
+			else if (name == "server_max_window_bits" && has_value)
+			{
+				//解压总是使用最大的窗口，可以接受任意较小的取值
+				std::string bits = tokens[i].substr(tokens[i].find('=') + 1);
+				base::TrimString(bits, " \t\"", &bits);
+				int window_bits = 0;
+				if (!base::StringToInt(bits, &window_bits) || window_bits < 8 || window_bits > 15)
+					return false;
+			}
+			else
+				return false;
+		}
+	}
+	std::lock_guard<std::mutex> guard(lock_);
+	deflate_ = params;
+	return true;
+}
+
+void WebSocketClient::OnConnect(int error_code)
+{
+	if (error_code != ERROR_SUCCESS)
+	{
+		Shutdown(error_code, kWebSocketCloseAbnormal, std::string(), false);
+		return;
+	}
+	std::shared_ptr<TcpClientSocket> socket;
+	std::string request;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ != kStateConnecting)
+			return;
+		socket = socket_;
+		request = BuildHandshakeRequest();
+	}
+	socket->Send(request.data(), request.size());
+}
+
+void WebSocketClient::OnReceive(int error_code, const void *data, size_t size)
+{
+	//TLS 或传输层出错，后续数据已不可信
+	if (error_code != NO_ERROR)
+	{
+		Shutdown(net::ERR_CONNECTION_CLOSED, kWebSocketCloseAbnormal, std::string(), false);
+		return;
+	}
+	State state = this->state();
+	if (state == kStateConnecting)
+		OnHandshakeReceived((const char *)data, size);
+	else if (state == kStateOpen || state == kStateClosing)
+		ProcessFrames((const char *)data, size);
+}
+
+void WebSocketClient::OnHandshakeReceived(const char *data, size_t size)
+{
+	//响应头之后可能紧跟着服务器的第一帧
+	size_t search_from = handshake_buffer_.size() > 3 ? handshake_buffer_.size() - 3 : 0;
+	handshake_buffer_.append(data, size);
+	size_t end = handshake_buffer_.find("\r\n\r\n", search_from);
+	if (end == std::string::npos)
+	{
+		if (handshake_buffer_.size() > kMaxHandshakeSize)
+			Shutdown(net::ERR_RESPONSE_HEADERS_TOO_BIG, kWebSocketCloseAbnormal, std::string(), false);
+		return;
+	}
+	int ret = ParseHandshakeResponse(handshake_buffer_.substr(0, end));
+	if (ret != net::OK)
+	{
+		Shutdown(ret, kWebSocketCloseAbnormal, std::string(), false);
+		return;
+	}
+	std::string frames = handshake_buffer_.substr(end + 4);
+	std::string().swap(handshake_buffer_);
+
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ != kStateConnecting)
+			return;
+		state_ = kStateOpen;
+		parser_->set_allow_rsv1(deflate_.enabled);
+		if (deflate_.enabled)
+			decompressor_.reset(new NS_EXTENSION::Decompressor(NS_EXTENSION::CompressionFormat::kRawDeflate));
+	}
+	if (options_.heartbeat)
+	{
+		int heartbeat_id = PhoenixHeartbeatScheduler::GetInstance()->Register([this]() { OnHeartbeat(); });
+		std::lock_guard<std::mutex> guard(lock_);
+		heartbeat_id_ = heartbeat_id;
+	}
+	if (handler_)
+		handler_->OnOpen(net::OK);
+	if (!frames.empty())
+		ProcessFrames(frames.data(), frames.size());
+}
+
+void WebSocketClient::ProcessFrames(const char *data, size_t size)
+{
+	int heartbeat_id = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		heartbeat_id = heartbeat_id_;
+	}
+	if (heartbeat_id != 0)
+		PhoenixHeartbeatScheduler::GetInstance()->OnDataReceived(heartbeat_id);
+
+	uint16_t close_code = kWebSocketCloseProtocolError;
+	bool failed = false;
+	bool ret = parser_->Feed(data, size, [this, &failed](const internal::WebSocketFrameParser::Frame &frame) {
+		if (OnFrame(frame))
+			return true;
+		failed = true;
+		return false;
+	}, close_code);
+	if (!ret)
+	{
+		Shutdown(net::ERR_WS_PROTOCOL_ERROR, close_code, std::string(), false);
+		return;
+	}
+	if (failed)
+		return;
+
+	//同一批数据中的多个 ping 只回复最后一个
+	if (pong_pending_)
+	{
+		pong_pending_ = false;
+		std::lock_guard<std::mutex> send_guard(send_lock_);
+		std::shared_ptr<TcpClientSocket> socket;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (state_ == kStateOpen)
+				socket = socket_;
+		}
+		if (socket && !close_sent_)
+			SendFrameLocked(socket.get(), kWebSocketPong, true, false, pong_payload_.data(), pong_payload_.size());
+	}
+}
+
+bool WebSocketClient::OnFrame(const internal::WebSocketFrameParser::Frame &frame)
+{
+	//已收到对端的关闭帧，之后的数据都被忽略，只等对端断开
+	if (peer_closed_)
+		return true;
+	if (frame.opcode & 0x08)
+		return OnControlFrame(frame);
+	return OnDataFrame(frame);
+}
+
+bool WebSocketClient::OnDataFrame(const internal::WebSocketFrameParser::Frame &frame)
+{
+	bool continuation = frame.opcode == kWebSocketContinuation;
+	//续帧必须在分片消息中，新消息不能打断分片消息，RSV1 只能出现在第一帧
+	if (continuation != (message_opcode_ != kWebSocketContinuation) || (continuation && frame.rsv1))
+	{
+		Shutdown(net::ERR_WS_PROTOCOL_ERROR, kWebSocketCloseProtocolError, std::string(), false);
+		return false;
+	}
+
+	//未分片的消息直接使用接收缓冲区
+	if (!continuation && frame.fin)
+		return DeliverMessage(frame.opcode, frame.payload, frame.size, frame.rsv1);
+
+	if (!continuation)
+	{
+		message_opcode_ = frame.opcode;
+		message_compressed_ = frame.rsv1;
+		message_.clear();
+	}
+	if (message_.size() + frame.size > options_.max_message_size)
+	{
+		Shutdown(net::ERR_MSG_TOO_BIG, kWebSocketCloseMessageTooBig, std::string(), false);
+		return false;
+	}
+	message_.append(frame.payload, frame.size);
+	if (!frame.fin)
+		return true;
+
+	WebSocketOpcode opcode = message_opcode_;
+	message_opcode_ = kWebSocketContinuation;
+	bool ret = DeliverMessage(opcode, message_.data(), message_.size(), message_compressed_);
+	message_.clear();
+	if (message_.capacity() > 64 * 1024)
+		std::string().swap(message_);
+	return ret;
+}
+
+bool WebSocketClient::DeliverMessage(WebSocketOpcode opcode, const char *data, size_t size, bool compressed)
+{
+	if (compressed)
+	{
+		inflated_.clear();
+		bool too_big = false;
+		size_t max_size = options_.max_message_size;
+		std::string *out = &inflated_;
+		auto sink = [out, max_size, &too_big](const char *data, size_t size) {
+			if (out->size() + size > max_size)
+			{
+				too_big = true;
+				return false;
+			}
+			out->append(data, size);
+			return true;
+		};
+		bool ret = decompressor_->Write(data, size, sink) && decompressor_->Write(kDeflateTail, sizeof(kDeflateTail), sink);
+		if (!ret)
+		{
+			if (too_big)
+				Shutdown(net::ERR_MSG_TOO_BIG, kWebSocketCloseMessageTooBig, std::string(), false);
+			else
+				Shutdown(net::ERR_WS_PROTOCOL_ERROR, kWebSocketCloseInvalidData, std::string(), false);
+			return false;
+		}
+		//对端不保留上下文，或者以 BFINAL 块结束了流，下一条消息都是新的 deflate 流
+		if (deflate_.server_no_context_takeover || decompressor_->finished())
+			decompressor_->Reset();
+		data = inflated_.data();
+		size = inflated_.size();
+	}
+	if (opcode == kWebSocketText && !base::IsStringUTF8(base::StringPiece(data, size)))
+	{
+		Shutdown(net::ERR_WS_PROTOCOL_ERROR, kWebSocketCloseInvalidData, std::string(), false);
+		return false;
+	}
+	if (handler_)
+		handler_->OnMessage(opcode, data, size);
+	if (inflated_.capacity() > 64 * 1024)
+		std::string().swap(inflated_);
+	return true;
+}
+
+bool WebSocketClient::OnControlFrame(const internal::WebSocketFrameParser::Frame &frame)
+{
+	if (frame.opcode == kWebSocketPing)
+	{
+		pong_pending_ = true;
+		pong_payload_.assign(frame.payload, frame.size);
+		return true;
+	}
+	if (frame.opcode == kWebSocketPong)
+	{
+		if (handler_)
+			handler_->OnPong(frame.payload, frame.size);
+		return true;
+	}
+
+	uint16_t code = kWebSocketCloseNoStatus;
+	std::string reason;
+	if (frame.size == 1)
+	{
+		Shutdown(net::ERR_WS_PROTOCOL_ERROR, kWebSocketCloseProtocolError, std::string(), false);
+		return false;
+	}
+	if (frame.size >= 2)
+	{
+		code = (uint16_t)(((uint8_t)frame.payload[0] << 8) | (uint8_t)frame.payload[1]);
+		reason.assign(frame.payload + 2, frame.size - 2);
+		if (!IsValidCloseCode(code) || !base::IsStringUTF8(reason))
+		{
+			Shutdown(net::ERR_WS_PROTOCOL_ERROR, kWebSocketCloseProtocolError, std::string(), false);
+			return false;
+		}
+	}
+	peer_closed_ = true;
+	peer_close_code_ = code;
+	peer_close_reason_ = reason;
+	pong_pending_ = false;
+
+	//回复关闭帧后等待服务器断开 TCP（RFC 6455 7.1.1），发送队列中的数据不会被丢弃
+	std::lock_guard<std::mutex> send_guard(send_lock_);
+	std::shared_ptr<TcpClientSocket> socket;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ == kStateOpen)
+			state_ = kStateClosing;
+		socket = socket_;
+	}
+	SendCloseLocked(socket.get(), code == kWebSocketCloseNoStatus ? (uint16_t)kWebSocketCloseNormal : code, std::string());
+	return true;
+}
+
+void WebSocketClient::OnClose(int error_code)
+{
+	//完成了关闭握手的断开是正常的
+	if (peer_closed_)
+		Shutdown(NO_ERROR, peer_close_code_, peer_close_reason_, false);
+	else
+		Shutdown(error_code != NO_ERROR ? error_code : net::ERR_CONNECTION_CLOSED, kWebSocketCloseAbnormal, std::string(), true);
+}
+
+void WebSocketClient::OnSend(int error_code)
+{
+
+}
+
+void WebSocketClient::OnHeartbeat()
+{
+	State state = this->state();
+	if (state == kStateOpen)
+		Ping();
+	//发出关闭帧后过了一个心跳间隔对端仍未断开
+	else if (state == kStateClosing)
+		Shutdown(net::ERR_TIMED_OUT, kWebSocketCloseAbnormal, std::string(), false);
+}
+
+void WebSocketClient::Shutdown(int error_code, uint16_t close_code, const std::string &reason, bool link_lost)
+{
+	bool opened = false;
+	int heartbeat_id = 0;
+	std::shared_ptr<TcpClientSocket> socket;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (state_ == kStateClosed)
+			return;
+		opened = state_ != kStateConnecting;
+		state_ = kStateClosed;
+		std::swap(heartbeat_id, heartbeat_id_);
+		socket = socket_;
+	}
+	if (heartbeat_id != 0)
+	{
+		//只有空闲时意外断开才用于推测 NAT 超时
+		if (link_lost)
+			PhoenixHeartbeatScheduler::GetInstance()->OnLinkLost(heartbeat_id);
+		else
+			PhoenixHeartbeatScheduler::GetInstance()->Unregister(heartbeat_id);
+	}
+	if (socket)
+		socket->Close();
+	if (!handler_)
+		return;
+	if (opened)
+		handler_->OnClose(error_code, close_code, reason);
+	else
+		handler_->OnOpen(error_code);
+}
+
+NET_END_DECLS
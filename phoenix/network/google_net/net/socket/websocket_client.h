@@ -0,0 +1,262 @@
+#ifndef __BASE_NET_WEBSOCKET_CLIENT_H__
+#define __BASE_NET_WEBSOCKET_CLIENT_H__
+
+#include "net/net_export.h"
+#include "net/config/build_config.h"
+#include "extension/config/build_config.h"
+#include "proxy_config/proxy_config/proxy_info.h"
+#include "net/socket/socket_handler.h"
+#include "net/socket/send_queue.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/socket/tls_layer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+EXTENSION_BEGIN_DECLS
+class Compressor;
+class Decompressor;
+EXTENSION_END_DECLS
+
+NET_BEGIN_DECLS
+
+enum WebSocketOpcode
+{
+	kWebSocketContinuation = 0x0,
+	kWebSocketText = 0x1,
+	kWebSocketBinary = 0x2,
+	kWebSocketClose = 0x8,
+	kWebSocketPing = 0x9,
+	kWebSocketPong = 0xA,
+};
+
+//RFC 6455 7.4.1 中常用的关闭码
+enum WebSocketCloseCode
+{
+	kWebSocketCloseNormal = 1000,
+	kWebSocketCloseGoingAway = 1001,
+	kWebSocketCloseProtocolError = 1002,
+	kWebSocketCloseNoStatus = 1005,		// 对端的关闭帧没有关闭码，不能通过 Close 发送
+	kWebSocketCloseAbnormal = 1006,		// 没有关闭握手就断开了，不能通过 Close 发送
+	kWebSocketCloseInvalidData = 1007,
+	kWebSocketCloseMessageTooBig = 1009,
+};
+
+struct NET_EXPORT WebSocketOptions
+{
+	WebSocketOptions()
+		: backend(kSocketBackendUV)
+		, permessage_deflate(true)
+		, deflate_level(6)
+		, deflate_min_size(128)
+		, no_context_takeover(false)
+		, max_message_size(16 * 1024 * 1024)
+		, heartbeat(true)
+	{
+		//控制帧的合并窗口很短，ping/pong 与同一时刻的数据帧一起写出
+		send_queue.delay_ms = 1;
+	}
+
+	SocketBackend	backend;			// 不使用代理时的传输，设置了代理时总是 kSocketBackendTinyNet
+	std::string		origin;				// 为空时不发送 Origin
+	std::vector<std::string> protocols;	// Sec-WebSocket-Protocol 的候选，服务器选中的通过 protocol() 取得
+	std::vector<std::pair<std::string, std::string>> headers;	// 握手请求附加的头，如 Cookie、Authorization
+	bool			permessage_deflate;	// 协商 RFC 7692 permessage-deflate，服务器不支持时不压缩
+	int				deflate_level;		// zlib 压缩等级 0~9
+	size_t			deflate_min_size;	// 小于该长度的消息不压缩
+	bool			no_context_takeover;// 请求双方每条消息独立压缩，省去每个连接约 300KB 的 zlib 窗口内存，但压缩率下降
+	size_t			max_message_size;	// 收到的消息（解压后）超过该长度时以 1009 关闭连接
+	bool			heartbeat;			// 连接建立后由 PhoenixHeartbeatScheduler 统一调度 ping；关闭握手后对端迟迟不断开时也由它断开
+	TlsOptions		tls;				// wss:// 时自动启用，server_name 为空时使用 URL 的 host
+	SendQueueOptions send_queue;
+};
+
+class NET_EXPORT WebSocketHandler
+{
+public:
+	virtual ~WebSocketHandler() {}
+
+	//握手完成或失败，失败时 error_code 为 net::Error，之后不会再回调 OnClose
+	virtual void OnOpen(int error_code) = 0;
+	//opcode 为 kWebSocketText 或 kWebSocketBinary，分片消息合并、压缩消息解压后回调一次，data 只在回调期间有效
+	virtual void OnMessage(WebSocketOpcode opcode, const char *data, size_t size) = 0;
+	//连接断开。收到过对端的关闭帧时 close_code 为对端的关闭码，本端因协议错误断开时为 1002、1007、1009 等，
+	//否则为 kWebSocketCloseAbnormal；正常完成关闭握手时 error_code 为 NO_ERROR
+	virtual void OnClose(int error_code, uint16_t close_code, const std::string &reason) = 0;
+	virtual void OnPong(const char *data, size_t size) {}
+};
+
+namespace internal{
+
+// 服务器发往客户端的帧的增量解析，不要求帧完整地落在一次 Feed 的数据中。
+// 一次 Feed 中完整的帧直接引用输入数据回调，只有跨 Feed 的帧才拷贝到内部缓冲区。
+// 服务器的帧不能带掩码，保留位只允许第一个数据帧的 RSV1（permessage-deflate）
+class NET_EXPORT WebSocketFrameParser
+{
+public:
+	struct Frame
+	{
+		bool			fin;
+		bool			rsv1;
+		WebSocketOpcode	opcode;
+		const char		*payload;
+		size_t			size;
+	};
+
+	// 返回 false 时停止解析（连接即将关闭）
+	typedef std::function<bool(const Frame &frame)> FrameCallback;
+
+	explicit WebSocketFrameParser(size_t max_frame_size);
+
+	// 帧格式非法时返回 false，close_code 为应发送给对端的关闭码
+	bool Feed(const char *data, size_t size, const FrameCallback &callback, uint16_t &close_code);
+	void Reset();
+	void set_allow_rsv1(bool allow) { allow_rsv1_ = allow; }
+
+private:
+	// 解析 data 开头的一帧，数据不足时返回 0，非法时返回 -1，否则返回帧的总长度
+	int64_t ParseFrame(const char *data, size_t size, Frame &frame, uint16_t &close_code) const;
+	// 补齐 buffer_ 中的半帧还需要到达的长度：头部不完整时为头部长度，否则为整帧长度
+	size_t PendingFrameSize() const;
+
+	size_t		max_frame_size_;
+	bool		allow_rsv1_;
+	std::string	buffer_;
+};
+
+// 客户端发出的帧：按 RFC 6455 5.3 对负载加掩码，header 和负载写入同一块内存
+NET_EXPORT void AppendWebSocketFrame(std::string &out, WebSocketOpcode opcode, bool fin, bool rsv1,
+	const char *payload, size_t size, uint32_t mask);
+
+// Sec-WebSocket-Accept 的期望值：base64(SHA1(key + RFC 6455 的 GUID))
+NET_EXPORT std::string ComputeWebSocketAccept(const std::string &key);
+
+}
+
+// WebSocket 客户端（RFC 6455），支持 permessage-deflate（RFC 7692）。
+// 建立在 TcpClientSocket 之上：不使用代理时默认走 kSocketBackendUV，与其他连接共用
+// UVLoopPool 的 libuv 事件循环（nim_http 的 MessagePumpForUV 可以通过 UVLoopPool::SetExternalHost
+// 接入，与 HTTP 共用同一个循环）；设置了代理时用 tinyNET 经 ProxyInfo 的 HTTP/SOCKS 代理连接，
+// 与 HTTP 请求使用同一份代理配置，bypass_list_ 同样生效。wss:// 使用 TcpClientSocket 的 TLS，
+// 同一 host:port 重连时恢复 TLS 会话。
+// 收到的未分片、未压缩的消息直接引用接收缓冲区回调，不做拷贝；分片的消息在内部拼接，
+// 压缩的消息解压到复用的缓冲区。ping 由 PhoenixHeartbeatScheduler 统一调度，与 link 连接的心跳
+// 在同一次唤醒中发出；一次收到的多个 ping 只回复最后一个的 pong（RFC 6455 5.5.3 允许）。
+// 发送可在任意线程调用，内部加锁保证帧（含分片）的顺序，压缩上下文只在锁内使用。
+// 回调在传输线程上执行，不能在回调中析构对象；析构前会注销回调并断开连接，不再回调 OnClose。
+class NET_EXPORT WebSocketClient : public TcpClientHandler
+{
+public:
+	enum State
+	{
+		kStateClosed = 0,
+		kStateConnecting,		// TCP/TLS 连接或握手中
+		kStateOpen,
+		kStateClosing,			// 已发出关闭帧，等待对端的关闭帧
+	};
+
+	explicit WebSocketClient(WebSocketHandler *handler, const WebSocketOptions &options = WebSocketOptions());
+	virtual ~WebSocketClient();
+
+	// url 为 ws://host[:port][/path][?query] 或 wss://...，proxy 为 nullptr 或无效时直连。
+	// 只能在 kStateClosed 时调用，结果通过 OnOpen 回调
+	bool Connect(const std::string &url, const ProxyInfo *proxy = nullptr);
+	// 负载较大的消息按 max_fragment_size 分片发送，0 表示不分片
+	bool SendText(const std::string &text, size_t max_fragment_size = 0);
+	bool SendBinary(const void *data, size_t size, size_t max_fragment_size = 0);
+	// 负载不超过 125 字节
+	bool Ping(const void *data = nullptr, size_t size = 0);
+	// 发起关闭握手，对端回复关闭帧后断开，已在关闭时不做任何事
+	void Close(uint16_t code = kWebSocketCloseNormal, const std::string &reason = std::string());
+
+	State state() const;
+	// 服务器在握手中选中的子协议，没有时为空
+	std::string protocol() const;
+	bool deflate_enabled() const;
+
+	// TcpClientHandler
+	virtual void OnClose(int error_code) override;
+	virtual void OnConnect(int error_code) override;
+	virtual void OnReceive(int error_code, const void *data, size_t size) override;
+	virtual void OnSend(int error_code) override;
+
+private:
+	struct DeflateParams
+	{
+		DeflateParams() : enabled(false), server_no_context_takeover(false), client_no_context_takeover(false) {}
+
+		bool	enabled;
+		bool	server_no_context_takeover;
+		bool	client_no_context_takeover;
+	};
+
+	bool SendMessage(WebSocketOpcode opcode, const char *data, size_t size, size_t max_fragment_size);
+	// 需持有 send_lock_
+	bool SendFrameLocked(TcpClientSocket *socket, WebSocketOpcode opcode, bool fin, bool rsv1, const char *payload, size_t size);
+	// 需持有 send_lock_，close_sent_ 为 false 时发出关闭帧
+	void SendCloseLocked(TcpClientSocket *socket, uint16_t code, const std::string &reason);
+
+	std::string BuildHandshakeRequest();
+	// 收到完整的响应头后校验，返回 net::Error
+	int ParseHandshakeResponse(const std::string &response);
+	bool ParseExtensions(const std::string &value);
+	void OnHandshakeReceived(const char *data, size_t size);
+	void ProcessFrames(const char *data, size_t size);
+
+	bool OnFrame(const internal::WebSocketFrameParser::Frame &frame);
+	bool OnDataFrame(const internal::WebSocketFrameParser::Frame &frame);
+	bool OnControlFrame(const internal::WebSocketFrameParser::Frame &frame);
+	bool DeliverMessage(WebSocketOpcode opcode, const char *data, size_t size, bool compressed);
+	// 断开传输层并回调 OnOpen（握手未完成时）或 OnClose，只回调一次；
+	// 协议错误时不等待关闭握手，直接断开（RFC 6455 7.1.7），close_code 为本端判定的关闭码。
+	// 不能在持有 lock_ 或 send_lock_ 时调用
+	void Shutdown(int error_code, uint16_t close_code, const std::string &reason, bool link_lost);
+	void OnHeartbeat();
+
+	uint32_t NextMask();
+
+private:
+	WebSocketHandler					*handler_;
+	WebSocketOptions					options_;
+	std::shared_ptr<TcpClientSocket>	socket_;
+
+	mutable std::mutex					lock_;
+	State								state_;
+	std::string							host_;
+	int									port_;
+	std::string							resource_;	// path 和 query
+	bool								secure_;
+	std::string							key_;
+	std::string							protocol_;
+	DeflateParams						deflate_;
+	int									heartbeat_id_;
+
+	// 以下只在传输线程上使用
+	std::string							handshake_buffer_;
+	std::unique_ptr<internal::WebSocketFrameParser> parser_;
+	WebSocketOpcode						message_opcode_;	// 分片消息的类型，不在分片消息中时为 kWebSocketContinuation
+	bool								message_compressed_;
+	bool								peer_closed_;
+	std::string							message_;
+	std::string							inflated_;
+	std::unique_ptr<NS_EXTENSION::Decompressor> decompressor_;
+	bool								pong_pending_;
+	std::string							pong_payload_;
+	uint16_t							peer_close_code_;
+	std::string							peer_close_reason_;
+
+	// 保护掩码、压缩上下文和帧的发送顺序
+	std::mutex							send_lock_;
+	bool								close_sent_;
+	std::mt19937						mask_generator_;
+	std::unique_ptr<NS_EXTENSION::Compressor> compressor_;
+	std::string							deflated_;
+};
+
+NET_END_DECLS
+#endif // __BASE_NET_WEBSOCKET_CLIENT_H__
@@ -364,6 +364,33 @@ bool DoReplaceComponents(const char* spec,
   return ReplacePathURL(spec, parsed, replacements, output, out_parsed);
 }
 
+// The same scheme dispatch as DoCanonicalize, but the input is not copied to
+// strip whitespace and nothing is written out, so the components stay offsets
+// into |spec|.
+template<typename CHAR>
+bool DoParseURL(const CHAR* spec,
+                int spec_len,
+                bool trim_path_end,
+                Parsed* parsed) {
+  *parsed = Parsed();
+  Component scheme;
+  if (!ExtractScheme(spec, spec_len, &scheme))
+    return false;
+
+  SchemeType unused_scheme_type = SCHEME_WITH_PORT;
+  if (DoCompareSchemeComponent(spec, scheme, url::kFileScheme))
+    ParseFileURL(spec, spec_len, parsed);
+  else if (DoCompareSchemeComponent(spec, scheme, url::kFileSystemScheme))
+    ParseFileSystemURL(spec, spec_len, parsed);
+  else if (DoIsStandard(spec, scheme, &unused_scheme_type))
+    ParseStandardURL(spec, spec_len, parsed);
+  else if (DoCompareSchemeComponent(spec, scheme, url::kMailToScheme))
+    ParseMailtoURL(spec, spec_len, parsed);
+  else
+    ParsePathURL(spec, spec_len, trim_path_end, parsed);
+  return true;
+}
+
 }  // namespace
 
 void Initialize() {
@@ -461,6 +488,20 @@ bool Canonicalize(const base::char16* spec,
                         output, output_parsed);
 }
 
+bool ParseURL(const char* spec,
+              int spec_len,
+              bool trim_path_end,
+              Parsed* parsed) {
+  return DoParseURL(spec, spec_len, trim_path_end, parsed);
+}
+
+bool ParseURL(const base::char16* spec,
+              int spec_len,
+              bool trim_path_end,
+              Parsed* parsed) {
+  return DoParseURL(spec, spec_len, trim_path_end, parsed);
+}
+
 bool ResolveRelative(const char* base_spec,
                      int base_spec_len,
                      const Parsed& base_parsed,
@@ -8,6 +8,7 @@
 #include <string>
 
 #include "base/strings/string16.h"
+#include "base/strings/string_piece.h"
 #include "net/url/url_parse.h"
 #include "net/url/url_canon.h"
 #include "net/net_export.h"
@@ -120,6 +121,25 @@ NET_EXPORT bool GetStandardSchemeType(const char* spec,
 
 // URL library wrappers -------------------------------------------------------
 
+// Splits |spec| into components according to the extracted scheme type,
+// without canonicalizing, copying or allocating. The components of |parsed|
+// are offsets into |spec| itself, so it must outlive their use. Unlike
+// Canonicalize, whitespace inside the spec is not removed, callers that take
+// URLs from user input should canonicalize them instead.
+//
+// Returns false if no scheme could be found, |parsed| is then reset.
+NET_EXPORT bool ParseURL(const char* spec,
+                         int spec_len,
+                         bool trim_path_end,
+                         Parsed* parsed);
+NET_EXPORT bool ParseURL(const base::char16* spec,
+                         int spec_len,
+                         bool trim_path_end,
+                         Parsed* parsed);
+inline bool ParseURL(const base::StringPiece& spec, Parsed* parsed) {
+  return ParseURL(spec.data(), static_cast<int>(spec.size()), true, parsed);
+}
+
 // Parses the given spec according to the extracted scheme type. Normal users
 // should use the URL object, although this may be useful if performance is
 // critical and you don't want to do the heap allocation for the std::string.
@@ -1,16 +1,143 @@
 #include "proxy_config/proxy_config/proxy_info.h"
+#include <ctype.h>
+#include <stdlib.h>
 
 NET_BEGIN_DECLS
 
+namespace {
+struct ProxyScheme
+{
+	const char* name;
+	ProxyType type;
+	uint16_t default_port;
+};
+const ProxyScheme kProxySchemes[] = {
+	{ "http", kProxyHttp11, 80 },
+	{ "https", kProxyHttps, 443 },
+	{ "socks4", kProxySocks4, 1080 },
+	{ "socks4a", kProxySocks4a, 1080 },
+	{ "socks5", kProxySocks5, 1080 },
+	{ "socks5h", kProxySocks5, 1080 },
+	{ "socks", kProxySocks4, 1080 },
+};
+const ProxyScheme* FindScheme(const std::string& name)
+{
+	for (auto& scheme : kProxySchemes)
+	{
+		if (name == scheme.name)
+			return &scheme;
+	}
+	return nullptr;
+}
+}
+
 ProxyInfo ProxyInfo::FromString(const std::string& url)
 {
-	return ProxyInfo();
+	ProxyInfo info(kProxyNone, std::string(), 0);
+	std::string rest = url;
+	while (!rest.empty() && isspace((unsigned char)rest.back()))
+		rest.pop_back();
+	size_t begin = 0;
+	while (begin < rest.size() && isspace((unsigned char)rest[begin]))
+		begin++;
+	rest.erase(0, begin);
+
+	std::string scheme = "http";
+	size_t pos = rest.find("://");
+	if (pos != std::string::npos)
+	{
+		scheme = rest.substr(0, pos);
+		for (auto& c : scheme)
+			c = (char)tolower((unsigned char)c);
+		rest.erase(0, pos + 3);
+	}
+	if (scheme == "system")
+	{
+		info.type_ = kProxySystem;
+		return info;
+	}
+	const ProxyScheme* proxy_scheme = FindScheme(scheme);
+	if (proxy_scheme == nullptr)
+		return info;
+	//路径部分对代理无意义
+	pos = rest.find('/');
+	if (pos != std::string::npos)
+		rest.erase(pos);
+	pos = rest.rfind('@');
+	if (pos != std::string::npos)
+	{
+		std::string user_info = rest.substr(0, pos);
+		rest.erase(0, pos + 1);
+		size_t colon = user_info.find(':');
+		info.user_ = user_info.substr(0, colon);
+		if (colon != std::string::npos)
+			info.password_ = user_info.substr(colon + 1);
+	}
+	std::string port;
+	if (!rest.empty() && rest[0] == '[')
+	{
+		//IPv6 地址
+		pos = rest.find(']');
+		if (pos == std::string::npos)
+			return ProxyInfo(kProxyNone, std::string(), 0);
+		info.host_ = rest.substr(1, pos - 1);
+		if (pos + 1 < rest.size() && rest[pos + 1] == ':')
+			port = rest.substr(pos + 2);
+	}
+	else
+	{
+		pos = rest.find(':');
+		info.host_ = rest.substr(0, pos);
+		if (pos != std::string::npos)
+			port = rest.substr(pos + 1);
+	}
+	unsigned long port_value = proxy_scheme->default_port;
+	if (!port.empty())
+	{
+		char* end = nullptr;
+		port_value = strtoul(port.c_str(), &end, 10);
+		if (*end != '\0' || port_value == 0 || port_value > 65535)
+			return ProxyInfo(kProxyNone, std::string(), 0);
+	}
+	if (info.host_.empty())
+		return ProxyInfo(kProxyNone, std::string(), 0);
+	info.type_ = proxy_scheme->type;
+	info.port_ = (uint16_t)port_value;
+	return info;
 }
 std::string ProxyInfo::ToString(const ProxyInfo& info)
 {
-	return std::string();
+	if (info.type_ == kProxySystem)
+		return "system://";
+	if (!info.Valid())
+		return std::string();
+	const char* scheme = "http";
+	for (auto& proxy_scheme : kProxySchemes)
+	{
+		if (proxy_scheme.type == info.type_)
+		{
+			scheme = proxy_scheme.name;
+			break;
+		}
+	}
+	std::string url = scheme;
+	url.append("://");
+	if (!info.user_.empty())
+	{
+		url.append(info.user_);
+		if (!info.password_.empty())
+			url.append(":").append(info.password_);
+		url.append("@");
+	}
+	if (info.host_.find(':') != std::string::npos)
+		url.append("[").append(info.host_).append("]");
+	else
+		url.append(info.host_);
+	url.append(":").append(std::to_string(info.port_));
+	return url;
 }
-ProxyInfo::ProxyInfo()
+ProxyInfo::ProxyInfo() :
+	type_(kProxyNone), port_(0)
 {
 }
 ProxyInfo::ProxyInfo(ProxyType type, const std::string& host, uint16_t	port, 
@@ -25,6 +152,7 @@ ProxyInfo& ProxyInfo::operator = (const ProxyInfo& config) {
 		this->port_ = config.port_;
 		this->user_ = config.user_;
 		this->password_ = config.password_;
+		this->bypass_list_ = config.bypass_list_;
 	}
 	return *this;
 }
@@ -0,0 +1,724 @@
+#include "proxy_config/proxy_config/proxy_resolver.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <future>
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include <winhttp.h>
+#pragma comment(lib, "winhttp.lib")
+#elif defined(OS_MACOSX)
+#include <CoreFoundation/CoreFoundation.h>
+#include <CFNetwork/CFNetwork.h>
+#endif
+
+NET_BEGIN_DECLS
+
+namespace {
+
+ProxyInfo DirectProxy()
+{
+	return ProxyInfo(kProxyNone, std::string(), 0);
+}
+
+std::string ToLower(const std::string& text)
+{
+	std::string lower = text;
+	for (auto& c : lower)
+		c = (char)tolower((unsigned char)c);
+	return lower;
+}
+
+std::string Trim(const std::string& text)
+{
+	size_t begin = 0;
+	size_t end = text.size();
+	while (begin < end && isspace((unsigned char)text[begin]))
+		begin++;
+	while (end > begin && isspace((unsigned char)text[end - 1]))
+		end--;
+	return text.substr(begin, end - begin);
+}
+
+//WebSocket 与 HTTP 使用相同的代理设置
+std::string ProxySchemeOf(const std::string& scheme)
+{
+	if (scheme == "ws")
+		return "http";
+	if (scheme == "wss")
+		return "https";
+	return scheme;
+}
+
+bool MatchPattern(const char* pattern, const char* text)
+{
+	const char* star = nullptr;
+	const char* resume = nullptr;
+	while (*text != '\0')
+	{
+		if (*pattern == '*')
+		{
+			star = pattern++;
+			resume = text;
+		}
+		else if (*pattern == *text)
+		{
+			pattern++;
+			text++;
+		}
+		else if (star != nullptr)
+		{
+			pattern = star + 1;
+			text = ++resume;
+		}
+		else
+			return false;
+	}
+	while (*pattern == '*')
+		pattern++;
+	return *pattern == '\0';
+}
+
+//PAC 的一个条目，如 "PROXY 10.0.0.1:8080"，关键字无法识别时返回 false
+bool ParsePacEntry(const std::string& entry, ProxyInfo& proxy)
+{
+	size_t space = entry.find_first_of(" \t");
+	std::string keyword = ToLower(entry.substr(0, space));
+	if (keyword == "direct")
+	{
+		proxy = DirectProxy();
+		return true;
+	}
+	if (space == std::string::npos)
+		return false;
+	std::string address = Trim(entry.substr(space));
+	const char* scheme = nullptr;
+	if (keyword == "proxy" || keyword == "http")
+		scheme = "http";
+	else if (keyword == "https")
+		scheme = "https";
+	else if (keyword == "socks" || keyword == "socks4")
+		scheme = "socks4";
+	else if (keyword == "socks5")
+		scheme = "socks5";
+	else
+		return false;
+	proxy = ProxyInfo::FromString(std::string(scheme) + "://" + address);
+	return proxy.Valid();
+}
+
+//WinHTTP 的地址可以带 scheme，不带时按 default_scheme
+ProxyInfo ParseServer(const std::string& address, const char* default_scheme)
+{
+	if (address.find("://") != std::string::npos)
+		return ProxyInfo::FromString(address);
+	return ProxyInfo::FromString(std::string(default_scheme) + "://" + address);
+}
+
+#if defined(OS_WIN)
+std::wstring UTF8ToWide(const std::string& text)
+{
+	int size = MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), nullptr, 0);
+	std::wstring wide(size > 0 ? size : 0, L'\0');
+	if (size > 0)
+		MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), &wide[0], size);
+	return wide;
+}
+
+std::string WideToUTF8(const wchar_t* text)
+{
+	if (text == nullptr)
+		return std::string();
+	int size = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+	if (size <= 1)
+		return std::string();
+	std::string utf8(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, text, -1, &utf8[0], size, nullptr, nullptr);
+	utf8.resize(size - 1);
+	return utf8;
+}
+
+//自动检测（WPAD）和 PAC 脚本由 WinHTTP 执行，WinHTTP 自己会缓存下载的脚本
+bool ResolveAutoProxy(const std::string& url, bool auto_detect, const std::string& auto_config_url,
+	std::string& proxy_list, std::string& bypass_list)
+{
+	HINTERNET session = WinHttpOpen(L"NimProxyResolver", WINHTTP_ACCESS_TYPE_NO_PROXY,
+		WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+	if (session == nullptr)
+		return false;
+
+	std::wstring wide_config_url = UTF8ToWide(auto_config_url);
+	std::wstring wide_url = UTF8ToWide(url);
+	WINHTTP_AUTOPROXY_OPTIONS options;
+	memset(&options, 0, sizeof(options));
+	//两者都有时与 IE 一样先自动检测，失败再用脚本地址
+	if (auto_detect)
+	{
+		options.dwFlags |= WINHTTP_AUTOPROXY_AUTO_DETECT;
+		options.dwAutoDetectFlags = WINHTTP_AUTO_DETECT_TYPE_DHCP | WINHTTP_AUTO_DETECT_TYPE_DNS_A;
+	}
+	if (!wide_config_url.empty())
+	{
+		options.dwFlags |= WINHTTP_AUTOPROXY_CONFIG_URL;
+		options.lpszAutoConfigUrl = wide_config_url.c_str();
+	}
+	WINHTTP_PROXY_INFO info;
+	memset(&info, 0, sizeof(info));
+	BOOL succeed = WinHttpGetProxyForUrl(session, wide_url.c_str(), &options, &info);
+	if (!succeed && GetLastError() == ERROR_WINHTTP_LOGIN_FAILURE)
+	{
+		//下载脚本需要身份验证时才使用当前用户的凭据
+		options.fAutoLogonIfChallenged = TRUE;
+		succeed = WinHttpGetProxyForUrl(session, wide_url.c_str(), &options, &info);
+	}
+	if (succeed)
+	{
+		if (info.dwAccessType == WINHTTP_ACCESS_TYPE_NAMED_PROXY)
+		{
+			proxy_list = WideToUTF8(info.lpszProxy);
+			bypass_list = WideToUTF8(info.lpszProxyBypass);
+		}
+		if (info.lpszProxy != nullptr)
+			GlobalFree(info.lpszProxy);
+		if (info.lpszProxyBypass != nullptr)
+			GlobalFree(info.lpszProxyBypass);
+	}
+	WinHttpCloseHandle(session);
+	return succeed != FALSE;
+}
+#elif defined(OS_MACOSX)
+//PAC 在解析线程上以私有的 run loop 模式执行，不影响其他线程的 run loop
+const CFStringRef kPacRunLoopMode = CFSTR("NimProxyResolverPac");
+const CFTimeInterval kPacTimeoutSeconds = 30;
+
+std::string CFStringToUTF8(CFStringRef text)
+{
+	if (text == nullptr)
+		return std::string();
+	CFIndex size = CFStringGetMaximumSizeForEncoding(CFStringGetLength(text), kCFStringEncodingUTF8) + 1;
+	std::string utf8(size, '\0');
+	if (!CFStringGetCString(text, &utf8[0], size, kCFStringEncodingUTF8))
+		return std::string();
+	utf8.resize(strlen(utf8.c_str()));
+	return utf8;
+}
+
+struct PacResult
+{
+	CFArrayRef proxies;
+	bool done;
+};
+
+void OnPacResult(void* client, CFArrayRef proxies, CFErrorRef error)
+{
+	PacResult* result = (PacResult*)client;
+	if (error == nullptr && proxies != nullptr)
+		result->proxies = (CFArrayRef)CFRetain(proxies);
+	result->done = true;
+	CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
+//返回的列表由调用者释放，失败或超时返回 nullptr
+CFArrayRef ExecutePac(CFURLRef pac_url, CFURLRef target_url)
+{
+	PacResult result = { nullptr, false };
+	CFStreamClientContext context = { 0, &result, nullptr, nullptr, nullptr };
+	CFRunLoopSourceRef source = CFNetworkExecuteProxyAutoConfigurationURL(pac_url, target_url, OnPacResult, &context);
+	if (source == nullptr)
+		return nullptr;
+	CFRunLoopRef run_loop = CFRunLoopGetCurrent();
+	CFRunLoopAddSource(run_loop, source, kPacRunLoopMode);
+	CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + kPacTimeoutSeconds;
+	while (!result.done)
+	{
+		CFTimeInterval remaining = deadline - CFAbsoluteTimeGetCurrent();
+		if (remaining <= 0)
+			break;
+		CFRunLoopRunInMode(kPacRunLoopMode, remaining, false);
+	}
+	CFRunLoopRemoveSource(run_loop, source, kPacRunLoopMode);
+	CFRunLoopSourceInvalidate(source);
+	CFRelease(source);
+	return result.proxies;
+}
+
+//取列表中第一个可用的条目，遇到 PAC 地址时执行脚本；没有可用条目时返回 false
+bool ProxyFromList(CFArrayRef proxies, CFURLRef target_url, bool allow_pac, ProxyInfo& proxy)
+{
+	for (CFIndex i = 0; i < CFArrayGetCount(proxies); i++)
+	{
+		CFDictionaryRef item = (CFDictionaryRef)CFArrayGetValueAtIndex(proxies, i);
+		CFStringRef type = (CFStringRef)CFDictionaryGetValue(item, kCFProxyTypeKey);
+		if (type == nullptr)
+			continue;
+		if (CFEqual(type, kCFProxyTypeNone))
+		{
+			proxy = DirectProxy();
+			return true;
+		}
+		if (CFEqual(type, kCFProxyTypeAutoConfigurationURL))
+		{
+			CFURLRef pac_url = (CFURLRef)CFDictionaryGetValue(item, kCFProxyAutoConfigurationURLKey);
+			if (!allow_pac || pac_url == nullptr)
+				continue;
+			CFArrayRef pac_proxies = ExecutePac(pac_url, target_url);
+			if (pac_proxies == nullptr)
+				continue;
+			bool resolved = ProxyFromList(pac_proxies, target_url, false, proxy);
+			CFRelease(pac_proxies);
+			if (resolved)
+				return true;
+			continue;
+		}
+		ProxyType proxy_type;
+		//kCFProxyTypeHTTPS 指访问 HTTPS 地址用的 HTTP 代理（CONNECT），不是 TLS 代理
+		if (CFEqual(type, kCFProxyTypeHTTP) || CFEqual(type, kCFProxyTypeHTTPS))
+			proxy_type = kProxyHttp11;
+		else if (CFEqual(type, kCFProxyTypeSOCKS))
+			proxy_type = kProxySocks5;
+		else
+			continue;
+		std::string host = CFStringToUTF8((CFStringRef)CFDictionaryGetValue(item, kCFProxyHostNameKey));
+		int port = 0;
+		CFNumberRef number = (CFNumberRef)CFDictionaryGetValue(item, kCFProxyPortNumberKey);
+		if (number != nullptr)
+			CFNumberGetValue(number, kCFNumberIntType, &port);
+		if (host.empty() || port <= 0 || port > 65535)
+			continue;
+		proxy = ProxyInfo(proxy_type, host, (uint16_t)port,
+			CFStringToUTF8((CFStringRef)CFDictionaryGetValue(item, kCFProxyUsernameKey)),
+			CFStringToUTF8((CFStringRef)CFDictionaryGetValue(item, kCFProxyPasswordKey)));
+		return true;
+	}
+	return false;
+}
+#else
+std::string GetEnvironment(const char* name, const char* upper_name)
+{
+	const char* value = getenv(name);
+	if ((value == nullptr || *value == '\0') && upper_name != nullptr)
+		value = getenv(upper_name);
+	return value != nullptr ? value : std::string();
+}
+#endif
+
+}
+
+NimProxyResolver* NimProxyResolver::GetInstance()
+{
+	static NimProxyResolver *instance = new NimProxyResolver;
+	return instance;
+}
+
+NimProxyResolver::NimProxyResolver() :
+	workers_("nim_proxy_resolver", options_.thread_count),
+	generation_(0)
+{
+}
+
+void NimProxyResolver::SetOptions(const NimProxyResolverOptions& options)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	options_ = options;
+	if (options_.thread_count == 0)
+		options_.thread_count = 1;
+	workers_.SetMaxThreads(options_.thread_count);
+	TrimLocked();
+}
+
+void NimProxyResolver::SetBackend(const Backend& backend)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	backend_ = backend;
+	//换了 PAC 引擎，之前的结果作废
+	cache_.clear();
+	inflight_.clear();
+	generation_++;
+}
+
+bool NimProxyResolver::ParseUrl(const std::string& url, std::string& scheme, std::string& host, int& port)
+{
+	size_t pos = url.find("://");
+	if (pos == std::string::npos || pos == 0)
+		return false;
+	scheme = ToLower(url.substr(0, pos));
+	std::string authority = url.substr(pos + 3);
+	pos = authority.find_first_of("/?#");
+	if (pos != std::string::npos)
+		authority.erase(pos);
+	pos = authority.rfind('@');
+	if (pos != std::string::npos)
+		authority.erase(0, pos + 1);
+
+	std::string port_text;
+	if (!authority.empty() && authority[0] == '[')
+	{
+		pos = authority.find(']');
+		if (pos == std::string::npos)
+			return false;
+		host = authority.substr(1, pos - 1);
+		if (pos + 1 < authority.size() && authority[pos + 1] == ':')
+			port_text = authority.substr(pos + 2);
+	}
+	else
+	{
+		pos = authority.find(':');
+		host = authority.substr(0, pos);
+		if (pos != std::string::npos)
+			port_text = authority.substr(pos + 1);
+	}
+	host = ToLower(host);
+	if (host.empty())
+		return false;
+
+	std::string proxy_scheme = ProxySchemeOf(scheme);
+	port = proxy_scheme == "https" ? 443 : (proxy_scheme == "http" ? 80 : 0);
+	if (!port_text.empty())
+	{
+		char* end = nullptr;
+		long value = strtol(port_text.c_str(), &end, 10);
+		if (*end != '\0' || value <= 0 || value > 65535)
+			return false;
+		port = (int)value;
+	}
+	return true;
+}
+
+void NimProxyResolver::Resolve(const std::string& url, const ResolveCallback& callback)
+{
+	std::string scheme, host;
+	int port = 0;
+	if (!ParseUrl(url, scheme, host, port))
+	{
+		if (callback)
+			callback(DirectProxy());
+		return;
+	}
+	std::string key = scheme + "://" + host + ":" + std::to_string(port);
+	ProxyInfo proxy;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto it = cache_.find(key);
+		if (it == cache_.end() || std::chrono::steady_clock::now() >= it->second.expires)
+		{
+			StartJobLocked(key, url, scheme, host, callback);
+			return;
+		}
+		proxy = it->second.proxy;
+	}
+	if (callback)
+		callback(proxy);
+}
+
+ProxyInfo NimProxyResolver::ResolveSync(const std::string& url)
+{
+	auto result = std::make_shared<std::promise<ProxyInfo>>();
+	auto future = result->get_future();
+	Resolve(url, [result](const ProxyInfo& proxy) {
+		result->set_value(proxy);
+	});
+	return future.get();
+}
+
+void NimProxyResolver::Clear()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	cache_.clear();
+	//进行中的解析仍会回调等待者，但新的请求不再合并到旧网络上发起的解析里
+	inflight_.clear();
+	generation_++;
+}
+
+ProxyInfo NimProxyResolver::ParseProxyList(const std::string& proxy_list, const std::string& scheme)
+{
+	std::string proxy_scheme = ProxySchemeOf(ToLower(scheme));
+	//PAC 格式取第一个条目；WinHTTP 格式优先取 scheme 对应的条目，其次是不分 scheme 的，最后是 socks
+	bool found_any = false;
+	bool found_socks = false;
+	ProxyInfo any_proxy = DirectProxy();
+	ProxyInfo socks_proxy = DirectProxy();
+	size_t begin = 0;
+	while (begin <= proxy_list.size())
+	{
+		size_t end = proxy_list.find(';', begin);
+		if (end == std::string::npos)
+			end = proxy_list.size();
+		std::string entry = Trim(proxy_list.substr(begin, end - begin));
+		begin = end + 1;
+		if (entry.empty())
+			continue;
+
+		size_t equal = entry.find('=');
+		if (equal == std::string::npos)
+		{
+			if (found_any)
+				continue;
+			ProxyInfo proxy;
+			if (entry.find_first_of(" \t") != std::string::npos || ToLower(entry) == "direct")
+			{
+				//也可能是空白分隔的 WinHTTP 列表，取第一个 host:port
+				if (!ParsePacEntry(entry, proxy))
+				{
+					std::string address = entry.substr(0, entry.find_first_of(" \t"));
+					if (address.find(':') == std::string::npos)
+						continue;
+					proxy = ParseServer(address, "http");
+					if (!proxy.Valid())
+						continue;
+				}
+			}
+			else
+			{
+				proxy = ParseServer(entry, "http");
+				if (!proxy.Valid())
+					continue;
+			}
+			found_any = true;
+			any_proxy = proxy;
+			continue;
+		}
+
+		std::string key = ToLower(Trim(entry.substr(0, equal)));
+		std::string address = Trim(entry.substr(equal + 1));
+		if (key == proxy_scheme)
+		{
+			//https= 指访问 HTTPS 地址用的 HTTP 代理
+			ProxyInfo proxy = ParseServer(address, "http");
+			if (proxy.Valid())
+				return proxy;
+		}
+		else if (key == "socks" && !found_socks)
+		{
+			ProxyInfo proxy = ParseServer(address, "socks4");
+			if (proxy.Valid())
+			{
+				found_socks = true;
+				socks_proxy = proxy;
+			}
+		}
+	}
+	return found_any ? any_proxy : socks_proxy;
+}
+
+bool NimProxyResolver::MatchBypassList(const std::string& bypass_list, const std::string& host)
+{
+	if (bypass_list.empty() || host.empty())
+		return false;
+	std::string lower_host = ToLower(host);
+	if (lower_host.size() > 2 && lower_host.front() == '[' && lower_host.back() == ']')
+		lower_host = lower_host.substr(1, lower_host.size() - 2);
+
+	size_t begin = 0;
+	while (begin < bypass_list.size())
+	{
+		size_t end = bypass_list.find_first_of(",; \t\r\n", begin);
+		if (end == std::string::npos)
+			end = bypass_list.size();
+		std::string entry = ToLower(bypass_list.substr(begin, end - begin));
+		begin = end + 1;
+		if (entry.empty())
+			continue;
+		if (entry == "*")
+			return true;
+		if (entry == "<local>")
+		{
+			if (lower_host.find_first_of(".:") == std::string::npos)
+				return true;
+			continue;
+		}
+		size_t pos = entry.find("://");
+		if (pos != std::string::npos)
+			entry.erase(0, pos + 3);
+		//去掉端口，不按端口区分
+		if (!entry.empty() && entry[0] == '[')
+		{
+			pos = entry.find(']');
+			entry = entry.substr(1, pos == std::string::npos ? std::string::npos : pos - 1);
+		}
+		else if (entry.find(':') == entry.rfind(':') && entry.find(':') != std::string::npos)
+			entry.erase(entry.find(':'));
+		if (entry.find('*') != std::string::npos)
+		{
+			if (MatchPattern(entry.c_str(), lower_host.c_str()))
+				return true;
+			continue;
+		}
+		if (entry[0] == '.')
+			entry.erase(0, 1);
+		if (entry.empty())
+			continue;
+		if (lower_host == entry)
+			return true;
+		if (lower_host.size() > entry.size() && lower_host[lower_host.size() - entry.size() - 1] == '.' &&
+			lower_host.compare(lower_host.size() - entry.size(), entry.size(), entry) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool NimProxyResolver::SystemResolve(const std::string& url, const std::string& scheme, const std::string& host, ProxyInfo& proxy)
+{
+	proxy = DirectProxy();
+#if defined(OS_WIN)
+	WINHTTP_CURRENT_USER_IE_PROXY_CONFIG ie_config;
+	memset(&ie_config, 0, sizeof(ie_config));
+	if (!WinHttpGetIEProxyConfigForCurrentUser(&ie_config))
+		return false;
+	bool auto_detect = ie_config.fAutoDetect != FALSE;
+	std::string auto_config_url = WideToUTF8(ie_config.lpszAutoConfigUrl);
+	std::string static_proxy = WideToUTF8(ie_config.lpszProxy);
+	std::string static_bypass = WideToUTF8(ie_config.lpszProxyBypass);
+	if (ie_config.lpszAutoConfigUrl != nullptr)
+		GlobalFree(ie_config.lpszAutoConfigUrl);
+	if (ie_config.lpszProxy != nullptr)
+		GlobalFree(ie_config.lpszProxy);
+	if (ie_config.lpszProxyBypass != nullptr)
+		GlobalFree(ie_config.lpszProxyBypass);
+
+	if (auto_detect || !auto_config_url.empty())
+	{
+		std::string proxy_list, bypass_list;
+		if (ResolveAutoProxy(url, auto_detect, auto_config_url, proxy_list, bypass_list))
+		{
+			if (!MatchBypassList(bypass_list, host))
+				proxy = ParseProxyList(proxy_list, scheme);
+			return true;
+		}
+		//自动配置失败时与 IE 一样使用手动设置的代理
+		if (static_proxy.empty())
+			return false;
+	}
+	if (!static_proxy.empty() && !MatchBypassList(static_bypass, host))
+		proxy = ParseProxyList(static_proxy, scheme);
+	return true;
+#elif defined(OS_MACOSX)
+	CFDictionaryRef settings = CFNetworkCopySystemProxySettings();
+	if (settings == nullptr)
+		return false;
+	bool resolved = false;
+	CFURLRef target_url = CFURLCreateWithBytes(kCFAllocatorDefault, (const UInt8*)url.data(), (CFIndex)url.size(),
+		kCFStringEncodingUTF8, nullptr);
+	if (target_url != nullptr)
+	{
+		//例外列表已由 CFNetworkCopyProxiesForURL 处理，命中时返回 kCFProxyTypeNone
+		CFArrayRef proxies = CFNetworkCopyProxiesForURL(target_url, settings);
+		if (proxies != nullptr)
+		{
+			resolved = ProxyFromList(proxies, target_url, true, proxy);
+			CFRelease(proxies);
+		}
+		CFRelease(target_url);
+	}
+	CFRelease(settings);
+	return resolved;
+#else
+	if (MatchBypassList(GetEnvironment("no_proxy", "NO_PROXY"), host))
+		return true;
+	std::string proxy_scheme = ProxySchemeOf(scheme);
+	std::string value;
+	if (proxy_scheme == "https")
+		value = GetEnvironment("https_proxy", "HTTPS_PROXY");
+	else if (proxy_scheme == "http")
+		value = GetEnvironment("http_proxy", nullptr);	//与 curl 一致不读 HTTP_PROXY，CGI 程序里它可能来自请求头
+	if (value.empty())
+		value = GetEnvironment("all_proxy", "ALL_PROXY");
+	if (!value.empty())
+	{
+		proxy = ProxyInfo::FromString(value);
+		if (!proxy.Valid())
+			proxy = DirectProxy();
+	}
+	return true;
+#endif
+}
+
+void NimProxyResolver::StartJobLocked(const std::string& key, const std::string& url, const std::string& scheme, const std::string& host, const ResolveCallback& callback)
+{
+	auto it = inflight_.find(key);
+	if (it != inflight_.end())
+	{
+		if (callback)
+			it->second->callbacks.push_back(callback);
+		return;
+	}
+
+	auto job = std::make_shared<Job>();
+	job->key = key;
+	job->url = url;
+	job->scheme = scheme;
+	job->host = host;
+	job->generation = generation_;
+	if (callback)
+		job->callbacks.push_back(callback);
+	inflight_[key] = job;
+	workers_.PostTask([this, job]() { RunJob(job); });
+}
+
+void NimProxyResolver::RunJob(const std::shared_ptr<Job>& job)
+{
+	Backend backend;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		backend = backend_;
+	}
+
+	ProxyInfo proxy = DirectProxy();
+	bool succeed = false;
+	std::string proxy_list;
+	if (backend && backend(job->url, proxy_list))
+	{
+		proxy = ParseProxyList(proxy_list, job->scheme);
+		succeed = true;
+	}
+	else
+		succeed = SystemResolve(job->url, job->scheme, job->host, proxy);
+	CompleteJob(job, succeed, proxy);
+}
+
+void NimProxyResolver::CompleteJob(const std::shared_ptr<Job>& job, bool succeed, const ProxyInfo& proxy)
+{
+	std::vector<ResolveCallback> callbacks;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (job->generation == generation_)
+		{
+			CacheEntry& entry = cache_[job->key];
+			entry.proxy = proxy;
+			entry.expires = std::chrono::steady_clock::now() +
+				std::chrono::seconds(succeed ? options_.ttl_seconds : options_.negative_ttl_seconds);
+			inflight_.erase(job->key);
+			TrimLocked();
+		}
+		callbacks.swap(job->callbacks);
+	}
+	for (auto& callback : callbacks)
+		callback(proxy);
+}
+
+void NimProxyResolver::TrimLocked()
+{
+	if (cache_.size() <= options_.max_entries)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	for (auto it = cache_.begin(); it != cache_.end();)
+	{
+		if (now >= it->second.expires)
+			it = cache_.erase(it);
+		else
+			++it;
+	}
+	while (cache_.size() > options_.max_entries)
+	{
+		auto oldest = cache_.begin();
+		for (auto it = cache_.begin(); it != cache_.end(); ++it)
+		{
+			if (it->second.expires < oldest->second.expires)
+				oldest = it;
+		}
+		cache_.erase(oldest);
+	}
+}
+
+NET_END_DECLS
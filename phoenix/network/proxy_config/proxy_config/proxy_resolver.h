@@ -0,0 +1,115 @@
+#ifndef NEWWORK_PROXY_CONFIG_PROXY_RESOLVER_H_
+#define NEWWORK_PROXY_CONFIG_PROXY_RESOLVER_H_
+
+#include "proxy_config/config/build_config.h"
+#include "proxy_config/proxy_config_export.h"
+#include "proxy_config/proxy_config/proxy_info.h"
+#include "extension/thread/background_thread.h"
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+NET_BEGIN_DECLS
+
+struct NimProxyResolverOptions
+{
+	NimProxyResolverOptions() :
+		thread_count(2),
+		ttl_seconds(300),
+		negative_ttl_seconds(30),
+		max_entries(256)
+	{
+	}
+
+	size_t thread_count;		// 读取系统设置、执行 PAC 的线程数，自动检测（WPAD）可能阻塞数秒
+	int ttl_seconds;			// 解析结果的缓存时间
+	int negative_ttl_seconds;	// 解析失败（如 WPAD 找不到脚本）按直连处理，缓存这么久后重试
+	size_t max_entries;
+};
+
+// 系统代理的解析服务，ProxyInfo 的类型为 kProxySystem 时由它决定每个目标实际使用的代理
+// net::TcpClientSocket::Init 和 nim_http 发出请求前经它解析，结果按 scheme://host:port 缓存，同一目标同时只解析一次。
+// PAC 脚本可能按路径返回不同的代理，实际很少见，这里不区分路径。
+// 系统设置的来源：
+//   Windows：IE 设置（WinHttpGetIEProxyConfigForCurrentUser），自动检测或 PAC 时由 WinHttpGetProxyForUrl 执行脚本
+//   macOS/iOS：CFNetworkCopyProxiesForURL，PAC 由 CFNetworkExecuteProxyAutoConfigurationURL 在解析线程上执行
+//   其他平台：http_proxy、https_proxy、all_proxy 和 no_proxy 环境变量
+// 可通过 SetBackend 接入自己的 PAC 引擎；网络切换时由 NimNetworkTransition 清空缓存，代理设置和 WPAD 往往随网络变化。
+// 代理列表只取第一个可用的条目，不在多个代理之间故障转移。
+// 解析在 BackgroundWorkerPool 上执行，线程数为 NimProxyResolverOptions::thread_count。
+class NET_EXPORT NimProxyResolver
+{
+public:
+	// 直连时 proxy 的类型为 kProxyNone
+	typedef std::function<void(const ProxyInfo& proxy)> ResolveCallback;
+	// 在解析线程上同步调用，proxy_list 为 PAC 格式的结果，如 "PROXY 10.0.0.1:8080; SOCKS5 10.0.0.2:1080; DIRECT"
+	// 返回 false 时改用系统设置
+	typedef std::function<bool(const std::string& url, std::string& proxy_list)> Backend;
+
+	static NimProxyResolver* GetInstance();
+
+	void SetOptions(const NimProxyResolverOptions& options);
+	void SetBackend(const Backend& backend);
+
+	// url 为要访问的地址，如 "https://example.com/path"；TCP 连接可传 "https://host:port/"
+	// 命中缓存时在调用线程上同步回调，否则在解析线程上回调；url 无法解析时同步回调直连
+	void Resolve(const std::string& url, const ResolveCallback& callback);
+	// 阻塞等待解析结果，不要在 ResolveCallback 中调用
+	ProxyInfo ResolveSync(const std::string& url);
+
+	void Clear();
+
+	// 解析 PAC 格式（"PROXY h:p; SOCKS5 h:p; DIRECT"）或 WinHTTP 格式（"http=h:p;https=h:p;socks=h:p"）的代理列表，
+	// 返回适用于 scheme 的第一个条目，遇到 DIRECT 或没有可用条目时类型为 kProxyNone
+	static ProxyInfo ParseProxyList(const std::string& proxy_list, const std::string& scheme);
+	// 按 no_proxy 和 WinHTTP 例外列表的写法判断 host 是否直连：逗号、分号或空白分隔，"*" 匹配全部，
+	// "example.com" 与 ".example.com" 匹配该域名及其子域名，支持 "*.example.com"、"10.*" 这样的通配和 "<local>"（不含点的主机名）
+	static bool MatchBypassList(const std::string& bypass_list, const std::string& host);
+
+private:
+	struct CacheEntry
+	{
+		ProxyInfo proxy;
+		std::chrono::steady_clock::time_point expires;
+	};
+	struct Job
+	{
+		std::string key;
+		std::string url;
+		std::string scheme;
+		std::string host;
+		uint64_t generation;
+		std::vector<ResolveCallback> callbacks;
+	};
+
+	NimProxyResolver();
+
+	// 取 url 的 scheme 和 host（均转为小写）及 port，没有端口时按 scheme 取默认端口
+	static bool ParseUrl(const std::string& url, std::string& scheme, std::string& host, int& port);
+	// 读取系统设置，返回 false 表示没能得出结果，按直连处理
+	static bool SystemResolve(const std::string& url, const std::string& scheme, const std::string& host, ProxyInfo& proxy);
+
+	void RunJob(const std::shared_ptr<Job>& job);
+	void CompleteJob(const std::shared_ptr<Job>& job, bool succeed, const ProxyInfo& proxy);
+	// 以下需持有 lock_
+	void StartJobLocked(const std::string& key, const std::string& url, const std::string& scheme, const std::string& host, const ResolveCallback& callback);
+	void TrimLocked();
+
+private:
+	std::mutex lock_;
+	NimProxyResolverOptions options_;
+	NS_EXTENSION::BackgroundWorkerPool workers_;
+	Backend backend_;
+	std::map<std::string, CacheEntry> cache_;
+	std::map<std::string, std::shared_ptr<Job>> inflight_;
+	// Clear 后递增，之前发起的解析结果不再写入缓存
+	uint64_t generation_;
+};
+
+NET_END_DECLS
+#endif // NEWWORK_PROXY_CONFIG_PROXY_RESOLVER_H_
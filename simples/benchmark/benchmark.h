@@ -0,0 +1,232 @@
+﻿// benchmark.h : simples下各基准测试程序共用的计时循环、延迟统计与结果输出
+// 每个场景输出一行JSON，便于脚本收集对比；各程序只需提供自己的场景，用JsonLine拼出结果行
+#ifndef SIMPLES_BENCHMARK_BENCHMARK_H_
+#define SIMPLES_BENCHMARK_BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace benchmark {
+
+inline int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//BENCHMARK_COUNT_OPERATOR_NEW替换的operator new的调用次数，未替换时一直为0
+inline std::atomic<uint64_t> g_new_count(0);
+
+//在全局作用域展开一次，让Run统计每次操作的new_per_op
+#define BENCHMARK_COUNT_OPERATOR_NEW() \
+	void* operator new(size_t size) \
+	{ \
+		benchmark::g_new_count++; \
+		void* ptr = malloc(size == 0 ? 1 : size); \
+		if (ptr == nullptr) \
+			throw std::bad_alloc(); \
+		return ptr; \
+	} \
+	void operator delete(void* ptr) noexcept \
+	{ \
+		free(ptr); \
+	} \
+	void operator delete(void* ptr, size_t) noexcept \
+	{ \
+		free(ptr); \
+	}
+
+//除operator new之外要按次统计的计数，如块池未命中数，|read|返回累计值，输出为|name|_per_op
+struct Counter
+{
+	std::string name;
+	std::function<uint64_t()> read;
+};
+
+struct RunResult
+{
+	RunResult() : ops(0), seconds(0), new_count(0), failed(false) {}
+	double ops_per_s() const { return seconds > 0 ? ops / seconds : 0; }
+	double per_op(uint64_t count) const { return ops > 0 ? (double)count / ops : 0; }
+
+	uint64_t ops;
+	double seconds;
+	uint64_t new_count;
+	//与Run的|counters|一一对应，为计时期间的增量
+	std::vector<std::pair<std::string, uint64_t>> counts;
+	bool failed;
+};
+
+//重复执行|operation|直到超过|min_ms|毫秒，每轮8次；先预热一次，首次调用的初始化不计入
+//|operation|返回bool时，返回false即停止并置failed
+template <class Operation>
+RunResult Run(Operation&& operation, int64_t min_ms, const std::vector<Counter>& counters = std::vector<Counter>())
+{
+	auto call = [&operation]() -> bool {
+		if constexpr (std::is_same<decltype(operation()), bool>::value)
+			return operation();
+		else
+		{
+			operation();
+			return true;
+		}
+	};
+	RunResult result;
+	if (!call())
+	{
+		result.failed = true;
+		return result;
+	}
+	uint64_t new_count = g_new_count;
+	std::vector<uint64_t> begin_counts;
+	for (const Counter& counter : counters)
+		begin_counts.push_back(counter.read());
+	auto begin = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration elapsed;
+	do
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			if (!call())
+			{
+				result.failed = true;
+				return result;
+			}
+			result.ops++;
+		}
+		elapsed = std::chrono::steady_clock::now() - begin;
+	} while (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() < min_ms);
+	result.seconds = std::chrono::duration<double>(elapsed).count();
+	result.new_count = g_new_count - new_count;
+	for (size_t i = 0; i < counters.size(); i++)
+		result.counts.emplace_back(counters[i].name, counters[i].read() - begin_counts[i]);
+	return result;
+}
+
+//单次操作的耗时，单位纳秒，输出时换算为微秒
+class Latencies
+{
+public:
+	void Add(int64_t ns) { values_.push_back(ns); }
+	void AddSince(int64_t begin_ns) { values_.push_back(NowNs() - begin_ns); }
+	void Append(const Latencies& other) { Append(other.values_); }
+	void Append(const std::vector<int64_t>& values) { values_.insert(values_.end(), values.begin(), values.end()); }
+	void Reserve(size_t count) { values_.reserve(count); }
+	size_t size() const { return values_.size(); }
+	bool empty() const { return values_.empty(); }
+	//最近秩，|percentile|为100时即最大值
+	double PercentileUs(double percentile)
+	{
+		if (values_.empty())
+			return 0;
+		size_t rank = std::min(values_.size() - 1, (size_t)(values_.size() * percentile / 100));
+		std::nth_element(values_.begin(), values_.begin() + rank, values_.end());
+		return values_[rank] / 1000.0;
+	}
+
+private:
+	std::vector<int64_t> values_;
+};
+
+//按调用顺序拼出一行JSON对象
+class JsonLine
+{
+public:
+	JsonLine& Add(const char* key, const std::string& value)
+	{
+		Key(key);
+		fields_ += '"';
+		for (char c : value)
+		{
+			if (c == '"' || c == '\\')
+			{
+				fields_ += '\\';
+				fields_ += c;
+			}
+			else if ((unsigned char)c < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+				fields_ += escaped;
+			}
+			else
+				fields_ += c;
+		}
+		fields_ += '"';
+		return *this;
+	}
+	JsonLine& Add(const char* key, const char* value) { return Add(key, std::string(value ? value : "")); }
+	JsonLine& Add(const char* key, bool value)
+	{
+		Key(key);
+		fields_ += value ? "true" : "false";
+		return *this;
+	}
+	template <class T>
+	typename std::enable_if<std::is_arithmetic<T>::value, JsonLine&>::type Add(const char* key, T value)
+	{
+		std::ostringstream stream;
+		stream << value;
+		Key(key);
+		fields_ += stream.str();
+		return *this;
+	}
+	//ops、ops_per_s、new_per_op与各计数的|name|_per_op
+	JsonLine& AddRun(const RunResult& result)
+	{
+		Add("ops", result.ops).Add("ops_per_s", result.ops_per_s()).Add("new_per_op", result.per_op(result.new_count));
+		for (const auto& count : result.counts)
+			Add((count.first + "_per_op").c_str(), result.per_op(count.second));
+		return *this;
+	}
+	//|percentiles|中的100输出为max_us，其余为p<N>_us
+	JsonLine& AddLatencies(Latencies& latencies, std::initializer_list<int> percentiles = { 50, 99, 100 })
+	{
+		for (int percentile : percentiles)
+		{
+			std::string key = percentile == 100 ? "max_us" : "p" + std::to_string(percentile) + "_us";
+			Add(key.c_str(), latencies.PercentileUs(percentile));
+		}
+		return *this;
+	}
+	JsonLine& Append(const JsonLine& other)
+	{
+		if (!other.fields_.empty())
+		{
+			if (!fields_.empty())
+				fields_ += ',';
+			fields_ += other.fields_;
+		}
+		return *this;
+	}
+	void Print() const { std::cout << "{" << fields_ << "}" << std::endl; }
+
+private:
+	void Key(const char* key)
+	{
+		if (!fields_.empty())
+			fields_ += ',';
+		fields_ += '"';
+		fields_ += key;
+		fields_ += "\":";
+	}
+
+	std::string fields_;
+};
+
+} // namespace benchmark
+
+#endif // SIMPLES_BENCHMARK_BENCHMARK_H_
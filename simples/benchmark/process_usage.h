@@ -0,0 +1,54 @@
+﻿// process_usage.h : 基准测试用的进程CPU时间与内存峰值
+// 单独成文件，只有需要的程序才引入windows.h、psapi.h（需链接Psapi.lib）
+#ifndef SIMPLES_BENCHMARK_PROCESS_USAGE_H_
+#define SIMPLES_BENCHMARK_PROCESS_USAGE_H_
+
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace benchmark {
+
+//进程的用户态加内核态CPU时间
+inline int64_t ProcessCpuMicroseconds()
+{
+#ifdef _WIN32
+	FILETIME create_time, exit_time, kernel_time, user_time;
+	if (!GetProcessTimes(GetCurrentProcess(), &create_time, &exit_time, &kernel_time, &user_time))
+		return 0;
+	auto to_us = [](const FILETIME& time) {
+		return (int64_t)((((uint64_t)time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+	};
+	return to_us(kernel_time) + to_us(user_time);
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+//进程启动以来的内存峰值，单位字节
+inline uint64_t PeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+} // namespace benchmark
+
+#endif // SIMPLES_BENCHMARK_PROCESS_USAGE_H_
@@ -0,0 +1,244 @@
+﻿// extension_memory_benchmark.cpp : Pack/Unpack打包解包与BlockBuffer各分配策略的性能测试
+// 用法：extension_memory_benchmark [每个场景的最少运行毫秒数]
+// pack/unpack按几种典型的消息结构测吞吐，fresh模式每次新建PackBuffer，reused模式复用同一个
+// blockbuffer按接收缓冲、增长后清空、短命消息几种追加与删除模式，对比new/delete、malloc/free和块池三种分配器
+// 分配次数分为C++的operator new、BlockBuffer向分配器申请的块和块池未命中后真正的malloc三部分
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <cstdlib>
+#include "extension/memory/packet.h"
+#include "extension/memory/marshal_fields.h"
+#include "extension/memory/blockbuffer.h"
+#include "extension/memory/block_pool_allocator.h"
+#include "simples/benchmark/benchmark.h"
+
+USING_NS_EXTENSION
+
+namespace {
+std::atomic<uint64_t> g_block_alloc_count(0);
+
+//转发给Allocator并计数，用于统计BlockBuffer每次操作申请的块
+template <typename Allocator>
+struct counting_block_allocator
+{
+	enum { requested_size = Allocator::requested_size };
+
+	static char* ordered_malloc(size_t n)
+	{
+		g_block_alloc_count++;
+		return Allocator::ordered_malloc(n);
+	}
+	static void ordered_free(char* const block, size_t n)
+	{
+		Allocator::ordered_free(block, n);
+	}
+};
+
+//协议头这类只有几个定长字段的小包
+struct SmallMessage
+{
+	uint16_t command = 0;
+	uint32_t serial = 0;
+	uint64_t uid = 0;
+	std::string session;
+	PHOENIX_MARSHAL(SmallMessage, command, serial, uid, session)
+};
+
+//消息、用户资料这类字符串和列表为主的中等包
+struct MediumMessage
+{
+	uint64_t id = 0;
+	uint32_t type = 0;
+	uint64_t time = 0;
+	bool read = false;
+	std::string from;
+	std::string to;
+	std::string body;
+	std::vector<uint32_t> tags;
+	PHOENIX_MARSHAL(MediumMessage, id, type, time, read, from, to, body, tags)
+};
+
+//同一结构手写Marshallable，与PHOENIX_MARSHAL生成的代码对比
+struct MediumMarshallable : public Marshallable
+{
+	MediumMessage message;
+
+	virtual void marshal(Pack& p) const override
+	{
+		p << message.id << message.type << message.time << message.read
+			<< message.from << message.to << message.body;
+		marshal_container(p, message.tags);
+	}
+	virtual void unmarshal(const Unpack& up) override
+	{
+		up >> message.id >> message.type >> message.time >> message.read
+			>> message.from >> message.to >> message.body;
+		message.tags.clear();
+		unmarshal_container(up, std::back_inserter(message.tags));
+	}
+};
+
+//文件分片、图片缩略图这类带大块数据的包
+struct LargeMessage
+{
+	uint32_t index = 0;
+	std::string data;
+	PHOENIX_MARSHAL(LargeMessage, index, data)
+};
+
+//在benchmark::Run上加上块的申请次数与|pool_misses|返回的块池累计未命中次数
+benchmark::RunResult Run(const std::function<void()>& operation, int64_t min_ms,
+	const std::function<size_t()>& pool_misses = std::function<size_t()>())
+{
+	return benchmark::Run(operation, min_ms, {
+		{ "block_allocs", []() { return g_block_alloc_count.load(); } },
+		{ "pool_misses", [&pool_misses]() { return pool_misses ? (uint64_t)pool_misses() : 0; } },
+	});
+}
+
+void Report(const char* group, const std::string& name, const char* mode, size_t size, const benchmark::RunResult& result)
+{
+	benchmark::JsonLine()
+		.Add("group", group).Add("case", name).Add("mode", mode).Add("size", size)
+		.AddRun(result)
+		.Add("mb_per_s", result.ops_per_s() * size / (1024.0 * 1024.0))
+		.Print();
+}
+
+template <typename Message>
+std::string PackOnce(const Message& message)
+{
+	PackBuffer buffer;
+	Pack pack(buffer);
+	pack << message;
+	return std::string(pack.data(), pack.size());
+}
+
+//打包fresh/reused两种模式和解包，|size|为打包后的字节数
+template <typename Message>
+void BenchmarkMessage(const std::string& name, const Message& message, int64_t min_ms)
+{
+	std::string packed = PackOnce(message);
+	Report("pack", name, "fresh", packed.size(), Run([&]() {
+		PackBuffer buffer;
+		Pack pack(buffer);
+		pack << message;
+	}, min_ms));
+	PackBuffer reused;
+	Report("pack", name, "reused", packed.size(), Run([&]() {
+		reused.resize(0);
+		Pack pack(reused);
+		pack << message;
+	}, min_ms));
+	Message output;
+	Report("unpack", name, "reused", packed.size(), Run([&]() {
+		Unpack unpack(packed.data(), packed.size());
+		unpack >> output;
+	}, min_ms));
+	Report("unpack", name, "fresh", packed.size(), Run([&]() {
+		Message fresh;
+		Unpack unpack(packed.data(), packed.size());
+		unpack >> fresh;
+	}, min_ms));
+}
+
+void BenchmarkPack(int64_t min_ms)
+{
+	SmallMessage small;
+	small.command = 12;
+	small.serial = 100;
+	small.uid = 1234567890123ULL;
+	small.session.assign(16, 's');
+	BenchmarkMessage("small", small, min_ms);
+
+	MediumMessage medium;
+	medium.id = 9876543210ULL;
+	medium.type = 1;
+	medium.time = 1600000000000ULL;
+	medium.read = true;
+	medium.from.assign(32, 'f');
+	medium.to.assign(32, 't');
+	medium.body.assign(256, 'b');
+	for (uint32_t i = 0; i < 16; i++)
+		medium.tags.push_back(i * 1000);
+	BenchmarkMessage("medium", medium, min_ms);
+
+	MediumMarshallable marshallable;
+	marshallable.message = medium;
+	BenchmarkMessage("medium_marshallable", marshallable, min_ms);
+
+	LargeMessage large;
+	large.index = 3;
+	large.data.assign(64 * 1024, 'd');
+	BenchmarkMessage("large", large, min_ms);
+}
+
+template <typename Allocator>
+void BenchmarkBlockBuffer(const char* allocator_name, int64_t min_ms, const std::function<size_t()>& pool_misses)
+{
+	typedef BlockBuffer<counting_block_allocator<Allocator>, 64> Buffer;
+	std::string chunk(512, 'c');
+
+	//接收缓冲：每次追加512字节，超过8KB后从头部取走4KB
+	Buffer stream;
+	Report("blockbuffer", "stream_append_512", allocator_name, chunk.size(), Run([&]() {
+		stream.append(chunk.data(), chunk.size());
+		if (stream.size() > 8 * 1024)
+			stream.erase(0, 4 * 1024);
+	}, min_ms, pool_misses));
+
+	//一次操作为每次追加256字节直到64KB，再整体清空并释放
+	const size_t kGrowSize = 64 * 1024;
+	Buffer grow;
+	Report("blockbuffer", "grow_64k_clear", allocator_name, kGrowSize, Run([&]() {
+		while (grow.size() < kGrowSize)
+			grow.append(chunk.data(), 256);
+		grow.erase();
+	}, min_ms, pool_misses));
+
+	//同上，清空时保留块
+	Buffer hold;
+	Report("blockbuffer", "grow_64k_clear_hold", allocator_name, kGrowSize, Run([&]() {
+		while (hold.size() < kGrowSize)
+			hold.append(chunk.data(), 256);
+		hold.erase(0, Buffer::npos, true);
+	}, min_ms, pool_misses));
+
+	//短命的小消息：新建缓冲、写入1KB、销毁
+	Report("blockbuffer", "message_1k", allocator_name, 1024, Run([&]() {
+		Buffer message;
+		message.append(chunk.data(), chunk.size());
+		message.append(chunk.data(), chunk.size());
+	}, min_ms, pool_misses));
+
+	//跨块的大消息：新建缓冲、写入12KB、销毁
+	Report("blockbuffer", "message_12k", allocator_name, 12 * 1024, Run([&]() {
+		Buffer message;
+		for (int i = 0; i < 24; i++)
+			message.append(chunk.data(), chunk.size());
+	}, min_ms, pool_misses));
+}
+}
+
+BENCHMARK_COUNT_OPERATOR_NEW()
+
+int main(int argc, char* argv[])
+{
+	int64_t min_ms = argc > 1 ? atoll(argv[1]) : 200;
+	try
+	{
+		BenchmarkPack(min_ms);
+	}
+	catch (const NException& e)
+	{
+		std::cerr << "pack benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+	BenchmarkBlockBuffer<default_block_allocator_new_delete<4 * 1024>>("new_delete_4k", min_ms, std::function<size_t()>());
+	BenchmarkBlockBuffer<default_block_allocator_malloc_free<4 * 1024>>("malloc_free_4k", min_ms, std::function<size_t()>());
+	BenchmarkBlockBuffer<pool_block_alloc_4k>("pool_4k", min_ms, &pool_block_alloc_4k::pool_misses);
+	return 0;
+}
@@ -0,0 +1,410 @@
+﻿// extension_thread_benchmark.cpp : ThreadManager跨线程投递与全局定时器线程的性能测试
+// 用法：extension_thread_benchmark [每个场景的最少运行毫秒数] [最多挂起的定时器数]
+// post按1:1、N:1、1:N投递，统计吞吐和从投递到开始执行的延迟（队列积压时延迟包含排队时间）
+// round_trip为单个任务往返一次的延迟，分别用两次PostTask和PostTaskAndReply实现
+// weak_callback对比直接调用、经WeakCallback调用和投递时包装WeakCallback的开销
+// timer在挂起1万到100万个定时器时测添加和取消的开销，TimerWheel运行在全局定时器线程上，
+// delayed_task为同样数量的PostDelayedTask加WeakCallbackFlag取消，作为对照运行在单独的线程上
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdlib>
+#include "extension/at_exit_manager.h"
+#include "extension/thread/thread_manager.h"
+#include "extension/callback/post_task.h"
+#include "extension/timer/timer_wheel.h"
+#include "simples/benchmark/benchmark.h"
+
+namespace {
+using benchmark::NowNs;
+using benchmark::g_new_count;
+
+const int64_t kProducerThreadBase = 100;
+const int64_t kConsumerThreadBase = 200;
+const int64_t kDelayedTaskThread = 300;
+const int kMaxThreads = 4;
+const int kTasksPerBatch = 10000;
+const int kRoundTripsPerBatch = 1000;
+const size_t kTimerProbes = 10000;
+
+//计数到0时唤醒Wait，CountDown只在最后一次时加锁
+class Latch
+{
+public:
+	explicit Latch(int64_t count) : count_(count) {}
+	void CountDown()
+	{
+		if (count_.fetch_sub(1) != 1)
+			return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		cv_.notify_all();
+	}
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this]() { return count_.load() == 0; });
+	}
+
+private:
+	std::atomic<int64_t> count_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+};
+
+//消费线程上执行的任务只写自己的latencies，Latch返回后由主线程读取
+struct Consumer
+{
+	int64_t identifier;
+	std::vector<int64_t> latencies;
+	NS_EXTENSION::WeakCallbackFlag flag;
+};
+
+//投递与往返场景另外记下每个任务的延迟
+struct BenchmarkResult : public benchmark::RunResult
+{
+	benchmark::Latencies latencies;
+};
+
+void Report(const char* group, const std::string& name, int threads, const benchmark::RunResult& result,
+	benchmark::Latencies* latencies = nullptr)
+{
+	benchmark::JsonLine line;
+	line.Add("group", group).Add("case", name).Add("threads", threads)
+		.AddRun(result)
+		.Add("ns_per_op", result.ops > 0 ? result.seconds * 1e9 / result.ops : 0);
+	if (latencies != nullptr && !latencies->empty())
+		line.AddLatencies(*latencies);
+	line.Print();
+}
+
+void Report(const char* group, const std::string& name, int threads, BenchmarkResult& result)
+{
+	Report(group, name, threads, result, &result.latencies);
+}
+
+void ReportTimer(const std::string& name, size_t pending, uint64_t ops, int64_t elapsed_ns, uint64_t new_count)
+{
+	benchmark::JsonLine()
+		.Add("group", "timer").Add("case", name).Add("pending", pending)
+		.Add("ops", ops)
+		.Add("ns_per_op", ops > 0 ? (double)elapsed_ns / ops : 0)
+		.Add("new_per_op", ops > 0 ? (double)new_count / ops : 0)
+		.Print();
+}
+
+class ThreadPool
+{
+public:
+	ThreadPool()
+	{
+		for (int i = 0; i < kMaxThreads; i++)
+		{
+			producers_.emplace_back(NS_EXTENSION::ThreadManager::CreateFrameworkThread(kProducerThreadBase + i, "producer"));
+			producers_.back()->Start();
+			std::unique_ptr<Consumer> consumer(new Consumer);
+			consumer->identifier = kConsumerThreadBase + i;
+			//先在主线程上创建WeakFlag，之后各生产线程只复制
+			consumer->flag.GetWeakFlag();
+			consumers_.push_back(std::move(consumer));
+			consumer_threads_.emplace_back(NS_EXTENSION::ThreadManager::CreateFrameworkThread(kConsumerThreadBase + i, "consumer"));
+			consumer_threads_.back()->Start();
+		}
+		for (auto& thread : producers_)
+			thread->WaitUntilThreadStarted();
+		for (auto& thread : consumer_threads_)
+			thread->WaitUntilThreadStarted();
+	}
+	~ThreadPool()
+	{
+		for (auto& thread : producers_)
+			thread->Stop();
+		for (auto& thread : consumer_threads_)
+			thread->Stop();
+	}
+	Consumer* consumer(int index) { return consumers_[index].get(); }
+
+private:
+	std::vector<std::unique_ptr<NS_EXTENSION::FrameworkThread>> producers_;
+	std::vector<std::unique_ptr<NS_EXTENSION::FrameworkThread>> consumer_threads_;
+	std::vector<std::unique_ptr<Consumer>> consumers_;
+};
+
+//|producers|个生产线程各投递kTasksPerBatch/producers个任务，依次轮流投给|consumers|个消费线程；
+//|weak|为true时每个任务用消费者的WeakCallbackFlag包装
+BenchmarkResult RunPost(ThreadPool& pool, int producers, int consumers, bool weak, int64_t min_ms)
+{
+	BenchmarkResult result;
+	int tasks_per_producer = kTasksPerBatch / producers;
+	int64_t tasks = (int64_t)tasks_per_producer * producers;
+	auto run_batch = [&]() {
+		for (int i = 0; i < consumers; i++)
+		{
+			pool.consumer(i)->latencies.clear();
+			pool.consumer(i)->latencies.reserve(tasks);
+		}
+		Latch done(tasks);
+		Latch* latch = &done;
+		for (int p = 0; p < producers; p++)
+		{
+			NS_EXTENSION::ThreadManager::PostTask(kProducerThreadBase + p, [&pool, latch, p, consumers, tasks_per_producer, weak]() {
+				for (int i = 0; i < tasks_per_producer; i++)
+				{
+					Consumer* consumer = pool.consumer((p + i) % consumers);
+					int64_t posted = NowNs();
+					auto task = [consumer, latch, posted]() {
+						consumer->latencies.push_back(NowNs() - posted);
+						latch->CountDown();
+					};
+					if (weak)
+						NS_EXTENSION::ThreadManager::PostTask(consumer->identifier, consumer->flag.ToWeakCallback(std::move(task)));
+					else
+						NS_EXTENSION::ThreadManager::PostTask(consumer->identifier, std::move(task));
+				}
+			});
+		}
+		done.Wait();
+	};
+	//预热一批，首次投递的初始化不计入
+	run_batch();
+	int64_t begin = NowNs();
+	int64_t elapsed = 0;
+	do
+	{
+		uint64_t new_count = g_new_count;
+		int64_t batch_begin = NowNs();
+		run_batch();
+		elapsed += NowNs() - batch_begin;
+		result.new_count += g_new_count - new_count;
+		result.ops += tasks;
+		for (int i = 0; i < consumers; i++)
+			result.latencies.Append(pool.consumer(i)->latencies);
+	} while (NowNs() - begin < min_ms * 1000000);
+	//只计批次本身，不含复制延迟数据的时间
+	result.seconds = elapsed / 1e9;
+	return result;
+}
+
+//生产线程0与消费线程0之间一来一回，上一次回来后才开始下一次
+struct RoundTripState
+{
+	explicit RoundTripState(bool reply) : use_reply(reply), remaining(0), start(0), done(nullptr) {}
+	void Reset(int64_t count, Latch* latch)
+	{
+		remaining = count;
+		done = latch;
+		latencies.clear();
+		latencies.reserve(count);
+	}
+	bool use_reply;
+	int64_t remaining;
+	int64_t start;
+	std::vector<int64_t> latencies;
+	Latch* done;
+};
+
+void StartRoundTrip(RoundTripState* state);
+
+void FinishRoundTrip(RoundTripState* state)
+{
+	state->latencies.push_back(NowNs() - state->start);
+	if (--state->remaining > 0)
+		StartRoundTrip(state);
+	else
+		state->done->CountDown();
+}
+
+void StartRoundTrip(RoundTripState* state)
+{
+	state->start = NowNs();
+	if (state->use_reply)
+	{
+		NS_EXTENSION::ThreadManager::PostTaskAndReply(kConsumerThreadBase, []() {}, [state]() {
+			FinishRoundTrip(state);
+		});
+	}
+	else
+	{
+		NS_EXTENSION::ThreadManager::PostTask(kConsumerThreadBase, [state]() {
+			NS_EXTENSION::ThreadManager::PostTask(kProducerThreadBase, [state]() {
+				FinishRoundTrip(state);
+			});
+		});
+	}
+}
+
+BenchmarkResult RunRoundTrip(bool use_reply, int64_t min_ms)
+{
+	BenchmarkResult result;
+	RoundTripState state(use_reply);
+	auto run_batch = [&state]() {
+		Latch done(1);
+		state.Reset(kRoundTripsPerBatch, &done);
+		RoundTripState* state_ptr = &state;
+		NS_EXTENSION::ThreadManager::PostTask(kProducerThreadBase, [state_ptr]() {
+			StartRoundTrip(state_ptr);
+		});
+		done.Wait();
+	};
+	run_batch();
+	int64_t begin = NowNs();
+	int64_t elapsed = 0;
+	do
+	{
+		uint64_t new_count = g_new_count;
+		int64_t batch_begin = NowNs();
+		run_batch();
+		elapsed += NowNs() - batch_begin;
+		result.new_count += g_new_count - new_count;
+		result.ops += kRoundTripsPerBatch;
+		result.latencies.Append(state.latencies);
+	} while (NowNs() - begin < min_ms * 1000000);
+	//只计批次本身，不含复制延迟数据的时间
+	result.seconds = elapsed / 1e9;
+	return result;
+}
+
+void BenchmarkPost(int64_t min_ms)
+{
+	ThreadPool pool;
+	BenchmarkResult result = RunPost(pool, 1, 1, false, min_ms);
+	Report("post", "1to1", 2, result);
+	for (int n = 2; n <= kMaxThreads; n *= 2)
+	{
+		result = RunPost(pool, n, 1, false, min_ms);
+		Report("post", std::to_string(n) + "to1", n + 1, result);
+		result = RunPost(pool, 1, n, false, min_ms);
+		Report("post", "1to" + std::to_string(n), n + 1, result);
+	}
+	result = RunRoundTrip(false, min_ms);
+	Report("round_trip", "post_task_twice", 2, result);
+	result = RunRoundTrip(true, min_ms);
+	Report("round_trip", "post_task_and_reply", 2, result);
+	result = RunPost(pool, 1, 1, true, min_ms);
+	Report("weak_callback", "post_1to1", 2, result);
+}
+
+void BenchmarkWeakCallback(int64_t min_ms)
+{
+	NS_EXTENSION::WeakCallbackFlag flag;
+	int64_t value = 0;
+	auto increment = [&value]() { value++; };
+	StdClosure plain = increment;
+	StdClosure weak = flag.ToWeakCallback(increment);
+	NS_EXTENSION::WeakCallbackFlag cancelled_flag;
+	StdClosure cancelled = cancelled_flag.ToWeakCallback(increment);
+	cancelled_flag.Cancel();
+
+	Report("weak_callback", "call_plain", 1, benchmark::Run([&]() { plain(); }, min_ms));
+	Report("weak_callback", "call_weak", 1, benchmark::Run([&]() { weak(); }, min_ms));
+	Report("weak_callback", "call_cancelled", 1, benchmark::Run([&]() { cancelled(); }, min_ms));
+	Report("weak_callback", "wrap_plain", 1, benchmark::Run([&]() { StdClosure closure(increment); closure(); }, min_ms));
+	Report("weak_callback", "wrap_weak", 1,
+		benchmark::Run([&]() { StdClosure closure(flag.ToWeakCallback(increment)); closure(); }, min_ms));
+}
+
+//定时器的到期时间分散在1秒到1小时之间，测试期间都不会触发
+NS_EXTENSION::TimeDelta TimerDelay(size_t index)
+{
+	return NS_EXTENSION::TimeDelta::FromMilliseconds(1000 + (int64_t)(index * 7919 % 3599000));
+}
+
+void BenchmarkTimerWheel(size_t pending)
+{
+	NS_EXTENSION::TimerWheel* wheel = NS_EXTENSION::TimerWheel::GetInstance();
+	std::vector<NS_EXTENSION::TimerWheel::TimerId> ids;
+	ids.reserve(pending);
+	uint64_t new_count = g_new_count;
+	int64_t begin = NowNs();
+	for (size_t i = 0; i < pending; i++)
+		ids.push_back(wheel->Schedule(TimerDelay(i), []() {}));
+	ReportTimer("wheel_schedule", pending, pending, NowNs() - begin, g_new_count - new_count);
+
+	//已有pending个定时器时再添加一个随即取消，即请求超时的常见用法
+	new_count = g_new_count;
+	begin = NowNs();
+	for (size_t i = 0; i < kTimerProbes; i++)
+		wheel->Cancel(wheel->Schedule(TimerDelay(i), []() {}));
+	ReportTimer("wheel_schedule_cancel", pending, kTimerProbes, NowNs() - begin, g_new_count - new_count);
+
+	new_count = g_new_count;
+	begin = NowNs();
+	for (NS_EXTENSION::TimerWheel::TimerId id : ids)
+		wheel->Cancel(id);
+	ReportTimer("wheel_cancel", pending, pending, NowNs() - begin, g_new_count - new_count);
+}
+
+//定时器线程处理完之前投递的任务（延迟任务已进入其优先队列）后返回
+void WaitForIdle(NS_EXTENSION::FrameworkThread* thread)
+{
+	Latch done(1);
+	Latch* latch = &done;
+	NS_EXTENSION::PostTask(thread->task_runner().get(), FROM_HERE, [latch]() { latch->CountDown(); });
+	done.Wait();
+}
+
+void BenchmarkDelayedTask(size_t pending)
+{
+	//每个级别用一个新线程，退出时连同挂起的延迟任务一起销毁，不影响下一个级别
+	std::unique_ptr<NS_EXTENSION::FrameworkThread> thread(
+		NS_EXTENSION::ThreadManager::CreateFrameworkThread(kDelayedTaskThread, "delayed_task_timer"));
+	thread->Start();
+	thread->WaitUntilThreadStarted();
+	std::vector<NS_EXTENSION::WeakCallbackFlag> flags(pending + kTimerProbes);
+	auto task_runner = thread->task_runner();
+
+	//包括定时器线程把延迟任务放进优先队列的时间
+	uint64_t new_count = g_new_count;
+	int64_t begin = NowNs();
+	for (size_t i = 0; i < pending; i++)
+		NS_EXTENSION::PostDelayedTask(task_runner.get(), FROM_HERE, flags[i].ToWeakCallback([]() {}), TimerDelay(i));
+	WaitForIdle(thread.get());
+	ReportTimer("delayed_task_schedule", pending, pending, NowNs() - begin, g_new_count - new_count);
+
+	//取消只是让回调失效，任务仍留在队列中直到到期
+	new_count = g_new_count;
+	begin = NowNs();
+	for (size_t i = pending; i < pending + kTimerProbes; i++)
+	{
+		NS_EXTENSION::PostDelayedTask(task_runner.get(), FROM_HERE, flags[i].ToWeakCallback([]() {}), TimerDelay(i));
+		flags[i].Cancel();
+	}
+	WaitForIdle(thread.get());
+	ReportTimer("delayed_task_schedule_cancel", pending, kTimerProbes, NowNs() - begin, g_new_count - new_count);
+
+	new_count = g_new_count;
+	begin = NowNs();
+	for (size_t i = 0; i < pending; i++)
+		flags[i].Cancel();
+	ReportTimer("delayed_task_cancel", pending, pending, NowNs() - begin, g_new_count - new_count);
+	thread->Stop();
+}
+
+void BenchmarkTimer(size_t max_pending)
+{
+	for (size_t pending = 10000; pending <= max_pending; pending *= 10)
+	{
+		BenchmarkTimerWheel(pending);
+		BenchmarkDelayedTask(pending);
+	}
+}
+}
+
+BENCHMARK_COUNT_OPERATOR_NEW()
+
+int main(int argc, char* argv[])
+{
+	int64_t min_ms = argc > 1 ? atoll(argv[1]) : 200;
+	size_t max_pending = argc > 2 ? (size_t)atoll(argv[2]) : 1000000;
+	NS_EXTENSION::AtExitManager at_exit = NS_EXTENSION::AtExitManagerAdeptor::GetAtExitManager();
+	std::shared_ptr<NS_EXTENSION::FrameworkThread> global_timer_thread = NS_EXTENSION::ThreadManager::GlobalTimerThreadRef();
+	BenchmarkPost(min_ms);
+	BenchmarkWeakCallback(min_ms);
+	BenchmarkTimer(max_pending);
+	global_timer_thread.reset();
+	at_exit.reset();
+	return 0;
+}
@@ -0,0 +1,767 @@
+﻿// net_socket_benchmark.cpp : google_net套接字层在回环地址上的吞吐与延迟测试
+// 用法：net_socket_benchmark [每个连接的消息数]
+// 在本进程内启动TCP回显、UDP回显和可靠UDP回显服务器，用TcpClientSocket的三种后端
+// （tinyNET、libuv、可靠UDP）以及UDPClientImpl、UVUDPClientImpl连接，按消息大小、连接数、
+// 在途窗口、是否开启发送队列（TCP）或批量接收（tinyNET UDP）组合出场景
+// 窗口为1时一问一答，测的是往返延迟；窗口较大时测的是吞吐，延迟中包含排队时间
+// UDP报文发出1秒还没有回来算作丢失；CPU统计包含服务器线程
+// 结果用于对比接收缓冲区、发送队列与引擎的改动
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+typedef SOCKET SocketHandle;
+#define CloseSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET (-1)
+#define CloseSocket close
+#endif
+#include "extension/at_exit_manager.h"
+#include "net/base/network_interfaces.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/socket/socket_wrapper.h"
+#include "net/socket/uv_socket_wrapper.h"
+#include "net/socket/reliable_udp_session.h"
+#include "simples/benchmark/benchmark.h"
+#include "simples/benchmark/process_usage.h"
+
+namespace {
+enum Transport
+{
+	kTransportTcpTinyNet = 0,
+	kTransportTcpUV,
+	kTransportReliableUdp,
+	kTransportUdpTinyNet,
+	kTransportUdpUV,
+};
+struct BenchmarkCase
+{
+	Transport transport;
+	int connections;
+	size_t message_size;
+	int window;
+	bool send_queue;
+	bool batch_receive;
+};
+struct BenchmarkResult
+{
+	BenchmarkResult() : connected(false), seconds(0), messages(0), lost(0), cpu_us_per_message(0) {}
+	bool connected;
+	double seconds;
+	int64_t messages;
+	int64_t lost;
+	benchmark::Latencies latencies;
+	double cpu_us_per_message;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+bool BindLoopback(SocketHandle socket_handle, int& port)
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	socklen_t length = sizeof(address);
+	if (bind(socket_handle, (sockaddr*)&address, sizeof(address)) != 0
+		|| getsockname(socket_handle, (sockaddr*)&address, &length) != 0)
+		return false;
+	port = ntohs(address.sin_port);
+	return true;
+}
+
+//TCP回显服务器，每个连接一个线程，收到什么发回什么
+class TcpEchoServer
+{
+public:
+	TcpEchoServer() : listen_socket_(INVALID_SOCKET), port_(0) {}
+	bool Start()
+	{
+		listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket_ == INVALID_SOCKET)
+			return false;
+		if (!BindLoopback(listen_socket_, port_) || listen(listen_socket_, SOMAXCONN) != 0)
+			return false;
+		std::thread([this]() { AcceptLoop(); }).detach();
+		return true;
+	}
+	int port() const { return port_; }
+
+private:
+	void AcceptLoop()
+	{
+		while (true)
+		{
+			SocketHandle client = accept(listen_socket_, NULL, NULL);
+			if (client == INVALID_SOCKET)
+				return;
+			int no_delay = 1;
+			setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+			std::thread([client]() { ServeConnection(client); }).detach();
+		}
+	}
+	static void ServeConnection(SocketHandle client)
+	{
+		char chunk[64 * 1024];
+		while (true)
+		{
+			int received = recv(client, chunk, sizeof(chunk), 0);
+			if (received <= 0)
+				break;
+			int sent = 0;
+			while (sent < received)
+			{
+				int count = send(client, chunk + sent, received - sent, 0);
+				if (count <= 0)
+					break;
+				sent += count;
+			}
+			if (sent < received)
+				break;
+		}
+		CloseSocket(client);
+	}
+
+	SocketHandle listen_socket_;
+	int port_;
+};
+
+//UDP回显服务器，一个线程处理所有客户端
+class UdpEchoServer
+{
+public:
+	UdpEchoServer() : socket_(INVALID_SOCKET), port_(0) {}
+	bool Start()
+	{
+		socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (socket_ == INVALID_SOCKET)
+			return false;
+		//多个连接的窗口同时到达时不在服务器这边丢包
+		int buffer_size = 4 * 1024 * 1024;
+		setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+		if (!BindLoopback(socket_, port_))
+			return false;
+		std::thread([this]() { ServeLoop(); }).detach();
+		return true;
+	}
+	int port() const { return port_; }
+
+private:
+	void ServeLoop()
+	{
+		char datagram[64 * 1024];
+		while (true)
+		{
+			sockaddr_in peer;
+			socklen_t length = sizeof(peer);
+			int received = recvfrom(socket_, datagram, sizeof(datagram), 0, (sockaddr*)&peer, &length);
+			if (received < 0)
+				continue;
+			sendto(socket_, datagram, received, 0, (sockaddr*)&peer, length);
+		}
+	}
+
+	SocketHandle socket_;
+	int port_;
+};
+
+//可靠UDP回显服务器，每个客户端地址一个被动的ReliableUdpSession，由一个线程收包并驱动重传
+class ReliableUdpEchoServer
+{
+public:
+	ReliableUdpEchoServer() : socket_(INVALID_SOCKET), port_(0), epoch_(Clock::now()) {}
+	bool Start()
+	{
+		socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (socket_ == INVALID_SOCKET)
+			return false;
+		int buffer_size = 4 * 1024 * 1024;
+		setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+		if (!BindLoopback(socket_, port_))
+			return false;
+		std::thread([this]() { ServeLoop(); }).detach();
+		return true;
+	}
+	int port() const { return port_; }
+
+private:
+	typedef net::internal::ReliableUdpSession Session;
+
+	uint32_t NowMs() const
+	{
+		return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch_).count();
+	}
+	Session* FindSession(const sockaddr_in& peer, uint32_t now)
+	{
+		uint64_t key = ((uint64_t)peer.sin_addr.s_addr << 16) | peer.sin_port;
+		auto iter = sessions_.find(key);
+		if (iter != sessions_.end() && iter->second->state() != Session::kStateClosed)
+			return iter->second.get();
+		SocketHandle socket_handle = socket_;
+		std::unique_ptr<Session> session(new Session(0, [socket_handle, peer](const char *data, size_t size) {
+			return sendto(socket_handle, data, (int)size, 0, (const sockaddr*)&peer, sizeof(peer)) == (int)size;
+		}));
+		session->Accept(now);
+		Session* result = session.get();
+		sessions_[key] = std::move(session);
+		return result;
+	}
+	void ServeLoop()
+	{
+		char datagram[64 * 1024];
+		std::string received;
+		while (true)
+		{
+			//等到最近一个会话需要重传的时候，最多10ms
+			uint32_t now = NowMs();
+			uint32_t wait_ms = 10;
+			for (auto& item : sessions_)
+			{
+				uint32_t when_ms;
+				if (item.second->NextUpdate(now, when_ms))
+					wait_ms = std::min(wait_ms, when_ms > now ? when_ms - now : 0);
+			}
+			fd_set read_set;
+			FD_ZERO(&read_set);
+			FD_SET(socket_, &read_set);
+			timeval timeout;
+			timeout.tv_sec = 0;
+			timeout.tv_usec = wait_ms * 1000;
+			if (select((int)socket_ + 1, &read_set, NULL, NULL, &timeout) > 0)
+			{
+				sockaddr_in peer;
+				socklen_t length = sizeof(peer);
+				int size = recvfrom(socket_, datagram, sizeof(datagram), 0, (sockaddr*)&peer, &length);
+				if (size > 0)
+				{
+					now = NowMs();
+					Session* session = FindSession(peer, now);
+					if (session->Input(datagram, size, now))
+					{
+						received.clear();
+						session->Recv(received);
+						if (!received.empty())
+							session->Send(received.data(), received.size());
+					}
+					session->Update(now);
+				}
+			}
+			now = NowMs();
+			for (auto iter = sessions_.begin(); iter != sessions_.end();)
+			{
+				if (iter->second->state() == Session::kStateClosed)
+				{
+					iter = sessions_.erase(iter);
+					continue;
+				}
+				uint32_t when_ms;
+				if (iter->second->NextUpdate(now, when_ms) && when_ms <= now)
+					iter->second->Update(now);
+				++iter;
+			}
+		}
+	}
+
+	SocketHandle socket_;
+	int port_;
+	Clock::time_point epoch_;
+	std::map<uint64_t, std::unique_ptr<Session>> sessions_;
+};
+
+//所有连接共享的完成计数，主线程在上面等待
+struct RunState
+{
+	RunState() : finished(0), target(0) {}
+	void OnFinished()
+	{
+		if (++finished >= target)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_one();
+		}
+	}
+	std::atomic<int64_t> finished;
+	int64_t target;
+	std::mutex mutex;
+	std::condition_variable done;
+};
+
+//一个客户端连接，保持|window|条消息在途，一条回来后在接收线程上发出下一条
+//每条消息的前8字节是它的序号，UDP按序号对应发送时间，TCP字节流按到达顺序对应
+class BenchmarkConnection
+{
+public:
+	BenchmarkConnection(const BenchmarkCase& bench_case, int message_count, RunState* state) :
+		message_size_(std::max(bench_case.message_size, sizeof(uint64_t))), window_(bench_case.window),
+		message_count_(message_count), state_(state), message_(message_size_, 'x'),
+		send_times_(message_count), finished_(message_count), latencies_(message_count, -1),
+		issued_(0), lost_(0), oldest_(0)
+	{
+		for (auto& finished : finished_)
+			finished = false;
+	}
+	virtual ~BenchmarkConnection() {}
+
+	virtual bool Connect(int port) = 0;
+	virtual void Close() = 0;
+
+	void Start()
+	{
+		for (int i = 0; i < window_; i++)
+			IssueNext();
+	}
+	//把发出超过|timeout_us|还没有回来的消息算作丢失，补发新消息保持窗口
+	void ExpireLost(int64_t timeout_us)
+	{
+		int64_t deadline = benchmark::NowNs() - timeout_us * 1000;
+		int issued = std::min(issued_.load(), message_count_);
+		for (int i = oldest_; i < issued; i++)
+		{
+			if (finished_[i])
+			{
+				if (i == oldest_)
+					oldest_++;
+				continue;
+			}
+			if (send_times_[i] > deadline)
+				break;
+			if (!finished_[i].exchange(true))
+			{
+				lost_++;
+				state_->OnFinished();
+				IssueNext();
+			}
+		}
+	}
+	int64_t lost() const { return lost_; }
+	void CollectLatencies(benchmark::Latencies& latencies) const
+	{
+		for (int64_t latency : latencies_)
+		{
+			if (latency >= 0)
+				latencies.Add(latency);
+		}
+	}
+
+protected:
+	virtual bool WriteMessage(const char *data, size_t size) = 0;
+
+	void OnMessage(uint64_t index)
+	{
+		if (index >= (uint64_t)message_count_ || finished_[index].exchange(true))
+			return;
+		latencies_[index] = benchmark::NowNs() - send_times_[index];
+		state_->OnFinished();
+		IssueNext();
+	}
+	size_t message_size() const { return message_size_; }
+
+private:
+	void IssueNext()
+	{
+		//序号在锁内分配，TCP上写入的先后与序号一致
+		std::lock_guard<std::mutex> lock(write_lock_);
+		int index = issued_;
+		if (index >= message_count_)
+			return;
+		uint64_t sequence = (uint64_t)index;
+		memcpy(&message_[0], &sequence, sizeof(sequence));
+		//先记下发送时间再计入已发出，ExpireLost只看已发出的消息
+		send_times_[index] = benchmark::NowNs();
+		issued_++;
+		if (!WriteMessage(message_.data(), message_.size()))
+		{
+			//发送失败的消息不会回来，直接算作丢失
+			if (!finished_[index].exchange(true))
+			{
+				lost_++;
+				state_->OnFinished();
+			}
+		}
+	}
+
+	size_t message_size_;
+	int window_;
+	int message_count_;
+	RunState *state_;
+	std::mutex write_lock_;
+	std::string message_;
+	std::vector<std::atomic<int64_t>> send_times_;
+	std::vector<std::atomic<bool>> finished_;
+	//单位纳秒，每个元素只被对应消息的接收回调写入，结束后主线程读取
+	std::vector<int64_t> latencies_;
+	std::atomic<int> issued_;
+	std::atomic<int64_t> lost_;
+	//只在主线程访问
+	int oldest_;
+};
+
+//TcpClientSocket的一个连接，三种后端都是字节流
+class TcpConnection : public BenchmarkConnection, public net::TcpClientHandler
+{
+public:
+	TcpConnection(const BenchmarkCase& bench_case, int message_count, RunState* state) :
+		BenchmarkConnection(bench_case, message_count, state), socket_(BackendOf(bench_case.transport)),
+		send_queue_(bench_case.send_queue), connect_result_(kConnecting), received_bytes_(0), received_messages_(0) {}
+
+	virtual bool Connect(int port) override
+	{
+		socket_.RegisterCallback(this);
+		net::TcpSocketOptions options;
+		options.no_delay = true;
+		socket_.SetSocketOptions(options);
+		if (send_queue_)
+			socket_.SetSendQueue(net::SendQueueOptions());
+		if (!socket_.Init("127.0.0.1", port))
+			return false;
+		std::unique_lock<std::mutex> lock(connect_lock_);
+		connected_.wait_for(lock, std::chrono::seconds(5), [this]() { return connect_result_ != kConnecting; });
+		return connect_result_ == kConnected;
+	}
+	virtual void Close() override
+	{
+		socket_.UnregisterCallback();
+		socket_.Close();
+	}
+
+	virtual void OnClose(int error_code) override {}
+	virtual void OnConnect(int error_code) override
+	{
+		std::lock_guard<std::mutex> lock(connect_lock_);
+		connect_result_ = error_code == ERROR_SUCCESS ? kConnected : kFailed;
+		connected_.notify_one();
+	}
+	virtual void OnReceive(int error_code, const void *data, size_t size) override
+	{
+		if (error_code != NO_ERROR)
+			return;
+		received_bytes_ += size;
+		while (received_bytes_ >= (received_messages_ + 1) * message_size())
+			OnMessage(received_messages_++);
+	}
+	virtual void OnSend(int error_code) override {}
+
+protected:
+	virtual bool WriteMessage(const char *data, size_t size) override
+	{
+		if (send_queue_)
+			return socket_.Send(data, size);
+		//不开发送队列时Write可能只写出一部分，写满时稍后重试
+		size_t written = 0;
+		while (written < size)
+		{
+			int count = socket_.Write(data + written, size - written);
+			if (count == SOCKET_ERROR)
+				return false;
+			if (count == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			written += count;
+		}
+		return true;
+	}
+
+private:
+	enum ConnectResult
+	{
+		kConnecting,
+		kConnected,
+		kFailed,
+	};
+	static net::SocketBackend BackendOf(Transport transport)
+	{
+		switch (transport)
+		{
+		case kTransportTcpUV: return net::kSocketBackendUV;
+		case kTransportReliableUdp: return net::kSocketBackendReliableUDP;
+		default: return net::kSocketBackendTinyNet;
+		}
+	}
+
+	net::TcpClientSocket socket_;
+	bool send_queue_;
+	std::mutex connect_lock_;
+	std::condition_variable connected_;
+	ConnectResult connect_result_;
+	//只在接收线程访问
+	uint64_t received_bytes_;
+	uint64_t received_messages_;
+};
+
+void EnableBatchReceive(net::internal::UDPClientImpl& client, bool enable)
+{
+	if (enable)
+		client.SetBatchReceive(32);
+}
+void EnableBatchReceive(net::internal::UVUDPClientImpl& client, bool enable)
+{
+}
+
+//UDPClientImpl或UVUDPClientImpl的一个连接，按报文中的序号对应消息
+template <typename ClientType>
+class UdpConnection : public BenchmarkConnection, public net::UdpClientHandler
+{
+public:
+	UdpConnection(const BenchmarkCase& bench_case, int message_count, RunState* state) :
+		BenchmarkConnection(bench_case, message_count, state), client_(std::make_shared<ClientType>()),
+		batch_receive_(bench_case.batch_receive) {}
+
+	virtual bool Connect(int port) override
+	{
+		client_->SetHandler(this);
+		EnableBatchReceive(*client_, batch_receive_);
+		if (!client_->Init("127.0.0.1", port))
+			return false;
+		//libuv实现在事件循环上异步连接
+		auto deadline = Clock::now() + std::chrono::seconds(5);
+		while (!client_->IsConnected() && Clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return client_->IsConnected();
+	}
+	virtual void Close() override
+	{
+		client_->SetHandler(nullptr);
+		client_->Close();
+	}
+
+	virtual void OnClose(int error_code) override {}
+	virtual void OnConnect(int error_code) override {}
+	virtual void OnReceive(int error_code, const void *data, size_t size) override
+	{
+		uint64_t index;
+		if (error_code != NO_ERROR || size < sizeof(index))
+			return;
+		memcpy(&index, data, sizeof(index));
+		OnMessage(index);
+	}
+
+protected:
+	virtual bool WriteMessage(const char *data, size_t size) override
+	{
+		//发送缓冲区满时报文在内核里被丢弃也一样算作丢失，这里只区分出错
+		return client_->Write(data, size) != SOCKET_ERROR;
+	}
+
+private:
+	std::shared_ptr<ClientType> client_;
+	bool batch_receive_;
+};
+
+bool IsUdpTransport(Transport transport)
+{
+	return transport == kTransportUdpTinyNet || transport == kTransportUdpUV;
+}
+
+class BenchmarkRun
+{
+public:
+	BenchmarkRun(const BenchmarkCase& bench_case, int port, int message_count) :
+		bench_case_(bench_case), port_(port), message_count_(message_count)
+	{
+		state_.target = (int64_t)message_count * bench_case.connections;
+		for (int i = 0; i < bench_case.connections; i++)
+			connections_.push_back(CreateConnection());
+	}
+	~BenchmarkRun()
+	{
+		for (auto& connection : connections_)
+			connection->Close();
+	}
+	BenchmarkResult Run()
+	{
+		BenchmarkResult result;
+		for (auto& connection : connections_)
+		{
+			if (!connection->Connect(port_))
+				return result;
+		}
+		result.connected = true;
+
+		int64_t cpu_begin = benchmark::ProcessCpuMicroseconds();
+		auto begin = Clock::now();
+		for (auto& connection : connections_)
+			connection->Start();
+		{
+			std::unique_lock<std::mutex> lock(state_.mutex);
+			int64_t last_finished = -1;
+			while (state_.finished < state_.target)
+			{
+				state_.done.wait_for(lock, std::chrono::milliseconds(100));
+				if (state_.finished >= state_.target)
+					break;
+				if (IsUdpTransport(bench_case_.transport))
+				{
+					lock.unlock();
+					for (auto& connection : connections_)
+						connection->ExpireLost(1000 * 1000);
+					lock.lock();
+				}
+				else if (state_.finished == last_finished
+					&& Clock::now() - begin > std::chrono::seconds(60))
+				{
+					//可靠传输不应丢消息，卡住一分钟时放弃这个场景
+					break;
+				}
+				last_finished = state_.finished;
+			}
+		}
+		auto end = Clock::now();
+		int64_t cpu_end = benchmark::ProcessCpuMicroseconds();
+
+		for (auto& connection : connections_)
+		{
+			connection->CollectLatencies(result.latencies);
+			result.lost += connection->lost();
+		}
+		result.seconds = std::chrono::duration<double>(end - begin).count();
+		result.messages = (int64_t)result.latencies.size();
+		result.lost += state_.target - state_.finished;
+		result.cpu_us_per_message = result.messages > 0 ? (double)(cpu_end - cpu_begin) / result.messages : 0;
+		return result;
+	}
+
+private:
+	std::unique_ptr<BenchmarkConnection> CreateConnection()
+	{
+		switch (bench_case_.transport)
+		{
+		case kTransportUdpTinyNet:
+			return std::unique_ptr<BenchmarkConnection>(
+				new UdpConnection<net::internal::UDPClientImpl>(bench_case_, message_count_, &state_));
+		case kTransportUdpUV:
+			return std::unique_ptr<BenchmarkConnection>(
+				new UdpConnection<net::internal::UVUDPClientImpl>(bench_case_, message_count_, &state_));
+		default:
+			return std::unique_ptr<BenchmarkConnection>(new TcpConnection(bench_case_, message_count_, &state_));
+		}
+	}
+
+	BenchmarkCase bench_case_;
+	int port_;
+	int message_count_;
+	RunState state_;
+	std::vector<std::unique_ptr<BenchmarkConnection>> connections_;
+};
+
+std::vector<BenchmarkCase> BuildCases()
+{
+	std::vector<BenchmarkCase> cases;
+	const Transport transports[] = { kTransportTcpTinyNet, kTransportTcpUV, kTransportReliableUdp,
+		kTransportUdpTinyNet, kTransportUdpUV };
+	const int connection_counts[] = { 1, 8 };
+	const int windows[] = { 1, 32 };
+	for (Transport transport : transports)
+	{
+		bool udp = IsUdpTransport(transport);
+		//UDP报文超过MTU会在IP层分片，只测不分片的大小
+		std::vector<size_t> message_sizes = udp ? std::vector<size_t>{ 64, 1024 }
+			: std::vector<size_t>{ 64, 1024, 16 * 1024 };
+		for (int connections : connection_counts)
+		{
+			for (size_t message_size : message_sizes)
+			{
+				for (int window : windows)
+				{
+					for (int option = 0; option <= 1; option++)
+					{
+						//发送队列只对TCP的两种后端与可靠UDP有意义，批量接收只有tinyNET UDP支持
+						if (option && transport == kTransportUdpUV)
+							continue;
+						BenchmarkCase bench_case;
+						bench_case.transport = transport;
+						bench_case.connections = connections;
+						bench_case.message_size = message_size;
+						bench_case.window = window;
+						bench_case.send_queue = !udp && option;
+						bench_case.batch_receive = transport == kTransportUdpTinyNet && option;
+						cases.push_back(bench_case);
+					}
+				}
+			}
+		}
+	}
+	return cases;
+}
+
+const char* TransportName(Transport transport)
+{
+	switch (transport)
+	{
+	case kTransportTcpTinyNet: return "tcp_tinynet";
+	case kTransportTcpUV: return "tcp_uv";
+	case kTransportReliableUdp: return "reliable_udp";
+	case kTransportUdpTinyNet: return "udp_tinynet";
+	case kTransportUdpUV: return "udp_uv";
+	default: return "unknown";
+	}
+}
+}
+
+int main(int argc, char* argv[])
+{
+	NS_EXTENSION::AtExitManager at_exit = NS_EXTENSION::AtExitManagerAdeptor::GetAtExitManager();
+#ifdef _WIN32
+	WSADATA wsa_data;
+	WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+	net::NetStartup();
+	int message_count = argc > 1 ? std::max(1, atoi(argv[1])) : 20000;
+	TcpEchoServer tcp_server;
+	UdpEchoServer udp_server;
+	ReliableUdpEchoServer reliable_udp_server;
+	if (!tcp_server.Start() || !udp_server.Start() || !reliable_udp_server.Start())
+	{
+		std::cerr << "start loopback server failed" << std::endl;
+		return 1;
+	}
+	auto cases = BuildCases();
+	for (const auto& bench_case : cases)
+	{
+		int port = bench_case.transport == kTransportReliableUdp ? reliable_udp_server.port()
+			: IsUdpTransport(bench_case.transport) ? udp_server.port() : tcp_server.port();
+		BenchmarkResult result;
+		{
+			BenchmarkRun run(bench_case, port, message_count);
+			result = run.Run();
+		}
+		double rate = result.seconds > 0 ? result.messages / result.seconds : 0;
+		benchmark::JsonLine()
+			.Add("transport", TransportName(bench_case.transport))
+			.Add("connections", bench_case.connections)
+			.Add("message_size", bench_case.message_size)
+			.Add("window", bench_case.window)
+			.Add("send_queue", bench_case.send_queue)
+			.Add("batch_receive", bench_case.batch_receive)
+			.Add("connected", result.connected)
+			.Add("messages", result.messages)
+			.Add("lost", result.lost)
+			.Add("seconds", result.seconds)
+			.Add("messages_per_second", rate)
+			.Add("mb_per_second", rate * bench_case.message_size / (1024 * 1024))
+			.AddLatencies(result.latencies)
+			.Add("cpu_us_per_message", result.cpu_us_per_message)
+			.Print();
+	}
+	net::NetCleanup();
+	return 0;
+}
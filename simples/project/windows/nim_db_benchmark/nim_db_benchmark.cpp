@@ -0,0 +1,517 @@
+﻿// nim_db_benchmark.cpp : 按消息库的访问模式测试nim_db的性能
+// 用法：nim_db_benchmark [消息条数] [并发场景的运行毫秒数] [数据库目录]
+// 每种数据库（plain为明文，encrypted为加密，加密只在Windows的wxsqlite3编解码器上生效）依次测试：
+// 批量插入（BulkInsert）、逐条自动提交插入、经SQLiteBatchWriter分组提交的插入、
+// 分页拉取历史消息（开启与关闭语句缓存）、单个会话的未读数与全部会话的未读汇总、
+// 一个写线程加多个读线程的并发读写（SQLiteConnectionPool与多线程共用一个连接对比）、
+// 在线备份、删除部分消息后的VACUUM与增量VACUUM
+// 每个场景的结果包括每秒操作数和单次操作的延迟百分位
+#include <string>
+#include <vector>
+#include <tuple>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include "nim_db/db_sqlite3.h"
+#include "nim_db/db_backup.h"
+#include "nim_db/db_batch_writer.h"
+#include "nim_db/db_connection_pool.h"
+#include "simples/benchmark/benchmark.h"
+
+USING_NS_DB
+
+namespace {
+using benchmark::NowNs;
+using benchmark::Latencies;
+
+const int kSessionCount = 200;
+const int kPageSize = 20;
+const int kBulkInsertChunk = 500;
+const int kAutoCommitInserts = 1000;
+const int kBatchWriterInserts = 10000;
+const int kQueries = 5000;
+const size_t kReaderThreads = 3;
+
+const char* kCreateTableSql =
+	"CREATE TABLE IF NOT EXISTS msg(id INTEGER PRIMARY KEY, session_id TEXT, sender TEXT, time INTEGER, "
+	"type INTEGER, status INTEGER, body TEXT);"
+	"CREATE INDEX IF NOT EXISTS msg_session_time ON msg(session_id, time);"
+	"CREATE INDEX IF NOT EXISTS msg_session_status ON msg(session_id, status);";
+const char* kInsertSql = "INSERT INTO msg(session_id, sender, time, type, status, body) VALUES(?, ?, ?, ?, ?, ?)";
+const char* kHistorySql =
+	"SELECT id, sender, time, type, status, body FROM msg WHERE session_id = ? AND time < ? ORDER BY time DESC LIMIT ?";
+const char* kUnreadCountSql = "SELECT COUNT(*) FROM msg WHERE session_id = ? AND status = 0";
+const char* kUnreadSummarySql = "SELECT session_id, COUNT(*) FROM msg WHERE status = 0 GROUP BY session_id";
+
+typedef std::tuple<std::string, std::string, int64_t, int, int, std::string> MessageRow;
+
+//线性同余，保证每次运行生成同样的数据
+class Random
+{
+public:
+	explicit Random(uint32_t seed) : state_(seed) {}
+	uint32_t Next(uint32_t range)
+	{
+		state_ = state_ * 1103515245 + 12345;
+		return (state_ >> 8) % range;
+	}
+
+private:
+	uint32_t state_;
+};
+
+std::string SessionId(int index)
+{
+	return "session_" + std::to_string(index);
+}
+
+//消息时间从1毫秒开始每条递增1毫秒，约10%为未读
+MessageRow MakeMessage(Random& random, int64_t time)
+{
+	int session = (int)random.Next(kSessionCount);
+	std::string body(20 + random.Next(180), 'a' + (char)random.Next(26));
+	return MessageRow(SessionId(session), "user_" + std::to_string(random.Next(1000)), time,
+		(int)random.Next(4), random.Next(10) == 0 ? 0 : 1, body);
+}
+
+int BindMessage(SQLiteStatement& statement, const MessageRow& row)
+{
+	int r = SQLITE_OK;
+	int index = 1;
+	std::apply([&](const auto&... values) {
+		((r = (r == SQLITE_OK ? SQLiteBind(statement, index++, values) : r)), ...);
+	}, row);
+	return r;
+}
+
+int InsertMessage(SQLiteDB* db, const MessageRow& row)
+{
+	SQLiteStatement statement;
+	int r = db->Query(statement, kInsertSql);
+	if (r == SQLITE_OK)
+		r = BindMessage(statement, row);
+	return r == SQLITE_OK ? statement.NextRow() : r;
+}
+
+//读出一页消息，返回读到的行数
+int QueryHistory(SQLiteDB* db, const std::string& session_id, int64_t before_time)
+{
+	SQLiteStatement statement;
+	if (db->Query(statement, kHistorySql) != SQLITE_OK)
+		return -1;
+	statement.BindText(1, session_id.data(), session_id.size());
+	statement.BindInt64(2, before_time);
+	statement.BindInt(3, kPageSize);
+	int rows = 0;
+	SQLiteRowRange range = db->Rows(statement);
+	for (SQLiteRow row : range)
+	{
+		//与界面展示一样读出每一列
+		auto columns = row.Columns<int64_t, std::string_view, int64_t, int, int, std::string_view>();
+		if (std::get<0>(columns) > 0)
+			rows++;
+	}
+	return range.GetResult() == SQLITE_DONE ? rows : -1;
+}
+
+//|latencies|为单次操作（批量插入时为一批）的耗时，|extra|为附加的字段
+void Report(const std::string& db, const std::string& name, uint64_t ops, double seconds, Latencies& latencies,
+	const benchmark::JsonLine& extra = benchmark::JsonLine())
+{
+	benchmark::JsonLine()
+		.Add("db", db).Add("case", name)
+		.Add("ops", ops)
+		.Add("ops_per_s", seconds > 0 ? ops / seconds : 0)
+		.AddLatencies(latencies, { 50, 90, 99, 100 })
+		.Append(extra)
+		.Print();
+}
+
+void ReportError(const std::string& db, const std::string& name, int code, const char* message)
+{
+	benchmark::JsonLine().Add("db", db).Add("case", name).Add("error", code).Add("message", message).Print();
+}
+
+void RemoveDatabase(const std::string& path)
+{
+	remove(path.c_str());
+	remove((path + "-wal").c_str());
+	remove((path + "-shm").c_str());
+	remove((path + "-journal").c_str());
+}
+
+int64_t QueryInt64(SQLiteDB& db, const char* sql)
+{
+	SQLiteStatement statement;
+	if (db.Query(statement, sql) != SQLITE_OK || statement.NextRow() != SQLITE_ROW)
+		return 0;
+	return statement.GetInt64Field(0);
+}
+
+class MessageStoreBenchmark
+{
+public:
+	MessageStoreBenchmark(const std::string& name, const std::string& path, const std::string& key,
+		int64_t messages, int64_t mixed_ms)
+		: name_(name), path_(path), key_(key), messages_(messages), mixed_ms_(mixed_ms), next_time_(1) {}
+
+	void Run()
+	{
+		RemoveDatabase(path_);
+		RemoveDatabase(path_ + ".bak");
+		if (!db_.Open(path_.c_str(), key_, SQLiteOpenOptions::FastCache()) || db_.Query(kCreateTableSql) != SQLITE_OK)
+		{
+			ReportError(name_, "open", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+			return;
+		}
+		BulkInsert();
+		AutoCommitInsert();
+		BatchWriterInsert();
+		HistoryPage(true);
+		HistoryPage(false);
+		UnreadCount();
+		db_.Close();
+		MixedPool();
+		MixedShared();
+		if (!db_.Open(path_.c_str(), key_, SQLiteOpenOptions::FastCache()))
+		{
+			ReportError(name_, "reopen", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+			return;
+		}
+		Backup();
+		Vacuum();
+		db_.Close();
+		RemoveDatabase(path_);
+		RemoveDatabase(path_ + ".bak");
+	}
+
+private:
+	//离线同步、漫游这类一次写入大量消息的场景
+	void BulkInsert()
+	{
+		Random random(1);
+		std::vector<MessageRow> rows;
+		rows.reserve(kBulkInsertChunk);
+		Latencies latencies;
+		int64_t inserted = 0;
+		int64_t begin = NowNs();
+		while (inserted < messages_)
+		{
+			rows.clear();
+			for (int i = 0; i < kBulkInsertChunk && inserted + i < messages_; i++)
+				rows.push_back(MakeMessage(random, next_time_++));
+			int64_t chunk_begin = NowNs();
+			int r = db_.BulkInsert("msg", { "session_id", "sender", "time", "type", "status", "body" }, rows);
+			if (r != SQLITE_OK)
+			{
+				ReportError(name_, "bulk_insert", r, db_.GetLastErrorMessage());
+				return;
+			}
+			latencies.AddSince(chunk_begin);
+			inserted += rows.size();
+		}
+		Report(name_, "bulk_insert", inserted, (NowNs() - begin) / 1e9, latencies,
+			benchmark::JsonLine().Add("rows_per_op", kBulkInsertChunk));
+	}
+
+	//在线时逐条收到消息、每条一个事务
+	void AutoCommitInsert()
+	{
+		Random random(2);
+		Latencies latencies;
+		int64_t begin = NowNs();
+		for (int i = 0; i < kAutoCommitInserts; i++)
+		{
+			MessageRow row = MakeMessage(random, next_time_++);
+			int64_t insert_begin = NowNs();
+			int r = InsertMessage(&db_, row);
+			if (r != SQLITE_DONE)
+			{
+				ReportError(name_, "insert_autocommit", r, db_.GetLastErrorMessage());
+				return;
+			}
+			latencies.AddSince(insert_begin);
+		}
+		Report(name_, "insert_autocommit", kAutoCommitInserts, (NowNs() - begin) / 1e9, latencies);
+	}
+
+	//同样逐条投递，由SQLiteBatchWriter分组提交；延迟为投递到提交完成回调
+	void BatchWriterInsert()
+	{
+		Random random(3);
+		std::vector<MessageRow> rows;
+		rows.reserve(kBatchWriterInserts);
+		for (int i = 0; i < kBatchWriterInserts; i++)
+			rows.push_back(MakeMessage(random, next_time_++));
+		Latencies latencies;
+		std::atomic<int> failed(0);
+		SQLiteBatchWriter writer(&db_);
+		if (!writer.Start())
+		{
+			ReportError(name_, "insert_batch_writer", SQLITE_ERROR, "start failed");
+			return;
+		}
+		int64_t begin = NowNs();
+		for (const MessageRow& row : rows)
+		{
+			int64_t post_time = NowNs();
+			//回调都在写线程上执行，Flush返回后才在本线程读取latencies
+			writer.Post([&row](SQLiteDB* db) { return InsertMessage(db, row); },
+				[&latencies, &failed, post_time](int result) {
+				if (result != SQLITE_OK)
+					failed++;
+				latencies.AddSince(post_time);
+			});
+		}
+		writer.Flush();
+		double seconds = (NowNs() - begin) / 1e9;
+		writer.Stop();
+		Report(name_, "insert_batch_writer", kBatchWriterInserts, seconds, latencies,
+			benchmark::JsonLine().Add("failed", failed.load()));
+	}
+
+	//打开会话后向前翻页，|cached|为false时每次重新准备语句
+	void HistoryPage(bool cached)
+	{
+		if (!cached)
+			db_.SetStatementCacheSize(0);
+		Random random(4);
+		Latencies latencies;
+		int64_t rows = 0;
+		int64_t begin = NowNs();
+		for (int i = 0; i < kQueries; i++)
+		{
+			std::string session_id = SessionId((int)random.Next(kSessionCount));
+			int64_t before_time = 1 + random.Next((uint32_t)next_time_);
+			int64_t query_begin = NowNs();
+			int count = QueryHistory(&db_, session_id, before_time);
+			if (count < 0)
+			{
+				ReportError(name_, "history_page", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+				break;
+			}
+			latencies.AddSince(query_begin);
+			rows += count;
+		}
+		Report(name_, cached ? "history_page_cached" : "history_page_uncached", kQueries,
+			(NowNs() - begin) / 1e9, latencies, benchmark::JsonLine().Add("rows_per_op", (double)rows / kQueries));
+		db_.SetStatementCacheSize(SQLiteDB::kDefaultStatementCacheSize);
+	}
+
+	//会话列表上的单个会话未读数，以及启动时全部会话的未读汇总
+	void UnreadCount()
+	{
+		Random random(5);
+		Latencies latencies;
+		int64_t begin = NowNs();
+		for (int i = 0; i < kQueries; i++)
+		{
+			std::string session_id = SessionId((int)random.Next(kSessionCount));
+			int64_t query_begin = NowNs();
+			SQLiteStatement statement;
+			db_.Query(statement, kUnreadCountSql);
+			statement.BindText(1, session_id.data(), session_id.size());
+			if (statement.NextRow() != SQLITE_ROW)
+			{
+				ReportError(name_, "unread_count", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+				return;
+			}
+			latencies.AddSince(query_begin);
+		}
+		Report(name_, "unread_count", kQueries, (NowNs() - begin) / 1e9, latencies);
+
+		const int kSummaries = 20;
+		Latencies summary_latencies;
+		begin = NowNs();
+		for (int i = 0; i < kSummaries; i++)
+		{
+			int64_t query_begin = NowNs();
+			SQLiteStatement statement;
+			db_.Query(statement, kUnreadSummarySql);
+			int64_t total = 0;
+			for (SQLiteRow row : db_.Rows(statement))
+				total += row.GetInt64(1);
+			summary_latencies.AddSince(query_begin);
+		}
+		Report(name_, "unread_summary", kSummaries, (NowNs() - begin) / 1e9, summary_latencies);
+	}
+
+	//一个线程不停地逐条写入，kReaderThreads个线程不停地翻页，运行mixed_ms_毫秒
+	void RunMixed(const std::string& case_name, const std::function<SQLiteDB*(SQLiteConnection&)>& acquire_writer,
+		const std::function<SQLiteDB*(SQLiteConnection&)>& acquire_reader)
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<int> errors(0);
+		Latencies write_latencies;
+		std::vector<Latencies> read_latencies(kReaderThreads);
+		int64_t time_base = next_time_;
+		int64_t begin = NowNs();
+		std::thread writer([&]() {
+			Random random(6);
+			int64_t time = time_base;
+			while (!stop)
+			{
+				MessageRow row = MakeMessage(random, time++);
+				int64_t insert_begin = NowNs();
+				SQLiteConnection connection;
+				SQLiteDB* db = acquire_writer(connection);
+				if (db == nullptr || InsertMessage(db, row) != SQLITE_DONE)
+					errors++;
+				else
+					write_latencies.AddSince(insert_begin);
+			}
+		});
+		std::vector<std::thread> readers;
+		for (size_t i = 0; i < kReaderThreads; i++)
+		{
+			readers.emplace_back([&, i]() {
+				Random random(7 + (uint32_t)i);
+				while (!stop)
+				{
+					std::string session_id = SessionId((int)random.Next(kSessionCount));
+					int64_t before_time = 1 + random.Next((uint32_t)time_base);
+					int64_t query_begin = NowNs();
+					SQLiteConnection connection;
+					SQLiteDB* db = acquire_reader(connection);
+					if (db == nullptr || QueryHistory(db, session_id, before_time) < 0)
+						errors++;
+					else
+						read_latencies[i].AddSince(query_begin);
+				}
+			});
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(mixed_ms_));
+		stop = true;
+		writer.join();
+		for (std::thread& reader : readers)
+			reader.join();
+		double seconds = (NowNs() - begin) / 1e9;
+		next_time_ = time_base + (int64_t)write_latencies.size() + errors + 1;
+
+		Latencies all_reads;
+		for (const Latencies& latencies : read_latencies)
+			all_reads.Append(latencies);
+		benchmark::JsonLine extra;
+		extra.Add("readers", kReaderThreads).Add("errors", errors.load());
+		Report(name_, case_name + "_write", write_latencies.size(), seconds, write_latencies, extra);
+		Report(name_, case_name + "_read", all_reads.size(), seconds, all_reads, extra);
+	}
+
+	//WAL模式下一个写连接加多个只读连接，读写互不阻塞
+	void MixedPool()
+	{
+		SQLiteConnectionPool pool;
+		if (!pool.Open(path_.c_str(), key_, kReaderThreads))
+		{
+			ReportError(name_, "mixed_pool", SQLITE_CANTOPEN, "open pool failed");
+			return;
+		}
+		RunMixed("mixed_pool",
+			[&pool](SQLiteConnection& connection) { return pool.AcquireWriter(connection) ? connection.Get() : nullptr; },
+			[&pool](SQLiteConnection& connection) { return pool.AcquireReader(connection) ? connection.Get() : nullptr; });
+		pool.Close();
+	}
+
+	//对照：所有线程共用一个modeSerialized连接，同样是WAL，读写在连接的互斥锁上排队
+	void MixedShared()
+	{
+		SQLiteDB shared;
+		if (!shared.Open(path_.c_str(), key_, SQLiteOpenOptions::FastCache()))
+		{
+			ReportError(name_, "mixed_shared", shared.GetLastErrorCode(), shared.GetLastErrorMessage());
+			return;
+		}
+		shared.SetBusyTimeout(5000);
+		SQLiteDB* db = &shared;
+		RunMixed("mixed_shared",
+			[db](SQLiteConnection&) { return db; },
+			[db](SQLiteConnection&) { return db; });
+		shared.Close();
+	}
+
+	//退出或升级前的在线备份
+	void Backup()
+	{
+		std::string backup_path = path_ + ".bak";
+		int64_t page_size = QueryInt64(db_, "PRAGMA page_size");
+		Latencies latencies;
+		int64_t begin = NowNs();
+		SQLiteBackup backup;
+		int r = backup.Begin(&db_, backup_path.c_str(), key_) ? backup.Run(256, 0) : SQLITE_CANTOPEN;
+		int pages = backup.GetTotalPages();
+		backup.Finish();
+		if (r != SQLITE_DONE)
+		{
+			ReportError(name_, "backup", r, "backup failed");
+			return;
+		}
+		latencies.AddSince(begin);
+		double seconds = (NowNs() - begin) / 1e9;
+		benchmark::JsonLine extra;
+		extra.Add("pages", pages).Add("mb_per_s", seconds > 0 ? pages * page_size / (1024.0 * 1024.0) / seconds : 0);
+		Report(name_, "backup", 1, seconds, latencies, extra);
+	}
+
+	//删除 time 早于 |before_time| 的消息，即清理历史消息
+	void DeleteBefore(int64_t before_time)
+	{
+		std::string sql = "DELETE FROM msg WHERE time < " + std::to_string(before_time);
+		db_.Query(sql.c_str());
+	}
+
+	//清理最早的一半消息后整库VACUUM，再切换为增量VACUUM并清理接下来的四分之一
+	void Vacuum()
+	{
+		DeleteBefore(next_time_ / 2);
+		int free_pages = db_.GetFreePageCount();
+		Latencies latencies;
+		int64_t begin = NowNs();
+		bool compacted = db_.Compact();
+		latencies.AddSince(begin);
+		double seconds = (NowNs() - begin) / 1e9;
+		if (!compacted)
+		{
+			ReportError(name_, "vacuum_full", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+			return;
+		}
+		Report(name_, "vacuum_full", 1, seconds, latencies, benchmark::JsonLine().Add("free_pages", free_pages));
+
+		if (!db_.EnableIncrementalVacuum(true))
+		{
+			ReportError(name_, "vacuum_incremental", db_.GetLastErrorCode(), db_.GetLastErrorMessage());
+			return;
+		}
+		DeleteBefore(next_time_ * 3 / 4);
+		free_pages = db_.GetFreePageCount();
+		Latencies incremental_latencies;
+		begin = NowNs();
+		db_.IncrementalVacuum(0);
+		incremental_latencies.AddSince(begin);
+		benchmark::JsonLine extra;
+		extra.Add("free_pages", free_pages).Add("free_pages_after", db_.GetFreePageCount());
+		Report(name_, "vacuum_incremental", 1, (NowNs() - begin) / 1e9, incremental_latencies, extra);
+	}
+
+	std::string name_;
+	std::string path_;
+	std::string key_;
+	int64_t messages_;
+	int64_t mixed_ms_;
+	int64_t next_time_;
+	SQLiteDB db_;
+};
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t messages = argc > 1 ? atoll(argv[1]) : 100000;
+	int64_t mixed_ms = argc > 2 ? atoll(argv[2]) : 2000;
+	std::string dir = argc > 3 ? argv[3] : ".";
+	MessageStoreBenchmark(std::string("plain"), dir + "/nim_db_benchmark_plain.db", std::string(), messages, mixed_ms).Run();
+	MessageStoreBenchmark(std::string("encrypted"), dir + "/nim_db_benchmark_encrypted.db", std::string("nim_db_benchmark"), messages, mixed_ms).Run();
+	return 0;
+}
@@ -0,0 +1,257 @@
+﻿// nim_encrypt_benchmark.cpp : nim_encrypt各加密方法、RSA与SM2在不同消息大小下的性能测试
+// 用法：nim_encrypt_benchmark [每个场景的最少运行毫秒数]
+// reused模式复用同一个方法对象与输出缓冲，fresh模式每次操作都新建对象并设置密钥
+// 分配次数分为C++的operator new与OpenSSL的CRYPTO_malloc两部分
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <cstdlib>
+#include <openssl/crypto.h>
+#include "nim_encrypt/wrapper/nim_encrypt.h"
+#include "simples/benchmark/benchmark.h"
+
+namespace {
+std::atomic<uint64_t> g_crypto_alloc_count(0);
+
+void* CountedCryptoMalloc(size_t size, const char* file, int line)
+{
+	g_crypto_alloc_count++;
+	return malloc(size);
+}
+void* CountedCryptoRealloc(void* ptr, size_t size, const char* file, int line)
+{
+	g_crypto_alloc_count++;
+	return realloc(ptr, size);
+}
+void CountedCryptoFree(void* ptr, const char* file, int line)
+{
+	free(ptr);
+}
+
+const size_t kMessageSizes[] = { 16, 256, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+//批量接口测试的消息条数与最大消息
+const size_t kBatchSize = 64;
+const size_t kMaxBatchMessageSize = 4 * 1024;
+//RSA与SM2只测短消息，它们用于密钥交换
+const size_t kAsymmetricMessageSizes[] = { 16, 256 };
+//测试用密钥，与nim_encrypt_test一致
+const std::string kRSAKeyMode = "B61F71009A9033DEA4E1C6494FF39876981BD9B05B21EF036C55492F9F0005512C97AD2924EE08193665B2B1C86BEF232F06DA17BCD487923DF9CEF4AE28796A08F26CF4E86FE28E2352E32A92D86DFA3638D06DA6F2E65CE640E9752BE3C8FF79F8C34D5437D709AAAE6A2EE76A42FC491271C468BCF46A38A35276735D91C9";
+const std::string kRSAKeyExp = "10001";
+const std::string kRSAPrivateKey = "2A163FFDFCBA00529E55D285D4A51D81A28B25165D290D5C0427FD5EB4E6C353CBF34D3FE9D9DC233F6FE708B0A148C51FB3FCA869A9CF9E9B15E49EA4B493C1EA7370C7E868EC7279424BB449964EBACEF7C10A63E2CDB97775C11683E519858F56E47947BCBD16DB985820E3A97A7FDE970CA0D76E51F3DA3766A9208C6325";
+const std::string kSM2KeyX = "f1a239fdb8b48aac71cc1f85b452fd148bd08afda770a75297fb54199d35a4f1";
+const std::string kSM2KeyY = "8522005a55d448a527e346d4cd3b674f0456692a90650d859c6ad4b34d74c6c0";
+const std::string kSM2PrivateKey = "0415193562d0b94025ad22315a3981af36571ebdd27fb59b6d65e7e8e2e80fdf";
+
+const char* MethodName(NS_NIMENCRYPT::EncryptMethod method)
+{
+	using NS_NIMENCRYPT::EncryptMethod;
+	switch (method)
+	{
+	case EncryptMethod::ENC_ARC4: return "ARC4";
+	case EncryptMethod::ENC_RC2: return "RC2";
+	case EncryptMethod::ENC_CAST: return "CAST";
+	case EncryptMethod::ENC_AES128: return "AES128";
+	case EncryptMethod::ENC_AES192: return "AES192";
+	case EncryptMethod::ENC_AES256: return "AES256";
+	case EncryptMethod::ENC_DES64: return "DES64";
+	case EncryptMethod::ENC_AES128_CBC: return "AES128_CBC";
+	case EncryptMethod::ENC_AES256_CBC: return "AES256_CBC";
+	case EncryptMethod::ENC_SM4_ECB: return "SM4_ECB";
+	case EncryptMethod::ENC_MD4: return "MD4";
+	case EncryptMethod::ENC_MD5: return "MD5";
+	case EncryptMethod::ENC_SHA1: return "SHA1";
+	case EncryptMethod::ENC_SM3: return "SM3";
+	case EncryptMethod::ENC_AES128_GCM: return "AES128_GCM";
+	case EncryptMethod::ENC_AES256_GCM: return "AES256_GCM";
+	case EncryptMethod::ENC_CHACHA20_POLY1305: return "CHACHA20_POLY1305";
+	case EncryptMethod::ENC_SHA256: return "SHA256";
+	case EncryptMethod::ENC_XXH64: return "XXH64";
+	default: return "UNKNOWN";
+	}
+}
+
+//|operation|返回false时该场景记为失败
+benchmark::RunResult Run(const std::function<bool()>& operation, int64_t min_ms)
+{
+	return benchmark::Run(operation, min_ms, { { "crypto_alloc", []() { return g_crypto_alloc_count.load(); } } });
+}
+
+void Report(const std::string& name, const char* operation, const char* mode, size_t size, const benchmark::RunResult& result)
+{
+	benchmark::JsonLine line;
+	line.Add("case", name).Add("op", operation).Add("mode", mode).Add("size", size);
+	if (result.failed || result.ops == 0)
+		line.Add("failed", true);
+	else
+		line.AddRun(result).Add("mb_per_s", result.ops_per_s() * size / (1024.0 * 1024.0));
+	line.Print();
+}
+
+void SetupMethod(const NS_NIMENCRYPT::SymmetricEncryptMethod& method)
+{
+	method->SetKey(std::string(32, 'k'));
+	method->SetIvParameterSpec(std::string(16, 'i'));
+}
+
+bool IsHash(NS_NIMENCRYPT::EncryptMethod method)
+{
+	using NS_NIMENCRYPT::EncryptMethod;
+	return method == EncryptMethod::ENC_MD4 || method == EncryptMethod::ENC_MD5 || method == EncryptMethod::ENC_SHA1
+		|| method == EncryptMethod::ENC_SM3 || method == EncryptMethod::ENC_SHA256 || method == EncryptMethod::ENC_XXH64;
+}
+
+void BenchmarkSymmetric(NS_NIMENCRYPT::EncryptMethod type, int64_t min_ms)
+{
+	auto method = NS_NIMENCRYPT::NIMEncrypt::CreateMethod(type);
+	if (method == nullptr)
+		return;
+	SetupMethod(method);
+	for (auto size : kMessageSizes)
+	{
+		std::string plain(size, 'p');
+		std::vector<char> encrypted(method->MaxEncryptedSize(size));
+		size_t encrypted_size = encrypted.size();
+		//reused模式：同一对象，写到调用方缓冲，无输出分配
+		Report(MethodName(type), "encrypt", "reused", size, Run([&]() {
+			encrypted_size = encrypted.size();
+			return method->Encrypt(plain.data(), plain.size(), encrypted.data(), encrypted_size);
+		}, min_ms));
+		//fresh模式：每次新建对象，输出到新的字符串
+		Report(MethodName(type), "encrypt", "fresh", size, Run([&]() {
+			auto fresh = NS_NIMENCRYPT::NIMEncrypt::CreateMethod(type);
+			SetupMethod(fresh);
+			std::string output;
+			return fresh->Encrypt(plain, output);
+		}, min_ms));
+		//batch模式：小消息每次64条写到同一块输出，按条计
+		std::vector<NS_NIMENCRYPT::CryptoBuffer> batch(kBatchSize, NS_NIMENCRYPT::CryptoBuffer{ plain.data(), plain.size() });
+		std::string arena;
+		std::vector<size_t> offsets;
+		if (size <= kMaxBatchMessageSize)
+		{
+			benchmark::RunResult batch_result = Run([&]() {
+				return method->EncryptBatch(batch.data(), batch.size(), arena, offsets);
+			}, min_ms);
+			batch_result.ops *= batch.size();
+			Report(MethodName(type), "encrypt", "batch", size, batch_result);
+		}
+		if (IsHash(type))
+			continue;
+		if (!method->Encrypt(plain.data(), plain.size(), encrypted.data(), encrypted_size))
+			continue;
+		std::vector<char> decrypted(method->MaxDecryptedSize(encrypted_size) + 1);
+		Report(MethodName(type), "decrypt", "reused", size, Run([&]() {
+			size_t decrypted_size = decrypted.size();
+			return method->Decrypt(encrypted.data(), encrypted_size, decrypted.data(), decrypted_size);
+		}, min_ms));
+		if (size <= kMaxBatchMessageSize)
+		{
+			std::vector<NS_NIMENCRYPT::CryptoBuffer> encrypted_batch(kBatchSize, NS_NIMENCRYPT::CryptoBuffer{ encrypted.data(), encrypted_size });
+			benchmark::RunResult batch_result = Run([&]() {
+				return method->DecryptBatch(encrypted_batch.data(), encrypted_batch.size(), arena, offsets);
+			}, min_ms);
+			batch_result.ops *= encrypted_batch.size();
+			Report(MethodName(type), "decrypt", "batch", size, batch_result);
+		}
+		std::string ciphertext(encrypted.data(), encrypted_size);
+		Report(MethodName(type), "decrypt", "fresh", size, Run([&]() {
+			auto fresh = NS_NIMENCRYPT::NIMEncrypt::CreateMethod(type);
+			SetupMethod(fresh);
+			std::string output;
+			return fresh->Decrypt(ciphertext, output);
+		}, min_ms));
+	}
+}
+
+void BenchmarkRSA(int64_t min_ms)
+{
+	auto setup = [](const NS_NIMENCRYPT::RSAEncryptMethod& rsa) {
+		rsa->SetPublicKey(kRSAKeyMode, kRSAKeyExp);
+		rsa->SetPirvateKey(kRSAPrivateKey);
+	};
+	auto rsa = NS_NIMENCRYPT::NIMEncrypt::CreateRSAMethod();
+	setup(rsa);
+	for (auto size : kAsymmetricMessageSizes)
+	{
+		std::string plain(size, 'p'), encrypted;
+		Report("RSA", "encrypt", "reused", size, Run([&]() {
+			return rsa->PublicKeyEncrypt(plain, encrypted);
+		}, min_ms));
+		Report("RSA", "encrypt", "fresh", size, Run([&]() {
+			auto fresh = NS_NIMENCRYPT::NIMEncrypt::CreateRSAMethod();
+			setup(fresh);
+			std::string output;
+			return fresh->PublicKeyEncrypt(plain, output);
+		}, min_ms));
+		if (!rsa->PublicKeyEncrypt(plain, encrypted))
+			continue;
+		std::string decrypted;
+		Report("RSA", "decrypt", "reused", size, Run([&]() {
+			return rsa->PrivateKeyDecrypt(encrypted, decrypted);
+		}, min_ms));
+		Report("RSA", "decrypt", "fresh", size, Run([&]() {
+			auto fresh = NS_NIMENCRYPT::NIMEncrypt::CreateRSAMethod();
+			setup(fresh);
+			std::string output;
+			return fresh->PrivateKeyDecrypt(encrypted, output);
+		}, min_ms));
+	}
+}
+
+void BenchmarkSM2(int64_t min_ms)
+{
+	auto setup = [](const NS_NIMENCRYPT::SM2EncryptMethod& sm2) {
+		sm2->SetPublicKey(kSM2KeyX, kSM2KeyY);
+		sm2->SetPirvateKey(kSM2PrivateKey);
+	};
+	auto sm2 = NS_NIMENCRYPT::NIMEncrypt::CreateSM2Method();
+	setup(sm2);
+	for (auto size : kAsymmetricMessageSizes)
+	{
+		std::string plain(size, 'p');
+		Report("SM2", "encrypt", "reused", size, Run([&]() {
+			std::string output;
+			return sm2->PublicKeyEncrypt(plain, output);
+		}, min_ms));
+		Report("SM2", "encrypt", "fresh", size, Run([&]() {
+			auto fresh = NS_NIMENCRYPT::NIMEncrypt::CreateSM2Method();
+			setup(fresh);
+			std::string output;
+			return fresh->PublicKeyEncrypt(plain, output);
+		}, min_ms));
+		//批量接口，每次8条，按条计
+		std::vector<std::string> batch(8, plain), batch_output;
+		benchmark::RunResult batch_result = Run([&]() {
+			return sm2->PublicKeyEncrypt(batch, batch_output);
+		}, min_ms);
+		batch_result.ops *= batch.size();
+		Report("SM2", "encrypt", "batch", size, batch_result);
+		std::string encrypted;
+		if (!sm2->PublicKeyEncrypt(plain, encrypted))
+			continue;
+		Report("SM2", "decrypt", "reused", size, Run([&]() {
+			std::string output;
+			return sm2->PrivateKeyDecrypt(encrypted, output);
+		}, min_ms));
+	}
+}
+}
+
+BENCHMARK_COUNT_OPERATOR_NEW()
+
+int main(int argc, char* argv[])
+{
+	//必须在OpenSSL的第一次分配之前设置
+	bool crypto_counted = CRYPTO_set_mem_functions(CountedCryptoMalloc, CountedCryptoRealloc, CountedCryptoFree) != 0;
+	if (!crypto_counted)
+		std::cerr << "CRYPTO_set_mem_functions failed, crypto_alloc_per_op is 0" << std::endl;
+	int64_t min_ms = argc > 1 ? atoll(argv[1]) : 200;
+	using NS_NIMENCRYPT::EncryptMethod;
+	for (int type = (int)EncryptMethod::ENC_BEGIN + 1; type < (int)EncryptMethod::ENC_END; type++)
+		BenchmarkSymmetric((EncryptMethod)type, min_ms);
+	BenchmarkRSA(min_ms);
+	BenchmarkSM2(min_ms);
+	return 0;
+}
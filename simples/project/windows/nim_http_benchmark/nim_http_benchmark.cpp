@@ -0,0 +1,346 @@
+﻿// nim_http_benchmark.cpp : nim_http在并发、包大小、长连接与HTTP版本不同组合下的压力测试
+// 用法：nim_http_benchmark [每个场景的请求数] [服务器URL]
+// 不指定服务器时在本进程内启动一个回环服务器，此时CPU统计包含服务器线程
+// 外部服务器需支持 /bench?size=N 返回N字节的响应体，并按请求头处理Connection
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+typedef SOCKET SocketHandle;
+#define CloseSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET (-1)
+#define CloseSocket close
+#endif
+#include "extension/at_exit_manager.h"
+#include "nim_http/wrapper/nim_http.h"
+#include "simples/benchmark/benchmark.h"
+#include "simples/benchmark/process_usage.h"
+
+namespace {
+struct BenchmarkCase
+{
+	std::string name;
+	int concurrency;
+	size_t request_size;
+	size_t response_size;
+	bool keep_alive;
+	NS_HTTP::HTTP_PROTOCOL_VERSION http_version;
+};
+struct BenchmarkResult
+{
+	double seconds;
+	int requests;
+	int failures;
+	benchmark::Latencies latencies;
+	double cpu_us_per_request;
+	uint64_t peak_memory;
+};
+
+//最简单的HTTP/1.x服务器，每个连接一个线程，只监听127.0.0.1
+class LoopbackServer
+{
+public:
+	LoopbackServer() : listen_socket_(INVALID_SOCKET), port_(0) {}
+	bool Start()
+	{
+		listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket_ == INVALID_SOCKET)
+			return false;
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0;
+		socklen_t length = sizeof(address);
+		if (bind(listen_socket_, (sockaddr*)&address, sizeof(address)) != 0
+			|| listen(listen_socket_, SOMAXCONN) != 0
+			|| getsockname(listen_socket_, (sockaddr*)&address, &length) != 0)
+			return false;
+		port_ = ntohs(address.sin_port);
+		std::thread([this]() { AcceptLoop(); }).detach();
+		return true;
+	}
+	std::string URL() const { return "http://127.0.0.1:" + std::to_string(port_) + "/bench"; }
+
+private:
+	void AcceptLoop()
+	{
+		while (true)
+		{
+			SocketHandle client = accept(listen_socket_, NULL, NULL);
+			if (client == INVALID_SOCKET)
+				return;
+			std::thread([client]() { ServeConnection(client); }).detach();
+		}
+	}
+	static void ServeConnection(SocketHandle client)
+	{
+		std::string buffer;
+		std::string body;
+		char chunk[16 * 1024];
+		while (true)
+		{
+			size_t head_end;
+			while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos)
+			{
+				int received = recv(client, chunk, sizeof(chunk), 0);
+				if (received <= 0)
+				{
+					CloseSocket(client);
+					return;
+				}
+				buffer.append(chunk, received);
+			}
+			std::string head = buffer.substr(0, head_end);
+			buffer.erase(0, head_end + 4);
+			for (auto& c : head)
+				c = (char)tolower((unsigned char)c);
+			bool http_1_0 = head.find("http/1.0\r\n") != std::string::npos;
+			bool keep_alive = http_1_0 ? head.find("connection: keep-alive") != std::string::npos
+				: head.find("connection: close") == std::string::npos;
+			size_t content_length = 0;
+			size_t pos = head.find("content-length:");
+			if (pos != std::string::npos)
+				content_length = (size_t)atoll(head.c_str() + pos + strlen("content-length:"));
+			size_t response_size = 0;
+			pos = head.find("size=");
+			if (pos != std::string::npos)
+				response_size = (size_t)atoll(head.c_str() + pos + strlen("size="));
+			//丢弃请求体
+			while (buffer.size() < content_length)
+			{
+				int received = recv(client, chunk, sizeof(chunk), 0);
+				if (received <= 0)
+				{
+					CloseSocket(client);
+					return;
+				}
+				buffer.append(chunk, received);
+			}
+			buffer.erase(0, content_length);
+
+			std::ostringstream response;
+			response << (http_1_0 ? "HTTP/1.0" : "HTTP/1.1") << " 200 OK\r\n"
+				<< "Content-Type: application/octet-stream\r\n"
+				<< "Content-Length: " << response_size << "\r\n"
+				<< "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n\r\n";
+			if (body.size() != response_size)
+				body.assign(response_size, 'x');
+			std::string data = response.str() + body;
+			size_t sent = 0;
+			while (sent < data.size())
+			{
+				int count = send(client, data.data() + sent, (int)(data.size() - sent), 0);
+				if (count <= 0)
+					break;
+				sent += count;
+			}
+			if (!keep_alive || sent < data.size())
+			{
+				CloseSocket(client);
+				return;
+			}
+		}
+	}
+
+	SocketHandle listen_socket_;
+	int port_;
+};
+
+//保持|concurrency|个请求在途，一个请求完成后在传输线程上发出下一个
+class BenchmarkRun
+{
+public:
+	BenchmarkRun(const BenchmarkCase& bench_case, const std::string& url, int request_count) :
+		bench_case_(bench_case), url_(url + "?size=" + std::to_string(bench_case.response_size)),
+		request_count_(request_count), request_body_(bench_case.request_size, 'x'),
+		latencies_(request_count), issued_(0), failures_(0), completed_(0)
+	{
+		manager_ = NS_HTTP::NIMHttp::CreateHttpManager();
+		manager_->SetConcurrency(NS_HTTP::HttpConcurrency(bench_case.concurrency * 2, bench_case.concurrency,
+			(size_t)bench_case.concurrency));
+	}
+	BenchmarkResult Run()
+	{
+		int64_t cpu_begin = benchmark::ProcessCpuMicroseconds();
+		int64_t begin = benchmark::NowNs();
+		for (int i = 0; i < bench_case_.concurrency; i++)
+			IssueNext();
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			done_.wait(lock, [this]() { return completed_ >= request_count_; });
+		}
+		int64_t end = benchmark::NowNs();
+		int64_t cpu_end = benchmark::ProcessCpuMicroseconds();
+
+		BenchmarkResult result;
+		result.seconds = (end - begin) / 1e9;
+		result.requests = request_count_;
+		result.failures = failures_;
+		result.latencies.Append(latencies_);
+		result.cpu_us_per_request = request_count_ > 0 ? (double)(cpu_end - cpu_begin) / request_count_ : 0;
+		result.peak_memory = benchmark::PeakMemoryBytes();
+		return result;
+	}
+
+private:
+	void IssueNext()
+	{
+		int index = issued_++;
+		if (index >= request_count_)
+			return;
+		int64_t begin = benchmark::NowNs();
+		auto response_cb = [this, index, begin](const std::shared_ptr<std::string>& text, bool ret, int code) {
+			latencies_[index] = benchmark::NowNs() - begin;
+			if (!ret || code != 200 || text == nullptr || text->size() != bench_case_.response_size)
+				failures_++;
+			IssueNext();
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (++completed_ >= request_count_)
+				done_.notify_one();
+		};
+		NS_HTTP::HttpRequest request = request_body_.empty() ?
+			NS_HTTP::NIMHttp::CreateRequest(url_, response_cb) :
+			NS_HTTP::NIMHttp::CreateRequest(url_, request_body_.data(), request_body_.size(), response_cb);
+		if (!bench_case_.keep_alive)
+			request->AddHeaderField("Connection", "close");
+		request->SetHttpVersion(bench_case_.http_version);
+		request->SetTimeout(30 * 1000);
+		manager_->PostRequest(request);
+	}
+
+	BenchmarkCase bench_case_;
+	std::string url_;
+	int request_count_;
+	std::string request_body_;
+	NS_HTTP::HttpManager manager_;
+	//按发出顺序存放，单位纳秒，每个元素只被对应请求的回调写入
+	std::vector<int64_t> latencies_;
+	std::atomic<int> issued_;
+	std::atomic<int> failures_;
+	std::mutex mutex_;
+	std::condition_variable done_;
+	int completed_;
+};
+
+std::vector<BenchmarkCase> BuildCases()
+{
+	std::vector<BenchmarkCase> cases;
+	const int concurrencies[] = { 1, 8, 64 };
+	const size_t response_sizes[] = { 256, 16 * 1024, 1024 * 1024 };
+	for (int keep_alive = 1; keep_alive >= 0; keep_alive--)
+	{
+		for (int concurrency : concurrencies)
+		{
+			for (size_t response_size : response_sizes)
+			{
+				BenchmarkCase bench_case;
+				bench_case.name = keep_alive ? "get_keep_alive" : "get_close";
+				bench_case.concurrency = concurrency;
+				bench_case.request_size = 0;
+				bench_case.response_size = response_size;
+				bench_case.keep_alive = keep_alive != 0;
+				bench_case.http_version = NS_HTTP::HTTP_PROTOCOL_1_1;
+				cases.push_back(bench_case);
+			}
+		}
+	}
+	//上传与HTTP/1.0短连接
+	BenchmarkCase post_case;
+	post_case.name = "post_keep_alive";
+	post_case.concurrency = 8;
+	post_case.request_size = 64 * 1024;
+	post_case.response_size = 256;
+	post_case.keep_alive = true;
+	post_case.http_version = NS_HTTP::HTTP_PROTOCOL_1_1;
+	cases.push_back(post_case);
+	BenchmarkCase http_1_0_case;
+	http_1_0_case.name = "get_http_1_0";
+	http_1_0_case.concurrency = 8;
+	http_1_0_case.request_size = 0;
+	http_1_0_case.response_size = 16 * 1024;
+	http_1_0_case.keep_alive = false;
+	http_1_0_case.http_version = NS_HTTP::HTTP_PROTOCOL_1_0;
+	cases.push_back(http_1_0_case);
+	return cases;
+}
+
+const char* HttpVersionName(NS_HTTP::HTTP_PROTOCOL_VERSION version)
+{
+	switch (version)
+	{
+	case NS_HTTP::HTTP_PROTOCOL_1_0: return "1.0";
+	case NS_HTTP::HTTP_PROTOCOL_1_1: return "1.1";
+	case NS_HTTP::HTTP_PROTOCOL_2: return "2";
+	default: return "default";
+	}
+}
+}
+
+int main(int argc, char* argv[])
+{
+	NS_EXTENSION::AtExitManager at_exit = NS_EXTENSION::AtExitManagerAdeptor::GetAtExitManager();
+#ifdef _WIN32
+	WSADATA wsa_data;
+	WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+	int request_count = argc > 1 ? std::max(1, atoi(argv[1])) : 2000;
+	std::string url;
+	LoopbackServer server;
+	if (argc > 2)
+	{
+		url = argv[2];
+	}
+	else
+	{
+		if (!server.Start())
+		{
+			std::cerr << "start loopback server failed" << std::endl;
+			return 1;
+		}
+		url = server.URL();
+	}
+	auto cases = BuildCases();
+	for (const auto& bench_case : cases)
+	{
+		BenchmarkResult result;
+		{
+			BenchmarkRun run(bench_case, url, request_count);
+			result = run.Run();
+		}
+		benchmark::JsonLine()
+			.Add("case", bench_case.name)
+			.Add("concurrency", bench_case.concurrency)
+			.Add("request_size", bench_case.request_size)
+			.Add("response_size", bench_case.response_size)
+			.Add("keep_alive", bench_case.keep_alive)
+			.Add("http_version", HttpVersionName(bench_case.http_version))
+			.Add("requests", result.requests)
+			.Add("failures", result.failures)
+			.Add("seconds", result.seconds)
+			.Add("requests_per_second", result.seconds > 0 ? result.requests / result.seconds : 0)
+			.AddLatencies(result.latencies)
+			.Add("cpu_us_per_request", result.cpu_us_per_request)
+			.Add("peak_memory", result.peak_memory)
+			.Print();
+	}
+	return 0;
+}
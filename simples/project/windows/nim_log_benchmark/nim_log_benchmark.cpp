@@ -0,0 +1,128 @@
+﻿// nim_log_benchmark.cpp : nim_log吞吐量与单次调用延迟的基准测试
+// 用法：nim_log_benchmark [输出目录] [每个线程写入的条数]
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include "nim_log/wrapper/log.h"
+#include "simples/benchmark/benchmark.h"
+
+USING_NS_NIMLOG
+
+namespace {
+struct BenchmarkCase
+{
+	std::string name;
+	int thread_count;
+	size_t message_size;
+	bool async;
+	LogFileConfig file_config;
+};
+struct BenchmarkResult
+{
+	double seconds;
+	uint64_t messages;
+	benchmark::Latencies latencies;
+};
+
+BenchmarkResult RunCase(const BenchmarkCase& bench_case, const std::string& output_dir, int messages_per_thread, int index)
+{
+	Logger logger = NIMLog::CreateLogger();
+	std::string log_path = output_dir + "/nim_log_benchmark_" + std::to_string(index) + ".log";
+	logger->SetLogFile(log_path, bench_case.file_config);
+	logger->SetLogLevel(LV_PRO);
+	if (bench_case.async)
+	{
+		LogAsyncConfig async_config;
+		async_config.enable_ = true;
+		logger->SetAsyncMode(async_config);
+	}
+	std::string payload(bench_case.message_size, 'x');
+	std::vector<benchmark::Latencies> latencies(bench_case.thread_count);
+	std::vector<std::thread> threads;
+	int64_t begin = benchmark::NowNs();
+	for (int thread_index = 0; thread_index < bench_case.thread_count; thread_index++)
+	{
+		threads.emplace_back([&, thread_index]() {
+			auto& samples = latencies[thread_index];
+			samples.Reserve(messages_per_thread);
+			for (int i = 0; i < messages_per_thread; i++)
+			{
+				int64_t call_begin = benchmark::NowNs();
+				__NIM_LOG_APP("benchmark thread:{0} seq:{1} payload:{2}", logger) << thread_index << i << payload;
+				samples.AddSince(call_begin);
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	//异步模式下计入写线程把队列写完的时间
+	logger->Flush();
+	int64_t end = benchmark::NowNs();
+	logger->Release();
+
+	BenchmarkResult result;
+	for (auto& samples : latencies)
+		result.latencies.Append(samples);
+	result.seconds = (end - begin) / 1e9;
+	result.messages = result.latencies.size();
+	return result;
+}
+
+std::vector<BenchmarkCase> BuildCases()
+{
+	std::vector<BenchmarkCase> cases;
+	const int thread_counts[] = { 1, 4, 16 };
+	const size_t message_sizes[] = { 16, 256, 4096 };
+	for (int async = 0; async <= 1; async++)
+	{
+		for (int thread_count : thread_counts)
+		{
+			for (size_t message_size : message_sizes)
+			{
+				BenchmarkCase bench_case;
+				bench_case.name = async ? "async" : "sync";
+				bench_case.thread_count = thread_count;
+				bench_case.message_size = message_size;
+				bench_case.async = async != 0;
+				cases.push_back(bench_case);
+			}
+		}
+		//小的mmap缓冲区和文件上限，使测试过程中不断发生溢出写文件和日志文件滚动
+		BenchmarkCase overflow_case;
+		overflow_case.name = async ? "async_overflow" : "sync_overflow";
+		overflow_case.thread_count = 4;
+		overflow_case.message_size = 256;
+		overflow_case.async = async != 0;
+		overflow_case.file_config.mmap_length_ = 8 * 1024;
+		overflow_case.file_config.max_file_length_ = 1024 * 1024;
+		cases.push_back(overflow_case);
+	}
+	return cases;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string output_dir = argc > 1 ? argv[1] : ".";
+	int messages_per_thread = argc > 2 ? std::max(1, atoi(argv[2])) : 20000;
+	auto cases = BuildCases();
+	for (size_t index = 0; index < cases.size(); index++)
+	{
+		const BenchmarkCase& bench_case = cases[index];
+		BenchmarkResult result = RunCase(bench_case, output_dir, messages_per_thread, (int)index);
+		benchmark::JsonLine()
+			.Add("case", bench_case.name)
+			.Add("threads", bench_case.thread_count)
+			.Add("message_size", bench_case.message_size)
+			.Add("mmap_length", bench_case.file_config.mmap_length_)
+			.Add("max_file_length", bench_case.file_config.max_file_length_)
+			.Add("messages", result.messages)
+			.Add("seconds", result.seconds)
+			.Add("messages_per_second", result.seconds > 0 ? result.messages / result.seconds : 0)
+			.AddLatencies(result.latencies)
+			.Print();
+	}
+	return 0;
+}
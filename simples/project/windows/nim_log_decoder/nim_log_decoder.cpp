@@ -0,0 +1,75 @@
+﻿// nim_log_decoder.cpp : 把加密(encrypt_key_)、压缩(enable_compress_)或二进制格式(LFF_BINARY)的nim_log日志还原成文本
+// 用法：nim_log_decoder [-k 密钥] [-o 输出文件] 日志文件...
+// 分段日志请按从旧到新的顺序传入（log.n ... log.0 log），前面文件中的字典对后面的文件同样有效
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include "nim_log/log/log_binary_format.h"
+#include "nim_log/log/log_block_compressor.h"
+#include "nim_log/log/log_block_encryptor.h"
+#include "extension/file_util/utf8_file_util.h"
+
+int main(int argc, char* argv[])
+{
+	std::string output_path;
+	std::string key;
+	std::vector<std::string> input_paths;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		if (arg == "-o" && i + 1 < argc)
+			output_path = argv[++i];
+		else if (arg == "-k" && i + 1 < argc)
+			key = argv[++i];
+		else
+			input_paths.push_back(arg);
+	}
+	if (input_paths.empty())
+	{
+		std::cerr << "usage: nim_log_decoder [-k key] [-o output] log_file..." << std::endl;
+		return 1;
+	}
+	NS_NIMLOG::LogBinaryDecoder decoder;
+	std::unique_ptr<NS_NIMLOG::LogBlockEncryptor> encryptor;
+	if (!key.empty())
+		encryptor = std::make_unique<NS_NIMLOG::LogBlockEncryptor>(key);
+	std::string text;
+	int count = 0;
+	for (auto& path : input_paths)
+	{
+		std::string data;
+		if (!NS_EXTENSION::ReadFileToString(path, data))
+		{
+			std::cerr << "read " << path << " failed" << std::endl;
+			continue;
+		}
+		//先解密再解压，写入时是先压缩再加密的
+		if (encryptor != nullptr)
+		{
+			std::string decrypted;
+			if (encryptor->Decrypt(data.data(), data.length(), decrypted) == 0)
+				std::cerr << "no block of " << path << " is decrypted, check the key" << std::endl;
+			data.swap(decrypted);
+		}
+		std::string file_text;
+		NS_NIMLOG::LogBlockCompressor::Decompress(data.data(), data.length(), file_text);
+		//没有二进制记录时说明是文本格式的日志，解压后直接输出
+		int file_count = decoder.Decode(file_text.data(), file_text.length(), text);
+		if (file_count == 0)
+			text.append(file_text);
+		count += file_count;
+	}
+	if (output_path.empty())
+	{
+		std::cout << text;
+	}
+	else
+	{
+		std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+		output.write(text.data(), text.length());
+	}
+	std::cerr << "decoded " << count << " records, skipped " << decoder.GetSkippedBytes() << " bytes" << std::endl;
+	return 0;
+}
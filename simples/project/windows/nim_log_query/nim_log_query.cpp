@@ -0,0 +1,145 @@
+﻿// nim_log_query.cpp : 在文本格式的nim_log日志中按时间、级别、进程-线程和关键字查找，通过旁路索引(.nim_idx)只读取可能命中的块
+// 用法：nim_log_query [-from 时间] [-to 时间] [-level 级别] [-thread pid-tid|tid] [-grep 关键字] [-rebuild] [-stat] [-o 输出文件] 日志文件...
+// 时间为"MM-DD HH:MM[:SS]"或"HH:MM[:SS]"（不限日期），级别为0~6或LV_KER~LV_PRO，如"-level LV_ERR"查错误及更严重的日志
+// 索引不存在或过期时自动建立，日志文件只追加时只索引新增的部分；压缩、加密或二进制格式的日志先用nim_log_decoder还原成文本
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "nim_log/log/log_index.h"
+
+namespace {
+const char* const kLEVEL_TEXT_LIST[] = {
+	"LV_KER", "LV_ASS", "LV_ERR", "LV_WAR", "LV_INT", "LV_APP", "LV_PRO"
+};
+
+bool ParseLevel(const std::string& text, NS_NIMLOG::LOG_LEVEL& level)
+{
+	for (int i = NS_NIMLOG::LV_KER; i <= NS_NIMLOG::LV_PRO; i++)
+	{
+		if (text == kLEVEL_TEXT_LIST[i] || text == std::to_string(i))
+		{
+			level = (NS_NIMLOG::LOG_LEVEL)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//"pid-tid"或只有"tid"
+bool ParseThread(const std::string& text, uint32_t& pid, uint32_t& tid)
+{
+	size_t pos = text.find('-');
+	if (pos != std::string::npos)
+		pid = (uint32_t)strtoul(text.substr(0, pos).c_str(), nullptr, 10);
+	tid = (uint32_t)strtoul(text.substr(pos == std::string::npos ? 0 : pos + 1).c_str(), nullptr, 10);
+	return pid != 0 || tid != 0;
+}
+
+void PrintStat(const std::string& path, const NS_NIMLOG::LogIndex& index)
+{
+	auto& blocks = index.GetBlocks();
+	uint64_t records = 0;
+	int64_t begin_time = -1, end_time = -1;
+	for (auto& block : blocks)
+	{
+		records += block.record_count_;
+		if (block.begin_time_ >= 0 && (begin_time < 0 || block.begin_time_ < begin_time))
+			begin_time = block.begin_time_;
+		if (block.end_time_ > end_time)
+			end_time = block.end_time_;
+	}
+	std::cerr << path << ": " << index.GetIndexedLength() << " bytes, " << blocks.size() << " blocks, " << records << " records, "
+		<< NS_NIMLOG::LogIndex::FormatTime(begin_time) << " ~ " << NS_NIMLOG::LogIndex::FormatTime(end_time) << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	NS_NIMLOG::LogQuery query;
+	std::string output_path;
+	bool rebuild = false;
+	bool stat = false;
+	std::vector<std::string> input_paths;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		bool has_value = i + 1 < argc;
+		if ((arg == "-from" || arg == "-to") && has_value)
+		{
+			int64_t time = 0;
+			bool time_of_day = false;
+			if (!NS_NIMLOG::LogIndex::ParseTime(argv[++i], time, time_of_day, arg == "-to"))
+			{
+				std::cerr << "bad time: " << argv[i] << std::endl;
+				return 1;
+			}
+			(arg == "-from" ? query.begin_time_ : query.end_time_) = time;
+			//两端有一个只给了时间，就都按一天中的时间比较
+			query.time_of_day_ = query.time_of_day_ || time_of_day;
+		}
+		else if (arg == "-level" && has_value)
+		{
+			if (!ParseLevel(argv[++i], query.max_level_))
+			{
+				std::cerr << "bad level: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "-thread" && has_value)
+		{
+			if (!ParseThread(argv[++i], query.pid_, query.tid_))
+			{
+				std::cerr << "bad thread: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "-grep" && has_value)
+			query.keyword_ = argv[++i];
+		else if (arg == "-o" && has_value)
+			output_path = argv[++i];
+		else if (arg == "-rebuild")
+			rebuild = true;
+		else if (arg == "-stat")
+			stat = true;
+		else
+			input_paths.push_back(arg);
+	}
+	if (input_paths.empty())
+	{
+		std::cerr << "usage: nim_log_query [-from time] [-to time] [-level level] [-thread pid-tid|tid] [-grep keyword] [-rebuild] [-stat] [-o output] log_file..." << std::endl;
+		return 1;
+	}
+	std::ofstream output_file;
+	if (!output_path.empty())
+		output_file.open(output_path, std::ios::binary | std::ios::trunc);
+	std::ostream& output = output_path.empty() ? std::cout : output_file;
+	int count = 0;
+	size_t scanned_blocks = 0;
+	size_t total_blocks = 0;
+	for (auto& path : input_paths)
+	{
+		NS_NIMLOG::LogIndex index;
+		if (!(rebuild ? index.Rebuild(path) : index.Build(path)))
+		{
+			std::cerr << "index " << path << " failed" << std::endl;
+			continue;
+		}
+		if (stat)
+		{
+			PrintStat(path, index);
+			continue;
+		}
+		size_t file_scanned = 0;
+		count += index.Query(query, [&output](const char* record, size_t length) {
+			output.write(record, length);
+			return true;
+		}, &file_scanned);
+		scanned_blocks += file_scanned;
+		total_blocks += index.GetBlocks().size();
+	}
+	if (!stat)
+		std::cerr << "matched " << count << " records, scanned " << scanned_blocks << " of " << total_blocks << " blocks" << std::endl;
+	return 0;
+}